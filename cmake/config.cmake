@@ -75,6 +75,11 @@ set(P4EST_ENABLE_BUILD_P6EST ${enable_p6est} CACHE BOOL "p6est support" FORCE)
 
 set(P4EST_ENABLE_FILE_DEPRECATED ${enable-file-deprecated})
 
+if(openmp)
+  find_package(OpenMP REQUIRED COMPONENTS C)
+  set(P4EST_ENABLE_OPENMP 1)
+endif()
+
 set(P4EST_ENABLE_MEMALIGN 1)
 
 if(P4EST_ENABLE_MPI)
@@ -105,6 +110,8 @@ set(P4EST_HAVE_STDLIB_H ${SC_HAVE_STDLIB_H} CACHE BOOL "platform has stdlib.h")
 
 check_include_file(strings.h P4EST_HAVE_STRINGS_H)
 set(P4EST_HAVE_STRING_H ${SC_HAVE_STRING_H} CACHE BOOL "platform has string.h")
+check_include_file(sys/mman.h P4EST_HAVE_SYS_MMAN_H)
+check_include_file(linux/perf_event.h P4EST_HAVE_LINUX_PERF_EVENT_H)
 set(P4EST_HAVE_SYS_STAT_H ${SC_HAVE_SYS_STAT_H} CACHE BOOL "platform has sys/stat.h")
 set(P4EST_HAVE_SYS_TYPES_H ${SC_HAVE_SYS_TYPES_H} CACHE BOOL "platform has sys/types.h")
 
@@ -125,6 +132,14 @@ if(P4EST_HAVE_ZLIB)
   endif()
 endif()
 
+if(hdf5)
+  find_package(HDF5 REQUIRED COMPONENTS C)
+  if(NOT HDF5_IS_PARALLEL)
+    message(FATAL_ERROR "p4est HDF5 backend requires parallel HDF5")
+  endif()
+  set(P4EST_WITH_HDF5 1)
+endif()
+
 if(CMAKE_BUILD_TYPE MATCHES "Debug")
   set(P4EST_ENABLE_DEBUG 1)
 endif()
@@ -5,6 +5,10 @@ option(P4EST_BUILD_TESTING "build p4est testing" on)
 
 option(enable-file-deprecated "use deprecated data file format" off)
 
+option(hdf5 "enable parallel HDF5 backend of data files" off)
+
+option(openmp "use OpenMP threads in refine and coarsen" off)
+
 option(vtk_binary "VTK binary interface" on)
 if(vtk_binary)
   set(P4EST_ENABLE_VTK_BINARY 1)
@@ -0,0 +1,42 @@
+
+dnl P4EST_CHECK_HDF5(PREFIX)
+dnl Check for the parallel HDF5 library and link a test program
+dnl
+AC_DEFUN([P4EST_CHECK_HDF5], [
+
+AC_MSG_CHECKING([for parallel HDF5])
+
+SC_ARG_WITH_PREFIX([hdf5], [enable HDF5 backend of data files], [HDF5], [$1])
+if test "x$$1_WITH_HDF5" != xno ; then
+  $1_HDF5_INC=
+  $1_HDF5_LD=
+  $1_HDF5_LIB="-lhdf5"
+  if test "x$$1_WITH_HDF5" != xyes ; then
+    $1_HDF5_INC="-I$$1_WITH_HDF5/include"
+    $1_HDF5_LD="-L$$1_WITH_HDF5/lib"
+  fi
+  PRE_HDF5_CPPFLAGS="$CPPFLAGS"
+  CPPFLAGS="$CPPFLAGS $$1_HDF5_INC"
+  PRE_HDF5_LDFLAGS="$LDFLAGS"
+  LDFLAGS="$LDFLAGS $$1_HDF5_LD"
+  PRE_HDF5_LIBS="$LIBS"
+  LIBS="$$1_HDF5_LIB $LIBS"
+
+  AC_LINK_IFELSE([AC_LANG_PROGRAM([[#include <hdf5.h>]],
+[[
+ hid_t fapl = H5Pcreate (H5P_FILE_ACCESS);
+
+ H5Pset_fapl_mpio (fapl, MPI_COMM_WORLD, MPI_INFO_NULL);
+ H5Pclose (fapl);
+]])],,
+                 [AC_MSG_ERROR([unable to link parallel HDF5])])
+dnl Keep the variables changed as done above
+dnl CPPFLAGS="$PRE_HDF5_CPPFLAGS"
+dnl LDFLAGS="$PRE_HDF5_LDFLAGS"
+dnl LIBS="$PRE_HDF5_LIBS"
+
+  AC_MSG_RESULT([successful])
+else
+  AC_MSG_RESULT([not used])
+fi
+])
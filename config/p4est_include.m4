@@ -49,6 +49,7 @@ AC_DEFUN([P4EST_CHECK_LIBRARIES],
 [
 P4EST_CHECK_METIS([$1])
 P4EST_CHECK_PETSC([$1])
+P4EST_CHECK_HDF5([$1])
 ])
 
 dnl P4EST_AS_SUBPACKAGE(PREFIX)
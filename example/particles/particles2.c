@@ -1763,23 +1763,6 @@ waitmpi (part_global_t * g)
   g->psmem = NULL;
 }
 
-static int
-part_weight (p4est_t * p4est,
-             p4est_topidx_t which_tree, p4est_quadrant_t * quadrant)
-{
-  p4est_locidx_t      ilem_particles;
-  part_global_t      *g = (part_global_t *) p4est->user_pointer;
-  qu_data_t          *qud = (qu_data_t *) quadrant->p.user_data;
-
-  ilem_particles = qud->u.lpend - g->prevlp;
-  g->prevlp = qud->u.lpend;
-
-  *(int *) sc_array_index (g->src_fixed, g->qcount++) =
-    (int) (ilem_particles * sizeof (pa_data_t));
-
-  return 1 + ilem_particles;
-}
-
 static void
 part (part_global_t * g)
 {
@@ -1793,6 +1776,7 @@ part (part_global_t * g)
   p4est_locidx_t      lquad, lq;
   p4est_locidx_t      lpnum;
   p4est_gloidx_t      gshipped;
+  int                *counts;
   p4est_gloidx_t     *src_gfq;
   p4est_tree_t       *tree;
   p4est_quadrant_t   *quad;
@@ -1814,13 +1798,27 @@ part (part_global_t * g)
                 src_gfq[g->mpirank + 1] - src_gfq[g->mpirank]);
   g->src_fixed = sc_array_new_count (sizeof (int), src_quads);
 
-  /* count particles per quadrant in callback */
-  g->qcount = 0;
-  g->prevlp = 0;
-  gshipped = p4est_partition_ext (g->p4est, 1, part_weight);
-  P4EST_ASSERT (g->qcount == src_quads);
+  /* count particles per quadrant to weigh the partition */
+  counts = P4EST_ALLOC (int, src_quads);
+  lpnum = 0;
+  lquad = 0;
+  for (tt = g->p4est->first_local_tree; tt <= g->p4est->last_local_tree; ++tt) {
+    tree = p4est_tree_array_index (g->p4est->trees, tt);
+    for (lq = 0; lq < (p4est_locidx_t) tree->quadrants.elem_count; ++lq) {
+      quad = p4est_quadrant_array_index (&tree->quadrants, lq);
+      qud = (qu_data_t *) quad->p.user_data;
+      counts[lquad] = (int) (qud->u.lpend - lpnum);
+      *(int *) sc_array_index (g->src_fixed, lquad) =
+        (int) (counts[lquad] * sizeof (pa_data_t));
+      lpnum = qud->u.lpend;
+      ++lquad;
+    }
+  }
+  P4EST_ASSERT (lquad == src_quads);
+  P4EST_ASSERT (lpnum == (p4est_locidx_t) g->padata->elem_count);
+  gshipped = p4est_partition_weights (g->p4est, 1, 1, counts);
+  P4EST_FREE (counts);
   dest_quads = g->p4est->local_num_quadrants;
-  P4EST_ASSERT (g->prevlp == (int) g->padata->elem_count);
 
   /* if nothing happens, we're done */
   if (gshipped == 0) {
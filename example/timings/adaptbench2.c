@@ -0,0 +1,561 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/*
+ * Usage: p4est_adaptbench [options]
+ *        Moves a feature through the domain and adapts the forest to it
+ *        in a number of cycles.  Every cycle coarsens, refines, balances
+ *        and partitions the forest and builds its ghost layer.  For every
+ *        cycle we write the global quadrant count, the number of quadrants
+ *        shipped by partition, the minimum, average and maximum ghost
+ *        layer size and the minimum, average and maximum over all
+ *        processes of the wall time of every phase in JSON or CSV format.
+ *
+ *        The forest uses the finest level within a distance of --width
+ *        from the feature.  The level drops by one whenever the distance
+ *        doubles, down to --min-level, which creates the ripples of graded
+ *        refinement typical of front tracking.  The feature travels the
+ *        distance --speed per cycle.  Distances are relative to the
+ *        bounding box of the connectivity's vertices.
+ *
+ *        possible patterns:
+ *        o front     A plane that sweeps through the domain along x,
+ *                    as in shock tracking.
+ *        o sphere    A spherical shell whose center moves on a circle.
+ *        o hotspots  Randomly placed points that drift in random
+ *                    directions; all processes use the same --seed.
+ *
+ *        possible configurations in 2D:
+ *        o unit      The unit square.
+ *        o periodic  The unit square with periodic b.c.
+ *        o three     A forest with three trees.
+ *        o moebius   A 5-tree Moebius band.
+ *        o star      A 6-tree star shaped domain.
+ *
+ *        possible configurations in 3D:
+ *        o unit      The unit cube.
+ *        o periodic  The unit cube with all-periodic b.c.
+ *        o rotwrap   The unit cube with weird periodic b.c.
+ *        o twocubes  A forest with two trees.
+ *        o rotcubes  A forest with six rotated trees.
+ *        o shell     A 24-tree spherical shell.
+ */
+
+#ifndef P4_TO_P8
+#include <p4est_bits.h>
+#include <p4est_extended.h>
+#include <p4est_ghost.h>
+#else
+#include <p8est_bits.h>
+#include <p8est_extended.h>
+#include <p8est_ghost.h>
+#endif
+#include <sc_options.h>
+#include <sc_statistics.h>
+
+enum
+{
+  ADAPT_COARSEN,
+  ADAPT_REFINE,
+  ADAPT_BALANCE,
+  ADAPT_PARTITION,
+  ADAPT_GHOST,
+  ADAPT_NUM_PHASES
+};
+
+enum
+{
+  ADAPT_FRONT,
+  ADAPT_SPHERE,
+  ADAPT_HOTSPOTS,
+  ADAPT_NUM_PATTERNS
+};
+
+static const char  *adapt_phase_names[ADAPT_NUM_PHASES] = {
+  "coarsen", "refine", "balance", "partition", "ghost"
+};
+
+static const char  *adapt_pattern_names[ADAPT_NUM_PATTERNS] = {
+  "front", "sphere", "hotspots"
+};
+
+/* per cycle: the phase times and the ghost layer size */
+#define ADAPT_GHOSTS ADAPT_NUM_PHASES
+#define ADAPT_NUM_STATS (ADAPT_NUM_PHASES + 1)
+
+typedef struct adapt_bench
+{
+  sc_MPI_Comm         mpicomm;
+  int                 mpisize;
+  int                 mpirank;
+  int                 pattern;
+  int                 min_level;
+  int                 max_level;
+  int                 num_cycles;
+  int                 num_hotspots;
+  double              width;
+  double              speed;
+  double              distance;         /**< travelled by the feature */
+  double              lower[3];         /**< of the vertex bounding box */
+  double              extent;           /**< largest side of the box */
+  double             *hotspots;         /**< position and direction */
+  double              start;
+  p4est_gloidx_t     *global_quadrants;
+  p4est_gloidx_t     *shipped;
+  sc_statinfo_t      *stats;
+}
+adapt_bench_t;
+
+static p4est_connectivity_t *
+adapt_connectivity (const char *name)
+{
+#ifndef P4_TO_P8
+  if (!strcmp (name, "unit")) {
+    return p4est_connectivity_new_unitsquare ();
+  }
+  if (!strcmp (name, "periodic")) {
+    return p4est_connectivity_new_periodic ();
+  }
+  if (!strcmp (name, "three")) {
+    return p4est_connectivity_new_corner ();
+  }
+  if (!strcmp (name, "moebius")) {
+    return p4est_connectivity_new_moebius ();
+  }
+  if (!strcmp (name, "star")) {
+    return p4est_connectivity_new_star ();
+  }
+#else
+  if (!strcmp (name, "unit")) {
+    return p8est_connectivity_new_unitcube ();
+  }
+  if (!strcmp (name, "periodic")) {
+    return p8est_connectivity_new_periodic ();
+  }
+  if (!strcmp (name, "rotwrap")) {
+    return p8est_connectivity_new_rotwrap ();
+  }
+  if (!strcmp (name, "twocubes")) {
+    return p8est_connectivity_new_twocubes ();
+  }
+  if (!strcmp (name, "rotcubes")) {
+    return p8est_connectivity_new_rotcubes ();
+  }
+  if (!strcmp (name, "shell")) {
+    return p8est_connectivity_new_shell ();
+  }
+#endif
+  return NULL;
+}
+
+/* normalize all distances by the bounding box of the vertices */
+static void
+adapt_bounding_box (adapt_bench_t * ab, p4est_connectivity_t * conn)
+{
+  int                 i;
+  p4est_topidx_t      vt;
+  double              upper[3];
+
+  for (i = 0; i < 3; ++i) {
+    ab->lower[i] = upper[i] = conn->vertices[i];
+  }
+  for (vt = 1; vt < conn->num_vertices; ++vt) {
+    for (i = 0; i < 3; ++i) {
+      ab->lower[i] = SC_MIN (ab->lower[i], conn->vertices[3 * vt + i]);
+      upper[i] = SC_MAX (upper[i], conn->vertices[3 * vt + i]);
+    }
+  }
+  ab->extent = 0.;
+  for (i = 0; i < 3; ++i) {
+    ab->extent = SC_MAX (ab->extent, upper[i] - ab->lower[i]);
+  }
+  SC_CHECK_ABORT (ab->extent > 0., "Degenerate vertex bounding box");
+}
+
+/* the same random hotspots on all processes */
+static void
+adapt_hotspots_new (adapt_bench_t * ab, int seed)
+{
+  int                 k, i;
+  double              norm, *spot;
+  sc_rand_state_t     rstate = (sc_rand_state_t) seed;
+
+  ab->hotspots = P4EST_ALLOC (double, 6 * ab->num_hotspots);
+  for (k = 0; k < ab->num_hotspots; ++k) {
+    spot = ab->hotspots + 6 * k;
+    norm = 0.;
+    for (i = 0; i < 3; ++i) {
+      spot[i] = sc_rand (&rstate);
+      spot[3 + i] = i < P4EST_DIM ? 2. * sc_rand (&rstate) - 1. : 0.;
+      norm += spot[3 + i] * spot[3 + i];
+    }
+    norm = sqrt (norm);
+    for (i = 0; i < 3; ++i) {
+      spot[3 + i] = norm > 0. ? spot[3 + i] / norm : (i == 0);
+    }
+  }
+}
+
+/* distance of a normalized point to the feature */
+static double
+adapt_feature_distance (adapt_bench_t * ab, const double xyz[3])
+{
+  int                 k, i;
+  double              d, dist, r, p;
+  double              center[3];
+  const double       *spot;
+
+  switch (ab->pattern) {
+  case ADAPT_FRONT:
+    return fabs (xyz[0] - fmod (ab->distance, 1.));
+  case ADAPT_SPHERE:
+    /* a shell of radius .2 whose center moves on a circle of radius .25 */
+    center[0] = .5 + .25 * cos (ab->distance / .25);
+    center[1] = .5 + .25 * sin (ab->distance / .25);
+    center[2] = .5;
+    r = 0.;
+    for (i = 0; i < P4EST_DIM; ++i) {
+      r += (xyz[i] - center[i]) * (xyz[i] - center[i]);
+    }
+    return fabs (sqrt (r) - .2);
+  case ADAPT_HOTSPOTS:
+    dist = 2.;
+    for (k = 0; k < ab->num_hotspots; ++k) {
+      spot = ab->hotspots + 6 * k;
+      d = 0.;
+      for (i = 0; i < P4EST_DIM; ++i) {
+        p = fmod (spot[i] + ab->distance * spot[3 + i], 1.);
+        p = p < 0. ? p + 1. : p;
+        d += (xyz[i] - p) * (xyz[i] - p);
+      }
+      dist = SC_MIN (dist, sqrt (d));
+    }
+    return dist;
+  default:
+    SC_ABORT_NOT_REACHED ();
+  }
+}
+
+/* level that a quadrant should have according to its closest point */
+static int
+adapt_target_level (p4est_t * p4est, p4est_topidx_t which_tree,
+                    const p4est_quadrant_t * q)
+{
+  adapt_bench_t      *ab = (adapt_bench_t *) p4est->user_pointer;
+  int                 i, level;
+  const p4est_qcoord_t half = P4EST_QUADRANT_LEN (q->level) / 2;
+  p4est_qcoord_t      qcoords[2 * P4EST_DIM];
+  double              xyz[6], *center = xyz, *corner = xyz + 3;
+  double              radius, d;
+
+  /* the center and half diagonal of the quadrant in normalized coordinates */
+  qcoords[0] = q->x + half;
+  qcoords[1] = q->y + half;
+  qcoords[P4EST_DIM + 0] = q->x;
+  qcoords[P4EST_DIM + 1] = q->y;
+#ifdef P4_TO_P8
+  qcoords[2] = q->z + half;
+  qcoords[P4EST_DIM + 2] = q->z;
+#endif
+  p4est_qcoord_to_vertex_batch (p4est->connectivity, which_tree, 2,
+                                qcoords, xyz);
+  radius = 0.;
+  for (i = 0; i < 3; ++i) {
+    center[i] = (center[i] - ab->lower[i]) / ab->extent;
+    corner[i] = (corner[i] - ab->lower[i]) / ab->extent;
+    radius += (center[i] - corner[i]) * (center[i] - corner[i]);
+  }
+  d = adapt_feature_distance (ab, center) - sqrt (radius);
+
+  /* one level less for every doubling of the distance */
+  level = ab->max_level;
+  if (d > ab->width) {
+    level -= 1 + (int) floor (log (d / ab->width) / log (2.));
+  }
+  return SC_MAX (level, ab->min_level);
+}
+
+static int
+refine_feature (p4est_t * p4est, p4est_topidx_t which_tree,
+                p4est_quadrant_t * q)
+{
+  return (int) q->level < adapt_target_level (p4est, which_tree, q);
+}
+
+static int
+coarsen_feature (p4est_t * p4est, p4est_topidx_t which_tree,
+                 p4est_quadrant_t * q[])
+{
+  p4est_quadrant_t    parent;
+
+  p4est_quadrant_parent (q[0], &parent);
+  return (int) parent.level >= adapt_target_level (p4est, which_tree,
+                                                   &parent);
+}
+
+static void
+adapt_begin (adapt_bench_t * ab)
+{
+  int                 mpiret;
+
+  mpiret = sc_MPI_Barrier (ab->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  ab->start = sc_MPI_Wtime ();
+}
+
+static void
+adapt_end (adapt_bench_t * ab, int cycle, int phase)
+{
+  sc_stats_set1 (ab->stats + cycle * ADAPT_NUM_STATS + phase,
+                 sc_MPI_Wtime () - ab->start, adapt_phase_names[phase]);
+}
+
+static void
+adapt_write (adapt_bench_t * ab, FILE * file, int json, const char *label,
+             const char *config_name)
+{
+  int                 c, k;
+  sc_statinfo_t      *st;
+
+  if (json) {
+    fprintf (file, "{\n  \"label\": \"%s\",\n  \"dim\": %d,\n"
+             "  \"configuration\": \"%s\",\n  \"pattern\": \"%s\",\n"
+             "  \"mpisize\": %d,\n  \"min_level\": %d,\n"
+             "  \"max_level\": %d,\n  \"cycles\": [", label, P4EST_DIM,
+             config_name, adapt_pattern_names[ab->pattern], ab->mpisize,
+             ab->min_level, ab->max_level);
+    for (c = 0; c < ab->num_cycles; ++c) {
+      st = ab->stats + c * ADAPT_NUM_STATS;
+      fprintf (file, "%s\n    { \"cycle\": %d, \"quadrants\": %lld,"
+               " \"shipped\": %lld,\n      \"ghosts\": { \"min\": %.6g,"
+               " \"avg\": %.6g, \"max\": %.6g }", c ? "," : "", c,
+               (long long) ab->global_quadrants[c],
+               (long long) ab->shipped[c], st[ADAPT_GHOSTS].min,
+               st[ADAPT_GHOSTS].average, st[ADAPT_GHOSTS].max);
+      for (k = 0; k < ADAPT_NUM_PHASES; ++k) {
+        fprintf (file, ",\n      \"%s\": { \"min\": %.6g, \"avg\": %.6g,"
+                 " \"max\": %.6g }", adapt_phase_names[k],
+                 st[k].min, st[k].average, st[k].max);
+      }
+      fprintf (file, " }");
+    }
+    fprintf (file, "\n  ]\n}\n");
+  }
+  else {
+    fprintf (file, "label,dim,configuration,pattern,mpisize,cycle,"
+             "quadrants,shipped,ghosts_min,ghosts_avg,ghosts_max");
+    for (k = 0; k < ADAPT_NUM_PHASES; ++k) {
+      fprintf (file, ",%s_min,%s_avg,%s_max", adapt_phase_names[k],
+               adapt_phase_names[k], adapt_phase_names[k]);
+    }
+    fprintf (file, "\n");
+    for (c = 0; c < ab->num_cycles; ++c) {
+      st = ab->stats + c * ADAPT_NUM_STATS;
+      fprintf (file, "%s,%d,%s,%s,%d,%d,%lld,%lld,%.6g,%.6g,%.6g", label,
+               P4EST_DIM, config_name, adapt_pattern_names[ab->pattern],
+               ab->mpisize, c, (long long) ab->global_quadrants[c],
+               (long long) ab->shipped[c], st[ADAPT_GHOSTS].min,
+               st[ADAPT_GHOSTS].average, st[ADAPT_GHOSTS].max);
+      for (k = 0; k < ADAPT_NUM_PHASES; ++k) {
+        fprintf (file, ",%.6g,%.6g,%.6g", st[k].min, st[k].average,
+                 st[k].max);
+      }
+      fprintf (file, "\n");
+    }
+  }
+}
+
+int
+main (int argc, char **argv)
+{
+  int                 c;
+  int                 mpiret;
+  int                 first_argc;
+  int                 json;
+  int                 seed;
+  int                 precheck, overlap_merge;
+  const char         *config_name;
+  const char         *pattern_name;
+  const char         *format;
+  const char         *label;
+  const char         *output;
+  FILE               *file;
+  adapt_bench_t       adapt_context, *ab = &adapt_context;
+  sc_statinfo_t      *st;
+  sc_options_t       *opt;
+  p4est_connectivity_t *connectivity;
+  p4est_t            *p4est;
+  p4est_ghost_t      *ghost;
+
+  /* initialize MPI and p4est internals */
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  memset (ab, 0, sizeof (*ab));
+  ab->mpicomm = sc_MPI_COMM_WORLD;
+  mpiret = sc_MPI_Comm_size (ab->mpicomm, &ab->mpisize);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Comm_rank (ab->mpicomm, &ab->mpirank);
+  SC_CHECK_MPI (mpiret);
+
+  sc_init (ab->mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+#ifndef P4EST_ENABLE_DEBUG
+  sc_set_log_defaults (NULL, NULL, SC_LP_ESSENTIAL);
+#endif
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+  /* process command line arguments */
+  opt = sc_options_new (argv[0]);
+#ifndef P4_TO_P8
+  sc_options_add_string (opt, 'c', "configuration", &config_name, "unit",
+                         "configuration: unit|periodic|three|moebius|star");
+#else
+  sc_options_add_string (opt, 'c', "configuration", &config_name, "unit",
+                         "configuration: unit|periodic|rotwrap|twocubes|rotcubes|shell");
+#endif
+  sc_options_add_string (opt, 't', "pattern", &pattern_name, "front",
+                         "moving feature: front|sphere|hotspots");
+  sc_options_add_int (opt, 'm', "min-level", &ab->min_level, 2,
+                      "coarsest refinement level");
+  sc_options_add_int (opt, 'l', "level", &ab->max_level, 7,
+                      "finest refinement level at the feature");
+  sc_options_add_double (opt, 'W', "width", &ab->width, .02,
+                         "distance of finest refinement to the feature");
+  sc_options_add_double (opt, 's', "speed", &ab->speed, .05,
+                         "distance travelled by the feature per cycle");
+  sc_options_add_int (opt, 'n', "cycles", &ab->num_cycles, 10,
+                      "number of adaptation cycles");
+  sc_options_add_int (opt, 'k', "hotspots", &ab->num_hotspots, 8,
+                      "number of hotspots");
+  sc_options_add_int (opt, 'r', "seed", &seed, 1,
+                      "random seed for the hotspots");
+  sc_options_add_switch (opt, 'B', "balance-precheck", &precheck,
+                         "skip balance when a cheap check proves it");
+  sc_options_add_switch (opt, 'M', "overlap-merge", &overlap_merge,
+                         "merge the balance overlap queries per tree");
+  sc_options_add_string (opt, 'f', "format", &format, "json",
+                         "output format: json|csv");
+  sc_options_add_string (opt, 'o', "output", &output, NULL,
+                         "output file, default standard output");
+  sc_options_add_string (opt, 'L', "label", &label, P4EST_PACKAGE_VERSION,
+                         "label of the results, such as a release");
+
+  first_argc = sc_options_parse (p4est_package_id, SC_LP_DEFAULT,
+                                 opt, argc, argv);
+  for (ab->pattern = 0; ab->pattern < ADAPT_NUM_PATTERNS; ++ab->pattern) {
+    if (!strcmp (pattern_name, adapt_pattern_names[ab->pattern])) {
+      break;
+    }
+  }
+  if (first_argc < 0 || first_argc != argc ||
+      (connectivity = adapt_connectivity (config_name)) == NULL ||
+      ab->pattern == ADAPT_NUM_PATTERNS ||
+      (strcmp (format, "json") && strcmp (format, "csv")) ||
+      ab->min_level < 0 || ab->max_level < ab->min_level ||
+      ab->max_level > P4EST_QMAXLEVEL || ab->width <= 0. ||
+      ab->num_cycles <= 0 || ab->num_hotspots <= 0) {
+    sc_options_print_usage (p4est_package_id, SC_LP_ERROR, opt, NULL);
+    sc_abort_collective ("Usage error");
+  }
+  json = !strcmp (format, "json");
+  sc_options_print_summary (p4est_package_id, SC_LP_PRODUCTION, opt);
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Processors %d configuration %s pattern %s levels %d to %d\n",
+     ab->mpisize, config_name, pattern_name, ab->min_level, ab->max_level);
+
+  adapt_bounding_box (ab, connectivity);
+  adapt_hotspots_new (ab, seed);
+  ab->global_quadrants = P4EST_ALLOC (p4est_gloidx_t, ab->num_cycles);
+  ab->shipped = P4EST_ALLOC (p4est_gloidx_t, ab->num_cycles);
+  ab->stats = P4EST_ALLOC_ZERO (sc_statinfo_t,
+                                ab->num_cycles * ADAPT_NUM_STATS);
+
+  /* the forest starts uniform and follows the feature from the first cycle */
+  p4est = p4est_new_ext (ab->mpicomm, connectivity, 0, ab->min_level, 1,
+                         0, NULL, ab);
+  p4est->inspect = P4EST_ALLOC_ZERO (p4est_inspect_t, 1);
+  p4est->inspect->use_balance_precheck = precheck;
+  p4est->inspect->use_overlap_merge = overlap_merge;
+
+  for (c = 0; c < ab->num_cycles; ++c) {
+    ab->distance = c * ab->speed;
+
+    adapt_begin (ab);
+    p4est_coarsen (p4est, 1, coarsen_feature, NULL);
+    adapt_end (ab, c, ADAPT_COARSEN);
+
+    adapt_begin (ab);
+    p4est_refine_ext (p4est, 1, ab->max_level, refine_feature, NULL, NULL);
+    adapt_end (ab, c, ADAPT_REFINE);
+
+    adapt_begin (ab);
+    p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
+    adapt_end (ab, c, ADAPT_BALANCE);
+
+    adapt_begin (ab);
+    ab->shipped[c] = p4est_partition_ext (p4est, 0, NULL);
+    adapt_end (ab, c, ADAPT_PARTITION);
+
+    adapt_begin (ab);
+    ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+    adapt_end (ab, c, ADAPT_GHOST);
+
+    st = ab->stats + c * ADAPT_NUM_STATS;
+    ab->global_quadrants[c] = p4est->global_num_quadrants;
+    sc_stats_set1 (st + ADAPT_GHOSTS, (double) ghost->ghosts.elem_count,
+                   "ghosts");
+    p4est_ghost_destroy (ghost);
+
+    P4EST_GLOBAL_PRODUCTIONF ("Cycle %d quadrants %lld shipped %lld\n", c,
+                              (long long) ab->global_quadrants[c],
+                              (long long) ab->shipped[c]);
+  }
+
+  /* reduce the statistics of all cycles at once */
+  sc_stats_compute (ab->mpicomm, ab->num_cycles * ADAPT_NUM_STATS,
+                    ab->stats);
+  if (ab->mpirank == 0) {
+    file = output == NULL ? stdout : fopen (output, "w");
+    SC_CHECK_ABORT (file != NULL, "Open benchmark output");
+    adapt_write (ab, file, json, label, config_name);
+    if (output != NULL) {
+      SC_CHECK_ABORT (!fclose (file), "Close benchmark output");
+    }
+  }
+
+  /* clean up and exit */
+  P4EST_FREE (ab->stats);
+  P4EST_FREE (ab->shipped);
+  P4EST_FREE (ab->global_quadrants);
+  P4EST_FREE (ab->hotspots);
+  P4EST_FREE (p4est->inspect);
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (connectivity);
+  sc_options_destroy (opt);
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
@@ -0,0 +1,622 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/*
+ * Usage: p4est_bench [options]
+ *        Times the main algorithms of p4est one after another and writes
+ *        the minimum, average and maximum over all processes of every
+ *        phase in JSON or CSV format.  The phases are
+ *        new refine balance partition ghost lnodes mesh iterate
+ *        iterate_edge iterate_corner search expand coarsen save load vtk;
+ *        a subset may be given by --phases.  The iterate phase runs volume
+ *        and face callbacks, iterate_edge (3D only) an edge callback only
+ *        and iterate_corner a corner callback only.
+ *        Refine, balance and partition are always executed since the
+ *        later phases work on their result.
+ *        For every phase we report the wall time, the quadrant count,
+ *        the point-to-point messages and bytes recorded by p4est_inspect,
+ *        the peak of the transient memory and the memory of the forest.
+ *
+ *        With --weak the refinement level is raised by one for every
+ *        2^P4EST_DIM processes, such that the number of quadrants per
+ *        process stays about constant.  See benchsweep.sh for a driver
+ *        that runs a strong or weak scaling sweep over process counts.
+ *
+ *        possible configurations in 2D:
+ *        o unit      Refinement on the unit square.
+ *        o periodic  Refinement on the unit square with periodic b.c.
+ *        o three     Refinement on a forest with three trees.
+ *        o moebius   Refinement on a 5-tree Moebius band.
+ *        o star      Refinement on a 6-tree star shaped domain.
+ *
+ *        possible configurations in 3D:
+ *        o unit      Refinement on the unit cube.
+ *        o periodic  Refinement on the unit cube with all-periodic b.c.
+ *        o rotwrap   Refinement on the unit cube with weird periodic b.c.
+ *        o twocubes  Refinement on a forest with two trees.
+ *        o rotcubes  Refinement on a forest with six rotated trees.
+ *        o shell     Refinement on a 24-tree spherical shell.
+ */
+
+#ifndef P4_TO_P8
+#include <p4est_bits.h>
+#include <p4est_extended.h>
+#include <p4est_ghost.h>
+#include <p4est_iterate.h>
+#include <p4est_lnodes.h>
+#include <p4est_mesh.h>
+#include <p4est_search.h>
+#include <p4est_vtk.h>
+#else
+#include <p8est_bits.h>
+#include <p8est_extended.h>
+#include <p8est_ghost.h>
+#include <p8est_iterate.h>
+#include <p8est_lnodes.h>
+#include <p8est_mesh.h>
+#include <p8est_search.h>
+#include <p8est_vtk.h>
+#endif
+#include <sc_options.h>
+#include <sc_statistics.h>
+
+enum
+{
+  BENCH_NEW,
+  BENCH_REFINE,
+  BENCH_BALANCE,
+  BENCH_PARTITION,
+  BENCH_GHOST,
+  BENCH_LNODES,
+  BENCH_MESH,
+  BENCH_ITERATE,
+#ifdef P4_TO_P8
+  BENCH_ITERATE_EDGE,
+#endif
+  BENCH_ITERATE_CORNER,
+  BENCH_SEARCH,
+  BENCH_EXPAND,
+  BENCH_COARSEN,
+  BENCH_SAVE,
+  BENCH_LOAD,
+  BENCH_VTK,
+  BENCH_NUM_PHASES
+};
+
+enum
+{
+  BENCH_TIME,
+  BENCH_QUADRANTS,
+  BENCH_MESSAGES,
+  BENCH_BYTES,
+  BENCH_MEMORY_PEAK,
+  BENCH_FOREST_MEMORY,
+  BENCH_NUM_QUANTITIES
+};
+
+static const char  *bench_phase_names[BENCH_NUM_PHASES] = {
+  "new", "refine", "balance", "partition", "ghost", "lnodes", "mesh",
+  "iterate",
+#ifdef P4_TO_P8
+  "iterate_edge",
+#endif
+  "iterate_corner", "search", "expand", "coarsen", "save", "load", "vtk"
+};
+
+static const char  *bench_quantity_names[BENCH_NUM_QUANTITIES] = {
+  "time", "quadrants", "messages", "bytes", "memory_peak", "forest_memory"
+};
+
+typedef struct bench
+{
+  sc_MPI_Comm         mpicomm;
+  int                 mpisize;
+  int                 mpirank;
+  int                 level;
+  int                 level_shift;
+  int                 run[BENCH_NUM_PHASES];
+  double              start;
+  sc_statinfo_t       stats[BENCH_NUM_PHASES * BENCH_NUM_QUANTITIES];
+}
+bench_t;
+
+static int
+refine_fractal (p4est_t * p4est, p4est_topidx_t which_tree,
+                p4est_quadrant_t * q)
+{
+  bench_t            *bench = (bench_t *) p4est->user_pointer;
+  int                 qid;
+
+  if ((int) q->level >= bench->level) {
+    return 0;
+  }
+  if ((int) q->level < bench->level - bench->level_shift) {
+    return 1;
+  }
+
+  qid = p4est_quadrant_child_id (q);
+  return (qid == 0 || qid == 3
+#ifdef P4_TO_P8
+          || qid == 5 || qid == 6
+#endif
+    );
+}
+
+static int
+coarsen_finest (p4est_t * p4est, p4est_topidx_t which_tree,
+                p4est_quadrant_t * q[])
+{
+  bench_t            *bench = (bench_t *) p4est->user_pointer;
+
+  return (int) q[0]->level == bench->level;
+}
+
+static int
+search_all (p4est_t * p4est, p4est_topidx_t which_tree,
+            p4est_quadrant_t * quadrant, p4est_locidx_t local_num,
+            void *point)
+{
+  if (local_num >= 0) {
+    ++*(size_t *) p4est->user_pointer;
+  }
+  return 1;
+}
+
+static void
+iter_volume (p4est_iter_volume_info_t * info, void *user_data)
+{
+  ++*(size_t *) user_data;
+}
+
+static void
+iter_face (p4est_iter_face_info_t * info, void *user_data)
+{
+  ++*(size_t *) user_data;
+}
+
+#ifdef P4_TO_P8
+static void
+iter_edge (p8est_iter_edge_info_t * info, void *user_data)
+{
+  ++*(size_t *) user_data;
+}
+#endif
+
+static void
+iter_corner (p4est_iter_corner_info_t * info, void *user_data)
+{
+  ++*(size_t *) user_data;
+}
+
+static p4est_connectivity_t *
+bench_connectivity (const char *name)
+{
+#ifndef P4_TO_P8
+  if (!strcmp (name, "unit")) {
+    return p4est_connectivity_new_unitsquare ();
+  }
+  if (!strcmp (name, "periodic")) {
+    return p4est_connectivity_new_periodic ();
+  }
+  if (!strcmp (name, "three")) {
+    return p4est_connectivity_new_corner ();
+  }
+  if (!strcmp (name, "moebius")) {
+    return p4est_connectivity_new_moebius ();
+  }
+  if (!strcmp (name, "star")) {
+    return p4est_connectivity_new_star ();
+  }
+#else
+  if (!strcmp (name, "unit")) {
+    return p8est_connectivity_new_unitcube ();
+  }
+  if (!strcmp (name, "periodic")) {
+    return p8est_connectivity_new_periodic ();
+  }
+  if (!strcmp (name, "rotwrap")) {
+    return p8est_connectivity_new_rotwrap ();
+  }
+  if (!strcmp (name, "twocubes")) {
+    return p8est_connectivity_new_twocubes ();
+  }
+  if (!strcmp (name, "rotcubes")) {
+    return p8est_connectivity_new_rotcubes ();
+  }
+  if (!strcmp (name, "shell")) {
+    return p8est_connectivity_new_shell ();
+  }
+#endif
+  return NULL;
+}
+
+/* parse a comma separated list of phase names */
+static int
+bench_parse_phases (bench_t * bench, const char *phases)
+{
+  int                 k;
+  size_t              len;
+  const char         *s, *e;
+
+  if (!strcmp (phases, "all")) {
+    for (k = 0; k < BENCH_NUM_PHASES; ++k) {
+      bench->run[k] = 1;
+    }
+    return 0;
+  }
+  memset (bench->run, 0, sizeof (bench->run));
+  for (s = phases; *s != '\0'; s = *e == ',' ? e + 1 : e) {
+    e = strchr (s, ',');
+    if (e == NULL) {
+      e = s + strlen (s);
+    }
+    len = (size_t) (e - s);
+    for (k = 0; k < BENCH_NUM_PHASES; ++k) {
+      if (strlen (bench_phase_names[k]) == len &&
+          !strncmp (bench_phase_names[k], s, len)) {
+        bench->run[k] = 1;
+        break;
+      }
+    }
+    if (k == BENCH_NUM_PHASES) {
+      return -1;
+    }
+  }
+
+  /* the forest is always created */
+  bench->run[BENCH_NEW] = 1;
+  return 0;
+}
+
+static void
+bench_begin (bench_t * bench, p4est_t * p4est)
+{
+  int                 mpiret;
+
+  if (p4est != NULL) {
+    p4est_inspect_reset (p4est->inspect);
+  }
+  mpiret = sc_MPI_Barrier (bench->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  bench->start = sc_MPI_Wtime ();
+}
+
+static void
+bench_end (bench_t * bench, p4est_t * p4est, int phase)
+{
+  int                 k;
+  double              elapsed = sc_MPI_Wtime () - bench->start;
+  size_t              messages, bytes;
+  p4est_inspect_record_t *record;
+  sc_statinfo_t      *st = bench->stats + phase * BENCH_NUM_QUANTITIES;
+
+  messages = bytes = 0;
+  for (k = 0; k < P4EST_INSPECT_NUM_ALGORITHMS; ++k) {
+    record = &p4est->inspect->records[k];
+    messages += record->messages_sent + record->messages_received;
+    bytes += record->bytes_sent + record->bytes_received;
+  }
+  sc_stats_set1 (st + BENCH_TIME, elapsed, bench_quantity_names[BENCH_TIME]);
+  sc_stats_set1 (st + BENCH_QUADRANTS, (double) p4est->local_num_quadrants,
+                 bench_quantity_names[BENCH_QUADRANTS]);
+  sc_stats_set1 (st + BENCH_MESSAGES, (double) messages,
+                 bench_quantity_names[BENCH_MESSAGES]);
+  sc_stats_set1 (st + BENCH_BYTES, (double) bytes,
+                 bench_quantity_names[BENCH_BYTES]);
+  sc_stats_set1 (st + BENCH_MEMORY_PEAK, (double) p4est->inspect->memory_peak,
+                 bench_quantity_names[BENCH_MEMORY_PEAK]);
+  sc_stats_set1 (st + BENCH_FOREST_MEMORY, (double) p4est_memory_used (p4est),
+                 bench_quantity_names[BENCH_FOREST_MEMORY]);
+}
+
+static void
+bench_write (bench_t * bench, FILE * file, int json, const char *label,
+             const char *config_name)
+{
+  int                 k, q, first;
+  sc_statinfo_t      *st;
+
+  if (json) {
+    fprintf (file, "{\n  \"label\": \"%s\",\n  \"dim\": %d,\n"
+             "  \"configuration\": \"%s\",\n  \"mpisize\": %d,\n"
+             "  \"level\": %d,\n  \"phases\": [", label, P4EST_DIM,
+             config_name, bench->mpisize, bench->level);
+    for (k = 0, first = 1; k < BENCH_NUM_PHASES; ++k) {
+      if (!bench->run[k]) {
+        continue;
+      }
+      fprintf (file, "%s\n    { \"name\": \"%s\"", first ? "" : ",",
+               bench_phase_names[k]);
+      first = 0;
+      for (q = 0; q < BENCH_NUM_QUANTITIES; ++q) {
+        st = bench->stats + k * BENCH_NUM_QUANTITIES + q;
+        fprintf (file, ",\n      \"%s\": { \"min\": %.6g, \"avg\": %.6g,"
+                 " \"max\": %.6g }", bench_quantity_names[q],
+                 st->min, st->average, st->max);
+      }
+      fprintf (file, " }");
+    }
+    fprintf (file, "\n  ]\n}\n");
+  }
+  else {
+    fprintf (file, "label,dim,configuration,mpisize,level,phase");
+    for (q = 0; q < BENCH_NUM_QUANTITIES; ++q) {
+      fprintf (file, ",%s_min,%s_avg,%s_max", bench_quantity_names[q],
+               bench_quantity_names[q], bench_quantity_names[q]);
+    }
+    fprintf (file, "\n");
+    for (k = 0; k < BENCH_NUM_PHASES; ++k) {
+      if (!bench->run[k]) {
+        continue;
+      }
+      fprintf (file, "%s,%d,%s,%d,%d,%s", label, P4EST_DIM, config_name,
+               bench->mpisize, bench->level, bench_phase_names[k]);
+      for (q = 0; q < BENCH_NUM_QUANTITIES; ++q) {
+        st = bench->stats + k * BENCH_NUM_QUANTITIES + q;
+        fprintf (file, ",%.6g,%.6g,%.6g", st->min, st->average, st->max);
+      }
+      fprintf (file, "\n");
+    }
+  }
+}
+
+int
+main (int argc, char **argv)
+{
+  int                 k;
+  int                 mpiret;
+  int                 first_argc;
+  int                 weak, json;
+  int                 procs;
+  const char         *config_name;
+  const char         *format;
+  const char         *phases;
+  const char         *label;
+  const char         *output;
+  const char         *prefix;
+  char                filename[BUFSIZ];
+  size_t              count;
+  FILE               *file;
+  bench_t             bench_context, *bench = &bench_context;
+  sc_options_t       *opt;
+  p4est_connectivity_t *connectivity, *loaded_conn;
+  p4est_t            *p4est, *loaded;
+  p4est_ghost_t      *ghost;
+  p4est_lnodes_t     *lnodes;
+  p4est_mesh_t       *mesh;
+
+  /* initialize MPI and p4est internals */
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  memset (bench, 0, sizeof (*bench));
+  bench->mpicomm = sc_MPI_COMM_WORLD;
+  mpiret = sc_MPI_Comm_size (bench->mpicomm, &bench->mpisize);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Comm_rank (bench->mpicomm, &bench->mpirank);
+  SC_CHECK_MPI (mpiret);
+
+  sc_init (bench->mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+#ifndef P4EST_ENABLE_DEBUG
+  sc_set_log_defaults (NULL, NULL, SC_LP_ESSENTIAL);
+#endif
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+  /* process command line arguments */
+  opt = sc_options_new (argv[0]);
+#ifndef P4_TO_P8
+  sc_options_add_string (opt, 'c', "configuration", &config_name, "unit",
+                         "configuration: unit|periodic|three|moebius|star");
+#else
+  sc_options_add_string (opt, 'c', "configuration", &config_name, "unit",
+                         "configuration: unit|periodic|rotwrap|twocubes|rotcubes|shell");
+#endif
+  sc_options_add_int (opt, 'l', "level", &bench->level, 6,
+                      "maximum refinement level");
+  sc_options_add_int (opt, 's', "level-shift", &bench->level_shift, 4,
+                      "levels of fractal refinement below the maximum");
+  sc_options_add_switch (opt, 'w', "weak", &weak,
+                         "add a level for every 2^dim processes");
+  sc_options_add_string (opt, 'p', "phases", &phases, "all",
+                         "comma separated list of phases to run");
+  sc_options_add_string (opt, 'f', "format", &format, "json",
+                         "output format: json|csv");
+  sc_options_add_string (opt, 'o', "output", &output, NULL,
+                         "output file, default standard output");
+  sc_options_add_string (opt, 'L', "label", &label, P4EST_PACKAGE_VERSION,
+                         "label of the results, such as a release");
+  sc_options_add_string (opt, 'P', "prefix", &prefix, P4EST_STRING "_bench",
+                         "prefix for the save and vtk files");
+
+  first_argc = sc_options_parse (p4est_package_id, SC_LP_DEFAULT,
+                                 opt, argc, argv);
+  if (first_argc < 0 || first_argc != argc ||
+      (connectivity = bench_connectivity (config_name)) == NULL ||
+      bench_parse_phases (bench, phases) ||
+      (strcmp (format, "json") && strcmp (format, "csv")) ||
+      bench->level < 0 || bench->level > P4EST_QMAXLEVEL ||
+      bench->level_shift < 0) {
+    sc_options_print_usage (p4est_package_id, SC_LP_ERROR, opt, NULL);
+    sc_abort_collective ("Usage error");
+  }
+  json = !strcmp (format, "json");
+  if (weak) {
+    for (procs = bench->mpisize; procs >= P4EST_CHILDREN;
+         procs /= P4EST_CHILDREN) {
+      ++bench->level;
+    }
+    bench->level = SC_MIN (bench->level, P4EST_QMAXLEVEL);
+  }
+  sc_options_print_summary (p4est_package_id, SC_LP_PRODUCTION, opt);
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Processors %d configuration %s level %d shift %d\n", bench->mpisize,
+     config_name, bench->level, bench->level_shift);
+
+  /* new */
+  bench_begin (bench, NULL);
+  p4est = p4est_new_ext (bench->mpicomm, connectivity, 0,
+                         SC_MAX (bench->level - bench->level_shift, 0), 1,
+                         0, NULL, bench);
+  p4est->inspect = P4EST_ALLOC_ZERO (p4est_inspect_t, 1);
+  bench_end (bench, p4est, BENCH_NEW);
+
+  /* the adaptive forest is the input of all later phases */
+  bench_begin (bench, p4est);
+  p4est_refine (p4est, 1, refine_fractal, NULL);
+  bench_end (bench, p4est, BENCH_REFINE);
+
+  bench_begin (bench, p4est);
+  p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
+  bench_end (bench, p4est, BENCH_BALANCE);
+
+  bench_begin (bench, p4est);
+  p4est_partition (p4est, 0, NULL);
+  bench_end (bench, p4est, BENCH_PARTITION);
+
+  /* phases that work on the ghost layer */
+  ghost = NULL;
+  if (bench->run[BENCH_GHOST] || bench->run[BENCH_LNODES] ||
+      bench->run[BENCH_MESH] || bench->run[BENCH_ITERATE] ||
+#ifdef P4_TO_P8
+      bench->run[BENCH_ITERATE_EDGE] ||
+#endif
+      bench->run[BENCH_ITERATE_CORNER] || bench->run[BENCH_EXPAND]) {
+    bench_begin (bench, p4est);
+    ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+    bench_end (bench, p4est, BENCH_GHOST);
+  }
+  if (bench->run[BENCH_LNODES]) {
+    bench_begin (bench, p4est);
+    lnodes = p4est_lnodes_new (p4est, ghost, 2);
+    bench_end (bench, p4est, BENCH_LNODES);
+    p4est_lnodes_destroy (lnodes);
+  }
+  if (bench->run[BENCH_MESH]) {
+    bench_begin (bench, p4est);
+    mesh = p4est_mesh_new (p4est, ghost, P4EST_CONNECT_FULL);
+    bench_end (bench, p4est, BENCH_MESH);
+    p4est_mesh_destroy (mesh);
+  }
+  if (bench->run[BENCH_ITERATE]) {
+    count = 0;
+    bench_begin (bench, p4est);
+    p4est_iterate (p4est, ghost, &count, iter_volume, iter_face,
+#ifdef P4_TO_P8
+                   NULL,
+#endif
+                   NULL);
+    bench_end (bench, p4est, BENCH_ITERATE);
+  }
+#ifdef P4_TO_P8
+  if (bench->run[BENCH_ITERATE_EDGE]) {
+    count = 0;
+    bench_begin (bench, p4est);
+    p8est_iterate (p4est, ghost, &count, NULL, NULL, iter_edge, NULL);
+    bench_end (bench, p4est, BENCH_ITERATE_EDGE);
+  }
+#endif
+  if (bench->run[BENCH_ITERATE_CORNER]) {
+    count = 0;
+    bench_begin (bench, p4est);
+    p4est_iterate (p4est, ghost, &count, NULL, NULL,
+#ifdef P4_TO_P8
+                   NULL,
+#endif
+                   iter_corner);
+    bench_end (bench, p4est, BENCH_ITERATE_CORNER);
+  }
+  if (bench->run[BENCH_SEARCH]) {
+    count = 0;
+    p4est->user_pointer = &count;
+    bench_begin (bench, p4est);
+    p4est_search_local (p4est, 0, search_all, NULL, NULL);
+    bench_end (bench, p4est, BENCH_SEARCH);
+    P4EST_ASSERT (count == (size_t) p4est->local_num_quadrants);
+    p4est->user_pointer = bench;
+  }
+  if (bench->run[BENCH_EXPAND]) {
+    bench_begin (bench, p4est);
+    p4est_ghost_expand (p4est, ghost);
+    bench_end (bench, p4est, BENCH_EXPAND);
+  }
+  if (ghost != NULL) {
+    p4est_ghost_destroy (ghost);
+  }
+
+  /* phases that change or write the forest */
+  if (bench->run[BENCH_COARSEN]) {
+    bench_begin (bench, p4est);
+    p4est_coarsen (p4est, 0, coarsen_finest, NULL);
+    bench_end (bench, p4est, BENCH_COARSEN);
+  }
+  snprintf (filename, BUFSIZ, "%s.%s", prefix, P4EST_STRING);
+  if (bench->run[BENCH_SAVE] || bench->run[BENCH_LOAD]) {
+    bench_begin (bench, p4est);
+    p4est_save (filename, p4est, 0);
+    bench_end (bench, p4est, BENCH_SAVE);
+  }
+  if (bench->run[BENCH_LOAD]) {
+    bench_begin (bench, p4est);
+    loaded = p4est_load (filename, bench->mpicomm, 0, 0, bench,
+                         &loaded_conn);
+    loaded->inspect = P4EST_ALLOC_ZERO (p4est_inspect_t, 1);
+    bench_end (bench, loaded, BENCH_LOAD);
+    P4EST_FREE (loaded->inspect);
+    p4est_destroy (loaded);
+    p4est_connectivity_destroy (loaded_conn);
+  }
+  if (bench->run[BENCH_VTK]) {
+    bench_begin (bench, p4est);
+    p4est_vtk_write_file (p4est, NULL, prefix);
+    bench_end (bench, p4est, BENCH_VTK);
+  }
+
+  /* reduce the statistics, where the skipped phases contribute zeros */
+  for (k = 0; k < BENCH_NUM_PHASES * BENCH_NUM_QUANTITIES; ++k) {
+    if (bench->stats[k].variable == NULL) {
+      sc_stats_set1 (bench->stats + k, 0., NULL);
+    }
+  }
+  sc_stats_compute (bench->mpicomm, BENCH_NUM_PHASES * BENCH_NUM_QUANTITIES,
+                    bench->stats);
+  if (bench->mpirank == 0) {
+    file = output == NULL ? stdout : fopen (output, "w");
+    SC_CHECK_ABORT (file != NULL, "Open benchmark output");
+    bench_write (bench, file, json, label, config_name);
+    if (output != NULL) {
+      SC_CHECK_ABORT (!fclose (file), "Close benchmark output");
+    }
+  }
+
+  /* clean up and exit */
+  P4EST_FREE (p4est->inspect);
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (connectivity);
+  sc_options_destroy (opt);
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
@@ -0,0 +1,38 @@
+#! /bin/sh
+
+# Run p{4,8}est_bench over a list of process counts and collect one CSV file.
+# Usage: benchsweep.sh [--weak] <bench executable> <output.csv> <np> ...
+# Further options for the benchmark may be passed in BENCHOPTS,
+# and the MPI launcher may be overridden by MPIRUN (default mpirun -np).
+# Without --weak all runs use the same level, which is a strong scaling
+# sweep; with --weak the level grows with the number of processes.
+
+WEAK=
+if test "x$1" = "x--weak" ; then
+	WEAK="--weak"
+	shift
+fi
+if test "$#" -lt 3 ; then
+	echo "Usage: $0 [--weak] <bench executable> <output.csv> <np> ..."
+	exit 1
+fi
+BENCH="$1"
+OUTPUT="$2"
+shift
+shift
+MPIRUN=${MPIRUN:-"mpirun -np"}
+
+TMPF="$OUTPUT.tmp"
+rm -f "$OUTPUT"
+for NP in "$@" ; do
+	$MPIRUN $NP "$BENCH" $WEAK $BENCHOPTS --format csv --output "$TMPF" \
+		|| { echo "Benchmark failed on $NP processes" ; exit 1 ; }
+
+	# keep the header line of the first run only
+	if test -f "$OUTPUT" ; then
+		tail -n +2 "$TMPF" >> "$OUTPUT"
+	else
+		cat "$TMPF" > "$OUTPUT"
+	fi
+done
+rm -f "$TMPF"
@@ -0,0 +1,508 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/*
+ * Usage: p4est_bitsbench [-n <NUM-QUADRANTS>] [-r <REPEAT>] [-S <SEED>]
+ *        Measures the throughput of the quadrant kernels in p4est_bits.
+ *        Every kernel is executed on the same array of random quadrants
+ *        whose levels and coordinates are drawn uniformly from a generator
+ *        seeded by p4est_quadrant_srand, such that runs are reproducible.
+ *        For each kernel we report the best of REPEAT rounds in ns/op.
+ *        If the Linux perf_event interface is available and permitted,
+ *        we also report the cycles and instructions per operation and
+ *        the operations per cycle; otherwise these columns are zero.
+ *        The program runs on every process independently and prints the
+ *        results of rank zero; it is meant to be run on one process.
+ */
+
+#ifndef P4_TO_P8
+#include <p4est_bits.h>
+#include <p4est_extended.h>
+#else
+#include <p8est_bits.h>
+#include <p8est_extended.h>
+#endif
+#include <sc_options.h>
+#ifdef P4EST_HAVE_LINUX_PERF_EVENT_H
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+typedef struct bits_counters
+{
+  int                 fd_cycles;
+  int                 fd_instructions;
+  uint64_t            cycles;
+  uint64_t            instructions;
+}
+bits_counters_t;
+
+typedef struct bits_data
+{
+  size_t              n;
+  p4est_quadrant_t   *a, *b, *r;
+  uint64_t           *ids;
+  p4est_lid_t        *lids;
+  int                *faces;
+  int                 ftransform[P4EST_FACES][P4EST_FTRANSFORM];
+  p4est_connectivity_t *conn;
+}
+bits_data_t;
+
+typedef uint64_t    (*bits_kernel_t) (bits_data_t * d);
+
+typedef struct bits_bench
+{
+  const char         *name;
+  bits_kernel_t       kernel;
+}
+bits_bench_t;
+
+#ifdef P4EST_HAVE_LINUX_PERF_EVENT_H
+
+static int
+bits_counter_open (uint64_t config, int group_fd)
+{
+  struct perf_event_attr attr;
+
+  memset (&attr, 0, sizeof (attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof (attr);
+  attr.config = config;
+  attr.disabled = group_fd == -1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int) syscall (__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static uint64_t
+bits_counter_read (int fd)
+{
+  uint64_t            value;
+
+  if (fd < 0 || read (fd, &value, sizeof (value)) != sizeof (value)) {
+    return 0;
+  }
+  return value;
+}
+
+#endif /* P4EST_HAVE_LINUX_PERF_EVENT_H */
+
+static void
+bits_counters_init (bits_counters_t * c)
+{
+  c->fd_cycles = c->fd_instructions = -1;
+  c->cycles = c->instructions = 0;
+#ifdef P4EST_HAVE_LINUX_PERF_EVENT_H
+  c->fd_cycles = bits_counter_open (PERF_COUNT_HW_CPU_CYCLES, -1);
+  if (c->fd_cycles >= 0) {
+    c->fd_instructions = bits_counter_open (PERF_COUNT_HW_INSTRUCTIONS,
+                                            c->fd_cycles);
+  }
+  else {
+    P4EST_GLOBAL_PRODUCTION ("Hardware counters are not available\n");
+  }
+#endif
+}
+
+static void
+bits_counters_start (bits_counters_t * c)
+{
+#ifdef P4EST_HAVE_LINUX_PERF_EVENT_H
+  if (c->fd_cycles >= 0) {
+    ioctl (c->fd_cycles, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl (c->fd_cycles, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+#endif
+}
+
+static void
+bits_counters_stop (bits_counters_t * c)
+{
+#ifdef P4EST_HAVE_LINUX_PERF_EVENT_H
+  if (c->fd_cycles >= 0) {
+    ioctl (c->fd_cycles, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    c->cycles = bits_counter_read (c->fd_cycles);
+    c->instructions = bits_counter_read (c->fd_instructions);
+  }
+#endif
+}
+
+static void
+bits_counters_reset (bits_counters_t * c)
+{
+#ifdef P4EST_HAVE_LINUX_PERF_EVENT_H
+  if (c->fd_instructions >= 0) {
+    close (c->fd_instructions);
+  }
+  if (c->fd_cycles >= 0) {
+    close (c->fd_cycles);
+  }
+#endif
+  c->fd_cycles = c->fd_instructions = -1;
+}
+
+/** Draw a random quadrant of level between 1 and the old maximum level.
+ * The old maximum level keeps the 64-bit linear index valid in 3D. */
+static void
+bits_random_quadrant (sc_rand_state_t * state, p4est_quadrant_t * q)
+{
+  int                 level;
+  p4est_qcoord_t      count;
+
+  P4EST_QUADRANT_INIT (q);
+  level = 1 + (int) (sc_rand (state) * P4EST_OLD_QMAXLEVEL);
+  level = SC_MIN (level, P4EST_OLD_QMAXLEVEL);
+  count = (p4est_qcoord_t) 1 << level;
+  q->x = ((p4est_qcoord_t) (sc_rand (state) * count) % count) <<
+    (P4EST_MAXLEVEL - level);
+  q->y = ((p4est_qcoord_t) (sc_rand (state) * count) % count) <<
+    (P4EST_MAXLEVEL - level);
+#ifdef P4_TO_P8
+  q->z = ((p4est_qcoord_t) (sc_rand (state) * count) % count) <<
+    (P4EST_MAXLEVEL - level);
+#endif
+  q->level = (int8_t) level;
+  P4EST_ASSERT (p4est_quadrant_is_valid (q));
+}
+
+static void
+bits_data_init (bits_data_t * d, size_t n, int seed)
+{
+  int                 face;
+  size_t              zz;
+  sc_rand_state_t     state;
+  p4est_quadrant_t    root, *a, *b;
+
+  d->n = n;
+  d->a = P4EST_ALLOC (p4est_quadrant_t, n);
+  d->b = P4EST_ALLOC (p4est_quadrant_t, n);
+  d->r = P4EST_ALLOC (p4est_quadrant_t, n);
+  d->ids = P4EST_ALLOC (uint64_t, n);
+  d->lids = P4EST_ALLOC (p4est_lid_t, n);
+  d->faces = P4EST_ALLOC (int, n);
+
+  /* the periodic unit domain provides a transform for every face */
+  d->conn = p4est_connectivity_new_periodic ();
+  for (face = 0; face < P4EST_FACES; ++face) {
+    p4est_find_face_transform (d->conn, 0, face, d->ftransform[face]);
+  }
+
+  P4EST_QUADRANT_INIT (&root);
+  p4est_quadrant_srand (&root, &state);
+  state ^= (sc_rand_state_t) seed;
+  for (zz = 0; zz < n; ++zz) {
+    a = d->a + zz;
+    b = d->b + zz;
+    bits_random_quadrant (&state, a);
+
+    /* reseed from the quadrant to make the partner reproducible */
+    p4est_quadrant_srand (a, &state);
+    state ^= (sc_rand_state_t) (seed + zz);
+    if (sc_rand (&state) < .5) {
+      /* half of the pairs are related to exercise ancestor tests */
+      p4est_quadrant_ancestor (a, (int) (sc_rand (&state) * a->level), b);
+    }
+    else {
+      bits_random_quadrant (&state, b);
+    }
+    d->faces[zz] = (int) (sc_rand (&state) * P4EST_FACES) % P4EST_FACES;
+    d->ids[zz] = p4est_quadrant_linear_id (a, (int) a->level);
+    p4est_quadrant_linear_id_ext128 (a, P4EST_QMAXLEVEL, d->lids + zz);
+  }
+}
+
+static void
+bits_data_reset (bits_data_t * d)
+{
+  p4est_connectivity_destroy (d->conn);
+  P4EST_FREE (d->a);
+  P4EST_FREE (d->b);
+  P4EST_FREE (d->r);
+  P4EST_FREE (d->ids);
+  P4EST_FREE (d->lids);
+  P4EST_FREE (d->faces);
+}
+
+static              uint64_t
+bits_checksum (const p4est_quadrant_t * q)
+{
+  return (uint64_t) q->x ^ ((uint64_t) q->y << 1) ^
+#ifdef P4_TO_P8
+    ((uint64_t) q->z << 2) ^
+#endif
+    (uint64_t) q->level;
+}
+
+static              uint64_t
+kernel_compare (bits_data_t * d)
+{
+  size_t              zz;
+  uint64_t            sum = 0;
+
+  for (zz = 0; zz < d->n; ++zz) {
+    sum += (uint64_t) (p4est_quadrant_compare (d->a + zz, d->b + zz) > 0);
+  }
+  return sum;
+}
+
+static              uint64_t
+kernel_is_ancestor (bits_data_t * d)
+{
+  size_t              zz;
+  uint64_t            sum = 0;
+
+  for (zz = 0; zz < d->n; ++zz) {
+    sum += (uint64_t) p4est_quadrant_is_ancestor (d->b + zz, d->a + zz);
+  }
+  return sum;
+}
+
+static              uint64_t
+kernel_face_neighbor_extra (bits_data_t * d)
+{
+  size_t              zz;
+  int                 nface;
+  uint64_t            sum = 0;
+
+  for (zz = 0; zz < d->n; ++zz) {
+    sum += (uint64_t) p4est_quadrant_face_neighbor_extra
+      (d->a + zz, 0, d->faces[zz], d->r + zz, &nface, d->conn);
+    sum += (uint64_t) nface;
+  }
+  return sum;
+}
+
+static              uint64_t
+kernel_transform_face (bits_data_t * d)
+{
+  size_t              zz;
+  uint64_t            sum = 0;
+
+  for (zz = 0; zz < d->n; ++zz) {
+    p4est_quadrant_transform_face (d->a + zz, d->r + zz,
+                                   d->ftransform[d->faces[zz]]);
+    sum += bits_checksum (d->r + zz);
+  }
+  return sum;
+}
+
+static              uint64_t
+kernel_linear_id (bits_data_t * d)
+{
+  size_t              zz;
+  uint64_t            sum = 0;
+
+  for (zz = 0; zz < d->n; ++zz) {
+    sum += p4est_quadrant_linear_id (d->a + zz, (int) d->a[zz].level);
+  }
+  return sum;
+}
+
+static              uint64_t
+kernel_set_morton (bits_data_t * d)
+{
+  size_t              zz;
+  uint64_t            sum = 0;
+
+  for (zz = 0; zz < d->n; ++zz) {
+    p4est_quadrant_set_morton (d->r + zz, (int) d->a[zz].level, d->ids[zz]);
+    sum += bits_checksum (d->r + zz);
+  }
+  return sum;
+}
+
+static              uint64_t
+kernel_successor (bits_data_t * d)
+{
+  size_t              zz;
+  uint64_t            sum = 0;
+
+  for (zz = 0; zz < d->n; ++zz) {
+    if (d->ids[zz] + 1 <
+        (uint64_t) 1 << (P4EST_DIM * (int) d->a[zz].level)) {
+      /* the last quadrant of a level has no successor */
+      p4est_quadrant_successor (d->a + zz, d->r + zz);
+      sum += bits_checksum (d->r + zz);
+    }
+  }
+  return sum;
+}
+
+static              uint64_t
+kernel_nearest_common_ancestor (bits_data_t * d)
+{
+  size_t              zz;
+  uint64_t            sum = 0;
+
+  for (zz = 0; zz < d->n; ++zz) {
+    p4est_nearest_common_ancestor (d->a + zz, d->b + zz, d->r + zz);
+    sum += (uint64_t) d->r[zz].level;
+  }
+  return sum;
+}
+
+static              uint64_t
+kernel_linear_id_ext128 (bits_data_t * d)
+{
+  size_t              zz;
+  uint64_t            sum = 0;
+  p4est_lid_t         id;
+
+  for (zz = 0; zz < d->n; ++zz) {
+    p4est_quadrant_linear_id_ext128 (d->a + zz, P4EST_QMAXLEVEL, &id);
+    sum += (uint64_t) p4est_lid_chk_bit (&id, 0);
+  }
+  return sum;
+}
+
+static              uint64_t
+kernel_set_morton_ext128 (bits_data_t * d)
+{
+  size_t              zz;
+  uint64_t            sum = 0;
+
+  for (zz = 0; zz < d->n; ++zz) {
+    p4est_quadrant_set_morton_ext128 (d->r + zz, P4EST_QMAXLEVEL,
+                                      d->lids + zz);
+    sum += bits_checksum (d->r + zz);
+  }
+  return sum;
+}
+
+static              uint64_t
+kernel_lid_arithmetic (bits_data_t * d)
+{
+  size_t              zz;
+  uint64_t            sum = 0;
+  p4est_lid_t         one, acc, tmp;
+
+  p4est_lid_set_one (&one);
+  p4est_lid_set_zero (&acc);
+  for (zz = 0; zz < d->n; ++zz) {
+    /* the typical sequence of computing a successor or ancestor index */
+    p4est_lid_shift_right (d->lids + zz, P4EST_DIM, &tmp);
+    p4est_lid_add_inplace (&tmp, &one);
+    p4est_lid_shift_left (&tmp, P4EST_DIM, &tmp);
+    p4est_lid_bitwise_or_inplace (&acc, &tmp);
+    sum += (uint64_t) (p4est_lid_compare (&tmp, d->lids + zz) > 0);
+  }
+  return sum + (uint64_t) p4est_lid_chk_bit (&acc, 0);
+}
+
+static const bits_bench_t bits_benches[] = {
+  {"compare", kernel_compare},
+  {"is_ancestor", kernel_is_ancestor},
+  {"face_neighbor_extra", kernel_face_neighbor_extra},
+  {"transform_face", kernel_transform_face},
+  {"linear_id", kernel_linear_id},
+  {"set_morton", kernel_set_morton},
+  {"successor", kernel_successor},
+  {"nearest_common_ancestor", kernel_nearest_common_ancestor},
+  {"linear_id_ext128", kernel_linear_id_ext128},
+  {"set_morton_ext128", kernel_set_morton_ext128},
+  {"lid_arithmetic", kernel_lid_arithmetic},
+  {NULL, NULL}
+};
+
+int
+main (int argc, char **argv)
+{
+  int                 mpiret;
+  int                 first_argc;
+  int                 num, repeat, seed;
+  int                 k, round;
+  double              start, elapsed, best, ops;
+  uint64_t            sum, best_cycles, best_instructions;
+  sc_options_t       *opt;
+  bits_data_t         sdata, *d = &sdata;
+  bits_counters_t     scounters, *c = &scounters;
+
+  /* initialize MPI and p4est internals */
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  sc_init (sc_MPI_COMM_WORLD, 1, 1, NULL, SC_LP_DEFAULT);
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+  /* process command line arguments */
+  opt = sc_options_new (argv[0]);
+  sc_options_add_int (opt, 'n', "num-quadrants", &num, 1 << 16,
+                      "number of random quadrants");
+  sc_options_add_int (opt, 'r', "repeat", &repeat, 10,
+                      "number of rounds per kernel");
+  sc_options_add_int (opt, 'S', "seed", &seed, 0,
+                      "seed of the random distribution");
+  first_argc = sc_options_parse (p4est_package_id, SC_LP_DEFAULT,
+                                 opt, argc, argv);
+  if (first_argc < 0 || first_argc != argc || num <= 0 || repeat <= 0) {
+    sc_options_print_usage (p4est_package_id, SC_LP_ERROR, opt, NULL);
+    sc_abort_collective ("Usage error");
+  }
+  sc_options_print_summary (p4est_package_id, SC_LP_PRODUCTION, opt);
+
+  bits_data_init (d, (size_t) num, seed);
+  bits_counters_init (c);
+  ops = (double) num;
+
+  P4EST_GLOBAL_PRODUCTIONF ("%-24s %10s %10s %10s %10s\n", "Kernel",
+                            "ns/op", "cycles/op", "instr/op", "ops/cycle");
+  for (k = 0; bits_benches[k].name != NULL; ++k) {
+    best = -1.;
+    best_cycles = best_instructions = 0;
+    sum = 0;
+    for (round = 0; round < repeat; ++round) {
+      bits_counters_start (c);
+      start = sc_MPI_Wtime ();
+      sum += bits_benches[k].kernel (d);
+      elapsed = sc_MPI_Wtime () - start;
+      bits_counters_stop (c);
+      if (best < 0. || elapsed < best) {
+        best = elapsed;
+        best_cycles = c->cycles;
+        best_instructions = c->instructions;
+      }
+    }
+    P4EST_GLOBAL_PRODUCTIONF ("%-24s %10.2f %10.2f %10.2f %10.4f\n",
+                              bits_benches[k].name, 1.e9 * best / ops,
+                              best_cycles / ops, best_instructions / ops,
+                              best_cycles > 0 ? ops / best_cycles : 0.);
+
+    /* print the checksum to keep the kernels from being optimized away */
+    P4EST_GLOBAL_VERBOSEF ("%s checksum %llu\n", bits_benches[k].name,
+                           (unsigned long long) sum);
+  }
+
+  /* clean up and exit */
+  bits_counters_reset (c);
+  bits_data_reset (d);
+  sc_options_destroy (opt);
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
@@ -0,0 +1,127 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/*
+ * Usage: p4est_conncomplete [-l <level>] [-r <repeat>] [<filename>]
+ *        Time the identification of corners (and edges in 3D) by
+ *        p4est_connectivity_complete.  Without a filename, the connectivity
+ *        is a brick of 2^level trees in each direction; with a filename,
+ *        it is loaded by p4est_connectivity_load.  The completion is
+ *        repeated after reducing the connectivity each time.
+ */
+
+#ifndef P4_TO_P8
+#include <p4est_connectivity.h>
+#else
+#include <p8est_connectivity.h>
+#endif
+#include <sc_options.h>
+
+static void
+run_complete (p4est_connectivity_t * conn, int repeat)
+{
+  int                 i;
+  double              elapsed, elapsed_min, elapsed_sum;
+
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Run complete on %lld trees and %lld vertices with %d threads\n",
+     (long long) conn->num_trees, (long long) conn->num_vertices,
+     p4est_get_num_threads ());
+
+  elapsed_min = elapsed_sum = 0.;
+  for (i = 0; i < repeat; ++i) {
+    p4est_connectivity_reduce (conn);
+
+    elapsed = -sc_MPI_Wtime ();
+    p4est_connectivity_complete (conn);
+    elapsed += sc_MPI_Wtime ();
+
+    elapsed_min = (i == 0 ? elapsed : SC_MIN (elapsed_min, elapsed));
+    elapsed_sum += elapsed;
+  }
+
+#ifndef P4_TO_P8
+  P4EST_GLOBAL_PRODUCTIONF ("Completed %lld corners\n",
+                            (long long) conn->num_corners);
+#else
+  P4EST_GLOBAL_PRODUCTIONF ("Completed %lld edges and %lld corners\n",
+                            (long long) conn->num_edges,
+                            (long long) conn->num_corners);
+#endif
+  P4EST_GLOBAL_PRODUCTIONF ("Timings %g %g\n", elapsed_min,
+                            elapsed_sum / repeat);
+}
+
+int
+main (int argc, char **argv)
+{
+  int                 mpiret, retval;
+  int                 level, repeat, tcount;
+  sc_options_t       *opt;
+  p4est_connectivity_t *conn;
+
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+
+  sc_init (sc_MPI_COMM_WORLD, 1, 1, NULL, SC_LP_DEFAULT);
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+  opt = sc_options_new (argv[0]);
+  sc_options_add_int (opt, 'l', "level", &level, 6,
+                      "Brick of 2^level trees in each direction");
+  sc_options_add_int (opt, 'r', "repeat", &repeat, 3,
+                      "Number of timed completions");
+  retval = sc_options_parse (p4est_package_id, SC_LP_ERROR, opt, argc, argv);
+  if (retval == -1 || retval + 1 < argc || level < 0 || level > 15 ||
+      repeat < 1) {
+    sc_options_print_usage (p4est_package_id, SC_LP_PRODUCTION, opt, NULL);
+    sc_abort_collective ("Usage error");
+  }
+
+  if (retval < argc) {
+    P4EST_LDEBUGF ("Loading %s\n", argv[retval]);
+    conn = p4est_connectivity_load (argv[retval], NULL);
+    SC_CHECK_ABORTF (conn != NULL, "Could not load %s", argv[retval]);
+  }
+  else {
+    tcount = 1 << level;
+#ifndef P4_TO_P8
+    conn = p4est_connectivity_new_brick (tcount, tcount, 0, 0);
+#else
+    conn = p8est_connectivity_new_brick (tcount, tcount, tcount, 0, 0, 0);
+#endif
+  }
+
+  run_complete (conn, repeat);
+
+  p4est_connectivity_destroy (conn);
+  sc_options_destroy (opt);
+
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
@@ -120,6 +120,7 @@ enum
   TIMINGS_LNODES,
   TIMINGS_LNODES3,
   TIMINGS_LNODES7,
+  TIMINGS_GHOST_SUPPORT,
   TIMINGS_NUM_STATS
 };
 
@@ -680,11 +681,19 @@ main (int argc, char **argv)
     lnodes = p4est_lnodes_new (p4est, ghost, 7);
     sc_flops_shot (&fi, &snapshot);
     sc_stats_set1 (&stats[TIMINGS_LNODES7], snapshot.iwtime, "L-Nodes 7");
+
+    /* time expanding the ghost layer by the support of the nodes */
+    sc_flops_snap (&fi, &snapshot);
+    p4est_ghost_support_lnodes (p4est, lnodes, ghost);
+    sc_flops_shot (&fi, &snapshot);
+    sc_stats_set1 (&stats[TIMINGS_GHOST_SUPPORT], snapshot.iwtime,
+                   "Ghost support 7");
     p4est_lnodes_destroy (lnodes);
   }
   else {
     sc_stats_set1 (&stats[TIMINGS_LNODES3], 0., "L-Nodes 3");
     sc_stats_set1 (&stats[TIMINGS_LNODES7], 0., "L-Nodes 7");
+    sc_stats_set1 (&stats[TIMINGS_GHOST_SUPPORT], 0., "Ghost support 7");
   }
 
   p4est_ghost_destroy (ghost);
@@ -43,9 +43,13 @@
 #include <sc_notify.h>
 #include <sc_ranges.h>
 #include <sc_search.h>
+#include <sc_statistics.h>
 #ifdef P4EST_HAVE_ZLIB
 #include <zlib.h>
 #endif
+#ifdef P4EST_ENABLE_OPENMP
+#include <omp.h>
+#endif
 
 #ifdef P4EST_ENABLE_MPIIO
 #define P4EST_MPIIO_WRITE
@@ -65,8 +69,63 @@ typedef struct
 }
 p4est_balance_peer_t;
 
+struct p4est_balance_context
+{
+  p4est_t            *p4est;
+  int                 is_current;
+  p4est_connect_type_t btype;
+  p4est_init_t        init_fn;
+  p4est_replace_t     replace_fn;
+  int8_t             *tree_flags;
+  size_t              localcount;
+  size_t              all_incount;
+  p4est_topidx_t      first_tree, last_tree;
+  p4est_locidx_t      skipped;
+  p4est_gloidx_t      old_gnq;
+  p4est_balance_peer_t *peers;
+  sc_array_t         *borders;
+#ifdef P4EST_ENABLE_DEBUG
+  size_t              data_pool_size;
+#endif
+#ifdef P4EST_ENABLE_MPI
+#ifdef P4EST_ENABLE_DEBUG
+  sc_array_t          checkarray;
+#endif
+  int                 request_first_count, request_second_count;
+  int                 request_send_count, total_send_count, total_recv_count;
+  int                 send_zero[2], send_load[2];
+  int                 recv_zero[2], recv_load[2];
+  int                *wait_indices;
+  MPI_Request        *requests_first;
+  MPI_Status         *recv_statuses;
+#endif
+};
+
+/** The quadrant arrays of the local trees of forests made by copy_shared. */
+struct p4est_shared_quadrants
+{
+  sc_refcount_t       rc;               /**< one reference per forest */
+  p4est_topidx_t      first_local_tree; /**< tree of the first array */
+  p4est_topidx_t      num_local_trees;  /**< number of arrays */
+  sc_array_t         *quadrants;        /**< owned quadrant arrays */
+};
+
+/** Temporary arrays kept by a forest between calls to its algorithms. */
+struct p4est_scratch
+{
+  int                 num_threads;      /**< number of lists */
+  sc_array_t         *lists;            /**< per thread, the kept arrays
+                                             as sc_array_t pointers */
+};
+
 #define p4est_num_ranges (25)
 
+/* multi-constraint partition: rounds of reweighting, the combined weight
+   of all quadrants per constraint, and the default imbalance tolerance */
+#define P4EST_PARTITION_MULTI_ITERATIONS 8
+#define P4EST_PARTITION_MULTI_SCALE ((int64_t) 1 << 40)
+#define P4EST_PARTITION_MULTI_TOLERANCE .05
+
 #ifndef P4_TO_P8
 
 static int          p4est_uninitialized_key;
@@ -75,9 +134,16 @@ void               *P4EST_DATA_UNINITIALIZED = &p4est_uninitialized_key;
 #endif /* P4_TO_P8 */
 
 static const size_t number_toread_quadrants = 32;
+static const size_t new_uniform_thread_quadrants = 8192;
+static const size_t checksum_thread_quadrants = 65536;
+static const size_t prefix_thread_quadrants = 65536;
 static const int8_t fully_owned_flag = 0x01;
 static const int8_t any_face_flag = 0x02;
 
+/** A tree is isolated if it is fully owned and has no face neighbors. */
+#define p4est_balance_is_isolated(flags) \
+  (((flags) & fully_owned_flag) && !((flags) & any_face_flag))
+
 void
 p4est_qcoord_to_vertex (p4est_connectivity_t * connectivity,
                         p4est_topidx_t treeid,
@@ -87,64 +153,100 @@ p4est_qcoord_to_vertex (p4est_connectivity_t * connectivity,
 #endif
                         double vxyz[3])
 {
-  const double       *vertices = connectivity->vertices;
-#ifdef P4EST_ENABLE_DEBUG
-  const p4est_topidx_t num_vertices = connectivity->num_vertices;
+  p4est_qcoord_t      qcoords[P4EST_DIM];
+
+  qcoords[0] = x;
+  qcoords[1] = y;
+#ifdef P4_TO_P8
+  qcoords[2] = z;
 #endif
-  const p4est_topidx_t *vindices;
-  int                 xi, yi;
+  p4est_qcoord_to_vertex_batch (connectivity, treeid, 1, qcoords, vxyz);
+}
+
+void
+p4est_qcoord_to_vertex_batch (p4est_connectivity_t * connectivity,
+                              p4est_topidx_t treeid, size_t n,
+                              const p4est_qcoord_t * qcoords, double *vxyz)
+{
+  const double        intsize = 1. / (double) P4EST_ROOT_LEN;
+  int                 corner, j;
+  size_t              zz;
   double              wx[2], wy[2];
 #ifdef P4_TO_P8
-  int                 zi;
   double              wz[2];
 #endif
-  double              xfactor, yfactor;
-  p4est_topidx_t      vindex;
+  double              weight[P4EST_CHILDREN];
+  double              vertices[3 * P4EST_CHILDREN];
+  double              sum;
+  const p4est_qcoord_t *qc;
 
-  P4EST_ASSERT (num_vertices > 0);
-  P4EST_ASSERT (vertices != NULL);
+  P4EST_ASSERT (connectivity->num_vertices > 0 ||
+                connectivity->brick != NULL);
   P4EST_ASSERT (treeid >= 0 && treeid < connectivity->num_trees);
 
-  P4EST_ASSERT (connectivity->tree_to_vertex != NULL);
-  vindices = connectivity->tree_to_vertex + P4EST_CHILDREN * treeid;
-
-  vxyz[0] = vxyz[1] = vxyz[2] = 0.;
-
-  P4EST_ASSERT (x >= 0 && x <= P4EST_ROOT_LEN);
-  wx[1] = (double) x / (double) P4EST_ROOT_LEN;
-  wx[0] = 1. - wx[1];
-
-  P4EST_ASSERT (y >= 0 && y <= P4EST_ROOT_LEN);
-  wy[1] = (double) y / (double) P4EST_ROOT_LEN;
-  wy[0] = 1. - wy[1];
-
-#ifdef P4_TO_P8
-  P4EST_ASSERT (z >= 0 && z <= P4EST_ROOT_LEN);
-  wz[1] = (double) z / (double) P4EST_ROOT_LEN;
-  wz[0] = 1. - wz[1];
+  /* the corner vertices may be implicit for a brick */
+  for (corner = 0; corner < P4EST_CHILDREN; ++corner) {
+    p4est_connectivity_tree_vertex (connectivity, treeid, corner,
+                                    vertices + 3 * corner);
+  }
 
-  for (zi = 0; zi < 2; ++zi) {
-#endif
-    for (yi = 0; yi < 2; ++yi) {
-#ifdef P4_TO_P8
-      yfactor = wz[zi] * wy[yi];
+  for (zz = 0; zz < n; ++zz) {
+    qc = qcoords + P4EST_DIM * zz;
+    P4EST_ASSERT (qc[0] >= 0 && qc[0] <= P4EST_ROOT_LEN);
+    P4EST_ASSERT (qc[1] >= 0 && qc[1] <= P4EST_ROOT_LEN);
+    wx[1] = (double) qc[0] * intsize;
+    wx[0] = 1. - wx[1];
+    wy[1] = (double) qc[1] * intsize;
+    wy[0] = 1. - wy[1];
+#ifndef P4_TO_P8
+    weight[0] = wy[0] * wx[0];
+    weight[1] = wy[0] * wx[1];
+    weight[2] = wy[1] * wx[0];
+    weight[3] = wy[1] * wx[1];
 #else
-      yfactor = wy[yi];
+    P4EST_ASSERT (qc[2] >= 0 && qc[2] <= P4EST_ROOT_LEN);
+    wz[1] = (double) qc[2] * intsize;
+    wz[0] = 1. - wz[1];
+    for (corner = 0; corner < P4EST_CHILDREN; ++corner) {
+      weight[corner] = wz[corner >> 2] * wy[(corner >> 1) & 1] *
+        wx[corner & 1];
+    }
 #endif
-      for (xi = 0; xi < 2; ++xi) {
-        xfactor = yfactor * wx[xi];
-
-        vindex = *vindices++;
-        P4EST_ASSERT (vindex >= 0 && vindex < num_vertices);
 
-        vxyz[0] += xfactor * vertices[3 * vindex + 0];
-        vxyz[1] += xfactor * vertices[3 * vindex + 1];
-        vxyz[2] += xfactor * vertices[3 * vindex + 2];
+    /* sum the corners in order */
+    for (j = 0; j < 3; ++j) {
+      sum = 0.;
+      for (corner = 0; corner < P4EST_CHILDREN; ++corner) {
+        sum += weight[corner] * vertices[3 * corner + j];
       }
+      vxyz[3 * zz + j] = sum;
     }
-#ifdef P4_TO_P8
   }
-#endif
+}
+
+/** Count the bytes allocated by the scratch arena. */
+static size_t
+p4est_scratch_memory_used (p4est_t * p4est)
+{
+  int                 i;
+  size_t              zz, size;
+  sc_array_t         *list;
+  struct p4est_scratch *scratch = p4est->scratch;
+
+  if (scratch == NULL) {
+    return 0;
+  }
+  size = sizeof (struct p4est_scratch) +
+    scratch->num_threads * sizeof (sc_array_t);
+  for (i = 0; i < scratch->num_threads; ++i) {
+    list = scratch->lists + i;
+    size += list->byte_alloc;
+    for (zz = 0; zz < list->elem_count; ++zz) {
+      size += sc_array_memory_used
+        (*(sc_array_t **) sc_array_index (list, zz), 1);
+    }
+  }
+  return size;
 }
 
 size_t
@@ -173,9 +275,17 @@ p4est_memory_used (p4est_t * p4est)
   if (p4est->data_size > 0) {
     P4EST_ASSERT (p4est->user_data_pool != NULL);
     size += sc_mempool_memory_used (p4est->user_data_pool);
+    size += p4est->data_size * (size_t) p4est->data_array_size;
+  }
+  if (p4est->balance_dirty != NULL) {
+    size += (size_t) p4est->connectivity->num_trees;
+  }
+  if (p4est->valid_dirty != NULL) {
+    size += (size_t) p4est->connectivity->num_trees;
   }
   P4EST_ASSERT (p4est->quadrant_pool != NULL);
   size += sc_mempool_memory_used (p4est->quadrant_pool);
+  size += p4est_scratch_memory_used (p4est);
 
   return size;
 }
@@ -198,6 +308,66 @@ p4est_new (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
                         data_size, init_fn, user_pointer);
 }
 
+/** Fill a tree with a contiguous range of quadrants of one level.
+ * The coordinates are computed from the Morton index of the first
+ * quadrant of every chunk and by successors within it.  The chunks are
+ * distributed among the threads, which also initialize the user data.
+ * \param [in] first_morton  Morton index of the first quadrant.
+ * \param [in] count         Number of quadrants, at least one.
+ */
+static void
+p4est_new_uniform_tree (p4est_t * p4est, p4est_topidx_t jt, int level,
+                        uint64_t first_morton, uint64_t count,
+                        p4est_init_t init_fn)
+{
+#ifdef P4EST_ENABLE_OPENMP
+  int                 num_threads;
+#endif
+  p4est_tree_t       *tree = p4est_tree_array_index (p4est->trees, jt);
+  sc_array_t         *tquadrants = &tree->quadrants;
+
+  P4EST_ASSERT (count > 0);
+
+  p4est_array_resize (tquadrants, (size_t) count);
+
+#ifdef P4EST_ENABLE_OPENMP
+  /* small trees are not worth the threads */
+  num_threads = (int) SC_MIN ((uint64_t) p4est_get_num_threads (),
+                              1 + count / new_uniform_thread_quadrants);
+  p4est_quadrant_data_cache_prepare (p4est);
+#pragma omp parallel num_threads (num_threads)
+#endif
+  {
+    int                 thread_id = 0;
+    int                 thread_count = 1;
+    uint64_t            miu, begin, end;
+    p4est_quadrant_t   *quad;
+
+#ifdef P4EST_ENABLE_OPENMP
+    thread_id = omp_get_thread_num ();
+    thread_count = omp_get_num_threads ();
+#endif
+    begin = count * thread_id / thread_count;
+    end = count * (thread_id + 1) / thread_count;
+    if (begin < end) {
+      quad = p4est_quadrant_array_index (tquadrants, (size_t) begin);
+      P4EST_QUADRANT_INIT (quad);
+      p4est_quadrant_set_morton (quad, level, first_morton + begin);
+      p4est_quadrant_init_data (p4est, jt, quad, init_fn);
+      for (miu = begin + 1; miu < end; ++miu) {
+        quad = p4est_quadrant_array_index (tquadrants, (size_t) miu);
+        P4EST_QUADRANT_INIT (quad);
+        p4est_quadrant_successor (quad - 1, quad);
+        p4est_quadrant_init_data (p4est, jt, quad, init_fn);
+      }
+    }
+  }
+
+  /* set tree counters */
+  tree->maxlevel = (int8_t) level;
+  tree->quadrants_per_level[level] = (p4est_locidx_t) count;
+}
+
 p4est_t            *
 p4est_new_ext (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
                p4est_locidx_t min_quadrants, int min_level, int fill_uniform,
@@ -206,7 +376,7 @@ p4est_new_ext (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
   int                 num_procs, rank;
   int                 i, must_remove_last_quadrant;
   int                 level;
-  uint64_t            first_morton, last_morton, miu, count;
+  uint64_t            first_morton, last_morton, count;
   p4est_topidx_t      jt, num_trees;
   p4est_gloidx_t      tree_num_quadrants, global_num_quadrants;
   p4est_gloidx_t      first_tree, first_quadrant, first_tree_quadrant;
@@ -411,29 +581,17 @@ p4est_new_ext (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
       last_morton = (uint64_t)
         (jt == last_tree ? last_tree_quadrant : tree_num_quadrants - 1);
       count = last_morton - first_morton + 1;
-      P4EST_ASSERT (count > 0);
 
       /* populate quadrant array in Morton order */
-      sc_array_resize (tquadrants, (size_t) count);
-      quad = p4est_quadrant_array_index (tquadrants, 0);
-      P4EST_QUADRANT_INIT (quad);
-      p4est_quadrant_set_morton (quad, level, first_morton);
-      p4est_quadrant_init_data (p4est, jt, quad, init_fn);
-      for (miu = 1; miu < count; ++miu) {
-        quad = p4est_quadrant_array_index (tquadrants, (size_t) miu);
-        P4EST_QUADRANT_INIT (quad);
-        p4est_quadrant_successor (quad - 1, quad);
-        p4est_quadrant_init_data (p4est, jt, quad, init_fn);
-      }
+      p4est_new_uniform_tree (p4est, jt, level, first_morton, count,
+                              init_fn);
+      quad = p4est_quadrant_array_index (tquadrants,
+                                         tquadrants->elem_count - 1);
 
       /* remember first tree position */
       p4est_quadrant_first_descendant (p4est_quadrant_array_index
                                        (tquadrants, 0), &tree->first_desc,
                                        P4EST_QMAXLEVEL);
-
-      /* set tree counters */
-      tree->maxlevel = (int8_t) level;
-      tree->quadrants_per_level[level] = (p4est_locidx_t) count;
     }
 
 #if 0
@@ -500,6 +658,211 @@ p4est_new_ext (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
   return p4est;
 }
 
+/** Move the local quadrant arrays of a forest into shared storage.
+ * The trees keep views of the arrays.
+ */
+static void
+p4est_quadrants_share (p4est_t * p4est)
+{
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  sc_array_t         *owned;
+  struct p4est_shared_quadrants *sq;
+
+  if (p4est->shared_quadrants != NULL) {
+    return;
+  }
+
+  sq = P4EST_ALLOC (struct p4est_shared_quadrants, 1);
+  sc_refcount_init (&sq->rc, p4est_package_id);
+  sq->first_local_tree = p4est->first_local_tree;
+  sq->num_local_trees = p4est->last_local_tree - p4est->first_local_tree + 1;
+  sq->quadrants = P4EST_ALLOC (sc_array_t, sq->num_local_trees);
+  for (jt = 0; jt < sq->num_local_trees; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, sq->first_local_tree + jt);
+    owned = sq->quadrants + jt;
+    *owned = tree->quadrants;
+    sc_array_init_data (&tree->quadrants, owned->array,
+                        sizeof (p4est_quadrant_t), owned->elem_count);
+  }
+  p4est->shared_quadrants = sq;
+}
+
+/** Drop one reference to shared quadrants and free them after the last.
+ * \return     True if the quadrants have been freed.
+ */
+static int
+p4est_quadrants_release (struct p4est_shared_quadrants *sq)
+{
+  p4est_topidx_t      jt;
+
+  if (!sc_refcount_unref (&sq->rc)) {
+    return 0;
+  }
+  for (jt = 0; jt < sq->num_local_trees; ++jt) {
+    sc_array_reset (sq->quadrants + jt);
+  }
+  P4EST_FREE (sq->quadrants);
+  P4EST_FREE (sq);
+  return 1;
+}
+
+void
+p4est_unshare_quadrants (p4est_t * p4est)
+{
+  int                 take;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  sc_array_t         *owned;
+  struct p4est_shared_quadrants *sq = p4est->shared_quadrants;
+
+  if (sq == NULL) {
+    return;
+  }
+  P4EST_ASSERT (sq->first_local_tree == p4est->first_local_tree);
+  P4EST_ASSERT (sq->num_local_trees ==
+                p4est->last_local_tree - p4est->first_local_tree + 1);
+
+  /* the last forest takes over the arrays, any other copies them */
+  take = sc_refcount_is_last (&sq->rc);
+  for (jt = 0; jt < sq->num_local_trees; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, sq->first_local_tree + jt);
+    owned = sq->quadrants + jt;
+    P4EST_ASSERT (tree->quadrants.array == owned->array);
+    P4EST_ASSERT (tree->quadrants.elem_count == owned->elem_count);
+    if (take) {
+      tree->quadrants = *owned;
+      sc_array_init (owned, sizeof (p4est_quadrant_t));
+    }
+    else {
+      sc_array_init (&tree->quadrants, sizeof (p4est_quadrant_t));
+      sc_array_copy (&tree->quadrants, owned);
+    }
+  }
+  P4EST_EXECUTE_ASSERT_INT (p4est_quadrants_release (sq), take);
+  p4est->shared_quadrants = NULL;
+}
+
+/** Create the scratch arena or extend it to the current thread count.
+ * Inside a parallel region the arena is left unchanged.
+ * \return     The arena, or NULL if there is none.
+ */
+static struct p4est_scratch *
+p4est_scratch_prepare (p4est_t * p4est)
+{
+  int                 i;
+  int                 num_threads;
+  struct p4est_scratch *scratch = p4est->scratch;
+
+  if (p4est_in_parallel_region ()) {
+    return scratch;
+  }
+  if (scratch == NULL) {
+    scratch = p4est->scratch = P4EST_ALLOC_ZERO (struct p4est_scratch, 1);
+  }
+  num_threads = p4est_get_num_threads ();
+  if (scratch->num_threads < num_threads) {
+    scratch->lists = P4EST_REALLOC (scratch->lists, sc_array_t, num_threads);
+    for (i = scratch->num_threads; i < num_threads; ++i) {
+      sc_array_init (scratch->lists + i, sizeof (sc_array_t *));
+    }
+    scratch->num_threads = num_threads;
+  }
+  return scratch;
+}
+
+/** Return the list of kept arrays of the calling thread or NULL. */
+static sc_array_t  *
+p4est_scratch_list (p4est_t * p4est)
+{
+  int                 thread_num;
+  struct p4est_scratch *scratch = p4est_scratch_prepare (p4est);
+
+  if (scratch == NULL) {
+    return NULL;
+  }
+  thread_num = p4est_get_thread_num ();
+  return thread_num < scratch->num_threads ?
+    scratch->lists + thread_num : NULL;
+}
+
+sc_array_t         *
+p4est_scratch_array_new (p4est_t * p4est, size_t elem_size)
+{
+  size_t              zz, last;
+  sc_array_t         *list, *array, **slot;
+
+  list = p4est_scratch_list (p4est);
+  if (list != NULL) {
+    /* prefer the array returned most recently */
+    for (zz = list->elem_count; zz > 0; --zz) {
+      slot = (sc_array_t **) sc_array_index (list, zz - 1);
+      array = *slot;
+      if (array->elem_size == elem_size) {
+        last = list->elem_count - 1;
+        *slot = *(sc_array_t **) sc_array_index (list, last);
+        sc_array_resize (list, last);
+        P4EST_ASSERT (array->elem_count == 0);
+        return array;
+      }
+    }
+  }
+  return sc_array_new (elem_size);
+}
+
+void
+p4est_scratch_array_destroy (p4est_t * p4est, sc_array_t * array)
+{
+  sc_array_t         *list;
+
+  P4EST_ASSERT (array != NULL);
+
+  list = p4est_scratch_list (p4est);
+  if (list == NULL) {
+    sc_array_destroy (array);
+    return;
+  }
+  sc_array_truncate (array);
+  *(sc_array_t **) sc_array_push (list) = array;
+}
+
+void
+p4est_scratch_trim (p4est_t * p4est, size_t max_bytes)
+{
+  int                 i;
+  size_t              bytes;
+  sc_array_t         *list, *array;
+  struct p4est_scratch *scratch = p4est->scratch;
+
+  P4EST_ASSERT (!p4est_in_parallel_region ());
+
+  if (scratch == NULL) {
+    return;
+  }
+
+  /* free the oldest arrays of each list first */
+  bytes = p4est_scratch_memory_used (p4est);
+  for (i = 0; i < scratch->num_threads; ++i) {
+    list = scratch->lists + i;
+    while (bytes > max_bytes && list->elem_count > 0) {
+      array = *(sc_array_t **) sc_array_index (list, 0);
+      bytes -= sc_array_memory_used (array, 1);
+      sc_array_destroy (array);
+      *(sc_array_t **) sc_array_index (list, 0) =
+        *(sc_array_t **) sc_array_index (list, list->elem_count - 1);
+      sc_array_resize (list, list->elem_count - 1);
+    }
+  }
+  if (max_bytes == 0) {
+    for (i = 0; i < scratch->num_threads; ++i) {
+      sc_array_reset (scratch->lists + i);
+    }
+    P4EST_FREE (scratch->lists);
+    P4EST_FREE (scratch);
+    p4est->scratch = NULL;
+  }
+}
+
 void
 p4est_destroy (p4est_t * p4est)
 {
@@ -513,7 +876,9 @@ p4est_destroy (p4est_t * p4est)
     tree = p4est_tree_array_index (p4est->trees, jt);
 
 #ifdef P4EST_ENABLE_DEBUG
-    for (qz = 0; qz < tree->quadrants.elem_count; ++qz) {
+    /* shared quadrants may still be in use by another forest */
+    for (qz = 0; p4est->shared_quadrants == NULL &&
+         qz < tree->quadrants.elem_count; ++qz) {
       p4est_quadrant_t   *quad =
         p4est_quadrant_array_index (&tree->quadrants, qz);
       p4est_quadrant_free_data (p4est, quad);
@@ -523,10 +888,18 @@ p4est_destroy (p4est_t * p4est)
     sc_array_reset (&tree->quadrants);
   }
   sc_array_destroy (p4est->trees);
+  if (p4est->shared_quadrants != NULL) {
+    p4est_quadrants_release (p4est->shared_quadrants);
+  }
 
+  p4est_quadrant_data_cache_flush (p4est);
   if (p4est->user_data_pool != NULL) {
     sc_mempool_destroy (p4est->user_data_pool);
   }
+  P4EST_FREE (p4est->data_array);
+  P4EST_FREE (p4est->balance_dirty);
+  P4EST_FREE (p4est->valid_dirty);
+  p4est_scratch_trim (p4est, 0);
   sc_mempool_destroy (p4est->quadrant_pool);
 
   p4est_comm_parallel_env_release (p4est);
@@ -541,8 +914,10 @@ p4est_copy (p4est_t * input, int copy_data)
   return p4est_copy_ext (input, copy_data, 0 /* don't duplicate MPI comm */ );
 }
 
-p4est_t            *
-p4est_copy_ext (p4est_t * input, int copy_data, int duplicate_mpicomm)
+/** Copy a forest, optionally sharing the local quadrant arrays. */
+static p4est_t     *
+p4est_copy_internal (p4est_t * input, int copy_data, int share,
+                     int duplicate_mpicomm)
 {
   const p4est_topidx_t num_trees = input->connectivity->num_trees;
   const p4est_topidx_t first_tree = input->first_local_tree;
@@ -563,6 +938,13 @@ p4est_copy_ext (p4est_t * input, int copy_data, int duplicate_mpicomm)
   p4est->trees = NULL;
   p4est->user_data_pool = NULL;
   p4est->quadrant_pool = NULL;
+  p4est->data_array = NULL;
+  p4est->data_array_size = p4est->data_array_used = 0;
+  p4est->balance_dirty = NULL;
+  p4est->valid_dirty = NULL;
+  p4est->shared_quadrants = NULL;
+  p4est->scratch = NULL;
+  p4est->data_cache = NULL;
 
   /* set parallel environment */
   p4est_comm_parallel_env_assign (p4est, input->mpicomm);
@@ -571,6 +953,7 @@ p4est_copy_ext (p4est_t * input, int copy_data, int duplicate_mpicomm)
   }
 
   /* allocate a user data pool if necessary and a quadrant pool */
+  P4EST_ASSERT (!share || !copy_data);
   if (copy_data && p4est->data_size > 0) {
     p4est->user_data_pool = sc_mempool_new (p4est->data_size);
   }
@@ -588,13 +971,23 @@ p4est_copy_ext (p4est_t * input, int copy_data, int duplicate_mpicomm)
     memcpy (ptree, itree, sizeof (p4est_tree_t));
     sc_array_init (&ptree->quadrants, sizeof (p4est_quadrant_t));
   }
+  if (share) {
+    p4est_quadrants_share (input);
+    sc_refcount_ref (&input->shared_quadrants->rc);
+    p4est->shared_quadrants = input->shared_quadrants;
+  }
   for (jt = first_tree; jt <= last_tree; ++jt) {
     itree = p4est_tree_array_index (input->trees, jt);
     iquadrants = &itree->quadrants;
     icount = iquadrants->elem_count;
     ptree = p4est_tree_array_index (p4est->trees, jt);
     pquadrants = &ptree->quadrants;
-    sc_array_resize (pquadrants, icount);
+    if (share) {
+      sc_array_init_data (pquadrants, iquadrants->array,
+                          sizeof (p4est_quadrant_t), icount);
+      continue;
+    }
+    p4est_array_resize (pquadrants, icount);
     memcpy (pquadrants->array, iquadrants->array,
             icount * sizeof (p4est_quadrant_t));
     if (p4est->data_size > 0) {
@@ -622,6 +1015,23 @@ p4est_copy_ext (p4est_t * input, int copy_data, int duplicate_mpicomm)
 
   /* the copy starts with a revision count of zero */
   p4est->revision = 0;
+  if (input->balance_dirty != NULL) {
+    p4est->balance_dirty = P4EST_ALLOC (int8_t, num_trees);
+    memcpy (p4est->balance_dirty, input->balance_dirty,
+            (size_t) num_trees * sizeof (int8_t));
+    p4est->balance_revision =
+      input->balance_revision == input->revision ? 0 : -1;
+  }
+  if (input->valid_dirty != NULL) {
+    p4est->valid_dirty = P4EST_ALLOC (int8_t, num_trees);
+    memcpy (p4est->valid_dirty, input->valid_dirty,
+            (size_t) num_trees * sizeof (int8_t));
+    p4est->valid_revision =
+      input->valid_revision == input->revision ? 0 : -1;
+  }
+
+  /* a contiguous copy receives its own data array */
+  p4est_compact_data (p4est);
 
   /* check for valid p4est and return */
   P4EST_ASSERT (p4est_is_valid (p4est));
@@ -629,6 +1039,18 @@ p4est_copy_ext (p4est_t * input, int copy_data, int duplicate_mpicomm)
   return p4est;
 }
 
+p4est_t            *
+p4est_copy_ext (p4est_t * input, int copy_data, int duplicate_mpicomm)
+{
+  return p4est_copy_internal (input, copy_data, 0, duplicate_mpicomm);
+}
+
+p4est_t            *
+p4est_copy_shared (p4est_t * input, int duplicate_mpicomm)
+{
+  return p4est_copy_internal (input, 0, 1, duplicate_mpicomm);
+}
+
 void
 p4est_reset_data (p4est_t * p4est, size_t data_size,
                   p4est_init_t init_fn, void *user_pointer)
@@ -640,15 +1062,20 @@ p4est_reset_data (p4est_t * p4est, size_t data_size,
   p4est_tree_t       *tree;
   sc_array_t         *tquadrants;
 
+  p4est_unshare_quadrants (p4est);
   doresize = (p4est->data_size != data_size);
 
   p4est->data_size = data_size;
   p4est->user_pointer = user_pointer;
 
   if (doresize) {
+    p4est_quadrant_data_cache_flush (p4est);
     if (p4est->user_data_pool != NULL) {
       sc_mempool_destroy (p4est->user_data_pool);
     }
+    P4EST_FREE (p4est->data_array);
+    p4est->data_array = NULL;
+    p4est->data_array_size = p4est->data_array_used = 0;
     if (p4est->data_size > 0) {
       p4est->user_data_pool = sc_mempool_new (p4est->data_size);
     }
@@ -675,2104 +1102,5140 @@ p4est_reset_data (p4est_t * p4est, size_t data_size,
       }
     }
   }
+  if (doresize) {
+    p4est_compact_data (p4est);
+  }
 }
 
 void
-p4est_refine (p4est_t * p4est, int refine_recursive,
-              p4est_refine_t refine_fn, p4est_init_t init_fn)
+p4est_set_data_contiguous (p4est_t * p4est, int contiguous)
 {
-  p4est_refine_ext (p4est, refine_recursive, -1, refine_fn, init_fn, NULL);
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_quadrant_t   *q;
+  p4est_tree_t       *tree;
+  void               *data;
+
+  p4est_unshare_quadrants (p4est);
+  if (contiguous) {
+    /* moves any data currently in the pool into a new array */
+    p4est->data_contiguous = 1;
+    p4est_compact_data (p4est);
+    return;
+  }
+
+  if (!p4est->data_contiguous) {
+    return;
+  }
+
+  /* afterwards all data is in the array and is copied back to the pool */
+  p4est_compact_data (p4est);
+  if (p4est->data_size > 0) {
+    for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+        q = p4est_quadrant_array_index (&tree->quadrants, zz);
+        data = sc_mempool_alloc (p4est->user_data_pool);
+        memcpy (data, q->p.user_data, p4est->data_size);
+        q->p.user_data = data;
+      }
+    }
+  }
+  P4EST_FREE (p4est->data_array);
+  p4est->data_array = NULL;
+  p4est->data_array_size = p4est->data_array_used = 0;
+  p4est->data_contiguous = 0;
 }
 
 void
-p4est_refine_ext (p4est_t * p4est, int refine_recursive, int allowed_level,
-                  p4est_refine_t refine_fn, p4est_init_t init_fn,
-                  p4est_replace_t replace_fn)
+p4est_set_balance_incremental (p4est_t * p4est, int incremental)
 {
-#ifdef P4EST_ENABLE_DEBUG
-  size_t              quadrant_pool_size, data_pool_size;
-#endif
-  int                 firsttime;
-  int                 i, maxlevel;
-  p4est_topidx_t      nt;
-  p4est_gloidx_t      old_gnq;
-  size_t              incount, current, restpos, movecount;
-  sc_list_t          *list;
-  p4est_tree_t       *tree;
-  p4est_quadrant_t   *q, *qalloc, *qpop;
-  p4est_quadrant_t   *c0, *c1, *c2, *c3;
-#ifdef P4_TO_P8
-  p4est_quadrant_t   *c4, *c5, *c6, *c7;
-#endif
-  sc_array_t         *tquadrants;
-  p4est_quadrant_t   *family[8];
-  p4est_quadrant_t    parent, *pp = &parent;
+  const p4est_topidx_t num_trees = p4est->connectivity->num_trees;
+  p4est_topidx_t      jt;
 
-  if (allowed_level < 0) {
-    allowed_level = P4EST_QMAXLEVEL;
+  if (!incremental) {
+    P4EST_FREE (p4est->balance_dirty);
+    p4est->balance_dirty = NULL;
+    return;
   }
-  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
-                            "_refine with %lld total quadrants,"
-                            " allowed level %d\n",
-                            (long long) p4est->global_num_quadrants,
-                            allowed_level);
-  p4est_log_indent_push ();
-  P4EST_ASSERT (p4est_is_valid (p4est));
-  P4EST_ASSERT (0 <= allowed_level && allowed_level <= P4EST_QMAXLEVEL);
-  P4EST_ASSERT (refine_fn != NULL);
 
-  /* remember input quadrant count; it will not decrease */
-  old_gnq = p4est->global_num_quadrants;
+  /* nothing is known about the forest until its next balance */
+  if (p4est->balance_dirty == NULL) {
+    p4est->balance_dirty = P4EST_ALLOC (int8_t, num_trees);
+  }
+  for (jt = 0; jt < num_trees; ++jt) {
+    p4est->balance_dirty[jt] = 1;
+  }
+  p4est->balance_type = P4EST_CONNECT_SELF;
+  p4est->balance_revision = -1;
+}
 
-  /*
-     q points to a quadrant that is an array member
-     qalloc is a quadrant that has been allocated through quadrant_pool
-     qpop is a quadrant that has been allocated through quadrant_pool
-     never mix these two types of quadrant pointers
+void
+p4est_set_valid_incremental (p4est_t * p4est, int incremental)
+{
+  const p4est_topidx_t num_trees = p4est->connectivity->num_trees;
 
-     The quadrant->pad8 field of list quadrants is interpreted as boolean
-     and set to true for quadrants that have already been refined.
-   */
-  list = sc_list_new (NULL);
-  p4est->local_num_quadrants = 0;
+  if (!incremental) {
+    P4EST_FREE (p4est->valid_dirty);
+    p4est->valid_dirty = NULL;
+    return;
+  }
 
-  /* loop over all local trees */
-  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
-    tree = p4est_tree_array_index (p4est->trees, nt);
-    tree->quadrants_offset = p4est->local_num_quadrants;
-    tquadrants = &tree->quadrants;
-#ifdef P4EST_ENABLE_DEBUG
-    quadrant_pool_size = p4est->quadrant_pool->elem_count;
-    data_pool_size = 0;
-    if (p4est->user_data_pool != NULL) {
-      data_pool_size = p4est->user_data_pool->elem_count;
-    }
-#endif
+  /* nothing is known about the forest until its next validation */
+  if (p4est->valid_dirty == NULL) {
+    p4est->valid_dirty = P4EST_ALLOC (int8_t, num_trees);
+  }
+  memset (p4est->valid_dirty, 1, (size_t) num_trees);
+  p4est->valid_revision = -1;
+}
 
-    /* initial log message for this tree */
-    P4EST_VERBOSEF ("Into refine tree %lld with %llu\n", (long long) nt,
-                    (unsigned long long) tquadrants->elem_count);
+/** The fixed part of a snapshot at the beginning of its buffer. */
+typedef struct p4est_snapshot_header
+{
+  size_t              data_size;        /**< 0 if the data is not saved */
+  int                 mpisize;
+  p4est_topidx_t      num_trees;
+  p4est_topidx_t      first_local_tree, last_local_tree;
+  p4est_locidx_t      local_num_quadrants;
+  p4est_gloidx_t      global_num_quadrants;
+}
+p4est_snapshot_header_t;
 
-    /* reset the quadrant counters */
-    maxlevel = 0;
-    for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
-      tree->quadrants_per_level[i] = 0;
-    }
+size_t
+p4est_snapshot_size (p4est_t * p4est, int save_data)
+{
+  const size_t        data_size = save_data ? p4est->data_size : 0;
+
+  return sizeof (p4est_snapshot_header_t) +
+    (size_t) (p4est->mpisize + 1) *
+    (sizeof (p4est_gloidx_t) + sizeof (p4est_quadrant_t)) +
+    (size_t) p4est->connectivity->num_trees * sizeof (p4est_tree_t) +
+    (size_t) p4est->local_num_quadrants *
+    (sizeof (p4est_quadrant_t) + data_size);
+}
 
-    /* run through the array to find first quadrant to be refined */
-    q = NULL;
-    incount = tquadrants->elem_count;
-    for (current = 0; current < incount; ++current) {
-      q = p4est_quadrant_array_index (tquadrants, current);
-      if (refine_fn (p4est, nt, q) && (int) q->level < allowed_level) {
-        break;
-      }
-      maxlevel = SC_MAX (maxlevel, (int) q->level);
-      ++tree->quadrants_per_level[q->level];
+void
+p4est_snapshot_save (p4est_t * p4est, int save_data, void *buffer)
+{
+  const p4est_topidx_t num_trees = p4est->connectivity->num_trees;
+  const size_t        data_size = save_data ? p4est->data_size : 0;
+  size_t              zz;
+  char               *pos = (char *) buffer;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  p4est_snapshot_header_t header;
+
+  P4EST_ASSERT (buffer != NULL);
+
+  memset (&header, 0, sizeof (header));
+  header.data_size = data_size;
+  header.mpisize = p4est->mpisize;
+  header.num_trees = num_trees;
+  header.first_local_tree = p4est->first_local_tree;
+  header.last_local_tree = p4est->last_local_tree;
+  header.local_num_quadrants = p4est->local_num_quadrants;
+  header.global_num_quadrants = p4est->global_num_quadrants;
+  memcpy (pos, &header, sizeof (header));
+  pos += sizeof (header);
+
+  /* the partition */
+  zz = (size_t) (p4est->mpisize + 1) * sizeof (p4est_gloidx_t);
+  memcpy (pos, p4est->global_first_quadrant, zz);
+  pos += zz;
+  zz = (size_t) (p4est->mpisize + 1) * sizeof (p4est_quadrant_t);
+  memcpy (pos, p4est->global_first_position, zz);
+  pos += zz;
+
+  /* the tree structures including the quadrant counts */
+  memcpy (pos, p4est->trees->array, num_trees * sizeof (p4est_tree_t));
+  pos += num_trees * sizeof (p4est_tree_t);
+
+  /* the quadrants with one copy per tree, followed by their data */
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    zz = tree->quadrants.elem_count * sizeof (p4est_quadrant_t);
+    if (zz > 0) {
+      memcpy (pos, tree->quadrants.array, zz);
     }
-    if (current == incount) {
-      /* no refinement occurs in this tree */
-      p4est->local_num_quadrants += incount;
-      continue;
+    pos += zz;
+  }
+  if (data_size > 0) {
+    for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+        q = p4est_quadrant_array_index (&tree->quadrants, zz);
+        memcpy (pos, q->p.user_data, data_size);
+        pos += data_size;
+      }
     }
-    P4EST_ASSERT (q != NULL);
-
-    /* now we have a quadrant to refine, prepend it to the list */
-    qalloc = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-    *qalloc = *q;               /* never prepend array members directly */
-    qalloc->pad8 = 0;           /* this quadrant has not been refined yet */
-    (void) sc_list_prepend (list, qalloc);      /* only new quadrants */
-
-    P4EST_QUADRANT_INIT (&parent);
-
-    /*
-       current points to the next array member to write
-       restpos points to the next array member to read
-     */
-    restpos = current + 1;
-
-    /* run through the list and refine recursively */
-    firsttime = 1;
-    while (list->elem_count > 0) {
-      qpop = p4est_quadrant_list_pop (list);
-      if (firsttime ||
-          ((refine_recursive || !qpop->pad8) &&
-           refine_fn (p4est, nt, qpop) &&
-           (int) qpop->level < allowed_level)) {
-        firsttime = 0;
-        sc_array_resize (tquadrants,
-                         tquadrants->elem_count + P4EST_CHILDREN - 1);
-
-        if (replace_fn != NULL) {
-          /* do not free qpop's data yet: we will do this when the parent
-           * is replaced */
-          parent = *qpop;
-        }
-        else {
-          p4est_quadrant_free_data (p4est, qpop);
-        }
-        c0 = qpop;
-        c1 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-        c2 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-        c3 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
+  }
+  P4EST_ASSERT (pos == (char *) buffer + p4est_snapshot_size (p4est,
+                                                               save_data));
+}
 
-#ifdef P4_TO_P8
-        c4 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-        c5 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-        c6 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-        c7 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
+void
+p4est_snapshot_restore (p4est_t * p4est, const void *buffer,
+                        p4est_init_t init_fn)
+{
+  size_t              zz;
+  const char         *pos = (const char *) buffer;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  sc_array_t          quadrants;
+  p4est_snapshot_header_t header;
+
+  P4EST_ASSERT (buffer != NULL);
+  memcpy (&header, pos, sizeof (header));
+  pos += sizeof (header);
+  P4EST_ASSERT (header.mpisize == p4est->mpisize);
+  P4EST_ASSERT (header.num_trees == p4est->connectivity->num_trees);
+  P4EST_ASSERT (header.data_size == 0 ||
+                header.data_size == p4est->data_size);
+
+  /* release the data of the current quadrants */
+  p4est_unshare_quadrants (p4est);
+  if (p4est->data_size > 0) {
+    for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+        q = p4est_quadrant_array_index (&tree->quadrants, zz);
+        p4est_quadrant_free_data (p4est, q);
+      }
+    }
+  }
 
-        p8est_quadrant_children (qpop, c0, c1, c2, c3, c4, c5, c6, c7);
-#else
-        p4est_quadrant_children (qpop, c0, c1, c2, c3);
-#endif
-        p4est_quadrant_init_data (p4est, nt, c0, init_fn);
-        p4est_quadrant_init_data (p4est, nt, c1, init_fn);
-        p4est_quadrant_init_data (p4est, nt, c2, init_fn);
-        p4est_quadrant_init_data (p4est, nt, c3, init_fn);
-        c0->pad8 = c1->pad8 = c2->pad8 = c3->pad8 = 1;
+  /* the partition */
+  p4est->first_local_tree = header.first_local_tree;
+  p4est->last_local_tree = header.last_local_tree;
+  p4est->local_num_quadrants = header.local_num_quadrants;
+  p4est->global_num_quadrants = header.global_num_quadrants;
+  zz = (size_t) (p4est->mpisize + 1) * sizeof (p4est_gloidx_t);
+  memcpy (p4est->global_first_quadrant, pos, zz);
+  pos += zz;
+  zz = (size_t) (p4est->mpisize + 1) * sizeof (p4est_quadrant_t);
+  memcpy (p4est->global_first_position, pos, zz);
+  pos += zz;
+
+  /* the tree structures keep their quadrant allocations */
+  for (jt = 0; jt < header.num_trees; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    quadrants = tree->quadrants;
+    memcpy (tree, pos, sizeof (p4est_tree_t));
+    pos += sizeof (p4est_tree_t);
+    zz = tree->quadrants.elem_count;
+    tree->quadrants = quadrants;
+    if (jt < header.first_local_tree || jt > header.last_local_tree) {
+      P4EST_ASSERT (zz == 0);
+      sc_array_truncate (&tree->quadrants);
+    }
+    else {
+      sc_array_resize (&tree->quadrants, zz);
+    }
+  }
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    zz = tree->quadrants.elem_count * sizeof (p4est_quadrant_t);
+    if (zz > 0) {
+      memcpy (tree->quadrants.array, pos, zz);
+    }
+    pos += zz;
+  }
 
-#ifdef P4_TO_P8
-        p4est_quadrant_init_data (p4est, nt, c4, init_fn);
-        p4est_quadrant_init_data (p4est, nt, c5, init_fn);
-        p4est_quadrant_init_data (p4est, nt, c6, init_fn);
-        p4est_quadrant_init_data (p4est, nt, c7, init_fn);
-        c4->pad8 = c5->pad8 = c6->pad8 = c7->pad8 = 1;
-
-        (void) sc_list_prepend (list, c7);
-        (void) sc_list_prepend (list, c6);
-        (void) sc_list_prepend (list, c5);
-        (void) sc_list_prepend (list, c4);
-#endif
-        (void) sc_list_prepend (list, c3);
-        (void) sc_list_prepend (list, c2);
-        (void) sc_list_prepend (list, c1);
-        (void) sc_list_prepend (list, c0);
-
-        if (replace_fn != NULL) {
-          /* in family mode we always call the replace callback right
-           * away */
-          family[0] = c0;
-          family[1] = c1;
-          family[2] = c2;
-          family[3] = c3;
-#ifdef P4_TO_P8
-          family[4] = c4;
-          family[5] = c5;
-          family[6] = c6;
-          family[7] = c7;
-#endif
-          replace_fn (p4est, nt, 1, &pp, P4EST_CHILDREN, family);
-          p4est_quadrant_free_data (p4est, &parent);
-        }
+  /* the saved data or freshly initialized data */
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      if (header.data_size > 0) {
+        p4est_quadrant_init_data (p4est, jt, q, NULL);
+        memcpy (q->p.user_data, pos, header.data_size);
+        pos += header.data_size;
       }
       else {
-        /* need to make room in the array to store this new quadrant */
-        if (restpos < incount && current == restpos) {
-          movecount = SC_MIN (incount - restpos, number_toread_quadrants);
-          while (movecount > 0) {
-            q = p4est_quadrant_array_index (tquadrants, restpos);
-            qalloc = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-            *qalloc = *q;       /* never append array members directly */
-            qalloc->pad8 = 0;   /* has not been refined yet */
-            (void) sc_list_append (list, qalloc);       /* only new quadrants */
-            --movecount;
-            ++restpos;
-          }
-        }
-
-        /* store new quadrant and update counters */
-        q = p4est_quadrant_array_index (tquadrants, current);
-        *q = *qpop;
-        maxlevel = SC_MAX (maxlevel, (int) qpop->level);
-        ++tree->quadrants_per_level[qpop->level];
-        ++current;
-        sc_mempool_free (p4est->quadrant_pool, qpop);
+        p4est_quadrant_init_data (p4est, jt, q, init_fn);
       }
     }
-    tree->maxlevel = (int8_t) maxlevel;
-    p4est->local_num_quadrants += tquadrants->elem_count;
-
-    P4EST_ASSERT (restpos == incount);
-    P4EST_ASSERT (current == tquadrants->elem_count);
-    P4EST_ASSERT (list->first == NULL && list->last == NULL);
-    P4EST_ASSERT (quadrant_pool_size == p4est->quadrant_pool->elem_count);
-    if (p4est->user_data_pool != NULL) {
-      P4EST_ASSERT (data_pool_size + tquadrants->elem_count ==
-                    p4est->user_data_pool->elem_count + incount);
-    }
-    P4EST_ASSERT (p4est_tree_is_sorted (tree));
-    P4EST_ASSERT (p4est_tree_is_complete (tree));
+  }
+  p4est_compact_data (p4est);
 
-    /* final log message for this tree */
-    P4EST_VERBOSEF ("Done refine tree %lld now %llu\n", (long long) nt,
-                    (unsigned long long) tquadrants->elem_count);
+  /* nothing is known about the changes since the snapshot */
+  ++p4est->revision;
+  if (p4est->balance_dirty != NULL) {
+    p4est_set_balance_incremental (p4est, 1);
   }
-  if (p4est->last_local_tree >= 0) {
-    for (; nt < p4est->connectivity->num_trees; ++nt) {
-      tree = p4est_tree_array_index (p4est->trees, nt);
-      tree->quadrants_offset = p4est->local_num_quadrants;
-    }
+  if (p4est->valid_dirty != NULL) {
+    p4est_set_valid_incremental (p4est, 1);
   }
+  P4EST_ASSERT (p4est_is_valid (p4est));
+}
 
-  sc_list_destroy (list);
+/** Number of quantities printed per algorithm by p4est_inspect_statistics */
+#define P4EST_INSPECT_NUM_STATS 12
 
-  /* compute global number of quadrants */
-  p4est_comm_count_quadrants (p4est);
-  P4EST_ASSERT (p4est->global_num_quadrants >= old_gnq);
-  if (old_gnq != p4est->global_num_quadrants) {
-    ++p4est->revision;
-  }
+/** Maximum length of a statistics name, including the algorithm name */
+#define P4EST_INSPECT_NAME_LENGTH 64
 
-  P4EST_ASSERT (p4est_is_valid (p4est));
-  p4est_log_indent_pop ();
-  P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
-                            "_refine with %lld total quadrants\n",
-                            (long long) p4est->global_num_quadrants);
+/* *INDENT-OFF* */
+static const char  *p4est_inspect_algorithm_names
+  [P4EST_INSPECT_NUM_ALGORITHMS] =
+{ "Partition", "Ghost", "Ghost expand", "Lnodes", "Mesh", "Search",
+  "Iterate", "File", "Balance", "Transfer" };
+
+static const char  *p4est_inspect_stat_names[P4EST_INSPECT_NUM_STATS] =
+{ "calls", "time", "peers", "messages", "bytes sent", "bytes received",
+  "memory", "memory peak", "zero messages", "min bytes per peer",
+  "avg bytes per peer", "max bytes per peer" };
+/* *INDENT-ON* */
+
+double
+p4est_inspect_start (p4est_inspect_t * inspect)
+{
+  return inspect != NULL ? sc_MPI_Wtime () : 0.;
 }
 
 void
-p4est_coarsen (p4est_t * p4est, int coarsen_recursive,
-               p4est_coarsen_t coarsen_fn, p4est_init_t init_fn)
+p4est_inspect_stop (p4est_inspect_t * inspect,
+                    p4est_inspect_algorithm_t algorithm, double start)
 {
-  p4est_coarsen_ext (p4est, coarsen_recursive, 0, coarsen_fn, init_fn, NULL);
+  p4est_inspect_record_t *record;
+
+  if (inspect == NULL) {
+    return;
+  }
+  P4EST_ASSERT (0 <= algorithm && algorithm < P4EST_INSPECT_NUM_ALGORITHMS);
+  record = &inspect->records[algorithm];
+  ++record->calls;
+  record->time += sc_MPI_Wtime () - start;
 }
 
 void
-p4est_coarsen_ext (p4est_t * p4est,
-                   int coarsen_recursive, int callback_orphans,
-                   p4est_coarsen_t coarsen_fn, p4est_init_t init_fn,
-                   p4est_replace_t replace_fn)
+p4est_inspect_comm (p4est_inspect_t * inspect,
+                    p4est_inspect_algorithm_t algorithm, size_t peers,
+                    size_t messages_sent, size_t bytes_sent,
+                    size_t messages_received, size_t bytes_received)
 {
-#ifdef P4EST_ENABLE_DEBUG
-  size_t              data_pool_size;
-#endif
-  int                 i, maxlevel;
-  int                 isfamily;
-  size_t              zz;
-  size_t              incount, removed;
-  size_t              window, start, length, cidz;
-  p4est_locidx_t      num_quadrants, prev_offset;
-  p4est_topidx_t      jt;
-  p4est_gloidx_t      old_gnq;
-  p4est_tree_t       *tree;
-  p4est_quadrant_t   *c[P4EST_CHILDREN];
-  p4est_quadrant_t   *cfirst, *clast;
-  sc_array_t         *tquadrants;
-  p4est_quadrant_t    qtemp;
+  p4est_inspect_record_t *record;
 
-  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
-                            "_coarsen with %lld total quadrants\n",
-                            (long long) p4est->global_num_quadrants);
-  p4est_log_indent_push ();
-  P4EST_ASSERT (p4est_is_valid (p4est));
-  P4EST_ASSERT (coarsen_fn != NULL);
+  if (inspect == NULL) {
+    return;
+  }
+  P4EST_ASSERT (0 <= algorithm && algorithm < P4EST_INSPECT_NUM_ALGORITHMS);
+  record = &inspect->records[algorithm];
+  record->peers += peers;
+  record->messages_sent += messages_sent;
+  record->bytes_sent += bytes_sent;
+  record->messages_received += messages_received;
+  record->bytes_received += bytes_received;
+}
 
-  /* remember input quadrant count; it will not increase */
-  old_gnq = p4est->global_num_quadrants;
+void
+p4est_inspect_send (p4est_inspect_t * inspect,
+                    p4est_inspect_algorithm_t algorithm, int peer,
+                    size_t bytes)
+{
+  p4est_inspect_record_t *record;
 
-  P4EST_QUADRANT_INIT (&qtemp);
+  if (inspect == NULL) {
+    return;
+  }
+  P4EST_ASSERT (0 <= algorithm && algorithm < P4EST_INSPECT_NUM_ALGORITHMS);
+  P4EST_ASSERT (peer >= 0);
+  record = &inspect->records[algorithm];
+  if (record->peer_sends == 0 || bytes < record->peer_bytes_min) {
+    record->peer_bytes_min = bytes;
+  }
+  record->peer_bytes_max = SC_MAX (record->peer_bytes_max, bytes);
+  record->peer_bytes += bytes;
+  ++record->peer_sends;
+  if (bytes == 0) {
+    ++record->peer_zero_sends;
+  }
+  if (inspect->peer_matrix != NULL) {
+    P4EST_ASSERT (peer < inspect->peer_matrix_size);
+    inspect->peer_matrix[algorithm * inspect->peer_matrix_size + peer] +=
+      bytes;
+  }
+}
 
-  /* loop over all local trees */
-  prev_offset = 0;
-  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
-    tree = p4est_tree_array_index (p4est->trees, jt);
-    tquadrants = &tree->quadrants;
-#ifdef P4EST_ENABLE_DEBUG
-    data_pool_size = 0;
-    if (p4est->user_data_pool != NULL) {
-      data_pool_size = p4est->user_data_pool->elem_count;
-    }
-#endif
-    removed = 0;
+void
+p4est_inspect_peers_enable (p4est_inspect_t * inspect, int mpisize)
+{
+  P4EST_ASSERT (inspect != NULL);
+  P4EST_ASSERT (mpisize > 0);
 
-    /* initial log message for this tree */
-    P4EST_VERBOSEF ("Into coarsen tree %lld with %llu\n", (long long) jt,
-                    (unsigned long long) tquadrants->elem_count);
+  P4EST_FREE (inspect->peer_matrix);
+  inspect->peer_matrix_size = mpisize;
+  inspect->peer_matrix = P4EST_ALLOC_ZERO (size_t, (size_t) mpisize *
+                                           P4EST_INSPECT_NUM_ALGORITHMS);
+}
 
-    /* state information */
-    window = 0;                 /* start position of sliding window in array */
-    start = 1;                  /* start position of hole in window/array */
-    length = 0;                 /* length of hole in window/array */
+void
+p4est_inspect_peers_disable (p4est_inspect_t * inspect)
+{
+  P4EST_ASSERT (inspect != NULL);
 
-    /* run through the array and coarsen recursively */
-    incount = tquadrants->elem_count;
-    while (window + P4EST_CHILDREN + length <= incount) {
-      P4EST_ASSERT (window < start);
+  P4EST_FREE (inspect->peer_matrix);
+  inspect->peer_matrix = NULL;
+  inspect->peer_matrix_size = 0;
+}
 
-      cidz = incount;
-      isfamily = 1;
-      for (zz = 0; zz < P4EST_CHILDREN; ++zz) {
-        c[zz] = (window + zz < start) ?
-          p4est_quadrant_array_index (tquadrants, window + zz) :
-          p4est_quadrant_array_index (tquadrants, window + length + zz);
+int
+p4est_inspect_peers_write (p4est_t * p4est, const char *filename)
+{
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+  int                 mpiret;
+  int                 k, p, q;
+  int                 failed;
+  size_t             *row;
+  p4est_gloidx_t     *send, *recv, total;
+  FILE               *file;
 
-        if (zz != (size_t) p4est_quadrant_child_id (c[zz])) {
-          isfamily = 0;
-          if (callback_orphans) {
-            c[1] = NULL;
-            (void) coarsen_fn (p4est, jt, c);
-          }
-          break;
-        }
-      }
-      /* in a complete tree, the only way P4EST_CHILDREN consecutive quadrants
-       * have the correct consecutive child_id's is if they are, in fact, a
-       * family.
-       */
-      P4EST_ASSERT (!isfamily || p4est_quadrant_is_familypv (c));
-      if (isfamily && coarsen_fn (p4est, jt, c)) {
-        /* coarsen this family of quadrants */
-        if (replace_fn == NULL) {
-          for (zz = 0; zz < P4EST_CHILDREN; ++zz) {
-            p4est_quadrant_free_data (p4est, c[zz]);
-          }
-        }
-        tree->quadrants_per_level[c[0]->level] -= P4EST_CHILDREN;
-        cfirst = c[0];
-        if (replace_fn != NULL) {
-          qtemp = *(c[0]);
-          c[0] = &qtemp;
-        }
-        p4est_quadrant_parent (c[0], cfirst);
-        p4est_quadrant_init_data (p4est, jt, cfirst, init_fn);
-        tree->quadrants_per_level[cfirst->level] += 1;
-        p4est->local_num_quadrants -= P4EST_CHILDREN - 1;
-        removed += P4EST_CHILDREN - 1;
-
-        cidz = (size_t) p4est_quadrant_child_id (cfirst);
-        start = window + 1;
-        length += P4EST_CHILDREN - 1;
-
-        if (replace_fn != NULL) {
-          replace_fn (p4est, jt, P4EST_CHILDREN, c, 1, &cfirst);
-          for (zz = 0; zz < P4EST_CHILDREN; zz++) {
-            p4est_quadrant_free_data (p4est, c[zz]);
-          }
-        }
-      }
+  P4EST_ASSERT (p4est->inspect != NULL);
+  P4EST_ASSERT (p4est->inspect->peer_matrix != NULL);
+  P4EST_ASSERT (p4est->inspect->peer_matrix_size == num_procs);
+  P4EST_ASSERT (filename != NULL);
 
-      if (cidz <= window && coarsen_recursive) {
-        window -= cidz;
-      }
-      else {
-        ++window;
-        if (window == start && start + length < incount) {
-          if (length > 0) {
-            cfirst = p4est_quadrant_array_index (tquadrants, start);
-            clast = p4est_quadrant_array_index (tquadrants, start + length);
-            *cfirst = *clast;
-          }
-          start = window + 1;
-        }
-      }
+  /* only rank zero opens the file, but everybody takes part in gathering */
+  file = NULL;
+  failed = 0;
+  if (rank == 0) {
+    file = fopen (filename, "wb");
+    if (file == NULL) {
+      P4EST_LERRORF ("Could not open %s for writing\n", filename);
+      failed = 1;
     }
-
-    /* adjust final array size */
-    if (length > 0) {
-      for (zz = start + length; zz < incount; ++zz) {
-        cfirst = p4est_quadrant_array_index (tquadrants, zz - length);
-        clast = p4est_quadrant_array_index (tquadrants, zz);
-        *cfirst = *clast;
-      }
-      sc_array_resize (tquadrants, incount - length);
+  }
+  send = P4EST_ALLOC (p4est_gloidx_t, num_procs);
+  recv = rank == 0 ? P4EST_ALLOC (p4est_gloidx_t,
+                                  (size_t) num_procs * num_procs) : NULL;
+  for (k = 0; k < P4EST_INSPECT_NUM_ALGORITHMS; ++k) {
+    row = p4est->inspect->peer_matrix + k * num_procs;
+    for (q = 0; q < num_procs; ++q) {
+      send[q] = (p4est_gloidx_t) row[q];
     }
-
-    /* call remaining orphans */
-    if (callback_orphans) {
-      c[1] = NULL;
-      for (zz = window; zz < incount - length; ++zz) {
-        c[0] = p4est_quadrant_array_index (tquadrants, zz);
-        (void) coarsen_fn (p4est, jt, c);
-      }
+    mpiret = sc_MPI_Gather (send, num_procs, P4EST_MPI_GLOIDX,
+                            recv, num_procs, P4EST_MPI_GLOIDX,
+                            0, p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+    if (file == NULL) {
+      continue;
     }
 
-    /* compute maximum level */
-    maxlevel = 0;
-    num_quadrants = 0;
-    for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
-      P4EST_ASSERT (tree->quadrants_per_level[i] >= 0);
-      num_quadrants += tree->quadrants_per_level[i];    /* same type */
-      if (tree->quadrants_per_level[i] > 0) {
-        maxlevel = i;
-      }
+    /* skip the algorithms that have not sent anything */
+    total = 0;
+    for (p = 0; p < num_procs * num_procs; ++p) {
+      total += recv[p];
     }
-    tree->maxlevel = (int8_t) maxlevel;
-    tree->quadrants_offset = prev_offset;
-    prev_offset += num_quadrants;
-
-    /* do some sanity checks */
-    P4EST_ASSERT (num_quadrants == (p4est_locidx_t) tquadrants->elem_count);
-    P4EST_ASSERT (tquadrants->elem_count == incount - removed);
-    if (p4est->user_data_pool != NULL) {
-      P4EST_ASSERT (data_pool_size - removed ==
-                    p4est->user_data_pool->elem_count);
+    if (total == 0) {
+      continue;
+    }
+    fprintf (file, "# %s bytes sent from row rank to column rank\n",
+             p4est_inspect_algorithm_names[k]);
+    for (p = 0; p < num_procs; ++p) {
+      for (q = 0; q < num_procs; ++q) {
+        fprintf (file, q == 0 ? "%lld" : " %lld",
+                 (long long) recv[p * num_procs + q]);
+      }
+      fputc ('\n', file);
     }
-    P4EST_ASSERT (p4est_tree_is_sorted (tree));
-    P4EST_ASSERT (p4est_tree_is_complete (tree));
-
-    /* final log message for this tree */
-    P4EST_VERBOSEF ("Done coarsen tree %lld now %llu\n", (long long) jt,
-                    (unsigned long long) tquadrants->elem_count);
   }
-  if (p4est->last_local_tree >= 0) {
-    for (; jt < p4est->connectivity->num_trees; ++jt) {
-      tree = p4est_tree_array_index (p4est->trees, jt);
-      tree->quadrants_offset = p4est->local_num_quadrants;
+  P4EST_FREE (send);
+  P4EST_FREE (recv);
+  if (file != NULL) {
+    failed = ferror (file) != 0;
+    if (fclose (file) != 0) {
+      failed = 1;
+    }
+    if (failed) {
+      P4EST_LERRORF ("Could not write %s\n", filename);
     }
   }
 
-  /* compute global number of quadrants */
-  p4est_comm_count_quadrants (p4est);
-  P4EST_ASSERT (p4est->global_num_quadrants <= old_gnq);
-  if (old_gnq != p4est->global_num_quadrants) {
-    ++p4est->revision;
-  }
+  /* everybody reports the same result */
+  mpiret = sc_MPI_Bcast (&failed, 1, sc_MPI_INT, 0, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  return failed;
+}
 
-  P4EST_ASSERT (p4est_is_valid (p4est));
-  p4est_log_indent_pop ();
-  P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
-                            "_coarsen with %lld total quadrants\n",
-                            (long long) p4est->global_num_quadrants);
+void
+p4est_inspect_memory (p4est_inspect_t * inspect,
+                      p4est_inspect_algorithm_t algorithm, size_t bytes)
+{
+  p4est_inspect_record_t *record;
+
+  if (inspect == NULL) {
+    return;
+  }
+  P4EST_ASSERT (0 <= algorithm && algorithm < P4EST_INSPECT_NUM_ALGORITHMS);
+  record = &inspect->records[algorithm];
+  record->memory = SC_MAX (record->memory, bytes);
 }
 
-/** Check if the insulation layer of a quadrant overlaps anybody.
- * If yes, the quadrant itself is scheduled for sending.
- * Both quadrants are in the receiving tree's coordinates.
- * \param [in]  qtree       Tree id of the receiving tree.
- * \param [in]  inter_tree  Boolean flag to specify inter-tree communication.
- * \param [in]  q           The quadrant to be sent if there is overlap.
- * \param [in]  insul       An insulation quadrant of \a q.
- * \param [in,out]  first_peer  Lowest peer, will be updated.
- * \param [in,out]  last_peer   Highest peer, will be updated.
- */
-static void
-p4est_balance_schedule (p4est_t * p4est, p4est_balance_peer_t * peers,
-                        p4est_topidx_t qtree, int inter_tree,
-                        const p4est_quadrant_t * q,
-                        const p4est_quadrant_t * insul,
-                        int *first_peer, int *last_peer)
+void
+p4est_inspect_alloc (p4est_inspect_t * inspect,
+                     p4est_inspect_algorithm_t algorithm, size_t bytes)
 {
-  const int           rank = p4est->mpirank;
-  int                 found;
-  int                 back, pos;
-  int                 owner, first_owner, last_owner;
-  p4est_gloidx_t     *global_first_quadrant = p4est->global_first_quadrant;
-  p4est_quadrant_t    ld, *s;
-  p4est_balance_peer_t *peer;
+  p4est_inspect_record_t *record;
 
-  P4EST_QUADRANT_INIT (&ld);
+  if (inspect == NULL) {
+    return;
+  }
+  P4EST_ASSERT (0 <= algorithm && algorithm < P4EST_INSPECT_NUM_ALGORITHMS);
+  record = &inspect->records[algorithm];
+  record->memory_current += bytes;
+  record->memory_peak = SC_MAX (record->memory_peak, record->memory_current);
+  inspect->memory_current += bytes;
+  inspect->memory_peak = SC_MAX (inspect->memory_peak,
+                                 inspect->memory_current);
+}
 
-  /* querying insul is equivalent to querying first descendant */
-  first_owner = p4est_comm_find_owner (p4est, qtree, insul, rank);
-  /* querying last descendant */
-  p4est_quadrant_last_descendant (insul, &ld, P4EST_QMAXLEVEL);
-  last_owner = p4est_comm_find_owner (p4est, qtree, &ld, rank);
+void
+p4est_inspect_free (p4est_inspect_t * inspect,
+                    p4est_inspect_algorithm_t algorithm, size_t bytes)
+{
+  p4est_inspect_record_t *record;
 
-  /* send to all processors possibly intersecting insulation */
-  for (owner = first_owner; owner <= last_owner; ++owner) {
-    if (owner == rank && !inter_tree) {
-      /* do not send to self for the same tree */
-      continue;
-    }
-    if (global_first_quadrant[owner] == global_first_quadrant[owner + 1]) {
-      /* do not send to empty processors */
-      continue;
-    }
-    peer = peers + owner;
-    /* avoid duplicates in the send array */
-    found = 0;
-    for (back = 0; back < P4EST_INSUL - 1; ++back) {
-      pos = (int) peer->send_first.elem_count - back - 1;
-      if (pos < 0) {
-        break;
-      }
-      s = (p4est_quadrant_t *) sc_array_index_int (&peer->send_first, pos);
-      if (p4est_quadrant_is_equal (s, q) && s->p.piggy2.which_tree == qtree
-          && s->p.piggy2.from_tree == q->p.piggy2.from_tree
-          && s->pad16 == q->pad16) {
-        found = 1;
-        break;
-      }
-    }
-    if (found) {
-      continue;
-    }
-
-    /* copy quadrant into shipping list */
-    s = p4est_quadrant_array_push_copy (&peer->send_first, q);
-    s->p.piggy2.which_tree = qtree;     /* piggy back tree id */
-
-    /* update lowest and highest peer */
-    if (owner != rank) {
-      *first_peer = SC_MIN (owner, *first_peer);
-      *last_peer = SC_MAX (owner, *last_peer);
-    }
+  if (inspect == NULL) {
+    return;
   }
+  P4EST_ASSERT (0 <= algorithm && algorithm < P4EST_INSPECT_NUM_ALGORITHMS);
+  record = &inspect->records[algorithm];
+  P4EST_ASSERT (record->memory_current >= bytes);
+  P4EST_ASSERT (inspect->memory_current >= bytes);
+  record->memory_current -= bytes;
+  inspect->memory_current -= bytes;
 }
 
-static void
-p4est_balance_response (p4est_t * p4est, p4est_balance_peer_t * peer,
-                        p4est_connect_type_t balance, sc_array_t * borders)
+int
+p4est_inspect_memory_tight (p4est_inspect_t * inspect, size_t bytes)
 {
-  sc_array_t         *first_seeds = sc_array_new (sizeof (p4est_quadrant_t));
+  return inspect != NULL && inspect->memory_budget > 0 &&
+    inspect->memory_current + bytes > inspect->memory_budget;
+}
 
-/* compute and uniqify overlap quadrants */
-  p4est_tree_compute_overlap (p4est, &peer->recv_first,
-                              &peer->send_second, balance, borders,
-                              first_seeds);
-  /* replace peer->recv_first with first_seeds */
-  p4est_tree_uniqify_overlap (&peer->send_second);
-  p4est_tree_uniqify_overlap (first_seeds);
-  /* replace peer->recv_first with first_seeds */
-  sc_array_resize (&peer->recv_first, first_seeds->elem_count);
-  memcpy (peer->recv_first.array, first_seeds->array,
-          first_seeds->elem_size * first_seeds->elem_count);
-  sc_array_destroy (first_seeds);
+void
+p4est_inspect_reset (p4est_inspect_t * inspect)
+{
+  int                 k;
+  size_t              current[P4EST_INSPECT_NUM_ALGORITHMS];
 
-  if (p4est->inspect) {
-    p4est->inspect->balance_comm_sent += peer->send_second.elem_count;
-    if (peer->send_second.elem_count) {
-      p4est->inspect->balance_comm_nzpeers++;
-    }
+  P4EST_ASSERT (inspect != NULL);
+
+  /* memory still held must be released against the records */
+  for (k = 0; k < P4EST_INSPECT_NUM_ALGORITHMS; ++k) {
+    current[k] = inspect->records[k].memory_current;
+  }
+  memset (inspect->records, 0, sizeof (inspect->records));
+  for (k = 0; k < P4EST_INSPECT_NUM_ALGORITHMS; ++k) {
+    inspect->records[k].memory_current = current[k];
+    inspect->records[k].memory_peak = current[k];
+  }
+  inspect->memory_peak = inspect->memory_current;
+  if (inspect->peer_matrix != NULL) {
+    memset (inspect->peer_matrix, 0, sizeof (size_t) *
+            inspect->peer_matrix_size * P4EST_INSPECT_NUM_ALGORITHMS);
   }
 }
 
 void
-p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
-               p4est_init_t init_fn)
+p4est_inspect_statistics (p4est_t * p4est, int log_priority)
 {
-  p4est_balance_ext (p4est, btype, init_fn, NULL);
+  int                 k, l;
+  double              values[P4EST_INSPECT_NUM_STATS];
+  char                names[P4EST_INSPECT_NUM_ALGORITHMS *
+                            P4EST_INSPECT_NUM_STATS]
+    [P4EST_INSPECT_NAME_LENGTH];
+  p4est_inspect_record_t *record;
+  sc_statinfo_t       stats[P4EST_INSPECT_NUM_ALGORITHMS *
+                            P4EST_INSPECT_NUM_STATS], *st;
+
+  P4EST_ASSERT (p4est->inspect != NULL);
+
+  for (k = 0; k < P4EST_INSPECT_NUM_ALGORITHMS; ++k) {
+    record = &p4est->inspect->records[k];
+    values[0] = (double) record->calls;
+    values[1] = record->time;
+    values[2] = (double) record->peers;
+    values[3] = (double) (record->messages_sent + record->messages_received);
+    values[4] = (double) record->bytes_sent;
+    values[5] = (double) record->bytes_received;
+    values[6] = (double) record->memory;
+    values[7] = (double) record->memory_peak;
+    values[8] = (double) record->peer_zero_sends;
+    values[9] = (double) record->peer_bytes_min;
+    values[10] = record->peer_sends == 0 ? 0. :
+      (double) record->peer_bytes / (double) record->peer_sends;
+    values[11] = (double) record->peer_bytes_max;
+
+    st = stats + k * P4EST_INSPECT_NUM_STATS;
+    for (l = 0; l < P4EST_INSPECT_NUM_STATS; ++l) {
+      snprintf (names[k * P4EST_INSPECT_NUM_STATS + l],
+                P4EST_INSPECT_NAME_LENGTH, "%s %s",
+                p4est_inspect_algorithm_names[k],
+                p4est_inspect_stat_names[l]);
+      sc_stats_set1 (st + l, values[l],
+                     names[k * P4EST_INSPECT_NUM_STATS + l]);
+    }
+  }
+  sc_stats_compute (p4est->mpicomm,
+                    P4EST_INSPECT_NUM_ALGORITHMS * P4EST_INSPECT_NUM_STATS,
+                    stats);
+
+  /* skip the algorithms that have not been called anywhere */
+  for (k = 0; k < P4EST_INSPECT_NUM_ALGORITHMS; ++k) {
+    st = stats + k * P4EST_INSPECT_NUM_STATS;
+    if (st->max > 0.) {
+      sc_stats_print (p4est_package_id, log_priority,
+                      P4EST_INSPECT_NUM_STATS, st, 1, 0);
+    }
+  }
 }
 
 void
-p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
-                   p4est_init_t init_fn, p4est_replace_t replace_fn)
+p4est_refine (p4est_t * p4est, int refine_recursive,
+              p4est_refine_t refine_fn, p4est_init_t init_fn)
+{
+  p4est_refine_ext (p4est, refine_recursive, -1, refine_fn, init_fn, NULL);
+}
+
+/** Refine the quadrants of one local tree without recursion, in place.
+ * A first pass queries the refine callback for every quadrant and flags
+ * the result in its pad8 field.  The array is then resized once and its
+ * tail moved back to front, leaving each flagged quadrant in the slot of
+ * its first child.  A final forward pass creates the children.
+ * No working storage beyond the quadrant array is used.
+ * Since all refine callbacks of the tree run before the first child is
+ * created, this is only used without init and replace callbacks.
+ */
+static void
+p4est_refine_tree_inplace (p4est_t * p4est, p4est_topidx_t nt,
+                           int allowed_level, p4est_refine_t refine_fn)
 {
-  const int           rank = p4est->mpirank;
-  const int           num_procs = p4est->mpisize;
-  int                 j, k, l, m, which;
-  int                 face;
-  int                 first_peer, last_peer;
-  int                 quad_contact[P4EST_FACES];
-  int                 any_face, tree_contact[P4EST_FACES];
-  int                 tree_fully_owned, full_tree[2];
-  int8_t             *tree_flags;
-  size_t              zz, treecount, ctree;
-  size_t              localcount;
-  size_t              qcount, qbytes;
-  size_t              all_incount, all_outcount;
-  p4est_qcoord_t      qh;
-  const p4est_qcoord_t rh = P4EST_ROOT_LEN;
-  p4est_topidx_t      qtree, nt;
-  p4est_topidx_t      first_tree, last_tree;
-  p4est_locidx_t      skipped;
-  p4est_gloidx_t      old_gnq;
-  p4est_balance_peer_t *peers, *peer;
-  p4est_tree_t       *tree;
-  p4est_quadrant_t    mylow, nextlow;
-  p4est_quadrant_t    tosend, insulq, tempq;
-  p4est_quadrant_t   *q, *s;
-  p4est_connectivity_t *conn = p4est->connectivity;
-  sc_array_t         *qarray, *tquadrants;
-  sc_array_t         *borders;
 #ifdef P4EST_ENABLE_DEBUG
   size_t              data_pool_size;
 #endif
-  int                 ftransform[P4EST_FTRANSFORM];
-  int                 face_axis[3];     /* 3 not P4EST_DIM */
-  int                 contact_face_only;
-#ifdef P4_TO_P8
-  int                 contact_edge_only;
-  int                 edge;
-  size_t              etree;
-  p8est_edge_info_t   ei;
-  p8est_edge_transform_t *et;
-  sc_array_t         *eta;
-#endif
-  int                 corner;
-  p4est_corner_info_t ci;
-  p4est_corner_transform_t *ct;
-  sc_array_t         *cta;
-#ifdef P4EST_ENABLE_MPI
-#ifdef P4EST_ENABLE_DEBUG
-  unsigned            checksum;
-  sc_array_t          checkarray;
-  p4est_gloidx_t      ltotal[2], gtotal[2];
-#endif /* P4EST_ENABLE_DEBUG */
-  int                 i;
-  int                 mpiret, rcount;
-  int                 first_bound;
-  int                 request_first_count, request_second_count, outcount;
-  int                 request_send_count, total_send_count, total_recv_count;
-  int                 nwin, maxpeers, maxwin, twomaxwin;
-  int                 send_zero[2], send_load[2];
-  int                 recv_zero[2], recv_load[2];
-  int                 my_ranges[2 * p4est_num_ranges];
-  int                *wait_indices;
-  int                *procs, *all_ranges;
-  int                *receiver_ranks, *sender_ranks;
-  int                 num_receivers, num_senders;
-  int                *receiver_ranks_ranges, *sender_ranks_ranges;
-  int                 num_receivers_ranges, num_senders_ranges;
-  int                *receiver_ranks_notify, *sender_ranks_notify;
-  int                 num_receivers_notify, num_senders_notify;
-  int                 is_ranges_primary, is_balance_verify;
-  int                 is_ranges_active, is_notify_active;
-  int                 max_ranges;
-  MPI_Request        *requests_first, *requests_second;
-  MPI_Request        *send_requests_first_count, *send_requests_first_load;
-  MPI_Request        *send_requests_second_count, *send_requests_second_load;
-  MPI_Status         *recv_statuses, *jstatus;
-#endif /* P4EST_ENABLE_MPI */
-
-  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
-                            "_balance %s with %lld total quadrants\n",
-                            p4est_connect_type_string (btype),
-                            (long long) p4est->global_num_quadrants);
-  p4est_log_indent_push ();
-  P4EST_ASSERT (p4est_is_valid (p4est));
-#ifndef P4_TO_P8
-  P4EST_ASSERT (btype == P4EST_CONNECT_FACE || btype == P4EST_CONNECT_CORNER);
-#else
-  P4EST_ASSERT (btype == P8EST_CONNECT_FACE || btype == P8EST_CONNECT_EDGE ||
-                btype == P8EST_CONNECT_CORNER);
-#endif
-
-  /* remember input quadrant count; it will not decrease */
-  old_gnq = p4est->global_num_quadrants;
+  int                 i, maxlevel;
+  size_t              incount, first, added, zz, current;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, *children;
+  sc_array_t         *tquadrants;
+  p4est_quadrant_t    parent;
 
+  tree = p4est_tree_array_index (p4est->trees, nt);
+  tquadrants = &tree->quadrants;
 #ifdef P4EST_ENABLE_DEBUG
   data_pool_size = 0;
   if (p4est->user_data_pool != NULL) {
-    data_pool_size = p4est->user_data_pool->elem_count;
+    data_pool_size = p4est_quadrant_data_count (p4est);
   }
 #endif
 
-  P4EST_QUADRANT_INIT (&mylow);
-  P4EST_QUADRANT_INIT (&nextlow);
-  P4EST_QUADRANT_INIT (&tosend);
-  P4EST_QUADRANT_INIT (&insulq);
-  P4EST_QUADRANT_INIT (&tempq);
+  /* initial log message for this tree */
+  P4EST_VERBOSEF ("Into refine tree %lld with %llu\n", (long long) nt,
+                  (unsigned long long) tquadrants->elem_count);
 
-  /* tree status flags (max 8 per tree) */
-  tree_flags = P4EST_ALLOC (int8_t, conn->num_trees);
-  for (nt = 0; nt < conn->num_trees; ++nt) {
-    tree_flags[nt] = 0x00;
+  /* reset the quadrant counters */
+  maxlevel = 0;
+  for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
+    tree->quadrants_per_level[i] = 0;
   }
 
-  localcount = (size_t) (p4est->last_local_tree + 1 -
-                         p4est->first_local_tree);
-  borders = sc_array_new_size (sizeof (sc_array_t), localcount);
-  for (zz = 0; zz < localcount; zz++) {
-    qarray = (sc_array_t *) sc_array_index (borders, zz);
-    sc_array_init (qarray, sizeof (p4est_quadrant_t));
+  /* flag the quadrants to refine and count the result */
+  incount = tquadrants->elem_count;
+  first = incount;
+  added = 0;
+  for (zz = 0; zz < incount; ++zz) {
+    q = p4est_quadrant_array_index (tquadrants, zz);
+    if (refine_fn (p4est, nt, q) && (int) q->level < allowed_level) {
+      q->pad8 = 1;
+      first = SC_MIN (first, zz);
+      added += P4EST_CHILDREN - 1;
+      maxlevel = SC_MAX (maxlevel, (int) q->level + 1);
+      tree->quadrants_per_level[q->level + 1] += P4EST_CHILDREN;
+    }
+    else {
+      q->pad8 = 0;
+      maxlevel = SC_MAX (maxlevel, (int) q->level);
+      ++tree->quadrants_per_level[q->level];
+    }
+  }
+  tree->maxlevel = (int8_t) maxlevel;
+  if (added == 0) {
+    /* no refinement occurs in this tree */
+    return;
   }
 
-#ifdef P4EST_ENABLE_MPI
-  requests_first = P4EST_ALLOC (MPI_Request, 6 * num_procs);
-  requests_second = requests_first + 1 * num_procs;
-  send_requests_first_count = requests_first + 2 * num_procs;
-  send_requests_first_load = requests_first + 3 * num_procs;
-  send_requests_second_count = requests_first + 4 * num_procs;
-  send_requests_second_load = requests_first + 5 * num_procs;
-  recv_statuses = P4EST_ALLOC (MPI_Status, num_procs);
-  for (j = 0; j < num_procs; ++j) {
-    requests_first[j] = requests_second[j] = MPI_REQUEST_NULL;
-    send_requests_first_count[j] = MPI_REQUEST_NULL;
-    send_requests_first_load[j] = MPI_REQUEST_NULL;
-    send_requests_second_count[j] = MPI_REQUEST_NULL;
-    send_requests_second_load[j] = MPI_REQUEST_NULL;
+  /* move the tail of the array to its final position back to front */
+  sc_array_resize (tquadrants, incount + added);
+  current = incount + added;
+  for (zz = incount; zz > first; --zz) {
+    q = p4est_quadrant_array_index (tquadrants, zz - 1);
+    current -= q->pad8 ? P4EST_CHILDREN : 1;
+    if (current != zz - 1) {
+      *p4est_quadrant_array_index (tquadrants, current) = *q;
+    }
+  }
+  P4EST_ASSERT (current == first);
+
+  /* create the children front to back */
+  P4EST_QUADRANT_INIT (&parent);
+  for (current = first; current < incount + added;) {
+    q = p4est_quadrant_array_index (tquadrants, current);
+    if (!q->pad8) {
+      ++current;
+      continue;
+    }
+    parent = *q;
+    parent.pad8 = 0;
+    p4est_quadrant_free_data (p4est, &parent);
+    children = q;
+    p4est_quadrant_childrenv (&parent, children);
+    for (i = 0; i < P4EST_CHILDREN; ++i) {
+      children[i].pad8 = 0;
+      p4est_quadrant_init_data (p4est, nt, children + i, NULL);
+    }
+    current += P4EST_CHILDREN;
   }
-  wait_indices = P4EST_ALLOC (int, num_procs);
-#ifdef P4EST_ENABLE_DEBUG
-  sc_array_init (&checkarray, 4);
-#endif /* P4EST_ENABLE_DEBUG */
-#endif /* P4EST_ENABLE_MPI */
 
-  /* allocate per peer storage and initialize requests */
-  peers = P4EST_ALLOC (p4est_balance_peer_t, num_procs);
-  for (j = 0; j < num_procs; ++j) {
-    peer = peers + j;
-    sc_array_init (&peer->send_first, sizeof (p4est_quadrant_t));
-    sc_array_init (&peer->send_second, sizeof (p4est_quadrant_t));
-    sc_array_init (&peer->recv_first, sizeof (p4est_quadrant_t));
-    sc_array_init (&peer->recv_second, sizeof (p4est_quadrant_t));
-    peer->send_first_count = peer->send_second_count = 0;
-    peer->recv_first_count = peer->recv_second_count = 0;
-    peer->have_first_count = peer->have_first_load = 0;
-    peer->have_second_count = peer->have_second_load = 0;
+  if (p4est->user_data_pool != NULL && !p4est_in_parallel_region ()) {
+    P4EST_ASSERT (data_pool_size + tquadrants->elem_count ==
+                  p4est_quadrant_data_count (p4est) + incount);
+  }
+  P4EST_ASSERT (p4est_tree_is_sorted (tree));
+  P4EST_ASSERT (p4est_tree_is_complete (tree));
+  if (p4est->balance_dirty != NULL) {
+    p4est->balance_dirty[nt] = 1;
+  }
+  if (p4est->valid_dirty != NULL) {
+    p4est->valid_dirty[nt] = 1;
   }
-#ifdef P4_TO_P8
-  eta = &ei.edge_transforms;
-  sc_array_init (eta, sizeof (p8est_edge_transform_t));
-#endif
-  cta = &ci.corner_transforms;
-  sc_array_init (cta, sizeof (p4est_corner_transform_t));
 
-  /* compute first quadrant on finest level */
-  mylow.x = p4est->global_first_position[rank].x;
-  mylow.y = p4est->global_first_position[rank].y;
-#ifdef P4_TO_P8
-  mylow.z = p4est->global_first_position[rank].z;
-#endif
-  mylow.level = P4EST_QMAXLEVEL;
+  /* final log message for this tree */
+  P4EST_VERBOSEF ("Done refine tree %lld now %llu\n", (long long) nt,
+                  (unsigned long long) tquadrants->elem_count);
+}
 
-  /* and the first finest quadrant of the next processor */
-  nextlow.x = p4est->global_first_position[rank + 1].x;
-  nextlow.y = p4est->global_first_position[rank + 1].y;
-#ifdef P4_TO_P8
-  nextlow.z = p4est->global_first_position[rank + 1].z;
+/** Refine the quadrants of one local tree.
+ * The tree's quadrant offset and the processor's quadrant count are
+ * not touched; the caller updates them after all trees are done.
+ * Non-recursive refinement without init and replace callbacks is done in
+ * place, see \ref p4est_refine_tree_inplace.  Otherwise, each refine
+ * callback is followed by the init and replace callbacks of its children
+ * before the next quadrant is queried.
+ * \param [in] list             Empty list to use as working storage.
+ * \param [in] quadrant_pool    Pool for the quadrants in \a list.
+ *                              Must not be used by any other thread.
+ */
+static void
+p4est_refine_tree (p4est_t * p4est, p4est_topidx_t nt,
+                   int refine_recursive, int allowed_level,
+                   p4est_refine_t refine_fn, p4est_init_t init_fn,
+                   p4est_replace_t replace_fn,
+                   sc_list_t * list, sc_mempool_t * quadrant_pool)
+{
+#ifdef P4EST_ENABLE_DEBUG
+  size_t              quadrant_pool_size, data_pool_size;
 #endif
-  nextlow.level = P4EST_QMAXLEVEL;
-
-  /* start balance_A timing */
-  if (p4est->inspect != NULL) {
-    p4est->inspect->balance_A = -sc_MPI_Wtime ();
-    p4est->inspect->balance_A_count_in = 0;
-    p4est->inspect->balance_A_count_out = 0;
-    p4est->inspect->use_B = 0;
+  int                 firsttime;
+  int                 i, maxlevel;
+  size_t              incount, current, restpos, movecount;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, *qalloc, *qpop;
+  p4est_quadrant_t   *c0, *c1, *c2, *c3;
+#ifdef P4_TO_P8
+  p4est_quadrant_t   *c4, *c5, *c6, *c7;
+#endif
+  sc_array_t         *tquadrants;
+  p4est_quadrant_t   *family[8];
+  p4est_quadrant_t    parent, *pp = &parent;
+
+  if (!refine_recursive && init_fn == NULL && replace_fn == NULL) {
+    p4est_refine_tree_inplace (p4est, nt, allowed_level, refine_fn);
+    return;
   }
 
-  /* loop over all local trees to assemble first send list */
-  first_tree = p4est->first_local_tree;
-  last_tree = p4est->last_local_tree;
-  first_peer = num_procs;
-  last_peer = -1;
-  all_incount = 0;
-  skipped = 0;
-  for (nt = first_tree; nt <= last_tree; ++nt) {
-    p4est_comm_tree_info (p4est, nt, full_tree, tree_contact, NULL, NULL);
-    tree_fully_owned = full_tree[0] && full_tree[1];
-    any_face = 0;
-    for (face = 0; face < P4EST_FACES; ++face) {
-      any_face = any_face || tree_contact[face];
-    }
-    if (any_face) {
-      tree_flags[nt] |= any_face_flag;
-    }
-    tree = p4est_tree_array_index (p4est->trees, nt);
-    tquadrants = &tree->quadrants;
-    all_incount += tquadrants->elem_count;
+  /*
+     q points to a quadrant that is an array member
+     qalloc is a quadrant that has been allocated through quadrant_pool
+     qpop is a quadrant that has been allocated through quadrant_pool
+     never mix these two types of quadrant pointers
 
-    /* initial log message for this tree */
-    P4EST_VERBOSEF ("Into balance tree %lld with %llu\n", (long long) nt,
-                    (unsigned long long) tquadrants->elem_count);
+     The quadrant->pad8 field of list quadrants is interpreted as boolean
+     and set to true for quadrants that have already been refined.
+   */
+  tree = p4est_tree_array_index (p4est->trees, nt);
+  tquadrants = &tree->quadrants;
+#ifdef P4EST_ENABLE_DEBUG
+  quadrant_pool_size = quadrant_pool->elem_count;
+  data_pool_size = 0;
+  if (p4est->user_data_pool != NULL) {
+    data_pool_size = p4est_quadrant_data_count (p4est);
+  }
+#endif
 
-    /* local balance first pass */
-    p4est_balance_subtree_ext (p4est, btype, nt, init_fn, replace_fn);
-    treecount = tquadrants->elem_count;
-    P4EST_VERBOSEF ("Balance tree %lld A %llu\n",
-                    (long long) nt, (unsigned long long) treecount);
+  /* initial log message for this tree */
+  P4EST_VERBOSEF ("Into refine tree %lld with %llu\n", (long long) nt,
+                  (unsigned long long) tquadrants->elem_count);
 
-    /* check if this tree is not shared with other processors */
-    if (tree_fully_owned) {
-      /* all quadrants in this tree are owned by me */
-      tree_flags[nt] |= fully_owned_flag;
-      if (!any_face) {
-        /* this tree is isolated, no balance between trees */
-        continue;
-      }
-    }
+  /* reset the quadrant counters */
+  maxlevel = 0;
+  for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
+    tree->quadrants_per_level[i] = 0;
+  }
 
-    if (borders != NULL) {
-      qarray = (sc_array_t *) sc_array_index (borders,
-                                              (size_t) (nt - first_tree));
-    }
-    else {
-      qarray = NULL;
+  /* run through the array to find first quadrant to be refined */
+  q = NULL;
+  incount = tquadrants->elem_count;
+  for (current = 0; current < incount; ++current) {
+    q = p4est_quadrant_array_index (tquadrants, current);
+    if (refine_fn (p4est, nt, q) && (int) q->level < allowed_level) {
+      break;
     }
+    maxlevel = SC_MAX (maxlevel, (int) q->level);
+    ++tree->quadrants_per_level[q->level];
+  }
+  if (current == incount) {
+    /* no refinement occurs in this tree */
+    return;
+  }
+  P4EST_ASSERT (q != NULL);
 
-    /* identify boundary quadrants and prepare them to be sent */
-    for (zz = 0; zz < treecount; ++zz) {
-      /* this quadrant may be on the boundary with a range of processors */
-      q = p4est_quadrant_array_index (tquadrants, zz);
-      qh = P4EST_QUADRANT_LEN (q->level);
-      if (p4est_comm_neighborhood_owned (p4est, nt,
-                                         full_tree, tree_contact, q)) {
-        /* this quadrant's 3x3 neighborhood is owned by this processor */
-        ++skipped;
-        continue;
-      }
+  /* now we have a quadrant to refine, prepend it to the list */
+  qalloc = p4est_quadrant_mempool_alloc (quadrant_pool);
+  *qalloc = *q;                 /* never prepend array members directly */
+  qalloc->pad8 = 0;             /* this quadrant has not been refined yet */
+  (void) sc_list_prepend (list, qalloc);        /* only new quadrants */
 
-      if (qarray != NULL) {
-        (void) p4est_quadrant_array_push_copy (qarray, q);
-      }
+  P4EST_QUADRANT_INIT (&parent);
 
-#ifdef P4_TO_P8
-      for (m = 0; m < 3; ++m) {
-#if 0
+  /*
+     current points to the next array member to write
+     restpos points to the next array member to read
+   */
+  restpos = current + 1;
+
+  /* run through the list and refine recursively */
+  firsttime = 1;
+  while (list->elem_count > 0) {
+    qpop = p4est_quadrant_list_pop (list);
+    if (firsttime ||
+        ((refine_recursive || !qpop->pad8) &&
+         refine_fn (p4est, nt, qpop) &&
+         (int) qpop->level < allowed_level)) {
+      firsttime = 0;
+      sc_array_resize (tquadrants,
+                       tquadrants->elem_count + P4EST_CHILDREN - 1);
+
+      if (replace_fn != NULL) {
+        /* do not free qpop's data yet: we will do this when the parent
+         * is replaced */
+        parent = *qpop;
       }
-#endif
-#else
-      m = 0;
-#endif
-      for (k = 0; k < 3; ++k) {
-        for (l = 0; l < 3; ++l) {
-          which = m * 9 + k * 3 + l;    /* 2D: 0..8, 3D: 0..26 */
-          /* exclude myself from the queries */
-          if (which == P4EST_INSUL / 2) {
-            continue;
-          }
-          /* may modify insulq below, never modify q itself! */
-          insulq = *q;
-          insulq.x += (l - 1) * qh;
-          insulq.y += (k - 1) * qh;
+      else {
+        p4est_quadrant_free_data (p4est, qpop);
+      }
+      c0 = qpop;
+      c1 = p4est_quadrant_mempool_alloc (quadrant_pool);
+      c2 = p4est_quadrant_mempool_alloc (quadrant_pool);
+      c3 = p4est_quadrant_mempool_alloc (quadrant_pool);
+
 #ifdef P4_TO_P8
-          insulq.z += (m - 1) * qh;
-#endif
-          /* check boundary status of insulation quadrant */
-          quad_contact[0] = (insulq.x < 0);
-          quad_contact[1] = (insulq.x >= rh);
-          face_axis[0] = quad_contact[0] || quad_contact[1];
-          quad_contact[2] = (insulq.y < 0);
-          quad_contact[3] = (insulq.y >= rh);
-          face_axis[1] = quad_contact[2] || quad_contact[3];
-#ifndef P4_TO_P8
-          face_axis[2] = 0;
+      c4 = p4est_quadrant_mempool_alloc (quadrant_pool);
+      c5 = p4est_quadrant_mempool_alloc (quadrant_pool);
+      c6 = p4est_quadrant_mempool_alloc (quadrant_pool);
+      c7 = p4est_quadrant_mempool_alloc (quadrant_pool);
+
+      p8est_quadrant_children (qpop, c0, c1, c2, c3, c4, c5, c6, c7);
 #else
-          quad_contact[4] = (insulq.z < 0);
-          quad_contact[5] = (insulq.z >= rh);
-          face_axis[2] = quad_contact[4] || quad_contact[5];
-          edge = -1;
-          contact_edge_only = 0;
-#endif
-          contact_face_only = 0;
-          face = -1;
-          if (face_axis[0] || face_axis[1] || face_axis[2]) {
-            /* this quadrant is relevant for inter-tree balancing */
-            if (!face_axis[1] && !face_axis[2]) {
-              contact_face_only = 1;
-              face = 0 + quad_contact[1];
-            }
-            else if (!face_axis[0] && !face_axis[2]) {
-              contact_face_only = 1;
-              face = 2 + quad_contact[3];
-            }
-#ifdef P4_TO_P8
-            else if (!face_axis[0] && !face_axis[1]) {
-              contact_face_only = 1;
-              face = 4 + quad_contact[5];
-            }
-            else if (!face_axis[0]) {
-              contact_edge_only = 1;
-              edge = 0 + 2 * quad_contact[5] + quad_contact[3];
-            }
-            else if (!face_axis[1]) {
-              contact_edge_only = 1;
-              edge = 4 + 2 * quad_contact[5] + quad_contact[1];
-            }
-            else if (!face_axis[2]) {
-              contact_edge_only = 1;
-              edge = 8 + 2 * quad_contact[3] + quad_contact[1];
-            }
+      p4est_quadrant_children (qpop, c0, c1, c2, c3);
 #endif
-            if (contact_face_only) {
-              /* square contact across a face */
-#ifdef P4_TO_P8
-              P4EST_ASSERT (!contact_edge_only);
-#endif
-              P4EST_ASSERT (face >= 0 && face < P4EST_FACES);
-              P4EST_ASSERT (quad_contact[face]);
-              qtree = p4est_find_face_transform (conn, nt, face, ftransform);
-              if (qtree >= 0) {
-                P4EST_ASSERT (tree_contact[face]);
-                p4est_quadrant_transform_face (q, &tosend, ftransform);
-                tosend.p.piggy2.from_tree = nt;
-                tosend.pad16 = face;
-                p4est_quadrant_transform_face (&insulq, &tempq, ftransform);
-                p4est_balance_schedule (p4est, peers, qtree, 1,
-                                        &tosend, &tempq,
-                                        &first_peer, &last_peer);
-              }
-              else {
-                /* goes across a face with no neighbor */
-                P4EST_ASSERT (!tree_contact[face]);
-              }
-            }
+      p4est_quadrant_init_data (p4est, nt, c0, init_fn);
+      p4est_quadrant_init_data (p4est, nt, c1, init_fn);
+      p4est_quadrant_init_data (p4est, nt, c2, init_fn);
+      p4est_quadrant_init_data (p4est, nt, c3, init_fn);
+      c0->pad8 = c1->pad8 = c2->pad8 = c3->pad8 = 1;
+
 #ifdef P4_TO_P8
-            else if (contact_edge_only) {
-              /* this quadrant crosses an edge */
-              P4EST_ASSERT (!contact_face_only);
-              P4EST_ASSERT (edge >= 0 && edge < P8EST_EDGES);
-              p8est_find_edge_transform (conn, nt, edge, &ei);
-              for (etree = 0; etree < eta->elem_count; ++etree) {
-                et = p8est_edge_array_index (eta, etree);
-                p8est_quadrant_transform_edge (q, &tosend, &ei, et, 0);
-                tosend.p.piggy2.from_tree = nt;
-                tosend.pad16 = edge;
-                p8est_quadrant_transform_edge (&insulq, &tempq, &ei, et, 1);
-                p4est_balance_schedule (p4est, peers, et->ntree, 1,
-                                        &tosend, &tempq,
-                                        &first_peer, &last_peer);
-              }
-            }
+      p4est_quadrant_init_data (p4est, nt, c4, init_fn);
+      p4est_quadrant_init_data (p4est, nt, c5, init_fn);
+      p4est_quadrant_init_data (p4est, nt, c6, init_fn);
+      p4est_quadrant_init_data (p4est, nt, c7, init_fn);
+      c4->pad8 = c5->pad8 = c6->pad8 = c7->pad8 = 1;
+
+      (void) sc_list_prepend (list, c7);
+      (void) sc_list_prepend (list, c6);
+      (void) sc_list_prepend (list, c5);
+      (void) sc_list_prepend (list, c4);
 #endif
-            else {
-              /* this quadrant crosses a corner */
-              P4EST_ASSERT (face_axis[0] && face_axis[1]);
-              corner = quad_contact[1] + 2 * quad_contact[3];
+      (void) sc_list_prepend (list, c3);
+      (void) sc_list_prepend (list, c2);
+      (void) sc_list_prepend (list, c1);
+      (void) sc_list_prepend (list, c0);
+
+      if (replace_fn != NULL) {
+        /* in family mode we always call the replace callback right
+         * away */
+        family[0] = c0;
+        family[1] = c1;
+        family[2] = c2;
+        family[3] = c3;
 #ifdef P4_TO_P8
-              P4EST_ASSERT (face_axis[2]);
-              corner += 4 * quad_contact[5];
+        family[4] = c4;
+        family[5] = c5;
+        family[6] = c6;
+        family[7] = c7;
 #endif
-              P4EST_ASSERT (p4est_quadrant_touches_corner (q, corner, 1));
-              P4EST_ASSERT (p4est_quadrant_touches_corner
-                            (&insulq, corner, 0));
-              p4est_find_corner_transform (conn, nt, corner, &ci);
-              for (ctree = 0; ctree < cta->elem_count; ++ctree) {
-                ct = p4est_corner_array_index (cta, ctree);
-                tosend = *q;
-                p4est_quadrant_transform_corner (&tosend, (int) ct->ncorner,
-                                                 0);
-                tosend.p.piggy2.from_tree = nt;
-                tosend.pad16 = corner;
-                tempq = insulq;
-                p4est_quadrant_transform_corner (&tempq, (int) ct->ncorner,
-                                                 1);
-                p4est_balance_schedule (p4est, peers, ct->ntree, 1,
-                                        &tosend, &tempq, &first_peer,
-                                        &last_peer);
-              }
-            }
-          }
-          else {
-            /* no inter-tree contact */
-            tosend = *q;
-            tosend.p.piggy2.from_tree = nt;
-            tosend.pad16 = -1;
-            p4est_balance_schedule (p4est, peers, nt, 0,
-                                    &tosend, &insulq, &first_peer,
-                                    &last_peer);
-          }
-        }
+        replace_fn (p4est, nt, 1, &pp, P4EST_CHILDREN, family);
+        p4est_quadrant_free_data (p4est, &parent);
       }
-#ifdef P4_TO_P8
-#if 0
-      {
-#endif
+    }
+    else {
+      /* need to make room in the array to store this new quadrant */
+      if (restpos < incount && current == restpos) {
+        movecount = SC_MIN (incount - restpos, number_toread_quadrants);
+        while (movecount > 0) {
+          q = p4est_quadrant_array_index (tquadrants, restpos);
+          qalloc = p4est_quadrant_mempool_alloc (quadrant_pool);
+          *qalloc = *q;         /* never append array members directly */
+          qalloc->pad8 = 0;     /* has not been refined yet */
+          (void) sc_list_append (list, qalloc); /* only new quadrants */
+          --movecount;
+          ++restpos;
+        }
       }
-#endif
+
+      /* store new quadrant and update counters */
+      q = p4est_quadrant_array_index (tquadrants, current);
+      *q = *qpop;
+      maxlevel = SC_MAX (maxlevel, (int) qpop->level);
+      ++tree->quadrants_per_level[qpop->level];
+      ++current;
+      sc_mempool_free (quadrant_pool, qpop);
     }
-    tquadrants = NULL;          /* safeguard */
+  }
+  tree->maxlevel = (int8_t) maxlevel;
+
+  P4EST_ASSERT (restpos == incount);
+  P4EST_ASSERT (current == tquadrants->elem_count);
+  P4EST_ASSERT (list->first == NULL && list->last == NULL);
+  P4EST_ASSERT (quadrant_pool_size == quadrant_pool->elem_count);
+  if (p4est->user_data_pool != NULL && !p4est_in_parallel_region ()) {
+    P4EST_ASSERT (data_pool_size + tquadrants->elem_count ==
+                  p4est_quadrant_data_count (p4est) + incount);
+  }
+  P4EST_ASSERT (p4est_tree_is_sorted (tree));
+  P4EST_ASSERT (p4est_tree_is_complete (tree));
+  if (p4est->balance_dirty != NULL && tquadrants->elem_count != incount) {
+    p4est->balance_dirty[nt] = 1;
+  }
+  if (p4est->valid_dirty != NULL && tquadrants->elem_count != incount) {
+    p4est->valid_dirty[nt] = 1;
   }
 
-  /* end balance_A, start balance_comm */
-#ifdef P4EST_ENABLE_MPI
-  is_ranges_primary = 0;
-  is_ranges_active = 0;
-  is_notify_active = 1;
-  is_balance_verify = 0;
+  /* final log message for this tree */
+  P4EST_VERBOSEF ("Done refine tree %lld now %llu\n", (long long) nt,
+                  (unsigned long long) tquadrants->elem_count);
+}
+
+void
+p4est_refine_ext (p4est_t * p4est, int refine_recursive, int allowed_level,
+                  p4est_refine_t refine_fn, p4est_init_t init_fn,
+                  p4est_replace_t replace_fn)
+{
+#ifdef P4EST_ENABLE_OPENMP
+  int                 num_threads;
 #endif
-  if (p4est->inspect != NULL) {
-    p4est->inspect->balance_A += sc_MPI_Wtime ();
-    p4est->inspect->balance_comm = -sc_MPI_Wtime ();
-    p4est->inspect->balance_comm_sent = 0;
-    p4est->inspect->balance_comm_nzpeers = 0;
-    for (k = 0; k < 2; ++k) {
-      p4est->inspect->balance_zero_sends[k] = 0;
-      p4est->inspect->balance_zero_receives[k] = 0;
-    }
-    p4est->inspect->balance_ranges = 0.;
-    p4est->inspect->balance_notify = 0.;
-    p4est->inspect->balance_notify_allgather = 0.;
-#ifdef P4EST_ENABLE_MPI
-    is_ranges_primary = p4est->inspect->use_balance_ranges;
-    is_ranges_active = is_ranges_primary;
-    is_notify_active = !is_ranges_primary;
-    if (p4est->inspect->use_balance_ranges_notify) {
-      is_ranges_active = is_notify_active = 1;
+  p4est_topidx_t      nt;
+  p4est_gloidx_t      old_gnq;
+  sc_list_t          *list;
+  p4est_tree_t       *tree;
+
+  if (allowed_level < 0) {
+    allowed_level = P4EST_QMAXLEVEL;
+  }
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_refine with %lld total quadrants,"
+                            " allowed level %d\n",
+                            (long long) p4est->global_num_quadrants,
+                            allowed_level);
+  p4est_log_indent_push ();
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (0 <= allowed_level && allowed_level <= P4EST_QMAXLEVEL);
+  P4EST_ASSERT (refine_fn != NULL);
+
+  /* the callbacks may write to the quadrants */
+  p4est_unshare_quadrants (p4est);
+
+  /* remember input quadrant count; it will not decrease */
+  old_gnq = p4est->global_num_quadrants;
+
+#ifdef P4EST_ENABLE_OPENMP
+  num_threads = p4est_get_num_threads ();
+  if (num_threads > 1 && p4est->first_local_tree < p4est->last_local_tree) {
+    /* the trees are independent: each thread uses private working storage */
+    p4est_quadrant_data_cache_prepare (p4est);
+#pragma omp parallel num_threads (num_threads) private (nt, list)
+    {
+      sc_mempool_t       *quadrant_pool;
+
+      list = sc_list_new (NULL);
+      quadrant_pool = p4est_quadrant_mempool_new ();
+#pragma omp for schedule (dynamic, 1)
+      for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+        p4est_refine_tree (p4est, nt, refine_recursive, allowed_level,
+                           refine_fn, init_fn, replace_fn,
+                           list, quadrant_pool);
+      }
+      sc_mempool_destroy (quadrant_pool);
+      sc_list_destroy (list);
     }
-    is_balance_verify = p4est->inspect->use_balance_verify;
+  }
+  else
 #endif
+  {
+    /* loop over all local trees */
+    list = sc_list_new (NULL);
+    for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+      p4est_refine_tree (p4est, nt, refine_recursive, allowed_level,
+                         refine_fn, init_fn, replace_fn,
+                         list, p4est->quadrant_pool);
+    }
+    sc_list_destroy (list);
   }
 
-#ifdef P4EST_ENABLE_MPI
-  /* encode and distribute the asymmetric communication pattern */
-  procs = NULL;
-  receiver_ranks = sender_ranks = NULL;
-  num_receivers = num_senders = 0;
-  receiver_ranks_ranges = sender_ranks_ranges = NULL;
-  num_receivers_ranges = num_senders_ranges = 0;
-  receiver_ranks_notify = sender_ranks_notify = NULL;
-  num_receivers_notify = num_senders_notify = 0;
+  /* update the quadrant offsets of all trees */
+  p4est->local_num_quadrants = 0;
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    tree->quadrants_offset = p4est->local_num_quadrants;
+    p4est->local_num_quadrants += (p4est_locidx_t) tree->quadrants.elem_count;
+  }
+  if (p4est->last_local_tree >= 0) {
+    for (; nt < p4est->connectivity->num_trees; ++nt) {
+      tree = p4est_tree_array_index (p4est->trees, nt);
+      tree->quadrants_offset = p4est->local_num_quadrants;
+    }
+  }
 
-  /* determine asymmetric communication pattern by sc_ranges function */
-  if (is_ranges_active) {
-    procs = P4EST_ALLOC (int, num_procs);
-    receiver_ranks_ranges = P4EST_ALLOC (int, num_procs);
-    sender_ranks_ranges = P4EST_ALLOC (int, num_procs);
+  /* compute global number of quadrants */
+  p4est_comm_count_quadrants (p4est);
+  P4EST_ASSERT (p4est->global_num_quadrants >= old_gnq);
+  if (old_gnq != p4est->global_num_quadrants) {
+    ++p4est->revision;
+    if (p4est->valid_dirty != NULL &&
+        p4est->valid_revision == p4est->revision - 1) {
+      /* the changed trees are flagged */
+      p4est->valid_revision = p4est->revision;
+    }
+  }
+  p4est_compact_data (p4est);
 
-    for (j = 0; j < num_procs; ++j) {
-      procs[j] = (int) peers[j].send_first.elem_count;
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  p4est_log_indent_pop ();
+  P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
+                            "_refine with %lld total quadrants\n",
+                            (long long) p4est->global_num_quadrants);
+}
+
+void
+p4est_coarsen (p4est_t * p4est, int coarsen_recursive,
+               p4est_coarsen_t coarsen_fn, p4est_init_t init_fn)
+{
+  p4est_coarsen_ext (p4est, coarsen_recursive, 0, coarsen_fn, init_fn, NULL);
+}
+
+/** Recursively coarsen the quadrants of one local tree in a single sweep.
+ * The input is read once and written to a compacting cursor that trails it.
+ * The output behind the cursor is a stack whose top holds the siblings of a
+ * possible family; a family is tested when its last child is pushed, and a
+ * coarsened parent is pushed in its place to test the next coarser family.
+ * Every candidate family is passed to the callback at most once and every
+ * quadrant is copied at most once.  Output quadrants that cannot take part
+ * in a family anymore are sealed and passed as orphans if requested.
+ * \return          The number of quadrants removed from the tree.
+ */
+static size_t
+p4est_coarsen_tree_recursive (p4est_t * p4est, p4est_topidx_t jt,
+                              int callback_orphans,
+                              p4est_coarsen_t coarsen_fn,
+                              p4est_init_t init_fn,
+                              p4est_replace_t replace_fn)
+{
+  int                 k;
+  size_t              zz, first;
+  size_t              incount, in, out, sealed;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *c[P4EST_CHILDREN];
+  p4est_quadrant_t   *q, *prev, *cfirst;
+  sc_array_t         *tquadrants;
+  p4est_quadrant_t    qtemp;
+
+  P4EST_QUADRANT_INIT (&qtemp);
+
+  tree = p4est_tree_array_index (p4est->trees, jt);
+  tquadrants = &tree->quadrants;
+  incount = tquadrants->elem_count;
+
+  /* entries below sealed are final, the ones above may still be coarsened */
+  sealed = 0;
+  out = 0;
+  for (in = 0; in < incount; ++in) {
+    /* push the next input quadrant onto the output stack */
+    q = p4est_quadrant_array_index (tquadrants, out);
+    if (out < in) {
+      *q = *p4est_quadrant_array_index (tquadrants, in);
     }
-    maxpeers = first_peer;
-    maxwin = last_peer;
-    max_ranges = p4est_num_ranges;
-    if (p4est->inspect != NULL) {
-      if (p4est->inspect->balance_max_ranges > 0 &&
-          p4est->inspect->balance_max_ranges < p4est_num_ranges) {
-        max_ranges = p4est->inspect->balance_max_ranges;
+    ++out;
+
+    /* examine the top of the stack until it is open or sealed */
+    for (;;) {
+      q = p4est_quadrant_array_index (tquadrants, out - 1);
+      k = q->level > 0 ? p4est_quadrant_child_id (q) : -1;
+      if (k == 0) {
+        /* a first child opens a possible family */
+        break;
       }
-      p4est->inspect->balance_ranges = -MPI_Wtime ();
-    }
-    nwin = sc_ranges_adaptive (p4est_package_id,
-                               p4est->mpicomm, procs, &maxpeers, &maxwin,
-                               max_ranges, my_ranges, &all_ranges);
-    twomaxwin = 2 * maxwin;
-    if (p4est->inspect != NULL) {
-      p4est->inspect->balance_ranges += sc_MPI_Wtime ();
-    }
-    sc_ranges_decode (num_procs, rank, maxwin, all_ranges,
-                      &num_receivers_ranges, receiver_ranks_ranges,
-                      &num_senders_ranges, sender_ranks_ranges);
-    if (is_balance_verify) {
-      /* verification written after using sc_ranges_decode */
-      k = 0;
-      for (j = 0; j < num_procs; ++j) {
-        if (j == rank) {
-          continue;
-        }
-        if (procs[j] > 0) {
-          P4EST_ASSERT (k < num_receivers_ranges &&
-                        receiver_ranks_ranges[k] == j);
-          ++k;
-        }
-        else {
-          if (k < num_receivers_ranges && receiver_ranks_ranges[k] == j) {
-            ++k;
-          }
+      if (k > 0 && out - 1 > sealed) {
+        /* the open entries below the top are a prefix of its family */
+        prev = p4est_quadrant_array_index (tquadrants, out - 2);
+        if (prev->level != q->level ||
+            p4est_quadrant_child_id (prev) != k - 1) {
+          k = -1;
         }
+        P4EST_ASSERT (k < 0 || p4est_quadrant_is_sibling (prev, q));
+      }
+      else {
+        k = -1;
+      }
+      if (k < 0) {
+        /* the top cannot complete a family and neither can anything below */
+        break;
+      }
+      if (k < P4EST_CHILDREN - 1) {
+        /* wait for the next sibling */
+        break;
       }
-      P4EST_ASSERT (k == num_receivers_ranges);
 
-      /* original verification loop modified and partially redundant */
-      k = 0;
-      for (j = first_peer; j <= last_peer; ++j) {
-        if (j == rank) {
-          P4EST_ASSERT (k == num_receivers_ranges ||
-                        receiver_ranks_ranges[k] != j);
-          continue;
+      /* the top P4EST_CHILDREN entries form a family */
+      first = out - P4EST_CHILDREN;
+      for (zz = 0; zz < P4EST_CHILDREN; ++zz) {
+        c[zz] = p4est_quadrant_array_index (tquadrants, first + zz);
+      }
+      P4EST_ASSERT (p4est_quadrant_is_familypv (c));
+      if (!coarsen_fn (p4est, jt, c)) {
+        /* the first child has been passed; the others follow as orphans */
+        if (callback_orphans) {
+          for (zz = sealed; zz < first; ++zz) {
+            c[0] = p4est_quadrant_array_index (tquadrants, zz);
+            c[1] = NULL;
+            (void) coarsen_fn (p4est, jt, c);
+          }
+          for (zz = first + 1; zz < out; ++zz) {
+            c[0] = p4est_quadrant_array_index (tquadrants, zz);
+            c[1] = NULL;
+            (void) coarsen_fn (p4est, jt, c);
+          }
         }
-        peer = peers + j;
-        qcount = peer->send_first.elem_count;
+        sealed = out;
+        break;
+      }
 
-        for (i = 0; i < nwin - 1; ++i) {
-          if (j > my_ranges[2 * i + 1] && j < my_ranges[2 * (i + 1)]) {
-            break;
-          }
+      /* replace the family by its parent on top of the stack */
+      if (replace_fn == NULL) {
+        for (zz = 0; zz < P4EST_CHILDREN; ++zz) {
+          p4est_quadrant_free_data (p4est, c[zz]);
         }
-        if (i < nwin - 1) {
-          P4EST_ASSERT (qcount == 0);
-          P4EST_ASSERT (k == num_receivers_ranges ||
-                        receiver_ranks_ranges[k] != j);
-          continue;
+      }
+      tree->quadrants_per_level[c[0]->level] -= P4EST_CHILDREN;
+      cfirst = c[0];
+      if (replace_fn != NULL) {
+        qtemp = *(c[0]);
+        c[0] = &qtemp;
+      }
+      p4est_quadrant_parent (c[0], cfirst);
+      p4est_quadrant_init_data (p4est, jt, cfirst, init_fn);
+      tree->quadrants_per_level[cfirst->level] += 1;
+      if (replace_fn != NULL) {
+        replace_fn (p4est, jt, P4EST_CHILDREN, c, 1, &cfirst);
+        for (zz = 0; zz < P4EST_CHILDREN; zz++) {
+          p4est_quadrant_free_data (p4est, c[zz]);
         }
-        P4EST_ASSERT (k < num_receivers_ranges &&
-                      receiver_ranks_ranges[k] == j);
-        ++k;
       }
-      P4EST_ASSERT (k == num_receivers_ranges);
+      out = first + 1;
+    }
 
-      /* original verification loop of who is sending to me */
-      k = 0;
-      for (j = 0; j < num_procs; ++j) {
-        if (j == rank) {
-          P4EST_ASSERT (k == num_senders_ranges ||
-                        sender_ranks_ranges[k] != j);
-          continue;
-        }
-        for (i = 0; i < maxwin; ++i) {
-          first_bound = all_ranges[twomaxwin * j + 2 * i];
-          if (first_bound == -1 || first_bound > rank) {
-            P4EST_ASSERT (k == num_senders_ranges ||
-                          sender_ranks_ranges[k] != j);
-            break;
-          }
-          if (rank <= all_ranges[twomaxwin * j + 2 * i + 1]) {
-            /* processor j is sending to me */
-            P4EST_ASSERT (k < num_senders_ranges &&
-                          sender_ranks_ranges[k] == j);
-            ++k;
-            break;
-          }
+    if (k < 0) {
+      /* seal the whole stack */
+      if (callback_orphans) {
+        c[1] = NULL;
+        for (zz = sealed; zz < out; ++zz) {
+          c[0] = p4est_quadrant_array_index (tquadrants, zz);
+          (void) coarsen_fn (p4est, jt, c);
         }
       }
-      P4EST_ASSERT (k == num_senders_ranges);
+      sealed = out;
+    }
+  }
+
+  /* the remaining open entries are orphans at the end of the local range */
+  if (callback_orphans) {
+    c[1] = NULL;
+    for (zz = sealed; zz < out; ++zz) {
+      c[0] = p4est_quadrant_array_index (tquadrants, zz);
+      (void) coarsen_fn (p4est, jt, c);
     }
+  }
+  sc_array_resize (tquadrants, out);
+
+  return incount - out;
+}
+
+/** Coarsen the quadrants of one local tree.
+ * The quadrant offsets and the processor's quadrant count are
+ * not touched; the caller updates them after all trees are done.
+ */
+static void
+p4est_coarsen_tree (p4est_t * p4est, p4est_topidx_t jt,
+                    int coarsen_recursive, int callback_orphans,
+                    p4est_coarsen_t coarsen_fn, p4est_init_t init_fn,
+                    p4est_replace_t replace_fn)
+{
 #ifdef P4EST_ENABLE_DEBUG
-    P4EST_GLOBAL_STATISTICSF ("Max peers %d ranges %d/%d\n",
-                              maxpeers, maxwin, max_ranges);
-    sc_ranges_statistics (p4est_package_id, SC_LP_STATISTICS,
-                          p4est->mpicomm, num_procs, procs,
-                          rank, max_ranges, my_ranges);
+  size_t              data_pool_size;
 #endif
-    SC_FREE (all_ranges);
-    P4EST_FREE (procs);
-    P4EST_VERBOSEF ("Peer ranges %d/%d/%d first %d last %d\n",
-                    nwin, maxwin, max_ranges, first_peer, last_peer);
+  int                 i, maxlevel;
+  int                 isfamily;
+  size_t              zz;
+  size_t              incount, removed;
+  size_t              window, start, length;
+  p4est_locidx_t      num_quadrants;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *c[P4EST_CHILDREN];
+  p4est_quadrant_t   *cfirst, *clast;
+  sc_array_t         *tquadrants;
+  p4est_quadrant_t    qtemp;
+
+  P4EST_QUADRANT_INIT (&qtemp);
+
+  tree = p4est_tree_array_index (p4est->trees, jt);
+  tquadrants = &tree->quadrants;
+#ifdef P4EST_ENABLE_DEBUG
+  data_pool_size = 0;
+  if (p4est->user_data_pool != NULL) {
+    data_pool_size = p4est_quadrant_data_count (p4est);
   }
+#endif
+  removed = 0;
 
-  /* determine asymmetric communication pattern by sc_notify function */
-  if (is_notify_active) {
-    receiver_ranks_notify = P4EST_ALLOC (int, num_procs);
-    sender_ranks_notify = P4EST_ALLOC (int, num_procs);
-    num_receivers_notify = num_senders_notify = 0;
+  /* initial log message for this tree */
+  P4EST_VERBOSEF ("Into coarsen tree %lld with %llu\n", (long long) jt,
+                  (unsigned long long) tquadrants->elem_count);
 
-    for (j = 0; j < num_procs; ++j) {
-      if (j != rank && peers[j].send_first.elem_count > 0) {
-        receiver_ranks_notify[num_receivers_notify++] = j;
+  /* state information */
+  window = 0;                   /* start position of sliding window in array */
+  start = 1;                    /* start position of hole in window/array */
+  length = 0;                   /* length of hole in window/array */
+
+  incount = tquadrants->elem_count;
+  if (coarsen_recursive) {
+    /* coarsen bottom-up in a single sweep */
+    removed = p4est_coarsen_tree_recursive (p4est, jt, callback_orphans,
+                                            coarsen_fn, init_fn, replace_fn);
+
+    /* skip the sliding window below */
+    window = incount;
+  }
+
+  /* run through the array and coarsen each family at most once */
+  while (window + P4EST_CHILDREN + length <= incount) {
+    P4EST_ASSERT (window < start);
+
+    isfamily = 1;
+    for (zz = 0; zz < P4EST_CHILDREN; ++zz) {
+      c[zz] = (window + zz < start) ?
+        p4est_quadrant_array_index (tquadrants, window + zz) :
+        p4est_quadrant_array_index (tquadrants, window + length + zz);
+
+      if (zz != (size_t) p4est_quadrant_child_id (c[zz])) {
+        isfamily = 0;
+        if (callback_orphans) {
+          c[1] = NULL;
+          (void) coarsen_fn (p4est, jt, c);
+        }
+        break;
       }
     }
-    if (p4est->inspect != NULL) {
-      p4est->inspect->balance_notify = -MPI_Wtime ();
-    }
-    mpiret = sc_notify (receiver_ranks_notify, num_receivers_notify,
-                        sender_ranks_notify, &num_senders_notify,
-                        p4est->mpicomm);
-    SC_CHECK_MPI (mpiret);
-    if (p4est->inspect != NULL) {
-      p4est->inspect->balance_notify += sc_MPI_Wtime ();
+    /* in a complete tree, the only way P4EST_CHILDREN consecutive quadrants
+     * have the correct consecutive child_id's is if they are, in fact, a
+     * family.
+     */
+    P4EST_ASSERT (!isfamily || p4est_quadrant_is_familypv (c));
+    if (isfamily && coarsen_fn (p4est, jt, c)) {
+      /* coarsen this family of quadrants */
+      if (replace_fn == NULL) {
+        for (zz = 0; zz < P4EST_CHILDREN; ++zz) {
+          p4est_quadrant_free_data (p4est, c[zz]);
+        }
+      }
+      tree->quadrants_per_level[c[0]->level] -= P4EST_CHILDREN;
+      cfirst = c[0];
+      if (replace_fn != NULL) {
+        qtemp = *(c[0]);
+        c[0] = &qtemp;
+      }
+      p4est_quadrant_parent (c[0], cfirst);
+      p4est_quadrant_init_data (p4est, jt, cfirst, init_fn);
+      tree->quadrants_per_level[cfirst->level] += 1;
+      removed += P4EST_CHILDREN - 1;
+
+      start = window + 1;
+      length += P4EST_CHILDREN - 1;
+
+      if (replace_fn != NULL) {
+        replace_fn (p4est, jt, P4EST_CHILDREN, c, 1, &cfirst);
+        for (zz = 0; zz < P4EST_CHILDREN; zz++) {
+          p4est_quadrant_free_data (p4est, c[zz]);
+        }
+      }
     }
 
-    /* double-check sc_notify results by sc_notify_allgather */
-    if (is_balance_verify) {
-      int                *sender_ranks2, num_senders2;
-
-      sender_ranks2 = P4EST_ALLOC (int, num_procs);
-      if (p4est->inspect != NULL) {
-        p4est->inspect->balance_notify_allgather = -MPI_Wtime ();
-      }
-      mpiret = sc_notify_allgather (receiver_ranks_notify,
-                                    num_receivers_notify,
-                                    sender_ranks2, &num_senders2,
-                                    p4est->mpicomm);
-      SC_CHECK_MPI (mpiret);
-      if (p4est->inspect != NULL) {
-        p4est->inspect->balance_notify_allgather += sc_MPI_Wtime ();
-      }
-
-      /* run verification against sc_notify_allgather */
-      SC_CHECK_ABORT (num_senders2 == num_senders_notify,
-                      "Failed notify_allgather sender count");
-      for (j = 0; j < num_senders_notify; ++j) {
-        SC_CHECK_ABORT (sender_ranks2[j] == sender_ranks_notify[j],
-                        "Failed notify_allgather sender rank");
+    ++window;
+    if (window == start && start + length < incount) {
+      if (length > 0) {
+        cfirst = p4est_quadrant_array_index (tquadrants, start);
+        clast = p4est_quadrant_array_index (tquadrants, start + length);
+        *cfirst = *clast;
       }
-      P4EST_FREE (sender_ranks2);
+      start = window + 1;
     }
   }
 
-  /* verify sc_ranges and sc_notify against each other */
-  if (is_ranges_active && is_notify_active && is_balance_verify) {
-#ifdef P4EST_ENABLE_DEBUG
-    int                 found_in_ranges, found_in_notify;
-#endif
-
-    /* verify receiver side */
-    P4EST_ASSERT (num_receivers_notify <= num_receivers_ranges);
-    k = l = 0;
-    for (j = 0; j < num_procs; ++j) {
-      P4EST_DEBUG_EXECUTE (found_in_ranges = found_in_notify = 0);
-      if (k < num_receivers_ranges && receiver_ranks_ranges[k] == j) {
-        P4EST_ASSERT (j != rank);
-        P4EST_DEBUG_EXECUTE (found_in_ranges = 1);
-        ++k;
-      }
-      if (l < num_receivers_notify && receiver_ranks_notify[l] == j) {
-        P4EST_ASSERT (j != rank && found_in_ranges);
-        P4EST_DEBUG_EXECUTE (found_in_notify = 1);
-        ++l;
-      }
-      if (j != rank && peers[j].send_first.elem_count > 0) {
-        P4EST_ASSERT (found_in_ranges && found_in_notify);
-      }
-      if (peers[j].send_first.elem_count == 0) {
-        P4EST_ASSERT (!found_in_notify);
-      }
+  /* adjust final array size */
+  if (length > 0) {
+    for (zz = start + length; zz < incount; ++zz) {
+      cfirst = p4est_quadrant_array_index (tquadrants, zz - length);
+      clast = p4est_quadrant_array_index (tquadrants, zz);
+      *cfirst = *clast;
     }
-    P4EST_ASSERT (k == num_receivers_ranges);
-    P4EST_ASSERT (l == num_receivers_notify);
+    sc_array_resize (tquadrants, incount - length);
+  }
 
-    /* verify sender side */
-    P4EST_ASSERT (num_senders_notify <= num_senders_ranges);
-    k = l = 0;
-    for (j = 0; j < num_procs; ++j) {
-      P4EST_DEBUG_EXECUTE (found_in_ranges = found_in_notify = 0);
-      if (k < num_senders_ranges && sender_ranks_ranges[k] == j) {
-        P4EST_ASSERT (j != rank);
-        P4EST_DEBUG_EXECUTE (found_in_ranges = 1);
-        ++k;
-      }
-      if (l < num_senders_notify && sender_ranks_notify[l] == j) {
-        P4EST_ASSERT (j != rank && found_in_ranges);
-        P4EST_DEBUG_EXECUTE (found_in_notify = 1);      /* for symmetry */
-        ++l;
-      }
+  /* call remaining orphans */
+  if (callback_orphans) {
+    c[1] = NULL;
+    for (zz = window; zz < incount - length; ++zz) {
+      c[0] = p4est_quadrant_array_index (tquadrants, zz);
+      (void) coarsen_fn (p4est, jt, c);
     }
-    P4EST_ASSERT (k == num_senders_ranges);
-    P4EST_ASSERT (l == num_senders_notify);
   }
 
-  /*
-   * loop over all peers and send first round of quadrants
-   * for intra-tree balancing, each load is contained in one tree
-   */
-  total_send_count = total_recv_count = 0;
-  request_first_count = request_second_count = request_send_count = 0;
-  send_zero[0] = send_load[0] = recv_zero[0] = recv_load[0] = 0;
-  send_zero[1] = send_load[1] = recv_zero[1] = recv_load[1] = 0;
-  if (is_ranges_primary) {
-    P4EST_ASSERT (is_ranges_active);
-    receiver_ranks = receiver_ranks_ranges;
-    sender_ranks = sender_ranks_ranges;
-    num_receivers = num_receivers_ranges;
-    num_senders = num_senders_ranges;
+  /* compute maximum level */
+  maxlevel = 0;
+  num_quadrants = 0;
+  for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
+    P4EST_ASSERT (tree->quadrants_per_level[i] >= 0);
+    num_quadrants += tree->quadrants_per_level[i];      /* same type */
+    if (tree->quadrants_per_level[i] > 0) {
+      maxlevel = i;
+    }
   }
-  else {
-    P4EST_ASSERT (is_notify_active);
-    receiver_ranks = receiver_ranks_notify;
-    sender_ranks = sender_ranks_notify;
-    num_receivers = num_receivers_notify;
-    num_senders = num_senders_notify;
+  tree->maxlevel = (int8_t) maxlevel;
+
+  /* do some sanity checks */
+  P4EST_ASSERT (num_quadrants == (p4est_locidx_t) tquadrants->elem_count);
+  P4EST_ASSERT (tquadrants->elem_count == incount - removed);
+  if (p4est->user_data_pool != NULL && !p4est_in_parallel_region ()) {
+    P4EST_ASSERT (data_pool_size - removed ==
+                  p4est_quadrant_data_count (p4est));
+  }
+  P4EST_ASSERT (p4est_tree_is_sorted (tree));
+  P4EST_ASSERT (p4est_tree_is_complete (tree));
+  if (p4est->balance_dirty != NULL && removed > 0) {
+    p4est->balance_dirty[jt] = 1;
+  }
+  if (p4est->valid_dirty != NULL && removed > 0) {
+    p4est->valid_dirty[jt] = 1;
   }
-  P4EST_ASSERT (receiver_ranks != NULL && sender_ranks != NULL);
-  num_receivers_ranges = num_senders_ranges = 0;
-  num_receivers_notify = num_senders_notify = 0;
 
-  /* Use receiver_ranks array to send to them */
-  for (k = 0; k < num_receivers; ++k) {
-    j = receiver_ranks[k];
-    P4EST_ASSERT (j >= first_peer && j <= last_peer && j != rank);
-    peer = peers + j;
-    qcount = peer->send_first.elem_count;
+  /* final log message for this tree */
+  P4EST_VERBOSEF ("Done coarsen tree %lld now %llu\n", (long long) jt,
+                  (unsigned long long) tquadrants->elem_count);
+}
 
-    /* first send number of quadrants to be expected */
-    if (qcount > 0) {
-      P4EST_LDEBUGF ("Balance A send %llu quadrants to %d\n",
-                     (unsigned long long) qcount, j);
-      ++send_load[0];
-    }
-    else {
-      P4EST_ASSERT (is_ranges_primary);
-      ++send_zero[0];
-    }
-    peer->send_first_count = (int) qcount;
-    mpiret = MPI_Isend (&peer->send_first_count, 1, MPI_INT,
-                        j, P4EST_COMM_BALANCE_FIRST_COUNT,
-                        p4est->mpicomm, &send_requests_first_count[j]);
-    SC_CHECK_MPI (mpiret);
-    ++request_send_count;
+void
+p4est_coarsen_ext (p4est_t * p4est,
+                   int coarsen_recursive, int callback_orphans,
+                   p4est_coarsen_t coarsen_fn, p4est_init_t init_fn,
+                   p4est_replace_t replace_fn)
+{
+#ifdef P4EST_ENABLE_OPENMP
+  int                 num_threads;
+#endif
+  p4est_topidx_t      jt;
+  p4est_gloidx_t      old_gnq;
+  p4est_tree_t       *tree;
 
-    /* sort and send the actual quadrants and post receive for reply */
-    if (qcount > 0) {
-      sc_array_sort (&peer->send_first, p4est_quadrant_compare_piggy);
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_coarsen with %lld total quadrants\n",
+                            (long long) p4est->global_num_quadrants);
+  p4est_log_indent_push ();
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (coarsen_fn != NULL);
+  p4est_unshare_quadrants (p4est);
 
-#ifdef P4EST_ENABLE_DEBUG
-      checksum = p4est_quadrant_checksum (&peer->send_first, &checkarray, 0);
-      P4EST_LDEBUGF ("Balance A send checksum 0x%08x to %d\n", checksum, j);
-#endif /* P4EST_ENABLE_DEBUG */
+  /* remember input quadrant count; it will not increase */
+  old_gnq = p4est->global_num_quadrants;
 
-      total_send_count += qcount;
-      qbytes = qcount * sizeof (p4est_quadrant_t);
-      mpiret = MPI_Isend (peer->send_first.array, (int) qbytes, MPI_BYTE,
-                          j, P4EST_COMM_BALANCE_FIRST_LOAD,
-                          p4est->mpicomm, &send_requests_first_load[j]);
-      SC_CHECK_MPI (mpiret);
-      ++request_send_count;
-      mpiret = MPI_Irecv (&peer->recv_second_count, 1, MPI_INT,
-                          j, P4EST_COMM_BALANCE_SECOND_COUNT,
-                          p4est->mpicomm, &requests_second[j]);
-      SC_CHECK_MPI (mpiret);
-      ++request_second_count;
+#ifdef P4EST_ENABLE_OPENMP
+  num_threads = p4est_get_num_threads ();
+  if (num_threads > 1 && p4est->first_local_tree < p4est->last_local_tree) {
+    /* the trees are independent and coarsened in place */
+    p4est_quadrant_data_cache_prepare (p4est);
+#pragma omp parallel for num_threads (num_threads) schedule (dynamic, 1)
+    for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+      p4est_coarsen_tree (p4est, jt, coarsen_recursive, callback_orphans,
+                          coarsen_fn, init_fn, replace_fn);
+    }
+  }
+  else
+#endif
+  {
+    /* loop over all local trees */
+    for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+      p4est_coarsen_tree (p4est, jt, coarsen_recursive, callback_orphans,
+                          coarsen_fn, init_fn, replace_fn);
     }
   }
-  peer = NULL;
-  P4EST_FREE (receiver_ranks_ranges);
-  P4EST_FREE (receiver_ranks_notify);
-  receiver_ranks = receiver_ranks_ranges = receiver_ranks_notify = NULL;
 
-  /* find out who is sending to me and receive quadrant counts */
-  for (k = 0; k < num_senders; ++k) {
-    j = sender_ranks[k];
-    ++request_first_count;
-    mpiret = MPI_Irecv (&peers[j].recv_first_count, 1, MPI_INT,
-                        j, P4EST_COMM_BALANCE_FIRST_COUNT,
-                        p4est->mpicomm, &requests_first[j]);
-    SC_CHECK_MPI (mpiret);
+  /* update the quadrant offsets of all trees */
+  p4est->local_num_quadrants = 0;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    tree->quadrants_offset = p4est->local_num_quadrants;
+    p4est->local_num_quadrants += (p4est_locidx_t) tree->quadrants.elem_count;
+  }
+  if (p4est->last_local_tree >= 0) {
+    for (; jt < p4est->connectivity->num_trees; ++jt) {
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      tree->quadrants_offset = p4est->local_num_quadrants;
+    }
   }
-  P4EST_FREE (sender_ranks_ranges);
-  P4EST_FREE (sender_ranks_notify);
-  sender_ranks = sender_ranks_ranges = sender_ranks_notify = NULL;
 
-  /* wait for quadrant counts and post receive and send for quadrants */
-  while (request_first_count > 0) {
-    mpiret = sc_MPI_Waitsome (num_procs, requests_first,
-                              &outcount, wait_indices, recv_statuses);
-    SC_CHECK_MPI (mpiret);
-    P4EST_ASSERT (outcount != MPI_UNDEFINED);
-    P4EST_ASSERT (outcount > 0);
-    for (i = 0; i < outcount; ++i) {
-      /* retrieve sender's rank */
-      j = wait_indices[i];
-      jstatus = &recv_statuses[i];
-      wait_indices[i] = -1;
-      P4EST_ASSERT (j != rank && 0 <= j && j < num_procs);
-      P4EST_ASSERT (requests_first[j] == MPI_REQUEST_NULL);
-      P4EST_ASSERT (jstatus->MPI_SOURCE == j);
+  /* compute global number of quadrants */
+  p4est_comm_count_quadrants (p4est);
+  P4EST_ASSERT (p4est->global_num_quadrants <= old_gnq);
+  if (old_gnq != p4est->global_num_quadrants) {
+    ++p4est->revision;
+    if (p4est->valid_dirty != NULL &&
+        p4est->valid_revision == p4est->revision - 1) {
+      /* the changed trees are flagged */
+      p4est->valid_revision = p4est->revision;
+    }
+  }
+  p4est_compact_data (p4est);
 
-      /* check if we are in receiving count or load */
-      peer = peers + j;
-      P4EST_ASSERT (!peer->have_first_load);
-      if (!peer->have_first_count) {
-        /* verify message size */
-        P4EST_ASSERT (jstatus->MPI_TAG == P4EST_COMM_BALANCE_FIRST_COUNT);
-        mpiret = sc_MPI_Get_count (jstatus, MPI_INT, &rcount);
-        SC_CHECK_MPI (mpiret);
-        SC_CHECK_ABORTF (rcount == 1, "Receive count mismatch A %d", rcount);
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  p4est_log_indent_pop ();
+  P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
+                            "_coarsen with %lld total quadrants\n",
+                            (long long) p4est->global_num_quadrants);
+}
 
-        /* process the count information received */
-        peer->have_first_count = 1;
-        qcount = (size_t) peer->recv_first_count;
-        if (qcount > 0) {
-          /* received nonzero count, post receive for load */
-          P4EST_LDEBUGF ("Balance A recv %llu quadrants from %d\n",
-                         (unsigned long long) qcount, j);
-          P4EST_ASSERT (peer->recv_first.elem_count == 0);
-          sc_array_resize (&peer->recv_first, qcount);
-          total_recv_count += qcount;
-          qbytes = qcount * sizeof (p4est_quadrant_t);
-          P4EST_ASSERT (requests_first[j] == MPI_REQUEST_NULL);
-          mpiret = MPI_Irecv (peer->recv_first.array, (int) qbytes, MPI_BYTE,
-                              j, P4EST_COMM_BALANCE_FIRST_LOAD,
-                              p4est->mpicomm, &requests_first[j]);
-          SC_CHECK_MPI (mpiret);
-          ++recv_load[0];
-        }
-        else {
-          /* will not receive load, close this request */
-          P4EST_ASSERT (qcount == 0);
-          P4EST_ASSERT (requests_first[j] == MPI_REQUEST_NULL);
-          --request_first_count;
-          ++recv_zero[0];
-        }
-      }
-      else {
-        /* verify received size */
-        P4EST_ASSERT (jstatus->MPI_TAG == P4EST_COMM_BALANCE_FIRST_LOAD);
-        P4EST_ASSERT (peer->recv_first_count > 0);
-        mpiret = sc_MPI_Get_count (jstatus, MPI_BYTE, &rcount);
-        SC_CHECK_MPI (mpiret);
-        SC_CHECK_ABORTF (rcount ==
-                         peer->recv_first_count *
+/** Check if the insulation layer of a quadrant overlaps anybody.
+ * If yes, the quadrant itself is scheduled for sending.
+ * Both quadrants are in the receiving tree's coordinates.
+ * \param [in]  qtree       Tree id of the receiving tree.
+ * \param [in]  inter_tree  Boolean flag to specify inter-tree communication.
+ * \param [in]  q           The quadrant to be sent if there is overlap.
+ * \param [in]  insul       An insulation quadrant of \a q.
+ * \param [in,out]  first_peer  Lowest peer, will be updated.
+ * \param [in,out]  last_peer   Highest peer, will be updated.
+ */
+static void
+p4est_balance_schedule (p4est_t * p4est, p4est_balance_peer_t * peers,
+                        p4est_topidx_t qtree, int inter_tree,
+                        const p4est_quadrant_t * q,
+                        const p4est_quadrant_t * insul,
+                        int *first_peer, int *last_peer)
+{
+  const int           rank = p4est->mpirank;
+  int                 found;
+  int                 back, pos;
+  int                 owner, first_owner, last_owner;
+  p4est_gloidx_t     *global_first_quadrant = p4est->global_first_quadrant;
+  p4est_quadrant_t    ld, *s;
+  p4est_balance_peer_t *peer;
+
+  P4EST_QUADRANT_INIT (&ld);
+
+  /* querying insul is equivalent to querying first descendant */
+  first_owner = p4est_comm_find_owner (p4est, qtree, insul, rank);
+  /* querying last descendant */
+  p4est_quadrant_last_descendant (insul, &ld, P4EST_QMAXLEVEL);
+  last_owner = p4est_comm_find_owner (p4est, qtree, &ld, rank);
+
+  /* send to all processors possibly intersecting insulation */
+  for (owner = first_owner; owner <= last_owner; ++owner) {
+    if (owner == rank && !inter_tree) {
+      /* do not send to self for the same tree */
+      continue;
+    }
+    if (global_first_quadrant[owner] == global_first_quadrant[owner + 1]) {
+      /* do not send to empty processors */
+      continue;
+    }
+    peer = peers + owner;
+    /* avoid duplicates in the send array */
+    found = 0;
+    for (back = 0; back < P4EST_INSUL - 1; ++back) {
+      pos = (int) peer->send_first.elem_count - back - 1;
+      if (pos < 0) {
+        break;
+      }
+      s = (p4est_quadrant_t *) sc_array_index_int (&peer->send_first, pos);
+      if (p4est_quadrant_is_equal (s, q) && s->p.piggy2.which_tree == qtree
+          && s->p.piggy2.from_tree == q->p.piggy2.from_tree
+          && s->pad16 == q->pad16) {
+        found = 1;
+        break;
+      }
+    }
+    if (found) {
+      continue;
+    }
+
+    /* copy quadrant into shipping list */
+    s = p4est_quadrant_array_push_copy (&peer->send_first, q);
+    s->p.piggy2.which_tree = qtree;     /* piggy back tree id */
+
+    /* update lowest and highest peer */
+    if (owner != rank) {
+      *first_peer = SC_MIN (owner, *first_peer);
+      *last_peer = SC_MAX (owner, *last_peer);
+    }
+  }
+}
+
+static void
+p4est_balance_response (p4est_t * p4est, p4est_balance_peer_t * peer,
+                        p4est_connect_type_t balance, sc_array_t * borders)
+{
+  sc_array_t         *first_seeds = sc_array_new (sizeof (p4est_quadrant_t));
+
+/* compute and uniqify overlap quadrants */
+  p4est_tree_compute_overlap (p4est, &peer->recv_first,
+                              &peer->send_second, balance, borders,
+                              first_seeds);
+  /* replace peer->recv_first with first_seeds */
+  p4est_tree_uniqify_overlap (&peer->send_second);
+  p4est_tree_uniqify_overlap (first_seeds);
+  /* replace peer->recv_first with first_seeds */
+  sc_array_resize (&peer->recv_first, first_seeds->elem_count);
+  memcpy (peer->recv_first.array, first_seeds->array,
+          first_seeds->elem_size * first_seeds->elem_count);
+  sc_array_destroy (first_seeds);
+
+  if (p4est->inspect) {
+    p4est->inspect->balance_comm_sent += peer->send_second.elem_count;
+    if (peer->send_second.elem_count) {
+      p4est->inspect->balance_comm_nzpeers++;
+    }
+  }
+}
+
+/** Run the local part of balance on all local trees.
+ * If more than one thread is set, the trees are distributed among them.
+ * \param [in] borders      If NULL, run the first local pass of balance on
+ *                          every tree.  Otherwise, balance the border of
+ *                          each tree whose flags indicate that quadrants
+ *                          may have been received.
+ * \param [in] tree_flags   Per-tree flags.  If \a borders is NULL, may be
+ *                          NULL to run the first pass on every tree.
+ * \param [in] isolated     With \a borders NULL and \a tree_flags set, run
+ *                          the first pass only on the trees that are
+ *                          isolated (true) or not isolated (false).
+ * \param [out] thread_times    If not NULL, each thread adds its time.
+ *                          Must hold P4EST_INSPECT_MAX_THREADS entries.
+ * \return                  The number of threads used.
+ */
+static int
+p4est_balance_local (p4est_t * p4est, p4est_connect_type_t btype,
+                     p4est_init_t init_fn, p4est_replace_t replace_fn,
+                     sc_array_t * borders, const int8_t * tree_flags,
+                     int isolated, double *thread_times)
+{
+  int                 num_threads;
+  p4est_topidx_t      nt;
+
+  num_threads = p4est_get_num_threads ();
+  if (p4est->first_local_tree >= p4est->last_local_tree) {
+    num_threads = 1;
+  }
+  /* the threads take their temporary arrays from the scratch arena */
+  p4est_scratch_prepare (p4est);
+  p4est_quadrant_data_cache_prepare (p4est);
+
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel num_threads (num_threads) private (nt)
+#endif
+  {
+    int                 thread_id = 0;
+    size_t              treecount;
+    double              thread_start;
+    p4est_tree_t       *tree;
+
+#ifdef P4EST_ENABLE_OPENMP
+    thread_id = omp_get_thread_num ();
+    thread_start = omp_get_wtime ();
+#pragma omp for schedule (dynamic, 1) nowait
+#else
+    thread_start = sc_MPI_Wtime ();
+#endif
+    for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+      tree = p4est_tree_array_index (p4est->trees, nt);
+      treecount = tree->quadrants.elem_count;
+      if (borders == NULL) {
+        if (tree_flags != NULL &&
+            p4est_balance_is_isolated (tree_flags[nt]) != isolated) {
+          continue;
+        }
+        if (p4est->balance_dirty != NULL && !p4est->balance_dirty[nt] &&
+            p4est->balance_type >= btype) {
+          /* this tree has not changed since it was last balanced */
+          continue;
+        }
+        /* local balance first pass */
+        P4EST_VERBOSEF ("Into balance tree %lld with %llu\n", (long long) nt,
+                        (unsigned long long) treecount);
+        p4est_balance_subtree_ext (p4est, btype, nt, init_fn, replace_fn);
+        P4EST_VERBOSEF ("Balance tree %lld A %llu\n", (long long) nt,
+                        (unsigned long long) tree->quadrants.elem_count);
+      }
+      else if (!p4est_balance_is_isolated (tree_flags[nt])) {
+        /* we have most probably received quadrants, run sort and balance */
+        /* balance the border, add it back into the tree, and linearize */
+        p4est_balance_border (p4est, btype, nt, init_fn, replace_fn, borders);
+        P4EST_VERBOSEF ("Balance tree %lld B %llu to %llu\n",
+                        (long long) nt, (unsigned long long) treecount,
+                        (unsigned long long) tree->quadrants.elem_count);
+      }
+    }
+    if (thread_times != NULL && thread_id < P4EST_INSPECT_MAX_THREADS) {
+#ifdef P4EST_ENABLE_OPENMP
+      thread_times[thread_id] += omp_get_wtime () - thread_start;
+#else
+      thread_times[thread_id] += sc_MPI_Wtime () - thread_start;
+#endif
+    }
+  }
+
+  return num_threads;
+}
+
+void
+p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
+               p4est_init_t init_fn)
+{
+  p4est_balance_ext (p4est, btype, init_fn, NULL);
+}
+
+/** Check whether a forest is balanced without running the balance.
+ * A local quadrant q is checked against each neighbor box of its own size
+ * in the directions of btype.  If the box lies in the local part of the
+ * tree, a violation exists exactly if a leaf of level below that of q
+ * minus one covers the box; every violation between two quadrants of the
+ * local part of a tree is found this way from the smaller quadrant.
+ * A box that leaves the local part, other than through a domain boundary
+ * face, makes q a border quadrant.  A violation between different trees
+ * or processes involves two border quadrants, so none is possible if the
+ * levels of all border quadrants are within one of each other.
+ * This function is collective and exchanges three integers per process.
+ * \return          True if no 2:1 violation with respect to btype exists.
+ */
+static int
+p4est_balance_precheck (p4est_t * p4est, p4est_connect_type_t btype)
+{
+  const int           max_contacts = p4est_connect_type_int (btype);
+  int                 mpiret;
+  int                 dir[3], contacts, exits, exit_face, nface;
+  int                 i, k, is_border;
+  int                 local[3], global[3];
+  size_t              zz;
+  ssize_t             found;
+  p4est_qcoord_t      qh;
+  p4est_qcoord_t     *coord[3];
+  p4est_topidx_t      nt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, *r;
+  p4est_quadrant_t    n, fd, ld;
+  p4est_connectivity_t *conn = p4est->connectivity;
+
+  P4EST_QUADRANT_INIT (&n);
+  P4EST_QUADRANT_INIT (&fd);
+  P4EST_QUADRANT_INIT (&ld);
+  coord[0] = &n.x;
+  coord[1] = &n.y;
+#ifdef P4_TO_P8
+  coord[2] = &n.z;
+#endif
+
+  /* local[0] flags a violation, local[1] and local[2] bound the negative
+   * minimum and the maximum level of the border quadrants */
+  local[0] = 0;
+  local[1] = -P4EST_MAXLEVEL - 1;
+  local[2] = -1;
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree &&
+       !local[0]; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    for (zz = 0; zz < tree->quadrants.elem_count && !local[0]; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      qh = P4EST_QUADRANT_LEN (q->level);
+      is_border = 0;
+
+      /* loop over the 3^P4EST_DIM - 1 neighbor directions */
+      for (k = 0; k < P4EST_INSUL && !local[0]; ++k) {
+        contacts = 0;
+        for (i = 0; i < P4EST_DIM; ++i) {
+          dir[i] = (k / (i == 0 ? 1 : i == 1 ? 3 : 9)) % 3 - 1;
+          contacts += (dir[i] != 0);
+        }
+        if (contacts == 0 || contacts > max_contacts) {
+          continue;
+        }
+        n = *q;
+        exits = 0;
+        exit_face = -1;
+        for (i = 0; i < P4EST_DIM; ++i) {
+          *coord[i] += dir[i] * qh;
+          if (*coord[i] < 0 || *coord[i] >= P4EST_ROOT_LEN) {
+            ++exits;
+            exit_face = 2 * i + (dir[i] > 0);
+          }
+        }
+        if (exits > 0) {
+          if (exits == 1 &&
+              p4est_connectivity_face_neighbor_tree (conn, nt, exit_face,
+                                                     &nface) == nt &&
+              nface == exit_face) {
+            /* there is no neighbor across a domain boundary face */
+            continue;
+          }
+          is_border = 1;
+          continue;
+        }
+        p4est_quadrant_first_descendant (&n, &fd, P4EST_QMAXLEVEL);
+        p4est_quadrant_last_descendant (&n, &ld, P4EST_QMAXLEVEL);
+        if (p4est_quadrant_compare (&fd, &tree->first_desc) < 0 ||
+            p4est_quadrant_compare (&tree->last_desc, &ld) < 0) {
+          is_border = 1;
+          continue;
+        }
+
+        /* the last leaf not after the box covers it or precedes it */
+        found = p4est_find_higher_bound (&tree->quadrants, &n, zz);
+        if (found < 0) {
+          continue;
+        }
+        r = p4est_quadrant_array_index (&tree->quadrants, (size_t) found);
+        if ((int) r->level < (int) q->level - 1 &&
+            p4est_quadrant_is_ancestor (r, &n)) {
+          local[0] = 1;
+        }
+      }
+      if (is_border) {
+        local[1] = SC_MAX (local[1], -(int) q->level);
+        local[2] = SC_MAX (local[2], (int) q->level);
+      }
+    }
+  }
+
+  mpiret = sc_MPI_Allreduce (local, global, 3, sc_MPI_INT, sc_MPI_MAX,
+                             p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  return !global[0] && global[1] + global[2] <= 1;
+}
+
+p4est_balance_context_t *
+p4est_balance_begin (p4est_t * p4est, p4est_connect_type_t btype,
+                     p4est_init_t init_fn, p4est_replace_t replace_fn)
+{
+  const int           rank = p4est->mpirank;
+  const int           num_procs = p4est->mpisize;
+  int                 j, k, l, m, which;
+  int                 face;
+  int                 num_threads;
+  int                 first_peer, last_peer;
+  int                 quad_contact[P4EST_FACES];
+  int                 tree_contact[P4EST_FACES];
+  int                 full_tree[2];
+  int8_t             *tree_flags;
+  size_t              zz, treecount, ctree;
+  size_t              localcount;
+  size_t              all_incount;
+  p4est_qcoord_t      qh;
+  const p4est_qcoord_t rh = P4EST_ROOT_LEN;
+  p4est_topidx_t      qtree, nt;
+  p4est_topidx_t      first_tree, last_tree;
+  p4est_locidx_t      skipped;
+  p4est_gloidx_t      old_gnq;
+  p4est_balance_peer_t *peers, *peer;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t    mylow, nextlow;
+  p4est_quadrant_t    tosend, insulq, tempq;
+  p4est_quadrant_t   *q;
+  p4est_connectivity_t *conn = p4est->connectivity;
+  p4est_balance_context_t *ctx;
+  sc_array_t         *qarray, *tquadrants;
+  sc_array_t         *borders;
+  double             *thread_times;
+#ifdef P4EST_ENABLE_DEBUG
+  size_t              data_pool_size;
+#endif
+  int                 ftransform[P4EST_FTRANSFORM];
+  int                 face_axis[3];     /* 3 not P4EST_DIM */
+  int                 contact_face_only;
+#ifdef P4_TO_P8
+  int                 contact_edge_only;
+  int                 edge;
+  size_t              etree;
+  p8est_edge_info_t   ei;
+  p8est_edge_transform_t *et;
+  sc_array_t         *eta;
+#endif
+  int                 corner;
+  p4est_corner_info_t ci;
+  p4est_corner_transform_t *ct;
+  sc_array_t         *cta;
+#ifdef P4EST_ENABLE_MPI
+#ifdef P4EST_ENABLE_DEBUG
+  unsigned            checksum;
+  sc_array_t          checkarray;
+#endif /* P4EST_ENABLE_DEBUG */
+  int                 i;
+  size_t              qcount, qbytes;
+  int                 mpiret;
+  int                 first_bound;
+  int                 request_first_count, request_second_count;
+  int                 request_send_count, total_send_count, total_recv_count;
+  int                 nwin, maxpeers, maxwin, twomaxwin;
+  int                 send_zero[2], send_load[2];
+  int                 recv_zero[2], recv_load[2];
+  int                 my_ranges[2 * p4est_num_ranges];
+  int                *wait_indices;
+  int                *procs, *all_ranges;
+  int                *receiver_ranks, *sender_ranks;
+  int                 num_receivers, num_senders;
+  int                *receiver_ranks_ranges, *sender_ranks_ranges;
+  int                 num_receivers_ranges, num_senders_ranges;
+  int                *receiver_ranks_notify, *sender_ranks_notify;
+  int                 num_receivers_notify, num_senders_notify;
+  int                 is_ranges_primary, is_balance_verify;
+  int                 is_notify_nodes;
+  int                 is_ranges_active, is_notify_active;
+  int                 max_ranges;
+  MPI_Request        *requests_first, *requests_second;
+  MPI_Request        *send_requests_first_count, *send_requests_first_load;
+  MPI_Request        *send_requests_second_count, *send_requests_second_load;
+  MPI_Status         *recv_statuses;
+#endif /* P4EST_ENABLE_MPI */
+
+  if (p4est->balance_dirty != NULL && p4est->balance_type >= btype &&
+      p4est->balance_revision == p4est->revision) {
+    /* the forest has not changed since it was last balanced */
+    P4EST_GLOBAL_PRODUCTIONF ("Skip " P4EST_STRING
+                              "_balance %s with %lld total quadrants\n",
+                              p4est_connect_type_string (btype),
+                              (long long) p4est->global_num_quadrants);
+    ctx = P4EST_ALLOC_ZERO (p4est_balance_context_t, 1);
+    ctx->p4est = p4est;
+    ctx->is_current = 1;
+    return ctx;
+  }
+
+  if (p4est->inspect != NULL && p4est->inspect->use_balance_precheck &&
+      p4est_balance_precheck (p4est, btype)) {
+    /* no violation is possible, so the mesh and revision stay as they are */
+    P4EST_GLOBAL_PRODUCTIONF ("Skip " P4EST_STRING
+                              "_balance %s with %lld total quadrants"
+                              " after precheck\n",
+                              p4est_connect_type_string (btype),
+                              (long long) p4est->global_num_quadrants);
+    P4EST_ASSERT (p4est_is_balanced (p4est, btype));
+    if (p4est->balance_dirty != NULL) {
+      memset (p4est->balance_dirty, 0,
+              (size_t) p4est->connectivity->num_trees);
+      p4est->balance_type = btype;
+      p4est->balance_revision = p4est->revision;
+    }
+    ctx = P4EST_ALLOC_ZERO (p4est_balance_context_t, 1);
+    ctx->p4est = p4est;
+    ctx->is_current = 1;
+    return ctx;
+  }
+
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_balance %s with %lld total quadrants\n",
+                            p4est_connect_type_string (btype),
+                            (long long) p4est->global_num_quadrants);
+  p4est_log_indent_push ();
+  P4EST_ASSERT (p4est_is_valid (p4est));
+#ifndef P4_TO_P8
+  P4EST_ASSERT (btype == P4EST_CONNECT_FACE || btype == P4EST_CONNECT_CORNER);
+#else
+  P4EST_ASSERT (btype == P8EST_CONNECT_FACE || btype == P8EST_CONNECT_EDGE ||
+                btype == P8EST_CONNECT_CORNER);
+#endif
+  p4est_unshare_quadrants (p4est);
+
+  /* remember input quadrant count; it will not decrease */
+  old_gnq = p4est->global_num_quadrants;
+
+#ifdef P4EST_ENABLE_DEBUG
+  data_pool_size = 0;
+  if (p4est->user_data_pool != NULL) {
+    data_pool_size = p4est_quadrant_data_count (p4est);
+  }
+#endif
+
+  P4EST_QUADRANT_INIT (&mylow);
+  P4EST_QUADRANT_INIT (&nextlow);
+  P4EST_QUADRANT_INIT (&tosend);
+  P4EST_QUADRANT_INIT (&insulq);
+  P4EST_QUADRANT_INIT (&tempq);
+
+  /* tree status flags (max 8 per tree) */
+  tree_flags = P4EST_ALLOC (int8_t, conn->num_trees);
+  for (nt = 0; nt < conn->num_trees; ++nt) {
+    tree_flags[nt] = 0x00;
+  }
+
+  localcount = (size_t) (p4est->last_local_tree + 1 -
+                         p4est->first_local_tree);
+  borders = sc_array_new_size (sizeof (sc_array_t), localcount);
+  for (zz = 0; zz < localcount; zz++) {
+    qarray = (sc_array_t *) sc_array_index (borders, zz);
+    sc_array_init (qarray, sizeof (p4est_quadrant_t));
+  }
+
+#ifdef P4EST_ENABLE_MPI
+  requests_first = P4EST_ALLOC (MPI_Request, 6 * num_procs);
+  requests_second = requests_first + 1 * num_procs;
+  send_requests_first_count = requests_first + 2 * num_procs;
+  send_requests_first_load = requests_first + 3 * num_procs;
+  send_requests_second_count = requests_first + 4 * num_procs;
+  send_requests_second_load = requests_first + 5 * num_procs;
+  recv_statuses = P4EST_ALLOC (MPI_Status, num_procs);
+  for (j = 0; j < num_procs; ++j) {
+    requests_first[j] = requests_second[j] = MPI_REQUEST_NULL;
+    send_requests_first_count[j] = MPI_REQUEST_NULL;
+    send_requests_first_load[j] = MPI_REQUEST_NULL;
+    send_requests_second_count[j] = MPI_REQUEST_NULL;
+    send_requests_second_load[j] = MPI_REQUEST_NULL;
+  }
+  wait_indices = P4EST_ALLOC (int, num_procs);
+#ifdef P4EST_ENABLE_DEBUG
+  sc_array_init (&checkarray, 4);
+#endif /* P4EST_ENABLE_DEBUG */
+#endif /* P4EST_ENABLE_MPI */
+
+  /* allocate per peer storage and initialize requests */
+  peers = P4EST_ALLOC (p4est_balance_peer_t, num_procs);
+  for (j = 0; j < num_procs; ++j) {
+    peer = peers + j;
+    sc_array_init (&peer->send_first, sizeof (p4est_quadrant_t));
+    sc_array_init (&peer->send_second, sizeof (p4est_quadrant_t));
+    sc_array_init (&peer->recv_first, sizeof (p4est_quadrant_t));
+    sc_array_init (&peer->recv_second, sizeof (p4est_quadrant_t));
+    peer->send_first_count = peer->send_second_count = 0;
+    peer->recv_first_count = peer->recv_second_count = 0;
+    peer->have_first_count = peer->have_first_load = 0;
+    peer->have_second_count = peer->have_second_load = 0;
+  }
+#ifdef P4_TO_P8
+  eta = &ei.edge_transforms;
+  sc_array_init (eta, sizeof (p8est_edge_transform_t));
+#endif
+  cta = &ci.corner_transforms;
+  sc_array_init (cta, sizeof (p4est_corner_transform_t));
+
+  /* compute first quadrant on finest level */
+  mylow.x = p4est->global_first_position[rank].x;
+  mylow.y = p4est->global_first_position[rank].y;
+#ifdef P4_TO_P8
+  mylow.z = p4est->global_first_position[rank].z;
+#endif
+  mylow.level = P4EST_QMAXLEVEL;
+
+  /* and the first finest quadrant of the next processor */
+  nextlow.x = p4est->global_first_position[rank + 1].x;
+  nextlow.y = p4est->global_first_position[rank + 1].y;
+#ifdef P4_TO_P8
+  nextlow.z = p4est->global_first_position[rank + 1].z;
+#endif
+  nextlow.level = P4EST_QMAXLEVEL;
+
+  /* start balance_A timing */
+  P4EST_REGION_BEGIN ("balance.A");
+  thread_times = NULL;
+  if (p4est->inspect != NULL) {
+    p4est->inspect->balance_A = -sc_MPI_Wtime ();
+    p4est->inspect->balance_A_count_in = 0;
+    p4est->inspect->balance_A_count_out = 0;
+    p4est->inspect->use_B = 0;
+    for (k = 0; k < P4EST_INSPECT_MAX_THREADS; ++k) {
+      p4est->inspect->balance_A_threads[k] = 0.;
+      p4est->inspect->balance_B_threads[k] = 0.;
+    }
+    thread_times = p4est->inspect->balance_A_threads;
+  }
+
+  /* local balance first pass, possibly on several threads */
+  first_tree = p4est->first_local_tree;
+  last_tree = p4est->last_local_tree;
+  all_incount = 0;
+  for (nt = first_tree; nt <= last_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    all_incount += tree->quadrants.elem_count;
+  }
+
+  /* the tree flags depend on the partition only */
+  for (nt = first_tree; nt <= last_tree; ++nt) {
+    p4est_comm_tree_info (p4est, nt, full_tree, tree_contact, NULL, NULL);
+    if (full_tree[0] && full_tree[1]) {
+      tree_flags[nt] |= fully_owned_flag;
+    }
+    for (face = 0; face < P4EST_FACES; ++face) {
+      if (tree_contact[face]) {
+        tree_flags[nt] |= any_face_flag;
+        break;
+      }
+    }
+  }
+
+  /* isolated trees are balanced later while messages are in flight */
+  num_threads = p4est_balance_local (p4est, btype, init_fn, replace_fn,
+                                     NULL, tree_flags, 0, thread_times);
+  if (p4est->inspect != NULL) {
+    p4est->inspect->balance_num_threads = num_threads;
+  }
+
+  /* loop over all local trees to assemble first send list */
+  first_peer = num_procs;
+  last_peer = -1;
+  skipped = 0;
+  for (nt = first_tree; nt <= last_tree; ++nt) {
+    if (p4est_balance_is_isolated (tree_flags[nt])) {
+      /* this tree is isolated, no balance between trees */
+      continue;
+    }
+    p4est_comm_tree_info (p4est, nt, full_tree, tree_contact, NULL, NULL);
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    tquadrants = &tree->quadrants;
+    treecount = tquadrants->elem_count;
+
+    if (borders != NULL) {
+      qarray = (sc_array_t *) sc_array_index (borders,
+                                              (size_t) (nt - first_tree));
+    }
+    else {
+      qarray = NULL;
+    }
+
+    /* identify boundary quadrants and prepare them to be sent */
+    for (zz = 0; zz < treecount; ++zz) {
+      /* this quadrant may be on the boundary with a range of processors */
+      q = p4est_quadrant_array_index (tquadrants, zz);
+      qh = P4EST_QUADRANT_LEN (q->level);
+      if (p4est_comm_neighborhood_owned (p4est, nt,
+                                         full_tree, tree_contact, q)) {
+        /* this quadrant's 3x3 neighborhood is owned by this processor */
+        ++skipped;
+        continue;
+      }
+
+      if (qarray != NULL) {
+        (void) p4est_quadrant_array_push_copy (qarray, q);
+      }
+
+#ifdef P4_TO_P8
+      for (m = 0; m < 3; ++m) {
+#if 0
+      }
+#endif
+#else
+      m = 0;
+#endif
+      for (k = 0; k < 3; ++k) {
+        for (l = 0; l < 3; ++l) {
+          which = m * 9 + k * 3 + l;    /* 2D: 0..8, 3D: 0..26 */
+          /* exclude myself from the queries */
+          if (which == P4EST_INSUL / 2) {
+            continue;
+          }
+          /* may modify insulq below, never modify q itself! */
+          insulq = *q;
+          insulq.x += (l - 1) * qh;
+          insulq.y += (k - 1) * qh;
+#ifdef P4_TO_P8
+          insulq.z += (m - 1) * qh;
+#endif
+          /* check boundary status of insulation quadrant */
+          quad_contact[0] = (insulq.x < 0);
+          quad_contact[1] = (insulq.x >= rh);
+          face_axis[0] = quad_contact[0] || quad_contact[1];
+          quad_contact[2] = (insulq.y < 0);
+          quad_contact[3] = (insulq.y >= rh);
+          face_axis[1] = quad_contact[2] || quad_contact[3];
+#ifndef P4_TO_P8
+          face_axis[2] = 0;
+#else
+          quad_contact[4] = (insulq.z < 0);
+          quad_contact[5] = (insulq.z >= rh);
+          face_axis[2] = quad_contact[4] || quad_contact[5];
+          edge = -1;
+          contact_edge_only = 0;
+#endif
+          contact_face_only = 0;
+          face = -1;
+          if (face_axis[0] || face_axis[1] || face_axis[2]) {
+            /* this quadrant is relevant for inter-tree balancing */
+            if (!face_axis[1] && !face_axis[2]) {
+              contact_face_only = 1;
+              face = 0 + quad_contact[1];
+            }
+            else if (!face_axis[0] && !face_axis[2]) {
+              contact_face_only = 1;
+              face = 2 + quad_contact[3];
+            }
+#ifdef P4_TO_P8
+            else if (!face_axis[0] && !face_axis[1]) {
+              contact_face_only = 1;
+              face = 4 + quad_contact[5];
+            }
+            else if (!face_axis[0]) {
+              contact_edge_only = 1;
+              edge = 0 + 2 * quad_contact[5] + quad_contact[3];
+            }
+            else if (!face_axis[1]) {
+              contact_edge_only = 1;
+              edge = 4 + 2 * quad_contact[5] + quad_contact[1];
+            }
+            else if (!face_axis[2]) {
+              contact_edge_only = 1;
+              edge = 8 + 2 * quad_contact[3] + quad_contact[1];
+            }
+#endif
+            if (contact_face_only) {
+              /* square contact across a face */
+#ifdef P4_TO_P8
+              P4EST_ASSERT (!contact_edge_only);
+#endif
+              P4EST_ASSERT (face >= 0 && face < P4EST_FACES);
+              P4EST_ASSERT (quad_contact[face]);
+              qtree = p4est_find_face_transform (conn, nt, face, ftransform);
+              if (qtree >= 0) {
+                P4EST_ASSERT (tree_contact[face]);
+                p4est_quadrant_transform_face (q, &tosend, ftransform);
+                tosend.p.piggy2.from_tree = nt;
+                tosend.pad16 = face;
+                p4est_quadrant_transform_face (&insulq, &tempq, ftransform);
+                p4est_balance_schedule (p4est, peers, qtree, 1,
+                                        &tosend, &tempq,
+                                        &first_peer, &last_peer);
+              }
+              else {
+                /* goes across a face with no neighbor */
+                P4EST_ASSERT (!tree_contact[face]);
+              }
+            }
+#ifdef P4_TO_P8
+            else if (contact_edge_only) {
+              /* this quadrant crosses an edge */
+              P4EST_ASSERT (!contact_face_only);
+              P4EST_ASSERT (edge >= 0 && edge < P8EST_EDGES);
+              p8est_find_edge_transform (conn, nt, edge, &ei);
+              for (etree = 0; etree < eta->elem_count; ++etree) {
+                et = p8est_edge_array_index (eta, etree);
+                p8est_quadrant_transform_edge (q, &tosend, &ei, et, 0);
+                tosend.p.piggy2.from_tree = nt;
+                tosend.pad16 = edge;
+                p8est_quadrant_transform_edge (&insulq, &tempq, &ei, et, 1);
+                p4est_balance_schedule (p4est, peers, et->ntree, 1,
+                                        &tosend, &tempq,
+                                        &first_peer, &last_peer);
+              }
+            }
+#endif
+            else {
+              /* this quadrant crosses a corner */
+              P4EST_ASSERT (face_axis[0] && face_axis[1]);
+              corner = quad_contact[1] + 2 * quad_contact[3];
+#ifdef P4_TO_P8
+              P4EST_ASSERT (face_axis[2]);
+              corner += 4 * quad_contact[5];
+#endif
+              P4EST_ASSERT (p4est_quadrant_touches_corner (q, corner, 1));
+              P4EST_ASSERT (p4est_quadrant_touches_corner
+                            (&insulq, corner, 0));
+              p4est_find_corner_transform (conn, nt, corner, &ci);
+              for (ctree = 0; ctree < cta->elem_count; ++ctree) {
+                ct = p4est_corner_array_index (cta, ctree);
+                tosend = *q;
+                p4est_quadrant_transform_corner (&tosend, (int) ct->ncorner,
+                                                 0);
+                tosend.p.piggy2.from_tree = nt;
+                tosend.pad16 = corner;
+                tempq = insulq;
+                p4est_quadrant_transform_corner (&tempq, (int) ct->ncorner,
+                                                 1);
+                p4est_balance_schedule (p4est, peers, ct->ntree, 1,
+                                        &tosend, &tempq, &first_peer,
+                                        &last_peer);
+              }
+            }
+          }
+          else {
+            /* no inter-tree contact */
+            tosend = *q;
+            tosend.p.piggy2.from_tree = nt;
+            tosend.pad16 = -1;
+            p4est_balance_schedule (p4est, peers, nt, 0,
+                                    &tosend, &insulq, &first_peer,
+                                    &last_peer);
+          }
+        }
+      }
+#ifdef P4_TO_P8
+#if 0
+      {
+#endif
+      }
+#endif
+    }
+    tquadrants = NULL;          /* safeguard */
+  }
+
+  /* end balance_A, start balance_comm */
+  P4EST_REGION_END ("balance.A");
+  P4EST_REGION_BEGIN ("balance.comm");
+#ifdef P4EST_ENABLE_MPI
+  is_ranges_primary = 0;
+  is_ranges_active = 0;
+  is_notify_active = 1;
+  is_balance_verify = 0;
+  is_notify_nodes = 0;
+#endif
+  if (p4est->inspect != NULL) {
+    p4est->inspect->balance_A += sc_MPI_Wtime ();
+    p4est->inspect->balance_comm = -sc_MPI_Wtime ();
+    p4est->inspect->balance_comm_sent = 0;
+    p4est->inspect->balance_comm_nzpeers = 0;
+    for (k = 0; k < 2; ++k) {
+      p4est->inspect->balance_zero_sends[k] = 0;
+      p4est->inspect->balance_zero_receives[k] = 0;
+    }
+    p4est->inspect->balance_ranges = 0.;
+    p4est->inspect->balance_notify = 0.;
+    p4est->inspect->balance_notify_allgather = 0.;
+#ifdef P4EST_ENABLE_MPI
+    is_ranges_primary = p4est->inspect->use_balance_ranges;
+    is_ranges_active = is_ranges_primary;
+    is_notify_active = !is_ranges_primary;
+    if (p4est->inspect->use_balance_ranges_notify) {
+      is_ranges_active = is_notify_active = 1;
+    }
+    is_balance_verify = p4est->inspect->use_balance_verify;
+    is_notify_nodes = p4est->inspect->use_notify_nodes;
+#endif
+  }
+
+#ifdef P4EST_ENABLE_MPI
+  /* encode and distribute the asymmetric communication pattern */
+  procs = NULL;
+  receiver_ranks = sender_ranks = NULL;
+  num_receivers = num_senders = 0;
+  receiver_ranks_ranges = sender_ranks_ranges = NULL;
+  num_receivers_ranges = num_senders_ranges = 0;
+  receiver_ranks_notify = sender_ranks_notify = NULL;
+  num_receivers_notify = num_senders_notify = 0;
+
+  /* determine asymmetric communication pattern by sc_ranges function */
+  if (is_ranges_active) {
+    procs = P4EST_ALLOC (int, num_procs);
+    receiver_ranks_ranges = P4EST_ALLOC (int, num_procs);
+    sender_ranks_ranges = P4EST_ALLOC (int, num_procs);
+
+    for (j = 0; j < num_procs; ++j) {
+      procs[j] = (int) peers[j].send_first.elem_count;
+    }
+    maxpeers = first_peer;
+    maxwin = last_peer;
+    max_ranges = p4est_num_ranges;
+    if (p4est->inspect != NULL) {
+      if (p4est->inspect->balance_max_ranges > 0 &&
+          p4est->inspect->balance_max_ranges < p4est_num_ranges) {
+        max_ranges = p4est->inspect->balance_max_ranges;
+      }
+      p4est->inspect->balance_ranges = -MPI_Wtime ();
+    }
+    P4EST_REGION_BEGIN ("balance.ranges");
+    nwin = sc_ranges_adaptive (p4est_package_id,
+                               p4est->mpicomm, procs, &maxpeers, &maxwin,
+                               max_ranges, my_ranges, &all_ranges);
+    P4EST_REGION_END ("balance.ranges");
+    twomaxwin = 2 * maxwin;
+    if (p4est->inspect != NULL) {
+      p4est->inspect->balance_ranges += sc_MPI_Wtime ();
+    }
+    sc_ranges_decode (num_procs, rank, maxwin, all_ranges,
+                      &num_receivers_ranges, receiver_ranks_ranges,
+                      &num_senders_ranges, sender_ranks_ranges);
+    if (is_balance_verify) {
+      /* verification written after using sc_ranges_decode */
+      k = 0;
+      for (j = 0; j < num_procs; ++j) {
+        if (j == rank) {
+          continue;
+        }
+        if (procs[j] > 0) {
+          P4EST_ASSERT (k < num_receivers_ranges &&
+                        receiver_ranks_ranges[k] == j);
+          ++k;
+        }
+        else {
+          if (k < num_receivers_ranges && receiver_ranks_ranges[k] == j) {
+            ++k;
+          }
+        }
+      }
+      P4EST_ASSERT (k == num_receivers_ranges);
+
+      /* original verification loop modified and partially redundant */
+      k = 0;
+      for (j = first_peer; j <= last_peer; ++j) {
+        if (j == rank) {
+          P4EST_ASSERT (k == num_receivers_ranges ||
+                        receiver_ranks_ranges[k] != j);
+          continue;
+        }
+        peer = peers + j;
+        qcount = peer->send_first.elem_count;
+
+        for (i = 0; i < nwin - 1; ++i) {
+          if (j > my_ranges[2 * i + 1] && j < my_ranges[2 * (i + 1)]) {
+            break;
+          }
+        }
+        if (i < nwin - 1) {
+          P4EST_ASSERT (qcount == 0);
+          P4EST_ASSERT (k == num_receivers_ranges ||
+                        receiver_ranks_ranges[k] != j);
+          continue;
+        }
+        P4EST_ASSERT (k < num_receivers_ranges &&
+                      receiver_ranks_ranges[k] == j);
+        ++k;
+      }
+      P4EST_ASSERT (k == num_receivers_ranges);
+
+      /* original verification loop of who is sending to me */
+      k = 0;
+      for (j = 0; j < num_procs; ++j) {
+        if (j == rank) {
+          P4EST_ASSERT (k == num_senders_ranges ||
+                        sender_ranks_ranges[k] != j);
+          continue;
+        }
+        for (i = 0; i < maxwin; ++i) {
+          first_bound = all_ranges[twomaxwin * j + 2 * i];
+          if (first_bound == -1 || first_bound > rank) {
+            P4EST_ASSERT (k == num_senders_ranges ||
+                          sender_ranks_ranges[k] != j);
+            break;
+          }
+          if (rank <= all_ranges[twomaxwin * j + 2 * i + 1]) {
+            /* processor j is sending to me */
+            P4EST_ASSERT (k < num_senders_ranges &&
+                          sender_ranks_ranges[k] == j);
+            ++k;
+            break;
+          }
+        }
+      }
+      P4EST_ASSERT (k == num_senders_ranges);
+    }
+#ifdef P4EST_ENABLE_DEBUG
+    P4EST_GLOBAL_STATISTICSF ("Max peers %d ranges %d/%d\n",
+                              maxpeers, maxwin, max_ranges);
+    sc_ranges_statistics (p4est_package_id, SC_LP_STATISTICS,
+                          p4est->mpicomm, num_procs, procs,
+                          rank, max_ranges, my_ranges);
+#endif
+    SC_FREE (all_ranges);
+    P4EST_FREE (procs);
+    P4EST_VERBOSEF ("Peer ranges %d/%d/%d first %d last %d\n",
+                    nwin, maxwin, max_ranges, first_peer, last_peer);
+  }
+
+  /* determine asymmetric communication pattern by sc_notify function */
+  if (is_notify_active) {
+    receiver_ranks_notify = P4EST_ALLOC (int, num_procs);
+    sender_ranks_notify = P4EST_ALLOC (int, num_procs);
+    num_receivers_notify = num_senders_notify = 0;
+
+    for (j = 0; j < num_procs; ++j) {
+      if (j != rank && peers[j].send_first.elem_count > 0) {
+        receiver_ranks_notify[num_receivers_notify++] = j;
+      }
+    }
+    if (p4est->inspect != NULL) {
+      p4est->inspect->balance_notify = -MPI_Wtime ();
+    }
+    P4EST_REGION_BEGIN ("balance.notify");
+    if (is_notify_nodes) {
+      mpiret = p4est_comm_notify_nodes (receiver_ranks_notify,
+                                        num_receivers_notify,
+                                        sender_ranks_notify,
+                                        &num_senders_notify, p4est->mpicomm);
+    }
+    else {
+      mpiret = sc_notify (receiver_ranks_notify, num_receivers_notify,
+                          sender_ranks_notify, &num_senders_notify,
+                          p4est->mpicomm);
+    }
+    SC_CHECK_MPI (mpiret);
+    P4EST_REGION_END ("balance.notify");
+    if (p4est->inspect != NULL) {
+      p4est->inspect->balance_notify += sc_MPI_Wtime ();
+    }
+
+    /* double-check sc_notify results by sc_notify_allgather */
+    if (is_balance_verify) {
+      int                *sender_ranks2, num_senders2;
+
+      sender_ranks2 = P4EST_ALLOC (int, num_procs);
+      if (p4est->inspect != NULL) {
+        p4est->inspect->balance_notify_allgather = -MPI_Wtime ();
+      }
+      mpiret = sc_notify_allgather (receiver_ranks_notify,
+                                    num_receivers_notify,
+                                    sender_ranks2, &num_senders2,
+                                    p4est->mpicomm);
+      SC_CHECK_MPI (mpiret);
+      if (p4est->inspect != NULL) {
+        p4est->inspect->balance_notify_allgather += sc_MPI_Wtime ();
+      }
+
+      /* run verification against sc_notify_allgather */
+      SC_CHECK_ABORT (num_senders2 == num_senders_notify,
+                      "Failed notify_allgather sender count");
+      for (j = 0; j < num_senders_notify; ++j) {
+        SC_CHECK_ABORT (sender_ranks2[j] == sender_ranks_notify[j],
+                        "Failed notify_allgather sender rank");
+      }
+      P4EST_FREE (sender_ranks2);
+    }
+  }
+
+  /* verify sc_ranges and sc_notify against each other */
+  if (is_ranges_active && is_notify_active && is_balance_verify) {
+#ifdef P4EST_ENABLE_DEBUG
+    int                 found_in_ranges, found_in_notify;
+#endif
+
+    /* verify receiver side */
+    P4EST_ASSERT (num_receivers_notify <= num_receivers_ranges);
+    k = l = 0;
+    for (j = 0; j < num_procs; ++j) {
+      P4EST_DEBUG_EXECUTE (found_in_ranges = found_in_notify = 0);
+      if (k < num_receivers_ranges && receiver_ranks_ranges[k] == j) {
+        P4EST_ASSERT (j != rank);
+        P4EST_DEBUG_EXECUTE (found_in_ranges = 1);
+        ++k;
+      }
+      if (l < num_receivers_notify && receiver_ranks_notify[l] == j) {
+        P4EST_ASSERT (j != rank && found_in_ranges);
+        P4EST_DEBUG_EXECUTE (found_in_notify = 1);
+        ++l;
+      }
+      if (j != rank && peers[j].send_first.elem_count > 0) {
+        P4EST_ASSERT (found_in_ranges && found_in_notify);
+      }
+      if (peers[j].send_first.elem_count == 0) {
+        P4EST_ASSERT (!found_in_notify);
+      }
+    }
+    P4EST_ASSERT (k == num_receivers_ranges);
+    P4EST_ASSERT (l == num_receivers_notify);
+
+    /* verify sender side */
+    P4EST_ASSERT (num_senders_notify <= num_senders_ranges);
+    k = l = 0;
+    for (j = 0; j < num_procs; ++j) {
+      P4EST_DEBUG_EXECUTE (found_in_ranges = found_in_notify = 0);
+      if (k < num_senders_ranges && sender_ranks_ranges[k] == j) {
+        P4EST_ASSERT (j != rank);
+        P4EST_DEBUG_EXECUTE (found_in_ranges = 1);
+        ++k;
+      }
+      if (l < num_senders_notify && sender_ranks_notify[l] == j) {
+        P4EST_ASSERT (j != rank && found_in_ranges);
+        P4EST_DEBUG_EXECUTE (found_in_notify = 1);      /* for symmetry */
+        ++l;
+      }
+    }
+    P4EST_ASSERT (k == num_senders_ranges);
+    P4EST_ASSERT (l == num_senders_notify);
+  }
+
+  /*
+   * loop over all peers and send first round of quadrants
+   * for intra-tree balancing, each load is contained in one tree
+   */
+  total_send_count = total_recv_count = 0;
+  request_first_count = request_second_count = request_send_count = 0;
+  send_zero[0] = send_load[0] = recv_zero[0] = recv_load[0] = 0;
+  send_zero[1] = send_load[1] = recv_zero[1] = recv_load[1] = 0;
+  if (is_ranges_primary) {
+    P4EST_ASSERT (is_ranges_active);
+    receiver_ranks = receiver_ranks_ranges;
+    sender_ranks = sender_ranks_ranges;
+    num_receivers = num_receivers_ranges;
+    num_senders = num_senders_ranges;
+  }
+  else {
+    P4EST_ASSERT (is_notify_active);
+    receiver_ranks = receiver_ranks_notify;
+    sender_ranks = sender_ranks_notify;
+    num_receivers = num_receivers_notify;
+    num_senders = num_senders_notify;
+  }
+  P4EST_ASSERT (receiver_ranks != NULL && sender_ranks != NULL);
+  num_receivers_ranges = num_senders_ranges = 0;
+  num_receivers_notify = num_senders_notify = 0;
+
+  /* Use receiver_ranks array to send to them */
+  for (k = 0; k < num_receivers; ++k) {
+    j = receiver_ranks[k];
+    P4EST_ASSERT (j >= first_peer && j <= last_peer && j != rank);
+    peer = peers + j;
+    qcount = peer->send_first.elem_count;
+
+    /* first send number of quadrants to be expected */
+    if (qcount > 0) {
+      P4EST_LDEBUGF ("Balance A send %llu quadrants to %d\n",
+                     (unsigned long long) qcount, j);
+      ++send_load[0];
+    }
+    else {
+      P4EST_ASSERT (is_ranges_primary);
+      ++send_zero[0];
+    }
+    peer->send_first_count = (int) qcount;
+    p4est_inspect_send (p4est->inspect, P4EST_INSPECT_BALANCE, j,
+                        qcount * sizeof (p4est_quadrant_t));
+    mpiret = MPI_Isend (&peer->send_first_count, 1, MPI_INT,
+                        j, P4EST_COMM_BALANCE_FIRST_COUNT,
+                        p4est->mpicomm, &send_requests_first_count[j]);
+    SC_CHECK_MPI (mpiret);
+    ++request_send_count;
+
+    /* sort and send the actual quadrants and post receive for reply */
+    if (qcount > 0) {
+      sc_array_sort (&peer->send_first, p4est_quadrant_compare_piggy);
+
+#ifdef P4EST_ENABLE_DEBUG
+      checksum = p4est_quadrant_checksum (&peer->send_first, &checkarray, 0);
+      P4EST_LDEBUGF ("Balance A send checksum 0x%08x to %d\n", checksum, j);
+#endif /* P4EST_ENABLE_DEBUG */
+
+      total_send_count += qcount;
+      qbytes = qcount * sizeof (p4est_quadrant_t);
+      mpiret = MPI_Isend (peer->send_first.array, (int) qbytes, MPI_BYTE,
+                          j, P4EST_COMM_BALANCE_FIRST_LOAD,
+                          p4est->mpicomm, &send_requests_first_load[j]);
+      SC_CHECK_MPI (mpiret);
+      ++request_send_count;
+      mpiret = MPI_Irecv (&peer->recv_second_count, 1, MPI_INT,
+                          j, P4EST_COMM_BALANCE_SECOND_COUNT,
+                          p4est->mpicomm, &requests_second[j]);
+      SC_CHECK_MPI (mpiret);
+      ++request_second_count;
+    }
+  }
+  peer = NULL;
+  P4EST_FREE (receiver_ranks_ranges);
+  P4EST_FREE (receiver_ranks_notify);
+  receiver_ranks = receiver_ranks_ranges = receiver_ranks_notify = NULL;
+
+  /* find out who is sending to me and receive quadrant counts */
+  for (k = 0; k < num_senders; ++k) {
+    j = sender_ranks[k];
+    ++request_first_count;
+    mpiret = MPI_Irecv (&peers[j].recv_first_count, 1, MPI_INT,
+                        j, P4EST_COMM_BALANCE_FIRST_COUNT,
+                        p4est->mpicomm, &requests_first[j]);
+    SC_CHECK_MPI (mpiret);
+  }
+  P4EST_FREE (sender_ranks_ranges);
+  P4EST_FREE (sender_ranks_notify);
+  sender_ranks = sender_ranks_ranges = sender_ranks_notify = NULL;
+
+#endif /* P4EST_ENABLE_MPI */
+
+  /* overlap the first round of messages with the isolated trees */
+  P4EST_REGION_END ("balance.comm");
+  P4EST_REGION_BEGIN ("balance.A");
+  if (p4est->inspect != NULL) {
+    p4est->inspect->balance_A -= sc_MPI_Wtime ();
+    thread_times = p4est->inspect->balance_A_threads;
+  }
+  (void) p4est_balance_local (p4est, btype, init_fn, replace_fn,
+                              NULL, tree_flags, 1, thread_times);
+  P4EST_REGION_END ("balance.A");
+  if (p4est->inspect != NULL) {
+    p4est->inspect->balance_A += sc_MPI_Wtime ();
+  }
+#ifdef P4_TO_P8
+  sc_array_reset (eta);
+#endif
+  sc_array_reset (cta);
+
+  /* store the state required to complete the balance */
+  ctx = P4EST_ALLOC (p4est_balance_context_t, 1);
+  ctx->p4est = p4est;
+  ctx->is_current = 0;
+  ctx->btype = btype;
+  ctx->init_fn = init_fn;
+  ctx->replace_fn = replace_fn;
+  ctx->tree_flags = tree_flags;
+  ctx->localcount = localcount;
+  ctx->all_incount = all_incount;
+  ctx->first_tree = first_tree;
+  ctx->last_tree = last_tree;
+  ctx->skipped = skipped;
+  ctx->old_gnq = old_gnq;
+  ctx->peers = peers;
+  ctx->borders = borders;
+#ifdef P4EST_ENABLE_DEBUG
+  ctx->data_pool_size = data_pool_size;
+#endif
+#ifdef P4EST_ENABLE_MPI
+#ifdef P4EST_ENABLE_DEBUG
+  ctx->checkarray = checkarray;
+#endif
+  ctx->request_first_count = request_first_count;
+  ctx->request_second_count = request_second_count;
+  ctx->request_send_count = request_send_count;
+  ctx->total_send_count = total_send_count;
+  ctx->total_recv_count = total_recv_count;
+  for (k = 0; k < 2; ++k) {
+    ctx->send_zero[k] = send_zero[k];
+    ctx->send_load[k] = send_load[k];
+    ctx->recv_zero[k] = recv_zero[k];
+    ctx->recv_load[k] = recv_load[k];
+  }
+  ctx->wait_indices = wait_indices;
+  ctx->requests_first = requests_first;
+  ctx->recv_statuses = recv_statuses;
+#endif
+
+  return ctx;
+}
+
+void
+p4est_balance_end (p4est_balance_context_t * ctx)
+{
+  p4est_t            *p4est = ctx->p4est;
+  const int           rank = p4est->mpirank;
+  const int           num_procs = p4est->mpisize;
+  const p4est_connect_type_t btype = ctx->btype;
+  p4est_init_t        init_fn = ctx->init_fn;
+  p4est_replace_t     replace_fn = ctx->replace_fn;
+  int                 j;
+  int8_t             *tree_flags = ctx->tree_flags;
+  size_t              zz;
+  size_t              localcount = ctx->localcount;
+  size_t              qcount, qbytes, peer_bytes;
+  size_t              all_outcount;
+  p4est_topidx_t      qtree, nt;
+  p4est_topidx_t      first_tree = ctx->first_tree;
+  p4est_topidx_t      last_tree = ctx->last_tree;
+  p4est_locidx_t      skipped = ctx->skipped;
+  p4est_gloidx_t      old_gnq = ctx->old_gnq;
+  p4est_balance_peer_t *peers = ctx->peers, *peer;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, *s;
+  p4est_connectivity_t *conn = p4est->connectivity;
+  sc_array_t         *qarray;
+  sc_array_t         *borders = ctx->borders;
+  double             *thread_times;
+#ifdef P4EST_ENABLE_DEBUG
+  size_t              all_incount = ctx->all_incount;
+  size_t              data_pool_size = ctx->data_pool_size;
+#endif
+#ifdef P4EST_ENABLE_MPI
+#ifdef P4EST_ENABLE_DEBUG
+  unsigned            checksum;
+  sc_array_t          checkarray = ctx->checkarray;
+  p4est_gloidx_t      ltotal[2], gtotal[2];
+#endif /* P4EST_ENABLE_DEBUG */
+  int                 i, k;
+  int                 mpiret, rcount;
+  int                 request_first_count = ctx->request_first_count;
+  int                 request_second_count = ctx->request_second_count;
+  int                 outcount;
+  int                 request_send_count = ctx->request_send_count;
+  int                 total_send_count = ctx->total_send_count;
+  int                 total_recv_count = ctx->total_recv_count;
+  int                 send_zero[2], send_load[2];
+  int                 recv_zero[2], recv_load[2];
+  int                *wait_indices = ctx->wait_indices;
+  MPI_Request        *requests_first = ctx->requests_first;
+  MPI_Request        *requests_second;
+  MPI_Request        *send_requests_first_count;
+  MPI_Request        *send_requests_second_count, *send_requests_second_load;
+  MPI_Status         *recv_statuses = ctx->recv_statuses, *jstatus;
+#endif /* P4EST_ENABLE_MPI */
+
+  if (ctx->is_current) {
+    P4EST_FREE (ctx);
+    return;
+  }
+
+#ifdef P4EST_ENABLE_MPI
+  requests_second = requests_first + 1 * num_procs;
+  send_requests_first_count = requests_first + 2 * num_procs;
+  send_requests_second_count = requests_first + 4 * num_procs;
+  send_requests_second_load = requests_first + 5 * num_procs;
+  for (k = 0; k < 2; ++k) {
+    send_zero[k] = ctx->send_zero[k];
+    send_load[k] = ctx->send_load[k];
+    recv_zero[k] = ctx->recv_zero[k];
+    recv_load[k] = ctx->recv_load[k];
+  }
+#endif /* P4EST_ENABLE_MPI */
+  P4EST_FREE (ctx);
+  P4EST_REGION_BEGIN ("balance.comm");
+
+#ifdef P4EST_ENABLE_MPI
+  /* wait for quadrant counts and post receive and send for quadrants */
+  while (request_first_count > 0) {
+    mpiret = sc_MPI_Waitsome (num_procs, requests_first,
+                              &outcount, wait_indices, recv_statuses);
+    SC_CHECK_MPI (mpiret);
+    P4EST_ASSERT (outcount != MPI_UNDEFINED);
+    P4EST_ASSERT (outcount > 0);
+    for (i = 0; i < outcount; ++i) {
+      /* retrieve sender's rank */
+      j = wait_indices[i];
+      jstatus = &recv_statuses[i];
+      wait_indices[i] = -1;
+      P4EST_ASSERT (j != rank && 0 <= j && j < num_procs);
+      P4EST_ASSERT (requests_first[j] == MPI_REQUEST_NULL);
+      P4EST_ASSERT (jstatus->MPI_SOURCE == j);
+
+      /* check if we are in receiving count or load */
+      peer = peers + j;
+      P4EST_ASSERT (!peer->have_first_load);
+      if (!peer->have_first_count) {
+        /* verify message size */
+        P4EST_ASSERT (jstatus->MPI_TAG == P4EST_COMM_BALANCE_FIRST_COUNT);
+        mpiret = sc_MPI_Get_count (jstatus, MPI_INT, &rcount);
+        SC_CHECK_MPI (mpiret);
+        SC_CHECK_ABORTF (rcount == 1, "Receive count mismatch A %d", rcount);
+
+        /* process the count information received */
+        peer->have_first_count = 1;
+        qcount = (size_t) peer->recv_first_count;
+        if (qcount > 0) {
+          /* received nonzero count, post receive for load */
+          P4EST_LDEBUGF ("Balance A recv %llu quadrants from %d\n",
+                         (unsigned long long) qcount, j);
+          P4EST_ASSERT (peer->recv_first.elem_count == 0);
+          sc_array_resize (&peer->recv_first, qcount);
+          total_recv_count += qcount;
+          qbytes = qcount * sizeof (p4est_quadrant_t);
+          P4EST_ASSERT (requests_first[j] == MPI_REQUEST_NULL);
+          mpiret = MPI_Irecv (peer->recv_first.array, (int) qbytes, MPI_BYTE,
+                              j, P4EST_COMM_BALANCE_FIRST_LOAD,
+                              p4est->mpicomm, &requests_first[j]);
+          SC_CHECK_MPI (mpiret);
+          ++recv_load[0];
+        }
+        else {
+          /* will not receive load, close this request */
+          P4EST_ASSERT (qcount == 0);
+          P4EST_ASSERT (requests_first[j] == MPI_REQUEST_NULL);
+          --request_first_count;
+          ++recv_zero[0];
+        }
+      }
+      else {
+        /* verify received size */
+        P4EST_ASSERT (jstatus->MPI_TAG == P4EST_COMM_BALANCE_FIRST_LOAD);
+        P4EST_ASSERT (peer->recv_first_count > 0);
+        mpiret = sc_MPI_Get_count (jstatus, MPI_BYTE, &rcount);
+        SC_CHECK_MPI (mpiret);
+        SC_CHECK_ABORTF (rcount ==
+                         peer->recv_first_count *
+                         (int) sizeof (p4est_quadrant_t),
+                         "Receive load mismatch A %d %dx%llu", rcount,
+                         peer->recv_first_count,
+                         (unsigned long long) sizeof (p4est_quadrant_t));
+
+        /* received load, close this request */
+        peer->have_first_load = 1;
+        P4EST_ASSERT (requests_first[j] == MPI_REQUEST_NULL);
+        --request_first_count;
+
+#ifdef P4EST_ENABLE_DEBUG
+        checksum =
+          p4est_quadrant_checksum (&peer->recv_first, &checkarray, 0);
+        P4EST_LDEBUGF ("Balance A recv checksum 0x%08x from %d\n", checksum,
+                       j);
+#endif /* P4EST_ENABLE_DEBUG */
+
+        /* process incoming quadrants to interleave with communication */
+        p4est_balance_response (p4est, peer, btype, borders);
+        qcount = peer->send_second.elem_count;
+        if (qcount > 0) {
+          P4EST_LDEBUGF ("Balance B send %llu quadrants to %d\n",
+                         (unsigned long long) qcount, j);
+          ++send_load[1];
+        }
+        else {
+          ++send_zero[1];
+        }
+        peer->send_second_count = (int) qcount;
+        p4est_inspect_send (p4est->inspect, P4EST_INSPECT_BALANCE, j,
+                            qcount * sizeof (p4est_quadrant_t));
+        mpiret = MPI_Isend (&peer->send_second_count, 1, MPI_INT,
+                            j, P4EST_COMM_BALANCE_SECOND_COUNT,
+                            p4est->mpicomm, &send_requests_second_count[j]);
+        SC_CHECK_MPI (mpiret);
+        ++request_send_count;
+        if (qcount > 0) {
+
+#ifdef P4EST_ENABLE_DEBUG
+          checksum =
+            p4est_quadrant_checksum (&peer->send_second, &checkarray, 0);
+          P4EST_LDEBUGF ("Balance B send checksum 0x%08x to %d\n", checksum,
+                         j);
+#endif /* P4EST_ENABLE_DEBUG */
+
+          total_send_count += qcount;
+          qbytes = qcount * sizeof (p4est_quadrant_t);
+          mpiret = MPI_Isend (peer->send_second.array, (int) qbytes, MPI_BYTE,
+                              j, P4EST_COMM_BALANCE_SECOND_LOAD,
+                              p4est->mpicomm, &send_requests_second_load[j]);
+          SC_CHECK_MPI (mpiret);
+          ++request_send_count;
+        }
+      }
+    }
+  }
+  for (j = 0; j < num_procs; ++j) {
+    P4EST_ASSERT (requests_first[j] == MPI_REQUEST_NULL);
+  }
+#endif /* P4EST_ENABLE_MPI */
+
+  /* simulate send and receive with myself across tree boundaries */
+  peer = peers + rank;
+  sc_array_sort (&peer->send_first, p4est_quadrant_compare_piggy);
+  qcount = peer->send_first.elem_count;
+  peer->recv_first_count = peer->send_first_count = (int) qcount;
+  qbytes = qcount * sizeof (p4est_quadrant_t);
+  qarray = &peer->recv_first;
+  sc_array_resize (qarray, qcount);
+  memcpy (qarray->array, peer->send_first.array, qbytes);
+  p4est_balance_response (p4est, peer, btype, borders);
+  qcount = peer->send_second.elem_count;
+  peer->recv_second_count = peer->send_second_count = (int) qcount;
+  qbytes = qcount * sizeof (p4est_quadrant_t);
+  qarray = &peer->recv_second;
+  sc_array_resize (qarray, qcount);
+  memcpy (qarray->array, peer->send_second.array, qbytes);
+
+#ifdef P4EST_ENABLE_MPI
+  /* receive second round appending to the same receive buffer */
+  while (request_second_count > 0) {
+    mpiret = sc_MPI_Waitsome (num_procs, requests_second,
+                              &outcount, wait_indices, recv_statuses);
+    SC_CHECK_MPI (mpiret);
+    P4EST_ASSERT (outcount != MPI_UNDEFINED);
+    P4EST_ASSERT (outcount > 0);
+    for (i = 0; i < outcount; ++i) {
+      /* retrieve sender's rank */
+      j = wait_indices[i];
+      jstatus = &recv_statuses[i];
+      wait_indices[i] = -1;
+      P4EST_ASSERT (j != rank && 0 <= j && j < num_procs);
+      P4EST_ASSERT (requests_second[j] == MPI_REQUEST_NULL);
+      P4EST_ASSERT (jstatus->MPI_SOURCE == j);
+
+      /* check if we are in receiving count or load */
+      peer = peers + j;
+      P4EST_ASSERT (!peer->have_second_load);
+      if (!peer->have_second_count) {
+        /* verify message size */
+        P4EST_ASSERT (jstatus->MPI_TAG == P4EST_COMM_BALANCE_SECOND_COUNT);
+        mpiret = sc_MPI_Get_count (jstatus, MPI_INT, &rcount);
+        SC_CHECK_MPI (mpiret);
+        SC_CHECK_ABORTF (rcount == 1, "Receive count mismatch B %d", rcount);
+
+        /* process the count information received */
+        peer->have_second_count = 1;
+        qcount = (size_t) peer->recv_second_count;
+        if (qcount > 0) {
+          /* received nonzero count, post receive for load */
+          P4EST_LDEBUGF ("Balance B recv %llu quadrants from %d\n",
+                         (unsigned long long) qcount, j);
+          P4EST_ASSERT (peer->recv_second.elem_count == 0);
+          sc_array_resize (&peer->recv_second, qcount);
+          total_recv_count += qcount;
+          qbytes = qcount * sizeof (p4est_quadrant_t);
+          P4EST_ASSERT (requests_second[j] == MPI_REQUEST_NULL);
+          mpiret = MPI_Irecv (peer->recv_second.array, (int) qbytes,
+                              MPI_BYTE, j, P4EST_COMM_BALANCE_SECOND_LOAD,
+                              p4est->mpicomm, &requests_second[j]);
+          SC_CHECK_MPI (mpiret);
+          ++recv_load[1];
+        }
+        else {
+          /* will not receive load, close this request */
+          P4EST_ASSERT (qcount == 0);
+          P4EST_ASSERT (requests_second[j] == MPI_REQUEST_NULL);
+          --request_second_count;
+          ++recv_zero[1];
+        }
+      }
+      else {
+        /* verify received size */
+        P4EST_ASSERT (jstatus->MPI_TAG == P4EST_COMM_BALANCE_SECOND_LOAD);
+        P4EST_ASSERT (peer->recv_second_count > 0);
+        mpiret = sc_MPI_Get_count (jstatus, MPI_BYTE, &rcount);
+        SC_CHECK_MPI (mpiret);
+        SC_CHECK_ABORTF (rcount ==
+                         peer->recv_second_count *
                          (int) sizeof (p4est_quadrant_t),
-                         "Receive load mismatch A %d %dx%llu", rcount,
-                         peer->recv_first_count,
+                         "Receive load mismatch B %d %dx%llu", rcount,
+                         peer->recv_second_count,
                          (unsigned long long) sizeof (p4est_quadrant_t));
 
-        /* received load, close this request */
-        peer->have_first_load = 1;
-        P4EST_ASSERT (requests_first[j] == MPI_REQUEST_NULL);
-        --request_first_count;
+        /* received load, close this request */
+        peer->have_second_load = 1;
+        P4EST_ASSERT (requests_second[j] == MPI_REQUEST_NULL);
+        --request_second_count;
+
+#ifdef P4EST_ENABLE_DEBUG
+        checksum =
+          p4est_quadrant_checksum (&peer->recv_second, &checkarray, 0);
+        P4EST_LDEBUGF ("Balance B recv checksum 0x%08x from %d\n", checksum,
+                       j);
+#endif /* P4EST_ENABLE_DEBUG */
+      }
+    }
+  }
+  for (j = 0; j < num_procs; ++j) {
+    P4EST_ASSERT (requests_second[j] == MPI_REQUEST_NULL);
+  }
+
+  /* print buffer statistics */
+  P4EST_VERBOSEF ("first send Z %d L %d recv Z %d L %d\n",
+                  send_zero[0], send_load[0], recv_zero[0], recv_load[0]);
+  P4EST_VERBOSEF ("second send Z %d L %d recv Z %d L %d\n",
+                  send_zero[1], send_load[1], recv_zero[1], recv_load[1]);
+  P4EST_VERBOSEF ("total send %d recv %d\n", total_send_count,
+                  total_recv_count);
+  for (j = 0; j < num_procs; ++j) {
+    peer = peers + j;
+    if (peer->send_first.elem_count > 0 || peer->recv_first_count > 0 ||
+        peer->send_second.elem_count > 0 || peer->recv_second_count > 0) {
+      P4EST_VERBOSEF ("peer %d first S %llu R %d second S %llu R %d\n",
+                      j, (unsigned long long) peer->send_first.elem_count,
+                      peer->recv_first_count,
+                      (unsigned long long) peer->send_second.elem_count,
+                      peer->recv_second_count);
+    }
+  }
+#endif /* P4EST_ENABLE_MPI */
+
+  /* end balance_comm, start balance_B */
+  P4EST_REGION_END ("balance.comm");
+  P4EST_REGION_BEGIN ("balance.B");
+  thread_times = NULL;
+  if (p4est->inspect != NULL) {
+    thread_times = p4est->inspect->balance_B_threads;
+    p4est->inspect->balance_comm += sc_MPI_Wtime ();
+    p4est->inspect->balance_B = -sc_MPI_Wtime ();
+    p4est->inspect->balance_B_count_in = 0;
+    p4est->inspect->balance_B_count_out = 0;
+    p4est->inspect->use_B = 1;
+#ifdef P4EST_ENABLE_MPI
+    for (k = 0; k < 2; ++k) {
+      p4est->inspect->balance_zero_sends[k] = send_zero[k];
+      p4est->inspect->balance_zero_receives[k] = recv_zero[k];
+    }
+
+    /* every count message may be followed by a load message */
+    p4est_inspect_comm (p4est->inspect, P4EST_INSPECT_BALANCE,
+                        (size_t) (send_zero[0] + send_load[0] +
+                                  recv_zero[0] + recv_load[0]),
+                        (size_t) (send_zero[0] + send_zero[1] +
+                                  2 * (send_load[0] + send_load[1])),
+                        total_send_count * sizeof (p4est_quadrant_t) +
+                        (send_zero[0] + send_zero[1] +
+                         send_load[0] + send_load[1]) * sizeof (int),
+                        (size_t) (recv_zero[0] + recv_zero[1] +
+                                  2 * (recv_load[0] + recv_load[1])),
+                        total_recv_count * sizeof (p4est_quadrant_t) +
+                        (recv_zero[0] + recv_zero[1] +
+                         recv_load[0] + recv_load[1]) * sizeof (int));
+#endif
+  }
+
+  /* merge received quadrants */
+  for (j = 0; j < num_procs; ++j) {
+    size_t              fcount;
+
+    /* access peer information */
+    peer = peers + j;
+    fcount = peer->recv_first.elem_count;
+    qcount = fcount + peer->recv_second.elem_count;
+    P4EST_ASSERT (peer->send_first_count ==
+                  (int) peer->send_first.elem_count);
+    P4EST_ASSERT (peer->send_second_count ==
+                  (int) peer->send_second.elem_count);
+    P4EST_ASSERT (peer->recv_second_count ==
+                  (int) peer->recv_second.elem_count);
+    if (qcount == 0) {
+      continue;
+    }
+
+    /* merge received quadrants into correct tree */
+    for (zz = 0; zz < qcount; ++zz) {
+      s = zz < fcount ? p4est_quadrant_array_index (&peer->recv_first, zz) :
+        p4est_quadrant_array_index (&peer->recv_second, zz - fcount);
+      P4EST_ASSERT (p4est_quadrant_is_extended (s));
+      qtree = s->p.piggy2.which_tree;
+      if (qtree < first_tree || qtree > last_tree) {
+        /* this is a corner/edge quadrant from the second pass of balance */
+        continue;
+      }
+      if (borders == NULL) {
+        tree = p4est_tree_array_index (p4est->trees, qtree);
+        q = p4est_quadrant_array_push_copy (&tree->quadrants, s);
+        ++tree->quadrants_per_level[q->level];
+        tree->maxlevel = (int8_t) SC_MAX (tree->maxlevel, q->level);
+        ++p4est->local_num_quadrants;
+        p4est_quadrant_init_data (p4est, qtree, q, init_fn);
+      }
+      else {
+        qarray = (sc_array_t *) sc_array_index (borders,
+                                                (int) (qtree - first_tree));
+        (void) p4est_quadrant_array_push_copy (qarray, s);
+      }
+    }
+  }
+
+  /* rebalance and clamp result back to original tree boundaries */
+  (void) p4est_balance_local (p4est, btype, init_fn, replace_fn,
+                              borders, tree_flags, 0, thread_times);
+  p4est->local_num_quadrants = 0;
+  for (nt = first_tree; nt <= last_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    tree->quadrants_offset = p4est->local_num_quadrants;
+    p4est->local_num_quadrants += tree->quadrants.elem_count;
+  }
+  if (last_tree >= 0) {
+    for (; nt < conn->num_trees; ++nt) {
+      tree = p4est_tree_array_index (p4est->trees, nt);
+      tree->quadrants_offset = p4est->local_num_quadrants;
+    }
+  }
+
+  /* end balance_B */
+  P4EST_REGION_END ("balance.B");
+  if (p4est->inspect != NULL) {
+    p4est->inspect->balance_B += sc_MPI_Wtime ();
+  }
+
+#ifdef P4EST_ENABLE_MPI
+  /* wait for all send operations */
+  if (request_send_count > 0) {
+    mpiret = sc_MPI_Waitall (4 * num_procs,
+                             send_requests_first_count, MPI_STATUSES_IGNORE);
+    SC_CHECK_MPI (mpiret);
+  }
+
+  /* compute global sum of send and receive counts */
+#ifdef P4EST_ENABLE_DEBUG
+  gtotal[0] = gtotal[1] = 0;
+  ltotal[0] = (p4est_gloidx_t) total_send_count;
+  ltotal[1] = (p4est_gloidx_t) total_recv_count;
+  mpiret = MPI_Reduce (ltotal, gtotal, 2, P4EST_MPI_GLOIDX,
+                       MPI_SUM, 0, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_GLOBAL_STATISTICSF ("Global number of shipped quadrants %lld\n",
+                            (long long) gtotal[0]);
+  P4EST_ASSERT (rank != 0 || gtotal[0] == gtotal[1]);
+#endif /* P4EST_ENABLE_DEBUG */
+#endif /* P4EST_ENABLE_MPI */
+
+  /* loop over all local trees to finalize balance */
+  all_outcount = 0;
+  for (nt = first_tree; nt <= last_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    all_outcount += tree->quadrants.elem_count;
+
+    /* final log message for this tree */
+    P4EST_VERBOSEF ("Done balance tree %lld now %llu\n", (long long) nt,
+                    (unsigned long long) tree->quadrants.elem_count);
+  }
+
+  /* cleanup temporary storage */
+  P4EST_FREE (tree_flags);
+  peer_bytes = 0;
+  for (j = 0; j < num_procs; ++j) {
+    peer = peers + j;
+    peer_bytes += (peer->send_first.elem_count + peer->send_second.elem_count
+                   + peer->recv_first.elem_count
+                   + peer->recv_second.elem_count) *
+      sizeof (p4est_quadrant_t);
+    sc_array_reset (&peer->send_first);
+    sc_array_reset (&peer->send_second);
+    sc_array_reset (&peer->recv_first);
+    sc_array_reset (&peer->recv_second);
+  }
+  P4EST_FREE (peers);
+
+  /* the message buffers have grown to their largest size by now */
+  p4est_inspect_alloc (p4est->inspect, P4EST_INSPECT_BALANCE, peer_bytes);
+  p4est_inspect_free (p4est->inspect, P4EST_INSPECT_BALANCE, peer_bytes);
+
+  if (borders != NULL) {
+    for (zz = 0; zz < localcount; zz++) {
+      qarray = (sc_array_t *) sc_array_index (borders, zz);
+      sc_array_reset (qarray);
+    }
+    sc_array_destroy (borders);
+  }
+
+#ifdef P4EST_ENABLE_MPI
+  P4EST_FREE (requests_first);  /* includes allocation for requests_second */
+  P4EST_FREE (recv_statuses);
+  P4EST_FREE (wait_indices);
+#ifdef P4EST_ENABLE_DEBUG
+  sc_array_reset (&checkarray);
+#endif /* P4EST_ENABLE_DEBUG */
+#endif /* P4EST_ENABLE_MPI */
+
+  /* compute global number of quadrants */
+  p4est_comm_count_quadrants (p4est);
+  P4EST_ASSERT (p4est->global_num_quadrants >= old_gnq);
+  if (old_gnq != p4est->global_num_quadrants) {
+    ++p4est->revision;
+  }
+  if (p4est->balance_dirty != NULL) {
+    /* now every tree is balanced */
+    memset (p4est->balance_dirty, 0, (size_t) conn->num_trees);
+    p4est->balance_type = btype;
+    p4est->balance_revision = p4est->revision;
+  }
+
+  /* some sanity checks */
+  P4EST_ASSERT ((p4est_locidx_t) all_outcount == p4est->local_num_quadrants);
+  P4EST_ASSERT (all_outcount >= all_incount);
+  if (p4est->user_data_pool != NULL) {
+    P4EST_ASSERT (data_pool_size + all_outcount - all_incount ==
+                  p4est_quadrant_data_count (p4est));
+  }
+  p4est_compact_data (p4est);
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (p4est_is_balanced (p4est, btype));
+  P4EST_VERBOSEF ("Balance skipped %lld\n", (long long) skipped);
+  if (p4est->inspect != NULL) {
+    /* the time of a split balance excludes the work done in between */
+    p4est_inspect_stop (p4est->inspect, P4EST_INSPECT_BALANCE,
+                        sc_MPI_Wtime () - (p4est->inspect->balance_A +
+                                           p4est->inspect->balance_comm +
+                                           p4est->inspect->balance_B));
+  }
+  p4est_log_indent_pop ();
+  P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
+                            "_balance with %lld total quadrants\n",
+                            (long long) p4est->global_num_quadrants);
+}
+
+void
+p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
+                   p4est_init_t init_fn, p4est_replace_t replace_fn)
+{
+  p4est_balance_end (p4est_balance_begin (p4est, btype, init_fn,
+                                          replace_fn));
+}
+
+void
+p4est_balance_ensemble (int num_forests, p4est_t * forests[],
+                        p4est_connect_type_t btype, p4est_init_t init_fn,
+                        p4est_replace_t replace_fn)
+{
+  int                 f;
+  p4est_balance_context_t **contexts;
+
+  P4EST_ASSERT (num_forests >= 0);
+  contexts = P4EST_ALLOC (p4est_balance_context_t *, num_forests);
+
+  /* messages between two processes are matched in the order of forests */
+  for (f = 0; f < num_forests; ++f) {
+    P4EST_ASSERT (forests[f]->mpisize == forests[0]->mpisize);
+    contexts[f] = p4est_balance_begin (forests[f], btype, init_fn,
+                                       replace_fn);
+  }
+  for (f = 0; f < num_forests; ++f) {
+    p4est_balance_end (contexts[f]);
+  }
+  P4EST_FREE (contexts);
+}
+
+/** Determine whether a quadrant has a possible neighbor outside of the
+ * local part of its tree, which includes any neighbor in another tree.
+ */
+static int
+p4est_quadrant_is_local_border (p4est_tree_t * tree,
+                                const p4est_quadrant_t * q)
+{
+  int                 k, l;
+#ifdef P4_TO_P8
+  int                 m;
+#endif
+  p4est_qcoord_t      qh = P4EST_QUADRANT_LEN (q->level);
+  p4est_quadrant_t    s, fd, ld;
+
+  P4EST_QUADRANT_INIT (&s);
+  P4EST_QUADRANT_INIT (&fd);
+  P4EST_QUADRANT_INIT (&ld);
+#ifdef P4_TO_P8
+  for (m = -1; m <= 1; ++m) {
+#endif
+    for (k = -1; k <= 1; ++k) {
+      for (l = -1; l <= 1; ++l) {
+        s = *q;
+        s.x += l * qh;
+        s.y += k * qh;
+#ifdef P4_TO_P8
+        s.z += m * qh;
+#endif
+        if (!p4est_quadrant_is_inside_root (&s)) {
+          return 1;
+        }
+        p4est_quadrant_first_descendant (&s, &fd, P4EST_QMAXLEVEL);
+        p4est_quadrant_last_descendant (&s, &ld, P4EST_QMAXLEVEL);
+        if (p4est_quadrant_compare (&fd, &tree->first_desc) < 0 ||
+            p4est_quadrant_compare (&tree->last_desc, &ld) < 0) {
+          return 1;
+        }
+      }
+    }
+#ifdef P4_TO_P8
+  }
+#endif
+  return 0;
+}
+
+void
+p4est_refine_balanced (p4est_t * p4est, int refine_recursive,
+                       int allowed_level, p4est_connect_type_t btype,
+                       p4est_refine_t refine_fn, p4est_init_t init_fn,
+                       p4est_replace_t replace_fn)
+{
+  int                 changed, border_changed, was_balanced;
+  size_t              zz, *old_counts;
+  ssize_t             index;
+  p4est_topidx_t      nt, num_local_trees;
+  p4est_gloidx_t      old_gnq;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, *r;
+  sc_array_t         *borders;
+
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_refine_balanced %s with %lld total quadrants\n",
+                            p4est_connect_type_string (btype),
+                            (long long) p4est->global_num_quadrants);
+  p4est_log_indent_push ();
+
+  /* without incremental tracking the input is assumed balanced */
+  was_balanced = p4est->balance_dirty == NULL ||
+    (p4est->balance_type >= btype &&
+     p4est->balance_revision == p4est->revision);
+
+  /* remember the quadrants that may have neighbors elsewhere */
+  num_local_trees = p4est->last_local_tree - p4est->first_local_tree + 1;
+  old_counts = P4EST_ALLOC (size_t, SC_MAX (num_local_trees, 1));
+  borders = p4est_scratch_array_new (p4est, sizeof (p4est_quadrant_t));
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    old_counts[nt - p4est->first_local_tree] = tree->quadrants.elem_count;
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      if (p4est_quadrant_is_local_border (tree, q)) {
+        r = p4est_quadrant_array_push_copy (borders, q);
+        r->p.which_tree = nt;
+      }
+    }
+  }
+
+  p4est_refine_ext (p4est, refine_recursive, allowed_level,
+                    refine_fn, init_fn, replace_fn);
+
+  /* insert the ripple of the refinement into every changed tree */
+  changed = 0;
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    if (tree->quadrants.elem_count !=
+        old_counts[nt - p4est->first_local_tree]) {
+      p4est_balance_subtree_ext (p4est, btype, nt, init_fn, replace_fn);
+      changed = 1;
+    }
+  }
+
+  /* a new quadrant can only have a neighbor elsewhere if it replaces one
+     of the border quadrants, since it is contained in that */
+  border_changed = 0;
+  for (zz = 0; !border_changed && zz < borders->elem_count; ++zz) {
+    q = p4est_quadrant_array_index (borders, zz);
+    tree = p4est_tree_array_index (p4est->trees, q->p.which_tree);
+    if (tree->quadrants.elem_count ==
+        old_counts[q->p.which_tree - p4est->first_local_tree]) {
+      continue;
+    }
+    index = p4est_find_lower_bound (&tree->quadrants, q, 0);
+    if (index < 0 ||
+        !p4est_quadrant_is_equal (q, p4est_quadrant_array_index
+                                  (&tree->quadrants, (size_t) index))) {
+      border_changed = 1;
+    }
+  }
+  p4est_scratch_array_destroy (p4est, borders);
+  P4EST_FREE (old_counts);
+
+  if (changed) {
+    /* update the quadrant offsets of all trees */
+    p4est->local_num_quadrants = 0;
+    for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+      tree = p4est_tree_array_index (p4est->trees, nt);
+      tree->quadrants_offset = p4est->local_num_quadrants;
+      p4est->local_num_quadrants +=
+        (p4est_locidx_t) tree->quadrants.elem_count;
+    }
+    for (; nt < p4est->connectivity->num_trees; ++nt) {
+      tree = p4est_tree_array_index (p4est->trees, nt);
+      tree->quadrants_offset = p4est->local_num_quadrants;
+    }
+  }
+  old_gnq = p4est->global_num_quadrants;
+  p4est_comm_count_quadrants (p4est);
+  if (old_gnq != p4est->global_num_quadrants) {
+    ++p4est->revision;
+  }
+  p4est_compact_data (p4est);
+
+  if (p4est_comm_sync_flag (p4est, border_changed || !was_balanced,
+                            sc_MPI_BOR)) {
+    /* the ripple may cross to other trees or processes */
+    P4EST_GLOBAL_INFO ("Refine balanced needs the parallel balance\n");
+    p4est_balance_ext (p4est, btype, init_fn, replace_fn);
+  }
+  else if (p4est->balance_dirty != NULL) {
+    /* every tree is balanced as it was on input */
+    memset (p4est->balance_dirty, 0,
+            (size_t) p4est->connectivity->num_trees);
+    p4est->balance_type = btype;
+    p4est->balance_revision = p4est->revision;
+  }
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  p4est_log_indent_pop ();
+  P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
+                            "_refine_balanced with %lld total quadrants\n",
+                            (long long) p4est->global_num_quadrants);
+}
+
+p4est_adapt_map_t *
+p4est_adapt_map_new (p4est_t * p4est)
+{
+  size_t              zz;
+  p4est_topidx_t      nt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *r;
+  p4est_adapt_map_t  *map;
+
+  map = P4EST_ALLOC_ZERO (p4est_adapt_map_t, 1);
+  map->num_old = p4est->local_num_quadrants;
+  map->old_quadrants = sc_array_new_count (sizeof (p4est_quadrant_t),
+                                           (size_t) map->num_old);
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      r = p4est_quadrant_array_index (map->old_quadrants,
+                                      (size_t) tree->quadrants_offset + zz);
+      *r = *p4est_quadrant_array_index (&tree->quadrants, zz);
+      r->p.which_tree = nt;
+    }
+  }
+
+  return map;
+}
+
+void
+p4est_adapt_map_update (p4est_adapt_map_t * map, p4est_t * p4est)
+{
+  size_t              zz, count;
+  p4est_locidx_t      lo, ln, first;
+  p4est_topidx_t      nt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *o, *n;
+
+  P4EST_FREE (map->old_first);
+  P4EST_FREE (map->old_count);
+  P4EST_FREE (map->relation);
+  map->num_new = p4est->local_num_quadrants;
+  map->old_first = P4EST_ALLOC (p4est_locidx_t, map->num_new);
+  map->old_count = P4EST_ALLOC (p4est_locidx_t, map->num_new);
+  map->relation = P4EST_ALLOC (int8_t, map->num_new);
+
+  /* both sequences cover the same local domain in the same order */
+  lo = ln = 0;
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    count = tree->quadrants.elem_count;
+    for (zz = 0; zz < count;) {
+      n = p4est_quadrant_array_index (&tree->quadrants, zz);
+      SC_CHECK_ABORT (lo < map->num_old, "Adapt map of a repartition");
+      o = p4est_quadrant_array_index (map->old_quadrants, (size_t) lo);
+      SC_CHECK_ABORT (o->p.which_tree == nt &&
+                      (p4est_quadrant_is_equal (o, n) ||
+                       p4est_quadrant_is_ancestor (o, n) ||
+                       p4est_quadrant_is_ancestor (n, o)),
+                      "Adapt map of a repartition");
+      if (o->level == n->level) {
+        map->old_first[ln] = lo++;
+        map->old_count[ln] = 1;
+        map->relation[ln++] = P4EST_ADAPT_SAME;
+        ++zz;
+      }
+      else if (o->level < n->level) {
+        /* the old quadrant has been refined */
+        do {
+          map->old_first[ln] = lo;
+          map->old_count[ln] = 1;
+          map->relation[ln++] = P4EST_ADAPT_CHILD;
+        }
+        while (++zz < count && p4est_quadrant_is_ancestor
+               (o, p4est_quadrant_array_index (&tree->quadrants, zz)));
+        ++lo;
+      }
+      else {
+        /* a range of old quadrants has been coarsened */
+        first = lo;
+        while (++lo < map->num_old) {
+          o = p4est_quadrant_array_index (map->old_quadrants, (size_t) lo);
+          if (o->p.which_tree != nt || !p4est_quadrant_is_ancestor (n, o)) {
+            break;
+          }
+        }
+        map->old_first[ln] = first;
+        map->old_count[ln] = lo - first;
+        map->relation[ln++] = P4EST_ADAPT_PARENT;
+        ++zz;
+      }
+    }
+  }
+  SC_CHECK_ABORT (lo == map->num_old && ln == map->num_new,
+                  "Adapt map of a repartition");
+}
+
+void
+p4est_adapt_map_destroy (p4est_adapt_map_t * map)
+{
+  sc_array_destroy (map->old_quadrants);
+  P4EST_FREE (map->old_first);
+  P4EST_FREE (map->old_count);
+  P4EST_FREE (map->relation);
+  P4EST_FREE (map);
+}
+
+void
+p4est_adapt_map_counts (const p4est_adapt_map_t * map,
+                        const int *old_counts, int *new_counts)
+{
+  int                 c, r;
+  p4est_locidx_t      il, jl, kl, n;
+
+  P4EST_ASSERT (map->num_new == 0 || map->relation != NULL);
+
+  for (il = 0; il < map->num_new; il = jl) {
+    jl = il + 1;
+    switch (map->relation[il]) {
+    case P4EST_ADAPT_SAME:
+      new_counts[il] = old_counts[map->old_first[il]];
+      break;
+    case P4EST_ADAPT_PARENT:
+      c = 0;
+      for (kl = 0; kl < map->old_count[il]; ++kl) {
+        c += old_counts[map->old_first[il] + kl];
+      }
+      new_counts[il] = c;
+      break;
+    case P4EST_ADAPT_CHILD:
+      /* spread the count over the descendants, remainder first */
+      while (jl < map->num_new && map->relation[jl] == P4EST_ADAPT_CHILD &&
+             map->old_first[jl] == map->old_first[il]) {
+        ++jl;
+      }
+      n = jl - il;
+      c = old_counts[map->old_first[il]];
+      r = (int) (c % n);
+      for (kl = il; kl < jl; ++kl) {
+        new_counts[kl] = (int) (c / n) + (kl - il < r);
+      }
+      break;
+    default:
+      SC_ABORT_NOT_REACHED ();
+    }
+  }
+}
+
+void
+p4est_partition (p4est_t * p4est, int allow_for_coarsening,
+                 p4est_weight_t weight_fn)
+{
+  (void) p4est_partition_ext (p4est, allow_for_coarsening, weight_fn);
+}
+
+#ifdef P4EST_ENABLE_MPI
+
+/** Compute a cut of the total weight according to the target fractions.
+ * \param [in] target_sums     Cumulative target fractions from 0 to 1,
+ *                             num_procs + 1 entries.  If NULL, all
+ *                             processes receive an equal share.
+ */
+static              uint64_t
+p4est_partition_cut_target (uint64_t weight_sum, int p, int num_procs,
+                            const double *target_sums)
+{
+  uint64_t            result;
+
+  if (target_sums == NULL) {
+    return p4est_partition_cut_uint64 (weight_sum, p, num_procs);
+  }
+
+  P4EST_ASSERT (0 <= p && p <= num_procs);
+  if (p == num_procs) {
+    /* prevent roundoff error */
+    return weight_sum;
+  }
+  result = (uint64_t) ((long double) weight_sum * target_sums[p]);
+
+  return SC_MIN (result, weight_sum);
+}
+
+/** Compute the quadrant counts of a weighted partition.
+ * \param [in] p4est    The forest to be partitioned.
+ * \param [in,out] local_weights       The cumulative weights of the local
+ *                      quadrants starting at 0, local_num_quadrants + 1
+ *                      entries.  They are shifted by the weight of the
+ *                      lower processes.
+ * \param [in] target_sums      Cumulative share of each process, see
+ *                      \ref p4est_partition_cut_target.  May be NULL.
+ * \param [out] num_quadrants_in_proc   The new quadrant counts.
+ * \return              False if all quadrants have zero weight.  Then
+ *                      \a num_quadrants_in_proc is not set.
+ */
+static int
+p4est_partition_weighted (p4est_t * p4est, int64_t * local_weights,
+                          const double *target_sums,
+                          p4est_locidx_t * num_quadrants_in_proc)
+{
+  int                 mpiret;
+  int                 low_source, high_source;
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+  const p4est_locidx_t local_num_quadrants = p4est->local_num_quadrants;
+  const p4est_gloidx_t global_num_quadrants = p4est->global_num_quadrants;
+  int                 i;
+  int                 send_lowest, send_highest;
+  int                 num_sends, rcount, base_index;
+  ssize_t             lowers;
+  p4est_locidx_t      kl, qlocal;
+  p4est_gloidx_t      send_index, recv_low, recv_high, qcount;
+  p4est_gloidx_t     *send_array;
+  int64_t             weight_sum;
+  int64_t             cut, my_lowcut, my_highcut;
+  int64_t            *global_weight_sums;
+  MPI_Request        *send_requests, recv_requests[2];
+  MPI_Status          recv_statuses[2];
+
+  global_weight_sums = P4EST_ALLOC (int64_t, num_procs + 1);
+  weight_sum = local_weights[local_num_quadrants];
+  P4EST_VERBOSEF ("local weight sum %lld\n", (long long) weight_sum);
+
+  /* distribute local weight sums */
+  global_weight_sums[0] = 0;
+  mpiret = MPI_Allgather (&weight_sum, 1, MPI_LONG_LONG_INT,
+                          &global_weight_sums[1], 1, MPI_LONG_LONG_INT,
+                          p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  /* adjust all arrays to reflect the global weight */
+  for (i = 0; i < num_procs; ++i) {
+    global_weight_sums[i + 1] += global_weight_sums[i];
+  }
+  if (rank > 0) {
+    weight_sum = global_weight_sums[rank];
+    for (kl = 0; kl <= local_num_quadrants; ++kl) {
+      local_weights[kl] += weight_sum;
+    }
+  }
+  P4EST_ASSERT (local_weights[0] == global_weight_sums[rank]);
+  P4EST_ASSERT (local_weights[local_num_quadrants] ==
+                global_weight_sums[rank + 1]);
+  weight_sum = global_weight_sums[num_procs];
+
+  if (rank == 0) {
+    for (i = 0; i <= num_procs; ++i) {
+      P4EST_GLOBAL_VERBOSEF ("Global weight sum [%d] %lld\n",
+                             i, (long long) global_weight_sums[i]);
+    }
+  }
+
+  /* if all quadrants have zero weight we do nothing */
+  if (weight_sum == 0) {
+    P4EST_FREE (global_weight_sums);
+    return 0;
+  }
+
+  /* determine processor ids to send to */
+  send_lowest = num_procs;
+  send_highest = 0;
+  for (i = 1; i <= num_procs; ++i) {
+    cut = p4est_partition_cut_target (weight_sum, i, num_procs,
+                                      target_sums);
+    if (global_weight_sums[rank] < cut &&
+        cut <= global_weight_sums[rank + 1]) {
+      send_lowest = SC_MIN (send_lowest, i);
+      send_highest = SC_MAX (send_highest, i);
+    }
+  }
+  /*
+   * send low cut to send_lowest..send_highest
+   * and high cut to send_lowest-1..send_highest-1
+   */
+  P4EST_LDEBUGF ("my send peers %d %d\n", send_lowest, send_highest);
+
+  num_sends = 2 * (send_highest - send_lowest + 1);
+  if (num_sends <= 0) {
+    num_sends = 0;
+    send_requests = NULL;
+    send_array = NULL;
+  }
+  else {
+    send_requests = P4EST_ALLOC (MPI_Request, num_sends);
+    send_array = P4EST_ALLOC (p4est_gloidx_t, num_sends);
+    lowers = 0;
+    for (i = send_lowest; i <= send_highest; ++i) {
+      base_index = 2 * (i - send_lowest);
+      if (i < num_procs) {
+        /* do binary search in the weight array */
+        lowers = sc_search_lower_bound64 (p4est_partition_cut_target
+                                          (weight_sum, i, num_procs,
+                                           target_sums),
+                                          local_weights,
+                                          (size_t) local_num_quadrants + 1,
+                                          (size_t) lowers);
+        P4EST_ASSERT (lowers > 0
+                      && (p4est_locidx_t) lowers <= local_num_quadrants);
+
+        /* send low bound */
+        send_index = send_array[base_index + 1] =
+          (p4est_gloidx_t) lowers + p4est->global_first_quadrant[rank];
+        P4EST_LDEBUGF ("send A %d %d %d index %lld base %d to %d\n",
+                       send_lowest, i, send_highest,
+                       (long long) send_index, base_index + 1, i);
+        mpiret =
+          MPI_Isend (&send_array[base_index + 1], 1, P4EST_MPI_GLOIDX, i,
+                     P4EST_COMM_PARTITION_WEIGHTED_LOW, p4est->mpicomm,
+                     &send_requests[base_index + 1]);
+        SC_CHECK_MPI (mpiret);
+      }
+      else {
+        lowers = 0;
+        send_index = global_num_quadrants;
+        send_requests[base_index + 1] = MPI_REQUEST_NULL;
+        send_array[base_index + 1] = -1;
+      }
+
+      /* send high bound */
+      send_array[base_index] = send_index;
+      P4EST_LDEBUGF ("send B %d %d %d index %lld base %d to %d\n",
+                     send_lowest, i, send_highest,
+                     (long long) send_index, base_index, i - 1);
+      mpiret = MPI_Isend (&send_array[base_index], 1, P4EST_MPI_GLOIDX,
+                          i - 1, P4EST_COMM_PARTITION_WEIGHTED_HIGH,
+                          p4est->mpicomm, &send_requests[base_index]);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+
+  /* determine processor ids to receive from and post irecv */
+  i = 0;
+  my_lowcut = p4est_partition_cut_target (weight_sum, rank, num_procs,
+                                          target_sums);
+  if (my_lowcut == 0) {
+    recv_low = 0;
+    recv_requests[0] = MPI_REQUEST_NULL;
+    low_source = -1;
+  }
+  else {
+    for (; i < num_procs; ++i) {
+      if (global_weight_sums[i] < my_lowcut &&
+          my_lowcut <= global_weight_sums[i + 1]) {
+        P4EST_LDEBUGF ("recv A from %d\n", i);
+        mpiret = MPI_Irecv (&recv_low, 1, P4EST_MPI_GLOIDX, i,
+                            P4EST_COMM_PARTITION_WEIGHTED_LOW,
+                            p4est->mpicomm, &recv_requests[0]);
+        SC_CHECK_MPI (mpiret);
+        break;
+      }
+    }
+    P4EST_ASSERT (i < num_procs);
+    low_source = i;
+  }
+  my_highcut = p4est_partition_cut_target (weight_sum, rank + 1, num_procs,
+                                           target_sums);
+  if (my_highcut == 0) {
+    recv_high = 0;
+    recv_requests[1] = MPI_REQUEST_NULL;
+    high_source = -1;
+  }
+  else {
+    for (; i < num_procs; ++i) {
+      if (global_weight_sums[i] < my_highcut &&
+          my_highcut <= global_weight_sums[i + 1]) {
+        P4EST_LDEBUGF ("recv B from %d\n", i);
+        mpiret = MPI_Irecv (&recv_high, 1, P4EST_MPI_GLOIDX, i,
+                            P4EST_COMM_PARTITION_WEIGHTED_HIGH,
+                            p4est->mpicomm, &recv_requests[1]);
+        SC_CHECK_MPI (mpiret);
+        break;
+      }
+    }
+    P4EST_ASSERT (i < num_procs);
+    high_source = i;
+  }
+  P4EST_LDEBUGF ("my recv peers %d %d cuts %lld %lld\n",
+                 low_source, high_source,
+                 (long long) my_lowcut, (long long) my_highcut);
+
+  /* free temporary memory */
+  P4EST_FREE (global_weight_sums);
+
+  /* wait for sends and receives to complete */
+  if (num_sends > 0) {
+    mpiret = sc_MPI_Waitall (num_sends, send_requests, MPI_STATUSES_IGNORE);
+    SC_CHECK_MPI (mpiret);
+    P4EST_FREE (send_requests);
+    P4EST_FREE (send_array);
+  }
+  mpiret = sc_MPI_Waitall (2, recv_requests, recv_statuses);
+  SC_CHECK_MPI (mpiret);
+  if (my_lowcut != 0) {
+    SC_CHECK_ABORT (recv_statuses[0].MPI_SOURCE == low_source,
+                    "Wait low source");
+    SC_CHECK_ABORT (recv_statuses[0].MPI_TAG ==
+                    P4EST_COMM_PARTITION_WEIGHTED_LOW, "Wait low tag");
+    mpiret =
+      sc_MPI_Get_count (&recv_statuses[0], P4EST_MPI_GLOIDX, &rcount);
+    SC_CHECK_MPI (mpiret);
+    SC_CHECK_ABORTF (rcount == 1, "Wait low count %d", rcount);
+  }
+  if (my_highcut != 0) {
+    SC_CHECK_ABORT (recv_statuses[1].MPI_SOURCE == high_source,
+                    "Wait high source");
+    SC_CHECK_ABORT (recv_statuses[1].MPI_TAG ==
+                    P4EST_COMM_PARTITION_WEIGHTED_HIGH, "Wait high tag");
+    mpiret =
+      sc_MPI_Get_count (&recv_statuses[1], P4EST_MPI_GLOIDX, &rcount);
+    SC_CHECK_MPI (mpiret);
+    SC_CHECK_ABORTF (rcount == 1, "Wait high count %d", rcount);
+  }
+
+  /* communicate the quadrant ranges */
+  qcount = recv_high - recv_low;
+  P4EST_LDEBUGF ("weighted partition count %lld\n", (long long) qcount);
+  P4EST_ASSERT (qcount >= 0 && qcount <= (p4est_gloidx_t) P4EST_LOCIDX_MAX);
+  qlocal = (p4est_locidx_t) qcount;
+  mpiret = MPI_Allgather (&qlocal, 1, P4EST_MPI_LOCIDX,
+                          num_quadrants_in_proc, 1, P4EST_MPI_LOCIDX,
+                          p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+#if(0)
+  /* run through the count array and repair zero ranges */
+  for (i = 0; i < num_procs; ++i) {
+    if (num_quadrants_in_proc[i] == 0) {
+      for (p = i - 1; p >= 0; --p) {
+        P4EST_ASSERT (num_quadrants_in_proc[p] > 0);
+        if (num_quadrants_in_proc[p] > 1) {
+          --num_quadrants_in_proc[p];
+          ++num_quadrants_in_proc[i];
+          break;
+        }
+      }
+      if (p < 0) {
+        for (p = i + 1; p < num_procs; ++p) {
+          P4EST_ASSERT (num_quadrants_in_proc[p] >= 0);
+          if (num_quadrants_in_proc[p] > 1) {
+            --num_quadrants_in_proc[p];
+            ++num_quadrants_in_proc[i];
+            break;
+          }
+        }
+        P4EST_ASSERT (p < num_procs);
+      }
+    }
+  }
+#endif
+
+  return 1;
+}
+
+/** Move the quadrants to match given counts, see p4est_partition_ext.
+ * The user data of \a data, if any, is sent while the quadrants move.
+ */
+static p4est_gloidx_t
+p4est_partition_apply (p4est_t * p4est, int partition_for_coarsening,
+                       p4est_locidx_t * num_quadrants_in_proc,
+                       int num_data, p4est_partition_data_t * data)
+{
+  const int           num_procs = p4est->mpisize;
+  int                 i, d;
+  size_t              zz, bytes;
+  p4est_gloidx_t      global_shipped;
+  p4est_gloidx_t      num_corrected;
+  p4est_gloidx_t     *src_gfq, *dest_gfq;
+  p4est_locidx_t      new_local_num;
+  p4est_transfer_context_t **tcs;
+
+  /* correct partition */
+  if (partition_for_coarsening) {
+    P4EST_REGION_BEGIN ("partition.coarsening");
+    num_corrected =
+      p4est_partition_for_coarsening (p4est, num_quadrants_in_proc);
+    P4EST_REGION_END ("partition.coarsening");
+    P4EST_GLOBAL_INFOF
+      ("Designated partition for coarsening %lld quadrants moved\n",
+       (long long) num_corrected);
+  }
+
+  /* post the user data messages in the same epoch as the quadrants */
+  P4EST_REGION_BEGIN ("partition.transfer");
+  tcs = NULL;
+  src_gfq = dest_gfq = NULL;
+  if (num_data > 0) {
+    src_gfq = P4EST_ALLOC (p4est_gloidx_t, 2 * (num_procs + 1));
+    dest_gfq = src_gfq + num_procs + 1;
+    memcpy (src_gfq, p4est->global_first_quadrant,
+            (num_procs + 1) * sizeof (p4est_gloidx_t));
+    dest_gfq[0] = 0;
+    for (i = 0; i < num_procs; ++i) {
+      dest_gfq[i + 1] = dest_gfq[i] + num_quadrants_in_proc[i];
+    }
+    new_local_num = num_quadrants_in_proc[p4est->mpirank];
+    tcs = P4EST_ALLOC (p4est_transfer_context_t *, num_data);
+
+    /* variable sizes must arrive before their data can be received */
+    for (d = 0; d < num_data; ++d) {
+      tcs[d] = NULL;
+      if (data[d].src_sizes != NULL) {
+        data[d].dest_sizes = P4EST_ALLOC (int, new_local_num);
+        tcs[d] = p4est_transfer_fixed_begin
+          (dest_gfq, src_gfq, p4est->mpicomm, P4EST_COMM_PARTITION_DATA,
+           data[d].dest_sizes, data[d].src_sizes, sizeof (int));
+      }
+    }
+    for (d = 0; d < num_data; ++d) {
+      if (tcs[d] != NULL) {
+        p4est_transfer_fixed_end (tcs[d]);
+      }
+    }
+    for (d = 0; d < num_data; ++d) {
+      if (data[d].src_sizes != NULL) {
+        for (zz = 0, bytes = 0; zz < (size_t) new_local_num; ++zz) {
+          bytes += (size_t) data[d].dest_sizes[zz];
+        }
+        data[d].dest_data = P4EST_ALLOC (char, bytes);
+        tcs[d] = p4est_transfer_custom_begin
+          (dest_gfq, src_gfq, p4est->mpicomm, P4EST_COMM_PARTITION_DATA,
+           data[d].dest_data, data[d].dest_sizes,
+           data[d].src_data, data[d].src_sizes);
+      }
+      else {
+        data[d].dest_data =
+          P4EST_ALLOC (char, data[d].data_size * new_local_num);
+        tcs[d] = p4est_transfer_fixed_begin
+          (dest_gfq, src_gfq, p4est->mpicomm, P4EST_COMM_PARTITION_DATA,
+           data[d].dest_data, data[d].src_data, data[d].data_size);
+      }
+    }
+  }
+
+  /* run the partition algorithm with proper quadrant counts */
+  global_shipped = p4est_partition_given (p4est, num_quadrants_in_proc);
+
+  /* complete the user data messages */
+  for (d = 0; d < num_data; ++d) {
+    if (data[d].src_sizes != NULL) {
+      p4est_transfer_custom_end (tcs[d]);
+    }
+    else {
+      p4est_transfer_fixed_end (tcs[d]);
+    }
+  }
+  P4EST_FREE (tcs);
+  P4EST_FREE (src_gfq);
+  P4EST_REGION_END ("partition.transfer");
+  if (global_shipped) {
+    /* the partition of the forest has changed somewhere */
+    ++p4est->revision;
+    if (p4est->balance_dirty != NULL &&
+        p4est->balance_revision == p4est->revision - 1) {
+      /* moving balanced quadrants keeps them balanced */
+      p4est->balance_revision = p4est->revision;
+    }
+  }
+  return global_shipped;
+}
+
+/** Compute the cumulative sums of an array of weights.
+ * Large arrays are summed in one piece per thread, which are then offset
+ * by the totals of the pieces before them.
+ * \param [in] weights  Array of \a n weights >= 0.
+ * \param [out] sums    Array of \a n + 1 entries, with sums[0] = 0.
+ */
+static void
+p4est_partition_prefix_sum (const int64_t * weights, p4est_locidx_t n,
+                            int64_t * sums)
+{
+  int                 num_threads = 1;
+  int                 t;
+  p4est_locidx_t      kl, begin, end;
+  int64_t            *offsets;
+
+#ifdef P4EST_ENABLE_OPENMP
+  /* small arrays are not worth the threads */
+  num_threads = (int) SC_MIN ((size_t) p4est_get_num_threads (),
+                              1 + (size_t) n / prefix_thread_quadrants);
+#endif
+  sums[0] = 0;
+  if (num_threads == 1) {
+    for (kl = 0; kl < n; ++kl) {
+      P4EST_ASSERT (weights[kl] >= 0);
+      sums[kl + 1] = sums[kl] + weights[kl];
+    }
+    return;
+  }
+
+  /* sum every piece from zero, then add the totals of the ones before */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_threads) private (kl, begin, end)
+#endif
+  for (t = 0; t < num_threads; ++t) {
+    begin = (p4est_locidx_t) ((int64_t) n * t / num_threads);
+    end = (p4est_locidx_t) ((int64_t) n * (t + 1) / num_threads);
+    sums[begin + 1] = weights[begin];
+    for (kl = begin + 1; kl < end; ++kl) {
+      P4EST_ASSERT (weights[kl] >= 0);
+      sums[kl + 1] = sums[kl] + weights[kl];
+    }
+  }
+  offsets = P4EST_ALLOC (int64_t, num_threads);
+  offsets[0] = 0;
+  for (t = 1; t < num_threads; ++t) {
+    begin = (p4est_locidx_t) ((int64_t) n * t / num_threads);
+    offsets[t] = offsets[t - 1] + sums[begin];
+  }
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_threads) private (kl, begin, end)
+#endif
+  for (t = 1; t < num_threads; ++t) {
+    begin = (p4est_locidx_t) ((int64_t) n * t / num_threads);
+    end = (p4est_locidx_t) ((int64_t) n * (t + 1) / num_threads);
+    for (kl = begin + 1; kl <= end; ++kl) {
+      sums[kl] += offsets[t];
+    }
+  }
+  P4EST_FREE (offsets);
+}
+
+/** Compute the number of quadrants of every process in the new partition.
+ * \param [in] base_weight      Added to \a counts to obtain the weights.
+ * \param [in] counts   If not NULL, one count per local quadrant that is
+ *                      used instead of \a weight_fn.
+ * \param [in] weights  If not NULL, one weight per local quadrant that is
+ *                      used instead of \a counts and \a weight_fn.
+ * \param [in] target_sums      Cumulative share of each process, see
+ *                      \ref p4est_partition_cut_target.  May be NULL.
+ * \return              Counts allocated with mpisize entries, or NULL
+ *                      if the weighted partition is left unchanged.
+ */
+static p4est_locidx_t *
+p4est_partition_counts (p4est_t * p4est, p4est_weight_t weight_fn,
+                        int base_weight, const int *counts,
+                        const int64_t *weights, const double *target_sums)
+{
+  const int           num_procs = p4est->mpisize;
+  const p4est_gloidx_t global_num_quadrants = p4est->global_num_quadrants;
+  const p4est_topidx_t first_tree = p4est->first_local_tree;
+  const p4est_topidx_t last_tree = p4est->last_local_tree;
+  const p4est_locidx_t local_num_quadrants = p4est->local_num_quadrants;
+  int                 p;
+  size_t              lz;
+  p4est_topidx_t      nt;
+  p4est_locidx_t      kl;
+  p4est_locidx_t     *num_quadrants_in_proc;
+  p4est_gloidx_t      prev_quadrant, next_quadrant;
+  p4est_gloidx_t      qcount;
+  int64_t             weight;
+  int64_t            *local_weights;    /* cumulative weights by quadrant */
+  p4est_quadrant_t   *q;
+  p4est_tree_t       *tree;
+
+  /* allocate new quadrant distribution counts */
+  num_quadrants_in_proc = P4EST_ALLOC (p4est_locidx_t, num_procs);
+
+  if (weight_fn == NULL && counts == NULL && weights == NULL &&
+      target_sums == NULL) {
+    /* Divide up the quadrants equally */
+    for (p = 0, next_quadrant = 0; p < num_procs; ++p) {
+      prev_quadrant = next_quadrant;
+      next_quadrant =
+        p4est_partition_cut_gloidx (global_num_quadrants, p + 1, num_procs);
+      qcount = next_quadrant - prev_quadrant;
+      P4EST_ASSERT (0 <= qcount
+                    && qcount <= (p4est_gloidx_t) P4EST_LOCIDX_MAX);
+      num_quadrants_in_proc[p] = (p4est_locidx_t) (qcount);
+    }
+  }
+  else {
+    /* do a weighted partition */
+    P4EST_REGION_BEGIN ("partition.weights");
+    local_weights = P4EST_ALLOC (int64_t, local_num_quadrants + 1);
+    P4EST_VERBOSEF ("local quadrant count %lld\n",
+                    (long long) local_num_quadrants);
+
+    /* linearly sum weights across all trees */
+    kl = 0;
+    local_weights[0] = 0;
+    if (weights != NULL) {
+      p4est_partition_prefix_sum (weights, local_num_quadrants,
+                                  local_weights);
+      kl = local_num_quadrants;
+    }
+    else {
+      for (nt = first_tree; nt <= last_tree; ++nt) {
+        tree = p4est_tree_array_index (p4est->trees, nt);
+        for (lz = 0; lz < tree->quadrants.elem_count; ++lz, ++kl) {
+          if (counts != NULL) {
+            weight = (int64_t) base_weight + (int64_t) counts[kl];
+          }
+          else if (weight_fn != NULL) {
+            q = p4est_quadrant_array_index (&tree->quadrants, lz);
+            weight = (int64_t) weight_fn (p4est, nt, q);
+          }
+          else {
+            weight = 1;
+          }
+          P4EST_ASSERT (weight >= 0);
+          local_weights[kl + 1] = local_weights[kl] + weight;
+        }
+      }
+    }
+    P4EST_ASSERT (kl == local_num_quadrants);
+
+    if (!p4est_partition_weighted (p4est, local_weights, target_sums,
+                                   num_quadrants_in_proc)) {
+      P4EST_FREE (num_quadrants_in_proc);
+      num_quadrants_in_proc = NULL;
+    }
+    P4EST_REGION_END ("partition.weights");
+    P4EST_FREE (local_weights);
+  }
+
+  return num_quadrants_in_proc;
+}
+
+#endif /* P4EST_ENABLE_MPI */
+
+/** Partition as p4est_partition_ext and move user data along.
+ * \param [in] base_weight      Added to \a counts to obtain the weights.
+ * \param [in] counts   If not NULL, one count per local quadrant that is
+ *                      used instead of \a weight_fn.
+ * \param [in] weights  If not NULL, one weight per local quadrant that is
+ *                      used instead of \a counts and \a weight_fn.
+ * \param [in] target_sums      Cumulative share of each process, see
+ *                      \ref p4est_partition_cut_target.  May be NULL.
+ */
+static p4est_gloidx_t
+p4est_partition_internal (p4est_t * p4est, int partition_for_coarsening,
+                          p4est_weight_t weight_fn, int base_weight,
+                          const int *counts, const int64_t *weights,
+                          const double *target_sums,
+                          int num_data, p4est_partition_data_t * data)
+{
+  p4est_gloidx_t      global_shipped = 0;
+  const p4est_gloidx_t global_num_quadrants = p4est->global_num_quadrants;
+  const double        inspect_start = p4est_inspect_start (p4est->inspect);
+#ifdef P4EST_ENABLE_MPI
+  p4est_locidx_t     *num_quadrants_in_proc;
+#endif /* P4EST_ENABLE_MPI */
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Into " P4EST_STRING
+     "_partition with %lld total quadrants\n",
+     (long long) p4est->global_num_quadrants);
+
+  /* this function does nothing in a serial setup */
+  if (p4est->mpisize == 1) {
+    P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_partition no shipping\n");
+
+    /* in particular, there is no need to bump the revision counter */
+    P4EST_ASSERT (global_shipped == 0);
+    p4est_inspect_stop (p4est->inspect, P4EST_INSPECT_PARTITION,
+                        inspect_start);
+    return global_shipped;
+  }
+
+  p4est_log_indent_push ();
+
+#ifdef P4EST_ENABLE_MPI
+  num_quadrants_in_proc = p4est_partition_counts (p4est, weight_fn,
+                                                  base_weight, counts,
+                                                  weights, target_sums);
+  if (num_quadrants_in_proc == NULL) {
+    p4est_log_indent_pop ();
+    P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_partition no shipping\n");
+
+    /* in particular, there is no need to bump the revision counter */
+    P4EST_ASSERT (global_shipped == 0);
+    p4est_inspect_stop (p4est->inspect, P4EST_INSPECT_PARTITION,
+                        inspect_start);
+    return global_shipped;
+  }
+
+  global_shipped = p4est_partition_apply (p4est, partition_for_coarsening,
+                                          num_quadrants_in_proc,
+                                          num_data, data);
+  P4EST_FREE (num_quadrants_in_proc);
+
+  /* check validity of the p4est */
+  P4EST_ASSERT (p4est_is_valid (p4est));
+#endif /* P4EST_ENABLE_MPI */
+
+  p4est_log_indent_pop ();
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Done " P4EST_STRING "_partition shipped %lld quadrants %.3g%%\n",
+     (long long) global_shipped,
+     global_shipped * 100. / global_num_quadrants);
+
+  p4est_inspect_stop (p4est->inspect, P4EST_INSPECT_PARTITION, inspect_start);
+  return global_shipped;
+}
+
+p4est_gloidx_t
+p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
+                     p4est_weight_t weight_fn)
+{
+  return p4est_partition_internal (p4est, partition_for_coarsening,
+                                   weight_fn, 0, NULL, NULL, NULL, 0, NULL);
+}
+
+p4est_gloidx_t
+p4est_partition_weights (p4est_t * p4est, int partition_for_coarsening,
+                         int base_weight, const int *counts)
+{
+  P4EST_ASSERT (base_weight >= 0);
+  return p4est_partition_internal (p4est, partition_for_coarsening,
+                                   NULL, base_weight, counts, NULL, NULL,
+                                   0, NULL);
+}
+
+p4est_gloidx_t
+p4est_partition_weights64 (p4est_t * p4est, int partition_for_coarsening,
+                           const int64_t * weights)
+{
+  P4EST_ASSERT (weights != NULL);
+  return p4est_partition_internal (p4est, partition_for_coarsening,
+                                   NULL, 0, NULL, weights, NULL, 0, NULL);
+}
+
+p4est_gloidx_t
+p4est_partition_targets (p4est_t * p4est, int partition_for_coarsening,
+                         p4est_weight_t weight_fn, const double *targets)
+{
+  const int           num_procs = p4est->mpisize;
+  int                 p;
+  double              target_total;
+  double             *target_sums;
+  p4est_gloidx_t      global_shipped;
+
+  P4EST_ASSERT (targets != NULL);
+
+  /* normalize the cumulative targets to end in one */
+  target_sums = P4EST_ALLOC (double, num_procs + 1);
+  target_sums[0] = 0.;
+  for (p = 0; p < num_procs; ++p) {
+    P4EST_ASSERT (targets[p] >= 0.);
+    target_sums[p + 1] = target_sums[p] + targets[p];
+  }
+  target_total = target_sums[num_procs];
+  SC_CHECK_ABORT (target_total > 0., "Partition targets must not all be 0");
+  for (p = 1; p < num_procs; ++p) {
+    target_sums[p] /= target_total;
+  }
+  target_sums[num_procs] = 1.;
+
+  global_shipped = p4est_partition_internal (p4est, partition_for_coarsening,
+                                             weight_fn, 0, NULL, NULL,
+                                             target_sums, 0, NULL);
+  P4EST_FREE (target_sums);
+  return global_shipped;
+}
+
+p4est_t            *
+p4est_agglomerate_new (p4est_t * p4est, p4est_gloidx_t quadrants_per_rank,
+                       int copy_data)
+{
+  const int           num_procs = p4est->mpisize;
+  const p4est_gloidx_t global_num = p4est->global_num_quadrants;
+  int                 p, num_active;
+  p4est_locidx_t     *num_quadrants_in_proc;
+  p4est_t            *coarse;
+
+  P4EST_ASSERT (quadrants_per_rank > 0);
+  P4EST_ASSERT (global_num > 0);
+
+  /* the smallest number of processes that meets the target */
+  num_active = (int) SC_MIN ((p4est_gloidx_t) num_procs,
+                             (global_num + quadrants_per_rank - 1) /
+                             quadrants_per_rank);
+  P4EST_GLOBAL_PRODUCTIONF ("Agglomerate %lld quadrants onto %d of %d"
+                            " processes\n", (long long) global_num,
+                            num_active, num_procs);
+
+  /* move the quadrants of a copy to the first processes */
+  coarse = p4est_copy_ext (p4est, copy_data, 1);
+  num_quadrants_in_proc = P4EST_ALLOC_ZERO (p4est_locidx_t, num_procs);
+  for (p = 0; p < num_active; ++p) {
+    num_quadrants_in_proc[p] = (p4est_locidx_t)
+      (p4est_partition_cut_gloidx (global_num, p + 1, num_active) -
+       p4est_partition_cut_gloidx (global_num, p, num_active));
+  }
+  p4est_partition_given (coarse, num_quadrants_in_proc);
+  P4EST_FREE (num_quadrants_in_proc);
+
+  /* the empty processes leave the copy */
+  p4est_comm_parallel_env_reduce (&coarse);
+  P4EST_ASSERT ((coarse != NULL) == (p4est->mpirank < num_active));
+
+  return coarse;
+}
+
+void
+p4est_agglomerate_expand (p4est_t * p4est, p4est_t * coarse,
+                          p4est_init_t init_fn)
+{
+  const p4est_topidx_t num_trees = p4est->connectivity->num_trees;
+  int                 i, copy_data;
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      num_quadrants;
+  p4est_tree_t       *tree, *ctree;
+  p4est_quadrant_t   *q, *cq;
+
+  P4EST_ASSERT (coarse == NULL ||
+                coarse->connectivity == p4est->connectivity);
+  P4EST_ASSERT (coarse == NULL || p4est_is_valid (coarse));
+
+  /* drop the local quadrants and their user data */
+  p4est_unshare_quadrants (p4est);
+  p4est_quadrant_data_cache_flush (p4est);
+  if (p4est->user_data_pool != NULL) {
+    sc_mempool_truncate (p4est->user_data_pool);
+  }
+  p4est->data_array_used = 0;
+  copy_data = (coarse != NULL && p4est->data_size > 0 &&
+               coarse->data_size == p4est->data_size);
+
+  /* take over the quadrants of the agglomerated forest */
+  num_quadrants = 0;
+  for (jt = 0; jt < num_trees; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    tree->quadrants_offset = num_quadrants;
+    if (coarse == NULL ||
+        jt < coarse->first_local_tree || jt > coarse->last_local_tree) {
+      sc_array_reset (&tree->quadrants);
+      P4EST_QUADRANT_INIT (&tree->first_desc);
+      P4EST_QUADRANT_INIT (&tree->last_desc);
+      for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
+        tree->quadrants_per_level[i] = 0;
+      }
+      tree->maxlevel = 0;
+      continue;
+    }
+    ctree = p4est_tree_array_index (coarse->trees, jt);
+    sc_array_copy (&tree->quadrants, &ctree->quadrants);
+    tree->first_desc = ctree->first_desc;
+    tree->last_desc = ctree->last_desc;
+    memcpy (tree->quadrants_per_level, ctree->quadrants_per_level,
+            (P4EST_QMAXLEVEL + 1) * sizeof (p4est_locidx_t));
+    tree->maxlevel = ctree->maxlevel;
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      if (p4est->data_size > 0) {
+        q->p.user_data = sc_mempool_alloc (p4est->user_data_pool);
+        if (copy_data) {
+          cq = p4est_quadrant_array_index (&ctree->quadrants, zz);
+          memcpy (q->p.user_data, cq->p.user_data, p4est->data_size);
+        }
+      }
+      else {
+        q->p.user_data = NULL;
+      }
+      if (!copy_data && init_fn != NULL) {
+        init_fn (p4est, jt, q);
+      }
+    }
+    num_quadrants += (p4est_locidx_t) tree->quadrants.elem_count;
+  }
+  p4est->local_num_quadrants = num_quadrants;
+  if (coarse != NULL) {
+    p4est->first_local_tree = coarse->first_local_tree;
+    p4est->last_local_tree = coarse->last_local_tree;
+    p4est_destroy (coarse);
+  }
+  else {
+    p4est->first_local_tree = -1;
+    p4est->last_local_tree = -2;
+  }
+
+  /* the quadrants may have changed arbitrarily */
+  p4est_comm_count_quadrants (p4est);
+  p4est_comm_global_partition (p4est, NULL);
+  p4est_compact_data (p4est);
+  ++p4est->revision;
+  if (p4est->balance_dirty != NULL) {
+    memset (p4est->balance_dirty, 1, (size_t) num_trees);
+  }
 
-#ifdef P4EST_ENABLE_DEBUG
-        checksum =
-          p4est_quadrant_checksum (&peer->recv_first, &checkarray, 0);
-        P4EST_LDEBUGF ("Balance A recv checksum 0x%08x from %d\n", checksum,
-                       j);
-#endif /* P4EST_ENABLE_DEBUG */
+  /* spread the quadrants over all processes */
+  p4est_partition_ext (p4est, 0, NULL);
+  P4EST_ASSERT (p4est_is_valid (p4est));
+}
 
-        /* process incoming quadrants to interleave with communication */
-        p4est_balance_response (p4est, peer, btype, borders);
-        qcount = peer->send_second.elem_count;
-        if (qcount > 0) {
-          P4EST_LDEBUGF ("Balance B send %llu quadrants to %d\n",
-                         (unsigned long long) qcount, j);
-          ++send_load[1];
-        }
-        else {
-          ++send_zero[1];
-        }
-        peer->send_second_count = (int) qcount;
-        mpiret = MPI_Isend (&peer->send_second_count, 1, MPI_INT,
-                            j, P4EST_COMM_BALANCE_SECOND_COUNT,
-                            p4est->mpicomm, &send_requests_second_count[j]);
-        SC_CHECK_MPI (mpiret);
-        ++request_send_count;
-        if (qcount > 0) {
+p4est_gloidx_t
+p4est_partition_ext_data (p4est_t * p4est, int partition_for_coarsening,
+                          p4est_weight_t weight_fn,
+                          int num_data, p4est_partition_data_t * data)
+{
+  int                 d;
+  size_t              zz, bytes;
+  p4est_gloidx_t      global_shipped;
+  const p4est_locidx_t old_local_num = p4est->local_num_quadrants;
+
+  P4EST_ASSERT (num_data >= 0);
+  for (d = 0; d < num_data; ++d) {
+    data[d].dest_data = NULL;
+    data[d].dest_sizes = NULL;
+  }
+  global_shipped = p4est_partition_internal (p4est, partition_for_coarsening,
+                                             weight_fn, 0, NULL, NULL,
+                                             NULL, num_data, data);
 
-#ifdef P4EST_ENABLE_DEBUG
-          checksum =
-            p4est_quadrant_checksum (&peer->send_second, &checkarray, 0);
-          P4EST_LDEBUGF ("Balance B send checksum 0x%08x to %d\n", checksum,
-                         j);
-#endif /* P4EST_ENABLE_DEBUG */
+  /* without messages the layout is unchanged */
+  for (d = 0; d < num_data; ++d) {
+    if (data[d].dest_data != NULL) {
+      continue;
+    }
+    P4EST_ASSERT (p4est->local_num_quadrants == old_local_num);
+    if (data[d].src_sizes != NULL) {
+      data[d].dest_sizes = P4EST_ALLOC (int, old_local_num);
+      memcpy (data[d].dest_sizes, data[d].src_sizes,
+              old_local_num * sizeof (int));
+      for (zz = 0, bytes = 0; zz < (size_t) old_local_num; ++zz) {
+        bytes += (size_t) data[d].src_sizes[zz];
+      }
+    }
+    else {
+      bytes = data[d].data_size * old_local_num;
+    }
+    data[d].dest_data = P4EST_ALLOC (char, bytes);
+    memcpy (data[d].dest_data, data[d].src_data, bytes);
+  }
+  return global_shipped;
+}
 
-          total_send_count += qcount;
-          qbytes = qcount * sizeof (p4est_quadrant_t);
-          mpiret = MPI_Isend (peer->send_second.array, (int) qbytes, MPI_BYTE,
-                              j, P4EST_COMM_BALANCE_SECOND_LOAD,
-                              p4est->mpicomm, &send_requests_second_load[j]);
-          SC_CHECK_MPI (mpiret);
-          ++request_send_count;
-        }
+struct p4est_partition_context
+{
+  p4est_t            *p4est;
+  p4est_gloidx_t      global_shipped;
+  p4est_gloidx_t     *dest_gfq;
+  p4est_quadrant_t   *src_quadrants, *dest_quadrants;
+  char               *src_data, *dest_data;
+  p4est_transfer_context_t *tc_quadrants, *tc_data;
+  double              inspect_start;
+};
+
+#ifdef P4EST_ENABLE_MPI
+
+/** Post the messages of a partition into given process counts.
+ * \param [in] num_quadrants_in_proc   New counts, freed by this function.
+ *                                      If NULL, the partition is unchanged.
+ */
+static void
+p4est_partition_begin_counts (p4est_partition_context_t * pc,
+                              int partition_for_coarsening,
+                              p4est_locidx_t * num_quadrants_in_proc)
+{
+  p4est_t            *p4est = pc->p4est;
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+  const size_t        data_size = p4est->data_size;
+  int                 p;
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      kl, new_local_num;
+  p4est_gloidx_t      num_corrected, num_kept;
+  p4est_gloidx_t     *src_gfq, *dest_gfq;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+
+  if (num_quadrants_in_proc == NULL) {
+    return;
+  }
+  if (partition_for_coarsening) {
+    num_corrected =
+      p4est_partition_for_coarsening (p4est, num_quadrants_in_proc);
+    P4EST_GLOBAL_INFOF
+      ("Designated partition for coarsening %lld quadrants moved\n",
+       (long long) num_corrected);
+  }
+  src_gfq = p4est->global_first_quadrant;
+  dest_gfq = P4EST_ALLOC (p4est_gloidx_t, num_procs + 1);
+  dest_gfq[0] = 0;
+  num_kept = 0;
+  for (p = 0; p < num_procs; ++p) {
+    dest_gfq[p + 1] = dest_gfq[p] + num_quadrants_in_proc[p];
+    num_kept += SC_MAX (0, SC_MIN (src_gfq[p + 1], dest_gfq[p + 1]) -
+                        SC_MAX (src_gfq[p], dest_gfq[p]));
+  }
+  P4EST_FREE (num_quadrants_in_proc);
+  P4EST_ASSERT (dest_gfq[num_procs] == src_gfq[num_procs]);
+  pc->global_shipped = p4est->global_num_quadrants - num_kept;
+  if (pc->global_shipped == 0) {
+    P4EST_FREE (dest_gfq);
+    return;
+  }
+  pc->dest_gfq = dest_gfq;
+
+  /* copy the local quadrants with their tree numbers and user data */
+  pc->src_quadrants =
+    P4EST_ALLOC (p4est_quadrant_t, p4est->local_num_quadrants);
+  if (data_size > 0) {
+    pc->src_data = P4EST_ALLOC (char, data_size * p4est->local_num_quadrants);
+  }
+  kl = 0;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++kl) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      pc->src_quadrants[kl] = *q;
+      pc->src_quadrants[kl].p.which_tree = jt;
+      if (data_size > 0) {
+        memcpy (pc->src_data + kl * data_size, q->p.user_data, data_size);
       }
     }
   }
-  for (j = 0; j < num_procs; ++j) {
-    P4EST_ASSERT (requests_first[j] == MPI_REQUEST_NULL);
+  P4EST_ASSERT (kl == p4est->local_num_quadrants);
+
+  /* post the messages of the quadrants and their user data */
+  new_local_num = (p4est_locidx_t) (dest_gfq[rank + 1] - dest_gfq[rank]);
+  pc->dest_quadrants = P4EST_ALLOC (p4est_quadrant_t, new_local_num);
+  pc->tc_quadrants = p4est_transfer_fixed_begin
+    (dest_gfq, src_gfq, p4est->mpicomm, P4EST_COMM_PARTITION_GIVEN,
+     pc->dest_quadrants, pc->src_quadrants, sizeof (p4est_quadrant_t));
+  if (data_size > 0) {
+    pc->dest_data = P4EST_ALLOC (char, data_size * new_local_num);
+    pc->tc_data = p4est_transfer_fixed_begin
+      (dest_gfq, src_gfq, p4est->mpicomm, P4EST_COMM_PARTITION_DATA,
+       pc->dest_data, pc->src_data, data_size);
   }
+}
+
 #endif /* P4EST_ENABLE_MPI */
 
-  /* simulate send and receive with myself across tree boundaries */
-  peer = peers + rank;
-  sc_array_sort (&peer->send_first, p4est_quadrant_compare_piggy);
-  qcount = peer->send_first.elem_count;
-  peer->recv_first_count = peer->send_first_count = (int) qcount;
-  qbytes = qcount * sizeof (p4est_quadrant_t);
-  qarray = &peer->recv_first;
-  sc_array_resize (qarray, qcount);
-  memcpy (qarray->array, peer->send_first.array, qbytes);
-  p4est_balance_response (p4est, peer, btype, borders);
-  qcount = peer->send_second.elem_count;
-  peer->recv_second_count = peer->send_second_count = (int) qcount;
-  qbytes = qcount * sizeof (p4est_quadrant_t);
-  qarray = &peer->recv_second;
-  sc_array_resize (qarray, qcount);
-  memcpy (qarray->array, peer->send_second.array, qbytes);
+/** Allocate the context of a split-phase partition. */
+static p4est_partition_context_t *
+p4est_partition_context_new (p4est_t * p4est)
+{
+  p4est_partition_context_t *pc;
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Into " P4EST_STRING "_partition_begin with %lld total quadrants\n",
+     (long long) p4est->global_num_quadrants);
+
+  pc = P4EST_ALLOC_ZERO (p4est_partition_context_t, 1);
+  pc->p4est = p4est;
+  pc->inspect_start = p4est_inspect_start (p4est->inspect);
+  return pc;
+}
+
+p4est_partition_context_t *
+p4est_partition_begin (p4est_t * p4est, int partition_for_coarsening,
+                       p4est_weight_t weight_fn)
+{
+  p4est_partition_context_t *pc = p4est_partition_context_new (p4est);
 
 #ifdef P4EST_ENABLE_MPI
-  /* receive second round appending to the same receive buffer */
-  while (request_second_count > 0) {
-    mpiret = sc_MPI_Waitsome (num_procs, requests_second,
-                              &outcount, wait_indices, recv_statuses);
-    SC_CHECK_MPI (mpiret);
-    P4EST_ASSERT (outcount != MPI_UNDEFINED);
-    P4EST_ASSERT (outcount > 0);
-    for (i = 0; i < outcount; ++i) {
-      /* retrieve sender's rank */
-      j = wait_indices[i];
-      jstatus = &recv_statuses[i];
-      wait_indices[i] = -1;
-      P4EST_ASSERT (j != rank && 0 <= j && j < num_procs);
-      P4EST_ASSERT (requests_second[j] == MPI_REQUEST_NULL);
-      P4EST_ASSERT (jstatus->MPI_SOURCE == j);
+  /* this function does nothing in a serial setup */
+  if (p4est->mpisize == 1) {
+    return pc;
+  }
 
-      /* check if we are in receiving count or load */
-      peer = peers + j;
-      P4EST_ASSERT (!peer->have_second_load);
-      if (!peer->have_second_count) {
-        /* verify message size */
-        P4EST_ASSERT (jstatus->MPI_TAG == P4EST_COMM_BALANCE_SECOND_COUNT);
-        mpiret = sc_MPI_Get_count (jstatus, MPI_INT, &rcount);
-        SC_CHECK_MPI (mpiret);
-        SC_CHECK_ABORTF (rcount == 1, "Receive count mismatch B %d", rcount);
+  /* compute the new partition with the blocking collectives */
+  p4est_partition_begin_counts
+    (pc, partition_for_coarsening,
+     p4est_partition_counts (p4est, weight_fn, 0, NULL, NULL, NULL));
+#endif /* P4EST_ENABLE_MPI */
 
-        /* process the count information received */
-        peer->have_second_count = 1;
-        qcount = (size_t) peer->recv_second_count;
-        if (qcount > 0) {
-          /* received nonzero count, post receive for load */
-          P4EST_LDEBUGF ("Balance B recv %llu quadrants from %d\n",
-                         (unsigned long long) qcount, j);
-          P4EST_ASSERT (peer->recv_second.elem_count == 0);
-          sc_array_resize (&peer->recv_second, qcount);
-          total_recv_count += qcount;
-          qbytes = qcount * sizeof (p4est_quadrant_t);
-          P4EST_ASSERT (requests_second[j] == MPI_REQUEST_NULL);
-          mpiret = MPI_Irecv (peer->recv_second.array, (int) qbytes,
-                              MPI_BYTE, j, P4EST_COMM_BALANCE_SECOND_LOAD,
-                              p4est->mpicomm, &requests_second[j]);
-          SC_CHECK_MPI (mpiret);
-          ++recv_load[1];
-        }
-        else {
-          /* will not receive load, close this request */
-          P4EST_ASSERT (qcount == 0);
-          P4EST_ASSERT (requests_second[j] == MPI_REQUEST_NULL);
-          --request_second_count;
-          ++recv_zero[1];
-        }
-      }
-      else {
-        /* verify received size */
-        P4EST_ASSERT (jstatus->MPI_TAG == P4EST_COMM_BALANCE_SECOND_LOAD);
-        P4EST_ASSERT (peer->recv_second_count > 0);
-        mpiret = sc_MPI_Get_count (jstatus, MPI_BYTE, &rcount);
-        SC_CHECK_MPI (mpiret);
-        SC_CHECK_ABORTF (rcount ==
-                         peer->recv_second_count *
-                         (int) sizeof (p4est_quadrant_t),
-                         "Receive load mismatch B %d %dx%llu", rcount,
-                         peer->recv_second_count,
-                         (unsigned long long) sizeof (p4est_quadrant_t));
+  return pc;
+}
 
-        /* received load, close this request */
-        peer->have_second_load = 1;
-        P4EST_ASSERT (requests_second[j] == MPI_REQUEST_NULL);
-        --request_second_count;
+p4est_gloidx_t
+p4est_partition_end (p4est_partition_context_t * pc)
+{
+  p4est_t            *p4est = pc->p4est;
+  const p4est_gloidx_t global_shipped = pc->global_shipped;
+#ifdef P4EST_ENABLE_MPI
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+#endif
 
-#ifdef P4EST_ENABLE_DEBUG
-        checksum =
-          p4est_quadrant_checksum (&peer->recv_second, &checkarray, 0);
-        P4EST_LDEBUGF ("Balance B recv checksum 0x%08x from %d\n", checksum,
-                       j);
-#endif /* P4EST_ENABLE_DEBUG */
-      }
+#ifdef P4EST_ENABLE_MPI
+  if (pc->dest_gfq != NULL) {
+    /* complete the messages and take over the new quadrants */
+    p4est_transfer_fixed_end (pc->tc_quadrants);
+    if (pc->tc_data != NULL) {
+      p4est_transfer_fixed_end (pc->tc_data);
+    }
+    P4EST_FREE (pc->src_quadrants);
+    P4EST_FREE (pc->src_data);
+    p4est_replace_quadrants (p4est, pc->dest_quadrants, pc->dest_data,
+                             (p4est_locidx_t) (pc->dest_gfq[rank + 1] -
+                                               pc->dest_gfq[rank]));
+    P4EST_FREE (pc->dest_quadrants);
+    P4EST_FREE (pc->dest_data);
+
+    /* update the global partition information */
+    memcpy (p4est->global_first_quadrant, pc->dest_gfq,
+            (num_procs + 1) * sizeof (p4est_gloidx_t));
+    P4EST_FREE (pc->dest_gfq);
+    p4est_comm_global_partition (p4est, NULL);
+
+    /* the partition of the forest has changed somewhere */
+    ++p4est->revision;
+    if (p4est->balance_dirty != NULL &&
+        p4est->balance_revision == p4est->revision - 1) {
+      /* moving balanced quadrants keeps them balanced */
+      p4est->balance_revision = p4est->revision;
     }
   }
-  for (j = 0; j < num_procs; ++j) {
-    P4EST_ASSERT (requests_second[j] == MPI_REQUEST_NULL);
+#endif /* P4EST_ENABLE_MPI */
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Done " P4EST_STRING "_partition_end shipped %lld quadrants %.3g%%\n",
+     (long long) global_shipped,
+     global_shipped * 100. / p4est->global_num_quadrants);
+
+  p4est_inspect_stop (p4est->inspect, P4EST_INSPECT_PARTITION,
+                      pc->inspect_start);
+  P4EST_FREE (pc);
+  return global_shipped;
+}
+
+#ifdef P4EST_ENABLE_MPI
+
+/** Compute the weighted counts of several forests with fused collectives.
+ * The cuts are the same as in \ref p4est_partition_weighted.  Each cut is
+ * found by the process that owns it and gathered by one reduction.
+ * \param [out] counts  For each forest new counts or NULL if unchanged.
+ */
+static void
+p4est_partition_ensemble_counts (int num_forests, p4est_t * forests[],
+                                 p4est_weight_t weight_fn,
+                                 p4est_locidx_t ** counts)
+{
+  int                 mpiret;
+  int                 f, p;
+  p4est_t            *p4est = forests[0];
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+  const size_t        stride = (size_t) num_procs + 1;
+  size_t              lz;
+  ssize_t             lowers;
+  p4est_topidx_t      nt;
+  p4est_locidx_t      kl;
+  p4est_gloidx_t     *local_cuts, *cuts;
+  int64_t             weight_sum, cut, low, high;
+  int64_t            *local_sums, *global_sums;
+  int64_t           **local_weights;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+
+  /* sum the weights of the local quadrants of every forest */
+  local_weights = P4EST_ALLOC (int64_t *, num_forests);
+  local_sums = P4EST_ALLOC (int64_t, num_forests);
+  for (f = 0; f < num_forests; ++f) {
+    p4est = forests[f];
+    local_weights[f] =
+      P4EST_ALLOC (int64_t, p4est->local_num_quadrants + 1);
+    local_weights[f][0] = 0;
+    kl = 0;
+    for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+      tree = p4est_tree_array_index (p4est->trees, nt);
+      for (lz = 0; lz < tree->quadrants.elem_count; ++lz, ++kl) {
+        q = p4est_quadrant_array_index (&tree->quadrants, lz);
+        local_weights[f][kl + 1] = local_weights[f][kl] +
+          (int64_t) weight_fn (p4est, nt, q);
+        P4EST_ASSERT (local_weights[f][kl + 1] >= local_weights[f][kl]);
+      }
+    }
+    P4EST_ASSERT (kl == p4est->local_num_quadrants);
+    local_sums[f] = local_weights[f][kl];
   }
 
-  /* print buffer statistics */
-  P4EST_VERBOSEF ("first send Z %d L %d recv Z %d L %d\n",
-                  send_zero[0], send_load[0], recv_zero[0], recv_load[0]);
-  P4EST_VERBOSEF ("second send Z %d L %d recv Z %d L %d\n",
-                  send_zero[1], send_load[1], recv_zero[1], recv_load[1]);
-  P4EST_VERBOSEF ("total send %d recv %d\n", total_send_count,
-                  total_recv_count);
-  for (j = 0; j < num_procs; ++j) {
-    peer = peers + j;
-    if (peer->send_first.elem_count > 0 || peer->recv_first_count > 0 ||
-        peer->send_second.elem_count > 0 || peer->recv_second_count > 0) {
-      P4EST_VERBOSEF ("peer %d first S %llu R %d second S %llu R %d\n",
-                      j, (unsigned long long) peer->send_first.elem_count,
-                      peer->recv_first_count,
-                      (unsigned long long) peer->send_second.elem_count,
-                      peer->recv_second_count);
+  /* one gather of the weight sums of all forests */
+  global_sums = P4EST_ALLOC (int64_t, num_procs * num_forests);
+  mpiret = MPI_Allgather (local_sums, num_forests, MPI_LONG_LONG_INT,
+                          global_sums, num_forests, MPI_LONG_LONG_INT,
+                          forests[0]->mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  /* every process contributes the cuts that fall into its range */
+  local_cuts = P4EST_ALLOC_ZERO (p4est_gloidx_t, 2 * stride * num_forests);
+  cuts = local_cuts + stride * num_forests;
+  for (f = 0; f < num_forests; ++f) {
+    p4est = forests[f];
+    low = weight_sum = 0;
+    for (p = 0; p < num_procs; ++p) {
+      if (p == rank) {
+        low = weight_sum;
+      }
+      weight_sum += global_sums[p * num_forests + f];
+    }
+    high = low + local_sums[f];
+    if (weight_sum == 0) {
+      continue;
+    }
+    lowers = 0;
+    for (p = 1; p < num_procs; ++p) {
+      cut = (int64_t) p4est_partition_cut_uint64 (weight_sum, p, num_procs);
+      if (low < cut && cut <= high) {
+        lowers = sc_search_lower_bound64 (cut - low, local_weights[f],
+                                          (size_t) p4est->local_num_quadrants
+                                          + 1, (size_t) lowers);
+        P4EST_ASSERT (lowers > 0 &&
+                      (p4est_locidx_t) lowers <= p4est->local_num_quadrants);
+        local_cuts[f * stride + p] =
+          (p4est_gloidx_t) lowers + p4est->global_first_quadrant[rank];
+      }
+    }
+    if (rank == 0) {
+      local_cuts[f * stride + num_procs] = p4est->global_num_quadrants;
+    }
+  }
+  P4EST_FREE (global_sums);
+
+  /* one reduction replaces the point-to-point messages of every forest */
+  mpiret = MPI_Allreduce (local_cuts, cuts, (int) (stride * num_forests),
+                          P4EST_MPI_GLOIDX, MPI_SUM, forests[0]->mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  for (f = 0; f < num_forests; ++f) {
+    P4EST_FREE (local_weights[f]);
+    if (cuts[f * stride + num_procs] == 0 &&
+        forests[f]->global_num_quadrants > 0) {
+      /* all quadrants have zero weight and the partition is unchanged */
+      counts[f] = NULL;
+      continue;
+    }
+    counts[f] = P4EST_ALLOC (p4est_locidx_t, num_procs);
+    for (p = 0; p < num_procs; ++p) {
+      P4EST_ASSERT (cuts[f * stride + p] <= cuts[f * stride + p + 1]);
+      counts[f][p] = (p4est_locidx_t)
+        (cuts[f * stride + p + 1] - cuts[f * stride + p]);
     }
   }
+  P4EST_FREE (local_cuts);
+  P4EST_FREE (local_weights);
+  P4EST_FREE (local_sums);
+}
+
 #endif /* P4EST_ENABLE_MPI */
 
-  /* end balance_comm, start balance_B */
-  if (p4est->inspect != NULL) {
-    p4est->inspect->balance_comm += sc_MPI_Wtime ();
-    p4est->inspect->balance_B = -sc_MPI_Wtime ();
-    p4est->inspect->balance_B_count_in = 0;
-    p4est->inspect->balance_B_count_out = 0;
-    p4est->inspect->use_B = 1;
+p4est_gloidx_t
+p4est_partition_ensemble (int num_forests, p4est_t * forests[],
+                          int partition_for_coarsening,
+                          p4est_weight_t weight_fn)
+{
+  int                 f;
+  p4est_gloidx_t      global_shipped = 0;
+  p4est_partition_context_t **pcs;
 #ifdef P4EST_ENABLE_MPI
-    for (k = 0; k < 2; ++k) {
-      p4est->inspect->balance_zero_sends[k] = send_zero[k];
-      p4est->inspect->balance_zero_receives[k] = recv_zero[k];
-    }
+  p4est_locidx_t    **counts;
 #endif
+
+  P4EST_ASSERT (num_forests >= 0);
+  if (num_forests == 0) {
+    return 0;
   }
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Into " P4EST_STRING "_partition_ensemble with %d forests\n",
+     num_forests);
+  p4est_log_indent_push ();
 
-  /* merge received quadrants */
-  for (j = 0; j < num_procs; ++j) {
-    size_t              fcount;
+  pcs = P4EST_ALLOC (p4est_partition_context_t *, num_forests);
+  for (f = 0; f < num_forests; ++f) {
+    P4EST_ASSERT (forests[f]->mpisize == forests[0]->mpisize);
+    P4EST_ASSERT (forests[f]->mpirank == forests[0]->mpirank);
+    pcs[f] = p4est_partition_context_new (forests[f]);
+  }
 
-    /* access peer information */
-    peer = peers + j;
-    fcount = peer->recv_first.elem_count;
-    qcount = fcount + peer->recv_second.elem_count;
-    P4EST_ASSERT (peer->send_first_count ==
-                  (int) peer->send_first.elem_count);
-    P4EST_ASSERT (peer->send_second_count ==
-                  (int) peer->send_second.elem_count);
-    P4EST_ASSERT (peer->recv_second_count ==
-                  (int) peer->recv_second.elem_count);
-    if (qcount == 0) {
-      continue;
+#ifdef P4EST_ENABLE_MPI
+  if (forests[0]->mpisize > 1) {
+    /* compute the new counts of all forests */
+    counts = P4EST_ALLOC (p4est_locidx_t *, num_forests);
+    if (weight_fn == NULL) {
+      for (f = 0; f < num_forests; ++f) {
+        counts[f] = p4est_partition_counts (forests[f], NULL, 0,
+                                            NULL, NULL, NULL);
+      }
+    }
+    else {
+      p4est_partition_ensemble_counts (num_forests, forests, weight_fn,
+                                       counts);
     }
 
-    /* merge received quadrants into correct tree */
-    for (zz = 0; zz < qcount; ++zz) {
-      s = zz < fcount ? p4est_quadrant_array_index (&peer->recv_first, zz) :
-        p4est_quadrant_array_index (&peer->recv_second, zz - fcount);
-      P4EST_ASSERT (p4est_quadrant_is_extended (s));
-      qtree = s->p.piggy2.which_tree;
-      if (qtree < first_tree || qtree > last_tree) {
-        /* this is a corner/edge quadrant from the second pass of balance */
-        continue;
-      }
-      if (borders == NULL) {
-        tree = p4est_tree_array_index (p4est->trees, qtree);
-        q = p4est_quadrant_array_push_copy (&tree->quadrants, s);
-        ++tree->quadrants_per_level[q->level];
-        tree->maxlevel = (int8_t) SC_MAX (tree->maxlevel, q->level);
-        ++p4est->local_num_quadrants;
-        p4est_quadrant_init_data (p4est, qtree, q, init_fn);
-      }
-      else {
-        qarray = (sc_array_t *) sc_array_index (borders,
-                                                (int) (qtree - first_tree));
-        (void) p4est_quadrant_array_push_copy (qarray, s);
-      }
+    /* post the messages of all forests before waiting for any */
+    for (f = 0; f < num_forests; ++f) {
+      p4est_partition_begin_counts (pcs[f], partition_for_coarsening,
+                                    counts[f]);
     }
+    P4EST_FREE (counts);
   }
+#endif /* P4EST_ENABLE_MPI */
 
-  /* rebalance and clamp result back to original tree boundaries */
-  p4est->local_num_quadrants = 0;
-  for (nt = first_tree; nt <= last_tree; ++nt) {
-    /* check if we are the only processor in an isolated tree */
-    tree = p4est_tree_array_index (p4est->trees, nt);
-    tree->quadrants_offset = p4est->local_num_quadrants;
-    tquadrants = &tree->quadrants;
-    treecount = tquadrants->elem_count;
-    if (!(tree_flags[nt] & fully_owned_flag) ||
-        (tree_flags[nt] & any_face_flag)) {
-      /* we have most probably received quadrants, run sort and balance */
-      /* balance the border, add it back into the tree, and linearize */
-      p4est_balance_border (p4est, btype, nt, init_fn, replace_fn, borders);
-      P4EST_VERBOSEF ("Balance tree %lld B %llu to %llu\n",
-                      (long long) nt,
-                      (unsigned long long) treecount,
-                      (unsigned long long) tquadrants->elem_count);
-    }
-    p4est->local_num_quadrants += tquadrants->elem_count;
-    tquadrants = NULL;          /* safeguard */
+  for (f = 0; f < num_forests; ++f) {
+    global_shipped += p4est_partition_end (pcs[f]);
   }
-  if (last_tree >= 0) {
-    for (; nt < conn->num_trees; ++nt) {
-      tree = p4est_tree_array_index (p4est->trees, nt);
-      tree->quadrants_offset = p4est->local_num_quadrants;
+  P4EST_FREE (pcs);
+
+  p4est_log_indent_pop ();
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Done " P4EST_STRING "_partition_ensemble shipped %lld quadrants\n",
+     (long long) global_shipped);
+  return global_shipped;
+}
+
+#ifdef P4EST_ENABLE_MPI
+
+/** Compute the load of every new partition for each constraint.
+ * \param [in] raw      The weights of the local quadrants by constraint.
+ * \param [out] loads   Global loads, mpisize * num_weights entries.
+ */
+static void
+p4est_partition_multi_loads (p4est_t * p4est,
+                             const p4est_locidx_t * num_quadrants_in_proc,
+                             int num_weights, const int *raw, int64_t * loads)
+{
+  int                 mpiret;
+  int                 p, c;
+  const int           num_procs = p4est->mpisize;
+  const size_t        num_loads = (size_t) num_procs * num_weights;
+  p4est_locidx_t      kl;
+  p4est_gloidx_t      gk, next;
+  int64_t            *local_loads;
+
+  local_loads = P4EST_ALLOC_ZERO (int64_t, num_loads);
+  gk = p4est->global_first_quadrant[p4est->mpirank];
+  p = 0;
+  next = num_quadrants_in_proc[0];
+  for (kl = 0; kl < p4est->local_num_quadrants; ++kl, ++gk) {
+    while (next <= gk) {
+      next += num_quadrants_in_proc[++p];
+    }
+    for (c = 0; c < num_weights; ++c) {
+      local_loads[p * num_weights + c] += raw[kl * num_weights + c];
     }
   }
+  mpiret = MPI_Allreduce (local_loads, loads, (int) num_loads,
+                          MPI_LONG_LONG_INT, MPI_SUM, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (local_loads);
+}
 
-  /* end balance_B */
-  if (p4est->inspect != NULL) {
-    p4est->inspect->balance_B += sc_MPI_Wtime ();
-  }
+#endif /* P4EST_ENABLE_MPI */
 
+p4est_gloidx_t
+p4est_partition_multi (p4est_t * p4est, int partition_for_coarsening,
+                       int num_weights, p4est_weights_t weights_fn,
+                       const double *tolerances)
+{
+  p4est_gloidx_t      global_shipped = 0;
+  const p4est_gloidx_t global_num_quadrants = p4est->global_num_quadrants;
 #ifdef P4EST_ENABLE_MPI
-  /* wait for all send operations */
-  if (request_send_count > 0) {
-    mpiret = sc_MPI_Waitall (4 * num_procs,
-                             send_requests_first_count, MPI_STATUSES_IGNORE);
-    SC_CHECK_MPI (mpiret);
+  int                 mpiret;
+  const int           num_procs = p4est->mpisize;
+  const p4est_topidx_t first_tree = p4est->first_local_tree;
+  const p4est_topidx_t last_tree = p4est->last_local_tree;
+  const p4est_locidx_t local_num_quadrants = p4est->local_num_quadrants;
+  int                 iter, p, c;
+  int                 any;
+  int                *raw;
+  size_t              lz;
+  p4est_topidx_t      nt;
+  p4est_locidx_t      kl;
+  p4est_locidx_t     *num_quadrants_in_proc, *best_counts;
+  int64_t            *local_sums, *global_sums, *loads, maxload;
+  double             *coef, *imbalance;
+  double              tol, combined, score, best_score, csum;
+  int64_t            *local_weights;    /* cumulative weights by quadrant */
+  p4est_quadrant_t   *q;
+  p4est_tree_t       *tree;
+#endif /* P4EST_ENABLE_MPI */
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (num_weights >= 1 && weights_fn != NULL);
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Into " P4EST_STRING
+     "_partition_multi with %lld total quadrants %d constraints\n",
+     (long long) global_num_quadrants, num_weights);
+
+  /* this function does nothing in a serial setup */
+  if (p4est->mpisize == 1) {
+    P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
+                             "_partition_multi no shipping\n");
+    return global_shipped;
   }
 
-  /* compute global sum of send and receive counts */
-#ifdef P4EST_ENABLE_DEBUG
-  gtotal[0] = gtotal[1] = 0;
-  ltotal[0] = (p4est_gloidx_t) total_send_count;
-  ltotal[1] = (p4est_gloidx_t) total_recv_count;
-  mpiret = MPI_Reduce (ltotal, gtotal, 2, P4EST_MPI_GLOIDX,
-                       MPI_SUM, 0, p4est->mpicomm);
-  SC_CHECK_MPI (mpiret);
-  P4EST_GLOBAL_STATISTICSF ("Global number of shipped quadrants %lld\n",
-                            (long long) gtotal[0]);
-  P4EST_ASSERT (rank != 0 || gtotal[0] == gtotal[1]);
-#endif /* P4EST_ENABLE_DEBUG */
-#endif /* P4EST_ENABLE_MPI */
+  p4est_log_indent_push ();
 
-  /* loop over all local trees to finalize balance */
-  all_outcount = 0;
+#ifdef P4EST_ENABLE_MPI
+  /* query all weights of the local quadrants once */
+  raw = P4EST_ALLOC (int, (size_t) local_num_quadrants * num_weights);
+  local_sums = P4EST_ALLOC_ZERO (int64_t, 2 * num_weights);
+  global_sums = local_sums + num_weights;
+  kl = 0;
   for (nt = first_tree; nt <= last_tree; ++nt) {
     tree = p4est_tree_array_index (p4est->trees, nt);
-    all_outcount += tree->quadrants.elem_count;
-
-    /* final log message for this tree */
-    P4EST_VERBOSEF ("Done balance tree %lld now %llu\n", (long long) nt,
-                    (unsigned long long) tree->quadrants.elem_count);
+    for (lz = 0; lz < tree->quadrants.elem_count; ++lz, ++kl) {
+      q = p4est_quadrant_array_index (&tree->quadrants, lz);
+      weights_fn (p4est, nt, q, raw + kl * num_weights);
+      for (c = 0; c < num_weights; ++c) {
+        P4EST_ASSERT (raw[kl * num_weights + c] >= 0);
+        local_sums[c] += raw[kl * num_weights + c];
+      }
+    }
   }
+  P4EST_ASSERT (kl == local_num_quadrants);
+  mpiret = MPI_Allreduce (local_sums, global_sums, num_weights,
+                          MPI_LONG_LONG_INT, MPI_SUM, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
 
-  /* cleanup temporary storage */
-  P4EST_FREE (tree_flags);
-  for (j = 0; j < num_procs; ++j) {
-    peer = peers + j;
-    sc_array_reset (&peer->send_first);
-    sc_array_reset (&peer->send_second);
-    sc_array_reset (&peer->recv_first);
-    sc_array_reset (&peer->recv_second);
+  /* constraints without any weight do not take part */
+  coef = P4EST_ALLOC (double, 2 * num_weights);
+  imbalance = coef + num_weights;
+  for (c = 0, any = 0; c < num_weights; ++c) {
+    coef[c] = global_sums[c] > 0 ? 1. : 0.;
+    any = any || global_sums[c] > 0;
   }
-  P4EST_FREE (peers);
-
-  if (borders != NULL) {
-    for (zz = 0; zz < localcount; zz++) {
-      qarray = (sc_array_t *) sc_array_index (borders, zz);
-      sc_array_reset (qarray);
-    }
-    sc_array_destroy (borders);
+  if (!any) {
+    P4EST_FREE (raw);
+    P4EST_FREE (local_sums);
+    P4EST_FREE (coef);
+    p4est_log_indent_pop ();
+    P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
+                             "_partition_multi no shipping\n");
+    return global_shipped;
   }
 
-#ifdef P4_TO_P8
-  sc_array_reset (eta);
-#endif
-  sc_array_reset (cta);
+  num_quadrants_in_proc = P4EST_ALLOC (p4est_locidx_t, num_procs);
+  best_counts = P4EST_ALLOC (p4est_locidx_t, num_procs);
+  local_weights = P4EST_ALLOC (int64_t, local_num_quadrants + 1);
+  loads = P4EST_ALLOC (int64_t, (size_t) num_procs * num_weights);
+  best_score = -1.;
+  for (iter = 0; iter < P4EST_PARTITION_MULTI_ITERATIONS; ++iter) {
+    /* combine the constraints normalized by their global sums */
+    local_weights[0] = 0;
+    for (kl = 0; kl < local_num_quadrants; ++kl) {
+      combined = 0.;
+      for (c = 0; c < num_weights; ++c) {
+        if (coef[c] > 0.) {
+          combined += coef[c] * (double) raw[kl * num_weights + c] *
+            (double) P4EST_PARTITION_MULTI_SCALE / (double) global_sums[c];
+        }
+      }
+      local_weights[kl + 1] = local_weights[kl] + (int64_t) (combined + .5);
+    }
+    if (!p4est_partition_weighted (p4est, local_weights, NULL,
+                                   num_quadrants_in_proc)) {
+      break;
+    }
 
-#ifdef P4EST_ENABLE_MPI
-  P4EST_FREE (requests_first);  /* includes allocation for requests_second */
-  P4EST_FREE (recv_statuses);
-  P4EST_FREE (wait_indices);
-#ifdef P4EST_ENABLE_DEBUG
-  sc_array_reset (&checkarray);
-#endif /* P4EST_ENABLE_DEBUG */
-#endif /* P4EST_ENABLE_MPI */
+    /* measure the imbalance of every constraint */
+    p4est_partition_multi_loads (p4est, num_quadrants_in_proc,
+                                 num_weights, raw, loads);
+    score = 0.;
+    for (c = 0; c < num_weights; ++c) {
+      imbalance[c] = 0.;
+      if (global_sums[c] == 0) {
+        continue;
+      }
+      for (p = 0, maxload = 0; p < num_procs; ++p) {
+        maxload = SC_MAX (maxload, loads[p * num_weights + c]);
+      }
+      imbalance[c] = (double) maxload * num_procs /
+        (double) global_sums[c] - 1.;
+      tol = tolerances != NULL ? tolerances[c] :
+        P4EST_PARTITION_MULTI_TOLERANCE;
+      score = SC_MAX (score, imbalance[c] / SC_MAX (tol, 1e-12));
+      P4EST_GLOBAL_VERBOSEF ("Partition iteration %d constraint %d"
+                             " imbalance %g\n", iter, c, imbalance[c]);
+    }
+    if (best_score < 0. || score < best_score) {
+      best_score = score;
+      memcpy (best_counts, num_quadrants_in_proc,
+              num_procs * sizeof (p4est_locidx_t));
+    }
+    if (score <= 1.) {
+      break;
+    }
 
-  /* compute global number of quadrants */
-  p4est_comm_count_quadrants (p4est);
-  P4EST_ASSERT (p4est->global_num_quadrants >= old_gnq);
-  if (old_gnq != p4est->global_num_quadrants) {
-    ++p4est->revision;
+    /* emphasize the constraints that violate their tolerance */
+    for (c = 0, csum = 0.; c < num_weights; ++c) {
+      tol = tolerances != NULL ? tolerances[c] :
+        P4EST_PARTITION_MULTI_TOLERANCE;
+      if (imbalance[c] > tol) {
+        coef[c] *= 1. + imbalance[c];
+      }
+      csum += coef[c];
+    }
+    for (c = 0; c < num_weights; ++c) {
+      coef[c] *= num_weights / csum;
+    }
   }
+  P4EST_FREE (raw);
+  P4EST_FREE (local_sums);
+  P4EST_FREE (coef);
+  P4EST_FREE (local_weights);
+  P4EST_FREE (loads);
+  P4EST_FREE (num_quadrants_in_proc);
 
-  /* some sanity checks */
-  P4EST_ASSERT ((p4est_locidx_t) all_outcount == p4est->local_num_quadrants);
-  P4EST_ASSERT (all_outcount >= all_incount);
-  if (p4est->user_data_pool != NULL) {
-    P4EST_ASSERT (data_pool_size + all_outcount - all_incount ==
-                  p4est->user_data_pool->elem_count);
+  if (best_score < 0.) {
+    /* rounding has removed all weight */
+    P4EST_FREE (best_counts);
+    p4est_log_indent_pop ();
+    P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
+                             "_partition_multi no shipping\n");
+    return global_shipped;
   }
+  P4EST_GLOBAL_INFOF ("Multi-constraint partition relative imbalance %g\n",
+                      best_score);
+
+  global_shipped = p4est_partition_apply (p4est, partition_for_coarsening,
+                                          best_counts, 0, NULL);
+  P4EST_FREE (best_counts);
+
+  /* check validity of the p4est */
   P4EST_ASSERT (p4est_is_valid (p4est));
-  P4EST_ASSERT (p4est_is_balanced (p4est, btype));
-  P4EST_VERBOSEF ("Balance skipped %lld\n", (long long) skipped);
+#endif /* P4EST_ENABLE_MPI */
+
   p4est_log_indent_pop ();
-  P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
-                            "_balance with %lld total quadrants\n",
-                            (long long) p4est->global_num_quadrants);
-}
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Done " P4EST_STRING "_partition_multi shipped %lld quadrants %.3g%%\n",
+     (long long) global_shipped,
+     global_shipped * 100. / global_num_quadrants);
 
-void
-p4est_partition (p4est_t * p4est, int allow_for_coarsening,
-                 p4est_weight_t weight_fn)
-{
-  (void) p4est_partition_ext (p4est, allow_for_coarsening, weight_fn);
+  return global_shipped;
 }
 
 p4est_gloidx_t
-p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
-                     p4est_weight_t weight_fn)
+p4est_partition_incremental (p4est_t * p4est, int partition_for_coarsening,
+                             p4est_weight_t weight_fn, double tolerance)
 {
   p4est_gloidx_t      global_shipped = 0;
   const p4est_gloidx_t global_num_quadrants = p4est->global_num_quadrants;
 #ifdef P4EST_ENABLE_MPI
   int                 mpiret;
-  int                 low_source, high_source;
   const int           num_procs = p4est->mpisize;
   const int           rank = p4est->mpirank;
   const p4est_topidx_t first_tree = p4est->first_local_tree;
   const p4est_topidx_t last_tree = p4est->last_local_tree;
   const p4est_locidx_t local_num_quadrants = p4est->local_num_quadrants;
-  int                 i, p;
-  int                 send_lowest, send_highest;
-  int                 num_sends, rcount, base_index;
+  int                 i, num_moved;
   size_t              lz;
   ssize_t             lowers;
   p4est_topidx_t      nt;
-  p4est_locidx_t      kl, qlocal;
+  p4est_locidx_t      kl;
   p4est_locidx_t     *num_quadrants_in_proc;
-  p4est_gloidx_t      prev_quadrant, next_quadrant;
-  p4est_gloidx_t      send_index, recv_low, recv_high, qcount;
-  p4est_gloidx_t     *send_array;
-  int64_t             weight, weight_sum;
-  int64_t             cut, my_lowcut, my_highcut;
+  p4est_gloidx_t     *local_cuts, *cuts;
+  int64_t             weight, weight_sum, maxload;
+  int64_t             ideal, delta, target;
   int64_t            *local_weights;    /* cumulative weights by quadrant */
   int64_t            *global_weight_sums;
+  double              imbalance;
   p4est_quadrant_t   *q;
   p4est_tree_t       *tree;
-  MPI_Request        *send_requests, recv_requests[2];
-  MPI_Status          recv_statuses[2];
-  p4est_gloidx_t      num_corrected;
 #endif /* P4EST_ENABLE_MPI */
 
   P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (0. <= tolerance && tolerance < 2.);
   P4EST_GLOBAL_PRODUCTIONF
     ("Into " P4EST_STRING
-     "_partition with %lld total quadrants\n",
-     (long long) p4est->global_num_quadrants);
+     "_partition_incremental with %lld total quadrants\n",
+     (long long) global_num_quadrants);
 
   /* this function does nothing in a serial setup */
   if (p4est->mpisize == 1) {
-    P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_partition no shipping\n");
-
-    /* in particular, there is no need to bump the revision counter */
-    P4EST_ASSERT (global_shipped == 0);
+    P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
+                             "_partition_incremental no shipping\n");
     return global_shipped;
   }
 
   p4est_log_indent_push ();
 
 #ifdef P4EST_ENABLE_MPI
-  /* allocate new quadrant distribution counts */
-  num_quadrants_in_proc = P4EST_ALLOC (p4est_locidx_t, num_procs);
-
-  if (weight_fn == NULL) {
-    /* Divide up the quadrants equally */
-    for (p = 0, next_quadrant = 0; p < num_procs; ++p) {
-      prev_quadrant = next_quadrant;
-      next_quadrant =
-        p4est_partition_cut_gloidx (global_num_quadrants, p + 1, num_procs);
-      qcount = next_quadrant - prev_quadrant;
-      P4EST_ASSERT (0 <= qcount
-                    && qcount <= (p4est_gloidx_t) P4EST_LOCIDX_MAX);
-      num_quadrants_in_proc[p] = (p4est_locidx_t) (qcount);
+  /* linearly sum weights across all trees */
+  local_weights = P4EST_ALLOC (int64_t, local_num_quadrants + 1);
+  kl = 0;
+  local_weights[0] = 0;
+  for (nt = first_tree; nt <= last_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    for (lz = 0; lz < tree->quadrants.elem_count; ++lz, ++kl) {
+      q = p4est_quadrant_array_index (&tree->quadrants, lz);
+      weight = weight_fn == NULL ? 1 : (int64_t) weight_fn (p4est, nt, q);
+      P4EST_ASSERT (weight >= 0);
+      local_weights[kl + 1] = local_weights[kl] + weight;
     }
   }
-  else {
-    /* do a weighted partition */
-    local_weights = P4EST_ALLOC (int64_t, local_num_quadrants + 1);
-    global_weight_sums = P4EST_ALLOC (int64_t, num_procs + 1);
-    P4EST_VERBOSEF ("local quadrant count %lld\n",
-                    (long long) local_num_quadrants);
-
-    /* linearly sum weights across all trees */
-    kl = 0;
-    local_weights[0] = 0;
-    for (nt = first_tree; nt <= last_tree; ++nt) {
-      tree = p4est_tree_array_index (p4est->trees, nt);
-      for (lz = 0; lz < tree->quadrants.elem_count; ++lz, ++kl) {
-        q = p4est_quadrant_array_index (&tree->quadrants, lz);
-        weight = (int64_t) weight_fn (p4est, nt, q);
-        P4EST_ASSERT (weight >= 0);
-        local_weights[kl + 1] = local_weights[kl] + weight;
-      }
-    }
-    P4EST_ASSERT (kl == local_num_quadrants);
-    weight_sum = local_weights[local_num_quadrants];
-    P4EST_VERBOSEF ("local weight sum %lld\n", (long long) weight_sum);
-
-    /* distribute local weight sums */
-    global_weight_sums[0] = 0;
-    mpiret = MPI_Allgather (&weight_sum, 1, MPI_LONG_LONG_INT,
-                            &global_weight_sums[1], 1, MPI_LONG_LONG_INT,
-                            p4est->mpicomm);
-    SC_CHECK_MPI (mpiret);
-
-    /* adjust all arrays to reflect the global weight */
-    for (i = 0; i < num_procs; ++i) {
-      global_weight_sums[i + 1] += global_weight_sums[i];
-    }
-    if (rank > 0) {
-      weight_sum = global_weight_sums[rank];
-      for (kl = 0; kl <= local_num_quadrants; ++kl) {
-        local_weights[kl] += weight_sum;
-      }
-    }
-    P4EST_ASSERT (local_weights[0] == global_weight_sums[rank]);
-    P4EST_ASSERT (local_weights[local_num_quadrants] ==
-                  global_weight_sums[rank + 1]);
-    weight_sum = global_weight_sums[num_procs];
-
-    if (rank == 0) {
-      for (i = 0; i <= num_procs; ++i) {
-        P4EST_GLOBAL_VERBOSEF ("Global weight sum [%d] %lld\n",
-                               i, (long long) global_weight_sums[i]);
-      }
-    }
-
-    /* if all quadrants have zero weight we do nothing */
-    if (weight_sum == 0) {
-      P4EST_FREE (local_weights);
-      P4EST_FREE (global_weight_sums);
-      P4EST_FREE (num_quadrants_in_proc);
-      p4est_log_indent_pop ();
-      P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
-                               "_partition no shipping\n");
-
-      /* in particular, there is no need to bump the revision counter */
-      P4EST_ASSERT (global_shipped == 0);
-      return global_shipped;
-    }
-
-    /* determine processor ids to send to */
-    send_lowest = num_procs;
-    send_highest = 0;
-    for (i = 1; i <= num_procs; ++i) {
-      cut = p4est_partition_cut_uint64 (weight_sum, i, num_procs);
-      if (global_weight_sums[rank] < cut &&
-          cut <= global_weight_sums[rank + 1]) {
-        send_lowest = SC_MIN (send_lowest, i);
-        send_highest = SC_MAX (send_highest, i);
-      }
-    }
-    /*
-     * send low cut to send_lowest..send_highest
-     * and high cut to send_lowest-1..send_highest-1
-     */
-    P4EST_LDEBUGF ("my send peers %d %d\n", send_lowest, send_highest);
-
-    num_sends = 2 * (send_highest - send_lowest + 1);
-    if (num_sends <= 0) {
-      num_sends = 0;
-      send_requests = NULL;
-      send_array = NULL;
-    }
-    else {
-      send_requests = P4EST_ALLOC (MPI_Request, num_sends);
-      send_array = P4EST_ALLOC (p4est_gloidx_t, num_sends);
-      lowers = 0;
-      for (i = send_lowest; i <= send_highest; ++i) {
-        base_index = 2 * (i - send_lowest);
-        if (i < num_procs) {
-          /* do binary search in the weight array */
-          lowers = sc_search_lower_bound64 (p4est_partition_cut_uint64
-                                            (weight_sum, i, num_procs),
-                                            local_weights,
-                                            (size_t) local_num_quadrants + 1,
-                                            (size_t) lowers);
-          P4EST_ASSERT (lowers > 0
-                        && (p4est_locidx_t) lowers <= local_num_quadrants);
-
-          /* send low bound */
-          send_index = send_array[base_index + 1] =
-            (p4est_gloidx_t) lowers + p4est->global_first_quadrant[rank];
-          P4EST_LDEBUGF ("send A %d %d %d index %lld base %d to %d\n",
-                         send_lowest, i, send_highest,
-                         (long long) send_index, base_index + 1, i);
-          mpiret =
-            MPI_Isend (&send_array[base_index + 1], 1, P4EST_MPI_GLOIDX, i,
-                       P4EST_COMM_PARTITION_WEIGHTED_LOW, p4est->mpicomm,
-                       &send_requests[base_index + 1]);
-          SC_CHECK_MPI (mpiret);
-        }
-        else {
-          lowers = 0;
-          send_index = global_num_quadrants;
-          send_requests[base_index + 1] = MPI_REQUEST_NULL;
-          send_array[base_index + 1] = -1;
-        }
-
-        /* send high bound */
-        send_array[base_index] = send_index;
-        P4EST_LDEBUGF ("send B %d %d %d index %lld base %d to %d\n",
-                       send_lowest, i, send_highest,
-                       (long long) send_index, base_index, i - 1);
-        mpiret = MPI_Isend (&send_array[base_index], 1, P4EST_MPI_GLOIDX,
-                            i - 1, P4EST_COMM_PARTITION_WEIGHTED_HIGH,
-                            p4est->mpicomm, &send_requests[base_index]);
-        SC_CHECK_MPI (mpiret);
-      }
-    }
-
-    /* determine processor ids to receive from and post irecv */
-    i = 0;
-    my_lowcut = p4est_partition_cut_uint64 (weight_sum, rank, num_procs);
-    if (my_lowcut == 0) {
-      recv_low = 0;
-      recv_requests[0] = MPI_REQUEST_NULL;
-      low_source = -1;
-    }
-    else {
-      for (; i < num_procs; ++i) {
-        if (global_weight_sums[i] < my_lowcut &&
-            my_lowcut <= global_weight_sums[i + 1]) {
-          P4EST_LDEBUGF ("recv A from %d\n", i);
-          mpiret = MPI_Irecv (&recv_low, 1, P4EST_MPI_GLOIDX, i,
-                              P4EST_COMM_PARTITION_WEIGHTED_LOW,
-                              p4est->mpicomm, &recv_requests[0]);
-          SC_CHECK_MPI (mpiret);
-          break;
-        }
-      }
-      P4EST_ASSERT (i < num_procs);
-      low_source = i;
-    }
-    my_highcut = p4est_partition_cut_uint64 (weight_sum, rank + 1, num_procs);
-    if (my_highcut == 0) {
-      recv_high = 0;
-      recv_requests[1] = MPI_REQUEST_NULL;
-      high_source = -1;
-    }
-    else {
-      for (; i < num_procs; ++i) {
-        if (global_weight_sums[i] < my_highcut &&
-            my_highcut <= global_weight_sums[i + 1]) {
-          P4EST_LDEBUGF ("recv B from %d\n", i);
-          mpiret = MPI_Irecv (&recv_high, 1, P4EST_MPI_GLOIDX, i,
-                              P4EST_COMM_PARTITION_WEIGHTED_HIGH,
-                              p4est->mpicomm, &recv_requests[1]);
-          SC_CHECK_MPI (mpiret);
-          break;
-        }
-      }
-      P4EST_ASSERT (i < num_procs);
-      high_source = i;
-    }
-    P4EST_LDEBUGF ("my recv peers %d %d cuts %lld %lld\n",
-                   low_source, high_source,
-                   (long long) my_lowcut, (long long) my_highcut);
-
-    /* free temporary memory */
+  P4EST_ASSERT (kl == local_num_quadrants);
+
+  /* the current load of every process */
+  global_weight_sums = P4EST_ALLOC (int64_t, num_procs + 1);
+  global_weight_sums[0] = 0;
+  weight_sum = local_weights[local_num_quadrants];
+  mpiret = MPI_Allgather (&weight_sum, 1, MPI_LONG_LONG_INT,
+                          &global_weight_sums[1], 1, MPI_LONG_LONG_INT,
+                          p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  maxload = 0;
+  for (i = 0; i < num_procs; ++i) {
+    maxload = SC_MAX (maxload, global_weight_sums[i + 1]);
+    global_weight_sums[i + 1] += global_weight_sums[i];
+  }
+  for (kl = 0; kl <= local_num_quadrants; ++kl) {
+    local_weights[kl] += global_weight_sums[rank];
+  }
+  weight_sum = global_weight_sums[num_procs];
+
+  /* leave the partition alone while it is balanced well enough */
+  imbalance = weight_sum == 0 ? 0. :
+    (double) maxload * num_procs / (double) weight_sum - 1.;
+  P4EST_GLOBAL_INFOF ("Partition imbalance %g tolerance %g\n",
+                      imbalance, tolerance);
+  if (imbalance <= tolerance) {
     P4EST_FREE (local_weights);
     P4EST_FREE (global_weight_sums);
+    p4est_log_indent_pop ();
+    P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
+                             "_partition_incremental no shipping\n");
+    return global_shipped;
+  }
 
-    /* wait for sends and receives to complete */
-    if (num_sends > 0) {
-      mpiret = sc_MPI_Waitall (num_sends, send_requests, MPI_STATUSES_IGNORE);
-      SC_CHECK_MPI (mpiret);
-      P4EST_FREE (send_requests);
-      P4EST_FREE (send_array);
+  /* move only the cuts that are too far from their ideal position, and
+     only as far as needed to keep every load below the tolerance */
+  delta = (int64_t) (tolerance * (double) weight_sum / (2. * num_procs));
+  local_cuts = P4EST_ALLOC (p4est_gloidx_t, 2 * (num_procs + 1));
+  cuts = local_cuts + num_procs + 1;
+  local_cuts[0] = 0;
+  local_cuts[num_procs] = global_num_quadrants;
+  num_moved = 0;
+  lowers = 0;
+  for (i = 1; i < num_procs; ++i) {
+    local_cuts[i] = -1;
+    ideal = (int64_t) p4est_partition_cut_uint64 (weight_sum, i, num_procs);
+    target = SC_MIN (SC_MAX (global_weight_sums[i], ideal - delta),
+                     ideal + delta);
+    if (target == global_weight_sums[i]) {
+      /* this cut stays where it is */
+      local_cuts[i] = p4est->global_first_quadrant[i];
+      continue;
     }
-    mpiret = sc_MPI_Waitall (2, recv_requests, recv_statuses);
-    SC_CHECK_MPI (mpiret);
-    if (my_lowcut != 0) {
-      SC_CHECK_ABORT (recv_statuses[0].MPI_SOURCE == low_source,
-                      "Wait low source");
-      SC_CHECK_ABORT (recv_statuses[0].MPI_TAG ==
-                      P4EST_COMM_PARTITION_WEIGHTED_LOW, "Wait low tag");
-      mpiret =
-        sc_MPI_Get_count (&recv_statuses[0], P4EST_MPI_GLOIDX, &rcount);
-      SC_CHECK_MPI (mpiret);
-      SC_CHECK_ABORTF (rcount == 1, "Wait low count %d", rcount);
-    }
-    if (my_highcut != 0) {
-      SC_CHECK_ABORT (recv_statuses[1].MPI_SOURCE == high_source,
-                      "Wait high source");
-      SC_CHECK_ABORT (recv_statuses[1].MPI_TAG ==
-                      P4EST_COMM_PARTITION_WEIGHTED_HIGH, "Wait high tag");
-      mpiret =
-        sc_MPI_Get_count (&recv_statuses[1], P4EST_MPI_GLOIDX, &rcount);
-      SC_CHECK_MPI (mpiret);
-      SC_CHECK_ABORTF (rcount == 1, "Wait high count %d", rcount);
+    ++num_moved;
+    if (target <= 0) {
+      local_cuts[i] = 0;
     }
-
-    /* communicate the quadrant ranges */
-    qcount = recv_high - recv_low;
-    P4EST_LDEBUGF ("weighted partition count %lld\n", (long long) qcount);
-    P4EST_ASSERT (qcount >= 0 && qcount <= (p4est_gloidx_t) P4EST_LOCIDX_MAX);
-    qlocal = (p4est_locidx_t) qcount;
-    mpiret = MPI_Allgather (&qlocal, 1, P4EST_MPI_LOCIDX,
-                            num_quadrants_in_proc, 1, P4EST_MPI_LOCIDX,
-                            p4est->mpicomm);
-    SC_CHECK_MPI (mpiret);
-
-#if(0)
-    /* run through the count array and repair zero ranges */
-    for (i = 0; i < num_procs; ++i) {
-      if (num_quadrants_in_proc[i] == 0) {
-        for (p = i - 1; p >= 0; --p) {
-          P4EST_ASSERT (num_quadrants_in_proc[p] > 0);
-          if (num_quadrants_in_proc[p] > 1) {
-            --num_quadrants_in_proc[p];
-            ++num_quadrants_in_proc[i];
-            break;
-          }
-        }
-        if (p < 0) {
-          for (p = i + 1; p < num_procs; ++p) {
-            P4EST_ASSERT (num_quadrants_in_proc[p] >= 0);
-            if (num_quadrants_in_proc[p] > 1) {
-              --num_quadrants_in_proc[p];
-              ++num_quadrants_in_proc[i];
-              break;
-            }
-          }
-          P4EST_ASSERT (p < num_procs);
-        }
-      }
+    else if (global_weight_sums[rank] < target &&
+             target <= global_weight_sums[rank + 1]) {
+      /* the new cut lies within my quadrants */
+      lowers = sc_search_lower_bound64 (target, local_weights,
+                                        (size_t) local_num_quadrants + 1,
+                                        (size_t) lowers);
+      P4EST_ASSERT (lowers > 0
+                    && (p4est_locidx_t) lowers <= local_num_quadrants);
+      local_cuts[i] =
+        (p4est_gloidx_t) lowers + p4est->global_first_quadrant[rank];
     }
-#endif
   }
+  P4EST_GLOBAL_VERBOSEF ("Moving %d of %d partition boundaries\n",
+                         num_moved, num_procs - 1);
+  P4EST_FREE (local_weights);
+  P4EST_FREE (global_weight_sums);
 
-  /* correct partition */
-  if (partition_for_coarsening) {
-    num_corrected =
-      p4est_partition_for_coarsening (p4est, num_quadrants_in_proc);
-    P4EST_GLOBAL_INFOF
-      ("Designated partition for coarsening %lld quadrants moved\n",
-       (long long) num_corrected);
-  }
+  mpiret = MPI_Allreduce (local_cuts, cuts, num_procs + 1,
+                          P4EST_MPI_GLOIDX, MPI_MAX, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
 
-  /* run the partition algorithm with proper quadrant counts */
-  global_shipped = p4est_partition_given (p4est, num_quadrants_in_proc);
-  if (global_shipped) {
-    /* the partition of the forest has changed somewhere */
-    ++p4est->revision;
+  /* zero weights may leave moved cuts out of order */
+  num_quadrants_in_proc = P4EST_ALLOC (p4est_locidx_t, num_procs);
+  for (i = 0; i < num_procs; ++i) {
+    P4EST_ASSERT (0 <= cuts[i + 1] && cuts[i + 1] <= global_num_quadrants);
+    cuts[i + 1] = SC_MAX (cuts[i + 1], cuts[i]);
+    P4EST_ASSERT (cuts[i + 1] - cuts[i] <=
+                  (p4est_gloidx_t) P4EST_LOCIDX_MAX);
+    num_quadrants_in_proc[i] = (p4est_locidx_t) (cuts[i + 1] - cuts[i]);
   }
+  P4EST_ASSERT (cuts[num_procs] == global_num_quadrants);
+  P4EST_FREE (local_cuts);
+
+  global_shipped = p4est_partition_apply (p4est, partition_for_coarsening,
+                                          num_quadrants_in_proc, 0, NULL);
   P4EST_FREE (num_quadrants_in_proc);
 
   /* check validity of the p4est */
@@ -2781,13 +6244,39 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
 
   p4est_log_indent_pop ();
   P4EST_GLOBAL_PRODUCTIONF
-    ("Done " P4EST_STRING "_partition shipped %lld quadrants %.3g%%\n",
+    ("Done " P4EST_STRING
+     "_partition_incremental shipped %lld quadrants %.3g%%\n",
      (long long) global_shipped,
      global_shipped * 100. / global_num_quadrants);
 
   return global_shipped;
 }
 
+#ifdef P4EST_ENABLE_MPI
+
+/** Apply the correction of one process to the partition counts.
+ * The quadrants are moved between \a rank and the previous nonempty process.
+ * \return The absolute number of moved quadrants.
+ */
+static              p4est_gloidx_t
+p4est_partition_correct_count (p4est_locidx_t * num_quadrants_in_proc,
+                               int rank, int correction)
+{
+  int                 p;
+
+  P4EST_ASSERT (rank > 0);
+
+  num_quadrants_in_proc[rank] += correction;
+  for (p = rank - 1; p >= 0 && num_quadrants_in_proc[p] == 0; --p) {
+  }
+  if (p >= 0) {
+    num_quadrants_in_proc[p] -= correction;
+  }
+  return P4EST_GLOIDX_ABS ((p4est_gloidx_t) correction);
+}
+
+#endif /* P4EST_ENABLE_MPI */
+
 p4est_gloidx_t
 p4est_partition_for_coarsening (p4est_t * p4est,
                                 p4est_locidx_t * num_quadrants_in_proc)
@@ -2825,8 +6314,10 @@ p4est_partition_for_coarsening (p4est_t * p4est,
   int                 process_with_cut = -1, process_with_cut_recv_id = -1;
   p4est_quadrant_t   *parent_receive;
   int                *receive_process;
-  int                *correction, correction_local = 0;
-  int                 current_proc, next_proc;
+  int                 correction_local = 0;
+  int                 nonzero_local, nonzero_offset, num_nonzero;
+  int                *correction_pairs;
+  signed char         correction_byte, *correction;
   p4est_gloidx_t      num_moved_quadrants;
 
   /* create array with first quadrants of new partition */
@@ -3327,11 +6818,42 @@ p4est_partition_for_coarsening (p4est_t * p4est,
   /* free memory */
   P4EST_FREE (partition_new);
 
-  /* communicate corrections */
-  correction = P4EST_ALLOC (int, num_procs);
-  mpiret = MPI_Allgather (&correction_local, 1, MPI_INT,
-                          correction, 1, MPI_INT, p4est->mpicomm);
+  /* communicate corrections: most are zero, so we count the nonzero ones
+     first and only gather all of them when that is cheaper */
+  P4EST_ASSERT (-P4EST_CHILDREN < correction_local &&
+                correction_local < P4EST_CHILDREN);
+  nonzero_local = (correction_local != 0);
+  mpiret = MPI_Allreduce (&nonzero_local, &num_nonzero, 1, MPI_INT, MPI_SUM,
+                          p4est->mpicomm);
   SC_CHECK_MPI (mpiret);
+  correction = NULL;
+  correction_pairs = NULL;
+  if (num_nonzero > 0 &&
+      2 * num_nonzero * (int) sizeof (int) < num_procs) {
+    /* every rank with a correction fills its slot of a short array */
+    mpiret = MPI_Exscan (&nonzero_local, &nonzero_offset, 1, MPI_INT,
+                         MPI_SUM, p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+    if (rank == 0) {
+      nonzero_offset = 0;
+    }
+    correction_pairs = P4EST_ALLOC_ZERO (int, 2 * num_nonzero);
+    if (nonzero_local) {
+      correction_pairs[2 * nonzero_offset] = rank;
+      correction_pairs[2 * nonzero_offset + 1] = correction_local;
+    }
+    mpiret = MPI_Allreduce (MPI_IN_PLACE, correction_pairs, 2 * num_nonzero,
+                            MPI_INT, MPI_SUM, p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+  }
+  else if (num_nonzero > 0) {
+    /* the corrections are small, so one byte each suffices */
+    correction_byte = (signed char) correction_local;
+    correction = P4EST_ALLOC (signed char, num_procs);
+    mpiret = MPI_Allgather (&correction_byte, 1, MPI_SIGNED_CHAR,
+                            correction, 1, MPI_SIGNED_CHAR, p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+  }
 
   /* BEGIN: wait for MPI send to complete */
   if (num_sends > 0) {
@@ -3345,37 +6867,27 @@ p4est_partition_for_coarsening (p4est_t * p4est,
   }
   /* END: wait for MPI send to complete */
 
-  /* correct partition */
-  current_proc =
-    p4est_next_nonempty_process (0, num_procs, num_quadrants_in_proc);
-  next_proc =
-    p4est_next_nonempty_process (current_proc + 1, num_procs,
-                                 num_quadrants_in_proc);
+  /* correct partition from the highest rank down, such that the lower
+     counts are unmodified when looking for the previous nonempty process */
   num_moved_quadrants = 0;
-  while (current_proc < num_procs) {
-    /* loop over all non empty processes */
-    /* compute correct partition for process `current_proc` */
-    if (0 < current_proc && current_proc < num_procs) {
-      /* if any process but first */
-      num_quadrants_in_proc[current_proc] += correction[current_proc];
-      /* input is just a locidx, but the result is gloidx so we cast cleanly */
-      num_moved_quadrants += P4EST_GLOIDX_ABS (correction[current_proc]);
+  if (correction_pairs != NULL) {
+    for (i = num_nonzero - 1; i >= 0; --i) {
+      num_moved_quadrants += p4est_partition_correct_count
+        (num_quadrants_in_proc, correction_pairs[2 * i],
+         correction_pairs[2 * i + 1]);
     }
-    if (next_proc < num_procs) {
-      /* if first process or next process is feasible */
-      num_quadrants_in_proc[current_proc] -= correction[next_proc];
+    P4EST_FREE (correction_pairs);
+  }
+  if (correction != NULL) {
+    for (i = num_procs - 1; i > 0; --i) {
+      if (correction[i] != 0) {
+        num_moved_quadrants += p4est_partition_correct_count
+          (num_quadrants_in_proc, i, (int) correction[i]);
+      }
     }
-
-    /* increase process ids */
-    current_proc = next_proc;
-    next_proc =
-      p4est_next_nonempty_process (next_proc + 1, num_procs,
-                                   num_quadrants_in_proc);
+    P4EST_FREE (correction);
   }
 
-  /* free memory */
-  P4EST_FREE (correction);
-
   /* return absolute number of moved quadrants */
   return num_moved_quadrants;
 #else
@@ -3458,6 +6970,117 @@ p4est_checksum_partition (p4est_t * p4est)
 #endif /* !P4EST_HAVE_ZLIB */
 }
 
+/** Number of quadrants serialized at a time by \ref p4est_checksum_crc32c. */
+#define P4EST_CHECKSUM_BLOCK 128
+
+/** Bytes hashed per quadrant: its coordinates and level. */
+#define P4EST_CHECKSUM_QBYTES (4 * (P4EST_DIM + 1))
+
+/** Store a 32-bit word in little-endian byte order. */
+static inline unsigned char *
+p4est_checksum_put (unsigned char *b, uint32_t v)
+{
+  b[0] = (unsigned char) v;
+  b[1] = (unsigned char) (v >> 8);
+  b[2] = (unsigned char) (v >> 16);
+  b[3] = (unsigned char) (v >> 24);
+  return b + 4;
+}
+
+/** CRC32C of a range of quadrants, staged through a small stack buffer. */
+static unsigned
+p4est_checksum_crc32c_range (const p4est_quadrant_t * quads, size_t count)
+{
+  unsigned char       buf[P4EST_CHECKSUM_BLOCK * P4EST_CHECKSUM_QBYTES];
+  unsigned char      *b;
+  unsigned            crc = 0;
+  size_t              zz, k, n;
+  const p4est_quadrant_t *q;
+
+  for (zz = 0; zz < count; zz += n) {
+    n = SC_MIN (count - zz, (size_t) P4EST_CHECKSUM_BLOCK);
+    for (k = 0, b = buf; k < n; ++k) {
+      q = quads + zz + k;
+      b = p4est_checksum_put (b, (uint32_t) q->x);
+      b = p4est_checksum_put (b, (uint32_t) q->y);
+#ifdef P4_TO_P8
+      b = p4est_checksum_put (b, (uint32_t) q->z);
+#endif
+      b = p4est_checksum_put (b, (uint32_t) q->level);
+    }
+    crc = p4est_crc32c (crc, buf, (size_t) (b - buf));
+  }
+  return crc;
+}
+
+/** CRC32C of a tree, split into consecutive pieces among the threads. */
+static unsigned
+p4est_checksum_crc32c_tree (sc_array_t * quadrants)
+{
+  const size_t        count = quadrants->elem_count;
+  int                 num_threads = 1;
+  int                 t;
+  size_t              begin, end;
+  unsigned            crc, *parts;
+
+#ifdef P4EST_ENABLE_OPENMP
+  /* small trees are not worth the threads */
+  num_threads = (int) SC_MIN ((size_t) p4est_get_num_threads (),
+                              1 + count / checksum_thread_quadrants);
+#endif
+  if (num_threads == 1) {
+    return p4est_checksum_crc32c_range
+      ((const p4est_quadrant_t *) quadrants->array, count);
+  }
+
+  parts = P4EST_ALLOC (unsigned, num_threads);
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_threads) private (begin, end)
+#endif
+  for (t = 0; t < num_threads; ++t) {
+    begin = count * t / num_threads;
+    end = count * (t + 1) / num_threads;
+    parts[t] = p4est_checksum_crc32c_range
+      (p4est_quadrant_array_index (quadrants, begin), end - begin);
+  }
+  crc = parts[0];
+  for (t = 1; t < num_threads; ++t) {
+    begin = count * t / num_threads;
+    end = count * (t + 1) / num_threads;
+    crc = p4est_crc32c_combine (crc, parts[t],
+                                (end - begin) * P4EST_CHECKSUM_QBYTES);
+  }
+  P4EST_FREE (parts);
+  return crc;
+}
+
+unsigned
+p4est_checksum_crc32c (p4est_t * p4est, int partition_dependent)
+{
+  unsigned            crc = 0;
+  unsigned char       buf[4];
+  size_t              bytes = 0, tbytes;
+  p4est_topidx_t      nt;
+  p4est_tree_t       *tree;
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+
+  if (partition_dependent && p4est->mpirank > 0) {
+    p4est_checksum_put (buf, (uint32_t) p4est->local_num_quadrants);
+    crc = p4est_crc32c (crc, buf, 4);
+    bytes = 4;
+  }
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    tbytes = tree->quadrants.elem_count * P4EST_CHECKSUM_QBYTES;
+    crc = p4est_crc32c_combine
+      (crc, p4est_checksum_crc32c_tree (&tree->quadrants), tbytes);
+    bytes += tbytes;
+  }
+
+  return p4est_comm_checksum_crc32c (p4est, crc, bytes);
+}
+
 void
 p4est_save (const char *filename, p4est_t * p4est, int save_data)
 {
@@ -3467,6 +7090,14 @@ p4est_save (const char *filename, p4est_t * p4est, int save_data)
 void
 p4est_save_ext (const char *filename, p4est_t * p4est,
                 int save_data, int save_partition)
+{
+  p4est_save_info (filename, p4est, save_data, save_partition,
+                   sc_MPI_INFO_NULL);
+}
+
+void
+p4est_save_info (const char *filename, p4est_t * p4est,
+                 int save_data, int save_partition, sc_MPI_Info info)
 {
   const int           headc = 6;
   const int           align = 32;
@@ -3605,26 +7236,28 @@ p4est_save_ext (const char *filename, p4est_t * p4est,
   SC_CHECK_MPI (mpiret);
   mpiret = MPI_File_open (p4est->mpicomm, (char *) filename,
                           MPI_MODE_WRONLY | MPI_MODE_APPEND |
-                          MPI_MODE_UNIQUE_OPEN, MPI_INFO_NULL, &mpifile);
+                          MPI_MODE_UNIQUE_OPEN, info, &mpifile);
   SC_CHECK_MPI (mpiret);
   mpiret = MPI_File_get_position (mpifile, &mpipos);
   SC_CHECK_MPI (mpiret);
 #endif
 
-  if (rank > 0) {
-    /* seek to the beginning of this processor's storage */
-    foffset = (long) (p4est->global_first_quadrant[rank] * comb_size);
-
+  /* the beginning of this processor's storage */
+  foffset = (long) (p4est->global_first_quadrant[rank] * comb_size);
 #ifndef P4EST_MPIIO_WRITE
+  if (rank > 0) {
     fthis = fpos + foffset;
     retval = fseek (file, fthis, SEEK_SET);
     SC_CHECK_ABORT (retval == 0, "seek data");
+  }
 #else
-    mpithis = mpipos + (MPI_Offset) foffset;
-    mpiret = MPI_File_seek (mpifile, mpithis, MPI_SEEK_SET);
-    SC_CHECK_MPI (mpiret);
+  mpithis = mpipos + (MPI_Offset) foffset;
+
+  /* all local quadrants are written by one collective call */
+  zcount = comb_size * (size_t) p4est->local_num_quadrants;
+  SC_CHECK_ABORT (zcount <= (size_t) INT_MAX, "local write size");
+  bp = lbuf = P4EST_ALLOC (char, zcount);
 #endif
-  }
 
   /* write quadrant coordinates and data interleaved */
   for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
@@ -3632,8 +7265,10 @@ p4est_save_ext (const char *filename, p4est_t * p4est,
     tquadrants = &tree->quadrants;
     zcount = tquadrants->elem_count;
 
+#ifndef P4EST_MPIIO_WRITE
     /* storage that will be written for this tree */
     bp = lbuf = P4EST_ALLOC (char, comb_size * zcount);
+#endif
     for (zz = 0; zz < zcount; ++zz) {
       qpos = (p4est_locidx_t *) bp;
       q = p4est_quadrant_array_index (tquadrants, zz);
@@ -3650,13 +7285,20 @@ p4est_save_ext (const char *filename, p4est_t * p4est,
     }
 #ifndef P4EST_MPIIO_WRITE
     sc_fwrite (lbuf, comb_size, zcount, file, "write quadrants");
-#else
-    sc_mpi_write (mpifile, lbuf, comb_size * zcount, MPI_BYTE,
-                  "write quadrants");
-#endif
     P4EST_FREE (lbuf);
+#endif
   }
 
+#ifdef P4EST_MPIIO_WRITE
+  /* collective buffering lets the MPI-IO layer aggregate the requests */
+  P4EST_ASSERT (bp == lbuf + comb_size * p4est->local_num_quadrants);
+  mpiret = MPI_File_write_at_all (mpifile, mpithis, lbuf,
+                                  (int) (bp - lbuf), MPI_BYTE,
+                                  MPI_STATUS_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (lbuf);
+#endif
+
 #ifndef P4EST_MPIIO_WRITE
   sc_fflush_fsync_fclose (file);
   file = NULL;
@@ -3690,12 +7332,49 @@ p4est_load (const char *filename, sc_MPI_Comm mpicomm, size_t data_size,
                          0, 0, user_pointer, connectivity);
 }
 
+p4est_t            *
+p4est_load_ext (const char *filename, sc_MPI_Comm mpicomm, size_t data_size,
+                int load_data, int autopartition, int broadcasthead,
+                void *user_pointer, p4est_connectivity_t ** connectivity)
+{
+  return p4est_load_info (filename, mpicomm, data_size, load_data,
+                          autopartition, broadcasthead, sc_MPI_INFO_NULL,
+                          user_pointer, connectivity);
+}
+
 #ifdef P4EST_ENABLE_MPIIO
 
+/** Extend a byte buffer to the first \a bytes of a file.
+ * This function is collective and must be called with identical \a bytes.
+ */
+static void
+p4est_load_mpi_head (MPI_File mpifile, sc_array_t * head, size_t bytes)
+{
+  int                 mpiret;
+  int                 count;
+  size_t              done, chunk;
+  MPI_Status          mpistatus;
+
+  P4EST_ASSERT (head->elem_size == 1 && head->elem_count <= bytes);
+  done = head->elem_count;
+  sc_array_resize (head, bytes);
+  for (; done < bytes; done += chunk) {
+    chunk = SC_MIN (bytes - done, (size_t) INT_MAX);
+    mpiret = MPI_File_read_at_all (mpifile, (MPI_Offset) done,
+                                   head->array + done, (int) chunk,
+                                   MPI_BYTE, &mpistatus);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Get_count (&mpistatus, MPI_BYTE, &count);
+    SC_CHECK_MPI (mpiret);
+    SC_CHECK_ABORT (count == (int) chunk, "read file header");
+  }
+}
+
 static p4est_t     *
 p4est_load_mpi (const char *filename, sc_MPI_Comm mpicomm, size_t data_size,
                 int load_data, int autopartition, int broadcasthead,
-                void *user_pointer, p4est_connectivity_t ** connectivity)
+                sc_MPI_Info info, void *user_pointer,
+                p4est_connectivity_t ** connectivity)
 {
   const int           headc = 6;
   const int           align = 32;
@@ -3719,10 +7398,11 @@ p4est_load_mpi (const char *filename, sc_MPI_Comm mpicomm, size_t data_size,
   p4est_connectivity_t *conn;
   p4est_t            *p4est;
   sc_io_source_t     *src;
-  sc_array_t         *qarr, *darr;
+  sc_array_t         *qarr, *darr, *head;
   char               *dap, *lbuf, *lptr;
   MPI_File            mpifile;
   MPI_Offset          mpiofs;
+  MPI_Datatype        filetype;
 
   /* retrieve MPI information */
   mpiret = sc_MPI_Comm_size (mpicomm, &num_procs);
@@ -3731,7 +7411,7 @@ p4est_load_mpi (const char *filename, sc_MPI_Comm mpicomm, size_t data_size,
   SC_CHECK_MPI (mpiret);
 
   src = NULL;
-  broadcasthead = 1;
+  head = NULL;
   if (broadcasthead) {
     /* We load the header of the file, including the connectivity,
        on the root process using standard file I/O and MPI_Bcast it. */
@@ -3745,12 +7425,37 @@ p4est_load_mpi (const char *filename, sc_MPI_Comm mpicomm, size_t data_size,
   }
   else {
     /* We read the whole file using MPI I/O. */
-    /* Not implemented since there is currently no function to
-       load the connectivity from a file using MPI I/O. */
+    /* Every process reads the header, including the connectivity, by
+       collective calls into memory and parses it from there. */
 
-    SC_ABORT_NOT_REACHED ();
+    mpiret = MPI_File_open (mpicomm, (char *) filename,
+                            MPI_MODE_RDONLY, info, &mpifile);
+    SC_CHECK_MPI (mpiret);
+    head = sc_array_new (1);
+    p4est_load_mpi_head (mpifile, head, P4EST_CONNECTIVITY_HEADER_BYTES);
+    conn_bytes = p4est_connectivity_sink_bytes (head->array);
+    SC_CHECK_ABORT (conn_bytes > 0, "connectivity header");
+    conn_bytes += (align - conn_bytes % align) % align;
+
+    /* the first part of the forest header gives the size of the rest */
+    p4est_load_mpi_head (mpifile, head,
+                         conn_bytes + headc * sizeof (uint64_t));
+    memcpy (&u64int, head->array + conn_bytes, sizeof (uint64_t));
+    SC_CHECK_ABORT (u64int == P4EST_ONDISK_FORMAT, "invalid format");
+    memcpy (&u64int, head->array + conn_bytes + 5 * sizeof (uint64_t),
+            sizeof (uint64_t));
+    head_count = (size_t) headc + (size_t) u64int;
+
+    /* the tree count is the fourth number of the connectivity header */
+    memcpy (&u64int, head->array + 32 + 3 * sizeof (uint64_t),
+            sizeof (uint64_t));
+    head_count += (size_t) u64int;
+    p4est_load_mpi_head (mpifile, head,
+                         conn_bytes + head_count * sizeof (uint64_t));
+    src = sc_io_source_new (SC_IO_TYPE_BUFFER, SC_IO_ENCODE_NONE, head);
+    SC_CHECK_ABORT (src != NULL, "buffer source");
   }
-  P4EST_ASSERT ((rank == root) == (src != NULL));
+  P4EST_ASSERT ((rank == root || !broadcasthead) == (src != NULL));
 
   /* set some parameters */
   P4EST_ASSERT (connectivity != NULL);
@@ -3767,8 +7472,8 @@ p4est_load_mpi (const char *filename, sc_MPI_Comm mpicomm, size_t data_size,
   u64a = P4EST_ALLOC (uint64_t, headc + 1);
   if (!broadcasthead || rank == root) {
 
-    /* read the forest connectivity */
-    conn = p4est_connectivity_source (src);
+    /* read the forest connectivity, validated below if read by all */
+    conn = p4est_connectivity_source_ext (src, !broadcasthead);
     SC_CHECK_ABORT (conn != NULL, "connectivity source");
     zcount = src->bytes_out;
     zpadding = (align - zcount % align) % align;
@@ -3815,6 +7520,11 @@ p4est_load_mpi (const char *filename, sc_MPI_Comm mpicomm, size_t data_size,
       conn_bytes = (size_t) u64a[headc + 0];
     }
   }
+  else {
+    /* each process checks its share of the trees */
+    SC_CHECK_ABORT (p4est_connectivity_is_valid_parallel (conn, mpicomm),
+                    "invalid connectivity");
+  }
   P4EST_ASSERT (save_num_procs >= 0);
   P4EST_ASSERT (save_data_size != (size_t) ULONG_MAX);
   *connectivity = conn;
@@ -3886,14 +7596,18 @@ p4est_load_mpi (const char *filename, sc_MPI_Comm mpicomm, size_t data_size,
     SC_CHECK_ABORT (!retval, "source destroy");
     src = NULL;
   }
+  if (head != NULL) {
+    sc_array_destroy (head);
+    head = NULL;
+  }
 
-  /* open MPI I/O file and seek to beginning of process storage */
-  mpiret = MPI_File_open (mpicomm, (char *) filename,
-                          MPI_MODE_RDONLY, MPI_INFO_NULL, &mpifile);
-  SC_CHECK_MPI (mpiret);
+  /* open MPI I/O file at the beginning of process storage */
+  if (broadcasthead) {
+    mpiret = MPI_File_open (mpicomm, (char *) filename,
+                            MPI_MODE_RDONLY, info, &mpifile);
+    SC_CHECK_MPI (mpiret);
+  }
   mpiofs = (MPI_Offset) (file_offset + zpadding + gfq[rank] * comb_size);
-  mpiret = MPI_File_seek (mpifile, mpiofs, MPI_SEEK_SET);
-  SC_CHECK_MPI (mpiret);
 
   /* read quadrant coordinates and data interleaved */
   qarr =
@@ -3915,18 +7629,19 @@ p4est_load_mpi (const char *filename, sc_MPI_Comm mpicomm, size_t data_size,
     P4EST_ASSERT (data_size == save_data_size && data_size > 0);
     darr = sc_array_new_size (data_size, zcount);
     dap = darr->array;
-    if (!load_in_one) {
-      P4EST_ASSERT (lbuf == NULL);
-      lbuf = P4EST_ALLOC (char, comb_size);
-    }
   }
+
+  /* each process reads its window by one collective call */
+  SC_CHECK_ABORT (comb_size * zcount <= (size_t) INT_MAX, "local read size");
   if (load_in_one) {
     if (save_data_size > 0) {
       P4EST_ASSERT (load_data);
       P4EST_ASSERT (data_size == save_data_size);
       P4EST_ASSERT (lbuf == lptr && lptr != NULL);
-      sc_mpi_read (mpifile, lptr, comb_size * zcount, MPI_BYTE,
-                   "read all local quadrants and data");
+      mpiret = MPI_File_read_at_all (mpifile, mpiofs, lptr,
+                                     (int) (comb_size * zcount), MPI_BYTE,
+                                     MPI_STATUS_IGNORE);
+      SC_CHECK_MPI (mpiret);
       for (zz = 0; zz < zcount; ++zz) {
         memcpy (qap, lptr, qbuf_size);
         qap += P4EST_DIM + 1;
@@ -3937,8 +7652,10 @@ p4est_load_mpi (const char *filename, sc_MPI_Comm mpicomm, size_t data_size,
     }
     else {
       P4EST_ASSERT (comb_size == qbuf_size);
-      sc_mpi_read (mpifile, qap, qbuf_size * zcount, MPI_BYTE,
-                   "read all local quadrants");
+      mpiret = MPI_File_read_at_all (mpifile, mpiofs, qap,
+                                     (int) (qbuf_size * zcount), MPI_BYTE,
+                                     MPI_STATUS_IGNORE);
+      SC_CHECK_MPI (mpiret);
     }
   }
   else {
@@ -3946,21 +7663,24 @@ p4est_load_mpi (const char *filename, sc_MPI_Comm mpicomm, size_t data_size,
     P4EST_ASSERT (save_data_size > 0);
     P4EST_ASSERT (lptr == NULL);
     P4EST_ASSERT (dap == NULL);
-#define P4EST_SEEK_CUR_BROKEN
-    for (zz = 0; zz < zcount; ++zz) {
-      sc_mpi_read (mpifile, qap, qbuf_size, MPI_BYTE, "read quadrant");
-#ifndef P4EST_SEEK_CUR_BROKEN
-      mpiret = MPI_File_seek
-        (mpifile, (MPI_Offset) save_data_size, MPI_SEEK_CUR);
-      SC_CHECK_MPI (mpiret);
-#else
-      /* avoid MPI_SEEK_CUR, which appears to be broken on some systems */
-      mpiofs += comb_size;
-      mpiret = MPI_File_seek (mpifile, mpiofs, MPI_SEEK_SET);
-      SC_CHECK_MPI (mpiret);
-#endif
-      qap += P4EST_DIM + 1;
-    }
+
+    /* the file view skips the data stored after each quadrant */
+    mpiret = MPI_Type_contiguous ((int) qbuf_size, MPI_BYTE, &filetype);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Type_create_resized (filetype, 0, (MPI_Aint) comb_size,
+                                      &filetype);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Type_commit (&filetype);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_File_set_view (mpifile, mpiofs, MPI_BYTE, filetype,
+                                "native", info);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_File_read_at_all (mpifile, 0, qap,
+                                   (int) (qbuf_size * zcount), MPI_BYTE,
+                                   MPI_STATUS_IGNORE);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Type_free (&filetype);
+    SC_CHECK_MPI (mpiret);
   }
   P4EST_FREE (lbuf);
 
@@ -3987,9 +7707,10 @@ p4est_load_mpi (const char *filename, sc_MPI_Comm mpicomm, size_t data_size,
 #endif /* P4EST_ENABLE_MPIIO */
 
 p4est_t            *
-p4est_load_ext (const char *filename, sc_MPI_Comm mpicomm, size_t data_size,
-                int load_data, int autopartition, int broadcasthead,
-                void *user_pointer, p4est_connectivity_t ** connectivity)
+p4est_load_info (const char *filename, sc_MPI_Comm mpicomm,
+                 size_t data_size, int load_data, int autopartition,
+                 int broadcasthead, sc_MPI_Info info, void *user_pointer,
+                 p4est_connectivity_t ** connectivity)
 {
 #ifndef P4EST_ENABLE_MPIIO
   int                 retval;
@@ -4004,7 +7725,7 @@ p4est_load_ext (const char *filename, sc_MPI_Comm mpicomm, size_t data_size,
   /* use MPI I/O functionality */
 
   p4est = p4est_load_mpi (filename, mpicomm, data_size, load_data,
-                          autopartition, broadcasthead, user_pointer,
+                          autopartition, broadcasthead, info, user_pointer,
                           connectivity);
 #else
   /* open file on all processors and rely on file system */
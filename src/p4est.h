@@ -169,6 +169,43 @@ typedef struct p4est
   sc_mempool_t       *quadrant_pool;  /**< memory allocator for temporary
                                            quadrants */
   p4est_inspect_t    *inspect;        /**< algorithmic switches */
+  int                 data_contiguous;  /**< flag if the user data is kept
+                                             in data_array, see
+                                             \ref p4est_set_data_contiguous */
+  char               *data_array;       /**< contiguous user data of the
+                                             local quadrants, data_size bytes
+                                             each, by local quadrant number */
+  p4est_locidx_t      data_array_size;  /**< number of entries allocated in
+                                             data_array */
+  p4est_locidx_t      data_array_used;  /**< number of entries in data_array
+                                             still owned by a quadrant */
+  int8_t             *balance_dirty;    /**< per-tree flags of the trees
+                                             changed by refine or coarsen
+                                             since the last balance; NULL
+                                             unless enabled by \ref
+                                             p4est_set_balance_incremental */
+  p4est_connect_type_t balance_type;    /**< balance that holds for the trees
+                                             not flagged in balance_dirty */
+  long                balance_revision; /**< revision after the last
+                                             balance */
+  int8_t             *valid_dirty;      /**< per-tree flags of the trees
+                                             changed by refine or coarsen
+                                             since the last validation; NULL
+                                             unless enabled by \ref
+                                             p4est_set_valid_incremental */
+  long                valid_revision;   /**< revision up to which the
+                                             changes are flagged in
+                                             valid_dirty */
+  struct p4est_shared_quadrants *shared_quadrants; /**< NULL unless the
+                                             local quadrant arrays are
+                                             shared with another forest, see
+                                             \ref p4est_copy_shared */
+  struct p4est_scratch *scratch;         /**< temporary arrays kept between
+                                             calls to the algorithms, see
+                                             \ref p4est_scratch_array_new */
+  struct p4est_data_cache *data_cache;   /**< per-thread free lists in
+                                             front of user_data_pool, see
+                                             \ref p4est_quadrant_data_cache_prepare */
 }
 p4est_t;
 
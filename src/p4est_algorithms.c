@@ -47,6 +47,20 @@
 #include <winsock2.h>
 #endif
 
+/** Number of border quadrants tested for descent at a time. */
+#define P4EST_BALANCE_BATCH 16
+
+/** Number of user data entries moved between a thread cache and the pool. */
+#define P4EST_DATA_CACHE_BATCH 64
+
+/** Free user data entries kept by each thread, see
+ * \ref p4est_quadrant_data_cache_prepare. */
+struct p4est_data_cache
+{
+  int                 num_threads;
+  sc_array_t         *lists;    /**< Pointers to free pool entries */
+};
+
 #ifndef P4_TO_P8
 
 #if 0                           /* currently unused */
@@ -85,14 +99,113 @@ p4est_quadrant_mempool_new (void)
   return sc_mempool_new_zero_and_persist (sizeof (p4est_quadrant_t));
 }
 
+/** Check whether a user data pointer refers into the contiguous array. */
+static int
+p4est_data_in_array (p4est_t * p4est, const void *data)
+{
+  const char         *pos = (const char *) data;
+
+  return p4est->data_array != NULL && pos >= p4est->data_array &&
+    pos < p4est->data_array + p4est->data_size * p4est->data_array_size;
+}
+
+/** Return the cache of the calling thread, or NULL outside of the
+ * parallel regions and for threads without a cache. */
+static sc_array_t  *
+p4est_data_cache_list (p4est_t * p4est)
+{
+  int                 thread_num;
+  struct p4est_data_cache *cache = p4est->data_cache;
+
+  if (cache == NULL || !p4est_in_parallel_region ()) {
+    return NULL;
+  }
+  thread_num = p4est_get_thread_num ();
+  return thread_num < cache->num_threads ? cache->lists + thread_num : NULL;
+}
+
+void
+p4est_quadrant_data_cache_prepare (p4est_t * p4est)
+{
+  int                 i;
+  int                 num_threads;
+  struct p4est_data_cache *cache = p4est->data_cache;
+
+  num_threads = p4est_get_num_threads ();
+  if (p4est->data_size == 0 || num_threads <= 1 ||
+      p4est_in_parallel_region ()) {
+    return;
+  }
+  if (cache == NULL) {
+    cache = p4est->data_cache = P4EST_ALLOC_ZERO (struct p4est_data_cache, 1);
+  }
+  if (cache->num_threads < num_threads) {
+    cache->lists = P4EST_REALLOC (cache->lists, sc_array_t, num_threads);
+    for (i = cache->num_threads; i < num_threads; ++i) {
+      sc_array_init_size (cache->lists + i, sizeof (void *),
+                          2 * P4EST_DATA_CACHE_BATCH);
+      sc_array_truncate (cache->lists + i);
+    }
+    cache->num_threads = num_threads;
+  }
+}
+
+void
+p4est_quadrant_data_cache_flush (p4est_t * p4est)
+{
+  int                 i;
+  size_t              zz;
+  sc_array_t         *list;
+  struct p4est_data_cache *cache = p4est->data_cache;
+
+  P4EST_ASSERT (!p4est_in_parallel_region ());
+
+  if (cache == NULL) {
+    return;
+  }
+  for (i = 0; i < cache->num_threads; ++i) {
+    list = cache->lists + i;
+    for (zz = 0; zz < list->elem_count; ++zz) {
+      sc_mempool_free (p4est->user_data_pool,
+                       *(void **) sc_array_index (list, zz));
+    }
+    sc_array_reset (list);
+  }
+  P4EST_FREE (cache->lists);
+  P4EST_FREE (cache);
+  p4est->data_cache = NULL;
+}
+
 void
 p4est_quadrant_init_data (p4est_t * p4est, p4est_topidx_t which_tree,
                           p4est_quadrant_t * quad, p4est_init_t init_fn)
 {
+  int                 i;
+  sc_array_t         *list;
+
   P4EST_ASSERT (p4est_quadrant_is_extended (quad));
 
   if (p4est->data_size > 0) {
-    quad->p.user_data = sc_mempool_alloc (p4est->user_data_pool);
+    list = p4est_data_cache_list (p4est);
+    if (list == NULL) {
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (p4est_user_data_pool)
+#endif
+      quad->p.user_data = sc_mempool_alloc (p4est->user_data_pool);
+    }
+    else {
+      if (list->elem_count == 0) {
+        /* refill the cache of this thread with one lock */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (p4est_user_data_pool)
+#endif
+        for (i = 0; i < P4EST_DATA_CACHE_BATCH; ++i) {
+          *(void **) sc_array_push (list) =
+            sc_mempool_alloc (p4est->user_data_pool);
+        }
+      }
+      quad->p.user_data = *(void **) sc_array_pop (list);
+    }
   }
   else {
     quad->p.user_data = NULL;
@@ -105,14 +218,196 @@ p4est_quadrant_init_data (p4est_t * p4est, p4est_topidx_t which_tree,
 void
 p4est_quadrant_free_data (p4est_t * p4est, p4est_quadrant_t * quad)
 {
+  int                 i;
+  sc_array_t         *list;
+
   P4EST_ASSERT (p4est_quadrant_is_extended (quad));
 
   if (p4est->data_size > 0) {
-    sc_mempool_free (p4est->user_data_pool, quad->p.user_data);
+    list = p4est_data_cache_list (p4est);
+    if (list != NULL && !p4est_data_in_array (p4est, quad->p.user_data)) {
+      *(void **) sc_array_push (list) = quad->p.user_data;
+      if (list->elem_count >= 2 * P4EST_DATA_CACHE_BATCH) {
+        /* return the surplus of this thread with one lock */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (p4est_user_data_pool)
+#endif
+        for (i = 0; i < P4EST_DATA_CACHE_BATCH; ++i) {
+          sc_mempool_free (p4est->user_data_pool,
+                           *(void **) sc_array_pop (list));
+        }
+      }
+    }
+    else {
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (p4est_user_data_pool)
+#endif
+      {
+        if (p4est_data_in_array (p4est, quad->p.user_data)) {
+          /* the entry is released with the array by p4est_compact_data */
+          P4EST_ASSERT (p4est->data_array_used > 0);
+          --p4est->data_array_used;
+        }
+        else {
+          sc_mempool_free (p4est->user_data_pool, quad->p.user_data);
+        }
+      }
+    }
   }
   quad->p.user_data = NULL;
 }
 
+size_t
+p4est_quadrant_data_count (p4est_t * p4est)
+{
+  int                 i;
+  size_t              count;
+
+  if (p4est->user_data_pool == NULL) {
+    return 0;
+  }
+  count = p4est->user_data_pool->elem_count +
+    (size_t) p4est->data_array_used;
+
+  /* the entries kept by the thread caches are free */
+  if (p4est->data_cache != NULL) {
+    for (i = 0; i < p4est->data_cache->num_threads; ++i) {
+      count -= p4est->data_cache->lists[i].elem_count;
+    }
+  }
+  return count;
+}
+
+void
+p4est_compact_data (p4est_t * p4est)
+{
+  const size_t        data_size = p4est->data_size;
+  char               *array, *pos;
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+
+  if (!p4est->data_contiguous) {
+    return;
+  }
+  P4EST_ASSERT (!p4est_in_parallel_region ());
+  p4est_quadrant_data_cache_flush (p4est);
+
+  array = NULL;
+  if (data_size > 0 && p4est->local_num_quadrants > 0) {
+    array = P4EST_ALLOC (char, data_size * p4est->local_num_quadrants);
+  }
+
+  /* copy the data of local quadrants in order and free pool entries */
+  pos = array;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      if (data_size > 0) {
+        memcpy (pos, q->p.user_data, data_size);
+        if (!p4est_data_in_array (p4est, q->p.user_data)) {
+          sc_mempool_free (p4est->user_data_pool, q->p.user_data);
+        }
+        q->p.user_data = pos;
+        pos += data_size;
+      }
+    }
+  }
+  P4EST_ASSERT (pos == array + (array == NULL ? 0 :
+                                data_size * p4est->local_num_quadrants));
+
+  P4EST_FREE (p4est->data_array);
+  p4est->data_array = array;
+  p4est->data_array_size = p4est->data_array_used =
+    (data_size > 0) ? p4est->local_num_quadrants : 0;
+  P4EST_ASSERT (p4est->user_data_pool == NULL ||
+                p4est->user_data_pool->elem_count == 0);
+}
+
+void
+p4est_replace_quadrants (p4est_t * p4est,
+                         const p4est_quadrant_t * quadrants,
+                         const char *data, p4est_locidx_t num_quadrants)
+{
+  const p4est_topidx_t num_trees = p4est->connectivity->num_trees;
+  const size_t        data_size = p4est->data_size;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      kl, offset;
+  size_t              zz;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+
+  P4EST_ASSERT (num_quadrants >= 0);
+
+  /* drop the local quadrants and their user data */
+  p4est_unshare_quadrants (p4est);
+  p4est_quadrant_data_cache_flush (p4est);
+  if (p4est->user_data_pool != NULL) {
+    sc_mempool_truncate (p4est->user_data_pool);
+  }
+  p4est->data_array_used = 0;
+  for (jt = 0; jt < num_trees; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    sc_array_reset (&tree->quadrants);
+  }
+
+  /* sort the new quadrants into their trees */
+  p4est->first_local_tree = -1;
+  p4est->last_local_tree = -2;
+  for (kl = 0; kl < num_quadrants; ++kl) {
+    jt = quadrants[kl].p.which_tree;
+    P4EST_ASSERT (0 <= jt && jt < num_trees);
+    P4EST_ASSERT (p4est->last_local_tree <= jt);
+    if (p4est->first_local_tree < 0) {
+      p4est->first_local_tree = jt;
+    }
+    p4est->last_local_tree = jt;
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    q = p4est_quadrant_array_push (&tree->quadrants);
+    *q = quadrants[kl];
+    if (data_size > 0) {
+      q->p.user_data = sc_mempool_alloc (p4est->user_data_pool);
+      if (data != NULL) {
+        memcpy (q->p.user_data, data + kl * data_size, data_size);
+      }
+    }
+    else {
+      q->p.user_data = NULL;
+    }
+  }
+
+  /* recompute the bookkeeping of every tree */
+  offset = 0;
+  for (jt = 0; jt < num_trees; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    tree->quadrants_offset = offset;
+    P4EST_QUADRANT_INIT (&tree->first_desc);
+    P4EST_QUADRANT_INIT (&tree->last_desc);
+    memset (tree->quadrants_per_level, 0,
+            (P4EST_QMAXLEVEL + 1) * sizeof (p4est_locidx_t));
+    tree->maxlevel = 0;
+    if (tree->quadrants.elem_count == 0) {
+      continue;
+    }
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      ++tree->quadrants_per_level[q->level];
+      tree->maxlevel = (int8_t) SC_MAX (tree->maxlevel, q->level);
+    }
+    q = p4est_quadrant_array_index (&tree->quadrants, 0);
+    p4est_quadrant_first_descendant (q, &tree->first_desc, P4EST_QMAXLEVEL);
+    q = p4est_quadrant_array_index (&tree->quadrants,
+                                    tree->quadrants.elem_count - 1);
+    p4est_quadrant_last_descendant (q, &tree->last_desc, P4EST_QMAXLEVEL);
+    offset += (p4est_locidx_t) tree->quadrants.elem_count;
+  }
+  P4EST_ASSERT (offset == num_quadrants);
+  p4est->local_num_quadrants = num_quadrants;
+  p4est_compact_data (p4est);
+}
+
 unsigned
 p4est_quadrant_checksum (sc_array_t * quadrants,
                          sc_array_t * checkarray, size_t first_quadrant)
@@ -356,6 +651,53 @@ p4est_tree_is_complete (p4est_tree_t * tree)
   return 1;
 }
 
+/** Sort key of a leaf in \ref p4est_tree_hilbert_order. */
+typedef struct p4est_hilbert_key
+{
+  uint64_t            key;
+  p4est_locidx_t      index;
+}
+p4est_hilbert_key_t;
+
+static int
+p4est_hilbert_key_compare (const void *v1, const void *v2)
+{
+  const p4est_hilbert_key_t *k1 = (const p4est_hilbert_key_t *) v1;
+  const p4est_hilbert_key_t *k2 = (const p4est_hilbert_key_t *) v2;
+
+  return k1->key < k2->key ? -1 : k1->key > k2->key ? 1 : 0;
+}
+
+void
+p4est_tree_hilbert_order (p4est_tree_t * tree, p4est_locidx_t * perm)
+{
+  size_t              iz;
+  sc_array_t         *tquadrants = &tree->quadrants;
+  sc_array_t          keys;
+  p4est_quadrant_t   *q;
+  p4est_hilbert_key_t *k;
+
+  P4EST_ASSERT (p4est_tree_is_linear (tree));
+
+  /* leaves do not overlap, so the index of their first cell is unique */
+  sc_array_init_size (&keys, sizeof (p4est_hilbert_key_t),
+                      tquadrants->elem_count);
+  for (iz = 0; iz < tquadrants->elem_count; ++iz) {
+    q = p4est_quadrant_array_index (tquadrants, iz);
+    k = (p4est_hilbert_key_t *) sc_array_index (&keys, iz);
+    k->key = p4est_quadrant_hilbert_id (q, q->level)
+      << P4EST_DIM * (P4EST_QMAXLEVEL - q->level);
+    k->index = (p4est_locidx_t) iz;
+  }
+  sc_array_sort (&keys, p4est_hilbert_key_compare);
+
+  for (iz = 0; iz < tquadrants->elem_count; ++iz) {
+    k = (p4est_hilbert_key_t *) sc_array_index (&keys, iz);
+    perm[iz] = k->index;
+  }
+  sc_array_reset (&keys);
+}
+
 void
 p4est_tree_print (int log_priority, p4est_tree_t * tree)
 {
@@ -766,6 +1108,198 @@ failtest:
   return !p4est_comm_sync_flag (p4est, failed, sc_MPI_BOR);
 }
 
+/** Check the counters and first and last descendants of all trees.
+ * This costs a few operations per tree and does not communicate.
+ * \return True if the check fails.
+ */
+static int
+p4est_valid_structure_failed (p4est_t * p4est)
+{
+  int                 i, maxlevel;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      lquadrants, nquadrants;
+  p4est_quadrant_t    s;
+  p4est_quadrant_t   *q;
+  p4est_tree_t       *tree;
+
+  if (p4est->global_first_quadrant[p4est->mpirank + 1] -
+      p4est->global_first_quadrant[p4est->mpirank] !=
+      (p4est_gloidx_t) p4est->local_num_quadrants) {
+    P4EST_NOTICE ("p4est invalid global quadrant index\n");
+    return 1;
+  }
+  lquadrants = 0;
+  for (jt = 0; jt < (p4est_topidx_t) p4est->trees->elem_count; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    if (tree->quadrants_offset != lquadrants) {
+      P4EST_NOTICE ("p4est invalid quadrants offset\n");
+      return 1;
+    }
+    maxlevel = 0;
+    nquadrants = 0;
+    for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
+      if (tree->quadrants_per_level[i] < 0) {
+        P4EST_NOTICE ("p4est invalid tree level\n");
+        return 1;
+      }
+      nquadrants += tree->quadrants_per_level[i];
+      if (tree->quadrants_per_level[i] > 0) {
+        maxlevel = i;
+      }
+    }
+    if (maxlevel != (int) tree->maxlevel ||
+        nquadrants != (p4est_locidx_t) tree->quadrants.elem_count) {
+      P4EST_NOTICE ("p4est invalid tree quadrant count\n");
+      return 1;
+    }
+    lquadrants += nquadrants;
+    if (nquadrants == 0) {
+      continue;
+    }
+    if (jt < p4est->first_local_tree || jt > p4est->last_local_tree) {
+      P4EST_NOTICE ("p4est invalid outside count\n");
+      return 1;
+    }
+    q = p4est_quadrant_array_index (&tree->quadrants, 0);
+    p4est_quadrant_first_descendant (q, &s, P4EST_QMAXLEVEL);
+    if (!p4est_quadrant_is_equal (&s, &tree->first_desc)) {
+      P4EST_NOTICE ("p4est invalid first tree descendant\n");
+      return 1;
+    }
+    q = p4est_quadrant_array_index (&tree->quadrants,
+                                    tree->quadrants.elem_count - 1);
+    p4est_quadrant_last_descendant (q, &s, P4EST_QMAXLEVEL);
+    if (!p4est_quadrant_is_equal (&s, &tree->last_desc)) {
+      P4EST_NOTICE ("p4est invalid last tree descendant\n");
+      return 1;
+    }
+  }
+  if (lquadrants != p4est->local_num_quadrants) {
+    P4EST_NOTICE ("p4est invalid local quadrant count\n");
+    return 1;
+  }
+  return 0;
+}
+
+/** Check a random sample of the local quadrants against their successors.
+ * \return True if the check fails.
+ */
+static int
+p4est_valid_sample_failed (p4est_t * p4est, double sample_rate)
+{
+  const p4est_locidx_t n = p4est->local_num_quadrants;
+  p4est_locidx_t      k, num_samples, lid;
+  p4est_topidx_t      lo, hi, mid;
+  sc_rand_state_t     rstate;
+  p4est_quadrant_t   *q, *r;
+  p4est_tree_t       *tree;
+
+  if (n == 0 || sample_rate <= 0.) {
+    return 0;
+  }
+  num_samples = (p4est_locidx_t) ceil (SC_MIN (sample_rate, 1.) * n);
+
+  /* the sample is reproducible and changes with the revision */
+  rstate = (sc_rand_state_t) p4est->revision * p4est->mpisize +
+    p4est->mpirank;
+  for (k = 0; k < num_samples; ++k) {
+    if (num_samples < n) {
+      lid = (p4est_locidx_t) (sc_rand (&rstate) * n);
+      lid = SC_MIN (lid, n - 1);
+    }
+    else {
+      /* a rate of one visits every quadrant */
+      lid = k;
+    }
+
+    /* find the tree of the local quadrant by bisection */
+    lo = p4est->first_local_tree;
+    hi = p4est->last_local_tree;
+    while (lo < hi) {
+      mid = lo + (hi - lo + 1) / 2;
+      tree = p4est_tree_array_index (p4est->trees, mid);
+      if (tree->quadrants_offset <= lid) {
+        lo = mid;
+      }
+      else {
+        hi = mid - 1;
+      }
+    }
+    tree = p4est_tree_array_index (p4est->trees, lo);
+    lid -= tree->quadrants_offset;
+    P4EST_ASSERT (0 <= lid && (size_t) lid < tree->quadrants.elem_count);
+    q = p4est_quadrant_array_index (&tree->quadrants, (size_t) lid);
+    if (!p4est_quadrant_is_valid (q) || q->level > tree->maxlevel) {
+      P4EST_NOTICE ("p4est invalid sampled quadrant\n");
+      return 1;
+    }
+    if ((size_t) lid + 1 < tree->quadrants.elem_count) {
+      r = p4est_quadrant_array_index (&tree->quadrants, (size_t) lid + 1);
+      if (!p4est_quadrant_is_next (q, r)) {
+        P4EST_NOTICE ("p4est invalid sampled successor\n");
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+int
+p4est_is_valid_ext (p4est_t * p4est, p4est_valid_check_t check,
+                    double sample_rate)
+{
+  int                 failed, all;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+
+  P4EST_ASSERT (p4est != NULL && p4est->connectivity != NULL);
+
+  if (check == P4EST_VALID_FULL) {
+    if (!p4est_is_valid (p4est)) {
+      return 0;
+    }
+  }
+  else {
+    failed = p4est_valid_structure_failed (p4est);
+    if (!failed && check == P4EST_VALID_SAMPLED) {
+      failed = p4est_valid_sample_failed (p4est, sample_rate);
+    }
+    else if (!failed) {
+      P4EST_ASSERT (check == P4EST_VALID_CHANGED);
+
+      /* changes not flagged since the last validation may be anywhere */
+      all = p4est->valid_dirty == NULL ||
+        p4est->valid_revision != p4est->revision;
+      for (jt = p4est->first_local_tree;
+           !failed && jt <= p4est->last_local_tree; ++jt) {
+        if (!all && !p4est->valid_dirty[jt]) {
+          continue;
+        }
+        tree = p4est_tree_array_index (p4est->trees, jt);
+        if (!p4est_tree_is_complete (tree)) {
+          P4EST_NOTICE ("p4est invalid not complete\n");
+          failed = 1;
+        }
+      }
+    }
+    if (p4est_comm_sync_flag (p4est, failed, sc_MPI_BOR)) {
+      return 0;
+    }
+    if (check == P4EST_VALID_SAMPLED) {
+      /* the sample does not cover the changed trees */
+      return 1;
+    }
+  }
+
+  /* the forest is known to be valid as of its current revision */
+  if (p4est->valid_dirty != NULL) {
+    memset (p4est->valid_dirty, 0,
+            (size_t) p4est->connectivity->num_trees);
+    p4est->valid_revision = p4est->revision;
+  }
+  return 1;
+}
+
 /* here come the heavyweight algorithms */
 #ifndef P4_TO_P8
 /* which face of the center quad touches this insul */
@@ -806,6 +1340,164 @@ p4est_output_array_push_data (sc_array_t * out, const p4est_quadrant_t * src,
   /* *INDENT-ON* */
 }
 
+/** Compute an insulation quadrant and the range of its descendants.
+ * \param [in] which    Position in the insulation layer of \a inq.
+ * \return              True if \a s lies inside the root and its range
+ *                      overlaps the one from \a treefd to \a treeld.
+ */
+static int
+p4est_overlap_insulation (const p4est_quadrant_t * inq, int which,
+                          const p4est_quadrant_t * treefd,
+                          const p4est_quadrant_t * treeld,
+                          p4est_quadrant_t * s, p4est_quadrant_t * fd,
+                          p4est_quadrant_t * ld)
+{
+  const p4est_qcoord_t qh = P4EST_QUADRANT_LEN (inq->level);
+
+  *s = *inq;
+  s->x += (which % 3 - 1) * qh;
+  s->y += ((which / 3) % 3 - 1) * qh;
+#ifdef P4_TO_P8
+  s->z += (which / 9 - 1) * qh;
+#endif
+  if ((s->x < 0 || s->x >= P4EST_ROOT_LEN) ||
+      (s->y < 0 || s->y >= P4EST_ROOT_LEN) ||
+#ifdef P4_TO_P8
+      (s->z < 0 || s->z >= P4EST_ROOT_LEN) ||
+#endif
+      0) {
+    /* this quadrant is outside this tree, no overlap */
+    return 0;
+  }
+  p4est_quadrant_first_descendant (s, fd, P4EST_QMAXLEVEL);
+  p4est_quadrant_last_descendant (s, ld, P4EST_QMAXLEVEL);
+
+  /* there is no overlap if the ranges are disjoint */
+  return !(p4est_quadrant_compare (ld, treefd) < 0 ||
+           p4est_quadrant_compare (treeld, fd) < 0);
+}
+
+/** A search key for the batched overlap computation. */
+typedef struct p4est_overlap_query
+{
+  p4est_quadrant_t    key;      /**< must be first for sorting */
+  size_t              slot;     /**< where to store the result */
+}
+p4est_overlap_query_t;
+
+/** Answer sorted queries by one merge walk through a sorted array.
+ * The position in the array is advanced by galloping, so that few queries
+ * against a long array cost about as much as binary searches.
+ * \param [in] lower    If true, find the first array quadrant >= key,
+ *                      otherwise the last array quadrant <= key.
+ * \param [out] bounds  The index found, or -1, is stored at each slot.
+ */
+static void
+p4est_overlap_merge (sc_array_t * tquadrants, sc_array_t * queries,
+                     int lower, ssize_t * bounds)
+{
+  const int           limit = lower ? 0 : 1;
+  size_t              iz, pos, lo, hi, mid, step;
+  size_t              count = tquadrants->elem_count;
+  p4est_overlap_query_t *query;
+
+  /* pos is the first array index not before the current key */
+  pos = 0;
+  for (iz = 0; iz < queries->elem_count; ++iz) {
+    query = (p4est_overlap_query_t *) sc_array_index (queries, iz);
+    if (pos < count &&
+        p4est_quadrant_compare (p4est_quadrant_array_index (tquadrants, pos),
+                                &query->key) < limit) {
+      lo = pos;
+      step = 1;
+      while (lo + step < count &&
+             p4est_quadrant_compare (p4est_quadrant_array_index
+                                     (tquadrants, lo + step),
+                                     &query->key) < limit) {
+        lo += step;
+        step *= 2;
+      }
+      hi = SC_MIN (lo + step, count);
+      while (hi - lo > 1) {
+        mid = lo + (hi - lo) / 2;
+        if (p4est_quadrant_compare (p4est_quadrant_array_index
+                                    (tquadrants, mid), &query->key) < limit) {
+          lo = mid;
+        }
+        else {
+          hi = mid;
+        }
+      }
+      pos = hi;
+    }
+    if (lower) {
+      bounds[query->slot] = pos < count ? (ssize_t) pos : -1;
+    }
+    else {
+      bounds[query->slot] = (ssize_t) pos - 1;
+    }
+  }
+}
+
+/** Search the tree ranges of all insulation quadrants of a run of incoming
+ * quadrants at once.  The queries are sorted and merged with the tree.
+ * \param [in] in           Incoming quadrants from \a first to \a last
+ *                          exclusive, all in the same tree.
+ * \param [in,out] lowq     Workspace for the lower bound queries.
+ * \param [in,out] highq    Workspace for the higher bound queries.
+ * \param [out] bounds      Resized to two entries per insulation quadrant.
+ *                          Entries are set for the quadrants that
+ *                          overlap the tree and need a search.
+ */
+static void
+p4est_overlap_bounds (sc_array_t * in, size_t first, size_t last,
+                      sc_array_t * tquadrants,
+                      const p4est_quadrant_t * treefd,
+                      const p4est_quadrant_t * treeld,
+                      sc_array_t * lowq, sc_array_t * highq,
+                      sc_array_t * bounds)
+{
+  int                 which;
+  size_t              iz, slot;
+  p4est_quadrant_t    s, fd, ld;
+  p4est_quadrant_t   *inq;
+  p4est_overlap_query_t *query;
+
+  P4EST_QUADRANT_INIT (&s);
+  P4EST_QUADRANT_INIT (&fd);
+  P4EST_QUADRANT_INIT (&ld);
+
+  sc_array_truncate (lowq);
+  sc_array_truncate (highq);
+  sc_array_resize (bounds, (last - first) * P4EST_INSUL * 2);
+  for (iz = first; iz < last; ++iz) {
+    inq = p4est_quadrant_array_index (in, iz);
+    for (which = 0; which < P4EST_INSUL; ++which) {
+      if (which == P4EST_INSUL / 2 ||
+          !p4est_overlap_insulation (inq, which, treefd, treeld,
+                                     &s, &fd, &ld)) {
+        continue;
+      }
+      slot = ((iz - first) * P4EST_INSUL + which) * 2;
+      if (p4est_quadrant_compare (treeld, &ld) > 0) {
+        query = (p4est_overlap_query_t *) sc_array_push (highq);
+        query->key = ld;
+        query->slot = slot + 1;
+      }
+      if (p4est_quadrant_compare (&fd, treefd) >= 0) {
+        query = (p4est_overlap_query_t *) sc_array_push (lowq);
+        query->key = s;
+        query->slot = slot;
+      }
+    }
+  }
+
+  sc_array_sort (lowq, p4est_quadrant_compare);
+  sc_array_sort (highq, p4est_quadrant_compare);
+  p4est_overlap_merge (tquadrants, lowq, 1, (ssize_t *) bounds->array);
+  p4est_overlap_merge (tquadrants, highq, 0, (ssize_t *) bounds->array);
+}
+
 void
 p4est_tree_compute_overlap (p4est_t * p4est, sc_array_t * in,
                             sc_array_t * out, p4est_connect_type_t balance,
@@ -820,10 +1512,9 @@ p4est_tree_compute_overlap (p4est_t * p4est, sc_array_t * in,
   int                 inter_tree, outface[P4EST_FACES];
   size_t              iz, jz, kz, ctree;
   size_t              treecount, incount, seedcount;
-  size_t              guess, split;
+  size_t              guess, split, runstart, runend, slot;
   ssize_t             first_index, last_index, js;
   p4est_topidx_t      qtree, ntree, first_tree, ftree = -1;
-  p4est_qcoord_t      qh;
   p4est_quadrant_t    fd, ld, tempq, ins[P4EST_INSUL];
   p4est_quadrant_t   *treefd, *treeld;
   p4est_quadrant_t   *tq, *s, *u;
@@ -844,8 +1535,11 @@ p4est_tree_compute_overlap (p4est_t * p4est, sc_array_t * in,
   sc_array_t         *cta;
   sc_array_t         *tquadrants;
   sc_array_t         *seeds = NULL;
+  sc_array_t         *splits;
+  sc_array_t         *lowq, *highq, *bounds;
   p4est_quadrant_t   *neigharray[P4EST_CHILDREN];
   size_t              nneigh = -1;
+  int8_t             *split_flags;
 
   P4EST_QUADRANT_INIT (&fd);
   P4EST_QUADRANT_INIT (&ld);
@@ -875,8 +1569,18 @@ p4est_tree_compute_overlap (p4est_t * p4est, sc_array_t * in,
   treecount = -1;
 
   seeds = sc_array_new (sizeof (p4est_quadrant_t));
+  splits = sc_array_new (sizeof (int8_t));
   first_tree = p4est->first_local_tree;
 
+  /* optionally search the tree for all insulation quadrants at once */
+  lowq = highq = bounds = NULL;
+  runstart = 0;
+  if (p4est->inspect != NULL && p4est->inspect->use_overlap_merge) {
+    lowq = p4est_scratch_array_new (p4est, sizeof (p4est_overlap_query_t));
+    highq = p4est_scratch_array_new (p4est, sizeof (p4est_overlap_query_t));
+    bounds = p4est_scratch_array_new (p4est, sizeof (ssize_t));
+  }
+
   /* loop over input list of quadrants */
   for (iz = 0; iz < incount; ++iz) {
     inq = p4est_quadrant_array_index (in, iz);
@@ -903,6 +1607,19 @@ p4est_tree_compute_overlap (p4est_t * p4est, sc_array_t * in,
       }
       treecount = tquadrants->elem_count;
       P4EST_ASSERT (treecount > 0);
+
+      if (bounds != NULL) {
+        /* answer the searches of all quadrants in this tree */
+        runstart = iz;
+        for (runend = iz + 1; runend < incount; ++runend) {
+          if (p4est_quadrant_array_index (in, runend)->p.piggy2.which_tree
+              != qtree) {
+            break;
+          }
+        }
+        p4est_overlap_bounds (in, runstart, runend, tquadrants,
+                              treefd, treeld, lowq, highq, bounds);
+      }
     }
 
     inter_tree = 0;
@@ -985,8 +1702,6 @@ p4est_tree_compute_overlap (p4est_t * p4est, sc_array_t * in,
         P4EST_ASSERT (ci.corner_transforms.elem_count > 0);
       }
     }
-    qh = P4EST_QUADRANT_LEN (inq->level);
-
     /* loop over the insulation layer of inq */
 #ifdef P4_TO_P8
     for (m = 0; m < 3; ++m) {
@@ -1004,30 +1719,14 @@ p4est_tree_compute_overlap (p4est_t * p4est, sc_array_t * in,
         if (which == P4EST_INSUL / 2) {
           continue;
         }
-        s = &ins[which];
-        *s = *inq;
-        s->x += (l - 1) * qh;
-        s->y += (k - 1) * qh;
-#ifdef P4_TO_P8
-        s->z += (m - 1) * qh;
-#endif
-        if ((s->x < 0 || s->x >= P4EST_ROOT_LEN) ||
-            (s->y < 0 || s->y >= P4EST_ROOT_LEN) ||
-#ifdef P4_TO_P8
-            (s->z < 0 || s->z >= P4EST_ROOT_LEN) ||
-#endif
-            0) {
-          /* this quadrant is outside this tree, no overlap */
-          continue;
-        }
-        p4est_quadrant_first_descendant (s, &fd, P4EST_QMAXLEVEL);
-        p4est_quadrant_last_descendant (s, &ld, P4EST_QMAXLEVEL);
 
         /* skip this insulation quadrant if there is no overlap */
-        if (p4est_quadrant_compare (&ld, treefd) < 0 ||
-            p4est_quadrant_compare (treeld, &fd) < 0) {
+        s = &ins[which];
+        if (!p4est_overlap_insulation (inq, which, treefd, treeld,
+                                       s, &fd, &ld)) {
           continue;
         }
+        slot = ((iz - runstart) * P4EST_INSUL + which) * 2;
 
         /* Find last quadrant in tree <= ld */
         guess = treecount / 2;
@@ -1037,7 +1736,9 @@ p4est_tree_compute_overlap (p4est_t * p4est, sc_array_t * in,
         }
         else {
           /* do a binary search for the highest tree quadrant <= ld */
-          last_index = p4est_find_higher_bound (tquadrants, &ld, guess);
+          last_index = bounds != NULL ?
+            *(ssize_t *) sc_array_index (bounds, slot + 1) :
+            p4est_find_higher_bound (tquadrants, &ld, guess);
           if (last_index < 0) {
             SC_ABORT_NOT_REACHED ();
           }
@@ -1051,7 +1752,9 @@ p4est_tree_compute_overlap (p4est_t * p4est, sc_array_t * in,
         else {
           /* Do a binary search for the lowest tree quadrant >= s.
              Does not accept a strict ancestor of s, which is on purpose. */
-          first_index = p4est_find_lower_bound (tquadrants, s, guess);
+          first_index = bounds != NULL ?
+            *(ssize_t *) sc_array_index (bounds, slot) :
+            p4est_find_lower_bound (tquadrants, s, guess);
         }
 
         if (first_index < 0 || first_index > last_index ||
@@ -1097,8 +1800,30 @@ p4est_tree_compute_overlap (p4est_t * p4est, sc_array_t * in,
 
         level = inq->level + 1;
 
+        /* evaluate the balance kernel for all candidates at once */
+        tq = p4est_quadrant_array_index (tquadrants, (size_t) first_index);
+        sc_array_resize (splits, (size_t) (last_index - first_index + 1));
+        split_flags = (int8_t *) splits->array;
+        if (f >= 0) {
+          p4est_balance_seeds_face_batch (tq, splits->elem_count, inq, f,
+                                          split_flags);
+        }
+#ifdef P4_TO_P8
+        else if (e >= 0) {
+          p8est_balance_seeds_edge_batch (tq, splits->elem_count, inq, e,
+                                          balance, split_flags);
+        }
+#endif
+        else {
+          p4est_balance_seeds_corner_batch (tq, splits->elem_count, inq, c,
+                                            balance, split_flags);
+        }
+
         /* copy relevant quadrants into out */
         for (js = first_index; js <= last_index; ++js) {
+          if (!split_flags[js - first_index]) {
+            continue;
+          }
           tq = p4est_quadrant_array_index (tquadrants, (size_t) js);
           if (tq->level <= level) {
             continue;
@@ -1194,6 +1919,12 @@ p4est_tree_compute_overlap (p4est_t * p4est, sc_array_t * in,
   sc_array_reset (cta);
 
   sc_array_destroy (seeds);
+  sc_array_destroy (splits);
+  if (bounds != NULL) {
+    p4est_scratch_array_destroy (p4est, lowq);
+    p4est_scratch_array_destroy (p4est, highq);
+    p4est_scratch_array_destroy (p4est, bounds);
+  }
 }
 
 void
@@ -1343,6 +2074,55 @@ p4est_tree_remove_nonowned (p4est_t * p4est, p4est_topidx_t which_tree)
   return removed;
 }
 
+/** Find the next quadrant of the minimal linear completion before \a b.
+ * The result is the coarsest quadrant that starts right after \a q, or
+ * with \a descend, the first child of \a q, and that does not overlap
+ * \a b.  It is found by stepping to the next sibling of the coarsest
+ * ancestor of \a q that has one, coarsening while the first child of a
+ * parent that stays clear of \a b, and refining while containing \a b.
+ * \param [in] q        Quadrant before \a b.  May be the same as \a n.
+ * \param [in] descend  If true, \a q is an ancestor of \a b.
+ * \param [in] b        Quadrant after \a q that ends the region.
+ * \param [out] n       The next quadrant if the return value is true.
+ * \return              True if \a n is before and disjoint from \a b.
+ */
+static int
+p4est_complete_next (const p4est_quadrant_t * q, int descend,
+                     const p4est_quadrant_t * b, p4est_quadrant_t * n)
+{
+  int                 cid;
+  p4est_quadrant_t    t;
+
+  P4EST_QUADRANT_INIT (&t);
+  if (descend) {
+    p4est_quadrant_child (q, &t, 0);
+    *n = t;
+  }
+  else {
+    *n = *q;
+    while ((cid = p4est_quadrant_child_id (n)) == P4EST_CHILDREN - 1) {
+      P4EST_ASSERT (n->level > 0);
+      p4est_quadrant_parent (n, n);
+    }
+    P4EST_ASSERT (n->level > 0);
+    p4est_quadrant_sibling (n, n, cid + 1);
+    while (n->level > 0 && p4est_quadrant_child_id (n) == 0) {
+      p4est_quadrant_parent (n, &t);
+      if (p4est_quadrant_is_ancestor (&t, b) ||
+          p4est_quadrant_is_equal (&t, b)) {
+        break;
+      }
+      *n = t;
+    }
+  }
+  while (p4est_quadrant_is_ancestor (n, b)) {
+    p4est_quadrant_child (n, &t, 0);
+    *n = t;
+  }
+  return p4est_quadrant_compare (n, b) < 0 &&
+    !p4est_quadrant_is_ancestor (b, n);
+}
+
 void
 p4est_complete_region (p4est_t * p4est,
                        const p4est_quadrant_t * q1,
@@ -1353,42 +2133,32 @@ p4est_complete_region (p4est_t * p4est,
                        p4est_topidx_t which_tree, p4est_init_t init_fn)
 {
 #ifdef P4EST_ENABLE_DEBUG
-  size_t              quadrant_pool_size, data_pool_size;
+  size_t              data_pool_size;
 #endif
 
   p4est_tree_t       *R;
-  sc_list_t          *W;
 
   p4est_quadrant_t    a = *q1;
   p4est_quadrant_t    b = *q2;
-
-  p4est_quadrant_t    Afinest;
-  p4est_quadrant_t   *c0, *c1, *c2, *c3;
-#ifdef P4_TO_P8
-  p4est_quadrant_t   *c4, *c5, *c6, *c7;
-#endif
+  p4est_quadrant_t    w;
 
   sc_array_t         *quadrants;
-  sc_mempool_t       *quadrant_pool = p4est->quadrant_pool;
 
-  p4est_quadrant_t   *w;
   p4est_quadrant_t   *r;
 
-  int                 comp;
+  int                 comp, more;
   int                 maxlevel = 0;
   p4est_locidx_t     *quadrants_per_level;
 
-  P4EST_QUADRANT_INIT (&Afinest);
+  P4EST_QUADRANT_INIT (&w);
 
-  W = sc_list_new (NULL);
   R = tree;
 
   /* needed for sanity check */
 #ifdef P4EST_ENABLE_DEBUG
-  quadrant_pool_size = p4est->quadrant_pool->elem_count;
   data_pool_size = 0;
   if (p4est->user_data_pool != NULL) {
-    data_pool_size = p4est->user_data_pool->elem_count;
+    data_pool_size = p4est_quadrant_data_count (p4est);
   }
 #endif
 
@@ -1411,84 +2181,17 @@ p4est_complete_region (p4est_t * p4est,
   }
 
   if (comp < 0) {
-    /* W <- C(A_{finest}(a,b)) */
-    p4est_nearest_common_ancestor (&a, &b, &Afinest);
-
-    c0 = p4est_quadrant_mempool_alloc (quadrant_pool);
-    c1 = p4est_quadrant_mempool_alloc (quadrant_pool);
-    c2 = p4est_quadrant_mempool_alloc (quadrant_pool);
-    c3 = p4est_quadrant_mempool_alloc (quadrant_pool);
-#ifdef P4_TO_P8
-    c4 = p4est_quadrant_mempool_alloc (quadrant_pool);
-    c5 = p4est_quadrant_mempool_alloc (quadrant_pool);
-    c6 = p4est_quadrant_mempool_alloc (quadrant_pool);
-    c7 = p4est_quadrant_mempool_alloc (quadrant_pool);
-
-    p8est_quadrant_children (&Afinest, c0, c1, c2, c3, c4, c5, c6, c7);
-#else
-    p4est_quadrant_children (&Afinest, c0, c1, c2, c3);
-#endif
-
-    (void) sc_list_append (W, c0);
-    (void) sc_list_append (W, c1);
-    (void) sc_list_append (W, c2);
-    (void) sc_list_append (W, c3);
-#ifdef P4_TO_P8
-    (void) sc_list_append (W, c4);
-    (void) sc_list_append (W, c5);
-    (void) sc_list_append (W, c6);
-    (void) sc_list_append (W, c7);
-#endif
-
-    /* for each w in W */
-    while (W->elem_count > 0) {
-      w = p4est_quadrant_list_pop (W);
-
-      /* if (a < w < b) and (w not in {A(b)}) */
-      if (((p4est_quadrant_compare (&a, w) < 0) &&
-           (p4est_quadrant_compare (w, &b) < 0)
-          ) && !p4est_quadrant_is_ancestor (w, &b)
-        ) {
-        /* R <- R + w */
-        r = p4est_quadrant_array_push_copy (quadrants, w);
-        p4est_quadrant_init_data (p4est, which_tree, r, init_fn);
-        maxlevel = SC_MAX ((int) r->level, maxlevel);
-        ++quadrants_per_level[r->level];
-      }
-      /* else if (w in {{A(a)}, {A(b)}}) */
-      else if (p4est_quadrant_is_ancestor (w, &a)
-               || p4est_quadrant_is_ancestor (w, &b)) {
-        /* W <- W + C(w) */
-        c0 = p4est_quadrant_mempool_alloc (quadrant_pool);
-        c1 = p4est_quadrant_mempool_alloc (quadrant_pool);
-        c2 = p4est_quadrant_mempool_alloc (quadrant_pool);
-        c3 = p4est_quadrant_mempool_alloc (quadrant_pool);
-#ifdef P4_TO_P8
-        c4 = p4est_quadrant_mempool_alloc (quadrant_pool);
-        c5 = p4est_quadrant_mempool_alloc (quadrant_pool);
-        c6 = p4est_quadrant_mempool_alloc (quadrant_pool);
-        c7 = p4est_quadrant_mempool_alloc (quadrant_pool);
-
-        p8est_quadrant_children (w, c0, c1, c2, c3, c4, c5, c6, c7);
-#else
-        p4est_quadrant_children (w, c0, c1, c2, c3);
-#endif
-
-#ifdef P4_TO_P8
-        (void) sc_list_prepend (W, c7);
-        (void) sc_list_prepend (W, c6);
-        (void) sc_list_prepend (W, c5);
-        (void) sc_list_prepend (W, c4);
-#endif
-        (void) sc_list_prepend (W, c3);
-        (void) sc_list_prepend (W, c2);
-        (void) sc_list_prepend (W, c1);
-        (void) sc_list_prepend (W, c0);
-      }
-
-      /* W <- W - w */
-      sc_mempool_free (quadrant_pool, w);
-    }                           /* end for */
+    /* R <- R + the coarsest quadrants strictly between a and b, computed
+       in Morton order from the preceding one without a work list */
+    more = p4est_complete_next (&a, p4est_quadrant_is_ancestor (&a, &b),
+                                &b, &w);
+    while (more) {
+      r = p4est_quadrant_array_push_copy (quadrants, &w);
+      p4est_quadrant_init_data (p4est, which_tree, r, init_fn);
+      maxlevel = SC_MAX ((int) r->level, maxlevel);
+      ++quadrants_per_level[r->level];
+      more = p4est_complete_next (&w, 0, &b, &w);
+    }
 
     /* R <- R + b */
     if (include_q2) {
@@ -1501,14 +2204,10 @@ p4est_complete_region (p4est_t * p4est,
 
   R->maxlevel = (int8_t) maxlevel;
 
-  P4EST_ASSERT (W->first == NULL && W->last == NULL);
-  sc_list_destroy (W);
-
   P4EST_ASSERT (p4est_tree_is_complete (R));
-  P4EST_ASSERT (quadrant_pool_size == p4est->quadrant_pool->elem_count);
   if (p4est->user_data_pool != NULL) {
     P4EST_ASSERT (data_pool_size + quadrants->elem_count ==
-                  p4est->user_data_pool->elem_count);
+                  p4est_quadrant_data_count (p4est));
   }
 }
 
@@ -2169,6 +2868,7 @@ p4est_complete_or_balance (p4est_t * p4est, p4est_topidx_t which_tree,
   p4est_tree_t       *tree;
   sc_array_t         *tquadrants;
   int                 bound;
+  int                 threaded;
   int8_t              maxlevel;
   sc_mempool_t       *qpool;
 #ifdef P4EST_ENABLE_DEBUG
@@ -2213,12 +2913,10 @@ p4est_complete_or_balance (p4est_t * p4est, p4est_topidx_t which_tree,
     SC_ABORT_NOT_REACHED ();
   }
 
-  qpool = p4est->quadrant_pool;
-
 #ifdef P4EST_ENABLE_DEBUG
   data_pool_size = 0;
   if (p4est->user_data_pool != NULL) {
-    data_pool_size = p4est->user_data_pool->elem_count;
+    data_pool_size = p4est_quadrant_data_count (p4est);
   }
 #endif
 
@@ -2245,10 +2943,12 @@ p4est_complete_or_balance (p4est_t * p4est, p4est_topidx_t which_tree,
   }
 
   /* initialize temporary storage */
+  threaded = p4est_in_parallel_region ();
+  qpool = threaded ? p4est_quadrant_mempool_new () : p4est->quadrant_pool;
   list_alloc = sc_mempool_new (sizeof (sc_link_t));
 
-  inlist = sc_array_new (sizeof (p4est_quadrant_t));
-  outlist = sc_array_new (sizeof (p4est_quadrant_t));
+  inlist = p4est_scratch_array_new (p4est, sizeof (p4est_quadrant_t));
+  outlist = p4est_scratch_array_new (p4est, sizeof (p4est_quadrant_t));
 
   /* get the reduced representation of the tree */
   q = p4est_quadrant_array_push (inlist);
@@ -2351,9 +3051,9 @@ p4est_complete_or_balance (p4est_t * p4est, p4est_topidx_t which_tree,
   tree->maxlevel = maxlevel;
 
   /* sanity check */
-  if (p4est->user_data_pool != NULL) {
+  if (p4est->user_data_pool != NULL && !threaded) {
     P4EST_ASSERT (data_pool_size + (ocount - tcount) ==
-                  p4est->user_data_pool->elem_count);
+                  p4est_quadrant_data_count (p4est));
   }
 
   P4EST_VERBOSEF
@@ -2363,11 +3063,17 @@ p4est_complete_or_balance (p4est_t * p4est, p4est_topidx_t which_tree,
      (unsigned long long) count_ancestor_inlist,
      (unsigned long long) (ocount - tcount));
 
-  sc_array_destroy (inlist);
-  sc_array_destroy (outlist);
+  p4est_scratch_array_destroy (p4est, inlist);
+  p4est_scratch_array_destroy (p4est, outlist);
   sc_mempool_destroy (list_alloc);
+  if (threaded) {
+    sc_mempool_destroy (qpool);
+  }
 
   if (p4est->inspect) {
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (p4est_inspect)
+#endif
     if (!p4est->inspect->use_B) {
       p4est->inspect->balance_A_count_in += count_already_inlist;
       p4est->inspect->balance_A_count_in += count_ancestor_inlist;
@@ -2386,7 +3092,7 @@ p4est_balance_border (p4est_t * p4est, p4est_connect_type_t btype,
                       p4est_topidx_t which_tree, p4est_init_t init_fn,
                       p4est_replace_t replace_fn, sc_array_t * borders)
 {
-  size_t              iz, jz, kz;
+  size_t              iz, jz, kz, lz, bz;
   size_t              incount;
   size_t              count_already_inlist, count_already_outlist;
   size_t              count_ancestor_inlist;
@@ -2402,6 +3108,8 @@ p4est_balance_border (p4est_t * p4est, p4est_connect_type_t btype,
   int                 bound;
   ssize_t             tqindex;
   size_t              tqorig;
+  int                 threaded;
+  int8_t              is_desc[P4EST_BALANCE_BATCH];
   sc_mempool_t       *list_alloc, *qpool;
   /* get this tree's border */
   sc_array_t         *qarray = (sc_array_t *) sc_array_index (borders,
@@ -2441,7 +3149,8 @@ p4est_balance_border (p4est_t * p4est, p4est_connect_type_t btype,
   sc_array_init_view (&tqview, tquadrants, tqoffset,
                       tquadrants->elem_count - tqoffset);
 
-  qpool = p4est->quadrant_pool;
+  threaded = p4est_in_parallel_region ();
+  qpool = threaded ? p4est_quadrant_mempool_new () : p4est->quadrant_pool;
 
   count_already_inlist = count_already_outlist = 0;
   count_ancestor_inlist = 0;
@@ -2450,8 +3159,8 @@ p4est_balance_border (p4est_t * p4est, p4est_connect_type_t btype,
   /* initialize temporary storage */
   list_alloc = sc_mempool_new (sizeof (sc_link_t));
 
-  inlist = sc_array_new (sizeof (p4est_quadrant_t));
-  flist = sc_array_new (sizeof (p4est_quadrant_t));
+  inlist = p4est_scratch_array_new (p4est, sizeof (p4est_quadrant_t));
+  flist = p4est_scratch_array_new (p4est, sizeof (p4est_quadrant_t));
 
   /* sort the border and remove duplicates */
   sc_array_sort (qarray, p4est_quadrant_compare);
@@ -2495,17 +3204,17 @@ p4est_balance_border (p4est_t * p4est, p4est_connect_type_t btype,
     jz = iz + 1;
     kz = jz;
 
-    if (kz < qcount) {
+    /* the descendants are contiguous, test them in batches */
+    while (kz < qcount) {
+      bz = SC_MIN (qcount - kz, (size_t) P4EST_BALANCE_BATCH);
       q = p4est_quadrant_array_index (qarray, kz);
-    }
-
-    while (kz < qcount && p4est_quadrant_is_ancestor (p, q)) {
-      kz++;
-
-      P4EST_ASSERT (p4est_quadrant_child_id (q) == 0);
-
-      if (kz < qcount) {
-        q = p4est_quadrant_array_index (qarray, kz);
+      p4est_quadrant_is_ancestor_batch (p, q, bz, is_desc);
+      for (lz = 0; lz < bz && is_desc[lz]; ++lz) {
+        P4EST_ASSERT (p4est_quadrant_child_id (&q[lz]) == 0);
+      }
+      kz += lz;
+      if (lz < bz) {
+        break;
       }
     }
 
@@ -2609,6 +3318,9 @@ p4est_balance_border (p4est_t * p4est, p4est_connect_type_t btype,
           flist->elem_count * flist->elem_size);
 
   sc_mempool_destroy (list_alloc);
+  if (threaded) {
+    sc_mempool_destroy (qpool);
+  }
   P4EST_ASSERT (tqorig + num_added == tquadrants->elem_count);
 
   /* print more statistics */
@@ -2619,15 +3331,20 @@ p4est_balance_border (p4est_t * p4est, p4est_connect_type_t btype,
      (unsigned long long) count_ancestor_inlist,
      (unsigned long long) num_added);
 
-  sc_array_destroy (inlist);
-  sc_array_destroy (flist);
+  p4est_scratch_array_destroy (p4est, inlist);
+  p4est_scratch_array_destroy (p4est, flist);
 
   P4EST_ASSERT (p4est_tree_is_complete (tree));
 
   if (p4est->inspect) {
-    p4est->inspect->balance_B_count_in += count_already_inlist;
-    p4est->inspect->balance_B_count_in += count_ancestor_inlist;
-    p4est->inspect->balance_B_count_out += count_already_outlist;
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (p4est_inspect)
+#endif
+    {
+      p4est->inspect->balance_B_count_in += count_already_inlist;
+      p4est->inspect->balance_B_count_in += count_ancestor_inlist;
+      p4est->inspect->balance_B_count_out += count_already_outlist;
+    }
   }
 }
 
@@ -2677,7 +3394,7 @@ p4est_linearize_tree (p4est_t * p4est, p4est_tree_t * tree)
 #ifdef P4EST_ENABLE_DEBUG
   data_pool_size = 0;
   if (p4est->user_data_pool != NULL) {
-    data_pool_size = p4est->user_data_pool->elem_count;
+    data_pool_size = p4est_quadrant_data_count (p4est);
   }
 #endif
   removed = 0;
@@ -2729,7 +3446,7 @@ p4est_linearize_tree (p4est_t * p4est, p4est_tree_t * tree)
   P4EST_ASSERT (tquadrants->elem_count == incount - removed);
   if (p4est->user_data_pool != NULL) {
     P4EST_ASSERT (data_pool_size - removed ==
-                  p4est->user_data_pool->elem_count);
+                  p4est_quadrant_data_count (p4est));
   }
   P4EST_ASSERT (p4est_tree_is_sorted (tree));
   P4EST_ASSERT (p4est_tree_is_linear (tree));
@@ -2825,10 +3542,13 @@ p4est_partition_given (p4est_t * p4est,
   int                 i;
   int                 from_proc, to_proc;
   int                 num_proc_recv_from, num_proc_send_to;
+  int                 send_one_by_one;
   char               *user_data_send_buf;
   char               *user_data_recv_buf;
   char              **recv_buf, **send_buf;
   size_t              recv_size, send_size, zz, zoffset;
+  size_t              num_sent, num_received, bytes_sent, bytes_received;
+  size_t              send_total;
   p4est_topidx_t      it;
   p4est_topidx_t      which_tree;
   p4est_topidx_t      first_tree, last_tree;
@@ -2877,6 +3597,7 @@ p4est_partition_given (p4est_t * p4est,
   P4EST_GLOBAL_INFOF
     ("Into " P4EST_STRING "_partition_given with %lld total quadrants\n",
      (long long) p4est->global_num_quadrants);
+  p4est_unshare_quadrants (p4est);
 
 #ifdef P4EST_ENABLE_DEBUG
   /* Save a checksum of the original forest */
@@ -3049,6 +3770,7 @@ p4est_partition_given (p4est_t * p4est,
 #endif
 
   /* Allocate space for receiving quadrants and user data */
+  num_sent = num_received = bytes_sent = bytes_received = 0;
   for (from_proc = from_begin_global_quad
 #ifdef P4EST_ENABLE_MPI
        , sk = 0
@@ -3062,6 +3784,8 @@ p4est_partition_given (p4est_t * p4est,
         + quad_plus_data_size * num_recv_from[from_proc];
 
       recv_buf[from_proc] = P4EST_ALLOC (char, recv_size);
+      ++num_received;
+      bytes_received += recv_size;
 
       /* Post receives for the quadrants and their data */
 #ifdef P4EST_ENABLE_MPI
@@ -3081,6 +3805,8 @@ p4est_partition_given (p4est_t * p4est,
     recv_request[sk] = MPI_REQUEST_NULL;
   }
 #endif
+  p4est_inspect_alloc (p4est->inspect, P4EST_INSPECT_PARTITION,
+                       bytes_received);
 
   /* For each processor calculate the number of quadrants sent */
   num_send_to = P4EST_ALLOC_ZERO (p4est_locidx_t, num_procs);
@@ -3220,7 +3946,26 @@ p4est_partition_given (p4est_t * p4est,
     }
   }
 
-  /* Allocate space for receiving quadrants and user data */
+  /* close to the memory budget the messages are sent one at a time */
+  send_total = 0;
+  for (to_proc = to_begin_global_quad; to_proc <= to_end_global_quad;
+       ++to_proc) {
+    if (to_proc != rank && num_send_to[to_proc]) {
+      send_total += num_send_trees * sizeof (p4est_locidx_t)
+        + quad_plus_data_size * num_send_to[to_proc];
+    }
+  }
+  send_one_by_one = p4est_inspect_memory_tight (p4est->inspect, send_total);
+  if (send_one_by_one) {
+    P4EST_VERBOSEF ("partition sends %llu bytes one message at a time\n",
+                    (unsigned long long) send_total);
+  }
+  else {
+    p4est_inspect_alloc (p4est->inspect, P4EST_INSPECT_PARTITION,
+                         send_total);
+  }
+
+  /* Allocate space for sending quadrants and user data */
   for (to_proc = to_begin_global_quad
 #ifdef P4EST_ENABLE_MPI
        , sk = 0
@@ -3231,6 +3976,12 @@ p4est_partition_given (p4est_t * p4est,
         + quad_plus_data_size * num_send_to[to_proc];
 
       send_buf[to_proc] = P4EST_ALLOC (char, send_size);
+      ++num_sent;
+      bytes_sent += send_size;
+      if (send_one_by_one) {
+        p4est_inspect_alloc (p4est->inspect, P4EST_INSPECT_PARTITION,
+                             send_size);
+      }
 
       num_per_tree_send_buf = (p4est_locidx_t *) send_buf[to_proc];
       memset (num_per_tree_send_buf, 0,
@@ -3282,6 +4033,11 @@ p4est_partition_given (p4est_t * p4est,
             if (data_size) {
               quad_send_buf[il].p.user_data = NULL;
             }
+
+            /* the packed user data is released right away for reuse */
+            quad = p4est_quadrant_array_index (&tree->quadrants,
+                                               (size_t) tree_from_begin + il);
+            p4est_quadrant_free_data (p4est, quad);
           }
 
           /* move pointer to beginning of quads that need to be copied */
@@ -3299,6 +4055,17 @@ p4est_partition_given (p4est_t * p4est,
                           to_proc, P4EST_COMM_PARTITION_GIVEN,
                           comm, send_request + sk);
       SC_CHECK_MPI (mpiret);
+      p4est_inspect_send (p4est->inspect, P4EST_INSPECT_PARTITION, to_proc,
+                          send_size);
+      if (send_one_by_one) {
+        /* the receives are posted everywhere, so this does not deadlock */
+        mpiret = sc_MPI_Wait (send_request + sk, MPI_STATUS_IGNORE);
+        SC_CHECK_MPI (mpiret);
+        P4EST_FREE (send_buf[to_proc]);
+        send_buf[to_proc] = NULL;
+        p4est_inspect_free (p4est->inspect, P4EST_INSPECT_PARTITION,
+                            send_size);
+      }
       ++sk;
 #endif
     }
@@ -3312,7 +4079,21 @@ p4est_partition_given (p4est_t * p4est,
   mpiret =
     sc_MPI_Waitall (num_proc_recv_from, recv_request, MPI_STATUSES_IGNORE);
   SC_CHECK_MPI (mpiret);
+
+  /* the receives are posted everywhere, so the sends complete quickly;
+     their buffers are released before the trees are rebuilt */
+  mpiret =
+    sc_MPI_Waitall (num_proc_send_to, send_request, MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
 #endif
+  for (i = to_begin_global_quad; i <= to_end_global_quad; ++i) {
+    if (i != rank && num_send_to[i])
+      P4EST_FREE (send_buf[i]);
+  }
+  if (!send_one_by_one) {
+    p4est_inspect_free (p4est->inspect, P4EST_INSPECT_PARTITION,
+                        send_total);
+  }
 
   /* Loop through and fill in */
 
@@ -3447,20 +4228,10 @@ p4est_partition_given (p4est_t * p4est,
           num_copy = 0;
         }
 
-        /* Free all userdata that no longer belongs to this process */
-        zoffset = SC_MIN ((size_t) tree_from_begin, quadrants->elem_count);
-        for (zz = 0; zz < zoffset; ++zz) {
-          quad = p4est_quadrant_array_index (quadrants, zz);
-          p4est_quadrant_free_data (p4est, quad);
-        }
-        zoffset = (size_t) tree_from_end + 1;
-        for (zz = zoffset; zz < quadrants->elem_count; ++zz) {
-          quad = p4est_quadrant_array_index (quadrants, zz);
-          p4est_quadrant_free_data (p4est, quad);
-        }
+        /* the user data of all quadrants sent away is already freed */
 
         if (num_quadrants > (p4est_locidx_t) quadrants->elem_count) {
-          sc_array_resize (quadrants, num_quadrants);
+          p4est_array_resize (quadrants, num_quadrants);
         }
 
         P4EST_LDEBUGF ("copying %lld local quads to tree %lld\n",
@@ -3491,13 +4262,7 @@ p4est_partition_given (p4est_t * p4est,
        * any quadrants in it.
        */
       if (which_tree >= first_local_tree && which_tree <= last_local_tree) {
-        /* Free all userdata that no longer belongs to this process */
-        for (zz = 0; zz < quadrants->elem_count; ++zz) {
-          quad = p4est_quadrant_array_index (quadrants, zz);
-          p4est_quadrant_free_data (p4est, quad);
-        }
-
-        /* The whole tree is dropped */
+        /* The whole tree is dropped; its user data was freed when sent */
         P4EST_QUADRANT_INIT (&tree->first_desc);
         P4EST_QUADRANT_INIT (&tree->last_desc);
         sc_array_reset (quadrants);
@@ -3553,7 +4318,7 @@ p4est_partition_given (p4est_t * p4est,
           tree = p4est_tree_array_index (trees, from_tree);
           quadrants = &tree->quadrants;
           num_quadrants = new_local_tree_elem_count[from_tree];
-          sc_array_resize (quadrants, num_quadrants);
+          p4est_array_resize (quadrants, num_quadrants);
 
           /* copy quadrants */
           P4EST_LDEBUGF ("copying %lld remote quads to tree %lld"
@@ -3589,9 +4354,17 @@ p4est_partition_given (p4est_t * p4est,
         quad_recv_buf += num_copy;
         user_data_recv_buf += num_copy * data_size;
       }
+
+      /* release each message as soon as it is copied into the trees */
+      if (from_proc != rank) {
+        P4EST_FREE (recv_buf[from_proc]);
+      }
     }
   }
 
+  p4est_inspect_free (p4est->inspect, P4EST_INSPECT_PARTITION,
+                      bytes_received);
+
   /* Set the global index and count of quadrants instead
    * of calling p4est_comm_count_quadrants
    */
@@ -3652,10 +4425,6 @@ p4est_partition_given (p4est_t * p4est,
   /* Clean up */
 
 #ifdef P4EST_ENABLE_MPI
-  mpiret =
-    sc_MPI_Waitall (num_proc_send_to, send_request, MPI_STATUSES_IGNORE);
-  SC_CHECK_MPI (mpiret);
-
 #ifdef P4EST_ENABLE_DEBUG
   for (i = 0; i < num_proc_recv_from; ++i) {
     P4EST_ASSERT (recv_request[i] == MPI_REQUEST_NULL);
@@ -3668,16 +4437,6 @@ p4est_partition_given (p4est_t * p4est,
   P4EST_FREE (send_request);
 #endif
 
-  for (i = from_begin_global_quad; i <= from_end_global_quad; ++i) {
-    if (i != rank && num_recv_from[i])
-      P4EST_FREE (recv_buf[i]);
-  }
-
-  for (i = to_begin_global_quad; i <= to_end_global_quad; ++i) {
-    if (i != rank && num_send_to[i])
-      P4EST_FREE (send_buf[i]);
-  }
-
   P4EST_FREE (num_per_tree_local);
   P4EST_FREE (local_tree_last_quad_index);
   P4EST_FREE (new_local_tree_elem_count);
@@ -3689,6 +4448,13 @@ p4est_partition_given (p4est_t * p4est,
   P4EST_FREE (begin_send_to);
 
   p4est_comm_global_partition (p4est, NULL);
+  p4est_compact_data (p4est);
+  if (p4est->balance_dirty != NULL &&
+      p4est->balance_revision != p4est->revision) {
+    /* changed quadrants may have moved into any of the local trees */
+    memset (p4est->balance_dirty, 1,
+            (size_t) p4est->connectivity->num_trees);
+  }
 
   /* Assert that we have a valid partition */
   P4EST_ASSERT (crc == p4est_checksum (p4est));
@@ -3698,6 +4464,9 @@ p4est_partition_given (p4est_t * p4est,
      (long long) total_quadrants_shipped,
      total_quadrants_shipped * 100. / p4est->global_num_quadrants);
 
+  p4est_inspect_comm (p4est->inspect, P4EST_INSPECT_PARTITION,
+                      num_sent + num_received, num_sent, bytes_sent,
+                      num_received, bytes_received);
   return total_quadrants_shipped;
 }
 
@@ -3705,14 +4474,15 @@ int
 p4est_quadrant_on_face_boundary (p4est_t * p4est, p4est_topidx_t treeid,
                                  int face, const p4est_quadrant_t * q)
 {
+  int                 nface;
   p4est_qcoord_t      dh, xyz;
   p4est_connectivity_t *conn = p4est->connectivity;
 
   P4EST_ASSERT (0 <= face && face < P4EST_FACES);
   P4EST_ASSERT (p4est_quadrant_is_valid (q));
 
-  if (conn->tree_to_tree[P4EST_FACES * treeid + face] != treeid ||
-      (int) conn->tree_to_face[P4EST_FACES * treeid + face] != face) {
+  if (p4est_connectivity_face_neighbor_tree (conn, treeid, face, &nface)
+      != treeid || nface != face) {
     return 0;
   }
 
@@ -220,6 +220,90 @@ p8est_balance_kernel_3d_face (p4est_qcoord_t dx, p4est_qcoord_t dy,
 }
 #endif
 
+/* The following predicates return true if the kernel of the same name
+ * computes a level larger than \a plevel, that is, if a quadrant of
+ * \a level at the given distances forces a split of a \a plevel quadrant.
+ * Since 0 <= plevel, the kernel level exceeds plevel if and only if each
+ * logarithm in the kernel is smaller than level - plevel.  We thus compare
+ * the kernel's operands against a power of two, which avoids the logarithm
+ * and all branches such that loops over many candidates vectorize.
+ * The distances must be nonnegative whenever \a level exceeds \a plevel.
+ */
+static inline int
+p4est_balance_split_1d (p4est_qcoord_t distance, int level, int plevel)
+{
+  const int           diff = level - plevel;
+  const p4est_qcoord_t limit = ((p4est_qcoord_t) 1) << (diff > 0 ? diff : 0);
+
+  distance >>= P4EST_MAXLEVEL - level;
+  return (diff > 0) & (distance + 1 < limit);
+}
+
+static inline int
+p4est_balance_split_2d (p4est_qcoord_t dx, p4est_qcoord_t dy,
+                        int level, int plevel)
+{
+  const int           shift = P4EST_MAXLEVEL - level;
+  const int           diff = level - plevel;
+  const p4est_qcoord_t limit = ((p4est_qcoord_t) 1) << (diff > 0 ? diff : 0);
+
+  dx = ((dx >> shift) + 1) & (~((p4est_qcoord_t) 0x1));
+  dy = ((dy >> shift) + 1) & (~((p4est_qcoord_t) 0x1));
+  return (diff > 0) & (dx + dy + 1 < limit);
+}
+
+#ifdef P4_TO_P8
+static inline int
+p8est_balance_split_3d_edge (p4est_qcoord_t dx, p4est_qcoord_t dy,
+                             p4est_qcoord_t dz, int level, int plevel)
+{
+  const int           shift = P4EST_MAXLEVEL - level;
+  const int           diff = level - plevel;
+  const p4est_qcoord_t limit = ((p4est_qcoord_t) 1) << (diff > 0 ? diff : 0);
+
+  /* the kernel's special case of zero distance is covered as well */
+  dx = ((dx >> shift) + 1) & (~((p4est_qcoord_t) 0x1));
+  dy = ((dy >> shift) + 1) & (~((p4est_qcoord_t) 0x1));
+  dz = ((dz >> shift) + 1) & (~((p4est_qcoord_t) 0x1));
+  return (diff > 0) & (dx < limit) & (dy < limit) & (dz < limit) &
+    (dx + dy + dz - (dx | dy | dz) < limit);
+}
+
+static inline int
+p8est_balance_split_3d_face (p4est_qcoord_t dx, p4est_qcoord_t dy,
+                             p4est_qcoord_t dz, int level, int plevel)
+{
+  const int           shift = P4EST_MAXLEVEL - level;
+  const int           diff = level - plevel;
+  const p4est_qcoord_t limit = ((p4est_qcoord_t) 1) << (diff > 0 ? diff : 0);
+  p4est_qcoord_t      dyz, dzx, dxy;
+
+  dx = ((dx >> shift) + 1) & (~((p4est_qcoord_t) 0x1));
+  dy = ((dy >> shift) + 1) & (~((p4est_qcoord_t) 0x1));
+  dz = ((dz >> shift) + 1) & (~((p4est_qcoord_t) 0x1));
+  dyz = dy + dz;
+  dzx = dz + dx;
+  dxy = dx + dy;
+  return (diff > 0) & (dyz < limit) & (dzx < limit) & (dxy < limit) &
+    (dyz + dzx + dxy - (dyz | dzx | dxy) < limit);
+}
+#endif
+
+/* translate the connect type into the balance switch of the kernels */
+static int
+p4est_balance_int (p4est_connect_type_t balance)
+{
+  if (balance == P4EST_CONNECT_FULL) {
+    return P4EST_DIM - 1;
+  }
+#ifdef P4_TO_P8
+  if (balance == P8EST_CONNECT_EDGE) {
+    return 1;
+  }
+#endif
+  return 0;
+}
+
 static void         p4est_bal_corner_con_internal (p4est_quadrant_t const *q,
                                                    p4est_quadrant_t * p,
                                                    int corner,
@@ -787,17 +871,7 @@ p4est_balance_seeds_face (p4est_quadrant_t * q,
   P4EST_ASSERT (seeds == NULL ||
                 seeds->elem_size == sizeof (p4est_quadrant_t));
 
-  if (balance == P4EST_CONNECT_FULL) {
-    ibalance = P4EST_DIM - 1;
-  }
-#ifdef P4_TO_P8
-  else if (balance == P8EST_CONNECT_EDGE) {
-    ibalance = 1;
-  }
-#endif
-  else {
-    ibalance = 0;
-  }
+  ibalance = p4est_balance_int (balance);
 
   if (seeds == NULL) {
     p4est_bal_face_con_internal (q, &temp, face, ibalance, &consistent, NULL);
@@ -837,17 +911,7 @@ p4est_balance_seeds_corner (p4est_quadrant_t * q,
   P4EST_ASSERT (seeds == NULL ||
                 seeds->elem_size == sizeof (p4est_quadrant_t));
 
-  if (balance == P4EST_CONNECT_FULL) {
-    ibalance = P4EST_DIM - 1;
-  }
-#ifdef P4_TO_P8
-  else if (balance == P8EST_CONNECT_EDGE) {
-    ibalance = 1;
-  }
-#endif
-  else {
-    ibalance = 0;
-  }
+  ibalance = p4est_balance_int (balance);
 
   p4est_bal_corner_con_internal (q, &temp, corner, ibalance, &consistent);
   if (seeds == NULL) {
@@ -884,17 +948,7 @@ p8est_balance_seeds_edge (p4est_quadrant_t * q,
   P4EST_ASSERT (seeds == NULL ||
                 seeds->elem_size == sizeof (p4est_quadrant_t));
 
-  if (balance == P4EST_CONNECT_FULL) {
-    ibalance = P4EST_DIM - 1;
-  }
-#ifdef P4_TO_P8
-  else if (balance == P8EST_CONNECT_EDGE) {
-    ibalance = 1;
-  }
-#endif
-  else {
-    ibalance = 0;
-  }
+  ibalance = p4est_balance_int (balance);
 
   if (seeds == NULL) {
     p8est_bal_edge_con_internal (q, &temp, edge, ibalance, &consistent, NULL);
@@ -1034,3 +1088,125 @@ p4est_balance_seeds (p4est_quadrant_t * q, p4est_quadrant_t * p,
     return -1;
   }
 }
+
+size_t
+p4est_balance_seeds_face_batch (const p4est_quadrant_t * qs, size_t num_qs,
+                                const p4est_quadrant_t * p, int face,
+                                int8_t * split)
+{
+  const int           plevel = (int) p->level;
+  const int           axis = face / 2;
+  const int           upper = face & 1;
+  const p4est_qcoord_t plen = P4EST_QUADRANT_LEN (plevel);
+  const p4est_qcoord_t pc = axis == 0 ? p->x :
+#ifdef P4_TO_P8
+    axis == 2 ? p->z :
+#endif
+    p->y;
+  int                 qlevel;
+  size_t              zz, count;
+  p4est_qcoord_t      qc, distance;
+
+  P4EST_ASSERT (0 <= face && face < P4EST_FACES);
+  P4EST_ASSERT (num_qs == 0 || (qs != NULL && split != NULL));
+
+  /* the face kernel does not depend on the balance type */
+  count = 0;
+  for (zz = 0; zz < num_qs; ++zz) {
+    qlevel = (int) qs[zz].level;
+    qc = axis == 0 ? qs[zz].x :
+#ifdef P4_TO_P8
+      axis == 2 ? qs[zz].z :
+#endif
+      qs[zz].y;
+    distance = upper ?
+      (qc + P4EST_QUADRANT_LEN (qlevel)) - (pc + plen) : pc - qc;
+    split[zz] = (int8_t) p4est_balance_split_1d (distance, qlevel, plevel);
+    count += (size_t) split[zz];
+  }
+  return count;
+}
+
+#ifdef P4_TO_P8
+size_t
+p8est_balance_seeds_edge_batch (const p4est_quadrant_t * qs, size_t num_qs,
+                                const p4est_quadrant_t * p, int edge,
+                                p4est_connect_type_t balance, int8_t * split)
+{
+  const int           ibalance = p4est_balance_int (balance);
+  const int           plevel = (int) p->level;
+  const int           axis = edge / 4;
+  const p4est_qcoord_t plen = P4EST_QUADRANT_LEN (plevel);
+  const p4est_qcoord_t pa = axis == 0 ? p->y : p->x;
+  const p4est_qcoord_t pb = axis == 2 ? p->y : p->z;
+  int                 qlevel;
+  size_t              zz, count;
+  p4est_qcoord_t      qlen, qa, qb, dx, dy;
+
+  P4EST_ASSERT (0 <= edge && edge < P8EST_EDGES);
+  P4EST_ASSERT (num_qs == 0 || (qs != NULL && split != NULL));
+
+  count = 0;
+  for (zz = 0; zz < num_qs; ++zz) {
+    qlevel = (int) qs[zz].level;
+    qlen = P4EST_QUADRANT_LEN (qlevel);
+    qa = axis == 0 ? qs[zz].y : qs[zz].x;
+    qb = axis == 2 ? qs[zz].y : qs[zz].z;
+    dx = (edge & 1) ? (qa + qlen) - (pa + plen) : pa - qa;
+    dy = (edge & 2) ? (qb + qlen) - (pb + plen) : pb - qb;
+    split[zz] = (int8_t) (ibalance ?
+                          p4est_balance_split_1d (SC_MAX (dx, dy),
+                                                  qlevel, plevel) :
+                          p4est_balance_split_2d (dx, dy, qlevel, plevel));
+    count += (size_t) split[zz];
+  }
+  return count;
+}
+#endif
+
+size_t
+p4est_balance_seeds_corner_batch (const p4est_quadrant_t * qs,
+                                  size_t num_qs, const p4est_quadrant_t * p,
+                                  int corner, p4est_connect_type_t balance,
+                                  int8_t * split)
+{
+  const int           ibalance = p4est_balance_int (balance);
+  const int           plevel = (int) p->level;
+  const p4est_qcoord_t plen = P4EST_QUADRANT_LEN (plevel);
+  int                 qlevel;
+  size_t              zz, count;
+  p4est_qcoord_t      qlen, dx, dy;
+#ifdef P4_TO_P8
+  p4est_qcoord_t      dz;
+#endif
+
+  P4EST_ASSERT (0 <= corner && corner < P4EST_CHILDREN);
+  P4EST_ASSERT (num_qs == 0 || (qs != NULL && split != NULL));
+
+  count = 0;
+  for (zz = 0; zz < num_qs; ++zz) {
+    qlevel = (int) qs[zz].level;
+    qlen = P4EST_QUADRANT_LEN (qlevel);
+    dx = (corner & 1) ? ((qs[zz].x + qlen) - (p->x + plen)) : p->x - qs[zz].x;
+    dy = (corner & 2) ? ((qs[zz].y + qlen) - (p->y + plen)) : p->y - qs[zz].y;
+#ifndef P4_TO_P8
+    split[zz] = (int8_t) (ibalance ?
+                          p4est_balance_split_1d (SC_MAX (dx, dy),
+                                                  qlevel, plevel) :
+                          p4est_balance_split_2d (dx, dy, qlevel, plevel));
+#else
+    dz = (corner & 4) ? ((qs[zz].z + qlen) - (p->z + plen)) : p->z - qs[zz].z;
+    split[zz] = (int8_t) (ibalance == 0 ?
+                          p8est_balance_split_3d_face (dx, dy, dz,
+                                                       qlevel, plevel) :
+                          ibalance == 1 ?
+                          p8est_balance_split_3d_edge (dx, dy, dz,
+                                                       qlevel, plevel) :
+                          p4est_balance_split_1d (SC_MAX (SC_MAX (dx, dy),
+                                                          dz),
+                                                  qlevel, plevel));
+#endif
+    count += (size_t) split[zz];
+  }
+  return count;
+}
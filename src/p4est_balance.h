@@ -64,6 +64,39 @@ int                 p4est_balance_seeds_corner (p4est_quadrant_t * q,
                                                 int face, p4est_connect_type_t
                                                 balance, sc_array_t * seeds);
 
+/** Determine for many test quadrants whether they cause \a p to split.
+ * This is \ref p4est_balance_seeds_face without seeds, applied to each
+ * member of a contiguous array of test quadrants known to be outside of
+ * \a face of \a p.  The balance kernel is evaluated by integer comparisons
+ * without branches, such that the loop over the array may be vectorized.
+ * The result does not depend on the balance type.
+ * \param [in] qs       Array of \a num_qs test quadrants.
+ * \param [in] num_qs   Number of test quadrants.
+ * \param [in] p        Trial quadrant.
+ * \param [in] face     Face of \a p that all test quadrants are outside of.
+ * \param [out] split   Array of \a num_qs entries, set to true for each
+ *                      test quadrant that causes \a p to split.
+ * \return              The number of test quadrants that cause a split.
+ */
+size_t              p4est_balance_seeds_face_batch (const p4est_quadrant_t *
+                                                    qs, size_t num_qs,
+                                                    const p4est_quadrant_t *
+                                                    p, int face,
+                                                    int8_t * split);
+
+/** Determine for many test quadrants whether they cause \a p to split.
+ * Same as \ref p4est_balance_seeds_face_batch for test quadrants known to be
+ * outside of \a corner of \a p.
+ * \param [in] balance  Balance condition.
+ */
+size_t              p4est_balance_seeds_corner_batch (const p4est_quadrant_t
+                                                      * qs, size_t num_qs,
+                                                      const p4est_quadrant_t
+                                                      * p, int corner,
+                                                      p4est_connect_type_t
+                                                      balance,
+                                                      int8_t * split);
+
 SC_EXTERN_C_END;
 
 #endif
@@ -23,9 +23,32 @@
 */
 
 #include <p4est_base.h>
+#ifdef P4EST_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef P4EST_ENABLE_OPENMP
+#include <omp.h>
+#endif
+#ifdef P4EST_HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef P4EST_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if defined (__SSE4_2__) && defined (__x86_64__)
+#include <nmmintrin.h>
+#define P4EST_CRC32C_SSE42
+#elif defined (__ARM_FEATURE_CRC32) && defined (__aarch64__) && \
+  !defined (__ARM_BIG_ENDIAN)
+#include <arm_acle.h>
+#define P4EST_CRC32C_ARMV8
+#endif
 
 int                 p4est_package_id = -1;
 int                 p4est_initialized = 0;
+static int          p4est_num_threads = 1;
+static int          p4est_memory_policy = P4EST_MEMORY_DEFAULT;
+p4est_region_hooks_t p4est_region_hooks = { NULL, NULL, NULL };
 
 void
 p4est_init (sc_log_handler_t log_handler, int log_threshold)
@@ -72,6 +95,396 @@ p4est_get_package_id (void)
   return p4est_package_id;
 }
 
+void
+p4est_set_num_threads (int num_threads)
+{
+  P4EST_ASSERT (num_threads >= 1);
+  p4est_num_threads = SC_MAX (num_threads, 1);
+}
+
+int
+p4est_get_num_threads (void)
+{
+#ifdef P4EST_ENABLE_OPENMP
+  return p4est_num_threads;
+#else
+  return 1;
+#endif
+}
+
+int
+p4est_in_parallel_region (void)
+{
+#ifdef P4EST_ENABLE_OPENMP
+  return omp_in_parallel ();
+#else
+  return 0;
+#endif
+}
+
+int
+p4est_get_thread_num (void)
+{
+#ifdef P4EST_ENABLE_OPENMP
+  return omp_get_thread_num ();
+#else
+  return 0;
+#endif
+}
+
+void
+p4est_set_memory_policy (int policy)
+{
+  P4EST_ASSERT (!p4est_in_parallel_region ());
+  P4EST_ASSERT (policy >= 0 &&
+                policy <= (P4EST_MEMORY_HUGEPAGES | P4EST_MEMORY_FIRST_TOUCH));
+  p4est_memory_policy = policy;
+}
+
+int
+p4est_get_memory_policy (void)
+{
+  return p4est_memory_policy;
+}
+
+void
+p4est_memory_place (void *ptr, size_t bytes)
+{
+  size_t              page_size;
+  size_t              first, last;
+#ifdef P4EST_ENABLE_OPENMP
+  long                num_pages, lp;
+#endif
+
+  if (p4est_memory_policy == P4EST_MEMORY_DEFAULT ||
+      bytes < P4EST_MEMORY_PLACE_MIN) {
+    return;
+  }
+  P4EST_ASSERT (ptr != NULL);
+
+#ifdef P4EST_HAVE_UNISTD_H
+  page_size = (size_t) sysconf (_SC_PAGESIZE);
+#else
+  page_size = 4096;
+#endif
+
+  /* only the whole pages within the range may be advised or touched */
+  first = ((size_t) ptr + page_size - 1) / page_size * page_size;
+  last = ((size_t) ptr + bytes) / page_size * page_size;
+  if (first >= last) {
+    return;
+  }
+
+#if defined (P4EST_HAVE_SYS_MMAN_H) && defined (MADV_HUGEPAGE)
+  if (p4est_memory_policy & P4EST_MEMORY_HUGEPAGES) {
+    /* a failure only means that the advice is not followed */
+    (void) madvise ((void *) first, last - first, MADV_HUGEPAGE);
+  }
+#endif
+
+#ifdef P4EST_ENABLE_OPENMP
+  if ((p4est_memory_policy & P4EST_MEMORY_FIRST_TOUCH) &&
+      p4est_num_threads > 1 && !omp_in_parallel ()) {
+    /* the static schedule matches the one of the threaded loops */
+    num_pages = (long) ((last - first) / page_size);
+#pragma omp parallel for num_threads (p4est_num_threads) schedule (static)
+    for (lp = 0; lp < num_pages; ++lp) {
+      *(volatile char *) (first + (size_t) lp * page_size) = 0;
+    }
+  }
+#endif
+}
+
+void
+p4est_array_resize (sc_array_t * array, size_t new_count)
+{
+  size_t              old_count;
+
+  P4EST_ASSERT (array != NULL);
+
+  old_count = array->elem_count;
+  sc_array_resize (array, new_count);
+  if (new_count > old_count) {
+    p4est_memory_place (array->array + old_count * array->elem_size,
+                        (new_count - old_count) * array->elem_size);
+  }
+}
+
+void
+p4est_set_region_hooks (p4est_region_t begin, p4est_region_t end,
+                        void *user)
+{
+  P4EST_ASSERT (!p4est_in_parallel_region ());
+  p4est_region_hooks.begin = begin;
+  p4est_region_hooks.end = end;
+  p4est_region_hooks.user = user;
+}
+
+size_t
+p4est_comm_compress_bound (size_t raw_bytes)
+{
+  /* a payload is sent raw whenever compression does not pay off */
+  return P4EST_COMM_COMPRESS_HEADER + raw_bytes;
+}
+
+#ifdef P4EST_HAVE_ZLIB
+
+/** Round doubles to keep as many mantissa bits as the tolerance needs. */
+static void
+p4est_comm_compress_round (double tolerance, const char *raw,
+                           size_t raw_bytes, char *out)
+{
+  int                 keep;
+  size_t              zz, num_doubles;
+  uint64_t            u, half, mask;
+  double              bound;
+  const uint64_t      exponent = (uint64_t) 0x7ff << 52;
+
+  /* find the mantissa bits that bound the relative error by tolerance */
+  for (keep = 0, bound = .5; keep < 52 && bound > tolerance; ++keep) {
+    bound *= .5;
+  }
+  num_doubles = raw_bytes / sizeof (double);
+  if (keep == 52) {
+    memcpy (out, raw, raw_bytes);
+    return;
+  }
+  mask = ((uint64_t) 1 << (52 - keep)) - 1;
+  half = (uint64_t) 1 << (51 - keep);
+  for (zz = 0; zz < num_doubles; ++zz) {
+    memcpy (&u, raw + zz * sizeof (double), sizeof (double));
+    if ((u & exponent) != exponent) {
+      /* round to nearest unless this would overflow to infinity */
+      u = ((u + half) & exponent) == exponent ? u & ~mask :
+        (u + half) & ~mask;
+    }
+    memcpy (out + zz * sizeof (double), &u, sizeof (double));
+  }
+
+  /* trailing bytes that do not form a double are kept */
+  memcpy (out + num_doubles * sizeof (double),
+          raw + num_doubles * sizeof (double),
+          raw_bytes - num_doubles * sizeof (double));
+}
+
+#endif /* P4EST_HAVE_ZLIB */
+
+size_t
+p4est_comm_compress_pack (p4est_comm_compress_t * compress,
+                          const void *raw, size_t raw_bytes, void *wire)
+{
+  int                 is_raw;
+  uint64_t            header[2];
+  char               *payload = (char *) wire + P4EST_COMM_COMPRESS_HEADER;
+#ifdef P4EST_HAVE_ZLIB
+  int                 zret;
+  char               *rounded;
+  double              max_ratio;
+  uLongf              zlen;
+#endif
+
+  P4EST_ASSERT (compress != NULL);
+  P4EST_ASSERT (raw_bytes == 0 || raw != NULL);
+
+  /* the default is to send the raw payload */
+  is_raw = 1;
+  header[0] = P4EST_COMM_CODEC_NONE;
+  header[1] = raw_bytes;
+#ifdef P4EST_HAVE_ZLIB
+  if (compress->codec != P4EST_COMM_CODEC_NONE &&
+      raw_bytes >= SC_MAX (compress->min_bytes, 1)) {
+    rounded = NULL;
+    if (compress->codec == P4EST_COMM_CODEC_FLOAT) {
+      P4EST_ASSERT (0. < compress->tolerance && compress->tolerance < 1.);
+      rounded = P4EST_ALLOC (char, raw_bytes);
+      p4est_comm_compress_round (compress->tolerance, (const char *) raw,
+                                 raw_bytes, rounded);
+    }
+
+    /* deflation fails if the output would be longer than the input */
+    zlen = (uLongf) raw_bytes;
+    zret = compress2 ((Bytef *) payload, &zlen, (const Bytef *)
+                      (rounded != NULL ? rounded : raw),
+                      (uLong) raw_bytes, Z_BEST_SPEED);
+    max_ratio = compress->max_ratio > 0. ? compress->max_ratio : 1.;
+    if (zret == Z_OK && (double) zlen <= max_ratio * (double) raw_bytes) {
+      is_raw = 0;
+      header[0] = (uint64_t) compress->codec;
+      header[1] = (uint64_t) zlen;
+    }
+    P4EST_FREE (rounded);
+  }
+#endif
+  if (is_raw && raw_bytes > 0) {
+    memcpy (payload, raw, raw_bytes);
+  }
+  memcpy (wire, header, sizeof (header));
+
+  /* record the payload and message sizes */
+  compress->raw_bytes += raw_bytes;
+  compress->wire_bytes += P4EST_COMM_COMPRESS_HEADER + (size_t) header[1];
+  return P4EST_COMM_COMPRESS_HEADER + (size_t) header[1];
+}
+
+void
+p4est_comm_compress_unpack (const void *wire, void *raw, size_t raw_bytes)
+{
+  uint64_t            header[2];
+  const char         *payload =
+    (const char *) wire + P4EST_COMM_COMPRESS_HEADER;
+#ifdef P4EST_HAVE_ZLIB
+  int                 zret;
+  uLongf              zlen;
+#endif
+
+  memcpy (header, wire, sizeof (header));
+  if (header[0] == P4EST_COMM_CODEC_NONE) {
+    SC_CHECK_ABORT (header[1] == raw_bytes, "Raw payload size mismatch");
+    memcpy (raw, payload, raw_bytes);
+    return;
+  }
+  SC_CHECK_ABORT (header[0] == P4EST_COMM_CODEC_DEFLATE ||
+                  header[0] == P4EST_COMM_CODEC_FLOAT,
+                  "Unknown payload codec");
+#ifdef P4EST_HAVE_ZLIB
+  zlen = (uLongf) raw_bytes;
+  zret = uncompress ((Bytef *) raw, &zlen, (const Bytef *) payload,
+                     (uLong) header[1]);
+  SC_CHECK_ABORT (zret == Z_OK && zlen == (uLongf) raw_bytes,
+                  "Payload inflation failed");
+#else
+  SC_ABORT ("Configure did not find a recent enough zlib.  Abort.\n");
+#endif
+}
+
+#ifndef P4EST_CRC32C_SSE42
+#ifndef P4EST_CRC32C_ARMV8
+
+/** Byte table of the reflected Castagnoli polynomial 0x82f63b78. */
+static const uint32_t p4est_crc32c_table[256] = {
+  0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c,
+  0x26a1e7e8, 0xd4ca64eb, 0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b,
+  0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24, 0x105ec76f, 0xe235446c,
+  0xf165b798, 0x030e349b, 0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,
+  0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54, 0x5d1d08bf, 0xaf768bbc,
+  0xbc267848, 0x4e4dfb4b, 0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a,
+  0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35, 0xaa64d611, 0x580f5512,
+  0x4b5fa6e6, 0xb93425e5, 0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,
+  0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45, 0xf779deae, 0x05125dad,
+  0x1642ae59, 0xe4292d5a, 0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a,
+  0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595, 0x417b1dbc, 0xb3109ebf,
+  0xa0406d4b, 0x522bee48, 0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,
+  0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687, 0x0c38d26c, 0xfe53516f,
+  0xed03a29b, 0x1f682198, 0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927,
+  0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38, 0xdbfc821c, 0x2997011f,
+  0x3ac7f2eb, 0xc8ac71e8, 0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,
+  0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096, 0xa65c047d, 0x5437877e,
+  0x4767748a, 0xb50cf789, 0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859,
+  0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46, 0x7198540d, 0x83f3d70e,
+  0x90a324fa, 0x62c8a7f9, 0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,
+  0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36, 0x3cdb9bdd, 0xceb018de,
+  0xdde0eb2a, 0x2f8b6829, 0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c,
+  0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93, 0x082f63b7, 0xfa44e0b4,
+  0xe9141340, 0x1b7f9043, 0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,
+  0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3, 0x55326b08, 0xa759e80b,
+  0xb4091bff, 0x466298fc, 0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c,
+  0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033, 0xa24bb5a6, 0x502036a5,
+  0x4370c551, 0xb11b4652, 0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
+  0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d, 0xef087a76, 0x1d63f975,
+  0x0e330a81, 0xfc588982, 0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d,
+  0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622, 0x38cc2a06, 0xcaa7a905,
+  0xd9f75af1, 0x2b9cd9f2, 0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,
+  0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530, 0x0417b1db, 0xf67c32d8,
+  0xe52cc12c, 0x1747422f, 0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff,
+  0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0, 0xd3d3e1ab, 0x21b862a8,
+  0x32e8915c, 0xc083125f, 0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
+  0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90, 0x9e902e7b, 0x6cfbad78,
+  0x7fab5e8c, 0x8dc0dd8f, 0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee,
+  0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1, 0x69e9f0d5, 0x9b8273d6,
+  0x88d28022, 0x7ab90321, 0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+  0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81, 0x34f4f86a, 0xc69f7b69,
+  0xd5cf889d, 0x27a40b9e, 0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e,
+  0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351
+};
+
+#endif
+#endif
+
+unsigned
+p4est_crc32c (unsigned crc, const void *data, size_t bytes)
+{
+  const unsigned char *p = (const unsigned char *) data;
+  uint32_t            c = ~(uint32_t) crc;
+#if defined P4EST_CRC32C_SSE42 || defined P4EST_CRC32C_ARMV8
+  uint64_t            w;
+
+  for (; bytes >= 8; bytes -= 8, p += 8) {
+    memcpy (&w, p, 8);
+#ifdef P4EST_CRC32C_SSE42
+    c = (uint32_t) _mm_crc32_u64 (c, w);
+#else
+    c = __crc32cd (c, w);
+#endif
+  }
+  for (; bytes > 0; --bytes, ++p) {
+#ifdef P4EST_CRC32C_SSE42
+    c = _mm_crc32_u8 (c, *p);
+#else
+    c = __crc32cb (c, *p);
+#endif
+  }
+#else
+  for (; bytes > 0; --bytes, ++p) {
+    c = p4est_crc32c_table[(c ^ *p) & 0xff] ^ (c >> 8);
+  }
+#endif
+  return (unsigned) ~c;
+}
+
+/** Multiply two polynomials modulo the Castagnoli polynomial.
+ * Both are stored reflected with the coefficient of x^0 in the top bit.
+ */
+static uint32_t
+p4est_crc32c_multmodp (uint32_t a, uint32_t b)
+{
+  uint32_t            m = (uint32_t) 1 << 31;
+  uint32_t            p = 0;
+
+  for (;;) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0) {
+        break;
+      }
+    }
+    m >>= 1;
+    b = (b & 1) ? (b >> 1) ^ 0x82f63b78 : b >> 1;
+  }
+  return p;
+}
+
+unsigned
+p4est_crc32c_combine (unsigned crc1, unsigned crc2, size_t bytes2)
+{
+  int                 k;
+  uint64_t            n = (uint64_t) bytes2;
+  uint32_t            p = (uint32_t) 1 << 31;
+  uint32_t            x2k = (uint32_t) 1 << 30;
+
+  /* raise x to eight times the number of bytes by repeated squaring */
+  for (k = 0; k < 3; ++k) {
+    x2k = p4est_crc32c_multmodp (x2k, x2k);
+  }
+  for (; n > 0; n >>= 1) {
+    if (n & 1) {
+      p = p4est_crc32c_multmodp (x2k, p);
+    }
+    x2k = p4est_crc32c_multmodp (x2k, x2k);
+  }
+  return (unsigned) (p4est_crc32c_multmodp (p, (uint32_t) crc1) ^
+                     (uint32_t) crc2);
+}
+
 #ifndef __cplusplus
 #undef P4EST_GLOBAL_LOGF
 #undef P4EST_LOGF
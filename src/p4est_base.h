@@ -154,6 +154,25 @@ typedef enum p4est_comm_tag
   P4EST_COMM_LNODES_PASS,
   P4EST_COMM_LNODES_OWNED,
   P4EST_COMM_LNODES_ALL,
+  P4EST_COMM_NOTIFY_NODES,
+  P4EST_COMM_GHOST_PLAN,
+  P4EST_COMM_PARTITION_DATA,
+  P4EST_COMM_LNODES_PLAN_OWNED,
+  P4EST_COMM_LNODES_PLAN_ADD,
+  P4EST_COMM_POINTS_COUNT,
+  P4EST_COMM_POINTS_LOAD,
+  P4EST_COMM_CONN_SCATTER,
+  P4EST_COMM_SPARSE_QUERY,
+  P4EST_COMM_SPARSE_REPLY,
+  P4EST_COMM_HIERARCHY_TRANSFER,
+  P4EST_COMM_REMAP_QUERY,
+  P4EST_COMM_REMAP_REPLY,
+  P4EST_COMM_REMAP_DATA,
+  P4EST_COMM_NODE_ORDER,
+  P4EST_COMM_OBJECTS_COUNT,
+  P4EST_COMM_OBJECTS_LOAD,
+  P4EST_COMM_LNODES_OFFSET,
+  P4EST_COMM_GHOST_TYPES,
   P4EST_COMM_TAG_LAST
 }
 p4est_comm_tag_t;
@@ -369,6 +388,271 @@ int                 p4est_have_zlib (void);
  */
 int                 p4est_get_package_id (void);
 
+/** Set the number of threads used by the thread-parallel algorithms.
+ * Currently these are \ref p4est_refine_ext and \ref p4est_coarsen_ext
+ * and their 3D counterparts, which distribute the local trees of the
+ * calling process among the threads.  Thus, the callbacks passed to them
+ * may be called concurrently for different trees and must be thread-safe.
+ * Library code whose callbacks share state, like \ref p4est_wrap_adapt and
+ * \ref p4est_new_points, refines and coarsens with one thread.
+ * The compressed VTK output uses the threads to encode blocks of data.
+ * The layer algorithms of p6est distribute the local columns instead.
+ * The default is one thread, which reproduces the serial behavior.
+ * The setting is ignored unless p4est is configured with OpenMP support,
+ * in which case libsc should be configured with threads as well.
+ * This function must not be called from within a parallel region.
+ * \param [in] num_threads     Positive number of threads.
+ */
+void                p4est_set_num_threads (int num_threads);
+
+/** Query the number of threads used by the thread-parallel algorithms.
+ * \return          The number of threads set by \ref p4est_set_num_threads,
+ *                  or 1 if p4est is configured without OpenMP support.
+ */
+int                 p4est_get_num_threads (void);
+
+/** Query whether the caller runs inside a thread-parallel region.
+ * \return          True if more than one thread may be active right now.
+ *                  Always false if p4est is configured without OpenMP.
+ */
+int                 p4est_in_parallel_region (void);
+
+/** Query the number of the calling thread within a thread-parallel region.
+ * Callbacks of the thread-parallel algorithms may use it to write into
+ * per-thread buffers without locking.
+ * \return          A number in 0 .. \ref p4est_get_num_threads - 1,
+ *                  or 0 outside of a parallel region or without OpenMP.
+ */
+int                 p4est_get_thread_num (void);
+
+/** Flags for placing the large arrays of a forest in memory.
+ * They may be combined by a bitwise or and are set by
+ * \ref p4est_set_memory_policy.
+ */
+typedef enum p4est_memory_policy
+{
+  P4EST_MEMORY_DEFAULT = 0,     /**< Leave the placement to the system */
+  P4EST_MEMORY_HUGEPAGES = 1,   /**< Advise transparent huge pages */
+  P4EST_MEMORY_FIRST_TOUCH = 2  /**< Touch new pages by all threads */
+}
+p4est_memory_policy_t;
+
+/** Arrays smaller than this many bytes are never placed specially. */
+#define P4EST_MEMORY_PLACE_MIN ((size_t) 1 << 21)
+
+/** Set the placement of the large arrays that p4est grows.
+ * These are the quadrant arrays of the trees, the ghost layer and the
+ * arrays created by \ref p4est_array_resize in general.
+ * With P4EST_MEMORY_HUGEPAGES new memory is advised to be backed by
+ * transparent huge pages, which reduces TLB misses on large forests.
+ * With P4EST_MEMORY_FIRST_TOUCH the new pages are touched in a static
+ * schedule by the threads of \ref p4est_set_num_threads, such that on
+ * a NUMA node they are spread over the memory of these threads.
+ * The flags are ignored where the system does not support them.
+ * The default is P4EST_MEMORY_DEFAULT.
+ * This function must not be called from within a parallel region.
+ * \param [in] policy      Bitwise or of \ref p4est_memory_policy_t flags.
+ */
+void                p4est_set_memory_policy (int policy);
+
+/** Query the placement set by \ref p4est_set_memory_policy.
+ * \return          Bitwise or of \ref p4est_memory_policy_t flags.
+ */
+int                 p4est_get_memory_policy (void);
+
+/** Apply the memory policy to a range of memory that is not yet written.
+ * Nothing is done for ranges smaller than \ref P4EST_MEMORY_PLACE_MIN.
+ * The content of the range is undefined afterwards.
+ * \param [in,out] ptr     Start of the range.
+ * \param [in] bytes       Length of the range.
+ */
+void                p4est_memory_place (void *ptr, size_t bytes);
+
+/** Resize an array and apply the memory policy to its new elements.
+ * This is a drop-in replacement for sc_array_resize.
+ * \param [in,out] array   Array that owns its memory.
+ * \param [in] new_count   New number of elements.
+ */
+void                p4est_array_resize (sc_array_t * array,
+                                        size_t new_count);
+
+/** Callback invoked at the boundary of an internal region of p4est.
+ * \param [in] region  Stable name of the region, such as "balance.A" or
+ *                      "ghost.new.mirrors".  The same string literal is
+ *                      passed to the matching begin and end call.
+ * \param [in] user    The pointer registered with the callback.
+ */
+typedef void        (*p4est_region_t) (const char *region, void *user);
+
+/** The region callbacks set by \ref p4est_set_region_hooks. */
+typedef struct p4est_region_hooks
+{
+  p4est_region_t      begin;    /**< Called on entering a region */
+  p4est_region_t      end;      /**< Called on leaving a region */
+  void               *user;     /**< Passed to both callbacks */
+}
+p4est_region_hooks_t;
+
+/** The currently registered region callbacks; read by the macros below. */
+extern p4est_region_hooks_t p4est_region_hooks;
+
+/** Register callbacks that annotate the phases of the internal algorithms.
+ * They are meant to forward the regions to an external profiler.
+ * Regions are properly nested within one call of a blocking algorithm.
+ * The split algorithms, such as \ref p4est_balance_begin and
+ * \ref p4est_ghost_new_begin, close their regions before returning,
+ * such that work done by the application in between is not attributed.
+ * The callbacks are only called from outside of thread-parallel regions.
+ * Without registered callbacks the cost of a region is one branch.
+ * \param [in] begin   Called on entering a region, or NULL.
+ * \param [in] end     Called on leaving a region, or NULL.
+ * \param [in] user    Passed to both callbacks.
+ */
+void                p4est_set_region_hooks (p4est_region_t begin,
+                                            p4est_region_t end, void *user);
+
+/** Mark the begin of an internal region, see \ref p4est_set_region_hooks. */
+#define P4EST_REGION_BEGIN(r)                                           \
+  do {                                                                  \
+    if (p4est_region_hooks.begin != NULL) {                             \
+      p4est_region_hooks.begin ((r), p4est_region_hooks.user);          \
+    }                                                                   \
+  } while (0)
+
+/** Mark the end of an internal region, see \ref p4est_set_region_hooks. */
+#define P4EST_REGION_END(r)                                             \
+  do {                                                                  \
+    if (p4est_region_hooks.end != NULL) {                               \
+      p4est_region_hooks.end ((r), p4est_region_hooks.user);            \
+    }                                                                   \
+  } while (0)
+
+/** Maximum number of threads whose timings are kept in \ref p4est_inspect. */
+#define P4EST_INSPECT_MAX_THREADS 64
+
+/** Algorithms whose cost is recorded in \ref p4est_inspect. */
+typedef enum p4est_inspect_algorithm
+{
+  P4EST_INSPECT_PARTITION = 0,  /**< Partition including the data transfer */
+  P4EST_INSPECT_GHOST,          /**< Construction of the ghost layer */
+  P4EST_INSPECT_GHOST_EXPAND,   /**< Expansion of the ghost layer */
+  P4EST_INSPECT_LNODES,         /**< Construction of lnodes */
+  P4EST_INSPECT_MESH,           /**< Construction of the mesh */
+  P4EST_INSPECT_SEARCH,         /**< Local, partition and all search */
+  P4EST_INSPECT_ITERATE,        /**< Iteration over the forest */
+  P4EST_INSPECT_FILE,           /**< Reading and writing of fields */
+  P4EST_INSPECT_BALANCE,        /**< 2:1 balance including communication */
+  P4EST_INSPECT_TRANSFER,       /**< Transfer of data between partitions */
+  P4EST_INSPECT_NUM_ALGORITHMS  /**< Number of algorithms recorded */
+}
+p4est_inspect_algorithm_t;
+
+/** Cost of one algorithm, accumulated over its calls since the last reset.
+ * Calls nested inside another recorded algorithm count for both.
+ */
+typedef struct p4est_inspect_record
+{
+  size_t              calls;            /**< Number of calls */
+  double              time;             /**< Accumulated wall time */
+  size_t              peers;            /**< Accumulated number of peers */
+  size_t              messages_sent;    /**< Point-to-point sends */
+  size_t              messages_received;        /**< Point-to-point receives */
+  size_t              bytes_sent;       /**< Payload of the sends */
+  size_t              bytes_received;   /**< Payload of the receives */
+  size_t              memory;           /**< Largest memory footprint of a
+                                             structure created by one call */
+  size_t              memory_current;   /**< Transient memory held now */
+  size_t              memory_peak;      /**< Largest transient memory held
+                                             by one call */
+  size_t              peer_sends;       /**< Payloads sent to one peer */
+  size_t              peer_zero_sends;  /**< Of those, the empty ones */
+  size_t              peer_bytes;       /**< Total of the payloads */
+  size_t              peer_bytes_min;   /**< Smallest payload to one peer */
+  size_t              peer_bytes_max;   /**< Largest payload to one peer */
+}
+p4est_inspect_record_t;
+
+/** Codecs for the optional compression of message payloads. */
+typedef enum p4est_comm_codec
+{
+  P4EST_COMM_CODEC_NONE = 0,    /**< Send the raw bytes */
+  P4EST_COMM_CODEC_DEFLATE,     /**< Lossless zlib deflate at its fastest
+                                     level; raw without zlib */
+  P4EST_COMM_CODEC_FLOAT        /**< Payload is an array of doubles that
+                                     are rounded to a relative tolerance
+                                     before deflating */
+}
+p4est_comm_codec_t;
+
+/** Number of bytes that precede every compressed payload. */
+#define P4EST_COMM_COMPRESS_HEADER 16
+
+/** Settings and byte counters for compressed message payloads.
+ * The sender decides for every message: payloads shorter than \a min_bytes
+ * are sent raw, and so are those whose measured compression ratio, wire
+ * bytes over raw bytes, is above \a max_ratio.  The receiver learns the
+ * choice from the message header and needs no settings.
+ */
+typedef struct p4est_comm_compress
+{
+  p4est_comm_codec_t  codec;    /**< Codec to try on every message */
+  size_t              min_bytes;        /**< Smaller payloads are sent raw */
+  double              max_ratio;        /**< Worse ratios are sent raw;
+                                             1 if not positive */
+  double              tolerance;        /**< Relative error bound of the
+                                             float codec, in (0, 1) */
+  size_t              raw_bytes;        /**< Sent payload bytes */
+  size_t              wire_bytes;       /**< Sent bytes including headers */
+}
+p4est_comm_compress_t;
+
+/** Return the number of bytes a payload may occupy on the wire.
+ * \param [in] raw_bytes    Length of the uncompressed payload.
+ * \return                  Size of a receive buffer for the payload.
+ */
+size_t              p4est_comm_compress_bound (size_t raw_bytes);
+
+/** Encode a payload with a header for sending.
+ * \param [in,out] compress Settings; its byte counters are incremented.
+ * \param [in] raw          Payload of \a raw_bytes bytes.
+ * \param [in] raw_bytes    Length of the payload.
+ * \param [out] wire        Buffer of \ref p4est_comm_compress_bound bytes.
+ * \return                  Number of bytes of \a wire to send.
+ */
+size_t              p4est_comm_compress_pack (p4est_comm_compress_t *
+                                              compress, const void *raw,
+                                              size_t raw_bytes, void *wire);
+
+/** Decode a payload encoded by \ref p4est_comm_compress_pack.
+ * Aborts if the message is corrupt or was compressed without zlib support.
+ * \param [in] wire         The received message.
+ * \param [out] raw         Buffer to store the payload into.
+ * \param [in] raw_bytes    Length of the payload that the caller expects.
+ */
+void                p4est_comm_compress_unpack (const void *wire, void *raw,
+                                                size_t raw_bytes);
+
+/** Extend a CRC32C (Castagnoli) checksum by a sequence of bytes.
+ * The result agrees with the iSCSI and ext4 convention; it uses the
+ * SSE 4.2 or ARMv8 CRC instructions if the compiler targets them and
+ * a table otherwise.
+ * \param [in] crc      Checksum of the preceding bytes, 0 to start.
+ * \param [in] data     Bytes to append.
+ * \param [in] bytes    Number of bytes.
+ * \return              Checksum of the preceding and the new bytes.
+ */
+unsigned            p4est_crc32c (unsigned crc, const void *data,
+                                  size_t bytes);
+
+/** Combine the CRC32C checksums of two consecutive byte sequences.
+ * \param [in] crc1     Checksum of the first sequence.
+ * \param [in] crc2     Checksum of the second sequence, started from 0.
+ * \param [in] bytes2   Length of the second sequence.
+ * \return              Checksum of the concatenated sequence.
+ */
+unsigned            p4est_crc32c_combine (unsigned crc1, unsigned crc2,
+                                          size_t bytes2);
+
 /** Compute hash value for two p4est_topidx_t integers.
  * \param [in] tt     Array of (at least) two values.
  * \return            An unsigned hash value.
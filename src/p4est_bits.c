@@ -24,20 +24,31 @@
 
 #ifdef P4_TO_P8
 #include <p8est_bits.h>
+#include <p8est_bits_inline.h>
 #include <p8est_extended.h>
 #else
 #include <p4est_bits.h>
+#include <p4est_bits_inline.h>
 #include <p4est_extended.h>
 #endif /* !P4_TO_P8 */
 
 /* Function declarations for 128 bit unsigned integers
- * are in p{4,8}est_extended.h. */
+ * are in p{4,8}est_extended.h.  In 3D, the arithmetic uses the compiler's
+ * native 128 bit type if P8EST_LID_NATIVE is defined there. */
 int
 p4est_lid_compare (const p4est_lid_t * a, const p4est_lid_t * b)
 {
   P4EST_ASSERT (a != NULL && b != NULL);
 #ifdef P4_TO_P8
+#ifdef P8EST_LID_NATIVE
+  if (p8est_lid_to_native (a) < p8est_lid_to_native (b))
+    return -1;
+  else if (p8est_lid_to_native (b) < p8est_lid_to_native (a))
+    return 1;
+  return 0;
+#else
   return sc_uint128_compare (a, b);
+#endif
 #else
   if (*a < *b)
     return -1;
@@ -145,7 +156,12 @@ p4est_lid_add (const p4est_lid_t * a, const p4est_lid_t * b,
 {
   P4EST_ASSERT (a != NULL && b != NULL);
 #ifdef P4_TO_P8
+#ifdef P8EST_LID_NATIVE
+  p8est_lid_from_native (result, p8est_lid_to_native (a) +
+                         p8est_lid_to_native (b));
+#else
   sc_uint128_add (a, b, result);
+#endif
   P4EST_ASSERT (result != NULL);
 #else
   *result = *a + *b;
@@ -158,7 +174,12 @@ p4est_lid_sub (const p4est_lid_t * a, const p4est_lid_t * b,
 {
   P4EST_ASSERT (a != NULL && b != NULL);
 #ifdef P4_TO_P8
+#ifdef P8EST_LID_NATIVE
+  p8est_lid_from_native (result, p8est_lid_to_native (a) -
+                         p8est_lid_to_native (b));
+#else
   sc_uint128_sub (a, b, result);
+#endif
   P4EST_ASSERT (result != NULL);
 #else
   *result = *a - *b;
@@ -209,7 +230,12 @@ p4est_lid_shift_right (const p4est_lid_t * input, unsigned shift_count,
 {
   P4EST_ASSERT (input != NULL);
 #ifdef P4_TO_P8
+#ifdef P8EST_LID_NATIVE
+  p8est_lid_from_native (result, shift_count >= 128 ? 0 :
+                         p8est_lid_to_native (input) >> shift_count);
+#else
   sc_uint128_shift_right (input, shift_count, result);
+#endif
   P4EST_ASSERT (result != NULL);
 #else
   *result = *input >> shift_count;
@@ -222,7 +248,12 @@ p4est_lid_shift_left (const p4est_lid_t * input, unsigned shift_count,
 {
   P4EST_ASSERT (input != NULL);
 #ifdef P4_TO_P8
+#ifdef P8EST_LID_NATIVE
+  p8est_lid_from_native (result, shift_count >= 128 ? 0 :
+                         p8est_lid_to_native (input) << shift_count);
+#else
   sc_uint128_shift_left (input, shift_count, result);
+#endif
   P4EST_ASSERT (result != NULL);
 #else
   *result = *input << shift_count;
@@ -234,7 +265,12 @@ p4est_lid_add_inplace (p4est_lid_t * a, const p4est_lid_t * b)
 {
   P4EST_ASSERT (a != NULL && b != NULL);
 #ifdef P4_TO_P8
+#ifdef P8EST_LID_NATIVE
+  p8est_lid_from_native (a, p8est_lid_to_native (a) +
+                         p8est_lid_to_native (b));
+#else
   sc_uint128_add_inplace (a, b);
+#endif
 #else
   *a += *b;
 #endif
@@ -245,7 +281,12 @@ p4est_lid_sub_inplace (p4est_lid_t * a, const p4est_lid_t * b)
 {
   P4EST_ASSERT (a != NULL && b != NULL);
 #ifdef P4_TO_P8
+#ifdef P8EST_LID_NATIVE
+  p8est_lid_from_native (a, p8est_lid_to_native (a) -
+                         p8est_lid_to_native (b));
+#else
   sc_uint128_sub_inplace (a, b);
+#endif
 #else
   *a -= *b;
 #endif
@@ -273,14 +314,6 @@ p4est_lid_bitwise_and_inplace (p4est_lid_t * a, const p4est_lid_t * b)
 #endif
 }
 
-static void
-p4est_qcoord_set_bit (p4est_qcoord_t * input, int bit_number)
-{
-  P4EST_ASSERT (input != NULL);
-  P4EST_ASSERT (bit_number >= 0 && bit_number < P4EST_QCOORD_BITS);
-  *input |= ((p4est_qcoord_t) 1) << bit_number;
-}
-
 void
 p4est_quadrant_pad (p4est_quadrant_t * q)
 {
@@ -312,11 +345,7 @@ p4est_quadrant_is_equal (const p4est_quadrant_t * q1,
   P4EST_ASSERT (p4est_quadrant_is_node (q2, 1) ||
                 p4est_quadrant_is_extended (q2));
 
-  return (q1->level == q2->level && q1->x == q2->x && q1->y == q2->y)
-#ifdef P4_TO_P8
-    && (q1->z == q2->z)
-#endif
-    ;
+  return p4est_quadrant_is_equal_inline (q1, q2);
 }
 
 void
@@ -336,18 +365,7 @@ int
 p4est_quadrant_overlaps (const p4est_quadrant_t * q1,
                          const p4est_quadrant_t * q2)
 {
-  int8_t              level = SC_MIN (q1->level, q2->level);
-  p4est_qcoord_t      mask = ~((1 << (P4EST_MAXLEVEL - level)) - 1);
-
-  if (((q1->x ^ q2->x) & mask) || ((q1->y ^ q2->y) & mask)
-#ifdef P4_TO_P8
-      || ((q1->z ^ q2->z) & mask)
-#endif
-      || 0) {
-    return 0;
-  }
-
-  return 1;
+  return p4est_quadrant_overlaps_inline (q1, q2);
 }
 
 int
@@ -362,47 +380,7 @@ int
 p4est_coordinates_compare (const p4est_qcoord_t v1[],
                            const p4est_qcoord_t v2[])
 {
-  uint32_t            exclorx, exclory, exclorxy, exclor;
-#ifdef P4_TO_P8
-  uint32_t            exclorz;
-#endif
-  int64_t             p1, p2, diff;
-
-  /* these are unsigned variables that inherit the sign bits */
-  exclorx = v1[0] ^ v2[0];
-  exclory = v1[1] ^ v2[1];
-  exclor = exclorxy = exclorx | exclory;
-#ifdef P4_TO_P8
-  exclorz = v1[2] ^ v2[2];
-  exclor = exclorxy | exclorz;
-#endif
-
-  if (!exclor) {
-    return 0;
-  }
-
-#ifdef P4_TO_P8
-  /* if (exclor ^ exclorz) > exclorz, then exclorxy has a more significant bit
-   * than exclorz; also exclor and (exclor ^ exclorz) cannot be equal */
-  if (exclorz > (exclor ^ exclorz)) {
-    p1 = v1[2] + ((v1[2] >= 0) ? 0 : ((int64_t) 1 << (P4EST_MAXLEVEL + 2)));
-    p2 = v2[2] + ((v2[2] >= 0) ? 0 : ((int64_t) 1 << (P4EST_MAXLEVEL + 2)));
-  }
-  else
-#if 0
-    ;
-#endif
-#endif
-  if (exclory > (exclorxy ^ exclory)) {
-    p1 = v1[1] + ((v1[1] >= 0) ? 0 : ((int64_t) 1 << (P4EST_MAXLEVEL + 2)));
-    p2 = v2[1] + ((v2[1] >= 0) ? 0 : ((int64_t) 1 << (P4EST_MAXLEVEL + 2)));
-  }
-  else {
-    p1 = v1[0] + ((v1[0] >= 0) ? 0 : ((int64_t) 1 << (P4EST_MAXLEVEL + 2)));
-    p2 = v2[0] + ((v2[0] >= 0) ? 0 : ((int64_t) 1 << (P4EST_MAXLEVEL + 2)));
-  }
-  diff = p1 - p2;
-  return (diff == 0) ? 0 : ((diff < 0) ? -1 : 1);
+  return p4est_coordinates_compare_inline (v1, v2);
 }
 
 int
@@ -411,26 +389,12 @@ p4est_quadrant_compare (const void *v1, const void *v2)
   const p4est_quadrant_t *q1 = (const p4est_quadrant_t *) v1;
   const p4est_quadrant_t *q2 = (const p4est_quadrant_t *) v2;
 
-  p4est_qcoord_t      a[P4EST_DIM], b[P4EST_DIM];
-  int                 coord_diff;
-
   P4EST_ASSERT (p4est_quadrant_is_node (q1, 1) ||
                 p4est_quadrant_is_extended (q1));
   P4EST_ASSERT (p4est_quadrant_is_node (q2, 1) ||
                 p4est_quadrant_is_extended (q2));
 
-  a[0] = q1->x;
-  a[1] = q1->y;
-#ifdef P4_TO_P8
-  a[2] = q1->z;
-#endif
-  b[0] = q2->x;
-  b[1] = q2->y;
-#ifdef P4_TO_P8
-  b[2] = q2->z;
-#endif
-  coord_diff = p4est_coordinates_compare (a, b);
-  return coord_diff ? coord_diff : ((int) q1->level - (int) q2->level);
+  return p4est_quadrant_compare_inline (q1, q2);
 }
 
 int
@@ -631,29 +595,19 @@ p4est_quadrant_contains_node (const p4est_quadrant_t * q,
 int
 p4est_quadrant_ancestor_id (const p4est_quadrant_t * q, int level)
 {
-  int                 id = 0;
-
   P4EST_ASSERT (p4est_quadrant_is_extended (q));
   P4EST_ASSERT (0 <= level && level <= P4EST_MAXLEVEL);
   P4EST_ASSERT ((int) q->level >= level);
 
-  if (level == 0) {
-    return 0;
-  }
-
-  id |= ((q->x & P4EST_QUADRANT_LEN (level)) ? 0x01 : 0);
-  id |= ((q->y & P4EST_QUADRANT_LEN (level)) ? 0x02 : 0);
-#ifdef P4_TO_P8
-  id |= ((q->z & P4EST_QUADRANT_LEN (level)) ? 0x04 : 0);
-#endif
-
-  return id;
+  return p4est_quadrant_ancestor_id_inline (q, level);
 }
 
 int
 p4est_quadrant_child_id (const p4est_quadrant_t * q)
 {
-  return p4est_quadrant_ancestor_id (q, (int) q->level);
+  P4EST_ASSERT (p4est_quadrant_is_extended (q));
+
+  return p4est_quadrant_child_id_inline (q);
 }
 
 int
@@ -672,15 +626,7 @@ p4est_coordinates_is_inside_root (const p4est_qcoord_t coord[])
 int
 p4est_quadrant_is_inside_root (const p4est_quadrant_t * q)
 {
-  p4est_qcoord_t      coord[P4EST_DIM];
-
-  coord[0] = q->x;
-  coord[1] = q->y;
-#ifdef P4_TO_P8
-  coord[2] = q->z;
-#endif
-
-  return p4est_coordinates_is_inside_root (coord);
+  return p4est_quadrant_is_inside_root_inline (q);
 }
 
 int
@@ -907,14 +853,7 @@ p4est_quadrant_is_parent (const p4est_quadrant_t * q,
   P4EST_ASSERT (p4est_quadrant_is_extended (q));
   P4EST_ASSERT (p4est_quadrant_is_extended (r));
 
-  return
-    (q->level + 1 == r->level) &&
-    (q->x == (r->x & ~P4EST_QUADRANT_LEN (r->level))) &&
-    (q->y == (r->y & ~P4EST_QUADRANT_LEN (r->level))) &&
-#ifdef P4_TO_P8
-    (q->z == (r->z & ~P4EST_QUADRANT_LEN (r->level))) &&
-#endif
-    1;
+  return p4est_quadrant_is_parent_inline (q, r);
 }
 
 int
@@ -940,28 +879,10 @@ int
 p4est_quadrant_is_ancestor (const p4est_quadrant_t * q,
                             const p4est_quadrant_t * r)
 {
-  p4est_qcoord_t      exclorx;
-  p4est_qcoord_t      exclory;
-#ifdef P4_TO_P8
-  p4est_qcoord_t      exclorz;
-#endif
-
   P4EST_ASSERT (p4est_quadrant_is_extended (q));
   P4EST_ASSERT (p4est_quadrant_is_extended (r));
 
-  if (q->level >= r->level) {
-    return 0;
-  }
-
-  exclorx = (q->x ^ r->x) >> (P4EST_MAXLEVEL - q->level);
-  exclory = (q->y ^ r->y) >> (P4EST_MAXLEVEL - q->level);
-#ifdef P4_TO_P8
-  exclorz = (q->z ^ r->z) >> (P4EST_MAXLEVEL - q->level);
-
-  return (exclorx == 0 && exclory == 0 && exclorz == 0);
-#else
-  return (exclorx == 0 && exclory == 0);
-#endif
+  return p4est_quadrant_is_ancestor_inline (q, r);
 }
 
 int
@@ -1237,12 +1158,7 @@ p4est_quadrant_parent (const p4est_quadrant_t * q, p4est_quadrant_t * r)
   P4EST_ASSERT (p4est_quadrant_is_extended (q));
   P4EST_ASSERT (q->level > 0);
 
-  r->x = q->x & ~P4EST_QUADRANT_LEN (q->level);
-  r->y = q->y & ~P4EST_QUADRANT_LEN (q->level);
-#ifdef P4_TO_P8
-  r->z = q->z & ~P4EST_QUADRANT_LEN (q->level);
-#endif
-  r->level = (int8_t) (q->level - 1);
+  p4est_quadrant_parent_inline (q, r);
   P4EST_ASSERT (p4est_quadrant_is_extended (r));
 }
 
@@ -1250,23 +1166,11 @@ void
 p4est_quadrant_sibling (const p4est_quadrant_t * q, p4est_quadrant_t * r,
                         int sibling_id)
 {
-  const int           addx = (sibling_id & 0x01);
-  const int           addy = (sibling_id & 0x02) >> 1;
-#ifdef P4_TO_P8
-  const int           addz = (sibling_id & 0x04) >> 2;
-#endif
-  const p4est_qcoord_t shift = P4EST_QUADRANT_LEN (q->level);
-
   P4EST_ASSERT (p4est_quadrant_is_extended (q));
   P4EST_ASSERT (q->level > 0);
   P4EST_ASSERT (sibling_id >= 0 && sibling_id < P4EST_CHILDREN);
 
-  r->x = (addx ? (q->x | shift) : (q->x & ~shift));
-  r->y = (addy ? (q->y | shift) : (q->y & ~shift));
-#ifdef P4_TO_P8
-  r->z = (addz ? (q->z | shift) : (q->z & ~shift));
-#endif
-  r->level = q->level;
+  p4est_quadrant_sibling_inline (q, r, sibling_id);
   P4EST_ASSERT (p4est_quadrant_is_extended (r));
 }
 
@@ -1274,18 +1178,11 @@ void
 p4est_quadrant_child (const p4est_quadrant_t * q, p4est_quadrant_t * r,
                       int child_id)
 {
-  const p4est_qcoord_t shift = P4EST_QUADRANT_LEN (q->level + 1);
-
   P4EST_ASSERT (p4est_quadrant_is_extended (q));
   P4EST_ASSERT (q->level < P4EST_QMAXLEVEL);
   P4EST_ASSERT (child_id >= 0 && child_id < P4EST_CHILDREN);
 
-  r->x = child_id & 0x01 ? (q->x | shift) : q->x;
-  r->y = child_id & 0x02 ? (q->y | shift) : q->y;
-#ifdef P4_TO_P8
-  r->z = child_id & 0x04 ? (q->z | shift) : q->z;
-#endif
-  r->level = q->level + 1;
+  p4est_quadrant_child_inline (q, r, child_id);
   P4EST_ASSERT (p4est_quadrant_is_parent (q, r));
 }
 
@@ -1293,17 +1190,10 @@ void
 p4est_quadrant_face_neighbor (const p4est_quadrant_t * q,
                               int face, p4est_quadrant_t * r)
 {
-  const p4est_qcoord_t qh = P4EST_QUADRANT_LEN (q->level);
-
   P4EST_ASSERT (0 <= face && face < P4EST_FACES);
   P4EST_ASSERT (p4est_quadrant_is_valid (q));
 
-  r->x = q->x + ((face == 0) ? -qh : (face == 1) ? qh : 0);
-  r->y = q->y + ((face == 2) ? -qh : (face == 3) ? qh : 0);
-#ifdef P4_TO_P8
-  r->z = q->z + ((face == 4) ? -qh : (face == 5) ? qh : 0);
-#endif
-  r->level = q->level;
+  p4est_quadrant_face_neighbor_inline (q, face, r);
   P4EST_ASSERT (p4est_quadrant_is_extended (r));
 }
 
@@ -1338,7 +1228,7 @@ p4est_quadrant_face_neighbor_extra (const p4est_quadrant_t * q,
   }
   p4est_quadrant_transform_face (&temp, r, transform);
   if (nface != NULL) {
-    *nface = (int) conn->tree_to_face[t * P4EST_FACES + face];
+    p4est_connectivity_face_neighbor_tree (conn, t, face, nface);
   }
 
   return flag;
@@ -1528,12 +1418,13 @@ p4est_quadrant_corner_neighbor_extra (const p4est_quadrant_t * q,
       }
       else if (ncorners != NULL) {
         int                 opc = (corner ^ 1);
-        int                 nface =
-          conn->tree_to_face[P4EST_FACES * t + face];
-        int                 o = nface / P4EST_FACES;
+        int                 nface;
+        int                 o;
         int                 nc;
         int                 c;
 
+        p4est_connectivity_face_neighbor_tree (conn, t, face, &nface);
+        o = nface / P4EST_FACES;
         nface = nface % P4EST_FACES;
         nc = p4est_corner_face_corners[opc][face];
 
@@ -1558,11 +1449,13 @@ p4est_quadrant_corner_neighbor_extra (const p4est_quadrant_t * q,
     }
     else if (ncorners != NULL) {
       int                 opc = (corner ^ 2);
-      int                 nface = conn->tree_to_face[P4EST_FACES * t + face];
-      int                 o = nface / P4EST_FACES;
+      int                 nface;
+      int                 o;
       int                 nc;
       int                 c;
 
+      p4est_connectivity_face_neighbor_tree (conn, t, face, &nface);
+      o = nface / P4EST_FACES;
       nface = nface % P4EST_FACES;
       nc = p4est_corner_face_corners[opc][face];
 
@@ -1765,31 +1658,17 @@ p4est_quadrant_first_descendant (const p4est_quadrant_t * q,
   P4EST_ASSERT (p4est_quadrant_is_extended (q));
   P4EST_ASSERT ((int) q->level <= level && level <= P4EST_QMAXLEVEL);
 
-  fd->x = q->x;
-  fd->y = q->y;
-#ifdef P4_TO_P8
-  fd->z = q->z;
-#endif
-  fd->level = (int8_t) level;
+  p4est_quadrant_first_descendant_inline (q, fd, level);
 }
 
 void
 p4est_quadrant_last_descendant (const p4est_quadrant_t * q,
                                 p4est_quadrant_t * ld, int level)
 {
-  p4est_qcoord_t      shift;
-
   P4EST_ASSERT (p4est_quadrant_is_extended (q));
   P4EST_ASSERT ((int) q->level <= level && level <= P4EST_QMAXLEVEL);
 
-  shift = P4EST_QUADRANT_LEN (q->level) - P4EST_QUADRANT_LEN (level);
-
-  ld->x = q->x + shift;
-  ld->y = q->y + shift;
-#ifdef P4_TO_P8
-  ld->z = q->z + shift;
-#endif
-  ld->level = (int8_t) level;
+  p4est_quadrant_last_descendant_inline (q, ld, level);
 }
 
 void
@@ -2232,65 +2111,84 @@ p4est_quadrant_shift_corner (const p4est_quadrant_t * q,
 uint64_t
 p4est_quadrant_linear_id (const p4est_quadrant_t * quadrant, int level)
 {
-  int                 i;
-  uint64_t            id;
-  uint64_t            x, y;
-#ifdef P4_TO_P8
-  uint64_t            z;
-#endif
-
   P4EST_ASSERT (p4est_quadrant_is_extended (quadrant));
   P4EST_ASSERT (0 <= level && level <= P4EST_OLD_MAXLEVEL);
 
-  /* this preserves the high bits from negative numbers */
-  x = quadrant->x >> (P4EST_MAXLEVEL - level);
-  y = quadrant->y >> (P4EST_MAXLEVEL - level);
+  return p4est_quadrant_linear_id_inline (quadrant, level);
+}
+
+/** Encode extended coordinates shifted to the grid level into an id.
+ * \param [in] qx, qy, qz  Coordinates divided by the grid cell length.
+ * \param [in] mask     Keep the lowest level + 2 bits of each coordinate.
+ */
+static inline void
+p4est_lid_encode (p4est_qcoord_t qx, p4est_qcoord_t qy,
 #ifdef P4_TO_P8
-  z = quadrant->z >> (P4EST_MAXLEVEL - level);
+                  p4est_qcoord_t qz,
 #endif
-
-  id = 0;
-  for (i = 0; i < level + 2; ++i) {
-    id |= ((x & ((uint64_t) 1 << i)) << ((P4EST_DIM - 1) * i));
-    id |= ((y & ((uint64_t) 1 << i)) << ((P4EST_DIM - 1) * i + 1));
+                  uint64_t mask, p4est_lid_t * id)
+{
+  uint64_t            x, y;
 #ifdef P4_TO_P8
-    id |= ((z & ((uint64_t) 1 << i)) << ((P4EST_DIM - 1) * i + 2));
+  uint64_t            z, high;
 #endif
-  }
 
-  return id;
+  x = (uint64_t) qx & mask;
+  y = (uint64_t) qy & mask;
+#ifndef P4_TO_P8
+  *id = p4est_linear_id_spread (x) | (p4est_linear_id_spread (y) << 1);
+#else
+  z = (uint64_t) qz & mask;
+
+  /* the lowest 21 bits of each coordinate fill bits 0 to 62 of the id */
+  id->low_bits = p4est_linear_id_spread (x) |
+    (p4est_linear_id_spread (y) << 1) | (p4est_linear_id_spread (z) << 2);
+  high = p4est_linear_id_spread (x >> 21) |
+    (p4est_linear_id_spread (y >> 21) << 1) |
+    (p4est_linear_id_spread (z >> 21) << 2);
+  id->low_bits |= high << 63;
+  id->high_bits = high >> 1;
+#endif
 }
 
 void
 p4est_quadrant_linear_id_ext128 (const p4est_quadrant_t *
                                  quadrant, int level, p4est_lid_t * id)
 {
-  int                 i;
-  uint64_t            x, y;
-#ifdef P4_TO_P8
-  uint64_t            z;
-#endif
+  int                 shift;
 
   P4EST_ASSERT (p4est_quadrant_is_extended (quadrant));
   P4EST_ASSERT (0 <= level && level <= P4EST_MAXLEVEL);
 
   /* this preserves the high bits from negative numbers */
-  x = quadrant->x >> (P4EST_MAXLEVEL - level);
-  y = quadrant->y >> (P4EST_MAXLEVEL - level);
+  shift = P4EST_MAXLEVEL - level;
+  p4est_lid_encode (quadrant->x >> shift, quadrant->y >> shift,
 #ifdef P4_TO_P8
-  z = quadrant->z >> (P4EST_MAXLEVEL - level);
+                    quadrant->z >> shift,
 #endif
+                    ((uint64_t) 1 << (level + 2)) - 1, id);
+}
+
+void
+p4est_quadrant_linear_id_ext128_batch (const p4est_quadrant_t * quadrants,
+                                       size_t n, int level, p4est_lid_t * id)
+{
+  size_t              iz;
+  int                 shift;
+  uint64_t            mask;
+
+  P4EST_ASSERT (0 <= level && level <= P4EST_MAXLEVEL);
 
-  p4est_lid_set_zero (id);
-  for (i = 0; i < level + 2; ++i) {
-    if (x & ((uint64_t) 1 << i))
-      p4est_lid_set_bit (id, P4EST_DIM * i);
-    if (y & ((uint64_t) 1 << i))
-      p4est_lid_set_bit (id, P4EST_DIM * i + 1);
+  /* as in p4est_quadrant_linear_id_ext128 */
+  shift = P4EST_MAXLEVEL - level;
+  mask = ((uint64_t) 1 << (level + 2)) - 1;
+  for (iz = 0; iz < n; ++iz) {
+    P4EST_ASSERT (p4est_quadrant_is_extended (&quadrants[iz]));
+    p4est_lid_encode (quadrants[iz].x >> shift, quadrants[iz].y >> shift,
 #ifdef P4_TO_P8
-    if (z & ((uint64_t) 1 << i))
-      p4est_lid_set_bit (id, P4EST_DIM * i + 2);
+                      quadrants[iz].z >> shift,
 #endif
+                      mask, &id[iz]);
   }
 }
 
@@ -2298,35 +2196,12 @@ void
 p4est_quadrant_set_morton (p4est_quadrant_t * quadrant,
                            int level, uint64_t id)
 {
-  int                 i;
-
   P4EST_ASSERT (0 <= level && level <= P4EST_OLD_QMAXLEVEL);
   P4EST_ASSERT (id < ((uint64_t) 1 << P4EST_DIM * (level + 2)));
 
-  quadrant->level = (int8_t) level;
-  quadrant->x = 0;
-  quadrant->y = 0;
-#ifdef P4_TO_P8
-  quadrant->z = 0;
-#endif
-
-  /* this may set the sign bit to create negative numbers */
-  for (i = 0; i < level + 2; ++i) {
-    quadrant->x |= (p4est_qcoord_t) ((id & (1ULL << (P4EST_DIM * i)))
-                                     >> ((P4EST_DIM - 1) * i));
-    quadrant->y |= (p4est_qcoord_t) ((id & (1ULL << (P4EST_DIM * i + 1)))
-                                     >> ((P4EST_DIM - 1) * i + 1));
-#ifdef P4_TO_P8
-    quadrant->z |= (p4est_qcoord_t) ((id & (1ULL << (P4EST_DIM * i + 2)))
-                                     >> ((P4EST_DIM - 1) * i + 2));
-#endif
-  }
+  p4est_quadrant_set_morton_inline (quadrant, level, id);
 
-  quadrant->x <<= (P4EST_MAXLEVEL - level);
-  quadrant->y <<= (P4EST_MAXLEVEL - level);
 #ifdef P4_TO_P8
-  quadrant->z <<= (P4EST_MAXLEVEL - level);
-
 #if P4EST_MAXLEVEL < 30         /* This is never true on purpose. */
   SC_ABORT_NOT_REACHED ();
   /* this was needed when number of bits could be more than MAXLEVEL + 2 */
@@ -2342,43 +2217,187 @@ p4est_quadrant_set_morton (p4est_quadrant_t * quadrant,
   P4EST_ASSERT (p4est_quadrant_is_extended (quadrant));
 }
 
+/** Shift negative coordinates of extended quadrants beyond the root.
+ * This reproduces the unsigned ordering of \ref p4est_coordinates_compare.
+ */
+static inline int64_t
+p4est_coordinate_key (p4est_qcoord_t c)
+{
+  return (int64_t) c + ((int64_t) (c < 0) << (P4EST_MAXLEVEL + 2));
+}
+
 void
-p4est_quadrant_set_morton_ext128 (p4est_quadrant_t * quadrant,
-                                  int level, const p4est_lid_t * id)
+p4est_quadrant_compare_batch (const p4est_quadrant_t * q,
+                              const p4est_quadrant_t * r, size_t n,
+                              int8_t * result)
 {
-  int                 i;
-#ifdef P4EST_ENABLE_DEBUG
-  p4est_lid_t         one, temp_lid;
+  size_t              iz;
+  uint32_t            exclorx, exclory, exclorxy;
+#ifdef P4_TO_P8
+  uint32_t            exclorz, exclor;
+#endif
+  int64_t             p1, p2;
+  int64_t             kx, ky;
+#ifdef P4_TO_P8
+  int64_t             kz;
 #endif
 
-  P4EST_ASSERT (0 <= level && level <= P4EST_QMAXLEVEL);
+  P4EST_ASSERT (p4est_quadrant_is_node (q, 1) ||
+                p4est_quadrant_is_extended (q));
 
-#ifdef P4EST_ENABLE_DEBUG
-  p4est_lid_set_one (&one);
-  p4est_lid_shift_left (&one, P4EST_DIM * (level + 2), &(temp_lid));
-  P4EST_ASSERT (p4est_lid_compare (id, &temp_lid) < 0);
+  /* the keys of q are the same for all comparisons */
+  kx = p4est_coordinate_key (q->x);
+  ky = p4est_coordinate_key (q->y);
+#ifdef P4_TO_P8
+  kz = p4est_coordinate_key (q->z);
 #endif
 
-  quadrant->level = (int8_t) level;
-  quadrant->x = 0;
-  quadrant->y = 0;
+  for (iz = 0; iz < n; ++iz) {
+    P4EST_ASSERT (p4est_quadrant_is_node (&r[iz], 1) ||
+                  p4est_quadrant_is_extended (&r[iz]));
+
+    /* select the coordinate containing the most significant differing bit */
+    exclorx = q->x ^ r[iz].x;
+    exclory = q->y ^ r[iz].y;
+    exclorxy = exclorx | exclory;
+    p1 = (exclory > (exclorxy ^ exclory)) ? ky : kx;
+    p2 = (exclory > (exclorxy ^ exclory)) ?
+      p4est_coordinate_key (r[iz].y) : p4est_coordinate_key (r[iz].x);
 #ifdef P4_TO_P8
-  quadrant->z = 0;
+    exclorz = q->z ^ r[iz].z;
+    exclor = exclorxy | exclorz;
+    p1 = (exclorz > (exclor ^ exclorz)) ? kz : p1;
+    p2 = (exclorz > (exclor ^ exclorz)) ? p4est_coordinate_key (r[iz].z) : p2;
 #endif
 
-  /* this may set the sign bit to create negative numbers */
-  for (i = 0; i < level + 2; ++i) {
-    if (p4est_lid_chk_bit (id, P4EST_DIM * i))
-      p4est_qcoord_set_bit (&quadrant->x, i);
+    /* equal coordinates are ordered by level */
+    result[iz] = (int8_t) ((p1 != p2) ? ((p1 > p2) - (p1 < p2)) :
+                           ((q->level > r[iz].level) -
+                            (q->level < r[iz].level)));
+  }
+}
+
+void
+p4est_quadrant_is_ancestor_batch (const p4est_quadrant_t * q,
+                                  const p4est_quadrant_t * r, size_t n,
+                                  int8_t * result)
+{
+  size_t              iz;
+  int                 shift;
+
+  P4EST_ASSERT (p4est_quadrant_is_extended (q));
+
+  shift = P4EST_MAXLEVEL - q->level;
+  for (iz = 0; iz < n; ++iz) {
+    P4EST_ASSERT (p4est_quadrant_is_extended (&r[iz]));
+    result[iz] = (int8_t) (q->level < r[iz].level &&
+                           ((q->x ^ r[iz].x) >> shift) == 0 &&
+                           ((q->y ^ r[iz].y) >> shift) == 0
+#ifdef P4_TO_P8
+                           && ((q->z ^ r[iz].z) >> shift) == 0
+#endif
+      );
+  }
+}
 
-    if (p4est_lid_chk_bit (id, P4EST_DIM * i + 1))
-      p4est_qcoord_set_bit (&quadrant->y, i);
+void
+p4est_quadrant_overlaps_batch (const p4est_quadrant_t * q,
+                               const p4est_quadrant_t * r, size_t n,
+                               int8_t * result)
+{
+  size_t              iz;
+  int8_t              level;
+  p4est_qcoord_t      mask;
 
+  for (iz = 0; iz < n; ++iz) {
+    level = SC_MIN (q->level, r[iz].level);
+    mask = ~((1 << (P4EST_MAXLEVEL - level)) - 1);
+    result[iz] = (int8_t) (((q->x ^ r[iz].x) & mask) == 0 &&
+                           ((q->y ^ r[iz].y) & mask) == 0
 #ifdef P4_TO_P8
-    if (p4est_lid_chk_bit (id, P4EST_DIM * i + 2))
-      p4est_qcoord_set_bit (&quadrant->z, i);
+                           && ((q->z ^ r[iz].z) & mask) == 0
 #endif
+      );
   }
+}
+
+void
+p4est_quadrant_linear_id_batch (const p4est_quadrant_t * r, size_t n,
+                                int level, uint64_t * id)
+{
+  size_t              iz;
+  int                 shift;
+  uint64_t            mask;
+
+  P4EST_ASSERT (0 <= level && level <= P4EST_OLD_MAXLEVEL);
+
+  /* as in p4est_quadrant_linear_id, keep level + 2 bits per coordinate */
+  shift = P4EST_MAXLEVEL - level;
+  mask = ((uint64_t) 1 << (level + 2)) - 1;
+  for (iz = 0; iz < n; ++iz) {
+    P4EST_ASSERT (p4est_quadrant_is_extended (&r[iz]));
+    id[iz] = p4est_linear_id_spread ((uint64_t) (r[iz].x >> shift) & mask)
+      | (p4est_linear_id_spread ((uint64_t) (r[iz].y >> shift) & mask) << 1)
+#ifdef P4_TO_P8
+      | (p4est_linear_id_spread ((uint64_t) (r[iz].z >> shift) & mask) << 2)
+#endif
+      ;
+  }
+}
+
+void
+p4est_quadrant_set_morton_batch (p4est_quadrant_t * quadrants, size_t n,
+                                 int level, const uint64_t * id)
+{
+  size_t              iz;
+  int                 shift;
+
+  P4EST_ASSERT (0 <= level && level <= P4EST_OLD_QMAXLEVEL);
+
+  /* as in p4est_quadrant_set_morton, the sign bit may be set */
+  shift = P4EST_MAXLEVEL - level;
+  for (iz = 0; iz < n; ++iz) {
+    P4EST_ASSERT (id[iz] < ((uint64_t) 1 << P4EST_DIM * (level + 2)));
+    quadrants[iz].level = (int8_t) level;
+    quadrants[iz].x = (p4est_qcoord_t)
+      ((uint32_t) p4est_linear_id_squeeze (id[iz]) << shift);
+    quadrants[iz].y = (p4est_qcoord_t)
+      ((uint32_t) p4est_linear_id_squeeze (id[iz] >> 1) << shift);
+#ifdef P4_TO_P8
+    quadrants[iz].z = (p4est_qcoord_t)
+      ((uint32_t) p4est_linear_id_squeeze (id[iz] >> 2) << shift);
+#endif
+    P4EST_ASSERT (p4est_quadrant_is_extended (&quadrants[iz]));
+  }
+}
+
+/** Set the coordinates and level of a quadrant from a linear position.
+ * The assertions on the range of the id are left to the caller.
+ */
+static inline void
+p4est_lid_decode (p4est_quadrant_t * quadrant, int level,
+                  const p4est_lid_t * id)
+{
+#ifdef P4_TO_P8
+  uint64_t            low, high;
+#endif
+
+  /* this may set the sign bit to create negative numbers */
+  quadrant->level = (int8_t) level;
+#ifndef P4_TO_P8
+  quadrant->x = (p4est_qcoord_t) p4est_linear_id_squeeze (*id);
+  quadrant->y = (p4est_qcoord_t) p4est_linear_id_squeeze (*id >> 1);
+#else
+  /* bits 0 to 62 of the id hold the lowest 21 bits of each coordinate */
+  low = id->low_bits & ~((uint64_t) 1 << 63);
+  high = (id->high_bits << 1) | (id->low_bits >> 63);
+  quadrant->x = (p4est_qcoord_t) (p4est_linear_id_squeeze (low) |
+                                  (p4est_linear_id_squeeze (high) << 21));
+  quadrant->y = (p4est_qcoord_t) (p4est_linear_id_squeeze (low >> 1) |
+                                  (p4est_linear_id_squeeze (high >> 1) << 21));
+  quadrant->z = (p4est_qcoord_t) (p4est_linear_id_squeeze (low >> 2) |
+                                  (p4est_linear_id_squeeze (high >> 2) << 21));
+#endif
 
   quadrant->x <<= (P4EST_MAXLEVEL - level);
   quadrant->y <<= (P4EST_MAXLEVEL - level);
@@ -2400,6 +2419,47 @@ p4est_quadrant_set_morton_ext128 (p4est_quadrant_t * quadrant,
   P4EST_ASSERT (p4est_quadrant_is_extended (quadrant));
 }
 
+void
+p4est_quadrant_set_morton_ext128 (p4est_quadrant_t * quadrant,
+                                  int level, const p4est_lid_t * id)
+{
+#ifdef P4EST_ENABLE_DEBUG
+  p4est_lid_t         one, temp_lid;
+#endif
+
+  P4EST_ASSERT (0 <= level && level <= P4EST_QMAXLEVEL);
+
+#ifdef P4EST_ENABLE_DEBUG
+  p4est_lid_set_one (&one);
+  p4est_lid_shift_left (&one, P4EST_DIM * (level + 2), &(temp_lid));
+  P4EST_ASSERT (p4est_lid_compare (id, &temp_lid) < 0);
+#endif
+
+  p4est_lid_decode (quadrant, level, id);
+}
+
+void
+p4est_quadrant_set_morton_ext128_batch (p4est_quadrant_t * quadrants,
+                                        size_t n, int level,
+                                        const p4est_lid_t * id)
+{
+  size_t              iz;
+#ifdef P4EST_ENABLE_DEBUG
+  p4est_lid_t         one, temp_lid;
+#endif
+
+  P4EST_ASSERT (0 <= level && level <= P4EST_QMAXLEVEL);
+
+#ifdef P4EST_ENABLE_DEBUG
+  p4est_lid_set_one (&one);
+  p4est_lid_shift_left (&one, P4EST_DIM * (level + 2), &(temp_lid));
+#endif
+  for (iz = 0; iz < n; ++iz) {
+    P4EST_ASSERT (p4est_lid_compare (&id[iz], &temp_lid) < 0);
+    p4est_lid_decode (&quadrants[iz], level, &id[iz]);
+  }
+}
+
 void
 p4est_quadrant_successor (const p4est_quadrant_t * quadrant,
                           p4est_quadrant_t * result)
@@ -2499,6 +2559,189 @@ p4est_quadrant_predecessor (const p4est_quadrant_t * quadrant,
   P4EST_ASSERT (p4est_quadrant_is_extended (result));
 }
 
+/** Map fine grid coordinates to the transposed Hilbert index in place.
+ * This follows Skilling's algorithm with P4EST_QMAXLEVEL bits per axis.
+ */
+static void
+p4est_hilbert_axes_to_transpose (uint32_t X[P4EST_DIM])
+{
+  int                 i;
+  uint32_t            P, Q, t;
+  const uint32_t      M = (uint32_t) 1 << (P4EST_QMAXLEVEL - 1);
+
+  /* inverse undo */
+  for (Q = M; Q > 1; Q >>= 1) {
+    P = Q - 1;
+    for (i = 0; i < P4EST_DIM; ++i) {
+      if (X[i] & Q) {
+        X[0] ^= P;
+      }
+      else {
+        t = (X[0] ^ X[i]) & P;
+        X[0] ^= t;
+        X[i] ^= t;
+      }
+    }
+  }
+
+  /* Gray encode */
+  for (i = 1; i < P4EST_DIM; ++i) {
+    X[i] ^= X[i - 1];
+  }
+  t = 0;
+  for (Q = M; Q > 1; Q >>= 1) {
+    if (X[P4EST_DIM - 1] & Q) {
+      t ^= Q - 1;
+    }
+  }
+  for (i = 0; i < P4EST_DIM; ++i) {
+    X[i] ^= t;
+  }
+}
+
+/** Inverse of \ref p4est_hilbert_axes_to_transpose. */
+static void
+p4est_hilbert_transpose_to_axes (uint32_t X[P4EST_DIM])
+{
+  int                 i;
+  uint32_t            P, Q, t;
+  const uint32_t      N = (uint32_t) 2 << (P4EST_QMAXLEVEL - 1);
+
+  /* Gray decode */
+  t = X[P4EST_DIM - 1] >> 1;
+  for (i = P4EST_DIM - 1; i > 0; --i) {
+    X[i] ^= X[i - 1];
+  }
+  X[0] ^= t;
+
+  /* undo excess work */
+  for (Q = 2; Q != N; Q <<= 1) {
+    P = Q - 1;
+    for (i = P4EST_DIM - 1; i >= 0; --i) {
+      if (X[i] & Q) {
+        X[0] ^= P;
+      }
+      else {
+        t = (X[0] ^ X[i]) & P;
+        X[0] ^= t;
+        X[i] ^= t;
+      }
+    }
+  }
+}
+
+uint64_t
+p4est_quadrant_hilbert_id (const p4est_quadrant_t * quadrant, int level)
+{
+  int                 i, j;
+  uint32_t            X[P4EST_DIM];
+  uint64_t            id;
+
+  P4EST_ASSERT (p4est_quadrant_is_valid (quadrant));
+  P4EST_ASSERT (0 <= level && level <= (int) quadrant->level);
+
+  /* any cell inside the quadrant yields the same leading index bits */
+  X[0] = (uint32_t) (quadrant->x >> (P4EST_MAXLEVEL - P4EST_QMAXLEVEL));
+  X[1] = (uint32_t) (quadrant->y >> (P4EST_MAXLEVEL - P4EST_QMAXLEVEL));
+#ifdef P4_TO_P8
+  X[2] = (uint32_t) (quadrant->z >> (P4EST_MAXLEVEL - P4EST_QMAXLEVEL));
+#endif
+  p4est_hilbert_axes_to_transpose (X);
+
+  /* interleave the leading bits of the transposed index */
+  id = 0;
+  for (j = P4EST_QMAXLEVEL - 1; j >= P4EST_QMAXLEVEL - level; --j) {
+    for (i = 0; i < P4EST_DIM; ++i) {
+      id = (id << 1) | (uint64_t) ((X[i] >> j) & 1);
+    }
+  }
+
+  return id;
+}
+
+void
+p4est_quadrant_set_hilbert (p4est_quadrant_t * quadrant,
+                            int level, uint64_t id)
+{
+  int                 i, j;
+  uint32_t            X[P4EST_DIM];
+  p4est_qcoord_t      mask;
+
+  P4EST_ASSERT (0 <= level && level <= P4EST_QMAXLEVEL);
+  P4EST_ASSERT (id < ((uint64_t) 1 << P4EST_DIM * level));
+
+  /* distribute the index bits onto the transposed form */
+  for (i = 0; i < P4EST_DIM; ++i) {
+    X[i] = 0;
+  }
+  for (j = P4EST_QMAXLEVEL - level; j < P4EST_QMAXLEVEL; ++j) {
+    for (i = P4EST_DIM - 1; i >= 0; --i) {
+      X[i] |= (uint32_t) (id & 1) << j;
+      id >>= 1;
+    }
+  }
+  p4est_hilbert_transpose_to_axes (X);
+
+  /* the lowest bits identify a cell inside the quadrant; clear them */
+  mask = ~(P4EST_QUADRANT_LEN (level) - 1);
+  quadrant->level = (int8_t) level;
+  quadrant->x =
+    ((p4est_qcoord_t) X[0] << (P4EST_MAXLEVEL - P4EST_QMAXLEVEL)) & mask;
+  quadrant->y =
+    ((p4est_qcoord_t) X[1] << (P4EST_MAXLEVEL - P4EST_QMAXLEVEL)) & mask;
+#ifdef P4_TO_P8
+  quadrant->z =
+    ((p4est_qcoord_t) X[2] << (P4EST_MAXLEVEL - P4EST_QMAXLEVEL)) & mask;
+#endif
+
+  P4EST_ASSERT (p4est_quadrant_is_valid (quadrant));
+}
+
+int
+p4est_quadrant_compare_hilbert (const void *v1, const void *v2)
+{
+  const p4est_quadrant_t *q1 = (const p4est_quadrant_t *) v1;
+  const p4est_quadrant_t *q2 = (const p4est_quadrant_t *) v2;
+  int                 level;
+  uint64_t            id1, id2;
+
+  /* compare the common ancestor level first, then ancestors before
+   * their descendants as in \ref p4est_quadrant_compare */
+  level = (int) SC_MIN (q1->level, q2->level);
+  id1 = p4est_quadrant_hilbert_id (q1, level);
+  id2 = p4est_quadrant_hilbert_id (q2, level);
+  if (id1 != id2) {
+    return id1 < id2 ? -1 : 1;
+  }
+  return (int) q1->level - (int) q2->level;
+}
+
+void
+p4est_quadrant_hilbert_successor (const p4est_quadrant_t * quadrant,
+                                  p4est_quadrant_t * result)
+{
+  uint64_t            id;
+
+  P4EST_ASSERT (p4est_quadrant_is_valid (quadrant));
+
+  id = p4est_quadrant_hilbert_id (quadrant, quadrant->level);
+  P4EST_ASSERT (id + 1 < ((uint64_t) 1 << P4EST_DIM * quadrant->level));
+  p4est_quadrant_set_hilbert (result, quadrant->level, id + 1);
+}
+
+void
+p4est_quadrant_hilbert_predecessor (const p4est_quadrant_t * quadrant,
+                                    p4est_quadrant_t * result)
+{
+  uint64_t            id;
+
+  P4EST_ASSERT (p4est_quadrant_is_valid (quadrant));
+
+  id = p4est_quadrant_hilbert_id (quadrant, quadrant->level);
+  P4EST_ASSERT (id > 0);
+  p4est_quadrant_set_hilbert (result, quadrant->level, id - 1);
+}
+
 void
 p4est_quadrant_srand (const p4est_quadrant_t * q, sc_rand_state_t * rstate)
 {
@@ -0,0 +1,317 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+/** \file p4est_bits_inline.h
+ *
+ * Header-only versions of the most frequently called quadrant routines.
+ *
+ * The functions in \ref p4est_bits.h are compiled into the library and
+ * cannot be inlined into other translation units without link-time
+ * optimization.  The functions below compute the same results with the
+ * dimension and the maximum level known at compile time and are defined
+ * static inline, such that loops in the library and in user code can
+ * inline them.  They do not verify their input; the out-of-line versions
+ * in \ref p4est_bits.h assert validity and then call these.
+ *
+ * \ingroup p4est
+ */
+
+#ifndef P4EST_BITS_INLINE_H
+#define P4EST_BITS_INLINE_H
+
+#include <p4est.h>
+
+SC_EXTERN_C_BEGIN;
+
+/** Spread the lowest 32 bits of a word to every second bit position. */
+/*@unused@*/
+static inline       uint64_t
+p4est_linear_id_spread (uint64_t v)
+{
+  v &= 0x00000000ffffffffULL;
+  v = (v | (v << 16)) & 0x0000ffff0000ffffULL;
+  v = (v | (v << 8)) & 0x00ff00ff00ff00ffULL;
+  v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  v = (v | (v << 2)) & 0x3333333333333333ULL;
+  v = (v | (v << 1)) & 0x5555555555555555ULL;
+  return v;
+}
+
+/** Collect every second bit of a word into its lowest bits.
+ * This is the inverse of \ref p4est_linear_id_spread.
+ */
+/*@unused@*/
+static inline       uint64_t
+p4est_linear_id_squeeze (uint64_t v)
+{
+  v &= 0x5555555555555555ULL;
+  v = (v | (v >> 1)) & 0x3333333333333333ULL;
+  v = (v | (v >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+  v = (v | (v >> 4)) & 0x00ff00ff00ff00ffULL;
+  v = (v | (v >> 8)) & 0x0000ffff0000ffffULL;
+  v = (v | (v >> 16)) & 0x00000000ffffffffULL;
+  return v;
+}
+
+/** Compare two coordinate pairs in Morton order,
+ * see \ref p4est_coordinates_compare. */
+/*@unused@*/
+static inline int
+p4est_coordinates_compare_inline (const p4est_qcoord_t v1[],
+                                  const p4est_qcoord_t v2[])
+{
+  uint32_t            exclorx, exclory, exclor;
+  int64_t             p1, p2, diff;
+
+  /* these are unsigned variables that inherit the sign bits */
+  exclorx = v1[0] ^ v2[0];
+  exclory = v1[1] ^ v2[1];
+  exclor = exclorx | exclory;
+
+  if (!exclor) {
+    return 0;
+  }
+
+  if (exclory > (exclor ^ exclory)) {
+    p1 = v1[1] + ((v1[1] >= 0) ? 0 : ((int64_t) 1 << (P4EST_MAXLEVEL + 2)));
+    p2 = v2[1] + ((v2[1] >= 0) ? 0 : ((int64_t) 1 << (P4EST_MAXLEVEL + 2)));
+  }
+  else {
+    p1 = v1[0] + ((v1[0] >= 0) ? 0 : ((int64_t) 1 << (P4EST_MAXLEVEL + 2)));
+    p2 = v2[0] + ((v2[0] >= 0) ? 0 : ((int64_t) 1 << (P4EST_MAXLEVEL + 2)));
+  }
+  diff = p1 - p2;
+  return (diff == 0) ? 0 : ((diff < 0) ? -1 : 1);
+}
+
+/** Compare two quadrants in Morton order, see \ref p4est_quadrant_compare. */
+/*@unused@*/
+static inline int
+p4est_quadrant_compare_inline (const p4est_quadrant_t * q1,
+                               const p4est_quadrant_t * q2)
+{
+  p4est_qcoord_t      a[P4EST_DIM], b[P4EST_DIM];
+  int                 coord_diff;
+
+  a[0] = q1->x;
+  a[1] = q1->y;
+  b[0] = q2->x;
+  b[1] = q2->y;
+  coord_diff = p4est_coordinates_compare_inline (a, b);
+  return coord_diff ? coord_diff : ((int) q1->level - (int) q2->level);
+}
+
+/** Test two quadrants for equal coordinates and level,
+ * see \ref p4est_quadrant_is_equal. */
+/*@unused@*/
+static inline int
+p4est_quadrant_is_equal_inline (const p4est_quadrant_t * q1,
+                                const p4est_quadrant_t * q2)
+{
+  return q1->level == q2->level && q1->x == q2->x && q1->y == q2->y;
+}
+
+/** Test whether two quadrants overlap, see \ref p4est_quadrant_overlaps. */
+/*@unused@*/
+static inline int
+p4est_quadrant_overlaps_inline (const p4est_quadrant_t * q1,
+                                const p4est_quadrant_t * q2)
+{
+  int8_t              level = SC_MIN (q1->level, q2->level);
+  p4est_qcoord_t      mask = ~((1 << (P4EST_MAXLEVEL - level)) - 1);
+
+  return !(((q1->x ^ q2->x) & mask) || ((q1->y ^ q2->y) & mask));
+}
+
+/** Compute the position of the ancestor of a quadrant at a given level
+ * within its parent, see \ref p4est_quadrant_ancestor_id. */
+/*@unused@*/
+static inline int
+p4est_quadrant_ancestor_id_inline (const p4est_quadrant_t * q, int level)
+{
+  int                 id = 0;
+
+  if (level == 0) {
+    return 0;
+  }
+  id |= ((q->x & P4EST_QUADRANT_LEN (level)) ? 0x01 : 0);
+  id |= ((q->y & P4EST_QUADRANT_LEN (level)) ? 0x02 : 0);
+  return id;
+}
+
+/** Compute the position of a quadrant within its parent,
+ * see \ref p4est_quadrant_child_id. */
+/*@unused@*/
+static inline int
+p4est_quadrant_child_id_inline (const p4est_quadrant_t * q)
+{
+  return p4est_quadrant_ancestor_id_inline (q, (int) q->level);
+}
+
+/** Test whether a quadrant lies inside the unit tree,
+ * see \ref p4est_quadrant_is_inside_root. */
+/*@unused@*/
+static inline int
+p4est_quadrant_is_inside_root_inline (const p4est_quadrant_t * q)
+{
+  return (q->x >= 0 && q->x < P4EST_ROOT_LEN) &&
+    (q->y >= 0 && q->y < P4EST_ROOT_LEN);
+}
+
+/** Test whether q is the parent of r, see \ref p4est_quadrant_is_parent. */
+/*@unused@*/
+static inline int
+p4est_quadrant_is_parent_inline (const p4est_quadrant_t * q,
+                                 const p4est_quadrant_t * r)
+{
+  return (q->level + 1 == r->level) &&
+    (q->x == (r->x & ~P4EST_QUADRANT_LEN (r->level))) &&
+    (q->y == (r->y & ~P4EST_QUADRANT_LEN (r->level)));
+}
+
+/** Test whether q is a strict ancestor of r,
+ * see \ref p4est_quadrant_is_ancestor. */
+/*@unused@*/
+static inline int
+p4est_quadrant_is_ancestor_inline (const p4est_quadrant_t * q,
+                                   const p4est_quadrant_t * r)
+{
+  if (q->level >= r->level) {
+    return 0;
+  }
+  return ((q->x ^ r->x) >> (P4EST_MAXLEVEL - q->level)) == 0 &&
+    ((q->y ^ r->y) >> (P4EST_MAXLEVEL - q->level)) == 0;
+}
+
+/** Compute the parent of a quadrant, see \ref p4est_quadrant_parent. */
+/*@unused@*/
+static inline void
+p4est_quadrant_parent_inline (const p4est_quadrant_t * q,
+                              p4est_quadrant_t * r)
+{
+  r->x = q->x & ~P4EST_QUADRANT_LEN (q->level);
+  r->y = q->y & ~P4EST_QUADRANT_LEN (q->level);
+  r->level = (int8_t) (q->level - 1);
+}
+
+/** Compute a sibling of a quadrant, see \ref p4est_quadrant_sibling. */
+/*@unused@*/
+static inline void
+p4est_quadrant_sibling_inline (const p4est_quadrant_t * q,
+                               p4est_quadrant_t * r, int sibling_id)
+{
+  const p4est_qcoord_t shift = P4EST_QUADRANT_LEN (q->level);
+
+  r->x = (sibling_id & 0x01) ? (q->x | shift) : (q->x & ~shift);
+  r->y = (sibling_id & 0x02) ? (q->y | shift) : (q->y & ~shift);
+  r->level = q->level;
+}
+
+/** Compute a child of a quadrant, see \ref p4est_quadrant_child. */
+/*@unused@*/
+static inline void
+p4est_quadrant_child_inline (const p4est_quadrant_t * q,
+                             p4est_quadrant_t * r, int child_id)
+{
+  const p4est_qcoord_t shift = P4EST_QUADRANT_LEN (q->level + 1);
+
+  r->x = (child_id & 0x01) ? (q->x | shift) : q->x;
+  r->y = (child_id & 0x02) ? (q->y | shift) : q->y;
+  r->level = (int8_t) (q->level + 1);
+}
+
+/** Compute the same-size neighbor across a face,
+ * see \ref p4est_quadrant_face_neighbor. */
+/*@unused@*/
+static inline void
+p4est_quadrant_face_neighbor_inline (const p4est_quadrant_t * q,
+                                     int face, p4est_quadrant_t * r)
+{
+  const p4est_qcoord_t qh = P4EST_QUADRANT_LEN (q->level);
+
+  r->x = q->x + ((face == 0) ? -qh : (face == 1) ? qh : 0);
+  r->y = q->y + ((face == 2) ? -qh : (face == 3) ? qh : 0);
+  r->level = q->level;
+}
+
+/** Compute the first descendant of a quadrant on a given level,
+ * see \ref p4est_quadrant_first_descendant. */
+/*@unused@*/
+static inline void
+p4est_quadrant_first_descendant_inline (const p4est_quadrant_t * q,
+                                        p4est_quadrant_t * fd, int level)
+{
+  fd->x = q->x;
+  fd->y = q->y;
+  fd->level = (int8_t) level;
+}
+
+/** Compute the last descendant of a quadrant on a given level,
+ * see \ref p4est_quadrant_last_descendant. */
+/*@unused@*/
+static inline void
+p4est_quadrant_last_descendant_inline (const p4est_quadrant_t * q,
+                                       p4est_quadrant_t * ld, int level)
+{
+  const p4est_qcoord_t shift =
+    P4EST_QUADRANT_LEN (q->level) - P4EST_QUADRANT_LEN (level);
+
+  ld->x = q->x + shift;
+  ld->y = q->y + shift;
+  ld->level = (int8_t) level;
+}
+
+/** Compute the Morton index of a quadrant on a uniform grid,
+ * see \ref p4est_quadrant_linear_id. */
+/*@unused@*/
+static inline       uint64_t
+p4est_quadrant_linear_id_inline (const p4est_quadrant_t * q, int level)
+{
+  const int           shift = P4EST_MAXLEVEL - level;
+  const uint64_t      mask = ((uint64_t) 1 << (level + 2)) - 1;
+
+  /* this preserves the high bits from negative numbers */
+  return p4est_linear_id_spread ((uint64_t) (q->x >> shift) & mask)
+    | (p4est_linear_id_spread ((uint64_t) (q->y >> shift) & mask) << 1);
+}
+
+/** Set a quadrant from its Morton index on a uniform grid,
+ * see \ref p4est_quadrant_set_morton. */
+/*@unused@*/
+static inline void
+p4est_quadrant_set_morton_inline (p4est_quadrant_t * q, int level,
+                                  uint64_t id)
+{
+  /* this may set the sign bit to create negative numbers */
+  q->level = (int8_t) level;
+  q->x = (p4est_qcoord_t) p4est_linear_id_squeeze (id);
+  q->y = (p4est_qcoord_t) p4est_linear_id_squeeze (id >> 1);
+  q->x <<= (P4EST_MAXLEVEL - level);
+  q->y <<= (P4EST_MAXLEVEL - level);
+}
+
+SC_EXTERN_C_END;
+
+#endif /* !P4EST_BITS_INLINE_H */
@@ -113,6 +113,14 @@ p4est_build_new (p4est_t * from, size_t data_size,
   p4est->user_data_pool = NULL;
   p4est->quadrant_pool = NULL;
   p4est->inspect = NULL;
+  p4est->data_contiguous = 0;
+  p4est->data_array = NULL;
+  p4est->data_array_size = p4est->data_array_used = 0;
+  p4est->balance_dirty = NULL;
+  p4est->valid_dirty = NULL;
+  p4est->shared_quadrants = NULL;
+  p4est->scratch = NULL;
+  p4est->data_cache = NULL;
 
   /* start populating missing members */
   p4est->global_first_quadrant =
@@ -380,3 +388,178 @@ p4est_build_complete (p4est_build_t * build)
 
   return p4est;
 }
+
+/** Context object for building a new p4est from a stream of leaves.
+ */
+struct p4est_build_stream
+{
+  p4est_t            *p4est;    /**< New forest being built. */
+  p4est_init_t        init_fn;  /**< Used for added quadrants. */
+  p4est_quadrant_t    prev;     /**< Previously added leaf.
+                                     If there is none yet, we set
+                                     its level to -1. */
+};
+
+p4est_build_stream_t *
+p4est_build_stream_new (sc_MPI_Comm mpicomm,
+                        p4est_connectivity_t * connectivity,
+                        size_t data_size, p4est_init_t init_fn,
+                        void *user_pointer)
+{
+  int                 ell;
+  p4est_topidx_t      jt, num_trees;
+  p4est_t            *p4est;
+  p4est_tree_t       *tree;
+  p4est_build_stream_t *stream;
+
+  P4EST_ASSERT (p4est_connectivity_is_valid (connectivity));
+
+  /* create an empty forest to be populated */
+  stream = P4EST_ALLOC (p4est_build_stream_t, 1);
+  stream->p4est = p4est = P4EST_ALLOC_ZERO (p4est_t, 1);
+  stream->init_fn = init_fn;
+  stream->prev.level = -1;
+  p4est->data_size = data_size;
+  p4est->user_pointer = user_pointer;
+  p4est->connectivity = connectivity;
+  num_trees = connectivity->num_trees;
+  p4est_comm_parallel_env_assign (p4est, mpicomm);
+  if (p4est->data_size > 0) {
+    p4est->user_data_pool = sc_mempool_new (p4est->data_size);
+  }
+  p4est->quadrant_pool = p4est_quadrant_mempool_new ();
+
+  /* allocate trees */
+  p4est->trees = sc_array_new_size (sizeof (p4est_tree_t), num_trees);
+  for (jt = 0; jt < num_trees; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    sc_array_init (&tree->quadrants, sizeof (p4est_quadrant_t));
+    P4EST_QUADRANT_INIT (&tree->first_desc);
+    P4EST_QUADRANT_INIT (&tree->last_desc);
+    tree->quadrants_offset = 0;
+    memset (tree->quadrants_per_level, 0,
+            (P4EST_QMAXLEVEL + 1) * sizeof (p4est_locidx_t));
+    for (ell = P4EST_QMAXLEVEL + 1; ell <= P4EST_MAXLEVEL; ++ell) {
+      tree->quadrants_per_level[ell] = -1;
+    }
+    tree->maxlevel = 0;
+  }
+  p4est->first_local_tree = -1;
+  p4est->last_local_tree = -2;
+  p4est->global_first_quadrant =
+    P4EST_ALLOC (p4est_gloidx_t, p4est->mpisize + 1);
+  p4est->global_first_position =
+    P4EST_ALLOC_ZERO (p4est_quadrant_t, p4est->mpisize + 1);
+
+  return stream;
+}
+
+/** Close the current tree by recording its last descendant. */
+static void
+p4est_build_stream_end_tree (p4est_build_stream_t * stream)
+{
+  p4est_t            *p4est = stream->p4est;
+  p4est_tree_t       *tree;
+
+  P4EST_ASSERT (p4est->last_local_tree >= 0);
+  tree = p4est_tree_array_index (p4est->trees, p4est->last_local_tree);
+  P4EST_ASSERT (tree->quadrants.elem_count > 0);
+  p4est_quadrant_last_descendant
+    (p4est_quadrant_array_index (&tree->quadrants,
+                                 tree->quadrants.elem_count - 1),
+     &tree->last_desc, P4EST_QMAXLEVEL);
+}
+
+void
+p4est_build_stream_add (p4est_build_stream_t * stream, sc_array_t * leaves)
+{
+  size_t              zz;
+  p4est_topidx_t      which_tree, jt;
+  p4est_t            *p4est;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *leaf, *q;
+
+  P4EST_ASSERT (stream != NULL);
+  P4EST_ASSERT (stream->p4est != NULL);
+  P4EST_ASSERT (leaves->elem_size == sizeof (p4est_quadrant_t));
+
+  p4est = stream->p4est;
+  tree = p4est->last_local_tree < 0 ? NULL :
+    p4est_tree_array_index (p4est->trees, p4est->last_local_tree);
+  for (zz = 0; zz < leaves->elem_count; ++zz) {
+    leaf = p4est_quadrant_array_index (leaves, zz);
+    which_tree = leaf->p.which_tree;
+    P4EST_ASSERT (p4est_quadrant_is_valid (leaf));
+    P4EST_ASSERT (0 <= which_tree &&
+                  which_tree < p4est->connectivity->num_trees);
+    P4EST_ASSERT (which_tree >= p4est->last_local_tree);
+
+    /* enter a new tree */
+    if (which_tree > p4est->last_local_tree) {
+      if (p4est->first_local_tree < 0) {
+        p4est->first_local_tree = which_tree;
+      }
+      else {
+        p4est_build_stream_end_tree (stream);
+      }
+      for (jt = SC_MAX (p4est->last_local_tree + 1,
+                        p4est->first_local_tree); jt <= which_tree; ++jt) {
+        tree = p4est_tree_array_index (p4est->trees, jt);
+        tree->quadrants_offset = p4est->local_num_quadrants;
+      }
+      p4est->last_local_tree = which_tree;
+      p4est_quadrant_first_descendant (leaf, &tree->first_desc,
+                                       P4EST_QMAXLEVEL);
+      stream->prev.level = -1;
+    }
+
+    /* the leaves must follow each other without overlap */
+    P4EST_ASSERT (stream->prev.level == -1 ||
+                  (p4est_quadrant_compare (&stream->prev, leaf) < 0 &&
+                   !p4est_quadrant_is_ancestor (&stream->prev, leaf)));
+    stream->prev = *leaf;
+
+    /* append the leaf to its tree */
+    q = p4est_quadrant_array_push (&tree->quadrants);
+    *q = *leaf;
+    p4est_quadrant_init_data (p4est, which_tree, q, stream->init_fn);
+    ++tree->quadrants_per_level[q->level];
+    if (q->level > tree->maxlevel) {
+      tree->maxlevel = q->level;
+    }
+    ++p4est->local_num_quadrants;
+  }
+}
+
+p4est_t            *
+p4est_build_stream_complete (p4est_build_stream_t * stream, int repartition)
+{
+  p4est_topidx_t      jt, num_trees;
+  p4est_t            *p4est;
+  p4est_tree_t       *tree;
+
+  P4EST_ASSERT (stream != NULL);
+  P4EST_ASSERT (stream->p4est != NULL);
+
+  p4est = stream->p4est;
+  num_trees = p4est->connectivity->num_trees;
+  if (p4est->first_local_tree >= 0) {
+    /* fix quadrants_offset in empty trees > last_local_tree */
+    p4est_build_stream_end_tree (stream);
+    for (jt = p4est->last_local_tree + 1; jt < num_trees; ++jt) {
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      tree->quadrants_offset = p4est->local_num_quadrants;
+    }
+  }
+  P4EST_FREE (stream);
+
+  /* the first leaves of all processors define the partition */
+  p4est_comm_global_partition (p4est, NULL);
+  p4est_comm_count_quadrants (p4est);
+  P4EST_ASSERT (p4est_is_valid (p4est));
+
+  if (repartition) {
+    p4est_partition (p4est, 0, NULL);
+  }
+  return p4est;
+}
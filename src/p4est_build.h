@@ -97,6 +97,54 @@ int                 p4est_build_add (p4est_build_t * build,
  */
 p4est_t            *p4est_build_complete (p4est_build_t * build);
 
+/** Context object for building a new forest from a stream of leaves.
+ * Unlike \ref p4est_build_t, this does not need a template forest.
+ * Every process passes the leaves of a contiguous section of the final
+ * forest in Morton order, in chunks of any size that are copied into the
+ * forest directly.  No process needs to hold more than its own leaves
+ * and the current chunk, which suits loading meshes from other codes.
+ */
+typedef struct p4est_build_stream p4est_build_stream_t;
+
+/** Allocate a context for building a forest from a stream of leaves.
+ * \param [in] mpicomm      A valid MPI communicator.  Not owned.
+ * \param [in] connectivity The connectivity of the new forest.  Not owned.
+ * \param [in] data_size    Data size of the created forest, may be zero.
+ * \param [in] init_fn      This function is called for every added leaf.
+ *                          NULL leaves the quadrant data uninitialized.
+ * \param [in] user_pointer Registered into the newly built forest.
+ * \return                  A context that needs to be processed further.
+ */
+p4est_build_stream_t *p4est_build_stream_new (sc_MPI_Comm mpicomm,
+                                             p4est_connectivity_t *
+                                             connectivity,
+                                             size_t data_size,
+                                             p4est_init_t init_fn,
+                                             void *user_pointer);
+
+/** Append a chunk of leaves to the forest being built.
+ * The leaves must follow the previously added ones in Morton order without
+ * overlap, and the leaves of all calls on all processes must form a
+ * complete forest, processes being ordered by rank.  Not collective.
+ * \param [in,out] stream   Context created by \ref p4est_build_stream_new.
+ * \param [in] leaves       Array of p4est_quadrant_t with the tree number
+ *                          stored in p.which_tree.  It may be reused for
+ *                          the next chunk after this function returns.
+ */
+void                p4est_build_stream_add (p4est_build_stream_t * stream,
+                                           sc_array_t * leaves);
+
+/** Finalize the construction of a forest from a stream of leaves.
+ * This function is collective.
+ * \param [in,out] stream   The context will be deallocated inside.
+ * \param [in] repartition  If true, partition the forest uniformly.
+ *                          Otherwise each process keeps the leaves it added.
+ * \return                  A valid forest object.
+ *                          Its revision number is zero unless repartitioned.
+ */
+p4est_t            *p4est_build_stream_complete (p4est_build_stream_t *
+                                                stream, int repartition);
+
 SC_EXTERN_C_END;
 
 #endif /* ! P4EST_BUILD_H */
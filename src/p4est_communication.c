@@ -26,11 +26,14 @@
 #include <p8est_algorithms.h>
 #include <p8est_communication.h>
 #include <p8est_bits.h>
+#include <p8est_extended.h>
 #else
 #include <p4est_algorithms.h>
 #include <p4est_communication.h>
 #include <p4est_bits.h>
+#include <p4est_extended.h>
 #endif /* !P4_TO_P8 */
+#include <sc_notify.h>
 #include <sc_search.h>
 #ifdef P4EST_HAVE_ZLIB
 #include <zlib.h>
@@ -319,6 +322,147 @@ p4est_comm_parallel_env_reduce_ext (p4est_t ** p4est_supercomm,
   return 1;
 }
 
+int
+p4est_comm_node_order (sc_MPI_Comm mpicomm, sc_MPI_Comm * ordered)
+{
+  int                 mpiret;
+  int                 rank, key, reordered;
+#ifdef P4EST_ENABLE_MPICOMMSHARED
+  int                 noderank, nodesize, nodefirst;
+  MPI_Comm            nodecomm, leadercomm;
+#endif
+
+  mpiret = sc_MPI_Comm_rank (mpicomm, &rank);
+  SC_CHECK_MPI (mpiret);
+  key = rank;
+
+#ifdef P4EST_ENABLE_MPICOMMSHARED
+  /* the nodes follow their lowest rank, the processes of a node follow
+     each other in their original order */
+  mpiret = MPI_Comm_split_type (mpicomm, MPI_COMM_TYPE_SHARED, rank,
+                                MPI_INFO_NULL, &nodecomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_rank (nodecomm, &noderank);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_size (nodecomm, &nodesize);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_split (mpicomm, noderank == 0 ? 0 : MPI_UNDEFINED,
+                           rank, &leadercomm);
+  SC_CHECK_MPI (mpiret);
+  nodefirst = 0;
+  if (noderank == 0) {
+    mpiret = MPI_Exscan (&nodesize, &nodefirst, 1, MPI_INT, MPI_SUM,
+                         leadercomm);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Comm_rank (leadercomm, &key);
+    SC_CHECK_MPI (mpiret);
+    if (key == 0) {
+      /* the result of the exclusive scan is undefined on rank zero */
+      nodefirst = 0;
+    }
+    mpiret = MPI_Comm_free (&leadercomm);
+    SC_CHECK_MPI (mpiret);
+  }
+  mpiret = MPI_Bcast (&nodefirst, 1, MPI_INT, 0, nodecomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_free (&nodecomm);
+  SC_CHECK_MPI (mpiret);
+  key = nodefirst + noderank;
+#endif
+
+  reordered = (key != rank);
+  mpiret = sc_MPI_Allreduce (sc_MPI_IN_PLACE, &reordered, 1, sc_MPI_INT,
+                             sc_MPI_LOR, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  if (reordered) {
+    mpiret = sc_MPI_Comm_split (mpicomm, 0, key, ordered);
+  }
+  else {
+    mpiret = sc_MPI_Comm_dup (mpicomm, ordered);
+  }
+  SC_CHECK_MPI (mpiret);
+
+  return reordered;
+}
+
+int
+p4est_comm_parallel_env_node_order (p4est_t * p4est)
+{
+  const size_t        data_size = p4est->data_size;
+  const size_t        unit = sizeof (p4est_quadrant_t) + data_size;
+  int                 mpiret;
+  int                 oldrank, newrank;
+  size_t              zz, num_send, num_recv;
+  char               *send_buf, *recv_buf, *pos;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, *sq;
+  sc_MPI_Comm         ordered;
+  sc_MPI_Request      request;
+  sc_MPI_Status       status;
+
+  if (!p4est_comm_node_order (p4est->mpicomm, &ordered)) {
+    mpiret = sc_MPI_Comm_free (&ordered);
+    SC_CHECK_MPI (mpiret);
+    return 0;
+  }
+  oldrank = p4est->mpirank;
+  mpiret = sc_MPI_Comm_rank (ordered, &newrank);
+  SC_CHECK_MPI (mpiret);
+
+  /* the partition stays the same, but the range of each old rank moves to
+     the process that now carries its number */
+  if (newrank != oldrank) {
+    num_send = (size_t) p4est->local_num_quadrants;
+    num_recv = (size_t) (p4est->global_first_quadrant[newrank + 1] -
+                         p4est->global_first_quadrant[newrank]);
+
+    /* the message holds the quadrants followed by their user data */
+    send_buf = P4EST_ALLOC (char, num_send * unit);
+    sq = (p4est_quadrant_t *) send_buf;
+    pos = send_buf + num_send * sizeof (p4est_quadrant_t);
+    for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++sq) {
+        q = p4est_quadrant_array_index (&tree->quadrants, zz);
+        *sq = *q;
+        sq->p.which_tree = jt;
+        if (data_size > 0) {
+          memcpy (pos, q->p.user_data, data_size);
+          pos += data_size;
+        }
+      }
+    }
+    recv_buf = P4EST_ALLOC (char, num_recv * unit);
+    mpiret = sc_MPI_Irecv (recv_buf, (int) (num_recv * unit), sc_MPI_BYTE,
+                           sc_MPI_ANY_SOURCE, P4EST_COMM_NODE_ORDER,
+                           ordered, &request);
+    SC_CHECK_MPI (mpiret);
+    mpiret = sc_MPI_Send (send_buf, (int) (num_send * unit), sc_MPI_BYTE,
+                          oldrank, P4EST_COMM_NODE_ORDER, ordered);
+    SC_CHECK_MPI (mpiret);
+    mpiret = sc_MPI_Wait (&request, &status);
+    SC_CHECK_MPI (mpiret);
+    P4EST_FREE (send_buf);
+
+    /* take over the received range */
+    p4est_replace_quadrants (p4est, (p4est_quadrant_t *) recv_buf,
+                             recv_buf + num_recv * sizeof (p4est_quadrant_t),
+                             (p4est_locidx_t) num_recv);
+    P4EST_FREE (recv_buf);
+  }
+  ++p4est->revision;
+
+  /* the forest owns the reordered communicator */
+  p4est_comm_parallel_env_release (p4est);
+  p4est_comm_parallel_env_assign (p4est, ordered);
+  p4est->mpicomm_owned = 1;
+  P4EST_ASSERT (p4est->mpirank == newrank);
+  P4EST_ASSERT (p4est_is_valid (p4est));
+
+  return 1;
+}
+
 void
 p4est_comm_count_quadrants (p4est_t * p4est)
 {
@@ -806,6 +950,460 @@ p4est_comm_find_owner (p4est_t * p4est, p4est_locidx_t which_tree,
   return guess;
 }
 
+/** Test whether a partition position is not after a quadrant.
+ * \return      True if \a pos is less or equal to the first descendant
+ *              of \a q in tree \a which_tree.
+ */
+static int
+p4est_comm_position_le (const p4est_quadrant_t * pos,
+                        p4est_topidx_t which_tree, const p4est_quadrant_t * q)
+{
+  p4est_quadrant_t    cur;
+
+  if (pos->p.which_tree != which_tree) {
+    return pos->p.which_tree < which_tree;
+  }
+  cur.x = pos->x;
+  cur.y = pos->y;
+#ifdef P4_TO_P8
+  cur.z = pos->z;
+#endif
+  cur.level = P4EST_QMAXLEVEL;
+  return p4est_quadrant_compare (&cur, q) <= 0 ||
+    (q->x == cur.x && q->y == cur.y
+#ifdef P4_TO_P8
+     && q->z == cur.z
+#endif
+    );
+}
+
+void
+p4est_comm_find_owners (p4est_t * p4est, sc_array_t * quadrants,
+                        int *owners)
+{
+  const int           num_procs = p4est->mpisize;
+  const p4est_quadrant_t *gfp = p4est->global_first_position;
+  int                 guess, low, high, mid, step;
+  size_t              zz;
+  p4est_topidx_t      which_tree;
+  p4est_quadrant_t   *q;
+
+  P4EST_ASSERT (quadrants->elem_size == sizeof (p4est_quadrant_t));
+
+  guess = p4est->mpirank;
+  for (zz = 0; zz < quadrants->elem_count; ++zz) {
+    q = p4est_quadrant_array_index (quadrants, zz);
+    which_tree = q->p.which_tree;
+    P4EST_ASSERT (0 <= which_tree &&
+                  which_tree < p4est->connectivity->num_trees);
+    P4EST_ASSERT (p4est_quadrant_is_node (q, 1) ||
+                  p4est_quadrant_is_valid (q));
+
+    /* gallop from the previous owner to bracket the last process whose
+       first position is not after q: low satisfies this, high does not */
+    if (p4est_comm_position_le (&gfp[guess], which_tree, q)) {
+      low = guess;
+      for (step = 1;; step *= 2) {
+        high = low + step;
+        if (high >= num_procs ||
+            !p4est_comm_position_le (&gfp[high], which_tree, q)) {
+          high = SC_MIN (high, num_procs);
+          break;
+        }
+        low = high;
+      }
+    }
+    else {
+      high = guess;
+      for (step = 1;; step *= 2) {
+        low = SC_MAX (high - step, 0);
+        if (p4est_comm_position_le (&gfp[low], which_tree, q)) {
+          break;
+        }
+        high = low;
+      }
+    }
+
+    /* bisect the bracket */
+    while (high - low > 1) {
+      mid = low + (high - low) / 2;
+      if (p4est_comm_position_le (&gfp[mid], which_tree, q)) {
+        low = mid;
+      }
+      else {
+        high = mid;
+      }
+    }
+
+    /* the last of several equal positions belongs to a nonempty process */
+    P4EST_ASSERT (0 <= low && low < num_procs);
+    P4EST_ASSERT (memcmp (&gfp[low], &gfp[low + 1],
+                          sizeof (p4est_quadrant_t)) != 0);
+    owners[zz] = guess = low;
+  }
+}
+
+/** Find the last of \a num positions that is not after a quadrant.
+ * The first position must not be after the quadrant.
+ */
+static int
+p4est_comm_positions_last_le (const p4est_quadrant_t * positions, int num,
+                              p4est_topidx_t which_tree,
+                              const p4est_quadrant_t * q)
+{
+  int                 low, high, mid;
+
+  P4EST_ASSERT (num >= 1);
+  P4EST_ASSERT (p4est_comm_position_le (&positions[0], which_tree, q));
+
+  low = 0;
+  high = num;
+  while (high - low > 1) {
+    mid = low + (high - low) / 2;
+    if (p4est_comm_position_le (&positions[mid], which_tree, q)) {
+      low = mid;
+    }
+    else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+p4est_comm_sparse_t *
+p4est_comm_sparse_new (p4est_t * p4est, int stride)
+{
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+  int                 i, k, block;
+  p4est_gloidx_t      local, offset;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *quadrant, input;
+  p4est_comm_sparse_t *sparse;
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+  MPI_Comm            blockcomm, samplecomm;
+#endif
+
+  P4EST_ASSERT (stride >= 1);
+  stride = SC_MIN (stride, num_procs);
+
+  sparse = P4EST_ALLOC (p4est_comm_sparse_t, 1);
+  sparse->mpicomm = p4est->mpicomm;
+  sparse->mpisize = num_procs;
+  sparse->mpirank = rank;
+  sparse->stride = stride;
+  block = rank / stride;
+  sparse->block_first = block * stride;
+  sparse->block_count = SC_MIN (stride, num_procs - sparse->block_first);
+  sparse->block_quadrant =
+    P4EST_ALLOC (p4est_gloidx_t, sparse->block_count + 1);
+  sparse->block_position =
+    P4EST_ALLOC (p4est_quadrant_t, sparse->block_count + 1);
+  sparse->num_samples = (num_procs + stride - 1) / stride;
+  sparse->sample_quadrant =
+    P4EST_ALLOC (p4est_gloidx_t, sparse->num_samples + 1);
+  sparse->sample_position =
+    P4EST_ALLOC (p4est_quadrant_t, sparse->num_samples + 1);
+
+  /* our first position, marked by a negative tree if we are empty */
+  local = (p4est_gloidx_t) p4est->local_num_quadrants;
+  SC_BZERO (&input, 1);
+  input.level = P4EST_QMAXLEVEL;
+  input.p.which_tree = -1;
+  if (local > 0) {
+    tree = p4est_tree_array_index (p4est->trees, p4est->first_local_tree);
+    quadrant = p4est_quadrant_array_index (&tree->quadrants, 0);
+    input.x = quadrant->x;
+    input.y = quadrant->y;
+#ifdef P4_TO_P8
+    input.z = quadrant->z;
+#endif
+    input.p.which_tree = p4est->first_local_tree;
+  }
+
+  /* exact markers within the block of consecutive ranks */
+#ifdef P4EST_ENABLE_MPI
+  mpiret = MPI_Comm_split (p4est->mpicomm, block, rank, &blockcomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Allgather (&local, 1, P4EST_MPI_GLOIDX,
+                          sparse->block_quadrant + 1, 1, P4EST_MPI_GLOIDX,
+                          blockcomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Allgather (&input, (int) sizeof (p4est_quadrant_t), MPI_BYTE,
+                          sparse->block_position,
+                          (int) sizeof (p4est_quadrant_t), MPI_BYTE,
+                          blockcomm);
+  SC_CHECK_MPI (mpiret);
+  offset = 0;
+  mpiret = MPI_Exscan (&local, &offset, 1, P4EST_MPI_GLOIDX, MPI_SUM,
+                       p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  if (rank == 0) {
+    offset = 0;
+  }
+#else
+  sparse->block_quadrant[1] = local;
+  sparse->block_position[0] = input;
+  offset = 0;
+#endif
+  for (i = 0; i < rank - sparse->block_first; ++i) {
+    offset -= sparse->block_quadrant[i + 1];
+  }
+  sparse->block_quadrant[0] = offset;
+  for (i = 0; i < sparse->block_count; ++i) {
+    sparse->block_quadrant[i + 1] += sparse->block_quadrant[i];
+  }
+
+  /* the sample of a block is its first nonempty position */
+  for (i = 0; i < sparse->block_count; ++i) {
+    if (sparse->block_position[i].p.which_tree >= 0) {
+      break;
+    }
+  }
+  input = sparse->block_position[SC_MIN (i, sparse->block_count - 1)];
+#ifdef P4EST_ENABLE_MPI
+  mpiret = MPI_Comm_split (p4est->mpicomm, rank == sparse->block_first ?
+                           0 : MPI_UNDEFINED, rank, &samplecomm);
+  SC_CHECK_MPI (mpiret);
+  if (rank == sparse->block_first) {
+    mpiret = MPI_Allgather (&offset, 1, P4EST_MPI_GLOIDX,
+                            sparse->sample_quadrant, 1, P4EST_MPI_GLOIDX,
+                            samplecomm);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Allgather (&input, (int) sizeof (p4est_quadrant_t),
+                            MPI_BYTE, sparse->sample_position,
+                            (int) sizeof (p4est_quadrant_t), MPI_BYTE,
+                            samplecomm);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Comm_free (&samplecomm);
+    SC_CHECK_MPI (mpiret);
+  }
+  mpiret = MPI_Bcast (sparse->sample_quadrant, sparse->num_samples,
+                      P4EST_MPI_GLOIDX, 0, blockcomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Bcast (sparse->sample_position, sparse->num_samples *
+                      (int) sizeof (p4est_quadrant_t), MPI_BYTE, 0,
+                      blockcomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_free (&blockcomm);
+  SC_CHECK_MPI (mpiret);
+#else
+  sparse->sample_quadrant[0] = offset;
+  sparse->sample_position[0] = input;
+#endif
+
+  /* correct for empty blocks and processes as in the global partition */
+  k = sparse->num_samples;
+  sparse->sample_quadrant[k] = p4est->global_num_quadrants;
+  SC_BZERO (&sparse->sample_position[k], 1);
+  sparse->sample_position[k].level = P4EST_QMAXLEVEL;
+  sparse->sample_position[k].p.which_tree = p4est->connectivity->num_trees;
+  for (--k; k >= 0; --k) {
+    if (sparse->sample_position[k].p.which_tree < 0) {
+      sparse->sample_position[k] = sparse->sample_position[k + 1];
+    }
+  }
+  i = sparse->block_count;
+  sparse->block_position[i] = sparse->sample_position[block + 1];
+  for (--i; i >= 0; --i) {
+    if (sparse->block_position[i].p.which_tree < 0) {
+      sparse->block_position[i] = sparse->block_position[i + 1];
+    }
+  }
+
+#ifdef P4EST_ENABLE_DEBUG
+  for (i = 0; i <= sparse->block_count; ++i) {
+    P4EST_ASSERT (sparse->block_quadrant[i] ==
+                  p4est->global_first_quadrant[sparse->block_first + i]);
+    P4EST_ASSERT (!memcmp (&sparse->block_position[i],
+                           &p4est->global_first_position[sparse->block_first
+                                                         + i],
+                           sizeof (p4est_quadrant_t)));
+  }
+  for (k = 0; k < sparse->num_samples; ++k) {
+    P4EST_ASSERT (sparse->sample_quadrant[k] ==
+                  p4est->global_first_quadrant[k * stride]);
+    P4EST_ASSERT (!memcmp (&sparse->sample_position[k],
+                           &p4est->global_first_position[k * stride],
+                           sizeof (p4est_quadrant_t)));
+  }
+#endif
+
+  return sparse;
+}
+
+void
+p4est_comm_sparse_destroy (p4est_comm_sparse_t * sparse)
+{
+  P4EST_FREE (sparse->block_quadrant);
+  P4EST_FREE (sparse->block_position);
+  P4EST_FREE (sparse->sample_quadrant);
+  P4EST_FREE (sparse->sample_position);
+  P4EST_FREE (sparse);
+}
+
+/** Resolve the owner of a quadrant in the block of this process. */
+static int
+p4est_comm_sparse_block_owner (p4est_comm_sparse_t * sparse,
+                               const p4est_quadrant_t * q)
+{
+  return sparse->block_first +
+    p4est_comm_positions_last_le (sparse->block_position,
+                                  sparse->block_count + 1,
+                                  q->p.which_tree, q);
+}
+
+void
+p4est_comm_sparse_find_owners (p4est_comm_sparse_t * sparse,
+                               sc_array_t * quadrants, int *owners)
+{
+  const int           block = sparse->mpirank / sparse->stride;
+  int                 k;
+  size_t              zz;
+  p4est_quadrant_t   *q;
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+  int                 i, j, rcount;
+  int                 num_receivers, num_senders;
+  int                *counts, *first, *order, *receivers, *senders;
+  int                *blocks, *replies, **answers;
+  size_t              num_remote;
+  p4est_quadrant_t   *sendq, *recvq;
+  MPI_Request        *requests;
+  MPI_Status          status;
+#endif
+
+  P4EST_ASSERT (quadrants->elem_size == sizeof (p4est_quadrant_t));
+
+#ifdef P4EST_ENABLE_MPI
+  counts = P4EST_ALLOC_ZERO (int, sparse->num_samples + 1);
+  blocks = P4EST_ALLOC (int, quadrants->elem_count);
+#endif
+  for (zz = 0; zz < quadrants->elem_count; ++zz) {
+    q = p4est_quadrant_array_index (quadrants, zz);
+    P4EST_ASSERT (p4est_quadrant_is_node (q, 1) ||
+                  p4est_quadrant_is_valid (q));
+
+    /* the owner is in the last block that starts no later than q */
+    k = p4est_comm_positions_last_le (sparse->sample_position,
+                                      sparse->num_samples + 1,
+                                      q->p.which_tree, q);
+    P4EST_ASSERT (k < sparse->num_samples);
+    if (k == block) {
+      owners[zz] = p4est_comm_sparse_block_owner (sparse, q);
+    }
+    else {
+      owners[zz] = -1;
+    }
+#ifdef P4EST_ENABLE_MPI
+    blocks[zz] = k;
+    if (k != block) {
+      ++counts[k + 1];
+    }
+#endif
+  }
+
+#ifdef P4EST_ENABLE_MPI
+  /* sort the remote queries by the first process of their block */
+  num_receivers = 0;
+  for (k = 0; k < sparse->num_samples; ++k) {
+    num_receivers += (counts[k + 1] > 0);
+    counts[k + 1] += counts[k];
+  }
+  num_remote = (size_t) counts[sparse->num_samples];
+  first = P4EST_ALLOC (int, sparse->num_samples + 1);
+  memcpy (first, counts, (sparse->num_samples + 1) * sizeof (int));
+  order = P4EST_ALLOC (int, num_remote);
+  sendq = P4EST_ALLOC (p4est_quadrant_t, num_remote);
+  for (zz = 0; zz < quadrants->elem_count; ++zz) {
+    k = blocks[zz];
+    if (k != block) {
+      order[counts[k]] = (int) zz;
+      sendq[counts[k]++] =
+        *p4est_quadrant_array_index (quadrants, zz);
+    }
+  }
+  P4EST_FREE (blocks);
+  receivers = P4EST_ALLOC (int, num_receivers);
+  for (k = 0, i = 0; k < sparse->num_samples; ++k) {
+    if (first[k + 1] > first[k]) {
+      receivers[i++] = k * sparse->stride;
+    }
+  }
+  P4EST_ASSERT (i == num_receivers);
+  senders = P4EST_ALLOC (int, sparse->mpisize);
+  mpiret = sc_notify (receivers, num_receivers, senders, &num_senders,
+                      sparse->mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  /* post the queries and the receives of their answers */
+  requests = P4EST_ALLOC (MPI_Request, 2 * num_receivers + num_senders);
+  replies = P4EST_ALLOC (int, num_remote);
+  for (i = 0; i < num_receivers; ++i) {
+    k = receivers[i] / sparse->stride;
+    mpiret = MPI_Isend (sendq + first[k], (first[k + 1] - first[k]) *
+                        (int) sizeof (p4est_quadrant_t), MPI_BYTE,
+                        receivers[i], P4EST_COMM_SPARSE_QUERY,
+                        sparse->mpicomm, &requests[i]);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Irecv (replies + first[k], first[k + 1] - first[k],
+                        MPI_INT, receivers[i], P4EST_COMM_SPARSE_REPLY,
+                        sparse->mpicomm, &requests[num_receivers + i]);
+    SC_CHECK_MPI (mpiret);
+  }
+
+  /* answer the queries addressed to our block */
+  recvq = NULL;
+  answers = P4EST_ALLOC (int *, num_senders);
+  for (j = 0; j < num_senders; ++j) {
+    mpiret = MPI_Probe (senders[j], P4EST_COMM_SPARSE_QUERY,
+                        sparse->mpicomm, &status);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Get_count (&status, MPI_BYTE, &rcount);
+    SC_CHECK_MPI (mpiret);
+    SC_CHECK_ABORT (rcount % (int) sizeof (p4est_quadrant_t) == 0,
+                    "Sparse owner query mismatch");
+    rcount /= (int) sizeof (p4est_quadrant_t);
+    recvq = P4EST_REALLOC (recvq, p4est_quadrant_t, rcount);
+    mpiret = MPI_Recv (recvq, rcount * (int) sizeof (p4est_quadrant_t),
+                       MPI_BYTE, senders[j], P4EST_COMM_SPARSE_QUERY,
+                       sparse->mpicomm, MPI_STATUS_IGNORE);
+    SC_CHECK_MPI (mpiret);
+    answers[j] = P4EST_ALLOC (int, rcount);
+    for (i = 0; i < rcount; ++i) {
+      answers[j][i] = p4est_comm_sparse_block_owner (sparse, &recvq[i]);
+    }
+    mpiret = MPI_Isend (answers[j], rcount, MPI_INT, senders[j],
+                        P4EST_COMM_SPARSE_REPLY, sparse->mpicomm,
+                        &requests[2 * num_receivers + j]);
+    SC_CHECK_MPI (mpiret);
+  }
+  P4EST_FREE (recvq);
+
+  /* wait for all messages to complete */
+  mpiret = MPI_Waitall (2 * num_receivers + num_senders, requests,
+                        MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  for (j = 0; j < num_senders; ++j) {
+    P4EST_FREE (answers[j]);
+  }
+  P4EST_FREE (answers);
+  for (zz = 0; zz < num_remote; ++zz) {
+    owners[order[zz]] = replies[zz];
+  }
+
+  P4EST_FREE (replies);
+  P4EST_FREE (requests);
+  P4EST_FREE (senders);
+  P4EST_FREE (receivers);
+  P4EST_FREE (sendq);
+  P4EST_FREE (order);
+  P4EST_FREE (first);
+  P4EST_FREE (counts);
+#endif
+}
+
 void
 p4est_comm_tree_info (p4est_t * p4est, p4est_locidx_t which_tree,
                       int full_tree[], int tree_contact[],
@@ -814,7 +1412,7 @@ p4est_comm_tree_info (p4est_t * p4est, p4est_locidx_t which_tree,
 {
   const p4est_quadrant_t *first_pos, *next_pos;
   p4est_connectivity_t *conn = p4est->connectivity;
-  int                 face;
+  int                 face, nface;
 
   P4EST_ASSERT (p4est->first_local_tree <= which_tree);
   P4EST_ASSERT (which_tree <= p4est->last_local_tree);
@@ -840,9 +1438,9 @@ p4est_comm_tree_info (p4est_t * p4est, p4est_locidx_t which_tree,
   if (tree_contact != NULL) {
     for (face = 0; face < P4EST_FACES; ++face) {
       tree_contact[face] =
-        (conn->tree_to_tree[P4EST_FACES * which_tree + face] != which_tree
-         || (int) conn->tree_to_face[P4EST_FACES * which_tree + face] !=
-         face);
+        (p4est_connectivity_face_neighbor_tree (conn, which_tree, face,
+                                                &nface) != which_tree
+         || nface != face);
     }
   }
 
@@ -969,6 +1567,292 @@ p4est_comm_checksum (p4est_t * p4est, unsigned local_crc, size_t local_bytes)
 #endif /* !P4EST_HAVE_ZLIB */
 }
 
+#ifdef P4EST_ENABLE_MPI
+
+/** Reduction operator on (checksum, byte count) pairs in rank order. */
+static void
+p4est_comm_crc32c_op (void *invec, void *inoutvec, int *len,
+                      MPI_Datatype * datatype)
+{
+  int                 i;
+  const uint64_t     *in = (const uint64_t *) invec;
+  uint64_t           *inout = (uint64_t *) inoutvec;
+
+  /* the input stems from the lower ranks and precedes the output */
+  for (i = 0; i < *len; ++i, in += 2, inout += 2) {
+    inout[0] = p4est_crc32c_combine ((unsigned) in[0], (unsigned) inout[0],
+                                     (size_t) inout[1]);
+    inout[1] += in[1];
+  }
+}
+
+#endif /* P4EST_ENABLE_MPI */
+
+unsigned
+p4est_comm_checksum_crc32c (p4est_t * p4est, unsigned local_crc,
+                            size_t local_bytes)
+{
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+  uint64_t            send[2], recv[2];
+  MPI_Datatype        pairtype;
+  MPI_Op              op;
+
+  send[0] = (uint64_t) local_crc;
+  send[1] = (uint64_t) local_bytes;
+  mpiret = MPI_Type_contiguous (2, MPI_LONG_LONG_INT, &pairtype);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Type_commit (&pairtype);
+  SC_CHECK_MPI (mpiret);
+
+  /* the operator is not commutative, so MPI respects the rank order */
+  mpiret = MPI_Op_create (p4est_comm_crc32c_op, 0, &op);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Allreduce (send, recv, 1, pairtype, op, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Op_free (&op);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Type_free (&pairtype);
+  SC_CHECK_MPI (mpiret);
+
+  return (unsigned) recv[0];
+#else
+  return local_crc;
+#endif
+}
+
+#ifdef P4EST_ENABLE_MPICOMMSHARED
+
+/** Compare two (leader, member, sender) triples lexicographically. */
+static int
+p4est_comm_notify_triple_compare (const void *v1, const void *v2)
+{
+  const int          *t1 = (const int *) v1;
+  const int          *t2 = (const int *) v2;
+  int                 i;
+
+  for (i = 0; i < 3; ++i) {
+    if (t1[i] != t2[i]) {
+      return t1[i] < t2[i] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+#endif /* P4EST_ENABLE_MPICOMMSHARED */
+
+int
+p4est_comm_notify_nodes (int *receivers, int num_receivers,
+                         int *senders, int *num_senders,
+                         sc_MPI_Comm mpicomm)
+{
+#ifndef P4EST_ENABLE_MPICOMMSHARED
+  return sc_notify (receivers, num_receivers, senders, num_senders, mpicomm);
+#else
+  int                 mpiret;
+  int                 i, j, k, l;
+  int                 rank, noderank, nodesize;
+  int                 num_leaders, leaderrank;
+  int                 num_triples, num_dests, num_sources;
+  int                 rcount, first, count;
+  int                *counts, *displs, *members, *recvs;
+  int                *nodesizes, *nodedispls, *allmembers;
+  int                *leader_of, *member_of;
+  int                *triples, *dests, *sources, *dest_first;
+  int                *t, *outcounts, *outdispls, *outbuf;
+  MPI_Comm            nodecomm, leadercomm;
+  MPI_Request        *requests;
+  MPI_Status          status;
+  sc_array_t          collect;
+
+  mpiret = MPI_Comm_rank (mpicomm, &rank);
+  SC_CHECK_MPI (mpiret);
+
+  /* group the processes by shared memory node and pick node leaders */
+  mpiret = MPI_Comm_split_type (mpicomm, MPI_COMM_TYPE_SHARED, rank,
+                                MPI_INFO_NULL, &nodecomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_rank (nodecomm, &noderank);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_size (nodecomm, &nodesize);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_split (mpicomm, noderank == 0 ? 0 : MPI_UNDEFINED,
+                           rank, &leadercomm);
+  SC_CHECK_MPI (mpiret);
+
+  /* collect the receiver lists of the node on its leader */
+  counts = displs = members = recvs = NULL;
+  if (noderank == 0) {
+    counts = P4EST_ALLOC (int, nodesize);
+    displs = P4EST_ALLOC (int, nodesize + 1);
+    members = P4EST_ALLOC (int, nodesize);
+  }
+  mpiret = MPI_Gather (&num_receivers, 1, MPI_INT,
+                       counts, 1, MPI_INT, 0, nodecomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Gather (&rank, 1, MPI_INT, members, 1, MPI_INT, 0, nodecomm);
+  SC_CHECK_MPI (mpiret);
+  if (noderank == 0) {
+    displs[0] = 0;
+    for (i = 0; i < nodesize; ++i) {
+      displs[i + 1] = displs[i] + counts[i];
+    }
+    recvs = P4EST_ALLOC (int, displs[nodesize]);
+  }
+  mpiret = MPI_Gatherv (receivers, num_receivers, MPI_INT,
+                        recvs, counts, displs, MPI_INT, 0, nodecomm);
+  SC_CHECK_MPI (mpiret);
+
+  outcounts = outdispls = outbuf = NULL;
+  if (noderank == 0) {
+    mpiret = MPI_Comm_size (leadercomm, &num_leaders);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Comm_rank (leadercomm, &leaderrank);
+    SC_CHECK_MPI (mpiret);
+
+    /* every leader learns the node and node rank of every process */
+    nodesizes = P4EST_ALLOC (int, num_leaders);
+    nodedispls = P4EST_ALLOC (int, num_leaders + 1);
+    mpiret = MPI_Allgather (&nodesize, 1, MPI_INT,
+                            nodesizes, 1, MPI_INT, leadercomm);
+    SC_CHECK_MPI (mpiret);
+    nodedispls[0] = 0;
+    for (l = 0; l < num_leaders; ++l) {
+      nodedispls[l + 1] = nodedispls[l] + nodesizes[l];
+    }
+    allmembers = P4EST_ALLOC (int, nodedispls[num_leaders]);
+    mpiret = MPI_Allgatherv (members, nodesize, MPI_INT, allmembers,
+                             nodesizes, nodedispls, MPI_INT, leadercomm);
+    SC_CHECK_MPI (mpiret);
+    leader_of = P4EST_ALLOC (int, nodedispls[num_leaders]);
+    member_of = P4EST_ALLOC (int, nodedispls[num_leaders]);
+    for (l = 0; l < num_leaders; ++l) {
+      for (k = nodedispls[l]; k < nodedispls[l + 1]; ++k) {
+        j = allmembers[k];
+        leader_of[j] = l;
+        member_of[j] = k - nodedispls[l];
+      }
+    }
+    P4EST_FREE (allmembers);
+    P4EST_FREE (nodedispls);
+    P4EST_FREE (nodesizes);
+
+    /* address every message by the node of its receiver */
+    num_triples = displs[nodesize];
+    triples = P4EST_ALLOC (int, 3 * num_triples);
+    for (i = 0; i < nodesize; ++i) {
+      for (k = displs[i]; k < displs[i + 1]; ++k) {
+        j = recvs[k];
+        triples[3 * k + 0] = leader_of[j];
+        triples[3 * k + 1] = member_of[j];
+        triples[3 * k + 2] = members[i];
+      }
+    }
+    qsort (triples, (size_t) num_triples, 3 * sizeof (int),
+           p4est_comm_notify_triple_compare);
+    P4EST_FREE (member_of);
+    P4EST_FREE (leader_of);
+
+    /* determine the destination leaders and notify among the leaders */
+    dests = P4EST_ALLOC (int, num_leaders);
+    dest_first = P4EST_ALLOC (int, num_leaders + 1);
+    num_dests = 0;
+    for (k = 0; k < num_triples; ++k) {
+      l = triples[3 * k];
+      if (l != leaderrank && (num_dests == 0 || dests[num_dests - 1] != l)) {
+        dests[num_dests] = l;
+        dest_first[num_dests++] = k;
+      }
+    }
+    sources = P4EST_ALLOC (int, num_leaders);
+    mpiret = sc_notify (dests, num_dests, sources, &num_sources, leadercomm);
+    SC_CHECK_MPI (mpiret);
+
+    /* send the triples to their leaders */
+    requests = P4EST_ALLOC (MPI_Request, num_dests);
+    for (l = 0; l < num_dests; ++l) {
+      first = dest_first[l];
+      for (count = 0; first + count < num_triples &&
+           triples[3 * (first + count)] == dests[l]; ++count) {
+      }
+      mpiret = MPI_Isend (triples + 3 * first, 3 * count, MPI_INT, dests[l],
+                          P4EST_COMM_NOTIFY_NODES, leadercomm, &requests[l]);
+      SC_CHECK_MPI (mpiret);
+    }
+
+    /* collect the triples addressed to this node, including its own */
+    sc_array_init (&collect, 3 * sizeof (int));
+    for (k = 0; k < num_triples; ++k) {
+      if (triples[3 * k] == leaderrank) {
+        memcpy (sc_array_push (&collect), triples + 3 * k, 3 * sizeof (int));
+      }
+    }
+    for (l = 0; l < num_sources; ++l) {
+      mpiret = MPI_Probe (sources[l], P4EST_COMM_NOTIFY_NODES, leadercomm,
+                          &status);
+      SC_CHECK_MPI (mpiret);
+      mpiret = MPI_Get_count (&status, MPI_INT, &rcount);
+      SC_CHECK_MPI (mpiret);
+      SC_CHECK_ABORT (rcount % 3 == 0, "Notify nodes count mismatch");
+      first = (int) collect.elem_count;
+      sc_array_resize (&collect, (size_t) (first + rcount / 3));
+      mpiret = MPI_Recv (sc_array_index_int (&collect, first), rcount,
+                         MPI_INT, sources[l], P4EST_COMM_NOTIFY_NODES,
+                         leadercomm, MPI_STATUS_IGNORE);
+      SC_CHECK_MPI (mpiret);
+    }
+    sc_array_sort (&collect, p4est_comm_notify_triple_compare);
+
+    /* sort the senders by the member that receives from them */
+    outcounts = counts;
+    outdispls = displs;
+    for (i = 0; i < nodesize; ++i) {
+      outcounts[i] = 0;
+    }
+    outbuf = P4EST_ALLOC (int, collect.elem_count);
+    for (k = 0; k < (int) collect.elem_count; ++k) {
+      t = (int *) sc_array_index_int (&collect, k);
+      P4EST_ASSERT (t[0] == leaderrank);
+      P4EST_ASSERT (0 <= t[1] && t[1] < nodesize);
+      ++outcounts[t[1]];
+      outbuf[k] = t[2];
+    }
+    outdispls[0] = 0;
+    for (i = 0; i < nodesize; ++i) {
+      outdispls[i + 1] = outdispls[i] + outcounts[i];
+    }
+
+    mpiret = MPI_Waitall (num_dests, requests, MPI_STATUSES_IGNORE);
+    SC_CHECK_MPI (mpiret);
+    P4EST_FREE (requests);
+    sc_array_reset (&collect);
+    P4EST_FREE (sources);
+    P4EST_FREE (dest_first);
+    P4EST_FREE (dests);
+    P4EST_FREE (triples);
+    P4EST_FREE (recvs);
+    P4EST_FREE (members);
+    mpiret = MPI_Comm_free (&leadercomm);
+    SC_CHECK_MPI (mpiret);
+  }
+
+  /* hand the senders to the members of the node */
+  mpiret = MPI_Scatter (outcounts, 1, MPI_INT, num_senders, 1, MPI_INT,
+                        0, nodecomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Scatterv (outbuf, outcounts, outdispls, MPI_INT,
+                         senders, *num_senders, MPI_INT, 0, nodecomm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (outbuf);
+  P4EST_FREE (counts);
+  P4EST_FREE (displs);
+  mpiret = MPI_Comm_free (&nodecomm);
+  SC_CHECK_MPI (mpiret);
+
+  return sc_MPI_SUCCESS;
+#endif /* P4EST_ENABLE_MPICOMMSHARED */
+}
+
 void
 p4est_transfer_fixed (const p4est_gloidx_t * dest_gfq,
                       const p4est_gloidx_t * src_gfq,
@@ -1177,6 +2061,7 @@ void
 p4est_transfer_end (p4est_transfer_context_t * tc)
 {
   int                 mpiret;
+  int                 i;
 
   P4EST_ASSERT (tc != NULL);
 
@@ -1186,13 +2071,34 @@ p4est_transfer_end (p4est_transfer_context_t * tc)
                              sc_MPI_STATUSES_IGNORE);
     SC_CHECK_MPI (mpiret);
   }
+  if (tc->recv_buf != NULL) {
+    /* decode the compressed messages */
+    for (i = 0; i < tc->num_senders; ++i) {
+      if (tc->recv_buf[i] != NULL) {
+        p4est_comm_compress_unpack (tc->recv_buf[i], tc->recv_dest[i],
+                                    tc->recv_bytes[i]);
+        P4EST_FREE (tc->recv_buf[i]);
+      }
+    }
+    P4EST_FREE (tc->recv_buf);
+    P4EST_FREE (tc->recv_dest);
+    P4EST_FREE (tc->recv_bytes);
+  }
   if (tc->num_receivers > 0) {
     mpiret = sc_MPI_Waitall (tc->num_receivers, tc->send_req,
                              sc_MPI_STATUSES_IGNORE);
     SC_CHECK_MPI (mpiret);
   }
+  if (tc->send_buf != NULL) {
+    for (i = 0; i < tc->num_receivers; ++i) {
+      P4EST_FREE (tc->send_buf[i]);
+    }
+    P4EST_FREE (tc->send_buf);
+  }
   P4EST_FREE (tc->recv_req);
   P4EST_FREE (tc->send_req);
+  p4est_inspect_stop (tc->inspect, P4EST_INSPECT_TRANSFER,
+                      tc->inspect_start);
 
   /* the context must disappear */
   P4EST_FREE (tc);
@@ -1228,7 +2134,9 @@ p4est_transfer_begin (const p4est_gloidx_t * dest_gfq,
                       sc_MPI_Comm mpicomm, int tag,
                       void *dest_data, const int *dest_sizes,
                       const void *src_data, const int *src_sizes,
-                      size_t item_size, int variable)
+                      size_t item_size, int variable,
+                      p4est_comm_compress_t * compress,
+                      p4est_inspect_t * inspect)
 {
   p4est_transfer_context_t *tc;
   int                 mpiret;
@@ -1243,7 +2151,9 @@ p4est_transfer_begin (const p4est_gloidx_t * dest_gfq,
   const int          *rs;
   char               *rb;
   char               *dest_cp, *src_cp;
-  size_t              byte_len, cp_len;
+  size_t              byte_len, cp_len, wire_len;
+  size_t              num_sent, bytes_sent;
+  size_t              num_received, bytes_received;
   p4est_gloidx_t      dest_begin, dest_end;
   p4est_gloidx_t      src_begin, src_end;
   p4est_gloidx_t      gbegin, gend;
@@ -1256,6 +2166,11 @@ p4est_transfer_begin (const p4est_gloidx_t * dest_gfq,
   /* setup context structure */
   tc = P4EST_ALLOC_ZERO (p4est_transfer_context_t, 1);
   tc->variable = variable;
+  tc->compress = compress != NULL &&
+    compress->codec != P4EST_COMM_CODEC_NONE ? compress : NULL;
+  tc->inspect = inspect;
+  tc->inspect_start = p4est_inspect_start (inspect);
+  num_sent = bytes_sent = num_received = bytes_received = 0;
 
   /* there is nothing to do when there is no data */
   if (item_size == 0) {
@@ -1297,6 +2212,11 @@ p4est_transfer_begin (const p4est_gloidx_t * dest_gfq,
     rq = tc->recv_req = P4EST_ALLOC (sc_MPI_Request, tc->num_senders);
     rb = (char *) dest_data;
     rs = dest_sizes;
+    if (tc->compress != NULL) {
+      tc->recv_buf = P4EST_ALLOC_ZERO (char *, tc->num_senders);
+      tc->recv_dest = P4EST_ALLOC (char *, tc->num_senders);
+      tc->recv_bytes = P4EST_ALLOC (size_t, tc->num_senders);
+    }
     for (q = first_sender; q <= last_sender; ++q) {
       /* prepare positions for the sender process q */
       gbegin = gend;
@@ -1328,12 +2248,28 @@ p4est_transfer_begin (const p4est_gloidx_t * dest_gfq,
           dest_cp = rb;
           *rq++ = sc_MPI_REQUEST_NULL;
         }
+        else if (tc->compress != NULL) {
+          /* we receive a compressed message and decode it later */
+          i = (int) (rq - tc->recv_req);
+          tc->recv_dest[i] = rb;
+          tc->recv_bytes[i] = byte_len;
+          tc->recv_buf[i] =
+            P4EST_ALLOC (char, p4est_comm_compress_bound (byte_len));
+          mpiret = sc_MPI_Irecv (tc->recv_buf[i], (int)
+                                 p4est_comm_compress_bound (byte_len),
+                                 sc_MPI_BYTE, q, tag, mpicomm, rq++);
+          SC_CHECK_MPI (mpiret);
+        }
         else {
           /* we receive a proper message */
           mpiret = sc_MPI_Irecv (rb, byte_len, sc_MPI_BYTE, q,
                                  tag, mpicomm, rq++);
           SC_CHECK_MPI (mpiret);
         }
+        if (q != mpirank) {
+          ++num_received;
+          bytes_received += byte_len;
+        }
         rb += byte_len;
       }
     }
@@ -1364,6 +2300,9 @@ p4est_transfer_begin (const p4est_gloidx_t * dest_gfq,
     rq = tc->send_req = P4EST_ALLOC (sc_MPI_Request, tc->num_receivers);
     rb = (char *) src_data;
     rs = src_sizes;
+    if (tc->compress != NULL) {
+      tc->send_buf = P4EST_ALLOC_ZERO (char *, tc->num_receivers);
+    }
     for (q = first_receiver; q <= last_receiver; ++q) {
       /* prepare positions for the receiver process q */
       gbegin = gend;
@@ -1395,11 +2334,28 @@ p4est_transfer_begin (const p4est_gloidx_t * dest_gfq,
           src_cp = rb;
           *rq++ = sc_MPI_REQUEST_NULL;
         }
+        else if (tc->compress != NULL) {
+          /* we encode the message into a buffer of its own */
+          i = (int) (rq - tc->send_req);
+          tc->send_buf[i] =
+            P4EST_ALLOC (char, p4est_comm_compress_bound (byte_len));
+          wire_len = p4est_comm_compress_pack (tc->compress, rb, byte_len,
+                                               tc->send_buf[i]);
+          mpiret = sc_MPI_Isend (tc->send_buf[i], (int) wire_len,
+                                 sc_MPI_BYTE, q, tag, mpicomm, rq++);
+          SC_CHECK_MPI (mpiret);
+          ++num_sent;
+          bytes_sent += wire_len;
+          p4est_inspect_send (inspect, P4EST_INSPECT_TRANSFER, q, wire_len);
+        }
         else {
           /* we send a proper message */
           mpiret = sc_MPI_Isend (rb, byte_len, sc_MPI_BYTE, q,
                                  tag, mpicomm, rq++);
           SC_CHECK_MPI (mpiret);
+          ++num_sent;
+          bytes_sent += byte_len;
+          p4est_inspect_send (inspect, P4EST_INSPECT_TRANSFER, q, byte_len);
         }
         rb += byte_len;
       }
@@ -1413,6 +2369,9 @@ p4est_transfer_begin (const p4est_gloidx_t * dest_gfq,
     P4EST_ASSERT (dest_cp != NULL && src_cp != NULL);
     memcpy (dest_cp, src_cp, cp_len);
   }
+  p4est_inspect_comm (inspect, P4EST_INSPECT_TRANSFER,
+                      num_sent + num_received, num_sent, bytes_sent,
+                      num_received, bytes_received);
 
   /* the rest goes into the p4est_transfer_custom_end function */
   return tc;
@@ -1427,7 +2386,71 @@ p4est_transfer_custom_begin (const p4est_gloidx_t * dest_gfq,
 {
   return p4est_transfer_begin
     (dest_gfq, src_gfq, mpicomm, tag,
-     dest_data, dest_sizes, src_data, src_sizes, 1, 1);
+     dest_data, dest_sizes, src_data, src_sizes, 1, 1, NULL, NULL);
+}
+
+void
+p4est_transfer_custom_compressed (const p4est_gloidx_t * dest_gfq,
+                                  const p4est_gloidx_t * src_gfq,
+                                  sc_MPI_Comm mpicomm, int tag,
+                                  void *dest_data, const int *dest_sizes,
+                                  const void *src_data, const int *src_sizes,
+                                  p4est_comm_compress_t * compress)
+{
+  p4est_transfer_context_t *tc;
+
+  tc = p4est_transfer_custom_compressed_begin (dest_gfq, src_gfq, mpicomm,
+                                               tag, dest_data, dest_sizes,
+                                               src_data, src_sizes,
+                                               compress);
+  p4est_transfer_custom_end (tc);
+}
+
+p4est_transfer_context_t *
+p4est_transfer_custom_compressed_begin (const p4est_gloidx_t * dest_gfq,
+                                        const p4est_gloidx_t * src_gfq,
+                                        sc_MPI_Comm mpicomm, int tag,
+                                        void *dest_data,
+                                        const int *dest_sizes,
+                                        const void *src_data,
+                                        const int *src_sizes,
+                                        p4est_comm_compress_t * compress)
+{
+  return p4est_transfer_begin
+    (dest_gfq, src_gfq, mpicomm, tag,
+     dest_data, dest_sizes, src_data, src_sizes, 1, 1, compress, NULL);
+}
+
+void
+p4est_transfer_custom_ext (const p4est_gloidx_t * dest_gfq,
+                           const p4est_gloidx_t * src_gfq,
+                           sc_MPI_Comm mpicomm, int tag,
+                           void *dest_data, const int *dest_sizes,
+                           const void *src_data, const int *src_sizes,
+                           p4est_comm_compress_t * compress,
+                           p4est_inspect_t * inspect)
+{
+  p4est_transfer_context_t *tc;
+
+  tc = p4est_transfer_custom_ext_begin (dest_gfq, src_gfq, mpicomm, tag,
+                                        dest_data, dest_sizes,
+                                        src_data, src_sizes,
+                                        compress, inspect);
+  p4est_transfer_custom_end (tc);
+}
+
+p4est_transfer_context_t *
+p4est_transfer_custom_ext_begin (const p4est_gloidx_t * dest_gfq,
+                                 const p4est_gloidx_t * src_gfq,
+                                 sc_MPI_Comm mpicomm, int tag,
+                                 void *dest_data, const int *dest_sizes,
+                                 const void *src_data, const int *src_sizes,
+                                 p4est_comm_compress_t * compress,
+                                 p4est_inspect_t * inspect)
+{
+  return p4est_transfer_begin
+    (dest_gfq, src_gfq, mpicomm, tag,
+     dest_data, dest_sizes, src_data, src_sizes, 1, 1, compress, inspect);
 }
 
 p4est_transfer_context_t *
@@ -1440,7 +2463,8 @@ p4est_transfer_items_begin (const p4est_gloidx_t * dest_gfq,
 {
   return p4est_transfer_begin
     (dest_gfq, src_gfq, mpicomm, tag,
-     dest_data, dest_counts, src_data, src_counts, item_size, 2);
+     dest_data, dest_counts, src_data, src_counts, item_size, 2, NULL,
+     NULL);
 }
 
 void
@@ -1476,3 +2500,470 @@ p4est_transfer_items_end (p4est_transfer_context_t * tc)
 
   p4est_transfer_end (tc);
 }
+
+#ifdef P4EST_ENABLE_MPI
+
+/** Post one message for a run of items with their own memory each.
+ * Empty items are skipped and no message is posted if all are empty.
+ */
+static void
+p4est_transfer_iovec_post (const p4est_transfer_iovec_t * iov, int count,
+                           int send, int peer, int tag, sc_MPI_Comm mpicomm,
+                           sc_MPI_Request * request)
+{
+  int                 mpiret;
+  int                 i, n;
+  int                *lengths;
+  MPI_Aint           *displs;
+  MPI_Datatype        type;
+
+  lengths = P4EST_ALLOC (int, count);
+  displs = P4EST_ALLOC (MPI_Aint, count);
+  for (i = n = 0; i < count; ++i) {
+    if (iov[i].len > 0) {
+      P4EST_ASSERT (iov[i].base != NULL);
+      P4EST_ASSERT (iov[i].len <= (size_t) INT_MAX);
+      lengths[n] = (int) iov[i].len;
+      mpiret = MPI_Get_address (iov[i].base, &displs[n++]);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+  if (n == 0) {
+    *request = sc_MPI_REQUEST_NULL;
+  }
+  else {
+    mpiret = MPI_Type_create_hindexed (n, lengths, displs, MPI_BYTE, &type);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Type_commit (&type);
+    SC_CHECK_MPI (mpiret);
+    if (send) {
+      mpiret = MPI_Isend (MPI_BOTTOM, 1, type, peer, tag, mpicomm, request);
+    }
+    else {
+      mpiret = MPI_Irecv (MPI_BOTTOM, 1, type, peer, tag, mpicomm, request);
+    }
+    SC_CHECK_MPI (mpiret);
+
+    /* the type is released by MPI once the message has completed */
+    mpiret = MPI_Type_free (&type);
+    SC_CHECK_MPI (mpiret);
+  }
+  P4EST_FREE (lengths);
+  P4EST_FREE (displs);
+}
+
+#endif /* P4EST_ENABLE_MPI */
+
+void
+p4est_transfer_iovec (const p4est_gloidx_t * dest_gfq,
+                      const p4est_gloidx_t * src_gfq,
+                      sc_MPI_Comm mpicomm, int tag, const int *dest_sizes,
+                      p4est_transfer_alloc_t alloc_fn, void *user,
+                      const p4est_transfer_iovec_t * src_iov)
+{
+  p4est_transfer_context_t *tc;
+
+  tc = p4est_transfer_iovec_begin (dest_gfq, src_gfq, mpicomm, tag,
+                                   dest_sizes, alloc_fn, user, src_iov);
+  p4est_transfer_iovec_end (tc);
+}
+
+p4est_transfer_context_t *
+p4est_transfer_iovec_begin (const p4est_gloidx_t * dest_gfq,
+                            const p4est_gloidx_t * src_gfq,
+                            sc_MPI_Comm mpicomm, int tag,
+                            const int *dest_sizes,
+                            p4est_transfer_alloc_t alloc_fn, void *user,
+                            const p4est_transfer_iovec_t * src_iov)
+{
+  p4est_transfer_context_t *tc;
+  int                 mpisize, mpirank;
+  p4est_locidx_t      kl, num_dest;
+  p4est_gloidx_t      dest_begin, dest_end;
+  p4est_gloidx_t      src_begin, src_end;
+  p4est_gloidx_t      gk, gbegin, gend;
+  p4est_transfer_iovec_t *dest_iov;
+#ifdef P4EST_ENABLE_MPI
+  int                 q, first, last;
+  sc_MPI_Request     *rq;
+#endif
+
+  /* setup context structure */
+  tc = P4EST_ALLOC_ZERO (p4est_transfer_context_t, 1);
+  tc->variable = 3;
+
+  /* grab local partition information */
+  p4est_transfer_assign_comm (dest_gfq, src_gfq, mpicomm, &mpisize, &mpirank);
+  dest_begin = dest_gfq[mpirank];
+  dest_end = dest_gfq[mpirank + 1];
+  src_begin = src_gfq[mpirank];
+  src_end = src_gfq[mpirank + 1];
+
+  /* request the memory of every item to be received */
+  num_dest = (p4est_locidx_t) (dest_end - dest_begin);
+  P4EST_ASSERT (num_dest == 0 || dest_sizes != NULL);
+  dest_iov = P4EST_ALLOC (p4est_transfer_iovec_t, num_dest);
+  for (kl = 0; kl < num_dest; ++kl) {
+    P4EST_ASSERT (dest_sizes[kl] >= 0);
+    dest_iov[kl].len = (size_t) dest_sizes[kl];
+    dest_iov[kl].base = dest_iov[kl].len == 0 ? NULL :
+      alloc_fn (user, kl, dest_iov[kl].len);
+  }
+
+#ifdef P4EST_ENABLE_MPI
+  /* post one receive from each sender process */
+  if (dest_begin < dest_end) {
+    first = p4est_bsearch_partition (dest_begin, src_gfq, mpisize);
+    last = p4est_bsearch_partition (dest_end - 1, src_gfq, mpisize);
+    tc->num_senders = last - first + 1;
+    rq = tc->recv_req = P4EST_ALLOC (sc_MPI_Request, tc->num_senders);
+    for (q = first; q <= last; ++q, ++rq) {
+      gbegin = SC_MAX (src_gfq[q], dest_begin);
+      gend = SC_MIN (src_gfq[q + 1], dest_end);
+      if (q == mpirank || gbegin >= gend) {
+        *rq = sc_MPI_REQUEST_NULL;
+        continue;
+      }
+      p4est_transfer_iovec_post (dest_iov + (gbegin - dest_begin),
+                                 (int) (gend - gbegin), 0, q, tag,
+                                 mpicomm, rq);
+    }
+  }
+
+  /* post one send to each receiver process */
+  if (src_begin < src_end) {
+    P4EST_ASSERT (src_iov != NULL);
+    first = p4est_bsearch_partition (src_begin, dest_gfq, mpisize);
+    last = p4est_bsearch_partition (src_end - 1, dest_gfq, mpisize);
+    tc->num_receivers = last - first + 1;
+    rq = tc->send_req = P4EST_ALLOC (sc_MPI_Request, tc->num_receivers);
+    for (q = first; q <= last; ++q, ++rq) {
+      gbegin = SC_MAX (dest_gfq[q], src_begin);
+      gend = SC_MIN (dest_gfq[q + 1], src_end);
+      if (q == mpirank || gbegin >= gend) {
+        *rq = sc_MPI_REQUEST_NULL;
+        continue;
+      }
+      p4est_transfer_iovec_post (src_iov + (gbegin - src_begin),
+                                 (int) (gend - gbegin), 1, q, tag,
+                                 mpicomm, rq);
+    }
+  }
+#endif /* P4EST_ENABLE_MPI */
+
+  /* copy the items that remain local */
+  gbegin = SC_MAX (dest_begin, src_begin);
+  gend = SC_MIN (dest_end, src_end);
+  for (gk = gbegin; gk < gend; ++gk) {
+    kl = (p4est_locidx_t) (gk - dest_begin);
+    P4EST_ASSERT (dest_iov[kl].len == src_iov[gk - src_begin].len);
+    if (dest_iov[kl].len > 0) {
+      memcpy (dest_iov[kl].base, src_iov[gk - src_begin].base,
+              dest_iov[kl].len);
+    }
+  }
+
+  /* the addresses live on in the derived datatypes */
+  P4EST_FREE (dest_iov);
+  return tc;
+}
+
+void
+p4est_transfer_iovec_end (p4est_transfer_context_t * tc)
+{
+  P4EST_ASSERT (tc != NULL);
+  P4EST_ASSERT (tc->variable == 3);
+
+  p4est_transfer_end (tc);
+}
+
+/** One registered field of a transfer plan. */
+typedef struct p4est_transfer_field
+{
+  void               *dest_data;
+  const int          *dest_sizes;       /**< NULL for fixed-size data */
+  const void         *src_data;
+  const int          *src_sizes;        /**< NULL for fixed-size data */
+  size_t              data_size;        /**< Bytes per quadrant if fixed */
+}
+p4est_transfer_field_t;
+
+/** Compute the bytes of a field for a range of local quadrants. */
+static size_t
+p4est_transfer_field_bytes (const int *sizes, size_t data_size,
+                            p4est_locidx_t begin, p4est_locidx_t end)
+{
+  size_t              bytes;
+  p4est_locidx_t      kl;
+
+  if (sizes == NULL) {
+    return (size_t) (end - begin) * data_size;
+  }
+  for (bytes = 0, kl = begin; kl < end; ++kl) {
+    P4EST_ASSERT (sizes[kl] >= 0);
+    bytes += (size_t) sizes[kl];
+  }
+  return bytes;
+}
+
+/** Find the processes whose partition overlaps a local range.
+ * Ourselves and processes with an empty overlap are skipped.
+ * \return      The number of processes found.
+ */
+static int
+p4est_transfer_plan_peers (const p4est_gloidx_t * gfq, int mpisize,
+                           int mpirank, p4est_gloidx_t begin,
+                           p4est_gloidx_t end, int **peers,
+                           p4est_locidx_t ** ranges)
+{
+  int                 q, first, last, num_peers;
+  p4est_gloidx_t      gbegin, gend;
+
+  *peers = NULL;
+  *ranges = NULL;
+  if (begin >= end) {
+    return 0;
+  }
+  first = p4est_bsearch_partition (begin, gfq, mpisize);
+  last = p4est_bsearch_partition (end - 1, gfq, mpisize);
+  *peers = P4EST_ALLOC (int, last - first + 1);
+  *ranges = P4EST_ALLOC (p4est_locidx_t, 2 * (last - first + 1));
+  for (num_peers = 0, q = first; q <= last; ++q) {
+    gbegin = SC_MAX (gfq[q], begin);
+    gend = SC_MIN (gfq[q + 1], end);
+    if (q == mpirank || gbegin >= gend) {
+      continue;
+    }
+    (*peers)[num_peers] = q;
+    (*ranges)[2 * num_peers] = (p4est_locidx_t) (gbegin - begin);
+    (*ranges)[2 * num_peers + 1] = (p4est_locidx_t) (gend - begin);
+    ++num_peers;
+  }
+  return num_peers;
+}
+
+p4est_transfer_plan_t *
+p4est_transfer_plan_new (const p4est_gloidx_t * dest_gfq,
+                         const p4est_gloidx_t * src_gfq,
+                         sc_MPI_Comm mpicomm)
+{
+  int                 mpisize, mpirank;
+  p4est_gloidx_t      dest_begin, dest_end;
+  p4est_gloidx_t      src_begin, src_end;
+  p4est_gloidx_t      gbegin, gend;
+  p4est_transfer_plan_t *plan;
+
+  p4est_transfer_assign_comm (dest_gfq, src_gfq, mpicomm, &mpisize, &mpirank);
+  dest_begin = dest_gfq[mpirank];
+  dest_end = dest_gfq[mpirank + 1];
+  src_begin = src_gfq[mpirank];
+  src_end = src_gfq[mpirank + 1];
+
+  plan = P4EST_ALLOC_ZERO (p4est_transfer_plan_t, 1);
+  plan->mpicomm = mpicomm;
+  plan->mpisize = mpisize;
+  plan->mpirank = mpirank;
+  plan->dest_gfq = P4EST_ALLOC (p4est_gloidx_t, mpisize + 1);
+  memcpy (plan->dest_gfq, dest_gfq, (mpisize + 1) * sizeof (p4est_gloidx_t));
+  plan->src_gfq = P4EST_ALLOC (p4est_gloidx_t, mpisize + 1);
+  memcpy (plan->src_gfq, src_gfq, (mpisize + 1) * sizeof (p4est_gloidx_t));
+  sc_array_init (&plan->fields, sizeof (p4est_transfer_field_t));
+
+  /* the peer ranges depend on the two partitions only */
+  plan->num_senders =
+    p4est_transfer_plan_peers (src_gfq, mpisize, mpirank, dest_begin,
+                               dest_end, &plan->senders,
+                               &plan->recv_ranges);
+  plan->num_receivers =
+    p4est_transfer_plan_peers (dest_gfq, mpisize, mpirank, src_begin,
+                               src_end, &plan->receivers,
+                               &plan->send_ranges);
+
+  /* the quadrants that stay on this process */
+  gbegin = SC_MAX (dest_begin, src_begin);
+  gend = SC_MIN (dest_end, src_end);
+  if (gbegin < gend) {
+    plan->local_dest = (p4est_locidx_t) (gbegin - dest_begin);
+    plan->local_src = (p4est_locidx_t) (gbegin - src_begin);
+    plan->local_count = (p4est_locidx_t) (gend - gbegin);
+  }
+  return plan;
+}
+
+void
+p4est_transfer_plan_destroy (p4est_transfer_plan_t * plan)
+{
+  P4EST_ASSERT (plan != NULL);
+
+  sc_array_reset (&plan->fields);
+  P4EST_FREE (plan->senders);
+  P4EST_FREE (plan->recv_ranges);
+  P4EST_FREE (plan->receivers);
+  P4EST_FREE (plan->send_ranges);
+  P4EST_FREE (plan->dest_gfq);
+  P4EST_FREE (plan->src_gfq);
+  P4EST_FREE (plan);
+}
+
+int
+p4est_transfer_plan_is_valid (p4est_transfer_plan_t * plan,
+                              const p4est_gloidx_t * dest_gfq,
+                              const p4est_gloidx_t * src_gfq)
+{
+  const size_t        bytes = (plan->mpisize + 1) * sizeof (p4est_gloidx_t);
+
+  return !memcmp (plan->dest_gfq, dest_gfq, bytes) &&
+    !memcmp (plan->src_gfq, src_gfq, bytes);
+}
+
+int
+p4est_transfer_plan_add_fixed (p4est_transfer_plan_t * plan,
+                               void *dest_data, const void *src_data,
+                               size_t data_size)
+{
+  p4est_transfer_field_t *field;
+
+  field = (p4est_transfer_field_t *) sc_array_push (&plan->fields);
+  field->dest_data = dest_data;
+  field->dest_sizes = NULL;
+  field->src_data = src_data;
+  field->src_sizes = NULL;
+  field->data_size = data_size;
+  return (int) plan->fields.elem_count - 1;
+}
+
+int
+p4est_transfer_plan_add_custom (p4est_transfer_plan_t * plan,
+                                void *dest_data, const int *dest_sizes,
+                                const void *src_data, const int *src_sizes)
+{
+  p4est_transfer_field_t *field;
+
+  P4EST_ASSERT (plan->dest_gfq[plan->mpirank] ==
+                plan->dest_gfq[plan->mpirank + 1] || dest_sizes != NULL);
+  P4EST_ASSERT (plan->src_gfq[plan->mpirank] ==
+                plan->src_gfq[plan->mpirank + 1] || src_sizes != NULL);
+
+  field = (p4est_transfer_field_t *) sc_array_push (&plan->fields);
+  field->dest_data = dest_data;
+  field->dest_sizes = dest_sizes;
+  field->src_data = src_data;
+  field->src_sizes = src_sizes;
+  field->data_size = 0;
+  return (int) plan->fields.elem_count - 1;
+}
+
+void
+p4est_transfer_plan_clear (p4est_transfer_plan_t * plan)
+{
+  sc_array_reset (&plan->fields);
+}
+
+#ifdef P4EST_ENABLE_MPI
+
+/** Post one combined message per peer that holds a range of every field.
+ * The peers are processed in ascending order of their ranges, so the
+ * byte position of each field is advanced through its sizes only once.
+ */
+static void
+p4est_transfer_plan_post (p4est_transfer_plan_t * plan, int send, int tag,
+                          sc_MPI_Request * requests)
+{
+  const int           num_peers =
+    send ? plan->num_receivers : plan->num_senders;
+  const int          *peers = send ? plan->receivers : plan->senders;
+  const p4est_locidx_t *ranges = send ? plan->send_ranges : plan->recv_ranges;
+  const int           num_fields = (int) plan->fields.elem_count;
+  int                 k, f;
+  size_t             *bytes;
+  const int          *sizes;
+  char               *data;
+  p4est_locidx_t      cursor;
+  p4est_transfer_field_t *field;
+  p4est_transfer_iovec_t *iov;
+
+  bytes = P4EST_ALLOC_ZERO (size_t, num_fields);
+  iov = P4EST_ALLOC (p4est_transfer_iovec_t, num_fields);
+  for (cursor = k = 0; k < num_peers; ++k) {
+    for (f = 0; f < num_fields; ++f) {
+      field = (p4est_transfer_field_t *) sc_array_index_int (&plan->fields,
+                                                             f);
+      sizes = send ? field->src_sizes : field->dest_sizes;
+      data = send ? (char *) field->src_data : (char *) field->dest_data;
+      bytes[f] += p4est_transfer_field_bytes (sizes, field->data_size,
+                                              cursor, ranges[2 * k]);
+      iov[f].len = p4est_transfer_field_bytes (sizes, field->data_size,
+                                               ranges[2 * k],
+                                               ranges[2 * k + 1]);
+      iov[f].base = iov[f].len == 0 ? NULL : data + bytes[f];
+      bytes[f] += iov[f].len;
+    }
+    cursor = ranges[2 * k + 1];
+    p4est_transfer_iovec_post (iov, num_fields, send, peers[k], tag,
+                               plan->mpicomm, &requests[k]);
+  }
+  P4EST_FREE (iov);
+  P4EST_FREE (bytes);
+}
+
+#endif /* P4EST_ENABLE_MPI */
+
+p4est_transfer_context_t *
+p4est_transfer_plan_begin (p4est_transfer_plan_t * plan, int tag)
+{
+  size_t              zz, dest_ofs, src_ofs, len;
+  p4est_transfer_field_t *field;
+  p4est_transfer_context_t *tc;
+
+  /* setup context structure */
+  tc = P4EST_ALLOC_ZERO (p4est_transfer_context_t, 1);
+  tc->variable = 4;
+
+#ifdef P4EST_ENABLE_MPI
+  /* post one receive from each sender and one send to each receiver */
+  if (plan->num_senders > 0) {
+    tc->num_senders = plan->num_senders;
+    tc->recv_req = P4EST_ALLOC (sc_MPI_Request, tc->num_senders);
+    p4est_transfer_plan_post (plan, 0, tag, tc->recv_req);
+  }
+  if (plan->num_receivers > 0) {
+    tc->num_receivers = plan->num_receivers;
+    tc->send_req = P4EST_ALLOC (sc_MPI_Request, tc->num_receivers);
+    p4est_transfer_plan_post (plan, 1, tag, tc->send_req);
+  }
+#endif
+
+  /* copy the data that remains local */
+  for (zz = 0; plan->local_count > 0 && zz < plan->fields.elem_count; ++zz) {
+    field = (p4est_transfer_field_t *) sc_array_index (&plan->fields, zz);
+    dest_ofs = p4est_transfer_field_bytes (field->dest_sizes,
+                                           field->data_size, 0,
+                                           plan->local_dest);
+    src_ofs = p4est_transfer_field_bytes (field->src_sizes,
+                                          field->data_size, 0,
+                                          plan->local_src);
+    len = p4est_transfer_field_bytes (field->src_sizes, field->data_size,
+                                      plan->local_src,
+                                      plan->local_src + plan->local_count);
+    if (len > 0) {
+      memcpy ((char *) field->dest_data + dest_ofs,
+              (const char *) field->src_data + src_ofs, len);
+    }
+  }
+  return tc;
+}
+
+void
+p4est_transfer_plan_end (p4est_transfer_context_t * tc)
+{
+  P4EST_ASSERT (tc != NULL);
+  P4EST_ASSERT (tc->variable == 4);
+
+  p4est_transfer_end (tc);
+}
+
+void
+p4est_transfer_plan_execute (p4est_transfer_plan_t * plan, int tag)
+{
+  p4est_transfer_plan_end (p4est_transfer_plan_begin (plan, tag));
+}
@@ -0,0 +1,192 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P4_TO_P8
+#include <p4est_bits.h>
+#include <p4est_build.h>
+#include <p4est_compact.h>
+#else
+#include <p8est_bits.h>
+#include <p8est_build.h>
+#include <p8est_compact.h>
+#endif
+
+/* the level occupies the lowest bits of a key */
+#define P4EST_COMPACT_LEVEL_BITS 5
+#define P4EST_COMPACT_LEVEL_MASK ((1 << P4EST_COMPACT_LEVEL_BITS) - 1)
+
+/* number of leaves decoded at a time by p4est_compact_expand */
+#define P4EST_COMPACT_CHUNK 1024
+
+uint64_t
+p4est_compact_key (const p4est_quadrant_t * q)
+{
+  P4EST_ASSERT (p4est_quadrant_is_valid (q));
+  SC_ASSERT (P4EST_DIM * P4EST_QMAXLEVEL + P4EST_COMPACT_LEVEL_BITS <= 64);
+  SC_ASSERT (P4EST_QMAXLEVEL <= P4EST_COMPACT_LEVEL_MASK);
+
+  return (p4est_quadrant_linear_id (q, P4EST_QMAXLEVEL)
+          << P4EST_COMPACT_LEVEL_BITS) | (uint64_t) q->level;
+}
+
+p4est_compact_t    *
+p4est_compact_new (p4est_t * p4est)
+{
+  p4est_topidx_t      jt, num_trees;
+  p4est_locidx_t      lid;
+  size_t              zz;
+  p4est_tree_t       *tree;
+  p4est_compact_t    *compact;
+
+  compact = P4EST_ALLOC_ZERO (p4est_compact_t, 1);
+  compact->revision = p4est->revision;
+  compact->first_local_tree = p4est->first_local_tree;
+  compact->last_local_tree = p4est->last_local_tree;
+  compact->num_quadrants = p4est->local_num_quadrants;
+
+  num_trees = p4est->last_local_tree - p4est->first_local_tree + 1;
+  P4EST_ASSERT (num_trees >= 0);
+  compact->tree_offsets = P4EST_ALLOC (p4est_locidx_t, num_trees + 1);
+  compact->keys = P4EST_ALLOC (uint64_t, compact->num_quadrants);
+
+  lid = 0;
+  for (jt = 0; jt < num_trees; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, p4est->first_local_tree + jt);
+    P4EST_ASSERT (tree->quadrants_offset == lid);
+    compact->tree_offsets[jt] = lid;
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lid) {
+      compact->keys[lid] = p4est_compact_key
+        (p4est_quadrant_array_index (&tree->quadrants, zz));
+    }
+  }
+  compact->tree_offsets[num_trees] = lid;
+  P4EST_ASSERT (lid == compact->num_quadrants);
+
+  return compact;
+}
+
+void
+p4est_compact_destroy (p4est_compact_t * compact)
+{
+  P4EST_FREE (compact->tree_offsets);
+  P4EST_FREE (compact->keys);
+  P4EST_FREE (compact);
+}
+
+size_t
+p4est_compact_memory_used (p4est_compact_t * compact)
+{
+  size_t              num_trees;
+
+  num_trees = (size_t)
+    (compact->last_local_tree - compact->first_local_tree + 1);
+  return sizeof (p4est_compact_t) +
+    (num_trees + 1) * sizeof (p4est_locidx_t) +
+    (size_t) compact->num_quadrants * sizeof (uint64_t);
+}
+
+void
+p4est_compact_get_quadrant (p4est_compact_t * compact, p4est_locidx_t lid,
+                            p4est_quadrant_t * q)
+{
+  uint64_t            key;
+
+  P4EST_ASSERT (0 <= lid && lid < compact->num_quadrants);
+
+  key = compact->keys[lid];
+  p4est_quadrant_set_morton (q, P4EST_QMAXLEVEL,
+                             key >> P4EST_COMPACT_LEVEL_BITS);
+  q->level = (int8_t) (key & P4EST_COMPACT_LEVEL_MASK);
+  P4EST_ASSERT (p4est_quadrant_is_valid (q));
+}
+
+ssize_t
+p4est_compact_find_higher_bound (p4est_compact_t * compact,
+                                 p4est_topidx_t which_tree,
+                                 const p4est_quadrant_t * q)
+{
+  uint64_t            key;
+  size_t              low, high, mid;
+  const uint64_t     *keys;
+
+  P4EST_ASSERT (compact->first_local_tree <= which_tree &&
+                which_tree <= compact->last_local_tree);
+
+  which_tree -= compact->first_local_tree;
+  keys = compact->keys + compact->tree_offsets[which_tree];
+  key = p4est_compact_key (q);
+
+  /* the first index in [low, high) whose key is larger than q's */
+  low = 0;
+  high = (size_t) (compact->tree_offsets[which_tree + 1] -
+                   compact->tree_offsets[which_tree]);
+  while (low < high) {
+    mid = low + (high - low) / 2;
+    if (keys[mid] <= key) {
+      low = mid + 1;
+    }
+    else {
+      high = mid;
+    }
+  }
+
+  return (ssize_t) low - 1;
+}
+
+p4est_t            *
+p4est_compact_expand (p4est_compact_t * compact, sc_MPI_Comm mpicomm,
+                      p4est_connectivity_t * connectivity, size_t data_size,
+                      p4est_init_t init_fn, void *user_pointer)
+{
+  p4est_topidx_t      jt;
+  p4est_locidx_t      lid, end;
+  sc_array_t         *chunk;
+  p4est_quadrant_t   *q;
+  p4est_build_stream_t *stream;
+
+  stream = p4est_build_stream_new (mpicomm, connectivity, data_size,
+                                   init_fn, user_pointer);
+  chunk = sc_array_new (sizeof (p4est_quadrant_t));
+
+  /* decode the keys in bounded chunks to limit the extra memory */
+  for (jt = compact->first_local_tree; jt <= compact->last_local_tree; ++jt) {
+    lid = compact->tree_offsets[jt - compact->first_local_tree];
+    end = compact->tree_offsets[jt - compact->first_local_tree + 1];
+    for (; lid < end; ++lid) {
+      q = (p4est_quadrant_t *) sc_array_push (chunk);
+      p4est_compact_get_quadrant (compact, lid, q);
+      q->p.which_tree = jt;
+      if (chunk->elem_count == P4EST_COMPACT_CHUNK) {
+        p4est_build_stream_add (stream, chunk);
+        sc_array_truncate (chunk);
+      }
+    }
+  }
+  if (chunk->elem_count > 0) {
+    p4est_build_stream_add (stream, chunk);
+  }
+  sc_array_destroy (chunk);
+
+  return p4est_build_stream_complete (stream, 0);
+}
@@ -0,0 +1,132 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/** \file p4est_compact.h
+ *
+ * Compact storage of the local leaves of a forest as Morton keys.
+ *
+ * A \ref p4est_quadrant_t takes 24 bytes in 2D and 32 bytes in 3D, most
+ * of which are coordinates that are implied by the position of the leaf in
+ * the space-filling curve.  A \ref p4est_compact_t stores every leaf as a
+ * single 64-bit key: its Morton index at the finest level, shifted left by
+ * five bits, combined with its level.  Sorting by key reproduces the order
+ * of \ref p4est_quadrant_compare within a tree, so the keys are searched
+ * in place by binary search.
+ *
+ * The compact store does not reference its forest.  It may be kept while
+ * the forest is destroyed, and a new forest is rebuilt from it by
+ * \ref p4est_compact_expand.  User data is not stored.
+ *
+ * \ingroup p4est
+ */
+
+#ifndef P4EST_COMPACT_H
+#define P4EST_COMPACT_H
+
+#include <p4est.h>
+
+SC_EXTERN_C_BEGIN;
+
+/** Local leaves of a forest encoded as Morton keys. */
+typedef struct p4est_compact
+{
+  long                revision;         /**< Revision of the forest encoded */
+  p4est_topidx_t      first_local_tree; /**< Copy of the forest's value */
+  p4est_topidx_t      last_local_tree;  /**< Copy of the forest's value */
+  p4est_locidx_t      num_quadrants;    /**< Number of local quadrants */
+  /** For each local tree and one beyond, the local number of the tree's
+   * first quadrant. */
+  p4est_locidx_t     *tree_offsets;
+  uint64_t           *keys;             /**< One key per local quadrant */
+}
+p4est_compact_t;
+
+/** Encode the current local quadrants of a forest.
+ * \param [in] p4est    The forest is not referenced afterwards.
+ * \return              The compact store, destroy with
+ *                      \ref p4est_compact_destroy.
+ */
+p4est_compact_t    *p4est_compact_new (p4est_t * p4est);
+
+/** Free the memory of a compact store. */
+void                p4est_compact_destroy (p4est_compact_t * compact);
+
+/** Compute the memory used by a compact store.
+ * \return              Memory used in bytes.
+ */
+size_t              p4est_compact_memory_used (p4est_compact_t * compact);
+
+/** Encode a quadrant into a key of a compact store.
+ * \param [in] q        A valid quadrant.
+ * \return              The key that orders like \ref p4est_quadrant_compare.
+ */
+uint64_t            p4est_compact_key (const p4est_quadrant_t * q);
+
+/** Decode a quadrant from a compact store.
+ * \param [in] compact  A compact store.
+ * \param [in] lid      Local quadrant number, less than num_quadrants.
+ * \param [out] q       Its coordinates and level are set.
+ */
+void                p4est_compact_get_quadrant (p4est_compact_t * compact,
+                                                p4est_locidx_t lid,
+                                                p4est_quadrant_t * q);
+
+/** Find the highest quadrant of a local tree that is <= q in the store.
+ * This is the analogue of \ref p4est_find_higher_bound.  For a quadrant
+ * inside the local part of the tree it returns the leaf containing it.
+ * \param [in] compact  A compact store.
+ * \param [in] which_tree   A local tree.
+ * \param [in] q        The quadrant to search for.
+ * \return              Index relative to the tree's first quadrant,
+ *                      or -1 if there is no such quadrant.
+ */
+ssize_t             p4est_compact_find_higher_bound (p4est_compact_t *
+                                                     compact,
+                                                     p4est_topidx_t
+                                                     which_tree,
+                                                     const p4est_quadrant_t
+                                                     * q);
+
+/** Rebuild a forest from compact stores on all processes.
+ * The leaves are decoded in bounded chunks and streamed into the new
+ * forest, which keeps the partition of the encoded forest.
+ * This function is collective.
+ * \param [in] compact      The compact store of this process.
+ * \param [in] mpicomm      The communicator of the encoded forest.
+ * \param [in] connectivity The connectivity of the encoded forest.
+ * \param [in] data_size    Data size of the created forest, may be zero.
+ * \param [in] init_fn      This function is called for every leaf.
+ * \param [in] user_pointer Registered into the newly built forest.
+ * \return                  A valid forest object.
+ */
+p4est_t            *p4est_compact_expand (p4est_compact_t * compact,
+                                          sc_MPI_Comm mpicomm,
+                                          p4est_connectivity_t *
+                                          connectivity, size_t data_size,
+                                          p4est_init_t init_fn,
+                                          void *user_pointer);
+
+SC_EXTERN_C_END;
+
+#endif /* ! P4EST_COMPACT_H */
@@ -23,12 +23,23 @@
 */
 
 #ifndef P4_TO_P8
+#include <p4est_bits.h>
 #include <p4est_connectivity.h>
 #include <p4est.h>
 #endif
+#include <ctype.h>
 #ifdef P4EST_WITH_METIS
 #include <metis.h>
 #endif
+#ifdef P4EST_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef P4EST_HAVE_SYS_MMAN_H
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #ifndef P4_TO_P8
 
@@ -106,15 +117,112 @@ p4est_connectivity_face_neighbor_corner (int c, int f, int nf, int o)
   return p4est_face_corners[nf][nfc];
 }
 
+/* Avoid redefinition in p4est_to_p8est.h */
+#ifdef P4_TO_P8
+#define p4est_connectivity_transforms   p8est_connectivity_transforms
+#endif
+
+/** The neighbor transforms of all trees cached in a connectivity. */
+struct p4est_connectivity_transforms
+{
+  p4est_topidx_t     *face_tree;        /**< neighbor per tree face or -1 */
+  int8_t             *face_transform;   /**< 9 entries per tree face */
+  size_t             *corner_offset;    /**< per tree corner and 1 beyond */
+  sc_array_t          corner_transforms;        /**< of all tree corners */
+#ifdef P4_TO_P8
+  size_t             *edge_offset;      /**< per tree edge and 1 beyond */
+  sc_array_t          edge_transforms;  /**< of all tree edges */
+#endif
+};
+
+/* Avoid redefinition in p4est_to_p8est.h */
+#ifdef P4_TO_P8
+#define p4est_connectivity_mapped       p8est_connectivity_mapped
+#endif
+
+/** The number of arrays listed in the mapped file format. */
+#define P4EST_CONN_MAPPED_ARRAYS 13
+
+/** The alignment in bytes of each array in the mapped file format. */
+#define P4EST_CONN_MAPPED_ALIGN 64
+
+/** The contents of a connectivity file that the arrays point into. */
+struct p4est_connectivity_mapped
+{
+  char               *data;     /**< file contents, mapped or read */
+  size_t              size;     /**< byte size of the file */
+  int                 is_mmap;  /**< boolean: \a data is memory-mapped */
+  void               *owned[P4EST_CONN_MAPPED_ARRAYS];  /**< decompressed */
+};
+
+/** Release the file contents of a connectivity and its decompressed arrays.
+ */
+static void
+p4est_connectivity_mapped_drop (struct p4est_connectivity_mapped *mapped)
+{
+  int                 k;
+
+  for (k = 0; k < P4EST_CONN_MAPPED_ARRAYS; ++k) {
+    P4EST_FREE (mapped->owned[k]);
+  }
+#ifdef P4EST_HAVE_SYS_MMAN_H
+  if (mapped->is_mmap) {
+    munmap (mapped->data, mapped->size);
+  }
+  else
+#endif
+  {
+    P4EST_FREE (mapped->data);
+  }
+  P4EST_FREE (mapped);
+}
+
+/** Free the cached neighbor transforms of a connectivity if any. */
+static void
+p4est_connectivity_transforms_drop (p4est_connectivity_t * conn)
+{
+  struct p4est_connectivity_transforms *tr = conn->transforms;
+
+  if (tr == NULL) {
+    return;
+  }
+  P4EST_FREE (tr->face_tree);
+  P4EST_FREE (tr->face_transform);
+  P4EST_FREE (tr->corner_offset);
+  sc_array_reset (&tr->corner_transforms);
+#ifdef P4_TO_P8
+  P4EST_FREE (tr->edge_offset);
+  sc_array_reset (&tr->edge_transforms);
+#endif
+  P4EST_FREE (tr);
+  conn->transforms = NULL;
+}
+
 size_t
 p4est_connectivity_memory_used (p4est_connectivity_t * conn)
 {
-  return sizeof (p4est_connectivity_t) +
-    (conn->num_vertices > 0 ?
-     (conn->num_vertices * 3 * sizeof (double) +
-      conn->num_trees * P4EST_CHILDREN * sizeof (p4est_topidx_t)) : 0) +
-    conn->num_trees * P4EST_FACES * (sizeof (p4est_topidx_t) +
-                                     sizeof (int8_t)) +
+  size_t              tsize = 0;
+  struct p4est_connectivity_transforms *tr = conn->transforms;
+
+  if (tr != NULL) {
+    tsize = sizeof (*tr) + conn->num_trees *
+      (P4EST_FACES * (sizeof (p4est_topidx_t) + 9 * sizeof (int8_t)) +
+       P4EST_CHILDREN * sizeof (size_t)) + sizeof (size_t) +
+      sc_array_memory_used (&tr->corner_transforms, 0);
+#ifdef P4_TO_P8
+    tsize += conn->num_trees * P8EST_EDGES * sizeof (size_t) +
+      sizeof (size_t) + sc_array_memory_used (&tr->edge_transforms, 0);
+#endif
+  }
+
+  /* an implicit brick stores neither vertices nor face neighbors */
+  return tsize + sizeof (p4est_connectivity_t) +
+    (conn->brick != NULL ? sizeof (p4est_connectivity_brick_t) :
+     (conn->num_vertices > 0 ?
+      (conn->num_vertices * 3 * sizeof (double) +
+       conn->num_trees * P4EST_CHILDREN * sizeof (p4est_topidx_t)) : 0) +
+     conn->num_trees * P4EST_FACES * (sizeof (p4est_topidx_t) +
+                                      sizeof (int8_t))) +
 #ifdef P4_TO_P8
     conn->num_trees * P8EST_EDGES * sizeof (p4est_topidx_t) +
     (conn->num_edges + 1) * sizeof (p4est_topidx_t) +
@@ -226,6 +334,7 @@ p4est_connectivity_new (p4est_topidx_t num_vertices, p4est_topidx_t num_trees,
   P4EST_ASSERT (num_ctt >= 0);
 
   conn = P4EST_ALLOC_ZERO (p4est_connectivity_t, 1);
+  sc_refcount_init (&conn->rc, p4est_package_id);
 
   conn->num_vertices = num_vertices;
   conn->num_trees = num_trees;
@@ -238,7 +347,7 @@ p4est_connectivity_new (p4est_topidx_t num_vertices, p4est_topidx_t num_trees,
     conn->vertices = NULL;
     conn->tree_to_vertex = NULL;
   }
-  conn->tree_to_tree = P4EST_ALLOC (p4est_topidx_t, P4EST_FACES * num_trees);
+  conn->tree_to_tree = P4EST_ALLOC (p4est_topidx_t, (size_t) P4EST_FACES * num_trees);
   conn->tree_to_face = P4EST_ALLOC (int8_t, P4EST_FACES * num_trees);
 
 #ifdef P4_TO_P8
@@ -296,7 +405,7 @@ p4est_connectivity_bcast (p4est_connectivity_t * conn_in, int root,
   SC_CHECK_MPI (mpiret);
   /* fill dims_buffer on root process */
   if (mpirank == root) {
-    P4EST_ASSERT (conn_in != NULL);
+    P4EST_ASSERT (conn_in != NULL && conn_in->brick == NULL);
     memset (&conn_dimensions, -1, sizeof (conn_dimensions));
     conn = conn_in;
     conn_dimensions.num_corners = conn->num_corners;
@@ -408,9 +517,598 @@ p4est_connectivity_bcast (p4est_connectivity_t * conn_in, int root,
   return conn;
 }
 
-void
-p4est_connectivity_destroy (p4est_connectivity_t * conn)
+#ifdef P4EST_ENABLE_MPIWINSHARED
+
+/* Avoid redefinition in p4est_to_p8est.h */
+#ifdef P4_TO_P8
+#define p4est_connectivity_shared       p8est_connectivity_shared
+#endif
+
+/** The storage of a connectivity shared by the processes of a node. */
+struct p4est_connectivity_shared
+{
+  MPI_Win             win;      /**< window holding all arrays */
+  MPI_Comm            nodecomm; /**< processes sharing the window */
+};
+
+/** Reserve space for an array in the shared window.
+ * \param [in] base     Start of the window or NULL to only count bytes.
+ * \param [in,out] offset   Bytes reserved so far, padded to 16 bytes.
+ * \param [in] src      If not NULL and base is not NULL, copy from here.
+ * \return              The array in the window or NULL.
+ */
+static void        *
+p4est_connectivity_shared_carve (char *base, size_t *offset,
+                                 size_t bytes, const void *src)
+{
+  char               *array;
+
+  if (base == NULL || bytes == 0) {
+    *offset += (bytes + 15) & ~((size_t) 15);
+    return NULL;
+  }
+  array = base + *offset;
+  if (src != NULL) {
+    memcpy (array, src, bytes);
+  }
+  *offset += (bytes + 15) & ~((size_t) 15);
+  return array;
+}
+
+/** Point the arrays of a connectivity into the shared window.
+ * The dimensions of \a conn must be set.
+ * \param [in] src      If not NULL, its arrays are copied into the window.
+ * \return              The number of bytes required by the window.
+ */
+static size_t
+p4est_connectivity_shared_layout (p4est_connectivity_t * conn, char *base,
+                                  p4est_connectivity_t * src,
+#ifdef P4_TO_P8
+                                  p4est_topidx_t num_ett,
+#endif
+                                  p4est_topidx_t num_ctt)
+{
+  size_t              offset = 0;
+  size_t              nt = (size_t) conn->num_trees;
+  size_t              tsize = sizeof (p4est_topidx_t);
+
+  conn->vertices = (double *) p4est_connectivity_shared_carve
+    (base, &offset, sizeof (double) * 3 * conn->num_vertices,
+     src == NULL ? NULL : src->vertices);
+  conn->tree_to_vertex = (p4est_topidx_t *) p4est_connectivity_shared_carve
+    (base, &offset, conn->num_vertices > 0 ? tsize * P4EST_CHILDREN * nt : 0,
+     src == NULL ? NULL : src->tree_to_vertex);
+  conn->tree_to_tree = (p4est_topidx_t *) p4est_connectivity_shared_carve
+    (base, &offset, tsize * P4EST_FACES * nt,
+     src == NULL ? NULL : src->tree_to_tree);
+  conn->tree_to_face = (int8_t *) p4est_connectivity_shared_carve
+    (base, &offset, sizeof (int8_t) * P4EST_FACES * nt,
+     src == NULL ? NULL : src->tree_to_face);
+#ifdef P4_TO_P8
+  conn->tree_to_edge = (p4est_topidx_t *) p4est_connectivity_shared_carve
+    (base, &offset, conn->num_edges > 0 ? tsize * P8EST_EDGES * nt : 0,
+     src == NULL ? NULL : src->tree_to_edge);
+  conn->ett_offset = (p4est_topidx_t *) p4est_connectivity_shared_carve
+    (base, &offset, tsize * (conn->num_edges + 1),
+     src == NULL ? NULL : src->ett_offset);
+  conn->edge_to_tree = (p4est_topidx_t *) p4est_connectivity_shared_carve
+    (base, &offset, conn->num_edges > 0 ? tsize * num_ett : 0,
+     src == NULL ? NULL : src->edge_to_tree);
+  conn->edge_to_edge = (int8_t *) p4est_connectivity_shared_carve
+    (base, &offset, conn->num_edges > 0 ? sizeof (int8_t) * num_ett : 0,
+     src == NULL ? NULL : src->edge_to_edge);
+#endif
+  conn->tree_to_corner = (p4est_topidx_t *) p4est_connectivity_shared_carve
+    (base, &offset, conn->num_corners > 0 ? tsize * P4EST_CHILDREN * nt : 0,
+     src == NULL ? NULL : src->tree_to_corner);
+  conn->ctt_offset = (p4est_topidx_t *) p4est_connectivity_shared_carve
+    (base, &offset, tsize * (conn->num_corners + 1),
+     src == NULL ? NULL : src->ctt_offset);
+  conn->corner_to_tree = (p4est_topidx_t *) p4est_connectivity_shared_carve
+    (base, &offset, conn->num_corners > 0 ? tsize * num_ctt : 0,
+     src == NULL ? NULL : src->corner_to_tree);
+  conn->corner_to_corner = (int8_t *) p4est_connectivity_shared_carve
+    (base, &offset, conn->num_corners > 0 ? sizeof (int8_t) * num_ctt : 0,
+     src == NULL ? NULL : src->corner_to_corner);
+  conn->tree_to_attr = (char *) p4est_connectivity_shared_carve
+    (base, &offset, conn->tree_attr_bytes * nt,
+     src == NULL ? NULL : src->tree_to_attr);
+
+  return offset;
+}
+
+#endif /* P4EST_ENABLE_MPIWINSHARED */
+
+p4est_connectivity_t *
+p4est_connectivity_bcast_shared (p4est_connectivity_t * conn_in, int root,
+                                 sc_MPI_Comm mpicomm)
+{
+#ifndef P4EST_ENABLE_MPIWINSHARED
+  return p4est_connectivity_bcast (conn_in, root, mpicomm);
+#else
+  int                 mpirank, mpiret, noderank, key;
+  int                 disp_unit;
+  size_t              bytes, done, chunk;
+  char               *base;
+  MPI_Aint            win_size;
+  MPI_Comm            leadercomm;
+  p4est_connectivity_t *conn;
+  struct p4est_connectivity_shared *shared;
+  struct
+  {
+    p4est_topidx_t      num_vertices, num_trees, num_corners, num_ctt;
+    size_t              tree_attr_bytes;
+#ifdef P4_TO_P8
+    p4est_topidx_t      num_edges, num_ett;
+#endif
+  }
+  conn_dimensions;
+
+  mpiret = sc_MPI_Comm_rank (mpicomm, &mpirank);
+  SC_CHECK_MPI (mpiret);
+  if (mpirank == root) {
+    P4EST_ASSERT (conn_in != NULL && conn_in->brick == NULL);
+    memset (&conn_dimensions, -1, sizeof (conn_dimensions));
+    conn_dimensions.num_corners = conn_in->num_corners;
+    conn_dimensions.num_trees = conn_in->num_trees;
+    conn_dimensions.num_vertices = conn_in->num_vertices;
+    conn_dimensions.tree_attr_bytes = conn_in->tree_attr_bytes;
+    conn_dimensions.num_ctt = conn_in->ctt_offset[conn_in->num_corners];
+#ifdef P4_TO_P8
+    conn_dimensions.num_edges = conn_in->num_edges;
+    conn_dimensions.num_ett = conn_in->ett_offset[conn_in->num_edges];
+#endif
+  }
+  else {
+    P4EST_ASSERT (conn_in == NULL);
+  }
+  mpiret = sc_MPI_Bcast (&conn_dimensions, sizeof (conn_dimensions),
+                         sc_MPI_BYTE, root, mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  /* every process holds only the small structure with the dimensions */
+  conn = P4EST_ALLOC_ZERO (p4est_connectivity_t, 1);
+  sc_refcount_init (&conn->rc, p4est_package_id);
+  conn->num_vertices = conn_dimensions.num_vertices;
+  conn->num_trees = conn_dimensions.num_trees;
+  conn->num_corners = conn_dimensions.num_corners;
+  conn->tree_attr_bytes = conn_dimensions.tree_attr_bytes;
+#ifdef P4_TO_P8
+  conn->num_edges = conn_dimensions.num_edges;
+#endif
+  bytes = p4est_connectivity_shared_layout (conn, NULL, NULL,
+#ifdef P4_TO_P8
+                                            conn_dimensions.num_ett,
+#endif
+                                            conn_dimensions.num_ctt);
+
+  /* the root becomes the leader of its node */
+  shared = P4EST_ALLOC (struct p4est_connectivity_shared, 1);
+  key = mpirank == root ? 0 : mpirank + 1;
+  mpiret = MPI_Comm_split_type (mpicomm, MPI_COMM_TYPE_SHARED, key,
+                                MPI_INFO_NULL, &shared->nodecomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_rank (shared->nodecomm, &noderank);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_split (mpicomm, noderank == 0 ? 0 : MPI_UNDEFINED,
+                           key, &leadercomm);
+  SC_CHECK_MPI (mpiret);
+
+  /* one copy of the arrays per node */
+  mpiret = MPI_Win_allocate_shared (noderank == 0 ? (MPI_Aint) bytes : 0,
+                                    1, MPI_INFO_NULL, shared->nodecomm,
+                                    &base, &shared->win);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Win_shared_query (shared->win, 0, &win_size, &disp_unit,
+                                 &base);
+  SC_CHECK_MPI (mpiret);
+  P4EST_ASSERT ((size_t) win_size == bytes);
+  mpiret = MPI_Win_fence (0, shared->win);
+  SC_CHECK_MPI (mpiret);
+
+  if (noderank == 0) {
+    /* fill the window on the root and send it to the other leaders */
+    p4est_connectivity_shared_layout (conn, base,
+                                      mpirank == root ? conn_in : NULL,
+#ifdef P4_TO_P8
+                                      conn_dimensions.num_ett,
+#endif
+                                      conn_dimensions.num_ctt);
+    for (done = 0; done < bytes; done += chunk) {
+      chunk = SC_MIN (bytes - done, (size_t) INT_MAX);
+      mpiret = MPI_Bcast (base + done, (int) chunk, MPI_BYTE, 0, leadercomm);
+      SC_CHECK_MPI (mpiret);
+    }
+    mpiret = MPI_Comm_free (&leadercomm);
+    SC_CHECK_MPI (mpiret);
+  }
+  else {
+    p4est_connectivity_shared_layout (conn, base, NULL,
+#ifdef P4_TO_P8
+                                      conn_dimensions.num_ett,
+#endif
+                                      conn_dimensions.num_ctt);
+  }
+  mpiret = MPI_Win_fence (0, shared->win);
+  SC_CHECK_MPI (mpiret);
+  conn->shared = shared;
+
+  if (mpirank == root) {
+    p4est_connectivity_destroy (conn_in);
+  }
+
+  P4EST_ASSERT (p4est_connectivity_is_valid (conn));
+  return conn;
+#endif
+}
+
+/** Add the trees listed in a shared corner or edge to the halo. */
+static void
+p4est_connectivity_extract_mark (p4est_topidx_t * local_of,
+                                 const p4est_topidx_t * list,
+                                 p4est_topidx_t begin, p4est_topidx_t end)
+{
+  p4est_topidx_t      pos;
+
+  for (pos = begin; pos < end; ++pos) {
+    if (local_of[list[pos]] == -1) {
+      local_of[list[pos]] = -2;
+    }
+  }
+}
+
+p4est_connectivity_t *
+p4est_connectivity_extract (p4est_connectivity_t * conn,
+                            p4est_topidx_t first_tree,
+                            p4est_topidx_t last_tree, sc_array_t * global_ids)
 {
+  int                 i;
+  p4est_topidx_t      gt, lt, nt, num_local, num_vertices;
+  p4est_topidx_t      num_corners, num_ctt, c, pos;
+  p4est_topidx_t     *local_of, *vertex_of, *corner_of, *gids;
+#ifdef P4_TO_P8
+  p4est_topidx_t      num_edges, num_ett, e;
+  p4est_topidx_t     *edge_of;
+#endif
+  p4est_connectivity_t *local;
+
+  P4EST_ASSERT (p4est_connectivity_is_valid (conn));
+  P4EST_ASSERT (conn->brick == NULL);
+  P4EST_ASSERT (0 <= first_tree && last_tree < conn->num_trees);
+  P4EST_ASSERT (first_tree <= last_tree + 1);
+  P4EST_ASSERT (global_ids != NULL &&
+                global_ids->elem_size == sizeof (p4est_topidx_t));
+
+  /* owned trees are -3, halo trees -2 and all others -1 */
+  local_of = P4EST_ALLOC (p4est_topidx_t, conn->num_trees);
+  for (gt = 0; gt < conn->num_trees; ++gt) {
+    local_of[gt] = (first_tree <= gt && gt <= last_tree) ? -3 : -1;
+  }
+  for (gt = first_tree; gt <= last_tree; ++gt) {
+    for (i = 0; i < P4EST_FACES; ++i) {
+      nt = conn->tree_to_tree[P4EST_FACES * gt + i];
+      if (local_of[nt] == -1) {
+        local_of[nt] = -2;
+      }
+    }
+#ifdef P4_TO_P8
+    if (conn->num_edges > 0) {
+      for (i = 0; i < P8EST_EDGES; ++i) {
+        e = conn->tree_to_edge[P8EST_EDGES * gt + i];
+        if (e >= 0) {
+          p4est_connectivity_extract_mark (local_of, conn->edge_to_tree,
+                                           conn->ett_offset[e],
+                                           conn->ett_offset[e + 1]);
+        }
+      }
+    }
+#endif
+    if (conn->num_corners > 0) {
+      for (i = 0; i < P4EST_CHILDREN; ++i) {
+        c = conn->tree_to_corner[P4EST_CHILDREN * gt + i];
+        if (c >= 0) {
+          p4est_connectivity_extract_mark (local_of, conn->corner_to_tree,
+                                           conn->ctt_offset[c],
+                                           conn->ctt_offset[c + 1]);
+        }
+      }
+    }
+  }
+
+  /* owned trees come first, followed by the halo in global order */
+  num_local = 0;
+  for (gt = first_tree; gt <= last_tree; ++gt) {
+    local_of[gt] = num_local++;
+  }
+  for (gt = 0; gt < conn->num_trees; ++gt) {
+    if (local_of[gt] == -2) {
+      local_of[gt] = num_local++;
+    }
+  }
+  sc_array_resize (global_ids, (size_t) num_local);
+  gids = (p4est_topidx_t *) global_ids->array;
+  for (gt = 0; gt < conn->num_trees; ++gt) {
+    if (local_of[gt] >= 0) {
+      gids[local_of[gt]] = gt;
+    }
+  }
+
+  /* keep the vertices of local trees */
+  num_vertices = 0;
+  vertex_of = NULL;
+  if (conn->num_vertices > 0) {
+    vertex_of = P4EST_ALLOC (p4est_topidx_t, conn->num_vertices);
+    memset (vertex_of, -1, sizeof (p4est_topidx_t) * conn->num_vertices);
+    for (lt = 0; lt < num_local; ++lt) {
+      for (i = 0; i < P4EST_CHILDREN; ++i) {
+        pos = conn->tree_to_vertex[P4EST_CHILDREN * gids[lt] + i];
+        if (vertex_of[pos] == -1) {
+          vertex_of[pos] = num_vertices++;
+        }
+      }
+    }
+  }
+
+  /* keep the shared corners and edges of owned trees, whose trees are
+     all local by construction of the halo */
+  num_corners = num_ctt = 0;
+  corner_of = NULL;
+  if (conn->num_corners > 0) {
+    corner_of = P4EST_ALLOC (p4est_topidx_t, conn->num_corners);
+    memset (corner_of, -1, sizeof (p4est_topidx_t) * conn->num_corners);
+    for (gt = first_tree; gt <= last_tree; ++gt) {
+      for (i = 0; i < P4EST_CHILDREN; ++i) {
+        c = conn->tree_to_corner[P4EST_CHILDREN * gt + i];
+        if (c >= 0 && corner_of[c] == -1) {
+          corner_of[c] = num_corners++;
+          num_ctt += conn->ctt_offset[c + 1] - conn->ctt_offset[c];
+        }
+      }
+    }
+  }
+#ifdef P4_TO_P8
+  num_edges = num_ett = 0;
+  edge_of = NULL;
+  if (conn->num_edges > 0) {
+    edge_of = P4EST_ALLOC (p4est_topidx_t, conn->num_edges);
+    memset (edge_of, -1, sizeof (p4est_topidx_t) * conn->num_edges);
+    for (gt = first_tree; gt <= last_tree; ++gt) {
+      for (i = 0; i < P8EST_EDGES; ++i) {
+        e = conn->tree_to_edge[P8EST_EDGES * gt + i];
+        if (e >= 0 && edge_of[e] == -1) {
+          edge_of[e] = num_edges++;
+          num_ett += conn->ett_offset[e + 1] - conn->ett_offset[e];
+        }
+      }
+    }
+  }
+#endif
+
+  local = p4est_connectivity_new (num_vertices, num_local,
+#ifdef P4_TO_P8
+                                  num_edges, num_ett,
+#endif
+                                  num_corners, num_ctt);
+  p4est_connectivity_set_attr (local, conn->tree_attr_bytes);
+
+  if (num_vertices > 0) {
+    for (pos = 0; pos < conn->num_vertices; ++pos) {
+      if (vertex_of[pos] >= 0) {
+        memcpy (local->vertices + 3 * vertex_of[pos],
+                conn->vertices + 3 * pos, 3 * sizeof (double));
+      }
+    }
+  }
+
+  for (lt = 0; lt < num_local; ++lt) {
+    gt = gids[lt];
+    for (i = 0; i < P4EST_FACES; ++i) {
+      nt = conn->tree_to_tree[P4EST_FACES * gt + i];
+      if (local_of[nt] >= 0) {
+        local->tree_to_tree[P4EST_FACES * lt + i] = local_of[nt];
+        local->tree_to_face[P4EST_FACES * lt + i] =
+          conn->tree_to_face[P4EST_FACES * gt + i];
+      }
+      else {
+        /* the halo ends here and looks like a domain boundary */
+        local->tree_to_tree[P4EST_FACES * lt + i] = lt;
+        local->tree_to_face[P4EST_FACES * lt + i] = (int8_t) i;
+      }
+    }
+    if (num_vertices > 0) {
+      for (i = 0; i < P4EST_CHILDREN; ++i) {
+        local->tree_to_vertex[P4EST_CHILDREN * lt + i] =
+          vertex_of[conn->tree_to_vertex[P4EST_CHILDREN * gt + i]];
+      }
+    }
+    if (num_corners > 0) {
+      for (i = 0; i < P4EST_CHILDREN; ++i) {
+        c = conn->tree_to_corner[P4EST_CHILDREN * gt + i];
+        local->tree_to_corner[P4EST_CHILDREN * lt + i] =
+          c >= 0 ? corner_of[c] : -1;
+      }
+    }
+#ifdef P4_TO_P8
+    if (num_edges > 0) {
+      for (i = 0; i < P8EST_EDGES; ++i) {
+        e = conn->tree_to_edge[P8EST_EDGES * gt + i];
+        local->tree_to_edge[P8EST_EDGES * lt + i] = e >= 0 ? edge_of[e] : -1;
+      }
+    }
+#endif
+    if (conn->tree_attr_bytes > 0) {
+      memcpy (local->tree_to_attr + conn->tree_attr_bytes * lt,
+              conn->tree_to_attr + conn->tree_attr_bytes * gt,
+              conn->tree_attr_bytes);
+    }
+  }
+
+  /* the kept corners and edges in their new order */
+  local->ctt_offset[0] = 0;
+  for (c = 0; c < conn->num_corners; ++c) {
+    if (corner_of[c] >= 0) {
+      local->ctt_offset[corner_of[c] + 1] =
+        conn->ctt_offset[c + 1] - conn->ctt_offset[c];
+    }
+  }
+  for (c = 0; c < num_corners; ++c) {
+    local->ctt_offset[c + 1] += local->ctt_offset[c];
+  }
+  for (c = 0; c < conn->num_corners; ++c) {
+    if (corner_of[c] >= 0) {
+      lt = local->ctt_offset[corner_of[c]];
+      for (pos = conn->ctt_offset[c]; pos < conn->ctt_offset[c + 1]; ++pos) {
+        local->corner_to_tree[lt] = local_of[conn->corner_to_tree[pos]];
+        local->corner_to_corner[lt++] = conn->corner_to_corner[pos];
+      }
+    }
+  }
+#ifdef P4_TO_P8
+  local->ett_offset[0] = 0;
+  for (e = 0; e < conn->num_edges; ++e) {
+    if (edge_of[e] >= 0) {
+      local->ett_offset[edge_of[e] + 1] =
+        conn->ett_offset[e + 1] - conn->ett_offset[e];
+    }
+  }
+  for (e = 0; e < num_edges; ++e) {
+    local->ett_offset[e + 1] += local->ett_offset[e];
+  }
+  for (e = 0; e < conn->num_edges; ++e) {
+    if (edge_of[e] >= 0) {
+      lt = local->ett_offset[edge_of[e]];
+      for (pos = conn->ett_offset[e]; pos < conn->ett_offset[e + 1]; ++pos) {
+        local->edge_to_tree[lt] = local_of[conn->edge_to_tree[pos]];
+        local->edge_to_edge[lt++] = conn->edge_to_edge[pos];
+      }
+    }
+  }
+  P4EST_FREE (edge_of);
+#endif
+
+  P4EST_FREE (local_of);
+  P4EST_FREE (vertex_of);
+  P4EST_FREE (corner_of);
+
+  P4EST_ASSERT (p4est_connectivity_is_valid (local));
+  return local;
+}
+
+p4est_connectivity_t *
+p4est_connectivity_scatter (p4est_connectivity_t * conn_in, int root,
+                            const p4est_topidx_t * tree_offsets,
+                            sc_array_t * global_ids, sc_MPI_Comm mpicomm)
+{
+  int                 mpiret, mpirank, mpisize;
+  p4est_connectivity_t *conn;
+#ifdef P4EST_ENABLE_MPI
+  int                 q;
+  long long           sizes[2];
+  sc_array_t         *buffer, q_ids;
+  sc_MPI_Status       status;
+#endif
+
+  P4EST_ASSERT (global_ids != NULL &&
+                global_ids->elem_size == sizeof (p4est_topidx_t));
+
+  mpiret = sc_MPI_Comm_rank (mpicomm, &mpirank);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Comm_size (mpicomm, &mpisize);
+  SC_CHECK_MPI (mpiret);
+
+  conn = NULL;
+  if (mpirank == root) {
+    P4EST_ASSERT (conn_in != NULL && tree_offsets != NULL);
+    P4EST_ASSERT (tree_offsets[0] == 0);
+    P4EST_ASSERT (tree_offsets[mpisize] == conn_in->num_trees);
+
+#ifdef P4EST_ENABLE_MPI
+    /* extract and send one process at a time to bound the memory */
+    sc_array_init (&q_ids, sizeof (p4est_topidx_t));
+    for (q = 0; q < mpisize; ++q) {
+      if (q == root) {
+        continue;
+      }
+      conn = p4est_connectivity_extract (conn_in, tree_offsets[q],
+                                         tree_offsets[q + 1] - 1, &q_ids);
+      buffer = p4est_connectivity_deflate (conn, P4EST_CONN_ENCODE_NONE);
+      p4est_connectivity_destroy (conn);
+      conn = NULL;
+      sizes[0] = (long long) buffer->elem_count;
+      sizes[1] = (long long) q_ids.elem_count;
+      mpiret = sc_MPI_Send (sizes, 2, sc_MPI_LONG_LONG_INT, q,
+                            P4EST_COMM_CONN_SCATTER, mpicomm);
+      SC_CHECK_MPI (mpiret);
+      mpiret = sc_MPI_Send (buffer->array, (int) buffer->elem_count,
+                            sc_MPI_BYTE, q, P4EST_COMM_CONN_SCATTER,
+                            mpicomm);
+      SC_CHECK_MPI (mpiret);
+      mpiret = sc_MPI_Send (q_ids.array, (int) q_ids.elem_count,
+                            P4EST_MPI_TOPIDX, q, P4EST_COMM_CONN_SCATTER,
+                            mpicomm);
+      SC_CHECK_MPI (mpiret);
+      sc_array_destroy (buffer);
+    }
+    sc_array_reset (&q_ids);
+#endif
+
+    /* the root keeps its part */
+    conn = p4est_connectivity_extract (conn_in, tree_offsets[root],
+                                       tree_offsets[root + 1] - 1,
+                                       global_ids);
+  }
+  else {
+    P4EST_ASSERT (conn_in == NULL);
+#ifdef P4EST_ENABLE_MPI
+    mpiret = sc_MPI_Recv (sizes, 2, sc_MPI_LONG_LONG_INT, root,
+                          P4EST_COMM_CONN_SCATTER, mpicomm, &status);
+    SC_CHECK_MPI (mpiret);
+    buffer = sc_array_new_count (sizeof (char), (size_t) sizes[0]);
+    mpiret = sc_MPI_Recv (buffer->array, (int) sizes[0], sc_MPI_BYTE, root,
+                          P4EST_COMM_CONN_SCATTER, mpicomm, &status);
+    SC_CHECK_MPI (mpiret);
+    sc_array_resize (global_ids, (size_t) sizes[1]);
+    mpiret = sc_MPI_Recv (global_ids->array, (int) sizes[1],
+                          P4EST_MPI_TOPIDX, root, P4EST_COMM_CONN_SCATTER,
+                          mpicomm, &status);
+    SC_CHECK_MPI (mpiret);
+    conn = p4est_connectivity_inflate (buffer);
+    SC_CHECK_ABORT (conn != NULL, "Inflate scattered connectivity");
+    sc_array_destroy (buffer);
+#endif
+  }
+
+  return conn;
+}
+
+/** Free the memory of a connectivity without references. */
+static void
+p4est_connectivity_free (p4est_connectivity_t * conn)
+{
+#ifdef P4EST_ENABLE_MPIWINSHARED
+  int                 mpiret;
+
+  if (conn->shared != NULL) {
+    /* the arrays live in a window that is freed collectively */
+    p4est_connectivity_transforms_drop (conn);
+    mpiret = MPI_Win_free (&conn->shared->win);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Comm_free (&conn->shared->nodecomm);
+    SC_CHECK_MPI (mpiret);
+    P4EST_FREE (conn->shared);
+    P4EST_FREE (conn);
+    return;
+  }
+#endif
+
+  if (conn->mapped != NULL) {
+    /* the arrays point into the file contents or are owned by it */
+    p4est_connectivity_transforms_drop (conn);
+    p4est_connectivity_mapped_drop (conn->mapped);
+    P4EST_FREE (conn);
+    return;
+  }
+
   P4EST_FREE (conn->vertices);
   P4EST_FREE (conn->tree_to_vertex);
 
@@ -429,15 +1127,42 @@ p4est_connectivity_destroy (p4est_connectivity_t * conn)
   P4EST_FREE (conn->corner_to_tree);
   P4EST_FREE (conn->corner_to_corner);
 
+  P4EST_FREE (conn->brick);
+  p4est_connectivity_transforms_drop (conn);
+
   p4est_connectivity_set_attr (conn, 0);
 
   P4EST_FREE (conn);
 }
 
+void
+p4est_connectivity_destroy (p4est_connectivity_t * conn)
+{
+  (void) p4est_connectivity_unref (conn);
+}
+
+p4est_connectivity_t *
+p4est_connectivity_ref (p4est_connectivity_t * conn)
+{
+  sc_refcount_ref (&conn->rc);
+  return conn;
+}
+
+int
+p4est_connectivity_unref (p4est_connectivity_t * conn)
+{
+  if (!sc_refcount_unref (&conn->rc)) {
+    return 0;
+  }
+  p4est_connectivity_free (conn);
+  return 1;
+}
+
 void
 p4est_connectivity_set_attr (p4est_connectivity_t * conn,
                              size_t bytes_per_tree)
 {
+  P4EST_ASSERT (conn->shared == NULL && conn->mapped == NULL);
   if (bytes_per_tree > 0) {
     P4EST_ASSERT (conn->tree_to_attr == NULL);
     conn->tree_to_attr = P4EST_ALLOC (char, bytes_per_tree * conn->num_trees);
@@ -446,11 +1171,125 @@ p4est_connectivity_set_attr (p4est_connectivity_t * conn,
     P4EST_FREE (conn->tree_to_attr);
     conn->tree_to_attr = NULL;
   }
-  conn->tree_attr_bytes = bytes_per_tree;
+  conn->tree_attr_bytes = bytes_per_tree;
+}
+
+/** Check the parameters of an implicit brick against the connectivity. */
+static int
+p4est_connectivity_brick_is_valid (p4est_connectivity_t * conn)
+{
+  int                 i;
+  p4est_topidx_t      num_trees = 1;
+
+  if (conn->vertices != NULL || conn->tree_to_vertex != NULL ||
+      conn->tree_to_tree != NULL || conn->tree_to_face != NULL) {
+    P4EST_NOTICE ("Implicit brick with explicit arrays\n");
+    return 0;
+  }
+  for (i = 0; i < P4EST_DIM; ++i) {
+    if (conn->brick->dims[i] <= 0) {
+      P4EST_NOTICEF ("Implicit brick dimension %d out of range\n", i);
+      return 0;
+    }
+    num_trees *= conn->brick->dims[i];
+  }
+  if (num_trees != conn->num_trees) {
+    P4EST_NOTICE ("Implicit brick tree count mismatch\n");
+    return 0;
+  }
+  return 1;
+}
+
+/** Check the properties of a connectivity that do not belong to one tree.
+ * \return          True if the global arrays are consistent.
+ */
+static int
+p4est_connectivity_arrays_are_valid (p4est_connectivity_t * conn)
+{
+  p4est_topidx_t      nctt, acorner;
+  const p4est_topidx_t num_vertices = conn->num_vertices;
+  const p4est_topidx_t num_trees = conn->num_trees;
+#ifdef P4_TO_P8
+  p4est_topidx_t      nett, aedge;
+  const p4est_topidx_t num_edges = conn->num_edges;
+  const p4est_topidx_t *eoff = conn->ett_offset;
+  const p4est_topidx_t *ett = conn->edge_to_tree;
+  const int8_t       *ete = conn->edge_to_edge;
+  const p4est_topidx_t num_ett = eoff[num_edges];
+#endif
+  const p4est_topidx_t num_corners = conn->num_corners;
+  const p4est_topidx_t *coff = conn->ctt_offset;
+  const p4est_topidx_t *ctt = conn->corner_to_tree;
+  const int8_t       *ctc = conn->corner_to_corner;
+  const p4est_topidx_t num_ctt = coff[num_corners];
+
+  if (num_vertices == 0 &&
+      (conn->vertices != NULL || conn->tree_to_vertex != NULL)) {
+    P4EST_NOTICE ("Zero vertices still with arrays\n");
+    return 0;
+  }
+  if (num_vertices > 0 &&
+      (conn->vertices == NULL || conn->tree_to_vertex == NULL)) {
+    P4EST_NOTICE ("Nonzero vertices missing arrays\n");
+    return 0;
+  }
+
+#ifdef P4_TO_P8
+  for (nett = 0; nett < num_ett; ++nett) {
+    if (ett[nett] < 0 || ett[nett] >= num_trees) {
+      P4EST_NOTICEF ("Edge to tree %lld out of range\n", (long long) nett);
+      return 0;
+    }
+    if (ete[nett] < 0 || ete[nett] >= 24) {
+      P4EST_NOTICEF ("Edge to edge %lld out of range\n", (long long) nett);
+      return 0;
+    }
+  }
+  for (aedge = 0; aedge < num_edges; ++aedge) {
+    if (eoff[aedge + 1] < eoff[aedge]) {
+      P4EST_NOTICEF ("Edge offset backwards %lld\n", (long long) aedge);
+      return 0;
+    }
+  }
+#endif
+
+  for (nctt = 0; nctt < num_ctt; ++nctt) {
+    if (ctt[nctt] < 0 || ctt[nctt] >= num_trees) {
+      P4EST_NOTICEF ("Corner to tree %lld out of range\n", (long long) nctt);
+      return 0;
+    }
+    if (ctc[nctt] < 0 || ctc[nctt] >= P4EST_CHILDREN) {
+      P4EST_NOTICEF ("Corner to corner %lld out of range\n",
+                     (long long) nctt);
+      return 0;
+    }
+  }
+  for (acorner = 0; acorner < num_corners; ++acorner) {
+    if (coff[acorner + 1] < coff[acorner]) {
+      P4EST_NOTICEF ("Corner offset backwards %lld\n", (long long) acorner);
+      return 0;
+    }
+  }
+
+  if ((conn->tree_to_attr != NULL) != (conn->tree_attr_bytes > 0)) {
+    P4EST_NOTICEF ("Tree attribute properties inconsistent %lld",
+                   (long long) conn->tree_attr_bytes);
+    return 0;
+  }
+
+  return 1;
 }
 
-int
-p4est_connectivity_is_valid (p4est_connectivity_t * conn)
+/** Check the relations of a range of trees to their neighbors.
+ * The arrays must have passed \ref p4est_connectivity_arrays_are_valid.
+ * \param [in] first_tree   First tree to check.
+ * \param [in] end_tree     One past the last tree to check.
+ * \return                  True if all trees in the range are valid.
+ */
+static int
+p4est_connectivity_trees_are_valid (p4est_connectivity_t * conn,
+                                    p4est_topidx_t first_tree,
+                                    p4est_topidx_t end_tree)
 {
   int                 nvert;
   int                 face, rface, nface, orientation;
@@ -496,42 +1335,8 @@ p4est_connectivity_is_valid (p4est_connectivity_t * conn)
 #endif
   sc_array_init (cta, sizeof (p4est_corner_transform_t));
 
-  if (num_vertices == 0 && (conn->vertices != NULL || ttv != NULL)) {
-    P4EST_NOTICE ("Zero vertices still with arrays\n");
-    goto failure;
-  }
-  if (num_vertices > 0 && (conn->vertices == NULL || ttv == NULL)) {
-    P4EST_NOTICE ("Nonzero vertices missing arrays\n");
-    goto failure;
-  }
-
-#ifdef P4_TO_P8
-  for (nett = 0; nett < num_ett; ++nett) {
-    if (ett[nett] < 0 || ett[nett] >= num_trees) {
-      P4EST_NOTICEF ("Edge to tree %lld out of range\n", (long long) nett);
-      goto failure;
-    }
-    if (ete[nett] < 0 || ete[nett] >= 24) {
-      P4EST_NOTICEF ("Edge to edge %lld out of range\n", (long long) nett);
-      goto failure;
-    }
-  }
-#endif
-
-  for (nctt = 0; nctt < num_ctt; ++nctt) {
-    if (ctt[nctt] < 0 || ctt[nctt] >= num_trees) {
-      P4EST_NOTICEF ("Corner to tree %lld out of range\n", (long long) nctt);
-      goto failure;
-    }
-    if (ctc[nctt] < 0 || ctc[nctt] >= P4EST_CHILDREN) {
-      P4EST_NOTICEF ("Corner to corner %lld out of range\n",
-                     (long long) nctt);
-      goto failure;
-    }
-  }
-
-  if (num_vertices > 0) {
-    for (tree = 0; tree < num_trees; ++tree) {
+  for (tree = first_tree; tree < end_tree; ++tree) {
+    if (num_vertices > 0) {
       for (nvert = 0; nvert < P4EST_CHILDREN; ++nvert) {
         vertex = ttv[tree * P4EST_CHILDREN + nvert];
         if (vertex < 0 || vertex >= num_vertices) {
@@ -541,15 +1346,7 @@ p4est_connectivity_is_valid (p4est_connectivity_t * conn)
         }
       }
     }
-  }
-
-  if ((conn->tree_to_attr != NULL) != (conn->tree_attr_bytes > 0)) {
-    P4EST_NOTICEF ("Tree attribute properties inconsistent %lld",
-                   (long long) conn->tree_attr_bytes);
-    goto failure;
-  }
 
-  for (tree = 0; tree < num_trees; ++tree) {
     for (face = 0; face < P4EST_FACES; ++face) {
       ntree = ttt[tree * P4EST_FACES + face];
       if (ntree < 0 || ntree >= num_trees) {
@@ -589,12 +1386,6 @@ p4est_connectivity_is_valid (p4est_connectivity_t * conn)
     }
 
 #ifdef P4_TO_P8
-    for (aedge = 0; aedge < num_edges; ++aedge) {
-      if (eoff[aedge + 1] < eoff[aedge]) {
-        P4EST_NOTICEF ("Edge offset backwards %lld\n", (long long) aedge);
-        goto failure;
-      }
-    }
     if (num_edges > 0) {
       for (edge = 0; edge < P8EST_EDGES; ++edge) {
         p8est_find_edge_transform (conn, tree, edge, &ei);
@@ -652,12 +1443,6 @@ p4est_connectivity_is_valid (p4est_connectivity_t * conn)
     }
 #endif
 
-    for (acorner = 0; acorner < num_corners; ++acorner) {
-      if (coff[acorner + 1] < coff[acorner]) {
-        P4EST_NOTICEF ("Corner offset backwards %lld\n", (long long) acorner);
-        goto failure;
-      }
-    }
     if (num_corners > 0) {
       for (corner = 0; corner < P4EST_CHILDREN; ++corner) {
         p4est_find_corner_transform (conn, tree, corner, &ci);
@@ -722,6 +1507,83 @@ failure:
   return good;
 }
 
+/** Check the relations of a range of trees using threads. */
+static int
+p4est_connectivity_trees_are_valid_threads (p4est_connectivity_t * conn,
+                                            p4est_topidx_t first_tree,
+                                            p4est_topidx_t end_tree)
+{
+#ifdef P4EST_ENABLE_OPENMP
+  const int           num_threads = p4est_get_num_threads ();
+  long                num_chunks, jj;
+  int                 good;
+  int                *chunk_good;
+
+  if (num_threads > 1 && end_tree - first_tree >= 2 * num_threads) {
+    /* several chunks per thread even out the cost of shared corners */
+    num_chunks = SC_MIN (8 * num_threads, (long) (end_tree - first_tree));
+    chunk_good = P4EST_ALLOC (int, num_chunks);
+#pragma omp parallel for num_threads (num_threads) schedule (dynamic)
+    for (jj = 0; jj < num_chunks; ++jj) {
+      const p4est_topidx_t range = end_tree - first_tree;
+
+      chunk_good[jj] = p4est_connectivity_trees_are_valid
+        (conn, first_tree + (p4est_topidx_t) ((range * jj) / num_chunks),
+         first_tree + (p4est_topidx_t) ((range * (jj + 1)) / num_chunks));
+    }
+    good = 1;
+    for (jj = 0; jj < num_chunks; ++jj) {
+      good = good && chunk_good[jj];
+    }
+    P4EST_FREE (chunk_good);
+    return good;
+  }
+#endif
+  return p4est_connectivity_trees_are_valid (conn, first_tree, end_tree);
+}
+
+int
+p4est_connectivity_is_valid (p4est_connectivity_t * conn)
+{
+  if (conn->brick != NULL) {
+    return p4est_connectivity_brick_is_valid (conn);
+  }
+  return p4est_connectivity_arrays_are_valid (conn) &&
+    p4est_connectivity_trees_are_valid_threads (conn, 0, conn->num_trees);
+}
+
+int
+p4est_connectivity_is_valid_parallel (p4est_connectivity_t * conn,
+                                      sc_MPI_Comm mpicomm)
+{
+  int                 mpiret;
+  int                 mpisize, mpirank;
+  int                 good, global_good;
+  p4est_gloidx_t      num_trees;
+
+  if (conn->brick != NULL) {
+    return p4est_connectivity_brick_is_valid (conn);
+  }
+
+  mpiret = sc_MPI_Comm_size (mpicomm, &mpisize);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Comm_rank (mpicomm, &mpirank);
+  SC_CHECK_MPI (mpiret);
+
+  /* every process checks the shared arrays and its range of trees */
+  num_trees = (p4est_gloidx_t) conn->num_trees;
+  good = p4est_connectivity_arrays_are_valid (conn) &&
+    p4est_connectivity_trees_are_valid_threads
+    (conn, (p4est_topidx_t) ((num_trees * mpirank) / mpisize),
+     (p4est_topidx_t) ((num_trees * (mpirank + 1)) / mpisize));
+
+  mpiret = sc_MPI_Allreduce (&good, &global_good, 1, sc_MPI_INT,
+                             sc_MPI_LAND, mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  return global_good;
+}
+
 int
 p4est_connectivity_is_equal (p4est_connectivity_t * conn1,
                              p4est_connectivity_t * conn2)
@@ -823,6 +1685,97 @@ p4est_connectivity_is_equal (p4est_connectivity_t * conn1,
   return 1;
 }
 
+/** Mix a memory range into a running checksum. */
+static uint64_t
+p4est_connectivity_hash (uint64_t hash, const void *data, size_t bytes)
+{
+  const char         *mem = (const char *) data;
+  const uint64_t      prime = (uint64_t) 0x100000001b3ULL;
+  uint64_t            word;
+  size_t              zz;
+
+  for (zz = 0; zz + sizeof (uint64_t) <= bytes; zz += sizeof (uint64_t)) {
+    memcpy (&word, mem + zz, sizeof (uint64_t));
+    hash = (hash ^ word) * prime;
+    hash ^= hash >> 32;
+  }
+  for (; zz < bytes; ++zz) {
+    hash = (hash ^ (uint64_t) (unsigned char) mem[zz]) * prime;
+  }
+  return hash;
+}
+
+uint64_t
+p4est_connectivity_checksum (p4est_connectivity_t * conn)
+{
+  const size_t        topsize = sizeof (p4est_topidx_t);
+  const p4est_topidx_t num_vertices = conn->num_vertices;
+  const p4est_topidx_t num_trees = conn->num_trees;
+  const p4est_topidx_t num_corners = conn->num_corners;
+  const p4est_topidx_t num_ctt = conn->ctt_offset[num_corners];
+#ifdef P4_TO_P8
+  const p4est_topidx_t num_edges = conn->num_edges;
+  const p4est_topidx_t num_ett = conn->ett_offset[num_edges];
+#else
+  const p4est_topidx_t num_edges = 0, num_ett = 0;
+#endif
+  const size_t        nt = (size_t) num_trees;
+  uint64_t            hash = (uint64_t) 0xcbf29ce484222325ULL;
+  uint64_t            counts[7];
+
+  SC_CHECK_ABORT (conn->brick == NULL,
+                  "Cannot checksum an implicit brick connectivity");
+
+  /* hash the sizes and then the arrays in the order they are written */
+  counts[0] = (uint64_t) num_vertices;
+  counts[1] = (uint64_t) num_trees;
+  counts[2] = (uint64_t) num_edges;
+  counts[3] = (uint64_t) num_ett;
+  counts[4] = (uint64_t) num_corners;
+  counts[5] = (uint64_t) num_ctt;
+  counts[6] = (uint64_t) conn->tree_attr_bytes;
+  hash = p4est_connectivity_hash (hash, counts, sizeof (counts));
+  if (num_vertices > 0) {
+    hash = p4est_connectivity_hash (hash, conn->vertices, (size_t)
+                                    num_vertices * 3 * sizeof (double));
+    hash = p4est_connectivity_hash (hash, conn->tree_to_vertex,
+                                    nt * P4EST_CHILDREN * topsize);
+  }
+#ifdef P4_TO_P8
+  if (num_edges > 0) {
+    hash = p4est_connectivity_hash (hash, conn->tree_to_edge,
+                                    nt * P8EST_EDGES * topsize);
+    hash = p4est_connectivity_hash (hash, conn->edge_to_tree,
+                                    (size_t) num_ett * topsize);
+    hash = p4est_connectivity_hash (hash, conn->edge_to_edge,
+                                    (size_t) num_ett);
+  }
+  hash = p4est_connectivity_hash (hash, conn->ett_offset,
+                                  (size_t) (num_edges + 1) * topsize);
+#endif
+  if (num_corners > 0) {
+    hash = p4est_connectivity_hash (hash, conn->tree_to_corner,
+                                    nt * P4EST_CHILDREN * topsize);
+    hash = p4est_connectivity_hash (hash, conn->corner_to_tree,
+                                    (size_t) num_ctt * topsize);
+    hash = p4est_connectivity_hash (hash, conn->corner_to_corner,
+                                    (size_t) num_ctt);
+  }
+  hash = p4est_connectivity_hash (hash, conn->ctt_offset,
+                                  (size_t) (num_corners + 1) * topsize);
+  hash = p4est_connectivity_hash (hash, conn->tree_to_tree,
+                                  nt * P4EST_FACES * topsize);
+  hash = p4est_connectivity_hash (hash, conn->tree_to_face,
+                                  nt * P4EST_FACES);
+  if (conn->tree_attr_bytes > 0) {
+    hash = p4est_connectivity_hash (hash, conn->tree_to_attr,
+                                    conn->tree_attr_bytes * nt);
+  }
+
+  /* zero marks files without a checksum */
+  return hash == 0 ? 1 : hash;
+}
+
 int
 p4est_connectivity_sink (p4est_connectivity_t * conn, sc_io_sink_t * sink)
 {
@@ -838,6 +1791,8 @@ p4est_connectivity_sink (p4est_connectivity_t * conn, sc_io_sink_t * sink)
   p4est_topidx_t      num_edges, num_ett, num_corners, num_ctt;
 
   P4EST_ASSERT (p4est_connectivity_is_valid (conn));
+  SC_CHECK_ABORT (conn->brick == NULL,
+                  "Cannot write an implicit brick connectivity");
 
   retval = 0;
   num_vertices = conn->num_vertices;
@@ -872,7 +1827,7 @@ p4est_connectivity_sink (p4est_connectivity_t * conn, sc_io_sink_t * sink)
   array10[6] = (uint64_t) num_corners;
   array10[7] = (uint64_t) num_ctt;
   array10[8] = (uint64_t) conn->tree_attr_bytes;
-  array10[9] = (uint64_t) 0;
+  array10[9] = p4est_connectivity_checksum (conn);
   retval = retval || sc_io_sink_write (sink, array10, 10 * u64z);
 
   if (num_vertices > 0) {
@@ -976,6 +1931,12 @@ p4est_connectivity_save (const char *filename, p4est_connectivity_t * conn)
 
 p4est_connectivity_t *
 p4est_connectivity_source (sc_io_source_t * source)
+{
+  return p4est_connectivity_source_ext (source, 0);
+}
+
+p4est_connectivity_t *
+p4est_connectivity_source_ext (sc_io_source_t * source, int trusted)
 {
   int                 retval;
   int                 has_tree_attr;
@@ -1187,7 +2148,15 @@ p4est_connectivity_source (sc_io_source_t * source)
     }
   }
 
-  if (!p4est_connectivity_is_valid (conn)) {
+  if (trusted && array10[9] != 0) {
+    /* the writer validated the connectivity and it arrived unchanged */
+    if (p4est_connectivity_checksum (conn) != array10[9]) {
+      /* "checksum mismatch" */
+      p4est_connectivity_destroy (conn);
+      return NULL;
+    }
+  }
+  else if (!p4est_connectivity_is_valid (conn)) {
     /* "invalid connectivity" */
     p4est_connectivity_destroy (conn);
     return NULL;
@@ -1196,6 +2165,56 @@ p4est_connectivity_source (sc_io_source_t * source)
   return conn;
 }
 
+size_t
+p4est_connectivity_sink_bytes (const char *header)
+{
+  const size_t        topsize = sizeof (p4est_topidx_t);
+  size_t              bytes, nt;
+  uint64_t            array10[10];
+
+  /* the header consists of the magic, the version and ten numbers */
+  P4EST_ASSERT (P4EST_CONNECTIVITY_HEADER_BYTES == 32 + sizeof (array10));
+  memcpy (array10, header + 32, sizeof (array10));
+  if (strncmp (header, P4EST_STRING, 8) ||
+      array10[0] != P4EST_ONDISK_FORMAT || array10[1] != (uint64_t) topsize) {
+    return 0;
+  }
+#ifndef P4_TO_P8
+  if (array10[4] != 0 || array10[5] != 0) {
+    return 0;
+  }
+#endif
+
+  /* add the arrays in the order written by p4est_connectivity_sink */
+  nt = (size_t) array10[3];
+  bytes = P4EST_CONNECTIVITY_HEADER_BYTES;
+  bytes += 3 * (size_t) array10[2] * sizeof (double);
+#ifdef P4_TO_P8
+  if (array10[4] > 0) {
+    bytes += P8EST_EDGES * nt * topsize;
+  }
+#endif
+  if (array10[2] > 0) {
+    bytes += P4EST_CHILDREN * nt * topsize;
+  }
+  if (array10[6] > 0) {
+    bytes += P4EST_CHILDREN * nt * topsize;
+  }
+  bytes += P4EST_FACES * nt * (topsize + sizeof (int8_t));
+  bytes += nt * (size_t) array10[8];
+#ifdef P4_TO_P8
+  bytes += ((size_t) array10[4] + 1) * topsize;
+  if (array10[4] > 0) {
+    bytes += (size_t) array10[5] * (topsize + sizeof (int8_t));
+  }
+#endif
+  bytes += ((size_t) array10[6] + 1) * topsize;
+  if (array10[6] > 0) {
+    bytes += (size_t) array10[7] * (topsize + sizeof (int8_t));
+  }
+  return bytes;
+}
+
 p4est_connectivity_t *
 p4est_connectivity_inflate (sc_array_t * buffer)
 {
@@ -1217,6 +2236,13 @@ p4est_connectivity_inflate (sc_array_t * buffer)
 
 p4est_connectivity_t *
 p4est_connectivity_load (const char *filename, size_t *bytes)
+{
+  return p4est_connectivity_load_ext (filename, bytes, 0);
+}
+
+p4est_connectivity_t *
+p4est_connectivity_load_ext (const char *filename, size_t *bytes,
+                             int trusted)
 {
   int                 retval;
   size_t              bytes_in;
@@ -1230,7 +2256,7 @@ p4est_connectivity_load (const char *filename, size_t *bytes)
   }
 
   /* Get byte length and close file even on earlier read error */
-  conn = p4est_connectivity_source (source);
+  conn = p4est_connectivity_source_ext (source, trusted);
   retval = sc_io_source_complete (source, &bytes_in, NULL) || conn == NULL;
   retval = sc_io_source_destroy (source) || retval;
   if (retval) {
@@ -1241,7 +2267,385 @@ p4est_connectivity_load (const char *filename, size_t *bytes)
   }
 
   if (bytes != NULL) {
-    *bytes = bytes_in;
+    *bytes = bytes_in;
+  }
+  return conn;
+}
+
+/** Check whether the host stores integers in little-endian byte order. */
+static int
+p4est_connectivity_mapped_is_le (void)
+{
+  const uint32_t      one = 1;
+
+  return *(const char *) &one == 1;
+}
+
+/** Return the byte size of an array in the mapped format.
+ * The dimensions of \a conn must be set.
+ */
+static size_t
+p4est_connectivity_mapped_bytes (p4est_connectivity_t * conn, int k,
+                                 p4est_topidx_t num_ett,
+                                 p4est_topidx_t num_ctt)
+{
+  const size_t        nt = (size_t) conn->num_trees;
+  const size_t        tsize = sizeof (p4est_topidx_t);
+
+  switch (k) {
+  case 0:
+    return sizeof (double) * 3 * (size_t) conn->num_vertices;
+  case 1:
+    return conn->num_vertices > 0 ? tsize * P4EST_CHILDREN * nt : 0;
+  case 2:
+    return tsize * P4EST_FACES * nt;
+  case 3:
+    return sizeof (int8_t) * P4EST_FACES * nt;
+#ifdef P4_TO_P8
+  case 4:
+    return conn->num_edges > 0 ? tsize * P8EST_EDGES * nt : 0;
+  case 5:
+    return tsize * (size_t) (conn->num_edges + 1);
+  case 6:
+    return conn->num_edges > 0 ? tsize * (size_t) num_ett : 0;
+  case 7:
+    return conn->num_edges > 0 ? sizeof (int8_t) * (size_t) num_ett : 0;
+#else
+  case 4:
+  case 5:
+  case 6:
+  case 7:
+    /* there are no edges in 2D */
+    return 0;
+#endif
+  case 8:
+    return conn->num_corners > 0 ? tsize * P4EST_CHILDREN * nt : 0;
+  case 9:
+    return tsize * (size_t) (conn->num_corners + 1);
+  case 10:
+    return conn->num_corners > 0 ? tsize * (size_t) num_ctt : 0;
+  case 11:
+    return conn->num_corners > 0 ? sizeof (int8_t) * (size_t) num_ctt : 0;
+  case 12:
+    return conn->tree_attr_bytes * nt;
+  default:
+    SC_ABORT_NOT_REACHED ();
+  }
+  return 0;
+}
+
+/** Access an array of a connectivity by its number in the mapped format.
+ * \param [in] array    If not NULL, the array is set to this address.
+ * \return              The address of the array.
+ */
+static void        *
+p4est_connectivity_mapped_array (p4est_connectivity_t * conn, int k,
+                                 void *array)
+{
+  switch (k) {
+  case 0:
+    return array == NULL ? (void *) conn->vertices :
+      (void *) (conn->vertices = (double *) array);
+  case 1:
+    return array == NULL ? (void *) conn->tree_to_vertex :
+      (void *) (conn->tree_to_vertex = (p4est_topidx_t *) array);
+  case 2:
+    return array == NULL ? (void *) conn->tree_to_tree :
+      (void *) (conn->tree_to_tree = (p4est_topidx_t *) array);
+  case 3:
+    return array == NULL ? (void *) conn->tree_to_face :
+      (void *) (conn->tree_to_face = (int8_t *) array);
+#ifdef P4_TO_P8
+  case 4:
+    return array == NULL ? (void *) conn->tree_to_edge :
+      (void *) (conn->tree_to_edge = (p4est_topidx_t *) array);
+  case 5:
+    return array == NULL ? (void *) conn->ett_offset :
+      (void *) (conn->ett_offset = (p4est_topidx_t *) array);
+  case 6:
+    return array == NULL ? (void *) conn->edge_to_tree :
+      (void *) (conn->edge_to_tree = (p4est_topidx_t *) array);
+  case 7:
+    return array == NULL ? (void *) conn->edge_to_edge :
+      (void *) (conn->edge_to_edge = (int8_t *) array);
+#else
+  case 4:
+  case 5:
+  case 6:
+  case 7:
+    return NULL;
+#endif
+  case 8:
+    return array == NULL ? (void *) conn->tree_to_corner :
+      (void *) (conn->tree_to_corner = (p4est_topidx_t *) array);
+  case 9:
+    return array == NULL ? (void *) conn->ctt_offset :
+      (void *) (conn->ctt_offset = (p4est_topidx_t *) array);
+  case 10:
+    return array == NULL ? (void *) conn->corner_to_tree :
+      (void *) (conn->corner_to_tree = (p4est_topidx_t *) array);
+  case 11:
+    return array == NULL ? (void *) conn->corner_to_corner :
+      (void *) (conn->corner_to_corner = (int8_t *) array);
+  case 12:
+    return array == NULL ? (void *) conn->tree_to_attr :
+      (void *) (conn->tree_to_attr = (char *) array);
+  default:
+    SC_ABORT_NOT_REACHED ();
+  }
+  return NULL;
+}
+
+int
+p4est_connectivity_save_mapped (const char *filename,
+                                p4est_connectivity_t * conn, int compress)
+{
+  int                 k, retval;
+  char                magic8[8];
+  char                zeros[P4EST_CONN_MAPPED_ALIGN];
+  const char         *stored;
+  size_t              offset, raw, pad, header_bytes;
+  uint64_t            header[11 + 3 * P4EST_CONN_MAPPED_ARRAYS];
+  p4est_topidx_t      num_ett, num_ctt;
+  FILE               *file;
+#ifdef P4EST_HAVE_ZLIB
+  char               *packed = NULL;
+  uLongf              zlen;
+#endif
+
+  P4EST_ASSERT (p4est_connectivity_is_valid (conn));
+  SC_CHECK_ABORT (conn->brick == NULL,
+                  "Cannot write an implicit brick connectivity");
+  if (!p4est_connectivity_mapped_is_le ()) {
+    /* the format is little-endian */
+    return -1;
+  }
+  if ((file = fopen (filename, "wb")) == NULL) {
+    return -1;
+  }
+
+#ifdef P4_TO_P8
+  num_ett = conn->ett_offset[conn->num_edges];
+#else
+  num_ett = 0;
+#endif
+  num_ctt = conn->ctt_offset[conn->num_corners];
+
+  /* the header is written once more after the array offsets are known */
+  memset (magic8, 0, 8);
+  memcpy (magic8, P4EST_STRING "map", 8);
+  memset (zeros, 0, P4EST_CONN_MAPPED_ALIGN);
+  memset (header, 0, sizeof (header));
+  header[0] = P4EST_MAPPED_FORMAT;
+  header[1] = (uint64_t) 0x0102030405060708ULL;
+  header[2] = (uint64_t) sizeof (p4est_topidx_t);
+  header[3] = (uint64_t) conn->num_vertices;
+  header[4] = (uint64_t) conn->num_trees;
+#ifdef P4_TO_P8
+  header[5] = (uint64_t) conn->num_edges;
+#endif
+  header[6] = (uint64_t) num_ett;
+  header[7] = (uint64_t) conn->num_corners;
+  header[8] = (uint64_t) num_ctt;
+  header[9] = (uint64_t) conn->tree_attr_bytes;
+  header[10] = (uint64_t) P4EST_CONN_MAPPED_ARRAYS;
+  header_bytes = 8 + sizeof (header);
+  retval = fwrite (magic8, 1, 8, file) != 8 ||
+    fwrite (header, sizeof (header), 1, file) != 1;
+
+  /* every array begins at an aligned offset */
+  offset = header_bytes;
+  for (k = 0; !retval && k < P4EST_CONN_MAPPED_ARRAYS; ++k) {
+    raw = p4est_connectivity_mapped_bytes (conn, k, num_ett, num_ctt);
+    pad = (P4EST_CONN_MAPPED_ALIGN - offset % P4EST_CONN_MAPPED_ALIGN) %
+      P4EST_CONN_MAPPED_ALIGN;
+    retval = pad > 0 && fwrite (zeros, 1, pad, file) != pad;
+    offset += pad;
+    stored = (const char *) p4est_connectivity_mapped_array (conn, k, NULL);
+    header[11 + 3 * k] = (uint64_t) offset;
+    header[11 + 3 * k + 1] = (uint64_t) raw;
+    header[11 + 3 * k + 2] = (uint64_t) raw;
+#ifdef P4EST_HAVE_ZLIB
+    if (compress && raw > 0) {
+      /* a compressed array is kept only if it is smaller */
+      zlen = compressBound ((uLong) raw);
+      packed = P4EST_ALLOC (char, zlen);
+      if (compress2 ((Bytef *) packed, &zlen, (const Bytef *) stored,
+                     (uLong) raw, Z_BEST_SPEED) == Z_OK &&
+          (size_t) zlen < raw) {
+        stored = packed;
+        header[11 + 3 * k + 2] = (uint64_t) zlen;
+      }
+    }
+#endif
+    if (header[11 + 3 * k + 2] > 0) {
+      retval = retval || fwrite (stored, 1, (size_t) header[11 + 3 * k + 2],
+                                 file) != (size_t) header[11 + 3 * k + 2];
+    }
+    offset += (size_t) header[11 + 3 * k + 2];
+#ifdef P4EST_HAVE_ZLIB
+    P4EST_FREE (packed);
+    packed = NULL;
+#endif
+  }
+
+  /* fill in the table of arrays */
+  retval = retval || fseek (file, 8, SEEK_SET) ||
+    fwrite (header, sizeof (header), 1, file) != 1;
+  retval = fclose (file) || retval;
+  return retval ? -1 : 0;
+}
+
+p4est_connectivity_t *
+p4est_connectivity_load_mapped (const char *filename, size_t *bytes)
+{
+  int                 k, retval;
+  char               *array;
+  size_t              offset, raw, stored;
+  uint64_t            header[11 + 3 * P4EST_CONN_MAPPED_ARRAYS];
+  p4est_topidx_t      num_ett, num_ctt;
+  p4est_connectivity_t *conn;
+  struct p4est_connectivity_mapped *mapped;
+#ifdef P4EST_HAVE_SYS_MMAN_H
+  int                 fd;
+  struct stat         st;
+  void               *addr;
+#else
+  FILE               *file;
+  long                fsize;
+#endif
+#ifdef P4EST_HAVE_ZLIB
+  uLongf              zlen;
+#endif
+
+  if (!p4est_connectivity_mapped_is_le ()) {
+    /* the format is little-endian */
+    return NULL;
+  }
+
+  /* map or read the complete file */
+  mapped = P4EST_ALLOC_ZERO (struct p4est_connectivity_mapped, 1);
+#ifdef P4EST_HAVE_SYS_MMAN_H
+  if ((fd = open (filename, O_RDONLY)) < 0) {
+    P4EST_FREE (mapped);
+    return NULL;
+  }
+  if (fstat (fd, &st) || (mapped->size = (size_t) st.st_size) <
+      8 + sizeof (header)) {
+    close (fd);
+    P4EST_FREE (mapped);
+    return NULL;
+  }
+  /* processes on one node share the pages of the file in memory */
+  addr = mmap (NULL, mapped->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (addr == MAP_FAILED) {
+    P4EST_FREE (mapped);
+    return NULL;
+  }
+  mapped->data = (char *) addr;
+  mapped->is_mmap = 1;
+#else
+  if ((file = fopen (filename, "rb")) == NULL) {
+    P4EST_FREE (mapped);
+    return NULL;
+  }
+  if (fseek (file, 0, SEEK_END) || (fsize = ftell (file)) < 0 ||
+      fseek (file, 0, SEEK_SET) ||
+      (mapped->size = (size_t) fsize) < 8 + sizeof (header)) {
+    fclose (file);
+    P4EST_FREE (mapped);
+    return NULL;
+  }
+  mapped->data = P4EST_ALLOC (char, mapped->size);
+  retval = fread (mapped->data, 1, mapped->size, file) != mapped->size;
+  retval = fclose (file) || retval;
+  if (retval) {
+    p4est_connectivity_mapped_drop (mapped);
+    return NULL;
+  }
+#endif
+
+  /* check the header */
+  memcpy (header, mapped->data + 8, sizeof (header));
+  if (memcmp (mapped->data, P4EST_STRING "map", 8) ||
+      header[0] != P4EST_MAPPED_FORMAT ||
+      header[1] != (uint64_t) 0x0102030405060708ULL ||
+      header[2] != (uint64_t) sizeof (p4est_topidx_t) ||
+      header[10] != (uint64_t) P4EST_CONN_MAPPED_ARRAYS ||
+      (p4est_topidx_t) header[3] < 0 || (p4est_topidx_t) header[4] < 0 ||
+#ifdef P4_TO_P8
+      (p4est_topidx_t) header[5] < 0 || (p4est_topidx_t) header[6] < 0 ||
+#else
+      header[5] != 0 || header[6] != 0 ||
+#endif
+      (p4est_topidx_t) header[7] < 0 || (p4est_topidx_t) header[8] < 0) {
+    p4est_connectivity_mapped_drop (mapped);
+    return NULL;
+  }
+
+  /* the connectivity holds only the dimensions and the array addresses */
+  conn = P4EST_ALLOC_ZERO (p4est_connectivity_t, 1);
+  sc_refcount_init (&conn->rc, p4est_package_id);
+  conn->num_vertices = (p4est_topidx_t) header[3];
+  conn->num_trees = (p4est_topidx_t) header[4];
+#ifdef P4_TO_P8
+  conn->num_edges = (p4est_topidx_t) header[5];
+#endif
+  num_ett = (p4est_topidx_t) header[6];
+  conn->num_corners = (p4est_topidx_t) header[7];
+  num_ctt = (p4est_topidx_t) header[8];
+  conn->tree_attr_bytes = (size_t) header[9];
+  conn->mapped = mapped;
+
+  retval = 0;
+  for (k = 0; !retval && k < P4EST_CONN_MAPPED_ARRAYS; ++k) {
+    offset = (size_t) header[11 + 3 * k];
+    raw = (size_t) header[11 + 3 * k + 1];
+    stored = (size_t) header[11 + 3 * k + 2];
+    if (raw != p4est_connectivity_mapped_bytes (conn, k, num_ett, num_ctt) ||
+        offset % P4EST_CONN_MAPPED_ALIGN != 0 || stored > raw ||
+        offset > mapped->size || stored > mapped->size - offset) {
+      retval = -1;
+      break;
+    }
+    if (raw == 0) {
+      continue;
+    }
+    if (stored == raw) {
+      /* the array is used in place */
+      p4est_connectivity_mapped_array (conn, k, mapped->data + offset);
+      continue;
+    }
+#ifdef P4EST_HAVE_ZLIB
+    array = P4EST_ALLOC (char, raw);
+    mapped->owned[k] = array;
+    zlen = (uLongf) raw;
+    if (uncompress ((Bytef *) array, &zlen,
+                    (const Bytef *) (mapped->data + offset),
+                    (uLong) stored) != Z_OK || (size_t) zlen != raw) {
+      retval = -1;
+      break;
+    }
+    p4est_connectivity_mapped_array (conn, k, array);
+#else
+    /* compressed arrays require zlib */
+    array = NULL;
+    retval = -1;
+#endif
+  }
+  if (retval ||
+#ifdef P4_TO_P8
+      conn->ett_offset[conn->num_edges] != num_ett ||
+#endif
+      conn->ctt_offset[conn->num_corners] != num_ctt ||
+      !p4est_connectivity_is_valid (conn)) {
+    p4est_connectivity_destroy (conn);
+    return NULL;
+  }
+
+  if (bytes != NULL) {
+    *bytes = mapped->size;
   }
   return conn;
 }
@@ -2857,6 +4261,241 @@ p8est_connectivity_new_brick (int mi, int ni, int pi, int periodic_a,
   return conn;
 }
 
+/** Compute the coordinates of a tree in an implicit brick. */
+static void
+p4est_connectivity_brick_coords (const p4est_connectivity_brick_t * brick,
+                                 p4est_topidx_t tree,
+                                 p4est_topidx_t coord[P4EST_DIM])
+{
+  coord[0] = tree % brick->dims[0];
+  tree /= brick->dims[0];
+#ifdef P4_TO_P8
+  coord[1] = tree % brick->dims[1];
+  tree /= brick->dims[1];
+#endif
+  coord[P4EST_DIM - 1] = tree;
+}
+
+/** Compute the number of a tree in an implicit brick. */
+static              p4est_topidx_t
+p4est_connectivity_brick_tree (const p4est_connectivity_brick_t * brick,
+                               const p4est_topidx_t coord[P4EST_DIM])
+{
+#ifdef P4_TO_P8
+  return coord[0] + brick->dims[0] * (coord[1] + brick->dims[1] * coord[2]);
+#else
+  return coord[0] + brick->dims[0] * coord[1];
+#endif
+}
+
+/** Return the cell below a lattice coordinate that indexes shared corners
+ * and edges in one direction, or -1 if the lattice point is on the domain
+ * boundary.  The number of such cells is dims - 1 or dims if periodic.
+ */
+static              p4est_topidx_t
+p4est_connectivity_brick_lower (const p4est_connectivity_brick_t * brick,
+                                int dir, p4est_topidx_t lattice)
+{
+  if (lattice == 0) {
+    return brick->periodic[dir] ? brick->dims[dir] - 1 : -1;
+  }
+  if (lattice == brick->dims[dir] && !brick->periodic[dir]) {
+    return -1;
+  }
+  return lattice - 1;
+}
+
+p4est_topidx_t
+p4est_connectivity_brick_face_neighbor (p4est_connectivity_t * conn,
+                                        p4est_topidx_t tree, int face,
+                                        int *nface)
+{
+  const p4est_connectivity_brick_t *brick = conn->brick;
+  const int           dir = face / 2;
+  p4est_topidx_t      coord[P4EST_DIM];
+
+  P4EST_ASSERT (brick != NULL);
+  P4EST_ASSERT (0 <= tree && tree < conn->num_trees);
+  P4EST_ASSERT (0 <= face && face < P4EST_FACES);
+
+  p4est_connectivity_brick_coords (brick, tree, coord);
+  coord[dir] += (face & 1) ? 1 : -1;
+  if (coord[dir] < 0 || coord[dir] >= brick->dims[dir]) {
+    if (!brick->periodic[dir]) {
+      *nface = face;
+      return tree;
+    }
+    coord[dir] = (coord[dir] + brick->dims[dir]) % brick->dims[dir];
+  }
+  *nface = face ^ 1;
+  return p4est_connectivity_brick_tree (brick, coord);
+}
+
+void
+p4est_connectivity_tree_vertex (p4est_connectivity_t * conn,
+                                p4est_topidx_t tree, int corner,
+                                double xyz[3])
+{
+  p4est_topidx_t      vertex;
+  p4est_topidx_t      coord[P4EST_DIM];
+
+  P4EST_ASSERT (0 <= tree && tree < conn->num_trees);
+  P4EST_ASSERT (0 <= corner && corner < P4EST_CHILDREN);
+
+  if (conn->brick != NULL) {
+    /* the corners are at integer coordinates as in the explicit brick */
+    p4est_connectivity_brick_coords (conn->brick, tree, coord);
+    xyz[0] = (double) (coord[0] + (corner & 1));
+    xyz[1] = (double) (coord[1] + ((corner >> 1) & 1));
+#ifndef P4_TO_P8
+    xyz[2] = 0.;
+#else
+    xyz[2] = (double) (coord[2] + (corner >> 2));
+#endif
+    return;
+  }
+
+  P4EST_ASSERT (conn->vertices != NULL && conn->tree_to_vertex != NULL);
+  vertex = conn->tree_to_vertex[P4EST_CHILDREN * tree + corner];
+  P4EST_ASSERT (0 <= vertex && vertex < conn->num_vertices);
+  memcpy (xyz, conn->vertices + 3 * vertex, 3 * sizeof (double));
+}
+
+p4est_connectivity_t *
+#ifndef P4_TO_P8
+p4est_connectivity_new_brick_implicit (int mi, int ni, int periodic_a,
+                                       int periodic_b)
+#else
+p8est_connectivity_new_brick_implicit (int mi, int ni, int pi,
+                                       int periodic_a, int periodic_b,
+                                       int periodic_c)
+#endif
+{
+  int                 i, k;
+  p4est_topidx_t      tree, id, nc[P4EST_DIM];
+  p4est_topidx_t      coord[P4EST_DIM], lower[P4EST_DIM];
+  p4est_topidx_t      num_corners, num_ctt;
+#ifdef P4_TO_P8
+  int                 dir, o1, o2;
+  p4est_topidx_t      num_edges, edge_offset[P4EST_DIM + 1];
+  p4est_topidx_t      l1, l2;
+#endif
+  p4est_connectivity_brick_t *brick;
+  p4est_connectivity_t *conn;
+
+  brick = P4EST_ALLOC (p4est_connectivity_brick_t, 1);
+  brick->dims[0] = (p4est_topidx_t) mi;
+  brick->dims[1] = (p4est_topidx_t) ni;
+  brick->periodic[0] = periodic_a;
+  brick->periodic[1] = periodic_b;
+#ifdef P4_TO_P8
+  brick->dims[2] = (p4est_topidx_t) pi;
+  brick->periodic[2] = periodic_c;
+#endif
+  for (i = 0; i < P4EST_DIM; ++i) {
+    P4EST_ASSERT (brick->dims[i] > 0);
+    nc[i] = brick->periodic[i] ? brick->dims[i] : brick->dims[i] - 1;
+  }
+
+  /* the face and vertex members stay NULL */
+  conn = P4EST_ALLOC_ZERO (p4est_connectivity_t, 1);
+  sc_refcount_init (&conn->rc, p4est_package_id);
+  conn->brick = brick;
+#ifndef P4_TO_P8
+  conn->num_trees = brick->dims[0] * brick->dims[1];
+  conn->num_vertices = (brick->dims[0] + 1) * (brick->dims[1] + 1);
+  num_corners = nc[0] * nc[1];
+#else
+  conn->num_trees = brick->dims[0] * brick->dims[1] * brick->dims[2];
+  conn->num_vertices = (brick->dims[0] + 1) * (brick->dims[1] + 1) *
+    (brick->dims[2] + 1);
+  num_corners = nc[0] * nc[1] * nc[2];
+#endif
+
+  /* every shared corner is touched by all trees around it */
+  num_ctt = P4EST_CHILDREN * num_corners;
+  conn->num_corners = num_corners;
+  conn->ctt_offset = P4EST_ALLOC (p4est_topidx_t, num_corners + 1);
+  for (id = 0; id <= num_corners; ++id) {
+    conn->ctt_offset[id] = P4EST_CHILDREN * id;
+  }
+  if (num_corners > 0) {
+    conn->tree_to_corner =
+      P4EST_ALLOC (p4est_topidx_t, P4EST_CHILDREN * conn->num_trees);
+    conn->corner_to_tree = P4EST_ALLOC (p4est_topidx_t, num_ctt);
+    conn->corner_to_corner = P4EST_ALLOC (int8_t, num_ctt);
+    for (tree = 0; tree < conn->num_trees; ++tree) {
+      p4est_connectivity_brick_coords (brick, tree, coord);
+      for (k = 0; k < P4EST_CHILDREN; ++k) {
+        id = 0;
+        for (i = P4EST_DIM - 1; i >= 0; --i) {
+          lower[i] = p4est_connectivity_brick_lower
+            (brick, i, coord[i] + ((k >> i) & 1));
+          if (lower[i] < 0) {
+            id = -1;
+            break;
+          }
+          id = id * nc[i] + lower[i];
+        }
+        conn->tree_to_corner[P4EST_CHILDREN * tree + k] = id;
+        if (id >= 0) {
+          /* this tree is the one at offset k ^ (P4EST_CHILDREN - 1) */
+          conn->corner_to_tree[P4EST_CHILDREN * id +
+                               (P4EST_CHILDREN - 1 - k)] = tree;
+          conn->corner_to_corner[P4EST_CHILDREN * id +
+                                 (P4EST_CHILDREN - 1 - k)] = (int8_t) k;
+        }
+      }
+    }
+  }
+
+#ifdef P4_TO_P8
+  /* edges of each direction are numbered after the previous directions */
+  edge_offset[0] = 0;
+  for (dir = 0; dir < P4EST_DIM; ++dir) {
+    o1 = dir == 0 ? 1 : 0;
+    o2 = dir == 2 ? 1 : 2;
+    edge_offset[dir + 1] =
+      edge_offset[dir] + brick->dims[dir] * nc[o1] * nc[o2];
+  }
+  num_edges = edge_offset[P4EST_DIM];
+  conn->num_edges = num_edges;
+  conn->ett_offset = P4EST_ALLOC (p4est_topidx_t, num_edges + 1);
+  for (id = 0; id <= num_edges; ++id) {
+    conn->ett_offset[id] = 4 * id;
+  }
+  if (num_edges > 0) {
+    conn->tree_to_edge =
+      P4EST_ALLOC (p4est_topidx_t, P8EST_EDGES * conn->num_trees);
+    conn->edge_to_tree = P4EST_ALLOC (p4est_topidx_t, 4 * num_edges);
+    conn->edge_to_edge = P4EST_ALLOC (int8_t, 4 * num_edges);
+    for (tree = 0; tree < conn->num_trees; ++tree) {
+      p4est_connectivity_brick_coords (brick, tree, coord);
+      for (k = 0; k < P8EST_EDGES; ++k) {
+        dir = k / 4;
+        o1 = dir == 0 ? 1 : 0;
+        o2 = dir == 2 ? 1 : 2;
+        l1 = p4est_connectivity_brick_lower (brick, o1, coord[o1] + (k & 1));
+        l2 = p4est_connectivity_brick_lower (brick, o2,
+                                             coord[o2] + ((k >> 1) & 1));
+        if (l1 < 0 || l2 < 0) {
+          conn->tree_to_edge[P8EST_EDGES * tree + k] = -1;
+          continue;
+        }
+        id = edge_offset[dir] +
+          coord[dir] + brick->dims[dir] * (l1 + nc[o1] * l2);
+        conn->tree_to_edge[P8EST_EDGES * tree + k] = id;
+        conn->edge_to_tree[4 * id + (3 - k % 4)] = tree;
+        conn->edge_to_edge[4 * id + (3 - k % 4)] = (int8_t) k;
+      }
+    }
+  }
+#endif
+
+  P4EST_ASSERT (p4est_connectivity_is_valid (conn));
+  return conn;
+}
+
 p4est_connectivity_t *
 p4est_connectivity_new_byname (const char *name)
 {
@@ -2935,37 +4574,9 @@ p4est_connectivity_new_byname (const char *name)
   return NULL;
 }
 
-typedef struct
-{
-  p4est_topidx_t      key[P4EST_HALF];
-  p4est_topidx_t      trees[2];
-  int8_t              faces[2];
-}
-p4est_conn_face_info_t;
-
-static unsigned
-p4est_conn_face_hash (const void *v, const void *u)
-{
-  const p4est_conn_face_info_t *fi = (p4est_conn_face_info_t *) v;
-
-#ifdef P4_TO_P8
-  return p4est_topidx_hash4 (fi->key);
-#else
-  return p4est_topidx_hash2 (fi->key);
-#endif
-}
-
-static int
-p4est_conn_face_equal (const void *v1, const void *v2, const void *u)
-{
-  const p4est_conn_face_info_t *fi1 = (p4est_conn_face_info_t *) v1;
-  const p4est_conn_face_info_t *fi2 = (p4est_conn_face_info_t *) v2;
-
-  return !memcmp (fi1->key, fi2->key, P4EST_HALF * sizeof (p4est_topidx_t));
-}
-
 static void
-p4est_conn_face_key (p4est_topidx_t * key, p4est_topidx_t * ttv, int face)
+p4est_conn_face_key (p4est_topidx_t * key, const p4est_topidx_t * ttv,
+                     int face)
 {
   int                 fc;
 
@@ -2979,46 +4590,111 @@ p4est_conn_face_key (p4est_topidx_t * key, p4est_topidx_t * ttv, int face)
 
 #ifdef P4_TO_P8
 
-typedef struct
+static void
+p8est_conn_edge_key (p4est_topidx_t * key, const p4est_topidx_t * ttv,
+                     int edge)
 {
-  p4est_topidx_t      key[2];
-  sc_array_t          trees;
-  sc_array_t          edges;
-  p4est_topidx_t      edgeid;
-}
-p8est_conn_edge_info_t;
+  int                 ec;
 
-static unsigned
-p8est_conn_edge_hash (const void *v, const void *u)
-{
-  const p8est_conn_edge_info_t *ei = (p8est_conn_edge_info_t *) v;
+  P4EST_ASSERT (0 <= edge && edge < P8EST_EDGES);
 
-  return p4est_topidx_hash2 (ei->key);
+  for (ec = 0; ec < 2; ++ec) {
+    key[ec] = ttv[p8est_edge_corners[edge][ec]];
+  }
+  p4est_topidx_bsort (key, 2);
 }
 
-static int
-p8est_conn_edge_equal (const void *v1, const void *v2, const void *u)
+#endif /* P4_TO_P8 */
+
+/** Sort records of vertex numbers by radix, one vertex number at a time.
+ * Each record consists of \a nkeys vertex numbers followed by a position.
+ * Every pass is a stable counting sort over the vertex numbers, starting
+ * with the last key, such that records with equal keys keep their order.
+ * \param [in,out] rec          Array of \a n records of \a nkeys + 1 entries.
+ * \param [in] n                Number of records in \a rec.
+ * \param [in] nkeys            Number of vertex numbers per record.
+ * \param [in] num_vertices     All vertex numbers are less than this.
+ */
+static void
+p4est_conn_sort_keys (p4est_topidx_t * rec, size_t n, int nkeys,
+                      p4est_topidx_t num_vertices)
 {
-  const p8est_conn_edge_info_t *ei1 = (p8est_conn_edge_info_t *) v1;
-  const p8est_conn_edge_info_t *ei2 = (p8est_conn_edge_info_t *) v2;
+  const int           stride = nkeys + 1;
+  int                 k;
+  size_t              zz, zsum, zc;
+  size_t             *count;
+  p4est_topidx_t      vv;
+  p4est_topidx_t     *src, *dst, *swap, *tmp;
+
+  P4EST_ASSERT (nkeys > 0);
+  if (n <= 1) {
+    return;
+  }
+
+  count = P4EST_ALLOC (size_t, num_vertices);
+  tmp = P4EST_ALLOC (p4est_topidx_t, stride * n);
+  src = rec;
+  dst = tmp;
+  for (k = nkeys - 1; k >= 0; --k) {
+    /* count the records per vertex and turn counts into offsets */
+    memset (count, 0, num_vertices * sizeof (size_t));
+    for (zz = 0; zz < n; ++zz) {
+      vv = src[stride * zz + k];
+      P4EST_ASSERT (0 <= vv && vv < num_vertices);
+      ++count[vv];
+    }
+    zsum = 0;
+    for (vv = 0; vv < num_vertices; ++vv) {
+      zc = count[vv];
+      count[vv] = zsum;
+      zsum += zc;
+    }
+    P4EST_ASSERT (zsum == n);
 
-  return !memcmp (ei1->key, ei2->key, 2 * sizeof (p4est_topidx_t));
+    /* move each record to the next free slot of its vertex */
+    for (zz = 0; zz < n; ++zz) {
+      vv = src[stride * zz + k];
+      memcpy (dst + stride * count[vv]++, src + stride * zz,
+              stride * sizeof (p4est_topidx_t));
+    }
+    swap = src;
+    src = dst;
+    dst = swap;
+  }
+  if (src != rec) {
+    memcpy (rec, src, stride * n * sizeof (p4est_topidx_t));
+  }
+  P4EST_FREE (tmp);
+  P4EST_FREE (count);
 }
 
-static void
-p8est_conn_edge_key (p4est_topidx_t * key, p4est_topidx_t * ttv, int edge)
+/** Return the length of the run of equal keys starting at a record. */
+static size_t
+p4est_conn_key_run (const p4est_topidx_t * rec, size_t n, int nkeys,
+                    size_t start)
 {
-  int                 ec;
-
-  P4EST_ASSERT (0 <= edge && edge < P8EST_EDGES);
+  const int           stride = nkeys + 1;
+  size_t              zz;
 
-  for (ec = 0; ec < 2; ++ec) {
-    key[ec] = ttv[p8est_edge_corners[edge][ec]];
+  P4EST_ASSERT (start < n);
+  for (zz = start + 1; zz < n; ++zz) {
+    if (memcmp (rec + stride * start, rec + stride * zz,
+                nkeys * sizeof (p4est_topidx_t))) {
+      break;
+    }
   }
-  p4est_topidx_bsort (key, 2);
+  return zz - start;
 }
 
-#endif /* P4_TO_P8 */
+/** Determine whether a record is the first of its run of equal keys. */
+static int
+p4est_conn_key_is_first (const p4est_topidx_t * rec, int nkeys, size_t pos)
+{
+  const int           stride = nkeys + 1;
+
+  return pos == 0 || memcmp (rec + stride * (pos - 1), rec + stride * pos,
+                             nkeys * sizeof (p4est_topidx_t));
+}
 
 static void
 p4est_expand_face_transform_internal (int iface, int target_face,
@@ -3092,14 +4768,28 @@ p4est_topidx_t
 p4est_find_face_transform (p4est_connectivity_t * connectivity,
                            p4est_topidx_t itree, int iface, int ftransform[])
 {
+  int                 i;
   int                 target_code, target_face, orientation;
   p4est_topidx_t      target_tree;
 
   P4EST_ASSERT (itree >= 0 && itree < connectivity->num_trees);
   P4EST_ASSERT (iface >= 0 && iface < P4EST_FACES);
 
-  target_tree = connectivity->tree_to_tree[P4EST_FACES * itree + iface];
-  target_code = (int) connectivity->tree_to_face[P4EST_FACES * itree + iface];
+  if (connectivity->transforms != NULL) {
+    const size_t        tf = (size_t) P4EST_FACES * itree + iface;
+    const int8_t       *cached = connectivity->transforms->face_transform;
+
+    target_tree = connectivity->transforms->face_tree[tf];
+    if (target_tree >= 0) {
+      for (i = 0; i < 9; ++i) {
+        ftransform[i] = cached[9 * tf + i];
+      }
+    }
+    return target_tree;
+  }
+
+  target_tree = p4est_connectivity_face_neighbor_tree (connectivity, itree,
+                                                       iface, &target_code);
   target_face = target_code % P4EST_FACES;
   orientation = target_code / P4EST_FACES;
 
@@ -3154,8 +4844,8 @@ p4est_find_corner_transform_internal (p4est_connectivity_t * conn,
   /* find the face neighbors */
   for (i = 0; i < P4EST_DIM; ++i) {
     iface = p4est_corner_faces[icorner][i];
-    ntree = conn->tree_to_tree[P4EST_FACES * itree + iface];
-    ncode = (int) conn->tree_to_face[P4EST_FACES * itree + iface];
+    ntree = p4est_connectivity_face_neighbor_tree (conn, itree, iface,
+                                                   &ncode);
     if (ntree != itree || ncode != iface) {     /* not domain boundary */
       nface = ncode % P4EST_FACES;
       orient = ncode / P4EST_FACES;
@@ -3250,6 +4940,22 @@ p4est_find_corner_transform_internal (p4est_connectivity_t * conn,
   return ndistinct;
 }
 
+/** Copy the cached transforms of one tree corner or edge into an array. */
+static void
+p4est_connectivity_transforms_copy (sc_array_t * cached,
+                                    const size_t * offset, size_t which,
+                                    sc_array_t * transforms)
+{
+  const size_t        count = offset[which + 1] - offset[which];
+
+  P4EST_ASSERT (transforms->elem_size == cached->elem_size);
+  sc_array_resize (transforms, count);
+  if (count > 0) {
+    memcpy (transforms->array, sc_array_index (cached, offset[which]),
+            count * cached->elem_size);
+  }
+}
+
 void
 p4est_find_corner_transform (p4est_connectivity_t * conn,
                              p4est_topidx_t itree, int icorner,
@@ -3265,8 +4971,15 @@ p4est_find_corner_transform (p4est_connectivity_t * conn,
   P4EST_ASSERT (0 <= icorner && icorner < P4EST_CHILDREN);
   P4EST_ASSERT (cta->elem_size == sizeof (p4est_corner_transform_t));
 
-  /* check if this corner exists at all */
   ci->icorner = (int8_t) icorner;
+  if (conn->transforms != NULL) {
+    p4est_connectivity_transforms_copy
+      (&conn->transforms->corner_transforms, conn->transforms->corner_offset,
+       (size_t) P4EST_CHILDREN * itree + icorner, cta);
+    return;
+  }
+
+  /* check if this corner exists at all */
   sc_array_resize (cta, 0);
   if (conn->num_corners == 0) {
     return;
@@ -3297,408 +5010,438 @@ p4est_find_corner_transform (p4est_connectivity_t * conn,
 }
 
 void
-p4est_connectivity_complete (p4est_connectivity_t * conn)
+p4est_connectivity_set_transform_cache (p4est_connectivity_t * conn,
+                                        int cache)
 {
-  int                 face, corner, r;
-  int                 primary, secondary, j;
-  size_t              pz;
-  p4est_topidx_t     *pt, treeid, nodeid, tt;
-  p4est_topidx_t     *ttv, *whichttv[2];
-  p4est_conn_face_info_t fikey, *fi;
-  sc_hash_array_t    *face_ha;
-#ifdef P4_TO_P8
-  int                 edge;
-  int8_t             *et;
-  size_t              ez, egz;
-  p4est_topidx_t     *ept, real_edges, enode[2];
-  p4est_topidx_t      ett_count, ett_offset, ett_edge;
-  p8est_conn_edge_info_t eikey, *ei;
-  p8est_edge_info_t   einfo;
-  sc_hash_array_t    *edge_ha;
-  sc_array_t          edge_array, edge_to_pz;
-  sc_array_t         *eta = &einfo.edge_transforms;
-#endif
-  int8_t             *ct;
-  size_t              zcount;
-  p4est_topidx_t      real_corners;
-  p4est_topidx_t      ctt_count, ctt_offset, ctt_corner;
-  p4est_corner_info_t cinfo;
-  sc_array_t         *node_trees, *nt;
-  sc_array_t         *node_corners, *nc;
-  sc_array_t         *cta = &cinfo.corner_transforms;
+  const p4est_topidx_t num_trees = conn->num_trees;
+  int                 i;
+  size_t              tz;
+  p4est_topidx_t      jt;
+  p4est_corner_info_t ci;
+#ifdef P4_TO_P8
+  p8est_edge_info_t   ei;
+#endif
+  struct p4est_connectivity_transforms *tr;
 
+  p4est_connectivity_transforms_drop (conn);
+  if (!cache) {
+    return;
+  }
   P4EST_ASSERT (p4est_connectivity_is_valid (conn));
 
-  /* prepare data structures and remove previous connectivity information */
-  face_ha = sc_hash_array_new (sizeof (p4est_conn_face_info_t),
-                               p4est_conn_face_hash, p4est_conn_face_equal,
-                               NULL);
+  /* the lookups below must not find a partial cache */
+  tr = P4EST_ALLOC (struct p4est_connectivity_transforms, 1);
+  tr->face_tree = P4EST_ALLOC (p4est_topidx_t, (size_t) P4EST_FACES * num_trees);
+  tr->face_transform = P4EST_ALLOC (int8_t, (size_t) 9 * P4EST_FACES * num_trees);
+  tr->corner_offset = P4EST_ALLOC (size_t, (size_t) P4EST_CHILDREN * num_trees + 1);
+  sc_array_init (&tr->corner_transforms, sizeof (p4est_corner_transform_t));
+  sc_array_init (&ci.corner_transforms, sizeof (p4est_corner_transform_t));
 #ifdef P4_TO_P8
-  edge_ha = sc_hash_array_new (sizeof (p8est_conn_edge_info_t),
-                               p8est_conn_edge_hash, p8est_conn_edge_equal,
-                               NULL);
-  P4EST_FREE (conn->tree_to_edge);
-  P4EST_FREE (conn->ett_offset);
-  P4EST_FREE (conn->edge_to_tree);
-  P4EST_FREE (conn->edge_to_edge);
-  real_edges = P8EST_EDGES * conn->num_trees;
-  conn->tree_to_edge = P4EST_ALLOC (p4est_topidx_t, real_edges);
-  memset (conn->tree_to_edge, -1, real_edges * sizeof (p4est_topidx_t));
-  real_edges = 0;
-  ett_count = 0;
-  sc_array_init (&edge_to_pz, sizeof (p4est_topidx_t));
-  sc_array_init (eta, sizeof (p8est_edge_transform_t));
+  tr->edge_offset = P4EST_ALLOC (size_t, (size_t) P8EST_EDGES * num_trees + 1);
+  sc_array_init (&tr->edge_transforms, sizeof (p8est_edge_transform_t));
+  sc_array_init (&ei.edge_transforms, sizeof (p8est_edge_transform_t));
 #endif
-  P4EST_FREE (conn->tree_to_corner);
-  P4EST_FREE (conn->ctt_offset);
-  P4EST_FREE (conn->corner_to_tree);
-  P4EST_FREE (conn->corner_to_corner);
-  real_corners = P4EST_CHILDREN * conn->num_trees;
-  conn->tree_to_corner = P4EST_ALLOC (p4est_topidx_t, real_corners);
-  memset (conn->tree_to_corner, -1, real_corners * sizeof (p4est_topidx_t));
-  real_corners = 0;
-  ctt_count = 0;
-  node_trees = P4EST_ALLOC (sc_array_t, conn->num_vertices);
-  node_corners = P4EST_ALLOC (sc_array_t, conn->num_vertices);
-  for (nodeid = 0; nodeid < conn->num_vertices; ++nodeid) {
-    sc_array_init (node_trees + nodeid, sizeof (p4est_topidx_t));
-    sc_array_init (node_corners + nodeid, sizeof (int8_t));
-  }
-  sc_array_init (cta, sizeof (p4est_corner_transform_t));
 
-  /* hash all faces and edges to identify connections, map corners */
-  ttv = conn->tree_to_vertex;
-  for (treeid = 0; treeid < conn->num_trees; ++treeid) {
-    for (face = 0; face < P4EST_FACES; ++face) {
-      p4est_conn_face_key (fikey.key, ttv, face);
-      fi = (p4est_conn_face_info_t *)
-        sc_hash_array_insert_unique (face_ha, &fikey, &pz);
-      if (fi != NULL) {
-        /* added fi to hash array as the first of two faces */
-        P4EST_ASSERT (sc_array_position (&face_ha->a, fi) == pz);
-        memcpy (fi->key, fikey.key, P4EST_HALF * sizeof (p4est_topidx_t));
-        fi->trees[0] = treeid;
-        fi->faces[0] = (int8_t) face;
-        fi->trees[1] = -1;
-        fi->faces[1] = -1;
-      }
-      else {
-        /* found existing entry from the first face */
-        fi = (p4est_conn_face_info_t *) sc_array_index (&face_ha->a, pz);
-        P4EST_ASSERT (p4est_conn_face_equal (fi->key, fikey.key, NULL));
-        P4EST_ASSERT (fi->trees[0] >= 0 && fi->faces[0] >= 0);
-        P4EST_ASSERT (fi->trees[1] == -1 && fi->faces[1] == -1);
-        fi->trees[1] = treeid;
-        fi->faces[1] = (int8_t) face;
-
-        /* find primary face and orientation to store it */
-        primary = (fi->faces[0] <= fi->faces[1] ? 0 : 1);
-        secondary = 1 - primary;
-        whichttv[0] = conn->tree_to_vertex + P4EST_CHILDREN * fi->trees[0];
-        whichttv[1] = ttv;
-        nodeid = whichttv[primary][p4est_face_corners[fi->faces[primary]][0]];
-        for (r = 0; r < P4EST_HALF; ++r) {
-          corner = p4est_face_corners[fi->faces[secondary]][r];
-          if (nodeid == whichttv[secondary][corner]) {
-            break;
-          }
-        }
-        P4EST_ASSERT (r < P4EST_HALF);
-        for (j = 0; j < 2; ++j) {
-          tt = P4EST_FACES * fi->trees[j] + fi->faces[j];
-          conn->tree_to_tree[tt] = fi->trees[1 - j];
-          conn->tree_to_face[tt] =
-            (int8_t) (P4EST_FACES * r + fi->faces[1 - j]);
-        }
+  tr->corner_offset[0] = 0;
+#ifdef P4_TO_P8
+  tr->edge_offset[0] = 0;
+#endif
+  for (jt = 0; jt < num_trees; ++jt) {
+    for (i = 0; i < P4EST_FACES; ++i) {
+      int                 ftransform[9];
+      int                 k;
+
+      tz = (size_t) P4EST_FACES * jt + i;
+      tr->face_tree[tz] = p4est_find_face_transform (conn, jt, i, ftransform);
+      for (k = 0; k < 9; ++k) {
+        tr->face_transform[9 * tz + k] =
+          (int8_t) (tr->face_tree[tz] >= 0 ? ftransform[k] : 0);
       }
     }
 #ifdef P4_TO_P8
-    for (edge = 0; edge < P8EST_EDGES; ++edge) {
-      p8est_conn_edge_key (eikey.key, ttv, edge);
-      ei = (p8est_conn_edge_info_t *)
-        sc_hash_array_insert_unique (edge_ha, &eikey, &pz);
-      P4EST_ASSERT (conn->tree_to_edge[P8EST_EDGES * treeid + edge] == -1);
-      if (ei != NULL) {
-        /* added ei to hash array as the first of an edge group */
-        P4EST_ASSERT (sc_array_position (&edge_ha->a, ei) == pz);
-        memcpy (ei->key, eikey.key, 2 * sizeof (p4est_topidx_t));
-        ei->edgeid = -1;
-        sc_array_init (&ei->trees, sizeof (p4est_topidx_t));
-        sc_array_init (&ei->edges, sizeof (int8_t));
+    for (i = 0; i < P8EST_EDGES; ++i) {
+      tz = (size_t) P8EST_EDGES * jt + i;
+      p8est_find_edge_transform (conn, jt, i, &ei);
+      sc_array_push_count (&tr->edge_transforms, ei.edge_transforms.elem_count);
+      tr->edge_offset[tz + 1] = tr->edge_transforms.elem_count;
+      if (ei.edge_transforms.elem_count > 0) {
+        memcpy (sc_array_index (&tr->edge_transforms, tr->edge_offset[tz]),
+                ei.edge_transforms.array, ei.edge_transforms.elem_count *
+                sizeof (p8est_edge_transform_t));
       }
-      else {
-        /* this edge has been found before */
-        ei = (p8est_conn_edge_info_t *) sc_array_index (&edge_ha->a, pz);
-        P4EST_ASSERT (p8est_conn_edge_equal (ei->key, eikey.key, NULL));
-        P4EST_ASSERT (ei->trees.elem_count == ei->edges.elem_count);
-        if (ei->trees.elem_count == 1) {
-          /* store number of this real edge and fill previous tree */
-          P4EST_ASSERT (ei->edgeid == -1);
-          ei->edgeid = real_edges++;
-          ept = (p4est_topidx_t *) sc_array_push (&edge_to_pz);
-          *ept = (p4est_topidx_t) pz;
-          pt = (p4est_topidx_t *) sc_array_index (&ei->trees, 0);
-          P4EST_ASSERT (0 <= *pt && *pt < conn->num_trees);
-          et = (int8_t *) sc_array_index (&ei->edges, 0);
-          P4EST_ASSERT (0 <= *et && *et < P8EST_EDGES);
-          P4EST_ASSERT (conn->tree_to_edge[P8EST_EDGES * *pt + *et] == -1);
-          conn->tree_to_edge[P8EST_EDGES * *pt + *et] = ei->edgeid;
-          ett_count += 2;
-        }
-        else {
-          /* check that edge is initialized */
-          P4EST_ASSERT (ei->trees.elem_count > 1);
-          P4EST_ASSERT (0 <= ei->edgeid && ei->edgeid < real_edges);
-          ++ett_count;
-        }
-        conn->tree_to_edge[P8EST_EDGES * treeid + edge] = ei->edgeid;
+    }
+#endif
+    for (i = 0; i < P4EST_CHILDREN; ++i) {
+      tz = (size_t) P4EST_CHILDREN * jt + i;
+      p4est_find_corner_transform (conn, jt, i, &ci);
+      sc_array_push_count (&tr->corner_transforms,
+                           ci.corner_transforms.elem_count);
+      tr->corner_offset[tz + 1] = tr->corner_transforms.elem_count;
+      if (ci.corner_transforms.elem_count > 0) {
+        memcpy (sc_array_index (&tr->corner_transforms,
+                                tr->corner_offset[tz]),
+                ci.corner_transforms.array, ci.corner_transforms.elem_count *
+                sizeof (p4est_corner_transform_t));
       }
+    }
+  }
+  sc_array_reset (&ci.corner_transforms);
+#ifdef P4_TO_P8
+  sc_array_reset (&ei.edge_transforms);
+#endif
 
-      /* store edge information */
-      pt = (p4est_topidx_t *) sc_array_push (&ei->trees);
-      *pt = treeid;
-      et = (int8_t *) sc_array_push (&ei->edges);
-      *et = (int8_t) edge;
-    }
-#endif
-    for (corner = 0; corner < P4EST_CHILDREN; ++corner) {
-      nodeid = ttv[corner];
-      P4EST_ASSERT (0 <= nodeid && nodeid < conn->num_vertices);
-      nt = node_trees + nodeid;
-      nc = node_corners + nodeid;
-      zcount = nt->elem_count;
-      P4EST_ASSERT (zcount == nc->elem_count);
-      if (zcount == 1) {
-        ctt_count += 2;
-      }
-      else if (zcount > 1) {
-        ++ctt_count;
-      }
-      P4EST_ASSERT (conn->tree_to_corner[P4EST_CHILDREN * treeid + corner] ==
-                    -1);
-      conn->tree_to_corner[P4EST_CHILDREN * treeid + corner] = nodeid;
-      pt = (p4est_topidx_t *) sc_array_push (nt);
-      *pt = treeid;
-      ct = (int8_t *) sc_array_push (nc);
-      *ct = (int8_t) corner;
+  conn->transforms = tr;
+}
+
+void
+p4est_connectivity_complete (p4est_connectivity_t * conn)
+{
+  const p4est_topidx_t num_trees = conn->num_trees;
+  const p4est_topidx_t num_vertices = conn->num_vertices;
+  const size_t        num_tfaces = (size_t) P4EST_FACES * num_trees;
+  const size_t        num_tcorners = (size_t) P4EST_CHILDREN * num_trees;
+#ifdef P4EST_ENABLE_OPENMP
+  int                 num_threads;
+#endif
+  long                lz;
+  size_t              zz;
+  p4est_topidx_t      tt, nodeid;
+  p4est_topidx_t      offset, count;
+  p4est_topidx_t      ctt_offset;
+  p4est_topidx_t     *fkeys;
+  int8_t             *keep;
+#ifdef P4_TO_P8
+  const size_t        num_tedges = (size_t) P8EST_EDGES * num_trees;
+  p4est_topidx_t      edgeid, real_edges;
+  p4est_topidx_t      ett_offset;
+  p4est_topidx_t     *ekeys, *estart;
+#endif
+
+  P4EST_ASSERT (p4est_connectivity_is_valid (conn));
+  p4est_connectivity_transforms_drop (conn);
+#ifdef P4EST_ENABLE_OPENMP
+  num_threads = p4est_get_num_threads ();
+#endif
+
+  /* sort all tree faces by their vertices to identify connections */
+  fkeys = P4EST_ALLOC (p4est_topidx_t, (P4EST_HALF + 1) * num_tfaces);
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_threads) schedule (static)
+#endif
+  for (lz = 0; lz < (long) num_trees; ++lz) {
+    int                 face;
+    p4est_topidx_t     *fk = fkeys + (P4EST_HALF + 1) * P4EST_FACES * lz;
+
+    for (face = 0; face < P4EST_FACES; ++face) {
+      p4est_conn_face_key (fk, conn->tree_to_vertex + P4EST_CHILDREN * lz,
+                           face);
+      fk[P4EST_HALF] = (p4est_topidx_t) (P4EST_FACES * lz + face);
+      fk += P4EST_HALF + 1;
     }
-    ttv += P4EST_CHILDREN;
   }
+  p4est_conn_sort_keys (fkeys, num_tfaces, P4EST_HALF, num_vertices);
+
+  /* connect each pair of faces, the first belonging to the lower tree */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_threads) schedule (static)
+#endif
+  for (lz = 0; lz < (long) num_tfaces; ++lz) {
+    int                 r, j;
+    int                 primary, secondary;
+    int                 corner, faces[2];
+    p4est_topidx_t      trees[2];
+    p4est_topidx_t      node, ft;
+    const p4est_topidx_t *whichttv[2];
+
+    if (!p4est_conn_key_is_first (fkeys, P4EST_HALF, (size_t) lz) ||
+        p4est_conn_key_run (fkeys, num_tfaces, P4EST_HALF,
+                            (size_t) lz) == 1) {
+      /* single faces are on the boundary and need not be changed */
+      continue;
+    }
+    P4EST_ASSERT (p4est_conn_key_run (fkeys, num_tfaces, P4EST_HALF,
+                                      (size_t) lz) == 2);
+    for (j = 0; j < 2; ++j) {
+      ft = fkeys[(P4EST_HALF + 1) * (lz + j) + P4EST_HALF];
+      trees[j] = ft / P4EST_FACES;
+      faces[j] = (int) (ft % P4EST_FACES);
+      whichttv[j] = conn->tree_to_vertex + P4EST_CHILDREN * trees[j];
+    }
 
-  /* single faces are on the boundary and need not be changed */
-  sc_hash_array_destroy (face_ha);
+    /* find primary face and orientation to store it */
+    primary = (faces[0] <= faces[1] ? 0 : 1);
+    secondary = 1 - primary;
+    node = whichttv[primary][p4est_face_corners[faces[primary]][0]];
+    for (r = 0; r < P4EST_HALF; ++r) {
+      corner = p4est_face_corners[faces[secondary]][r];
+      if (node == whichttv[secondary][corner]) {
+        break;
+      }
+    }
+    P4EST_ASSERT (r < P4EST_HALF);
+    for (j = 0; j < 2; ++j) {
+      ft = P4EST_FACES * trees[j] + faces[j];
+      conn->tree_to_tree[ft] = trees[1 - j];
+      conn->tree_to_face[ft] = (int8_t) (P4EST_FACES * r + faces[1 - j]);
+    }
+  }
+  P4EST_FREE (fkeys);
 
-  /* complete edge identification */
 #ifdef P4_TO_P8
-  P4EST_ASSERT (edge_to_pz.elem_count == (size_t) real_edges);
-  conn->num_edges = real_edges;
-  conn->ett_offset = P4EST_ALLOC (p4est_topidx_t, conn->num_edges + 1);
-  conn->edge_to_tree = P4EST_ALLOC (p4est_topidx_t, ett_count);
-  conn->edge_to_edge = P4EST_ALLOC (int8_t, ett_count);
-  sc_hash_array_rip (edge_ha, &edge_array);
-  ett_edge = 0;
-  ett_offset = 0;
+  /* sort all tree edges by their vertices to identify connections */
+  ekeys = P4EST_ALLOC (p4est_topidx_t, 3 * num_tedges);
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_threads) schedule (static)
+#endif
+  for (lz = 0; lz < (long) num_trees; ++lz) {
+    int                 edge;
+    p4est_topidx_t     *ek = ekeys + 3 * P8EST_EDGES * lz;
+
+    for (edge = 0; edge < P8EST_EDGES; ++edge) {
+      p8est_conn_edge_key (ek, conn->tree_to_vertex + P4EST_CHILDREN * lz,
+                           edge);
+      ek[2] = (p4est_topidx_t) (P8EST_EDGES * lz + edge);
+      ek += 3;
+    }
+  }
+  p4est_conn_sort_keys (ekeys, num_tedges, 2, num_vertices);
+
+  /* number shared edges in the order of their second tree edge */
+  estart = P4EST_ALLOC (p4est_topidx_t, num_tedges);
+  memset (estart, -1, num_tedges * sizeof (p4est_topidx_t));
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_threads) schedule (static)
+#endif
+  for (lz = 0; lz < (long) num_tedges - 1; ++lz) {
+    if (p4est_conn_key_is_first (ekeys, 2, (size_t) lz) &&
+        !p4est_conn_key_is_first (ekeys, 2, (size_t) lz + 1)) {
+      estart[ekeys[3 * (lz + 1) + 2]] = (p4est_topidx_t) lz;
+    }
+  }
   real_edges = 0;
+  for (tt = 0; tt < (p4est_topidx_t) num_tedges; ++tt) {
+    if (estart[tt] >= 0) {
+      estart[real_edges++] = estart[tt];
+    }
+  }
 
-  /* loop through all connected edges */
-  for (ez = 0; ez < edge_to_pz.elem_count; ++ez) {
-    ept = (p4est_topidx_t *) sc_array_index (&edge_to_pz, ez);
-    ei = (p8est_conn_edge_info_t *) sc_array_index (&edge_array, *ept);
-    P4EST_ASSERT (ei->trees.elem_count > 1);
-    P4EST_ASSERT (ei->trees.elem_count == ei->edges.elem_count);
-    P4EST_ASSERT (0 <= ei->edgeid && ei->edgeid < conn->num_edges);
-    P4EST_ASSERT ((size_t) ei->edgeid == ez);
-
-    /* set up edge connection information */
-    for (egz = 0; egz < ei->trees.elem_count; ++egz) {
-      pt = (p4est_topidx_t *) sc_array_index (&ei->trees, egz);
-      et = (int8_t *) sc_array_index (&ei->edges, egz);
-      P4EST_ASSERT (0 <= *pt && *pt < conn->num_trees);
-      P4EST_ASSERT (0 <= *et && *et < P8EST_EDGES);
-      P4EST_ASSERT (conn->tree_to_edge[P8EST_EDGES * *pt + *et]
-                    == ei->edgeid);
-      if (real_edges > 0) {
-        conn->tree_to_edge[P8EST_EDGES * *pt + *et] -= real_edges;
-      }
+  /* list the tree edges of every shared edge in the order of the trees */
+  P4EST_FREE (conn->tree_to_edge);
+  P4EST_FREE (conn->ett_offset);
+  P4EST_FREE (conn->edge_to_tree);
+  P4EST_FREE (conn->edge_to_edge);
+  conn->tree_to_edge = P4EST_ALLOC (p4est_topidx_t, num_tedges);
+  memset (conn->tree_to_edge, -1, num_tedges * sizeof (p4est_topidx_t));
+  conn->ett_offset = P4EST_ALLOC (p4est_topidx_t, real_edges + 1);
+  ett_offset = 0;
+  for (edgeid = 0; edgeid < real_edges; ++edgeid) {
+    conn->ett_offset[edgeid] = ett_offset;
+    ett_offset += (p4est_topidx_t)
+      p4est_conn_key_run (ekeys, num_tedges, 2, (size_t) estart[edgeid]);
+  }
+  conn->ett_offset[real_edges] = ett_offset;
+  conn->edge_to_tree = P4EST_ALLOC (p4est_topidx_t, ett_offset);
+  conn->edge_to_edge = P4EST_ALLOC (int8_t, ett_offset);
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_threads) schedule (static)
+#endif
+  for (lz = 0; lz < (long) real_edges; ++lz) {
+    int                 edge, j;
+    const p4est_topidx_t *ek = ekeys + 3 * estart[lz];
+    p4est_topidx_t      et, etree, enode[2];
+
+    for (et = conn->ett_offset[lz]; et < conn->ett_offset[lz + 1];
+         ++et, ek += 3) {
+      etree = ek[2] / P8EST_EDGES;
+      edge = (int) (ek[2] % P8EST_EDGES);
       for (j = 0; j < 2; ++j) {
-        enode[j] = conn->tree_to_vertex[P4EST_CHILDREN * *pt
-                                        + p8est_edge_corners[*et][j]];
+        enode[j] = conn->tree_to_vertex[P4EST_CHILDREN * etree
+                                        + p8est_edge_corners[edge][j]];
       }
       P4EST_ASSERT (enode[0] != enode[1]);
-      conn->edge_to_tree[ett_offset + egz] = *pt;
-      conn->edge_to_edge[ett_offset + egz] =
-        *et + (enode[0] < enode[1] ? 0 : P8EST_EDGES);
-    }
-    ei->edgeid -= real_edges;
-
-    /* determine if this edge is redundant */
-    for (egz = 0; egz < ei->trees.elem_count; ++egz) {
-      pt = (p4est_topidx_t *) sc_array_index (&ei->trees, egz);
-      et = (int8_t *) sc_array_index (&ei->edges, egz);
-      einfo.iedge = -1;         /* unused */
-      p8est_find_edge_transform_internal (conn, *pt, *et, &einfo,
-                                          conn->edge_to_tree +
-                                          ett_offset,
-                                          conn->edge_to_edge +
-                                          ett_offset, ei->trees.elem_count);
-      if (eta->elem_count != 0) {
-        /* edge is non-redundant */
-        break;
-      }
+      conn->edge_to_tree[et] = etree;
+      conn->edge_to_edge[et] =
+        (int8_t) (edge + (enode[0] < enode[1] ? 0 : P8EST_EDGES));
     }
+  }
+  P4EST_FREE (estart);
+  P4EST_FREE (ekeys);
 
-    if (eta->elem_count == 0) {
-      /* erase all references to this redundant edge */
-      for (egz = 0; egz < ei->trees.elem_count; ++egz) {
-        pt = (p4est_topidx_t *) sc_array_index (&ei->trees, egz);
-        et = (int8_t *) sc_array_index (&ei->edges, egz);
-        P4EST_ASSERT (conn->tree_to_edge[P8EST_EDGES * *pt + *et]
-                      == ei->edgeid);
-        conn->tree_to_edge[P8EST_EDGES * *pt + *et] = -1;
+  /* determine which edges are not redundant with the face connections */
+  keep = P4EST_ALLOC (int8_t, real_edges);
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel num_threads (num_threads)
+#endif
+  {
+    p4est_topidx_t      et, ettae, edge_trees;
+    p8est_edge_info_t   einfo;
+    sc_array_t         *eta = &einfo.edge_transforms;
+
+    sc_array_init (eta, sizeof (p8est_edge_transform_t));
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp for schedule (dynamic, 64)
+#endif
+    for (lz = 0; lz < (long) real_edges; ++lz) {
+      ettae = conn->ett_offset[lz];
+      edge_trees = conn->ett_offset[lz + 1] - ettae;
+      keep[lz] = 0;
+      for (et = ettae; et < ettae + edge_trees; ++et) {
+        einfo.iedge = -1;       /* unused */
+        p8est_find_edge_transform_internal (conn, conn->edge_to_tree[et],
+                                            conn->edge_to_edge[et] %
+                                            P8EST_EDGES, &einfo,
+                                            conn->edge_to_tree + ettae,
+                                            conn->edge_to_edge + ettae,
+                                            edge_trees);
+        if (eta->elem_count != 0) {
+          /* edge is non-redundant */
+          sc_array_resize (eta, 0);
+          keep[lz] = 1;
+          break;
+        }
       }
-      ei->edgeid = -1;
-      ++real_edges;
-    }
-    else {
-      /* accept edge as non-redundant */
-      sc_array_reset (eta);
-      conn->ett_offset[ett_edge++] = ett_offset;
-      ett_offset += (p4est_topidx_t) ei->trees.elem_count;
-    }
-  }
-  sc_array_reset (&edge_to_pz);
-  P4EST_ASSERT (ett_edge == conn->num_edges - real_edges);
-  P4EST_ASSERT (ett_offset <= ett_count);
-  conn->ett_offset[ett_edge] = ett_offset;
-  if (real_edges > 0) {
-    conn->num_edges -= real_edges;
-    conn->ett_offset = P4EST_REALLOC (conn->ett_offset, p4est_topidx_t,
-                                      conn->num_edges + 1);
-    conn->edge_to_tree =
-      P4EST_REALLOC (conn->edge_to_tree, p4est_topidx_t, ett_offset);
-    conn->edge_to_edge =
-      P4EST_REALLOC (conn->edge_to_edge, int8_t, ett_offset);
-  }
-  /* clean up storage for all edges */
-  for (ez = 0; ez < edge_array.elem_count; ++ez) {
-    ei = (p8est_conn_edge_info_t *) sc_array_index (&edge_array, ez);
-    P4EST_ASSERT (ei->trees.elem_count >= 1);
-    P4EST_ASSERT (ei->trees.elem_count == ei->edges.elem_count);
-    P4EST_ASSERT (-1 <= ei->edgeid && ei->edgeid < conn->num_edges);
-#ifdef P4EST_ENABLE_DEBUG
-    if (ei->trees.elem_count == 1) {
-      /* isolated edge does not count */
-      P4EST_ASSERT (ei->edgeid == -1);
-      pt = (p4est_topidx_t *) sc_array_index (&ei->trees, 0);
-      et = (int8_t *) sc_array_index (&ei->edges, 0);
-      P4EST_ASSERT (0 <= *pt && *pt < conn->num_trees);
-      P4EST_ASSERT (0 <= *et && *et < P8EST_EDGES);
-      P4EST_ASSERT (conn->tree_to_edge[P8EST_EDGES * *pt + *et] == -1);
     }
-#endif
-    sc_array_reset (&ei->trees);
-    sc_array_reset (&ei->edges);
+    sc_array_reset (eta);
   }
-  sc_array_reset (&edge_array);
+
+  /* number the remaining edges consecutively and compact their storage;
+     we never overwrite an offset that is still to be read */
+  conn->num_edges = 0;
+  ett_offset = 0;
+  for (edgeid = 0; edgeid < real_edges; ++edgeid) {
+    if (!keep[edgeid]) {
+      continue;
+    }
+    offset = conn->ett_offset[edgeid];
+    count = conn->ett_offset[edgeid + 1] - offset;
+    if (ett_offset < offset) {
+      memmove (conn->edge_to_tree + ett_offset, conn->edge_to_tree + offset,
+               count * sizeof (p4est_topidx_t));
+      memmove (conn->edge_to_edge + ett_offset, conn->edge_to_edge + offset,
+               count * sizeof (int8_t));
+    }
+    for (tt = ett_offset; tt < ett_offset + count; ++tt) {
+      conn->tree_to_edge[P8EST_EDGES * conn->edge_to_tree[tt] +
+                         conn->edge_to_edge[tt] % P8EST_EDGES] =
+        conn->num_edges;
+    }
+    conn->ett_offset[conn->num_edges++] = ett_offset;
+    ett_offset += count;
+  }
+  conn->ett_offset[conn->num_edges] = ett_offset;
+  P4EST_FREE (keep);
+  conn->ett_offset = P4EST_REALLOC (conn->ett_offset, p4est_topidx_t,
+                                    conn->num_edges + 1);
+  conn->edge_to_tree =
+    P4EST_REALLOC (conn->edge_to_tree, p4est_topidx_t, ett_offset);
+  conn->edge_to_edge = P4EST_REALLOC (conn->edge_to_edge, int8_t, ett_offset);
 #endif /* P4_TO_P8 */
 
-  /* complete corner identification */
-  P4EST_ASSERT (real_corners == 0);
-  conn->num_corners = conn->num_vertices;
-  conn->ctt_offset = P4EST_ALLOC (p4est_topidx_t, conn->num_corners + 1);
-  conn->corner_to_tree = P4EST_ALLOC (p4est_topidx_t, ctt_count);
-  conn->corner_to_corner = P4EST_ALLOC (int8_t, ctt_count);
-  ctt_corner = 0;
+  /* sort the tree corners by vertex, each vertex in the order of the trees */
+  P4EST_FREE (conn->tree_to_corner);
+  P4EST_FREE (conn->ctt_offset);
+  P4EST_FREE (conn->corner_to_tree);
+  P4EST_FREE (conn->corner_to_corner);
+  conn->tree_to_corner = P4EST_ALLOC (p4est_topidx_t, num_tcorners);
+  memset (conn->tree_to_corner, -1, num_tcorners * sizeof (p4est_topidx_t));
+  conn->ctt_offset = P4EST_ALLOC_ZERO (p4est_topidx_t, num_vertices + 1);
+  conn->corner_to_tree = P4EST_ALLOC (p4est_topidx_t, num_tcorners);
+  conn->corner_to_corner = P4EST_ALLOC (int8_t, num_tcorners);
+  for (zz = 0; zz < num_tcorners; ++zz) {
+    nodeid = conn->tree_to_vertex[zz];
+    P4EST_ASSERT (0 <= nodeid && nodeid < num_vertices);
+    ++conn->ctt_offset[nodeid];
+  }
   ctt_offset = 0;
-  for (nodeid = 0; nodeid < conn->num_vertices; ++nodeid) {
-    nt = node_trees + nodeid;
-    nc = node_corners + nodeid;
-    zcount = nt->elem_count;
-    P4EST_ASSERT (zcount == nc->elem_count);
-    if (zcount <= 1) {
-      /* isolated corner does not count */
-      if (zcount == 1) {
-        pt = (p4est_topidx_t *) sc_array_index (nt, 0);
-        ct = (int8_t *) sc_array_index (nc, 0);
-        P4EST_ASSERT (0 <= *pt && *pt < conn->num_trees);
-        P4EST_ASSERT (0 <= *ct && *ct < P4EST_CHILDREN);
-        P4EST_ASSERT (conn->tree_to_corner[P4EST_CHILDREN * *pt + *ct] ==
-                      nodeid);
-        conn->tree_to_corner[P4EST_CHILDREN * *pt + *ct] = -1;
-      }
-      ++real_corners;
-    }
-    else {
-      /* set up corner connection information */
-      for (pz = 0; pz < zcount; ++pz) {
-        pt = (p4est_topidx_t *) sc_array_index (nt, pz);
-        ct = (int8_t *) sc_array_index (nc, pz);
-        P4EST_ASSERT (0 <= *pt && *pt < conn->num_trees);
-        P4EST_ASSERT (0 <= *ct && *ct < P4EST_CHILDREN);
-        P4EST_ASSERT (conn->tree_to_corner[P4EST_CHILDREN * *pt + *ct]
-                      == nodeid);
-        if (real_corners > 0) {
-          conn->tree_to_corner[P4EST_CHILDREN * *pt + *ct] -= real_corners;
-        }
-        conn->corner_to_tree[ctt_offset + pz] = *pt;
-        conn->corner_to_corner[ctt_offset + pz] = *ct;
-      }
+  for (nodeid = 0; nodeid <= num_vertices; ++nodeid) {
+    count = conn->ctt_offset[nodeid];
+    conn->ctt_offset[nodeid] = ctt_offset;
+    ctt_offset += count;
+  }
+  P4EST_ASSERT ((size_t) ctt_offset == num_tcorners);
+  for (zz = 0; zz < num_tcorners; ++zz) {
+    tt = conn->ctt_offset[conn->tree_to_vertex[zz]]++;
+    conn->corner_to_tree[tt] = (p4est_topidx_t) (zz / P4EST_CHILDREN);
+    conn->corner_to_corner[tt] = (int8_t) (zz % P4EST_CHILDREN);
+  }
+  memmove (conn->ctt_offset + 1, conn->ctt_offset,
+           num_vertices * sizeof (p4est_topidx_t));
+  conn->ctt_offset[0] = 0;
+
+  /* determine which corners are not redundant with faces and edges */
+  keep = P4EST_ALLOC (int8_t, num_vertices);
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel num_threads (num_threads)
+#endif
+  {
+    p4est_topidx_t      ct, cttac, corner_trees;
+    p4est_corner_info_t cinfo;
+    sc_array_t         *cta = &cinfo.corner_transforms;
 
-      /* determine if this corner is redundant */
-      for (pz = 0; pz < zcount; ++pz) {
-        pt = (p4est_topidx_t *) sc_array_index (nt, pz);
-        ct = (int8_t *) sc_array_index (nc, pz);
+    sc_array_init (cta, sizeof (p4est_corner_transform_t));
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp for schedule (dynamic, 64)
+#endif
+    for (lz = 0; lz < (long) num_vertices; ++lz) {
+      cttac = conn->ctt_offset[lz];
+      corner_trees = conn->ctt_offset[lz + 1] - cttac;
+      keep[lz] = 0;
+      if (corner_trees <= 1) {
+        /* isolated corner does not count */
+        continue;
+      }
+      for (ct = cttac; ct < cttac + corner_trees; ++ct) {
         cinfo.icorner = -1;     /* unused */
         (void)
-          p4est_find_corner_transform_internal (conn, *pt, *ct, &cinfo,
-                                                conn->corner_to_tree +
-                                                ctt_offset,
+          p4est_find_corner_transform_internal (conn, conn->corner_to_tree[ct],
+                                                conn->corner_to_corner[ct],
+                                                &cinfo,
+                                                conn->corner_to_tree + cttac,
                                                 conn->corner_to_corner +
-                                                ctt_offset, zcount);
+                                                cttac, corner_trees);
         if (cta->elem_count != 0) {
           /* corner is non-redundant */
+          sc_array_resize (cta, 0);
+          keep[lz] = 1;
           break;
         }
       }
-
-      if (cta->elem_count == 0) {
-        /* erase all references to this redundant corner */
-        for (pz = 0; pz < zcount; ++pz) {
-          pt = (p4est_topidx_t *) sc_array_index (nt, pz);
-          ct = (int8_t *) sc_array_index (nc, pz);
-          P4EST_ASSERT (conn->tree_to_corner[P4EST_CHILDREN * *pt + *ct]
-                        == nodeid - real_corners);
-          conn->tree_to_corner[P4EST_CHILDREN * *pt + *ct] = -1;
-        }
-        ++real_corners;
-      }
-      else {
-        /* accept corner as non-redundant */
-        sc_array_reset (cta);
-        conn->ctt_offset[ctt_corner++] = ctt_offset;
-        ctt_offset += (p4est_topidx_t) zcount;
-      }
     }
+    sc_array_reset (cta);
   }
-  P4EST_ASSERT (ctt_corner == conn->num_corners - real_corners);
-  P4EST_ASSERT (ctt_offset <= ctt_count);
-  conn->ctt_offset[ctt_corner] = ctt_offset;
-  if (real_corners > 0) {
-    conn->num_corners -= real_corners;
-    conn->ctt_offset = P4EST_REALLOC (conn->ctt_offset, p4est_topidx_t,
-                                      conn->num_corners + 1);
-    conn->corner_to_tree =
-      P4EST_REALLOC (conn->corner_to_tree, p4est_topidx_t, ctt_offset);
-    conn->corner_to_corner =
-      P4EST_REALLOC (conn->corner_to_corner, int8_t, ctt_offset);
-  }
-  /* clean up storage for all corners */
-  for (nodeid = 0; nodeid < conn->num_vertices; ++nodeid) {
-    sc_array_reset (node_trees + nodeid);
-    sc_array_reset (node_corners + nodeid);
-  }
-  P4EST_FREE (node_trees);
-  P4EST_FREE (node_corners);
+
+  /* number the remaining corners consecutively and compact their storage;
+     we never overwrite an offset that is still to be read */
+  conn->num_corners = 0;
+  ctt_offset = 0;
+  for (nodeid = 0; nodeid < num_vertices; ++nodeid) {
+    if (!keep[nodeid]) {
+      continue;
+    }
+    offset = conn->ctt_offset[nodeid];
+    count = conn->ctt_offset[nodeid + 1] - offset;
+    if (ctt_offset < offset) {
+      memmove (conn->corner_to_tree + ctt_offset,
+               conn->corner_to_tree + offset,
+               count * sizeof (p4est_topidx_t));
+      memmove (conn->corner_to_corner + ctt_offset,
+               conn->corner_to_corner + offset, count * sizeof (int8_t));
+    }
+    for (tt = ctt_offset; tt < ctt_offset + count; ++tt) {
+      conn->tree_to_corner[P4EST_CHILDREN * conn->corner_to_tree[tt] +
+                           conn->corner_to_corner[tt]] = conn->num_corners;
+    }
+    conn->ctt_offset[conn->num_corners++] = ctt_offset;
+    ctt_offset += count;
+  }
+  conn->ctt_offset[conn->num_corners] = ctt_offset;
+  P4EST_FREE (keep);
+  conn->ctt_offset = P4EST_REALLOC (conn->ctt_offset, p4est_topidx_t,
+                                    conn->num_corners + 1);
+  conn->corner_to_tree =
+    P4EST_REALLOC (conn->corner_to_tree, p4est_topidx_t, ctt_offset);
+  conn->corner_to_corner =
+    P4EST_REALLOC (conn->corner_to_corner, int8_t, ctt_offset);
 
   /* and be done */
   P4EST_ASSERT (p4est_connectivity_is_valid (conn));
@@ -3707,6 +5450,7 @@ p4est_connectivity_complete (p4est_connectivity_t * conn)
 void
 p4est_connectivity_reduce (p4est_connectivity_t * conn)
 {
+  p4est_connectivity_transforms_drop (conn);
   conn->num_corners = 0;
   conn->ctt_offset[conn->num_corners] = 0;
   P4EST_FREE (conn->tree_to_corner);
@@ -3739,6 +5483,8 @@ p4est_connectivity_permute (p4est_connectivity_t * conn, sc_array_t * inperm,
   sc_array_t          array_view;
   int                 j;
 
+  p4est_connectivity_transforms_drop (conn);
+
   /* we want the permutation to be the current to new map, not
    * the new to current map */
   if (is_current_to_new) {
@@ -3818,6 +5564,13 @@ p4est_connectivity_permute (p4est_connectivity_t * conn, sc_array_t * inperm,
     sc_array_permute (&array_view, permarray, 1);
   }
 
+  /* tree_to_attr */
+  if (conn->tree_to_attr != NULL) {
+    sc_array_init_data (&array_view, conn->tree_to_attr,
+                        conn->tree_attr_bytes, ntrees);
+    sc_array_permute (&array_view, permarray, 1);
+  }
+
   P4EST_ASSERT (p4est_connectivity_is_valid (conn));
 
   if (!is_current_to_new) {
@@ -3825,6 +5578,152 @@ p4est_connectivity_permute (p4est_connectivity_t * conn, sc_array_t * inperm,
   }
 }
 
+/** Sort key of a tree in p4est_connectivity_reorder_sfc. */
+typedef struct p4est_reorder_sfc_key
+{
+  uint64_t            key;
+  size_t              tree;
+}
+p4est_reorder_sfc_key_t;
+
+static int
+p4est_reorder_sfc_compare (const void *a, const void *b)
+{
+  const p4est_reorder_sfc_key_t *A = (const p4est_reorder_sfc_key_t *) a;
+  const p4est_reorder_sfc_key_t *B = (const p4est_reorder_sfc_key_t *) b;
+
+  if (A->key != B->key) {
+    return A->key < B->key ? -1 : 1;
+  }
+  return A->tree < B->tree ? -1 : A->tree > B->tree ? 1 : 0;
+}
+
+/** Compute the centroid of a tree from its corner vertices. */
+static void
+p4est_reorder_sfc_centroid (p4est_connectivity_t * conn, p4est_topidx_t tt,
+                            double xyz[3])
+{
+  int                 c, j;
+  double              v[3];
+
+  xyz[0] = xyz[1] = xyz[2] = 0.;
+  for (c = 0; c < P4EST_CHILDREN; ++c) {
+    p4est_connectivity_tree_vertex (conn, tt, c, v);
+    for (j = 0; j < 3; ++j) {
+      xyz[j] += v[j] / P4EST_CHILDREN;
+    }
+  }
+}
+
+sc_array_t         *
+p4est_connectivity_reorder_sfc (sc_MPI_Comm comm,
+                                p4est_connectivity_t * conn,
+                                sc_array_t * newid)
+{
+  const p4est_topidx_t num_trees = conn->num_trees;
+  int                 mpiret, num_procs, rank;
+  int                 p, j;
+  int                *counts, *displs;
+  double              xyz[3], lo[3], hi[3], scale;
+  uint64_t           *keys, *local_keys;
+  p4est_topidx_t      tt, first, last;
+  p4est_quadrant_t    q;
+  p4est_qcoord_t      coord[3];
+  p4est_reorder_sfc_key_t *sk;
+  sc_array_t         *sorter;
+  size_t              zz;
+
+  P4EST_ASSERT (p4est_connectivity_is_valid (conn));
+  P4EST_ASSERT (newid == NULL || newid->elem_size == sizeof (size_t));
+  SC_CHECK_ABORT (conn->num_vertices > 0 && conn->vertices != NULL,
+                  "Reordering by space filling curve requires vertices");
+
+  mpiret = sc_MPI_Comm_size (comm, &num_procs);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Comm_rank (comm, &rank);
+  SC_CHECK_MPI (mpiret);
+
+  /* the bounding box of all vertices is the same on every process */
+  for (j = 0; j < 3; ++j) {
+    lo[j] = hi[j] = conn->vertices[j];
+  }
+  for (tt = 0; tt < conn->num_vertices; ++tt) {
+    for (j = 0; j < 3; ++j) {
+      lo[j] = SC_MIN (lo[j], conn->vertices[3 * tt + j]);
+      hi[j] = SC_MAX (hi[j], conn->vertices[3 * tt + j]);
+    }
+  }
+  scale = 0.;
+  for (j = 0; j < 3; ++j) {
+    scale = SC_MAX (scale, hi[j] - lo[j]);
+  }
+  scale = scale > 0. ? 1. / scale : 0.;
+
+  /* every process computes the keys of a contiguous slice of the trees */
+  counts = P4EST_ALLOC (int, 2 * num_procs);
+  displs = counts + num_procs;
+  for (p = 0; p < num_procs; ++p) {
+    displs[p] = (int) p4est_partition_cut_gloidx (num_trees, p, num_procs);
+    counts[p] = (int) p4est_partition_cut_gloidx (num_trees, p + 1,
+                                                  num_procs) - displs[p];
+  }
+  first = (p4est_topidx_t) displs[rank];
+  last = first + (p4est_topidx_t) counts[rank];
+  local_keys = P4EST_ALLOC (uint64_t, SC_MAX (last - first, 1));
+  P4EST_QUADRANT_INIT (&q);
+  q.level = P4EST_QMAXLEVEL;
+  for (tt = first; tt < last; ++tt) {
+    p4est_reorder_sfc_centroid (conn, tt, xyz);
+    for (j = 0; j < 3; ++j) {
+      /* scale into the root at the finest quadrant level */
+      coord[j] = (p4est_qcoord_t) ((xyz[j] - lo[j]) * scale *
+                                   P4EST_ROOT_LEN);
+      coord[j] = SC_MIN (coord[j], P4EST_LAST_OFFSET (P4EST_QMAXLEVEL));
+      coord[j] &= ~(P4EST_QUADRANT_LEN (P4EST_QMAXLEVEL) - 1);
+    }
+    q.x = coord[0];
+    q.y = coord[1];
+#ifdef P4_TO_P8
+    q.z = coord[2];
+#endif
+    local_keys[tt - first] = p4est_quadrant_hilbert_id (&q, P4EST_QMAXLEVEL);
+  }
+
+  /* gather all keys to sort the trees identically everywhere */
+  keys = P4EST_ALLOC (uint64_t, SC_MAX (num_trees, 1));
+  mpiret = sc_MPI_Allgatherv (local_keys, counts[rank], sc_MPI_LONG_LONG_INT,
+                              keys, counts, displs, sc_MPI_LONG_LONG_INT,
+                              comm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (local_keys);
+  P4EST_FREE (counts);
+
+  sorter = sc_array_new_size (sizeof (p4est_reorder_sfc_key_t),
+                              (size_t) num_trees);
+  for (zz = 0; zz < (size_t) num_trees; ++zz) {
+    sk = (p4est_reorder_sfc_key_t *) sc_array_index (sorter, zz);
+    sk->key = keys[zz];
+    sk->tree = zz;
+  }
+  P4EST_FREE (keys);
+  sc_array_sort (sorter, p4est_reorder_sfc_compare);
+
+  /* the jth tree in curve order receives the new index j */
+  if (newid == NULL) {
+    newid = sc_array_new (sizeof (size_t));
+  }
+  sc_array_resize (newid, (size_t) num_trees);
+  for (zz = 0; zz < (size_t) num_trees; ++zz) {
+    sk = (p4est_reorder_sfc_key_t *) sc_array_index (sorter, zz);
+    *(size_t *) sc_array_index (newid, sk->tree) = zz;
+  }
+  sc_array_destroy (sorter);
+
+  p4est_connectivity_permute (conn, newid, 1);
+
+  return newid;
+}
+
 #ifdef P4EST_WITH_METIS
 
 static int
@@ -4292,6 +6191,7 @@ p4est_connectivity_join_corners (p4est_connectivity_t * conn,
   P4EST_ASSERT (tree_right >= 0 && tree_right < conn->num_trees);
   P4EST_ASSERT (corner_left >= 0 && corner_left < P4EST_CHILDREN);
   P4EST_ASSERT (corner_right >= 0 && corner_right < P4EST_CHILDREN);
+  p4est_connectivity_transforms_drop (conn);
 
   /* it could be that the current connectivity did not store corner information,
    * because all of the corners are simple enough that they can be figured out
@@ -4383,6 +6283,8 @@ p8est_connectivity_join_edges (p8est_connectivity_t * conn,
   P4EST_ASSERT (tree_right >= 0 && tree_right < conn->num_trees);
   P4EST_ASSERT (edge_left >= 0 && edge_left < P8EST_EDGES);
   P4EST_ASSERT (edge_right >= 0 && edge_right < P8EST_EDGES);
+  p4est_connectivity_transforms_drop (conn);
+
   for (i = 0; i < 2; i++) {
     /* get matching corners */
     c_left = p8est_edge_corners[edge_left][i];
@@ -4502,6 +6404,7 @@ p4est_connectivity_join_faces (p4est_connectivity_t * conn,
                 (int8_t) face_left);
   P4EST_ASSERT (conn->tree_to_face[P4EST_FACES * tree_right + face_right] ==
                 (int8_t) face_right);
+  p4est_connectivity_transforms_drop (conn);
 
 #ifdef P4_TO_P8
   /* figure out which edges are next to each other */
@@ -4757,6 +6660,10 @@ p4est_connectivity_getline_upper (FILE * stream)
       P4EST_FREE (linep);
       return NULL;
     }
+    if (c == EOF) {
+      /* the last line need not end in a newline */
+      break;
+    }
     c = toupper (c);
 
     if (--len == 0) {
@@ -4918,10 +6825,319 @@ p4est_connectivity_read_inp_stream (FILE * stream,
   }
 }
 
+/** Approximate size in bytes of the chunks an .inp buffer is parsed in. */
+#define P4EST_INP_CHUNK_SIZE (1 << 20)
+
+/** A range of whole data lines of one *NODE or *ELEMENT block. */
+typedef struct p4est_inp_chunk
+{
+  int                 is_element;       /**< Element or node lines. */
+  int                 error;    /**< Nonzero if parsing failed. */
+  size_t              begin, end;       /**< Byte range in the buffer. */
+  p4est_topidx_t      count;    /**< Number of lines in the range. */
+  p4est_topidx_t      first;    /**< Number of element lines before. */
+}
+p4est_inp_chunk_t;
+
+/** Return the position after the end of the line starting at \a pos. */
+static size_t
+p4est_inp_line_end (const char *buffer, size_t pos, size_t length)
+{
+  const char         *nl;
+
+  nl = (const char *) memchr (buffer + pos, '\n', length - pos);
+  return nl == NULL ? length : (size_t) (nl - buffer) + 1;
+}
+
+/** Classify a control line of an .inp file.
+ * \return 1 for a node block, 2 for a supported element block, else 0.
+ */
+static int
+p4est_inp_control_type (const char *line, size_t length)
+{
+  char               *upper;
+  size_t              zz;
+  int                 type = 0;
+
+  upper = P4EST_ALLOC (char, length + 1);
+  for (zz = 0; zz < length; ++zz) {
+    upper[zz] = (char) toupper ((unsigned char) line[zz]);
+  }
+  upper[length] = '\0';
+
+  if (strstr (upper, "*NODE")) {
+    type = 1;
+  }
+  else if (strstr (upper, "*ELEMENT")) {
+    if (
+#ifdef P4_TO_P8
+         strstr (upper, "TYPE=C3D8")
+#else
+         strstr (upper, "TYPE=C2D4") || strstr (upper, "TYPE=CPS4")
+         || strstr (upper, "TYPE=S4")
+#endif
+      ) {
+      type = 2;
+    }
+  }
+  P4EST_FREE (upper);
+  return type;
+}
+
+/** Advance over blanks and at most one comma before the next number. */
+static const char  *
+p4est_inp_skip (const char *s, const char *end)
+{
+  int                 comma = 0;
+
+  for (; s < end; ++s) {
+    if (*s == ',' && !comma) {
+      comma = 1;
+    }
+    else if (*s != ' ' && *s != '\t' && *s != '\r') {
+      break;
+    }
+  }
+  return s;
+}
+
+/** Parse an integer token.  \return The position after it or NULL. */
+static const char  *
+p4est_inp_integer (const char *s, const char *end, long long *value)
+{
+  long long           v = 0;
+  int                 negative = 0;
+  const char         *start;
+
+  s = p4est_inp_skip (s, end);
+  if (s < end && (*s == '-' || *s == '+')) {
+    negative = (*s++ == '-');
+  }
+  for (start = s; s < end && *s >= '0' && *s <= '9'; ++s) {
+    v = 10 * v + (*s - '0');
+  }
+  if (s == start) {
+    return NULL;
+  }
+  *value = negative ? -v : v;
+  return s;
+}
+
+/** Parse a floating point token.  \return The position after it or NULL. */
+static const char  *
+p4est_inp_double (const char *s, const char *end, double *value)
+{
+  char                token[64], *tend;
+  size_t              n = 0;
+
+  /* copy the token since the buffer need not be NUL-terminated */
+  s = p4est_inp_skip (s, end);
+  while (s + n < end && n < sizeof (token) - 1 &&
+         (isdigit ((unsigned char) s[n]) ||
+          (s[n] != '\0' && strchr ("+-.eEdD", s[n]) != NULL))) {
+    token[n] = (s[n] == 'd' || s[n] == 'D') ? 'e' : s[n];
+    ++n;
+  }
+  token[n] = '\0';
+  *value = strtod (token, &tend);
+  if (tend == token) {
+    return NULL;
+  }
+  return s + (tend - token);
+}
+
+/** Parse the lines of one chunk into the vertices or the trees.
+ * \return 0 on success, 1 on a malformed line, 2 for a vertex number out
+ *         of range and 3 if there are more elements than expected.
+ */
+static int
+p4est_inp_parse_chunk (const char *buffer, const p4est_inp_chunk_t * chunk,
+                       p4est_topidx_t num_vertices, p4est_topidx_t num_trees,
+                       double *vertices, p4est_topidx_t * tree_to_vertex)
+{
+  /* Note that when we read in the vertices we switch from right-hand
+     vertex ordering to z-order */
+#ifndef P4_TO_P8
+  const int           order[P4EST_CHILDREN] = { 0, 1, 3, 2 };
+#else
+  const int           order[P4EST_CHILDREN] = { 0, 1, 3, 2, 4, 5, 7, 6 };
+#endif
+  const char         *s, *eol, *end = buffer + chunk->end;
+  p4est_topidx_t      element = chunk->first;
+  long long           id, v;
+  double              x[3];
+  int                 n;
+
+  for (s = buffer + chunk->begin; s < end; s = eol) {
+    eol = buffer + p4est_inp_line_end (buffer, (size_t) (s - buffer),
+                                       chunk->end);
+    if ((s = p4est_inp_integer (s, eol, &id)) == NULL) {
+      return 1;
+    }
+    if (!chunk->is_element) {
+      for (n = 0; n < 3; ++n) {
+        if ((s = p4est_inp_double (s, eol, &x[n])) == NULL) {
+          return 1;
+        }
+      }
+      if (id < 1 || id > (long long) num_vertices) {
+        return 2;
+      }
+      vertices[3 * (id - 1) + 0] = x[0];
+      vertices[3 * (id - 1) + 1] = x[1];
+      vertices[3 * (id - 1) + 2] = x[2];
+    }
+    else {
+      if (element >= num_trees) {
+        return 3;
+      }
+      for (n = 0; n < P4EST_CHILDREN; ++n) {
+        if ((s = p4est_inp_integer (s, eol, &v)) == NULL) {
+          return 1;
+        }
+        tree_to_vertex[P4EST_CHILDREN * element + order[n]] =
+          (p4est_topidx_t) (v - 1);
+      }
+      ++element;
+    }
+  }
+  return 0;
+}
+
+int
+p4est_connectivity_read_inp_buffer (const char *buffer, size_t length,
+                                    p4est_topidx_t * num_vertices,
+                                    p4est_topidx_t * num_trees,
+                                    double *vertices,
+                                    p4est_topidx_t * tree_to_vertex)
+{
+  int                 type, retval;
+  long                jj, num_chunks;
+  size_t              pos, eol, stop;
+  sc_array_t         *chunks;
+  p4est_inp_chunk_t  *chunk;
+  p4est_topidx_t      num_nodes = 0;
+  p4est_topidx_t      num_elements = 0;
+  int                 fill_trees_and_vertices = (vertices != NULL &&
+                                                 tree_to_vertex != NULL);
+
+  P4EST_ASSERT ((vertices == NULL && tree_to_vertex == NULL) ||
+                (vertices != NULL && tree_to_vertex != NULL));
+  P4EST_ASSERT (buffer != NULL || length == 0);
+
+  /* find the node and element blocks and cut them into chunks of lines */
+  chunks = sc_array_new (sizeof (p4est_inp_chunk_t));
+  type = 0;
+  for (pos = 0; pos < length; pos = eol) {
+    eol = p4est_inp_line_end (buffer, pos, length);
+
+    /* check for control line */
+    if (buffer[pos] == '*') {
+      type = p4est_inp_control_type (buffer + pos, eol - pos);
+      continue;
+    }
+    if (type == 0) {
+      continue;
+    }
+
+    /* extend the data lines up to the next control line */
+    for (stop = eol; stop < length && buffer[stop] != '*';
+         stop = p4est_inp_line_end (buffer, stop, length)) {
+      if (stop - pos >= P4EST_INP_CHUNK_SIZE) {
+        break;
+      }
+    }
+    chunk = (p4est_inp_chunk_t *) sc_array_push (chunks);
+    chunk->is_element = (type == 2);
+    chunk->error = 0;
+    chunk->begin = pos;
+    chunk->end = stop;
+    eol = stop;
+  }
+  num_chunks = (long) chunks->elem_count;
+
+  /* count the lines of every chunk */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (p4est_get_num_threads ()) \
+  schedule (dynamic)
+#endif
+  for (jj = 0; jj < num_chunks; ++jj) {
+    p4est_inp_chunk_t  *c = (p4est_inp_chunk_t *)
+      sc_array_index_long (chunks, jj);
+    size_t              zz;
+
+    c->count = 0;
+    for (zz = c->begin; zz < c->end;
+         zz = p4est_inp_line_end (buffer, zz, c->end)) {
+      ++c->count;
+    }
+  }
+  for (jj = 0; jj < num_chunks; ++jj) {
+    chunk = (p4est_inp_chunk_t *) sc_array_index_long (chunks, jj);
+    chunk->first = num_elements;
+    if (chunk->is_element) {
+      num_elements += chunk->count;
+    }
+    else {
+      num_nodes += chunk->count;
+    }
+  }
+
+  /* parse the chunks independently */
+  if (fill_trees_and_vertices) {
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (p4est_get_num_threads ()) \
+  schedule (dynamic)
+#endif
+    for (jj = 0; jj < num_chunks; ++jj) {
+      p4est_inp_chunk_t  *c = (p4est_inp_chunk_t *)
+        sc_array_index_long (chunks, jj);
+
+      c->error = p4est_inp_parse_chunk (buffer, c, *num_vertices, *num_trees,
+                                        vertices, tree_to_vertex);
+    }
+    for (jj = 0; jj < num_chunks; ++jj) {
+      chunk = (p4est_inp_chunk_t *) sc_array_index_long (chunks, jj);
+      if (chunk->error == 1) {
+        P4EST_LERROR ("Premature end of file");
+      }
+      else if (chunk->error == 2) {
+        P4EST_LERRORF ("Encountered vertex that will not fit in vertices"
+                       " array of length %lld.  Are the vertices contiguously"
+                       " numbered?\n", (long long int) *num_vertices);
+      }
+      else if (chunk->error == 3) {
+        P4EST_LERROR ("Encountered element that will not fit into"
+                      " tree_to_vertex array. More elements than expected.\n");
+      }
+      if (chunk->error) {
+        sc_array_destroy (chunks);
+        return 1;
+      }
+    }
+  }
+  sc_array_destroy (chunks);
+
+  *num_vertices = num_nodes;
+  *num_trees = num_elements;
+
+  if (num_nodes == 0 || num_elements == 0) {
+    P4EST_LERROR ("No elements or nodes found in mesh file.\n");
+    retval = -1;
+  }
+  else {
+    retval = 0;
+  }
+  return retval;
+}
+
 p4est_connectivity_t *
 p4est_connectivity_read_inp (const char *filename)
 {
   int                 retval;
+  long                file_size;
+  size_t              length;
+  char               *buffer = NULL;
   p4est_topidx_t      num_vertices = 0, num_trees = 0, tree;
   int                 face;
 
@@ -4936,13 +7152,31 @@ p4est_connectivity_read_inp (const char *filename)
     goto dead;
   }
 
-  if (p4est_connectivity_read_inp_stream
-      (fid, &num_vertices, &num_trees, NULL, NULL)) {
-    P4EST_LERRORF ("Failed to read %s: pass 1\n", filename);
+  /* read the whole file at once and parse it from memory */
+  if (fseek (fid, 0, SEEK_END) || (file_size = ftell (fid)) < 0 ||
+      fseek (fid, 0, SEEK_SET)) {
+    P4EST_LERRORF ("Failed to determine the size of %s\n", filename);
+    goto dead;
+  }
+  length = (size_t) file_size;
+  buffer = P4EST_ALLOC (char, SC_MAX (length, 1));
+  if (fread (buffer, 1, length, fid) != length) {
+    P4EST_LERRORF ("Failed to read %s\n", filename);
+    goto dead;
+  }
+
+  retval = fclose (fid);
+  fid = NULL;
+  if (retval) {
+    P4EST_LERRORF ("Failed to close %s\n", filename);
     goto dead;
   }
 
-  rewind (fid);
+  if (p4est_connectivity_read_inp_buffer
+      (buffer, length, &num_vertices, &num_trees, NULL, NULL)) {
+    P4EST_LERRORF ("Failed to read %s: pass 1\n", filename);
+    goto dead;
+  }
 
   conn = p4est_connectivity_new (num_vertices, num_trees,
 #ifdef P4_TO_P8
@@ -4950,12 +7184,15 @@ p4est_connectivity_read_inp (const char *filename)
 #endif
                                  0, 0);
 
-  if (p4est_connectivity_read_inp_stream (fid, &conn->num_vertices,
+  if (p4est_connectivity_read_inp_buffer (buffer, length,
+                                          &conn->num_vertices,
                                           &conn->num_trees, conn->vertices,
                                           conn->tree_to_vertex)) {
     P4EST_LERRORF ("Failed to read %s: pass 2\n", filename);
     goto dead;
   }
+  P4EST_FREE (buffer);
+  buffer = NULL;
 
   /*
    * Fill tree_to_tree and tree_to_face to make sure we have a valid
@@ -4972,13 +7209,6 @@ p4est_connectivity_read_inp (const char *filename)
   /* Compute real tree_to_* fields and complete (edge and) corner fields. */
   p4est_connectivity_complete (conn);
 
-  retval = fclose (fid);
-  fid = NULL;
-  if (retval) {
-    P4EST_LERRORF ("Failed to close %s\n", filename);
-    goto dead;
-  }
-
   P4EST_GLOBAL_PRODUCTIONF
     ("New connectivity with %lld trees and %lld vertices\n",
      (long long) conn->num_trees, (long long) conn->num_vertices);
@@ -4990,6 +7220,7 @@ dead:
   if (fid != NULL) {
     fclose (fid);
   }
+  P4EST_FREE (buffer);
   if (conn != NULL) {
     p4est_connectivity_destroy (conn);
   }
@@ -56,6 +56,103 @@ trilinear_interp (double (*v)[3], double eta[3], double xyz[3])
   }
 }
 
+/** Create the refined trees of one tree of the input connectivity.
+ * \param [in] conn_in      The connectivity to be refined.
+ * \param [in] ti           The tree to refine.
+ * \param [in] num_per_edge The number of new trees in each direction.
+ * \param [in] vnodes       The number of nodes per lnodes element.
+ * \param [in] element_nodes    The lnodes element nodes of tree \a ti.
+ * \param [out] tree_to_vertex  Receives the vertices of the new trees,
+ *                              numbered as the local lnodes nodes.
+ * \param [in,out] vertices     The coordinates of the new trees' corners
+ *                              are written at their local node numbers.
+ * \return                  The number of new trees.
+ */
+static p4est_topidx_t
+p4est_connrefine_tree (p4est_connectivity_t * conn_in, p4est_topidx_t ti,
+                       int num_per_edge, int vnodes,
+                       const p4est_locidx_t * element_nodes,
+                       p4est_topidx_t * tree_to_vertex, double *vertices)
+{
+  int                 ceillog = SC_LOG2_32 (num_per_edge - 1) + 1;
+#ifndef P4_TO_P8
+  int                 M = 1 << (2 * ceillog);
+#else
+  int                 M = 1 << (3 * ceillog);
+#endif
+  int                 j;
+  p4est_topidx_t      count;
+  double              v[P4EST_CHILDREN][3];
+
+  for (j = 0; j < P4EST_CHILDREN; j++) {
+    int                 k;
+
+    for (k = 0; k < 3; k++) {
+      v[j][k] =
+        conn_in->vertices[3 *
+                          conn_in->tree_to_vertex[P4EST_CHILDREN * ti + j] +
+                          k];
+    }
+  }
+  for (count = 0, j = 0; j < M; j++) {
+    p4est_quadrant_t    dummy;
+    uint64_t            R = j;
+    int                 x[P4EST_DIM], k;
+    int                 id, pow;
+    double              xyz[3];
+    p4est_locidx_t      thisvert;
+
+    p4est_quadrant_set_morton (&dummy, ceillog, R);
+
+    x[0] = (dummy.x >> (P4EST_MAXLEVEL - ceillog));
+    x[1] = (dummy.y >> (P4EST_MAXLEVEL - ceillog));
+#ifdef P4_TO_P8
+    x[2] = (dummy.z >> (P4EST_MAXLEVEL - ceillog));
+#endif
+    for (k = 0; k < P4EST_DIM; k++) {
+      if (x[k] >= num_per_edge) {
+        break;
+      }
+    }
+    if (k < P4EST_DIM) {
+      continue;
+    }
+
+    id = 0;
+    pow = 1;
+    for (k = 0; k < P4EST_DIM; k++) {
+      id += x[k] * pow;
+      pow *= (num_per_edge + 1);
+    }
+
+    for (k = 0; k < P4EST_CHILDREN; k++) {
+      int                 thisid = id, l;
+      double              eta[3] = { 0. };
+
+      pow = 1;
+      for (l = 0; l < P4EST_DIM; l++) {
+        int                 thisx = x[l];
+        int                 thisincr = (! !(k & 1 << l));
+
+        thisid += pow * thisincr;
+        pow *= (num_per_edge + 1);
+        eta[l] = ((double) (thisx + thisincr)) / ((double) num_per_edge);
+      }
+      P4EST_ASSERT (thisid < vnodes);
+      trilinear_interp (v, eta, xyz);
+      thisvert = element_nodes[thisid];
+      tree_to_vertex[P4EST_CHILDREN * count + k] = (p4est_topidx_t) thisvert;
+      for (l = 0; l < 3; l++) {
+        vertices[3 * thisvert + l] = xyz[l];
+      }
+    }
+
+    count++;
+  }
+
+  return count;
+}
+
 p4est_connectivity_t *
 p4est_connectivity_refine (p4est_connectivity_t * conn_in, int num_per_edge)
 {
@@ -64,14 +161,13 @@ p4est_connectivity_refine (p4est_connectivity_t * conn_in, int num_per_edge)
   p4est_lnodes_t     *dummy_lnodes;
   p4est_connectivity_t *conn_out;
   p4est_topidx_t      num_old_trees = conn_in->num_trees;
+#ifdef P4EST_ENABLE_DEBUG
   int                 ceillog = SC_LOG2_32 (num_per_edge - 1) + 1;
-  int                 ceil = (1 << ceillog);
+#endif
 #ifndef P4_TO_P8
   int                 N = num_per_edge * num_per_edge;
-  int                 M = ceil * ceil;
 #else
   int                 N = num_per_edge * num_per_edge * num_per_edge;
-  int                 M = ceil * ceil * ceil;
 #endif
   p4est_topidx_t      num_new_trees = num_old_trees * N;
   p4est_topidx_t      num_new_vertices, ti, count;
@@ -100,81 +196,158 @@ p4est_connectivity_refine (p4est_connectivity_t * conn_in, int num_per_edge)
     }
   }
   for (count = 0, ti = 0; ti < num_old_trees; ti++) {
-    double              v[P4EST_CHILDREN][3];
+    count += p4est_connrefine_tree (conn_in, ti, num_per_edge,
+                                    dummy_lnodes->vnodes,
+                                    dummy_lnodes->element_nodes +
+                                    dummy_lnodes->vnodes * ti,
+                                    conn_out->tree_to_vertex +
+                                    P4EST_CHILDREN * count,
+                                    conn_out->vertices);
+  }
+  P4EST_ASSERT (count == num_new_trees);
+
+  p4est_lnodes_destroy (dummy_lnodes);
+  p4est_ghost_destroy (dummy_ghost);
+  p4est_destroy (dummy_forest);
 
-    for (j = 0; j < P4EST_CHILDREN; j++) {
-      int                 k;
+  p4est_connectivity_complete (conn_out);
 
-      for (k = 0; k < 3; k++) {
-        v[j][k] =
-          conn_in->vertices[3 *
-                            conn_in->tree_to_vertex[P4EST_CHILDREN * ti + j] +
-                            k];
-      }
-    }
-    for (j = 0; j < M; j++) {
-      p4est_quadrant_t    dummy;
-      uint64_t            R = j;
-      int                 x[P4EST_DIM], k;
-      int                 id, pow;
-      double              xyz[3];
-      p4est_topidx_t      thisvert;
-
-      p4est_quadrant_set_morton (&dummy, ceillog, R);
-
-      x[0] = (dummy.x >> (P4EST_MAXLEVEL - ceillog));
-      x[1] = (dummy.y >> (P4EST_MAXLEVEL - ceillog));
-#ifdef P4_TO_P8
-      x[2] = (dummy.z >> (P4EST_MAXLEVEL - ceillog));
+  return conn_out;
+}
+
+p4est_connectivity_t *
+p4est_connectivity_refine_parallel (p4est_connectivity_t * conn_in,
+                                    int num_per_edge, int shared,
+                                    sc_MPI_Comm mpicomm)
+{
+  int                 mpiret, mpisize, mpirank, p;
+#ifdef P4EST_ENABLE_DEBUG
+  int                 ceillog = SC_LOG2_32 (num_per_edge - 1) + 1;
 #endif
-      for (k = 0; k < P4EST_DIM; k++) {
-        if (x[k] >= num_per_edge) {
-          break;
-        }
-      }
-      if (k < P4EST_DIM) {
-        continue;
-      }
+#ifndef P4_TO_P8
+  int                 N = num_per_edge * num_per_edge;
+#else
+  int                 N = num_per_edge * num_per_edge * num_per_edge;
+#endif
+  int                 local_counts[2];
+  int                *counts, *displs, *vcounts, *vdispls;
+  int                 j;
+  p4est_topidx_t      num_new_trees, num_new_vertices;
+  p4est_topidx_t      ti, jt, count;
+  p4est_topidx_t     *ttv;
+  p4est_locidx_t      el, ln;
+  double             *vertices;
+  p4est_t            *dummy_forest;
+  p4est_ghost_t      *dummy_ghost;
+  p4est_lnodes_t     *lnodes;
+  p4est_connectivity_t *conn_out;
 
-      id = 0;
-      pow = 1;
-      for (k = 0; k < P4EST_DIM; k++) {
-        id += x[k] * pow;
-        pow *= (num_per_edge + 1);
-      }
+  P4EST_ASSERT (num_per_edge >= 1);
+  P4EST_ASSERT (ceillog <= P4EST_OLD_QMAXLEVEL);
+  P4EST_ASSERT (conn_in->num_trees <= P4EST_TOPIDX_MAX / N);
 
-      for (k = 0; k < P4EST_CHILDREN; k++) {
-        int                 thisid = id, l;
-        double              eta[3] = { 0. };
-
-        pow = 1;
-        for (l = 0; l < P4EST_DIM; l++) {
-          int                 thisx = x[l];
-          int                 thisincr = (! !(k & 1 << l));
-
-          thisid += pow * thisincr;
-          pow *= (num_per_edge + 1);
-          eta[l] = ((double) (thisx + thisincr)) / ((double) num_per_edge);
-        }
-        P4EST_ASSERT (thisid < dummy_lnodes->vnodes);
-        trilinear_interp (v, eta, xyz);
-        conn_out->tree_to_vertex[P4EST_CHILDREN * count + k] = thisvert =
-          dummy_lnodes->element_nodes[dummy_lnodes->vnodes * ti + thisid];
-        for (l = 0; l < 3; l++) {
-          conn_out->vertices[3 * thisvert + l] = xyz[l];
-        }
-      }
+  mpiret = sc_MPI_Comm_size (mpicomm, &mpisize);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Comm_rank (mpicomm, &mpirank);
+  SC_CHECK_MPI (mpiret);
+
+  /* the processes share the old trees and number the new vertices */
+  dummy_forest = p4est_new (mpicomm, conn_in, 0, 0, NULL);
+  dummy_ghost = p4est_ghost_new (dummy_forest, P4EST_CONNECT_FULL);
+  lnodes = p4est_lnodes_new (dummy_forest, dummy_ghost, num_per_edge);
 
-      count++;
+  /* each process refines its trees in local vertex numbers */
+  ttv = P4EST_ALLOC (p4est_topidx_t, (size_t) P4EST_CHILDREN * N *
+                     dummy_forest->local_num_quadrants);
+  vertices = P4EST_ALLOC (double, 3 * (size_t) lnodes->num_local_nodes);
+  count = 0;
+  el = 0;
+  for (jt = dummy_forest->first_local_tree;
+       jt <= dummy_forest->last_local_tree; ++jt) {
+    if (p4est_tree_array_index (dummy_forest->trees, jt)->quadrants.
+        elem_count == 0) {
+      continue;
     }
+    count += p4est_connrefine_tree (conn_in, jt, num_per_edge,
+                                    lnodes->vnodes, lnodes->element_nodes +
+                                    lnodes->vnodes * el,
+                                    ttv + P4EST_CHILDREN * count, vertices);
+    ++el;
   }
-  P4EST_ASSERT (count == num_new_trees);
+  P4EST_ASSERT (el == dummy_forest->local_num_quadrants);
+  P4EST_ASSERT (count == (p4est_topidx_t) N * el);
 
-  p4est_lnodes_destroy (dummy_lnodes);
+  /* translate to the global vertex numbers of lnodes */
+  for (ti = 0; ti < P4EST_CHILDREN * count; ++ti) {
+    ln = (p4est_locidx_t) ttv[ti];
+    ttv[ti] = (p4est_topidx_t) (ln < lnodes->owned_count ?
+                                lnodes->global_offset + ln :
+                                lnodes->nonlocal_nodes[ln -
+                                                       lnodes->owned_count]);
+  }
+
+  /* the root collects the trees and the vertices of all owners */
+  local_counts[0] = (int) (P4EST_CHILDREN * count);
+  local_counts[1] = 3 * (int) lnodes->owned_count;
+  counts = vcounts = displs = vdispls = NULL;
+  conn_out = NULL;
+  if (mpirank == 0) {
+    counts = P4EST_ALLOC (int, 4 * mpisize);
+    vcounts = counts + mpisize;
+    displs = vcounts + mpisize;
+    vdispls = displs + mpisize;
+  }
+  /* the displacement arrays are contiguous and receive the count pairs */
+  mpiret = sc_MPI_Gather (local_counts, 2, sc_MPI_INT,
+                          displs, 2, sc_MPI_INT, 0, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  if (mpirank == 0) {
+    num_new_trees = num_new_vertices = 0;
+    for (p = 0; p < mpisize; ++p) {
+      counts[p] = displs[2 * p];
+      vcounts[p] = displs[2 * p + 1];
+    }
+    for (p = 0; p < mpisize; ++p) {
+      displs[p] = P4EST_CHILDREN * num_new_trees;
+      vdispls[p] = 3 * num_new_vertices;
+      num_new_trees += counts[p] / P4EST_CHILDREN;
+      num_new_vertices += vcounts[p] / 3;
+    }
+    P4EST_ASSERT (num_new_trees == conn_in->num_trees * N);
+    conn_out = p4est_connectivity_new (num_new_vertices, num_new_trees,
+#ifdef P4_TO_P8
+                                       0, 0,
+#endif
+                                       0, 0);
+    for (ti = 0; ti < num_new_trees; ti++) {
+      for (j = 0; j < P4EST_FACES; j++) {
+        conn_out->tree_to_tree[P4EST_FACES * ti + j] = ti;
+        conn_out->tree_to_face[P4EST_FACES * ti + j] = j;
+      }
+    }
+  }
+  mpiret = sc_MPI_Gatherv (ttv, local_counts[0], P4EST_MPI_TOPIDX,
+                           conn_out == NULL ? NULL : conn_out->tree_to_vertex,
+                           counts, displs, P4EST_MPI_TOPIDX, 0, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Gatherv (vertices, local_counts[1], sc_MPI_DOUBLE,
+                           conn_out == NULL ? NULL : conn_out->vertices,
+                           vcounts, vdispls, sc_MPI_DOUBLE, 0, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (counts);
+  P4EST_FREE (ttv);
+  P4EST_FREE (vertices);
+
+  p4est_lnodes_destroy (lnodes);
   p4est_ghost_destroy (dummy_ghost);
   p4est_destroy (dummy_forest);
 
-  p4est_connectivity_complete (conn_out);
-
-  return conn_out;
+  /* complete and distribute the connectivity */
+  if (mpirank == 0) {
+    p4est_connectivity_complete (conn_out);
+  }
+  if (shared) {
+    return p4est_connectivity_bcast_shared (conn_out, 0, mpicomm);
+  }
+  return p4est_connectivity_bcast (conn_out, 0, mpicomm);
 }
@@ -34,6 +34,16 @@
 #include <p8est_geometry.h>
 #endif
 
+/** A geometry holding the per-tree coefficients of its connectivity.
+ * The builtin geometries begin with the same two members. */
+typedef struct p4est_geometry_cached
+{
+  /** The geom member needs to come first; we cast to p4est_geometry_t * */
+  p4est_geometry_t    geom;
+  p4est_geometry_cache_t *cache;        /**< May be NULL if unused. */
+}
+p4est_geometry_cached_t;
+
 #ifndef P4_TO_P8
 
 typedef enum
@@ -82,6 +92,8 @@ typedef struct p4est_geometry_builtin
 {
   /** The geom member needs to come first; we cast to p4est_geometry_t * */
   p4est_geometry_t    geom;
+  /** The cache member comes second as in p4est_geometry_cached_t */
+  p4est_geometry_cache_t *cache;
   union
   {
     p4est_geometry_builtin_type_t type;
@@ -107,36 +119,108 @@ p4est_geometry_destroy (p4est_geometry_t * geom)
   }
 }
 
+void
+p4est_geometry_X_batch (p4est_geometry_t * geom, p4est_topidx_t which_tree,
+                        size_t n, const double *abc, double *xyz)
+{
+  size_t              zz;
+  double              rst[3];
+
+  P4EST_ASSERT (geom != NULL);
+  P4EST_ASSERT (n == 0 || (abc != NULL && xyz != NULL));
+
+  if (geom->X_batch != NULL) {
+    geom->X_batch (geom, which_tree, n, abc, xyz);
+    return;
+  }
+
+  /* the input is copied since xyz may be the same array as abc */
+  P4EST_ASSERT (geom->X != NULL);
+  for (zz = 0; zz < n; ++zz) {
+    rst[0] = abc[3 * zz + 0];
+    rst[1] = abc[3 * zz + 1];
+    rst[2] = abc[3 * zz + 2];
+    geom->X (geom, which_tree, rst, xyz + 3 * zz);
+  }
+}
+
+void
+p4est_geometry_J (p4est_geometry_t * geom, p4est_topidx_t which_tree,
+                  const double abc[3], double J[3][3])
+{
+  int                 i, j;
+  const double        step = sqrt (SC_EPS);
+  double              h, rst[3], xyz[3], xyzh[3];
+
+  P4EST_ASSERT (geom != NULL);
+
+  if (geom->J != NULL) {
+    geom->J (geom, which_tree, abc, J);
+    return;
+  }
+
+  /* one-sided differences that stay inside the tree */
+  P4EST_ASSERT (geom->X != NULL);
+  rst[0] = abc[0];
+  rst[1] = abc[1];
+  rst[2] = P4EST_DIM == 3 ? abc[2] : 0.;
+  geom->X (geom, which_tree, rst, xyz);
+  for (j = 0; j < 3; ++j) {
+    if (j >= P4EST_DIM) {
+      for (i = 0; i < 3; ++i) {
+        J[i][j] = 0.;
+      }
+      continue;
+    }
+    h = rst[j] + step <= 1. ? step : -step;
+    rst[j] += h;
+    geom->X (geom, which_tree, rst, xyzh);
+    rst[j] = abc[j];
+    for (i = 0; i < 3; ++i) {
+      J[i][j] = (xyzh[i] - xyz[i]) / h;
+    }
+  }
+}
+
 void
 p4est_geometry_connectivity_X (p4est_geometry_t * geom,
                                p4est_topidx_t which_tree,
                                const double abc[3], double xyz[3])
+{
+  p4est_geometry_connectivity_X_batch (geom, which_tree, 1, abc, xyz);
+}
+
+void
+p4est_geometry_connectivity_X_batch (p4est_geometry_t * geom,
+                                     p4est_topidx_t which_tree, size_t n,
+                                     const double *abc, double *xyz)
 {
   P4EST_ASSERT (geom->user != NULL);
   p4est_connectivity_t *connectivity = (p4est_connectivity_t *) geom->user;
-  P4EST_ASSERT (connectivity->tree_to_vertex != NULL);
-  const p4est_topidx_t *tree_to_vertex = connectivity->tree_to_vertex;
-  const double       *v = connectivity->vertices;
+  double              v[3 * P4EST_CHILDREN];
   double              eta_x, eta_y, eta_z = 0.;
   int                 j, k;
+  size_t              zz;
   p4est_topidx_t      vt[P4EST_CHILDREN];
 
-  /* retrieve corners of the tree */
+  /* retrieve corners of the tree, which may be implicit for a brick */
   for (k = 0; k < P4EST_CHILDREN; ++k) {
-    vt[k] = tree_to_vertex[which_tree * P4EST_CHILDREN + k];
+    p4est_connectivity_tree_vertex (connectivity, which_tree, k, v + 3 * k);
+    vt[k] = k;
   }
 
-  /* these are reference coordinates in [0, 1]**d */
-  eta_x = abc[0];
-  eta_y = abc[1];
+  for (zz = 0; zz < n; ++zz) {
+    /* these are reference coordinates in [0, 1]**d */
+    eta_x = abc[3 * zz + 0];
+    eta_y = abc[3 * zz + 1];
 #ifdef P4_TO_P8
-  eta_z = abc[2];
+    eta_z = abc[3 * zz + 2];
 #endif
 
-  /* bi/trilinear transformation */
-  for (j = 0; j < 3; ++j) {
-    /* *INDENT-OFF* */
-    xyz[j] =
+    /* bi/trilinear transformation */
+    for (j = 0; j < 3; ++j) {
+      /* *INDENT-OFF* */
+      xyz[3 * zz + j] =
            ((1. - eta_z) * ((1. - eta_y) * ((1. - eta_x) * v[3 * vt[0] + j] +
                                                   eta_x  * v[3 * vt[1] + j]) +
                                   eta_y  * ((1. - eta_x) * v[3 * vt[2] + j] +
@@ -148,60 +232,222 @@ p4est_geometry_connectivity_X (p4est_geometry_t * geom,
                                                   eta_x  * v[3 * vt[7] + j]))
 #endif
            );
-    /* *INDENT-ON* */
+      /* *INDENT-ON* */
+    }
+  }
+}
+
+p4est_geometry_cache_t *
+p4est_geometry_cache_new (p4est_connectivity_t * conn)
+{
+  p4est_geometry_cache_t *cache;
+  double              v[3 * P4EST_CHILDREN];
+  double             *co;
+  int                 i, k, b;
+  p4est_topidx_t      jt;
+
+  P4EST_ASSERT (conn->vertices != NULL || conn->brick != NULL);
+
+  cache = P4EST_ALLOC (p4est_geometry_cache_t, 1);
+  cache->conn = conn;
+  cache->num_trees = conn->num_trees;
+  cache->coeff = P4EST_ALLOC (double, 3 * P4EST_CHILDREN *
+                              SC_MAX (conn->num_trees, 1));
+
+  for (jt = 0; jt < conn->num_trees; ++jt) {
+    /* retrieve corners of the tree, which may be implicit for a brick */
+    for (k = 0; k < P4EST_CHILDREN; ++k) {
+      p4est_connectivity_tree_vertex (conn, jt, k, v + 3 * k);
+    }
+
+    /* turn the corner values into monomial coefficients by differencing
+       along each coordinate direction in turn */
+    co = cache->coeff + 3 * P4EST_CHILDREN * jt;
+    for (i = 0; i < 3; ++i) {
+      for (k = 0; k < P4EST_CHILDREN; ++k) {
+        co[k] = v[3 * k + i];
+      }
+      for (b = 0; b < P4EST_DIM; ++b) {
+        for (k = 0; k < P4EST_CHILDREN; ++k) {
+          if (k & (1 << b)) {
+            co[k] -= co[k ^ (1 << b)];
+          }
+        }
+      }
+      co += P4EST_CHILDREN;
+    }
+  }
+
+  return cache;
+}
+
+void
+p4est_geometry_cache_destroy (p4est_geometry_cache_t * cache)
+{
+  P4EST_FREE (cache->coeff);
+  P4EST_FREE (cache);
+}
+
+void
+p4est_geometry_cache_X_batch (p4est_geometry_cache_t * cache,
+                              p4est_topidx_t which_tree, size_t n,
+                              const double *abc, double *xyz)
+{
+  const double       *co;
+  double              a, b, c = 0.;
+  size_t              zz;
+  int                 i;
+
+  P4EST_ASSERT (cache != NULL);
+  P4EST_ASSERT (0 <= which_tree && which_tree < cache->num_trees);
+
+  co = cache->coeff + 3 * P4EST_CHILDREN * which_tree;
+  for (zz = 0; zz < n; ++zz) {
+    a = abc[3 * zz + 0];
+    b = abc[3 * zz + 1];
+#ifdef P4_TO_P8
+    c = abc[3 * zz + 2];
+#endif
+    for (i = 0; i < 3; ++i) {
+      const double       *ci = co + P4EST_CHILDREN * i;
+
+      xyz[3 * zz + i] = ci[0] + a * ci[1] + b * (ci[2] + a * ci[3])
+#ifdef P4_TO_P8
+        + c * (ci[4] + a * ci[5] + b * (ci[6] + a * ci[7]))
+#endif
+        ;
+    }
+  }
+  (void) c;
+}
+
+void
+p4est_geometry_cache_J (p4est_geometry_cache_t * cache,
+                        p4est_topidx_t which_tree,
+                        const double abc[3], double J[3][3])
+{
+  const double       *co;
+  double              a, b, c = 0.;
+  int                 i;
+
+  P4EST_ASSERT (cache != NULL);
+  P4EST_ASSERT (0 <= which_tree && which_tree < cache->num_trees);
+
+  co = cache->coeff + 3 * P4EST_CHILDREN * which_tree;
+  a = abc[0];
+  b = abc[1];
+#ifdef P4_TO_P8
+  c = abc[2];
+#endif
+  for (i = 0; i < 3; ++i) {
+    const double       *ci = co + P4EST_CHILDREN * i;
+
+#ifndef P4_TO_P8
+    J[i][0] = ci[1] + b * ci[3];
+    J[i][1] = ci[2] + a * ci[3];
+    J[i][2] = 0.;
+#else
+    J[i][0] = ci[1] + b * ci[3] + c * (ci[5] + b * ci[7]);
+    J[i][1] = ci[2] + a * ci[3] + c * (ci[6] + a * ci[7]);
+    J[i][2] = ci[4] + a * ci[5] + b * (ci[6] + a * ci[7]);
+#endif
+  }
+  (void) c;
+}
+
+/** Free a geometry that holds a cache and the cache with it. */
+static void
+p4est_geometry_cached_destroy (p4est_geometry_t * geom)
+{
+  p4est_geometry_cached_t *cached = (p4est_geometry_cached_t *) geom;
+
+  if (cached->cache != NULL) {
+    p4est_geometry_cache_destroy (cached->cache);
+  }
+  P4EST_FREE (cached);
+}
+
+/** Vertex space transformation of a geometry that holds a cache. */
+static void
+p4est_geometry_cached_X_batch (p4est_geometry_t * geom,
+                               p4est_topidx_t which_tree, size_t n,
+                               const double *abc, double *xyz)
+{
+  p4est_geometry_cache_X_batch (((p4est_geometry_cached_t *) geom)->cache,
+                                which_tree, n, abc, xyz);
+}
+
+static void
+p4est_geometry_cached_X (p4est_geometry_t * geom, p4est_topidx_t which_tree,
+                         const double abc[3], double xyz[3])
+{
+  p4est_geometry_cached_X_batch (geom, which_tree, 1, abc, xyz);
+}
+
+/** Vertex space Jacobian of a geometry that holds a cache. */
+static void
+p4est_geometry_cached_J (p4est_geometry_t * geom, p4est_topidx_t which_tree,
+                         const double abc[3], double J[3][3])
+{
+  p4est_geometry_cache_J (((p4est_geometry_cached_t *) geom)->cache,
+                          which_tree, abc, J);
+}
+
+/** Multiply the Jacobian of a map applied after the vertex transformation.
+ * \param [in] M      Jacobian of the map with respect to vertex space.
+ * \param [in,out] J  On input the Jacobian of the vertex transformation,
+ *                    on output that of the composition.
+ */
+static void
+p4est_geometry_chain_J (const double M[3][3], double J[3][3])
+{
+  int                 i, j;
+  double              Jv[3][3];
+
+  memcpy (Jv, J, sizeof (Jv));
+  for (i = 0; i < 3; ++i) {
+    for (j = 0; j < 3; ++j) {
+      J[i][j] = M[i][0] * Jv[0][j] + M[i][1] * Jv[1][j] + M[i][2] * Jv[2][j];
+    }
   }
 }
 
 p4est_geometry_t   *
 p4est_geometry_new_connectivity (p4est_connectivity_t * conn)
 {
-  p4est_geometry_t   *geom;
+  p4est_geometry_cached_t *cached;
 
-  P4EST_ASSERT (conn->vertices != NULL);
+  P4EST_ASSERT (conn->vertices != NULL || conn->brick != NULL);
 
-  geom = P4EST_ALLOC_ZERO (p4est_geometry_t, 1);
+  cached = P4EST_ALLOC_ZERO (p4est_geometry_cached_t, 1);
+  cached->cache = p4est_geometry_cache_new (conn);
 
-  geom->name = P4EST_STRING "_connectivity";
-  geom->user = conn;
-  geom->X = p4est_geometry_connectivity_X;
+  cached->geom.name = P4EST_STRING "_connectivity";
+  cached->geom.user = conn;
+  cached->geom.X = p4est_geometry_cached_X;
+  cached->geom.X_batch = p4est_geometry_cached_X_batch;
+  cached->geom.J = p4est_geometry_cached_J;
+  cached->geom.destroy = p4est_geometry_cached_destroy;
 
-  return geom;
+  return &cached->geom;
 }
 
 #ifndef P4_TO_P8
 
 /**
- * Geometric coordinate transformation for icosahedron geometry.
- *
- * Define the geometric transformation from tree-local reference coordinates 
- * to physical space
+ * Look up the icosahedron nodes spanning a tree.
  *
- * \param[in]  geom       associated geometry
  * \param[in]  which_tree tree id inside forest
- * \param[in]  rst        tree-local reference coordinates : [0,1]^2.
- *                        Note: rst[2] is never accessed
- * \param[out] xyz        Cartesian coordinates in physical space after geometry
- *
+ * \param[out] n          Cartesian coordinates of the four nodes of the
+ *                        tree, before scaling to the target radius
  */
 static void
-p4est_geometry_icosahedron_X (p4est_geometry_t * geom,
-                              p4est_topidx_t which_tree,
-                              const double rst[3], double xyz[3])
+p4est_geometry_icosahedron_nodes (p4est_topidx_t which_tree, double n[4][3])
 {
-  const struct p4est_geometry_builtin_icosahedron *icosahedron
-    = &((p4est_geometry_builtin_t *) geom)->p.icosahedron;
   double              a = 1.0;
   double              g = (1.0 + sqrt (5.0)) * 0.5;     /* golden ratio */
   double              ga = a / g;
-  double              r = sqrt ((5.0 - sqrt (5.0)) * 0.5);      /* sqrt(a*a+ga*ga) -> current radius */
-
-  double              R = icosahedron->R;       /* target sphere radius */
-  double              radius_ratio = R / r;
-
-  /* these are reference coordinates in [0, 1]**d */
-  double              eta_x, eta_y;
-  eta_x = rst[0];
-  eta_y = rst[1];
+  int                 i, j;
 
   /*
    * icosahedron node Cartesian coordinates
@@ -250,72 +496,192 @@ p4est_geometry_icosahedron_X (p4est_geometry_t * geom,
     10, 11, 1, 6,
   };
 
-  /* assert that input points are in the expected range */
-  P4EST_ASSERT (icosahedron->type == P4EST_GEOMETRY_BUILTIN_ICOSAHEDRON);
   P4EST_ASSERT (0 <= which_tree && which_tree < 10);
 
-  /* transform from the reference cube into vertex space */
+  /* use tree to nodes mapping to get nodes index of current tree */
+  for (i = 0; i < 4; ++i) {
+    for (j = 0; j < 3; ++j) {
+      n[i][j] = N[tree_to_nodes[which_tree * 4 + i] * 3 + j];
+    }
+  }
+}
+
+/** Ratio of the icosahedron target radius and the radius of its nodes. */
+static double
+p4est_geometry_icosahedron_ratio (p4est_geometry_t * geom)
+{
+  const struct p4est_geometry_builtin_icosahedron *icosahedron
+    = &((p4est_geometry_builtin_t *) geom)->p.icosahedron;
+  double              r = sqrt ((5.0 - sqrt (5.0)) * 0.5);      /* sqrt(a*a+ga*ga) -> current radius */
+
+  P4EST_ASSERT (icosahedron->type == P4EST_GEOMETRY_BUILTIN_ICOSAHEDRON);
+  return icosahedron->R / r;    /* target sphere radius */
+}
+
+/**
+ * Geometric coordinate transformation for many points of the icosahedron
+ * geometry.  The tree nodes and the first slerp angle are set up once.
+ *
+ * \param[in]  geom       associated geometry
+ * \param[in]  which_tree tree id inside forest
+ * \param[in]  n          number of points
+ * \param[in]  rst        tree-local reference coordinates : [0,1]^2,
+ *                        3 per point.  Note: rst[3 * i + 2] is never accessed
+ * \param[out] xyz        Cartesian coordinates in physical space after
+ *                        geometry, 3 per point.  May equal \a rst.
+ */
+static void
+p4est_geometry_icosahedron_X_batch (p4est_geometry_t * geom,
+                                    p4est_topidx_t which_tree, size_t n,
+                                    const double *rst, double *xyz)
+{
+  double              radius_ratio = p4est_geometry_icosahedron_ratio (geom);
+
+  /* these are reference coordinates in [0, 1]**d */
+  double              eta_x, eta_y;
 
   /* assign correct coordinates based on patch id */
   /* use bilinear SLERP :  spherical bilinear interpolation */
   {
     int                 j;
-
-    /* use tree to nodes mapping to get nodes index of current tree */
-    const int           i0 = tree_to_nodes[which_tree * 4 + 0];
-    const int           i1 = tree_to_nodes[which_tree * 4 + 1];
-    const int           i2 = tree_to_nodes[which_tree * 4 + 2];
-    const int           i3 = tree_to_nodes[which_tree * 4 + 3];
+    size_t              zz;
 
     /* get 3D Cartesian coordinates of our face */
-    const double        n0[3] =
-      { N[i0 * 3 + 0], N[i0 * 3 + 1], N[i0 * 3 + 2] };
-    const double        n1[3] =
-      { N[i1 * 3 + 0], N[i1 * 3 + 1], N[i1 * 3 + 2] };
-    const double        n2[3] =
-      { N[i2 * 3 + 0], N[i2 * 3 + 1], N[i2 * 3 + 2] };
-    const double        n3[3] =
-      { N[i3 * 3 + 0], N[i3 * 3 + 1], N[i3 * 3 + 2] };
-    double              norme2 =
-      n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2];
-
-    /* 1. apply slerp
-     * - between n0 and n1
-     * - between n2 and n3
-     */
-    double              xyz01[3];       /* slerp along n0 -> n1 */
-    double              xyz23[3];       /* slerp along n2 -> n3 */
-    double              dot1 = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
-    double              theta1 = acos (dot1 / norme2);
-
-    for (j = 0; j < 3; ++j) {
-      xyz01[j] =
-        sin ((1.0 - eta_x) * theta1) / sin (theta1) * n0[j] +
-        sin ((eta_x) * theta1) / sin (theta1) * n1[j];
-      xyz23[j] =
-        sin ((1.0 - eta_x) * theta1) / sin (theta1) * n2[j] +
-        sin ((eta_x) * theta1) / sin (theta1) * n3[j];
+    double              nd[4][3];
+    double              norme2, dot1, theta1, sin1;
+
+    p4est_geometry_icosahedron_nodes (which_tree, nd);
+    norme2 = nd[0][0] * nd[0][0] + nd[0][1] * nd[0][1] + nd[0][2] * nd[0][2];
+
+    /* the angle of the first slerp only depends on the tree */
+    dot1 = nd[0][0] * nd[1][0] + nd[0][1] * nd[1][1] + nd[0][2] * nd[1][2];
+    theta1 = acos (dot1 / norme2);
+    sin1 = sin (theta1);
+
+    for (zz = 0; zz < n; ++zz) {
+      /* 1. apply slerp
+       * - between n0 and n1
+       * - between n2 and n3
+       */
+      double              xyz01[3];     /* slerp along n0 -> n1 */
+      double              xyz23[3];     /* slerp along n2 -> n3 */
+      double              s0, s1, dot2, theta2, sin2;
+
+      eta_x = rst[3 * zz + 0];
+      eta_y = rst[3 * zz + 1];
+
+      s0 = sin ((1.0 - eta_x) * theta1) / sin1;
+      s1 = sin ((eta_x) * theta1) / sin1;
+      for (j = 0; j < 3; ++j) {
+        xyz01[j] = s0 * nd[0][j] + s1 * nd[1][j];
+        xyz23[j] = s0 * nd[2][j] + s1 * nd[3][j];
+      }
+
+      /* apply slerp between xyz01 and xyz23 */
+      dot2 = xyz01[0] * xyz23[0] + xyz01[1] * xyz23[1] + xyz01[2] * xyz23[2];
+      theta2 = acos (dot2 / norme2);
+      sin2 = sin (theta2);
+      s0 = sin ((1.0 - eta_y) * theta2) / sin2 * radius_ratio;
+      s1 = sin ((eta_y) * theta2) / sin2 * radius_ratio;
+      for (j = 0; j < 3; ++j) {
+        /* rescale coordinates to target radius */
+        xyz[3 * zz + j] = s0 * xyz01[j] + s1 * xyz23[j];
+      }
     }
+  }                             /* end of bilinear slerp */
 
-    /* apply slerp between xyz01 and xyz23 */
-    double              dot2 =
-      xyz01[0] * xyz23[0] + xyz01[1] * xyz23[1] + xyz01[2] * xyz23[2];
-    double              theta2 = acos (dot2 / norme2);
-    for (j = 0; j < 3; ++j) {
-      xyz[j] =
-        sin ((1.0 - eta_y) * theta2) / sin (theta2) * xyz01[j] +
-        sin ((eta_y) * theta2) / sin (theta2) * xyz23[j];
-      xyz[j] *= radius_ratio;   /* rescale coordinates to target radius */
-    }
+}                               /* p4est_geometry_icosahedron_X_batch */
 
-    /* printf("DEBUG : %g | %g %g %g | \n", */
-    /*     xyz[0]*xyz[0] + xyz[1]*xyz[1] + xyz[2]*xyz[2], */
-    /*     xyz[0],xyz[1],xyz[2] */
-    /*     ); */
+/**
+ * Geometric coordinate transformation for icosahedron geometry.
+ *
+ * Define the geometric transformation from tree-local reference coordinates 
+ * to physical space
+ *
+ * \param[in]  geom       associated geometry
+ * \param[in]  which_tree tree id inside forest
+ * \param[in]  rst        tree-local reference coordinates : [0,1]^2.
+ *                        Note: rst[2] is never accessed
+ * \param[out] xyz        Cartesian coordinates in physical space after geometry
+ *
+ */
+static void
+p4est_geometry_icosahedron_X (p4est_geometry_t * geom,
+                              p4est_topidx_t which_tree,
+                              const double rst[3], double xyz[3])
+{
+  p4est_geometry_icosahedron_X_batch (geom, which_tree, 1, rst, xyz);
+}                               /* p4est_geometry_icosahedron_X */
 
-  }                             /* end of bilinear slerp */
+/**
+ * Jacobian of the icosahedron geometry, the derivative of the bilinear
+ * slerp in \ref p4est_geometry_icosahedron_X_batch.
+ *
+ * \param[in]  geom       associated geometry
+ * \param[in]  which_tree tree id inside forest
+ * \param[in]  rst        tree-local reference coordinates : [0,1]^2.
+ *                        Note: rst[2] is never accessed
+ * \param[out] J          derivatives of xyz by rst, third column zero
+ */
+static void
+p4est_geometry_icosahedron_J (p4est_geometry_t * geom,
+                              p4est_topidx_t which_tree,
+                              const double rst[3], double J[3][3])
+{
+  double              radius_ratio = p4est_geometry_icosahedron_ratio (geom);
+  double              nd[4][3];
+  double              norme2, dot1, theta1, sin1;
+  double              s0, s1, ds0, ds1, t0, t1;
+  double              xyz01[3], xyz23[3], d01[3], d23[3];
+  double              dot2, ddot2, theta2, sin2, cos2, dtheta2;
+  double              c0, c1, dt0, dt1;
+  const double        eta_x = rst[0];
+  const double        eta_y = rst[1];
+  int                 j;
+
+  p4est_geometry_icosahedron_nodes (which_tree, nd);
+  norme2 = nd[0][0] * nd[0][0] + nd[0][1] * nd[0][1] + nd[0][2] * nd[0][2];
+  dot1 = nd[0][0] * nd[1][0] + nd[0][1] * nd[1][1] + nd[0][2] * nd[1][2];
+  theta1 = acos (dot1 / norme2);
+  sin1 = sin (theta1);
+
+  /* first slerp and its derivative by eta_x */
+  s0 = sin ((1.0 - eta_x) * theta1) / sin1;
+  s1 = sin (eta_x * theta1) / sin1;
+  ds0 = -theta1 * cos ((1.0 - eta_x) * theta1) / sin1;
+  ds1 = theta1 * cos (eta_x * theta1) / sin1;
+  for (j = 0; j < 3; ++j) {
+    xyz01[j] = s0 * nd[0][j] + s1 * nd[1][j];
+    xyz23[j] = s0 * nd[2][j] + s1 * nd[3][j];
+    d01[j] = ds0 * nd[0][j] + ds1 * nd[1][j];
+    d23[j] = ds0 * nd[2][j] + ds1 * nd[3][j];
+  }
 
-}                               /* p4est_geometry_icosahedron_X */
+  /* the angle of the second slerp depends on eta_x */
+  dot2 = xyz01[0] * xyz23[0] + xyz01[1] * xyz23[1] + xyz01[2] * xyz23[2];
+  ddot2 = d01[0] * xyz23[0] + d01[1] * xyz23[1] + d01[2] * xyz23[2] +
+    xyz01[0] * d23[0] + xyz01[1] * d23[1] + xyz01[2] * d23[2];
+  theta2 = acos (dot2 / norme2);
+  sin2 = sin (theta2);
+  cos2 = cos (theta2);
+  dtheta2 = -ddot2 / (norme2 * sin2);
+
+  /* second slerp weights and their derivatives */
+  c0 = cos ((1.0 - eta_y) * theta2);
+  c1 = cos (eta_y * theta2);
+  t0 = sin ((1.0 - eta_y) * theta2) / sin2;
+  t1 = sin (eta_y * theta2) / sin2;
+  dt0 = ((1.0 - eta_y) * c0 - t0 * cos2) / sin2 * dtheta2;
+  dt1 = (eta_y * c1 - t1 * cos2) / sin2 * dtheta2;
+
+  for (j = 0; j < 3; ++j) {
+    J[j][0] = radius_ratio * (dt0 * xyz01[j] + dt1 * xyz23[j] +
+                              t0 * d01[j] + t1 * d23[j]);
+    J[j][1] = radius_ratio * theta2 / sin2 * (-c0 * xyz01[j] +
+                                              c1 * xyz23[j]);
+    J[j][2] = 0.;
+  }
+}                               /* p4est_geometry_icosahedron_J */
 
 p4est_geometry_t   *
 p4est_geometry_new_icosahedron (p4est_connectivity_t * conn, double R)
@@ -332,11 +698,110 @@ p4est_geometry_new_icosahedron (p4est_connectivity_t * conn, double R)
   builtin->geom.name = "p4est_icosahedron";
   builtin->geom.user = conn;
   builtin->geom.X = p4est_geometry_icosahedron_X;
+  builtin->geom.X_batch = p4est_geometry_icosahedron_X_batch;
+  builtin->geom.J = p4est_geometry_icosahedron_J;
 
   return (p4est_geometry_t *) builtin;
 
 }                               /* p4est_geometry_new_icosahedron */
 
+/**
+ * Select the rotation of a shell2d or disk2d patch.  The Cartesian
+ * coordinates are xyz[i] = q * (cq[i] + cx[i] * x) for i = 0, 1.
+ *
+ * \param[in]  patch      0 through 3 for bottom, right, top and left
+ * \param[in]  sign       +1 for shell2d, -1 for disk2d where the
+ *                        right and left patches are swapped
+ * \param[out] cq         coefficients of q
+ * \param[out] cx         coefficients of q * x
+ */
+static void
+p4est_geometry_patch2d (int patch, double sign, double cq[2], double cx[2])
+{
+  switch (patch) {
+  case 0:                      /* bottom */
+    cq[0] = +1.;                /*  R*cos(theta) */
+    cx[0] = 0.;
+    cq[1] = 0.;                 /*  R*sin(theta) */
+    cx[1] = +1.;
+    break;
+  case 1:                      /* right */
+    cq[0] = 0.;                 /* -R*sin(theta) = R*cos(theta+PI/2) */
+    cx[0] = -sign;
+    cq[1] = +sign;              /*  R*cos(theta) = R*sin(theta+PI/2) */
+    cx[1] = 0.;
+    break;
+  case 2:                      /* top */
+    cq[0] = -1.;                /* - R*cos(theta) = R*cos(theta+PI) */
+    cx[0] = 0.;
+    cq[1] = 0.;                 /* - R*sin(theta) = R*sin(theta+PI) */
+    cx[1] = -1.;
+    break;
+  case 3:                      /* left */
+    cq[0] = 0.;                 /*  R*sin(theta) = R*cos(theta+3*PI/2) */
+    cx[0] = +sign;
+    cq[1] = -sign;              /* -R*cos(theta) = R*sin(theta+3*PI/2) */
+    cx[1] = 0.;
+    break;
+  default:
+    SC_ABORT_NOT_REACHED ();
+  }
+}
+
+/**
+ * Geometric coordinate transformation for many points of the shell2d
+ * geometry.  The patch rotation is selected once for the tree.
+ *
+ * \param[in]  geom       associated geometry
+ * \param[in]  which_tree tree id inside forest
+ * \param[in]  n          number of points
+ * \param[in]  rst        tree-local reference coordinates : [0,1]^2,
+ *                        3 per point.  Note: rst[3 * i + 2] is never accessed
+ * \param[out] xyz        Cartesian coordinates in physical space after
+ *                        geometry, 3 per point.  May equal \a rst.
+ */
+static void
+p4est_geometry_shell2d_X_batch (p4est_geometry_t * geom,
+                                p4est_topidx_t which_tree, size_t n,
+                                const double *rst, double *xyz)
+{
+  const struct p4est_geometry_builtin_shell2d *shell2d
+    = &((p4est_geometry_builtin_t *) geom)->p.shell2d;
+  double              x, R, q;
+  double              cq[2], cx[2];
+  size_t              zz;
+
+  /* assert that input points are in the expected range */
+  P4EST_ASSERT (shell2d->type == P4EST_GEOMETRY_BUILTIN_SHELL2D);
+  P4EST_ASSERT (0 <= which_tree && which_tree < 8);
+
+  /* assign correct coordinates based on patch id */
+  p4est_geometry_patch2d (which_tree / 2, +1., cq, cx);
+
+  /* transform from the reference cube into vertex space */
+  p4est_geometry_cached_X_batch (geom, which_tree, n, rst, xyz);
+
+  for (zz = 0; zz < n; ++zz) {
+    double             *abc = xyz + 3 * zz;
+
+    P4EST_ASSERT (abc[0] < 1.0 + SC_1000_EPS && abc[0] > -1.0 - SC_1000_EPS);
+    P4EST_ASSERT (abc[1] < 2.0 + SC_1000_EPS && abc[1] > 1.0 - SC_1000_EPS);
+
+    /* abc[2] is always 0 here ... */
+
+    /* transform abc[0] in-place for nicer grading */
+    x = tan (abc[0] * M_PI_4);
+
+    /* compute transformation ingredients */
+    R = shell2d->R1sqrbyR2 * pow (shell2d->R2byR1, abc[1]);
+    q = R / sqrt (x * x + 1.);
+
+    abc[0] = q * (cq[0] + cx[0] * x);
+    abc[1] = q * (cq[1] + cx[1] * x);
+    abc[2] = 0.0;
+  }
+}                               /* p4est_geometry_shell2d_X_batch */
+
 /**
  * Geometric coordinate transformation for shell2d geometry.
  *
@@ -354,54 +819,53 @@ static void
 p4est_geometry_shell2d_X (p4est_geometry_t * geom,
                           p4est_topidx_t which_tree,
                           const double rst[3], double xyz[3])
+{
+  p4est_geometry_shell2d_X_batch (geom, which_tree, 1, rst, xyz);
+}                               /* p4est_geometry_shell2d_X */
+
+/**
+ * Jacobian of the shell2d geometry.
+ *
+ * \param[in]  geom       associated geometry
+ * \param[in]  which_tree tree id inside forest
+ * \param[in]  rst        tree-local reference coordinates : [0,1]^2.
+ *                        Note: rst[2] is never accessed
+ * \param[out] J          derivatives of xyz by rst, third column zero
+ */
+static void
+p4est_geometry_shell2d_J (p4est_geometry_t * geom,
+                          p4est_topidx_t which_tree,
+                          const double rst[3], double J[3][3])
 {
   const struct p4est_geometry_builtin_shell2d *shell2d
     = &((p4est_geometry_builtin_t *) geom)->p.shell2d;
-  double              x, R, q;
-  double              abc[3];
+  double              abc[3], M[3][3];
+  double              cq[2], cx[2];
+  double              x, dx, R, q, dqdx, w;
+  int                 i;
 
-  xyz[2] = 0.0;
-
-  /* transform from the reference cube into vertex space */
-  p4est_geometry_connectivity_X (geom, which_tree, rst, abc);
-
-  /* assert that input points are in the expected range */
   P4EST_ASSERT (shell2d->type == P4EST_GEOMETRY_BUILTIN_SHELL2D);
   P4EST_ASSERT (0 <= which_tree && which_tree < 8);
-  P4EST_ASSERT (abc[0] < 1.0 + SC_1000_EPS && abc[0] > -1.0 - SC_1000_EPS);
-  P4EST_ASSERT (abc[1] < 2.0 + SC_1000_EPS && abc[1] > 1.0 - SC_1000_EPS);
 
-  /* abc[2] is always 0 here ... */
+  p4est_geometry_patch2d (which_tree / 2, +1., cq, cx);
+  p4est_geometry_cached_X (geom, which_tree, rst, abc);
+  p4est_geometry_cached_J (geom, which_tree, rst, J);
 
-  /* transform abc[0] in-place for nicer grading */
   x = tan (abc[0] * M_PI_4);
-
-  /* compute transformation ingredients */
+  dx = M_PI_4 * (1. + x * x);
   R = shell2d->R1sqrbyR2 * pow (shell2d->R2byR1, abc[1]);
   q = R / sqrt (x * x + 1.);
-
-  /* assign correct coordinates based on patch id */
-  switch (which_tree / 2) {
-  case 0:                      /* bottom */
-    xyz[0] = +q;                /*  R*cos(theta) */
-    xyz[1] = +q * x;            /*  R*sin(theta) */
-    break;
-  case 1:                      /* right */
-    xyz[0] = -q * x;            /* -R*sin(theta) = R*cos(theta+PI/2) */
-    xyz[1] = +q;                /*  R*cos(theta) = R*sin(theta+PI/2) */
-    break;
-  case 2:                      /* top */
-    xyz[0] = -q;                /* - R*cos(theta) = R*cos(theta+PI) */
-    xyz[1] = -q * x;            /* - R*sin(theta) = R*sin(theta+PI) */
-    break;
-  case 3:                      /* left */
-    xyz[0] = +q * x;            /*  R*sin(theta) = R*cos(theta+3*PI/2) */
-    xyz[1] = -q;                /* -R*cos(theta) = R*sin(theta+3*PI/2) */
-    break;
-  default:
-    SC_ABORT_NOT_REACHED ();
+  dqdx = -q * x / (x * x + 1.);
+
+  /* derivatives of the physical by the vertex coordinates */
+  memset (M, 0, sizeof (M));
+  for (i = 0; i < 2; ++i) {
+    w = cq[i] + cx[i] * x;
+    M[i][0] = (dqdx * w + q * cx[i]) * dx;
+    M[i][1] = q * shell2d->Rlog * w;
   }
-}                               /* p4est_geometry_shell2d_X */
+  p4est_geometry_chain_J (M, J);
+}                               /* p4est_geometry_shell2d_J */
 
 p4est_geometry_t   *
 p4est_geometry_new_shell2d (p4est_connectivity_t * conn, double R2, double R1)
@@ -410,6 +874,7 @@ p4est_geometry_new_shell2d (p4est_connectivity_t * conn, double R2, double R1)
   struct p4est_geometry_builtin_shell2d *shell2d;
 
   builtin = P4EST_ALLOC_ZERO (p4est_geometry_builtin_t, 1);
+  builtin->cache = p4est_geometry_cache_new (conn);
 
   shell2d = &builtin->p.shell2d;
   shell2d->type = P4EST_GEOMETRY_BUILTIN_SHELL2D;
@@ -422,44 +887,36 @@ p4est_geometry_new_shell2d (p4est_connectivity_t * conn, double R2, double R1)
   builtin->geom.name = "p4est_shell2d";
   builtin->geom.user = conn;
   builtin->geom.X = p4est_geometry_shell2d_X;
+  builtin->geom.X_batch = p4est_geometry_shell2d_X_batch;
+  builtin->geom.J = p4est_geometry_shell2d_J;
+  builtin->geom.destroy = p4est_geometry_cached_destroy;
 
   return (p4est_geometry_t *) builtin;
 
 }                               /* p4est_geometry_new_shell2d */
 
 /**
- * geometric coordinate transformation for disk2d geometry.
- *
- * Define the geometric transformation from tree-local reference coordinates 
- * to physical space.
+ * geometric coordinate transformation for many points of the disk2d
+ * geometry.  The patch rotation is selected once for the tree.
  *
  * \param[in]  geom       associated geometry
  * \param[in]  which_tree tree id inside forest
- * \param[in]  rst        tree-local reference coordinates : [0,1]^2.
- *                        Note: rst[2] is never accessed.
- * \param[out] xyz        Cartesian coordinates in physical space after geometry
- *
- * Note abc[3] contains Cartesian coordinates in logical
- * vertex space (before geometry).
+ * \param[in]  n          number of points
+ * \param[in]  rst        tree-local reference coordinates : [0,1]^2,
+ *                        3 per point.  Note: rst[3 * i + 2] is never accessed
+ * \param[out] xyz        Cartesian coordinates in physical space after
+ *                        geometry, 3 per point.  May equal \a rst.
  */
 static void
-p4est_geometry_disk2d_X (p4est_geometry_t * geom,
-                         p4est_topidx_t which_tree,
-                         const double rst[3], double xyz[3])
+p4est_geometry_disk2d_X_batch (p4est_geometry_t * geom,
+                               p4est_topidx_t which_tree, size_t n,
+                               const double *rst, double *xyz)
 {
   const p4est_geometry_builtin_disk2d_t *disk2d
     = &((p4est_geometry_builtin_t *) geom)->p.disk2d;
-  double              x, y, R, q;
-  double              abc[3];
-
-  (void) y;
-
-  /* in 2D z is ZERO ! */
-  xyz[2] = 0.0;
-
-  /* transform from the reference cube [0,1]^3 into logical vertex space
-     using bi/trilinear transformation */
-  p4est_geometry_connectivity_X (geom, which_tree, rst, abc);
+  double              x, R, q;
+  double              cq[2], cx[2];
+  size_t              zz;
 
   /*
    * assert that input points are in the expected range
@@ -468,17 +925,40 @@ p4est_geometry_disk2d_X (p4est_geometry_t * geom,
    */
   P4EST_ASSERT (disk2d->type == P4EST_GEOMETRY_BUILTIN_DISK2D);
   P4EST_ASSERT (0 <= which_tree && which_tree < 5);
-  P4EST_ASSERT (abc[0] < 1.0 + SC_1000_EPS && abc[0] > -1.0 - SC_1000_EPS);
-  if (which_tree < 4)
-    P4EST_ASSERT (abc[1] < 2.0 + SC_1000_EPS && abc[1] > 1.0 - SC_1000_EPS);
-  else
-    P4EST_ASSERT (abc[1] < 1.0 + SC_1000_EPS && abc[1] > -1.0 - SC_1000_EPS);
 
-  /* abc[2] is always 0 here and so unused in 2D ... */
+  /* transform from the reference cube [0,1]^3 into logical vertex space
+     using bi/trilinear transformation */
+  p4est_geometry_cached_X_batch (geom, which_tree, n, rst, xyz);
 
-  if (which_tree < 4) {
+  if (which_tree == 4) {
+    /* center square */
+    for (zz = 0; zz < n; ++zz) {
+      double             *abc = xyz + 3 * zz;
+
+      P4EST_ASSERT (abc[0] < 1.0 + SC_1000_EPS
+                    && abc[0] > -1.0 - SC_1000_EPS);
+      P4EST_ASSERT (abc[1] < 1.0 + SC_1000_EPS
+                    && abc[1] > -1.0 - SC_1000_EPS);
+
+      abc[0] *= disk2d->Clength;
+      abc[1] *= disk2d->Clength;
+      abc[2] = 0.0;
+    }
+    return;
+  }
+
+  /* assign correct coordinates based on patch id */
+  p4est_geometry_patch2d (which_tree, -1., cq, cx);
+
+  for (zz = 0; zz < n; ++zz) {
+    double             *abc = xyz + 3 * zz;
     double              p, tanx;
 
+    P4EST_ASSERT (abc[0] < 1.0 + SC_1000_EPS && abc[0] > -1.0 - SC_1000_EPS);
+    P4EST_ASSERT (abc[1] < 2.0 + SC_1000_EPS && abc[1] > 1.0 - SC_1000_EPS);
+
+    /* abc[2] is always 0 here and so unused in 2D ... */
+
     p = 2.0 - abc[1];
     tanx = -tan (abc[0] * M_PI_4);      /* x = tan (theta) */
 
@@ -491,39 +971,97 @@ p4est_geometry_disk2d_X (p4est_geometry_t * geom,
     /* q = R / sqrt (x * x + 1.); */
     q = R / sqrt (1. + (1. - p) * (tanx * tanx) + 1. * p);
 
-    /* assign correct coordinates based on patch id */
-    switch (which_tree) {
-    case 0:                    /* bottom */
-      xyz[0] = +q;              /*   R*cos(theta) */
-      xyz[1] = +q * x;          /*   R*sin(theta) */
-      break;
-    case 1:                    /* right */
-      xyz[0] = +q * x;          /*   R*sin(theta) = R*cos(theta-PI/2) */
-      xyz[1] = -q;              /* - R*cos(theta) = R*sin(theta-PI/2) */
-      break;
-    case 2:                    /* top */
-      xyz[0] = -q;              /* - R*cos(theta) = R*cos(theta-PI) */
-      xyz[1] = -q * x;          /* - R*sin(theta) = R*sin(theta-PI) */
-      break;
-    case 3:                    /* left */
-      xyz[0] = -q * x;          /* -R*sin(theta) = R*cos(theta-3*PI/2) */
-      xyz[1] = +q;              /*  R*cos(theta) = R*sin(theta-3*PI/2) */
-      break;
-    default:
-      SC_ABORT_NOT_REACHED ();
-    }
-
+    abc[0] = q * (cq[0] + cx[0] * x);
+    abc[1] = q * (cq[1] + cx[1] * x);
+    abc[2] = 0.0;
   }
-  else {
+}                               /* p4est_geometry_disk2d_X_batch */
 
-    /* center square */
-    xyz[0] = abc[0] * disk2d->Clength;
-    xyz[1] = abc[1] * disk2d->Clength;
-    xyz[2] = 0.0;
+/**
+ * geometric coordinate transformation for disk2d geometry.
+ *
+ * Define the geometric transformation from tree-local reference coordinates 
+ * to physical space.
+ *
+ * \param[in]  geom       associated geometry
+ * \param[in]  which_tree tree id inside forest
+ * \param[in]  rst        tree-local reference coordinates : [0,1]^2.
+ *                        Note: rst[2] is never accessed.
+ * \param[out] xyz        Cartesian coordinates in physical space after geometry
+ *
+ * Note abc[3] contains Cartesian coordinates in logical
+ * vertex space (before geometry).
+ */
+static void
+p4est_geometry_disk2d_X (p4est_geometry_t * geom,
+                         p4est_topidx_t which_tree,
+                         const double rst[3], double xyz[3])
+{
+  p4est_geometry_disk2d_X_batch (geom, which_tree, 1, rst, xyz);
+}                               /* p4est_geometry_disk2d_X */
+
+/**
+ * Jacobian of the disk2d geometry.
+ *
+ * \param[in]  geom       associated geometry
+ * \param[in]  which_tree tree id inside forest
+ * \param[in]  rst        tree-local reference coordinates : [0,1]^2.
+ *                        Note: rst[2] is never accessed.
+ * \param[out] J          derivatives of xyz by rst, third column zero
+ */
+static void
+p4est_geometry_disk2d_J (p4est_geometry_t * geom,
+                         p4est_topidx_t which_tree,
+                         const double rst[3], double J[3][3])
+{
+  const p4est_geometry_builtin_disk2d_t *disk2d
+    = &((p4est_geometry_builtin_t *) geom)->p.disk2d;
+  double              abc[3], M[3][3];
+  double              cq[2], cx[2];
+  double              p, tanx, dtanx, x, dx[2], s, ds[2], R, q, dq[2], w;
+  int                 i, k;
+
+  P4EST_ASSERT (disk2d->type == P4EST_GEOMETRY_BUILTIN_DISK2D);
+  P4EST_ASSERT (0 <= which_tree && which_tree < 5);
+
+  p4est_geometry_cached_J (geom, which_tree, rst, J);
 
+  /* derivatives of the physical by the vertex coordinates */
+  memset (M, 0, sizeof (M));
+  if (which_tree == 4) {
+    /* center square */
+    M[0][0] = M[1][1] = disk2d->Clength;
+    p4est_geometry_chain_J (M, J);
+    return;
   }
 
-}                               /* p4est_geometry_disk2d_X */
+  p4est_geometry_patch2d (which_tree, -1., cq, cx);
+  p4est_geometry_cached_X (geom, which_tree, rst, abc);
+
+  p = 2.0 - abc[1];
+  tanx = -tan (abc[0] * M_PI_4);
+  dtanx = -M_PI_4 * (1. + tanx * tanx);
+  x = p * (-abc[0]) + (1. - p) * tanx;
+  dx[0] = -p + (1. - p) * dtanx;
+  dx[1] = abc[0] + tanx;
+
+  s = 1. + (1. - p) * (tanx * tanx) + 1. * p;
+  ds[0] = 2. * (1. - p) * tanx * dtanx;
+  ds[1] = tanx * tanx - 1.;
+
+  R = disk2d->R0sqrbyR1 * pow (disk2d->R1byR0, abc[1]);
+  q = R / sqrt (s);
+  dq[0] = -.5 * q * ds[0] / s;
+  dq[1] = q * disk2d->R0log - .5 * q * ds[1] / s;
+
+  for (i = 0; i < 2; ++i) {
+    w = cq[i] + cx[i] * x;
+    for (k = 0; k < 2; ++k) {
+      M[i][k] = dq[k] * w + q * cx[i] * dx[k];
+    }
+  }
+  p4est_geometry_chain_J (M, J);
+}                               /* p4est_geometry_disk2d_J */
 
 p4est_geometry_t   *
 p4est_geometry_new_disk2d (p4est_connectivity_t * conn, double R0, double R1)
@@ -532,6 +1070,7 @@ p4est_geometry_new_disk2d (p4est_connectivity_t * conn, double R0, double R1)
   struct p4est_geometry_builtin_disk2d *disk2d;
 
   builtin = P4EST_ALLOC_ZERO (p4est_geometry_builtin_t, 1);
+  builtin->cache = p4est_geometry_cache_new (conn);
 
   disk2d = &builtin->p.disk2d;
   disk2d->type = P4EST_GEOMETRY_BUILTIN_DISK2D;
@@ -550,11 +1089,58 @@ p4est_geometry_new_disk2d (p4est_connectivity_t * conn, double R0, double R1)
   builtin->geom.name = "p4est_disk2d";
   builtin->geom.user = conn;
   builtin->geom.X = p4est_geometry_disk2d_X;
+  builtin->geom.X_batch = p4est_geometry_disk2d_X_batch;
+  builtin->geom.J = p4est_geometry_disk2d_J;
+  builtin->geom.destroy = p4est_geometry_cached_destroy;
 
   return (p4est_geometry_t *) builtin;
 
 }                               /* p4est_geometry_new_disk2d */
 
+/**
+ * geometric coordinate transformation for many points of the sphere2d
+ * geometry.
+ *
+ * \param[in]  geom       associated geometry
+ * \param[in]  which_tree tree id inside forest
+ * \param[in]  n          number of points
+ * \param[in]  rst        tree-local reference coordinates : [0,1]^2,
+ *                        3 per point.  Note: rst[3 * i + 2] is never accessed
+ * \param[out] xyz        Cartesian coordinates in physical space after
+ *                        geometry, 3 per point.  May equal \a rst.
+ */
+static void
+p4est_geometry_sphere2d_X_batch (p4est_geometry_t * geom,
+                                 p4est_topidx_t which_tree, size_t n,
+                                 const double *rst, double *xyz)
+{
+  const struct p4est_geometry_builtin_sphere2d *sphere2d
+    = &((p4est_geometry_builtin_t *) geom)->p.sphere2d;
+  const double        R = sphere2d->R;
+  double              R_on_norm;
+  size_t              zz;
+
+  /* transform from the tree-local reference coordinates into the cube-surface
+   * in physical space using vertex bi/trilinear transformation.
+   */
+  p4est_geometry_cached_X_batch (geom, which_tree, n, rst, xyz);
+
+  for (zz = 0; zz < n; ++zz) {
+    double             *X = xyz + 3 * zz;
+
+    /* align cube center with origin */
+    X[0] -= 0.5;
+    X[1] -= 0.5;
+    X[2] -= 0.5;
+
+    /* normalise to radius R sphere */
+    R_on_norm = R / sqrt (X[0] * X[0] + X[1] * X[1] + X[2] * X[2]);
+    X[0] *= R_on_norm;
+    X[1] *= R_on_norm;
+    X[2] *= R_on_norm;
+  }
+}                               /* p4est_geometry_sphere2d_X_batch */
+
 /**
  * geometric coordinate transformation for sphere2d geometry.
  *
@@ -572,29 +1158,46 @@ static void
 p4est_geometry_sphere2d_X (p4est_geometry_t * geom,
                            p4est_topidx_t which_tree,
                            const double rst[3], double xyz[3])
+{
+  p4est_geometry_sphere2d_X_batch (geom, which_tree, 1, rst, xyz);
+}                               /* p4est_geometry_sphere2d_X */
+
+/**
+ * Jacobian of the sphere2d geometry.
+ *
+ * \param[in]  geom       associated geometry
+ * \param[in]  which_tree tree id inside forest
+ * \param[in]  rst        tree-local reference coordinates : [0,1]^2.
+ *                        Note: rst[2] is never accessed
+ * \param[out] J          derivatives of xyz by rst, third column zero
+ */
+static void
+p4est_geometry_sphere2d_J (p4est_geometry_t * geom,
+                           p4est_topidx_t which_tree,
+                           const double rst[3], double J[3][3])
 {
   const struct p4est_geometry_builtin_sphere2d *sphere2d
     = &((p4est_geometry_builtin_t *) geom)->p.sphere2d;
-  double              R;
-
-  /* transform from the tree-local reference coordinates into the cube-surface
-   * in physical space using vertex bi/trilinear transformation.
-   */
-  p4est_geometry_connectivity_X (geom, which_tree, rst, xyz);
-
-  /* align cube center with origin */
-  xyz[0] -= 0.5;
-  xyz[1] -= 0.5;
-  xyz[2] -= 0.5;
-
-  /* normalise to radius R sphere */
-  R = sphere2d->R;
-  double              R_on_norm =
-    R / sqrt (xyz[0] * xyz[0] + xyz[1] * xyz[1] + xyz[2] * xyz[2]);
-  xyz[0] *= R_on_norm;
-  xyz[1] *= R_on_norm;
-  xyz[2] *= R_on_norm;
-}                               /* p4est_geometry_sphere2d_X */
+  double              X[3], M[3][3];
+  double              norm2, R_on_norm;
+  int                 i, k;
+
+  p4est_geometry_cached_X (geom, which_tree, rst, X);
+  p4est_geometry_cached_J (geom, which_tree, rst, J);
+
+  /* the normalisation projects onto the tangent plane */
+  X[0] -= 0.5;
+  X[1] -= 0.5;
+  X[2] -= 0.5;
+  norm2 = X[0] * X[0] + X[1] * X[1] + X[2] * X[2];
+  R_on_norm = sphere2d->R / sqrt (norm2);
+  for (i = 0; i < 3; ++i) {
+    for (k = 0; k < 3; ++k) {
+      M[i][k] = R_on_norm * ((i == k ? 1. : 0.) - X[i] * X[k] / norm2);
+    }
+  }
+  p4est_geometry_chain_J (M, J);
+}                               /* p4est_geometry_sphere2d_J */
 
 p4est_geometry_t   *
 p4est_geometry_new_sphere2d (p4est_connectivity_t * conn, double R)
@@ -603,6 +1206,7 @@ p4est_geometry_new_sphere2d (p4est_connectivity_t * conn, double R)
   struct p4est_geometry_builtin_sphere2d *sphere2d;
 
   builtin = P4EST_ALLOC_ZERO (p4est_geometry_builtin_t, 1);
+  builtin->cache = p4est_geometry_cache_new (conn);
 
   sphere2d = &builtin->p.sphere2d;
   sphere2d->type = P4EST_GEOMETRY_BUILTIN_SPHERE2D;
@@ -611,6 +1215,9 @@ p4est_geometry_new_sphere2d (p4est_connectivity_t * conn, double R)
   builtin->geom.name = "p4est_sphere2d";
   builtin->geom.user = conn;
   builtin->geom.X = p4est_geometry_sphere2d_X;
+  builtin->geom.X_batch = p4est_geometry_sphere2d_X_batch;
+  builtin->geom.J = p4est_geometry_sphere2d_J;
+  builtin->geom.destroy = p4est_geometry_cached_destroy;
 
   return (p4est_geometry_t *) builtin;
 }                               /* p4est_geometry_new_sphere2d */
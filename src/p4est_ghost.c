@@ -49,6 +49,29 @@
 #include <winsock2.h>
 #endif
 
+/* neighborhood collectives are part of MPI-3 */
+#if defined P4EST_ENABLE_MPI && defined MPI_VERSION && MPI_VERSION >= 3
+#define P4EST_GHOST_NEIGHBORHOOD
+#endif
+
+#ifdef P4EST_ENABLE_MPICOMMSHARED
+
+/** Send buffer of a ghost plan in a window shared within the node.
+ * The processes of a node read their ghost data directly from the
+ * packed send buffers of their node peers instead of messaging.
+ */
+struct p4est_ghost_shared
+{
+  MPI_Comm            nodecomm;         /**< Processes of this node */
+  MPI_Win             win;              /**< Holds the plan's send buffer */
+  int                 num_peers;        /**< Node peers we have ghosts of */
+  int                *peers;            /**< Their ranks in the forest */
+  const char        **sources;          /**< Our data in their windows */
+  int8_t             *on_node;          /**< Flag per rank in the forest */
+};
+
+#endif /* P4EST_ENABLE_MPICOMMSHARED */
+
 typedef enum
 {
   P4EST_GHOST_UNBALANCED_ABORT = 0,
@@ -57,13 +80,405 @@ typedef enum
 }
 p4est_ghost_tolerance_t;
 
+/** Open addressing hash table of the ghost quadrants. */
+struct p4est_ghost_index
+{
+  size_t              mask;     /**< Number of slots minus one */
+  int                 minlevel, maxlevel;       /**< Range of ghost levels */
+  p4est_locidx_t     *slots;    /**< Ghost number plus one or zero */
+};
+
+/** Compact storage of the ghosts and mirrors, see p4est_ghost_set_compact.
+ * The trees of ghosts and mirrors follow from the tree offsets. */
+struct p4est_ghost_compact
+{
+  p4est_locidx_t      num_ghosts, num_mirrors;
+  uint64_t           *ghost_keys;       /**< Morton index on the level */
+  int8_t             *ghost_levels;
+  p4est_locidx_t     *ghost_local_nums; /**< Local number on the owner */
+  p4est_locidx_t     *mirror_local_nums;        /**< Local quadrant numbers */
+  size_t             *mirror_proc_bytes;        /**< mpisize + 1 offsets */
+  unsigned char      *mirror_proc_deltas;       /**< Variable length deltas */
+  int                 fronts_alias;     /**< Fronts were the mirror lists */
+  int                 had_index;        /**< Rebuild the hash index */
+};
+
 size_t
 p4est_ghost_memory_used (p4est_ghost_t * ghost)
 {
-  return sizeof (p4est_ghost_t) +
+  size_t              mem;
+  p4est_ghost_compact_t *compact = ghost->compact;
+
+  mem = sizeof (p4est_ghost_t) +
     sc_array_memory_used (&ghost->ghosts, 0) +
-    (ghost->mpisize + 1) * sizeof (p4est_locidx_t) +
-    (ghost->num_trees + 1) * sizeof (p4est_locidx_t);
+    sc_array_memory_used (&ghost->mirrors, 0) +
+    2 * (ghost->mpisize + 1) * sizeof (p4est_locidx_t) +
+    2 * (ghost->num_trees + 1) * sizeof (p4est_locidx_t);
+  if (ghost->mirror_proc_mirrors != NULL) {
+    mem += ghost->mirror_proc_offsets[ghost->mpisize] *
+      sizeof (p4est_locidx_t);
+  }
+  if (ghost->mirror_proc_fronts != NULL &&
+      ghost->mirror_proc_fronts != ghost->mirror_proc_mirrors) {
+    mem += (ghost->mpisize + 1 +
+            ghost->mirror_proc_front_offsets[ghost->mpisize]) *
+      sizeof (p4est_locidx_t);
+  }
+  if (ghost->index != NULL) {
+    mem += sizeof (p4est_ghost_index_t) +
+      (ghost->index->mask + 1) * sizeof (p4est_locidx_t);
+  }
+  if (compact != NULL) {
+    mem += sizeof (p4est_ghost_compact_t) +
+      compact->num_ghosts * (sizeof (uint64_t) + sizeof (int8_t) +
+                             sizeof (p4est_locidx_t)) +
+      compact->num_mirrors * sizeof (p4est_locidx_t) +
+      (ghost->mpisize + 1) * sizeof (size_t) +
+      compact->mirror_proc_bytes[ghost->mpisize];
+  }
+  return mem;
+}
+
+/** Compute the hash table position of a quadrant in a tree. */
+static inline size_t
+p4est_ghost_index_hash (p4est_topidx_t which_tree, const p4est_quadrant_t * q)
+{
+  uint64_t            h;
+
+  h = (uint64_t) (uint32_t) q->x;
+  h = h * 0x9e3779b97f4a7c15ULL ^ (uint64_t) (uint32_t) q->y;
+#ifdef P4_TO_P8
+  h = h * 0x9e3779b97f4a7c15ULL ^ (uint64_t) (uint32_t) q->z;
+#endif
+  h = h * 0x9e3779b97f4a7c15ULL ^
+    ((uint64_t) (uint32_t) which_tree << 8 | (uint64_t) q->level);
+
+  /* the final mixing step of splitmix64 */
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  return (size_t) (h ^ (h >> 31));
+}
+
+/** Look up a quadrant in the hash table of a ghost layer.
+ * \return             Its position in the ghosts or -1 if not found.
+ */
+static ssize_t
+p4est_ghost_index_find (p4est_ghost_t * ghost, p4est_topidx_t which_tree,
+                        const p4est_quadrant_t * q)
+{
+  p4est_ghost_index_t *index = ghost->index;
+  size_t              pos;
+  p4est_locidx_t      slot;
+  p4est_quadrant_t   *g;
+
+  for (pos = p4est_ghost_index_hash (which_tree, q) & index->mask;;
+       pos = (pos + 1) & index->mask) {
+    if ((slot = index->slots[pos]) == 0) {
+      return -1;
+    }
+    g = p4est_quadrant_array_index (&ghost->ghosts, (size_t) (slot - 1));
+    if (g->p.which_tree == which_tree && p4est_quadrant_is_equal (g, q)) {
+      return (ssize_t) (slot - 1);
+    }
+  }
+}
+
+void
+p4est_ghost_set_index (p4est_ghost_t * ghost, int enable)
+{
+  size_t              zz, num_slots, pos;
+  p4est_ghost_index_t *index;
+  p4est_quadrant_t   *g;
+
+  if (ghost->index != NULL) {
+    P4EST_FREE (ghost->index->slots);
+    P4EST_FREE (ghost->index);
+    ghost->index = NULL;
+  }
+  if (!enable) {
+    return;
+  }
+
+  /* keep the table at most half full */
+  num_slots = 16;
+  while (num_slots < 2 * ghost->ghosts.elem_count) {
+    num_slots *= 2;
+  }
+  index = ghost->index = P4EST_ALLOC (p4est_ghost_index_t, 1);
+  index->mask = num_slots - 1;
+  index->minlevel = P4EST_QMAXLEVEL + 1;
+  index->maxlevel = -1;
+  index->slots = P4EST_ALLOC_ZERO (p4est_locidx_t, num_slots);
+  for (zz = 0; zz < ghost->ghosts.elem_count; ++zz) {
+    g = p4est_quadrant_array_index (&ghost->ghosts, zz);
+    index->minlevel = SC_MIN (index->minlevel, (int) g->level);
+    index->maxlevel = SC_MAX (index->maxlevel, (int) g->level);
+    pos = p4est_ghost_index_hash (g->p.which_tree, g) & index->mask;
+    while (index->slots[pos] != 0) {
+      pos = (pos + 1) & index->mask;
+    }
+    index->slots[pos] = (p4est_locidx_t) zz + 1;
+  }
+}
+
+static void
+p4est_ghost_compact_destroy (p4est_ghost_compact_t * compact)
+{
+  P4EST_FREE (compact->ghost_keys);
+  P4EST_FREE (compact->ghost_levels);
+  P4EST_FREE (compact->ghost_local_nums);
+  P4EST_FREE (compact->mirror_local_nums);
+  P4EST_FREE (compact->mirror_proc_bytes);
+  P4EST_FREE (compact->mirror_proc_deltas);
+  P4EST_FREE (compact);
+}
+
+/** Append a signed difference as a zigzag varint to a byte array. */
+static size_t
+p4est_ghost_compact_put (unsigned char *bytes, int64_t delta)
+{
+  size_t              nb = 0;
+  uint64_t            u;
+
+  u = ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63);
+  while (u >= 0x80) {
+    bytes[nb++] = (unsigned char) (u | 0x80);
+    u >>= 7;
+  }
+  bytes[nb++] = (unsigned char) u;
+  return nb;
+}
+
+/** Read a zigzag varint written by p4est_ghost_compact_put. */
+static size_t
+p4est_ghost_compact_get (const unsigned char *bytes, int64_t * delta)
+{
+  size_t              nb = 0;
+  int                 shift = 0;
+  uint64_t            u = 0;
+
+  do {
+    u |= (uint64_t) (bytes[nb] & 0x7f) << shift;
+    shift += 7;
+  }
+  while (bytes[nb++] & 0x80);
+  *delta = (int64_t) (u >> 1) ^ -(int64_t) (u & 1);
+  return nb;
+}
+
+void
+p4est_ghost_compact_ghost (p4est_ghost_t * ghost, p4est_locidx_t n,
+                           p4est_quadrant_t * q)
+{
+  p4est_ghost_compact_t *compact = ghost->compact;
+  p4est_topidx_t      lo, hi, mid;
+
+  P4EST_ASSERT (0 <= n && n < ghost->proc_offsets[ghost->mpisize]);
+  if (compact == NULL) {
+    *q = *p4est_quadrant_array_index (&ghost->ghosts, (size_t) n);
+    return;
+  }
+
+  /* find the last tree whose offset is at most n */
+  lo = 0;
+  hi = ghost->num_trees - 1;
+  while (lo < hi) {
+    mid = lo + (hi - lo + 1) / 2;
+    if (ghost->tree_offsets[mid] <= n) {
+      lo = mid;
+    }
+    else {
+      hi = mid - 1;
+    }
+  }
+  P4EST_QUADRANT_INIT (q);
+  p4est_quadrant_set_morton (q, (int) compact->ghost_levels[n],
+                             compact->ghost_keys[n]);
+  q->p.piggy3.which_tree = lo;
+  q->p.piggy3.local_num = compact->ghost_local_nums[n];
+}
+
+p4est_locidx_t
+p4est_ghost_compact_mirror (p4est_ghost_t * ghost, p4est_locidx_t n)
+{
+  P4EST_ASSERT (0 <= n && n < ghost->mirror_tree_offsets[ghost->num_trees]);
+  if (ghost->compact == NULL) {
+    return p4est_quadrant_array_index (&ghost->mirrors, (size_t) n)->
+      p.piggy3.local_num;
+  }
+  return ghost->compact->mirror_local_nums[n];
+}
+
+void
+p4est_ghost_compact_proc_mirrors (p4est_ghost_t * ghost, int p,
+                                  sc_array_t * mirrors)
+{
+  p4est_ghost_compact_t *compact = ghost->compact;
+  p4est_locidx_t      il, count;
+  p4est_locidx_t     *out;
+  const unsigned char *bytes;
+  int64_t             prev, delta;
+
+  P4EST_ASSERT (0 <= p && p < ghost->mpisize);
+  P4EST_ASSERT (mirrors->elem_size == sizeof (p4est_locidx_t));
+  P4EST_ASSERT (ghost->mirror_proc_offsets != NULL);
+  P4EST_ASSERT (compact == NULL || compact->mirror_proc_deltas != NULL);
+
+  count = ghost->mirror_proc_offsets[p + 1] - ghost->mirror_proc_offsets[p];
+  sc_array_resize (mirrors, (size_t) count);
+  out = (p4est_locidx_t *) mirrors->array;
+  if (compact == NULL) {
+    for (il = 0; il < count; ++il) {
+      out[il] = ghost->mirror_proc_mirrors[ghost->mirror_proc_offsets[p] + il];
+    }
+    return;
+  }
+  bytes = compact->mirror_proc_deltas + compact->mirror_proc_bytes[p];
+  prev = -1;
+  for (il = 0; il < count; ++il) {
+    bytes += p4est_ghost_compact_get (bytes, &delta);
+    out[il] = (p4est_locidx_t) (prev += delta);
+  }
+  P4EST_ASSERT (bytes == compact->mirror_proc_deltas +
+                compact->mirror_proc_bytes[p + 1]);
+}
+
+void
+p4est_ghost_set_compact (p4est_t * p4est, p4est_ghost_t * ghost, int enable)
+{
+  p4est_ghost_compact_t *compact = ghost->compact;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      il, num_entries;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  int                 p;
+  int64_t             prev;
+  size_t              nb, full_bytes;
+  unsigned char      *bytes;
+  sc_array_t          view;
+
+  if (!enable == (compact == NULL)) {
+    return;
+  }
+
+  if (!enable) {
+    /* restore the ghost quadrants from their packed form */
+    sc_array_resize (&ghost->ghosts, (size_t) compact->num_ghosts);
+    for (jt = 0; jt < ghost->num_trees; ++jt) {
+      for (il = ghost->tree_offsets[jt]; il < ghost->tree_offsets[jt + 1];
+           ++il) {
+        q = p4est_quadrant_array_index (&ghost->ghosts, (size_t) il);
+        P4EST_QUADRANT_INIT (q);
+        p4est_quadrant_set_morton (q, (int) compact->ghost_levels[il],
+                                   compact->ghost_keys[il]);
+        q->p.piggy3.which_tree = jt;
+        q->p.piggy3.local_num = compact->ghost_local_nums[il];
+      }
+    }
+
+    /* the mirrors are copies of local quadrants */
+    sc_array_resize (&ghost->mirrors, (size_t) compact->num_mirrors);
+    for (jt = 0; jt < ghost->num_trees; ++jt) {
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      for (il = ghost->mirror_tree_offsets[jt];
+           il < ghost->mirror_tree_offsets[jt + 1]; ++il) {
+        q = p4est_quadrant_array_index (&ghost->mirrors, (size_t) il);
+        *q = *p4est_quadrant_array_index (&tree->quadrants, (size_t)
+                                          (compact->mirror_local_nums[il] -
+                                           tree->quadrants_offset));
+        q->p.piggy3.which_tree = jt;
+        q->p.piggy3.local_num = compact->mirror_local_nums[il];
+      }
+    }
+
+    if (compact->mirror_proc_deltas != NULL) {
+      num_entries = ghost->mirror_proc_offsets[ghost->mpisize];
+      ghost->mirror_proc_mirrors = P4EST_ALLOC (p4est_locidx_t, num_entries);
+      for (p = 0; p < ghost->mpisize; ++p) {
+        sc_array_init_data (&view, ghost->mirror_proc_mirrors +
+                            ghost->mirror_proc_offsets[p],
+                            sizeof (p4est_locidx_t), (size_t)
+                            (ghost->mirror_proc_offsets[p + 1] -
+                             ghost->mirror_proc_offsets[p]));
+        p4est_ghost_compact_proc_mirrors (ghost, p, &view);
+      }
+      if (compact->fronts_alias) {
+        ghost->mirror_proc_fronts = ghost->mirror_proc_mirrors;
+      }
+    }
+
+    ghost->compact = NULL;
+    p4est_ghost_set_index (ghost, compact->had_index);
+    p4est_ghost_compact_destroy (compact);
+    return;
+  }
+
+  P4EST_ASSERT (p4est->mpisize == ghost->mpisize);
+  full_bytes = p4est_ghost_memory_used (ghost);
+
+  compact = P4EST_ALLOC_ZERO (p4est_ghost_compact_t, 1);
+  compact->num_ghosts = (p4est_locidx_t) ghost->ghosts.elem_count;
+  compact->num_mirrors = (p4est_locidx_t) ghost->mirrors.elem_count;
+
+  /* ghosts keep their position on their level and their owner's number */
+  compact->ghost_keys = P4EST_ALLOC (uint64_t, compact->num_ghosts);
+  compact->ghost_levels = P4EST_ALLOC (int8_t, compact->num_ghosts);
+  compact->ghost_local_nums = P4EST_ALLOC (p4est_locidx_t,
+                                           compact->num_ghosts);
+  for (il = 0; il < compact->num_ghosts; ++il) {
+    q = p4est_quadrant_array_index (&ghost->ghosts, (size_t) il);
+    compact->ghost_keys[il] = p4est_quadrant_linear_id (q, (int) q->level);
+    compact->ghost_levels[il] = q->level;
+    compact->ghost_local_nums[il] = q->p.piggy3.local_num;
+  }
+
+  /* mirrors are local quadrants and need only their number */
+  compact->mirror_local_nums = P4EST_ALLOC (p4est_locidx_t,
+                                            compact->num_mirrors);
+  for (il = 0; il < compact->num_mirrors; ++il) {
+    q = p4est_quadrant_array_index (&ghost->mirrors, (size_t) il);
+    compact->mirror_local_nums[il] = q->p.piggy3.local_num;
+  }
+
+  /* the mirror lists are ascending per process and differences are small */
+  compact->mirror_proc_bytes = P4EST_ALLOC_ZERO (size_t, ghost->mpisize + 1);
+  if (ghost->mirror_proc_mirrors != NULL) {
+    num_entries = ghost->mirror_proc_offsets[ghost->mpisize];
+    bytes = compact->mirror_proc_deltas =
+      P4EST_ALLOC (unsigned char, 10 * (size_t) num_entries + 1);
+    nb = 0;
+    for (p = 0; p < ghost->mpisize; ++p) {
+      compact->mirror_proc_bytes[p] = nb;
+      prev = -1;
+      for (il = ghost->mirror_proc_offsets[p];
+           il < ghost->mirror_proc_offsets[p + 1]; ++il) {
+        nb += p4est_ghost_compact_put (bytes + nb, (int64_t)
+                                       ghost->mirror_proc_mirrors[il] - prev);
+        prev = ghost->mirror_proc_mirrors[il];
+      }
+    }
+    compact->mirror_proc_bytes[ghost->mpisize] = nb;
+    compact->mirror_proc_deltas =
+      P4EST_REALLOC (bytes, unsigned char, nb + 1);
+
+    compact->fronts_alias =
+      (ghost->mirror_proc_fronts == ghost->mirror_proc_mirrors);
+    if (compact->fronts_alias) {
+      ghost->mirror_proc_fronts = NULL;
+    }
+    P4EST_FREE (ghost->mirror_proc_mirrors);
+    ghost->mirror_proc_mirrors = NULL;
+  }
+
+  /* the hash index refers to the quadrant array and is rebuilt later */
+  compact->had_index = (ghost->index != NULL);
+  p4est_ghost_set_index (ghost, 0);
+  sc_array_reset (&ghost->ghosts);
+  sc_array_reset (&ghost->mirrors);
+  ghost->compact = compact;
+  P4EST_VERBOSEF ("Compact ghost layer uses %llu bytes instead of %llu\n",
+                  (unsigned long long) p4est_ghost_memory_used (ghost),
+                  (unsigned long long) full_bytes);
 }
 
 #ifdef P4EST_ENABLE_MPI
@@ -95,6 +510,11 @@ p4est_ghost_new_local (p4est_t * p4est, p4est_connect_type_t ctype)
   Ppo = (ghost->mpisize = p4est->mpisize) + 1;
   ntpo = (ghost->num_trees = p4est->connectivity->num_trees) + 1;
   ghost->btype = ctype;
+  ghost->neighbor_comm = sc_MPI_COMM_NULL;
+  ghost->tree_fingerprints = NULL;
+  ghost->update_positions = NULL;
+  ghost->index = NULL;
+  ghost->compact = NULL;
 
   /* the ghost and mirror quadrants themselves */
   sc_array_init (&ghost->ghosts, sizeof (p4est_quadrant_t));
@@ -115,7 +535,10 @@ p4est_ghost_new_local (p4est_t * p4est, p4est_connect_type_t ctype)
 
 static p4est_ghost_t *p4est_ghost_new_check (p4est_t * p4est,
                                              p4est_connect_type_t btype,
-                                             p4est_ghost_tolerance_t tol);
+                                             p4est_ghost_tolerance_t tol,
+                                             p4est_ghost_t * old,
+                                             const int8_t * clean,
+                                             const int8_t * selected);
 
 int
 p4est_quadrant_find_owner (p4est_t * p4est, p4est_topidx_t treeid,
@@ -126,6 +549,7 @@ p4est_quadrant_find_owner (p4est_t * p4est, p4est_topidx_t treeid,
 #ifdef P4EST_ENABLE_DEBUG
   int                 dims;
 #endif
+  int                 nface;
   int                 ftransform[P4EST_FTRANSFORM];
   p4est_topidx_t      ntreeid;
   p4est_quadrant_t    nq;
@@ -140,9 +564,9 @@ p4est_quadrant_find_owner (p4est_t * p4est, p4est_topidx_t treeid,
   if (face != -1) {
     P4EST_ASSERT (face >= 0 && face < P4EST_FACES);
     P4EST_ASSERT (treeid >= 0 && treeid < conn->num_trees);
-    ntreeid = conn->tree_to_tree[P4EST_FACES * treeid + face];
-    if (ntreeid == treeid
-        && ((int) conn->tree_to_face[P4EST_FACES * treeid + face] == face)) {
+    ntreeid = p4est_connectivity_face_neighbor_tree (conn, treeid, face,
+                                                     &nface);
+    if (ntreeid == treeid && nface == face) {
       /* This quadrant goes across a face with no neighbor */
       return -1;
     }
@@ -174,10 +598,9 @@ p4est_quadrant_find_owner (p4est_t * p4est, p4est_topidx_t treeid,
     ntreeid = -1;
     for (face = 0; face < P4EST_FACES; ++face) {
       if (quad_contact[face]) {
-        ntreeid = conn->tree_to_tree[P4EST_FACES * treeid + face];
-        if (ntreeid == treeid
-            && ((int) conn->tree_to_face[P4EST_FACES * treeid + face] ==
-                face)) {
+        ntreeid = p4est_connectivity_face_neighbor_tree (conn, treeid, face,
+                                                         &nface);
+        if (ntreeid == treeid && nface == face) {
           /* This quadrant goes across a face with no neighbor */
           return -1;
         }
@@ -301,10 +724,19 @@ p4est_ghost_bsearch (p4est_ghost_t * ghost,
 {
   size_t              start, ended;
 
+  P4EST_ASSERT (ghost->compact == NULL);
+
   if (p4est_ghost_check_range (ghost, which_proc, which_tree, &start, &ended)) {
     ssize_t             result;
     sc_array_t          ghost_view;
 
+    if (ghost->index != NULL && which_tree != -1) {
+      /* the hash table search is restricted to the range afterwards */
+      result = p4est_ghost_index_find (ghost, which_tree, q);
+      return (result < (ssize_t) start || result >= (ssize_t) ended) ?
+        (ssize_t) (-1) : result;
+    }
+
     /* create a per-tree window on the ghost layer */
     sc_array_init_view (&ghost_view, &ghost->ghosts, start, ended - start);
     result = sc_array_bsearch (&ghost_view, q, p4est_quadrant_compare);
@@ -331,6 +763,30 @@ p4est_ghost_contains (p4est_ghost_t * ghost,
     sc_array_t          ghost_view;
     p4est_quadrant_t   *qresult;
 
+    if (ghost->index != NULL && which_tree != -1) {
+      int                 level;
+      ssize_t             found;
+      p4est_quadrant_t    a;
+
+      /* look for q and its ancestors on the levels present */
+      for (level = SC_MIN ((int) q->level, ghost->index->maxlevel);
+           level >= ghost->index->minlevel; --level) {
+        if (level == (int) q->level) {
+          found = p4est_ghost_index_find (ghost, which_tree, q);
+        }
+        else {
+          p4est_quadrant_ancestor (q, level, &a);
+          found = p4est_ghost_index_find (ghost, which_tree, &a);
+        }
+        if (found >= 0) {
+          /* the ghost layer has no overlapping quadrants */
+          return (found < (ssize_t) start || found >= (ssize_t) ended) ?
+            (ssize_t) (-1) : found;
+        }
+      }
+      return -1;
+    }
+
     /* create a per-tree window on the ghost layer */
     sc_array_init_view (&ghost_view, &ghost->ghosts, start, ended - start);
     result = sc_bsearch_range (q, ghost_view.array,
@@ -628,8 +1084,8 @@ p4est_face_quadrant_exists (p4est_t * p4est, p4est_ghost_t * ghost,
   }
 
   /* neighbor is across a tree face */
-  tqtreeid = conn->tree_to_tree[P4EST_FACES * treeid + face];
-  nface = (int) conn->tree_to_face[P4EST_FACES * treeid + face];
+  tqtreeid = p4est_connectivity_face_neighbor_tree (conn, treeid, face,
+                                                    &nface);
   if (tqtreeid == treeid && nface == face) {
     *owner_rank = -1;
     *pface = -1;
@@ -769,7 +1225,7 @@ p4est_quadrant_on_corner_boundary (p4est_t * p4est, p4est_topidx_t treeid,
                                    int corner, const p4est_quadrant_t * q)
 {
   p4est_connectivity_t *conn = p4est->connectivity;
-  int                 face;
+  int                 face, nface;
   int                 on_boundary = 0;
   p4est_quadrant_t    q2;
 #ifdef P4_TO_P8
@@ -837,8 +1293,8 @@ p4est_quadrant_on_corner_boundary (p4est_t * p4est, p4est_topidx_t treeid,
   }
 
   return
-    (conn->tree_to_tree[P4EST_FACES * treeid + face] == treeid &&
-     (int) conn->tree_to_face[P4EST_FACES * treeid + face] == face);
+    (p4est_connectivity_face_neighbor_tree (conn, treeid, face, &nface)
+     == treeid && nface == face);
 }
 
 int
@@ -871,7 +1327,8 @@ p4est_is_balanced (p4est_t * p4est, p4est_connect_type_t btype)
 #endif
   p4est_ghost_t      *gl;
 
-  gl = p4est_ghost_new_check (p4est, btype, P4EST_GHOST_UNBALANCED_FAIL);
+  gl = p4est_ghost_new_check (p4est, btype, P4EST_GHOST_UNBALANCED_FAIL,
+                              NULL, NULL, NULL);
   if (gl == NULL) {
     return 0;
   }
@@ -1419,11 +1876,155 @@ p4est_ghost_test_add (p4est_t * p4est, p4est_ghost_mirror_t * m,
   }
 }
 
+/** For every mirror of a previous ghost layer, list the receiving processes.
+ * \param [in] old       The previous ghost layer.
+ * \param [out] procs    Ascending process numbers for each mirror in turn.
+ * \return               Offsets into \a procs by mirror, one more than the
+ *                       number of mirrors.  Free both arrays when done.
+ */
+static p4est_locidx_t *
+p4est_ghost_mirror_procs (p4est_ghost_t * old, int **procs)
+{
+  const size_t        num_mirrors = old->mirrors.elem_count;
+  int                 p;
+  size_t              zz;
+  p4est_locidx_t      il, mirr;
+  p4est_locidx_t     *offsets, *fill;
+
+  offsets = P4EST_ALLOC_ZERO (p4est_locidx_t, num_mirrors + 1);
+  *procs = P4EST_ALLOC (int, old->mirror_proc_offsets[old->mpisize]);
+  for (il = 0; il < old->mirror_proc_offsets[old->mpisize]; ++il) {
+    ++offsets[old->mirror_proc_mirrors[il] + 1];
+  }
+  for (zz = 0; zz < num_mirrors; ++zz) {
+    offsets[zz + 1] += offsets[zz];
+  }
+  fill = P4EST_ALLOC (p4est_locidx_t, num_mirrors);
+  memcpy (fill, offsets, num_mirrors * sizeof (p4est_locidx_t));
+  for (p = 0; p < old->mpisize; ++p) {
+    for (il = old->mirror_proc_offsets[p];
+         il < old->mirror_proc_offsets[p + 1]; ++il) {
+      mirr = old->mirror_proc_mirrors[il];
+      (*procs)[fill[mirr]++] = p;
+    }
+  }
+  P4EST_FREE (fill);
+  return offsets;
+}
+
+/** Record the mirrors of an unchanged tree from a previous ghost layer.
+ * \param [in] m        The temporary data structure to work on.
+ * \param [in] old      The previous ghost layer, which is not expanded.
+ * \param [in] offsets  Result of \ref p4est_ghost_mirror_procs.
+ * \param [in] procs    Result of \ref p4est_ghost_mirror_procs.
+ * \param [in] tree     Local tree with the same quadrants as before.
+ * \param [in] nt       Number of this tree.
+ */
+static void
+p4est_ghost_mirror_reuse (p4est_ghost_mirror_t * m, p4est_ghost_t * old,
+                          const p4est_locidx_t * offsets, const int *procs,
+                          p4est_tree_t * tree, p4est_topidx_t nt)
+{
+  const p4est_locidx_t first = old->mirror_tree_offsets[nt];
+  const p4est_locidx_t last = old->mirror_tree_offsets[nt + 1];
+  ssize_t             found;
+  p4est_locidx_t      ml, k, shift, number;
+  p4est_quadrant_t   *q;
+
+  if (first == last) {
+    return;
+  }
+
+  /* the local numbers of the tree have moved by one common shift */
+  q = p4est_quadrant_array_index (&old->mirrors, (size_t) first);
+  found = sc_array_bsearch (&tree->quadrants, q, p4est_quadrant_compare);
+  P4EST_ASSERT (found >= 0);
+  shift = tree->quadrants_offset + (p4est_locidx_t) found -
+    q->p.piggy3.local_num;
+
+  for (ml = first; ml < last; ++ml) {
+    q = p4est_quadrant_array_index (&old->mirrors, (size_t) ml);
+    number = q->p.piggy3.local_num + shift;
+    P4EST_ASSERT (p4est_quadrant_is_equal
+                  (q, p4est_quadrant_array_index
+                   (&tree->quadrants,
+                    (size_t) (number - tree->quadrants_offset))));
+    m->known = 0;
+    for (k = offsets[ml]; k < offsets[ml + 1]; ++k) {
+      p4est_ghost_mirror_add (m, nt, number, q, procs[k]);
+    }
+  }
+}
+
+/** Check whether we send the same mirrors to a process as before.
+ * \param [in] old      The previous ghost layer.
+ * \param [in] p        The receiving process.
+ * \param [in] buf      The quadrants to be sent to \a p now.
+ * \return              True if \a buf is identical to the old mirrors
+ *                      for \a p, including tree and local numbers.
+ */
+static int
+p4est_ghost_mirrors_unchanged (p4est_ghost_t * old, int p, sc_array_t * buf)
+{
+  const p4est_locidx_t first = old->mirror_proc_offsets[p];
+  const p4est_locidx_t last = old->mirror_proc_offsets[p + 1];
+  p4est_locidx_t      il;
+  p4est_quadrant_t   *q1, *q2;
+
+  if ((size_t) (last - first) != buf->elem_count) {
+    return 0;
+  }
+  for (il = first; il < last; ++il) {
+    q1 = p4est_quadrant_array_index (&old->mirrors,
+                                     (size_t) old->mirror_proc_mirrors[il]);
+    q2 = p4est_quadrant_array_index (buf, (size_t) (il - first));
+    if (!p4est_quadrant_is_equal_piggy (q1, q2) ||
+        q1->p.piggy3.local_num != q2->p.piggy3.local_num) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/** Record the count round and the quadrant round of a ghost exchange.
+ * Quadrant messages are only sent for positive counts.
+ */
+static void
+p4est_ghost_inspect_comm (p4est_t * p4est,
+                          p4est_inspect_algorithm_t algorithm, int num_peers,
+                          const p4est_locidx_t * send_counts,
+                          const p4est_locidx_t * recv_counts)
+{
+  int                 peer;
+  size_t              num_sent, num_received;
+  size_t              bytes_sent, bytes_received;
+
+  if (p4est->inspect == NULL) {
+    return;
+  }
+  num_sent = num_received = (size_t) num_peers;
+  bytes_sent = bytes_received = num_peers * sizeof (p4est_locidx_t);
+  for (peer = 0; peer < num_peers; ++peer) {
+    if (send_counts[peer] > 0) {
+      ++num_sent;
+      bytes_sent += send_counts[peer] * sizeof (p4est_quadrant_t);
+    }
+    if (recv_counts[peer] > 0) {
+      ++num_received;
+      bytes_received += recv_counts[peer] * sizeof (p4est_quadrant_t);
+    }
+  }
+  p4est_inspect_comm (p4est->inspect, algorithm, (size_t) num_peers,
+                      num_sent, bytes_sent, num_received, bytes_received);
+}
+
 #endif /* P4EST_ENABLE_MPI */
 
-static p4est_ghost_t *
-p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
-                       p4est_ghost_tolerance_t tol)
+static p4est_ghost_build_t *
+p4est_ghost_new_check_begin (p4est_t * p4est, p4est_connect_type_t btype,
+                             p4est_ghost_tolerance_t tol,
+                             p4est_ghost_t * old, const int8_t * clean,
+                             const int8_t * selected)
 {
   const p4est_topidx_t num_trees = p4est->connectivity->num_trees;
   const int           num_procs = p4est->mpisize;
@@ -1441,13 +2042,12 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
   int                 full_tree[2], tree_contact[2 * P4EST_DIM];
   int                 urg[P4EST_DIM - 1];
   size_t              pz, zz;
+  size_t              send_bytes;
   p4est_topidx_t      first_local_tree = p4est->first_local_tree;
   p4est_topidx_t      last_local_tree = p4est->last_local_tree;
-#ifdef P4EST_ENABLE_DEBUG
-  p4est_locidx_t      li;
-#endif
   p4est_locidx_t      local_num;
-  p4est_locidx_t      num_ghosts, ghost_offset, skipped;
+  p4est_locidx_t      skipped, *old_offsets;
+  int                *old_procs;
   p4est_locidx_t     *send_counts, *recv_counts;
   p4est_tree_t       *tree;
   p4est_quadrant_t   *q;
@@ -1456,7 +2056,7 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
   sc_array_t          procs[P4EST_DIM - 1];
   sc_array_t         *buf, *quadrants;
   MPI_Request        *recv_request, *send_request;
-  MPI_Request        *recv_load_request, *send_load_request;
+  MPI_Request        *send_load_request;
 #ifdef P4_TO_P8
   int                 edge, nedge;
   p8est_edge_info_t   ei;
@@ -1468,9 +2068,6 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
   int                 nc0, nc1;
   int                 oppedge;
   int                 n1ur_proc;
-#endif
-#ifdef P4EST_ENABLE_DEBUG
-  p4est_quadrant_t   *q2;
 #endif
   int                 ftransform[P4EST_FTRANSFORM];
   int32_t             touch;
@@ -1480,13 +2077,14 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
   sc_array_t         *cta;
   size_t              ctree;
   p4est_ghost_mirror_t m;
+  p4est_topidx_t      nt;
 #endif
-  size_t             *ppz;
-  sc_array_t          split;
   sc_array_t         *ghost_layer;
-  p4est_topidx_t      nt;
   p4est_ghost_t      *gl;
+  p4est_ghost_build_t *build;
+  double              inspect_start;
 
+  inspect_start = p4est_inspect_start (p4est->inspect);
   P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_ghost_new %s\n",
                             p4est_connect_type_string (btype));
   p4est_log_indent_push ();
@@ -1495,6 +2093,11 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
   gl->mpisize = num_procs;
   gl->num_trees = num_trees;
   gl->btype = btype;
+  gl->neighbor_comm = sc_MPI_COMM_NULL;
+  gl->tree_fingerprints = NULL;
+  gl->update_positions = NULL;
+  gl->index = NULL;
+  gl->compact = NULL;
 
   ghost_layer = &gl->ghosts;
   sc_array_init (ghost_layer, sizeof (p4est_quadrant_t));
@@ -1540,8 +2143,15 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
 
   /* initialize structure to keep track of mirror quadrants */
   p4est_ghost_mirror_init (gl, p4est->mpirank, &send_bufs, &m);
+  old_offsets = NULL;
+  old_procs = NULL;
+  if (clean != NULL) {
+    P4EST_ASSERT (old != NULL);
+    old_offsets = p4est_ghost_mirror_procs (old, &old_procs);
+  }
 
   /* loop over all local trees */
+  P4EST_REGION_BEGIN ("ghost.new.mirrors");
   local_num = 0;
   for (nt = 0; nt < first_local_tree; ++nt) {
     /* does nothing if this processor is empty */
@@ -1554,11 +2164,24 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
     p4est_comm_tree_info (p4est, nt, full_tree, tree_contact, NULL, NULL);
     gl->mirror_tree_offsets[nt] = (p4est_locidx_t) gl->mirrors.elem_count;
 
+    if (clean != NULL && clean[nt]) {
+      /* the mirrors of an unchanged tree need no owner search */
+      p4est_ghost_mirror_reuse (&m, old, old_offsets, old_procs, tree, nt);
+      local_num += (p4est_locidx_t) quadrants->elem_count;
+      skipped += (p4est_locidx_t) quadrants->elem_count;
+      continue;
+    }
+
     /* Find the smaller neighboring processors of each quadrant */
     for (zz = 0; zz < quadrants->elem_count; ++local_num, ++zz) {
       q = p4est_quadrant_array_index (quadrants, zz);
       m.known = 0;
 
+      if (selected != NULL && !selected[local_num]) {
+        /* q is not wanted as a ghost by any other processor */
+        ++skipped;
+        continue;
+      }
       if (p4est_comm_neighborhood_owned
           (p4est, nt, full_tree, tree_contact, q)) {
         /* The 3x3 neighborhood of q is owned by this processor */
@@ -1618,7 +2241,7 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
             if (nnt < 0) {
               continue;
             }
-            nface = (int) conn->tree_to_face[nt * P4EST_FACES + face];
+            p4est_connectivity_face_neighbor_tree (conn, nt, face, &nface);
             nface %= P4EST_FACES;
             touch = ((int32_t) 1 << nface);
             p4est_quadrant_transform_face (&n[0], &n[1], ftransform);
@@ -1764,7 +2387,7 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
               oppedge = edge ^ 1;
               P4EST_ASSERT (p8est_edge_faces[oppedge][1] == face);
             }
-            nface = (int) conn->tree_to_face[nt * P4EST_FACES + face];
+            p4est_connectivity_face_neighbor_tree (conn, nt, face, &nface);
             o = nface / P4EST_FACES;
             nface %= P4EST_FACES;
             ref = p8est_face_permutation_refs[face][nface];
@@ -1984,6 +2607,9 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
   }
 
 failtest:
+  P4EST_REGION_END ("ghost.new.mirrors");
+  P4EST_FREE (old_offsets);
+  P4EST_FREE (old_procs);
   if (tol == P4EST_GHOST_UNBALANCED_FAIL) {
     if (p4est_comm_sync_flag (p4est, failed, MPI_BOR)) {
       p4est_ghost_mirror_reset (gl, &m, 0);
@@ -2008,11 +2634,15 @@ failtest:
   }
 
   /* Count the number of peers that I send to and receive from */
+  P4EST_REGION_BEGIN ("ghost.new.post");
+  send_bytes = 0;
   for (i = 0, num_peers = 0; i < num_procs; ++i) {
     buf = p4est_ghost_array_index (&send_bufs, i);
     if (buf->elem_count > 0)
       ++num_peers;
+    send_bytes += buf->elem_count * sizeof (p4est_quadrant_t);
   }
+  p4est_inspect_alloc (p4est->inspect, P4EST_INSPECT_GHOST, send_bytes);
 
   recv_request = P4EST_ALLOC (MPI_Request, 2 * num_peers);
   send_request = P4EST_ALLOC (MPI_Request, 2 * num_peers);
@@ -2020,7 +2650,6 @@ failtest:
   recv_counts = P4EST_ALLOC (p4est_locidx_t, 2 * num_peers);
   send_counts = recv_counts + num_peers;
 
-  recv_load_request = recv_request + num_peers;
   send_load_request = send_request + num_peers;
 
   /* Post receives for the counts of ghosts to be received */
@@ -2044,6 +2673,10 @@ failtest:
     if (buf->elem_count > 0) {
       peer_proc = i;
       send_counts[peer] = (p4est_locidx_t) buf->elem_count;
+      if (old != NULL && p4est_ghost_mirrors_unchanged (old, i, buf)) {
+        /* the receiver still has these quadrants as ghosts */
+        send_counts[peer] = -1;
+      }
       P4EST_LDEBUGF ("ghost layer post count send %lld to %d\n",
                      (long long) send_counts[peer], peer_proc);
       mpiret = MPI_Isend (send_counts + peer, 1, P4EST_MPI_LOCIDX,
@@ -2054,10 +2687,100 @@ failtest:
     }
   }
 
+  /* Send the ghosts */
+  for (i = 0, peer = 0; i < num_procs; ++i) {
+    buf = p4est_ghost_array_index (&send_bufs, i);
+    if (buf->elem_count > 0) {
+      peer_proc = i;
+      if (send_counts[peer] < 0) {
+        /* the receiver reuses its previous ghosts from us */
+        p4est_inspect_send (p4est->inspect, P4EST_INSPECT_GHOST, peer_proc,
+                            0);
+        send_load_request[peer] = MPI_REQUEST_NULL;
+        ++peer;
+        continue;
+      }
+      P4EST_ASSERT ((p4est_locidx_t) buf->elem_count == send_counts[peer]);
+      p4est_inspect_send (p4est->inspect, P4EST_INSPECT_GHOST, peer_proc,
+                          buf->elem_count * sizeof (p4est_quadrant_t));
+      P4EST_LDEBUGF ("ghost layer post ghost send %lld quadrants to %d\n",
+                     (long long) send_counts[peer], peer_proc);
+      mpiret =
+        MPI_Isend (buf->array,
+                   (int) (send_counts[peer] * sizeof (p4est_quadrant_t)),
+                   MPI_BYTE, peer_proc, P4EST_COMM_GHOST_LOAD, comm,
+                   send_load_request + peer);
+      SC_CHECK_MPI (mpiret);
+      ++peer;
+    }
+  }
+  P4EST_REGION_END ("ghost.new.post");
+
   /* The mirrors can be assembled here since they are defined on the sender */
   p4est_ghost_mirror_reset (gl, &m, 1);
+  for (i = 0; i < P4EST_DIM - 1; ++i) {
+    sc_array_reset (&procs[i]);
+  }
+#endif /* P4EST_ENABLE_MPI */
+
+  build = P4EST_ALLOC_ZERO (p4est_ghost_build_t, 1);
+  build->p4est = p4est;
+  build->ghost = gl;
+  build->old = old;
+#ifdef P4EST_ENABLE_MPI
+  build->skipped = skipped;
+  build->num_peers = num_peers;
+  build->recv_counts = recv_counts;
+  build->send_counts = send_counts;
+  build->recv_request = recv_request;
+  build->send_request = send_request;
+  build->send_bufs = send_bufs;
+#endif
+  build->inspect_time = p4est_inspect_start (p4est->inspect) - inspect_start;
+
+  p4est_log_indent_pop ();
+  return build;
+}
+
+static p4est_ghost_t *
+p4est_ghost_new_check_end (p4est_ghost_build_t * build)
+{
+  p4est_t            *p4est = build->p4est;
+  const double        inspect_start = p4est_inspect_start (p4est->inspect);
+  p4est_ghost_t      *gl = build->ghost;
+  const p4est_topidx_t num_trees = p4est->connectivity->num_trees;
+#ifdef P4EST_ENABLE_MPI
+  const int           num_procs = p4est->mpisize;
+  MPI_Comm            comm = p4est->mpicomm;
+  const int           num_peers = build->num_peers;
+  int                 i;
+  int                 peer, peer_proc;
+  int                 mpiret;
+  size_t              send_bytes;
+#ifdef P4EST_ENABLE_DEBUG
+  p4est_locidx_t      li;
+  p4est_quadrant_t   *q, *q2;
+#endif
+  p4est_locidx_t      num_ghosts, ghost_offset;
+  p4est_locidx_t      old_excl, old_count;
+  p4est_locidx_t     *recv_counts = build->recv_counts;
+  p4est_ghost_t      *old = build->old;
+  sc_array_t         *send_bufs = &build->send_bufs;
+  sc_array_t         *buf;
+  MPI_Request        *recv_request = build->recv_request;
+  MPI_Request        *send_request = build->send_request;
+  MPI_Request        *recv_load_request = recv_request + num_peers;
+  MPI_Request        *send_load_request = send_request + num_peers;
+#endif
+  size_t             *ppz;
+  sc_array_t          split;
+  sc_array_t         *ghost_layer = &gl->ghosts;
+  p4est_topidx_t      nt;
 
+  p4est_log_indent_push ();
+#ifdef P4EST_ENABLE_MPI
   /* Wait for the counts */
+  P4EST_REGION_BEGIN ("ghost.new.receive");
   if (num_peers > 0) {
     mpiret = sc_MPI_Waitall (num_peers, recv_request, MPI_STATUSES_IGNORE);
     SC_CHECK_MPI (mpiret);
@@ -2076,21 +2799,46 @@ failtest:
 #endif
 
   /* Count ghosts */
-  for (peer = 0, num_ghosts = 0; peer < num_peers; ++peer) {
-    P4EST_ASSERT (recv_counts[peer] > 0);
-    num_ghosts += recv_counts[peer];    /* same type */
+  for (i = 0, peer = 0, num_ghosts = 0; i < num_procs; ++i) {
+    buf = p4est_ghost_array_index (send_bufs, i);
+    if (buf->elem_count > 0) {
+      if (recv_counts[peer] < 0) {
+        /* the sender has not changed the ghosts it sent before */
+        P4EST_ASSERT (old != NULL);
+        num_ghosts += old->proc_offsets[i + 1] - old->proc_offsets[i];
+      }
+      else {
+        P4EST_ASSERT (recv_counts[peer] > 0);
+        num_ghosts += recv_counts[peer];        /* same type */
+      }
+      ++peer;
+    }
   }
   P4EST_VERBOSEF ("Total quadrants skipped %lld ghosts to receive %lld\n",
-                  (long long) skipped, (long long) num_ghosts);
+                  (long long) build->skipped, (long long) num_ghosts);
 
   /* Allocate space for the ghosts */
-  sc_array_resize (ghost_layer, (size_t) num_ghosts);
+  p4est_array_resize (ghost_layer, (size_t) num_ghosts);
 
   /* Post receives for the ghosts */
   for (i = 0, peer = 0, ghost_offset = 0; i < num_procs; ++i) {
-    buf = p4est_ghost_array_index (&send_bufs, i);
+    buf = p4est_ghost_array_index (send_bufs, i);
     if (buf->elem_count > 0) {
       peer_proc = i;
+      if (recv_counts[peer] < 0) {
+        /* copy the unchanged ghosts from the previous ghost layer */
+        old_excl = old->proc_offsets[i];
+        old_count = old->proc_offsets[i + 1] - old_excl;
+        P4EST_ASSERT (old_count > 0);
+        memcpy (ghost_layer->array + ghost_offset * sizeof (p4est_quadrant_t),
+                old->ghosts.array + old_excl * sizeof (p4est_quadrant_t),
+                old_count * sizeof (p4est_quadrant_t));
+        recv_load_request[peer] = MPI_REQUEST_NULL;
+        ghost_offset += old_count;
+        ++peer;
+        gl->proc_offsets[i + 1] = ghost_offset;
+        continue;
+      }
       P4EST_LDEBUGF
         ("ghost layer post ghost receive %lld quadrants from %d\n",
          (long long) recv_counts[peer], peer_proc);
@@ -2110,24 +2858,6 @@ failtest:
   }
   P4EST_ASSERT (ghost_offset == num_ghosts);
 
-  /* Send the ghosts */
-  for (i = 0, peer = 0; i < num_procs; ++i) {
-    buf = p4est_ghost_array_index (&send_bufs, i);
-    if (buf->elem_count > 0) {
-      peer_proc = i;
-      P4EST_ASSERT ((p4est_locidx_t) buf->elem_count == send_counts[peer]);
-      P4EST_LDEBUGF ("ghost layer post ghost send %lld quadrants to %d\n",
-                     (long long) send_counts[peer], peer_proc);
-      mpiret =
-        MPI_Isend (buf->array,
-                   (int) (send_counts[peer] * sizeof (p4est_quadrant_t)),
-                   MPI_BYTE, peer_proc, P4EST_COMM_GHOST_LOAD, comm,
-                   send_load_request + peer);
-      SC_CHECK_MPI (mpiret);
-      ++peer;
-    }
-  }
-
   /* Wait for everything */
   if (num_peers > 0) {
     mpiret =
@@ -2138,8 +2868,11 @@ failtest:
       sc_MPI_Waitall (num_peers, send_load_request, MPI_STATUSES_IGNORE);
     SC_CHECK_MPI (mpiret);
   }
+  P4EST_REGION_END ("ghost.new.receive");
 
   /* Clean up */
+  p4est_ghost_inspect_comm (p4est, P4EST_INSPECT_GHOST, num_peers,
+                            build->send_counts, recv_counts);
   P4EST_FREE (recv_counts);
 
 #ifdef P4EST_ENABLE_DEBUG
@@ -2166,14 +2899,13 @@ failtest:
   P4EST_FREE (recv_request);
   P4EST_FREE (send_request);
 
-  for (i = 0; i < num_procs; ++i) {
-    buf = p4est_ghost_array_index (&send_bufs, i);
+  for (i = 0, send_bytes = 0; i < num_procs; ++i) {
+    buf = p4est_ghost_array_index (send_bufs, i);
+    send_bytes += buf->elem_count * sizeof (p4est_quadrant_t);
     sc_array_reset (buf);
   }
-  sc_array_reset (&send_bufs);
-  for (i = 0; i < P4EST_DIM - 1; ++i) {
-    sc_array_reset (&procs[i]);
-  }
+  sc_array_reset (send_bufs);
+  p4est_inspect_free (p4est->inspect, P4EST_INSPECT_GHOST, send_bytes);
 #endif /* P4EST_ENABLE_MPI */
 
   /* calculate tree offsets */
@@ -2207,16 +2939,85 @@ failtest:
   gl->mirror_proc_front_offsets = gl->mirror_proc_offsets;
 
   P4EST_ASSERT (p4est_ghost_is_valid (p4est, gl));
+  if (p4est->inspect != NULL) {
+    p4est_inspect_memory (p4est->inspect, P4EST_INSPECT_GHOST,
+                          p4est_ghost_memory_used (gl));
+  }
+  p4est_inspect_stop (p4est->inspect, P4EST_INSPECT_GHOST,
+                      inspect_start - build->inspect_time);
+  P4EST_FREE (build);
 
   p4est_log_indent_pop ();
   P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_ghost_new\n");
   return gl;
 }
 
+
+static p4est_ghost_t *
+p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
+                       p4est_ghost_tolerance_t tol,
+                       p4est_ghost_t * old, const int8_t * clean,
+                       const int8_t * selected)
+{
+  p4est_ghost_build_t *build;
+
+  build = p4est_ghost_new_check_begin (p4est, btype, tol, old, clean,
+                                       selected);
+  if (build == NULL) {
+    return NULL;
+  }
+  return p4est_ghost_new_check_end (build);
+}
+
 p4est_ghost_t      *
 p4est_ghost_new (p4est_t * p4est, p4est_connect_type_t btype)
 {
-  return p4est_ghost_new_check (p4est, btype, P4EST_GHOST_UNBALANCED_ALLOW);
+  return p4est_ghost_new_check (p4est, btype, P4EST_GHOST_UNBALANCED_ALLOW,
+                                NULL, NULL, NULL);
+}
+
+p4est_ghost_t      *
+p4est_ghost_new_selective (p4est_t * p4est, p4est_connect_type_t btype,
+                           const int8_t * selected)
+{
+  return p4est_ghost_new_check (p4est, btype, P4EST_GHOST_UNBALANCED_ALLOW,
+                                NULL, NULL, selected);
+}
+
+p4est_ghost_build_t *
+p4est_ghost_new_begin (p4est_t * p4est, p4est_connect_type_t btype)
+{
+  return p4est_ghost_new_check_begin (p4est, btype,
+                                      P4EST_GHOST_UNBALANCED_ALLOW,
+                                      NULL, NULL, NULL);
+}
+
+p4est_ghost_t      *
+p4est_ghost_new_end (p4est_ghost_build_t * build)
+{
+  return p4est_ghost_new_check_end (build);
+}
+
+void
+p4est_ghost_new_ensemble (int num_forests, p4est_t * forests[],
+                          p4est_connect_type_t btype,
+                          p4est_ghost_t * ghosts[])
+{
+  int                 f;
+  p4est_ghost_build_t **builds;
+
+  P4EST_ASSERT (num_forests >= 0);
+  builds = P4EST_ALLOC (p4est_ghost_build_t *, num_forests);
+
+  /* messages between two processes are matched in the order of forests */
+  for (f = 0; f < num_forests; ++f) {
+    P4EST_ASSERT (forests[f]->mpisize == forests[0]->mpisize);
+    builds[f] = p4est_ghost_new_begin (forests[f], btype);
+  }
+  for (f = 0; f < num_forests; ++f) {
+    ghosts[f] = p4est_ghost_new_end (builds[f]);
+  }
+  P4EST_FREE (builds);
 }
 
 void
@@ -2238,9 +3039,158 @@ p4est_ghost_destroy (p4est_ghost_t * ghost)
   P4EST_FREE (ghost->mirror_proc_mirrors);
   P4EST_FREE (ghost->mirror_proc_offsets);
 
+  P4EST_FREE (ghost->tree_fingerprints);
+  P4EST_FREE (ghost->update_positions);
+
+  p4est_ghost_set_index (ghost, 0);
+  p4est_ghost_set_neighborhood (NULL, ghost, 0);
+  if (ghost->compact != NULL) {
+    p4est_ghost_compact_destroy (ghost->compact);
+  }
   P4EST_FREE (ghost);
 }
 
+/** Compute a fingerprint of the quadrants in a tree.
+ * It is used to detect trees that have not changed between ghost updates.
+ */
+static uint64_t
+p4est_ghost_tree_fingerprint (p4est_tree_t * tree)
+{
+  const uint64_t      prime = 1099511628211ULL;
+  uint64_t            hash = 14695981039346656037ULL;
+  size_t              zz;
+  p4est_quadrant_t   *q;
+
+  hash = (hash ^ (uint64_t) tree->quadrants.elem_count) * prime;
+  for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+    q = p4est_quadrant_array_index (&tree->quadrants, zz);
+    hash = (hash ^ (uint64_t) (uint32_t) q->x) * prime;
+    hash = (hash ^ (uint64_t) (uint32_t) q->y) * prime;
+#ifdef P4_TO_P8
+    hash = (hash ^ (uint64_t) (uint32_t) q->z) * prime;
+#endif
+    hash = (hash ^ (uint64_t) q->level) * prime;
+  }
+  return hash;
+}
+
+void
+p4est_ghost_update (p4est_t * p4est, p4est_ghost_t * ghost)
+{
+  const p4est_topidx_t num_trees = ghost->num_trees;
+  const int           num_procs = ghost->mpisize;
+  int                 p;
+  int                 reuse, neighborhood, indexed;
+  int8_t             *clean;
+  uint64_t           *fingerprints;
+  p4est_topidx_t      nt;
+  p4est_tree_t       *tree;
+  p4est_ghost_t      *gl, swap;
+
+  P4EST_ASSERT (ghost->compact == NULL);
+
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_ghost_update %s\n",
+                            p4est_connect_type_string (ghost->btype));
+  p4est_log_indent_push ();
+  P4EST_ASSERT (num_procs == p4est->mpisize);
+  P4EST_ASSERT (num_trees == p4est->connectivity->num_trees);
+
+  /* identify the local trees by their current quadrants */
+  fingerprints = P4EST_ALLOC_ZERO (uint64_t, num_trees);
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    fingerprints[nt] = p4est_ghost_tree_fingerprint (tree);
+  }
+
+  /* mirrors depend only on the local quadrants and the partition */
+  reuse = (ghost->tree_fingerprints != NULL &&
+           ghost->mirror_proc_fronts == ghost->mirror_proc_mirrors);
+  for (p = 0; reuse && p <= num_procs; ++p) {
+    reuse = p4est_quadrant_is_equal_piggy (&ghost->update_positions[p],
+                                           &p4est->global_first_position[p]);
+  }
+  clean = NULL;
+  if (reuse) {
+    clean = P4EST_ALLOC_ZERO (int8_t, num_trees);
+    for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+      clean[nt] = (fingerprints[nt] == ghost->tree_fingerprints[nt]);
+    }
+  }
+
+  /* build the new ghost layer, exchanging only changed lists */
+  gl = p4est_ghost_new_check (p4est, ghost->btype,
+                              P4EST_GHOST_UNBALANCED_ALLOW, ghost, clean,
+                              NULL);
+  P4EST_FREE (clean);
+
+  /* move the new contents into place and free the old ones */
+  neighborhood = (ghost->neighbor_comm != sc_MPI_COMM_NULL);
+  indexed = (ghost->index != NULL);
+  swap = *ghost;
+  *ghost = *gl;
+  *gl = swap;
+  p4est_ghost_destroy (gl);
+  ghost->tree_fingerprints = fingerprints;
+  ghost->update_positions = P4EST_ALLOC (p4est_quadrant_t, num_procs + 1);
+  memcpy (ghost->update_positions, p4est->global_first_position,
+          (num_procs + 1) * sizeof (p4est_quadrant_t));
+  if (neighborhood) {
+    p4est_ghost_set_neighborhood (p4est, ghost, 1);
+  }
+  if (indexed) {
+    p4est_ghost_set_index (ghost, 1);
+  }
+
+  p4est_log_indent_pop ();
+  P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_ghost_update\n");
+}
+
+void
+p4est_ghost_set_neighborhood (p4est_t * p4est, p4est_ghost_t * ghost,
+                              int enable)
+{
+  int                 mpiret;
+#ifdef P4EST_GHOST_NEIGHBORHOOD
+  int                 q;
+  int                 indegree, outdegree;
+  int                *sources, *destinations, *weights;
+#endif
+
+  /* the neighbor processes may have changed since the last call */
+  if (ghost->neighbor_comm != sc_MPI_COMM_NULL) {
+    mpiret = sc_MPI_Comm_free (&ghost->neighbor_comm);
+    SC_CHECK_MPI (mpiret);
+    ghost->neighbor_comm = sc_MPI_COMM_NULL;
+  }
+  if (!enable) {
+    return;
+  }
+  P4EST_ASSERT (p4est != NULL && ghost->mpisize == p4est->mpisize);
+
+#ifdef P4EST_GHOST_NEIGHBORHOOD
+  /* we receive from the owners of ghosts and send to those of mirrors */
+  sources = P4EST_ALLOC (int, 3 * ghost->mpisize);
+  destinations = sources + ghost->mpisize;
+  weights = destinations + ghost->mpisize;
+  indegree = outdegree = 0;
+  for (q = 0; q < ghost->mpisize; ++q) {
+    weights[q] = 1;
+    if (ghost->proc_offsets[q + 1] > ghost->proc_offsets[q]) {
+      sources[indegree++] = q;
+    }
+    if (ghost->mirror_proc_offsets[q + 1] > ghost->mirror_proc_offsets[q]) {
+      destinations[outdegree++] = q;
+    }
+  }
+  mpiret = MPI_Dist_graph_create_adjacent
+    (p4est->mpicomm, indegree, sources, weights,
+     outdegree, destinations, weights, MPI_INFO_NULL, 0,
+     &ghost->neighbor_comm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (sources);
+#endif
+}
+
 unsigned
 p4est_ghost_checksum (p4est_t * p4est, p4est_ghost_t * ghost)
 {
@@ -2348,6 +3298,8 @@ p4est_ghost_exchange_data_begin (p4est_t * p4est, p4est_ghost_t * ghost,
   p4est_ghost_exchange_t *exc;
   void              **mirror_data;
 
+  P4EST_ASSERT (ghost->compact == NULL);
+
   /* allocate temporary storage */
   mirror_data = P4EST_ALLOC (void *, ghost->mirrors.elem_count);
 
@@ -2409,6 +3361,238 @@ p4est_ghost_exchange_custom (p4est_t * p4est, p4est_ghost_t * ghost,
                                     mirror_data, ghost_data));
 }
 
+#ifdef P4EST_GHOST_NEIGHBORHOOD
+
+/** Post one neighborhood collective for a custom exchange.
+ * Only the ghosts and mirrors in the level range of \a exc take part.
+ * For the full level range we receive into the ghost data directly,
+ * otherwise into a single buffer that is unpacked on completion.
+ * If \a packed is not NULL, it is sent as is and \a mirror_data is ignored.
+ */
+static void
+p4est_ghost_exchange_neighbor_begin (p4est_ghost_exchange_t * exc,
+                                     void **mirror_data, void *packed)
+{
+  p4est_ghost_t      *ghost = exc->ghost;
+  const int           num_procs = ghost->mpisize;
+  const int           minlevel = exc->minlevel;
+  const int           maxlevel = exc->maxlevel;
+  const int           all_levels =
+    (minlevel <= 0 && maxlevel >= P4EST_QMAXLEVEL);
+  const size_t        data_size = exc->data_size;
+  int                 mpiret;
+  int                 q, indegree, outdegree;
+  int                *rcounts, *rdispls, *scounts, *sdispls;
+  char               *mem, *smem, *rmem, **rbuf, **sbuf;
+  p4est_locidx_t      ng_excl, ng_incl, theg;
+  p4est_locidx_t      lmatches, lsum;
+  p4est_locidx_t      mirr;
+  p4est_quadrant_t   *g, *m;
+
+  rcounts = exc->ncounts = P4EST_ALLOC (int, 4 * num_procs);
+  rdispls = rcounts + num_procs;
+  scounts = rdispls + num_procs;
+  sdispls = scounts + num_procs;
+
+  /* count the data to receive from every source in rank order */
+  indegree = 0;
+  lsum = 0;
+  for (q = 0; q < num_procs; ++q) {
+    ng_excl = ghost->proc_offsets[q];
+    ng_incl = ghost->proc_offsets[q + 1];
+    if (ng_incl > ng_excl) {
+      if (all_levels) {
+        lmatches = ng_incl - ng_excl;
+      }
+      else {
+        for (lmatches = 0, theg = ng_excl; theg < ng_incl; ++theg) {
+          g = p4est_quadrant_array_index (&ghost->ghosts, theg);
+          if (minlevel <= (int) g->level && (int) g->level <= maxlevel) {
+            ++lmatches;
+          }
+        }
+      }
+      rcounts[indegree] = (int) (lmatches * data_size);
+      rdispls[indegree] = (int) (lsum * data_size);
+      lsum += lmatches;
+      ++indegree;
+    }
+  }
+  if (all_levels) {
+    rmem = (char *) exc->ghost_data;
+  }
+  else {
+    rbuf = (char **) sc_array_push (&exc->rbuffers);
+    rmem = *rbuf = P4EST_ALLOC (char, lsum * data_size);
+  }
+
+  /* count the data to send to every destination in rank order */
+  outdegree = 0;
+  lsum = 0;
+  for (q = 0; q < num_procs; ++q) {
+    ng_excl = ghost->mirror_proc_offsets[q];
+    ng_incl = ghost->mirror_proc_offsets[q + 1];
+    if (ng_incl > ng_excl) {
+      if (all_levels) {
+        lmatches = ng_incl - ng_excl;
+      }
+      else {
+        for (lmatches = 0, theg = ng_excl; theg < ng_incl; ++theg) {
+          mirr = ghost->mirror_proc_mirrors[theg];
+          m = p4est_quadrant_array_index (&ghost->mirrors, mirr);
+          if (minlevel <= (int) m->level && (int) m->level <= maxlevel) {
+            ++lmatches;
+          }
+        }
+      }
+      scounts[outdegree] = (int) (lmatches * data_size);
+      sdispls[outdegree] = (int) (lsum * data_size);
+      lsum += lmatches;
+      ++outdegree;
+    }
+  }
+
+  if (packed != NULL) {
+    /* the caller has packed the data for all levels */
+    P4EST_ASSERT (all_levels);
+    smem = (char *) packed;
+  }
+  else {
+    /* pack all outgoing data into one send buffer */
+    sbuf = (char **) sc_array_push (&exc->sbuffers);
+    mem = smem = *sbuf = P4EST_ALLOC (char, lsum * data_size);
+    for (theg = 0; theg < ghost->mirror_proc_offsets[num_procs]; ++theg) {
+      mirr = ghost->mirror_proc_mirrors[theg];
+      P4EST_ASSERT (0 <= mirr && (size_t) mirr < ghost->mirrors.elem_count);
+      m = p4est_quadrant_array_index (&ghost->mirrors, mirr);
+      if (minlevel <= (int) m->level && (int) m->level <= maxlevel) {
+        memcpy (mem, mirror_data[mirr], data_size);
+        mem += data_size;
+      }
+    }
+    P4EST_ASSERT (mem == *sbuf + lsum * data_size);
+  }
+
+  mpiret = MPI_Ineighbor_alltoallv (smem, scounts, sdispls, MPI_BYTE,
+                                    rmem, rcounts, rdispls, MPI_BYTE,
+                                    ghost->neighbor_comm,
+                                    (sc_MPI_Request *)
+                                    sc_array_push (&exc->requests));
+  SC_CHECK_MPI (mpiret);
+}
+
+#endif /* P4EST_GHOST_NEIGHBORHOOD */
+
+/** Post the messages of a custom exchange with compressed payloads.
+ * Every message is received into a buffer of its own that is decoded
+ * into the ghost data in \ref p4est_ghost_exchange_custom_end.
+ */
+static void
+p4est_ghost_exchange_compressed_begin (p4est_ghost_exchange_t * exc,
+                                       void **mirror_data)
+{
+  p4est_t            *p4est = exc->p4est;
+  p4est_ghost_t      *ghost = exc->ghost;
+  const int           num_procs = p4est->mpisize;
+  const size_t        data_size = exc->data_size;
+  int                 mpiret;
+  int                 q;
+  size_t              wire_bytes;
+  char               *raw, *mem, **rbuf, **sbuf;
+  p4est_locidx_t      ng_excl, ng_incl, ng, theg;
+  p4est_locidx_t      mirr;
+  sc_MPI_Request     *r;
+
+  exc->compress = p4est->inspect->ghost_compress;
+  exc->qactive = P4EST_ALLOC (int, num_procs);
+  sc_array_init (&exc->rrequests, sizeof (sc_MPI_Request));
+  sc_array_init (&exc->rbuffers, sizeof (char *));
+
+  /* receive into buffers large enough for an uncompressed payload */
+  for (q = 0; q < num_procs; ++q) {
+    ng_excl = ghost->proc_offsets[q];
+    ng_incl = ghost->proc_offsets[q + 1];
+    ng = ng_incl - ng_excl;
+    P4EST_ASSERT (ng >= 0);
+    if (ng > 0) {
+      wire_bytes = p4est_comm_compress_bound (ng * data_size);
+      exc->qactive[exc->rrequests.elem_count] = q;
+      rbuf = (char **) sc_array_push (&exc->rbuffers);
+      *rbuf = P4EST_ALLOC (char, wire_bytes);
+      r = (sc_MPI_Request *) sc_array_push (&exc->rrequests);
+      mpiret = sc_MPI_Irecv (*rbuf, (int) wire_bytes, sc_MPI_BYTE, q,
+                             P4EST_COMM_GHOST_EXCHANGE, p4est->mpicomm, r);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+
+  /* pack the data for every peer and encode it into its send buffer */
+  for (q = 0; q < num_procs; ++q) {
+    ng_excl = ghost->mirror_proc_offsets[q];
+    ng_incl = ghost->mirror_proc_offsets[q + 1];
+    ng = ng_incl - ng_excl;
+    P4EST_ASSERT (ng >= 0);
+    if (ng > 0) {
+      mem = raw = P4EST_ALLOC (char, ng * data_size);
+      for (theg = ng_excl; theg < ng_incl; ++theg) {
+        mirr = ghost->mirror_proc_mirrors[theg];
+        P4EST_ASSERT (0 <= mirr && (size_t) mirr < ghost->mirrors.elem_count);
+        memcpy (mem, mirror_data[mirr], data_size);
+        mem += data_size;
+      }
+      sbuf = (char **) sc_array_push (&exc->sbuffers);
+      *sbuf = P4EST_ALLOC (char, p4est_comm_compress_bound (ng * data_size));
+      wire_bytes = p4est_comm_compress_pack (exc->compress, raw,
+                                             ng * data_size, *sbuf);
+      P4EST_FREE (raw);
+      r = (sc_MPI_Request *) sc_array_push (&exc->requests);
+      mpiret = sc_MPI_Isend (*sbuf, (int) wire_bytes, sc_MPI_BYTE, q,
+                             P4EST_COMM_GHOST_EXCHANGE, p4est->mpicomm, r);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+}
+
+/** Decode the compressed messages of a custom exchange as they arrive. */
+static void
+p4est_ghost_exchange_compressed_end (p4est_ghost_exchange_t * exc)
+{
+  p4est_ghost_t      *ghost = exc->ghost;
+  const size_t        data_size = exc->data_size;
+  int                 mpiret;
+  int                 i, expected, remaining, received, *peers;
+  int                 q;
+  char              **rbuf;
+  p4est_locidx_t      ng_excl, ng_incl;
+
+  peers = P4EST_ALLOC (int, exc->rrequests.elem_count);
+  expected = remaining = (int) exc->rrequests.elem_count;
+  while (remaining > 0) {
+    mpiret =
+      sc_MPI_Waitsome (expected, (sc_MPI_Request *) exc->rrequests.array,
+                       &received, peers, sc_MPI_STATUSES_IGNORE);
+    SC_CHECK_MPI (mpiret);
+    P4EST_ASSERT (received != sc_MPI_UNDEFINED);
+    P4EST_ASSERT (received > 0);
+    for (i = 0; i < received; ++i) {
+      P4EST_ASSERT (0 <= peers[i] && peers[i] < expected);
+      q = exc->qactive[peers[i]];
+      ng_excl = ghost->proc_offsets[q];
+      ng_incl = ghost->proc_offsets[q + 1];
+      rbuf = (char **) sc_array_index_int (&exc->rbuffers, peers[i]);
+      p4est_comm_compress_unpack (*rbuf, (char *) exc->ghost_data +
+                                  ng_excl * data_size,
+                                  (ng_incl - ng_excl) * data_size);
+      P4EST_FREE (*rbuf);
+    }
+    remaining -= received;
+  }
+  P4EST_FREE (peers);
+  P4EST_FREE (exc->qactive);
+  sc_array_reset (&exc->rrequests);
+  sc_array_reset (&exc->rbuffers);
+}
+
 p4est_ghost_exchange_t *
 p4est_ghost_exchange_custom_begin (p4est_t * p4est, p4est_ghost_t * ghost,
                                    size_t data_size,
@@ -2423,6 +3607,8 @@ p4est_ghost_exchange_custom_begin (p4est_t * p4est, p4est_ghost_t * ghost,
   p4est_ghost_exchange_t *exc;
   sc_MPI_Request     *r;
 
+  P4EST_ASSERT (ghost->compact == NULL);
+
   /* initialize transient storage */
   exc = P4EST_ALLOC_ZERO (p4est_ghost_exchange_t, 1);
   exc->is_custom = 1;
@@ -2440,6 +3626,21 @@ p4est_ghost_exchange_custom_begin (p4est_t * p4est, p4est_ghost_t * ghost,
     return exc;
   }
 
+  /* compress the messages if the forest asks for it */
+  if (p4est->inspect != NULL && p4est->inspect->ghost_compress != NULL &&
+      p4est->inspect->ghost_compress->codec != P4EST_COMM_CODEC_NONE) {
+    p4est_ghost_exchange_compressed_begin (exc, mirror_data);
+    return exc;
+  }
+
+#ifdef P4EST_GHOST_NEIGHBORHOOD
+  /* use a neighborhood collective if the ghost layer provides one */
+  if (ghost->neighbor_comm != sc_MPI_COMM_NULL) {
+    p4est_ghost_exchange_neighbor_begin (exc, mirror_data, NULL);
+    return exc;
+  }
+#endif
+
   /* receive data from other processors */
   ng_excl = 0;
   for (q = 0; q < num_procs; ++q) {
@@ -2498,6 +3699,11 @@ p4est_ghost_exchange_custom_end (p4est_ghost_exchange_t * exc)
   /* don't confuse it with p4est_ghost_exchange_custom_levels_end either */
   P4EST_ASSERT (!exc->is_levels);
 
+  /* decode compressed messages before waiting for the sends */
+  if (exc->compress != NULL) {
+    p4est_ghost_exchange_compressed_end (exc);
+  }
+
   /* wait for messages to complete and clean up */
   mpiret = sc_MPI_Waitall (exc->requests.elem_count, (sc_MPI_Request *)
                            exc->requests.array, sc_MPI_STATUSES_IGNORE);
@@ -2508,250 +3714,1219 @@ p4est_ghost_exchange_custom_end (p4est_ghost_exchange_t * exc)
     P4EST_FREE (*sbuf);
   }
   sc_array_reset (&exc->sbuffers);
+  P4EST_FREE (exc->ncounts);
 
   /* free the store */
   P4EST_FREE (exc);
 }
 
 void
-p4est_ghost_exchange_custom_levels (p4est_t * p4est, p4est_ghost_t * ghost,
-                                    int minlevel, int maxlevel,
-                                    size_t data_size,
-                                    void **mirror_data, void *ghost_data)
+p4est_ghost_exchange_packed (p4est_t * p4est, p4est_ghost_t * ghost,
+                             size_t data_size,
+                             void *send_buffer, void *ghost_data)
 {
-  p4est_ghost_exchange_custom_levels_end
-    (p4est_ghost_exchange_custom_levels_begin (p4est, ghost,
-                                               minlevel, maxlevel, data_size,
-                                               mirror_data, ghost_data));
+  p4est_ghost_exchange_custom_end (p4est_ghost_exchange_packed_begin
+                                   (p4est, ghost, data_size,
+                                    send_buffer, ghost_data));
 }
 
 p4est_ghost_exchange_t *
-p4est_ghost_exchange_custom_levels_begin (p4est_t * p4est,
-                                          p4est_ghost_t * ghost,
-                                          int minlevel, int maxlevel,
-                                          size_t data_size,
-                                          void **mirror_data,
-                                          void *ghost_data)
+p4est_ghost_exchange_packed_begin (p4est_t * p4est, p4est_ghost_t * ghost,
+                                   size_t data_size,
+                                   void *send_buffer, void *ghost_data)
 {
   const int           num_procs = p4est->mpisize;
   int                 mpiret;
   int                 q;
-  int                *theq, *qactive, *qbuffer;
-  char               *mem, **rbuf, **sbuf;
-  p4est_locidx_t      ng_excl, ng_incl, ng, theg;
-  p4est_locidx_t      lmatches;
-  p4est_locidx_t      mirr;
-  p4est_quadrant_t   *g, *m;
+  p4est_locidx_t      ng_excl, ng_incl, ng;
   p4est_ghost_exchange_t *exc;
   sc_MPI_Request     *r;
 
-  if (minlevel <= 0 && maxlevel >= P4EST_QMAXLEVEL) {
-    /* this case can be processed by a more specialized function */
-    exc = p4est_ghost_exchange_custom_begin (p4est, ghost, data_size,
+  /* initialize transient storage */
+  exc = P4EST_ALLOC_ZERO (p4est_ghost_exchange_t, 1);
+  exc->is_custom = 1;
+  exc->p4est = p4est;
+  exc->ghost = ghost;
+  exc->minlevel = 0;
+  exc->maxlevel = P4EST_QMAXLEVEL;
+  exc->data_size = data_size;
+  exc->ghost_data = ghost_data;
+  sc_array_init (&exc->requests, sizeof (sc_MPI_Request));
+  sc_array_init (&exc->sbuffers, sizeof (char *));
+
+  /* return early if there is nothing to do */
+  if (data_size == 0) {
+    return exc;
+  }
+
+#ifdef P4EST_GHOST_NEIGHBORHOOD
+  /* use a neighborhood collective if the ghost layer provides one */
+  if (ghost->neighbor_comm != sc_MPI_COMM_NULL) {
+    p4est_ghost_exchange_neighbor_begin (exc, NULL, send_buffer);
+    return exc;
+  }
+#endif
+
+  /* receive data from other processors */
+  for (q = 0; q < num_procs; ++q) {
+    ng_excl = ghost->proc_offsets[q];
+    ng_incl = ghost->proc_offsets[q + 1];
+    ng = ng_incl - ng_excl;
+    P4EST_ASSERT (ng >= 0);
+    if (ng > 0) {
+      r = (sc_MPI_Request *) sc_array_push (&exc->requests);
+      mpiret = sc_MPI_Irecv ((char *) ghost_data + ng_excl * data_size,
+                             ng * data_size, sc_MPI_BYTE, q,
+                             P4EST_COMM_GHOST_EXCHANGE, p4est->mpicomm, r);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+
+  /* send the caller's buffer sections to other processors */
+  for (q = 0; q < num_procs; ++q) {
+    ng_excl = ghost->mirror_proc_offsets[q];
+    ng_incl = ghost->mirror_proc_offsets[q + 1];
+    ng = ng_incl - ng_excl;
+    P4EST_ASSERT (ng >= 0);
+    if (ng > 0) {
+      r = (sc_MPI_Request *) sc_array_push (&exc->requests);
+      mpiret = sc_MPI_Isend ((char *) send_buffer + ng_excl * data_size,
+                             ng * data_size, sc_MPI_BYTE, q,
+                             P4EST_COMM_GHOST_EXCHANGE, p4est->mpicomm, r);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+
+  /* we are done posting the messages */
+  return exc;
+}
+
+void
+p4est_ghost_exchange_custom_levels (p4est_t * p4est, p4est_ghost_t * ghost,
+                                    int minlevel, int maxlevel,
+                                    size_t data_size,
+                                    void **mirror_data, void *ghost_data)
+{
+  p4est_ghost_exchange_custom_levels_end
+    (p4est_ghost_exchange_custom_levels_begin (p4est, ghost,
+                                               minlevel, maxlevel, data_size,
+                                               mirror_data, ghost_data));
+}
+
+p4est_ghost_exchange_t *
+p4est_ghost_exchange_custom_levels_begin (p4est_t * p4est,
+                                          p4est_ghost_t * ghost,
+                                          int minlevel, int maxlevel,
+                                          size_t data_size,
+                                          void **mirror_data,
+                                          void *ghost_data)
+{
+  const int           num_procs = p4est->mpisize;
+  int                 mpiret;
+  int                 q;
+  int                *theq, *qactive, *qbuffer;
+  char               *mem, **rbuf, **sbuf;
+  p4est_locidx_t      ng_excl, ng_incl, ng, theg;
+  p4est_locidx_t      lmatches;
+  p4est_locidx_t      mirr;
+  p4est_quadrant_t   *g, *m;
+  p4est_ghost_exchange_t *exc;
+  sc_MPI_Request     *r;
+
+  P4EST_ASSERT (ghost->compact == NULL);
+
+  if (minlevel <= 0 && maxlevel >= P4EST_QMAXLEVEL) {
+    /* this case can be processed by a more specialized function */
+    exc = p4est_ghost_exchange_custom_begin (p4est, ghost, data_size,
                                              mirror_data, ghost_data);
     P4EST_ASSERT (exc->is_custom);
     P4EST_ASSERT (!exc->is_levels);
     exc->is_levels = 1;
 
-    /* the completion function will have to switch for this case */
-    return exc;
-  }
+    /* the completion function will have to switch for this case */
+    return exc;
+  }
+
+  /* initialize transient storage */
+  exc = P4EST_ALLOC_ZERO (p4est_ghost_exchange_t, 1);
+  exc->is_custom = 1;
+  exc->is_levels = 1;
+  exc->p4est = p4est;
+  exc->ghost = ghost;
+  exc->minlevel = minlevel;
+  exc->maxlevel = maxlevel;
+  exc->data_size = data_size;
+  exc->ghost_data = ghost_data;
+  sc_array_init (&exc->requests, sizeof (sc_MPI_Request));
+  sc_array_init (&exc->rrequests, sizeof (sc_MPI_Request));
+  sc_array_init (&exc->rbuffers, sizeof (char *));
+  sc_array_init (&exc->sbuffers, sizeof (char *));
+
+  /* return early if there is nothing to do */
+  if (data_size == 0 || minlevel > maxlevel) {
+    return exc;
+  }
+
+#ifdef P4EST_GHOST_NEIGHBORHOOD
+  /* use a neighborhood collective if the ghost layer provides one */
+  if (ghost->neighbor_comm != sc_MPI_COMM_NULL) {
+    p4est_ghost_exchange_neighbor_begin (exc, mirror_data, NULL);
+    return exc;
+  }
+#endif
+  qactive = exc->qactive = P4EST_ALLOC (int, num_procs);
+  qbuffer = exc->qbuffer = P4EST_ALLOC (int, num_procs);
+
+  /* receive data from other processors */
+  ng_excl = 0;
+  for (q = 0; q < num_procs; ++q) {
+    qactive[q] = -1;
+    qbuffer[q] = -1;
+    ng_incl = ghost->proc_offsets[q + 1];
+    ng = ng_incl - ng_excl;
+    P4EST_ASSERT (ng >= 0);
+    if (ng > 0) {
+      P4EST_ASSERT (q != p4est->mpirank);
+      /* run through ghosts to count the matching level quadrants */
+      for (lmatches = 0, theg = 0; theg < ng; ++theg) {
+        g = p4est_quadrant_array_index (&ghost->ghosts, ng_excl + theg);
+        if (minlevel <= (int) g->level && (int) g->level <= maxlevel) {
+          ++lmatches;
+        }
+      }
+      if (lmatches > 0) {
+        theq = qactive + exc->rrequests.elem_count;
+        r = (sc_MPI_Request *) sc_array_push (&exc->rrequests);
+        if (lmatches < ng) {
+          /* every peer populates its own receive buffer */
+          *theq = q;
+          qbuffer[q] = (int) exc->rbuffers.elem_count;
+          rbuf = (char **) sc_array_push (&exc->rbuffers);
+          *rbuf = P4EST_ALLOC (char, lmatches * data_size);
+          mpiret = sc_MPI_Irecv (*rbuf, lmatches * data_size, sc_MPI_BYTE, q,
+                                 P4EST_COMM_GHOST_EXCHANGE, p4est->mpicomm,
+                                 r);
+        }
+        else {
+          /* use the ghost data memory as is */
+          *theq = -1;
+          mpiret = sc_MPI_Irecv ((char *) ghost_data + ng_excl * data_size,
+                                 ng * data_size, sc_MPI_BYTE, q,
+                                 P4EST_COMM_GHOST_EXCHANGE, p4est->mpicomm,
+                                 r);
+        }
+        SC_CHECK_MPI (mpiret);
+      }
+      ng_excl = ng_incl;
+    }
+  }
+  P4EST_ASSERT (ng_excl == (p4est_locidx_t) ghost->ghosts.elem_count);
+
+  /* send data to other processors */
+  ng_excl = 0;
+  for (q = 0; q < num_procs; ++q) {
+    ng_incl = ghost->mirror_proc_offsets[q + 1];
+    ng = ng_incl - ng_excl;
+    P4EST_ASSERT (ng >= 0);
+    if (ng > 0) {
+      P4EST_ASSERT (q != p4est->mpirank);
+      /* run through mirrors to count the matching level quadrants */
+      for (lmatches = 0, theg = 0; theg < ng; ++theg) {
+        mirr = ghost->mirror_proc_mirrors[ng_excl + theg];
+        m = p4est_quadrant_array_index (&ghost->mirrors, mirr);
+        if (minlevel <= (int) m->level && (int) m->level <= maxlevel) {
+          ++lmatches;
+        }
+      }
+      if (lmatches > 0) {
+        /* every peer populates its own send buffer */
+        sbuf = (char **) sc_array_push (&exc->sbuffers);
+        mem = *sbuf = P4EST_ALLOC (char, lmatches * data_size);
+        for (theg = 0; theg < ng; ++theg) {
+          mirr = ghost->mirror_proc_mirrors[ng_excl + theg];
+          m = p4est_quadrant_array_index (&ghost->mirrors, mirr);
+          if (minlevel <= (int) m->level && (int) m->level <= maxlevel) {
+            memcpy (mem, mirror_data[mirr], data_size);
+            mem += data_size;
+          }
+        }
+        r = (sc_MPI_Request *) sc_array_push (&exc->requests);
+        mpiret = sc_MPI_Isend (*sbuf, lmatches * data_size, sc_MPI_BYTE, q,
+                               P4EST_COMM_GHOST_EXCHANGE, p4est->mpicomm, r);
+        SC_CHECK_MPI (mpiret);
+      }
+      ng_excl = ng_incl;
+    }
+  }
+
+  /* we are done posting messages */
+  return exc;
+}
+
+void
+p4est_ghost_exchange_custom_levels_end (p4est_ghost_exchange_t * exc)
+{
+  p4est_ghost_t      *ghost = exc->ghost;
+#ifdef P4EST_ENABLE_DEBUG
+  p4est_t            *p4est = exc->p4est;
+  const int           num_procs = p4est->mpisize;
+#endif
+  const int           minlevel = exc->minlevel;
+  const int           maxlevel = exc->maxlevel;
+  const size_t        data_size = exc->data_size;
+  int                 mpiret;
+  int                 i, expected, remaining, received, *peers;
+  int                 q;
+  char              **rbuf, **sbuf;
+  size_t              zz;
+  p4est_locidx_t      ng_excl, ng_incl, ng, theg;
+  p4est_locidx_t      lmatches;
+  p4est_quadrant_t   *g;
+
+  /* make sure that the begin function matches the end function */
+  P4EST_ASSERT (exc->is_custom);
+  P4EST_ASSERT (exc->is_levels);
+
+  /* check whether we have used the specialized function */
+  if (minlevel <= 0 && maxlevel >= P4EST_QMAXLEVEL) {
+    exc->is_levels = 0;
+    p4est_ghost_exchange_custom_end (exc);
+    return;
+  }
+
+#ifdef P4EST_GHOST_NEIGHBORHOOD
+  if (exc->ncounts != NULL) {
+    /* the collective completes all receives and sends at once */
+    mpiret = sc_MPI_Waitall (exc->requests.elem_count, (sc_MPI_Request *)
+                             exc->requests.array, sc_MPI_STATUSES_IGNORE);
+    SC_CHECK_MPI (mpiret);
+
+    /* run through ghosts to copy the matching level quadrants' data */
+    P4EST_ASSERT (exc->rbuffers.elem_count == 1);
+    rbuf = (char **) sc_array_index (&exc->rbuffers, 0);
+    for (lmatches = 0, theg = 0;
+         theg < (p4est_locidx_t) ghost->ghosts.elem_count; ++theg) {
+      g = p4est_quadrant_array_index (&ghost->ghosts, theg);
+      if (minlevel <= (int) g->level && (int) g->level <= maxlevel) {
+        memcpy ((char *) exc->ghost_data + theg * data_size,
+                *rbuf + lmatches * data_size, data_size);
+        ++lmatches;
+      }
+    }
+    P4EST_FREE (*rbuf);
+    sc_array_truncate (&exc->rbuffers);
+    P4EST_FREE (exc->ncounts);
+
+    /* the remaining code finds no receives and completed sends */
+    P4EST_ASSERT (exc->rrequests.elem_count == 0);
+  }
+#endif
+
+  /* wait for receives and copy data into the proper result array */
+  peers = P4EST_ALLOC (int, exc->rrequests.elem_count);
+  expected = remaining = (int) exc->rrequests.elem_count;
+  while (remaining > 0) {
+    mpiret =
+      sc_MPI_Waitsome (expected, (sc_MPI_Request *) exc->rrequests.array,
+                       &received, peers, sc_MPI_STATUSES_IGNORE);
+    SC_CHECK_MPI (mpiret);
+    P4EST_ASSERT (received != sc_MPI_UNDEFINED);
+    P4EST_ASSERT (received > 0);
+    for (i = 0; i < received; ++i) {
+      P4EST_ASSERT (0 <= peers[i] &&
+                    peers[i] < (int) exc->rrequests.elem_count);
+      q = exc->qactive[peers[i]];
+      if (q >= 0) {
+        P4EST_ASSERT (q != p4est->mpirank && q < num_procs);
+        ng_excl = ghost->proc_offsets[q];
+        ng_incl = ghost->proc_offsets[q + 1];
+        ng = ng_incl - ng_excl;
+        P4EST_ASSERT (ng > 0);
+        /* run through ghosts to copy the matching level quadrants' data */
+        rbuf = (char **) sc_array_index_int (&exc->rbuffers, exc->qbuffer[q]);
+        for (lmatches = 0, theg = 0; theg < ng; ++theg) {
+          g = p4est_quadrant_array_index (&ghost->ghosts, ng_excl + theg);
+          if (minlevel <= (int) g->level && (int) g->level <= maxlevel) {
+            memcpy ((char *) exc->ghost_data + (ng_excl + theg) * data_size,
+                    *rbuf + lmatches * data_size, data_size);
+            ++lmatches;
+          }
+        }
+        P4EST_FREE (*rbuf);
+        exc->qactive[peers[i]] = -1;
+        exc->qbuffer[q] = -1;
+      }
+    }
+    remaining -= received;
+  }
+  P4EST_FREE (peers);
+  P4EST_FREE (exc->qactive);
+  P4EST_FREE (exc->qbuffer);
+  sc_array_reset (&exc->rrequests);
+  sc_array_reset (&exc->rbuffers);
+
+  /* wait for sends and clean up */
+  mpiret = sc_MPI_Waitall (exc->requests.elem_count, (sc_MPI_Request *)
+                           exc->requests.array, sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  sc_array_reset (&exc->requests);
+  for (zz = 0; zz < exc->sbuffers.elem_count; ++zz) {
+    sbuf = (char **) sc_array_index (&exc->sbuffers, zz);
+    P4EST_FREE (*sbuf);
+  }
+  sc_array_reset (&exc->sbuffers);
+
+  /* free temporary storage */
+  P4EST_FREE (exc);
+}
+
+/** Check whether a quadrant level is selected by a field's level mask. */
+static inline int
+p4est_ghost_field_has_level (const p4est_ghost_field_t * field, int level)
+{
+  return field->level_mask == 0 || ((field->level_mask >> level) & 1);
+}
+
+/** Compute the bytes of all fields for a range of ghosts or mirrors.
+ * \param [in] quads    The ghost or mirror quadrants.
+ * \param [in] indices  If not NULL, the range indexes into this array
+ *                      which in turn indexes into \a quads.
+ */
+static size_t
+p4est_ghost_fields_bytes (p4est_ghost_exchange_t * exc, sc_array_t * quads,
+                          const p4est_locidx_t * indices,
+                          p4est_locidx_t first, p4est_locidx_t last)
+{
+  int                 f;
+  size_t              bytes;
+  p4est_locidx_t      theg;
+  p4est_quadrant_t   *q;
+  p4est_ghost_field_t *field;
+
+  bytes = 0;
+  for (f = 0; f < exc->num_fields; ++f) {
+    field = exc->fields + f;
+    for (theg = first; theg < last; ++theg) {
+      q = p4est_quadrant_array_index
+        (quads, (size_t) (indices == NULL ? theg : indices[theg]));
+      if (p4est_ghost_field_has_level (field, (int) q->level)) {
+        bytes += field->elem_size;
+      }
+    }
+  }
+  return bytes;
+}
+
+void
+p4est_ghost_exchange_fields (p4est_t * p4est, p4est_ghost_t * ghost,
+                             int num_fields,
+                             const p4est_ghost_field_t * fields)
+{
+  p4est_ghost_exchange_fields_end (p4est_ghost_exchange_fields_begin
+                                   (p4est, ghost, num_fields, fields));
+}
+
+p4est_ghost_exchange_t *
+p4est_ghost_exchange_fields_begin (p4est_t * p4est, p4est_ghost_t * ghost,
+                                   int num_fields,
+                                   const p4est_ghost_field_t * fields)
+{
+  const int           num_procs = p4est->mpisize;
+  int                 mpiret;
+  int                 q, f;
+  size_t              bytes;
+  char               *mem, **rbuf, **sbuf;
+  p4est_locidx_t      ng_excl, ng_incl, theg;
+  p4est_locidx_t      mirr;
+  p4est_quadrant_t   *m;
+  p4est_ghost_field_t *field;
+  p4est_ghost_exchange_t *exc;
+  sc_MPI_Request     *r;
+
+  P4EST_ASSERT (ghost->compact == NULL);
+
+  P4EST_ASSERT (num_fields >= 0);
+
+  /* initialize transient storage */
+  exc = P4EST_ALLOC_ZERO (p4est_ghost_exchange_t, 1);
+  exc->is_custom = 1;
+  exc->p4est = p4est;
+  exc->ghost = ghost;
+  exc->minlevel = 0;
+  exc->maxlevel = P4EST_QMAXLEVEL;
+  exc->num_fields = num_fields;
+  exc->fields = P4EST_ALLOC (p4est_ghost_field_t, num_fields);
+  for (f = 0; f < num_fields; ++f) {
+    field = exc->fields + f;
+    *field = fields[f];
+    if (field->stride == 0) {
+      field->stride = field->elem_size;
+    }
+    P4EST_ASSERT (field->stride >= field->elem_size);
+  }
+  sc_array_init (&exc->requests, sizeof (sc_MPI_Request));
+  sc_array_init (&exc->rrequests, sizeof (sc_MPI_Request));
+  sc_array_init (&exc->rbuffers, sizeof (char *));
+  sc_array_init (&exc->sbuffers, sizeof (char *));
+  exc->qactive = P4EST_ALLOC (int, num_procs);
+  exc->qbuffer = P4EST_ALLOC (int, num_procs);
+
+  /* receive all fields from every peer in one message */
+  for (q = 0; q < num_procs; ++q) {
+    exc->qactive[q] = -1;
+    exc->qbuffer[q] = -1;
+    ng_excl = ghost->proc_offsets[q];
+    ng_incl = ghost->proc_offsets[q + 1];
+    P4EST_ASSERT (ng_incl >= ng_excl);
+    bytes = p4est_ghost_fields_bytes (exc, &ghost->ghosts, NULL,
+                                      ng_excl, ng_incl);
+    if (bytes > 0) {
+      P4EST_ASSERT (q != p4est->mpirank);
+      exc->qactive[exc->rrequests.elem_count] = q;
+      exc->qbuffer[q] = (int) exc->rbuffers.elem_count;
+      rbuf = (char **) sc_array_push (&exc->rbuffers);
+      *rbuf = P4EST_ALLOC (char, bytes);
+      r = (sc_MPI_Request *) sc_array_push (&exc->rrequests);
+      mpiret = sc_MPI_Irecv (*rbuf, (int) bytes, sc_MPI_BYTE, q,
+                             P4EST_COMM_GHOST_EXCHANGE, p4est->mpicomm, r);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+
+  /* pack all fields for every peer into one message, field by field */
+  for (q = 0; q < num_procs; ++q) {
+    ng_excl = ghost->mirror_proc_offsets[q];
+    ng_incl = ghost->mirror_proc_offsets[q + 1];
+    P4EST_ASSERT (ng_incl >= ng_excl);
+    bytes = p4est_ghost_fields_bytes (exc, &ghost->mirrors,
+                                      ghost->mirror_proc_mirrors,
+                                      ng_excl, ng_incl);
+    if (bytes > 0) {
+      P4EST_ASSERT (q != p4est->mpirank);
+      sbuf = (char **) sc_array_push (&exc->sbuffers);
+      mem = *sbuf = P4EST_ALLOC (char, bytes);
+      for (f = 0; f < num_fields; ++f) {
+        field = exc->fields + f;
+        for (theg = ng_excl; theg < ng_incl; ++theg) {
+          mirr = ghost->mirror_proc_mirrors[theg];
+          P4EST_ASSERT (0 <= mirr &&
+                        (size_t) mirr < ghost->mirrors.elem_count);
+          m = p4est_quadrant_array_index (&ghost->mirrors, mirr);
+          if (p4est_ghost_field_has_level (field, (int) m->level)) {
+            memcpy (mem, (const char *) field->local_data +
+                    m->p.piggy3.local_num * field->stride, field->elem_size);
+            mem += field->elem_size;
+          }
+        }
+      }
+      P4EST_ASSERT (mem == *sbuf + bytes);
+      r = (sc_MPI_Request *) sc_array_push (&exc->requests);
+      mpiret = sc_MPI_Isend (*sbuf, (int) bytes, sc_MPI_BYTE, q,
+                             P4EST_COMM_GHOST_EXCHANGE, p4est->mpicomm, r);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+
+  /* we are done posting messages */
+  return exc;
+}
+
+void
+p4est_ghost_exchange_fields_end (p4est_ghost_exchange_t * exc)
+{
+  p4est_ghost_t      *ghost = exc->ghost;
+  int                 mpiret;
+  int                 i, f, expected, remaining, received, *peers;
+  int                 q;
+  char               *mem, **rbuf, **sbuf;
+  size_t              zz;
+  p4est_locidx_t      ng_excl, ng_incl, theg;
+  p4est_quadrant_t   *g;
+  p4est_ghost_field_t *field;
+
+  /* this function must not be called for any other exchange */
+  P4EST_ASSERT (exc->is_custom);
+  P4EST_ASSERT (!exc->is_levels);
+  P4EST_ASSERT (exc->qactive != NULL && exc->qbuffer != NULL);
+
+  /* scatter the fields of every peer as soon as its message arrives */
+  peers = P4EST_ALLOC (int, exc->rrequests.elem_count);
+  expected = remaining = (int) exc->rrequests.elem_count;
+  while (remaining > 0) {
+    mpiret =
+      sc_MPI_Waitsome (expected, (sc_MPI_Request *) exc->rrequests.array,
+                       &received, peers, sc_MPI_STATUSES_IGNORE);
+    SC_CHECK_MPI (mpiret);
+    P4EST_ASSERT (received != sc_MPI_UNDEFINED);
+    P4EST_ASSERT (received > 0);
+    for (i = 0; i < received; ++i) {
+      P4EST_ASSERT (0 <= peers[i] && peers[i] < expected);
+      q = exc->qactive[peers[i]];
+      P4EST_ASSERT (0 <= q && q < ghost->mpisize);
+      ng_excl = ghost->proc_offsets[q];
+      ng_incl = ghost->proc_offsets[q + 1];
+      rbuf = (char **) sc_array_index_int (&exc->rbuffers, exc->qbuffer[q]);
+      mem = *rbuf;
+      for (f = 0; f < exc->num_fields; ++f) {
+        field = exc->fields + f;
+        for (theg = ng_excl; theg < ng_incl; ++theg) {
+          g = p4est_quadrant_array_index (&ghost->ghosts, theg);
+          if (p4est_ghost_field_has_level (field, (int) g->level)) {
+            memcpy ((char *) field->ghost_data + theg * field->stride,
+                    mem, field->elem_size);
+            mem += field->elem_size;
+          }
+        }
+      }
+      P4EST_FREE (*rbuf);
+      exc->qbuffer[q] = -1;
+    }
+    remaining -= received;
+  }
+  P4EST_FREE (peers);
+  P4EST_FREE (exc->qactive);
+  P4EST_FREE (exc->qbuffer);
+  sc_array_reset (&exc->rrequests);
+  sc_array_reset (&exc->rbuffers);
+
+  /* wait for sends and clean up */
+  mpiret = sc_MPI_Waitall (exc->requests.elem_count, (sc_MPI_Request *)
+                           exc->requests.array, sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  sc_array_reset (&exc->requests);
+  for (zz = 0; zz < exc->sbuffers.elem_count; ++zz) {
+    sbuf = (char **) sc_array_index (&exc->sbuffers, zz);
+    P4EST_FREE (*sbuf);
+  }
+  sc_array_reset (&exc->sbuffers);
+
+  /* free temporary storage */
+  P4EST_FREE (exc->fields);
+  P4EST_FREE (exc);
+}
+
+#ifdef P4EST_ENABLE_MPI
+
+/** Return the memory the ghost data of a plan is received into. */
+static char        *
+p4est_ghost_plan_recv_target (p4est_ghost_plan_t * plan)
+{
+  return plan->recv_buffer != NULL ? plan->recv_buffer : plan->ghost_data;
+}
+
+#endif /* P4EST_ENABLE_MPI */
+
+#ifdef P4EST_ENABLE_MPICOMMSHARED
+
+/** Place the send buffer of a plan into a window shared within the node.
+ * Collective.  Leaves plan->shared NULL if the node has no other process.
+ */
+static void
+p4est_ghost_shared_new (p4est_ghost_plan_t * plan)
+{
+  p4est_ghost_t      *ghost = plan->ghost;
+  const int           num_procs = ghost->mpisize;
+  int                 mpiret;
+  int                 i, q, rank, noderank, nodesize, disp_unit;
+  int                *members;
+  long long          *offsets_to, *offsets_from;
+  char               *base;
+  MPI_Aint            bytes;
+  struct p4est_ghost_shared *shared;
+
+  shared = P4EST_ALLOC_ZERO (struct p4est_ghost_shared, 1);
+  mpiret = MPI_Comm_rank (plan->p4est->mpicomm, &rank);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_split_type (plan->p4est->mpicomm, MPI_COMM_TYPE_SHARED,
+                                rank, MPI_INFO_NULL, &shared->nodecomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_size (shared->nodecomm, &nodesize);
+  SC_CHECK_MPI (mpiret);
+  if (nodesize == 1) {
+    mpiret = MPI_Comm_free (&shared->nodecomm);
+    SC_CHECK_MPI (mpiret);
+    P4EST_FREE (shared);
+    return;
+  }
+  mpiret = MPI_Comm_rank (shared->nodecomm, &noderank);
+  SC_CHECK_MPI (mpiret);
+
+  /* identify the processes of this node */
+  members = P4EST_ALLOC (int, nodesize);
+  mpiret = MPI_Allgather (&rank, 1, MPI_INT, members, 1, MPI_INT,
+                          shared->nodecomm);
+  SC_CHECK_MPI (mpiret);
+  shared->on_node = P4EST_ALLOC_ZERO (int8_t, num_procs);
+  for (i = 0; i < nodesize; ++i) {
+    shared->on_node[members[i]] = 1;
+  }
+
+  /* the send buffer is ordered by receiver as in the message path */
+  bytes = (MPI_Aint) (plan->data_size * plan->send_offsets[num_procs]);
+  mpiret = MPI_Win_allocate_shared (bytes, 1, MPI_INFO_NULL,
+                                    shared->nodecomm, &base, &shared->win);
+  SC_CHECK_MPI (mpiret);
+  plan->send_buffer = base;
+
+  /* tell every node peer where its data starts in our window */
+  offsets_to = P4EST_ALLOC (long long, nodesize);
+  offsets_from = P4EST_ALLOC (long long, nodesize);
+  for (i = 0; i < nodesize; ++i) {
+    offsets_to[i] = (long long) (plan->data_size *
+                                 plan->send_offsets[members[i]]);
+  }
+  mpiret = MPI_Alltoall (offsets_to, 1, MPI_LONG_LONG_INT,
+                         offsets_from, 1, MPI_LONG_LONG_INT,
+                         shared->nodecomm);
+  SC_CHECK_MPI (mpiret);
+  shared->peers = P4EST_ALLOC (int, nodesize);
+  shared->sources = P4EST_ALLOC (const char *, nodesize);
+  for (i = 0; i < nodesize; ++i) {
+    q = members[i];
+    if (i == noderank || plan->recv_offsets[q + 1] == plan->recv_offsets[q]) {
+      continue;
+    }
+    mpiret = MPI_Win_shared_query (shared->win, i, &bytes, &disp_unit,
+                                   &base);
+    SC_CHECK_MPI (mpiret);
+    shared->peers[shared->num_peers] = q;
+    shared->sources[shared->num_peers++] = base + offsets_from[i];
+  }
+  P4EST_FREE (offsets_from);
+  P4EST_FREE (offsets_to);
+  P4EST_FREE (members);
+
+  /* keep a passive epoch open for the lifetime of the plan */
+  mpiret = MPI_Win_lock_all (MPI_MODE_NOCHECK, shared->win);
+  SC_CHECK_MPI (mpiret);
+  plan->shared = shared;
+}
+
+/** Free the window and the node communicator of a plan. */
+static void
+p4est_ghost_shared_destroy (struct p4est_ghost_shared *shared)
+{
+  int                 mpiret;
+
+  mpiret = MPI_Win_unlock_all (shared->win);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Win_free (&shared->win);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_free (&shared->nodecomm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (shared->on_node);
+  P4EST_FREE (shared->sources);
+  P4EST_FREE (shared->peers);
+  P4EST_FREE (shared);
+}
+
+#endif /* P4EST_ENABLE_MPICOMMSHARED */
+
+p4est_ghost_plan_t *
+p4est_ghost_plan_new (p4est_t * p4est, p4est_ghost_t * ghost,
+                      size_t data_size)
+{
+  return p4est_ghost_plan_new_levels (p4est, ghost, 0, P4EST_QMAXLEVEL,
+                                      data_size);
+}
+
+p4est_ghost_plan_t *
+p4est_ghost_plan_new_levels (p4est_t * p4est, p4est_ghost_t * ghost,
+                             int minlevel, int maxlevel, size_t data_size)
+{
+  p4est_ghost_plan_t *plan;
+  const int           num_procs = ghost->mpisize;
+  int                 q, all_levels;
+  p4est_locidx_t      il, mirr, nsend, nrecv;
+  p4est_quadrant_t   *m;
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+  p4est_locidx_t      ng;
+#endif
+
+  P4EST_ASSERT (ghost->mpisize == p4est->mpisize);
+
+  plan = P4EST_ALLOC_ZERO (p4est_ghost_plan_t, 1);
+  plan->p4est = p4est;
+  plan->ghost = ghost;
+  plan->revision = p4est->revision;
+  plan->num_ghosts = ghost->ghosts.elem_count;
+  plan->num_mirrors = ghost->mirrors.elem_count;
+  plan->data_size = data_size;
+  plan->minlevel = minlevel = SC_MAX (minlevel, 0);
+  plan->maxlevel = maxlevel = SC_MIN (maxlevel, P4EST_QMAXLEVEL);
+  all_levels = (minlevel == 0 && maxlevel == P4EST_QMAXLEVEL);
+
+  /* select the mirrors to send and the ghosts to receive by peer once */
+  plan->send_offsets = P4EST_ALLOC (p4est_locidx_t, num_procs + 1);
+  plan->send_mirrors = P4EST_ALLOC (p4est_locidx_t,
+                                    ghost->mirror_proc_offsets[num_procs]);
+  plan->recv_offsets = P4EST_ALLOC (p4est_locidx_t, num_procs + 1);
+  if (!all_levels) {
+    plan->recv_ghosts = P4EST_ALLOC (p4est_locidx_t, plan->num_ghosts);
+  }
+  nsend = nrecv = 0;
+  for (q = 0; q < num_procs; ++q) {
+    plan->send_offsets[q] = nsend;
+    for (il = ghost->mirror_proc_offsets[q];
+         il < ghost->mirror_proc_offsets[q + 1]; ++il) {
+      mirr = ghost->mirror_proc_mirrors[il];
+      m = p4est_quadrant_array_index (&ghost->mirrors, (size_t) mirr);
+      if (minlevel <= (int) m->level && (int) m->level <= maxlevel) {
+        plan->send_mirrors[nsend++] = mirr;
+      }
+    }
+    plan->recv_offsets[q] = nrecv;
+    for (il = ghost->proc_offsets[q]; il < ghost->proc_offsets[q + 1]; ++il) {
+      m = p4est_quadrant_array_index (&ghost->ghosts, (size_t) il);
+      if (minlevel <= (int) m->level && (int) m->level <= maxlevel) {
+        if (plan->recv_ghosts != NULL) {
+          plan->recv_ghosts[nrecv] = il;
+        }
+        ++nrecv;
+      }
+    }
+  }
+  plan->send_offsets[num_procs] = nsend;
+  plan->recv_offsets[num_procs] = nrecv;
+  P4EST_ASSERT (!all_levels || (size_t) nrecv == plan->num_ghosts);
+
+  /* ghost data of other levels is left alone, as in the levels exchange */
+  plan->ghost_data = P4EST_ALLOC (char, data_size * plan->num_ghosts);
+  if (plan->recv_ghosts != NULL) {
+    plan->recv_buffer = P4EST_ALLOC (char, data_size * nrecv);
+  }
+  plan->requests = P4EST_ALLOC (sc_MPI_Request, 2 * ghost->mpisize);
+#ifdef P4EST_ENABLE_MPICOMMSHARED
+  if (data_size > 0) {
+    p4est_ghost_shared_new (plan);
+  }
+  if (plan->shared == NULL)
+#endif
+  {
+    plan->send_buffer = P4EST_ALLOC (char, data_size * nsend);
+  }
+
+#ifdef P4EST_ENABLE_MPI
+  if (data_size == 0) {
+    return plan;
+  }
+
+  /* set up the receives of ghost data from other processors */
+  for (q = 0; q < num_procs; ++q) {
+    ng = plan->recv_offsets[q + 1] - plan->recv_offsets[q];
+    P4EST_ASSERT (ng >= 0);
+#ifdef P4EST_ENABLE_MPICOMMSHARED
+    if (plan->shared != NULL && plan->shared->on_node[q]) {
+      continue;
+    }
+#endif
+    if (ng > 0) {
+      mpiret = MPI_Recv_init (p4est_ghost_plan_recv_target (plan) +
+                              plan->recv_offsets[q] * data_size,
+                              ng * data_size, MPI_BYTE, q,
+                              P4EST_COMM_GHOST_PLAN, p4est->mpicomm,
+                              plan->requests + plan->num_requests++);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+
+  /* set up the sends of mirror data to other processors */
+  for (q = 0; q < num_procs; ++q) {
+    ng = plan->send_offsets[q + 1] - plan->send_offsets[q];
+    P4EST_ASSERT (ng >= 0);
+#ifdef P4EST_ENABLE_MPICOMMSHARED
+    if (plan->shared != NULL && plan->shared->on_node[q]) {
+      continue;
+    }
+#endif
+    if (ng > 0) {
+      mpiret = MPI_Send_init (plan->send_buffer +
+                              plan->send_offsets[q] * data_size,
+                              ng * data_size, MPI_BYTE, q,
+                              P4EST_COMM_GHOST_PLAN, p4est->mpicomm,
+                              plan->requests + plan->num_requests++);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+#endif
+
+  return plan;
+}
+
+void
+p4est_ghost_plan_destroy (p4est_ghost_plan_t * plan)
+{
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+  int                 i;
+#endif
+
+  P4EST_ASSERT (!plan->is_active);
+
+#ifdef P4EST_ENABLE_MPI
+  for (i = 0; i < plan->num_requests; ++i) {
+    mpiret = MPI_Request_free (plan->requests + i);
+    SC_CHECK_MPI (mpiret);
+  }
+#endif
+
+  P4EST_FREE (plan->requests);
+  P4EST_FREE (plan->ghost_data);
+  P4EST_FREE (plan->recv_buffer);
+  P4EST_FREE (plan->recv_ghosts);
+  P4EST_FREE (plan->recv_offsets);
+  P4EST_FREE (plan->send_mirrors);
+  P4EST_FREE (plan->send_offsets);
+#ifdef P4EST_ENABLE_MPICOMMSHARED
+  if (plan->shared != NULL) {
+    /* the send buffer is freed with the window */
+    p4est_ghost_shared_destroy (plan->shared);
+  }
+  else
+#endif
+  {
+    P4EST_FREE (plan->send_buffer);
+  }
+  P4EST_FREE (plan);
+}
+
+int
+p4est_ghost_plan_is_valid (p4est_ghost_plan_t * plan)
+{
+  return plan->revision == plan->p4est->revision &&
+    plan->num_ghosts == plan->ghost->ghosts.elem_count &&
+    plan->num_mirrors == plan->ghost->mirrors.elem_count;
+}
+
+void
+p4est_ghost_plan_begin (p4est_ghost_plan_t * plan, void **mirror_data)
+{
+  p4est_t            *p4est = plan->p4est;
+  p4est_ghost_t      *ghost = plan->ghost;
+  const size_t        data_size = plan->data_size;
+  char               *mem;
+  void               *src;
+  p4est_locidx_t      il, nl, mirr, which_quad;
+  p4est_quadrant_t   *mirror, *q;
+  p4est_tree_t       *tree;
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+#endif
+
+  SC_CHECK_ABORT (p4est_ghost_plan_is_valid (plan),
+                  "Ghost plan does not match the forest");
+  P4EST_ASSERT (!plan->is_active);
+  P4EST_ASSERT (mirror_data != NULL || data_size ==
+                (p4est->data_size == 0 ? sizeof (void *) : p4est->data_size));
+  plan->is_active = 1;
+
+  /* pack the selected mirror data in the order of the receivers */
+  mem = plan->send_buffer;
+  nl = plan->send_offsets[ghost->mpisize];
+  for (il = 0; il < nl; ++il) {
+    mirr = plan->send_mirrors[il];
+    P4EST_ASSERT (0 <= mirr && (size_t) mirr < ghost->mirrors.elem_count);
+    if (mirror_data != NULL) {
+      src = mirror_data[mirr];
+    }
+    else {
+      mirror = p4est_quadrant_array_index (&ghost->mirrors, (size_t) mirr);
+      tree = p4est_tree_array_index (p4est->trees,
+                                     mirror->p.piggy3.which_tree);
+      which_quad = mirror->p.piggy3.local_num - tree->quadrants_offset;
+      P4EST_ASSERT (0 <= which_quad &&
+                    which_quad < (p4est_locidx_t) tree->quadrants.elem_count);
+      q = p4est_quadrant_array_index (&tree->quadrants, (size_t) which_quad);
+      src = p4est->data_size == 0 ? &q->p.user_data : q->p.user_data;
+    }
+    memcpy (mem, src, data_size);
+    mem += data_size;
+  }
+
+#ifdef P4EST_ENABLE_MPICOMMSHARED
+  if (plan->shared != NULL) {
+    /* publish the packed data to the processes of this node */
+    mpiret = MPI_Win_sync (plan->shared->win);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Barrier (plan->shared->nodecomm);
+    SC_CHECK_MPI (mpiret);
+  }
+#endif
+#ifdef P4EST_ENABLE_MPI
+  if (plan->num_requests > 0) {
+    mpiret = MPI_Startall (plan->num_requests, plan->requests);
+    SC_CHECK_MPI (mpiret);
+  }
+#endif
+}
+
+void               *
+p4est_ghost_plan_end (p4est_ghost_plan_t * plan)
+{
+  const size_t        data_size = plan->data_size;
+  int                 mpiret;
+  p4est_locidx_t      il, nl;
+#ifdef P4EST_ENABLE_MPICOMMSHARED
+  int                 i, q;
+  p4est_locidx_t      ng_excl, ng_incl;
+  struct p4est_ghost_shared *shared = plan->shared;
+#endif
+
+  P4EST_ASSERT (plan->is_active);
+
+#ifdef P4EST_ENABLE_MPICOMMSHARED
+  if (shared != NULL) {
+    /* copy the ghosts owned on this node straight from the window */
+    mpiret = MPI_Win_sync (shared->win);
+    SC_CHECK_MPI (mpiret);
+    for (i = 0; i < shared->num_peers; ++i) {
+      q = shared->peers[i];
+      ng_excl = plan->recv_offsets[q];
+      ng_incl = plan->recv_offsets[q + 1];
+      memcpy (p4est_ghost_plan_recv_target (plan) + ng_excl * data_size,
+              shared->sources[i], (ng_incl - ng_excl) * data_size);
+    }
+  }
+#endif
+  mpiret = sc_MPI_Waitall (plan->num_requests, plan->requests,
+                           sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+#ifdef P4EST_ENABLE_MPICOMMSHARED
+  if (shared != NULL) {
+    /* the next exchange must not overwrite data still being read */
+    mpiret = MPI_Barrier (shared->nodecomm);
+    SC_CHECK_MPI (mpiret);
+  }
+#endif
+
+  /* place the data of a level range at the positions of its ghosts */
+  if (plan->recv_ghosts != NULL) {
+    nl = plan->recv_offsets[plan->ghost->mpisize];
+    for (il = 0; il < nl; ++il) {
+      memcpy (plan->ghost_data + plan->recv_ghosts[il] * data_size,
+              plan->recv_buffer + il * data_size, data_size);
+    }
+  }
+  plan->is_active = 0;
+
+  return plan->ghost_data;
+}
+
+void               *
+p4est_ghost_plan_exchange (p4est_ghost_plan_t * plan, void **mirror_data)
+{
+  p4est_ghost_plan_begin (plan, mirror_data);
+  return p4est_ghost_plan_end (plan);
+}
+
+#ifdef P4EST_ENABLE_MPI
+
+/** Create the datatype of equal blocks of bytes at quadrant positions.
+ * \param [in] indices  The quadrant positions, or NULL for the \a count
+ *                      consecutive positions starting at \a first.
+ */
+static              MPI_Datatype
+p4est_ghost_types_block (int count, const p4est_locidx_t * indices,
+                         p4est_locidx_t first, size_t elem_size,
+                         size_t stride)
+{
+  int                 mpiret;
+  int                 i;
+  MPI_Aint           *displs;
+  MPI_Datatype        type;
+#if MPI_VERSION < 3
+  int                *lengths;
+#endif
+
+  P4EST_ASSERT (count > 0);
+  P4EST_ASSERT (elem_size <= (size_t) INT_MAX);
+
+  displs = P4EST_ALLOC (MPI_Aint, count);
+  for (i = 0; i < count; ++i) {
+    displs[i] = (MPI_Aint)
+      ((size_t) (indices != NULL ? indices[i] : first + i) * stride);
+  }
+#if MPI_VERSION >= 3
+  mpiret = MPI_Type_create_hindexed_block (count, (int) elem_size, displs,
+                                           MPI_BYTE, &type);
+  SC_CHECK_MPI (mpiret);
+#else
+  lengths = P4EST_ALLOC (int, count);
+  for (i = 0; i < count; ++i) {
+    lengths[i] = (int) elem_size;
+  }
+  mpiret = MPI_Type_create_hindexed (count, lengths, displs, MPI_BYTE, &type);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (lengths);
+#endif
+  mpiret = MPI_Type_commit (&type);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (displs);
+
+  return type;
+}
+
+#endif /* P4EST_ENABLE_MPI */
+
+p4est_ghost_types_t *
+p4est_ghost_types_new (p4est_t * p4est, p4est_ghost_t * ghost,
+                       size_t elem_size, size_t stride)
+{
+  const int           num_procs = ghost->mpisize;
+  p4est_ghost_types_t *types;
+#ifdef P4EST_ENABLE_MPI
+  int                 q, n;
+  size_t              zz;
+  p4est_locidx_t      ng, *local_nums;
+  sc_array_t          mirrors;
+#endif
 
-  /* initialize transient storage */
-  exc = P4EST_ALLOC_ZERO (p4est_ghost_exchange_t, 1);
-  exc->is_custom = 1;
-  exc->is_levels = 1;
-  exc->p4est = p4est;
-  exc->ghost = ghost;
-  exc->minlevel = minlevel;
-  exc->maxlevel = maxlevel;
-  exc->data_size = data_size;
-  exc->ghost_data = ghost_data;
-  sc_array_init (&exc->requests, sizeof (sc_MPI_Request));
-  sc_array_init (&exc->rrequests, sizeof (sc_MPI_Request));
-  sc_array_init (&exc->rbuffers, sizeof (char *));
-  sc_array_init (&exc->sbuffers, sizeof (char *));
+  P4EST_ASSERT (ghost->mpisize == p4est->mpisize);
 
-  /* return early if there is nothing to do */
-  if (data_size == 0 || minlevel > maxlevel) {
-    return exc;
+  types = P4EST_ALLOC_ZERO (p4est_ghost_types_t, 1);
+  types->p4est = p4est;
+  types->ghost = ghost;
+  types->revision = p4est->revision;
+  types->num_ghosts = ghost->proc_offsets[num_procs];
+  types->num_sends = ghost->mirror_proc_offsets[num_procs];
+  types->elem_size = elem_size;
+  types->stride = stride == 0 ? elem_size : stride;
+  P4EST_ASSERT (types->elem_size <= types->stride);
+
+#ifdef P4EST_ENABLE_MPI
+  if (elem_size == 0) {
+    return types;
   }
-  qactive = exc->qactive = P4EST_ALLOC (int, num_procs);
-  qbuffer = exc->qbuffer = P4EST_ALLOC (int, num_procs);
+  types->peers = P4EST_ALLOC (int, 2 * num_procs);
+  types->types = P4EST_ALLOC (sc_MPI_Datatype, 2 * num_procs);
 
-  /* receive data from other processors */
-  ng_excl = 0;
+  /* the ghosts of each sender are consecutive in the ghost array */
+  n = 0;
   for (q = 0; q < num_procs; ++q) {
-    qactive[q] = -1;
-    qbuffer[q] = -1;
-    ng_incl = ghost->proc_offsets[q + 1];
-    ng = ng_incl - ng_excl;
+    ng = ghost->proc_offsets[q + 1] - ghost->proc_offsets[q];
     P4EST_ASSERT (ng >= 0);
     if (ng > 0) {
-      P4EST_ASSERT (q != p4est->mpirank);
-      /* run through ghosts to count the matching level quadrants */
-      for (lmatches = 0, theg = 0; theg < ng; ++theg) {
-        g = p4est_quadrant_array_index (&ghost->ghosts, ng_excl + theg);
-        if (minlevel <= (int) g->level && (int) g->level <= maxlevel) {
-          ++lmatches;
-        }
-      }
-      if (lmatches > 0) {
-        theq = qactive + exc->rrequests.elem_count;
-        r = (sc_MPI_Request *) sc_array_push (&exc->rrequests);
-        if (lmatches < ng) {
-          /* every peer populates its own receive buffer */
-          *theq = q;
-          qbuffer[q] = (int) exc->rbuffers.elem_count;
-          rbuf = (char **) sc_array_push (&exc->rbuffers);
-          *rbuf = P4EST_ALLOC (char, lmatches * data_size);
-          mpiret = sc_MPI_Irecv (*rbuf, lmatches * data_size, sc_MPI_BYTE, q,
-                                 P4EST_COMM_GHOST_EXCHANGE, p4est->mpicomm,
-                                 r);
-        }
-        else {
-          /* use the ghost data memory as is */
-          *theq = -1;
-          mpiret = sc_MPI_Irecv ((char *) ghost_data + ng_excl * data_size,
-                                 ng * data_size, sc_MPI_BYTE, q,
-                                 P4EST_COMM_GHOST_EXCHANGE, p4est->mpicomm,
-                                 r);
-        }
-        SC_CHECK_MPI (mpiret);
-      }
-      ng_excl = ng_incl;
+      types->peers[n] = q;
+      types->types[n++] =
+        p4est_ghost_types_block ((int) ng, NULL, ghost->proc_offsets[q],
+                                 elem_size, types->stride);
     }
   }
-  P4EST_ASSERT (ng_excl == (p4est_locidx_t) ghost->ghosts.elem_count);
+  types->num_recv_peers = n;
 
-  /* send data to other processors */
-  ng_excl = 0;
+  /* the mirrors of each receiver are read by their local number */
+  sc_array_init (&mirrors, sizeof (p4est_locidx_t));
+  local_nums = P4EST_ALLOC (p4est_locidx_t,
+                            ghost->mirror_proc_offsets[num_procs]);
   for (q = 0; q < num_procs; ++q) {
-    ng_incl = ghost->mirror_proc_offsets[q + 1];
-    ng = ng_incl - ng_excl;
-    P4EST_ASSERT (ng >= 0);
-    if (ng > 0) {
-      P4EST_ASSERT (q != p4est->mpirank);
-      /* run through mirrors to count the matching level quadrants */
-      for (lmatches = 0, theg = 0; theg < ng; ++theg) {
-        mirr = ghost->mirror_proc_mirrors[ng_excl + theg];
-        m = p4est_quadrant_array_index (&ghost->mirrors, mirr);
-        if (minlevel <= (int) m->level && (int) m->level <= maxlevel) {
-          ++lmatches;
-        }
-      }
-      if (lmatches > 0) {
-        /* every peer populates its own send buffer */
-        sbuf = (char **) sc_array_push (&exc->sbuffers);
-        mem = *sbuf = P4EST_ALLOC (char, lmatches * data_size);
-        for (theg = 0; theg < ng; ++theg) {
-          mirr = ghost->mirror_proc_mirrors[ng_excl + theg];
-          m = p4est_quadrant_array_index (&ghost->mirrors, mirr);
-          if (minlevel <= (int) m->level && (int) m->level <= maxlevel) {
-            memcpy (mem, mirror_data[mirr], data_size);
-            mem += data_size;
-          }
-        }
-        r = (sc_MPI_Request *) sc_array_push (&exc->requests);
-        mpiret = sc_MPI_Isend (*sbuf, lmatches * data_size, sc_MPI_BYTE, q,
-                               P4EST_COMM_GHOST_EXCHANGE, p4est->mpicomm, r);
-        SC_CHECK_MPI (mpiret);
-      }
-      ng_excl = ng_incl;
+    p4est_ghost_compact_proc_mirrors (ghost, q, &mirrors);
+    if (mirrors.elem_count == 0) {
+      continue;
     }
+    for (zz = 0; zz < mirrors.elem_count; ++zz) {
+      local_nums[zz] = p4est_ghost_compact_mirror
+        (ghost, *(p4est_locidx_t *) sc_array_index (&mirrors, zz));
+    }
+    types->peers[n] = q;
+    types->types[n++] =
+      p4est_ghost_types_block ((int) mirrors.elem_count, local_nums, 0,
+                               elem_size, types->stride);
   }
+  types->num_send_peers = n - types->num_recv_peers;
+  P4EST_FREE (local_nums);
+  sc_array_reset (&mirrors);
 
-  /* we are done posting messages */
-  return exc;
+  types->requests = P4EST_ALLOC (sc_MPI_Request, n);
+#endif
+
+  return types;
 }
 
 void
-p4est_ghost_exchange_custom_levels_end (p4est_ghost_exchange_t * exc)
+p4est_ghost_types_destroy (p4est_ghost_types_t * types)
 {
-  p4est_ghost_t      *ghost = exc->ghost;
-#ifdef P4EST_ENABLE_DEBUG
-  p4est_t            *p4est = exc->p4est;
-  const int           num_procs = p4est->mpisize;
-#endif
-  const int           minlevel = exc->minlevel;
-  const int           maxlevel = exc->maxlevel;
-  const size_t        data_size = exc->data_size;
+#ifdef P4EST_ENABLE_MPI
   int                 mpiret;
-  int                 i, expected, remaining, received, *peers;
-  int                 q;
-  char              **rbuf, **sbuf;
-  size_t              zz;
-  p4est_locidx_t      ng_excl, ng_incl, ng, theg;
-  p4est_locidx_t      lmatches;
-  p4est_quadrant_t   *g;
+  int                 i;
+#endif
 
-  /* make sure that the begin function matches the end function */
-  P4EST_ASSERT (exc->is_custom);
-  P4EST_ASSERT (exc->is_levels);
+  P4EST_ASSERT (!types->is_active);
 
-  /* check whether we have used the specialized function */
-  if (minlevel <= 0 && maxlevel >= P4EST_QMAXLEVEL) {
-    exc->is_levels = 0;
-    p4est_ghost_exchange_custom_end (exc);
-    return;
+#ifdef P4EST_ENABLE_MPI
+  for (i = 0; i < types->num_recv_peers + types->num_send_peers; ++i) {
+    mpiret = MPI_Type_free (types->types + i);
+    SC_CHECK_MPI (mpiret);
   }
+#endif
 
-  /* wait for receives and copy data into the proper result array */
-  peers = P4EST_ALLOC (int, exc->rrequests.elem_count);
-  expected = remaining = (int) exc->rrequests.elem_count;
-  while (remaining > 0) {
-    mpiret =
-      sc_MPI_Waitsome (expected, (sc_MPI_Request *) exc->rrequests.array,
-                       &received, peers, sc_MPI_STATUSES_IGNORE);
+  P4EST_FREE (types->requests);
+  P4EST_FREE (types->types);
+  P4EST_FREE (types->peers);
+  P4EST_FREE (types);
+}
+
+int
+p4est_ghost_types_is_valid (p4est_ghost_types_t * types)
+{
+  const int           num_procs = types->ghost->mpisize;
+
+  return types->revision == types->p4est->revision &&
+    types->num_ghosts == types->ghost->proc_offsets[num_procs] &&
+    types->num_sends == types->ghost->mirror_proc_offsets[num_procs];
+}
+
+void
+p4est_ghost_types_begin (p4est_ghost_types_t * types,
+                         const void *local_data, void *ghost_data)
+{
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+  int                 i;
+  const int           nr = types->num_recv_peers;
+#endif
+
+  SC_CHECK_ABORT (p4est_ghost_types_is_valid (types),
+                  "Ghost types do not match the forest");
+  P4EST_ASSERT (!types->is_active);
+  types->is_active = 1;
+
+#ifdef P4EST_ENABLE_MPI
+  /* the datatypes address the arrays directly: nothing is packed here */
+  for (i = 0; i < nr; ++i) {
+    mpiret = MPI_Irecv (ghost_data, 1, types->types[i], types->peers[i],
+                        P4EST_COMM_GHOST_TYPES, types->p4est->mpicomm,
+                        types->requests + i);
     SC_CHECK_MPI (mpiret);
-    P4EST_ASSERT (received != sc_MPI_UNDEFINED);
-    P4EST_ASSERT (received > 0);
-    for (i = 0; i < received; ++i) {
-      P4EST_ASSERT (0 <= peers[i] &&
-                    peers[i] < (int) exc->rrequests.elem_count);
-      q = exc->qactive[peers[i]];
-      if (q >= 0) {
-        P4EST_ASSERT (q != p4est->mpirank && q < num_procs);
-        ng_excl = ghost->proc_offsets[q];
-        ng_incl = ghost->proc_offsets[q + 1];
-        ng = ng_incl - ng_excl;
-        P4EST_ASSERT (ng > 0);
-        /* run through ghosts to copy the matching level quadrants' data */
-        rbuf = (char **) sc_array_index_int (&exc->rbuffers, exc->qbuffer[q]);
-        for (lmatches = 0, theg = 0; theg < ng; ++theg) {
-          g = p4est_quadrant_array_index (&ghost->ghosts, ng_excl + theg);
-          if (minlevel <= (int) g->level && (int) g->level <= maxlevel) {
-            memcpy ((char *) exc->ghost_data + (ng_excl + theg) * data_size,
-                    *rbuf + lmatches * data_size, data_size);
-            ++lmatches;
-          }
-        }
-        P4EST_FREE (*rbuf);
-        exc->qactive[peers[i]] = -1;
-        exc->qbuffer[q] = -1;
-      }
-    }
-    remaining -= received;
   }
-  P4EST_FREE (peers);
-  P4EST_FREE (exc->qactive);
-  P4EST_FREE (exc->qbuffer);
-  sc_array_reset (&exc->rrequests);
-  sc_array_reset (&exc->rbuffers);
+  for (i = nr; i < nr + types->num_send_peers; ++i) {
+    mpiret = MPI_Isend ((void *) local_data, 1, types->types[i],
+                        types->peers[i], P4EST_COMM_GHOST_TYPES,
+                        types->p4est->mpicomm, types->requests + i);
+    SC_CHECK_MPI (mpiret);
+  }
+#endif
+}
 
-  /* wait for sends and clean up */
-  mpiret = sc_MPI_Waitall (exc->requests.elem_count, (sc_MPI_Request *)
-                           exc->requests.array, sc_MPI_STATUSES_IGNORE);
+void
+p4est_ghost_types_end (p4est_ghost_types_t * types)
+{
+  int                 mpiret;
+
+  P4EST_ASSERT (types->is_active);
+
+  mpiret = sc_MPI_Waitall (types->num_recv_peers + types->num_send_peers,
+                           types->requests, sc_MPI_STATUSES_IGNORE);
   SC_CHECK_MPI (mpiret);
-  sc_array_reset (&exc->requests);
-  for (zz = 0; zz < exc->sbuffers.elem_count; ++zz) {
-    sbuf = (char **) sc_array_index (&exc->sbuffers, zz);
-    P4EST_FREE (*sbuf);
-  }
-  sc_array_reset (&exc->sbuffers);
+  types->is_active = 0;
+}
 
-  /* free temporary storage */
-  P4EST_FREE (exc);
+void
+p4est_ghost_types_exchange (p4est_ghost_types_t * types,
+                            const void *local_data, void *ghost_data)
+{
+  p4est_ghost_types_begin (types, local_data, ghost_data);
+  p4est_ghost_types_end (types);
 }
 
 #ifdef P4EST_ENABLE_MPI
@@ -2922,8 +5097,8 @@ p4est_ghost_expand_kernel (p4est_topidx_t t, p4est_quadrant_t * mq,
           }
         }
       }
-      sc_array_reset (tempquads);
-      sc_array_reset (temptrees);
+      sc_array_truncate (tempquads);
+      sc_array_truncate (temptrees);
     }
 #endif
     else {
@@ -2948,8 +5123,8 @@ p4est_ghost_expand_kernel (p4est_topidx_t t, p4est_quadrant_t * mq,
           }
         }
       }
-      sc_array_reset (tempquads);
-      sc_array_reset (temptrees);
+      sc_array_truncate (tempquads);
+      sc_array_truncate (temptrees);
     }
   }
 }
@@ -3008,6 +5183,53 @@ p4est_quadrant_compare_piggy_proc (const void *a, const void *b)
 
 #endif /* P4EST_ENABLE_MPI */
 
+/** Sort an array whose leading elements are sorted already and make it unique.
+ * Only the trailing elements are sorted, then merged with the leading ones
+ * in linear time.
+ * \param [in,out] array       On output sorted without duplicates.
+ * \param [in] num_sorted      Number of leading elements in sorted order.
+ */
+static void
+p4est_ghost_sort_tail (sc_array_t * array, size_t num_sorted,
+                       int (*compar) (const void *, const void *))
+{
+  const size_t        size = array->elem_size;
+  const size_t        num_tail = array->elem_count - num_sorted;
+  size_t              i, j, k;
+  char               *tail;
+  sc_array_t          view;
+
+  P4EST_ASSERT (num_sorted <= array->elem_count);
+  if (num_tail > 0) {
+    sc_array_init_view (&view, array, num_sorted, num_tail);
+    sc_array_sort (&view, compar);
+    if (num_sorted > 0 &&
+        compar (sc_array_index (array, num_sorted - 1),
+                sc_array_index (array, num_sorted)) > 0) {
+      /* merge from the back so that no leading element is overwritten */
+      tail = P4EST_ALLOC (char, num_tail * size);
+      memcpy (tail, sc_array_index (array, num_sorted), num_tail * size);
+      i = num_sorted;
+      j = num_tail;
+      k = array->elem_count;
+      while (j > 0) {
+        --k;
+        if (i > 0 && compar (sc_array_index (array, i - 1),
+                             tail + (j - 1) * size) > 0) {
+          --i;
+          memcpy (sc_array_index (array, k), sc_array_index (array, i), size);
+        }
+        else {
+          --j;
+          memcpy (sc_array_index (array, k), tail + j * size, size);
+        }
+      }
+      P4EST_FREE (tail);
+    }
+  }
+  sc_array_uniq (array, compar);
+}
+
 static void
 p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
                              p4est_ghost_t * ghost)
@@ -3034,6 +5256,7 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
   int                 mpiret;
   sc_array_t         *send_bufs, *buf;
   size_t              zz, *ppz;
+  size_t              send_bytes;
   p4est_topidx_t      t;
   sc_array_t         *nmpma, *nmpfa;
   p4est_locidx_t      old_num_ghosts, num_new_ghosts, ghost_offset;
@@ -3048,16 +5271,23 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
   p4est_locidx_t     *ntq_offset = NULL;
   p4est_locidx_t     *node_to_quad = NULL;
   p4est_topidx_t     *node_to_tree = NULL;
+  p4est_locidx_t     *elem_mirror = NULL;
+  double              inspect_start;
+
+  P4EST_ASSERT (ghost->compact == NULL);
 
+  inspect_start = p4est_inspect_start (p4est->inspect);
   P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_ghost_expand %s\n",
                             p4est_connect_type_string (btype));
   p4est_log_indent_push ();
+  P4EST_REGION_BEGIN ("ghost.expand.candidates");
 
-  tempquads = sc_array_new (sizeof (p4est_quadrant_t));
-  temptrees = sc_array_new (sizeof (p4est_topidx_t));
-  tempquads2 = sc_array_new (sizeof (p4est_quadrant_t));
-  temptrees2 = sc_array_new (sizeof (p4est_topidx_t));
-  npoints = sc_array_new (sizeof (int));
+  /* the neighbor lists are reused from previous calls */
+  tempquads = p4est_scratch_array_new (p4est, sizeof (p4est_quadrant_t));
+  temptrees = p4est_scratch_array_new (p4est, sizeof (p4est_topidx_t));
+  tempquads2 = p4est_scratch_array_new (p4est, sizeof (p4est_quadrant_t));
+  temptrees2 = p4est_scratch_array_new (p4est, sizeof (p4est_topidx_t));
+  npoints = p4est_scratch_array_new (p4est, sizeof (int));
 
   /* if lnodes, build node_to_quad */
   if (lnodes) {
@@ -3248,6 +5478,17 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
 
     P4EST_FREE (node_to_quad_count);
     P4EST_FREE (quad_to_node_global_ghost);
+
+    /* mirrors are sorted like the local elements: map element to mirror */
+    elem_mirror = P4EST_ALLOC (p4est_locidx_t, K);
+    for (qid = 0; qid < K; qid++) {
+      elem_mirror[qid] = -1;
+    }
+    for (il = 0; il < num_mirrors; il++) {
+      qid = p4est_quadrant_array_index (mirrors, (size_t) il)->
+        p.piggy3.local_num;
+      elem_mirror[qid] = il;
+    }
   }
 
   /* post recvs */
@@ -3349,7 +5590,6 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
           for (il = qstart; il < qend; il++) {
             p4est_locidx_t      nqid = node_to_quad[il];
             p4est_topidx_t      nt = node_to_tree[il];
-            p4est_quadrant_t    qtemp;
             p4est_quadrant_t   *q;
             int                 already_in_mirrors = 0;
 
@@ -3366,7 +5606,6 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
             }
             else {
               /* local */
-              ssize_t             idx;
               p4est_tree_t       *tree =
                 p4est_tree_array_index (p4est->trees, nt);
               q =
@@ -3374,22 +5613,10 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
                                             nqid - tree->quadrants_offset);
 
               owner = mpirank;
-              qtemp = *q;
-
-              qtemp.p.piggy3.which_tree = nt;
-              qtemp.p.piggy3.local_num = qid;
-
-              idx =
-                sc_array_bsearch (mirrors, &qtemp,
-                                  p4est_quadrant_compare_piggy);
-              if (idx >= 0) {
-                p4est_locidx_t      key = (p4est_locidx_t) idx;
-
-                idx = sc_array_bsearch (&pview, &key, p4est_locidx_compare);
-
-                if (idx >= 0) {
-                  already_in_mirrors = 1;
-                }
+              if (elem_mirror[nqid] >= 0 &&
+                  sc_array_bsearch (&pview, &elem_mirror[nqid],
+                                    p4est_locidx_compare) >= 0) {
+                already_in_mirrors = 1;
               }
             }
             if (!already_in_mirrors && owner != p) {
@@ -3455,9 +5682,9 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
                                     send_bufs);
 
           }
-          sc_array_reset (tempquads2);
-          sc_array_reset (temptrees2);
-          sc_array_reset (npoints);
+          sc_array_truncate (tempquads2);
+          sc_array_truncate (temptrees2);
+          sc_array_truncate (npoints);
         }
         if (btype == P8EST_CONNECT_EDGE) {
           continue;
@@ -3487,9 +5714,9 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
                                     P4EST_CONNECT_CORNER, nc, tempquads,
                                     temptrees, p, p4est, ghost, send_bufs);
           }
-          sc_array_reset (tempquads2);
-          sc_array_reset (temptrees2);
-          sc_array_reset (npoints);
+          sc_array_truncate (tempquads2);
+          sc_array_truncate (temptrees2);
+          sc_array_truncate (npoints);
         }
       }
     }
@@ -3500,14 +5727,17 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
     P4EST_FREE (ntq_offset);
     P4EST_FREE (node_to_quad);
     P4EST_FREE (node_to_tree);
+    P4EST_FREE (elem_mirror);
   }
-  sc_array_destroy (tempquads);
-  sc_array_destroy (temptrees);
-  sc_array_destroy (tempquads2);
-  sc_array_destroy (temptrees2);
-  sc_array_destroy (npoints);
+  p4est_scratch_array_destroy (p4est, tempquads);
+  p4est_scratch_array_destroy (p4est, temptrees);
+  p4est_scratch_array_destroy (p4est, tempquads2);
+  p4est_scratch_array_destroy (p4est, temptrees2);
+  p4est_scratch_array_destroy (p4est, npoints);
+  P4EST_REGION_END ("ghost.expand.candidates");
 
   /* Send the counts of ghosts that are going to be sent */
+  P4EST_REGION_BEGIN ("ghost.expand.comm");
   new_count = 0;
   for (p = 0, peer = 0; p < mpisize; p++) {
     buf = (sc_array_t *) sc_array_index_int (send_bufs, p);
@@ -3532,6 +5762,9 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
   }
   P4EST_ASSERT (peer == num_peers);
   P4EST_VERBOSEF ("Total new ghosts to send %lld\n", (long long) new_count);
+  send_bytes = (size_t) new_count * sizeof (p4est_quadrant_t);
+  p4est_inspect_alloc (p4est->inspect, P4EST_INSPECT_GHOST_EXPAND,
+                       send_bytes);
 
   /* Wait for the counts */
   if (num_peers > 0) {
@@ -3560,7 +5793,8 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
 
   /* Allocate space for the ghosts */
   old_num_ghosts = (p4est_locidx_t) ghost_layer->elem_count;
-  sc_array_resize (ghost_layer, (size_t) (old_num_ghosts + num_new_ghosts));
+  p4est_array_resize (ghost_layer,
+                      (size_t) (old_num_ghosts + num_new_ghosts));
 
   /* Post receives for the ghosts */
   for (p = 0, peer = 0, ghost_offset = old_num_ghosts; p < mpisize; p++) {
@@ -3596,6 +5830,8 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
       continue;
     }
     buf = (sc_array_t *) sc_array_index (send_bufs, p);
+    p4est_inspect_send (p4est->inspect, P4EST_INSPECT_GHOST_EXPAND, p,
+                        buf->elem_count * sizeof (p4est_quadrant_t));
     if (buf->elem_count > 0) {
       P4EST_ASSERT ((p4est_locidx_t) buf->elem_count == send_counts[peer]);
       P4EST_LDEBUGF
@@ -3624,6 +5860,7 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
       sc_MPI_Waitall (num_peers, send_load_request, MPI_STATUSES_IGNORE);
     SC_CHECK_MPI (mpiret);
   }
+  P4EST_REGION_END ("ghost.expand.comm");
 
 #ifdef P4EST_ENABLE_DEBUG
   for (p = 0; p < num_peers; p++) {
@@ -3635,6 +5872,8 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
 #endif
 
   /* Clean up */
+  p4est_ghost_inspect_comm (p4est, P4EST_INSPECT_GHOST_EXPAND, num_peers,
+                            send_counts, recv_counts);
   P4EST_FREE (recv_counts);
   P4EST_FREE (recv_request);
   P4EST_FREE (send_request);
@@ -3756,9 +5995,9 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
 
     sc_array_resize (ghost_layer, (size_t) (old_num_ghosts + num_new_ghosts));
     if (num_new_ghosts) {
-      /* update the ghost layer */
-      sc_array_sort (ghost_layer, p4est_quadrant_compare_piggy);
-      sc_array_uniq (ghost_layer, p4est_quadrant_compare_piggy);
+      /* update the ghost layer: only the new ghosts need sorting */
+      p4est_ghost_sort_tail (ghost_layer, (size_t) old_num_ghosts,
+                             p4est_quadrant_compare_piggy);
 
       num_new_ghosts = ghost_layer->elem_count - old_num_ghosts;
 
@@ -3810,8 +6049,8 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
               buf->array, buf->elem_count * buf->elem_size);
     }
   }
-  sc_array_sort (new_mirrors, p4est_quadrant_compare_piggy);
-  sc_array_uniq (new_mirrors, p4est_quadrant_compare_piggy);
+  p4est_ghost_sort_tail (new_mirrors, (size_t) old_num_mirrors,
+                         p4est_quadrant_compare_piggy);
   new_num_mirrors = (p4est_locidx_t) new_mirrors->elem_count;
   P4EST_ASSERT (new_num_mirrors >= old_num_mirrors);
 
@@ -3857,6 +6096,8 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
   memcpy (mpf, nmpfa->array, nmpfa->elem_size * nmpfa->elem_count);
   sc_array_destroy (nmpfa);
   sc_array_destroy (send_bufs);
+  p4est_inspect_free (p4est->inspect, P4EST_INSPECT_GHOST_EXPAND,
+                      send_bytes);
 
   /* update mirror_proc_mirrors */
   nmpma = sc_array_new (sizeof (p4est_locidx_t));
@@ -3925,6 +6166,21 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
 #endif
   P4EST_ASSERT (p4est_ghost_is_valid (p4est, ghost));
 
+  /* the neighbor processes may have changed */
+  if (ghost->neighbor_comm != sc_MPI_COMM_NULL) {
+    p4est_ghost_set_neighborhood (p4est, ghost, 1);
+  }
+  if (ghost->index != NULL) {
+    p4est_ghost_set_index (ghost, 1);
+  }
+
+  if (p4est->inspect != NULL) {
+    p4est_inspect_memory (p4est->inspect, P4EST_INSPECT_GHOST_EXPAND,
+                          p4est_ghost_memory_used (ghost));
+  }
+  p4est_inspect_stop (p4est->inspect, P4EST_INSPECT_GHOST_EXPAND,
+                      inspect_start);
+
   p4est_log_indent_pop ();
   P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_ghost_expand\n");
 #endif
@@ -3936,6 +6192,30 @@ p4est_ghost_expand (p4est_t * p4est, p4est_ghost_t * ghost)
   p4est_ghost_expand_internal (p4est, NULL, ghost);
 }
 
+p4est_ghost_t      *
+p4est_ghost_new_layers (p4est_t * p4est, p4est_connect_type_t btype,
+                        int nlayers)
+{
+  int                 layer;
+  p4est_ghost_t      *ghost;
+
+  P4EST_ASSERT (nlayers >= 1);
+
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_ghost_new_layers %d\n",
+                            nlayers);
+  p4est_log_indent_push ();
+
+  /* the outer layers are computed from the fronts of the inner ones */
+  ghost = p4est_ghost_new (p4est, btype);
+  for (layer = 1; layer < nlayers; ++layer) {
+    p4est_ghost_expand_internal (p4est, NULL, ghost);
+  }
+
+  p4est_log_indent_pop ();
+  P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_ghost_new_layers\n");
+  return ghost;
+}
+
 void
 p4est_ghost_expand_by_lnodes (p4est_t * p4est, p4est_lnodes_t * lnodes,
                               p4est_ghost_t * ghost)
@@ -0,0 +1,158 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef P4_TO_P8
+#include <p4est_algorithms.h>
+#include <p4est_communication.h>
+#include <p4est_extended.h>
+#include <p4est_hierarchy.h>
+#else
+#include <p8est_algorithms.h>
+#include <p8est_communication.h>
+#include <p8est_extended.h>
+#include <p8est_hierarchy.h>
+#endif
+
+static int
+p4est_hierarchy_coarsen_all (p4est_t * p4est, p4est_topidx_t which_tree,
+                             p4est_quadrant_t * quadrants[])
+{
+  return 1;
+}
+
+p4est_hierarchy_t  *
+p4est_hierarchy_new (p4est_t * p4est, int max_levels,
+                     p4est_connect_type_t btype, p4est_coarsen_t coarsen_fn)
+{
+  int                 l;
+  p4est_locidx_t      i, j;
+  p4est_t            *fine, *coarse;
+  p4est_adapt_map_t  *map;
+  p4est_hierarchy_t  *hierarchy;
+  p4est_hierarchy_level_t *level;
+
+  P4EST_ASSERT (max_levels >= 1);
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_hierarchy_new with %lld total quadrants\n",
+                            (long long) p4est->global_num_quadrants);
+  p4est_log_indent_push ();
+
+  if (coarsen_fn == NULL) {
+    coarsen_fn = p4est_hierarchy_coarsen_all;
+  }
+
+  hierarchy = P4EST_ALLOC (p4est_hierarchy_t, 1);
+  hierarchy->levels = P4EST_ALLOC_ZERO (p4est_hierarchy_level_t, max_levels);
+  hierarchy->levels[0].p4est = p4est;
+  hierarchy->num_levels = 1;
+  p4est_partition_ext (p4est, 1, NULL);
+
+  for (l = 1; l < max_levels; ++l) {
+    fine = hierarchy->levels[l - 1].p4est;
+
+    /* coarsen a copy in the partition of the finer level */
+    coarse = p4est_copy (fine, 0);
+    map = p4est_adapt_map_new (coarse);
+    p4est_coarsen_ext (coarse, 0, 0, coarsen_fn, NULL, NULL);
+    if (btype != P4EST_CONNECT_SELF) {
+      p4est_balance (coarse, btype, NULL);
+    }
+    if (coarse->global_num_quadrants == fine->global_num_quadrants) {
+      p4est_adapt_map_destroy (map);
+      p4est_destroy (coarse);
+      break;
+    }
+
+    /* restriction and prolongation are local in this partition */
+    level = &hierarchy->levels[l];
+    p4est_adapt_map_update (map, coarse);
+    level->num_parents = map->num_new;
+    level->child_offsets = P4EST_ALLOC (p4est_locidx_t, map->num_new + 1);
+    level->parent_index = P4EST_ALLOC (p4est_locidx_t, map->num_old);
+    for (i = 0; i < map->num_new; ++i) {
+      SC_CHECK_ABORT (map->relation[i] != P4EST_ADAPT_CHILD,
+                      "Hierarchy needs a balanced finest forest");
+      level->child_offsets[i] = map->old_first[i];
+      for (j = 0; j < map->old_count[i]; ++j) {
+        level->parent_index[map->old_first[i] + j] = i;
+      }
+    }
+    level->child_offsets[map->num_new] = map->num_old;
+    p4est_adapt_map_destroy (map);
+
+    /* remember the partition of the parents and prepare the next level */
+    level->parent_gfq = P4EST_ALLOC (p4est_gloidx_t, coarse->mpisize + 1);
+    memcpy (level->parent_gfq, coarse->global_first_quadrant,
+            (coarse->mpisize + 1) * sizeof (p4est_gloidx_t));
+    p4est_partition_ext (coarse, 1, NULL);
+    level->p4est = coarse;
+    ++hierarchy->num_levels;
+  }
+
+  p4est_log_indent_pop ();
+  P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
+                            "_hierarchy_new with %d levels\n",
+                            hierarchy->num_levels);
+  return hierarchy;
+}
+
+void
+p4est_hierarchy_destroy (p4est_hierarchy_t * hierarchy)
+{
+  int                 l;
+  p4est_hierarchy_level_t *level;
+
+  for (l = 1; l < hierarchy->num_levels; ++l) {
+    level = &hierarchy->levels[l];
+    p4est_destroy (level->p4est);
+    P4EST_FREE (level->child_offsets);
+    P4EST_FREE (level->parent_index);
+    P4EST_FREE (level->parent_gfq);
+  }
+  P4EST_FREE (hierarchy->levels);
+  P4EST_FREE (hierarchy);
+}
+
+void
+p4est_hierarchy_transfer (p4est_hierarchy_t * hierarchy, int level,
+                          int to_coarse, void *dest_data,
+                          const void *src_data, size_t data_size)
+{
+  p4est_hierarchy_level_t *hl;
+
+  P4EST_ASSERT (0 < level && level < hierarchy->num_levels);
+
+  hl = &hierarchy->levels[level];
+  if (to_coarse) {
+    p4est_transfer_fixed (hl->p4est->global_first_quadrant, hl->parent_gfq,
+                          hl->p4est->mpicomm, P4EST_COMM_HIERARCHY_TRANSFER,
+                          dest_data, src_data, data_size);
+  }
+  else {
+    p4est_transfer_fixed (hl->parent_gfq, hl->p4est->global_first_quadrant,
+                          hl->p4est->mpicomm, P4EST_COMM_HIERARCHY_TRANSFER,
+                          dest_data, src_data, data_size);
+  }
+}
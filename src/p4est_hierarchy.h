@@ -0,0 +1,123 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+/** \file p4est_hierarchy.h
+ *
+ * A sequence of successively coarsened forests for geometric multigrid.
+ *
+ * Level 0 is the forest passed to \ref p4est_hierarchy_new.  Every further
+ * level is a copy of the previous one that is coarsened by one level,
+ * optionally 2:1 balanced, and partitioned with partition_for_coarsening.
+ * The next level's families are thus complete on one process.  Since
+ * the coarsening precedes the repartition, every quadrant of a level and
+ * its parent on the next level live on the same process.  The parents
+ * are first numbered in the partition of the finer level, where the
+ * restriction and prolongation maps are purely local.  Then
+ * \ref p4est_hierarchy_transfer moves data between this numbering and
+ * the partition of the coarser level.
+ *
+ * Building the hierarchy costs one copy, one non-recursive coarsening and
+ * one partition per level.  The levels shrink geometrically, so the total
+ * cost is close to one coarsening pass of the finest forest.
+ *
+ * \ingroup p4est
+ */
+
+#ifndef P4EST_HIERARCHY_H
+#define P4EST_HIERARCHY_H
+
+#include <p4est.h>
+
+SC_EXTERN_C_BEGIN;
+
+/** One level of a forest hierarchy and its maps to the finer level. */
+typedef struct p4est_hierarchy_level
+{
+  p4est_t            *p4est;            /**< The forest of this level */
+
+  /* the remaining members are NULL or zero on level 0 */
+  p4est_locidx_t      num_parents;      /**< Local quadrants of this level
+                                             in the finer partition */
+  p4est_locidx_t     *child_offsets;    /**< For each parent and one beyond,
+                                             its first child in the local
+                                             numbering of the finer level */
+  p4est_locidx_t     *parent_index;     /**< For each local quadrant of the
+                                             finer level, its parent */
+  p4est_gloidx_t     *parent_gfq;       /**< The partition of the parents,
+                                             mpisize + 1 entries */
+}
+p4est_hierarchy_level_t;
+
+/** A sequence of successively coarsened forests. */
+typedef struct p4est_hierarchy
+{
+  int                 num_levels;       /**< At least one */
+  p4est_hierarchy_level_t *levels;      /**< The finest level comes first */
+}
+p4est_hierarchy_t;
+
+/** Build a hierarchy of successively coarsened forests.  Collective.
+ * \param [in,out] p4est    The finest level.  It is repartitioned with
+ *                          partition_for_coarsening and referenced by the
+ *                          hierarchy, but not destroyed with it.  If \a
+ *                          btype balances, it must be balanced likewise.
+ * \param [in] max_levels   Maximum number of levels including the finest.
+ *                          The construction stops earlier once a level
+ *                          does not coarsen anymore.
+ * \param [in] btype        The balance of the coarse levels, or
+ *                          P4EST_CONNECT_SELF for none.
+ * \param [in] coarsen_fn   Decides about the coarsening of a family.
+ *                          If NULL, every complete family is coarsened.
+ * \return                  The hierarchy.  The coarse forests have no
+ *                          user data.
+ */
+p4est_hierarchy_t *p4est_hierarchy_new (p4est_t * p4est, int max_levels,
+                                        p4est_connect_type_t btype,
+                                        p4est_coarsen_t coarsen_fn);
+
+/** Destroy a hierarchy and its coarse forests, but not the finest one. */
+void                p4est_hierarchy_destroy (p4est_hierarchy_t * hierarchy);
+
+/** Move per-quadrant data between the two numberings of a coarse level.
+ * Collective over the communicator of the forests.
+ * \param [in] hierarchy    A hierarchy built by \ref p4est_hierarchy_new.
+ * \param [in] level        A coarse level, 0 < \a level < num_levels.
+ * \param [in] to_coarse    If true, data indexed by the parents in the
+ *                          finer partition is sent to the local quadrants
+ *                          of \a level.  Otherwise the direction is
+ *                          reversed.
+ * \param [out] dest_data   Memory for the data received.
+ * \param [in] src_data     The data to send.
+ * \param [in] data_size    The fixed data size per quadrant.
+ */
+void                p4est_hierarchy_transfer (p4est_hierarchy_t * hierarchy,
+                                              int level, int to_coarse,
+                                              void *dest_data,
+                                              const void *src_data,
+                                              size_t data_size);
+
+SC_EXTERN_C_END;
+
+#endif /* ! P4EST_HIERARCHY_H */
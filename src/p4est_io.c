@@ -35,6 +35,19 @@
 #endif
 #include <sc_search.h>
 #include <sc.h>
+#ifdef P4EST_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef P4EST_HAVE_SYS_MMAN_H
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef P4EST_WITH_HDF5
+#include <hdf5.h>
+#endif
 
 #ifdef P4EST_ENABLE_FILE_DEPRECATED
 
@@ -443,6 +456,15 @@ p4est_inflate_null (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
 /* Avoid redefinition in p4est_to_p8est.h */
 #ifdef P4_TO_P8
 #define p4est_file_context               p8est_file_context
+#define p4est_file_async                 p8est_file_async
+#define p4est_file_delta                 p8est_file_delta
+#define p4est_file_map                   p8est_file_map
+#endif
+
+/* nonblocking collective file writes require MPI 3.1 */
+#if defined (P4EST_ENABLE_MPIIO) && \
+  (MPI_VERSION > 3 || (MPI_VERSION == 3 && MPI_SUBVERSION >= 1))
+#define P4EST_FILE_HAVE_IWRITE
 #endif
 
 /** The opaque file context for for p4est data files. */
@@ -460,6 +482,68 @@ struct p4est_file_context
   sc_MPI_File         file;             /**< file object */
   sc_MPI_Offset       accessed_bytes;   /**< count only array data bytes and
                                            array metadata bytes */
+  p4est_file_backend_t backend;         /**< storage backend for writing */
+#ifdef P4EST_WITH_HDF5
+  hid_t               h5file;           /**< HDF5 file for that backend */
+#endif
+  p4est_inspect_t    *inspect;          /**< of the forest opened with,
+                                             or NULL */
+};
+
+/** A data set staged for writing in the background. */
+typedef struct p4est_file_staged
+{
+  sc_array_t         *data;             /**< owned copy, may be NULL */
+  size_t              bytes;            /**< local number of bytes */
+#ifdef P4EST_FILE_HAVE_IWRITE
+  MPI_Request         request;          /**< the pending write */
+#endif
+}
+p4est_file_staged_t;
+
+/** The opaque context for writing data sets in the background. */
+struct p4est_file_async
+{
+  p4est_file_context_t *fc;             /**< the file written to */
+  size_t              max_staged;       /**< bound on the staged bytes */
+  size_t              staged;           /**< currently staged bytes */
+  int                 count_error;      /**< a completed write was short */
+  sc_array_t          pending;          /**< p4est_file_staged_t in order */
+};
+
+/** The checkpoint and section that hold the data of a field. */
+typedef struct p4est_file_delta_field
+{
+  char                user_string[P4EST_FILE_USER_STRING_BYTES]; /**< key */
+  p4est_gloidx_t      checkpoint;       /**< -1 if not written */
+  p4est_gloidx_t      section;          /**< section number in the file */
+  size_t              quadrant_size;    /**< bytes per quadrant */
+  size_t              local_count;      /**< local number of entries */
+  uint64_t            hash;             /**< hash of the local data */
+}
+p4est_file_delta_field_t;
+
+/** The opaque context for writing delta checkpoints. */
+struct p4est_file_delta
+{
+  p4est_gloidx_t      checkpoint;       /**< current checkpoint number */
+  p4est_gloidx_t      forest_checkpoint; /**< -1 if no forest written */
+  p4est_gloidx_t      forest_section;   /**< section number in the file */
+  long                revision;         /**< revision of the forest */
+  p4est_locidx_t      local_num_quadrants; /**< local quadrants of it */
+  uint64_t            hash;             /**< hash of its local user data */
+  sc_array_t          fields;           /**< p4est_file_delta_field_t */
+};
+
+/** The opaque context for serial random access to a data file. */
+struct p4est_file_map
+{
+  const char         *data;             /**< the file contents */
+  size_t              size;             /**< the file size in bytes */
+  int                 mapped;           /**< data is mapped, not allocated */
+  p4est_gloidx_t      global_num_quadrants; /**< from the file header */
+  sc_array_t          sections;         /**< p4est_file_section_metadata_t */
+  sc_array_t          offsets;          /**< size_t offset of section data */
 };
 
 /** This function calculates a padding string consisting of spaces.
@@ -636,20 +720,254 @@ p4est_file_error_cleanup (sc_MPI_File * file)
 
 static int          p4est_file_error_code (int errcode, int *p4est_errcode);
 
+#ifdef P4EST_WITH_HDF5
+
+/** Write a NUL-terminated string attribute to an HDF5 object.
+ * \return  A negative value on error.
+ */
+static              herr_t
+p4est_file_h5_string_attribute (hid_t object, const char *name,
+                                const char *value)
+{
+  herr_t              status;
+  hid_t               type, space, attr;
+
+  type = H5Tcopy (H5T_C_S1);
+  H5Tset_size (type, strlen (value) + 1);
+  space = H5Screate (H5S_SCALAR);
+  attr = H5Acreate2 (object, name, type, space, H5P_DEFAULT, H5P_DEFAULT);
+  status = attr < 0 ? -1 : H5Awrite (attr, type, value);
+  if (attr >= 0) {
+    H5Aclose (attr);
+  }
+  H5Sclose (space);
+  H5Tclose (type);
+  return status;
+}
+
+/** Collectively determine whether any rank saw an HDF5 error.
+ * On error close the file, free the context and set errcode.
+ * \return  True if the context has been destroyed.
+ */
+static int
+p4est_file_h5_check (p4est_file_context_t * fc, int failed,
+                     const char *user_msg, int *errcode)
+{
+  int                 mpiret, any_failed;
+
+  mpiret = sc_MPI_Allreduce (&failed, &any_failed, 1, sc_MPI_INT,
+                             sc_MPI_LOR, fc->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  if (!any_failed) {
+    *errcode = P4EST_FILE_ERR_SUCCESS;
+    return 0;
+  }
+
+  P4EST_LERRORF (P4EST_STRING "_file_h5: %s\n", user_msg);
+  H5Fclose (fc->h5file);
+  if (fc->gfq_owned) {
+    P4EST_FREE (fc->global_first_quadrant);
+  }
+  P4EST_FREE (fc);
+  *errcode = P4EST_FILE_ERR_IO;
+  return 1;
+}
+
+/** Write one section as a byte dataset of the HDF5 file.
+ * Each rank writes the hyperslab of rows [row_offset, row_offset +
+ * local_rows) of a dataset with global_rows rows of row_size bytes.
+ */
+static p4est_file_context_t *
+p4est_file_h5_write_section (p4est_file_context_t * fc, char section_type,
+                             int ndims, hsize_t global_rows,
+                             hsize_t row_size, hsize_t row_offset,
+                             hsize_t local_rows, const void *data,
+                             const char *user_string, int *errcode)
+{
+  int                 failed;
+  char                name[BUFSIZ], type_string[2];
+  hsize_t             dims[2], start[2], count[2];
+  hid_t               filespace, memspace, dset, dxpl;
+
+  snprintf (name, BUFSIZ, "section_%06llu",
+            (unsigned long long) fc->num_calls);
+  dims[0] = global_rows;
+  dims[1] = row_size;
+  start[0] = row_offset;
+  start[1] = 0;
+  count[0] = local_rows;
+  count[1] = row_size;
+
+  filespace = H5Screate_simple (ndims, dims, NULL);
+  memspace = H5Screate_simple (ndims, count, NULL);
+  if (local_rows * row_size > 0) {
+    H5Sselect_hyperslab (filespace, H5S_SELECT_SET, start, NULL, count,
+                         NULL);
+  }
+  else {
+    H5Sselect_none (filespace);
+    H5Sselect_none (memspace);
+  }
+
+  dxpl = H5Pcreate (H5P_DATASET_XFER);
+#ifdef P4EST_ENABLE_MPI
+  H5Pset_dxpl_mpio (dxpl, H5FD_MPIO_COLLECTIVE);
+#endif
+
+  /* dataset creation, the write and the attributes are collective */
+  type_string[0] = section_type;
+  type_string[1] = '\0';
+  failed = 0;
+  dset = H5Dcreate2 (fc->h5file, name, H5T_NATIVE_UCHAR, filespace,
+                     H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+  if (dset < 0) {
+    failed = 1;
+  }
+  else {
+    failed = H5Dwrite (dset, H5T_NATIVE_UCHAR, memspace, filespace, dxpl,
+                       data) < 0;
+    failed = p4est_file_h5_string_attribute (dset, "section_type",
+                                             type_string) < 0 || failed;
+    failed = p4est_file_h5_string_attribute (dset, "user_string",
+                                             user_string) < 0 || failed;
+    H5Dclose (dset);
+  }
+  H5Pclose (dxpl);
+  H5Sclose (memspace);
+  H5Sclose (filespace);
+
+  if (p4est_file_h5_check (fc, failed, "Writing a section", errcode)) {
+    return NULL;
+  }
+  ++fc->num_calls;
+  return fc;
+}
+
+/** Create a data file through parallel HDF5. */
+static p4est_file_context_t *
+p4est_file_h5_open_create (p4est_t * p4est, const char *filename,
+                           const char *user_string, int *errcode)
+{
+  int                 failed;
+  long long           global_num_quadrants;
+  hid_t               fapl, space, attr;
+  p4est_file_context_t *fc;
+
+  fc = P4EST_ALLOC (p4est_file_context_t, 1);
+  fc->mpicomm = p4est->mpicomm;
+  fc->local_num_quadrants = p4est->local_num_quadrants;
+  fc->global_num_quadrants = p4est->global_num_quadrants;
+  fc->global_first_quadrant = P4EST_ALLOC (p4est_gloidx_t,
+                                           p4est->mpisize + 1);
+  memcpy (fc->global_first_quadrant, p4est->global_first_quadrant,
+          (p4est->mpisize + 1) * sizeof (p4est_gloidx_t));
+  fc->gfq_owned = 1;
+  fc->accessed_bytes = 0;
+  fc->inspect = p4est->inspect;
+  fc->num_calls = 0;
+  fc->backend = P4EST_FILE_BACKEND_HDF5;
+
+  fapl = H5Pcreate (H5P_FILE_ACCESS);
+#ifdef P4EST_ENABLE_MPI
+  H5Pset_fapl_mpio (fapl, p4est->mpicomm, sc_MPI_INFO_NULL);
+#endif
+  fc->h5file = H5Fcreate (filename, H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
+  H5Pclose (fapl);
+  if (fc->h5file < 0) {
+    /* the creation is collective and fails on all ranks */
+    *errcode = P4EST_FILE_ERR_FILE;
+    P4EST_FILE_CHECK_VERBOSE (*errcode, "File open create");
+    P4EST_FREE (fc->global_first_quadrant);
+    P4EST_FREE (fc);
+    return NULL;
+  }
+
+  /* the file metadata become attributes of the root group */
+  failed = p4est_file_h5_string_attribute (fc->h5file, "magic",
+                                           P4EST_FILE_MAGIC_NUMBER) < 0;
+  failed = p4est_file_h5_string_attribute (fc->h5file, "version",
+                                           p4est_version ()) < 0 || failed;
+  failed = p4est_file_h5_string_attribute (fc->h5file, "user_string",
+                                           user_string) < 0 || failed;
+  global_num_quadrants = (long long) p4est->global_num_quadrants;
+  space = H5Screate (H5S_SCALAR);
+  attr = H5Acreate2 (fc->h5file, "global_num_quadrants",
+                     H5T_NATIVE_LLONG, space, H5P_DEFAULT, H5P_DEFAULT);
+  failed = attr < 0 || failed;
+  if (attr >= 0) {
+    failed = H5Awrite (attr, H5T_NATIVE_LLONG, &global_num_quadrants) < 0
+      || failed;
+    H5Aclose (attr);
+  }
+  H5Sclose (space);
+
+  if (p4est_file_h5_check (fc, failed, "Writing the file header", errcode)) {
+    return NULL;
+  }
+  return fc;
+}
+
+#endif /* P4EST_WITH_HDF5 */
+
 p4est_file_context_t *
-p4est_file_open_create (p4est_t * p4est, const char *filename,
-                        const char *user_string, int *errcode)
+p4est_file_open_create_ext (p4est_t * p4est, const char *filename,
+                            const char *user_string,
+                            p4est_file_backend_t backend, int *errcode)
+{
+  p4est_file_context_t *fc;
+
+  P4EST_ASSERT (errcode != NULL);
+
+  if (backend == P4EST_FILE_BACKEND_NATIVE) {
+    return p4est_file_open_create (p4est, filename, user_string, errcode);
+  }
+
+#ifdef P4EST_WITH_HDF5
+  if (backend == P4EST_FILE_BACKEND_HDF5) {
+    /* check the input as for the native backend */
+    P4EST_ASSERT (p4est_is_valid (p4est));
+    P4EST_ASSERT (filename != NULL);
+    if (strlen (user_string) < P4EST_FILE_USER_STRING_BYTES &&
+        p4est->global_num_quadrants <= P4EST_FILE_MAX_GLOBAL_QUAD) {
+      fc = p4est_file_h5_open_create (p4est, filename, user_string, errcode);
+      p4est_file_error_code (*errcode, errcode);
+      return fc;
+    }
+  }
+#endif
+
+  /* unknown or unavailable backend or invalid input */
+  fc = NULL;
+  *errcode = P4EST_FILE_ERR_IN_DATA;
+  P4EST_FILE_CHECK_VERBOSE (*errcode,
+                            P4EST_STRING "_open_create_ext: Invalid input");
+  return fc;
+}
+
+p4est_file_context_t *
+p4est_file_open_create_partition (sc_MPI_Comm mpicomm,
+                                  const p4est_gloidx_t * gfq,
+                                  const char *filename,
+                                  const char *user_string, int *errcode)
 {
-  int                 mpiret, count, count_error, mpisize;
+  int                 mpiret, count, count_error, mpisize, mpirank;
   /* We enforce the padding of the file header. */
   char                metadata[P4EST_FILE_METADATA_BYTES +
                                P4EST_FILE_BYTE_DIV + 1];
+  p4est_gloidx_t      global_num_quadrants;
   p4est_file_context_t *file_context;
 
-  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (gfq != NULL);
   P4EST_ASSERT (filename != NULL);
   P4EST_ASSERT (errcode != NULL);
 
+  mpiret = sc_MPI_Comm_size (mpicomm, &mpisize);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Comm_rank (mpicomm, &mpirank);
+  SC_CHECK_MPI (mpiret);
+  P4EST_ASSERT (gfq[0] == 0);
+  global_num_quadrants = gfq[mpisize];
+
   if (!(strlen (user_string) < P4EST_FILE_USER_STRING_BYTES)) {
     /* invalid user string */
     *errcode = P4EST_FILE_ERR_IN_DATA;
@@ -662,7 +980,7 @@ p4est_file_open_create (p4est_t * p4est, const char *filename,
     return NULL;
   }
 
-  if (!(p4est->global_num_quadrants <= P4EST_FILE_MAX_GLOBAL_QUAD)) {
+  if (!(global_num_quadrants <= P4EST_FILE_MAX_GLOBAL_QUAD)) {
     /* number of global quadrant can not be written to the file header */
     *errcode = P4EST_FILE_ERR_IN_DATA;
     /* We do not use p4est file error macro since there is no
@@ -678,16 +996,16 @@ p4est_file_open_create (p4est_t * p4est, const char *filename,
 
   /* Open the file and create a new file if necessary */
   mpiret =
-    sc_io_open (p4est->mpicomm, filename,
+    sc_io_open (mpicomm, filename,
                 SC_IO_WRITE_CREATE, sc_MPI_INFO_NULL, &file_context->file);
   P4EST_FILE_CHECK_OPEN (mpiret, file_context, "File open create", errcode);
 
-  if (p4est->mpirank == 0) {
+  if (mpirank == 0) {
     /* write padded p4est-defined header */
     snprintf (metadata, P4EST_FILE_METADATA_BYTES + P4EST_FILE_BYTE_DIV + 1,
               "%.7s\n%-23s\n%-47s\n%.16lld\n%-14s\n", P4EST_FILE_MAGIC_NUMBER,
               p4est_version (), user_string,
-              (long long) p4est->global_num_quadrants, "");
+              (long long) global_num_quadrants, "");
     mpiret =
       sc_io_write_at (file_context->file, 0, metadata,
                       P4EST_FILE_METADATA_BYTES + P4EST_FILE_BYTE_DIV,
@@ -698,28 +1016,47 @@ p4est_file_open_create (p4est_t * p4est, const char *filename,
                                    P4EST_FILE_BYTE_DIV, count);
   }
 
-  P4EST_HANDLE_MPI_ERROR (mpiret, file_context, p4est->mpicomm, errcode);
+  P4EST_HANDLE_MPI_ERROR (mpiret, file_context, mpicomm, errcode);
 
   /* initialize the file context */
-  file_context->mpicomm = p4est->mpicomm;
-  file_context->local_num_quadrants = p4est->local_num_quadrants;
-  file_context->global_num_quadrants = p4est->global_num_quadrants;
-  mpiret = sc_MPI_Comm_size (p4est->mpicomm, &mpisize);
+  file_context->mpicomm = mpicomm;
+  file_context->local_num_quadrants =
+    (p4est_locidx_t) (gfq[mpirank + 1] - gfq[mpirank]);
+  file_context->global_num_quadrants = global_num_quadrants;
   file_context->global_first_quadrant =
     P4EST_ALLOC (p4est_gloidx_t, mpisize + 1);
-  memcpy (file_context->global_first_quadrant, p4est->global_first_quadrant,
+  memcpy (file_context->global_first_quadrant, gfq,
           (mpisize + 1) * sizeof (p4est_gloidx_t));
   file_context->gfq_owned = 1;
 
   P4EST_HANDLE_MPI_COUNT_ERROR (count_error, file_context, errcode);
 
   file_context->accessed_bytes = 0;
+  file_context->inspect = NULL;
   file_context->num_calls = 0;
+  file_context->backend = P4EST_FILE_BACKEND_NATIVE;
 
   p4est_file_error_code (*errcode, errcode);
   return file_context;
 }
 
+p4est_file_context_t *
+p4est_file_open_create (p4est_t * p4est, const char *filename,
+                        const char *user_string, int *errcode)
+{
+  p4est_file_context_t *fc;
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+
+  fc = p4est_file_open_create_partition (p4est->mpicomm,
+                                         p4est->global_first_quadrant,
+                                         filename, user_string, errcode);
+  if (fc != NULL) {
+    fc->inspect = p4est->inspect;
+  }
+  return fc;
+}
+
 p4est_file_context_t *
 p4est_file_open_read_ext (sc_MPI_Comm mpicomm, const char *filename,
                           char *user_string,
@@ -746,7 +1083,9 @@ p4est_file_open_read_ext (sc_MPI_Comm mpicomm, const char *filename,
   file_context->global_first_quadrant = NULL;
   file_context->gfq_owned = 0;
   file_context->accessed_bytes = 0;
+  file_context->inspect = NULL;
   file_context->num_calls = 0;
+  file_context->backend = P4EST_FILE_BACKEND_NATIVE;
 
   /* get the MPI rank */
   mpiret = sc_MPI_Comm_rank (mpicomm, &rank);
@@ -830,16 +1169,20 @@ p4est_file_open_read (p4est_t * p4est, const char *filename,
     /* use the partition of the given p4est */
     fc->global_first_quadrant = p4est->global_first_quadrant;
     fc->gfq_owned = 0;
+    fc->inspect = p4est->inspect;
   }
 
   p4est_file_error_code (*errcode, errcode);
   return fc;
 }
 
-p4est_file_context_t *
-p4est_file_write_block (p4est_file_context_t * fc, size_t block_size,
-                        sc_array_t * block_data,
-                        const char *user_string, int *errcode)
+/** Write a block section of the given type.
+ * See \ref p4est_file_write_block for the remaining parameters.
+ */
+static p4est_file_context_t *
+p4est_file_write_block_type (p4est_file_context_t * fc, char block_type,
+                             size_t block_size, sc_array_t * block_data,
+                             const char *user_string, int *errcode)
 {
   size_t              num_pad_bytes;
   char                header_metadata[P4EST_FILE_FIELD_HEADER_BYTES + 1],
@@ -873,6 +1216,16 @@ p4est_file_write_block (p4est_file_context_t * fc, size_t block_size,
   mpiret = sc_MPI_Comm_rank (fc->mpicomm, &rank);
   SC_CHECK_MPI (mpiret);
 
+#ifdef P4EST_WITH_HDF5
+  if (fc->backend == P4EST_FILE_BACKEND_HDF5) {
+    /* the block is written by rank zero only */
+    return p4est_file_h5_write_section (fc, block_type, 1, block_size, 1, 0,
+                                        rank == 0 ? block_size : 0,
+                                        block_data->array, user_string,
+                                        errcode);
+  }
+#endif
+
 #ifdef P4EST_ENABLE_MPIIO
   /* set the file size */
   mpiret = MPI_File_set_size (fc->file,
@@ -890,8 +1243,8 @@ p4est_file_write_block (p4est_file_context_t * fc, size_t block_size,
     /* header-dependent metadata */
     snprintf (header_metadata,
               P4EST_FILE_FIELD_HEADER_BYTES +
-              1, "B %.13llu\n%-47s\n", (unsigned long long) block_size,
-              user_string);
+              1, "%c %.13llu\n%-47s\n", block_type,
+              (unsigned long long) block_size, user_string);
 
     /* write header-dependent metadata */
     mpiret =
@@ -945,6 +1298,15 @@ p4est_file_write_block (p4est_file_context_t * fc, size_t block_size,
   return fc;
 }
 
+p4est_file_context_t *
+p4est_file_write_block (p4est_file_context_t * fc, size_t block_size,
+                        sc_array_t * block_data,
+                        const char *user_string, int *errcode)
+{
+  return p4est_file_write_block_type (fc, 'B', block_size, block_data,
+                                      user_string, errcode);
+}
+
 /** Collectivly read and check block metadata.
  * If user_string == NULL data_size is not compared to
  * read_data_size.
@@ -993,7 +1355,8 @@ p4est_file_read_block_metadata (p4est_file_context_t * fc,
   /* check for given block specifying character */
   invalid_block = 0;
   if (block_metadata[0] != block_type) {
-    invalid_block = block_metadata[0] != 'F' && block_metadata[0] != 'B';
+    invalid_block = block_metadata[0] != 'F' && block_metadata[0] != 'B'
+      && block_metadata[0] != 'C' && block_metadata[0] != 'R';
     if (rank == 0) {
       if (invalid_block) {
         P4EST_LERROR (P4EST_STRING
@@ -1032,7 +1395,9 @@ p4est_file_read_block_metadata (p4est_file_context_t * fc,
   /* we cut off the block type specifier */
   *read_data_size = sc_atol (&block_metadata[2]);
 
-  if (user_string != NULL && *read_data_size != data_size) {
+  /* the element size of a compressed section is checked by the caller */
+  if (user_string != NULL && block_type != 'C' &&
+      *read_data_size != data_size) {
     if (rank == 0) {
       P4EST_LERRORF (P4EST_STRING
                      "_io: Error reading. Wrong section data size (in file = %ld, by parameter = %ld).\n",
@@ -1073,7 +1438,8 @@ p4est_file_read_block_metadata (p4est_file_context_t * fc,
     if (block_metadata[0] == 'F') {
       data_block_size = *read_data_size * fc->global_num_quadrants;
     }
-    else if (block_metadata[0] == 'B') {
+    else if (block_metadata[0] == 'B' || block_metadata[0] == 'C'
+             || block_metadata[0] == 'R') {
       data_block_size = *read_data_size;
     }
     else {
@@ -1118,10 +1484,13 @@ p4est_file_read_block_metadata (p4est_file_context_t * fc,
   return fc;
 }
 
-p4est_file_context_t *
-p4est_file_read_block (p4est_file_context_t * fc,
-                       size_t block_size, sc_array_t * block_data,
-                       char *user_string, int *errcode)
+/** Read a block section of the given type.
+ * See \ref p4est_file_read_block for the remaining parameters.
+ */
+static p4est_file_context_t *
+p4est_file_read_block_type (p4est_file_context_t * fc, char block_type,
+                            size_t block_size, sc_array_t * block_data,
+                            char *user_string, int *errcode)
 {
   int                 mpiret, count, count_error, rank;
   size_t              num_pad_bytes, read_data_size;
@@ -1145,7 +1514,7 @@ p4est_file_read_block (p4est_file_context_t * fc,
   if (block_data == NULL) {
     /* Nothing to read but we shift our own file pointer */
     if (p4est_file_read_block_metadata
-        (fc, &read_data_size, block_size, 'B', user_string,
+        (fc, &read_data_size, block_size, block_type, user_string,
          errcode) == NULL) {
       p4est_file_error_code (*errcode, errcode);
       return NULL;
@@ -1187,7 +1556,8 @@ p4est_file_read_block (p4est_file_context_t * fc,
 
   /* check the header metadata */
   if (p4est_file_read_block_metadata
-      (fc, &read_data_size, block_size, 'B', user_string, errcode) == NULL) {
+      (fc, &read_data_size, block_size, block_type, user_string,
+       errcode) == NULL) {
     p4est_file_error_code (*errcode, errcode);
     return NULL;
   }
@@ -1217,11 +1587,20 @@ p4est_file_read_block (p4est_file_context_t * fc,
   p4est_file_error_code (*errcode, errcode);
   return fc;
 }
-
 p4est_file_context_t *
-p4est_file_write_field (p4est_file_context_t * fc, size_t quadrant_size,
-                        sc_array_t * quadrant_data, const char *user_string,
-                        int *errcode)
+p4est_file_read_block (p4est_file_context_t * fc,
+                       size_t block_size, sc_array_t * block_data,
+                       char *user_string, int *errcode)
+{
+  return p4est_file_read_block_type (fc, 'B', block_size, block_data,
+                                     user_string, errcode);
+}
+
+/** Write a field; see \ref p4est_file_write_field for the parameters. */
+static p4est_file_context_t *
+p4est_file_write_field_int (p4est_file_context_t * fc, size_t quadrant_size,
+                            sc_array_t * quadrant_data,
+                            const char *user_string, int *errcode)
 {
   size_t              bytes_to_write, num_pad_bytes, array_size;
   char                array_metadata[P4EST_FILE_FIELD_HEADER_BYTES + 1],
@@ -1255,6 +1634,18 @@ p4est_file_write_field (p4est_file_context_t * fc, size_t quadrant_size,
   mpiret = sc_MPI_Comm_rank (fc->mpicomm, &rank);
   SC_CHECK_MPI (mpiret);
 
+#ifdef P4EST_WITH_HDF5
+  if (fc->backend == P4EST_FILE_BACKEND_HDF5) {
+    /* one row of the dataset per global quadrant */
+    return p4est_file_h5_write_section (fc, 'F', 2, fc->global_num_quadrants,
+                                        quadrant_data->elem_size,
+                                        fc->global_first_quadrant[rank],
+                                        quadrant_data->elem_count,
+                                        quadrant_data->array, user_string,
+                                        errcode);
+  }
+#endif
+
   /* Check how many bytes we write to the disk */
   bytes_to_write = quadrant_data->elem_count * quadrant_data->elem_size;
 
@@ -1346,8 +1737,9 @@ p4est_file_write_field (p4est_file_context_t * fc, size_t quadrant_size,
   return fc;
 }
 
-p4est_file_context_t *
-p4est_file_read_field_ext (p4est_file_context_t * fc, p4est_gloidx_t * gfq,
+/** Read a field; see \ref p4est_file_read_field_ext for the parameters. */
+static p4est_file_context_t *
+p4est_file_read_field_int (p4est_file_context_t * fc, p4est_gloidx_t * gfq,
                            size_t quadrant_size, sc_array_t * quadrant_data,
                            char *user_string, int *errcode)
 {
@@ -1443,6 +1835,44 @@ p4est_file_read_field_ext (p4est_file_context_t * fc, p4est_gloidx_t * gfq,
   return fc;
 }
 
+p4est_file_context_t *
+p4est_file_write_field (p4est_file_context_t * fc, size_t quadrant_size,
+                        sc_array_t * quadrant_data, const char *user_string,
+                        int *errcode)
+{
+  p4est_inspect_t    *inspect = fc->inspect;
+  const double        inspect_start = p4est_inspect_start (inspect);
+
+  /* the context is closed on error */
+  fc = p4est_file_write_field_int (fc, quadrant_size, quadrant_data,
+                                   user_string, errcode);
+  if (fc != NULL) {
+    p4est_inspect_comm (inspect, P4EST_INSPECT_FILE, 0, 0,
+                        quadrant_size * quadrant_data->elem_count, 0, 0);
+  }
+  p4est_inspect_stop (inspect, P4EST_INSPECT_FILE, inspect_start);
+  return fc;
+}
+
+p4est_file_context_t *
+p4est_file_read_field_ext (p4est_file_context_t * fc, p4est_gloidx_t * gfq,
+                           size_t quadrant_size, sc_array_t * quadrant_data,
+                           char *user_string, int *errcode)
+{
+  p4est_inspect_t    *inspect = fc->inspect;
+  const double        inspect_start = p4est_inspect_start (inspect);
+
+  /* the context is closed on error */
+  fc = p4est_file_read_field_int (fc, gfq, quadrant_size, quadrant_data,
+                                  user_string, errcode);
+  if (fc != NULL && quadrant_data != NULL) {
+    p4est_inspect_comm (inspect, P4EST_INSPECT_FILE, 0, 0, 0, 0,
+                        quadrant_size * quadrant_data->elem_count);
+  }
+  p4est_inspect_stop (inspect, P4EST_INSPECT_FILE, inspect_start);
+  return fc;
+}
+
 p4est_file_context_t *
 p4est_file_read_field (p4est_file_context_t * fc, size_t quadrant_size,
                        sc_array_t * quadrant_data, char *user_string,
@@ -1499,62 +1929,479 @@ p4est_file_read_field (p4est_file_context_t * fc, size_t quadrant_size,
   return retfc;
 }
 
-/** This function checks for successful completion and cleans up if required.
- *
- * \param[in,out]  file     The MPI file that will be closed in case of an error.
- * \param[in]      eclass   The eclass that indicates if an error occured.
- *                          \b eclass is an MPI, libsc or p4est_file error
- *                          code.
- * \param[out]     errcode  The error code that is obtained by converting
- *                          \b eclass to p4est_file error code.
- * \return                  -1 if \b eclass indicates an error,
- *                          0 otherwise.
+/** The number of entries in the index of a compressed field section that
+ * was written by \a num_chunks ranks. The index stores the element size,
+ * the compression method, the number of chunks, and the global first
+ * quadrant and the first byte of the compressed stream for each chunk.
  */
-static int
-p4est_file_info_cleanup (sc_MPI_File * file, int eclass, int *errcode)
-{
-  if (!P4EST_FILE_IS_SUCCESS (eclass)) {
-    p4est_file_error_cleanup (file);
-    p4est_file_error_code (eclass, errcode);
-    return -1;
-  }
-  return 0;
-}
+#define P4EST_FILE_COMPRESSED_INDEX_ENTRIES(num_chunks) \
+  (3 + 2 * ((size_t) (num_chunks) + 1))
 
-int
-p4est_file_info (p4est_t * p4est, const char *filename,
-                 char *user_string, sc_array_t * data_sections, int *errcode)
+/* compression methods of a compressed field section */
+#define P4EST_FILE_COMPRESS_RAW 0       /**< chunks are stored verbatim */
+#define P4EST_FILE_COMPRESS_ZLIB 1      /**< chunks are zlib streams */
+
+p4est_file_context_t *
+p4est_file_write_field_compressed (p4est_file_context_t * fc,
+                                   size_t quadrant_size,
+                                   sc_array_t * quadrant_data,
+                                   const char *user_string, int *errcode)
 {
-  int                 mpiret, eclass;
-  int                 count, count_error;
-  long                long_header;
-  size_t              current_size, num_pad_bytes;
-  char                metadata[P4EST_FILE_METADATA_BYTES + 1];
-  char                block_metadata[P4EST_FILE_FIELD_HEADER_BYTES + 1];
-  p4est_gloidx_t      global_num_quadrants;
-  p4est_file_section_metadata_t *current_member;
-  sc_MPI_Offset       current_position;
-  sc_MPI_File         file;
+  size_t              raw_bytes, comp_bytes, index_bytes, payload_size;
+  size_t              lead_bytes, num_pad_bytes;
+  char                array_metadata[P4EST_FILE_FIELD_HEADER_BYTES + 1],
+    pad[P4EST_FILE_MAX_NUM_PAD_BYTES];
+  char               *buffer;
+  p4est_gloidx_t     *index, *qoffs, *boffs, local_bytes;
+  sc_MPI_Offset       section_offset, write_offset;
+  int                 mpiret, count, count_error, rank, mpisize, i;
+#ifdef P4EST_HAVE_ZLIB
+  uLongf              zlen;
+#endif
 
-  P4EST_ASSERT (p4est != NULL);
-  P4EST_ASSERT (p4est_is_valid (p4est));
-  P4EST_ASSERT (filename != NULL);
-  P4EST_ASSERT (user_string != NULL);
-  P4EST_ASSERT (data_sections != NULL);
-  P4EST_ASSERT (data_sections->elem_size ==
-                sizeof (p4est_file_section_metadata_t));
+  P4EST_ASSERT (fc != NULL);
+  P4EST_ASSERT (fc->backend == P4EST_FILE_BACKEND_NATIVE);
+  P4EST_ASSERT (fc->global_first_quadrant != NULL);
+  P4EST_ASSERT (quadrant_data != NULL
+                && (quadrant_data->elem_count == 0
+                    || quadrant_data->elem_count ==
+                    (size_t) fc->local_num_quadrants));
+  P4EST_ASSERT (quadrant_size == quadrant_data->elem_size);
   P4EST_ASSERT (errcode != NULL);
 
-  /* set default output values */
-  sc_array_reset (data_sections);
-
-  /* open the file in reading mode */
-  *errcode = eclass = sc_MPI_SUCCESS;   /* MPI defines MPI_SUCCESS to equal 0. */
-  file = sc_MPI_FILE_NULL;
+  if (!(strlen (user_string) < P4EST_FILE_USER_STRING_BYTES)) {
+    *errcode = P4EST_FILE_ERR_IN_DATA;
+    P4EST_FILE_CHECK_NULL (*errcode, fc,
+                           P4EST_STRING
+                           "_file_write_field_compressed: Invalid user string",
+                           errcode);
+  }
 
-  /* we do not use the general error handling since we can not close the file */
-  eclass = sc_io_open (p4est->mpicomm, filename, SC_IO_READ,
-                       sc_MPI_INFO_NULL, &file);
+  if (!(quadrant_size <= P4EST_FILE_MAX_FIELD_ENTRY_SIZE)) {
+    *errcode = P4EST_FILE_ERR_IN_DATA;
+    P4EST_FILE_CHECK_NULL (*errcode, fc,
+                           P4EST_STRING
+                           "_file_write_field_compressed: Invalid byte number per field entry",
+                           errcode);
+  }
+
+  mpiret = sc_MPI_Comm_rank (fc->mpicomm, &rank);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Comm_size (fc->mpicomm, &mpisize);
+  SC_CHECK_MPI (mpiret);
+  section_offset = fc->accessed_bytes + P4EST_FILE_METADATA_BYTES +
+    P4EST_FILE_BYTE_DIV;
+
+  /* rank 0 prepends the section header and the index to its chunk */
+  index_bytes =
+    P4EST_FILE_COMPRESSED_INDEX_ENTRIES (mpisize) * sizeof (p4est_gloidx_t);
+  lead_bytes = (rank == 0) ? P4EST_FILE_FIELD_HEADER_BYTES + index_bytes : 0;
+
+  /* compress the local chunk independently of all other ranks */
+  raw_bytes = quadrant_data->elem_count * quadrant_size;
+  comp_bytes = 0;
+#ifdef P4EST_HAVE_ZLIB
+  zlen = (raw_bytes > 0) ? compressBound ((uLong) raw_bytes) : 0;
+  buffer = P4EST_ALLOC (char, lead_bytes + zlen);
+  if (raw_bytes > 0) {
+    if (compress ((Bytef *) (buffer + lead_bytes), &zlen,
+                  (const Bytef *) quadrant_data->array,
+                  (uLong) raw_bytes) != Z_OK) {
+      SC_ABORT (P4EST_STRING "_file_write_field_compressed: compress");
+    }
+    comp_bytes = (size_t) zlen;
+  }
+#else
+  buffer = P4EST_ALLOC (char, lead_bytes + raw_bytes);
+  if (raw_bytes > 0) {
+    memcpy (buffer + lead_bytes, quadrant_data->array, raw_bytes);
+    comp_bytes = raw_bytes;
+  }
+#endif
+
+  /* the index is known to all ranks after gathering the chunk sizes */
+  index = P4EST_ALLOC (p4est_gloidx_t,
+                       P4EST_FILE_COMPRESSED_INDEX_ENTRIES (mpisize));
+  index[0] = (p4est_gloidx_t) quadrant_size;
+#ifdef P4EST_HAVE_ZLIB
+  index[1] = P4EST_FILE_COMPRESS_ZLIB;
+#else
+  index[1] = P4EST_FILE_COMPRESS_RAW;
+#endif
+  index[2] = (p4est_gloidx_t) mpisize;
+  qoffs = index + 3;
+  boffs = qoffs + mpisize + 1;
+  memcpy (qoffs, fc->global_first_quadrant,
+          (mpisize + 1) * sizeof (p4est_gloidx_t));
+  local_bytes = (p4est_gloidx_t) comp_bytes;
+  mpiret = sc_MPI_Allgather (&local_bytes, 1, P4EST_MPI_GLOIDX,
+                             boffs + 1, 1, P4EST_MPI_GLOIDX, fc->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  boffs[0] = 0;
+  for (i = 0; i < mpisize; ++i) {
+    boffs[i + 1] += boffs[i];
+  }
+  payload_size = index_bytes + (size_t) boffs[mpisize];
+  write_offset = section_offset + P4EST_FILE_FIELD_HEADER_BYTES +
+    index_bytes + boffs[rank] - lead_bytes;
+
+  if (!(payload_size <= P4EST_FILE_MAX_BLOCK_SIZE)) {
+    P4EST_FREE (buffer);
+    P4EST_FREE (index);
+    *errcode = P4EST_FILE_ERR_IN_DATA;
+    P4EST_FILE_CHECK_NULL (*errcode, fc,
+                           P4EST_STRING
+                           "_file_write_field_compressed: Invalid section size",
+                           errcode);
+  }
+
+  if (rank == 0) {
+    /* the section size counts the index and the compressed stream */
+    snprintf (array_metadata,
+              P4EST_FILE_FIELD_HEADER_BYTES +
+              1, "C %.13llu\n%-47s\n",
+              (unsigned long long) payload_size, user_string);
+    memcpy (buffer, array_metadata, P4EST_FILE_FIELD_HEADER_BYTES);
+    memcpy (buffer + P4EST_FILE_FIELD_HEADER_BYTES, index, index_bytes);
+  }
+  P4EST_FREE (index);
+
+  /* write the header, the index and the compressed chunks back to back */
+  mpiret =
+    sc_io_write_at_all (fc->file, write_offset, buffer,
+                        (int) (lead_bytes + comp_bytes), sc_MPI_BYTE,
+                        &count);
+  P4EST_FREE (buffer);
+  P4EST_FILE_CHECK_NULL (mpiret, fc, "Writing compressed quadrant-wise",
+                         errcode);
+  P4EST_FILE_CHECK_COUNT ((lead_bytes + comp_bytes), count, fc, errcode);
+
+  /* write padding bytes after the data as in \ref p4est_file_write_field */
+  if (rank == 0) {
+    p4est_file_get_padding_string (payload_size, P4EST_FILE_BYTE_DIV, pad,
+                                   &num_pad_bytes);
+    mpiret =
+      sc_io_write_at (fc->file,
+                      section_offset + P4EST_FILE_FIELD_HEADER_BYTES +
+                      payload_size, pad, num_pad_bytes, sc_MPI_BYTE, &count);
+    P4EST_FILE_CHECK_MPI (mpiret,
+                          "Writing padding bytes for a compressed array");
+    count_error = ((int) num_pad_bytes != count);
+    P4EST_FILE_CHECK_COUNT_SERIAL (num_pad_bytes, count);
+  }
+  else {
+    p4est_file_get_padding_string (payload_size, P4EST_FILE_BYTE_DIV, NULL,
+                                   &num_pad_bytes);
+  }
+
+  P4EST_HANDLE_MPI_ERROR (mpiret, fc, fc->mpicomm, errcode);
+  P4EST_HANDLE_MPI_COUNT_ERROR (count_error, fc, errcode);
+
+  /* This is *not* the processor local value */
+  fc->accessed_bytes +=
+    payload_size + P4EST_FILE_FIELD_HEADER_BYTES + num_pad_bytes;
+  ++fc->num_calls;
+
+  p4est_file_error_code (*errcode, errcode);
+  return fc;
+}
+
+p4est_file_context_t *
+p4est_file_read_field_compressed_ext (p4est_file_context_t * fc,
+                                      p4est_gloidx_t * gfq,
+                                      size_t quadrant_size,
+                                      sc_array_t * quadrant_data,
+                                      char *user_string, int *errcode)
+{
+  size_t              read_data_size, num_pad_bytes, index_bytes;
+  size_t              raw_bytes, chunk_bytes;
+  char               *buffer, *chunk, *dest;
+  p4est_gloidx_t      head[3], *offsets, *qoffs, *boffs;
+  p4est_gloidx_t      lo, hi, first, last;
+  sc_MPI_Offset       section_offset;
+  int                 mpiret, count, rank, mpisize;
+  int                 num_chunks, c, c0, c1;
+  int                 local_error, global_error;
+#ifdef P4EST_HAVE_ZLIB
+  uLongf              zlen;
+#endif
+
+  P4EST_ASSERT (fc != NULL);
+
+  mpiret = sc_MPI_Comm_rank (fc->mpicomm, &rank);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Comm_size (fc->mpicomm, &mpisize);
+  SC_CHECK_MPI (mpiret);
+
+  P4EST_ASSERT (gfq != NULL);
+  P4EST_ASSERT (errcode != NULL);
+  P4EST_ASSERT (user_string != NULL);
+  P4EST_ASSERT (quadrant_data == NULL
+                || quadrant_size == quadrant_data->elem_size);
+
+  /* check gfq in the debug mode */
+  P4EST_ASSERT (gfq[0] == 0);
+  P4EST_ASSERT (gfq[mpisize] == fc->global_num_quadrants);
+
+  /* check the section metadata; read_data_size is the section size */
+  if (p4est_file_read_block_metadata
+      (fc, &read_data_size, quadrant_size, 'C', user_string,
+       errcode) == NULL) {
+    p4est_file_error_code (*errcode, errcode);
+    return NULL;
+  }
+  section_offset = fc->accessed_bytes + P4EST_FILE_METADATA_BYTES +
+    P4EST_FILE_BYTE_DIV + P4EST_FILE_FIELD_HEADER_BYTES;
+
+  /* every rank reads the fixed part of the index */
+  mpiret = sc_io_read_at_all (fc->file, section_offset, head,
+                              (int) sizeof (head), sc_MPI_BYTE, &count);
+  P4EST_FILE_CHECK_NULL (mpiret, fc, "Reading compressed array index",
+                         errcode);
+  P4EST_FILE_CHECK_COUNT (sizeof (head), count, fc, errcode);
+
+  num_chunks = (int) head[2];
+  if ((size_t) head[0] != quadrant_size
+      || (head[1] != P4EST_FILE_COMPRESS_RAW
+#ifdef P4EST_HAVE_ZLIB
+          && head[1] != P4EST_FILE_COMPRESS_ZLIB
+#endif
+      ) || head[2] <= 0 || head[2] >= (p4est_gloidx_t) INT_MAX
+      || (size_t) head[2] > read_data_size
+      || P4EST_FILE_COMPRESSED_INDEX_ENTRIES (num_chunks) *
+      sizeof (p4est_gloidx_t) > read_data_size) {
+    if (rank == 0) {
+      P4EST_LERROR (P4EST_STRING
+                    "_io: Error reading. Wrong compressed section index.\n");
+    }
+    p4est_file_error_cleanup (&fc->file);
+    P4EST_FREE (fc);
+    *errcode = P4EST_FILE_ERR_FORMAT;
+    p4est_file_error_code (*errcode, errcode);
+    return NULL;
+  }
+  index_bytes =
+    P4EST_FILE_COMPRESSED_INDEX_ENTRIES (num_chunks) *
+    sizeof (p4est_gloidx_t);
+
+  /* calculate the padding bytes for this section */
+  p4est_file_get_padding_string (read_data_size, P4EST_FILE_BYTE_DIV, NULL,
+                                 &num_pad_bytes);
+
+  if (quadrant_data != NULL) {
+    sc_array_resize (quadrant_data, (size_t) (gfq[rank + 1] - gfq[rank]));
+
+    /* read the partition of the writer and the chunk offsets */
+    offsets = P4EST_ALLOC (p4est_gloidx_t, 2 * (num_chunks + 1));
+    qoffs = offsets;
+    boffs = offsets + num_chunks + 1;
+    mpiret = sc_io_read_at_all (fc->file, section_offset + sizeof (head),
+                                offsets, (int) (index_bytes - sizeof (head)),
+                                sc_MPI_BYTE, &count);
+    if (!P4EST_FILE_IS_SUCCESS (mpiret)) {
+      P4EST_FREE (offsets);
+    }
+    P4EST_FILE_CHECK_NULL (mpiret, fc, "Reading compressed array index",
+                           errcode);
+    local_error = ((int) (index_bytes - sizeof (head)) != count);
+
+    /* validate the index identically on all ranks */
+    if (!local_error) {
+      local_error = qoffs[0] != 0 ||
+        qoffs[num_chunks] != fc->global_num_quadrants || boffs[0] != 0 ||
+        (size_t) boffs[num_chunks] != read_data_size - index_bytes;
+      for (c = 0; !local_error && c < num_chunks; ++c) {
+        local_error = qoffs[c] > qoffs[c + 1] || boffs[c] > boffs[c + 1];
+      }
+    }
+
+    /* locate the range of writer chunks that overlap our window */
+    lo = gfq[rank];
+    hi = gfq[rank + 1];
+    c0 = c1 = 0;
+    buffer = NULL;
+    if (!local_error && lo < hi) {
+      c0 = p4est_bsearch_partition (lo, qoffs, num_chunks);
+      c1 = p4est_bsearch_partition (hi - 1, qoffs, num_chunks) + 1;
+      buffer = P4EST_ALLOC (char, boffs[c1] - boffs[c0]);
+    }
+
+    /* read the compressed bytes of the overlapping chunks */
+    mpiret = sc_io_read_at_all (fc->file,
+                                section_offset + index_bytes + boffs[c0],
+                                buffer, (int) (boffs[c1] - boffs[c0]),
+                                sc_MPI_BYTE, &count);
+    if (!P4EST_FILE_IS_SUCCESS (mpiret)) {
+      P4EST_FREE (offsets);
+      P4EST_FREE (buffer);
+    }
+    P4EST_FILE_CHECK_NULL (mpiret, fc, "Reading compressed quadrant-wise",
+                           errcode);
+    local_error = local_error || (int) (boffs[c1] - boffs[c0]) != count;
+
+    /* decompress each chunk and copy its overlap with our window */
+    for (c = c0; !local_error && c < c1; ++c) {
+      raw_bytes = (size_t) (qoffs[c + 1] - qoffs[c]) * quadrant_size;
+      chunk_bytes = (size_t) (boffs[c + 1] - boffs[c]);
+      if (raw_bytes == 0) {
+        local_error = (chunk_bytes != 0);
+        continue;
+      }
+      first = SC_MAX (lo, qoffs[c]);
+      last = SC_MIN (hi, qoffs[c + 1]);
+      dest = (char *) quadrant_data->array +
+        (size_t) (first - lo) * quadrant_size;
+
+      /* decompress in place if the chunk lies entirely in our window */
+      chunk = (first == qoffs[c] && last == qoffs[c + 1]) ?
+        dest : P4EST_ALLOC (char, raw_bytes);
+      if (head[1] == P4EST_FILE_COMPRESS_RAW) {
+        local_error = (chunk_bytes != raw_bytes);
+        if (!local_error) {
+          memcpy (chunk, buffer + (boffs[c] - boffs[c0]), raw_bytes);
+        }
+      }
+#ifdef P4EST_HAVE_ZLIB
+      else {
+        zlen = (uLongf) raw_bytes;
+        local_error =
+          uncompress ((Bytef *) chunk, &zlen,
+                      (const Bytef *) (buffer + (boffs[c] - boffs[c0])),
+                      (uLong) chunk_bytes) != Z_OK
+          || (size_t) zlen != raw_bytes;
+      }
+#endif
+      if (chunk != dest) {
+        if (!local_error) {
+          memcpy (dest, chunk + (size_t) (first - qoffs[c]) * quadrant_size,
+                  (size_t) (last - first) * quadrant_size);
+        }
+        P4EST_FREE (chunk);
+      }
+    }
+    P4EST_FREE (offsets);
+    P4EST_FREE (buffer);
+
+    mpiret = sc_MPI_Allreduce (&local_error, &global_error, 1, sc_MPI_INT,
+                               sc_MPI_LOR, fc->mpicomm);
+    SC_CHECK_MPI (mpiret);
+    if (global_error) {
+      if (rank == 0) {
+        P4EST_LERROR (P4EST_STRING
+                      "_io: Error reading. Corrupt compressed section.\n");
+      }
+      p4est_file_error_cleanup (&fc->file);
+      P4EST_FREE (fc);
+      *errcode = P4EST_FILE_ERR_FORMAT;
+      p4est_file_error_code (*errcode, errcode);
+      return NULL;
+    }
+  }
+
+  fc->accessed_bytes +=
+    read_data_size + P4EST_FILE_FIELD_HEADER_BYTES + num_pad_bytes;
+  ++fc->num_calls;
+
+  p4est_file_error_code (*errcode, errcode);
+  return fc;
+}
+
+p4est_file_context_t *
+p4est_file_read_field_compressed (p4est_file_context_t * fc,
+                                  size_t quadrant_size,
+                                  sc_array_t * quadrant_data,
+                                  char *user_string, int *errcode)
+{
+  int                 mpiret, mpisize, uniform;
+  p4est_gloidx_t     *gfq = NULL;
+  p4est_file_context_t *retfc;
+
+  P4EST_ASSERT (fc != NULL);
+  P4EST_ASSERT (errcode != NULL);
+
+  /* fc may be freed by the call below */
+  uniform = (fc->global_first_quadrant == NULL);
+  if (uniform) {
+    /* there is no partition set in the file context */
+    mpiret = sc_MPI_Comm_size (fc->mpicomm, &mpisize);
+    SC_CHECK_MPI (mpiret);
+
+    gfq = P4EST_ALLOC (p4est_gloidx_t, mpisize + 1);
+
+    /* calculate gfq for a uniform partition */
+    p4est_comm_global_first_quadrant (fc->global_num_quadrants, mpisize, gfq);
+  }
+  else {
+    gfq = fc->global_first_quadrant;
+  }
+
+  retfc = p4est_file_read_field_compressed_ext (fc, gfq, quadrant_size,
+                                                quadrant_data, user_string,
+                                                errcode);
+  if (uniform) {
+    P4EST_FREE (gfq);
+  }
+
+  p4est_file_error_code (*errcode, errcode);
+  return retfc;
+}
+
+/** This function checks for successful completion and cleans up if required.
+ *
+ * \param[in,out]  file     The MPI file that will be closed in case of an error.
+ * \param[in]      eclass   The eclass that indicates if an error occured.
+ *                          \b eclass is an MPI, libsc or p4est_file error
+ *                          code.
+ * \param[out]     errcode  The error code that is obtained by converting
+ *                          \b eclass to p4est_file error code.
+ * \return                  -1 if \b eclass indicates an error,
+ *                          0 otherwise.
+ */
+static int
+p4est_file_info_cleanup (sc_MPI_File * file, int eclass, int *errcode)
+{
+  if (!P4EST_FILE_IS_SUCCESS (eclass)) {
+    p4est_file_error_cleanup (file);
+    p4est_file_error_code (eclass, errcode);
+    return -1;
+  }
+  return 0;
+}
+
+int
+p4est_file_info (p4est_t * p4est, const char *filename,
+                 char *user_string, sc_array_t * data_sections, int *errcode)
+{
+  int                 mpiret, eclass;
+  int                 count, count_error;
+  long                long_header;
+  size_t              current_size, num_pad_bytes;
+  char                metadata[P4EST_FILE_METADATA_BYTES + 1];
+  char                block_metadata[P4EST_FILE_FIELD_HEADER_BYTES + 1];
+  p4est_gloidx_t      global_num_quadrants;
+  p4est_file_section_metadata_t *current_member;
+  sc_MPI_Offset       current_position;
+  sc_MPI_File         file;
+
+  P4EST_ASSERT (p4est != NULL);
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (filename != NULL);
+  P4EST_ASSERT (user_string != NULL);
+  P4EST_ASSERT (data_sections != NULL);
+  P4EST_ASSERT (data_sections->elem_size ==
+                sizeof (p4est_file_section_metadata_t));
+  P4EST_ASSERT (errcode != NULL);
+
+  /* set default output values */
+  sc_array_reset (data_sections);
+
+  /* open the file in reading mode */
+  *errcode = eclass = sc_MPI_SUCCESS;   /* MPI defines MPI_SUCCESS to equal 0. */
+  file = sc_MPI_FILE_NULL;
+
+  /* we do not use the general error handling since we can not close the file */
+  eclass = sc_io_open (p4est->mpicomm, filename, SC_IO_READ,
+                       sc_MPI_INFO_NULL, &file);
 
   if (!P4EST_FILE_IS_SUCCESS (eclass)) {
     *errcode = eclass;
@@ -1641,7 +2488,8 @@ p4est_file_info (p4est_t * p4est, const char *filename,
       /* parse and store the element size, the block type and the user string */
       current_member =
         (p4est_file_section_metadata_t *) sc_array_push (data_sections);
-      if (block_metadata[0] == 'B' || block_metadata[0] == 'F') {
+      if (block_metadata[0] == 'B' || block_metadata[0] == 'F'
+          || block_metadata[0] == 'C' || block_metadata[0] == 'R') {
         /* we want to read the block type */
         current_member->block_type = block_metadata[0];
       }
@@ -1686,7 +2534,9 @@ p4est_file_info (p4est_t * p4est, const char *filename,
         current_size =
           (size_t) (p4est->global_num_quadrants * current_member->data_size);
       }
-      else if (current_member->block_type == 'B') {
+      else if (current_member->block_type == 'B'
+               || current_member->block_type == 'C'
+               || current_member->block_type == 'R') {
         current_size = current_member->data_size;
       }
       else {
@@ -1915,12 +2765,15 @@ p4est_file_error_string (int errclass, char *string, int *resultlen)
   return sc_MPI_SUCCESS;
 }
 
-/* Write in an already opened file one or two sections. */
-p4est_file_context_t *
-p4est_file_write_p4est (p4est_file_context_t * fc, p4est_t * p4est,
-                        const char *quad_string, const char *quad_data_string,
-                        int *errcode)
+/* Write in an already opened file the sections of a forest.
+ * If compact is true, only the level of each quadrant is written.
+ */
+static p4est_file_context_t *
+p4est_file_write_p4est_internal (p4est_file_context_t * fc, p4est_t * p4est,
+                                 int compact, const char *quad_string,
+                                 const char *quad_data_string, int *errcode)
 {
+  p4est_locidx_t      il;
   p4est_gloidx_t     *pertree;
   sc_array_t          arr;
   sc_array_t         *quads, *quad_data;
@@ -1953,12 +2806,26 @@ p4est_file_write_p4est (p4est_file_context_t * fc, p4est_t * p4est,
 
   quads = p4est_deflate_quadrants (p4est, &quad_data);
 
-  /* p4est_file_write_field requires per rank local_num_quadrants many elements
-   * and therefore we group the data per local quadrant by type casting.
-   */
-  sc_array_init_reshape (&reshape, quads,
-                         P4EST_FILE_COMPRESSED_QUAD_SIZE,
-                         p4est->local_num_quadrants);
+  if (compact) {
+    /* the leaves of a tree are complete and sorted: the levels suffice */
+    sc_array_init_size (&reshape, sizeof (int8_t),
+                        (size_t) p4est->local_num_quadrants);
+    for (il = 0; il < p4est->local_num_quadrants; ++il) {
+      *(int8_t *) sc_array_index (&reshape, (size_t) il) = (int8_t)
+        *(p4est_qcoord_t *) sc_array_index (quads, (size_t)
+                                            ((P4EST_DIM + 1) * il +
+                                             P4EST_DIM));
+    }
+  }
+  else {
+    /* p4est_file_write_field requires per rank local_num_quadrants many
+     * elements and therefore we group the data per local quadrant by type
+     * casting.
+     */
+    sc_array_init_reshape (&reshape, quads,
+                           P4EST_FILE_COMPRESSED_QUAD_SIZE,
+                           p4est->local_num_quadrants);
+  }
 
   /** Write the current p4est to the file; we do not write the
    * connectivity to disk because the connectivity is assumed to
@@ -1967,9 +2834,11 @@ p4est_file_write_p4est (p4est_file_context_t * fc, p4est_t * p4est,
   fc =
     p4est_file_write_field (fc, reshape.elem_size, &reshape, quad_string,
                             errcode);
+  sc_array_reset (&reshape);
   if (*errcode != P4EST_FILE_ERR_SUCCESS) {
     P4EST_ASSERT (fc == NULL);
     /* first write call failed */
+    P4EST_FREE (pertree);
     sc_array_destroy (quads);
     sc_array_destroy (quad_data);
     return NULL;
@@ -1985,6 +2854,24 @@ p4est_file_write_p4est (p4est_file_context_t * fc, p4est_t * p4est,
   return fc;
 }
 
+p4est_file_context_t *
+p4est_file_write_p4est (p4est_file_context_t * fc, p4est_t * p4est,
+                        const char *quad_string, const char *quad_data_string,
+                        int *errcode)
+{
+  return p4est_file_write_p4est_internal (fc, p4est, 0, quad_string,
+                                          quad_data_string, errcode);
+}
+
+p4est_file_context_t *
+p4est_file_write_p4est_compact (p4est_file_context_t * fc, p4est_t * p4est,
+                                const char *quad_string,
+                                const char *quad_data_string, int *errcode)
+{
+  return p4est_file_write_p4est_internal (fc, p4est, 1, quad_string,
+                                          quad_data_string, errcode);
+}
+
 /** Convert read checkpoint data to a simulation p4est.
  *
  * \param [in] mpicomm    MPI communicator of the p4est.
@@ -2043,21 +2930,170 @@ p4est_file_data_to_p4est (sc_MPI_Comm mpicomm, int mpisize,
   return ptemp;
 }
 
-p4est_file_context_t *
-p4est_file_read_p4est (p4est_file_context_t * fc, p4est_connectivity_t * conn,
-                       size_t data_size,
-                       p4est_t ** p4est, char *quad_string,
-                       char *quad_data_string, int *errcode)
+/** Store a linear index in two signed integers for communication. */
+static void
+p4est_file_lid_split (const p4est_lid_t * lid, p4est_gloidx_t * hilo)
 {
-  int                 mpisize, mpiret;
-  p4est_topidx_t      jt;
-  p4est_gloidx_t      jq;
-  p4est_gloidx_t     *gfq, *pertree;
-  sc_array_t          quadrants, quad_data, pertree_arr;
-  p4est_qcoord_t     *comp_quad;
-
-  /* verify call convention */
-  P4EST_ASSERT (fc != NULL);
+#ifdef P4_TO_P8
+  hilo[0] = (p4est_gloidx_t) lid->high_bits;
+  hilo[1] = (p4est_gloidx_t) lid->low_bits;
+#else
+  hilo[0] = 0;
+  hilo[1] = (p4est_gloidx_t) * lid;
+#endif
+}
+
+/** Reconstruct the quadrant coordinates from their levels.
+ * The leaves of each tree are complete and in Morton order, such that the
+ * position of a quadrant is the sum of the volumes of the leaves before it
+ * in its tree.  The volumes of the leaves on earlier processes are
+ * obtained by gathering the volume of each process in its last tree.
+ * This function is collective.
+ *
+ * \param [in] mpicomm    MPI communicator.
+ * \param [in] gfq        The partition of the levels read.
+ * \param [in] pertree    The cumulative count per tree.
+ * \param [in] num_trees  The number of trees.
+ * \param [in] levels     One int8_t per local quadrant.
+ * \param [out] quads     Resized to the compressed local quadrants.
+ * \return                True if the levels describe complete trees.
+ */
+static int
+p4est_file_levels_to_quadrants (sc_MPI_Comm mpicomm,
+                                const p4est_gloidx_t * gfq,
+                                const p4est_gloidx_t * pertree,
+                                p4est_topidx_t num_trees,
+                                sc_array_t * levels, sc_array_t * quads)
+{
+  int                 mpisize, rank, mpiret, q;
+  int                 valid;
+  int8_t              level;
+  size_t              zz, nlocal;
+  p4est_topidx_t      jt, first_tree, last_tree;
+  p4est_gloidx_t      gi, mine[3], *all;
+  p4est_qcoord_t     *comp_quad;
+  p4est_lid_t         one, position, volume, tree_volume;
+  p4est_quadrant_t    quad;
+
+  P4EST_ASSERT (levels->elem_size == sizeof (int8_t));
+  P4EST_ASSERT (quads->elem_size == P4EST_FILE_COMPRESSED_QUAD_SIZE);
+
+  mpiret = sc_MPI_Comm_size (mpicomm, &mpisize);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Comm_rank (mpicomm, &rank);
+  SC_CHECK_MPI (mpiret);
+  nlocal = levels->elem_count;
+  P4EST_ASSERT ((p4est_gloidx_t) nlocal == gfq[rank + 1] - gfq[rank]);
+
+  /* the volume of a quadrant in units of the smallest quadrants */
+  p4est_lid_set_one (&one);
+  p4est_lid_shift_left (&one, P4EST_DIM * P4EST_QMAXLEVEL, &tree_volume);
+
+  /* the tree of the first local quadrant */
+  first_tree = last_tree = -1;
+  if (nlocal > 0) {
+    for (first_tree = 0; pertree[first_tree + 1] <= gfq[rank];
+         ++first_tree);
+    P4EST_ASSERT (first_tree < num_trees);
+  }
+
+  /* gather the volume of every process in its last tree */
+  valid = 1;
+  p4est_lid_set_zero (&position);
+  jt = first_tree;
+  for (zz = 0; zz < nlocal; ++zz) {
+    gi = gfq[rank] + (p4est_gloidx_t) zz;
+    while (pertree[jt + 1] <= gi) {
+      ++jt;
+      p4est_lid_set_zero (&position);
+    }
+    last_tree = jt;
+    level = *(int8_t *) sc_array_index (levels, zz);
+    if (level < 0 || level > P4EST_QMAXLEVEL) {
+      valid = 0;
+      continue;
+    }
+    p4est_lid_shift_left (&one, P4EST_DIM * (P4EST_QMAXLEVEL - level),
+                          &volume);
+    p4est_lid_add_inplace (&position, &volume);
+  }
+  mine[0] = (p4est_gloidx_t) last_tree;
+  p4est_file_lid_split (&position, mine + 1);
+  all = P4EST_ALLOC (p4est_gloidx_t, 3 * mpisize);
+  mpiret = sc_MPI_Allgather (mine, 3, P4EST_MPI_GLOIDX,
+                             all, 3, P4EST_MPI_GLOIDX, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  p4est_lid_set_zero (&position);
+  for (q = 0; q < rank; ++q) {
+    if (all[3 * q] == (p4est_gloidx_t) first_tree) {
+      p4est_lid_init (&volume, (uint64_t) all[3 * q + 1],
+                      (uint64_t) all[3 * q + 2]);
+      p4est_lid_add_inplace (&position, &volume);
+    }
+  }
+  P4EST_FREE (all);
+  if (!valid) {
+    return 0;
+  }
+
+  /* walk the local quadrants and place each one after the previous */
+  sc_array_resize (quads, nlocal);
+  jt = first_tree;
+  P4EST_QUADRANT_INIT (&quad);
+  for (zz = 0; zz < nlocal; ++zz) {
+    gi = gfq[rank] + (p4est_gloidx_t) zz;
+    while (pertree[jt + 1] <= gi) {
+      ++jt;
+      p4est_lid_set_zero (&position);
+    }
+    if (p4est_lid_compare (&position, &tree_volume) >= 0) {
+      return 0;
+    }
+    level = *(int8_t *) sc_array_index (levels, zz);
+    p4est_quadrant_set_morton_ext128 (&quad, P4EST_QMAXLEVEL, &position);
+    quad.level = level;
+    if (!p4est_quadrant_is_valid (&quad)) {
+      /* the quadrant is not aligned with its level */
+      return 0;
+    }
+    p4est_lid_shift_left (&one, P4EST_DIM * (P4EST_QMAXLEVEL - level),
+                          &volume);
+    p4est_lid_add_inplace (&position, &volume);
+    if (gi + 1 == pertree[jt + 1] &&
+        !p4est_lid_is_equal (&position, &tree_volume)) {
+      /* the last leaf of a tree must end at its last corner */
+      return 0;
+    }
+
+    comp_quad = (p4est_qcoord_t *) sc_array_index (quads, zz);
+    comp_quad[0] = quad.x;
+    comp_quad[1] = quad.y;
+#ifdef P4_TO_P8
+    comp_quad[2] = quad.z;
+#endif
+    comp_quad[P4EST_DIM] = (p4est_qcoord_t) level;
+  }
+  return 1;
+}
+
+static p4est_file_context_t *
+p4est_file_read_p4est_internal (p4est_file_context_t * fc,
+                                p4est_connectivity_t * conn,
+                                size_t data_size,
+                                const p4est_gloidx_t * target_gfq,
+                                int compact, p4est_t ** p4est,
+                                char *quad_string, char *quad_data_string,
+                                int *errcode)
+{
+  int                 mpisize, mpiret;
+  p4est_topidx_t      jt;
+  p4est_gloidx_t      jq;
+  p4est_gloidx_t     *gfq, *pertree;
+  sc_array_t          quadrants, quad_data, pertree_arr, levels;
+  p4est_qcoord_t     *comp_quad;
+
+  /* verify call convention */
+  P4EST_ASSERT (fc != NULL);
   P4EST_ASSERT (conn != NULL);
   P4EST_ASSERT (p4est_connectivity_is_valid (conn));
 
@@ -2118,21 +3154,57 @@ p4est_file_read_p4est (p4est_file_context_t * fc, p4est_connectivity_t * conn,
   }
 
   gfq = P4EST_ALLOC (p4est_gloidx_t, mpisize + 1);
-  /** Compute a uniform global first quadrant array to use a uniform
-   * partition to read the data fields in parallel.
-   */
-  p4est_comm_global_first_quadrant (fc->global_num_quadrants, mpisize, gfq);
+  if (target_gfq != NULL) {
+    /* every rank reads exactly its range of the target partition */
+    P4EST_ASSERT (target_gfq[0] == 0);
+    P4EST_ASSERT (target_gfq[mpisize] == fc->global_num_quadrants);
+    memcpy (gfq, target_gfq, (mpisize + 1) * sizeof (p4est_gloidx_t));
+  }
+  else {
+    /** Compute a uniform global first quadrant array to use a uniform
+     * partition to read the data fields in parallel.
+     */
+    p4est_comm_global_first_quadrant (fc->global_num_quadrants, mpisize,
+                                      gfq);
+  }
 
   P4EST_ASSERT (gfq[mpisize] == pertree[conn->num_trees]);
 
   /* read the quadrants */
-  fc =
-    p4est_file_read_field_ext (fc, gfq, quadrants.elem_size, &quadrants,
-                               quad_string, errcode);
-  if (*errcode != P4EST_FILE_ERR_SUCCESS) {
-    P4EST_ASSERT (fc == NULL);
-    /* second read call failed */
-    goto p4est_read_file_p4est_end;
+  if (compact) {
+    sc_array_init (&levels, sizeof (int8_t));
+    fc =
+      p4est_file_read_field_ext (fc, gfq, levels.elem_size, &levels,
+                                 quad_string, errcode);
+    if (*errcode != P4EST_FILE_ERR_SUCCESS) {
+      P4EST_ASSERT (fc == NULL);
+      /* second read call failed */
+      sc_array_reset (&levels);
+      goto p4est_read_file_p4est_end;
+    }
+    if (!p4est_file_levels_to_quadrants (fc->mpicomm, gfq, pertree,
+                                         conn->num_trees, &levels,
+                                         &quadrants)) {
+      *errcode = P4EST_FILE_ERR_P4EST;
+      P4EST_FREE (gfq);
+      sc_array_reset (&levels);
+      sc_array_reset (&pertree_arr);
+      sc_array_reset (&quadrants);
+      P4EST_FILE_CHECK_NULL (*errcode, fc,
+                             P4EST_STRING "_file_read_" P4EST_STRING,
+                             errcode);
+    }
+    sc_array_reset (&levels);
+  }
+  else {
+    fc =
+      p4est_file_read_field_ext (fc, gfq, quadrants.elem_size, &quadrants,
+                                 quad_string, errcode);
+    if (*errcode != P4EST_FILE_ERR_SUCCESS) {
+      P4EST_ASSERT (fc == NULL);
+      /* second read call failed */
+      goto p4est_read_file_p4est_end;
+    }
   }
 
   /* check the read quadrants */
@@ -2185,6 +3257,148 @@ p4est_read_file_p4est_end:
   return fc;
 }
 
+p4est_file_context_t *
+p4est_file_read_p4est_ext (p4est_file_context_t * fc,
+                           p4est_connectivity_t * conn, size_t data_size,
+                           const p4est_gloidx_t * target_gfq,
+                           p4est_t ** p4est, char *quad_string,
+                           char *quad_data_string, int *errcode)
+{
+  return p4est_file_read_p4est_internal (fc, conn, data_size, target_gfq, 0,
+                                         p4est, quad_string,
+                                         quad_data_string, errcode);
+}
+
+p4est_file_context_t *
+p4est_file_read_p4est (p4est_file_context_t * fc, p4est_connectivity_t * conn,
+                       size_t data_size,
+                       p4est_t ** p4est, char *quad_string,
+                       char *quad_data_string, int *errcode)
+{
+  return p4est_file_read_p4est_ext (fc, conn, data_size, NULL, p4est,
+                                    quad_string, quad_data_string, errcode);
+}
+
+p4est_file_context_t *
+p4est_file_read_p4est_compact (p4est_file_context_t * fc,
+                               p4est_connectivity_t * conn, size_t data_size,
+                               const p4est_gloidx_t * gfq, p4est_t ** p4est,
+                               char *quad_string, char *quad_data_string,
+                               int *errcode)
+{
+  return p4est_file_read_p4est_internal (fc, conn, data_size, gfq, 1, p4est,
+                                         quad_string, quad_data_string,
+                                         errcode);
+}
+
+p4est_file_context_t *
+p4est_file_read_weights (p4est_file_context_t * fc, p4est_gloidx_t * gfq,
+                         char *user_string, int *errcode)
+{
+  int                 mpiret, mpisize, rank, i;
+  int                 negative, any_negative;
+  int                 weight;
+  size_t              lowers;
+  uint64_t            cut;
+  int64_t             weight_sum;
+  int64_t            *local_weights, *global_weight_sums;
+  p4est_locidx_t      kl, num_local;
+  p4est_gloidx_t     *uniform, *cuts;
+  sc_array_t          weights;
+
+  P4EST_ASSERT (fc != NULL);
+  P4EST_ASSERT (gfq != NULL);
+  P4EST_ASSERT (errcode != NULL);
+
+  mpiret = sc_MPI_Comm_size (fc->mpicomm, &mpisize);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Comm_rank (fc->mpicomm, &rank);
+  SC_CHECK_MPI (mpiret);
+
+  /* read the weights in a uniform partition */
+  uniform = P4EST_ALLOC (p4est_gloidx_t, mpisize + 1);
+  p4est_comm_global_first_quadrant (fc->global_num_quadrants, mpisize,
+                                    uniform);
+  sc_array_init (&weights, sizeof (int));
+  fc = p4est_file_read_field_ext (fc, uniform, weights.elem_size, &weights,
+                                  user_string, errcode);
+  if (fc == NULL) {
+    P4EST_FREE (uniform);
+    sc_array_reset (&weights);
+    return NULL;
+  }
+
+  /* cumulative weights by quadrant as in p4est_partition_ext */
+  num_local = (p4est_locidx_t) weights.elem_count;
+  local_weights = P4EST_ALLOC (int64_t, num_local + 1);
+  local_weights[0] = 0;
+  negative = 0;
+  for (kl = 0; kl < num_local; ++kl) {
+    weight = *(int *) sc_array_index_int (&weights, (int) kl);
+    negative = negative || weight < 0;
+    local_weights[kl + 1] = local_weights[kl] + SC_MAX (weight, 0);
+  }
+  sc_array_reset (&weights);
+  mpiret = sc_MPI_Allreduce (&negative, &any_negative, 1, sc_MPI_INT,
+                             sc_MPI_LOR, fc->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  if (any_negative) {
+    P4EST_FREE (uniform);
+    P4EST_FREE (local_weights);
+    *errcode = P4EST_FILE_ERR_IN_DATA;
+    P4EST_FILE_CHECK_NULL (*errcode, fc,
+                           P4EST_STRING "_file_read_weights: negative weight",
+                           errcode);
+  }
+
+  /* distribute local weight sums */
+  global_weight_sums = P4EST_ALLOC (int64_t, mpisize + 1);
+  global_weight_sums[0] = 0;
+  mpiret = sc_MPI_Allgather (&local_weights[num_local], 1,
+                             sc_MPI_LONG_LONG_INT, &global_weight_sums[1], 1,
+                             sc_MPI_LONG_LONG_INT, fc->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  for (i = 0; i < mpisize; ++i) {
+    global_weight_sums[i + 1] += global_weight_sums[i];
+  }
+  for (kl = 0; kl <= num_local; ++kl) {
+    local_weights[kl] += global_weight_sums[rank];
+  }
+  weight_sum = global_weight_sums[mpisize];
+
+  if (weight_sum == 0) {
+    /* if all quadrants have zero weight we keep the uniform partition */
+    memcpy (gfq, uniform, (mpisize + 1) * sizeof (p4est_gloidx_t));
+  }
+  else {
+    /* every cut is found by the one rank whose weight range contains it */
+    cuts = P4EST_ALLOC_ZERO (p4est_gloidx_t, mpisize + 1);
+    lowers = 0;
+    for (i = 1; i < mpisize; ++i) {
+      cut = p4est_partition_cut_uint64 ((uint64_t) weight_sum, i, mpisize);
+      if (global_weight_sums[rank] < (int64_t) cut &&
+          (int64_t) cut <= global_weight_sums[rank + 1]) {
+        lowers = sc_search_lower_bound64 ((int64_t) cut, local_weights,
+                                          (size_t) num_local + 1, lowers);
+        P4EST_ASSERT (lowers > 0 && (p4est_locidx_t) lowers <= num_local);
+        cuts[i] = uniform[rank] + (p4est_gloidx_t) lowers;
+      }
+    }
+    mpiret = sc_MPI_Allreduce (cuts, gfq, mpisize + 1, P4EST_MPI_GLOIDX,
+                               sc_MPI_MAX, fc->mpicomm);
+    SC_CHECK_MPI (mpiret);
+    gfq[mpisize] = fc->global_num_quadrants;
+    P4EST_FREE (cuts);
+  }
+
+  P4EST_FREE (uniform);
+  P4EST_FREE (local_weights);
+  P4EST_FREE (global_weight_sums);
+
+  p4est_file_error_code (*errcode, errcode);
+  return fc;
+}
+
 p4est_file_context_t *
 p4est_file_write_connectivity (p4est_file_context_t * fc,
                                p4est_connectivity_t * conn,
@@ -2286,6 +3500,22 @@ p4est_file_read_connectivity (p4est_file_context_t * fc,
   return fc;
 }
 
+sc_MPI_Comm
+p4est_file_get_mpicomm (p4est_file_context_t * fc)
+{
+  P4EST_ASSERT (fc != NULL);
+
+  return fc->mpicomm;
+}
+
+p4est_gloidx_t
+p4est_file_get_global_num_quadrants (p4est_file_context_t * fc)
+{
+  P4EST_ASSERT (fc != NULL);
+
+  return fc->global_num_quadrants;
+}
+
 int
 p4est_file_close (p4est_file_context_t * fc, int *errcode)
 {
@@ -2294,6 +3524,19 @@ p4est_file_close (p4est_file_context_t * fc, int *errcode)
 
   int                 mpiret;
 
+#ifdef P4EST_WITH_HDF5
+  if (fc->backend == P4EST_FILE_BACKEND_HDF5) {
+    mpiret = H5Fclose (fc->h5file) < 0;
+    if (fc->gfq_owned) {
+      P4EST_FREE (fc->global_first_quadrant);
+    }
+    P4EST_FREE (fc);
+    *errcode = mpiret ? P4EST_FILE_ERR_IO : P4EST_FILE_ERR_SUCCESS;
+    P4EST_FILE_CHECK_VERBOSE (*errcode, "Close file");
+    return mpiret ? -1 : 0;
+  }
+#endif
+
   mpiret = sc_io_close (&fc->file);
   P4EST_FILE_CHECK_INT (mpiret, "Close file", errcode);
 
@@ -2306,4 +3549,1143 @@ p4est_file_close (p4est_file_context_t * fc, int *errcode)
   return 0;
 }
 
+
+/** Complete pending background writes in the order they were started.
+ * \param [in] block   If true, wait for all of them.  Otherwise stop at
+ *                     the first write that has not completed yet.
+ */
+static void
+p4est_file_async_finish (p4est_file_async_t * async, int block)
+{
+  size_t              zz, done;
+  p4est_file_staged_t *st;
+#ifdef P4EST_FILE_HAVE_IWRITE
+  int                 mpiret, flag, count;
+  MPI_Status          status;
+#endif
+
+  for (done = 0; done < async->pending.elem_count; ++done) {
+    st = (p4est_file_staged_t *) sc_array_index (&async->pending, done);
+#ifdef P4EST_FILE_HAVE_IWRITE
+    if (block) {
+      mpiret = MPI_Wait (&st->request, &status);
+      SC_CHECK_MPI (mpiret);
+    }
+    else {
+      mpiret = MPI_Test (&st->request, &flag, &status);
+      SC_CHECK_MPI (mpiret);
+      if (!flag) {
+        break;
+      }
+    }
+    mpiret = MPI_Get_count (&status, MPI_BYTE, &count);
+    SC_CHECK_MPI (mpiret);
+    if (count != (int) st->bytes) {
+      async->count_error = 1;
+    }
+#endif
+    P4EST_ASSERT (async->staged >= st->bytes);
+    async->staged -= st->bytes;
+    if (st->data != NULL) {
+      sc_array_destroy (st->data);
+    }
+  }
+
+  /* remove the completed writes from the front of the queue */
+  if (done > 0) {
+    zz = async->pending.elem_count - done;
+    memmove (async->pending.array,
+             sc_array_index (&async->pending, done),
+             zz * sizeof (p4est_file_staged_t));
+    sc_array_resize (&async->pending, zz);
+  }
+}
+
+/** Complete all pending writes, close the file and free both contexts.
+ * \param [in] mpiret  The error that occurred.
+ * \return             Always NULL.
+ */
+static p4est_file_async_t *
+p4est_file_async_abort (p4est_file_async_t * async, int mpiret,
+                        int *errcode)
+{
+  p4est_file_async_finish (async, 1);
+  sc_array_reset (&async->pending);
+  p4est_file_error_cleanup (&async->fc->file);
+  P4EST_FREE (async->fc);
+  P4EST_FREE (async);
+
+  p4est_file_error_code (mpiret, errcode);
+  return NULL;
+}
+
+p4est_file_async_t *
+p4est_file_async_new (p4est_file_context_t * fc, size_t max_staged)
+{
+  p4est_file_async_t *async;
+
+  P4EST_ASSERT (fc != NULL);
+  P4EST_ASSERT (fc->backend == P4EST_FILE_BACKEND_NATIVE);
+
+  async = P4EST_ALLOC_ZERO (p4est_file_async_t, 1);
+  async->fc = fc;
+  async->max_staged = max_staged;
+  sc_array_init (&async->pending, sizeof (p4est_file_staged_t));
+
+  return async;
+}
+
+/** Write a field section whose local data is owned by the async context.
+ * \param [in] data    Array of elem_size * local_num_quadrants bytes,
+ *                     or NULL if there are no local bytes.  Taken over.
+ */
+static p4est_file_async_t *
+p4est_file_async_stage (p4est_file_async_t * async, size_t elem_size,
+                        sc_array_t * data, const char *user_string,
+                        int *errcode)
+{
+  p4est_file_context_t *fc = async->fc;
+  size_t              bytes;
+#ifdef P4EST_FILE_HAVE_IWRITE
+  size_t              array_size, num_pad_bytes;
+  int                 mpiret, rank, count, errs[2];
+  char                array_metadata[P4EST_FILE_FIELD_HEADER_BYTES + 1],
+    pad[P4EST_FILE_MAX_NUM_PAD_BYTES];
+  sc_MPI_Offset       write_offset;
+  p4est_file_staged_t *st;
+#else
+  sc_array_t          view;
+#endif
+
+  bytes = elem_size * (size_t) fc->local_num_quadrants;
+  P4EST_ASSERT (data == NULL || data->elem_count * data->elem_size == bytes);
+
+  /* keep the staged memory bounded by finishing earlier writes */
+  if (async->staged > 0 && async->staged + bytes > async->max_staged) {
+    p4est_file_async_finish (async, 1);
+  }
+
+#ifndef P4EST_FILE_HAVE_IWRITE
+  /* without nonblocking MPI I/O the data set is written right away */
+  if (data != NULL) {
+    view = *data;
+  }
+  else {
+    /* no local bytes; the section is written all the same */
+    view.elem_size = elem_size;
+    view.elem_count = 0;
+    view.byte_alloc = 0;
+    view.array = NULL;
+  }
+  async->fc = p4est_file_write_field (fc, elem_size, &view, user_string,
+                                      errcode);
+  if (data != NULL) {
+    sc_array_destroy (data);
+  }
+  if (async->fc == NULL) {
+    sc_array_reset (&async->pending);
+    P4EST_FREE (async);
+    return NULL;
+  }
+  return async;
+#else
+  mpiret = sc_MPI_Comm_rank (fc->mpicomm, &rank);
+  SC_CHECK_MPI (mpiret);
+  array_size = fc->global_num_quadrants * elem_size;
+
+  /* rank 0 writes the section header and the padding after the data */
+  write_offset = fc->accessed_bytes + P4EST_FILE_METADATA_BYTES +
+    P4EST_FILE_BYTE_DIV;
+  p4est_file_get_padding_string (array_size, P4EST_FILE_BYTE_DIV,
+                                 rank == 0 ? pad : NULL, &num_pad_bytes);
+  errs[0] = sc_MPI_SUCCESS;
+  errs[1] = 0;
+  if (rank == 0) {
+    snprintf (array_metadata,
+              P4EST_FILE_FIELD_HEADER_BYTES +
+              1, "F %.13llu\n%-47s\n", (unsigned long long) elem_size,
+              user_string);
+    errs[0] = sc_io_write_at (fc->file, write_offset, array_metadata,
+                              P4EST_FILE_FIELD_HEADER_BYTES, sc_MPI_BYTE,
+                              &count);
+    errs[1] = (P4EST_FILE_FIELD_HEADER_BYTES != count);
+    if (P4EST_FILE_IS_SUCCESS (errs[0]) && !errs[1]) {
+      errs[0] = sc_io_write_at (fc->file, write_offset +
+                                P4EST_FILE_FIELD_HEADER_BYTES + array_size,
+                                pad, num_pad_bytes, sc_MPI_BYTE, &count);
+      errs[1] = ((int) num_pad_bytes != count);
+    }
+  }
+  mpiret = sc_MPI_Bcast (errs, 2, sc_MPI_INT, 0, fc->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  if (!P4EST_FILE_IS_SUCCESS (errs[0]) || errs[1]) {
+    if (data != NULL) {
+      sc_array_destroy (data);
+    }
+    return p4est_file_async_abort
+      (async, errs[1] ? P4EST_FILE_ERR_COUNT : errs[0], errcode);
+  }
+
+  /* start the collective write of the local data */
+  st = (p4est_file_staged_t *) sc_array_push (&async->pending);
+  st->data = data;
+  st->bytes = bytes;
+  mpiret = MPI_File_iwrite_at_all
+    (fc->file, write_offset + P4EST_FILE_FIELD_HEADER_BYTES +
+     fc->global_first_quadrant[rank] * elem_size,
+     data == NULL ? NULL : data->array, (int) bytes, MPI_BYTE, &st->request);
+  if (mpiret != sc_MPI_SUCCESS) {
+    /* the request has not been started */
+    sc_array_resize (&async->pending, async->pending.elem_count - 1);
+    if (data != NULL) {
+      sc_array_destroy (data);
+    }
+    return p4est_file_async_abort (async, mpiret, errcode);
+  }
+  async->staged += bytes;
+
+  /* This is *not* the processor local value */
+  fc->accessed_bytes += array_size + P4EST_FILE_FIELD_HEADER_BYTES +
+    num_pad_bytes;
+  ++fc->num_calls;
+
+  *errcode = P4EST_FILE_ERR_SUCCESS;
+  return async;
+#endif
+}
+
+p4est_file_async_t *
+p4est_file_async_write_field (p4est_file_async_t * async,
+                              size_t quadrant_size,
+                              sc_array_t * quadrant_data,
+                              const char *user_string, int *errcode)
+{
+  size_t              bytes;
+  sc_array_t         *copy;
+
+  P4EST_ASSERT (async != NULL);
+  P4EST_ASSERT (quadrant_data != NULL
+                && (quadrant_data->elem_count == 0
+                    || quadrant_data->elem_count ==
+                    (size_t) async->fc->local_num_quadrants));
+  P4EST_ASSERT (quadrant_size == quadrant_data->elem_size);
+  P4EST_ASSERT (errcode != NULL);
+
+  if (!(strlen (user_string) < P4EST_FILE_USER_STRING_BYTES) ||
+      !(quadrant_size <= P4EST_FILE_MAX_FIELD_ENTRY_SIZE)) {
+    *errcode = P4EST_FILE_ERR_IN_DATA;
+    P4EST_FILE_CHECK_VERBOSE (*errcode, P4EST_STRING
+                              "_file_async_write_field: Invalid input");
+    return p4est_file_async_abort (async, P4EST_FILE_ERR_IN_DATA, errcode);
+  }
+
+  /* take a snapshot so the caller may modify the data after return */
+  copy = NULL;
+  bytes = quadrant_data->elem_count * quadrant_size;
+  if (bytes > 0) {
+    if (async->staged > 0 && async->staged + bytes > async->max_staged) {
+      p4est_file_async_finish (async, 1);
+    }
+    copy = sc_array_new_size (quadrant_size, quadrant_data->elem_count);
+    memcpy (copy->array, quadrant_data->array, bytes);
+  }
+
+  return p4est_file_async_stage (async, quadrant_size, copy, user_string,
+                                 errcode);
+}
+
+p4est_file_async_t *
+p4est_file_async_write_p4est (p4est_file_async_t * async, p4est_t * p4est,
+                              const char *quad_string,
+                              const char *quad_data_string, int *errcode)
+{
+  p4est_gloidx_t     *pertree;
+  sc_array_t          arr;
+  sc_array_t         *quads, *quad_data;
+
+  P4EST_ASSERT (async != NULL);
+  P4EST_ASSERT (p4est != NULL);
+  P4EST_ASSERT (errcode != NULL);
+
+  /* the block write below must not fail with writes pending */
+  p4est_file_async_finish (async, 1);
+
+  /* the count per tree is small and written directly */
+  pertree = P4EST_ALLOC (p4est_gloidx_t, p4est->connectivity->num_trees + 1);
+  p4est_comm_count_pertree (p4est, pertree);
+  sc_array_init_data (&arr, pertree,
+                      sizeof (p4est_gloidx_t) *
+                      (p4est->connectivity->num_trees + 1), 1);
+  async->fc = p4est_file_write_block (async->fc, arr.elem_size, &arr,
+                                      P4EST_STRING " count per tree",
+                                      errcode);
+  P4EST_FREE (pertree);
+  if (async->fc == NULL) {
+    sc_array_reset (&async->pending);
+    P4EST_FREE (async);
+    return NULL;
+  }
+
+  /* the deflated arrays are the snapshot; group them per quadrant */
+  quads = p4est_deflate_quadrants (p4est, &quad_data);
+  quads->elem_size = P4EST_FILE_COMPRESSED_QUAD_SIZE;
+  quads->elem_count = (size_t) p4est->local_num_quadrants;
+  async = p4est_file_async_stage (async, P4EST_FILE_COMPRESSED_QUAD_SIZE,
+                                  quads, quad_string, errcode);
+  if (async == NULL) {
+    sc_array_destroy (quad_data);
+    return NULL;
+  }
+  return p4est_file_async_stage (async, quad_data->elem_size, quad_data,
+                                 quad_data_string, errcode);
+}
+
+int
+p4est_file_async_test (p4est_file_async_t * async)
+{
+  P4EST_ASSERT (async != NULL);
+
+  p4est_file_async_finish (async, 0);
+  return async->pending.elem_count == 0;
+}
+
+size_t
+p4est_file_async_staged (p4est_file_async_t * async)
+{
+  P4EST_ASSERT (async != NULL);
+
+  return async->staged;
+}
+
+p4est_file_context_t *
+p4est_file_async_wait (p4est_file_async_t * async, int *errcode)
+{
+  int                 mpiret, count_error;
+  p4est_file_context_t *fc;
+
+  P4EST_ASSERT (async != NULL);
+  P4EST_ASSERT (errcode != NULL);
+
+  p4est_file_async_finish (async, 1);
+  P4EST_ASSERT (async->staged == 0);
+  mpiret = sc_MPI_Allreduce (&async->count_error, &count_error, 1,
+                             sc_MPI_INT, sc_MPI_LOR, async->fc->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  if (count_error) {
+    p4est_file_async_abort (async, P4EST_FILE_ERR_COUNT, errcode);
+    return NULL;
+  }
+
+  fc = async->fc;
+  sc_array_reset (&async->pending);
+  P4EST_FREE (async);
+
+  *errcode = P4EST_FILE_ERR_SUCCESS;
+  return fc;
+}
+
+/** Read the type of the next section without advancing the context. */
+static p4est_file_context_t *
+p4est_file_peek_section (p4est_file_context_t * fc, char *block_type,
+                         int *errcode)
+{
+  int                 mpiret, count, count_error, rank;
+
+  P4EST_ASSERT (fc != NULL);
+  P4EST_ASSERT (block_type != NULL);
+
+  mpiret = sc_MPI_Comm_rank (fc->mpicomm, &rank);
+  SC_CHECK_MPI (mpiret);
+
+  if (rank == 0) {
+    mpiret = sc_io_read_at (fc->file,
+                            fc->accessed_bytes + P4EST_FILE_METADATA_BYTES +
+                            P4EST_FILE_BYTE_DIV, block_type, 1, sc_MPI_BYTE,
+                            &count);
+    P4EST_FILE_CHECK_MPI (mpiret, "Reading section type");
+    count_error = (1 != count);
+    P4EST_FILE_CHECK_COUNT_SERIAL (1, count);
+  }
+  P4EST_HANDLE_MPI_ERROR (mpiret, fc, fc->mpicomm, errcode);
+  P4EST_HANDLE_MPI_COUNT_ERROR (count_error, fc, errcode);
+
+  mpiret = sc_MPI_Bcast (block_type, 1, sc_MPI_BYTE, 0, fc->mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  return fc;
+}
+
+/** Advance the context over the next section of any type. */
+static p4est_file_context_t *
+p4est_file_skip_section (p4est_file_context_t * fc, int *errcode)
+{
+  int                 mpiret, count, count_error, rank;
+  char                block_metadata[P4EST_FILE_ARRAY_METADATA_BYTES + 2];
+  size_t              data_size, num_pad_bytes;
+
+  P4EST_ASSERT (fc != NULL);
+
+  mpiret = sc_MPI_Comm_rank (fc->mpicomm, &rank);
+  SC_CHECK_MPI (mpiret);
+
+  if (rank == 0) {
+    mpiret = sc_io_read_at (fc->file,
+                            fc->accessed_bytes + P4EST_FILE_METADATA_BYTES +
+                            P4EST_FILE_BYTE_DIV, block_metadata,
+                            P4EST_FILE_ARRAY_METADATA_BYTES + 2, sc_MPI_BYTE,
+                            &count);
+    P4EST_FILE_CHECK_MPI (mpiret, "Reading section metadata to skip");
+    count_error = (P4EST_FILE_ARRAY_METADATA_BYTES + 2 != count);
+    P4EST_FILE_CHECK_COUNT_SERIAL (P4EST_FILE_ARRAY_METADATA_BYTES + 2,
+                                   count);
+  }
+  P4EST_HANDLE_MPI_ERROR (mpiret, fc, fc->mpicomm, errcode);
+  P4EST_HANDLE_MPI_COUNT_ERROR (count_error, fc, errcode);
+
+  mpiret = sc_MPI_Bcast (block_metadata, P4EST_FILE_ARRAY_METADATA_BYTES + 2,
+                         sc_MPI_BYTE, 0, fc->mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  /* the size of the section depends on its type */
+  data_size = 0;
+  if (block_metadata[P4EST_FILE_ARRAY_METADATA_BYTES + 1] == '\n') {
+    block_metadata[P4EST_FILE_ARRAY_METADATA_BYTES + 1] = '\0';
+    data_size = (size_t) sc_atol (&block_metadata[2]);
+  }
+  else {
+    block_metadata[0] = '\0';
+  }
+  if (block_metadata[0] == 'F') {
+    data_size *= (size_t) fc->global_num_quadrants;
+  }
+  else if (block_metadata[0] != 'B' && block_metadata[0] != 'C'
+           && block_metadata[0] != 'R') {
+    if (rank == 0) {
+      P4EST_LERROR (P4EST_STRING
+                    "_io: Error skipping. Invalid data section type.\n");
+    }
+    p4est_file_error_cleanup (&fc->file);
+    P4EST_FREE (fc);
+    *errcode = P4EST_FILE_ERR_FORMAT;
+    p4est_file_error_code (*errcode, errcode);
+    return NULL;
+  }
+  p4est_file_get_padding_string (data_size, P4EST_FILE_BYTE_DIV, NULL,
+                                 &num_pad_bytes);
+
+  fc->accessed_bytes +=
+    data_size + P4EST_FILE_FIELD_HEADER_BYTES + num_pad_bytes;
+  ++fc->num_calls;
+
+  p4est_file_error_code (*errcode, errcode);
+  return fc;
+}
+
+/** Hash a local data set by the 64-bit FNV-1a function. */
+static uint64_t
+p4est_file_delta_hash (uint64_t hash, const void *data, size_t bytes)
+{
+  size_t              zz;
+  const unsigned char *bdata = (const unsigned char *) data;
+
+  for (zz = 0; zz < bytes; ++zz) {
+    hash ^= (uint64_t) bdata[zz];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+/** Return true if a data set is unchanged on all ranks. */
+static int
+p4est_file_delta_unchanged (sc_MPI_Comm mpicomm, int local_unchanged)
+{
+  int                 mpiret, local_changed, changed;
+
+  local_changed = !local_unchanged;
+  mpiret = sc_MPI_Allreduce (&local_changed, &changed, 1, sc_MPI_INT,
+                             sc_MPI_LOR, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  return !changed;
+}
+
+/** Write a reference to the data of an earlier checkpoint. */
+static p4est_file_context_t *
+p4est_file_delta_write_reference (p4est_file_context_t * fc,
+                                  p4est_gloidx_t checkpoint,
+                                  p4est_gloidx_t section,
+                                  const char *user_string, int *errcode)
+{
+  p4est_gloidx_t      ref[2];
+  sc_array_t          arr;
+
+  ref[0] = checkpoint;
+  ref[1] = section;
+  sc_array_init_data (&arr, ref, sizeof (ref), 1);
+  return p4est_file_write_block_type (fc, 'R', arr.elem_size, &arr,
+                                      user_string, errcode);
+}
+
+p4est_file_delta_t *
+p4est_file_delta_new (void)
+{
+  p4est_file_delta_t *delta;
+
+  delta = P4EST_ALLOC (p4est_file_delta_t, 1);
+  delta->checkpoint = -1;
+  delta->forest_checkpoint = -1;
+  delta->forest_section = 0;
+  delta->revision = 0;
+  delta->local_num_quadrants = 0;
+  delta->hash = 0;
+  sc_array_init (&delta->fields, sizeof (p4est_file_delta_field_t));
+
+  return delta;
+}
+
+void
+p4est_file_delta_destroy (p4est_file_delta_t * delta)
+{
+  P4EST_ASSERT (delta != NULL);
+
+  sc_array_reset (&delta->fields);
+  P4EST_FREE (delta);
+}
+
+p4est_file_context_t *
+p4est_file_delta_write_p4est (p4est_file_context_t * fc,
+                              p4est_file_delta_t * delta, p4est_t * p4est,
+                              const char *quad_string,
+                              const char *quad_data_string, int *errcode)
+{
+  size_t              zz;
+  uint64_t            hash;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+
+  P4EST_ASSERT (fc != NULL);
+  P4EST_ASSERT (delta != NULL);
+  P4EST_ASSERT (p4est != NULL);
+  P4EST_ASSERT (errcode != NULL);
+
+  /* every checkpoint begins with the forest */
+  ++delta->checkpoint;
+
+  /* the quadrant user data is part of the forest section */
+  hash = 0xcbf29ce484222325ULL;
+  if (p4est->data_size > 0) {
+    for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+        q = p4est_quadrant_array_index (&tree->quadrants, zz);
+        hash = p4est_file_delta_hash (hash, q->p.user_data,
+                                      p4est->data_size);
+      }
+    }
+  }
+
+  if (p4est_file_delta_unchanged (p4est->mpicomm,
+                                  delta->forest_checkpoint >= 0 &&
+                                  delta->revision == p4est->revision &&
+                                  delta->local_num_quadrants ==
+                                  p4est->local_num_quadrants &&
+                                  delta->hash == hash)) {
+    return p4est_file_delta_write_reference (fc, delta->forest_checkpoint,
+                                             delta->forest_section,
+                                             quad_string, errcode);
+  }
+
+  /* field data of an earlier forest must not be referenced */
+  sc_array_truncate (&delta->fields);
+  delta->forest_checkpoint = delta->checkpoint;
+  delta->forest_section = (p4est_gloidx_t) fc->num_calls;
+  delta->revision = p4est->revision;
+  delta->local_num_quadrants = p4est->local_num_quadrants;
+  delta->hash = hash;
+
+  fc = p4est_file_write_p4est (fc, p4est, quad_string, quad_data_string,
+                               errcode);
+  if (fc == NULL) {
+    delta->forest_checkpoint = -1;
+  }
+  return fc;
+}
+
+p4est_file_context_t *
+p4est_file_delta_write_field (p4est_file_context_t * fc,
+                              p4est_file_delta_t * delta,
+                              size_t quadrant_size,
+                              sc_array_t * quadrant_data,
+                              const char *user_string, int *errcode)
+{
+  size_t              zz;
+  uint64_t            hash;
+  p4est_file_delta_field_t *field;
+
+  P4EST_ASSERT (fc != NULL);
+  P4EST_ASSERT (delta != NULL && delta->checkpoint >= 0);
+  P4EST_ASSERT (quadrant_data != NULL);
+  P4EST_ASSERT (quadrant_size == quadrant_data->elem_size);
+  P4EST_ASSERT (user_string != NULL);
+  P4EST_ASSERT (errcode != NULL);
+
+  hash = p4est_file_delta_hash (0xcbf29ce484222325ULL, quadrant_data->array,
+                                quadrant_data->elem_count * quadrant_size);
+
+  /* fields are identified by their user string */
+  field = NULL;
+  for (zz = 0; zz < delta->fields.elem_count; ++zz) {
+    field = (p4est_file_delta_field_t *) sc_array_index (&delta->fields, zz);
+    if (!strncmp (field->user_string, user_string,
+                  P4EST_FILE_USER_STRING_BYTES)) {
+      break;
+    }
+    field = NULL;
+  }
+
+  if (p4est_file_delta_unchanged (fc->mpicomm,
+                                  field != NULL && field->checkpoint >= 0 &&
+                                  field->quadrant_size == quadrant_size &&
+                                  field->local_count ==
+                                  quadrant_data->elem_count &&
+                                  field->hash == hash)) {
+    return p4est_file_delta_write_reference (fc, field->checkpoint,
+                                             field->section, user_string,
+                                             errcode);
+  }
+
+  if (field == NULL) {
+    field = (p4est_file_delta_field_t *) sc_array_push (&delta->fields);
+    sc_strcopy (field->user_string, P4EST_FILE_USER_STRING_BYTES,
+                user_string);
+  }
+  field->checkpoint = delta->checkpoint;
+  field->section = (p4est_gloidx_t) fc->num_calls;
+  field->quadrant_size = quadrant_size;
+  field->local_count = quadrant_data->elem_count;
+  field->hash = hash;
+
+  fc = p4est_file_write_field (fc, quadrant_size, quadrant_data,
+                               user_string, errcode);
+  if (fc == NULL) {
+    field->checkpoint = -1;
+  }
+  return fc;
+}
+
+/** Read the next section if it is a reference.
+ * \param [out] ref     The checkpoint and section referenced if
+ *                      \a is_ref is true on output.
+ */
+static p4est_file_context_t *
+p4est_file_delta_read_reference (p4est_file_context_t * fc, int *is_ref,
+                                 p4est_gloidx_t * ref, char *user_string,
+                                 int *errcode)
+{
+  char                block_type;
+  sc_array_t          arr;
+
+  *is_ref = 0;
+  if ((fc = p4est_file_peek_section (fc, &block_type, errcode)) == NULL ||
+      block_type != 'R') {
+    return fc;
+  }
+
+  *is_ref = 1;
+  sc_array_init_data (&arr, ref, 2 * sizeof (p4est_gloidx_t), 1);
+  return p4est_file_read_block_type (fc, 'R', arr.elem_size, &arr,
+                                     user_string, errcode);
+}
+
+/** Open the checkpoint referenced and advance to the referenced section.
+ * The referenced data is read in the partition of \a fc.
+ * \return              The new context or NULL and an error code.
+ */
+static p4est_file_context_t *
+p4est_file_delta_open_reference (p4est_file_context_t * fc,
+                                 const char **chain,
+                                 const p4est_gloidx_t * ref, int *errcode)
+{
+  char                user_string[P4EST_FILE_USER_STRING_BYTES];
+  p4est_gloidx_t      global_num_quadrants, jg;
+  p4est_file_context_t *ref_fc;
+
+  P4EST_ASSERT (chain != NULL && chain[ref[0]] != NULL);
+
+  ref_fc = p4est_file_open_read_ext (fc->mpicomm, chain[ref[0]],
+                                     user_string, &global_num_quadrants,
+                                     errcode);
+  if (ref_fc == NULL) {
+    return NULL;
+  }
+  if (global_num_quadrants != fc->global_num_quadrants) {
+    p4est_file_close (ref_fc, errcode);
+    *errcode = P4EST_FILE_ERR_FORMAT;
+    return NULL;
+  }
+  ref_fc->global_first_quadrant = fc->global_first_quadrant;
+  ref_fc->gfq_owned = 0;
+
+  for (jg = 0; jg < ref[1]; ++jg) {
+    if ((ref_fc = p4est_file_skip_section (ref_fc, errcode)) == NULL) {
+      return NULL;
+    }
+  }
+  return ref_fc;
+}
+
+p4est_file_context_t *
+p4est_file_delta_read_p4est (p4est_file_context_t * fc, const char **chain,
+                             p4est_connectivity_t * conn, size_t data_size,
+                             p4est_t ** p4est, char *quad_string,
+                             char *quad_data_string, int *errcode)
+{
+  int                 is_ref;
+  p4est_gloidx_t      ref[2];
+  p4est_file_context_t *ref_fc;
+
+  P4EST_ASSERT (fc != NULL);
+  P4EST_ASSERT (p4est != NULL);
+  P4EST_ASSERT (errcode != NULL);
+
+  *p4est = NULL;
+  if ((fc = p4est_file_delta_read_reference (fc, &is_ref, ref, quad_string,
+                                             errcode)) == NULL || !is_ref) {
+    return fc == NULL ? NULL :
+      p4est_file_read_p4est (fc, conn, data_size, p4est, quad_string,
+                             quad_data_string, errcode);
+  }
+
+  /* the forest is stored in an earlier checkpoint */
+  if ((ref_fc = p4est_file_delta_open_reference (fc, chain, ref, errcode))
+      == NULL ||
+      (ref_fc = p4est_file_read_p4est (ref_fc, conn, data_size, p4est,
+                                       quad_string, quad_data_string,
+                                       errcode)) == NULL ||
+      p4est_file_close (ref_fc, errcode)) {
+    if (*p4est != NULL) {
+      p4est_destroy (*p4est);
+      *p4est = NULL;
+    }
+    P4EST_FILE_CHECK_NULL (*errcode, fc,
+                           P4EST_STRING "_file_delta_read_" P4EST_STRING,
+                           errcode);
+  }
+
+  p4est_file_error_code (*errcode, errcode);
+  return fc;
+}
+
+p4est_file_context_t *
+p4est_file_delta_read_field (p4est_file_context_t * fc, const char **chain,
+                             size_t quadrant_size,
+                             sc_array_t * quadrant_data, char *user_string,
+                             int *errcode)
+{
+  int                 is_ref;
+  p4est_gloidx_t      ref[2];
+  p4est_file_context_t *ref_fc;
+
+  P4EST_ASSERT (fc != NULL);
+  P4EST_ASSERT (errcode != NULL);
+
+  if ((fc = p4est_file_delta_read_reference (fc, &is_ref, ref, user_string,
+                                             errcode)) == NULL || !is_ref) {
+    return fc == NULL ? NULL :
+      p4est_file_read_field (fc, quadrant_size, quadrant_data, user_string,
+                             errcode);
+  }
+
+  /* the field is stored in an earlier checkpoint */
+  if ((ref_fc = p4est_file_delta_open_reference (fc, chain, ref, errcode))
+      == NULL ||
+      (ref_fc = p4est_file_read_field (ref_fc, quadrant_size, quadrant_data,
+                                       user_string, errcode)) == NULL ||
+      p4est_file_close (ref_fc, errcode)) {
+    P4EST_FILE_CHECK_NULL (*errcode, fc,
+                           P4EST_STRING "_file_delta_read_field", errcode);
+  }
+
+  p4est_file_error_code (*errcode, errcode);
+  return fc;
+}
+
+/** Load or map a file for reading.
+ * \return              The file error code.
+ */
+static int
+p4est_file_map_load (p4est_file_map_t * map, const char *filename)
+{
+#ifdef P4EST_HAVE_SYS_MMAN_H
+  int                 fd;
+  struct stat         st;
+  void               *addr;
+
+  if ((fd = open (filename, O_RDONLY)) < 0) {
+    return (errno == ENOENT) ? P4EST_FILE_ERR_NO_SUCH_FILE :
+      (errno == EACCES) ? P4EST_FILE_ERR_ACCESS : P4EST_FILE_ERR_FILE;
+  }
+  if (fstat (fd, &st)) {
+    close (fd);
+    return P4EST_FILE_ERR_IO;
+  }
+  map->size = (size_t) st.st_size;
+  if (map->size > 0) {
+    /* pages are only read from disk when they are accessed */
+    addr = mmap (NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      close (fd);
+      return P4EST_FILE_ERR_IO;
+    }
+    map->data = (const char *) addr;
+    map->mapped = 1;
+  }
+  close (fd);
+#else
+  FILE               *file;
+  long                fsize;
+  char               *buffer;
+
+  /* without mmap we read the whole file */
+  if ((file = fopen (filename, "rb")) == NULL) {
+    return P4EST_FILE_ERR_NO_SUCH_FILE;
+  }
+  if (fseek (file, 0, SEEK_END) || (fsize = ftell (file)) < 0 ||
+      fseek (file, 0, SEEK_SET)) {
+    fclose (file);
+    return P4EST_FILE_ERR_IO;
+  }
+  map->size = (size_t) fsize;
+  buffer = P4EST_ALLOC (char, map->size + 1);
+  map->data = buffer;
+  if (fread (buffer, 1, map->size, file) != map->size) {
+    fclose (file);
+    return P4EST_FILE_ERR_IO;
+  }
+  fclose (file);
+#endif
+  return P4EST_FILE_ERR_SUCCESS;
+}
+
+p4est_file_map_t   *
+p4est_file_map_open (const char *filename, char *user_string, int *errcode)
+{
+  int                 eclass;
+  char                metadata[P4EST_FILE_METADATA_BYTES + 1];
+  char                size_string[P4EST_FILE_ARRAY_METADATA_BYTES];
+  const char         *header;
+  size_t              offset, data_size, num_pad_bytes;
+  p4est_file_map_t   *map;
+  p4est_file_section_metadata_t *section;
+
+  P4EST_ASSERT (filename != NULL);
+  P4EST_ASSERT (user_string != NULL);
+  P4EST_ASSERT (errcode != NULL);
+
+  map = P4EST_ALLOC_ZERO (p4est_file_map_t, 1);
+  sc_array_init (&map->sections, sizeof (p4est_file_section_metadata_t));
+  sc_array_init (&map->offsets, sizeof (size_t));
+  if ((eclass = p4est_file_map_load (map, filename)) !=
+      P4EST_FILE_ERR_SUCCESS) {
+    *errcode = eclass;
+    p4est_file_map_close (map);
+    return NULL;
+  }
+
+  /* check the file header */
+  if (map->size < P4EST_FILE_METADATA_BYTES + P4EST_FILE_BYTE_DIV) {
+    *errcode = P4EST_FILE_ERR_FORMAT;
+    p4est_file_map_close (map);
+    return NULL;
+  }
+  memcpy (metadata, map->data, P4EST_FILE_METADATA_BYTES);
+  metadata[P4EST_FILE_METADATA_BYTES] = '\0';
+  if (p4est_file_check_file_metadata (sc_MPI_COMM_SELF, filename,
+                                      user_string, metadata,
+                                      &map->global_num_quadrants) !=
+      sc_MPI_SUCCESS) {
+    *errcode = P4EST_FILE_ERR_FORMAT;
+    p4est_file_map_close (map);
+    return NULL;
+  }
+
+  /* parse the section headers once; stop at the first incomplete one */
+  offset = P4EST_FILE_METADATA_BYTES + P4EST_FILE_BYTE_DIV;
+  while (offset + P4EST_FILE_FIELD_HEADER_BYTES <= map->size) {
+    header = map->data + offset;
+    if ((header[0] != 'F' && header[0] != 'B' && header[0] != 'C' &&
+         header[0] != 'R') ||
+        header[P4EST_FILE_ARRAY_METADATA_BYTES + 1] != '\n' ||
+        header[P4EST_FILE_FIELD_HEADER_BYTES - 1] != '\n') {
+      break;
+    }
+    memcpy (size_string, &header[2], P4EST_FILE_ARRAY_METADATA_CHARS);
+    size_string[P4EST_FILE_ARRAY_METADATA_CHARS] = '\0';
+    data_size = (size_t) sc_atol (size_string);
+
+    /* a field section holds one entry per quadrant */
+    offset += P4EST_FILE_FIELD_HEADER_BYTES;
+    if (header[0] == 'F') {
+      if (map->global_num_quadrants > 0 && data_size >
+          (map->size - offset) / (size_t) map->global_num_quadrants) {
+        break;
+      }
+      data_size *= (size_t) map->global_num_quadrants;
+    }
+    p4est_file_get_padding_string (data_size, P4EST_FILE_BYTE_DIV, NULL,
+                                   &num_pad_bytes);
+    if (data_size + num_pad_bytes > map->size - offset ||
+        map->data[offset + data_size] != '\n' ||
+        map->data[offset + data_size + num_pad_bytes - 1] != '\n') {
+      break;
+    }
+
+    section = (p4est_file_section_metadata_t *) sc_array_push (&map->sections);
+    section->block_type = header[0];
+    section->data_size = (size_t) sc_atol (size_string);
+    memcpy (section->user_string, &header[P4EST_FILE_ARRAY_METADATA_BYTES + 2],
+            P4EST_FILE_USER_STRING_BYTES - 1);
+    section->user_string[P4EST_FILE_USER_STRING_BYTES - 1] = '\0';
+    *(size_t *) sc_array_push (&map->offsets) = offset;
+
+    offset += data_size + num_pad_bytes;
+  }
+
+  *errcode = P4EST_FILE_ERR_SUCCESS;
+  return map;
+}
+
+void
+p4est_file_map_close (p4est_file_map_t * map)
+{
+  P4EST_ASSERT (map != NULL);
+
+#ifdef P4EST_HAVE_SYS_MMAN_H
+  if (map->mapped) {
+    munmap ((void *) map->data, map->size);
+  }
+#else
+  P4EST_FREE ((char *) map->data);
+#endif
+  sc_array_reset (&map->sections);
+  sc_array_reset (&map->offsets);
+  P4EST_FREE (map);
+}
+
+p4est_gloidx_t
+p4est_file_map_global_num_quadrants (const p4est_file_map_t * map)
+{
+  P4EST_ASSERT (map != NULL);
+
+  return map->global_num_quadrants;
+}
+
+size_t
+p4est_file_map_num_sections (const p4est_file_map_t * map)
+{
+  P4EST_ASSERT (map != NULL);
+
+  return map->sections.elem_count;
+}
+
+const p4est_file_section_metadata_t *
+p4est_file_map_section (const p4est_file_map_t * map, size_t section)
+{
+  P4EST_ASSERT (map != NULL);
+  P4EST_ASSERT (section < map->sections.elem_count);
+
+  return (const p4est_file_section_metadata_t *)
+    sc_array_index ((sc_array_t *) & map->sections, section);
+}
+
+const void         *
+p4est_file_map_block (const p4est_file_map_t * map, size_t section)
+{
+  P4EST_ASSERT (map != NULL);
+
+  if (section >= map->sections.elem_count ||
+      p4est_file_map_section (map, section)->block_type == 'F') {
+    return NULL;
+  }
+  return map->data +
+    *(size_t *) sc_array_index ((sc_array_t *) & map->offsets, section);
+}
+
+const void         *
+p4est_file_map_field (const p4est_file_map_t * map, size_t section,
+                      p4est_gloidx_t first, p4est_gloidx_t count)
+{
+  const p4est_file_section_metadata_t *meta;
+  const char         *data;
+#if defined (P4EST_HAVE_SYS_MMAN_H) && defined (MADV_WILLNEED)
+  size_t              page, begin, end;
+#endif
+
+  P4EST_ASSERT (map != NULL);
+
+  if (section >= map->sections.elem_count || first < 0 || count < 0 ||
+      first + count > map->global_num_quadrants) {
+    return NULL;
+  }
+  meta = p4est_file_map_section (map, section);
+  if (meta->block_type != 'F') {
+    return NULL;
+  }
+  data = map->data +
+    *(size_t *) sc_array_index ((sc_array_t *) & map->offsets, section) +
+    (size_t) first * meta->data_size;
+
+#if defined (P4EST_HAVE_SYS_MMAN_H) && defined (MADV_WILLNEED)
+  /* announce the range to read it ahead; this is only a hint */
+  if (map->mapped && count > 0 && meta->data_size > 0) {
+    page = (size_t) sysconf (_SC_PAGESIZE);
+    begin = (size_t) (data - map->data) / page * page;
+    end = (size_t) (data - map->data) + (size_t) count * meta->data_size;
+    (void) madvise ((void *) (map->data + begin), end - begin,
+                    MADV_WILLNEED);
+  }
+#endif
+  return data;
+}
+
+/** Scan a contiguous range of quadrants of a mapped file in order.
+ * The fields are accessed in chunks so that the read ahead is announced
+ * for a bounded window at a time.
+ */
+static void
+p4est_file_map_scan_range (const p4est_file_map_t * map,
+                           const int64_t * pertree, p4est_topidx_t num_trees,
+                           size_t quad_section, size_t num_fields,
+                           const size_t *field_sections,
+                           p4est_gloidx_t first, p4est_gloidx_t count,
+                           p4est_file_map_scan_t scan_fn, void *user)
+{
+  const p4est_gloidx_t chunk = 4096;
+  size_t              fz;
+  size_t             *sizes;
+  p4est_topidx_t      jt;
+  p4est_gloidx_t      gi, gc, end, nc;
+  const p4est_qcoord_t *qc;
+  const char        **bases;
+  const void        **fields;
+  p4est_quadrant_t    quad;
+
+  if (count <= 0) {
+    return;
+  }
+  bases = P4EST_ALLOC (const char *, SC_MAX (num_fields, 1));
+  fields = P4EST_ALLOC (const void *, SC_MAX (num_fields, 1));
+  sizes = P4EST_ALLOC (size_t, SC_MAX (num_fields, 1));
+  for (fz = 0; fz < num_fields; ++fz) {
+    sizes[fz] = p4est_file_map_section (map, field_sections[fz])->data_size;
+  }
+
+  /* the tree of the first quadrant is the last one starting at or before */
+  jt = (p4est_topidx_t) sc_search_lower_bound64 ((int64_t) first + 1,
+                                                 pertree,
+                                                 (size_t) num_trees + 1,
+                                                 0) - 1;
+  P4EST_ASSERT (0 <= jt && jt < num_trees);
+
+  P4EST_QUADRANT_INIT (&quad);
+  end = first + count;
+  for (gc = first; gc < end; gc += nc) {
+    nc = SC_MIN (chunk, end - gc);
+    qc = (const p4est_qcoord_t *)
+      p4est_file_map_field (map, quad_section, gc, nc);
+    for (fz = 0; fz < num_fields; ++fz) {
+      bases[fz] = (const char *)
+        p4est_file_map_field (map, field_sections[fz], gc, nc);
+    }
+    for (gi = gc; gi < gc + nc; ++gi) {
+      while (pertree[jt + 1] <= (int64_t) gi) {
+        ++jt;
+      }
+      quad.x = *qc++;
+      quad.y = *qc++;
+#ifdef P4_TO_P8
+      quad.z = *qc++;
+#endif
+      quad.level = (int8_t) *qc++;
+      quad.p.which_tree = jt;
+      for (fz = 0; fz < num_fields; ++fz) {
+        fields[fz] = bases[fz] + (size_t) (gi - gc) * sizes[fz];
+      }
+      if (!scan_fn (jt, &quad, gi, fields, user)) {
+        gc = end;
+        break;
+      }
+    }
+  }
+
+  P4EST_FREE (bases);
+  P4EST_FREE (fields);
+  P4EST_FREE (sizes);
+}
+
+int
+p4est_file_map_scan (const p4est_file_map_t * map, size_t quad_section,
+                     size_t num_fields, const size_t *field_sections,
+                     p4est_gloidx_t first, p4est_gloidx_t count,
+                     p4est_file_map_scan_t scan_fn, void *user)
+{
+  int                 num_threads = 1;
+  int                 t;
+  size_t              fz;
+  p4est_topidx_t      num_trees;
+  const int64_t      *pertree;
+  const p4est_file_section_metadata_t *meta;
+
+  P4EST_ASSERT (map != NULL);
+  P4EST_ASSERT (num_fields == 0 || field_sections != NULL);
+  P4EST_ASSERT (scan_fn != NULL);
+
+  /* the quadrants follow the block of quadrant counts per tree */
+  if (quad_section == 0 || quad_section >= map->sections.elem_count ||
+      first < 0 || count < 0 || first + count > map->global_num_quadrants) {
+    return P4EST_FILE_ERR_IN_DATA;
+  }
+  meta = p4est_file_map_section (map, quad_section);
+  if (meta->block_type != 'F' ||
+      meta->data_size != P4EST_FILE_COMPRESSED_QUAD_SIZE) {
+    return P4EST_FILE_ERR_FORMAT;
+  }
+  meta = p4est_file_map_section (map, quad_section - 1);
+  if (meta->block_type != 'B' || meta->data_size < 2 * sizeof (int64_t) ||
+      meta->data_size % sizeof (int64_t) != 0) {
+    return P4EST_FILE_ERR_FORMAT;
+  }
+  num_trees = (p4est_topidx_t) (meta->data_size / sizeof (int64_t) - 1);
+  pertree = (const int64_t *) p4est_file_map_block (map, quad_section - 1);
+  if (pertree[0] != 0 ||
+      pertree[num_trees] != (int64_t) map->global_num_quadrants) {
+    return P4EST_FILE_ERR_FORMAT;
+  }
+  for (fz = 0; fz < num_fields; ++fz) {
+    if (field_sections[fz] >= map->sections.elem_count ||
+        p4est_file_map_section (map, field_sections[fz])->block_type
+        != 'F') {
+      return P4EST_FILE_ERR_IN_DATA;
+    }
+  }
+
+#ifdef P4EST_ENABLE_OPENMP
+  /* each thread scans one contiguous piece of the range */
+  num_threads = (int) SC_MIN ((p4est_gloidx_t) p4est_get_num_threads (),
+                              1 + count / 65536);
+#pragma omp parallel for num_threads (num_threads)
+#endif
+  for (t = 0; t < num_threads; ++t) {
+    p4est_gloidx_t      begin, end;
+
+    begin = first + count * t / num_threads;
+    end = first + count * (t + 1) / num_threads;
+    p4est_file_map_scan_range (map, pertree, num_trees, quad_section,
+                               num_fields, field_sections, begin,
+                               end - begin, scan_fn, user);
+  }
+
+  return P4EST_FILE_ERR_SUCCESS;
+}
+
 #endif /* P4EST_ENABLE_FILE_DEPRECATED */
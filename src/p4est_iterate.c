@@ -167,6 +167,7 @@ typedef struct p4est_iter_loop_args
 {
   int                 alloc_size;       /* large enough to accommodate strange
                                            corners/edges between trees */
+  int8_t              loop_face;        /* should face_iterate be run */
 #ifdef P4_TO_P8
   int8_t              loop_edge;        /* should edge_iterate be run */
 #endif
@@ -204,11 +205,77 @@ typedef struct p4est_iter_loop_args
                                    functions: passed as an argument to avoid
                                    using alloc/free on each call */
   sc_array_t         *tier_rings;
+  const p4est_locidx_t *active; /* optional sorted local indices of the
+                                   quadrants whose neighborhood is searched */
+  p4est_locidx_t      num_active;       /* number of entries in active */
+  p4est_locidx_t      active_offset[2]; /* local index of the first quadrant
+                                           of the local arrays of the two
+                                           sides of a volume or face search */
+  int                 minlevel, maxlevel;       /* the levels searched for */
+  int8_t              in_range[2];      /* whether the local tree of each side
+                                           of a volume or face search has
+                                           quadrants of a searched level */
 }
 p4est_iter_loop_args_t;
 
+/* return whether a sorted list contains a value in [begin, begin + count) */
+static int
+p4est_iter_active_range (const p4est_locidx_t * active,
+                         p4est_locidx_t num_active, p4est_locidx_t begin,
+                         size_t count)
+{
+  p4est_locidx_t      lo = 0, hi = num_active, mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (active[mid] < begin) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return lo < num_active && active[lo] < begin + (p4est_locidx_t) count;
+}
+
+/* return whether a search area of local quadrants at the current level
+ * needs to be searched: without an active list or level range, this is
+ * true for every nonempty search area */
+static int
+p4est_iter_has_active (p4est_iter_loop_args_t * loop_args, int side,
+                       size_t first_index, size_t count)
+{
+  if (count == 0 || !loop_args->in_range[side] ||
+      loop_args->level > loop_args->maxlevel) {
+    return 0;
+  }
+  if (loop_args->active == NULL) {
+    return 1;
+  }
+  return p4est_iter_active_range (loop_args->active, loop_args->num_active,
+                                  loop_args->active_offset[side] +
+                                  (p4est_locidx_t) first_index, count);
+}
+
+/* return whether a local tree has quadrants of a searched level */
+static int8_t
+p4est_iter_tree_in_range (p4est_iter_loop_args_t * loop_args,
+                          p4est_tree_t * tree)
+{
+  int                 l;
+
+  for (l = loop_args->minlevel;
+       l <= SC_MIN (loop_args->maxlevel, (int) tree->maxlevel); ++l) {
+    if (tree->quadrants_per_level[l] > 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
 static p4est_iter_loop_args_t *
 p4est_iter_loop_args_new (p4est_connectivity_t * conn,
+                          p4est_iter_face_t iter_face,
 #ifdef P4_TO_P8
                           p8est_iter_edge_t iter_edge,
 #endif
@@ -298,6 +365,20 @@ p4est_iter_loop_args_new (p4est_connectivity_t * conn,
   loop_args->loop_edge = ((iter_corner != NULL) || (iter_edge != NULL));
 #endif
   loop_args->loop_corner = (iter_corner != NULL);
+  /* faces are searched for their own callback and for the edges and
+   * corners they contain; with a volume callback only they are skipped */
+  loop_args->loop_face = (iter_face != NULL || loop_args->loop_corner
+#ifdef P4_TO_P8
+                          || loop_args->loop_edge
+#endif
+    );
+
+  loop_args->active = NULL;
+  loop_args->num_active = 0;
+  loop_args->active_offset[0] = loop_args->active_offset[1] = 0;
+  loop_args->minlevel = 0;
+  loop_args->maxlevel = P4EST_QMAXLEVEL;
+  loop_args->in_range[0] = loop_args->in_range[1] = 1;
 
   return loop_args;
 }
@@ -348,6 +429,10 @@ p4est_iter_init_loop_volume (p4est_iter_loop_args_t * loop_args,
 
   loop_args->level = 0;
   loop_args->level_num[0] = 0;
+  loop_args->active_offset[left] = loop_args->active_offset[right] =
+    tree->quadrants_offset;
+  loop_args->in_range[left] = loop_args->in_range[right] =
+    p4est_iter_tree_in_range (loop_args, tree);
 
   for (i = left; i <= right; i++) {
     loop_args->index[i * 2 + local][0] = 0;
@@ -400,8 +485,12 @@ p4est_iter_init_loop_face (p4est_iter_loop_args_t * loop_args,
 
   tree = p4est_tree_array_index (trees, t);
   left_local_quads = &(tree->quadrants);
+  loop_args->active_offset[left] = tree->quadrants_offset;
+  loop_args->in_range[left] = p4est_iter_tree_in_range (loop_args, tree);
   tree = p4est_tree_array_index (trees, nt);
   right_local_quads = &(tree->quadrants);
+  loop_args->active_offset[right] = tree->quadrants_offset;
+  loop_args->in_range[right] = p4est_iter_tree_in_range (loop_args, tree);
 
   loop_args->level = 0;
   loop_args->level_num[0] = 0;
@@ -459,6 +548,8 @@ p4est_iter_init_loop_outside_face (p4est_iter_loop_args_t * loop_args,
 
   loop_args->level = 0;
   loop_args->level_num[0] = 0;
+  loop_args->active_offset[0] = tree->quadrants_offset;
+  loop_args->in_range[0] = p4est_iter_tree_in_range (loop_args, tree);
 
   loop_args->index[local][0] = 0;
   loop_args->index[local][1] = local_quads->elem_count;
@@ -627,8 +718,6 @@ p4est_iter_init_corner (p4est_iter_corner_args_t * args,
   int                 count = 0;
   p4est_topidx_t      nt;
   p4est_connectivity_t *conn = p4est->connectivity;
-  p4est_topidx_t     *ttt = conn->tree_to_tree;
-  int8_t             *ttf = conn->tree_to_face;
   p4est_topidx_t     *ttc = conn->tree_to_corner;
   p4est_topidx_t     *ctt_offset = conn->ctt_offset;
   p4est_topidx_t     *ctt = conn->corner_to_tree;
@@ -685,8 +774,7 @@ p4est_iter_init_corner (p4est_iter_corner_args_t * args,
     for (i = 0; i < P4EST_DIM; i++) {
       f = p4est_corner_faces[c][i];
       c2 = p4est_corner_face_corners[c][f];
-      nt = ttt[t * P4EST_FACES + f];
-      nf = (int) ttf[t * P4EST_FACES + f];
+      nt = p4est_connectivity_face_neighbor_tree (conn, t, f, &nf);
       o = nf / P4EST_FACES;
       nf %= P4EST_FACES;
       if (nt == t && nf == f) {
@@ -793,9 +881,8 @@ p4est_iter_init_corner (p4est_iter_corner_args_t * args,
           cside->faces[j] = faces_count;
 
           f = p4est_corner_faces[nc][j];
-          nnt = ttt[P4EST_FACES * nt + f];
+          nnt = p4est_connectivity_face_neighbor_tree (conn, nt, f, &nf);
           c2 = p4est_corner_face_corners[nc][f];
-          nf = (int) ttf[P4EST_FACES * nt + f];
           o = nf / P4EST_FACES;
 
           nf %= P4EST_FACES;
@@ -875,9 +962,8 @@ p4est_iter_init_corner (p4est_iter_corner_args_t * args,
               p4est_iter_corner_side_t *cside2;
 
               f = p8est_edge_faces[e][l];
-              nnt = ttt[P4EST_FACES * nt + f];
+              nnt = p4est_connectivity_face_neighbor_tree (conn, nt, f, &nf);
               c2 = p4est_corner_face_corners[nc][f];
-              nf = (int) ttf[P4EST_FACES * nt + f];
               o = nf / P4EST_FACES;
 
               nf %= P4EST_FACES;
@@ -1320,8 +1406,6 @@ p8est_iter_init_edge (p8est_iter_edge_args_t * args, p8est_t * p8est,
   p8est_iter_edge_info_t *info = &(args->info);
   p8est_iter_edge_side_t *eside;
   int                *start_idx2;
-  p4est_topidx_t     *ttt = conn->tree_to_tree;
-  int8_t             *ttf = conn->tree_to_face;
   p4est_topidx_t     *tte = conn->tree_to_edge;
   p4est_topidx_t     *ett_offset = conn->ett_offset;
   p4est_topidx_t     *ett = conn->edge_to_tree;
@@ -1364,8 +1448,7 @@ p8est_iter_init_edge (p8est_iter_edge_args_t * args, p8est_t * p8est,
     eside->faces[1] = -1;
     for (i = 0; i < 2; i++) {
       f = p8est_edge_faces[e][i];
-      nt = ttt[t * P4EST_FACES + f];
-      nf = (int) ttf[t * P4EST_FACES + f];
+      nt = p4est_connectivity_face_neighbor_tree (conn, t, f, &nf);
       o = nf / P4EST_FACES;
       nf %= P4EST_FACES;
       if (nt == t && nf == f) {
@@ -1433,8 +1516,7 @@ p8est_iter_init_edge (p8est_iter_edge_args_t * args, p8est_t * p8est,
           eside->faces[j] = faces_count;
 
           f = p8est_edge_faces[ne][j];
-          nnt = ttt[P4EST_FACES * nt + f];
-          nf = (int) ttf[nt * P4EST_FACES + f];
+          nnt = p4est_connectivity_face_neighbor_tree (conn, nt, f, &nf);
           o = nf / P4EST_FACES;
           nf %= P4EST_FACES;
           if (nnt == nt && nf == f) {
@@ -2055,9 +2137,11 @@ p4est_iter_init_face (p4est_iter_face_args_t * args, p4est_t * p4est,
   int                 ref, set;
 #endif
   p4est_connectivity_t *conn = p4est->connectivity;
-  p4est_topidx_t      nt = conn->tree_to_tree[t * P4EST_FACES + f];
-  int                 nf = (int) conn->tree_to_face[t * P4EST_FACES + f];
-  int                 o = nf / P4EST_FACES;
+  int                 nf;
+  p4est_topidx_t      nt =
+    p4est_connectivity_face_neighbor_tree (conn, t, f, &nf);
+  const int           norient = nf / P4EST_FACES;
+  int                 o = norient;
 
   nf %= P4EST_FACES;
 
@@ -2094,8 +2178,7 @@ p4est_iter_init_face (p4est_iter_face_args_t * args, p4est_t * p4est,
     fside->treeid = nt;
     fside->face = (int8_t) nf;
     start_idx2[count++] = 0;
-    o = info->orientation =
-      conn->tree_to_face[t * P4EST_FACES + f] / P4EST_FACES;
+    o = info->orientation = norient;
   }
 
   /* for each corner, find the touching corner on the other tree */
@@ -2229,12 +2312,19 @@ p4est_face_iterate (p4est_iter_face_args_t * args, void *user_data,
   /* face_iterate only runs if there is a chance of a local quadrant touching
    * the desired face */
   if (!args->outside_face) {
-    if (!count[left * 2 + local] && !count[right * 2 + local]) {
+    if (!p4est_iter_has_active (loop_args, left, first_index[left * 2 +
+                                                             local],
+                                count[left * 2 + local]) &&
+        !p4est_iter_has_active (loop_args, right, first_index[right * 2 +
+                                                              local],
+                                count[right * 2 + local])) {
       return;
     }
   }
   else {
-    if (!count[left * 2 + local]) {
+    if (!p4est_iter_has_active (loop_args, left, first_index[left * 2 +
+                                                             local],
+                                count[left * 2 + local])) {
       return;
     }
   }
@@ -2424,7 +2514,9 @@ p4est_face_iterate (p4est_iter_face_args_t * args, void *user_data,
             st = side * 2 + type;
             first_index[st] = zindex[st][quad_idx2[side]];
             count[st] = (zindex[st][quad_idx2[side] + 1] - first_index[st]);
-            if (type == local && count[st]) {
+            if (type == local &&
+                p4est_iter_has_active (loop_args, side, first_index[st],
+                                       count[st])) {
               all_empty = 0;
             }
           }
@@ -2622,7 +2714,7 @@ p4est_iter_init_volume (p4est_iter_volume_args_t * args, p4est_t * p4est,
   args->start_idx2 = 0;
 
   for (i = 0; i < P4EST_DIM; i++) {
-    for (j = 0; j < P4EST_CHILDREN / 2; j++) {
+    for (j = 0; loop_args->loop_face && j < P4EST_CHILDREN / 2; j++) {
       p4est_iter_init_face_from_volume (&(args->face_args[i][j]), args, i, j);
     }
 #ifdef P4_TO_P8
@@ -2647,7 +2739,7 @@ p4est_iter_reset_volume (p4est_iter_volume_args_t * args)
   int                 i, j;
 
   for (i = 0; i < P4EST_DIM; i++) {
-    for (j = 0; j < P4EST_CHILDREN / 2; j++) {
+    for (j = 0; args->loop_args->loop_face && j < P4EST_CHILDREN / 2; j++) {
       p4est_iter_reset_face (&(args->face_args[i][j]));
     }
 #ifdef P4_TO_P8
@@ -2664,32 +2756,43 @@ p4est_iter_reset_volume (p4est_iter_volume_args_t * args)
 }
 
 /* when there is only a volume callback, there is no coordination necessary, so
- * a simple loop is performed */
+ * a simple loop is performed; the quadrants of each tree are split evenly
+ * among the threads, which is deterministic */
 static void
 p4est_volume_iterate_simple (p4est_t * p4est, p4est_ghost_t * ghost_layer,
-                             void *user_data, p4est_iter_volume_t iter_volume)
+                             void *user_data, p4est_iter_volume_t iter_volume,
+                             int num_threads, int deterministic)
 {
   p4est_topidx_t      t;
   p4est_topidx_t      first_local_tree = p4est->first_local_tree;
   p4est_topidx_t      last_local_tree = p4est->last_local_tree;
   sc_array_t         *trees = p4est->trees;
-  p4est_tree_t       *tree;
-  size_t              si, n_quads;
-  sc_array_t         *quadrants;
-  p4est_iter_volume_info_t info;
-
-  info.p4est = p4est;
-  info.ghost_layer = ghost_layer;
 
-  for (t = first_local_tree; t <= last_local_tree; t++) {
-    info.treeid = t;
-    tree = p4est_tree_array_index (trees, t);
-    quadrants = &(tree->quadrants);
-    n_quads = quadrants->elem_count;
-    for (si = 0; si < n_quads; si++) {
-      info.quad = p4est_quadrant_array_index (quadrants, si);
-      info.quadid = si;
-      iter_volume (&info, user_data);
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel if (num_threads > 1) num_threads (num_threads) private (t)
+#endif
+  {
+    long                zl, n_quads;
+    p4est_tree_t       *tree;
+    sc_array_t         *quadrants;
+    p4est_iter_volume_info_t info;
+
+    info.p4est = p4est;
+    info.ghost_layer = ghost_layer;
+
+    for (t = first_local_tree; t <= last_local_tree; t++) {
+      info.treeid = t;
+      tree = p4est_tree_array_index (trees, t);
+      quadrants = &(tree->quadrants);
+      n_quads = (long) quadrants->elem_count;
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp for schedule (static)
+#endif
+      for (zl = 0; zl < n_quads; zl++) {
+        info.quad = p4est_quadrant_array_index (quadrants, (size_t) zl);
+        info.quadid = (p4est_locidx_t) zl;
+        iter_volume (&info, user_data);
+      }
     }
   }
 }
@@ -2741,7 +2844,8 @@ p4est_volume_iterate (p4est_iter_volume_args_t * args, void *user_data,
   }
 
   /* if there are no local quadrants, nothing to be done */
-  if (!count[local]) {
+  if (!p4est_iter_has_active (loop_args, local, first_index[local],
+                              count[local])) {
     return;
   }
 
@@ -2811,7 +2915,7 @@ p4est_volume_iterate (p4est_iter_volume_args_t * args, void *user_data,
        * search areas on the level*/
       if (level_num[*Level] == P4EST_CHILDREN) {
         /* for each direction */
-        for (dir = 0; dir < P4EST_DIM; dir++) {
+        for (dir = 0; loop_args->loop_face && dir < P4EST_DIM; dir++) {
           for (side = 0; side < P4EST_CHILDREN / 2; side++) {
             p4est_iter_copy_indices (loop_args,
                                      args->face_args[dir][side].start_idx2,
@@ -2860,7 +2964,8 @@ p4est_volume_iterate (p4est_iter_volume_args_t * args, void *user_data,
           first_index[type] = zindex[type][quad_idx2];
           count[type] = zindex[type][quad_idx2 + 1] - first_index[type];
         }
-        if (!count[local]) {
+        if (!p4est_iter_has_active (loop_args, local, first_index[local],
+                                    count[local])) {
           /* if there are no local quadrants, we are done with this search area,
            * and we advance to the next branch at this level */
           level_num[*Level]++;
@@ -2919,8 +3024,6 @@ p4est_iter_get_boundaries (p4est_t * p4est, p4est_topidx_t * last_run_tree,
   int                 ref, set;
   int                 this_o;
 #endif
-  p4est_topidx_t     *ttt = conn->tree_to_tree;
-  int8_t             *ttf = conn->tree_to_face;
 #ifndef P4_TO_P8
   int                 corner_offset = 4;
 #else
@@ -2970,8 +3073,7 @@ p4est_iter_get_boundaries (p4est_t * p4est, p4est_topidx_t * last_run_tree,
     mask = 0x00000001;
     for (f = 0; f < P4EST_FACES; f++, mask <<= 1) {
       if ((touch & mask) && !(init[t] & mask)) {
-        nt = ttt[t * P4EST_FACES + f];
-        nf = (int) ttf[t * P4EST_FACES + f];
+        nt = p4est_connectivity_face_neighbor_tree (conn, t, f, &nf);
         nf %= P4EST_FACES;
         init[t] |= mask;
         init[nt] |= (((int32_t) 1) << nf);
@@ -3022,8 +3124,7 @@ p4est_iter_get_boundaries (p4est_t * p4est, p4est_topidx_t * last_run_tree,
             f = p8est_edge_faces[e][i];
             c = p8est_corner_face_corners[c][f];
             c2 = p8est_corner_face_corners[c2][f];
-            nt = ttt[t * P4EST_FACES + f];
-            nf = (int) ttf[t * P4EST_FACES + f];
+            nt = p4est_connectivity_face_neighbor_tree (conn, t, f, &nf);
             o = nf / P4EST_FACES;
             nf %= P4EST_FACES;
             if (t == nt && f == nf) {
@@ -3078,8 +3179,7 @@ p4est_iter_get_boundaries (p4est_t * p4est, p4est_topidx_t * last_run_tree,
           for (i = 0; i < P4EST_DIM; i++) {
             f = p4est_corner_faces[c][i];
             c2 = p4est_corner_face_corners[c][f];
-            nt = ttt[t * P4EST_FACES + f];
-            nf = (int) ttf[t * P4EST_FACES + f];
+            nt = p4est_connectivity_face_neighbor_tree (conn, t, f, &nf);
             o = nf / P4EST_FACES;
             nf %= P4EST_FACES;
             if (t == nt && f == nf) {
@@ -3148,23 +3248,19 @@ p4est_iter_get_boundaries (p4est_t * p4est, p4est_topidx_t * last_run_tree,
   return owned;
 }
 
-void
-p4est_iterate_ext (p4est_t * p4est, p4est_ghost_t * Ghost_layer,
-                   void *user_data, p4est_iter_volume_t iter_volume,
-                   p4est_iter_face_t iter_face,
+/* iterate over the volume of one tree and the inter-tree entities it owns */
+static void
+p4est_iterate_tree (p4est_t * p4est, p4est_ghost_t * ghost_layer,
+                    p4est_iter_loop_args_t * loop_args,
+                    const int32_t * owned, int remote, p4est_topidx_t t,
+                    void *user_data, p4est_iter_volume_t iter_volume,
+                    p4est_iter_face_t iter_face,
 #ifdef P4_TO_P8
-                   p8est_iter_edge_t iter_edge,
+                    p8est_iter_edge_t iter_edge,
 #endif
-                   p4est_iter_corner_t iter_corner, int remote)
+                    p4est_iter_corner_t iter_corner)
 {
   int                 f, c;
-  p4est_topidx_t      t;
-  p4est_ghost_t       empty_ghost_layer;
-  p4est_ghost_t      *ghost_layer;
-  sc_array_t         *trees = p4est->trees;
-  p4est_connectivity_t *conn = p4est->connectivity;
-  size_t              global_num_trees = trees->elem_count;
-  p4est_iter_loop_args_t *loop_args;
   p4est_iter_face_args_t face_args;
 #ifdef P4_TO_P8
   int                 e;
@@ -3172,11 +3268,231 @@ p4est_iterate_ext (p4est_t * p4est, p4est_ghost_t * Ghost_layer,
 #endif
   p4est_iter_corner_args_t corner_args;
   p4est_iter_volume_args_t args;
+  int32_t             mask, touch;
+
+  /* start with the assumption that we only run on entities touches by the
+   * local processor's domain */
+  args.remote = remote;
+  face_args.remote = remote;
+#ifdef P4_TO_P8
+  edge_args.remote = remote;
+#endif
+  corner_args.remote = remote;
+
+  if (t >= p4est->first_local_tree && t <= p4est->last_local_tree) {
+    p4est_iter_init_volume (&args, p4est, ghost_layer, loop_args, t);
+
+    p4est_volume_iterate (&args, user_data, iter_volume, iter_face,
+#ifdef P4_TO_P8
+                          iter_edge,
+#endif
+                          iter_corner);
+
+    p4est_iter_reset_volume (&args);
+  }
+
+  touch = owned[t];
+  if (!touch) {
+    return;
+  }
+  mask = 0x00000001;
+  /* Now we need to run face_iterate on the faces between trees */
+  for (f = 0; f < 2 * P4EST_DIM; f++, mask <<= 1) {
+    if ((touch & mask) == 0 || !loop_args->loop_face) {
+      continue;
+    }
+    p4est_iter_init_face (&face_args, p4est, ghost_layer, loop_args, t, f);
+    p4est_face_iterate (&face_args, user_data, iter_face,
+#ifdef P4_TO_P8
+                        iter_edge,
+#endif
+                        iter_corner);
+    p4est_iter_reset_face (&face_args);
+  }
+
+  /* if there is an edge or a corner callback, we need to run
+   * edge_iterate on the edges between trees */
+#ifdef P4_TO_P8
+  if (loop_args->loop_edge) {
+    for (e = 0; e < 12; e++, mask <<= 1) {
+      if ((touch & mask) == 0) {
+        continue;
+      }
+      p8est_iter_init_edge (&edge_args, p4est, ghost_layer, loop_args, t, e);
+      p8est_edge_iterate (&edge_args, user_data, iter_edge, iter_corner);
+      p8est_iter_reset_edge (&edge_args);
+    }
+  }
+  else {
+    mask <<= 12;
+  }
+#endif
+
+  if (loop_args->loop_corner) {
+    for (c = 0; c < P4EST_CHILDREN; c++, mask <<= 1) {
+      if ((touch & mask) == 0) {
+        continue;
+      }
+      p4est_iter_init_corner (&corner_args, p4est, ghost_layer, loop_args,
+                              t, c);
+      p4est_corner_iterate (&corner_args, user_data, iter_corner);
+      p4est_iter_reset_corner (&corner_args);
+    }
+  }
+}
+
+/* add the trees that share a face, edge or corner with tree t to nbrs */
+static void
+p4est_iter_tree_neighbors (p4est_connectivity_t * conn, p4est_topidx_t t,
+                           sc_array_t * nbrs)
+{
+  int                 i, nf;
+  p4est_topidx_t      ti, id;
+
+  *(p4est_topidx_t *) sc_array_push (nbrs) = t;
+  for (i = 0; i < P4EST_FACES; i++) {
+    *(p4est_topidx_t *) sc_array_push (nbrs) =
+      p4est_connectivity_face_neighbor_tree (conn, t, i, &nf);
+  }
+#ifdef P4_TO_P8
+  if (conn->tree_to_edge != NULL) {
+    for (i = 0; i < P8EST_EDGES; i++) {
+      id = conn->tree_to_edge[P8EST_EDGES * t + i];
+      if (id < 0) {
+        continue;
+      }
+      for (ti = conn->ett_offset[id]; ti < conn->ett_offset[id + 1]; ti++) {
+        *(p4est_topidx_t *) sc_array_push (nbrs) = conn->edge_to_tree[ti];
+      }
+    }
+  }
+#endif
+  if (conn->tree_to_corner != NULL) {
+    for (i = 0; i < P4EST_CHILDREN; i++) {
+      id = conn->tree_to_corner[P4EST_CHILDREN * t + i];
+      if (id < 0) {
+        continue;
+      }
+      for (ti = conn->ctt_offset[id]; ti < conn->ctt_offset[id + 1]; ti++) {
+        *(p4est_topidx_t *) sc_array_push (nbrs) = conn->corner_to_tree[ti];
+      }
+    }
+  }
+}
+
+/* Sort the trees first_tree..last_tree into groups (colors).  Two trees of
+ * the same group do not touch a common tree, thus the callbacks issued
+ * for them never touch the same quadrant.  On output, the trees of group g
+ * are at positions [offsets[g], offsets[g + 1]) of the returned array. */
+static p4est_topidx_t *
+p4est_iter_color_trees (p4est_connectivity_t * conn,
+                        p4est_topidx_t first_tree, p4est_topidx_t last_tree,
+                        sc_array_t * offsets)
+{
+  int                 num_colors, col;
+  int                *tree_color, *stamp;
+  size_t              zz, zy;
+  p4est_topidx_t      t, u, r;
+  p4est_topidx_t      num_trees = last_tree - first_tree + 1;
+  p4est_topidx_t     *sorted;
+  sc_array_t          nbrs, nbrs2;
+
+  tree_color = P4EST_ALLOC (int, conn->num_trees);
+  stamp = P4EST_ALLOC (int, num_trees + 1);
+  sorted = P4EST_ALLOC (p4est_topidx_t, num_trees);
+  sc_array_init (&nbrs, sizeof (p4est_topidx_t));
+  sc_array_init (&nbrs2, sizeof (p4est_topidx_t));
+  for (t = 0; t < conn->num_trees; t++) {
+    tree_color[t] = -1;
+  }
+  for (col = 0; col <= num_trees; col++) {
+    stamp[col] = -1;
+  }
+
+  /* greedy coloring of the distance two neighborhood graph */
+  num_colors = 0;
+  for (t = first_tree; t <= last_tree; t++) {
+    sc_array_truncate (&nbrs);
+    p4est_iter_tree_neighbors (conn, t, &nbrs);
+    for (zz = 0; zz < nbrs.elem_count; zz++) {
+      r = *(p4est_topidx_t *) sc_array_index (&nbrs, zz);
+      sc_array_truncate (&nbrs2);
+      p4est_iter_tree_neighbors (conn, r, &nbrs2);
+      for (zy = 0; zy < nbrs2.elem_count; zy++) {
+        u = *(p4est_topidx_t *) sc_array_index (&nbrs2, zy);
+        if (tree_color[u] >= 0) {
+          stamp[tree_color[u]] = (int) (t - first_tree);
+        }
+      }
+    }
+    for (col = 0; stamp[col] == (int) (t - first_tree); col++) {
+    }
+    P4EST_ASSERT (col <= num_trees);
+    tree_color[t] = col;
+    num_colors = SC_MAX (num_colors, col + 1);
+  }
+
+  /* counting sort of the trees by color, stable in the tree index */
+  sc_array_resize (offsets, (size_t) num_colors + 1);
+  for (col = 0; col <= num_colors; col++) {
+    *(size_t *) sc_array_index_int (offsets, col) = 0;
+  }
+  for (t = first_tree; t <= last_tree; t++) {
+    ++*(size_t *) sc_array_index_int (offsets, tree_color[t] + 1);
+  }
+  for (col = 0; col < num_colors; col++) {
+    *(size_t *) sc_array_index_int (offsets, col + 1) +=
+      *(size_t *) sc_array_index_int (offsets, col);
+  }
+  for (t = first_tree; t <= last_tree; t++) {
+    zz = (*(size_t *) sc_array_index_int (offsets, tree_color[t]))++;
+    sorted[zz] = t;
+  }
+  for (col = num_colors; col > 0; col--) {
+    *(size_t *) sc_array_index_int (offsets, col) =
+      *(size_t *) sc_array_index_int (offsets, col - 1);
+  }
+  *(size_t *) sc_array_index_int (offsets, 0) = 0;
+
+  sc_array_reset (&nbrs);
+  sc_array_reset (&nbrs2);
+  P4EST_FREE (stamp);
+  P4EST_FREE (tree_color);
+  return sorted;
+}
+
+/* the common implementation of p4est_iterate_ext, p4est_iterate_threads,
+ * p4est_iterate_active and p4est_iterate_levels: the search skips all areas
+ * that contain no local quadrant in the active list, if it is not NULL, or
+ * of a level in [minlevel, maxlevel]; only p4est_iterate_threads runs with
+ * more than one thread */
+static void
+p4est_iterate_internal (p4est_t * p4est, p4est_ghost_t * Ghost_layer,
+                        void *user_data, p4est_iter_volume_t iter_volume,
+                        p4est_iter_face_t iter_face,
+#ifdef P4_TO_P8
+                        p8est_iter_edge_t iter_edge,
+#endif
+                        p4est_iter_corner_t iter_corner, int remote,
+                        int threaded, int colored, int deterministic,
+                        const p4est_locidx_t * active,
+                        p4est_locidx_t num_active, int minlevel,
+                        int maxlevel)
+{
+  int                 num_threads;
+  size_t              col, num_colors, first, last;
   p4est_topidx_t      first_local_tree = p4est->first_local_tree;
   p4est_topidx_t      last_local_tree = p4est->last_local_tree;
   p4est_topidx_t      last_run_tree;
+  p4est_topidx_t     *run_trees;
+  p4est_ghost_t       empty_ghost_layer;
+  p4est_ghost_t      *ghost_layer;
+  sc_array_t         *trees = p4est->trees;
+  sc_array_t          color_offsets;
+  p4est_connectivity_t *conn = p4est->connectivity;
+  size_t              global_num_trees = trees->elem_count;
   int32_t            *owned;
-  int32_t             mask, touch;
+  const double        inspect_start = p4est_inspect_start (p4est->inspect);
 
   P4EST_ASSERT (p4est_is_valid (p4est));
 
@@ -3200,107 +3516,107 @@ p4est_iterate_ext (p4est_t * p4est, p4est_ghost_t * Ghost_layer,
   else {
     ghost_layer = Ghost_layer;
   }
+  num_threads = threaded ? p4est_get_num_threads () : 1;
+
+  /* the callbacks may allocate quadrant data from the threads */
+  p4est_quadrant_data_cache_prepare (p4est);
 
   /* simple loop if there is only a volume callback */
-  if (iter_face == NULL && iter_corner == NULL
+  if (active == NULL && minlevel == 0 && maxlevel == P4EST_QMAXLEVEL &&
+      iter_face == NULL && iter_corner == NULL
 #ifdef P4_TO_P8
       && iter_edge == NULL
 #endif
     ) {
-    p4est_volume_iterate_simple (p4est, ghost_layer, user_data, iter_volume);
+    p4est_volume_iterate_simple (p4est, ghost_layer, user_data, iter_volume,
+                                 num_threads, deterministic);
     if (Ghost_layer == NULL) {
       P4EST_FREE (empty_ghost_layer.tree_offsets);
       P4EST_FREE (empty_ghost_layer.proc_offsets);
     }
+    p4est_inspect_stop (p4est->inspect, P4EST_INSPECT_ITERATE,
+                        inspect_start);
     return;
   }
 
-  /** initialize arrays that keep track of where we are in the search */
-  loop_args = p4est_iter_loop_args_new (conn,
-#ifdef P4_TO_P8
-                                        iter_edge,
-#endif
-                                        iter_corner, ghost_layer,
-                                        p4est->mpisize);
-
   owned = p4est_iter_get_boundaries (p4est, &last_run_tree, remote);
   last_run_tree = (last_run_tree < last_local_tree) ? last_local_tree :
     last_run_tree;
 
-  /* start with the assumption that we only run on entities touches by the
-   * local processor's domain */
-  args.remote = remote;
-  face_args.remote = remote;
-#ifdef P4_TO_P8
-  edge_args.remote = remote;
-#endif
-  corner_args.remote = remote;
-
   /** we have to loop over all trees and not just local trees because of the
-   * ghost layer */
-  for (t = first_local_tree; t <= last_run_tree; t++) {
-    if (t >= first_local_tree && t <= last_local_tree) {
-      p4est_iter_init_volume (&args, p4est, ghost_layer, loop_args, t);
+   * ghost layer; the trees are processed in groups that may run
+   * concurrently */
+  sc_array_init (&color_offsets, sizeof (size_t));
+  if (num_threads > 1 && colored) {
+    run_trees = p4est_iter_color_trees (conn, first_local_tree,
+                                        last_run_tree, &color_offsets);
+  }
+  else {
+    run_trees = P4EST_ALLOC (p4est_topidx_t,
+                             last_run_tree - first_local_tree + 1);
+    for (first = 0; first <= (size_t) (last_run_tree - first_local_tree);
+         ++first) {
+      run_trees[first] = first_local_tree + (p4est_topidx_t) first;
+    }
+    sc_array_resize (&color_offsets, 2);
+    *(size_t *) sc_array_index (&color_offsets, 0) = 0;
+    *(size_t *) sc_array_index (&color_offsets, 1) =
+      (size_t) (last_run_tree - first_local_tree + 1);
+  }
+  num_colors = color_offsets.elem_count - 1;
 
-      p4est_volume_iterate (&args, user_data, iter_volume, iter_face,
-#ifdef P4_TO_P8
-                            iter_edge,
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel if (num_threads > 1) num_threads (num_threads) \
+  private (col, first, last)
 #endif
-                            iter_corner);
-
-      p4est_iter_reset_volume (&args);
-    }
+  {
+    long                zl;
+    p4est_iter_loop_args_t *loop_args;
 
-    touch = owned[t];
-    if (!touch) {
-      continue;
-    }
-    mask = 0x00000001;
-    /* Now we need to run face_iterate on the faces between trees */
-    for (f = 0; f < 2 * P4EST_DIM; f++, mask <<= 1) {
-      if ((touch & mask) == 0) {
-        continue;
-      }
-      p4est_iter_init_face (&face_args, p4est, ghost_layer, loop_args, t, f);
-      p4est_face_iterate (&face_args, user_data, iter_face,
+    /** initialize arrays that keep track of where we are in the search */
+    loop_args = p4est_iter_loop_args_new (conn, iter_face,
 #ifdef P4_TO_P8
-                          iter_edge,
+                                          iter_edge,
 #endif
-                          iter_corner);
-      p4est_iter_reset_face (&face_args);
-    }
-
-    /* if there is an edge or a corner callback, we need to run
-     * edge_iterate on the edges between trees */
+                                          iter_corner, ghost_layer,
+                                          p4est->mpisize);
+    loop_args->active = active;
+    loop_args->num_active = num_active;
+    loop_args->minlevel = minlevel;
+    loop_args->maxlevel = maxlevel;
+    for (col = 0; col < num_colors; ++col) {
+      first = *(size_t *) sc_array_index (&color_offsets, col);
+      last = *(size_t *) sc_array_index (&color_offsets, col + 1);
+      if (deterministic) {
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp for schedule (static)
+#endif
+        for (zl = (long) first; zl < (long) last; ++zl) {
+          p4est_iterate_tree (p4est, ghost_layer, loop_args, owned, remote,
+                              run_trees[zl], user_data, iter_volume,
+                              iter_face,
 #ifdef P4_TO_P8
-    if (loop_args->loop_edge) {
-      for (e = 0; e < 12; e++, mask <<= 1) {
-        if ((touch & mask) == 0) {
-          continue;
+                              iter_edge,
+#endif
+                              iter_corner);
         }
-        p8est_iter_init_edge (&edge_args, p4est, ghost_layer, loop_args, t,
-                              e);
-        p8est_edge_iterate (&edge_args, user_data, iter_edge, iter_corner);
-        p8est_iter_reset_edge (&edge_args);
       }
-    }
-    else {
-      mask <<= 12;
-    }
+      else {
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp for schedule (dynamic, 1)
 #endif
-
-    if (loop_args->loop_corner) {
-      for (c = 0; c < P4EST_CHILDREN; c++, mask <<= 1) {
-        if ((touch & mask) == 0) {
-          continue;
+        for (zl = (long) first; zl < (long) last; ++zl) {
+          p4est_iterate_tree (p4est, ghost_layer, loop_args, owned, remote,
+                              run_trees[zl], user_data, iter_volume,
+                              iter_face,
+#ifdef P4_TO_P8
+                              iter_edge,
+#endif
+                              iter_corner);
         }
-        p4est_iter_init_corner (&corner_args, p4est, ghost_layer, loop_args,
-                                t, c);
-        p4est_corner_iterate (&corner_args, user_data, iter_corner);
-        p4est_iter_reset_corner (&corner_args);
       }
     }
-
+    p4est_iter_loop_args_destroy (loop_args);
   }
 
   if (Ghost_layer == NULL) {
@@ -3308,8 +3624,47 @@ p4est_iterate_ext (p4est_t * p4est, p4est_ghost_t * Ghost_layer,
     P4EST_FREE (empty_ghost_layer.proc_offsets);
   }
 
+  sc_array_reset (&color_offsets);
+  P4EST_FREE (run_trees);
   P4EST_FREE (owned);
-  p4est_iter_loop_args_destroy (loop_args);
+  p4est_inspect_stop (p4est->inspect, P4EST_INSPECT_ITERATE, inspect_start);
+}
+
+void
+p4est_iterate_ext (p4est_t * p4est, p4est_ghost_t * Ghost_layer,
+                   void *user_data, p4est_iter_volume_t iter_volume,
+                   p4est_iter_face_t iter_face,
+#ifdef P4_TO_P8
+                   p8est_iter_edge_t iter_edge,
+#endif
+                   p4est_iter_corner_t iter_corner, int remote)
+{
+  p4est_iterate_internal (p4est, Ghost_layer, user_data, iter_volume,
+                          iter_face,
+#ifdef P4_TO_P8
+                          iter_edge,
+#endif
+                          iter_corner, remote, 0, 0, 0,
+                          NULL, 0, 0, P4EST_QMAXLEVEL);
+}
+
+void
+p4est_iterate_threads (p4est_t * p4est, p4est_ghost_t * Ghost_layer,
+                       void *user_data, p4est_iter_volume_t iter_volume,
+                       p4est_iter_face_t iter_face,
+#ifdef P4_TO_P8
+                       p8est_iter_edge_t iter_edge,
+#endif
+                       p4est_iter_corner_t iter_corner, int remote,
+                       int colored, int deterministic)
+{
+  p4est_iterate_internal (p4est, Ghost_layer, user_data, iter_volume,
+                          iter_face,
+#ifdef P4_TO_P8
+                          iter_edge,
+#endif
+                          iter_corner, remote, 1, colored, deterministic,
+                          NULL, 0, 0, P4EST_QMAXLEVEL);
 }
 
 void
@@ -3326,3 +3681,944 @@ p4est_iterate (p4est_t * p4est, p4est_ghost_t * Ghost_layer, void *user_data,
 #endif
                      iter_corner, 0);
 }
+
+/* the buffers of p4est_iterate_face_batch for all kinds of faces */
+typedef struct p4est_iter_face_batch_ctx
+{
+  size_t              batch_size;
+  p4est_iter_face_batch_t iter_batch;
+  void               *user_data;
+  p4est_iter_face_batch_info_t info[P4EST_ITER_FACE_NUM_KINDS];
+}
+p4est_iter_face_batch_ctx_t;
+
+/* store the quadrant index of one side's quadrant in position pos */
+static void
+p4est_iter_face_batch_quad (p4est_iter_face_batch_info_t * info, int s,
+                            size_t pos, p4est_topidx_t treeid,
+                            int8_t is_ghost, p4est_locidx_t quadid)
+{
+  p4est_tree_t       *tree;
+
+  info->is_ghost[s][pos] = is_ghost;
+  if (!is_ghost && quadid >= 0) {
+    tree = p4est_tree_array_index (info->p4est->trees, treeid);
+    quadid += tree->quadrants_offset;
+  }
+  info->quadid[s][pos] = quadid;
+}
+
+/* pass a nonempty batch to the user and empty it */
+static void
+p4est_iter_face_batch_flush (p4est_iter_face_batch_ctx_t * ctx, int kind)
+{
+  p4est_iter_face_batch_info_t *info = &ctx->info[kind];
+
+  if (info->count > 0) {
+    ctx->iter_batch (info, ctx->user_data);
+    info->count = 0;
+  }
+}
+
+static void
+p4est_iter_face_batch_collect (p4est_iter_face_info_t * finfo,
+                               void *user_data)
+{
+  p4est_iter_face_batch_ctx_t *ctx =
+    (p4est_iter_face_batch_ctx_t *) user_data;
+  p4est_iter_face_batch_info_t *info;
+  p4est_iter_face_side_t *side[2];
+  int                 kind, s, h;
+  size_t              pos;
+
+  side[0] = p4est_iter_fside_array_index_int (&finfo->sides, 0);
+  if (finfo->sides.elem_count == 1) {
+    kind = P4EST_ITER_FACE_BOUNDARY;
+    side[1] = NULL;
+  }
+  else {
+    P4EST_ASSERT (finfo->sides.elem_count == 2);
+    side[1] = p4est_iter_fside_array_index_int (&finfo->sides, 1);
+    P4EST_ASSERT (!side[0]->is_hanging || !side[1]->is_hanging);
+    if (side[0]->is_hanging) {
+      /* the full side comes first */
+      side[0] = side[1];
+      side[1] = p4est_iter_fside_array_index_int (&finfo->sides, 0);
+    }
+    kind = side[1]->is_hanging ?
+      P4EST_ITER_FACE_HANGING : P4EST_ITER_FACE_SAME;
+  }
+
+  info = &ctx->info[kind];
+  pos = info->count;
+  P4EST_ASSERT (pos < ctx->batch_size);
+  info->orientation[pos] = finfo->orientation;
+  info->tree_boundary[pos] = finfo->tree_boundary;
+  for (s = 0; s < 2 && side[s] != NULL; ++s) {
+    info->face[s][pos] = side[s]->face;
+    if (!side[s]->is_hanging) {
+      p4est_iter_face_batch_quad (info, s, pos, side[s]->treeid,
+                                  side[s]->is.full.is_ghost,
+                                  side[s]->is.full.quadid);
+    }
+    else {
+      for (h = 0; h < P4EST_HALF; ++h) {
+        p4est_iter_face_batch_quad (info, s, P4EST_HALF * pos + h,
+                                    side[s]->treeid,
+                                    side[s]->is.hanging.is_ghost[h],
+                                    side[s]->is.hanging.quadid[h]);
+      }
+    }
+  }
+  if (++info->count == ctx->batch_size) {
+    p4est_iter_face_batch_flush (ctx, kind);
+  }
+}
+
+void
+p4est_iterate_face_batch (p4est_t * p4est, p4est_ghost_t * ghost_layer,
+                          void *user_data, size_t batch_size,
+                          p4est_iter_face_batch_t iter_batch)
+{
+  int                 kind, s;
+  size_t              per_face;
+  p4est_iter_face_batch_ctx_t ctx;
+  p4est_iter_face_batch_info_t *info;
+
+  P4EST_ASSERT (batch_size > 0);
+  P4EST_ASSERT (iter_batch != NULL);
+
+  ctx.batch_size = batch_size;
+  ctx.iter_batch = iter_batch;
+  ctx.user_data = user_data;
+  for (kind = 0; kind < P4EST_ITER_FACE_NUM_KINDS; ++kind) {
+    info = &ctx.info[kind];
+    info->p4est = p4est;
+    info->ghost_layer = ghost_layer;
+    info->kind = (p4est_iter_face_kind_t) kind;
+    info->count = 0;
+    info->orientation = P4EST_ALLOC (int8_t, 4 * batch_size);
+    info->tree_boundary = info->orientation + batch_size;
+    info->face[0] = info->tree_boundary + batch_size;
+    info->face[1] = info->face[0] + batch_size;
+    for (s = 0; s < 2; ++s) {
+      per_face = (s == 1 && kind == P4EST_ITER_FACE_HANGING) ?
+        P4EST_HALF : 1;
+      info->quadid[s] = P4EST_ALLOC (p4est_locidx_t, per_face * batch_size);
+      info->is_ghost[s] = P4EST_ALLOC (int8_t, per_face * batch_size);
+    }
+  }
+
+  p4est_iterate (p4est, ghost_layer, &ctx, NULL,
+                 p4est_iter_face_batch_collect,
+#ifdef P4_TO_P8
+                 NULL,
+#endif
+                 NULL);
+
+  for (kind = 0; kind < P4EST_ITER_FACE_NUM_KINDS; ++kind) {
+    p4est_iter_face_batch_flush (&ctx, kind);
+    info = &ctx.info[kind];
+    P4EST_FREE (info->orientation);
+    for (s = 0; s < 2; ++s) {
+      P4EST_FREE (info->quadid[s]);
+      P4EST_FREE (info->is_ghost[s]);
+    }
+  }
+}
+
+/* append the sides of one face, edge or corner to a plan */
+static void
+p4est_iter_plan_push (sc_array_t * offsets, sc_array_t * sides,
+                      sc_array_t * tree_boundary, sc_array_t * info_sides,
+                      int8_t info_tree_boundary)
+{
+  size_t              count = info_sides->elem_count;
+
+  P4EST_ASSERT (sides->elem_size == info_sides->elem_size);
+  if (count > 0) {
+    memcpy (sc_array_push_count (sides, count), info_sides->array,
+            count * sides->elem_size);
+  }
+  *(size_t *) sc_array_push (offsets) = sides->elem_count;
+  *(int8_t *) sc_array_push (tree_boundary) = info_tree_boundary;
+}
+
+static void
+p4est_iter_plan_face (p4est_iter_face_info_t * info, void *user_data)
+{
+  p4est_iter_plan_t  *plan = (p4est_iter_plan_t *) user_data;
+
+  p4est_iter_plan_push (plan->face_offsets, plan->face_sides,
+                        plan->face_tree_boundary, &info->sides,
+                        info->tree_boundary);
+  *(int8_t *) sc_array_push (plan->face_orientation) = info->orientation;
+}
+
+#ifdef P4_TO_P8
+static void
+p8est_iter_plan_edge (p8est_iter_edge_info_t * info, void *user_data)
+{
+  p8est_iter_plan_t  *plan = (p8est_iter_plan_t *) user_data;
+
+  p4est_iter_plan_push (plan->edge_offsets, plan->edge_sides,
+                        plan->edge_tree_boundary, &info->sides,
+                        info->tree_boundary);
+}
+#endif
+
+static void
+p4est_iter_plan_corner (p4est_iter_corner_info_t * info, void *user_data)
+{
+  p4est_iter_plan_t  *plan = (p4est_iter_plan_t *) user_data;
+
+  p4est_iter_plan_push (plan->corner_offsets, plan->corner_sides,
+                        plan->corner_tree_boundary, &info->sides,
+                        info->tree_boundary);
+}
+
+p4est_iter_plan_t  *
+p4est_iter_plan_new (p4est_t * p4est, p4est_ghost_t * ghost_layer,
+                     int remote)
+{
+  p4est_iter_plan_t  *plan;
+
+  plan = P4EST_ALLOC (p4est_iter_plan_t, 1);
+  plan->p4est = p4est;
+  plan->ghost_layer = ghost_layer;
+  plan->revision = p4est->revision;
+
+  plan->face_offsets = sc_array_new (sizeof (size_t));
+  plan->face_sides = sc_array_new (sizeof (p4est_iter_face_side_t));
+  plan->face_orientation = sc_array_new (sizeof (int8_t));
+  plan->face_tree_boundary = sc_array_new (sizeof (int8_t));
+  *(size_t *) sc_array_push (plan->face_offsets) = 0;
+#ifdef P4_TO_P8
+  plan->edge_offsets = sc_array_new (sizeof (size_t));
+  plan->edge_sides = sc_array_new (sizeof (p8est_iter_edge_side_t));
+  plan->edge_tree_boundary = sc_array_new (sizeof (int8_t));
+  *(size_t *) sc_array_push (plan->edge_offsets) = 0;
+#endif
+  plan->corner_offsets = sc_array_new (sizeof (size_t));
+  plan->corner_sides = sc_array_new (sizeof (p4est_iter_corner_side_t));
+  plan->corner_tree_boundary = sc_array_new (sizeof (int8_t));
+  *(size_t *) sc_array_push (plan->corner_offsets) = 0;
+
+  p4est_iterate_ext (p4est, ghost_layer, plan, NULL, p4est_iter_plan_face,
+#ifdef P4_TO_P8
+                     p8est_iter_plan_edge,
+#endif
+                     p4est_iter_plan_corner, remote);
+
+  return plan;
+}
+
+void
+p4est_iter_plan_destroy (p4est_iter_plan_t * plan)
+{
+  sc_array_destroy (plan->face_offsets);
+  sc_array_destroy (plan->face_sides);
+  sc_array_destroy (plan->face_orientation);
+  sc_array_destroy (plan->face_tree_boundary);
+#ifdef P4_TO_P8
+  sc_array_destroy (plan->edge_offsets);
+  sc_array_destroy (plan->edge_sides);
+  sc_array_destroy (plan->edge_tree_boundary);
+#endif
+  sc_array_destroy (plan->corner_offsets);
+  sc_array_destroy (plan->corner_sides);
+  sc_array_destroy (plan->corner_tree_boundary);
+  P4EST_FREE (plan);
+}
+
+int
+p4est_iter_plan_is_current (p4est_iter_plan_t * plan)
+{
+  return plan->p4est->revision == plan->revision;
+}
+
+/* point a view at the sides of the i-th entry of a plan */
+static void
+p4est_iter_plan_sides (sc_array_t * view, sc_array_t * offsets,
+                       sc_array_t * sides, size_t i)
+{
+  size_t              first = *(size_t *) sc_array_index (offsets, i);
+  size_t              last = *(size_t *) sc_array_index (offsets, i + 1);
+
+  P4EST_ASSERT (first <= last && last <= sides->elem_count);
+  sc_array_init_data (view, sides->array + first * sides->elem_size,
+                      sides->elem_size, last - first);
+}
+
+void
+p4est_iter_plan_replay (p4est_iter_plan_t * plan, void *user_data,
+                        p4est_iter_volume_t iter_volume,
+                        p4est_iter_face_t iter_face,
+#ifdef P4_TO_P8
+                        p8est_iter_edge_t iter_edge,
+#endif
+                        p4est_iter_corner_t iter_corner)
+{
+  p4est_t            *p4est = plan->p4est;
+  p4est_topidx_t      t;
+  p4est_locidx_t      qid;
+  p4est_tree_t       *tree;
+  size_t              i, num;
+  p4est_iter_volume_info_t vinfo;
+  p4est_iter_face_info_t finfo;
+#ifdef P4_TO_P8
+  p8est_iter_edge_info_t einfo;
+#endif
+  p4est_iter_corner_info_t cinfo;
+
+  P4EST_ASSERT (p4est_iter_plan_is_current (plan));
+
+  if (iter_volume != NULL && p4est->first_local_tree >= 0) {
+    vinfo.p4est = p4est;
+    vinfo.ghost_layer = plan->ghost_layer;
+    for (t = p4est->first_local_tree; t <= p4est->last_local_tree; ++t) {
+      tree = p4est_tree_array_index (p4est->trees, t);
+      vinfo.treeid = t;
+      for (qid = 0; qid < (p4est_locidx_t) tree->quadrants.elem_count;
+           ++qid) {
+        vinfo.quad = p4est_quadrant_array_index (&tree->quadrants,
+                                                 (size_t) qid);
+        vinfo.quadid = qid;
+        iter_volume (&vinfo, user_data);
+      }
+    }
+  }
+
+  if (iter_face != NULL) {
+    finfo.p4est = p4est;
+    finfo.ghost_layer = plan->ghost_layer;
+    num = plan->face_orientation->elem_count;
+    for (i = 0; i < num; ++i) {
+      finfo.orientation =
+        *(int8_t *) sc_array_index (plan->face_orientation, i);
+      finfo.tree_boundary =
+        *(int8_t *) sc_array_index (plan->face_tree_boundary, i);
+      p4est_iter_plan_sides (&finfo.sides, plan->face_offsets,
+                             plan->face_sides, i);
+      iter_face (&finfo, user_data);
+    }
+  }
+
+#ifdef P4_TO_P8
+  if (iter_edge != NULL) {
+    einfo.p4est = p4est;
+    einfo.ghost_layer = plan->ghost_layer;
+    num = plan->edge_tree_boundary->elem_count;
+    for (i = 0; i < num; ++i) {
+      einfo.tree_boundary =
+        *(int8_t *) sc_array_index (plan->edge_tree_boundary, i);
+      p4est_iter_plan_sides (&einfo.sides, plan->edge_offsets,
+                             plan->edge_sides, i);
+      iter_edge (&einfo, user_data);
+    }
+  }
+#endif
+
+  if (iter_corner != NULL) {
+    cinfo.p4est = p4est;
+    cinfo.ghost_layer = plan->ghost_layer;
+    num = plan->corner_tree_boundary->elem_count;
+    for (i = 0; i < num; ++i) {
+      cinfo.tree_boundary =
+        *(int8_t *) sc_array_index (plan->corner_tree_boundary, i);
+      p4est_iter_plan_sides (&cinfo.sides, plan->corner_offsets,
+                             plan->corner_sides, i);
+      iter_corner (&cinfo, user_data);
+    }
+  }
+}
+
+/* the kinds of entities recorded in a plan */
+enum
+{
+  P4EST_ITER_BLOCK_FACE,
+#ifdef P4_TO_P8
+  P8EST_ITER_BLOCK_EDGE,
+#endif
+  P4EST_ITER_BLOCK_CORNER
+};
+
+#ifdef __GNUC__
+#define P4EST_ITER_PREFETCH(a) __builtin_prefetch ((a))
+#else
+#define P4EST_ITER_PREFETCH(a) SC_NOOP ()
+#endif
+
+/* list the quadrants of one side of a face, edge or corner; return their
+ * number, which is P4EST_HALF for hanging faces and 2 for hanging edges */
+static int
+p4est_iter_block_side (int kind, const void *side, p4est_topidx_t * treeid,
+                       p4est_quadrant_t ** quad, p4est_locidx_t * quadid,
+                       int8_t * is_ghost)
+{
+  int                 i;
+  const p4est_iter_face_side_t *fside;
+#ifdef P4_TO_P8
+  const p8est_iter_edge_side_t *eside;
+#endif
+  const p4est_iter_corner_side_t *cside;
+
+  if (kind == P4EST_ITER_BLOCK_FACE) {
+    fside = (const p4est_iter_face_side_t *) side;
+    *treeid = fside->treeid;
+    if (!fside->is_hanging) {
+      quad[0] = fside->is.full.quad;
+      quadid[0] = fside->is.full.quadid;
+      is_ghost[0] = fside->is.full.is_ghost;
+      return 1;
+    }
+    for (i = 0; i < P4EST_HALF; ++i) {
+      quad[i] = fside->is.hanging.quad[i];
+      quadid[i] = fside->is.hanging.quadid[i];
+      is_ghost[i] = fside->is.hanging.is_ghost[i];
+    }
+    return P4EST_HALF;
+  }
+#ifdef P4_TO_P8
+  if (kind == P8EST_ITER_BLOCK_EDGE) {
+    eside = (const p8est_iter_edge_side_t *) side;
+    *treeid = eside->treeid;
+    if (!eside->is_hanging) {
+      quad[0] = eside->is.full.quad;
+      quadid[0] = eside->is.full.quadid;
+      is_ghost[0] = eside->is.full.is_ghost;
+      return 1;
+    }
+    for (i = 0; i < 2; ++i) {
+      quad[i] = eside->is.hanging.quad[i];
+      quadid[i] = eside->is.hanging.quadid[i];
+      is_ghost[i] = eside->is.hanging.is_ghost[i];
+    }
+    return 2;
+  }
+#endif
+  P4EST_ASSERT (kind == P4EST_ITER_BLOCK_CORNER);
+  cside = (const p4est_iter_corner_side_t *) side;
+  *treeid = cside->treeid;
+  quad[0] = cside->quad;
+  quadid[0] = cside->quadid;
+  is_ghost[0] = cside->is_ghost;
+  return 1;
+}
+
+/* sort the entries of a plan by the block of their largest local quadrant;
+ * on output, the entries of block b are at positions [block_offsets[b],
+ * block_offsets[b + 1]) of the returned array */
+static size_t      *
+p4est_iter_block_sort (p4est_t * p4est, int kind, sc_array_t * offsets,
+                       sc_array_t * sides, p4est_locidx_t block_size,
+                       size_t num_blocks, size_t * block_offsets)
+{
+  int                 j, n;
+  int8_t              is_ghost[P4EST_HALF];
+  size_t              i, k, b, num, first, last;
+  size_t             *order, *blocks;
+  p4est_topidx_t      treeid;
+  p4est_locidx_t      quadid[P4EST_HALF], lq, lmax;
+  p4est_quadrant_t   *quad[P4EST_HALF];
+
+  num = offsets->elem_count - 1;
+  order = P4EST_ALLOC (size_t, num);
+  blocks = P4EST_ALLOC (size_t, num);
+  memset (block_offsets, 0, (num_blocks + 1) * sizeof (size_t));
+
+  /* find the block of each entry */
+  for (i = 0; i < num; ++i) {
+    first = *(size_t *) sc_array_index (offsets, i);
+    last = *(size_t *) sc_array_index (offsets, i + 1);
+    lmax = -1;
+    for (k = first; k < last; ++k) {
+      n = p4est_iter_block_side (kind, sc_array_index (sides, k), &treeid,
+                                 quad, quadid, is_ghost);
+      for (j = 0; j < n; ++j) {
+        if (quad[j] != NULL && !is_ghost[j] && quadid[j] >= 0) {
+          lq = p4est_tree_array_index (p4est->trees, treeid)->
+            quadrants_offset + quadid[j];
+          lmax = SC_MAX (lmax, lq);
+        }
+      }
+    }
+    blocks[i] = (lmax < 0) ? 0 : (size_t) (lmax / block_size);
+    P4EST_ASSERT (blocks[i] < num_blocks);
+    ++block_offsets[blocks[i] + 1];
+  }
+
+  /* counting sort, stable in the recorded order */
+  for (b = 0; b < num_blocks; ++b) {
+    block_offsets[b + 1] += block_offsets[b];
+  }
+  for (i = 0; i < num; ++i) {
+    order[block_offsets[blocks[i]]++] = i;
+  }
+  P4EST_FREE (blocks);
+  for (b = num_blocks; b > 0; --b) {
+    block_offsets[b] = block_offsets[b - 1];
+  }
+  block_offsets[0] = 0;
+
+  return order;
+}
+
+/* issue prefetches for the user data of the quadrants of some entries */
+static void
+p4est_iter_block_prefetch (int kind, sc_array_t * offsets,
+                           sc_array_t * sides, const size_t * order, size_t begin, size_t end,
+                           void *ghost_data, size_t data_size)
+{
+  int                 j, n;
+  int8_t              is_ghost[P4EST_HALF];
+  size_t              i, k, first, last;
+  p4est_topidx_t      treeid;
+  p4est_locidx_t      quadid[P4EST_HALF];
+  p4est_quadrant_t   *quad[P4EST_HALF];
+
+  for (i = begin; i < end; ++i) {
+    first = *(size_t *) sc_array_index (offsets, order[i]);
+    last = *(size_t *) sc_array_index (offsets, order[i] + 1);
+    for (k = first; k < last; ++k) {
+      n = p4est_iter_block_side (kind, sc_array_index (sides, k), &treeid,
+                                 quad, quadid, is_ghost);
+      for (j = 0; j < n; ++j) {
+        if (quad[j] == NULL) {
+          continue;
+        }
+        if (!is_ghost[j]) {
+          P4EST_ITER_PREFETCH (quad[j]->p.user_data);
+        }
+        else {
+          P4EST_ITER_PREFETCH (quad[j]);
+          if (ghost_data != NULL && quadid[j] >= 0) {
+            P4EST_ITER_PREFETCH ((char *) ghost_data +
+                                 data_size * (size_t) quadid[j]);
+          }
+        }
+      }
+    }
+  }
+}
+
+void
+p4est_iter_plan_replay_blocked (p4est_iter_plan_t * plan, void *user_data,
+                                p4est_locidx_t block_size,
+                                void *ghost_data, size_t data_size,
+                                p4est_iter_volume_t iter_volume,
+                                p4est_iter_face_t iter_face,
+#ifdef P4_TO_P8
+                                p8est_iter_edge_t iter_edge,
+#endif
+                                p4est_iter_corner_t iter_corner)
+{
+  p4est_t            *p4est = plan->p4est;
+  p4est_topidx_t      t;
+  p4est_locidx_t      qid, lq, lend;
+  p4est_tree_t       *tree;
+  size_t              b, num_blocks, k, i;
+  size_t             *face_blocks, *face_order;
+#ifdef P4_TO_P8
+  size_t             *edge_blocks, *edge_order;
+  p8est_iter_edge_info_t einfo;
+#endif
+  size_t             *corner_blocks, *corner_order;
+  p4est_iter_volume_info_t vinfo;
+  p4est_iter_face_info_t finfo;
+  p4est_iter_corner_info_t cinfo;
+
+  P4EST_ASSERT (p4est_iter_plan_is_current (plan));
+  P4EST_ASSERT (block_size > 0);
+  P4EST_ASSERT (ghost_data == NULL || data_size > 0);
+
+  num_blocks = (p4est->local_num_quadrants > 0) ?
+    (size_t) ((p4est->local_num_quadrants - 1) / block_size + 1) : 1;
+
+  /* group the recorded entries by block */
+  face_blocks = face_order = NULL;
+  if (iter_face != NULL) {
+    face_blocks = P4EST_ALLOC (size_t, num_blocks + 1);
+    face_order = p4est_iter_block_sort (p4est, P4EST_ITER_BLOCK_FACE,
+                                        plan->face_offsets, plan->face_sides,
+                                        block_size, num_blocks, face_blocks);
+  }
+#ifdef P4_TO_P8
+  edge_blocks = edge_order = NULL;
+  if (iter_edge != NULL) {
+    edge_blocks = P4EST_ALLOC (size_t, num_blocks + 1);
+    edge_order = p4est_iter_block_sort (p4est, P8EST_ITER_BLOCK_EDGE,
+                                        plan->edge_offsets, plan->edge_sides,
+                                        block_size, num_blocks, edge_blocks);
+  }
+#endif
+  corner_blocks = corner_order = NULL;
+  if (iter_corner != NULL) {
+    corner_blocks = P4EST_ALLOC (size_t, num_blocks + 1);
+    corner_order = p4est_iter_block_sort (p4est, P4EST_ITER_BLOCK_CORNER,
+                                          plan->corner_offsets,
+                                          plan->corner_sides, block_size,
+                                          num_blocks, corner_blocks);
+  }
+
+  vinfo.p4est = finfo.p4est = cinfo.p4est = p4est;
+  vinfo.ghost_layer = finfo.ghost_layer = cinfo.ghost_layer =
+    plan->ghost_layer;
+#ifdef P4_TO_P8
+  einfo.p4est = p4est;
+  einfo.ghost_layer = plan->ghost_layer;
+#endif
+  t = p4est->first_local_tree;
+  tree = (t >= 0) ? p4est_tree_array_index (p4est->trees, t) : NULL;
+  qid = 0;
+  for (b = 0; b < num_blocks; ++b) {
+    /* request the data of the next block while this one is processed */
+    if (b + 1 < num_blocks) {
+      if (iter_face != NULL) {
+        p4est_iter_block_prefetch (P4EST_ITER_BLOCK_FACE,
+                                   plan->face_offsets, plan->face_sides,
+                                   face_order, face_blocks[b + 1],
+                                   face_blocks[b + 2], ghost_data,
+                                   data_size);
+      }
+#ifdef P4_TO_P8
+      if (iter_edge != NULL) {
+        p4est_iter_block_prefetch (P8EST_ITER_BLOCK_EDGE,
+                                   plan->edge_offsets, plan->edge_sides,
+                                   edge_order, edge_blocks[b + 1],
+                                   edge_blocks[b + 2], ghost_data,
+                                   data_size);
+      }
+#endif
+      if (iter_corner != NULL) {
+        p4est_iter_block_prefetch (P4EST_ITER_BLOCK_CORNER,
+                                   plan->corner_offsets, plan->corner_sides,
+                                   corner_order, corner_blocks[b + 1],
+                                   corner_blocks[b + 2], ghost_data,
+                                   data_size);
+      }
+    }
+
+    /* the local quadrants of this block in tree order */
+    if (iter_volume != NULL && tree != NULL) {
+      lend = SC_MIN (p4est->local_num_quadrants,
+                     (p4est_locidx_t) (b + 1) * block_size);
+      for (lq = (p4est_locidx_t) b * block_size; lq < lend; ++lq) {
+        while (qid == (p4est_locidx_t) tree->quadrants.elem_count) {
+          tree = p4est_tree_array_index (p4est->trees, ++t);
+          qid = 0;
+        }
+        P4EST_ASSERT (tree->quadrants_offset + qid == lq);
+        vinfo.treeid = t;
+        vinfo.quad = p4est_quadrant_array_index (&tree->quadrants,
+                                                 (size_t) qid);
+        vinfo.quadid = qid++;
+        iter_volume (&vinfo, user_data);
+      }
+    }
+
+    /* the faces, edges and corners whose last local quadrant is here */
+    if (iter_face != NULL) {
+      for (k = face_blocks[b]; k < face_blocks[b + 1]; ++k) {
+        i = face_order[k];
+        finfo.orientation =
+          *(int8_t *) sc_array_index (plan->face_orientation, i);
+        finfo.tree_boundary =
+          *(int8_t *) sc_array_index (plan->face_tree_boundary, i);
+        p4est_iter_plan_sides (&finfo.sides, plan->face_offsets,
+                               plan->face_sides, i);
+        iter_face (&finfo, user_data);
+      }
+    }
+#ifdef P4_TO_P8
+    if (iter_edge != NULL) {
+      for (k = edge_blocks[b]; k < edge_blocks[b + 1]; ++k) {
+        i = edge_order[k];
+        einfo.tree_boundary =
+          *(int8_t *) sc_array_index (plan->edge_tree_boundary, i);
+        p4est_iter_plan_sides (&einfo.sides, plan->edge_offsets,
+                               plan->edge_sides, i);
+        iter_edge (&einfo, user_data);
+      }
+    }
+#endif
+    if (iter_corner != NULL) {
+      for (k = corner_blocks[b]; k < corner_blocks[b + 1]; ++k) {
+        i = corner_order[k];
+        cinfo.tree_boundary =
+          *(int8_t *) sc_array_index (plan->corner_tree_boundary, i);
+        p4est_iter_plan_sides (&cinfo.sides, plan->corner_offsets,
+                               plan->corner_sides, i);
+        iter_corner (&cinfo, user_data);
+      }
+    }
+  }
+
+  P4EST_FREE (face_blocks);
+  P4EST_FREE (face_order);
+#ifdef P4_TO_P8
+  P4EST_FREE (edge_blocks);
+  P4EST_FREE (edge_order);
+#endif
+  P4EST_FREE (corner_blocks);
+  P4EST_FREE (corner_order);
+}
+
+/* the user callbacks of p4est_iterate_active and p4est_iterate_levels */
+typedef struct p4est_iter_active_ctx
+{
+  const p4est_locidx_t *active;
+  p4est_locidx_t      num_active;
+  int                 minlevel, maxlevel;
+  void               *user_data;
+  p4est_iter_volume_t iter_volume;
+  p4est_iter_face_t   iter_face;
+#ifdef P4_TO_P8
+  p8est_iter_edge_t   iter_edge;
+#endif
+  p4est_iter_corner_t iter_corner;
+}
+p4est_iter_active_ctx_t;
+
+/* return whether a quadrant of a callback side is local and active */
+static int
+p4est_iter_active_quad (p4est_iter_active_ctx_t * ctx, p4est_t * p4est,
+                        p4est_topidx_t treeid, int8_t is_ghost,
+                        p4est_quadrant_t * quad, p4est_locidx_t quadid)
+{
+  p4est_tree_t       *tree;
+
+  if (is_ghost || quadid < 0 || (int) quad->level < ctx->minlevel ||
+      (int) quad->level > ctx->maxlevel) {
+    return 0;
+  }
+  if (ctx->active == NULL) {
+    return 1;
+  }
+  tree = p4est_tree_array_index (p4est->trees, treeid);
+  return p4est_iter_active_range (ctx->active, ctx->num_active,
+                                  tree->quadrants_offset + quadid, 1);
+}
+
+static void
+p4est_iter_active_volume (p4est_iter_volume_info_t * info, void *user_data)
+{
+  p4est_iter_active_ctx_t *ctx = (p4est_iter_active_ctx_t *) user_data;
+
+  if (p4est_iter_active_quad (ctx, info->p4est, info->treeid, 0,
+                              info->quad, info->quadid)) {
+    ctx->iter_volume (info, ctx->user_data);
+  }
+}
+
+static void
+p4est_iter_active_face (p4est_iter_face_info_t * info, void *user_data)
+{
+  p4est_iter_active_ctx_t *ctx = (p4est_iter_active_ctx_t *) user_data;
+  p4est_iter_face_side_t *side;
+  size_t              zz;
+  int                 h;
+
+  for (zz = 0; zz < info->sides.elem_count; ++zz) {
+    side = p4est_iter_fside_array_index (&info->sides, zz);
+    if (!side->is_hanging) {
+      if (p4est_iter_active_quad (ctx, info->p4est, side->treeid,
+                                  side->is.full.is_ghost,
+                                  side->is.full.quad,
+                                  side->is.full.quadid)) {
+        ctx->iter_face (info, ctx->user_data);
+        return;
+      }
+    }
+    else {
+      for (h = 0; h < P4EST_HALF; ++h) {
+        if (p4est_iter_active_quad (ctx, info->p4est, side->treeid,
+                                    side->is.hanging.is_ghost[h],
+                                    side->is.hanging.quad[h],
+                                    side->is.hanging.quadid[h])) {
+          ctx->iter_face (info, ctx->user_data);
+          return;
+        }
+      }
+    }
+  }
+}
+
+#ifdef P4_TO_P8
+static void
+p8est_iter_active_edge (p8est_iter_edge_info_t * info, void *user_data)
+{
+  p4est_iter_active_ctx_t *ctx = (p4est_iter_active_ctx_t *) user_data;
+  p8est_iter_edge_side_t *side;
+  size_t              zz;
+  int                 h;
+
+  for (zz = 0; zz < info->sides.elem_count; ++zz) {
+    side = p8est_iter_eside_array_index (&info->sides, zz);
+    if (!side->is_hanging) {
+      if (p4est_iter_active_quad (ctx, info->p4est, side->treeid,
+                                  side->is.full.is_ghost,
+                                  side->is.full.quad,
+                                  side->is.full.quadid)) {
+        ctx->iter_edge (info, ctx->user_data);
+        return;
+      }
+    }
+    else {
+      for (h = 0; h < 2; ++h) {
+        if (p4est_iter_active_quad (ctx, info->p4est, side->treeid,
+                                    side->is.hanging.is_ghost[h],
+                                    side->is.hanging.quad[h],
+                                    side->is.hanging.quadid[h])) {
+          ctx->iter_edge (info, ctx->user_data);
+          return;
+        }
+      }
+    }
+  }
+}
+#endif
+
+static void
+p4est_iter_active_corner (p4est_iter_corner_info_t * info, void *user_data)
+{
+  p4est_iter_active_ctx_t *ctx = (p4est_iter_active_ctx_t *) user_data;
+  p4est_iter_corner_side_t *side;
+  size_t              zz;
+
+  for (zz = 0; zz < info->sides.elem_count; ++zz) {
+    side = p4est_iter_cside_array_index (&info->sides, zz);
+    if (p4est_iter_active_quad (ctx, info->p4est, side->treeid,
+                                side->is_ghost, side->quad,
+                                side->quadid)) {
+      ctx->iter_corner (info, ctx->user_data);
+      return;
+    }
+  }
+}
+
+void
+p4est_iterate_active (p4est_t * p4est, p4est_ghost_t * ghost_layer,
+                      void *user_data, const p4est_locidx_t * active,
+                      p4est_locidx_t num_active,
+                      p4est_iter_volume_t iter_volume,
+                      p4est_iter_face_t iter_face,
+#ifdef P4_TO_P8
+                      p8est_iter_edge_t iter_edge,
+#endif
+                      p4est_iter_corner_t iter_corner)
+{
+  p4est_locidx_t      il, qid;
+  p4est_topidx_t      t;
+  p4est_tree_t       *tree;
+  p4est_iter_volume_info_t vinfo;
+  p4est_iter_active_ctx_t ctx;
+
+  P4EST_ASSERT (num_active >= 0);
+  P4EST_ASSERT (num_active == 0 || active != NULL);
+#ifdef P4EST_ENABLE_DEBUG
+  for (il = 0; il < num_active; ++il) {
+    P4EST_ASSERT (0 <= active[il] &&
+                  active[il] < p4est->local_num_quadrants);
+    P4EST_ASSERT (il == 0 || active[il - 1] < active[il]);
+  }
+#endif
+
+  if (num_active == 0) {
+    return;
+  }
+
+  if (iter_face == NULL && iter_corner == NULL
+#ifdef P4_TO_P8
+      && iter_edge == NULL
+#endif
+    ) {
+    /* without a search, visit the active quadrants directly */
+    if (iter_volume == NULL) {
+      return;
+    }
+    vinfo.p4est = p4est;
+    vinfo.ghost_layer = ghost_layer;
+    t = p4est->first_local_tree;
+    tree = p4est_tree_array_index (p4est->trees, t);
+    for (il = 0; il < num_active; ++il) {
+      while (active[il] >= tree->quadrants_offset +
+             (p4est_locidx_t) tree->quadrants.elem_count) {
+        tree = p4est_tree_array_index (p4est->trees, ++t);
+      }
+      qid = active[il] - tree->quadrants_offset;
+      vinfo.treeid = t;
+      vinfo.quad = p4est_quadrant_array_index (&tree->quadrants,
+                                               (size_t) qid);
+      vinfo.quadid = qid;
+      iter_volume (&vinfo, user_data);
+    }
+    return;
+  }
+
+  ctx.active = active;
+  ctx.num_active = num_active;
+  ctx.minlevel = 0;
+  ctx.maxlevel = P4EST_QMAXLEVEL;
+  ctx.user_data = user_data;
+  ctx.iter_volume = iter_volume;
+  ctx.iter_face = iter_face;
+#ifdef P4_TO_P8
+  ctx.iter_edge = iter_edge;
+#endif
+  ctx.iter_corner = iter_corner;
+
+  p4est_iterate_internal (p4est, ghost_layer, &ctx,
+                          iter_volume != NULL ? p4est_iter_active_volume :
+                          NULL,
+                          iter_face != NULL ? p4est_iter_active_face : NULL,
+#ifdef P4_TO_P8
+                          iter_edge != NULL ? p8est_iter_active_edge : NULL,
+#endif
+                          iter_corner != NULL ?
+                          p4est_iter_active_corner : NULL, 0, 0, 0, 0,
+                          active, num_active, 0, P4EST_QMAXLEVEL);
+}
+
+void
+p4est_iterate_levels (p4est_t * p4est, p4est_ghost_t * ghost_layer,
+                      void *user_data, int minlevel, int maxlevel,
+                      p4est_iter_volume_t iter_volume,
+                      p4est_iter_face_t iter_face,
+#ifdef P4_TO_P8
+                      p8est_iter_edge_t iter_edge,
+#endif
+                      p4est_iter_corner_t iter_corner, int remote)
+{
+  p4est_iter_active_ctx_t ctx;
+
+  P4EST_ASSERT (0 <= minlevel && minlevel <= P4EST_QMAXLEVEL);
+  P4EST_ASSERT (0 <= maxlevel && maxlevel <= P4EST_QMAXLEVEL);
+
+  if (minlevel > maxlevel) {
+    return;
+  }
+
+  ctx.active = NULL;
+  ctx.num_active = 0;
+  ctx.minlevel = minlevel;
+  ctx.maxlevel = maxlevel;
+  ctx.user_data = user_data;
+  ctx.iter_volume = iter_volume;
+  ctx.iter_face = iter_face;
+#ifdef P4_TO_P8
+  ctx.iter_edge = iter_edge;
+#endif
+  ctx.iter_corner = iter_corner;
+
+  p4est_iterate_internal (p4est, ghost_layer, &ctx,
+                          iter_volume != NULL ? p4est_iter_active_volume :
+                          NULL,
+                          iter_face != NULL ? p4est_iter_active_face : NULL,
+#ifdef P4_TO_P8
+                          iter_edge != NULL ? p8est_iter_active_edge : NULL,
+#endif
+                          iter_corner != NULL ?
+                          p4est_iter_active_corner : NULL, remote, 0, 0, 0,
+                          NULL, 0, minlevel, maxlevel);
+}
@@ -236,6 +236,206 @@ void                p4est_iterate (p4est_t * p4est,
                                    p4est_iter_face_t iter_face,
                                    p4est_iter_corner_t iter_corner);
 
+/** The kinds of faces that p4est_iterate_face_batch groups into batches. */
+typedef enum p4est_iter_face_kind
+{
+  P4EST_ITER_FACE_SAME = 0,     /**< two full quadrants of the same size */
+  P4EST_ITER_FACE_HANGING,      /**< a full quadrant against smaller ones */
+  P4EST_ITER_FACE_BOUNDARY,     /**< one quadrant on the domain boundary */
+  P4EST_ITER_FACE_NUM_KINDS
+}
+p4est_iter_face_kind_t;
+
+/** A batch of faces of one kind, stored as a structure of arrays.
+ *
+ * Entry i of each array describes the i-th face of the batch.  Quadrants
+ * are identified by their local index, i.e. the tree's quadrants_offset
+ * plus the index in the tree, if they are local, or by their index in
+ * the ghost layer's ghosts array otherwise.  A quadrant that is missing
+ * from the ghost layer has index -1.
+ *
+ * Side 0 is the full side: for hanging faces the sides are exchanged as
+ * necessary.  Side 1 holds one quadrant per face for the kind
+ * P4EST_ITER_FACE_SAME and P4EST_HALF quadrants per face, in z-order, for
+ * the kind P4EST_ITER_FACE_HANGING; its arrays are unused for boundaries.
+ */
+typedef struct p4est_iter_face_batch_info
+{
+  p4est_t            *p4est;
+  p4est_ghost_t      *ghost_layer;
+  p4est_iter_face_kind_t kind;  /**< the kind shared by all faces */
+  size_t              count;    /**< number of faces in the batch */
+  int8_t             *orientation;      /**< as in p4est_iter_face_info_t */
+  int8_t             *tree_boundary;    /**< as in p4est_iter_face_info_t */
+  int8_t             *face[2];  /**< the face touched on each side */
+  p4est_locidx_t     *quadid[2];        /**< local or ghost indices */
+  int8_t             *is_ghost[2];      /**< boolean for each quadid */
+}
+p4est_iter_face_batch_info_t;
+
+/** The prototype for a function that p4est_iterate_face_batch executes on
+ * each batch of faces.
+ * \param [in] info          the faces of the batch
+ * \param [in,out] user_data the user context passed to the iteration
+ */
+typedef void        (*p4est_iter_face_batch_t) (p4est_iter_face_batch_info_t
+                                                * info, void *user_data);
+
+/** Execute a user supplied callback on batches of faces of the same kind.
+ *
+ * This traverses the faces as p4est_iterate does and collects them by
+ * kind into batches of at most \a batch_size faces.  A full batch is
+ * passed to \a iter_batch at once; the remaining partial batches follow
+ * at the end of the traversal.  The arrays of the batch allow for loops
+ * without per-face callbacks or indirection through the sides.
+ *
+ * \param[in] p4est          the forest, which must be face balanced
+ * \param[in] ghost_layer    optional, as for p4est_iterate
+ * \param[in,out] user_data  optional context to supply to the callback
+ * \param[in] batch_size     the maximum number of faces per batch, > 0
+ * \param[in] iter_batch     callback function for every batch of faces
+ */
+void                p4est_iterate_face_batch (p4est_t * p4est,
+                                              p4est_ghost_t * ghost_layer,
+                                              void *user_data,
+                                              size_t batch_size,
+                                              p4est_iter_face_batch_t
+                                              iter_batch);
+
+/** Execute user supplied callbacks in the neighborhood of active quadrants.
+ *
+ * This is p4est_iterate restricted to a subset of the local quadrants.
+ * The volume callback is executed for the active quadrants only, and the
+ * face and corner callbacks are executed where at least one of the
+ * sides is an active quadrant.  The search skips every part of a tree
+ * that contains no active quadrant, such that the cost grows with the
+ * size of the active set rather than that of the forest.
+ *
+ * \param[in] p4est          the forest
+ * \param[in] ghost_layer    optional, as for p4est_iterate
+ * \param[in,out] user_data  optional context to supply to each callback
+ * \param[in] active         strictly increasing local indices, i.e. the
+ *                           tree's quadrants_offset plus the index in the
+ *                           tree, of the active quadrants
+ * \param[in] num_active     the number of entries in \a active
+ * \param[in] iter_volume    callback function for every active quadrant
+ * \param[in] iter_face      callback function for every face touching an
+ *                           active quadrant
+ * \param[in] iter_corner    callback function for every corner touching an
+ *                           active quadrant
+ */
+void                p4est_iterate_active (p4est_t * p4est,
+                                          p4est_ghost_t * ghost_layer,
+                                          void *user_data,
+                                          const p4est_locidx_t * active,
+                                          p4est_locidx_t num_active,
+                                          p4est_iter_volume_t iter_volume,
+                                          p4est_iter_face_t iter_face,
+                                          p4est_iter_corner_t iter_corner);
+
+/** A recorded traversal of a forest that does not change between uses.
+ *
+ * Recording stores the information that p4est_iterate_ext passes to the
+ * face and corner callbacks, such that it can be replayed without
+ * repeating the traversal, or read directly by the application.
+ * The entries are stored in compressed sparse row format: the sides of
+ * face i are the elements offsets[i] to offsets[i + 1] - 1 of face_sides,
+ * and likewise for the corners.  The quadrant pointers in the sides
+ * refer into the forest and the ghost layer, which must not be modified
+ * while the plan is used.
+ */
+typedef struct p4est_iter_plan
+{
+  p4est_t            *p4est;
+  p4est_ghost_t      *ghost_layer;
+  long                revision;         /**< revision of p4est at recording */
+  sc_array_t         *face_offsets;     /**< size_t, one more than faces */
+  sc_array_t         *face_sides;       /**< p4est_iter_face_side_t */
+  sc_array_t         *face_orientation; /**< int8_t, one per face */
+  sc_array_t         *face_tree_boundary;       /**< int8_t, one per face */
+  sc_array_t         *corner_offsets;   /**< size_t, one more than corners */
+  sc_array_t         *corner_sides;     /**< p4est_iter_corner_side_t */
+  sc_array_t         *corner_tree_boundary;     /**< int8_t, one per corner */
+}
+p4est_iter_plan_t;
+
+/** Record the faces and corners of the local forest into a plan.
+ * \param[in] p4est          the forest, which must be face balanced
+ * \param[in] ghost_layer    optional, as for p4est_iterate
+ * \param[in] remote         as for p4est_iterate_ext
+ * \return                   a plan to be freed with p4est_iter_plan_destroy
+ */
+p4est_iter_plan_t  *p4est_iter_plan_new (p4est_t * p4est,
+                                         p4est_ghost_t * ghost_layer,
+                                         int remote);
+
+/** Free the memory of a plan.
+ */
+void                p4est_iter_plan_destroy (p4est_iter_plan_t * plan);
+
+/** Check whether the forest of a plan is unchanged since the recording.
+ * \return                   true if the revision of the forest matches
+ */
+int                 p4est_iter_plan_is_current (p4est_iter_plan_t * plan);
+
+/** Execute user supplied callbacks on a recorded plan.
+ *
+ * The callbacks receive the same information as in p4est_iterate_ext.
+ * The plan must be current, see p4est_iter_plan_is_current.  Unlike
+ * p4est_iterate, all volume callbacks are executed first, followed by
+ * all face callbacks and then all corner callbacks.  The callbacks must
+ * not modify the sides array of the info structure.
+ *
+ * \param[in] plan           a plan recorded for the unchanged forest
+ * \param[in,out] user_data  optional context to supply to each callback
+ * \param[in] iter_volume    callback function for every local quadrant
+ * \param[in] iter_face      callback function for every recorded face
+ * \param[in] iter_corner    callback function for every recorded corner
+ */
+void                p4est_iter_plan_replay (p4est_iter_plan_t * plan,
+                                            void *user_data,
+                                            p4est_iter_volume_t iter_volume,
+                                            p4est_iter_face_t iter_face,
+                                            p4est_iter_corner_t iter_corner);
+
+/** Execute user supplied callbacks on a recorded plan in cache blocks.
+ *
+ * The local quadrants are split into blocks of \a block_size consecutive
+ * local indices, which are contiguous in Morton order.  For each block
+ * in turn, the volume callbacks of its quadrants are executed, followed
+ * by the faces and corners whose largest local quadrant is in
+ * the block.
+ * Thus the callbacks of a block touch the same few quadrants, and all
+ * volume callbacks of the local sides have run before the callback of
+ * an entity.  While a block is processed, prefetches are issued for the
+ * user data of the quadrants and the ghost data of the next block.
+ * Grouping the entries costs a pass over the plan per call.
+ * The plan must be current, see p4est_iter_plan_is_current.
+ *
+ * \param[in] plan           a plan recorded for the unchanged forest
+ * \param[in,out] user_data  optional context to supply to each callback
+ * \param[in] block_size     number of local quadrants per block, > 0;
+ *                           choose it such that the data of a block
+ *                           fits into the cache
+ * \param[in] ghost_data     optional array of data for the ghost
+ *                           quadrants as exchanged by
+ *                           p4est_ghost_exchange_data, only prefetched
+ * \param[in] data_size      size of one entry of \a ghost_data
+ * \param[in] iter_volume    callback function for every local quadrant
+ * \param[in] iter_face      callback function for every recorded face
+ * \param[in] iter_corner    callback function for every recorded corner
+ */
+void                p4est_iter_plan_replay_blocked (p4est_iter_plan_t * plan,
+                                                    void *user_data,
+                                                    p4est_locidx_t block_size,
+                                                    void *ghost_data,
+                                                    size_t data_size,
+                                                    p4est_iter_volume_t
+                                                    iter_volume,
+                                                    p4est_iter_face_t iter_face,
+                                                    p4est_iter_corner_t
+                                                    iter_corner);
+
 /** Return a pointer to a iter_corner_side array element indexed by a int.
  */
 /*@unused@*/
@@ -816,8 +816,8 @@ p4est_lnodes_corner_callback (p4est_iter_corner_info_t * info, void *Data)
       P4EST_ASSERT (owner_f >= 0);
 
       /* figure out which tree is on the other side of the face */
-      nt = conn->tree_to_tree[P4EST_FACES * owner_tid + owner_f];
-      nf = conn->tree_to_face[P4EST_FACES * owner_tid + owner_f];
+      nt = p4est_connectivity_face_neighbor_tree (conn, owner_tid, owner_f,
+                                                  &nf);
 
       nf %= P4EST_FACES;
 
@@ -1224,8 +1224,8 @@ p8est_lnodes_edge_callback (p8est_iter_edge_info_t * info, void *Data)
       owner_f = p4est_child_corner_faces[c1][c2];
       P4EST_ASSERT (owner_f >= 0);
 
-      nt = conn->tree_to_tree[P4EST_FACES * owner_tid + owner_f];
-      nf = conn->tree_to_face[P4EST_FACES * owner_tid + owner_f];
+      nt = p4est_connectivity_face_neighbor_tree (conn, owner_tid, owner_f,
+                                                  &nf);
 
       /* o2 = nf / P4EST_FACES; */
       nf %= P4EST_FACES;
@@ -2033,12 +2033,17 @@ p4est_lnodes_count_send (p4est_lnodes_data_t * data, p4est_t * p4est,
                              sc_MPI_BYTE, i, P4EST_COMM_LNODES_PASS,
                              p4est->mpicomm, send_request);
       SC_CHECK_MPI (mpiret);
+      p4est_inspect_send (p4est->inspect, P4EST_INSPECT_LNODES, i,
+                          send_count * sizeof (p4est_locidx_t));
       num_send_procs++;
       total_sent += (send_count * sizeof (p4est_locidx_t));
     }
   }
   P4EST_VERBOSEF ("Total of %llu bytes sent to %d processes\n",
                   (unsigned long long) total_sent, num_send_procs);
+  p4est_inspect_comm (p4est->inspect, P4EST_INSPECT_LNODES,
+                      (size_t) num_send_procs, (size_t) num_send_procs,
+                      total_sent, 0, 0);
 }
 
 #ifdef P4EST_ENABLE_DEBUG
@@ -2290,6 +2295,8 @@ p4est_lnodes_recv (p4est_t * p4est, p4est_lnodes_data_t * data,
 
   P4EST_VERBOSEF ("Total of %llu bytes received from %d processes\n",
                   (unsigned long long) total_recv, num_recv_procs);
+  p4est_inspect_comm (p4est->inspect, P4EST_INSPECT_LNODES, 0, 0, 0,
+                      (size_t) num_recv_procs, total_recv);
   P4EST_FREE (data->send_buf);
   P4EST_FREE (recv_buf);
   P4EST_FREE (num_recv_expect);
@@ -2306,9 +2313,11 @@ p4est_lnodes_recv (p4est_t * p4est, p4est_lnodes_data_t * data,
  */
 static              p4est_gloidx_t
 p4est_lnodes_global_and_sharers (p4est_lnodes_data_t * data,
-                                 p4est_lnodes_t * lnodes, p4est_t * p4est)
+                                 p4est_lnodes_t * lnodes, p4est_t * p4est,
+                                 int global_counts)
 {
   int                 i, j, k, l;
+  int                 mpiret;
   int                 mpisize = p4est->mpisize;
   p4est_gloidx_t     *gnodes = lnodes->nonlocal_nodes, gtotal;
   size_t              count, zz;
@@ -2339,25 +2348,95 @@ p4est_lnodes_global_and_sharers (p4est_lnodes_data_t * data,
   int                 shareidx;
   p4est_locidx_t      gidx;
   sc_array_t         *shared_nodes;
-  p4est_locidx_t     *global_num_indep;
+  p4est_gloidx_t      local_count;
   p4est_gloidx_t     *global_offsets = P4EST_ALLOC (p4est_gloidx_t,
                                                     mpisize + 1);
+  sc_array_t         *requests;
   p4est_locidx_t     *poff = data->poff;
+#ifdef P4EST_ENABLE_OPENMP
+  int                 num_threads = p4est_get_num_threads ();
+#endif
 
-  global_num_indep = lnodes->global_owned_count = P4EST_ALLOC (p4est_locidx_t,
-                                                               mpisize);
-  sc_MPI_Allgather (&owned_count, 1, P4EST_MPI_LOCIDX, global_num_indep, 1,
-                    P4EST_MPI_LOCIDX, p4est->mpicomm);
-
-  global_offsets[0] = 0;
+  /* figure out all nodes that also share nodes shared by the local process */
+  comm_proc = P4EST_ALLOC_ZERO (int, mpisize);
+  count = inode_sharers->elem_count;
+  for (zz = 0; zz < count; zz++) {
+    i = *((int *) sc_array_index (inode_sharers, zz));
+    comm_proc[i] = 1;
+  }
+  /* create an entry in sharers for each such process, providing a map from
+   * process id to sharer index */
+  comm_proc_count = 0;
+  lnodes->sharers = sharers = sc_array_new (sizeof (p4est_lnodes_rank_t));
   for (i = 0; i < mpisize; i++) {
-    global_offsets[i + 1] = global_offsets[i] +
-      (p4est_gloidx_t) global_num_indep[i];
+    if (comm_proc[i]) {
+      lrank = (p4est_lnodes_rank_t *) sc_array_push (sharers);
+      lrank->rank = i;
+      sc_array_init (&(lrank->shared_nodes), sizeof (p4est_locidx_t));
+      comm_proc[i] = comm_proc_count++;
+    }
+    else {
+      comm_proc[i] = -1;
+    }
+  }
+
+  if (global_counts) {
+    /* all processes learn the owned counts of all processes */
+    lnodes->global_owned_count = P4EST_ALLOC (p4est_locidx_t, mpisize);
+    mpiret = sc_MPI_Allgather (&owned_count, 1, P4EST_MPI_LOCIDX,
+                               lnodes->global_owned_count, 1,
+                               P4EST_MPI_LOCIDX, p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+
+    global_offsets[0] = 0;
+    for (i = 0; i < mpisize; i++) {
+      global_offsets[i + 1] = global_offsets[i] +
+        (p4est_gloidx_t) lnodes->global_owned_count[i];
+    }
+    lnodes->global_offset = global_offsets[p4est->mpirank];
+    gtotal = global_offsets[p4est->mpisize];
+  }
+  else {
+    /* the offsets of the sharing processes suffice to number the nodes */
+    lnodes->global_owned_count = NULL;
+    local_count = (p4est_gloidx_t) owned_count;
+    lnodes->global_offset = 0;
+    mpiret = sc_MPI_Exscan (&local_count, &lnodes->global_offset, 1,
+                            P4EST_MPI_GLOIDX, sc_MPI_SUM, p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+    if (p4est->mpirank == 0) {
+      lnodes->global_offset = 0;
+    }
+    mpiret = sc_MPI_Allreduce (&local_count, &gtotal, 1, P4EST_MPI_GLOIDX,
+                               sc_MPI_SUM, p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+
+    requests = sc_array_new (sizeof (sc_MPI_Request));
+    for (zz = 0; zz < sharers->elem_count; zz++) {
+      lrank = p4est_lnodes_rank_array_index (sharers, zz);
+      proc = lrank->rank;
+      if (proc == p4est->mpirank) {
+        continue;
+      }
+      mpiret = sc_MPI_Irecv (global_offsets + proc, 1, P4EST_MPI_GLOIDX,
+                             proc, P4EST_COMM_LNODES_OFFSET, p4est->mpicomm,
+                             (sc_MPI_Request *) sc_array_push (requests));
+      SC_CHECK_MPI (mpiret);
+      mpiret = sc_MPI_Isend (&lnodes->global_offset, 1, P4EST_MPI_GLOIDX,
+                             proc, P4EST_COMM_LNODES_OFFSET, p4est->mpicomm,
+                             (sc_MPI_Request *) sc_array_push (requests));
+      SC_CHECK_MPI (mpiret);
+    }
+    if (requests->elem_count > 0) {
+      mpiret = sc_MPI_Waitall ((int) requests->elem_count,
+                               (sc_MPI_Request *) requests->array,
+                               sc_MPI_STATUSES_IGNORE);
+      SC_CHECK_MPI (mpiret);
+    }
+    sc_array_destroy (requests);
+    global_offsets[p4est->mpirank] = lnodes->global_offset;
   }
-  lnodes->global_offset = global_offsets[p4est->mpirank];
-  gtotal = global_offsets[p4est->mpisize];
 
-  i = p4est->mpirank;
   for (i = 0; i < mpisize; i++) {
     if (i == p4est->mpirank) {
       continue;
@@ -2371,6 +2450,11 @@ p4est_lnodes_global_and_sharers (p4est_lnodes_data_t * data,
     }
   }
 
+  /* the element nodes are independent of each other */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for if (num_threads > 1) num_threads (num_threads) \
+  private (inidx, inode) schedule (static)
+#endif
   for (li = 0; li < nlen; li++) {
     inidx = elnodes[li];
     P4EST_ASSERT (0 <= inidx && inidx < num_inodes);
@@ -2388,29 +2472,6 @@ p4est_lnodes_global_and_sharers (p4est_lnodes_data_t * data,
     }
   }
 
-  /* figure out all nodes that also share nodes shared by the local process */
-  comm_proc = P4EST_ALLOC_ZERO (int, mpisize);
-  count = inode_sharers->elem_count;
-  for (zz = 0; zz < count; zz++) {
-    i = *((int *) sc_array_index (inode_sharers, zz));
-    comm_proc[i] = 1;
-  }
-  /* create an entry in sharers for each such process, providing a map from
-   * process id to sharer index */
-  comm_proc_count = 0;
-  lnodes->sharers = sharers = sc_array_new (sizeof (p4est_lnodes_rank_t));
-  for (i = 0; i < mpisize; i++) {
-    if (comm_proc[i]) {
-      lrank = (p4est_lnodes_rank_t *) sc_array_push (sharers);
-      lrank->rank = i;
-      sc_array_init (&(lrank->shared_nodes), sizeof (p4est_locidx_t));
-      comm_proc[i] = comm_proc_count++;
-    }
-    else {
-      comm_proc[i] = -1;
-    }
-  }
-
   /* for every node in a send or receive list, figure out which global node it
    * is, and which processes share it, and add the index in global nodes to that
    * sharer's element_nodes array.
@@ -2487,8 +2548,12 @@ p4est_lnodes_global_and_sharers (p4est_lnodes_data_t * data,
     }
   }
 
-  /* for each sharer, figure out which entries in element_nodes are owned by
-   * the current process, and which are owned by the sharer's rank */
+  /* sort the shared nodes of each sharer by global index: the sharers are
+   * independent of each other */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for if (num_threads > 1) num_threads (num_threads) \
+  private (lrank, shared_nodes, count, zz, gidx) schedule (dynamic, 1)
+#endif
   for (i = 0; i < comm_proc_count; i++) {
     lrank = p4est_lnodes_rank_array_index_int (sharers, i);
     shared_nodes = &(lrank->shared_nodes);
@@ -2514,6 +2579,14 @@ p4est_lnodes_global_and_sharers (p4est_lnodes_data_t * data,
       }
       sc_array_destroy (sortshared);
     }
+  }
+
+  /* for each sharer, figure out which entries in element_nodes are owned by
+   * the current process, and which are owned by the sharer's rank */
+  for (i = 0; i < comm_proc_count; i++) {
+    lrank = p4est_lnodes_rank_array_index_int (sharers, i);
+    shared_nodes = &(lrank->shared_nodes);
+    count = shared_nodes->elem_count;
     proc = lrank->rank;
     lrank->shared_mine_offset = -1;
     lrank->shared_mine_count = 0;
@@ -2550,6 +2623,13 @@ p4est_lnodes_global_and_sharers (p4est_lnodes_data_t * data,
 
 p4est_lnodes_t     *
 p4est_lnodes_new (p4est_t * p4est, p4est_ghost_t * ghost_layer, int degree)
+{
+  return p4est_lnodes_new_ext (p4est, ghost_layer, degree, 1);
+}
+
+p4est_lnodes_t     *
+p4est_lnodes_new_ext (p4est_t * p4est, p4est_ghost_t * ghost_layer,
+                      int degree, int global_counts)
 {
   p4est_iter_face_t   fiter;
   p4est_iter_volume_t viter;
@@ -2565,6 +2645,7 @@ p4est_lnodes_new (p4est_t * p4est, p4est_ghost_t * ghost_layer, int degree)
 #endif
   p4est_lnodes_t     *lnodes = P4EST_ALLOC (p4est_lnodes_t, 1);
   p4est_gloidx_t      gtotal;
+  const double        inspect_start = p4est_inspect_start (p4est->inspect);
 
   P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_lnodes_new, degree %d\n",
                             degree);
@@ -2621,11 +2702,13 @@ p4est_lnodes_new (p4est_t * p4est, p4est_ghost_t * ghost_layer, int degree)
 #endif
   citer = data.nodes_per_corner ? p4est_lnodes_corner_callback : NULL;
 
+  P4EST_REGION_BEGIN ("lnodes.iterate");
   p4est_iterate_ext (p4est, ghost_layer, &data, viter, fiter,
 #ifdef P4_TO_P8
                      eiter,
 #endif
                      citer, 1);
+  P4EST_REGION_END ("lnodes.iterate");
 
 #ifdef P4EST_ENABLE_DEBUG
   for (lj = 0; lj < nlen; lj++) {
@@ -2635,11 +2718,18 @@ p4est_lnodes_new (p4est_t * p4est, p4est_ghost_t * ghost_layer, int degree)
 
   P4EST_ASSERT (p4est_lnodes_test_comm (p4est, &data));
 
+  P4EST_REGION_BEGIN ("lnodes.send");
   p4est_lnodes_count_send (&data, p4est, lnodes);
+  P4EST_REGION_END ("lnodes.send");
 
+  P4EST_REGION_BEGIN ("lnodes.recv");
   p4est_lnodes_recv (p4est, &data, lnodes);
+  P4EST_REGION_END ("lnodes.recv");
 
-  gtotal = p4est_lnodes_global_and_sharers (&data, lnodes, p4est);
+  P4EST_REGION_BEGIN ("lnodes.global");
+  gtotal = p4est_lnodes_global_and_sharers (&data, lnodes, p4est,
+                                            global_counts);
+  P4EST_REGION_END ("lnodes.global");
 
   p4est_lnodes_reset_data (&data, p4est);
 
@@ -2654,6 +2744,19 @@ p4est_lnodes_new (p4est_t * p4est, p4est_ghost_t * ghost_layer, int degree)
   }
 #endif
 
+  if (p4est->inspect != NULL) {
+    /* the node arrays dominate the memory of the lnodes */
+    p4est_inspect_memory (p4est->inspect, P4EST_INSPECT_LNODES,
+                          sizeof (p4est_lnodes_t) +
+                          nlen * sizeof (p4est_locidx_t) +
+                          (lnodes->num_local_nodes - lnodes->owned_count) *
+                          sizeof (p4est_gloidx_t) +
+                          (global_counts ? p4est->mpisize : 0) *
+                          sizeof (p4est_locidx_t) +
+                          nel * sizeof (p4est_lnodes_code_t));
+  }
+  p4est_inspect_stop (p4est->inspect, P4EST_INSPECT_LNODES, inspect_start);
+
   p4est_log_indent_pop ();
   P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING "_lnodes_new with"
                             " %lld global nodes\n",
@@ -2661,6 +2764,23 @@ p4est_lnodes_new (p4est_t * p4est, p4est_ghost_t * ghost_layer, int degree)
   return lnodes;
 }
 
+p4est_locidx_t     *
+p4est_lnodes_global_owned_count (p4est_lnodes_t * lnodes)
+{
+  int                 mpiret, mpisize;
+
+  if (lnodes->global_owned_count == NULL) {
+    mpiret = sc_MPI_Comm_size (lnodes->mpicomm, &mpisize);
+    SC_CHECK_MPI (mpiret);
+    lnodes->global_owned_count = P4EST_ALLOC (p4est_locidx_t, mpisize);
+    mpiret = sc_MPI_Allgather (&lnodes->owned_count, 1, P4EST_MPI_LOCIDX,
+                               lnodes->global_owned_count, 1,
+                               P4EST_MPI_LOCIDX, lnodes->mpicomm);
+    SC_CHECK_MPI (mpiret);
+  }
+  return lnodes->global_owned_count;
+}
+
 void
 p4est_lnodes_destroy (p4est_lnodes_t * lnodes)
 {
@@ -2682,6 +2802,124 @@ p4est_lnodes_destroy (p4est_lnodes_t * lnodes)
   P4EST_FREE (lnodes);
 }
 
+void
+p4est_lnodes_reorder (p4est_lnodes_t * lnodes, p4est_locidx_t * perm)
+{
+  int                 mpiret;
+  int                 p, npeers, mpirank;
+  size_t              zz, count;
+  p4est_locidx_t      il, lnum, next;
+  p4est_locidx_t      num_local_nodes = lnodes->num_local_nodes;
+  p4est_locidx_t      owned_count = lnodes->owned_count;
+  p4est_locidx_t      enodes =
+    lnodes->num_local_elements * (p4est_locidx_t) lnodes->vnodes;
+  p4est_locidx_t     *newnum;
+  p4est_gloidx_t     *gp;
+  sc_array_t         *gnodes, *sortnodes;
+  p4est_lnodes_rank_t *lrank;
+
+  mpiret = sc_MPI_Comm_rank (lnodes->mpicomm, &mpirank);
+  SC_CHECK_MPI (mpiret);
+
+  newnum = P4EST_ALLOC (p4est_locidx_t, num_local_nodes);
+  for (il = 0; il < num_local_nodes; ++il) {
+    newnum[il] = -1;
+  }
+
+  /* number the owned nodes in the order they are first touched by the
+   * elements, so element_nodes accesses memory mostly in increasing order */
+  next = 0;
+  for (il = 0; il < enodes; ++il) {
+    lnum = lnodes->element_nodes[il];
+    if (lnum < owned_count && newnum[lnum] < 0) {
+      newnum[lnum] = next++;
+    }
+  }
+  for (il = 0; il < owned_count; ++il) {
+    if (newnum[il] < 0) {
+      newnum[il] = next++;
+    }
+  }
+  P4EST_ASSERT (next == owned_count);
+
+  /* learn the new global numbers of the nodes owned by other processes */
+  gnodes = sc_array_new_count (sizeof (p4est_gloidx_t),
+                               (size_t) num_local_nodes);
+  for (il = 0; il < num_local_nodes; ++il) {
+    *(p4est_gloidx_t *) sc_array_index (gnodes, (size_t) il) =
+      il < owned_count ? lnodes->global_offset + newnum[il] : -1;
+  }
+  p4est_lnodes_share_owned (gnodes, lnodes);
+
+  /* the nodes of each other owner remain contiguous and sorted by global
+   * number, which is what the sharing functions rely on */
+  npeers = (int) lnodes->sharers->elem_count;
+  sortnodes = sc_array_new (2 * sizeof (p4est_gloidx_t));
+  for (p = 0; p < npeers; ++p) {
+    lrank = p4est_lnodes_rank_array_index_int (lnodes->sharers, p);
+    if (lrank->rank == mpirank || lrank->owned_count == 0) {
+      continue;
+    }
+    sc_array_resize (sortnodes, (size_t) lrank->owned_count);
+    for (il = 0; il < lrank->owned_count; ++il) {
+      gp = (p4est_gloidx_t *) sc_array_index (sortnodes, (size_t) il);
+      lnum = lrank->owned_offset + il;
+      gp[0] = *(p4est_gloidx_t *) sc_array_index (gnodes, (size_t) lnum);
+      gp[1] = lnum;
+    }
+    sc_array_sort (sortnodes, p4est_gloidx_compare);
+    for (il = 0; il < lrank->owned_count; ++il) {
+      gp = (p4est_gloidx_t *) sc_array_index (sortnodes, (size_t) il);
+      lnum = lrank->owned_offset + il;
+      newnum[(p4est_locidx_t) gp[1]] = lnum;
+      lnodes->nonlocal_nodes[lnum - owned_count] = gp[0];
+    }
+  }
+#ifdef P4EST_ENABLE_DEBUG
+  for (il = 0; il < num_local_nodes; ++il) {
+    P4EST_ASSERT (0 <= newnum[il] && newnum[il] < num_local_nodes);
+  }
+#endif
+
+  /* apply the permutation to the elements and the sharers */
+  for (il = 0; il < enodes; ++il) {
+    lnodes->element_nodes[il] = newnum[lnodes->element_nodes[il]];
+  }
+  for (p = 0; p < npeers; ++p) {
+    lrank = p4est_lnodes_rank_array_index_int (lnodes->sharers, p);
+    count = lrank->shared_nodes.elem_count;
+    sc_array_resize (sortnodes, count);
+    for (zz = 0; zz < count; ++zz) {
+      gp = (p4est_gloidx_t *) sc_array_index (sortnodes, zz);
+      lnum = newnum[*(p4est_locidx_t *) sc_array_index
+                    (&lrank->shared_nodes, zz)];
+      gp[0] = p4est_lnodes_global_index (lnodes, lnum);
+      gp[1] = lnum;
+    }
+    sc_array_sort (sortnodes, p4est_gloidx_compare);
+    lrank->shared_mine_offset = -1;
+    lrank->shared_mine_count = 0;
+    for (zz = 0; zz < count; ++zz) {
+      gp = (p4est_gloidx_t *) sc_array_index (sortnodes, zz);
+      lnum = (p4est_locidx_t) gp[1];
+      *(p4est_locidx_t *) sc_array_index (&lrank->shared_nodes, zz) = lnum;
+      if (lnum < owned_count) {
+        if (lrank->shared_mine_count == 0) {
+          lrank->shared_mine_offset = (p4est_locidx_t) zz;
+        }
+        lrank->shared_mine_count++;
+      }
+    }
+  }
+  sc_array_destroy (sortnodes);
+  sc_array_destroy (gnodes);
+
+  if (perm != NULL) {
+    memcpy (perm, newnum, num_local_nodes * sizeof (p4est_locidx_t));
+  }
+  P4EST_FREE (newnum);
+}
+
 #ifdef P4EST_ENABLE_MPI
 
 static              size_t
@@ -2713,12 +2951,17 @@ p4est_ghost_support_lnodes (p4est_t * p4est, p4est_lnodes_t * lnodes,
   int                 mpisize = p4est->mpisize;
   int                 self = p4est->mpirank;
   int                 mpiret;
-  int                 n_comm;
-  p4est_locidx_t      old_num_mirrors, *newmpcount;
-  sc_array_t         *recv_counts, *send_counts;
-  sc_array_t         *recv_all, *send_all;
-  sc_array_t         *recv_requests;
+  int                 n_comm, i, p, vid, V;
+  p4est_locidx_t      N, K, nid, elid, il, jl;
+  p4est_locidx_t      old_num_mirrors, num_new_mirrors;
+  p4est_locidx_t     *elem_mirror, *elem_mark;
+  p4est_locidx_t     *ntq_offset, *node_to_elem;
+  p4est_locidx_t     *newmpoffset, *new_mirror_proc_mirrors;
+  p4est_locidx_t     *new_proc_offsets;
+  p4est_topidx_t      t;
+  sc_array_t         *send_elems, *send_all, *recv_all;
   sc_array_t         *send_requests;
+  p4est_lnodes_rank_t *lrank;
   p4est_connectivity_t *conn = p4est->connectivity;
 
   P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_ghost_support_lnodes %s\n",
@@ -2728,516 +2971,395 @@ p4est_ghost_support_lnodes (p4est_t * p4est, p4est_lnodes_t * lnodes,
   /* this should only be done with an unexpanded ghost layer */
   P4EST_ASSERT (ghost->mirror_proc_fronts == ghost->mirror_proc_mirrors &&
                 ghost->mirror_proc_front_offsets ==
-                ghost->mirror_proc_front_offsets);
+                ghost->mirror_proc_offsets);
 
-  /* get the topological nodes */
+  N = lnodes->num_local_nodes;
+  K = lnodes->num_local_elements;
+  V = lnodes->vnodes;
   n_comm = lnodes->sharers ? (int) lnodes->sharers->elem_count : 0;
-  recv_counts = sc_array_new_size (sizeof (p4est_locidx_t), n_comm);
-  send_counts = sc_array_new_size (sizeof (p4est_locidx_t), n_comm);
-  recv_all = sc_array_new_size (sizeof (sc_array_t), n_comm);
-  send_all = sc_array_new_size (sizeof (sc_array_t), n_comm);
-  recv_requests = sc_array_new (sizeof (sc_MPI_Request));
-  send_requests = sc_array_new (sizeof (sc_MPI_Request));
-
-  new_mirrors =
-    sc_array_new_size (sizeof (p4est_quadrant_t), mirrors->elem_count);
   old_num_mirrors = (p4est_locidx_t) mirrors->elem_count;
-  sc_array_copy (new_mirrors, mirrors);
-
-  /* figure out which quads to send and send them */
-  {
-    int                *quads_per_node;
-    int                *tmp_count;
-    p4est_quadrant_t   *node_to_quad;
-    p4est_locidx_t     *qpn_offsets;
-    int                 V, vid;
-    p4est_locidx_t      nid, elid, N, K;
-    p4est_lnodes_rank_t *lrank;
-    int                 i, p;
-    p4est_topidx_t      flt, llt, t;
-
-    N = lnodes->num_local_nodes;
-    K = lnodes->num_local_elements;
-    V = lnodes->vnodes;
-    /* count the quadrants per node */
-    quads_per_node = P4EST_ALLOC_ZERO (int, N);
-    for (elid = 0; elid < K; elid++) {
-      for (vid = 0; vid < V; vid++) {
-        nid = lnodes->element_nodes[V * elid + vid];
-        quads_per_node[nid]++;
-      }
-    }
-
-    /* convert counts to offsets */
-    qpn_offsets = P4EST_ALLOC (int, N + 1);
-    qpn_offsets[0] = 0;
-    for (nid = 0; nid < N; nid++) {
-      qpn_offsets[nid + 1] = qpn_offsets[nid] + quads_per_node[nid];
-    }
-
-    /* create and fill the node to quadrant array */
-    node_to_quad = P4EST_ALLOC (p4est_quadrant_t, qpn_offsets[N]);
-    tmp_count = P4EST_ALLOC_ZERO (int, N);
-
-    flt = p4est->first_local_tree;
-    llt = p4est->last_local_tree;
 
-    for (elid = 0, t = flt; t <= llt; t++) {
-      p4est_tree_t       *tree = p4est_tree_array_index (p4est->trees, t);
-      sc_array_t         *quadrants = &tree->quadrants;
-      p4est_locidx_t      il, nquads = (p4est_locidx_t) quadrants->elem_count;
-
-      for (il = 0; il < nquads; il++, elid++) {
-        for (vid = 0; vid < V; vid++) {
-          p4est_quadrant_t   *q;
+  /* mirrors are sorted like the local elements: map element to mirror */
+  elem_mirror = P4EST_ALLOC (p4est_locidx_t, K);
+  elem_mark = P4EST_ALLOC (p4est_locidx_t, K);
+  for (elid = 0; elid < K; ++elid) {
+    elem_mirror[elid] = elem_mark[elid] = -1;
+  }
+  for (il = 0; il < old_num_mirrors; ++il) {
+    elid = p4est_quadrant_array_index (mirrors, (size_t) il)->
+      p.piggy3.local_num;
+    elem_mirror[elid] = il;
+  }
 
-          nid = lnodes->element_nodes[V * elid + vid];
-          q = &(node_to_quad[qpn_offsets[nid] + tmp_count[nid]++]);
-          *q = *p4est_quadrant_array_index (quadrants, (size_t) il);
-          q->p.piggy3.which_tree = t;
-          q->p.piggy3.local_num = elid;
-        }
-      }
+  /* the elements adjacent to each node in ascending order */
+  ntq_offset = P4EST_ALLOC_ZERO (p4est_locidx_t, N + 1);
+  for (il = 0; il < K * V; ++il) {
+    ++ntq_offset[lnodes->element_nodes[il] + 1];
+  }
+  for (nid = 0; nid < N; ++nid) {
+    ntq_offset[nid + 1] += ntq_offset[nid];
+  }
+  node_to_elem = P4EST_ALLOC (p4est_locidx_t, ntq_offset[N]);
+  for (elid = 0; elid < K; ++elid) {
+    for (vid = 0; vid < V; ++vid) {
+      nid = lnodes->element_nodes[V * elid + vid];
+      node_to_elem[ntq_offset[nid]++] = elid;
     }
+  }
+  for (nid = N; nid > 0; --nid) {
+    ntq_offset[nid] = ntq_offset[nid - 1];
+  }
+  ntq_offset[0] = 0;
 
-    newmpcount = P4EST_ALLOC (p4est_locidx_t, p4est->mpisize);
-    for (i = 0; i < p4est->mpisize; i++) {
-      newmpcount[i] = mirror_proc_offsets[i + 1] - mirror_proc_offsets[i];
+  /* figure out which elements to send and send them in one message */
+  send_elems = sc_array_new_size (sizeof (sc_array_t), (size_t) n_comm);
+  send_all = sc_array_new_size (sizeof (sc_array_t), (size_t) n_comm);
+  recv_all = sc_array_new_size (sizeof (sc_array_t), (size_t) n_comm);
+  send_requests = sc_array_new (sizeof (sc_MPI_Request));
+  num_new_mirrors = 0;
+  for (i = 0; i < n_comm; i++) {
+    sc_array_t         *shared, *elems, *send_quads;
+    sc_MPI_Request     *req;
+    p4est_locidx_t     *pe, *pm, mend, nelems;
+    p4est_tree_t       *tree;
+    p4est_quadrant_t   *q;
+
+    lrank = p4est_lnodes_rank_array_index_int (lnodes->sharers, i);
+    elems = (sc_array_t *) sc_array_index_int (send_elems, i);
+    send_quads = (sc_array_t *) sc_array_index_int (send_all, i);
+    sc_array_init (elems, sizeof (p4est_locidx_t));
+    sc_array_init (send_quads, sizeof (p4est_quadrant_t));
+    sc_array_init ((sc_array_t *) sc_array_index_int (recv_all, i),
+                   sizeof (p4est_quadrant_t));
+    p = lrank->rank;
+    if (p == self) {
+      continue;
     }
 
-    /* for each communication partner */
-    for (i = 0; i < n_comm; i++) {
-      p4est_locidx_t     *count_recv, *count_send;
-      sc_MPI_Request     *req;
-      p4est_locidx_t      nshared, il, jl, nquads;
-      sc_array_t         *shared, *send_quads;
-      sc_array_t          mirror_view;
-      p4est_locidx_t      startmirror, endmirror;
-
-      lrank = p4est_lnodes_rank_array_index_int (lnodes->sharers, i);
-
-      p = lrank->rank;
-      if (p == self) {
-        continue;
-      }
-      /* post the count receive */
-      count_recv = (p4est_locidx_t *) sc_array_index_int (recv_counts, i);
-      req = (sc_MPI_Request *) sc_array_push (recv_requests);
-      mpiret = sc_MPI_Irecv (count_recv, 1, P4EST_MPI_LOCIDX, p,
-                             P4EST_COMM_GHOST_SUPPORT_COUNT, p4est->mpicomm,
-                             req);
-      SC_CHECK_MPI (mpiret);
-
-      /* create the send buffer */
-      shared = &(lrank->shared_nodes);
-      nshared = (p4est_locidx_t) shared->elem_count;
-      send_quads = (sc_array_t *) sc_array_index_int (send_all, i);
-      sc_array_init (send_quads, sizeof (p4est_quadrant_t));
-      for (il = 0; il < nshared; il++) {
-        p4est_locidx_t      startquad, endquad, qid;
-
-        nid = *((p4est_locidx_t *) sc_array_index (shared, il));
-        startquad = qpn_offsets[nid];
-        endquad = qpn_offsets[nid + 1];
-        for (qid = startquad; qid < endquad; qid++) {
-          (void) p4est_quadrant_array_push_copy
-            (send_quads, node_to_quad + qid);
+    /* collect each element adjacent to a shared node once */
+    shared = &lrank->shared_nodes;
+    for (il = 0; il < (p4est_locidx_t) shared->elem_count; il++) {
+      nid = *(p4est_locidx_t *) sc_array_index (shared, (size_t) il);
+      for (jl = ntq_offset[nid]; jl < ntq_offset[nid + 1]; jl++) {
+        elid = node_to_elem[jl];
+        if (elem_mark[elid] != i) {
+          elem_mark[elid] = i;
+          *(p4est_locidx_t *) sc_array_push (elems) = elid;
         }
       }
-      sc_array_sort (send_quads, p4est_quadrant_compare_piggy);
-      sc_array_uniq (send_quads, p4est_quadrant_compare_piggy);
-
-      nquads = (p4est_locidx_t) send_quads->elem_count;
-
-      startmirror = mirror_proc_offsets[p];
-      endmirror = mirror_proc_offsets[p + 1];
-      sc_array_init_data (&mirror_view,
-                          &(mirror_proc_mirrors[startmirror]),
-                          sizeof (p4est_locidx_t),
-                          (size_t) (endmirror - startmirror));
-
-      for (il = 0, jl = 0; (size_t) il < send_quads->elem_count; il++) {
-        p4est_quadrant_t   *q;
-        ssize_t             idx;
-        int                 already_sent = 0;
-
-        q = p4est_quadrant_array_index (send_quads, (size_t) il);
-        idx = sc_array_bsearch (mirrors, q, p4est_quadrant_compare_piggy);
-        if (idx >= 0) {
-          p4est_locidx_t      key = (p4est_locidx_t) idx;
-          idx = sc_array_bsearch (&mirror_view, &key, p4est_locidx_compare);
-          if (idx >= 0) {
-            already_sent = 1;
-          }
-        }
-        else {
-          (void) p4est_quadrant_array_push_copy (new_mirrors, q);
-        }
-        if (already_sent) {
-          nquads--;
+    }
+    sc_array_sort (elems, p4est_locidx_compare);
+
+    /* merge with the sorted mirrors already sent to p */
+    pe = (p4est_locidx_t *) elems->array;
+    pm = mirror_proc_mirrors + mirror_proc_offsets[p];
+    mend = mirror_proc_offsets[p + 1] - mirror_proc_offsets[p];
+    for (il = 0, jl = 0, nelems = 0;
+         il < (p4est_locidx_t) elems->elem_count; il++) {
+      elid = pe[il];
+      if (elem_mirror[elid] >= 0) {
+        while (jl < mend && pm[jl] < elem_mirror[elid]) {
+          jl++;
         }
-        else {
-          size_t              jz;
-
-          jz = (size_t) jl++;
-          if (jz != (size_t) il) {
-            p4est_quadrant_t   *q2;
-
-            q2 = p4est_quadrant_array_index (send_quads, jz);
-            *q2 = *q;
-          }
+        if (jl < mend && pm[jl] == elem_mirror[elid]) {
+          continue;
         }
       }
-      sc_array_resize (send_quads, nquads);
-      newmpcount[p] += nquads;
-
-      P4EST_LDEBUGF ("ghost layer support nodes sending %lld new to %d\n",
-                     (long long) nquads, p);
-
-      count_send = (p4est_locidx_t *) sc_array_index_int (send_counts, i);
-      *count_send = nquads;
-      req = (sc_MPI_Request *) sc_array_push (send_requests);
-      mpiret = sc_MPI_Isend (count_send, 1, P4EST_MPI_LOCIDX, p,
-                             P4EST_COMM_GHOST_SUPPORT_COUNT, p4est->mpicomm,
-                             req);
-      SC_CHECK_MPI (mpiret);
-
-      if (nquads) {
-        req = (sc_MPI_Request *) sc_array_push (send_requests);
-        mpiret = sc_MPI_Isend (send_quads->array, nquads * sizeof
-                               (p4est_quadrant_t), sc_MPI_BYTE, p,
-                               P4EST_COMM_GHOST_SUPPORT_LOAD, p4est->mpicomm,
-                               req);
-        SC_CHECK_MPI (mpiret);
+      else if (elem_mirror[elid] == -1) {
+        /* mark as new mirror */
+        elem_mirror[elid] = -2;
+        ++num_new_mirrors;
       }
+      pe[nelems++] = elid;
+    }
+    sc_array_resize (elems, (size_t) nelems);
+
+    /* copy the quadrants by walking the trees in order */
+    sc_array_resize (send_quads, (size_t) nelems);
+    t = p4est->first_local_tree;
+    tree = NULL;
+    for (il = 0; il < nelems; il++) {
+      elid = pe[il];
+      if (tree == NULL) {
+        tree = p4est_tree_array_index (p4est->trees, t);
+      }
+      while (elid >= tree->quadrants_offset +
+             (p4est_locidx_t) tree->quadrants.elem_count) {
+        tree = p4est_tree_array_index (p4est->trees, ++t);
+      }
+      q = p4est_quadrant_array_index (send_quads, (size_t) il);
+      *q = *p4est_quadrant_array_index (&tree->quadrants,
+                                        (size_t) (elid -
+                                                  tree->quadrants_offset));
+      q->p.piggy3.which_tree = t;
+      q->p.piggy3.local_num = elid;
     }
 
-    P4EST_FREE (quads_per_node);
-    P4EST_FREE (tmp_count);
-    P4EST_FREE (node_to_quad);
-    P4EST_FREE (qpn_offsets);
-  }
-
-  /* update mirror structures */
-  {
-    p4est_locidx_t      new_num_mirrors;
-    p4est_locidx_t     *newmpoffset, *new_mirror_proc_mirrors;
-    int                 i, p;
-    p4est_lnodes_rank_t *lrank;
+    P4EST_LDEBUGF ("ghost layer support nodes sending %lld new to %d\n",
+                   (long long) nelems, p);
 
-    newmpoffset = P4EST_ALLOC (p4est_locidx_t, mpisize + 1);
-    newmpoffset[0] = 0;
-    for (i = 0; i < mpisize; i++) {
-      newmpoffset[i + 1] = newmpoffset[i] + newmpcount[i];
+    req = (sc_MPI_Request *) sc_array_push (send_requests);
+    mpiret = sc_MPI_Isend (send_quads->array,
+                           (int) (nelems * sizeof (p4est_quadrant_t)),
+                           sc_MPI_BYTE, p, P4EST_COMM_GHOST_SUPPORT_LOAD,
+                           p4est->mpicomm, req);
+    SC_CHECK_MPI (mpiret);
+  }
+  P4EST_FREE (elem_mark);
+  P4EST_FREE (ntq_offset);
+  P4EST_FREE (node_to_elem);
+
+  /* merge the new mirrors into the sorted mirrors */
+  new_mirrors = sc_array_new_size (sizeof (p4est_quadrant_t),
+                                   (size_t) (old_num_mirrors +
+                                             num_new_mirrors));
+  if (num_new_mirrors > 0) {
+    p4est_tree_t       *tree;
+    p4est_quadrant_t   *q;
+
+    t = p4est->first_local_tree;
+    tree = p4est_tree_array_index (p4est->trees, t);
+    for (elid = 0, il = 0; elid < K; ++elid) {
+      while (elid >= tree->quadrants_offset +
+             (p4est_locidx_t) tree->quadrants.elem_count) {
+        tree = p4est_tree_array_index (p4est->trees, ++t);
+      }
+      if (elem_mirror[elid] == -1) {
+        continue;
+      }
+      q = p4est_quadrant_array_index (new_mirrors, (size_t) il);
+      if (elem_mirror[elid] >= 0) {
+        *q = *p4est_quadrant_array_index (mirrors,
+                                          (size_t) elem_mirror[elid]);
+      }
+      else {
+        *q = *p4est_quadrant_array_index (&tree->quadrants,
+                                          (size_t) (elid -
+                                                    tree->quadrants_offset));
+        q->p.piggy3.which_tree = t;
+        q->p.piggy3.local_num = elid;
+      }
+      elem_mirror[elid] = il++;
     }
-    new_mirror_proc_mirrors =
-      P4EST_ALLOC (p4est_locidx_t, newmpoffset[mpisize]);
-
-    sc_array_sort (new_mirrors, p4est_quadrant_compare_piggy);
-    sc_array_uniq (new_mirrors, p4est_quadrant_compare_piggy);
-    new_num_mirrors = (p4est_locidx_t) new_mirrors->elem_count;
-    P4EST_ASSERT (new_num_mirrors >= old_num_mirrors);
+    P4EST_ASSERT (il == old_num_mirrors + num_new_mirrors);
 
-    if (new_num_mirrors > old_num_mirrors) {
+    /* update mirror_tree_offsets */
+    {
       sc_array_t          split;
-      p4est_topidx_t      t;
+      size_t             *ppz;
 
-      /* update mirror_tree_offsets */
       sc_array_init (&split, sizeof (size_t));
       sc_array_split (new_mirrors, &split,
                       (size_t) conn->num_trees, ghost_tree_type, NULL);
       P4EST_ASSERT (split.elem_count == (size_t) conn->num_trees + 1);
       for (t = 0; t <= conn->num_trees; ++t) {
-        size_t             *ppz;
-
         ppz = (size_t *) sc_array_index (&split, (size_t) t);
         mirror_tree_offsets[t] = (p4est_locidx_t) (*ppz);
       }
       sc_array_reset (&split);
     }
+  }
+  else {
+    sc_array_copy (new_mirrors, mirrors);
+  }
 
-    /* update mirror_proc_mirrors */
-    for (p = 0; p < mpisize; p++) {
-      p4est_locidx_t      old_offset = mirror_proc_offsets[p];
-      p4est_locidx_t      old_count = mirror_proc_offsets[p + 1] - old_offset;
-      p4est_locidx_t      il;
-
-      for (il = 0; il < old_count; il++) {
-        ssize_t             idx;
-        p4est_quadrant_t   *q;
-
-        q = p4est_quadrant_array_index (mirrors, (size_t)
-                                        mirror_proc_mirrors[old_offset + il]);
-
-        idx = sc_array_bsearch (new_mirrors, q, p4est_quadrant_compare_piggy);
-        P4EST_ASSERT (idx >= 0);
-        new_mirror_proc_mirrors[newmpoffset[p] + il] = (p4est_locidx_t) idx;
-      }
+  /* merge the old and new mirrors of each process, both being sorted */
+  newmpoffset = P4EST_ALLOC (p4est_locidx_t, mpisize + 1);
+  for (p = 0; p < mpisize; p++) {
+    newmpoffset[p + 1] = mirror_proc_offsets[p + 1] - mirror_proc_offsets[p];
+  }
+  for (i = 0; i < n_comm; i++) {
+    lrank = p4est_lnodes_rank_array_index_int (lnodes->sharers, i);
+    newmpoffset[lrank->rank + 1] += (p4est_locidx_t)
+      ((sc_array_t *) sc_array_index_int (send_elems, i))->elem_count;
+  }
+  newmpoffset[0] = 0;
+  for (p = 0; p < mpisize; p++) {
+    newmpoffset[p + 1] += newmpoffset[p];
+  }
+  new_mirror_proc_mirrors =
+    P4EST_ALLOC (p4est_locidx_t, newmpoffset[mpisize]);
+  for (p = 0; p < mpisize; p++) {
+    p4est_locidx_t     *pm = new_mirror_proc_mirrors + newmpoffset[p];
+
+    for (il = mirror_proc_offsets[p]; il < mirror_proc_offsets[p + 1]; il++) {
+      elid = p4est_quadrant_array_index
+        (mirrors, (size_t) mirror_proc_mirrors[il])->p.piggy3.local_num;
+      *pm++ = elem_mirror[elid];
     }
-
-    for (i = 0; i < n_comm; i++) {
-      sc_array_t         *send_quads;
-      int                 p;
-
-      lrank = p4est_lnodes_rank_array_index_int (lnodes->sharers, i);
-
-      p = lrank->rank;
-      if (p == self) {
-        continue;
+  }
+  for (i = 0; i < n_comm; i++) {
+    sc_array_t         *elems;
+    p4est_locidx_t     *pm, *pe, *merged;
+    p4est_locidx_t      oldcount, newcount, kl;
+
+    lrank = p4est_lnodes_rank_array_index_int (lnodes->sharers, i);
+    p = lrank->rank;
+    elems = (sc_array_t *) sc_array_index_int (send_elems, i);
+    newcount = (p4est_locidx_t) elems->elem_count;
+    if (p == self || newcount == 0) {
+      continue;
+    }
+    pm = new_mirror_proc_mirrors + newmpoffset[p];
+    pe = (p4est_locidx_t *) elems->array;
+    oldcount = mirror_proc_offsets[p + 1] - mirror_proc_offsets[p];
+
+    /* merge from the back so that no old entry is overwritten */
+    merged = pm + oldcount + newcount;
+    for (il = oldcount, jl = newcount; jl > 0;) {
+      kl = elem_mirror[pe[jl - 1]];
+      if (il > 0 && pm[il - 1] > kl) {
+        *--merged = pm[--il];
       }
-      send_quads = (sc_array_t *) sc_array_index_int (send_all, i);
-      if (send_quads->elem_count) {
-        p4est_locidx_t      il, startidx, endidx;
-        p4est_locidx_t      old_offset = mirror_proc_offsets[p];
-        p4est_locidx_t      old_count =
-          mirror_proc_offsets[p + 1] - old_offset;
-        sc_array_t          pview;
-
-        startidx = newmpoffset[p];
-        endidx = newmpoffset[p + 1];
-
-        for (il = 0; (size_t) il < send_quads->elem_count; il++) {
-          p4est_quadrant_t   *q;
-          ssize_t             idx;
-          p4est_locidx_t      idxl;
-
-          q = p4est_quadrant_array_index (send_quads, (size_t) il);
-          idx =
-            sc_array_bsearch (new_mirrors, q, p4est_quadrant_compare_piggy);
-          P4EST_ASSERT (idx >= 0);
-          idxl = (p4est_locidx_t) idx;
-          new_mirror_proc_mirrors[startidx + old_count + il] = idxl;
-        }
-
-        sc_array_init_data (&pview, &new_mirror_proc_mirrors[startidx],
-                            sizeof (p4est_locidx_t),
-                            (size_t) (endidx - startidx));
-        sc_array_sort (&pview, p4est_locidx_compare);
-        sc_array_reset (&pview);
+      else {
+        *--merged = kl;
+        --jl;
       }
     }
-    P4EST_FREE (mirror_proc_mirrors);
-    P4EST_FREE (mirror_proc_offsets);
-    ghost->mirror_proc_mirrors = mirror_proc_mirrors =
-      new_mirror_proc_mirrors;
-    ghost->mirror_proc_offsets = mirror_proc_offsets = newmpoffset;
-    ghost->mirror_proc_fronts = mirror_proc_mirrors;
-    ghost->mirror_proc_front_offsets = mirror_proc_offsets;
-
-    sc_array_resize (mirrors, new_mirrors->elem_count);
-    sc_array_copy (mirrors, new_mirrors);
-    sc_array_destroy (new_mirrors);
-    P4EST_FREE (newmpcount);
   }
-
-  /* update the ghost layer */
-  {
-    int                 i, p;
-    p4est_locidx_t     *new_proc_counts, *new_proc_offsets;
-    p4est_lnodes_rank_t *lrank;
-
-    mpiret =
-      sc_MPI_Waitall ((int) recv_requests->elem_count,
-                      (sc_MPI_Request *) recv_requests->array,
-                      sc_MPI_STATUSES_IGNORE);
-    SC_CHECK_MPI (mpiret);
-    sc_array_reset (recv_requests);
-    sc_array_init (recv_requests, sizeof (sc_MPI_Request));
-    new_proc_counts = P4EST_ALLOC (p4est_locidx_t, mpisize);
-    for (p = 0; p < mpisize; p++) {
-      new_proc_counts[p] = proc_offsets[p + 1] - proc_offsets[p];
+  P4EST_FREE (elem_mirror);
+  P4EST_FREE (mirror_proc_mirrors);
+  P4EST_FREE (mirror_proc_offsets);
+  ghost->mirror_proc_mirrors = new_mirror_proc_mirrors;
+  ghost->mirror_proc_offsets = newmpoffset;
+  ghost->mirror_proc_fronts = new_mirror_proc_mirrors;
+  ghost->mirror_proc_front_offsets = newmpoffset;
+  sc_array_resize (mirrors, new_mirrors->elem_count);
+  sc_array_copy (mirrors, new_mirrors);
+  sc_array_destroy (new_mirrors);
+
+  /* receive the new ghosts, each message sized by probing */
+  new_proc_offsets = P4EST_ALLOC (p4est_locidx_t, mpisize + 1);
+  for (p = 0; p < mpisize; p++) {
+    new_proc_offsets[p + 1] = proc_offsets[p + 1] - proc_offsets[p];
+  }
+  for (i = 0; i < n_comm; i++) {
+    sc_array_t         *recv_quads;
+    sc_MPI_Status       status;
+    int                 rcount;
+
+    lrank = p4est_lnodes_rank_array_index_int (lnodes->sharers, i);
+    p = lrank->rank;
+    if (p == self) {
+      continue;
     }
+    mpiret = sc_MPI_Probe (p, P4EST_COMM_GHOST_SUPPORT_LOAD, p4est->mpicomm,
+                           &status);
+    SC_CHECK_MPI (mpiret);
+    mpiret = sc_MPI_Get_count (&status, sc_MPI_BYTE, &rcount);
+    SC_CHECK_MPI (mpiret);
+    P4EST_ASSERT (rcount % ((int) sizeof (p4est_quadrant_t)) == 0);
+    recv_quads = (sc_array_t *) sc_array_index_int (recv_all, i);
+    sc_array_resize (recv_quads, rcount / sizeof (p4est_quadrant_t));
+    mpiret = sc_MPI_Recv (recv_quads->array, rcount, sc_MPI_BYTE, p,
+                          P4EST_COMM_GHOST_SUPPORT_LOAD, p4est->mpicomm,
+                          sc_MPI_STATUS_IGNORE);
+    SC_CHECK_MPI (mpiret);
 
-    for (i = 0; i < n_comm; i++) {
-      sc_array_t         *recv_quads;
-      p4est_locidx_t      recv_count;
-
-      lrank = p4est_lnodes_rank_array_index_int (lnodes->sharers, i);
-
-      p = lrank->rank;
-      if (p == self) {
-        continue;
-      }
-
-      recv_count = *((p4est_locidx_t *) sc_array_index_int (recv_counts, i));
-
-      P4EST_LDEBUGF
-        ("ghost layer support nodes receiving  %lld new from %d\n",
-         (long long) recv_count, p);
-
-      new_proc_counts[p] += recv_count;
-
-      recv_quads = (sc_array_t *) sc_array_index (recv_all, i);
-      sc_array_init_size (recv_quads, sizeof (p4est_quadrant_t),
-                          (size_t) recv_count);
-      if (recv_count) {
-        sc_MPI_Request     *req;
+    P4EST_LDEBUGF ("ghost layer support nodes receiving %lld new from %d\n",
+                   (long long) recv_quads->elem_count, p);
+    new_proc_offsets[p + 1] += (p4est_locidx_t) recv_quads->elem_count;
+  }
+  new_proc_offsets[0] = 0;
+  for (p = 0; p < mpisize; p++) {
+    new_proc_offsets[p + 1] += new_proc_offsets[p];
+  }
 
-        req = (sc_MPI_Request *) sc_array_push (recv_requests);
+  /* merge the received ghosts of each process with the old ones */
+  new_ghosts = sc_array_new_size (sizeof (p4est_quadrant_t),
+                                  (size_t) new_proc_offsets[mpisize]);
+  for (p = 0; p < mpisize; p++) {
+    p4est_locidx_t      count = proc_offsets[p + 1] - proc_offsets[p];
 
-        mpiret =
-          sc_MPI_Irecv (recv_quads->array,
-                        recv_count * sizeof (p4est_quadrant_t), sc_MPI_BYTE,
-                        p, P4EST_COMM_GHOST_SUPPORT_LOAD, p4est->mpicomm,
-                        req);
-        SC_CHECK_MPI (mpiret);
-      }
+    if (count > 0 && new_proc_offsets[p + 1] - new_proc_offsets[p] == count) {
+      memcpy (sc_array_index (new_ghosts, (size_t) new_proc_offsets[p]),
+              sc_array_index (ghosts, (size_t) proc_offsets[p]),
+              count * sizeof (p4est_quadrant_t));
     }
-
-    new_proc_offsets = P4EST_ALLOC (p4est_locidx_t, mpisize + 1);
-    new_proc_offsets[0] = 0;
-    for (p = 0; p < mpisize; p++) {
-      new_proc_offsets[p + 1] = new_proc_offsets[p] + new_proc_counts[p];
+  }
+  for (i = 0; i < n_comm; i++) {
+    sc_array_t         *recv_quads;
+    p4est_quadrant_t   *a, *b, *dest;
+    p4est_locidx_t      na, nb;
+
+    lrank = p4est_lnodes_rank_array_index_int (lnodes->sharers, i);
+    p = lrank->rank;
+    recv_quads = (sc_array_t *) sc_array_index_int (recv_all, i);
+    nb = (p4est_locidx_t) recv_quads->elem_count;
+    if (p == self || nb == 0) {
+      continue;
     }
-
-    new_ghosts = sc_array_new_size (sizeof (p4est_quadrant_t),
-                                    (size_t) new_proc_offsets[mpisize]);
-    for (p = 0; p < mpisize; p++) {
-      p4est_quadrant_t   *dest, *src;
-      p4est_locidx_t      count;
-
-      count = proc_offsets[p + 1] - proc_offsets[p];
-      if (count) {
-        dest = p4est_quadrant_array_index (new_ghosts, new_proc_offsets[p]);
-        src = p4est_quadrant_array_index (ghosts, proc_offsets[p]);
-        memcpy (dest, src, count * sizeof (p4est_quadrant_t));
+    na = proc_offsets[p + 1] - proc_offsets[p];
+    a = na > 0 ?
+      p4est_quadrant_array_index (ghosts, (size_t) proc_offsets[p]) : NULL;
+    b = p4est_quadrant_array_index (recv_quads, 0);
+    dest = p4est_quadrant_array_index (new_ghosts,
+                                       (size_t) new_proc_offsets[p]);
+    for (il = 0, jl = 0; il < na || jl < nb;) {
+      if (jl == nb ||
+          (il < na && p4est_quadrant_compare_piggy (a + il, b + jl) < 0)) {
+        *dest++ = a[il++];
+      }
+      else {
+        P4EST_ASSERT (il == na ||
+                      p4est_quadrant_compare_piggy (a + il, b + jl) > 0);
+        *dest++ = b[jl++];
       }
     }
+  }
+  P4EST_ASSERT (sc_array_is_sorted (new_ghosts,
+                                    p4est_quadrant_compare_piggy));
+
+  if (new_ghosts->elem_count > ghosts->elem_count) {
+    sc_array_t          split;
+    size_t             *ppz;
+
+    /* update tree_offsets */
+    sc_array_init (&split, sizeof (size_t));
+    sc_array_split (new_ghosts, &split,
+                    (size_t) conn->num_trees, ghost_tree_type, NULL);
+    P4EST_ASSERT (split.elem_count == (size_t) conn->num_trees + 1);
+    for (t = 0; t <= conn->num_trees; ++t) {
+      ppz = (size_t *) sc_array_index (&split, (size_t) t);
+      tree_offsets[t] = (p4est_locidx_t) (*ppz);
+    }
+    sc_array_reset (&split);
+    sc_array_resize (ghosts, new_ghosts->elem_count);
+    sc_array_copy (ghosts, new_ghosts);
+  }
+  P4EST_FREE (proc_offsets);
+  ghost->proc_offsets = new_proc_offsets;
+  sc_array_destroy (new_ghosts);
+
+  /* end sends and clean up */
+  mpiret = sc_MPI_Waitall ((int) send_requests->elem_count,
+                           (sc_MPI_Request *) send_requests->array,
+                           sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  for (i = 0; i < n_comm; i++) {
+    sc_array_reset ((sc_array_t *) sc_array_index_int (send_elems, i));
+    sc_array_reset ((sc_array_t *) sc_array_index_int (send_all, i));
+    sc_array_reset ((sc_array_t *) sc_array_index_int (recv_all, i));
+  }
+  sc_array_destroy (send_elems);
+  sc_array_destroy (send_all);
+  sc_array_destroy (recv_all);
+  sc_array_destroy (send_requests);
 
-    mpiret =
-      sc_MPI_Waitall ((int) recv_requests->elem_count,
-                      (sc_MPI_Request *) recv_requests->array,
-                      sc_MPI_STATUSES_IGNORE);
-    SC_CHECK_MPI (mpiret);
+  P4EST_ASSERT (p4est_ghost_is_valid (p4est, ghost));
 
-    for (i = 0; i < n_comm; i++) {
-      sc_array_t         *recv_quads;
+  /* the neighbor processes may have changed */
+  if (ghost->neighbor_comm != sc_MPI_COMM_NULL) {
+    p4est_ghost_set_neighborhood (p4est, ghost, 1);
+  }
+  if (ghost->index != NULL) {
+    p4est_ghost_set_index (ghost, 1);
+  }
 
-      lrank = p4est_lnodes_rank_array_index_int (lnodes->sharers, i);
-
-      p = lrank->rank;
-      if (p == self) {
-        continue;
-      }
-
-      recv_quads = (sc_array_t *) sc_array_index (recv_all, i);
-
-      if (recv_quads->elem_count) {
-        p4est_quadrant_t   *dest, *src;
-        p4est_locidx_t      startidx, endidx, oldcount;
-        sc_array_t          pview;
-
-        startidx = new_proc_offsets[p];
-        endidx = new_proc_offsets[p + 1];
-
-        oldcount = proc_offsets[p + 1] - proc_offsets[p];
-
-        dest = p4est_quadrant_array_index (new_ghosts, (size_t)
-                                           (new_proc_offsets[p] + oldcount));
-
-        src = p4est_quadrant_array_index (recv_quads, 0);
-
-        memcpy (dest, src,
-                recv_quads->elem_count * sizeof (p4est_quadrant_t));
-
-        sc_array_init_view (&pview, new_ghosts, startidx,
-                            (size_t) (endidx - startidx));
-        sc_array_sort (&pview, p4est_quadrant_compare_piggy);
-        sc_array_reset (&pview);
-      }
-    }
-
-    if (new_ghosts->elem_count > ghosts->elem_count) {
-      p4est_topidx_t      t;
-      sc_array_t          split;
-
-      /* update tree_offsets */
-      sc_array_init (&split, sizeof (size_t));
-      sc_array_split (new_ghosts, &split,
-                      (size_t) conn->num_trees, ghost_tree_type, NULL);
-      P4EST_ASSERT (split.elem_count == (size_t) conn->num_trees + 1);
-      for (t = 0; t <= conn->num_trees; ++t) {
-        size_t             *ppz;
-
-        ppz = (size_t *) sc_array_index (&split, (size_t) t);
-        tree_offsets[t] = *ppz;
-      }
-      sc_array_reset (&split);
-
-      P4EST_ASSERT (sc_array_is_sorted
-                    (new_ghosts, p4est_quadrant_compare_piggy));
-#ifdef P4EST_ENABLE_DEBUG
-      {
-        size_t              zz;
-
-        for (zz = 0; zz < ghosts->elem_count - 1; zz++) {
-          p4est_quadrant_t   *q1 = p4est_quadrant_array_index (ghosts, zz);
-          p4est_quadrant_t   *q2 =
-            p4est_quadrant_array_index (ghosts, zz + 1);
-
-          if (!p4est_quadrant_compare_piggy (q1, q2)) {
-            P4EST_LERROR ("already duplicate in ghost:\n");
-            p4est_quadrant_print (SC_LP_ERROR, q1);
-          }
-        }
-        for (zz = 0; zz < new_ghosts->elem_count - 1; zz++) {
-          p4est_quadrant_t   *q1 =
-            p4est_quadrant_array_index (new_ghosts, zz);
-          p4est_quadrant_t   *q2 =
-            p4est_quadrant_array_index (new_ghosts, zz + 1);
-
-          if (!p4est_quadrant_compare_piggy (q1, q2)) {
-            P4EST_LERROR ("duplicate in new ghost:\n");
-            p4est_quadrant_print (SC_LP_ERROR, q1);
-          }
-        }
-      }
-#endif
-      sc_array_resize (ghosts, new_ghosts->elem_count);
-      sc_array_copy (ghosts, new_ghosts);
-    }
-    P4EST_FREE (proc_offsets);
-    ghost->proc_offsets = new_proc_offsets;
-    sc_array_destroy (new_ghosts);
-    P4EST_FREE (new_proc_counts);
-
-    /* end sends */
-    mpiret =
-      sc_MPI_Waitall ((int) send_requests->elem_count,
-                      (sc_MPI_Request *) send_requests->array,
-                      sc_MPI_STATUSES_IGNORE);
-    SC_CHECK_MPI (mpiret);
-
-    /* clean up */
-    sc_array_destroy (recv_counts);
-    sc_array_destroy (send_counts);
-    for (i = 0; i < n_comm; i++) {
-      sc_array_t         *quads;
-
-      lrank = p4est_lnodes_rank_array_index_int (lnodes->sharers, i);
-
-      p = lrank->rank;
-      if (p == self) {
-        continue;
-      }
-
-      quads = (sc_array_t *) sc_array_index (recv_all, i);
-      sc_array_reset (quads);
-      quads = (sc_array_t *) sc_array_index (send_all, i);
-      sc_array_reset (quads);
-    }
-    sc_array_destroy (recv_all);
-    sc_array_destroy (send_all);
-    sc_array_destroy (recv_requests);
-    sc_array_destroy (send_requests);
-  }
-
-  P4EST_ASSERT (p4est_ghost_is_valid (p4est, ghost));
-
-  p4est_log_indent_pop ();
-  P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_ghost_support_lnodes\n");
-#endif
-}
+  p4est_log_indent_pop ();
+  P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_ghost_support_lnodes\n");
+#endif
+}
 
 typedef struct p4est_part_lnodes
 {
@@ -3336,23 +3458,6 @@ p4est_lnodes_count_face (p4est_iter_face_info_t * info, void *user_data)
   }
 }
 
-static void
-p4est_lnodes_count_volume (p4est_iter_volume_info_t * info, void *user_data)
-{
-  p4est_part_lnodes_t *part = (p4est_part_lnodes_t *) user_data;
-  p4est_locidx_t      quadid;
-  p4est_topidx_t      t;
-  p4est_tree_t       *tree;
-  p4est_locidx_t      offset;
-
-  t = info->treeid;
-  tree = p4est_tree_array_index (info->p4est->trees, t);
-  offset = tree->quadrants_offset;
-
-  quadid = info->quadid + offset;
-  part->weights[quadid] += part->nodes_per_volume;
-}
-
 static int
 p4est_lnodes_weight (p4est_t * p4est, p4est_topidx_t which_tree,
                      p4est_quadrant_t * quadrant)
@@ -3366,105 +3471,170 @@ p4est_lnodes_weight (p4est_t * p4est, p4est_topidx_t which_tree,
   return weight;
 }
 
-void
-p4est_partition_lnodes_detailed (p4est_t * p4est, p4est_ghost_t * ghost,
-                                 int nodes_per_volume, int nodes_per_face,
-#ifdef P4_TO_P8
-                                 int nodes_per_edge,
-#endif
-                                 int nodes_per_corner,
-                                 int partition_for_coarsening)
+/** Partition by the weights counted for each local element. */
+static void
+p4est_partition_lnodes_weights (p4est_t * p4est, p4est_part_lnodes_t * part,
+                                int partition_for_coarsening)
+{
+  void               *orig_user_pointer = p4est->user_pointer;
+
+  p4est->user_pointer = part;
+  part->count = 0;
+
+  p4est_partition_ext (p4est, partition_for_coarsening, p4est_lnodes_weight);
+
+  p4est->user_pointer = orig_user_pointer;
+}
+
+/** Count the nodes of each element by faces, edges and corners.
+ * The volume nodes are the same for every element and set directly.
+ * If the plan is current, it is replayed instead of iterating the forest.
+ */
+static void
+p4est_partition_lnodes_count (p4est_t * p4est, p4est_ghost_t * ghost,
+                              p4est_iter_plan_t * plan,
+                              p4est_part_lnodes_t * part)
 {
-  int                *weights;
   int                 ghost_given = (ghost != NULL);
+  p4est_locidx_t      il;
   p4est_iter_corner_t citer = NULL;
 #ifdef P4_TO_P8
   p8est_iter_edge_t   eiter = NULL;
 #endif
   p4est_iter_face_t   fiter = NULL;
-  p4est_iter_volume_t viter = NULL;
-  p4est_part_lnodes_t part;
-  void               *orig_user_pointer = p4est->user_pointer;
 
-  if (!ghost_given) {
-    ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+  for (il = 0; il < p4est->local_num_quadrants; ++il) {
+    part->weights[il] = part->nodes_per_volume;
   }
 
-  part.nodes_per_corner = nodes_per_corner;
-#ifdef P4_TO_P8
-  part.nodes_per_edge = nodes_per_edge;
-#endif
-  part.nodes_per_face = nodes_per_face;
-  part.nodes_per_volume = nodes_per_volume;
-
-  if (nodes_per_corner) {
+  if (part->nodes_per_corner) {
     citer = p4est_lnodes_count_corner;
   }
 #ifdef P4_TO_P8
-  if (nodes_per_edge) {
+  if (part->nodes_per_edge) {
     eiter = p8est_lnodes_count_edge;
   }
 #endif
-  if (nodes_per_face) {
+  if (part->nodes_per_face) {
     fiter = p4est_lnodes_count_face;
   }
-  if (nodes_per_volume) {
-    viter = p4est_lnodes_count_volume;
+  if (citer == NULL &&
+#ifdef P4_TO_P8
+      eiter == NULL &&
+#endif
+      fiter == NULL) {
+    return;
   }
 
-  weights = P4EST_ALLOC_ZERO (int, p4est->local_num_quadrants);
-
-  part.weights = weights;
+  if (plan != NULL && p4est_iter_plan_is_current (plan)) {
+    P4EST_ASSERT (plan->p4est == p4est);
+    p4est_iter_plan_replay (plan, part, NULL, fiter,
+#ifdef P4_TO_P8
+                            eiter,
+#endif
+                            citer);
+    return;
+  }
 
-  p4est_iterate (p4est, ghost, &part, viter, fiter,
+  if (!ghost_given) {
+    ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+  }
+  p4est_iterate (p4est, ghost, part, NULL, fiter,
 #ifdef P4_TO_P8
                  eiter,
 #endif
                  citer);
-
-  p4est->user_pointer = &part;
-  part.count = 0;
-
-  p4est_partition_ext (p4est, partition_for_coarsening, p4est_lnodes_weight);
-
-  p4est->user_pointer = orig_user_pointer;
-
-  P4EST_FREE (weights);
-
   if (!ghost_given) {
     p4est_ghost_destroy (ghost);
   }
 }
 
 void
-p4est_partition_lnodes (p4est_t * p4est, p4est_ghost_t * ghost, int degree,
-                        int partition_for_coarsening)
+p4est_partition_lnodes_detailed (p4est_t * p4est, p4est_ghost_t * ghost,
+                                 int nodes_per_volume, int nodes_per_face,
+#ifdef P4_TO_P8
+                                 int nodes_per_edge,
+#endif
+                                 int nodes_per_corner,
+                                 int partition_for_coarsening)
 {
-  int                 nodes_per_volume, nodes_per_face, nodes_per_corner;
+  p4est_part_lnodes_t part;
+
+  part.nodes_per_corner = nodes_per_corner;
 #ifdef P4_TO_P8
-  int                 nodes_per_edge;
+  part.nodes_per_edge = nodes_per_edge;
 #endif
+  part.nodes_per_face = nodes_per_face;
+  part.nodes_per_volume = nodes_per_volume;
+  part.weights = P4EST_ALLOC (int, p4est->local_num_quadrants);
+
+  p4est_partition_lnodes_count (p4est, ghost, NULL, &part);
+  p4est_partition_lnodes_weights (p4est, &part, partition_for_coarsening);
 
+  P4EST_FREE (part.weights);
+}
+
+/** Set the number of nodes per corner, edge, face and volume of a degree. */
+static void
+p4est_partition_lnodes_degree (p4est_part_lnodes_t * part, int degree)
+{
   P4EST_ASSERT (degree >= 1);
 
 #ifndef P4_TO_P8
-  nodes_per_corner = 1;
-  nodes_per_face = (degree - 1);
-  nodes_per_volume = (degree - 1) * (degree - 1);
+  part->nodes_per_corner = 1;
+  part->nodes_per_face = (degree - 1);
+  part->nodes_per_volume = (degree - 1) * (degree - 1);
 #else
-  nodes_per_corner = 1;
-  nodes_per_edge = (degree - 1);
-  nodes_per_face = (degree - 1) * (degree - 1);
-  nodes_per_volume = (degree - 1) * (degree - 1) * (degree - 1);
+  part->nodes_per_corner = 1;
+  part->nodes_per_edge = (degree - 1);
+  part->nodes_per_face = (degree - 1) * (degree - 1);
+  part->nodes_per_volume = (degree - 1) * (degree - 1) * (degree - 1);
 #endif
+}
 
-  p4est_partition_lnodes_detailed (p4est, ghost, nodes_per_volume,
-                                   nodes_per_face,
-#ifdef P4_TO_P8
-                                   nodes_per_edge,
-#endif
-                                   nodes_per_corner,
-                                   partition_for_coarsening);
+void
+p4est_partition_lnodes (p4est_t * p4est, p4est_ghost_t * ghost, int degree,
+                        int partition_for_coarsening)
+{
+  p4est_partition_lnodes_ext (p4est, ghost, NULL, NULL, degree,
+                              partition_for_coarsening);
+}
+
+void
+p4est_partition_lnodes_ext (p4est_t * p4est, p4est_ghost_t * ghost,
+                            p4est_lnodes_t * lnodes, p4est_iter_plan_t * plan,
+                            int degree, int partition_for_coarsening)
+{
+  p4est_part_lnodes_t part;
+
+  part.weights = P4EST_ALLOC (int, p4est->local_num_quadrants);
+  if (lnodes != NULL) {
+    int                 vid, V = lnodes->vnodes;
+    int8_t             *counted;
+    p4est_locidx_t      elid, nid, K = lnodes->num_local_elements;
+
+    /* each owned node is counted for the first element that uses it */
+    P4EST_ASSERT (K == p4est->local_num_quadrants);
+    counted = P4EST_ALLOC_ZERO (int8_t, lnodes->owned_count);
+    for (elid = 0; elid < K; ++elid) {
+      part.weights[elid] = 0;
+      for (vid = 0; vid < V; ++vid) {
+        nid = lnodes->element_nodes[V * elid + vid];
+        if (nid < lnodes->owned_count && !counted[nid]) {
+          counted[nid] = 1;
+          ++part.weights[elid];
+        }
+      }
+    }
+    P4EST_FREE (counted);
+  }
+  else {
+    p4est_partition_lnodes_degree (&part, degree);
+    p4est_partition_lnodes_count (p4est, ghost, plan, &part);
+  }
+  p4est_partition_lnodes_weights (p4est, &part, partition_for_coarsening);
+
+  P4EST_FREE (part.weights);
 }
 
 p4est_lnodes_buffer_t *
@@ -3715,3 +3885,671 @@ p4est_lnodes_buffer_destroy (p4est_lnodes_buffer_t * buffer)
   }
   P4EST_FREE (buffer);
 }
+
+p4est_lnodes_plan_t *
+p4est_lnodes_plan_new (p4est_lnodes_t * lnodes, size_t data_size)
+{
+  int                 mpiret;
+  int                 p, mpirank;
+  int                 npeers = (int) lnodes->sharers->elem_count;
+  size_t              num_mine, num_owned;
+  p4est_lnodes_rank_t *lrank;
+  p4est_lnodes_plan_t *plan;
+#ifdef P4EST_ENABLE_MPI
+  int                 phase;
+  char               *mine, *owned;
+  sc_MPI_Request     *requests;
+  int                *num_requests;
+  size_t              mine_bytes, owned_bytes;
+#endif
+
+  mpiret = sc_MPI_Comm_rank (lnodes->mpicomm, &mpirank);
+  SC_CHECK_MPI (mpiret);
+
+  /* the shared nodes owned by this process are sent to each sharer, and the
+   * nodes owned by a sharer are received from it */
+  num_mine = num_owned = 0;
+  for (p = 0; p < npeers; ++p) {
+    lrank = p4est_lnodes_rank_array_index_int (lnodes->sharers, p);
+    if (lrank->rank != mpirank) {
+      num_mine += (size_t) lrank->shared_mine_count;
+      num_owned += (size_t) lrank->owned_count;
+    }
+  }
+
+  plan = P4EST_ALLOC_ZERO (p4est_lnodes_plan_t, 1);
+  plan->lnodes = lnodes;
+  plan->data_size = data_size;
+  plan->mine_buffer = P4EST_ALLOC (char, data_size * num_mine);
+  plan->owned_buffer = P4EST_ALLOC (char, data_size * num_owned);
+  plan->owned_requests = P4EST_ALLOC (sc_MPI_Request, 2 * npeers);
+  plan->add_requests = P4EST_ALLOC (sc_MPI_Request, 2 * npeers);
+
+#ifdef P4EST_ENABLE_MPI
+  if (data_size == 0) {
+    return plan;
+  }
+
+  /* the sums travel the reverse way of the owned values */
+  for (phase = 0; phase < 2; ++phase) {
+    requests = phase == 0 ? plan->owned_requests : plan->add_requests;
+    num_requests = phase == 0 ? &plan->num_owned_requests :
+      &plan->num_add_requests;
+
+    /* receives */
+    mine = plan->mine_buffer;
+    owned = plan->owned_buffer;
+    for (p = 0; p < npeers; ++p) {
+      lrank = p4est_lnodes_rank_array_index_int (lnodes->sharers, p);
+      if (lrank->rank == mpirank) {
+        continue;
+      }
+      mine_bytes = data_size * (size_t) lrank->shared_mine_count;
+      owned_bytes = data_size * (size_t) lrank->owned_count;
+      if (phase == 0 && owned_bytes > 0) {
+        mpiret = MPI_Recv_init (owned, (int) owned_bytes, MPI_BYTE,
+                                lrank->rank, P4EST_COMM_LNODES_PLAN_OWNED,
+                                lnodes->mpicomm,
+                                requests + (*num_requests)++);
+        SC_CHECK_MPI (mpiret);
+      }
+      if (phase == 1 && mine_bytes > 0) {
+        mpiret = MPI_Recv_init (mine, (int) mine_bytes, MPI_BYTE,
+                                lrank->rank, P4EST_COMM_LNODES_PLAN_ADD,
+                                lnodes->mpicomm,
+                                requests + (*num_requests)++);
+        SC_CHECK_MPI (mpiret);
+      }
+      mine += mine_bytes;
+      owned += owned_bytes;
+    }
+
+    /* sends */
+    mine = plan->mine_buffer;
+    owned = plan->owned_buffer;
+    for (p = 0; p < npeers; ++p) {
+      lrank = p4est_lnodes_rank_array_index_int (lnodes->sharers, p);
+      if (lrank->rank == mpirank) {
+        continue;
+      }
+      mine_bytes = data_size * (size_t) lrank->shared_mine_count;
+      owned_bytes = data_size * (size_t) lrank->owned_count;
+      if (phase == 0 && mine_bytes > 0) {
+        mpiret = MPI_Send_init (mine, (int) mine_bytes, MPI_BYTE,
+                                lrank->rank, P4EST_COMM_LNODES_PLAN_OWNED,
+                                lnodes->mpicomm,
+                                requests + (*num_requests)++);
+        SC_CHECK_MPI (mpiret);
+      }
+      if (phase == 1 && owned_bytes > 0) {
+        mpiret = MPI_Send_init (owned, (int) owned_bytes, MPI_BYTE,
+                                lrank->rank, P4EST_COMM_LNODES_PLAN_ADD,
+                                lnodes->mpicomm,
+                                requests + (*num_requests)++);
+        SC_CHECK_MPI (mpiret);
+      }
+      mine += mine_bytes;
+      owned += owned_bytes;
+    }
+  }
+#endif
+
+  return plan;
+}
+
+void
+p4est_lnodes_plan_destroy (p4est_lnodes_plan_t * plan)
+{
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+  int                 i;
+
+  for (i = 0; i < plan->num_owned_requests; ++i) {
+    mpiret = MPI_Request_free (plan->owned_requests + i);
+    SC_CHECK_MPI (mpiret);
+  }
+  for (i = 0; i < plan->num_add_requests; ++i) {
+    mpiret = MPI_Request_free (plan->add_requests + i);
+    SC_CHECK_MPI (mpiret);
+  }
+#endif
+
+  P4EST_FREE (plan->owned_requests);
+  P4EST_FREE (plan->add_requests);
+  P4EST_FREE (plan->mine_buffer);
+  P4EST_FREE (plan->owned_buffer);
+  P4EST_FREE (plan);
+}
+
+/* run the persistent requests of one direction of a plan */
+static void
+p4est_lnodes_plan_run (int num_requests, sc_MPI_Request * requests)
+{
+  int                 mpiret;
+
+#ifdef P4EST_ENABLE_MPI
+  if (num_requests > 0) {
+    mpiret = MPI_Startall (num_requests, requests);
+    SC_CHECK_MPI (mpiret);
+  }
+#endif
+  mpiret = sc_MPI_Waitall (num_requests, requests, sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+}
+
+void
+p4est_lnodes_plan_share_owned (p4est_lnodes_plan_t * plan,
+                               sc_array_t * node_data)
+{
+  int                 mpiret;
+  int                 p, mpirank;
+  p4est_lnodes_t     *lnodes = plan->lnodes;
+  int                 npeers = (int) lnodes->sharers->elem_count;
+  const size_t        data_size = plan->data_size;
+  p4est_locidx_t      li, lz;
+  p4est_lnodes_rank_t *lrank;
+  char               *mem;
+
+  P4EST_ASSERT (node_data->elem_size == data_size);
+  P4EST_ASSERT (node_data->elem_count == (size_t) lnodes->num_local_nodes);
+
+  mpiret = sc_MPI_Comm_rank (lnodes->mpicomm, &mpirank);
+  SC_CHECK_MPI (mpiret);
+
+  /* pack the owned shared nodes in the order of the sharers */
+  mem = plan->mine_buffer;
+  for (p = 0; p < npeers; ++p) {
+    lrank = p4est_lnodes_rank_array_index_int (lnodes->sharers, p);
+    if (lrank->rank == mpirank) {
+      continue;
+    }
+    for (li = 0; li < lrank->shared_mine_count; ++li) {
+      lz = *(p4est_locidx_t *) sc_array_index
+        (&lrank->shared_nodes, (size_t) (lrank->shared_mine_offset + li));
+      memcpy (mem, node_data->array + data_size * lz, data_size);
+      mem += data_size;
+    }
+  }
+
+  p4est_lnodes_plan_run (plan->num_owned_requests, plan->owned_requests);
+
+  /* the nodes owned by each sharer are contiguous in node_data */
+  mem = plan->owned_buffer;
+  for (p = 0; p < npeers; ++p) {
+    lrank = p4est_lnodes_rank_array_index_int (lnodes->sharers, p);
+    if (lrank->rank == mpirank || lrank->owned_count == 0) {
+      continue;
+    }
+    memcpy (node_data->array + data_size * lrank->owned_offset, mem,
+            data_size * lrank->owned_count);
+    mem += data_size * lrank->owned_count;
+  }
+}
+
+void
+p4est_lnodes_plan_add_reduce (p4est_lnodes_plan_t * plan,
+                              sc_array_t * node_data)
+{
+  int                 mpiret;
+  int                 p, mpirank;
+  p4est_lnodes_t     *lnodes = plan->lnodes;
+  int                 npeers = (int) lnodes->sharers->elem_count;
+  const size_t        data_size = plan->data_size;
+  const size_t        ncomp = data_size / sizeof (double);
+  size_t              zc;
+  p4est_locidx_t      li, lz;
+  p4est_lnodes_rank_t *lrank;
+  char               *mem;
+  double             *sum, *add;
+
+  P4EST_ASSERT (data_size % sizeof (double) == 0);
+  P4EST_ASSERT (node_data->elem_size == data_size);
+  P4EST_ASSERT (node_data->elem_count == (size_t) lnodes->num_local_nodes);
+
+  mpiret = sc_MPI_Comm_rank (lnodes->mpicomm, &mpirank);
+  SC_CHECK_MPI (mpiret);
+
+  /* send the contributions to the nodes owned by each sharer */
+  mem = plan->owned_buffer;
+  for (p = 0; p < npeers; ++p) {
+    lrank = p4est_lnodes_rank_array_index_int (lnodes->sharers, p);
+    if (lrank->rank == mpirank || lrank->owned_count == 0) {
+      continue;
+    }
+    memcpy (mem, node_data->array + data_size * lrank->owned_offset,
+            data_size * lrank->owned_count);
+    mem += data_size * lrank->owned_count;
+  }
+
+  p4est_lnodes_plan_run (plan->num_add_requests, plan->add_requests);
+
+  /* add the contributions of all sharers to the owned nodes */
+  mem = plan->mine_buffer;
+  for (p = 0; p < npeers; ++p) {
+    lrank = p4est_lnodes_rank_array_index_int (lnodes->sharers, p);
+    if (lrank->rank == mpirank) {
+      continue;
+    }
+    for (li = 0; li < lrank->shared_mine_count; ++li) {
+      lz = *(p4est_locidx_t *) sc_array_index
+        (&lrank->shared_nodes, (size_t) (lrank->shared_mine_offset + li));
+      sum = (double *) (node_data->array + data_size * lz);
+      add = (double *) mem;
+      for (zc = 0; zc < ncomp; ++zc) {
+        sum[zc] += add[zc];
+      }
+      mem += data_size;
+    }
+  }
+
+  /* return the sums to the sharers */
+  p4est_lnodes_plan_share_owned (plan, node_data);
+}
+
+p4est_lnodes_export_t *
+p4est_lnodes_export_new (p4est_lnodes_t * lnodes, int node_major)
+{
+  int                 k;
+  const int           vnodes = lnodes->vnodes;
+  const p4est_locidx_t num_elements = lnodes->num_local_elements;
+  p4est_locidx_t      el, nh;
+  int                 hanging_face[P4EST_FACES];
+#ifdef P4_TO_P8
+  int                 hanging_edge[P8EST_EDGES];
+#endif
+  p4est_lnodes_export_t *ex;
+
+  ex = P4EST_ALLOC (p4est_lnodes_export_t, 1);
+  ex->num_elements = num_elements;
+  ex->vnodes = vnodes;
+  ex->node_major = node_major;
+  ex->element_nodes = P4EST_ALLOC (int32_t, vnodes * num_elements);
+  if (node_major) {
+    for (el = 0; el < num_elements; ++el) {
+      for (k = 0; k < vnodes; ++k) {
+        ex->element_nodes[k * num_elements + el] =
+          (int32_t) lnodes->element_nodes[el * vnodes + k];
+      }
+    }
+  }
+  else {
+    for (el = 0; el < num_elements * vnodes; ++el) {
+      ex->element_nodes[el] = (int32_t) lnodes->element_nodes[el];
+    }
+  }
+
+  /* the hanging elements are found in ascending order */
+  ex->num_hanging = 0;
+  for (el = 0; el < num_elements; ++el) {
+    if (lnodes->face_code[el]) {
+      ++ex->num_hanging;
+    }
+  }
+  ex->hanging_elements = P4EST_ALLOC (int32_t, ex->num_hanging);
+  ex->hanging_face = P4EST_ALLOC (int8_t, P4EST_FACES * ex->num_hanging);
+#ifdef P4_TO_P8
+  ex->hanging_edge = P4EST_ALLOC (int8_t, P8EST_EDGES * ex->num_hanging);
+#endif
+  for (el = 0, nh = 0; el < num_elements; ++el) {
+    if (!lnodes->face_code[el]) {
+      continue;
+    }
+    ex->hanging_elements[nh] = (int32_t) el;
+#ifndef P4_TO_P8
+    p4est_lnodes_decode (lnodes->face_code[el], hanging_face);
+#else
+    p8est_lnodes_decode (lnodes->face_code[el], hanging_face, hanging_edge);
+    for (k = 0; k < P8EST_EDGES; ++k) {
+      ex->hanging_edge[P8EST_EDGES * nh + k] = (int8_t) hanging_edge[k];
+    }
+#endif
+    for (k = 0; k < P4EST_FACES; ++k) {
+      ex->hanging_face[P4EST_FACES * nh + k] = (int8_t) hanging_face[k];
+    }
+    ++nh;
+  }
+  P4EST_ASSERT (nh == ex->num_hanging);
+
+  return ex;
+}
+
+void
+p4est_lnodes_export_destroy (p4est_lnodes_export_t * export_data)
+{
+  P4EST_FREE (export_data->element_nodes);
+  P4EST_FREE (export_data->hanging_elements);
+  P4EST_FREE (export_data->hanging_face);
+#ifdef P4_TO_P8
+  P4EST_FREE (export_data->hanging_edge);
+#endif
+  P4EST_FREE (export_data);
+}
+
+/** Compute the Gauss-Lobatto points of a given degree on [0, 1]. */
+static void
+lnodes_lobatto_points (int degree, double *points)
+{
+  const double        pi = 4.0 * atan (1.0);
+  int                 i, k, iter;
+  double              y, dy, p0, p1, p2;
+
+  for (i = 0; i <= degree; ++i) {
+    /* Newton iteration from the Chebyshev-Gauss-Lobatto points */
+    y = -cos (pi * i / degree);
+    for (iter = 0; iter < 100; ++iter) {
+      p1 = 1.;
+      p2 = y;
+      for (k = 2; k <= degree; ++k) {
+        p0 = ((2 * k - 1) * y * p2 - (k - 1) * p1) / k;
+        p1 = p2;
+        p2 = p0;
+      }
+      dy = (y * p2 - p1) / ((degree + 1) * p2);
+      y -= dy;
+      if (fabs (dy) < 1.e-15) {
+        break;
+      }
+    }
+    points[i] = .5 * (1. + y);
+  }
+  points[0] = 0.;
+  points[degree] = 1.;
+}
+
+p4est_lnodes_hanging_t *
+p4est_lnodes_hanging_new (int degree, const double *points)
+{
+  const int           np = degree + 1;
+  int                 h, k, j, m;
+  double              y, l;
+  double             *x;
+  p4est_lnodes_hanging_t *hanging;
+
+  P4EST_ASSERT (degree > 0);
+
+  x = P4EST_ALLOC (double, np);
+  if (points == NULL) {
+    lnodes_lobatto_points (degree, x);
+  }
+  else {
+    P4EST_ASSERT (points[0] == 0. && points[degree] == 1.);
+    memcpy (x, points, np * sizeof (double));
+  }
+
+  hanging = P4EST_ALLOC (p4est_lnodes_hanging_t, 1);
+  hanging->degree = degree;
+  hanging->vnodes = 1;
+  for (k = 0; k < P4EST_DIM; ++k) {
+    hanging->vnodes *= np;
+  }
+  hanging->interp = P4EST_ALLOC (double, 2 * np * np);
+
+  /* evaluate the coarse Lagrange polynomials at the nodes of each half */
+  for (h = 0; h < 2; ++h) {
+    for (k = 0; k < np; ++k) {
+      y = .5 * (x[k] + h);
+      for (j = 0; j < np; ++j) {
+        l = 1.;
+        for (m = 0; m < np; ++m) {
+          if (m != j) {
+            l *= (y - x[m]) / (x[j] - x[m]);
+          }
+        }
+        hanging->interp[(h * np + k) * np + j] = l;
+      }
+    }
+  }
+  hanging->points = x;
+
+  return hanging;
+}
+
+void
+p4est_lnodes_hanging_destroy (p4est_lnodes_hanging_t * hanging)
+{
+  P4EST_FREE (hanging->points);
+  P4EST_FREE (hanging->interp);
+  P4EST_FREE (hanging);
+}
+
+/** List the lines of nodes an element interpolates for a face_code.
+ * Each line is stored as its first node, its direction and the half of
+ * the coarse line it covers.  The lines are sorted by direction: sweeping
+ * the directions in order applies the tensor product interpolation on every
+ * hanging face, where each line shared by two faces is listed only once.
+ * \return          The number of lines.
+ */
+static int
+lnodes_hanging_lines (int degree, p4est_lnodes_code_t face_code, int *lines)
+{
+  const int           np = degree + 1;
+  const int           c = face_code & (P4EST_CHILDREN - 1);
+  const int           faces =
+    (face_code >> P4EST_DIM) & ((1 << P4EST_DIM) - 1);
+  int                 d, n, s;
+  int                 num_lines = 0;
+  int                 pos[P4EST_DIM];
+#ifdef P4_TO_P8
+  const int           edges = face_code >> (2 * P4EST_DIM);
+  int                 t, l;
+  int                 stride[P4EST_DIM];
+#endif
+
+  for (d = 0, s = 1; d < P4EST_DIM; ++d, s *= np) {
+#ifdef P4_TO_P8
+    stride[d] = s;
+#endif
+    pos[d] = ((c >> d) & 1) * degree * s;
+  }
+  for (d = 0; d < P4EST_DIM; ++d) {
+    for (n = 0; n < P4EST_DIM; ++n) {
+      if (n == d || !(faces & (1 << n))) {
+        continue;
+      }
+#ifndef P4_TO_P8
+      lines[3 * num_lines] = pos[n];
+      lines[3 * num_lines + 1] = d;
+      lines[3 * num_lines + 2] = (c >> d) & 1;
+      ++num_lines;
+#else
+      t = 3 - n - d;
+      for (l = 0; l < np; ++l) {
+        if (t < n && (faces & (1 << t)) && l == ((c >> t) & 1) * degree) {
+          /* this line is listed for the hanging face normal to t */
+          continue;
+        }
+        lines[3 * num_lines] = pos[n] + l * stride[t];
+        lines[3 * num_lines + 1] = d;
+        lines[3 * num_lines + 2] = (c >> d) & 1;
+        ++num_lines;
+      }
+#endif
+    }
+#ifdef P4_TO_P8
+    if ((edges & (1 << d)) && !(faces & (7 ^ (1 << d)))) {
+      /* the edge hangs but neither face touching it */
+      lines[3 * num_lines] = pos[0] + pos[1] + pos[2] - pos[d];
+      lines[3 * num_lines + 1] = d;
+      lines[3 * num_lines + 2] = (c >> d) & 1;
+      ++num_lines;
+    }
+#endif
+  }
+
+  return num_lines;
+}
+
+/** Apply the hanging node interpolation or its transpose to element data. */
+static void
+lnodes_hanging_apply (p4est_lnodes_hanging_t * hanging,
+                      p4est_lnodes_code_t face_code,
+                      p4est_locidx_t num_elements, double *values,
+                      int transpose)
+{
+  const int           degree = hanging->degree;
+  const int           np = degree + 1;
+  const int           vnodes = hanging->vnodes;
+  int                 i, k, j, num_lines, stride;
+  int                *lines;
+  p4est_locidx_t      el;
+  const double       *M;
+  double             *v, *tmp, sum;
+
+  if (!face_code || !num_elements) {
+    return;
+  }
+
+#ifndef P4_TO_P8
+  lines = P4EST_ALLOC (int, 3 * 4);
+#else
+  lines = P4EST_ALLOC (int, 3 * (6 * np + 3));
+#endif
+  tmp = P4EST_ALLOC (double, np);
+  num_lines = lnodes_hanging_lines (degree, face_code, lines);
+
+  /* the transpose applies the transposed lines in reverse order */
+  for (i = 0; i < num_lines; ++i) {
+    const int          *line = lines + 3 * (transpose ? num_lines - 1 - i : i);
+
+    stride = 1;
+    for (k = 0; k < line[1]; ++k) {
+      stride *= np;
+    }
+    M = hanging->interp + line[2] * np * np;
+
+    /* every element of the batch runs the same loops */
+    if (!transpose) {
+      for (el = 0; el < num_elements; ++el) {
+        v = values + (size_t) el * vnodes + line[0];
+        for (k = 0; k < np; ++k) {
+          sum = 0.;
+          for (j = 0; j < np; ++j) {
+            sum += M[k * np + j] * v[j * stride];
+          }
+          tmp[k] = sum;
+        }
+        for (k = 0; k < np; ++k) {
+          v[k * stride] = tmp[k];
+        }
+      }
+    }
+    else {
+      for (el = 0; el < num_elements; ++el) {
+        v = values + (size_t) el * vnodes + line[0];
+        for (k = 0; k < np; ++k) {
+          sum = 0.;
+          for (j = 0; j < np; ++j) {
+            sum += M[j * np + k] * v[j * stride];
+          }
+          tmp[k] = sum;
+        }
+        for (k = 0; k < np; ++k) {
+          v[k * stride] = tmp[k];
+        }
+      }
+    }
+  }
+
+  P4EST_FREE (tmp);
+  P4EST_FREE (lines);
+}
+
+void
+p4est_lnodes_hanging_interpolate (p4est_lnodes_hanging_t * hanging,
+                                  p4est_lnodes_code_t face_code,
+                                  p4est_locidx_t num_elements,
+                                  double *values)
+{
+  lnodes_hanging_apply (hanging, face_code, num_elements, values, 0);
+}
+
+void
+p4est_lnodes_hanging_restrict (p4est_lnodes_hanging_t * hanging,
+                               p4est_lnodes_code_t face_code,
+                               p4est_locidx_t num_elements, double *values)
+{
+  lnodes_hanging_apply (hanging, face_code, num_elements, values, 1);
+}
+
+void
+p4est_lnodes_hanging_gather (p4est_lnodes_hanging_t * hanging,
+                             p4est_lnodes_t * lnodes,
+                             p4est_locidx_t num_elements,
+                             const p4est_locidx_t * elements,
+                             const double *node_values, double *values)
+{
+  const int           vnodes = lnodes->vnodes;
+  int                 k;
+  p4est_locidx_t      el;
+  const p4est_locidx_t *nodes;
+
+  P4EST_ASSERT (hanging->degree == lnodes->degree);
+  if (!num_elements) {
+    return;
+  }
+
+  for (el = 0; el < num_elements; ++el) {
+    P4EST_ASSERT (lnodes->face_code[elements[el]] ==
+                  lnodes->face_code[elements[0]]);
+    nodes = lnodes->element_nodes + (size_t) elements[el] * vnodes;
+    for (k = 0; k < vnodes; ++k) {
+      values[(size_t) el * vnodes + k] = node_values[nodes[k]];
+    }
+  }
+  lnodes_hanging_apply (hanging, lnodes->face_code[elements[0]],
+                        num_elements, values, 0);
+}
+
+void
+p4est_lnodes_hanging_scatter (p4est_lnodes_hanging_t * hanging,
+                              p4est_lnodes_t * lnodes,
+                              p4est_locidx_t num_elements,
+                              const p4est_locidx_t * elements,
+                              double *values, double *node_values)
+{
+  const int           vnodes = lnodes->vnodes;
+  int                 k;
+  p4est_locidx_t      el;
+  const p4est_locidx_t *nodes;
+
+  P4EST_ASSERT (hanging->degree == lnodes->degree);
+  if (!num_elements) {
+    return;
+  }
+
+  lnodes_hanging_apply (hanging, lnodes->face_code[elements[0]],
+                        num_elements, values, 1);
+  for (el = 0; el < num_elements; ++el) {
+    P4EST_ASSERT (lnodes->face_code[elements[el]] ==
+                  lnodes->face_code[elements[0]]);
+    nodes = lnodes->element_nodes + (size_t) elements[el] * vnodes;
+    for (k = 0; k < vnodes; ++k) {
+      node_values[nodes[k]] += values[(size_t) el * vnodes + k];
+    }
+  }
+}
+
+void
+p4est_lnodes_code_groups (p4est_lnodes_t * lnodes, p4est_locidx_t * offsets,
+                          p4est_locidx_t * elements)
+{
+  int                 code;
+  p4est_locidx_t      el, sum, count;
+
+  /* count the elements of each code and sort them stably */
+  memset (offsets, 0, (P4EST_LNODES_CODES + 1) * sizeof (p4est_locidx_t));
+  for (el = 0; el < lnodes->num_local_elements; ++el) {
+    code = (int) lnodes->face_code[el];
+    P4EST_ASSERT (0 <= code && code < P4EST_LNODES_CODES);
+    ++offsets[code + 1];
+  }
+  for (code = 0, sum = 0; code <= P4EST_LNODES_CODES; ++code) {
+    count = offsets[code];
+    offsets[code] = sum;
+    sum += count;
+  }
+  for (el = 0; el < lnodes->num_local_elements; ++el) {
+    elements[offsets[(int) lnodes->face_code[el] + 1]++] = el;
+  }
+  P4EST_ASSERT (offsets[P4EST_LNODES_CODES] == lnodes->num_local_elements);
+}
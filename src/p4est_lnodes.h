@@ -26,11 +26,15 @@
 #define P4EST_LNODES_H
 
 #include <p4est_ghost.h>
+#include <p4est_iterate.h>
 
 SC_EXTERN_C_BEGIN;
 
 typedef int8_t      p4est_lnodes_code_t;
 
+/** Number of distinct values of p4est_lnodes_code_t for 2D elements. */
+#define P4EST_LNODES_CODES 16
+
 /** Store a parallel numbering of Lobatto points of a given degree > 0.
  *
  * Each element has degree+1 nodes per face
@@ -87,7 +91,9 @@ typedef int8_t      p4est_lnodes_code_t;
  * as well.  The upper corner is not incident on q, so q cannot own it.
  *
  * global_owned_count contains the number of independent nodes owned by each
- * process.
+ * process.  It is NULL if the nodes were numbered without it by
+ * \ref p4est_lnodes_new_ext and is then computed on demand by
+ * \ref p4est_lnodes_global_owned_count.
  *
  * The sharers array contains items of type p4est_lnodes_rank_t
  * that hold the ranks that own or share independent local nodes.
@@ -209,8 +215,50 @@ p4est_lnodes_t     *p4est_lnodes_new (p4est_t * p4est,
                                       p4est_ghost_t * ghost_layer,
                                       int degree);
 
+/** Create the node numbering, optionally without global communication.
+ * \param [in] p4est     The forest must be face balanced.
+ * \param [in] ghost_layer  Ghost layer as for \ref p4est_lnodes_new.
+ * \param [in] degree   Degree as for \ref p4est_lnodes_new.
+ * \param [in] global_counts  If true, gather the owned counts of all
+ *                      processes into global_owned_count, which is what
+ *                      \ref p4est_lnodes_new does.  If false, the global
+ *                      offset is computed by a prefix sum and exchanged
+ *                      with the sharing processes only, avoiding the
+ *                      memory and time proportional to the number of
+ *                      processes; global_owned_count is left NULL.
+ * \return              The node numbering, identical in both modes.
+ */
+p4est_lnodes_t     *p4est_lnodes_new_ext (p4est_t * p4est,
+                                          p4est_ghost_t * ghost_layer,
+                                          int degree, int global_counts);
+
 void                p4est_lnodes_destroy (p4est_lnodes_t * lnodes);
 
+/** Return the number of owned nodes of each process.
+ * If global_owned_count has not been computed by \ref p4est_lnodes_new,
+ * it is gathered now and stored in the lnodes.  In that case, the call is
+ * collective over the communicator of lnodes.
+ * \param [in,out] lnodes  The node numbering.
+ * \return              The array global_owned_count of lnodes.
+ */
+p4est_locidx_t     *p4est_lnodes_global_owned_count (p4est_lnodes_t * lnodes);
+
+/** Renumber the local nodes for memory locality of the element loops.
+ * The owned nodes are numbered in the order they are first touched by
+ * element_nodes, and the global numbers of the owned nodes change
+ * accordingly.  The nodes owned by other processes stay grouped by owner
+ * and sorted by their new global numbers, so owned_count, global_offset,
+ * global_owned_count and the owned sections of the sharers are unchanged.
+ * This function is collective over the communicator of lnodes.
+ * \param [in,out] lnodes  The node numbering is changed in place.
+ * \param [out] perm       If not NULL, an array of num_local_nodes entries
+ *                         that receives the new local number of each
+ *                         former local node.  Node data \a old is mapped
+ *                         by new_data[perm[i]] = old[i].
+ */
+void                p4est_lnodes_reorder (p4est_lnodes_t * lnodes,
+                                         p4est_locidx_t * perm);
+
 /** Expand the ghost layer to include the support of all nodes supported on
  * the local partition.
  *
@@ -260,6 +308,30 @@ void                p4est_partition_lnodes_detailed (p4est_t * p4est,
                                                      int
                                                      partition_for_coarsening);
 
+/** Partition using weights based on the number of nodes of each element.
+ * If \a lnodes is given, each locally owned node is counted once for the
+ * first local element that references it, and no iteration is needed.
+ * Otherwise the nodes are counted as in p4est_partition_lnodes, where
+ * a current \a plan is replayed instead of iterating over the forest.
+ *
+ * \param[in,out] p4est                    the forest to be repartitioned
+ * \param[in]     ghost                    the ghost layer, may be NULL
+ * \param[in]     lnodes                   nodes of the forest, may be NULL
+ * \param[in]     plan                     iteration plan, may be NULL
+ * \param[in]     degree                   the degree that would be passed to
+ *                                         p4est_lnodes_new(), ignored if
+ *                                         \a lnodes is given
+ * \param[in]     partition_for_coarsening whether the partition should allow
+ *                                         coarsening (i.e. group siblings who
+ *                                         might merge)
+ */
+void                p4est_partition_lnodes_ext (p4est_t * p4est,
+                                                p4est_ghost_t * ghost,
+                                                p4est_lnodes_t * lnodes,
+                                                p4est_iter_plan_t * plan,
+                                                int degree,
+                                                int partition_for_coarsening);
+
 /** p4est_lnodes_buffer_t handles the communication of data associated with
  * nodes.
  *
@@ -347,6 +419,210 @@ p4est_lnodes_buffer_t *p4est_lnodes_share_all (sc_array_t * node_data,
 void                p4est_lnodes_buffer_destroy (p4est_lnodes_buffer_t *
                                                  buffer);
 
+/** Persistent storage for repeated node data exchanges on unchanged lnodes.
+ * The buffers and MPI requests are set up once by \ref p4est_lnodes_plan_new.
+ * Each exchange only packs and unpacks the shared node data.
+ */
+typedef struct p4est_lnodes_plan
+{
+  p4est_lnodes_t     *lnodes;
+  size_t              data_size;        /**< Bytes exchanged per node */
+  char               *mine_buffer;      /**< Owned shared nodes by sharer */
+  char               *owned_buffer;     /**< Nodes owned by other processes */
+  int                 num_owned_requests;       /**< Owners to sharers */
+  int                 num_add_requests; /**< Sharers to owners */
+  sc_MPI_Request     *owned_requests;   /**< Receives first, then sends */
+  sc_MPI_Request     *add_requests;     /**< Receives first, then sends */
+}
+p4est_lnodes_plan_t;
+
+/** Create a persistent plan for exchanging node data of a given size.
+ * The plan must be destroyed before \a lnodes.
+ * \param [in] lnodes           The nodes used for reference.
+ * \param [in] data_size        The data size to transfer per node.
+ * \return                      Plan ready for the exchange functions.
+ */
+p4est_lnodes_plan_t *p4est_lnodes_plan_new (p4est_lnodes_t * lnodes,
+                                            size_t data_size);
+
+/** Destroy a plan. */
+void                p4est_lnodes_plan_destroy (p4est_lnodes_plan_t * plan);
+
+/** Write the values of all nodes from their owners, as
+ * \ref p4est_lnodes_share_owned does, without allocating memory.
+ * \param [in] plan             A plan for this data size.
+ * \param [in,out] node_data    One entry of the plan's data size per node.
+ */
+void                p4est_lnodes_plan_share_owned (p4est_lnodes_plan_t *
+                                                   plan,
+                                                   sc_array_t * node_data);
+
+/** Sum the values of every node over all processes that share it.
+ * The contributions are added on the owner of each node, which then sends
+ * the sum to all sharers.  This is the assembly of a finite element vector
+ * from element contributions.  The entries of \a node_data are arrays of
+ * double and the plan's data size must be a multiple of sizeof (double).
+ * \param [in] plan             A plan for this data size.
+ * \param [in,out] node_data    On input, the local contributions of each
+ *                              node; on output, the sums.
+ */
+void                p4est_lnodes_plan_add_reduce (p4est_lnodes_plan_t * plan,
+                                                  sc_array_t * node_data);
+
+/** Flat arrays of an lnodes structure for kernels on accelerators.
+ * The element-to-node map is stored in 32-bit integers, either element by
+ * element as in \ref p4est_lnodes_t::element_nodes or transposed node by
+ * node, so that consecutive threads handling consecutive elements read
+ * consecutive memory.  The elements with hanging faces are
+ * listed in ascending order together with the values decoded from their
+ * face_code by \ref p4est_lnodes_decode, such that the hanging node interpolation
+ * can run as a separate kernel over this list only.
+ */
+typedef struct p4est_lnodes_export
+{
+  p4est_locidx_t      num_elements;     /**< Number of local elements */
+  int                 vnodes;           /**< Nodes per element */
+  int                 node_major;       /**< Layout of element_nodes */
+  int32_t            *element_nodes;    /**< If node_major is false,
+                                             node k of element e is at
+                                             e * vnodes + k, otherwise at
+                                             k * num_elements + e */
+  p4est_locidx_t      num_hanging;      /**< Number of hanging elements */
+  int32_t            *hanging_elements; /**< Ascending element indices */
+  int8_t             *hanging_face;     /**< P4EST_FACES decoded face values
+                                             per hanging element */
+}
+p4est_lnodes_export_t;
+
+/** Create the flat arrays for an lnodes structure.
+ * \param [in] lnodes      The node numbering, which is not referenced
+ *                         by the result.
+ * \param [in] node_major  If true, store element_nodes transposed.
+ * \return                 Allocated arrays, to be freed with
+ *                         \ref p4est_lnodes_export_destroy.
+ */
+p4est_lnodes_export_t *p4est_lnodes_export_new (p4est_lnodes_t * lnodes,
+                                                int node_major);
+
+/** Free the arrays created by \ref p4est_lnodes_export_new. */
+void                p4est_lnodes_export_destroy (p4est_lnodes_export_t *
+                                                   export_data);
+
+/** Interpolation of the hanging nodes of elements from their independent
+ * nodes, stored once per degree.  Node k of a hanging face or edge holds the
+ * value of node k of the coarse face or edge in element_nodes; the
+ * interpolation replaces it with the value of the coarse Lagrange polynomial
+ * at the node of the element.  It is applied as a sequence of
+ * one-dimensional interpolations along the lines of nodes, which is the same
+ * for all elements of one face_code.  Batches of such elements, as grouped
+ * by \ref p4est_lnodes_code_groups, run without branches per element.
+ */
+typedef struct p4est_lnodes_hanging
+{
+  int                 degree;   /**< Degree of the nodes */
+  int                 vnodes;   /**< Nodes per element */
+  double             *points;   /**< The degree + 1 node positions */
+  double             *interp;   /**< For the lower and upper half of a
+                                     line, (degree + 1)^2 coefficients
+                                     each, row by row */
+}
+p4est_lnodes_hanging_t;
+
+/** Create the hanging node interpolation for nodes of a given degree.
+ * \param [in] degree      The degree of the nodes, > 0.
+ * \param [in] points      The degree + 1 ascending node positions in [0, 1],
+ *                         starting with 0 and ending with 1, or NULL for
+ *                         the Gauss-Lobatto points.
+ * \return                 Interpolation to be destroyed with
+ *                         \ref p4est_lnodes_hanging_destroy.
+ */
+p4est_lnodes_hanging_t *p4est_lnodes_hanging_new (int degree,
+                                                  const double *points);
+
+/** Destroy a hanging node interpolation. */
+void                p4est_lnodes_hanging_destroy (p4est_lnodes_hanging_t *
+                                                  hanging);
+
+/** Interpolate the hanging nodes of a batch of elements.
+ * \param [in] hanging      Interpolation of the degree of the nodes.
+ * \param [in] face_code    The face_code common to all elements.
+ * \param [in] num_elements Number of elements in the batch.
+ * \param [in,out] values   The vnodes values of each element one after
+ *                          another, as gathered by element_nodes on input
+ *                          and with the hanging nodes interpolated on output.
+ */
+void                p4est_lnodes_hanging_interpolate (p4est_lnodes_hanging_t
+                                                      * hanging,
+                                                      p4est_lnodes_code_t
+                                                      face_code,
+                                                      p4est_locidx_t
+                                                      num_elements,
+                                                      double *values);
+
+/** Apply the transpose of \ref p4est_lnodes_hanging_interpolate, which
+ * moves the contributions of the hanging nodes to the nodes they depend on.
+ * \param [in] hanging      Interpolation of the degree of the nodes.
+ * \param [in] face_code    The face_code common to all elements.
+ * \param [in] num_elements Number of elements in the batch.
+ * \param [in,out] values   The vnodes values of each element one after
+ *                          another, ready to be added by element_nodes on
+ *                          output.
+ */
+void                p4est_lnodes_hanging_restrict (p4est_lnodes_hanging_t *
+                                                   hanging,
+                                                   p4est_lnodes_code_t
+                                                   face_code,
+                                                   p4est_locidx_t
+                                                   num_elements,
+                                                   double *values);
+
+/** Gather the node values of a batch of elements and interpolate them.
+ * \param [in] hanging      Interpolation of the degree of the nodes.
+ * \param [in] lnodes       The node numbering.
+ * \param [in] num_elements Number of elements in the batch.
+ * \param [in] elements     The local elements, all of the same face_code.
+ * \param [in] node_values  One value per local node.
+ * \param [out] values      The vnodes values of each element of the batch.
+ */
+void                p4est_lnodes_hanging_gather (p4est_lnodes_hanging_t *
+                                                 hanging,
+                                                 p4est_lnodes_t * lnodes,
+                                                 p4est_locidx_t num_elements,
+                                                 const p4est_locidx_t *
+                                                 elements,
+                                                 const double *node_values,
+                                                 double *values);
+
+/** Restrict the values of a batch of elements and add them to their nodes.
+ * This is the transpose of \ref p4est_lnodes_hanging_gather.
+ * \param [in] hanging      Interpolation of the degree of the nodes.
+ * \param [in] lnodes       The node numbering.
+ * \param [in] num_elements Number of elements in the batch.
+ * \param [in] elements     The local elements, all of the same face_code.
+ * \param [in,out] values   The vnodes values of each element of the batch,
+ *                          restricted on output.
+ * \param [in,out] node_values One value per local node to be added to.
+ */
+void                p4est_lnodes_hanging_scatter (p4est_lnodes_hanging_t *
+                                                  hanging,
+                                                  p4est_lnodes_t * lnodes,
+                                                  p4est_locidx_t num_elements,
+                                                  const p4est_locidx_t *
+                                                  elements, double *values,
+                                                  double *node_values);
+
+/** Sort the local elements by their face_code.
+ * \param [in] lnodes       The node numbering.
+ * \param [out] offsets     Array of P4EST_LNODES_CODES + 1 entries: the
+ *                          elements of code i are listed from offsets[i] to
+ *                          offsets[i + 1] - 1.
+ * \param [out] elements    Array of num_local_elements entries, sorted
+ *                          by code and ascending within each code.
+ */
+void                p4est_lnodes_code_groups (p4est_lnodes_t * lnodes,
+                                              p4est_locidx_t * offsets,
+                                              p4est_locidx_t * elements);
+
 /** Return a pointer to a lnodes_rank array element indexed by a int.
  */
 /*@unused@*/
@@ -36,6 +36,9 @@
 #include <p8est_search.h>
 #endif /* P4_TO_P8 */
 
+/* arrays of fewer entries per thread are summed by one thread */
+static const size_t mesh_prefix_quadrants = 65536;
+
 /*********************** constructor functions ***********************/
 
 /** Populate mesh information for corners across tree boundaries, i.e. every
@@ -45,15 +48,19 @@
  *
  * \param [in][out] mesh     The mesh structure to which we will add corner
  *                           information
+ * \param [in]      in_qtoc  Position in quad_to_corner that links to the
+ *                           new corner
  * \param [in]      clen     Number of quadrants to be added
  * \param [in]      pcquad   List of quadrant indices
  * \param [in]      pccorner List of quadrant encodings
  */
 static              p4est_locidx_t
-mesh_corner_allocate (p4est_mesh_t * mesh, p4est_locidx_t clen,
-                      p4est_locidx_t ** pcquad, int8_t ** pccorner)
+mesh_corner_allocate (p4est_mesh_t * mesh, p4est_locidx_t in_qtoc,
+                      p4est_locidx_t clen, p4est_locidx_t ** pcquad,
+                      int8_t ** pccorner)
 {
   p4est_locidx_t      cornerid, cstart, cend;
+  p4est_locidx_t     *coffset;
 
   P4EST_ASSERT (clen > 0);
   P4EST_ASSERT (mesh->corner_offset->elem_count ==
@@ -62,7 +69,12 @@ mesh_corner_allocate (p4est_mesh_t * mesh, p4est_locidx_t clen,
   cornerid = mesh->local_num_corners++;
   cstart = *(p4est_locidx_t *) sc_array_index (mesh->corner_offset, cornerid);
   cend = cstart + clen;
-  *(p4est_locidx_t *) sc_array_push (mesh->corner_offset) = cend;
+  coffset = (p4est_locidx_t *) sc_array_push (mesh->corner_offset);
+  coffset[0] = cend;
+  if (mesh->corner_offset->elem_size > sizeof (p4est_locidx_t)) {
+    /* the part of a threaded build remembers where the corner is linked */
+    coffset[1] = in_qtoc;
+  }
 
   P4EST_ASSERT (mesh->corner_offset->elem_count ==
                 (size_t) (mesh->local_num_corners + 1));
@@ -86,15 +98,19 @@ mesh_corner_allocate (p4est_mesh_t * mesh, p4est_locidx_t clen,
  *
  * \param [in][out] mesh     The mesh structure to which we will add edge
  *                           information
+ * \param [in]      in_qtoe  Position in quad_to_edge that links to the
+ *                           new edge
  * \param [in]      elen     Number of quadrants to be added
  * \param [in]      pequad   List of quadrant indices
  * \param [in]      peedge   List of quadrant encodings
  */
 static              p4est_locidx_t
-mesh_edge_allocate (p4est_mesh_t * mesh, p4est_locidx_t elen,
-                    p4est_locidx_t ** pequad, int8_t ** peedge)
+mesh_edge_allocate (p4est_mesh_t * mesh, p4est_locidx_t in_qtoe,
+                    p4est_locidx_t elen, p4est_locidx_t ** pequad,
+                    int8_t ** peedge)
 {
   p4est_locidx_t      edgeid, estart, eend;
+  p4est_locidx_t     *eoffset;
 
   P4EST_ASSERT (elen > 0);
   P4EST_ASSERT (mesh->edge_offset->elem_count ==
@@ -102,7 +118,12 @@ mesh_edge_allocate (p4est_mesh_t * mesh, p4est_locidx_t elen,
   edgeid = mesh->local_num_edges++;
   estart = *(p4est_locidx_t *) sc_array_index (mesh->edge_offset, edgeid);
   eend = estart + elen;
-  *(p4est_locidx_t *) sc_array_push (mesh->edge_offset) = eend;
+  eoffset = (p4est_locidx_t *) sc_array_push (mesh->edge_offset);
+  eoffset[0] = eend;
+  if (mesh->edge_offset->elem_size > sizeof (p4est_locidx_t)) {
+    /* the part of a threaded build remembers where the edge is linked */
+    eoffset[1] = in_qtoe;
+  }
 
   P4EST_ASSERT (mesh->edge_offset->elem_count ==
                 (size_t) (mesh->local_num_edges + 1));
@@ -299,9 +320,10 @@ mesh_edge_process_inter_tree_edges (p8est_iter_edge_info_t * info,
   if (add_hedges) {
     if (cgoodones > 0) {
       /* Allocate and fill corner information in the mesh structure */
-      cornerid = mesh_corner_allocate (mesh, cgoodones, &pcquad, &pccorner);
-      /* "link" to arrays encoding inter-tree corner-neighborhood */
       cid = p8est_edge_corners[side1->edge][subedge_id ^ 1];
+      cornerid = mesh_corner_allocate (mesh, P8EST_CHILDREN * qid1 + cid,
+                                       cgoodones, &pcquad, &pccorner);
+      /* "link" to arrays encoding inter-tree corner-neighborhood */
       P4EST_ASSERT (mesh->quad_to_corner[P8EST_CHILDREN * qid1 + cid] == -1);
       mesh->quad_to_corner[P8EST_CHILDREN * qid1 + cid] =
         edgeid_offset + cornerid;
@@ -315,7 +337,8 @@ mesh_edge_process_inter_tree_edges (p8est_iter_edge_info_t * info,
 
   if (goodones > 0) {
     /* Allocate and fill edge information in the mesh structure */
-    edgeid = mesh_edge_allocate (mesh, goodones, &pequad, &peedge);
+    edgeid = mesh_edge_allocate (mesh, P8EST_EDGES * qid1 + side1->edge,
+                                 goodones, &pequad, &peedge);
     /* "link" to arrays encoding inter-tree edge-neighborhood */
     P4EST_ASSERT (mesh->quad_to_edge[P8EST_EDGES * qid1 + side1->edge] == -1);
     mesh->quad_to_edge[P8EST_EDGES * qid1 + side1->edge] =
@@ -430,7 +453,9 @@ mesh_corner_process_inter_tree_corners (p4est_iter_corner_info_t * info,
 
   if (goodones > 0) {
     /* Allocate and fill corner information in the mesh structure */
-    corner_id = mesh_corner_allocate (mesh, goodones, &pcquad, &pccorner);
+    corner_id = mesh_corner_allocate (mesh,
+                                      P4EST_CHILDREN * qid1 + side1->corner,
+                                      goodones, &pcquad, &pccorner);
     /* "link" to arrays encoding inter-tree corner-neighborhood */
     P4EST_ASSERT
       (mesh->quad_to_corner[P4EST_CHILDREN * qid1 + side1->corner] == -1);
@@ -824,7 +849,8 @@ mesh_iter_edge (p8est_iter_edge_info_t * info, void *user_data)
                 eedges[k] = -24 + side2->edge;
               }
 
-              edgeid = mesh_edge_allocate (mesh, 2, &pequad, &peedge);
+              edgeid = mesh_edge_allocate (mesh, in_qtoe, 2,
+                                           &pequad, &peedge);
               memcpy (pequad, qls1, 2 * sizeof (p4est_locidx_t));
               memcpy (peedge, eedges, 2 * sizeof (int8_t));
 
@@ -840,7 +866,8 @@ mesh_iter_edge (p8est_iter_edge_info_t * info, void *user_data)
 
                 P4EST_ASSERT (mesh->quad_to_edge[in_qtoe] == -1);
 
-                edgeid = mesh_edge_allocate (mesh, 1, &pequad, &peedge);
+                edgeid = mesh_edge_allocate (mesh, in_qtoe, 1,
+                                             &pequad, &peedge);
                 *pequad = qid1;
 
                 /* orientation is 0 as we are in the same tree */
@@ -1116,6 +1143,11 @@ mesh_iter_face (p4est_iter_face_info_t * info, void *user_data)
         for (h = 0; h < P4EST_HALF; ++h) {
           halfentries[h] = jls[h];
         }
+        if (mesh->quad_to_half->elem_size >
+            P4EST_HALF * sizeof (p4est_locidx_t)) {
+          /* the part of a threaded build remembers where the pair is linked */
+          halfentries[P4EST_HALF] = in_qtoq;
+        }
       }
       for (h = 0; h < P4EST_HALF; ++h) {
         int                 pos =
@@ -1160,6 +1192,677 @@ mesh_iter_volume (p4est_iter_volume_info_t * info, void *user_data)
   }
 }
 
+/** Refresh the optional per-quadrant lists of a mesh. */
+static void
+mesh_update_volume (p4est_mesh_t * mesh, p4est_t * p4est)
+{
+  int                 level;
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      lq;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+
+  if (mesh->quad_to_tree != NULL) {
+    mesh->quad_to_tree = P4EST_REALLOC (mesh->quad_to_tree, p4est_topidx_t,
+                                        mesh->local_num_quadrants);
+  }
+  if (mesh->quad_level != NULL) {
+    for (level = 0; level <= P4EST_QMAXLEVEL; ++level) {
+      sc_array_truncate (mesh->quad_level + level);
+    }
+  }
+  lq = 0;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lq) {
+      if (mesh->quad_to_tree != NULL) {
+        mesh->quad_to_tree[lq] = jt;
+      }
+      if (mesh->quad_level != NULL) {
+        q = p4est_quadrant_array_index (&tree->quadrants, zz);
+        *(p4est_locidx_t *) sc_array_push (mesh->quad_level + q->level) = lq;
+      }
+    }
+  }
+}
+
+/* the threaded build passes each thread its own part of the mesh */
+static void
+mesh_thread_face (p4est_iter_face_info_t * info, void *user_data)
+{
+  mesh_iter_face (info, (p4est_mesh_t *) user_data + p4est_get_thread_num ());
+}
+
+#ifdef P4_TO_P8
+static void
+mesh_thread_edge (p8est_iter_edge_info_t * info, void *user_data)
+{
+  mesh_iter_edge (info, (p4est_mesh_t *) user_data + p4est_get_thread_num ());
+}
+#endif /* P4_TO_P8 */
+
+static void
+mesh_thread_corner (p4est_iter_corner_info_t * info, void *user_data)
+{
+  mesh_iter_corner (info,
+                    (p4est_mesh_t *) user_data + p4est_get_thread_num ());
+}
+
+/** Replace counts by their exclusive prefix sum.
+ * Large arrays are summed in one piece per thread, which are then offset
+ * by the totals of the pieces before them.
+ * \param [in,out] counts   On input \a n counts, on output \a n + 1 sums
+ *                          with counts[0] = 0.
+ * \return                  The total of the counts.
+ */
+static              p4est_locidx_t
+mesh_prefix_sum (p4est_locidx_t * counts, p4est_locidx_t n, int num_threads)
+{
+  int                 t;
+  p4est_locidx_t      kl, begin, end, sum, count;
+  p4est_locidx_t     *totals;
+
+  /* small arrays are not worth the threads */
+  num_threads = (int) SC_MIN ((size_t) num_threads,
+                              1 + (size_t) n / mesh_prefix_quadrants);
+  totals = P4EST_ALLOC (p4est_locidx_t, num_threads + 1);
+
+  /* sum every piece from zero, then add the totals of the ones before */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for if (num_threads > 1) num_threads (num_threads) \
+  private (kl, begin, end, sum, count)
+#endif
+  for (t = 0; t < num_threads; ++t) {
+    begin = (p4est_locidx_t) ((int64_t) n * t / num_threads);
+    end = (p4est_locidx_t) ((int64_t) n * (t + 1) / num_threads);
+    for (sum = 0, kl = begin; kl < end; ++kl) {
+      count = counts[kl];
+      counts[kl] = sum;
+      sum += count;
+    }
+    totals[t + 1] = sum;
+  }
+  totals[0] = 0;
+  for (t = 0; t < num_threads; ++t) {
+    totals[t + 1] += totals[t];
+  }
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for if (num_threads > 1) num_threads (num_threads) \
+  private (kl, begin, end)
+#endif
+  for (t = 1; t < num_threads; ++t) {
+    begin = (p4est_locidx_t) ((int64_t) n * t / num_threads);
+    end = (p4est_locidx_t) ((int64_t) n * (t + 1) / num_threads);
+    for (kl = begin; kl < end; ++kl) {
+      counts[kl] += totals[t];
+    }
+  }
+  counts[n] = sum = totals[num_threads];
+  P4EST_FREE (totals);
+
+  return sum;
+}
+
+/** Access the corner or edge groups of a mesh.
+ * \param [out] links   Number of links per local quadrant.
+ * \return              The corner or edge links of the local quadrants.
+ */
+static p4est_locidx_t *
+mesh_groups (p4est_mesh_t * mesh, int edges, int *links,
+             sc_array_t ** offset, sc_array_t ** quad, sc_array_t ** code)
+{
+#ifdef P4_TO_P8
+  if (edges) {
+    *links = P8EST_EDGES;
+    *offset = mesh->edge_offset;
+    *quad = mesh->edge_quad;
+    *code = mesh->edge_edge;
+    return mesh->quad_to_edge;
+  }
+#endif /* P4_TO_P8 */
+  P4EST_ASSERT (!edges);
+  *links = P4EST_CHILDREN;
+  *offset = mesh->corner_offset;
+  *quad = mesh->corner_quad;
+  *code = mesh->corner_corner;
+  return mesh->quad_to_corner;
+}
+
+/** Merge the pairs of half-size neighbors found by the threads.
+ * The pairs are numbered in the order of the quad_to_quad entries that
+ * link to them, which does not depend on the distribution of the work.
+ */
+static void
+mesh_merge_halves (p4est_mesh_t * mesh, p4est_mesh_t * parts,
+                   int num_threads)
+{
+  int                 t, f;
+  size_t              zz;
+  p4est_locidx_t      jl, lq = mesh->local_num_quadrants;
+  p4est_locidx_t      in_qtoq, *count, *entry;
+
+  /* number the links of every quadrant after the ones before it */
+  count = P4EST_ALLOC (p4est_locidx_t, lq + 1);
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_threads) private (f)
+#endif
+  for (jl = 0; jl < lq; ++jl) {
+    count[jl] = 0;
+    for (f = 0; f < P4EST_FACES; ++f) {
+      count[jl] += (mesh->quad_to_face[P4EST_FACES * jl + f] < 0);
+    }
+  }
+  sc_array_resize (mesh->quad_to_half,
+                   (size_t) mesh_prefix_sum (count, lq, num_threads));
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_threads) private (f, in_qtoq)
+#endif
+  for (jl = 0; jl < lq; ++jl) {
+    for (f = 0; f < P4EST_FACES; ++f) {
+      in_qtoq = P4EST_FACES * jl + f;
+      if (mesh->quad_to_face[in_qtoq] < 0) {
+        mesh->quad_to_quad[in_qtoq] = count[jl]++;
+      }
+    }
+  }
+  P4EST_FREE (count);
+
+  /* every thread moves its pairs to their new position */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_threads) private (zz, entry)
+#endif
+  for (t = 0; t < num_threads; ++t) {
+    for (zz = 0; zz < parts[t].quad_to_half->elem_count; ++zz) {
+      entry = (p4est_locidx_t *) sc_array_index (parts[t].quad_to_half, zz);
+      memcpy (sc_array_index (mesh->quad_to_half,
+                              mesh->quad_to_quad[entry[P4EST_HALF]]),
+              entry, P4EST_HALF * sizeof (p4est_locidx_t));
+    }
+  }
+}
+
+/** Merge the corner or edge groups found by the threads.
+ * The groups are numbered in the order of the quad_to_corner or
+ * quad_to_edge entries that link to them, and their offsets are the
+ * prefix sum of their sizes.
+ * \return              The number of groups.
+ */
+static              p4est_locidx_t
+mesh_merge_groups (p4est_mesh_t * mesh, p4est_mesh_t * parts,
+                   int num_threads, int edges)
+{
+  int                 t, k, links;
+  size_t              zz;
+  p4est_locidx_t      jl, lq = mesh->local_num_quadrants;
+  p4est_locidx_t      first_group, num_groups, gl, in_qtox;
+  p4est_locidx_t     *quad_to_x, *count, *goffset, *poffset;
+  sc_array_t         *offset, *quad, *code;
+  sc_array_t         *part_offset, *part_quad, *part_code;
+
+  /* number the links of every quadrant after the ones before it */
+  first_group = mesh->local_num_quadrants + mesh->ghost_num_quadrants;
+  quad_to_x = mesh_groups (mesh, edges, &links, &offset, &quad, &code);
+  count = P4EST_ALLOC (p4est_locidx_t, lq + 1);
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_threads) private (k)
+#endif
+  for (jl = 0; jl < lq; ++jl) {
+    count[jl] = 0;
+    for (k = 0; k < links; ++k) {
+      count[jl] += (quad_to_x[links * jl + k] >= first_group);
+    }
+  }
+  num_groups = mesh_prefix_sum (count, lq, num_threads);
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_threads) private (k, in_qtox)
+#endif
+  for (jl = 0; jl < lq; ++jl) {
+    for (k = 0; k < links; ++k) {
+      in_qtox = links * jl + k;
+      if (quad_to_x[in_qtox] >= first_group) {
+        quad_to_x[in_qtox] = first_group + count[jl]++;
+      }
+    }
+  }
+  P4EST_FREE (count);
+
+  /* every thread stores the sizes of its groups at their new position */
+  sc_array_resize (offset, (size_t) num_groups + 1);
+  goffset = (p4est_locidx_t *) offset->array;
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_threads) \
+  private (zz, links, poffset, gl, part_offset, part_quad, part_code)
+#endif
+  for (t = 0; t < num_threads; ++t) {
+    (void) mesh_groups (parts + t, edges, &links,
+                        &part_offset, &part_quad, &part_code);
+    for (zz = 0; zz + 1 < part_offset->elem_count; ++zz) {
+      /* the end of a group is followed by the position of its link */
+      poffset = (p4est_locidx_t *) sc_array_index (part_offset, zz);
+      gl = quad_to_x[poffset[3]] - first_group;
+      goffset[gl] = poffset[2] - poffset[0];
+    }
+  }
+  (void) mesh_prefix_sum (goffset, num_groups, num_threads);
+
+  /* every thread moves its groups to their new position */
+  sc_array_resize (quad, (size_t) goffset[num_groups]);
+  sc_array_resize (code, (size_t) goffset[num_groups]);
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_threads) \
+  private (zz, links, poffset, gl, part_offset, part_quad, part_code)
+#endif
+  for (t = 0; t < num_threads; ++t) {
+    (void) mesh_groups (parts + t, edges, &links,
+                        &part_offset, &part_quad, &part_code);
+    for (zz = 0; zz + 1 < part_offset->elem_count; ++zz) {
+      poffset = (p4est_locidx_t *) sc_array_index (part_offset, zz);
+      gl = quad_to_x[poffset[3]] - first_group;
+      P4EST_ASSERT (goffset[gl + 1] - goffset[gl] ==
+                    poffset[2] - poffset[0]);
+      memcpy (sc_array_index (quad, (size_t) goffset[gl]),
+              sc_array_index (part_quad, (size_t) poffset[0]),
+              (poffset[2] - poffset[0]) * sizeof (p4est_locidx_t));
+      memcpy (sc_array_index (code, (size_t) goffset[gl]),
+              sc_array_index (part_code, (size_t) poffset[0]),
+              (poffset[2] - poffset[0]) * sizeof (int8_t));
+    }
+  }
+
+  return num_groups;
+}
+
+/** Find the neighbors of all local quadrants with several threads.
+ * Every link in quad_to_quad, quad_to_corner and quad_to_edge is written
+ * by exactly one callback, so the threads write them in place.  The pairs
+ * of half-size neighbors and the corner and edge groups are collected in
+ * one part of the mesh per thread, together with the position of their
+ * link, and merged in the end.
+ */
+static void
+mesh_iterate_threads (p4est_mesh_t * mesh, p4est_t * p4est,
+                      p4est_ghost_t * ghost, int num_threads)
+{
+  int                 t;
+  p4est_locidx_t     *offset;
+  p4est_mesh_t       *parts, *part;
+
+  /* the offsets and pairs of the parts have room for the link position */
+  parts = P4EST_ALLOC (p4est_mesh_t, num_threads);
+  for (t = 0; t < num_threads; ++t) {
+    part = parts + t;
+    *part = *mesh;
+    part->quad_to_half =
+      sc_array_new ((P4EST_HALF + 1) * sizeof (p4est_locidx_t));
+#ifdef P4_TO_P8
+    if (mesh->quad_to_edge != NULL) {
+      part->edge_offset = sc_array_new (2 * sizeof (p4est_locidx_t));
+      offset = (p4est_locidx_t *) sc_array_push (part->edge_offset);
+      offset[0] = 0;
+      offset[1] = -1;
+      part->edge_quad = sc_array_new (sizeof (p4est_locidx_t));
+      part->edge_edge = sc_array_new (sizeof (int8_t));
+    }
+#endif /* P4_TO_P8 */
+    if (mesh->quad_to_corner != NULL) {
+      part->corner_offset = sc_array_new (2 * sizeof (p4est_locidx_t));
+      offset = (p4est_locidx_t *) sc_array_push (part->corner_offset);
+      offset[0] = 0;
+      offset[1] = -1;
+      part->corner_quad = sc_array_new (sizeof (p4est_locidx_t));
+      part->corner_corner = sc_array_new (sizeof (int8_t));
+    }
+  }
+
+  /* every face, edge and corner is visited once */
+  p4est_iterate_threads (p4est, ghost, parts, NULL, mesh_thread_face,
+#ifdef P4_TO_P8
+                         (mesh->quad_to_edge != NULL ?
+                          mesh_thread_edge : NULL),
+#endif /* P4_TO_P8 */
+                         (mesh->quad_to_corner != NULL ?
+                          mesh_thread_corner : NULL), 0, 0, 0);
+
+  /* number the collected entries in the order of their links */
+  mesh_merge_halves (mesh, parts, num_threads);
+#ifdef P4_TO_P8
+  if (mesh->quad_to_edge != NULL) {
+    mesh->local_num_edges = mesh_merge_groups (mesh, parts, num_threads, 1);
+  }
+#endif /* P4_TO_P8 */
+  if (mesh->quad_to_corner != NULL) {
+    mesh->local_num_corners =
+      mesh_merge_groups (mesh, parts, num_threads, 0);
+  }
+
+  for (t = 0; t < num_threads; ++t) {
+    part = parts + t;
+    sc_array_destroy (part->quad_to_half);
+#ifdef P4_TO_P8
+    if (mesh->quad_to_edge != NULL) {
+      sc_array_destroy (part->edge_offset);
+      sc_array_destroy (part->edge_quad);
+      sc_array_destroy (part->edge_edge);
+    }
+#endif /* P4_TO_P8 */
+    if (mesh->quad_to_corner != NULL) {
+      sc_array_destroy (part->corner_offset);
+      sc_array_destroy (part->corner_quad);
+      sc_array_destroy (part->corner_corner);
+    }
+  }
+  P4EST_FREE (parts);
+}
+
+/** Store the face neighbors in compressed sparse row format.
+ * This is a pass over quad_to_quad, quad_to_face and quad_to_half
+ * after they have been populated by the face iterator.
+ */
+static void
+mesh_face_csr (p4est_mesh_t * mesh)
+{
+  const int           code_base = P4EST_HALF * P4EST_FACES;
+  int                 f, h, nh, v;
+  p4est_locidx_t      lq = mesh->local_num_quadrants;
+  p4est_locidx_t      jl, qtq, num_entries;
+  p4est_locidx_t     *halfs;
+  int8_t              qtf;
+
+  /* count the neighbors of each quadrant */
+  mesh->face_offset = P4EST_ALLOC (p4est_locidx_t, lq + 1);
+  num_entries = 0;
+  for (jl = 0; jl < lq; ++jl) {
+    mesh->face_offset[jl] = num_entries;
+    for (f = 0; f < P4EST_FACES; ++f) {
+      qtq = mesh->quad_to_quad[P4EST_FACES * jl + f];
+      qtf = mesh->quad_to_face[P4EST_FACES * jl + f];
+      if (qtf < 0) {
+        num_entries += P4EST_HALF;
+      }
+      else if (qtq != jl || qtf != f) {
+        ++num_entries;
+      }
+    }
+  }
+  mesh->face_offset[lq] = num_entries;
+
+  mesh->face_quad = P4EST_ALLOC (p4est_locidx_t, num_entries);
+  mesh->face_face = P4EST_ALLOC (int8_t, num_entries);
+  mesh->face_nface = P4EST_ALLOC (int8_t, num_entries);
+  mesh->face_subface = P4EST_ALLOC (int8_t, num_entries);
+
+  /* decode quad_to_face once for all */
+  num_entries = 0;
+  for (jl = 0; jl < lq; ++jl) {
+    for (f = 0; f < P4EST_FACES; ++f) {
+      qtq = mesh->quad_to_quad[P4EST_FACES * jl + f];
+      qtf = mesh->quad_to_face[P4EST_FACES * jl + f];
+      if (qtf < 0) {
+        /* half-size neighbors in the order of the face corners */
+        halfs = (p4est_locidx_t *) sc_array_index (mesh->quad_to_half,
+                                                   (size_t) qtq);
+        for (h = 0; h < P4EST_HALF; ++h) {
+          mesh->face_quad[num_entries] = halfs[h];
+          mesh->face_face[num_entries] = (int8_t) f;
+          mesh->face_nface[num_entries] = (int8_t) (code_base + qtf);
+          mesh->face_subface[num_entries] = (int8_t) h;
+          ++num_entries;
+        }
+        continue;
+      }
+      if (qtq == jl && qtf == f) {
+        /* domain boundary */
+        continue;
+      }
+      v = qtf;
+      nh = -1;
+      if (v >= code_base) {
+        /* double-size neighbor */
+        nh = P4EST_HALF + (v - code_base) / code_base;
+        v = (v - code_base) % code_base;
+      }
+      mesh->face_quad[num_entries] = qtq;
+      mesh->face_face[num_entries] = (int8_t) f;
+      mesh->face_nface[num_entries] = (int8_t) v;
+      mesh->face_subface[num_entries] = (int8_t) nh;
+      ++num_entries;
+    }
+  }
+  P4EST_ASSERT (num_entries == mesh->face_offset[lq]);
+}
+
+/** Count or store one entry of the unique face list.
+ * In the counting pass, only the number of faces per level is updated.
+ */
+static void
+mesh_face_list_entry (p4est_mesh_t * mesh, p4est_locidx_t * cursor,
+                      int store, int level, p4est_locidx_t left,
+                      p4est_locidx_t right, int lface, int rcode,
+                      int hanging)
+{
+  p4est_locidx_t      fi;
+
+  fi = cursor[level]++;
+  if (!store) {
+    return;
+  }
+  mesh->face_to_quad[2 * fi] = left;
+  mesh->face_to_quad[2 * fi + 1] = right;
+  mesh->face_to_face[2 * fi] = (int8_t) lface;
+  mesh->face_to_face[2 * fi + 1] = (int8_t) rcode;
+  mesh->face_hanging[fi] = (int8_t) hanging;
+}
+
+/** Store each face once, sorted by the level of its smaller side.
+ * This is a pass over quad_to_quad, quad_to_face and quad_to_half
+ * after they have been populated by the face iterator.
+ */
+static void
+mesh_face_list (p4est_mesh_t * mesh, p4est_t * p4est)
+{
+  const int           code_base = P4EST_HALF * P4EST_FACES;
+  int                 f, h, level, store;
+  int8_t              qtf, *qlevel;
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      lq = mesh->local_num_quadrants;
+  p4est_locidx_t      jl, qtq;
+  p4est_locidx_t     *halfs, *cursor;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *quad;
+
+  /* the level of each local quadrant */
+  qlevel = P4EST_ALLOC (int8_t, lq);
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      quad = p4est_quadrant_array_index (&tree->quadrants, zz);
+      qlevel[tree->quadrants_offset + (p4est_locidx_t) zz] = quad->level;
+    }
+  }
+
+  /* count the faces per level, then store them at the level offsets */
+  mesh->face_level_offset = P4EST_ALLOC_ZERO (p4est_locidx_t,
+                                              P4EST_QMAXLEVEL + 2);
+  cursor = mesh->face_level_offset + 1;
+  for (store = 0; store < 2; ++store) {
+    if (store) {
+      for (level = 0; level <= P4EST_QMAXLEVEL; ++level) {
+        cursor[level] += mesh->face_level_offset[level];
+      }
+      mesh->local_num_faces = cursor[P4EST_QMAXLEVEL];
+      mesh->face_to_quad =
+        P4EST_ALLOC (p4est_locidx_t, 2 * mesh->local_num_faces);
+      mesh->face_to_face = P4EST_ALLOC (int8_t, 2 * mesh->local_num_faces);
+      mesh->face_hanging = P4EST_ALLOC (int8_t, mesh->local_num_faces);
+
+      /* the cursor now runs from the beginning of each level */
+      cursor = P4EST_ALLOC (p4est_locidx_t, P4EST_QMAXLEVEL + 1);
+      memcpy (cursor, mesh->face_level_offset,
+              (P4EST_QMAXLEVEL + 1) * sizeof (p4est_locidx_t));
+    }
+    for (jl = 0; jl < lq; ++jl) {
+      level = (int) qlevel[jl];
+      for (f = 0; f < P4EST_FACES; ++f) {
+        qtq = mesh->quad_to_quad[P4EST_FACES * jl + f];
+        qtf = mesh->quad_to_face[P4EST_FACES * jl + f];
+        if (qtf < 0) {
+          /* local half-size neighbors store the face themselves */
+          halfs = (p4est_locidx_t *) sc_array_index (mesh->quad_to_half,
+                                                     (size_t) qtq);
+          for (h = 0; h < P4EST_HALF; ++h) {
+            if (halfs[h] >= lq) {
+              mesh_face_list_entry (mesh, cursor, store, level + 1, jl,
+                                    halfs[h], f, code_base + qtf, h);
+            }
+          }
+        }
+        else if (qtq == jl && qtf == f) {
+          /* domain boundary */
+          mesh_face_list_entry (mesh, cursor, store, level, jl, -1, f, -1,
+                                -1);
+        }
+        else if (qtf >= code_base) {
+          /* this is the small side of a hanging face */
+          h = qtf / code_base - 1;
+          mesh_face_list_entry (mesh, cursor, store, level, jl, qtq, f,
+                                qtf % code_base, P4EST_HALF + h);
+        }
+        else if (qtq >= lq || jl < qtq ||
+                 (jl == qtq && f < qtf % P4EST_FACES)) {
+          /* same-size face seen from its first local quadrant */
+          mesh_face_list_entry (mesh, cursor, store, level, jl, qtq, f, qtf,
+                                -1);
+        }
+      }
+    }
+  }
+  P4EST_ASSERT (cursor[P4EST_QMAXLEVEL] == mesh->local_num_faces);
+  P4EST_FREE (cursor);
+  P4EST_FREE (qlevel);
+}
+
+/** Look up a face neighbor of a ghost among the local and ghost quadrants.
+ * \return      The neighbor encoded as in quad_to_quad, -2 on the domain
+ *              boundary, or -1 if the neighbor is not known to this process.
+ */
+static              p4est_locidx_t
+mesh_ghost_face_lookup (p4est_mesh_t * mesh, p4est_t * p4est,
+                        p4est_ghost_t * ghost, p4est_topidx_t treeid,
+                        const p4est_quadrant_t * n, int face, int *pnface,
+                        int *phang)
+{
+  int                 owner_rank;
+  p4est_locidx_t      lnid;
+
+  *pnface = face;
+  lnid = p4est_face_quadrant_exists (p4est, ghost, treeid, n,
+                                     pnface, phang, &owner_rank);
+  if (lnid >= 0 && owner_rank != p4est->mpirank) {
+    lnid += mesh->local_num_quadrants;
+  }
+  return lnid;
+}
+
+/** Populate the face neighbors of the ghost quadrants.
+ * The forest iterator only visits faces of local quadrants, so we look up
+ * the same-size, double-size and half-size neighbor of each ghost face.
+ */
+static void
+mesh_ghost_faces (p4est_mesh_t * mesh, p4est_t * p4est,
+                  p4est_ghost_t * ghost)
+{
+  int                 f, k, c, nface, hang;
+  size_t              in_gtoq;
+  p4est_topidx_t      treeid;
+  p4est_locidx_t      gl, lnid, ng = mesh->ghost_num_quadrants;
+  p4est_locidx_t      halfs[P4EST_HALF], *halfentries;
+  p4est_quadrant_t   *g, p, child, n;
+
+  mesh->ghost_to_quad = P4EST_ALLOC (p4est_locidx_t, P4EST_FACES * ng);
+  mesh->ghost_to_face = P4EST_ALLOC (int8_t, P4EST_FACES * ng);
+  for (gl = 0; gl < ng; ++gl) {
+    g = p4est_quadrant_array_index (&ghost->ghosts, (size_t) gl);
+    treeid = g->p.piggy3.which_tree;
+    c = (g->level > 0) ? p4est_quadrant_child_id (g) : -1;
+    for (f = 0; f < P4EST_FACES; ++f) {
+      in_gtoq = (size_t) (P4EST_FACES * gl + f);
+      mesh->ghost_to_quad[in_gtoq] = -1;
+      mesh->ghost_to_face[in_gtoq] = -25;
+
+      /* same-size neighbor or domain boundary */
+      p4est_quadrant_face_neighbor (g, f, &n);
+      lnid = mesh_ghost_face_lookup (mesh, p4est, ghost, treeid, &n, f,
+                                     &nface, NULL);
+      if (lnid == -2) {
+        mesh->ghost_to_quad[in_gtoq] = mesh->local_num_quadrants + gl;
+        mesh->ghost_to_face[in_gtoq] = (int8_t) f;
+        continue;
+      }
+      if (lnid >= 0) {
+        mesh->ghost_to_quad[in_gtoq] = lnid;
+        mesh->ghost_to_face[in_gtoq] = (int8_t) nface;
+        continue;
+      }
+
+      /* double-size neighbor if the face lies on a face of the parent */
+      if (c >= 0 && ((c >> (f / 2)) & 1) == (f & 1)) {
+        p4est_quadrant_parent (g, &p);
+        p4est_quadrant_face_neighbor (&p, f, &n);
+        hang = c;
+        lnid = mesh_ghost_face_lookup (mesh, p4est, ghost, treeid, &n, f,
+                                       &nface, &hang);
+        if (lnid >= 0) {
+          mesh->ghost_to_quad[in_gtoq] = lnid;
+          mesh->ghost_to_face[in_gtoq] =
+            (int8_t) (P4EST_FACES * (hang + 1) * P4EST_HALF + nface);
+          continue;
+        }
+      }
+
+      /* half-size neighbors, all of which must be known */
+      if (g->level < P4EST_QMAXLEVEL) {
+        for (k = 0; k < P4EST_HALF; ++k) {
+          p4est_quadrant_child (g, &child, p4est_face_corners[f][k]);
+          p4est_quadrant_face_neighbor (&child, f, &n);
+          halfs[k] = mesh_ghost_face_lookup (mesh, p4est, ghost, treeid, &n,
+                                             f, &nface, NULL);
+          if (halfs[k] < 0) {
+            break;
+          }
+        }
+        if (k == P4EST_HALF) {
+          mesh->ghost_to_quad[in_gtoq] =
+            (p4est_locidx_t) mesh->quad_to_half->elem_count;
+          mesh->ghost_to_face[in_gtoq] =
+            (int8_t) (nface - P4EST_FACES * P4EST_HALF);
+          halfentries = (p4est_locidx_t *) sc_array_push (mesh->quad_to_half);
+          memcpy (halfentries, halfs, P4EST_HALF * sizeof (p4est_locidx_t));
+        }
+      }
+    }
+  }
+}
+
+/** Store the owner rank of every ghost quadrant. */
+static void
+mesh_ghost_to_proc (p4est_mesh_t * mesh, p4est_t * p4est,
+                    p4est_ghost_t * ghost)
+{
+  int                 rank;
+  p4est_locidx_t      jl, ng = mesh->ghost_num_quadrants;
+
+  rank = 0;
+  for (jl = 0; jl < ng; ++jl) {
+    while (ghost->proc_offsets[rank + 1] <= jl) {
+      ++rank;
+      P4EST_ASSERT (rank < p4est->mpisize);
+    }
+    mesh->ghost_to_proc[jl] = rank;
+  }
+}
+
 size_t
 p4est_mesh_memory_used (p4est_mesh_t * mesh)
 {
@@ -1209,6 +1912,28 @@ p4est_mesh_memory_used (p4est_mesh_t * mesh)
       sc_array_memory_used (mesh->corner_corner, 1);
   }
 
+  /* add compressed face information */
+  if (mesh->face_offset != NULL) {
+    all_memory +=
+      (lqz + 1) * sizeof (p4est_locidx_t) +
+      (size_t) mesh->face_offset[lqz] *
+      (sizeof (p4est_locidx_t) + 3 * sizeof (int8_t));
+  }
+
+  /* add unique face information */
+  if (mesh->face_level_offset != NULL) {
+    all_memory +=
+      (P4EST_QMAXLEVEL + 2) * sizeof (p4est_locidx_t) +
+      (size_t) mesh->local_num_faces *
+      (2 * sizeof (p4est_locidx_t) + 3 * sizeof (int8_t));
+  }
+
+  /* add ghost face information */
+  if (mesh->ghost_to_quad != NULL) {
+    all_memory +=
+      P4EST_FACES * ngz * (sizeof (p4est_locidx_t) + sizeof (int8_t));
+  }
+
   return all_memory;
 }
 
@@ -1223,6 +1948,9 @@ p4est_mesh_params_init (p4est_mesh_params_t * params)
 #ifdef P4_TO_P8
   params->edgehanging_corners = 0;
 #endif
+  params->compute_face_csr = 0;
+  params->compute_face_list = 0;
+  params->compute_ghost_faces = 0;
 }
 
 p4est_mesh_t       *
@@ -1260,10 +1988,11 @@ p4est_mesh_new_params (p4est_t * p4est, p4est_ghost_t * ghost,
   int                 do_edge = 0;
 #endif /* P4_TO_P8 */
   int                 do_volume = 0;
-  int                 rank;
+  int                 num_threads;
   p4est_locidx_t      lq, ng;
   p4est_locidx_t      jl;
   p4est_mesh_t       *mesh;
+  const double        inspect_start = p4est_inspect_start (p4est->inspect);
 
   /* check whether input condition for p4est is met */
   P4EST_ASSERT (p4est_is_balanced (p4est, params->btype));
@@ -1316,14 +2045,7 @@ p4est_mesh_new_params (p4est_t * p4est, p4est_ghost_t * ghost,
   }
 
   /* Populate ghost information */
-  rank = 0;
-  for (jl = 0; jl < ng; ++jl) {
-    while (ghost->proc_offsets[rank + 1] <= jl) {
-      ++rank;
-      P4EST_ASSERT (rank < p4est->mpisize);
-    }
-    mesh->ghost_to_proc[jl] = rank;
-  }
+  mesh_ghost_to_proc (mesh, p4est, ghost);
 
   /* Fill face arrays with default values */
   memset (mesh->quad_to_quad, (char) -1,
@@ -1360,15 +2082,44 @@ p4est_mesh_new_params (p4est_t * p4est, p4est_ghost_t * ghost,
   }
 
   /* Call the forest iterator to collect face connectivity */
-  p4est_iterate (p4est,         /* p4est */
-                 ghost,         /* ghost layer */
-                 mesh,          /* user_data */
-                 (do_volume ? mesh_iter_volume : NULL), mesh_iter_face,
+  num_threads = p4est_get_num_threads ();
+  if (num_threads > 1) {
+    mesh_iterate_threads (mesh, p4est, ghost, num_threads);
+    if (do_volume) {
+      mesh_update_volume (mesh, p4est);
+    }
+  }
+  else {
+    p4est_iterate (p4est,       /* p4est */
+                   ghost,       /* ghost layer */
+                   mesh,        /* user_data */
+                   (do_volume ? mesh_iter_volume : NULL), mesh_iter_face,
 #ifdef P4_TO_P8
-                 (do_edge ? mesh_iter_edge : NULL),
+                   (do_edge ? mesh_iter_edge : NULL),
 #endif /* P4_TO_P8 */
-                 (do_corner ? mesh_iter_corner : NULL));
+                   (do_corner ? mesh_iter_corner : NULL));
+  }
+
+  /* Optional face neighbors of the ghost quadrants */
+  if (mesh->params.compute_ghost_faces) {
+    mesh_ghost_faces (mesh, p4est, ghost);
+  }
+
+  /* Optional compressed face neighbor lists */
+  if (mesh->params.compute_face_csr) {
+    mesh_face_csr (mesh);
+  }
+
+  /* Optional list of unique faces */
+  if (mesh->params.compute_face_list) {
+    mesh_face_list (mesh, p4est);
+  }
 
+  if (p4est->inspect != NULL) {
+    p4est_inspect_memory (p4est->inspect, P4EST_INSPECT_MESH,
+                          p4est_mesh_memory_used (mesh));
+  }
+  p4est_inspect_stop (p4est->inspect, P4EST_INSPECT_MESH, inspect_start);
   return mesh;
 }
 
@@ -1409,9 +2160,335 @@ p4est_mesh_destroy (p4est_mesh_t * mesh)
     sc_array_destroy (mesh->corner_corner);
   }
 
+  if (mesh->face_offset != NULL) {
+    P4EST_FREE (mesh->face_offset);
+    P4EST_FREE (mesh->face_quad);
+    P4EST_FREE (mesh->face_face);
+    P4EST_FREE (mesh->face_nface);
+    P4EST_FREE (mesh->face_subface);
+  }
+
+  if (mesh->face_level_offset != NULL) {
+    P4EST_FREE (mesh->face_level_offset);
+    P4EST_FREE (mesh->face_to_quad);
+    P4EST_FREE (mesh->face_to_face);
+    P4EST_FREE (mesh->face_hanging);
+  }
+
+  if (mesh->ghost_to_quad != NULL) {
+    P4EST_FREE (mesh->ghost_to_quad);
+    P4EST_FREE (mesh->ghost_to_face);
+  }
+
   P4EST_FREE (mesh);
 }
 
+p4est_mesh_history_t *
+p4est_mesh_history_new (void)
+{
+  p4est_mesh_history_t *history;
+
+  history = P4EST_ALLOC (p4est_mesh_history_t, 1);
+  sc_array_init (&history->outgoing, sizeof (p4est_quadrant_t));
+  sc_array_init (&history->incoming, sizeof (p4est_quadrant_t));
+
+  return history;
+}
+
+void
+p4est_mesh_history_destroy (p4est_mesh_history_t * history)
+{
+  sc_array_reset (&history->outgoing);
+  sc_array_reset (&history->incoming);
+  P4EST_FREE (history);
+}
+
+void
+p4est_mesh_history_add (p4est_mesh_history_t * history,
+                        p4est_topidx_t which_tree,
+                        int num_outgoing, p4est_quadrant_t * outgoing[],
+                        int num_incoming, p4est_quadrant_t * incoming[])
+{
+  int                 i;
+  p4est_quadrant_t   *q;
+
+  for (i = 0; i < num_outgoing; ++i) {
+    q = (p4est_quadrant_t *) sc_array_push (&history->outgoing);
+    *q = *outgoing[i];
+    q->p.which_tree = which_tree;
+  }
+  for (i = 0; i < num_incoming; ++i) {
+    q = (p4est_quadrant_t *) sc_array_push (&history->incoming);
+    *q = *incoming[i];
+    q->p.which_tree = which_tree;
+  }
+}
+
+/** Map the local quadrants of an adapted forest to the old ones.
+ * \param [in] p4est        The adapted forest.
+ * \param [in,out] history  Its replacements; the arrays are sorted.
+ * \param [out] new_to_old  For each local quadrant its old local index,
+ *                          or -1 if it was added by the adaptation.
+ * \return                  The number of old local quadrants, or -1 if
+ *                          the history does not match the forest.
+ */
+static              p4est_locidx_t
+mesh_history_map (p4est_t * p4est, p4est_mesh_history_t * history,
+                  p4est_locidx_t * new_to_old)
+{
+  int                 cmp;
+  size_t              zo, zi, zz;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      lq, unchanged;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t    key, *q;
+  sc_array_t         *out = &history->outgoing;
+  sc_array_t         *in = &history->incoming;
+  sc_array_t          netout, netin;
+
+  /* quadrants that were added and removed again cancel */
+  sc_array_sort (out, p4est_quadrant_compare_piggy);
+  sc_array_sort (in, p4est_quadrant_compare_piggy);
+  sc_array_init (&netout, sizeof (p4est_quadrant_t));
+  sc_array_init (&netin, sizeof (p4est_quadrant_t));
+  zo = zi = 0;
+  while (zo < out->elem_count || zi < in->elem_count) {
+    if (zo == out->elem_count) {
+      cmp = 1;
+    }
+    else if (zi == in->elem_count) {
+      cmp = -1;
+    }
+    else {
+      cmp = p4est_quadrant_compare_piggy (sc_array_index (out, zo),
+                                          sc_array_index (in, zi));
+    }
+    if (cmp < 0) {
+      *(p4est_quadrant_t *) sc_array_push (&netout) =
+        *p4est_quadrant_array_index (out, zo++);
+    }
+    else if (cmp > 0) {
+      *(p4est_quadrant_t *) sc_array_push (&netin) =
+        *p4est_quadrant_array_index (in, zi++);
+    }
+    else {
+      ++zo;
+      ++zi;
+    }
+  }
+
+  /* the old index of a kept quadrant counts the kept and removed
+   * quadrants before it */
+  lq = unchanged = 0;
+  zo = zi = 0;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lq) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      key = *q;
+      key.p.which_tree = jt;
+      while (zo < netout.elem_count &&
+             p4est_quadrant_compare_piggy (sc_array_index (&netout, zo),
+                                           &key) < 0) {
+        ++zo;
+      }
+      if (zi < netin.elem_count &&
+          !p4est_quadrant_compare_piggy (sc_array_index (&netin, zi), &key)) {
+        new_to_old[lq] = -1;
+        ++zi;
+      }
+      else {
+        new_to_old[lq] = unchanged + (p4est_locidx_t) zo;
+        ++unchanged;
+      }
+    }
+  }
+  P4EST_ASSERT (lq == p4est->local_num_quadrants);
+  if (zi < netin.elem_count) {
+    unchanged = -1;
+  }
+  else {
+    unchanged += (p4est_locidx_t) netout.elem_count;
+  }
+  sc_array_reset (&netout);
+  sc_array_reset (&netin);
+
+  return unchanged;
+}
+
+/** Test whether an old neighbor index is a ghost or has been removed. */
+static int
+mesh_update_lost (p4est_locidx_t old_lq, const p4est_locidx_t * old_to_new,
+                  p4est_locidx_t qtq)
+{
+  return qtq >= old_lq || old_to_new[qtq] < 0;
+}
+
+void
+p4est_mesh_update (p4est_mesh_t * mesh, p4est_t * p4est,
+                   p4est_ghost_t * ghost, p4est_mesh_history_t * history)
+{
+  int                 f, h, skip;
+  int8_t              qtf;
+  size_t              in_qtoq;
+  p4est_locidx_t      lq, old_lq, jl, ol, qtq, num_active;
+  p4est_locidx_t     *new_to_old, *old_to_new, *active;
+  p4est_locidx_t     *quad_to_quad, *halfs, *halfentries;
+  int8_t             *quad_to_face, *is_active;
+  sc_array_t         *quad_to_half;
+  p4est_mesh_t       *rebuilt, swap;
+
+  lq = p4est->local_num_quadrants;
+  old_lq = -1;
+  new_to_old = NULL;
+  if (history != NULL && mesh->quad_to_corner == NULL
+#ifdef P4_TO_P8
+      && mesh->quad_to_edge == NULL
+#endif
+    ) {
+    new_to_old = P4EST_ALLOC (p4est_locidx_t, lq);
+    old_lq = mesh_history_map (p4est, history, new_to_old);
+  }
+  if (history != NULL) {
+    sc_array_truncate (&history->outgoing);
+    sc_array_truncate (&history->incoming);
+  }
+  if (old_lq != mesh->local_num_quadrants) {
+    /* no usable history: rebuild the mesh and swap the contents */
+    P4EST_FREE (new_to_old);
+    rebuilt = p4est_mesh_new_params (p4est, ghost, &mesh->params);
+    swap = *mesh;
+    *mesh = *rebuilt;
+    *rebuilt = swap;
+    p4est_mesh_destroy (rebuilt);
+    return;
+  }
+  old_to_new = P4EST_ALLOC (p4est_locidx_t, old_lq);
+  for (ol = 0; ol < old_lq; ++ol) {
+    old_to_new[ol] = -1;
+  }
+  for (jl = 0; jl < lq; ++jl) {
+    if (new_to_old[jl] >= 0) {
+      old_to_new[new_to_old[jl]] = jl;
+    }
+  }
+
+  /* a quadrant is recomputed if it is new or has a new or ghost neighbor */
+  is_active = P4EST_ALLOC (int8_t, lq);
+  num_active = 0;
+  for (jl = 0; jl < lq; ++jl) {
+    ol = new_to_old[jl];
+    is_active[jl] = (int8_t) (ol < 0);
+    for (f = 0; !is_active[jl] && f < P4EST_FACES; ++f) {
+      qtq = mesh->quad_to_quad[P4EST_FACES * ol + f];
+      qtf = mesh->quad_to_face[P4EST_FACES * ol + f];
+      if (qtf >= 0) {
+        is_active[jl] = (int8_t) mesh_update_lost (old_lq, old_to_new, qtq);
+      }
+      else {
+        halfs = (p4est_locidx_t *) sc_array_index (mesh->quad_to_half,
+                                                   (size_t) qtq);
+        for (h = 0; h < P4EST_HALF; ++h) {
+          if (mesh_update_lost (old_lq, old_to_new, halfs[h])) {
+            is_active[jl] = 1;
+          }
+        }
+      }
+    }
+    num_active += is_active[jl];
+  }
+
+  /* copy the faces between kept quadrants that are not recomputed */
+  quad_to_quad = P4EST_ALLOC (p4est_locidx_t, P4EST_FACES * lq);
+  quad_to_face = P4EST_ALLOC (int8_t, P4EST_FACES * lq);
+  quad_to_half = sc_array_new (P4EST_HALF * sizeof (p4est_locidx_t));
+  active = P4EST_ALLOC (p4est_locidx_t, num_active);
+  num_active = 0;
+  for (jl = 0; jl < lq; ++jl) {
+    if (is_active[jl]) {
+      active[num_active++] = jl;
+    }
+    ol = new_to_old[jl];
+    for (f = 0; f < P4EST_FACES; ++f) {
+      in_qtoq = (size_t) (P4EST_FACES * jl + f);
+      quad_to_quad[in_qtoq] = -1;
+      quad_to_face[in_qtoq] = -25;
+      if (is_active[jl]) {
+        continue;
+      }
+      qtq = mesh->quad_to_quad[P4EST_FACES * ol + f];
+      qtf = mesh->quad_to_face[P4EST_FACES * ol + f];
+      if (qtf >= 0) {
+        if (!is_active[old_to_new[qtq]]) {
+          quad_to_quad[in_qtoq] = old_to_new[qtq];
+          quad_to_face[in_qtoq] = qtf;
+        }
+      }
+      else {
+        halfs = (p4est_locidx_t *) sc_array_index (mesh->quad_to_half,
+                                                   (size_t) qtq);
+        for (skip = 0, h = 0; h < P4EST_HALF; ++h) {
+          skip = skip || is_active[old_to_new[halfs[h]]];
+        }
+        if (!skip) {
+          quad_to_quad[in_qtoq] = (p4est_locidx_t) quad_to_half->elem_count;
+          quad_to_face[in_qtoq] = qtf;
+          halfentries = (p4est_locidx_t *) sc_array_push (quad_to_half);
+          for (h = 0; h < P4EST_HALF; ++h) {
+            halfentries[h] = old_to_new[halfs[h]];
+          }
+        }
+      }
+    }
+  }
+  P4EST_FREE (is_active);
+  P4EST_FREE (old_to_new);
+  P4EST_FREE (new_to_old);
+
+  /* install the new arrays and recompute the remaining faces */
+  P4EST_FREE (mesh->quad_to_quad);
+  P4EST_FREE (mesh->quad_to_face);
+  sc_array_destroy (mesh->quad_to_half);
+  mesh->quad_to_quad = quad_to_quad;
+  mesh->quad_to_face = quad_to_face;
+  mesh->quad_to_half = quad_to_half;
+  mesh->local_num_quadrants = lq;
+  mesh->ghost_num_quadrants = (p4est_locidx_t) ghost->ghosts.elem_count;
+  mesh->ghost_to_proc = P4EST_REALLOC (mesh->ghost_to_proc, int,
+                                       mesh->ghost_num_quadrants);
+  mesh_ghost_to_proc (mesh, p4est, ghost);
+  p4est_iterate_active (p4est, ghost, mesh, active, num_active,
+                        NULL, mesh_iter_face,
+#ifdef P4_TO_P8
+                        NULL,
+#endif
+                        NULL);
+  P4EST_FREE (active);
+
+  /* refresh the derived lists */
+  mesh_update_volume (mesh, p4est);
+  if (mesh->ghost_to_quad != NULL) {
+    P4EST_FREE (mesh->ghost_to_quad);
+    P4EST_FREE (mesh->ghost_to_face);
+    mesh_ghost_faces (mesh, p4est, ghost);
+  }
+  if (mesh->face_offset != NULL) {
+    P4EST_FREE (mesh->face_offset);
+    P4EST_FREE (mesh->face_quad);
+    P4EST_FREE (mesh->face_face);
+    P4EST_FREE (mesh->face_nface);
+    P4EST_FREE (mesh->face_subface);
+    mesh_face_csr (mesh);
+  }
+  if (mesh->face_level_offset != NULL) {
+    P4EST_FREE (mesh->face_level_offset);
+    P4EST_FREE (mesh->face_to_quad);
+    P4EST_FREE (mesh->face_to_face);
+    P4EST_FREE (mesh->face_hanging);
+    mesh_face_list (mesh, p4est);
+  }
+}
+
 /************************* accessor functions ************************/
 
 p4est_quadrant_t   *
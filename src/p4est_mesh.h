@@ -62,6 +62,16 @@ typedef struct
   p4est_connect_type_t btype;                 /**< Flag indicating the
                                                    connection types (face, edge,
                                                    corner) stored in the mesh. */
+  int                 compute_face_csr;       /**< Boolean to decide whether to
+                                                   compute the face neighbors
+                                                   in face_offset and friends. */
+  int                 compute_face_list;      /**< Boolean to decide whether to
+                                                   compute the unique faces
+                                                   in face_to_quad and friends. */
+  int                 compute_ghost_faces;    /**< Boolean to decide whether to
+                                                   compute the face neighbors
+                                                   of ghosts in ghost_to_quad
+                                                   and ghost_to_face. */
 }
 p4est_mesh_params_t;
 
@@ -122,6 +132,42 @@ p4est_mesh_params_t;
  * only happens on the domain boundary, which is necessarily a tree boundary.
  * Corner-neighbors for hanging nodes are assigned the value -1.
  *
+ * If compute_face_csr in params is true, the face neighbors are also stored
+ * in compressed sparse row format, one entry per neighbor, such that a loop
+ * over all neighbors of a quadrant needs no decoding of quad_to_face.  The
+ * entries of local quadrant q are face_offset[q] .. face_offset[q + 1] - 1,
+ * sorted by face and subface; faces on the domain boundary have no entry.
+ * For entry i, face_quad[i] is the neighbor encoded as in quad_to_quad,
+ * face_face[i] = 0..3 is the face of q, face_nface[i] = r * 4 + nf
+ * is the neighbor's face and orientation as for a same-size quad_to_face
+ * value, and face_subface[i] is -1 for a same-size neighbor, h = 0..1
+ * for a half-size neighbor on subface h of the face of q, and 2 + h for
+ * a double-size neighbor whose subface h is touched by q.
+ *
+ * If compute_face_list in params is true, each face between a local
+ * quadrant and a neighbor is also stored once in a list of unique faces.
+ * A hanging face contributes one entry per small quadrant, and each face
+ * on the domain boundary contributes one entry.  For face i, the left
+ * side face_to_quad[2 * i] is always a local quadrant and the right side
+ * face_to_quad[2 * i + 1] is encoded as in quad_to_quad, or -1 on the
+ * domain boundary.  Two local sides are ordered such that the smaller
+ * quadrant or, for equal size, the smaller quadrant number is left.
+ * face_to_face[2 * i] = 0..3 is the face of the left quadrant and
+ * face_to_face[2 * i + 1] = r * 4 + nf is the right quadrant's face and
+ * orientation as for a same-size quad_to_face value, or -1 on the domain
+ * boundary.  face_hanging[i] encodes the sizes as face_subface does.
+ * The list is sorted by the level of the smaller side, such that the
+ * faces of level l are face_level_offset[l] .. face_level_offset[l + 1] - 1
+ * in correspondence with the level lists in quad_level.
+ *
+ * If compute_ghost_faces in params is true, the face neighbors of the ghost
+ * quadrants are stored in ghost_to_quad and ghost_to_face, 4 entries per
+ * ghost, restricted to the local and ghost quadrants known to this process.
+ * The values are encoded as for quad_to_quad and quad_to_face, and pairs
+ * of half-size neighbors are appended to quad_to_half.  A neighbor that is
+ * not a local or ghost quadrant has a ghost_to_quad value of -1, in which
+ * case the ghost_to_face value is -25 and has no meaning.
+ *
  * The params struct describes the parameters the mesh was created with.
  * For full control over the parameters, use \ref p8est_mesh_new_params for
  * mesh creation.
@@ -155,6 +201,25 @@ typedef struct
   sc_array_t         *corner_quad;      /**< corner_offset indexes into this */
   sc_array_t         *corner_corner;    /**< and this one too (type int8_t) */
 
+  /* These members are NULL if compute_face_csr in params is 0. */
+  p4est_locidx_t     *face_offset;      /**< local_num_quadrants + 1 entries */
+  p4est_locidx_t     *face_quad;        /**< face_offset indexes into this */
+  int8_t             *face_face;        /**< and this one */
+  int8_t             *face_nface;       /**< and this one */
+  int8_t             *face_subface;     /**< and this one too */
+
+  /* These members are NULL if compute_face_list in params is 0. */
+  p4est_locidx_t      local_num_faces;  /**< number of unique faces */
+  p4est_locidx_t     *face_level_offset;        /**< P4EST_QMAXLEVEL + 2
+                                                     offsets into the faces */
+  p4est_locidx_t     *face_to_quad;     /**< two quadrants for each face */
+  int8_t             *face_to_face;     /**< two face codes for each face */
+  int8_t             *face_hanging;     /**< hanging status of each face */
+
+  /* These members are NULL if compute_ghost_faces in params is 0. */
+  p4est_locidx_t     *ghost_to_quad;    /**< one index for each ghost face */
+  int8_t             *ghost_to_face;    /**< encoded as quad_to_face */
+
   p4est_mesh_params_t params;           /**< parameters the mesh was created
                                              with, e.g. by passing them to
                                              \ref p4est_mesh_new_ext or
@@ -211,6 +276,10 @@ p4est_mesh_t       *p4est_mesh_new (p4est_t * p4est,
                                     p4est_connect_type_t btype);
 
 /** Create a new mesh.
+ * With more than one thread set by \ref p4est_set_num_threads, the neighbors
+ * are found by the threads.  Then the entries of quad_to_half and the corner
+ * groups are numbered in the order of the links that refer to them, which
+ * does not depend on the number of threads.
  * \param [in] p4est    A forest that is fully 2:1 balanced.
  * \param [in] ghost    The ghost layer created from the provided p4est.
  * \param [in] params   The mesh creation parameters. If NULL, the function
@@ -226,6 +295,56 @@ p4est_mesh_t       *p4est_mesh_new_params (p4est_t * p4est,
  */
 void                p4est_mesh_destroy (p4est_mesh_t * mesh);
 
+/** The quadrants replaced by an adaptation of the forest, as needed by
+ * \ref p4est_mesh_update.  Both arrays hold copies of quadrants with
+ * their tree number in p.which_tree.
+ */
+typedef struct p4est_mesh_history
+{
+  sc_array_t          outgoing; /**< Quadrants removed from the forest */
+  sc_array_t          incoming; /**< Quadrants added to the forest */
+}
+p4est_mesh_history_t;
+
+/** Create an empty adaptation history. */
+p4est_mesh_history_t *p4est_mesh_history_new (void);
+
+/** Destroy an adaptation history. */
+void                p4est_mesh_history_destroy (p4est_mesh_history_t *
+                                                  history);
+
+/** Record one replacement of quadrants in an adaptation history.
+ * The arguments match those of a p4est_replace_t callback, such that this
+ * function can be called from the replace callback of refine, coarsen and
+ * balance.  Quadrants that are added and removed again, for example by
+ * recursive refinement, are recognized by \ref p4est_mesh_update.
+ */
+void                p4est_mesh_history_add (p4est_mesh_history_t * history,
+                                              p4est_topidx_t which_tree,
+                                              int num_outgoing,
+                                              p4est_quadrant_t * outgoing[],
+                                              int num_incoming,
+                                              p4est_quadrant_t * incoming[]);
+
+/** Update a mesh after the forest has been adapted.
+ * The face neighbor information is recomputed only for the new quadrants,
+ * their neighbors and the quadrants next to a ghost, and copied for all
+ * other quadrants.  The tree index, level lists and compressed face lists
+ * are refreshed if present.  If the mesh stores corner neighbors,
+ * or if \a history is NULL, the mesh is rebuilt from scratch; this is
+ * required after the forest has been partitioned.
+ * \param [in,out] mesh    A mesh of the forest before adaptation, which is
+ *                         changed into a mesh of the adapted forest.
+ * \param [in] p4est       The adapted forest; it must not have been
+ *                         partitioned since the mesh was created.
+ * \param [in] ghost       The ghost layer of the adapted forest.
+ * \param [in,out] history All replacements since the mesh was created,
+ *                         or NULL.  It is emptied on output.
+ */
+void                p4est_mesh_update (p4est_mesh_t * mesh, p4est_t * p4est,
+                                         p4est_ghost_t * ghost,
+                                         p4est_mesh_history_t * history);
+
 /** Access a process-local quadrant inside a forest.
  * Needs a mesh with populated quad_to_tree array.
  * This is a special case of \ref p4est_mesh_quadrant_cumulative.
@@ -373,6 +492,60 @@ p4est_quadrant_t   *p4est_mesh_face_neighbor_next (p4est_mesh_face_neighbor_t
 void               *p4est_mesh_face_neighbor_data (p4est_mesh_face_neighbor_t
                                                    * mfn, void *ghost_data);
 
+/** Decode the face neighbors of a local quadrant across one of its faces.
+ * This is an inline alternative to \ref p4est_mesh_face_neighbor_next
+ * for loops over mesh indices.  For a same-size or double-size neighbor
+ * it reads one entry each of quad_to_quad and quad_to_face, and only
+ * the half-size case looks into quad_to_half.
+ * \param [in] mesh      A mesh derived from a forest.
+ * \param [in] qid       Local quadrant number in 0..local_num_quadrants-1.
+ * \param [in] face      Face of the quadrant in 0..3.
+ * \param [out] nquad    Filled with the neighbors encoded as in quad_to_quad,
+ *                       half-size ones in the order of the face corners.
+ * \param [out] nsubface Filled for each neighbor with -1 if same-size,
+ *                       h = 0..1 for a half-size neighbor on subface h,
+ *                       and 2 + h for a double-size neighbor whose
+ *                       subface h is touched by the quadrant.
+ * \param [out] nface    The neighbors' face and orientation r * 4 + nf
+ *                       as for a same-size quad_to_face value.
+ * \return               The number of neighbors, that is 1 or 2, or 0
+ *                       on the domain boundary.
+ */
+/*@unused@*/
+static inline int
+p4est_mesh_face_neighbors (const p4est_mesh_t * mesh, p4est_locidx_t qid,
+                           int face, p4est_locidx_t nquad[P4EST_HALF],
+                           int8_t nsubface[P4EST_HALF], int *nface)
+{
+  const size_t        in_qtoq = (size_t) (P4EST_FACES * qid + face);
+  const p4est_locidx_t qtq = mesh->quad_to_quad[in_qtoq];
+  const int           qtf = (int) mesh->quad_to_face[in_qtoq];
+  const p4est_locidx_t *halfs;
+  int                 h, size;
+
+  P4EST_ASSERT (0 <= qid && qid < mesh->local_num_quadrants);
+  P4EST_ASSERT (0 <= face && face < P4EST_FACES);
+
+  if (qtf >= 0) {
+    if (qtq == qid && qtf == face) {
+      return 0;
+    }
+    size = qtf / (P4EST_HALF * P4EST_FACES);
+    nquad[0] = qtq;
+    nsubface[0] = (int8_t) (size ? P4EST_HALF + size - 1 : -1);
+    *nface = qtf % (P4EST_HALF * P4EST_FACES);
+    return 1;
+  }
+  halfs = (const p4est_locidx_t *)
+    sc_array_index (mesh->quad_to_half, (size_t) qtq);
+  for (h = 0; h < P4EST_HALF; ++h) {
+    nquad[h] = halfs[h];
+    nsubface[h] = (int8_t) h;
+  }
+  *nface = qtf + P4EST_HALF * P4EST_FACES;
+  return P4EST_HALF;
+}
+
 SC_EXTERN_C_END;
 
 #endif /* !P4EST_MESH_H */
@@ -274,7 +274,7 @@ p4est_node_canonicalize (p4est_t * p4est, p4est_topidx_t treeid,
   p4est_connectivity_t *conn = p4est->connectivity;
   int                 face_axis[3];     /* 3 not P4EST_DIM */
   int                 quad_contact[P4EST_FACES];
-  int                 contacts, face, corner;
+  int                 contacts, face, nface, corner;
   int                 ftransform[P4EST_FTRANSFORM];
   size_t              ctreez;
   p4est_topidx_t      ntreeid, lowest;
@@ -328,9 +328,9 @@ p4est_node_canonicalize (p4est_t * p4est, p4est_topidx_t treeid,
       /* The node is not touching this face */
       continue;
     }
-    ntreeid = conn->tree_to_tree[P4EST_FACES * treeid + face];
-    if (ntreeid == treeid
-        && ((int) conn->tree_to_face[P4EST_FACES * treeid + face] == face)) {
+    ntreeid = p4est_connectivity_face_neighbor_tree (conn, treeid, face,
+                                                     &nface);
+    if (ntreeid == treeid && nface == face) {
       /* The node touches a face with no neighbor */
       continue;
     }
@@ -446,14 +446,55 @@ endfunction:
   P4EST_ASSERT (c->p.which_tree >= 0 && c->p.which_tree < conn->num_trees);
 }
 
-static int
-p4est_nodes_foreach (void **item, const void *u)
+/** Sort node keys and find the runs of equal nodes.
+ * \param [in,out] keys  Canonicalized nodes whose piggy3.local_num holds
+ *                       the index into local_nodes they were created for.
+ *                       Sorted by tree and z-order on output.
+ * \param [out] runs     Resized to one more than the number of distinct
+ *                       nodes; run i covers keys runs[i] to runs[i+1] - 1.
+ * \return               The number of distinct nodes.
+ */
+static              p4est_locidx_t
+p4est_nodes_sort_merge (sc_array_t * keys, sc_array_t * runs)
 {
-  const p4est_locidx_t *new_node_number = (const p4est_locidx_t *) u;
+  size_t              zz, count = keys->elem_count;
+  p4est_quadrant_t   *prev, *key;
+
+  sc_array_sort (keys, p4est_quadrant_compare_piggy);
+  sc_array_truncate (runs);
+  prev = NULL;
+  for (zz = 0; zz < count; ++zz) {
+    key = p4est_quadrant_array_index (keys, zz);
+    if (prev == NULL || p4est_quadrant_compare_piggy (prev, key)) {
+      *(size_t *) sc_array_push (runs) = zz;
+    }
+    prev = key;
+  }
+  *(size_t *) sc_array_push (runs) = count;
 
-  *item = (void *) (size_t) new_node_number[(size_t) *item];
+  return (p4est_locidx_t) (runs->elem_count - 1);
+}
 
-  return 1;
+/** Assign the numbers of the distinct nodes to the corners of the elements.
+ * \param [in] keys      Sorted by \ref p4est_nodes_sort_merge.
+ * \param [in] runs      Output of \ref p4est_nodes_sort_merge.
+ * \param [in] offset    Number of the first node of this kind.
+ * \param [out] local_nodes     The corners referenced by the keys are set.
+ */
+static void
+p4est_nodes_assign_runs (sc_array_t * keys, sc_array_t * runs,
+                         p4est_locidx_t offset, p4est_locidx_t * local_nodes)
+{
+  size_t              zz, zr;
+  p4est_quadrant_t   *key;
+
+  for (zr = 0; zr + 1 < runs->elem_count; ++zr) {
+    for (zz = *(size_t *) sc_array_index (runs, zr);
+         zz < *(size_t *) sc_array_index (runs, zr + 1); ++zz) {
+      key = p4est_quadrant_array_index (keys, zz);
+      local_nodes[key->p.piggy3.local_num] = offset + (p4est_locidx_t) zr;
+    }
+  }
 }
 
 #ifdef P4EST_ENABLE_MPI
@@ -498,6 +539,7 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
   int                *old_sharers, *new_sharers;
   char               *this_base;
   size_t              first_size, second_size, this_size;
+  size_t              position;
   size_t              num_sharers, old_position, new_position;
   p4est_qcoord_t     *xyz;
   p4est_topidx_t     *ttt;
@@ -515,43 +557,37 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
 #endif
   int                 k;
   int                 qcid, face;
-  int                 clamped = 1;
-  void               *save_user_data;
-  size_t              zz, position;
+  size_t              zz, zr;
   int8_t             *local_status, *quad_status;
   p4est_topidx_t      jt;
   p4est_locidx_t      il, first, second;
-  p4est_locidx_t      num_local_nodes, quad_indeps[P4EST_CHILDREN];
+  p4est_locidx_t      num_local_nodes;
   p4est_locidx_t      num_owned_shared, num_owned_indeps;
   p4est_locidx_t      offset_owned_indeps;
   p4est_locidx_t      num_indep_nodes, dup_indep_nodes, all_face_hangings;
   p4est_locidx_t      num_face_hangings, dup_face_hangings;
   p4est_locidx_t     *local_nodes, *quad_nodes;
-  p4est_locidx_t     *new_node_number;
+  p4est_locidx_t      slot;
   p4est_tree_t       *tree;
   p4est_nodes_t      *nodes;
   p4est_quadrant_t    c, n, p;
-  p4est_quadrant_t   *q, *qpp[3], *r;
+  p4est_quadrant_t   *q, *qpp[3], *key;
   p4est_indep_t      *in;
   sc_array_t         *quadrants;
   sc_array_t         *inda, *faha;
   sc_array_t         *shared_indeps;
-  sc_hash_array_t    *indep_nodes;
-  sc_hash_array_t    *face_hangings;
+  sc_array_t         *indep_keys, *face_keys;
+  sc_array_t         *indep_runs, *face_runs;
 #ifndef P4_TO_P8
   p4est_hang2_t      *fh;
 #else
   int                 edge, corner;
-#ifdef P4EST_ENABLE_DEBUG
-  p4est_locidx_t      num_face_hangings_end;
-#endif
-  p4est_locidx_t      num_edge_hangings_begin;
   p4est_locidx_t      num_edge_hangings, dup_edge_hangings;
   p8est_hang4_t      *fh;
   p8est_hang2_t      *eh;
   sc_array_t          exist_array;
   sc_array_t         *edha;
-  sc_hash_array_t    *edge_hangings;
+  sc_array_t         *edge_keys, *edge_runs;
 #endif
 
   if (ghost == NULL)
@@ -595,22 +631,24 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
     P4EST_ALLOC (p4est_locidx_t, num_local_nodes);
   memset (local_nodes, -1, num_local_nodes * sizeof (*local_nodes));
 
-  indep_nodes = sc_hash_array_new (sizeof (p4est_indep_t),
-                                   p4est_node_hash_piggy_fn,
-                                   p4est_node_equal_piggy_fn, &clamped);
+  /* Nodes are deduplicated by sorting keys that remember their element
+   * corner and merging runs of equal keys.  One run is one node. */
+  inda = &nodes->indep_nodes;
+  sc_array_init (inda, sizeof (p4est_indep_t));
 #ifndef P4_TO_P8
-  face_hangings = sc_hash_array_new (sizeof (p4est_hang2_t),
-                                     p4est_node_hash_piggy_fn,
-                                     p4est_node_equal_piggy_fn, &clamped);
+  sc_array_init (faha, sizeof (p4est_hang2_t));
 #else
-  face_hangings = sc_hash_array_new (sizeof (p8est_hang4_t),
-                                     p4est_node_hash_piggy_fn,
-                                     p4est_node_equal_piggy_fn, &clamped);
-  edge_hangings = sc_hash_array_new (sizeof (p8est_hang2_t),
-                                     p4est_node_hash_piggy_fn,
-                                     p4est_node_equal_piggy_fn, &clamped);
+  sc_array_init (faha, sizeof (p8est_hang4_t));
+  sc_array_init (edha, sizeof (p8est_hang2_t));
   sc_array_init (&exist_array, sizeof (int));
+  edge_keys = sc_array_new (sizeof (p4est_quadrant_t));
+  edge_runs = sc_array_new (sizeof (size_t));
 #endif
+  indep_keys = sc_array_new_size (sizeof (p4est_quadrant_t),
+                                  (size_t) num_local_nodes);
+  face_keys = sc_array_new (sizeof (p4est_quadrant_t));
+  indep_runs = sc_array_new (sizeof (size_t));
+  face_runs = sc_array_new (sizeof (size_t));
 
   /* This first loop will fill the local_status array with hanging status.
    * It will also collect all independent nodes relevant for the elements.
@@ -687,56 +725,33 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
       for (k = 0; k < P4EST_CHILDREN; ++k) {
         P4EST_ASSERT (quad_status[k] >= 0 || quad_status[k] <= 2);
         p4est_quadrant_corner_node (qpp[quad_status[k]], k, &n);
-        p4est_node_canonicalize (p4est, jt, &n, &c);
-        r =
-          (p4est_quadrant_t *) sc_hash_array_insert_unique (indep_nodes, &c,
-                                                            &position);
-        if (r != NULL) {
-          *r = c;
-          P4EST_ASSERT (num_indep_nodes == (p4est_locidx_t) position);
-          ++num_indep_nodes;
-        }
-        else {
-          ++dup_indep_nodes;
-        }
-        P4EST_ASSERT ((p4est_locidx_t) position < num_indep_nodes);
-        quad_nodes[k] = (p4est_locidx_t) position;
+        slot = (p4est_locidx_t) (quad_nodes - local_nodes) + k;
+        key = p4est_quadrant_array_index (indep_keys, (size_t) slot);
+        p4est_node_canonicalize (p4est, jt, &n, key);
+        key->p.piggy3.local_num = slot;
       }
     }
   }
-  P4EST_ASSERT (num_indep_nodes + dup_indep_nodes == num_local_nodes);
 #ifdef P4_TO_P8
   sc_array_reset (&exist_array);
 #endif
-  inda = &indep_nodes->a;
-  P4EST_ASSERT (num_indep_nodes == (p4est_locidx_t) inda->elem_count);
 
-  /* Reorder independent nodes by their global treeid and z-order index. */
-  new_node_number = P4EST_ALLOC (p4est_locidx_t, num_indep_nodes);
+  /* Number independent nodes by their global treeid and z-order index. */
+  num_indep_nodes = p4est_nodes_sort_merge (indep_keys, indep_runs);
+  dup_indep_nodes = num_local_nodes - num_indep_nodes;
+  p4est_nodes_assign_runs (indep_keys, indep_runs, 0, local_nodes);
+  sc_array_resize (inda, (size_t) num_indep_nodes);
   for (il = 0; il < num_indep_nodes; ++il) {
     in = (p4est_indep_t *) sc_array_index (inda, (size_t) il);
+    key = p4est_quadrant_array_index
+      (indep_keys, *(size_t *) sc_array_index (indep_runs, (size_t) il));
+    *(p4est_quadrant_t *) in = *key;
     in->pad8 = 0;               /* shared by 0 other processors so far */
     in->pad16 = (int16_t) (-1);
     in->p.piggy3.local_num = il;
   }
-  sc_array_sort (inda, p4est_quadrant_compare_piggy);
-  for (il = 0; il < num_indep_nodes; ++il) {
-    in = (p4est_indep_t *) sc_array_index (inda, (size_t) il);
-    new_node_number[in->p.piggy3.local_num] = il;
-#ifndef P4EST_ENABLE_MPI
-    in->p.piggy3.local_num = il;
-#endif
-  }
-
-  /* Re-synchronize hash array and local nodes */
-  save_user_data = indep_nodes->user_data;
-  indep_nodes->user_data = new_node_number;
-  sc_hash_array_foreach (indep_nodes, p4est_nodes_foreach);
-  indep_nodes->user_data = save_user_data;
-  for (il = 0; il < num_local_nodes; ++il) {
-    P4EST_ASSERT (local_nodes[il] >= 0 && local_nodes[il] < num_indep_nodes);
-    local_nodes[il] = new_node_number[local_nodes[il]];
-  }
+  sc_array_destroy (indep_keys);
+  sc_array_destroy (indep_runs);
 #ifndef P4EST_ENABLE_MPI
   num_owned_indeps = num_indep_nodes;
   offset_owned_indeps = 0;
@@ -745,7 +760,6 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
   offset_owned_indeps = -1;     /* will be computed below */
 #endif
   num_owned_shared = 0;
-  P4EST_FREE (new_node_number);
 
 #ifdef P4EST_ENABLE_MPI
   /* Fill send buffers and number owned nodes. */
@@ -902,14 +916,14 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
 #endif
       ttt = (p4est_topidx_t *) (&xyz[P4EST_DIM]);
       inkey.p.which_tree = *ttt;
-      P4EST_EXECUTE_ASSERT_TRUE (sc_hash_array_lookup
-                                 (indep_nodes, &inkey, &position));
+      position = (size_t) sc_array_bsearch (inda, &inkey,
+                                            p4est_quadrant_compare_piggy);
       P4EST_ASSERT ((p4est_locidx_t) position >= offset_owned_indeps &&
                     (p4est_locidx_t) position < end_owned_indeps);
       node_number = (p4est_locidx_t *) xyz;
       *node_number = (p4est_locidx_t) position - offset_owned_indeps;
       in = (p4est_indep_t *) sc_array_index (inda, position);
-      P4EST_ASSERT (p4est_node_equal_piggy_fn (&inkey, in, &clamped));
+      P4EST_ASSERT (!p4est_quadrant_compare_piggy (&inkey, in));
       P4EST_ASSERT (in->pad8 >= 0);
       num_sharers = (size_t) in->pad8;
       P4EST_ASSERT (num_sharers <= shared_indeps->elem_count);
@@ -1011,12 +1025,7 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
   }
 #endif /* P4EST_ENABLE_MPI */
 
-  /* This second loop will collect and assign all hanging nodes. */
-  num_face_hangings = dup_face_hangings = 0;    /* still unknown */
-#ifdef P4_TO_P8
-  num_edge_hangings = dup_edge_hangings = 0;    /* still unknown */
-  num_edge_hangings_begin = num_indep_nodes + all_face_hangings;
-#endif
+  /* This second loop will collect all hanging nodes. */
   quad_nodes = local_nodes;
   quad_status = local_status;
   for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
@@ -1029,131 +1038,131 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
       q = p4est_quadrant_array_index (quadrants, zz);
       qcid = p4est_quadrant_child_id (q);
 
-      /* create hanging nodes and assign related independent nodes */
-      memcpy (quad_indeps, quad_nodes, P4EST_CHILDREN * sizeof (*quad_nodes));
+      /* remember the element corner and its child id with each node */
       for (k = 0; k < P4EST_CHILDREN; ++k) {
         if (quad_status[k] == 1) {
-          P4EST_ASSERT (qcid != k && quad_indeps[qcid] != quad_indeps[k]);
+          P4EST_ASSERT (qcid != k && quad_nodes[qcid] != quad_nodes[k]);
           P4EST_ASSERT (p4est_child_corner_faces[qcid][k] >= 0);
-          p4est_quadrant_corner_node (q, k, &n);
-          p4est_node_canonicalize (p4est, jt, &n, &c);
-          r =
-            (p4est_quadrant_t *) sc_hash_array_insert_unique (face_hangings,
-                                                              &c, &position);
-          if (r != NULL) {
-            *r = c;
-            P4EST_ASSERT (num_face_hangings == (p4est_locidx_t) position);
-#ifndef P4_TO_P8
-            fh = (p4est_hang2_t *) r;
-            first = quad_indeps[qcid];
-            second = quad_indeps[k];
-            if (first < second) {
-              fh->p.piggy.depends[0] = first;
-              fh->p.piggy.depends[1] = second;
-            }
-            else {
-              fh->p.piggy.depends[0] = second;
-              fh->p.piggy.depends[1] = first;
-            }
-#else
-            fh = (p8est_hang4_t *) r;
-            fh->p.piggy.depends[0] = quad_indeps[qcid];
-            fh->p.piggy.depends[1] = quad_indeps[k];
-            fh->p.piggy.depends[2] = -1;
-            fh->p.piggy.depends[3] = -1;
-            face = p8est_child_corner_faces[qcid][k];
-            for (l = 0; l < 4; ++l) {
-              corner = p8est_face_corners[face][l];
-              if (corner != qcid && corner != k) {
-                if (fh->p.piggy.depends[2] == -1) {
-                  fh->p.piggy.depends[2] = quad_indeps[corner];
-                }
-                else {
-                  P4EST_ASSERT (fh->p.piggy.depends[3] == -1);
-                  fh->p.piggy.depends[3] = quad_indeps[corner];
-                }
-              }
-            }
-            qsort (fh->p.piggy.depends,
-                   4, sizeof (p4est_locidx_t), p4est_locidx_compare);
-#endif
-            ++num_face_hangings;
-          }
-          else {
-            ++dup_face_hangings;
-          }
-          quad_nodes[k] =       /* same type */
-            num_indep_nodes + (p4est_locidx_t) position;
+          key = (p4est_quadrant_t *) sc_array_push (face_keys);
         }
 #ifdef P4_TO_P8
         else if (quad_status[k] == 2) {
-          P4EST_ASSERT (qcid != k && quad_indeps[qcid] != quad_indeps[k]);
+          P4EST_ASSERT (qcid != k && quad_nodes[qcid] != quad_nodes[k]);
           P4EST_ASSERT (p8est_child_corner_edges[qcid][k] >= 0);
-          p4est_quadrant_corner_node (q, k, &n);
-          p4est_node_canonicalize (p4est, jt, &n, &c);
-          r =
-            (p4est_quadrant_t *) sc_hash_array_insert_unique (edge_hangings,
-                                                              &c, &position);
-          if (r != NULL) {
-            *r = c;
-            P4EST_ASSERT (num_edge_hangings == (p4est_locidx_t) position);
-            eh = (p8est_hang2_t *) r;
-            first = quad_indeps[qcid];
-            second = quad_indeps[k];
-            if (first < second) {
-              eh->p.piggy.depends[0] = first;
-              eh->p.piggy.depends[1] = second;
-            }
-            else {
-              eh->p.piggy.depends[0] = second;
-              eh->p.piggy.depends[1] = first;
-            }
-            ++num_edge_hangings;
-          }
-          else {
-            ++dup_edge_hangings;
-          }
-          quad_nodes[k] =       /* same type */
-            num_edge_hangings_begin + (p4est_locidx_t) position;
+          key = (p4est_quadrant_t *) sc_array_push (edge_keys);
         }
 #endif
+        else {
+          continue;
+        }
+        p4est_quadrant_corner_node (q, k, &n);
+        p4est_node_canonicalize (p4est, jt, &n, key);
+        key->pad8 = (int8_t) qcid;
+        key->p.piggy3.local_num = (p4est_locidx_t) (quad_nodes - local_nodes)
+          + k;
       }
     }
   }
-  P4EST_ASSERT (num_face_hangings + dup_face_hangings == all_face_hangings);
+  P4EST_ASSERT ((p4est_locidx_t) face_keys->elem_count == all_face_hangings);
   P4EST_FREE (local_status);
-  sc_hash_array_rip (face_hangings, faha);
-  P4EST_ASSERT (num_face_hangings == (p4est_locidx_t) faha->elem_count);
-#ifdef P4_TO_P8
-  sc_hash_array_rip (edge_hangings, edha);
-  P4EST_ASSERT (num_edge_hangings == (p4est_locidx_t) edha->elem_count);
 
-  /* Correct the offsets of edge hanging nodes */
-#ifdef P4EST_ENABLE_DEBUG
-  num_face_hangings_end = num_indep_nodes + num_face_hangings;
+  /* The first element corner of each hanging node determines the
+   * independent nodes it depends on, which local_nodes still contains. */
+  num_face_hangings = p4est_nodes_sort_merge (face_keys, face_runs);
+  dup_face_hangings = all_face_hangings - num_face_hangings;
+  sc_array_resize (faha, (size_t) num_face_hangings);
+  for (zr = 0; zr < (size_t) num_face_hangings; ++zr) {
+    key = p4est_quadrant_array_index
+      (face_keys, *(size_t *) sc_array_index (face_runs, zr));
+    qcid = (int) key->pad8;
+    k = (int) (key->p.piggy3.local_num % P4EST_CHILDREN);
+    quad_nodes = local_nodes + (key->p.piggy3.local_num - k);
+#ifndef P4_TO_P8
+    fh = (p4est_hang2_t *) sc_array_index (faha, zr);
+    *(p4est_quadrant_t *) fh = *key;
+    fh->pad8 = 0;
+    first = quad_nodes[qcid];
+    second = quad_nodes[k];
+    if (first < second) {
+      fh->p.piggy.depends[0] = first;
+      fh->p.piggy.depends[1] = second;
+    }
+    else {
+      fh->p.piggy.depends[0] = second;
+      fh->p.piggy.depends[1] = first;
+    }
+#else
+    fh = (p8est_hang4_t *) sc_array_index (faha, zr);
+    *(p4est_quadrant_t *) fh = *key;
+    fh->pad8 = 0;
+    fh->p.piggy.depends[0] = quad_nodes[qcid];
+    fh->p.piggy.depends[1] = quad_nodes[k];
+    fh->p.piggy.depends[2] = -1;
+    fh->p.piggy.depends[3] = -1;
+    face = p8est_child_corner_faces[qcid][k];
+    for (l = 0; l < 4; ++l) {
+      corner = p8est_face_corners[face][l];
+      if (corner != qcid && corner != k) {
+        if (fh->p.piggy.depends[2] == -1) {
+          fh->p.piggy.depends[2] = quad_nodes[corner];
+        }
+        else {
+          P4EST_ASSERT (fh->p.piggy.depends[3] == -1);
+          fh->p.piggy.depends[3] = quad_nodes[corner];
+        }
+      }
+    }
+    qsort (fh->p.piggy.depends,
+           4, sizeof (p4est_locidx_t), p4est_locidx_compare);
 #endif
-  for (il = 0; il < num_local_nodes; ++il) {
-    if (local_nodes[il] >= num_edge_hangings_begin) {
-      local_nodes[il] -= dup_face_hangings;
-      P4EST_ASSERT (local_nodes[il] >= num_face_hangings_end);
+  }
+#ifdef P4_TO_P8
+  num_edge_hangings = p4est_nodes_sort_merge (edge_keys, edge_runs);
+  dup_edge_hangings =
+    (p4est_locidx_t) edge_keys->elem_count - num_edge_hangings;
+  sc_array_resize (edha, (size_t) num_edge_hangings);
+  for (zr = 0; zr < (size_t) num_edge_hangings; ++zr) {
+    key = p4est_quadrant_array_index
+      (edge_keys, *(size_t *) sc_array_index (edge_runs, zr));
+    qcid = (int) key->pad8;
+    k = (int) (key->p.piggy3.local_num % P4EST_CHILDREN);
+    quad_nodes = local_nodes + (key->p.piggy3.local_num - k);
+    eh = (p8est_hang2_t *) sc_array_index (edha, zr);
+    *(p4est_quadrant_t *) eh = *key;
+    eh->pad8 = 0;
+    first = quad_nodes[qcid];
+    second = quad_nodes[k];
+    if (first < second) {
+      eh->p.piggy.depends[0] = first;
+      eh->p.piggy.depends[1] = second;
     }
     else {
-      P4EST_ASSERT (local_nodes[il] >= 0 &&
-                    local_nodes[il] < num_face_hangings_end);
+      eh->p.piggy.depends[0] = second;
+      eh->p.piggy.depends[1] = first;
     }
   }
 #endif
 
+  /* Only now replace the independent by the hanging node numbers */
+  p4est_nodes_assign_runs (face_keys, face_runs, num_indep_nodes,
+                           local_nodes);
+  sc_array_destroy (face_keys);
+  sc_array_destroy (face_runs);
+#ifdef P4_TO_P8
+  p4est_nodes_assign_runs (edge_keys, edge_runs,
+                           num_indep_nodes + num_face_hangings, local_nodes);
+  sc_array_destroy (edge_keys);
+  sc_array_destroy (edge_runs);
+#endif
+
   /* Allocate remaining output data structures */
   nodes->num_owned_indeps = num_owned_indeps;
   nodes->num_owned_shared = num_owned_shared;
   nodes->offset_owned_indeps = offset_owned_indeps;
-  sc_hash_array_rip (indep_nodes, inda = &nodes->indep_nodes);
   nodes->nonlocal_ranks =
     P4EST_ALLOC (int, num_indep_nodes - num_owned_indeps);
   nodes->global_owned_indeps = P4EST_ALLOC (p4est_locidx_t, num_procs);
   nodes->global_owned_indeps[rank] = num_owned_indeps;
-  indep_nodes = NULL;
 
 #ifdef P4EST_ENABLE_MPI
   nonlocal_ranks = nodes->nonlocal_ranks;
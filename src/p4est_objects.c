@@ -0,0 +1,500 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef P4_TO_P8
+#include <p4est_algorithms.h>
+#include <p4est_bits.h>
+#include <p4est_extended.h>
+#include <p4est_objects.h>
+#include <p4est_search.h>
+#else
+#include <p8est_algorithms.h>
+#include <p8est_bits.h>
+#include <p8est_extended.h>
+#include <p8est_objects.h>
+#include <p8est_search.h>
+#endif
+#include <sc_notify.h>
+
+/** Working data of the searches, passed as the forest's user pointer. */
+typedef struct p4est_objects_state
+{
+  sc_array_t         *objects;          /**< Objects searched for */
+  double              lower[3];         /**< Box of the current quadrant */
+  double              upper[3];
+  int                 maxlevel;         /**< Leaves at this level stay */
+  p4est_objects_refine_t refine_fn;
+  void               *user;
+
+  /* partition search */
+  int                *last_rank;        /**< Last receiver of each object */
+  sc_array_t         *routes;           /**< Pairs of rank and object */
+
+  /* local search */
+  int8_t             *flags;            /**< Refine flag of each leaf */
+  p4est_locidx_t      num_flags;        /**< Number of flags set */
+  sc_array_t         *pairs;            /**< Pairs of leaf and object */
+
+  /* refinement */
+  p4est_locidx_t     *cursor;           /**< Next flag of each tree */
+}
+p4est_objects_state_t;
+
+/** Compute the box of a quadrant in the reference coordinates of its tree.
+ */
+static void
+p4est_objects_quadrant_box (const p4est_quadrant_t * q, double lower[3],
+                            double upper[3])
+{
+  const double        irootlen = 1. / (double) P4EST_ROOT_LEN;
+  const double        h = irootlen * (double) P4EST_QUADRANT_LEN (q->level);
+
+  lower[0] = irootlen * (double) q->x;
+  lower[1] = irootlen * (double) q->y;
+#ifndef P4_TO_P8
+  lower[2] = 0.;
+#else
+  lower[2] = irootlen * (double) q->z;
+#endif
+  upper[0] = lower[0] + h;
+  upper[1] = lower[1] + h;
+  upper[2] = lower[2] + h;
+}
+
+/** Test whether an object's box touches the current quadrant's box. */
+static int
+p4est_objects_overlap (const p4est_objects_state_t * s,
+                       const p4est_object_t * o, p4est_topidx_t which_tree)
+{
+  int                 i;
+
+  if (o->which_tree != which_tree) {
+    return 0;
+  }
+  for (i = 0; i < P4EST_DIM; ++i) {
+    if (o->upper[i] < s->lower[i] || s->upper[i] < o->lower[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int
+p4est_objects_partition_quadrant (p4est_t * p4est, p4est_topidx_t which_tree,
+                                  p4est_quadrant_t * quadrant, int pfirst,
+                                  int plast, void *point)
+{
+  p4est_objects_state_t *s = (p4est_objects_state_t *) p4est->user_pointer;
+
+  P4EST_ASSERT (point == NULL);
+  p4est_objects_quadrant_box (quadrant, s->lower, s->upper);
+  return 1;
+}
+
+static int
+p4est_objects_partition_point (p4est_t * p4est, p4est_topidx_t which_tree,
+                               p4est_quadrant_t * quadrant, int pfirst,
+                               int plast, void *point)
+{
+  p4est_objects_state_t *s = (p4est_objects_state_t *) p4est->user_pointer;
+  const p4est_locidx_t li = *(p4est_locidx_t *) point;
+  int                *route;
+
+  if (!p4est_objects_overlap
+      (s, (p4est_object_t *) sc_array_index (s->objects, (size_t) li),
+       which_tree)) {
+    return 0;
+  }
+  if (pfirst < plast) {
+    return 1;
+  }
+
+  /* the ranks are visited in ascending order, so this catches duplicates */
+  if (s->last_rank[li] != pfirst) {
+    P4EST_ASSERT (s->last_rank[li] < pfirst);
+    s->last_rank[li] = pfirst;
+    route = (int *) sc_array_push (s->routes);
+    route[0] = pfirst;
+    route[1] = (int) li;
+  }
+  return 0;
+}
+
+static int
+p4est_objects_local_quadrant (p4est_t * p4est, p4est_topidx_t which_tree,
+                              p4est_quadrant_t * quadrant,
+                              p4est_locidx_t local_num, void *point)
+{
+  p4est_objects_state_t *s = (p4est_objects_state_t *) p4est->user_pointer;
+
+  P4EST_ASSERT (point == NULL);
+  p4est_objects_quadrant_box (quadrant, s->lower, s->upper);
+  return 1;
+}
+
+static int
+p4est_objects_local_point (p4est_t * p4est, p4est_topidx_t which_tree,
+                           p4est_quadrant_t * quadrant,
+                           p4est_locidx_t local_num, void *point)
+{
+  p4est_objects_state_t *s = (p4est_objects_state_t *) p4est->user_pointer;
+  const p4est_locidx_t li = *(p4est_locidx_t *) point;
+  const p4est_object_t *o =
+    (const p4est_object_t *) sc_array_index (s->objects, (size_t) li);
+  p4est_locidx_t     *pair;
+
+  if (!p4est_objects_overlap (s, o, which_tree)) {
+    return 0;
+  }
+  if (local_num < 0) {
+    return 1;
+  }
+
+  /* this leaf overlaps the object */
+  pair = (p4est_locidx_t *) sc_array_push (s->pairs);
+  pair[0] = local_num;
+  pair[1] = li;
+  if (s->refine_fn != NULL && !s->flags[local_num] &&
+      (int) quadrant->level < s->maxlevel &&
+      s->refine_fn (p4est, which_tree, quadrant, o, s->user)) {
+    s->flags[local_num] = 1;
+    ++s->num_flags;
+  }
+  return 0;
+}
+
+/** Read the flags in order, which holds per tree even with threads. */
+static int
+p4est_objects_refine_flag (p4est_t * p4est, p4est_topidx_t which_tree,
+                           p4est_quadrant_t * quadrant)
+{
+  p4est_objects_state_t *s = (p4est_objects_state_t *) p4est->user_pointer;
+
+  return s->flags[s->cursor[which_tree]++];
+}
+
+/** Send each object to the processes whose partition its box touches.
+ * \return          The objects received, ordered by sender rank.
+ */
+static sc_array_t  *
+p4est_objects_route (p4est_t * p4est, p4est_objects_state_t * s,
+                     sc_array_t * objects)
+{
+  const size_t        object_size = objects->elem_size;
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+  int                 i, *route;
+  int                *counts, *offsets;
+  size_t              zz, num_routes, self_pos;
+  p4est_locidx_t      li, num_objects;
+  char               *send_buf;
+  sc_array_t         *points, *received;
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+  int                 num_receivers, num_senders;
+  int                *receivers, *senders, *recv_counts;
+  size_t              num_total, pos;
+  sc_MPI_Request     *requests;
+#endif
+
+  /* find the receivers of every object */
+  num_objects = (p4est_locidx_t) objects->elem_count;
+  s->objects = objects;
+  s->last_rank = P4EST_ALLOC (int, SC_MAX (num_objects, 1));
+  s->routes = sc_array_new (2 * sizeof (int));
+  points = sc_array_new_count (sizeof (p4est_locidx_t), (size_t) num_objects);
+  for (li = 0; li < num_objects; ++li) {
+    s->last_rank[li] = -1;
+    *(p4est_locidx_t *) sc_array_index (points, (size_t) li) = li;
+  }
+  p4est_search_partition (p4est, 0, p4est_objects_partition_quadrant,
+                          p4est_objects_partition_point, points);
+  sc_array_destroy (points);
+  P4EST_FREE (s->last_rank);
+  s->last_rank = NULL;
+
+  /* pack the objects by receiver */
+  num_routes = s->routes->elem_count;
+  counts = P4EST_ALLOC_ZERO (int, num_procs);
+  offsets = P4EST_ALLOC (int, num_procs + 1);
+  for (zz = 0; zz < num_routes; ++zz) {
+    route = (int *) sc_array_index (s->routes, zz);
+    ++counts[route[0]];
+  }
+  offsets[0] = 0;
+  for (i = 0; i < num_procs; ++i) {
+    offsets[i + 1] = offsets[i] + counts[i];
+  }
+  send_buf = P4EST_ALLOC (char, SC_MAX (num_routes, 1) * object_size);
+  for (zz = 0; zz < num_routes; ++zz) {
+    route = (int *) sc_array_index (s->routes, zz);
+    memcpy (send_buf + (size_t) offsets[route[0]]++ * object_size,
+            sc_array_index_int (objects, route[1]), object_size);
+  }
+  for (i = num_procs; i > 0; --i) {
+    offsets[i] = offsets[i - 1];
+  }
+  offsets[0] = 0;
+  sc_array_destroy (s->routes);
+  s->routes = NULL;
+
+  received = sc_array_new (object_size);
+  self_pos = 0;
+#ifdef P4EST_ENABLE_MPI
+  /* find the senders and exchange the number of objects */
+  receivers = P4EST_ALLOC (int, num_procs);
+  for (num_receivers = 0, i = 0; i < num_procs; ++i) {
+    if (i != rank && counts[i] > 0) {
+      receivers[num_receivers++] = i;
+    }
+  }
+  senders = P4EST_ALLOC (int, num_procs);
+  mpiret = sc_notify (receivers, num_receivers, senders, &num_senders,
+                      p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  requests = P4EST_ALLOC (sc_MPI_Request, num_senders + num_receivers);
+  recv_counts = P4EST_ALLOC (int, SC_MAX (num_senders, 1));
+  for (i = 0; i < num_senders; ++i) {
+    mpiret = sc_MPI_Irecv (recv_counts + i, 1, sc_MPI_INT, senders[i],
+                           P4EST_COMM_OBJECTS_COUNT, p4est->mpicomm,
+                           requests + i);
+    SC_CHECK_MPI (mpiret);
+  }
+  for (i = 0; i < num_receivers; ++i) {
+    mpiret = sc_MPI_Isend (counts + receivers[i], 1, sc_MPI_INT,
+                           receivers[i], P4EST_COMM_OBJECTS_COUNT,
+                           p4est->mpicomm, requests + num_senders + i);
+    SC_CHECK_MPI (mpiret);
+  }
+  mpiret = sc_MPI_Waitall (num_senders + num_receivers, requests,
+                           sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+
+  /* the received objects are ordered by rank with our own in between */
+  for (num_total = (size_t) counts[rank], i = 0; i < num_senders; ++i) {
+    num_total += (size_t) recv_counts[i];
+  }
+  sc_array_resize (received, num_total);
+  for (pos = 0, i = 0; i < num_senders; ++i) {
+    if (senders[i] < rank) {
+      self_pos += (size_t) recv_counts[i];
+    }
+  }
+  for (pos = 0, i = 0; i < num_senders; ++i) {
+    if (pos == self_pos && senders[i] > rank) {
+      pos += (size_t) counts[rank];
+    }
+    mpiret = sc_MPI_Irecv (sc_array_index (received, pos),
+                           (int) ((size_t) recv_counts[i] * object_size),
+                           sc_MPI_BYTE, senders[i], P4EST_COMM_OBJECTS_LOAD,
+                           p4est->mpicomm, requests + i);
+    SC_CHECK_MPI (mpiret);
+    pos += (size_t) recv_counts[i];
+  }
+  for (i = 0; i < num_receivers; ++i) {
+    mpiret = sc_MPI_Isend (send_buf + (size_t) offsets[receivers[i]] *
+                           object_size,
+                           (int) ((size_t) counts[receivers[i]] *
+                                  object_size), sc_MPI_BYTE, receivers[i],
+                           P4EST_COMM_OBJECTS_LOAD, p4est->mpicomm,
+                           requests + num_senders + i);
+    SC_CHECK_MPI (mpiret);
+  }
+#else
+  sc_array_resize (received, (size_t) counts[rank]);
+#endif
+
+  /* copy our own objects while the messages are in flight */
+  if (counts[rank] > 0) {
+    memcpy (sc_array_index (received, self_pos),
+            send_buf + (size_t) offsets[rank] * object_size,
+            (size_t) counts[rank] * object_size);
+  }
+
+#ifdef P4EST_ENABLE_MPI
+  mpiret = sc_MPI_Waitall (num_senders + num_receivers, requests,
+                           sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (requests);
+  P4EST_FREE (recv_counts);
+  P4EST_FREE (senders);
+  P4EST_FREE (receivers);
+#endif
+  P4EST_FREE (send_buf);
+  P4EST_FREE (offsets);
+  P4EST_FREE (counts);
+
+  return received;
+}
+
+p4est_objects_t    *
+p4est_objects_refine (p4est_t * p4est, int maxlevel, int partition,
+                      sc_array_t * objects, p4est_objects_refine_t refine_fn,
+                      p4est_init_t init_fn, void *user)
+{
+  int                 mpiret;
+  int                 local_flagged, global_flagged;
+  int                 round;
+  size_t              zz, num_pairs;
+  void               *orig_user_pointer;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      li, num_objects, num_used, *pair, *remap;
+  p4est_tree_t       *tree;
+  sc_array_t         *received, *points, *compact;
+  p4est_objects_t    *objs;
+  p4est_objects_state_t state, *s = &state;
+
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_objects_refine with %lld objects\n",
+                            (long long) objects->elem_count);
+  p4est_log_indent_push ();
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (objects->elem_size >= sizeof (p4est_object_t));
+  if (maxlevel < 0) {
+    maxlevel = P4EST_QMAXLEVEL;
+  }
+  P4EST_ASSERT (maxlevel <= P4EST_QMAXLEVEL);
+
+  memset (s, 0, sizeof (*s));
+  s->maxlevel = maxlevel;
+  s->refine_fn = refine_fn;
+  s->user = user;
+  orig_user_pointer = p4est->user_pointer;
+  p4est->user_pointer = s;
+
+  /* each round sends the input objects to the processes they overlap,
+     then refines the leaves they request */
+  received = NULL;
+  for (round = 0;; ++round) {
+    if (received != NULL) {
+      sc_array_destroy (received);
+    }
+    received = p4est_objects_route (p4est, s, objects);
+    num_objects = (p4est_locidx_t) received->elem_count;
+
+    /* match the objects to the local leaves and collect refine flags */
+    s->objects = received;
+    s->flags = P4EST_ALLOC_ZERO (int8_t, SC_MAX (p4est->local_num_quadrants,
+                                                 1));
+    s->num_flags = 0;
+    s->pairs = sc_array_new (2 * sizeof (p4est_locidx_t));
+    points = sc_array_new_count (sizeof (p4est_locidx_t),
+                                 (size_t) num_objects);
+    for (li = 0; li < num_objects; ++li) {
+      *(p4est_locidx_t *) sc_array_index (points, (size_t) li) = li;
+    }
+    p4est_search_local (p4est, 0, p4est_objects_local_quadrant,
+                        p4est_objects_local_point, points);
+    sc_array_destroy (points);
+
+    local_flagged = s->num_flags > 0;
+    mpiret = sc_MPI_Allreduce (&local_flagged, &global_flagged, 1,
+                               sc_MPI_INT, sc_MPI_LOR, p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+    P4EST_GLOBAL_INFOF ("Objects round %d flagged %s\n", round,
+                        global_flagged ? "leaves" : "none");
+    if (!global_flagged) {
+      break;
+    }
+
+    /* refine the flagged leaves once and start over */
+    sc_array_destroy (s->pairs);
+    s->pairs = NULL;
+    s->cursor = P4EST_ALLOC (p4est_locidx_t, p4est->trees->elem_count);
+    for (jt = 0; jt < (p4est_topidx_t) p4est->trees->elem_count; ++jt) {
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      s->cursor[jt] = tree->quadrants_offset;
+    }
+    p4est_refine_ext (p4est, 0, maxlevel, p4est_objects_refine_flag,
+                      init_fn, NULL);
+    P4EST_FREE (s->cursor);
+    s->cursor = NULL;
+    P4EST_FREE (s->flags);
+    s->flags = NULL;
+    if (partition) {
+      p4est_partition (p4est, 0, NULL);
+    }
+  }
+  P4EST_FREE (s->flags);
+  p4est->user_pointer = orig_user_pointer;
+
+  /* sort the pairs into per-leaf lists, keeping the used objects only */
+  objs = P4EST_ALLOC (p4est_objects_t, 1);
+  objs->num_leaves = p4est->local_num_quadrants;
+  objs->offsets = P4EST_ALLOC_ZERO (p4est_locidx_t, objs->num_leaves + 1);
+  num_pairs = s->pairs->elem_count;
+  objs->indices = P4EST_ALLOC (p4est_locidx_t, SC_MAX (num_pairs, 1));
+  remap = P4EST_ALLOC (p4est_locidx_t, SC_MAX (num_objects, 1));
+  for (li = 0; li < num_objects; ++li) {
+    remap[li] = -1;
+  }
+  num_used = 0;
+  for (zz = 0; zz < num_pairs; ++zz) {
+    pair = (p4est_locidx_t *) sc_array_index (s->pairs, zz);
+    ++objs->offsets[pair[0] + 1];
+    if (remap[pair[1]] < 0) {
+      remap[pair[1]] = num_used++;
+    }
+  }
+  for (li = 0; li < objs->num_leaves; ++li) {
+    objs->offsets[li + 1] += objs->offsets[li];
+  }
+  for (zz = 0; zz < num_pairs; ++zz) {
+    pair = (p4est_locidx_t *) sc_array_index (s->pairs, zz);
+    objs->indices[objs->offsets[pair[0]]++] = remap[pair[1]];
+  }
+  for (li = objs->num_leaves; li > 0; --li) {
+    objs->offsets[li] = objs->offsets[li - 1];
+  }
+  objs->offsets[0] = 0;
+  sc_array_destroy (s->pairs);
+
+  compact = sc_array_new_count (received->elem_size, (size_t) num_used);
+  for (li = 0; li < num_objects; ++li) {
+    if (remap[li] >= 0) {
+      memcpy (sc_array_index (compact, (size_t) remap[li]),
+              sc_array_index (received, (size_t) li), received->elem_size);
+    }
+  }
+  objs->objects = compact;
+  P4EST_FREE (remap);
+  sc_array_destroy (received);
+
+  p4est_log_indent_pop ();
+  P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
+                            "_objects_refine with %lld local pairs\n",
+                            (long long) num_pairs);
+  return objs;
+}
+
+void
+p4est_objects_destroy (p4est_objects_t * objs)
+{
+  sc_array_destroy (objs->objects);
+  P4EST_FREE (objs->offsets);
+  P4EST_FREE (objs->indices);
+  P4EST_FREE (objs);
+}
@@ -346,8 +346,7 @@ fill_orientations (p4est_quadrant_t * q, p4est_topidx_t t,
       p4est_topidx_t      nt;
       int                 nf, o;
 
-      nt = conn->tree_to_tree[P4EST_FACES * t + f];
-      nf = conn->tree_to_face[P4EST_FACES * t + f];
+      nt = p4est_connectivity_face_neighbor_tree (conn, t, f, &nf);
       o = nf / P4EST_FACES;
       nf = nf % P4EST_FACES;
       if (nt < t || (nt == t && nf < f)) {
@@ -449,15 +448,14 @@ fill_orientations (p4est_quadrant_t * q, p4est_topidx_t t,
         int                 i, j, o = 0;
         for (i = 0; i < 2; i++) {
           p4est_locidx_t      nt;
-          int8_t              nf;
+          int                 nf;
           int                 fo;
           int                 ref, set;
           int                 cid[2];
           int                 ne;
 
           f = p8est_edge_faces[e][i];
-          nt = conn->tree_to_tree[P4EST_FACES * t + f];
-          nf = conn->tree_to_face[P4EST_FACES * t + f];
+          nt = p4est_connectivity_face_neighbor_tree (conn, t, f, &nf);
           fo = nf / P8EST_FACES;
           nf = nf % P8EST_FACES;
 
@@ -783,47 +781,45 @@ p4est_get_plex_data_int (p4est_t * p4est, p4est_ghost_t * ghost,
    * the new indices straight */
   /* create a list of all global nodes seen */
   {
-    p4est_gloidx_t     *quad_to_global = P4EST_ALLOC (p4est_gloidx_t, K * V);
+    p4est_gloidx_t     *pair;
 
-    /* fill the local portion of quad_to_global */
+    /* the local global indices go straight into the list of pairs */
+    all_global = sc_array_new_size (2 * sizeof (p4est_gloidx_t), V * K);
+    pair = (p4est_gloidx_t *) all_global->array;
     for (qid = 0; qid < Klocal * V; qid++) {
-      p4est_locidx_t      nid;
-
-      nid = lnodes->element_nodes[qid];
-      quad_to_global[qid] = p4est_lnodes_global_index (lnodes, nid);
+      pair[2 * qid] =
+        p4est_lnodes_global_index (lnodes, lnodes->element_nodes[qid]);
+      pair[2 * qid + 1] = qid;
     }
     if (overlap) {
-      /* get the ghost portion of quad_to_global */
+      /* only the mirrors and ghosts need contiguous buffers to exchange */
       p4est_gloidx_t    **mirror_data;
+      p4est_gloidx_t     *mirror_global, *ghost_global;
 
       mirror_data = P4EST_ALLOC (p4est_gloidx_t *, num_mirrors);
+      mirror_global = P4EST_ALLOC (p4est_gloidx_t, num_mirrors * V);
+      ghost_global = P4EST_ALLOC (p4est_gloidx_t, G * V);
       for (il = 0; il < num_mirrors; il++) {
         p4est_quadrant_t   *q;
 
         q = p4est_quadrant_array_index (&ghost->mirrors, il);
         qid = q->p.piggy3.local_num;
-        mirror_data[il] = &quad_to_global[qid * V];
+        for (v = 0; v < V; v++) {
+          mirror_global[il * V + v] = pair[2 * (qid * V + v)];
+        }
+        mirror_data[il] = &mirror_global[il * V];
       }
       p4est_ghost_exchange_custom (p4est, ghost,
                                    (size_t) V * sizeof (p4est_gloidx_t),
-                                   (void **) mirror_data,
-                                   Klocal ? &quad_to_global[Klocal *
-                                                            V] : NULL);
+                                   (void **) mirror_data, ghost_global);
       P4EST_FREE (mirror_data);
-    }
-
-    all_global = sc_array_new_size (2 * sizeof (p4est_gloidx_t), V * K);
-    for (qid = 0; qid < K; qid++) {
-      for (v = 0; v < V; v++) {
-        p4est_gloidx_t     *pair =
-          (p4est_gloidx_t *) sc_array_index (all_global,
-                                             (size_t) qid * V + v);
-
-        pair[0] = quad_to_global[qid * V + v];
-        pair[1] = qid * V + v;
+      P4EST_FREE (mirror_global);
+      for (qid = Klocal * V; qid < K * V; qid++) {
+        pair[2 * qid] = ghost_global[qid - Klocal * V];
+        pair[2 * qid + 1] = qid;
       }
+      P4EST_FREE (ghost_global);
     }
-    P4EST_FREE (quad_to_global);
   }
 
   /* assign a local index to each global node referenced */
@@ -1915,7 +1911,8 @@ p4est_get_plex_data_ext (p4est_t * p4est,
                          sc_array_t * out_leaves, sc_array_t * out_remotes,
                          int custom_numbering)
 {
-  int                 ctype_int = p4est_connect_type_int (ctype);
+  /* the plex points are always derived from the corner nodes */
+  int                 ctype_int = p4est_connect_type_int (P4EST_CONNECT_FULL);
   int                 i;
   int                 created_ghost = 0;
 
@@ -1926,6 +1923,11 @@ p4est_get_plex_data_ext (p4est_t * p4est,
   if (!*lnodes) {
     *lnodes = p4est_lnodes_new (p4est, *ghost, -ctype_int);
   }
+  else {
+    /* reuse the caller's lnodes instead of building a temporary one */
+    SC_CHECK_ABORT ((*lnodes)->degree == -ctype_int,
+                    "Plex data requires lnodes of corner degree");
+  }
   if (created_ghost) {
     if (overlap) {
       p4est_ghost_support_lnodes (p4est, *lnodes, *ghost);
@@ -1934,10 +1936,6 @@ p4est_get_plex_data_ext (p4est_t * p4est,
       p4est_ghost_expand_by_lnodes (p4est, *lnodes, *ghost);
     }
   }
-  if (ctype != P4EST_CONNECT_FULL) {
-    p4est_lnodes_destroy (*lnodes);
-    *lnodes = p4est_lnodes_new (p4est, *ghost, -ctype);
-  }
   p4est_get_plex_data_int (p4est, *ghost, *lnodes, overlap, 0,
                            first_local_quad, out_points_per_dim,
                            out_cone_sizes, out_cones, out_cone_orientations,
@@ -33,17 +33,22 @@
 #ifdef P4_TO_P8
 #include <p8est_algorithms.h>
 #include <p8est_bits.h>
+#include <p8est_build.h>
 #include <p8est_communication.h>
 #include <p8est_extended.h>
 #include <p8est_points.h>
+#include <p8est_search.h>
 #else
 #include <p4est_algorithms.h>
 #include <p4est_bits.h>
+#include <p4est_build.h>
 #include <p4est_communication.h>
 #include <p4est_extended.h>
 #include <p4est_points.h>
+#include <p4est_search.h>
 #endif /* !P4_TO_P8 */
 #include <sc_allgather.h>
+#include <sc_notify.h>
 #include <sc_sort.h>
 
 typedef struct
@@ -96,12 +101,18 @@ p4est_points_refine (p4est_t * p4est, p4est_topidx_t which_tree,
   }
 }
 
-p4est_t            *
-p4est_new_points (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
-                  int maxlevel, p4est_quadrant_t * points,
-                  p4est_locidx_t num_points, p4est_locidx_t max_points,
-                  size_t data_size, p4est_init_t init_fn, void *user_pointer)
+/** Create the coarsest forest whose partition follows the points.
+ * Each quadrant stores the range of points it contains as user data.
+ * \param [in] sorted      If true, the points are sorted globally already.
+ * \param [in,out] ppstate The points and their count must be set.
+ */
+static p4est_t     *
+p4est_points_coarse (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
+                     int sorted, p4est_points_state_t * ppstate)
 {
+  const int           maxlevel = ppstate->maxlevel;
+  p4est_quadrant_t   *points = ppstate->points;
+  const p4est_locidx_t num_points = ppstate->num_points;
   int                 mpiret;
   int                 num_procs, rank;
   int                 i, isizet;
@@ -117,14 +128,8 @@ p4est_new_points (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
   p4est_quadrant_t    a, b, c, f, l, n;
   p4est_tree_t       *tree;
   p4est_t            *p4est;
-  p4est_points_state_t ppstate;
 
-  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
-                            "_new_points with max level %d max points %lld\n",
-                            maxlevel, (long long) max_points);
-  p4est_log_indent_push ();
   P4EST_ASSERT (p4est_connectivity_is_valid (connectivity));
-  P4EST_ASSERT (max_points >= -1);
 
   /* retrieve MPI information */
   mpiret = sc_MPI_Comm_size (mpicomm, &num_procs);
@@ -145,14 +150,16 @@ p4est_new_points (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
 
   /* parallel sort the incoming points */
   lcount = (size_t) num_points;
-  nmemb = P4EST_ALLOC_ZERO (size_t, num_procs);
-  isizet = (int) sizeof (size_t);
-  mpiret = sc_MPI_Allgather (&lcount, isizet, sc_MPI_BYTE,
-                             nmemb, isizet, sc_MPI_BYTE, mpicomm);
-  SC_CHECK_MPI (mpiret);
-  sc_psort (mpicomm, points, nmemb, sizeof (p4est_quadrant_t),
-            p4est_quadrant_compare_piggy);
-  P4EST_FREE (nmemb);
+  if (!sorted) {
+    nmemb = P4EST_ALLOC_ZERO (size_t, num_procs);
+    isizet = (int) sizeof (size_t);
+    mpiret = sc_MPI_Allgather (&lcount, isizet, sc_MPI_BYTE,
+                               nmemb, isizet, sc_MPI_BYTE, mpicomm);
+    SC_CHECK_MPI (mpiret);
+    sc_psort (mpicomm, points, nmemb, sizeof (p4est_quadrant_t),
+              p4est_quadrant_compare_piggy);
+    P4EST_FREE (nmemb);
+  }
 #ifdef P4EST_ENABLE_DEBUG
   first_quad = points;
   for (zz = 1; zz < lcount; ++zz) {
@@ -164,15 +171,11 @@ p4est_new_points (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
 
   /* create the p4est */
   p4est = P4EST_ALLOC_ZERO (p4est_t, 1);
-  ppstate.points = points;
-  ppstate.num_points = num_points;
-  ppstate.max_points = max_points;
-  ppstate.current = 0;
-  ppstate.maxlevel = maxlevel;
+  ppstate->current = 0;
 
   /* assign some data members */
   p4est->data_size = 2 * sizeof (p4est_locidx_t);       /* temporary */
-  p4est->user_pointer = &ppstate;
+  p4est->user_pointer = ppstate;
   p4est->connectivity = connectivity;
   num_trees = connectivity->num_trees;
 
@@ -367,6 +370,39 @@ p4est_new_points (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
                   (long long) p4est->local_num_quadrants);
 
   P4EST_ASSERT (p4est_is_valid (p4est));
+
+  return p4est;
+}
+
+p4est_t            *
+p4est_new_points (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
+                  int maxlevel, p4est_quadrant_t * points,
+                  p4est_locidx_t num_points, p4est_locidx_t max_points,
+                  size_t data_size, p4est_init_t init_fn, void *user_pointer)
+{
+#ifdef P4EST_ENABLE_DEBUG
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_quadrant_t   *first_quad, *next_quad;
+  p4est_tree_t       *tree;
+#endif
+  int                 num_threads = p4est_get_num_threads ();
+  p4est_t            *p4est;
+  p4est_points_state_t ppstate;
+
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_new_points with max level %d max points %lld\n",
+                            maxlevel, (long long) max_points);
+  p4est_log_indent_push ();
+  P4EST_ASSERT (max_points >= -1);
+
+  ppstate.points = points;
+  ppstate.num_points = num_points;
+  ppstate.max_points = max_points;
+  ppstate.current = 0;
+  ppstate.maxlevel = maxlevel;
+  p4est = p4est_points_coarse (mpicomm, connectivity, 0, &ppstate);
+
   p4est_log_indent_pop ();
   P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
                             "_new_points with %lld total quadrants\n",
@@ -374,10 +410,13 @@ p4est_new_points (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
 
   /* refine to have one point per quadrant */
   if (max_points >= 0) {
+    /* the callbacks pass the current point through the user pointer */
+    p4est_set_num_threads (1);
     p4est_refine_ext (p4est, 1, maxlevel, p4est_points_refine,
                       p4est_points_init, NULL);
+    p4est_set_num_threads (num_threads);
 #ifdef P4EST_ENABLE_DEBUG
-    for (jt = first_tree; jt <= last_tree; ++jt) {
+    for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
       tree = p4est_tree_array_index (p4est->trees, jt);
       first_quad = p4est_quadrant_array_index (&tree->quadrants, 0);
       for (zz = 1; zz < tree->quadrants.elem_count; ++zz) {
@@ -395,3 +434,545 @@ p4est_new_points (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
 
   return p4est;
 }
+
+/** Sort points globally by regular sampling.
+ * Every process sorts its points, contributes equally spaced samples,
+ * and sends each point to the process whose splitter range contains it.
+ * \param [in,out] points   On input, the local points in any order.
+ *                          On output, the local share of the globally
+ *                          sorted points; the shares are roughly balanced.
+ */
+static void
+p4est_points_sample_sort (sc_MPI_Comm mpicomm, sc_array_t * points)
+{
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+  int                 num_procs, rank;
+  int                 i, j, num_receivers, num_senders;
+  int                 num_samples, total_samples;
+  int                *sample_counts, *sample_displs;
+  int                *receivers, *senders, *counts, *recv_counts;
+  size_t              zz, lo, hi, num_points, num_total, pos;
+  size_t             *bounds;
+  p4est_quadrant_t   *samples, *all_samples, *splitter, *recv_buf;
+  sc_MPI_Request     *requests;
+#endif
+
+  P4EST_ASSERT (points->elem_size == sizeof (p4est_quadrant_t));
+
+  /* sort the local points first */
+  sc_array_sort (points, p4est_quadrant_compare_piggy);
+
+#ifdef P4EST_ENABLE_MPI
+  mpiret = sc_MPI_Comm_size (mpicomm, &num_procs);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Comm_rank (mpicomm, &rank);
+  SC_CHECK_MPI (mpiret);
+  if (num_procs == 1) {
+    return;
+  }
+
+  /* gather num_procs regular samples from every nonempty process */
+  num_points = points->elem_count;
+  num_samples = num_points > 0 ? num_procs : 0;
+  samples = P4EST_ALLOC (p4est_quadrant_t, num_samples);
+  for (i = 0; i < num_samples; ++i) {
+    samples[i] = *p4est_quadrant_array_index
+      (points, ((2 * (size_t) i + 1) * num_points) / (2 * num_procs));
+  }
+  sample_counts = P4EST_ALLOC (int, num_procs);
+  sample_displs = P4EST_ALLOC (int, num_procs + 1);
+  i = num_samples * (int) sizeof (p4est_quadrant_t);
+  mpiret = sc_MPI_Allgather (&i, 1, sc_MPI_INT,
+                             sample_counts, 1, sc_MPI_INT, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  sample_displs[0] = 0;
+  for (j = 0; j < num_procs; ++j) {
+    sample_displs[j + 1] = sample_displs[j] + sample_counts[j];
+  }
+  total_samples = sample_displs[num_procs] / (int) sizeof (p4est_quadrant_t);
+  all_samples = P4EST_ALLOC (p4est_quadrant_t, total_samples);
+  mpiret = sc_MPI_Allgatherv (samples, i, sc_MPI_BYTE, all_samples,
+                              sample_counts, sample_displs, sc_MPI_BYTE,
+                              mpicomm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (samples);
+  P4EST_FREE (sample_counts);
+  P4EST_FREE (sample_displs);
+  if (total_samples == 0) {
+    /* there are no points at all */
+    P4EST_FREE (all_samples);
+    return;
+  }
+  qsort (all_samples, (size_t) total_samples, sizeof (p4est_quadrant_t),
+         p4est_quadrant_compare_piggy);
+
+  /* process j receives the points from splitter j to splitter j + 1 */
+  bounds = P4EST_ALLOC (size_t, num_procs + 1);
+  counts = P4EST_ALLOC (int, num_procs);
+  bounds[0] = 0;
+  bounds[num_procs] = num_points;
+  for (j = 1; j < num_procs; ++j) {
+    splitter = all_samples + ((size_t) j * total_samples) / num_procs;
+    for (lo = bounds[j - 1], hi = num_points; lo < hi;) {
+      zz = lo + (hi - lo) / 2;
+      if (p4est_quadrant_compare_piggy
+          (p4est_quadrant_array_index (points, zz), splitter) < 0) {
+        lo = zz + 1;
+      }
+      else {
+        hi = zz;
+      }
+    }
+    bounds[j] = lo;
+  }
+  for (j = 0; j < num_procs; ++j) {
+    counts[j] = (int) (bounds[j + 1] - bounds[j]);
+  }
+  P4EST_FREE (all_samples);
+
+  /* find the processes that send to us */
+  receivers = P4EST_ALLOC (int, num_procs);
+  senders = P4EST_ALLOC (int, num_procs);
+  for (num_receivers = 0, j = 0; j < num_procs; ++j) {
+    if (j != rank && counts[j] > 0) {
+      receivers[num_receivers++] = j;
+    }
+  }
+  mpiret = sc_notify (receivers, num_receivers, senders, &num_senders,
+                      mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  /* exchange the number of points */
+  requests = P4EST_ALLOC (sc_MPI_Request, num_senders + num_receivers);
+  recv_counts = P4EST_ALLOC (int, num_senders);
+  for (i = 0; i < num_senders; ++i) {
+    mpiret = sc_MPI_Irecv (recv_counts + i, 1, sc_MPI_INT, senders[i],
+                           P4EST_COMM_POINTS_COUNT, mpicomm, requests + i);
+    SC_CHECK_MPI (mpiret);
+  }
+  for (i = 0; i < num_receivers; ++i) {
+    mpiret = sc_MPI_Isend (counts + receivers[i], 1, sc_MPI_INT,
+                           receivers[i], P4EST_COMM_POINTS_COUNT, mpicomm,
+                           requests + num_senders + i);
+    SC_CHECK_MPI (mpiret);
+  }
+  mpiret = sc_MPI_Waitall (num_senders + num_receivers, requests,
+                           sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+
+  /* exchange the points themselves */
+  for (num_total = 0, i = 0; i < num_senders; ++i) {
+    num_total += (size_t) recv_counts[i];
+  }
+  recv_buf = P4EST_ALLOC (p4est_quadrant_t, num_total);
+  for (pos = 0, i = 0; i < num_senders; ++i) {
+    mpiret = sc_MPI_Irecv (recv_buf + pos,
+                           recv_counts[i] * (int) sizeof (p4est_quadrant_t),
+                           sc_MPI_BYTE, senders[i], P4EST_COMM_POINTS_LOAD,
+                           mpicomm, requests + i);
+    SC_CHECK_MPI (mpiret);
+    pos += (size_t) recv_counts[i];
+  }
+  for (i = 0; i < num_receivers; ++i) {
+    mpiret = sc_MPI_Isend (sc_array_index (points, bounds[receivers[i]]),
+                           counts[receivers[i]] *
+                           (int) sizeof (p4est_quadrant_t), sc_MPI_BYTE,
+                           receivers[i], P4EST_COMM_POINTS_LOAD, mpicomm,
+                           requests + num_senders + i);
+    SC_CHECK_MPI (mpiret);
+  }
+  mpiret = sc_MPI_Waitall (num_senders + num_receivers, requests,
+                           sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+
+  /* keep our own range and append the received points */
+  if (bounds[rank] > 0) {
+    memmove (points->array, sc_array_index (points, bounds[rank]),
+             (size_t) counts[rank] * sizeof (p4est_quadrant_t));
+  }
+  sc_array_resize (points, (size_t) counts[rank] + num_total);
+  memcpy (sc_array_index (points, (size_t) counts[rank]), recv_buf,
+          num_total * sizeof (p4est_quadrant_t));
+  sc_array_sort (points, p4est_quadrant_compare_piggy);
+
+  P4EST_FREE (recv_buf);
+  P4EST_FREE (recv_counts);
+  P4EST_FREE (requests);
+  P4EST_FREE (senders);
+  P4EST_FREE (receivers);
+  P4EST_FREE (counts);
+  P4EST_FREE (bounds);
+#endif /* P4EST_ENABLE_MPI */
+}
+
+/** Add the leaves that subdivide a quadrant until it has few points. */
+static void
+p4est_points_build (p4est_build_t * build, p4est_topidx_t which_tree,
+                    const p4est_quadrant_t * quadrant,
+                    const p4est_points_state_t * ppstate,
+                    p4est_locidx_t begin, p4est_locidx_t end)
+{
+  int                 i;
+  p4est_locidx_t      cend;
+  p4est_quadrant_t    child;
+
+  if (ppstate->max_points < 0 || end - begin <= ppstate->max_points ||
+      quadrant->level >= ppstate->maxlevel) {
+    p4est_build_add (build, which_tree, (p4est_quadrant_t *) quadrant);
+    return;
+  }
+
+  /* the points are sorted, so each child holds a contiguous range */
+  for (i = 0; i < P4EST_CHILDREN; ++i) {
+    p4est_quadrant_child (quadrant, &child, i);
+    for (cend = begin; cend < end &&
+         p4est_quadrant_contains_node (&child, ppstate->points + cend);
+         ++cend);
+    p4est_points_build (build, which_tree, &child, ppstate, begin, cend);
+    begin = cend;
+  }
+  P4EST_ASSERT (begin == end);
+}
+
+p4est_t            *
+p4est_new_points_sort (sc_MPI_Comm mpicomm,
+                       p4est_connectivity_t * connectivity, int maxlevel,
+                       sc_array_t * points, p4est_locidx_t max_points,
+                       size_t data_size, p4est_init_t init_fn,
+                       void *user_pointer)
+{
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_locidx_t     *qdata;
+  p4est_quadrant_t   *quad;
+  p4est_tree_t       *tree;
+  p4est_build_t      *build;
+  p4est_t            *coarse, *p4est;
+  p4est_points_state_t ppstate;
+
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_new_points_sort with max level %d"
+                            " max points %lld\n",
+                            maxlevel, (long long) max_points);
+  p4est_log_indent_push ();
+  P4EST_ASSERT (points->elem_size == sizeof (p4est_quadrant_t));
+  P4EST_ASSERT (max_points >= -1);
+
+  /* sort the points globally without sc_psort */
+  p4est_points_sample_sort (mpicomm, points);
+
+  /* the coarsest forest knows which points each local quadrant contains */
+  ppstate.points = (p4est_quadrant_t *) points->array;
+  ppstate.num_points = (p4est_locidx_t) points->elem_count;
+  ppstate.max_points = max_points;
+  ppstate.current = 0;
+  ppstate.maxlevel = maxlevel;
+  coarse = p4est_points_coarse (mpicomm, connectivity, 1, &ppstate);
+
+  /* refine every coarse quadrant in one pass and add the leaves in order */
+  build = p4est_build_new (coarse, data_size, init_fn, user_pointer);
+  for (jt = coarse->first_local_tree; jt <= coarse->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (coarse->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      quad = p4est_quadrant_array_index (&tree->quadrants, zz);
+      qdata = (p4est_locidx_t *) quad->p.user_data;
+      p4est_points_build (build, jt, quad, &ppstate, qdata[0], qdata[1]);
+    }
+  }
+  p4est = p4est_build_complete (build);
+  p4est_destroy (coarse);
+
+  p4est_log_indent_pop ();
+  P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
+                            "_new_points_sort with %lld total quadrants\n",
+                            (long long) p4est->global_num_quadrants);
+  return p4est;
+}
+
+p4est_points_migrate_t *
+p4est_points_migrate_new (p4est_t * p4est, size_t payload_size)
+{
+  p4est_points_migrate_t *migrate;
+
+  migrate = P4EST_ALLOC_ZERO (p4est_points_migrate_t, 1);
+  migrate->p4est = p4est;
+  migrate->payload_size = payload_size;
+  sc_array_init (&migrate->receivers, sizeof (int));
+  sc_array_init (&migrate->senders, sizeof (int));
+  sc_array_init (&migrate->counts, sizeof (int));
+
+  return migrate;
+}
+
+void
+p4est_points_migrate_destroy (p4est_points_migrate_t * migrate)
+{
+  sc_array_reset (&migrate->receivers);
+  sc_array_reset (&migrate->senders);
+  sc_array_reset (&migrate->counts);
+  P4EST_FREE (migrate);
+}
+
+/** Find the local quadrant that contains each point owned by this process
+ * and sort the points and their payloads by its local index.
+ */
+static void
+p4est_points_locate (p4est_t * p4est, sc_array_t * points,
+                     sc_array_t * payloads, size_t payload_size)
+{
+  const size_t        num_points = points->elem_count;
+  size_t              zz, pos;
+  ssize_t             result;
+  p4est_locidx_t      jl, lq = p4est->local_num_quadrants;
+  p4est_locidx_t     *offsets;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  sc_array_t          sorted, sorted_payloads;
+
+  /* the containing leaf is the last local quadrant not after the point */
+  offsets = P4EST_ALLOC_ZERO (p4est_locidx_t, lq + 1);
+  for (zz = 0; zz < num_points; ++zz) {
+    q = p4est_quadrant_array_index (points, zz);
+    P4EST_ASSERT (p4est->first_local_tree <= q->p.which_tree &&
+                  q->p.which_tree <= p4est->last_local_tree);
+    tree = p4est_tree_array_index (p4est->trees, q->p.which_tree);
+    result = p4est_find_higher_bound (&tree->quadrants, q,
+                                      tree->quadrants.elem_count / 2);
+    P4EST_ASSERT (result >= 0);
+    P4EST_ASSERT (p4est_quadrant_contains_node
+                  (p4est_quadrant_array_index (&tree->quadrants,
+                                               (size_t) result), q));
+    q->p.piggy3.local_num = tree->quadrants_offset + (p4est_locidx_t) result;
+    ++offsets[q->p.piggy3.local_num + 1];
+  }
+  for (jl = 0; jl < lq; ++jl) {
+    offsets[jl + 1] += offsets[jl];
+  }
+
+  /* counting sort by the local quadrant index */
+  sc_array_init_size (&sorted, sizeof (p4est_quadrant_t), num_points);
+  sc_array_init_size (&sorted_payloads, SC_MAX (payload_size, 1),
+                      payload_size > 0 ? num_points : 0);
+  for (zz = 0; zz < num_points; ++zz) {
+    q = p4est_quadrant_array_index (points, zz);
+    pos = (size_t) offsets[q->p.piggy3.local_num]++;
+    *p4est_quadrant_array_index (&sorted, pos) = *q;
+    if (payload_size > 0) {
+      memcpy (sc_array_index (&sorted_payloads, pos),
+              sc_array_index (payloads, zz), payload_size);
+    }
+  }
+  memcpy (points->array, sorted.array, num_points * sizeof (p4est_quadrant_t));
+  if (payload_size > 0) {
+    memcpy (payloads->array, sorted_payloads.array,
+            num_points * payload_size);
+  }
+  sc_array_reset (&sorted);
+  sc_array_reset (&sorted_payloads);
+  P4EST_FREE (offsets);
+}
+
+void
+p4est_points_migrate (p4est_points_migrate_t * migrate,
+                      sc_array_t * points, sc_array_t * payloads)
+{
+  p4est_t            *p4est = migrate->p4est;
+  const size_t        payload_size = migrate->payload_size;
+  size_t              zc;
+  p4est_quadrant_t   *q;
+#ifdef P4EST_ENABLE_MPI
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+  const size_t        item_size = sizeof (p4est_quadrant_t) + payload_size;
+  int                 mpiret;
+  int                 owner, changed, any_changed;
+  int                 i, j, num_receivers, num_senders;
+  int                *receivers, *senders;
+  int                *counts, *offsets, *recv_counts;
+  size_t              zz, pos, num_points, num_kept, num_total;
+  char               *send_buf, *recv_buf, *item;
+  sc_array_t          kept, kept_payloads;
+  sc_MPI_Request     *requests;
+#endif
+
+  P4EST_ASSERT (points->elem_size == sizeof (p4est_quadrant_t));
+  P4EST_ASSERT (payload_size == 0 ||
+                (payloads != NULL && payloads->elem_size == payload_size &&
+                 payloads->elem_count == points->elem_count));
+  ++migrate->num_calls;
+
+#ifdef P4EST_ENABLE_MPI
+  /* find the owner of each point and count the points per process */
+  num_points = points->elem_count;
+  counts = P4EST_ALLOC_ZERO (int, num_procs);
+  offsets = P4EST_ALLOC (int, num_procs + 1);
+  recv_counts = NULL;
+  owner = rank;
+  for (zz = 0; zz < num_points; ++zz) {
+    q = p4est_quadrant_array_index (points, zz);
+    owner = p4est_comm_find_owner (p4est, q->p.which_tree, q, owner);
+    q->p.piggy3.local_num = owner;
+    ++counts[owner];
+  }
+
+  /* reuse the senders if we send to a subset of the previous receivers */
+  receivers = (int *) migrate->receivers.array;
+  num_receivers = (int) migrate->receivers.elem_count;
+  changed = (migrate->num_calls == 1);
+  for (i = 0, j = 0; !changed && i < num_procs; ++i) {
+    if (i == rank || counts[i] == 0) {
+      continue;
+    }
+    while (j < num_receivers && receivers[j] < i) {
+      ++j;
+    }
+    changed = (j == num_receivers || receivers[j] != i);
+  }
+  mpiret = sc_MPI_Allreduce (&changed, &any_changed, 1, sc_MPI_INT,
+                             sc_MPI_MAX, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  if (any_changed) {
+    sc_array_truncate (&migrate->receivers);
+    for (i = 0; i < num_procs; ++i) {
+      if (i != rank && counts[i] > 0) {
+        *(int *) sc_array_push (&migrate->receivers) = i;
+      }
+    }
+    receivers = (int *) migrate->receivers.array;
+    num_receivers = (int) migrate->receivers.elem_count;
+    sc_array_resize (&migrate->senders, (size_t) num_procs);
+    mpiret = sc_notify (receivers, num_receivers,
+                        (int *) migrate->senders.array, &num_senders,
+                        p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+    sc_array_resize (&migrate->senders, (size_t) num_senders);
+    ++migrate->num_notify;
+  }
+  senders = (int *) migrate->senders.array;
+  num_senders = (int) migrate->senders.elem_count;
+
+  /* exchange the number of points with the communication partners */
+  requests = P4EST_ALLOC (sc_MPI_Request, num_senders + num_receivers);
+  recv_counts = P4EST_ALLOC (int, num_senders);
+  for (i = 0; i < num_senders; ++i) {
+    mpiret = sc_MPI_Irecv (recv_counts + i, 1, sc_MPI_INT, senders[i],
+                           P4EST_COMM_POINTS_COUNT, p4est->mpicomm,
+                           requests + i);
+    SC_CHECK_MPI (mpiret);
+  }
+  for (i = 0; i < num_receivers; ++i) {
+    mpiret = sc_MPI_Isend (counts + receivers[i], 1, sc_MPI_INT,
+                           receivers[i], P4EST_COMM_POINTS_COUNT,
+                           p4est->mpicomm, requests + num_senders + i);
+    SC_CHECK_MPI (mpiret);
+  }
+  mpiret = sc_MPI_Waitall (num_senders + num_receivers, requests,
+                           sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+
+  /* pack the points and payloads by owner */
+  offsets[0] = 0;
+  for (i = 0; i < num_procs; ++i) {
+    offsets[i + 1] = offsets[i] + counts[i];
+  }
+  send_buf = P4EST_ALLOC (char, num_points * item_size);
+  for (zz = 0; zz < num_points; ++zz) {
+    q = p4est_quadrant_array_index (points, zz);
+    item = send_buf + (size_t) offsets[q->p.piggy3.local_num]++ * item_size;
+    memcpy (item, q, sizeof (p4est_quadrant_t));
+    if (payload_size > 0) {
+      memcpy (item + sizeof (p4est_quadrant_t),
+              sc_array_index (payloads, zz), payload_size);
+    }
+  }
+  for (i = num_procs; i > 0; --i) {
+    offsets[i] = offsets[i - 1];
+  }
+  offsets[0] = 0;
+
+  /* send and receive the points */
+  for (num_total = 0, i = 0; i < num_senders; ++i) {
+    num_total += (size_t) recv_counts[i];
+  }
+  recv_buf = P4EST_ALLOC (char, num_total * item_size);
+  for (pos = 0, i = 0; i < num_senders; ++i) {
+    requests[i] = sc_MPI_REQUEST_NULL;
+    if (recv_counts[i] > 0) {
+      mpiret = sc_MPI_Irecv (recv_buf + pos * item_size,
+                             (int) ((size_t) recv_counts[i] * item_size),
+                             sc_MPI_BYTE, senders[i], P4EST_COMM_POINTS_LOAD,
+                             p4est->mpicomm, requests + i);
+      SC_CHECK_MPI (mpiret);
+    }
+    pos += (size_t) recv_counts[i];
+  }
+  for (i = 0; i < num_receivers; ++i) {
+    requests[num_senders + i] = sc_MPI_REQUEST_NULL;
+    if (counts[receivers[i]] > 0) {
+      mpiret = sc_MPI_Isend (send_buf +
+                             (size_t) offsets[receivers[i]] * item_size,
+                             (int) ((size_t) counts[receivers[i]] *
+                                    item_size), sc_MPI_BYTE, receivers[i],
+                             P4EST_COMM_POINTS_LOAD, p4est->mpicomm,
+                             requests + num_senders + i);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+
+  /* keep the points owned by this process while messages are in flight */
+  num_kept = (size_t) counts[rank];
+  sc_array_init_size (&kept, sizeof (p4est_quadrant_t), num_kept);
+  sc_array_init_size (&kept_payloads, SC_MAX (payload_size, 1),
+                      payload_size > 0 ? num_kept : 0);
+  for (zz = 0; zz < num_kept; ++zz) {
+    item = send_buf + ((size_t) offsets[rank] + zz) * item_size;
+    memcpy (sc_array_index (&kept, zz), item, sizeof (p4est_quadrant_t));
+    if (payload_size > 0) {
+      memcpy (sc_array_index (&kept_payloads, zz),
+              item + sizeof (p4est_quadrant_t), payload_size);
+    }
+  }
+  mpiret = sc_MPI_Waitall (num_senders + num_receivers, requests,
+                           sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+
+  /* the owned points are the kept ones followed by the received ones */
+  sc_array_resize (points, num_kept + num_total);
+  memcpy (points->array, kept.array, num_kept * sizeof (p4est_quadrant_t));
+  if (payload_size > 0) {
+    sc_array_resize (payloads, num_kept + num_total);
+    memcpy (payloads->array, kept_payloads.array, num_kept * payload_size);
+  }
+  for (zz = 0; zz < num_total; ++zz) {
+    item = recv_buf + zz * item_size;
+    memcpy (sc_array_index (points, num_kept + zz), item,
+            sizeof (p4est_quadrant_t));
+    if (payload_size > 0) {
+      memcpy (sc_array_index (payloads, num_kept + zz),
+              item + sizeof (p4est_quadrant_t), payload_size);
+    }
+  }
+  sc_array_reset (&kept);
+  sc_array_reset (&kept_payloads);
+  P4EST_FREE (send_buf);
+  P4EST_FREE (recv_buf);
+  P4EST_FREE (requests);
+  P4EST_FREE (recv_counts);
+  P4EST_FREE (offsets);
+  P4EST_FREE (counts);
+#endif /* P4EST_ENABLE_MPI */
+
+  /* every point is now local */
+  p4est_points_locate (p4est, points, payloads, payload_size);
+
+  /* count the points of every local quadrant */
+  sc_array_resize (&migrate->counts, (size_t) p4est->local_num_quadrants);
+  memset (migrate->counts.array, 0,
+          migrate->counts.elem_count * migrate->counts.elem_size);
+  for (zc = 0; zc < points->elem_count; ++zc) {
+    q = p4est_quadrant_array_index (points, zc);
+    ++*(int *) sc_array_index (&migrate->counts,
+                               (size_t) q->p.piggy3.local_num);
+  }
+}
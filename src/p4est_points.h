@@ -62,6 +62,102 @@ p4est_t            *p4est_new_points (sc_MPI_Comm mpicomm,
                                       size_t data_size, p4est_init_t init_fn,
                                       void *user_pointer);
 
+/** Create a new forest from points that may be distributed arbitrarily.
+ * Unlike \ref p4est_new_points, this function does not rely on sc_psort.
+ * It sorts the points globally by regular sampling: every process sorts
+ * its points in Morton order, all processes agree on splitters chosen from
+ * equally spaced samples, and the points are exchanged accordingly.  The
+ * forest is then built in a single pass with \ref p4est_build_add,
+ * subdividing each coarse quadrant until it holds at most max_points points
+ * or reaches maxlevel.  The leaves are those of \ref p4est_new_points
+ * for the same points, while the partition may differ.
+ *
+ * \param [in] mpicomm       A valid MPI communicator.
+ * \param [in] connectivity  This is the connectivity information that
+ *                           the forest is built with.  Note the p4est
+ *                           does not take ownership of the memory.
+ * \param [in] maxlevel      Level of the smallest possible quadrants.
+ * \param [in,out] points    On input, an array of the locally known clamped
+ *                           quadrant nodes in any order, the tree id stored
+ *                           in p.which_tree.  On output, the points inside
+ *                           the local quadrants of the new forest in order.
+ * \param [in] max_points    Maximum number of points per quadrant.
+ *                           Applies to quadrants above maxlevel, so 0 is ok.
+ *                           A value of -1 disables all refinement.
+ * \param [in] data_size     This is the size of data for each quadrant which
+ *                           can be zero.  Then user_data_pool is set to NULL.
+ * \param [in] init_fn       Callback function to initialize the user_data
+ *                           which is already allocated automatically.
+ * \param [in] user_pointer  Assign to the user_pointer member of the p4est
+ *                           before init_fn is called the first time.
+ *
+ * \return This returns a valid forest.
+ */
+p4est_t            *p4est_new_points_sort (sc_MPI_Comm mpicomm,
+                                           p4est_connectivity_t *
+                                           connectivity, int maxlevel,
+                                           sc_array_t * points,
+                                           p4est_locidx_t max_points,
+                                           size_t data_size,
+                                           p4est_init_t init_fn,
+                                           void *user_pointer);
+
+/** Persistent state for moving points to the processes that own them.
+ * Each point is a clamped quadrant node as for \ref p4est_new_points,
+ * with the tree id stored in p.which_tree, and carries a payload of
+ * payload_size bytes.  The communication pattern of one call to
+ * \ref p4est_points_migrate is remembered.  If the next call sends to a
+ * subset of the previous receivers on all processes, the senders are
+ * known and the collective notification is skipped.
+ */
+typedef struct p4est_points_migrate
+{
+  p4est_t            *p4est;            /**< The forest to locate points in.
+                                             May be replaced between calls,
+                                             for example after partition. */
+  size_t              payload_size;     /**< Bytes of payload per point */
+  sc_array_t          receivers;        /**< Ranks sent to in the last call */
+  sc_array_t          senders;          /**< Ranks received from last call */
+  sc_array_t          counts;           /**< Points per local quadrant after
+                                             the last call, as int.  May be
+                                             passed to
+                                             p4est_partition_weights. */
+  int                 num_calls;        /**< Calls to p4est_points_migrate */
+  int                 num_notify;       /**< Calls that had to notify */
+}
+p4est_points_migrate_t;
+
+/** Create a persistent context for the migration of points.
+ * \param [in] p4est        The forest that locates the points.
+ *                          It is not copied and must stay alive.
+ * \param [in] payload_size Bytes of payload per point, may be zero.
+ * \return                  Context to be freed with
+ *                          \ref p4est_points_migrate_destroy.
+ */
+p4est_points_migrate_t *p4est_points_migrate_new (p4est_t * p4est,
+                                                   size_t payload_size);
+
+/** Free a context created by \ref p4est_points_migrate_new. */
+void                p4est_points_migrate_destroy (p4est_points_migrate_t *
+                                                  migrate);
+
+/** Send points to their owner processes and find their local quadrants.
+ * This function is collective over the communicator of the forest.
+ * \param [in] migrate      Context created by \ref p4est_points_migrate_new.
+ * \param [in,out] points   On input, the locally known points as an array
+ *                          of p4est_quadrant_t: clamped quadrant nodes with
+ *                          the tree in p.which_tree.  On output, the points
+ *                          owned by this process, sorted by the local
+ *                          quadrant that contains them, whose local index is
+ *                          stored in p.piggy3.local_num.
+ * \param [in,out] payloads Array with element size payload_size that holds
+ *                          one payload per point, permuted and resized with
+ *                          the points.  May be NULL if payload_size is 0.
+ */
+void                p4est_points_migrate (p4est_points_migrate_t * migrate,
+                                          sc_array_t * points,
+                                          sc_array_t * payloads);
+
 SC_EXTERN_C_END;
 
 #endif /* !P4EST_POINTS_H */
@@ -0,0 +1,528 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef P4_TO_P8
+#include <p4est_bits.h>
+#include <p4est_communication.h>
+#include <p4est_remap.h>
+#include <p4est_search.h>
+#else
+#include <p8est_bits.h>
+#include <p8est_communication.h>
+#include <p8est_remap.h>
+#include <p8est_search.h>
+#endif
+#include <sc_notify.h>
+
+/** One overlap returned to the process of the target quadrant. */
+typedef struct p4est_remap_reply
+{
+  p4est_gloidx_t      index;            /**< Global number in the source */
+  double              fraction;         /**< Covered part of the target */
+  p4est_locidx_t      local_num;        /**< Local number in the target */
+  p4est_locidx_t      pad;
+}
+p4est_remap_reply_t;
+
+/** Find the local source quadrants overlapping the queried quadrants.
+ * \param [in] source       The source forest.
+ * \param [in] queries      Target quadrants with tree and local number in
+ *                          the piggy3 member.
+ * \param [in] num_queries  Number of queries.
+ * \param [in,out] replies  One \ref p4est_remap_reply_t is appended per
+ *                          overlap.
+ * \param [in,out] indices  The local source number of each overlap is
+ *                          appended to this array of p4est_locidx_t.
+ */
+static void
+p4est_remap_answer (p4est_t * source, const p4est_quadrant_t * queries,
+                    size_t num_queries, sc_array_t * replies,
+                    sc_array_t * indices)
+{
+  const p4est_gloidx_t offset =
+    source->global_first_quadrant[source->mpirank];
+  size_t              zz, j, count;
+  ssize_t             k;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  const p4est_quadrant_t *a;
+  p4est_quadrant_t   *b, fd, ld;
+  p4est_remap_reply_t *reply;
+
+  for (zz = 0; zz < num_queries; ++zz) {
+    a = &queries[zz];
+    jt = a->p.piggy3.which_tree;
+    if (jt < source->first_local_tree || jt > source->last_local_tree) {
+      continue;
+    }
+    tree = p4est_tree_array_index (source->trees, jt);
+    count = tree->quadrants.elem_count;
+    p4est_quadrant_first_descendant (a, &fd, P4EST_QMAXLEVEL);
+    p4est_quadrant_last_descendant (a, &ld, P4EST_QMAXLEVEL);
+
+    /* the first overlap contains the first descendant or follows it */
+    j = 0;
+    k = p4est_find_higher_bound (&tree->quadrants, &fd, 0);
+    if (k >= 0) {
+      b = p4est_quadrant_array_index (&tree->quadrants, (size_t) k);
+      j = (size_t) k;
+      if (!p4est_quadrant_is_equal (b, &fd) &&
+          !p4est_quadrant_is_ancestor (b, &fd)) {
+        ++j;
+      }
+    }
+    for (; j < count; ++j) {
+      b = p4est_quadrant_array_index (&tree->quadrants, j);
+      if (p4est_quadrant_compare (b, &ld) > 0) {
+        break;
+      }
+      reply = (p4est_remap_reply_t *) sc_array_push (replies);
+      reply->index = offset + tree->quadrants_offset + (p4est_gloidx_t) j;
+      reply->fraction = b->level <= a->level ? 1. :
+        1. / (double) ((uint64_t) 1 << (P4EST_DIM * (b->level - a->level)));
+      reply->local_num = a->p.piggy3.local_num;
+      reply->pad = 0;
+      *(p4est_locidx_t *) sc_array_push (indices) =
+        tree->quadrants_offset + (p4est_locidx_t) j;
+    }
+  }
+}
+
+p4est_remap_t      *
+p4est_remap_new (p4est_t * p4est, p4est_t * source)
+{
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+  int                 p, i;
+  int                *owners, *counts, *first;
+  int                 num_dests, self_index;
+  int                *dests;
+  size_t              zz;
+  p4est_locidx_t      lid, slot, n;
+  p4est_locidx_t     *cursor;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, *bound, *sendq;
+  p4est_remap_reply_t *reply;
+  sc_array_t         *bounds, **replies, *indices;
+  p4est_remap_t      *remap;
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret, j;
+  int                 rcount, num_receivers, num_senders;
+  int                *receivers, *senders;
+  sc_array_t         *queries;
+  sc_array_t        **answers, **answer_indices;
+  MPI_Request        *requests;
+  MPI_Status          status;
+#endif
+
+  P4EST_ASSERT (p4est_connectivity_is_equivalent (p4est->connectivity,
+                                                  source->connectivity));
+  P4EST_ASSERT (p4est->mpisize == source->mpisize);
+  P4EST_ASSERT (p4est->mpirank == source->mpirank);
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_remap_new with %lld target quadrants\n",
+                            (long long) p4est->global_num_quadrants);
+  p4est_log_indent_push ();
+
+  /* find the source owners of the first and last descendants */
+  bounds = sc_array_new_count (sizeof (p4est_quadrant_t),
+                               2 * (size_t) p4est->local_num_quadrants);
+  lid = 0;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lid) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      bound = p4est_quadrant_array_index (bounds, 2 * (size_t) lid);
+      p4est_quadrant_first_descendant (q, bound, P4EST_QMAXLEVEL);
+      bound->p.which_tree = jt;
+      p4est_quadrant_last_descendant (q, bound + 1, P4EST_QMAXLEVEL);
+      bound[1].p.which_tree = jt;
+    }
+  }
+  P4EST_ASSERT (lid == p4est->local_num_quadrants);
+  owners = P4EST_ALLOC (int, bounds->elem_count);
+  p4est_comm_find_owners (source, bounds, owners);
+
+  /* every nonempty process between the two owners receives a query */
+  counts = P4EST_ALLOC_ZERO (int, num_procs + 1);
+  for (lid = 0; lid < p4est->local_num_quadrants; ++lid) {
+    for (p = owners[2 * lid]; p <= owners[2 * lid + 1]; ++p) {
+      if (!p4est_comm_is_empty (source, p)) {
+        ++counts[p + 1];
+      }
+    }
+  }
+  num_dests = 0;
+  for (p = 0; p < num_procs; ++p) {
+    num_dests += (counts[p + 1] > 0);
+    counts[p + 1] += counts[p];
+  }
+  first = P4EST_ALLOC (int, num_procs + 1);
+  memcpy (first, counts, (num_procs + 1) * sizeof (int));
+  sendq = P4EST_ALLOC (p4est_quadrant_t, counts[num_procs]);
+  lid = 0;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lid) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      for (p = owners[2 * lid]; p <= owners[2 * lid + 1]; ++p) {
+        if (!p4est_comm_is_empty (source, p)) {
+          P4EST_QUADRANT_INIT (&sendq[counts[p]]);
+          sendq[counts[p]].x = q->x;
+          sendq[counts[p]].y = q->y;
+#ifdef P4_TO_P8
+          sendq[counts[p]].z = q->z;
+#endif
+          sendq[counts[p]].level = q->level;
+          sendq[counts[p]].p.piggy3.which_tree = jt;
+          sendq[counts[p]].p.piggy3.local_num = lid;
+          ++counts[p];
+        }
+      }
+    }
+  }
+  P4EST_FREE (owners);
+  sc_array_destroy (bounds);
+  dests = P4EST_ALLOC (int, num_dests);
+  for (p = 0, i = 0; p < num_procs; ++p) {
+    if (first[p + 1] > first[p]) {
+      dests[i++] = p;
+    }
+  }
+  P4EST_ASSERT (i == num_dests);
+
+  /* the replies arrive in the order of the destinations */
+  replies = P4EST_ALLOC (sc_array_t *, num_dests);
+  for (i = 0; i < num_dests; ++i) {
+    replies[i] = sc_array_new (sizeof (p4est_remap_reply_t));
+  }
+  self_index = -1;
+  for (i = 0; i < num_dests; ++i) {
+    if (dests[i] == rank) {
+      self_index = i;
+    }
+  }
+
+  remap = P4EST_ALLOC_ZERO (p4est_remap_t, 1);
+  remap->mpicomm = p4est->mpicomm;
+  remap->mpirank = rank;
+  indices = sc_array_new (sizeof (p4est_locidx_t));
+
+#ifdef P4EST_ENABLE_MPI
+  num_receivers = num_dests - (self_index >= 0);
+  receivers = P4EST_ALLOC (int, num_receivers);
+  for (i = 0, j = 0; i < num_dests; ++i) {
+    if (i != self_index) {
+      receivers[j++] = dests[i];
+    }
+  }
+  senders = P4EST_ALLOC (int, num_procs);
+  mpiret = sc_notify (receivers, num_receivers, senders, &num_senders,
+                      p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  /* post the queries */
+  requests = P4EST_ALLOC (MPI_Request, num_receivers + num_senders);
+  for (j = 0; j < num_receivers; ++j) {
+    p = receivers[j];
+    mpiret = MPI_Isend (sendq + first[p], (first[p + 1] - first[p]) *
+                        (int) sizeof (p4est_quadrant_t), MPI_BYTE, p,
+                        P4EST_COMM_REMAP_QUERY, p4est->mpicomm,
+                        &requests[j]);
+    SC_CHECK_MPI (mpiret);
+  }
+
+  /* answer the queries of other processes */
+  queries = sc_array_new (sizeof (p4est_quadrant_t));
+  answers = P4EST_ALLOC (sc_array_t *, num_senders);
+  answer_indices = P4EST_ALLOC (sc_array_t *, num_senders);
+  for (j = 0; j < num_senders; ++j) {
+    mpiret = MPI_Probe (senders[j], P4EST_COMM_REMAP_QUERY,
+                        p4est->mpicomm, &status);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Get_count (&status, MPI_BYTE, &rcount);
+    SC_CHECK_MPI (mpiret);
+    SC_CHECK_ABORT (rcount % (int) sizeof (p4est_quadrant_t) == 0,
+                    "Remap query mismatch");
+    sc_array_resize (queries, (size_t) rcount / sizeof (p4est_quadrant_t));
+    mpiret = MPI_Recv (queries->array, rcount, MPI_BYTE, senders[j],
+                       P4EST_COMM_REMAP_QUERY, p4est->mpicomm,
+                       MPI_STATUS_IGNORE);
+    SC_CHECK_MPI (mpiret);
+    answers[j] = sc_array_new (sizeof (p4est_remap_reply_t));
+    answer_indices[j] = sc_array_new (sizeof (p4est_locidx_t));
+    p4est_remap_answer (source, (p4est_quadrant_t *) queries->array,
+                        queries->elem_count, answers[j], answer_indices[j]);
+    mpiret = MPI_Isend (answers[j]->array, (int)
+                        (answers[j]->elem_count *
+                         sizeof (p4est_remap_reply_t)), MPI_BYTE,
+                        senders[j], P4EST_COMM_REMAP_REPLY,
+                        p4est->mpicomm, &requests[num_receivers + j]);
+    SC_CHECK_MPI (mpiret);
+  }
+  sc_array_destroy (queries);
+#endif
+
+  /* answer our own queries locally */
+  if (self_index >= 0) {
+    p4est_remap_answer (source, sendq + first[rank],
+                        (size_t) (first[rank + 1] - first[rank]),
+                        replies[self_index], indices);
+  }
+
+  /* the send plan lists ourselves first and then the querying ranks */
+  remap->num_sends = (self_index >= 0);
+#ifdef P4EST_ENABLE_MPI
+  remap->num_sends += num_senders;
+#endif
+  remap->send_ranks = P4EST_ALLOC (int, remap->num_sends);
+  remap->send_offsets = P4EST_ALLOC (p4est_locidx_t, remap->num_sends + 1);
+  remap->send_offsets[0] = 0;
+  i = 0;
+  if (self_index >= 0) {
+    remap->send_ranks[0] = rank;
+    remap->send_offsets[1] = (p4est_locidx_t) indices->elem_count;
+    i = 1;
+  }
+#ifdef P4EST_ENABLE_MPI
+  for (j = 0; j < num_senders; ++j, ++i) {
+    remap->send_ranks[i] = senders[j];
+    remap->send_offsets[i + 1] = remap->send_offsets[i] +
+      (p4est_locidx_t) answer_indices[j]->elem_count;
+  }
+#endif
+  P4EST_ASSERT (i == remap->num_sends);
+  remap->send_index =
+    P4EST_ALLOC (p4est_locidx_t, remap->send_offsets[remap->num_sends]);
+  memcpy (remap->send_index, indices->array,
+          indices->elem_count * sizeof (p4est_locidx_t));
+#ifdef P4EST_ENABLE_MPI
+  for (j = 0; j < num_senders; ++j) {
+    i = j + (self_index >= 0);
+    memcpy (remap->send_index + remap->send_offsets[i],
+            answer_indices[j]->array,
+            answer_indices[j]->elem_count * sizeof (p4est_locidx_t));
+    sc_array_destroy (answer_indices[j]);
+  }
+#endif
+  sc_array_destroy (indices);
+
+#ifdef P4EST_ENABLE_MPI
+  /* receive the replies to our queries */
+  for (i = 0; i < num_dests; ++i) {
+    if (i == self_index) {
+      continue;
+    }
+    mpiret = MPI_Probe (dests[i], P4EST_COMM_REMAP_REPLY,
+                        p4est->mpicomm, &status);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Get_count (&status, MPI_BYTE, &rcount);
+    SC_CHECK_MPI (mpiret);
+    SC_CHECK_ABORT (rcount % (int) sizeof (p4est_remap_reply_t) == 0,
+                    "Remap reply mismatch");
+    sc_array_resize (replies[i],
+                     (size_t) rcount / sizeof (p4est_remap_reply_t));
+    mpiret = MPI_Recv (replies[i]->array, rcount, MPI_BYTE, dests[i],
+                       P4EST_COMM_REMAP_REPLY, p4est->mpicomm,
+                       MPI_STATUS_IGNORE);
+    SC_CHECK_MPI (mpiret);
+  }
+  mpiret = MPI_Waitall (num_receivers + num_senders, requests,
+                        MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  for (j = 0; j < num_senders; ++j) {
+    sc_array_destroy (answers[j]);
+  }
+  P4EST_FREE (answers);
+  P4EST_FREE (answer_indices);
+  P4EST_FREE (requests);
+  P4EST_FREE (senders);
+  P4EST_FREE (receivers);
+#endif
+  P4EST_FREE (sendq);
+  P4EST_FREE (first);
+  P4EST_FREE (counts);
+
+  /* assemble the overlaps of each target quadrant by ascending rank */
+  remap->num_local = p4est->local_num_quadrants;
+  remap->offsets = P4EST_ALLOC_ZERO (p4est_locidx_t, remap->num_local + 1);
+  remap->num_recvs = num_dests;
+  remap->recv_ranks = dests;
+  remap->recv_offsets = P4EST_ALLOC (p4est_locidx_t, num_dests + 1);
+  remap->recv_offsets[0] = 0;
+  for (i = 0; i < num_dests; ++i) {
+    remap->recv_offsets[i + 1] = remap->recv_offsets[i] +
+      (p4est_locidx_t) replies[i]->elem_count;
+    for (zz = 0; zz < replies[i]->elem_count; ++zz) {
+      reply = (p4est_remap_reply_t *) sc_array_index (replies[i], zz);
+      SC_CHECK_ABORT (0 <= reply->local_num &&
+                      reply->local_num < remap->num_local,
+                      "Remap reply out of range");
+      ++remap->offsets[reply->local_num + 1];
+    }
+  }
+  for (lid = 0; lid < remap->num_local; ++lid) {
+    remap->offsets[lid + 1] += remap->offsets[lid];
+  }
+  remap->num_overlaps = remap->offsets[remap->num_local];
+  P4EST_ASSERT (remap->num_overlaps == remap->recv_offsets[num_dests]);
+  remap->overlap_index = P4EST_ALLOC (p4est_gloidx_t, remap->num_overlaps);
+  remap->overlap_owner = P4EST_ALLOC (int, remap->num_overlaps);
+  remap->overlap_fraction = P4EST_ALLOC (double, remap->num_overlaps);
+  remap->recv_slots = P4EST_ALLOC (p4est_locidx_t, remap->num_overlaps);
+  cursor = P4EST_ALLOC (p4est_locidx_t, remap->num_local);
+  memcpy (cursor, remap->offsets, remap->num_local * sizeof (p4est_locidx_t));
+  n = 0;
+  for (i = 0; i < num_dests; ++i) {
+    for (zz = 0; zz < replies[i]->elem_count; ++zz) {
+      reply = (p4est_remap_reply_t *) sc_array_index (replies[i], zz);
+      slot = cursor[reply->local_num]++;
+      remap->overlap_index[slot] = reply->index;
+      remap->overlap_owner[slot] = dests[i];
+      remap->overlap_fraction[slot] = reply->fraction;
+      remap->recv_slots[n++] = slot;
+    }
+    sc_array_destroy (replies[i]);
+  }
+  P4EST_ASSERT (n == remap->num_overlaps);
+  P4EST_FREE (cursor);
+  P4EST_FREE (replies);
+
+  P4EST_VERBOSEF ("Remap overlaps %lld from %d processes, serving %d\n",
+                  (long long) remap->num_overlaps, remap->num_recvs,
+                  remap->num_sends);
+
+  p4est_log_indent_pop ();
+  P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_remap_new\n");
+  return remap;
+}
+
+void
+p4est_remap_destroy (p4est_remap_t * remap)
+{
+  P4EST_FREE (remap->offsets);
+  P4EST_FREE (remap->overlap_index);
+  P4EST_FREE (remap->overlap_owner);
+  P4EST_FREE (remap->overlap_fraction);
+  P4EST_FREE (remap->recv_ranks);
+  P4EST_FREE (remap->recv_offsets);
+  P4EST_FREE (remap->recv_slots);
+  P4EST_FREE (remap->send_ranks);
+  P4EST_FREE (remap->send_offsets);
+  P4EST_FREE (remap->send_index);
+  P4EST_FREE (remap);
+}
+
+void
+p4est_remap_gather (p4est_remap_t * remap, const void *source_data,
+                    void *overlap_data, size_t data_size)
+{
+  int                 i;
+  p4est_locidx_t      k, first, count;
+  char               *self_buf, **send_bufs;
+  const char         *src = (const char *) source_data;
+  char               *dst = (char *) overlap_data;
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret, num_requests;
+  char              **recv_bufs;
+  MPI_Request        *requests;
+#endif
+
+  /* pack the requested source data by receiving process */
+  self_buf = NULL;
+  send_bufs = P4EST_ALLOC (char *, remap->num_sends);
+  for (i = 0; i < remap->num_sends; ++i) {
+    first = remap->send_offsets[i];
+    count = remap->send_offsets[i + 1] - first;
+    send_bufs[i] = P4EST_ALLOC (char, count * data_size);
+    for (k = 0; k < count; ++k) {
+      memcpy (send_bufs[i] + k * data_size,
+              src + remap->send_index[first + k] * data_size, data_size);
+    }
+    if (remap->send_ranks[i] == remap->mpirank) {
+      self_buf = send_bufs[i];
+    }
+  }
+
+#ifdef P4EST_ENABLE_MPI
+  num_requests = 0;
+  requests = P4EST_ALLOC (MPI_Request, remap->num_sends + remap->num_recvs);
+  recv_bufs = P4EST_ALLOC_ZERO (char *, remap->num_recvs);
+  for (i = 0; i < remap->num_recvs; ++i) {
+    if (remap->recv_ranks[i] != remap->mpirank) {
+      count = remap->recv_offsets[i + 1] - remap->recv_offsets[i];
+      recv_bufs[i] = P4EST_ALLOC (char, count * data_size);
+      mpiret = MPI_Irecv (recv_bufs[i], (int) (count * data_size), MPI_BYTE,
+                          remap->recv_ranks[i], P4EST_COMM_REMAP_DATA,
+                          remap->mpicomm, &requests[num_requests++]);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+  for (i = 0; i < remap->num_sends; ++i) {
+    if (remap->send_ranks[i] != remap->mpirank) {
+      count = remap->send_offsets[i + 1] - remap->send_offsets[i];
+      mpiret = MPI_Isend (send_bufs[i], (int) (count * data_size), MPI_BYTE,
+                          remap->send_ranks[i], P4EST_COMM_REMAP_DATA,
+                          remap->mpicomm, &requests[num_requests++]);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+#endif
+
+  /* place the received data into the overlap slots */
+  for (i = 0; i < remap->num_recvs; ++i) {
+    if (remap->recv_ranks[i] == remap->mpirank) {
+      first = remap->recv_offsets[i];
+      count = remap->recv_offsets[i + 1] - first;
+      for (k = 0; k < count; ++k) {
+        memcpy (dst + remap->recv_slots[first + k] * data_size,
+                self_buf + k * data_size, data_size);
+      }
+    }
+  }
+#ifdef P4EST_ENABLE_MPI
+  mpiret = MPI_Waitall (num_requests, requests, MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  for (i = 0; i < remap->num_recvs; ++i) {
+    if (recv_bufs[i] != NULL) {
+      first = remap->recv_offsets[i];
+      count = remap->recv_offsets[i + 1] - first;
+      for (k = 0; k < count; ++k) {
+        memcpy (dst + remap->recv_slots[first + k] * data_size,
+                recv_bufs[i] + k * data_size, data_size);
+      }
+      P4EST_FREE (recv_bufs[i]);
+    }
+  }
+  P4EST_FREE (recv_bufs);
+  P4EST_FREE (requests);
+#endif
+
+  for (i = 0; i < remap->num_sends; ++i) {
+    P4EST_FREE (send_bufs[i]);
+  }
+  P4EST_FREE (send_bufs);
+}
@@ -24,11 +24,15 @@
 
 #ifndef P4_TO_P8
 #include <p4est_bits.h>
+#include <p4est_bits_inline.h>
 #include <p4est_communication.h>
+#include <p4est_extended.h>
 #include <p4est_search.h>
 #else
 #include <p8est_bits.h>
+#include <p8est_bits_inline.h>
 #include <p8est_communication.h>
+#include <p8est_extended.h>
 #include <p8est_search.h>
 #endif
 #include <sc_search.h>
@@ -38,6 +42,10 @@
                 p4est_comm_is_empty_gfq ((gfq), (num_procs), (p)) :\
                 p4est_comm_is_empty_gfp ((gfp), (num_procs), (p)))
 
+/** Ranges of at most this many quadrants are searched by one batch of
+ * comparisons instead of bisection. */
+#define P4EST_SEARCH_BATCH 16
+
 /** A callback function that describes the search window.
  *  The idea is to define the type of an array entry as type 1, if
  *  my_begin <= array[i], my_end > array[i] and as type 2, if the entry
@@ -96,7 +104,8 @@ p4est_find_lower_bound (sc_array_t * array,
                         const p4est_quadrant_t * q, size_t guess)
 {
   int                 comp;
-  size_t              count;
+  int8_t              batch[P4EST_SEARCH_BATCH];
+  size_t              count, iz;
   size_t              quad_low, quad_high;
   p4est_quadrant_t   *cur;
 
@@ -112,12 +121,25 @@ p4est_find_lower_bound (sc_array_t * array,
     P4EST_ASSERT (quad_low < count && quad_high < count);
     P4EST_ASSERT (quad_low <= guess && guess <= quad_high);
 
+    /* the result, if any, is the first quadrant >= q in the range */
+    if (quad_high - quad_low < P4EST_SEARCH_BATCH) {
+      cur = p4est_quadrant_array_index (array, quad_low);
+      p4est_quadrant_compare_batch (q, cur, quad_high - quad_low + 1, batch);
+      for (iz = 0; iz <= quad_high - quad_low; ++iz) {
+        if (batch[iz] <= 0) {
+          return (ssize_t) (quad_low + iz);
+        }
+      }
+      return -1;
+    }
+
     /* compare two quadrants */
     cur = p4est_quadrant_array_index (array, guess);
-    comp = p4est_quadrant_compare (q, cur);
+    comp = p4est_quadrant_compare_inline (q, cur);
 
     /* check if guess is higher or equal q and there's room below it */
-    if (comp <= 0 && (guess > 0 && p4est_quadrant_compare (q, cur - 1) <= 0)) {
+    if (comp <= 0 &&
+        (guess > 0 && p4est_quadrant_compare_inline (q, cur - 1) <= 0)) {
       quad_high = guess - 1;
       guess = (quad_low + quad_high + 1) / 2;
       continue;
@@ -145,7 +167,8 @@ p4est_find_higher_bound (sc_array_t * array,
                          const p4est_quadrant_t * q, size_t guess)
 {
   int                 comp;
-  size_t              count;
+  int8_t              batch[P4EST_SEARCH_BATCH];
+  size_t              count, iz;
   size_t              quad_low, quad_high;
   p4est_quadrant_t   *cur;
 
@@ -161,13 +184,26 @@ p4est_find_higher_bound (sc_array_t * array,
     P4EST_ASSERT (quad_low < count && quad_high < count);
     P4EST_ASSERT (quad_low <= guess && guess <= quad_high);
 
+    /* the result, if any, is the last quadrant <= q in the range */
+    if (quad_high - quad_low < P4EST_SEARCH_BATCH) {
+      cur = p4est_quadrant_array_index (array, quad_low);
+      p4est_quadrant_compare_batch (q, cur, quad_high - quad_low + 1, batch);
+      for (iz = quad_high - quad_low + 1; iz > 0; --iz) {
+        if (batch[iz - 1] >= 0) {
+          return (ssize_t) (quad_low + iz - 1);
+        }
+      }
+      return -1;
+    }
+
     /* compare two quadrants */
     cur = p4est_quadrant_array_index (array, guess);
-    comp = p4est_quadrant_compare (cur, q);
+    comp = p4est_quadrant_compare_inline (cur, q);
 
     /* check if guess is lower or equal q and there's room above it */
     if (comp <= 0 &&
-        (guess < count - 1 && p4est_quadrant_compare (cur + 1, q) <= 0)) {
+        (guess < count - 1 &&
+         p4est_quadrant_compare_inline (cur + 1, q) <= 0)) {
       quad_low = guess + 1;
       guess = (quad_low + quad_high) / 2;
       continue;
@@ -245,6 +281,84 @@ p4est_find_quadrant_cumulative (p4est_t * p4est, p4est_locidx_t cumulative_id,
   }
 }
 
+void
+p4est_find_quadrant_cumulative_batch (p4est_t * p4est, size_t num_ids,
+                                      const p4est_locidx_t * cumulative_ids,
+                                      p4est_topidx_t * which_trees,
+                                      p4est_locidx_t * quadrant_ids,
+                                      p4est_quadrant_t ** quadrants)
+{
+  int                 is_sorted;
+  size_t              zz;
+  p4est_topidx_t      num_local_trees, jt, low, high, guess;
+  p4est_locidx_t      id, *offsets;
+  p4est_tree_t       *tree;
+
+  if (num_ids == 0) {
+    return;
+  }
+  P4EST_ASSERT (cumulative_ids != NULL);
+  P4EST_ASSERT (p4est->first_local_tree <= p4est->last_local_tree);
+
+  /* the local tree offsets are a run-length encoding of the tree numbers */
+  num_local_trees = p4est->last_local_tree - p4est->first_local_tree + 1;
+  offsets = P4EST_ALLOC (p4est_locidx_t, num_local_trees + 1);
+  for (jt = 0; jt < num_local_trees; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees,
+                                   p4est->first_local_tree + jt);
+    offsets[jt] = tree->quadrants_offset;
+  }
+  offsets[num_local_trees] = p4est->local_num_quadrants;
+
+  /* sorted input is translated by a single merge over the trees */
+  is_sorted = 1;
+  for (zz = 1; is_sorted && zz < num_ids; ++zz) {
+    is_sorted = (cumulative_ids[zz - 1] <= cumulative_ids[zz]);
+  }
+
+  jt = 0;
+  for (zz = 0; zz < num_ids; ++zz) {
+    id = cumulative_ids[zz];
+    P4EST_ASSERT (0 <= id && id < p4est->local_num_quadrants);
+    if (is_sorted) {
+      while (offsets[jt + 1] <= id) {
+        ++jt;
+      }
+    }
+    else {
+      /* find the smallest high with offsets[high] > id */
+      low = 1;
+      high = num_local_trees;
+      while (low < high) {
+        guess = low + (high - low) / 2;
+        if (offsets[guess] > id) {
+          high = guess;
+        }
+        else {
+          low = guess + 1;
+        }
+      }
+      jt = high - 1;
+    }
+    P4EST_ASSERT (offsets[jt] <= id && id < offsets[jt + 1]);
+
+    if (which_trees != NULL) {
+      which_trees[zz] = p4est->first_local_tree + jt;
+    }
+    if (quadrant_ids != NULL) {
+      quadrant_ids[zz] = id - offsets[jt];
+    }
+    if (quadrants != NULL) {
+      tree = p4est_tree_array_index (p4est->trees,
+                                     p4est->first_local_tree + jt);
+      quadrants[zz] = p4est_quadrant_array_index (&tree->quadrants,
+                                                  (size_t) (id -
+                                                            offsets[jt]));
+    }
+  }
+  P4EST_FREE (offsets);
+}
+
 static              size_t
 p4est_array_split_ancestor_id (sc_array_t * array, size_t zindex, void *data)
 {
@@ -380,7 +494,7 @@ p4est_range_boundaries (p4est_quadrant_t * lq, p4est_quadrant_t * uq,
       touch |= (p4est_corner_boundaries[i] & mask);
     }
 
-    cid = p4est_quadrant_child_id (lq);
+    cid = p4est_quadrant_child_id_inline (lq);
     x = lq->x + ((cid & 1) ? shift : 0);
     y = lq->y + (((cid >> 1) & 1) ? shift : 0);
 #ifdef P4_TO_P8
@@ -406,7 +520,7 @@ p4est_range_boundaries (p4est_quadrant_t * lq, p4est_quadrant_t * uq,
                                        level + 1, touch, lnext);
     }
 
-    cid = p4est_quadrant_child_id (uq);
+    cid = p4est_quadrant_child_id_inline (uq);
     x = uq->x + ((cid & 1) ? shift : 0);
     y = uq->y + (((cid >> 1) & 1) ? shift : 0);
 #ifdef P4_TO_P8
@@ -471,7 +585,7 @@ p4est_find_range_boundaries (p4est_quadrant_t * lq, p4est_quadrant_t * uq,
   if (lq == NULL) {
     P4EST_ASSERT (uq->level == P4EST_QMAXLEVEL);
 
-    cid = p4est_quadrant_child_id (uq);
+    cid = p4est_quadrant_child_id_inline (uq);
     x = uq->x + ((cid & 1) ? shift : 0);
     y = uq->y + (((cid >> 1) & 1) ? shift : 0);
 #ifdef P4_TO_P8
@@ -498,7 +612,7 @@ p4est_find_range_boundaries (p4est_quadrant_t * lq, p4est_quadrant_t * uq,
   else if (uq == NULL) {
     P4EST_ASSERT (lq->level == P4EST_QMAXLEVEL);
 
-    cid = p4est_quadrant_child_id (lq);
+    cid = p4est_quadrant_child_id_inline (lq);
     x = lq->x + ((cid & 1) ? shift : 0);
     y = lq->y + (((cid >> 1) & 1) ? shift : 0);
 #ifdef P4_TO_P8
@@ -563,6 +677,60 @@ find_range_boundaries_exit:
   return touch;
 }
 
+/** Store the indices of the points to be queried in a batch.
+ * \param [in] actives     The active point indices, or NULL for all points.
+ * \param [in] act_count   The number of active points.
+ * \param [in,out] chact   Empty array of size_t, is filled with the indices.
+ * \return                 Allocated keep mask with one entry per index.
+ */
+static int8_t      *
+p4est_search_batch_prepare (sc_array_t * actives, size_t act_count,
+                            sc_array_t * chact)
+{
+  size_t              zz, *pz;
+
+  P4EST_ASSERT (chact->elem_count == 0);
+  if (actives != NULL) {
+    sc_array_copy (chact, actives);
+  }
+  else {
+    pz = (size_t *) sc_array_push_count (chact, act_count);
+    for (zz = 0; zz < act_count; ++zz) {
+      pz[zz] = zz;
+    }
+  }
+  return P4EST_ALLOC (int8_t, act_count);
+}
+
+/** Keep the indices of the points selected in a batch.
+ * \param [in,out] chact   Indices from \ref p4est_search_batch_prepare;
+ *                         is reset if no index is kept.
+ * \param [in] keep        Keep mask written by the callback; freed here.
+ * \param [in] proceed     If false, no index is kept.
+ */
+static void
+p4est_search_batch_compact (sc_array_t * chact, int8_t * keep, int proceed)
+{
+  size_t              zz, kept;
+  size_t             *pz = (size_t *) chact->array;
+
+  kept = 0;
+  if (proceed) {
+    for (zz = 0; zz < chact->elem_count; ++zz) {
+      if (keep[zz]) {
+        pz[kept++] = pz[zz];
+      }
+    }
+  }
+  P4EST_FREE (keep);
+  if (kept == 0) {
+    sc_array_reset (chact);
+  }
+  else {
+    sc_array_resize (chact, kept);
+  }
+}
+
 /** This recursion context saves on the number of parameters passed. */
 typedef struct p4est_local_recursion
 {
@@ -571,10 +739,12 @@ typedef struct p4est_local_recursion
   int                 call_post;        /**< Boolean to call quadrant twice. */
   int                 skip;             /**< Boolean to avoid skipping levels in parallel, if desired*/
   p4est_search_reorder_t children_fn;   /**< Reorder children if not NULL. */
+  p4est_search_order_t order_fn;        /**< Choose child order if not NULL. */
   p4est_search_local_t quadrant_fn;     /**< The quadrant callback for backwards compatibility, if any. */
   p4est_search_local_t pre_quadrant_fn; /**< The pre recursion quadrant callback, if any. */
   p4est_search_local_t post_quadrant_fn;/**< The post recursion quadrant callback, if any. */
   p4est_search_local_t point_fn;        /**< The point callback, if any. */
+  p4est_search_local_batch_t batch_fn; /**< The batch point callback. */
   sc_array_t         *points;           /**< Array of points to search. */
 }
 p4est_local_recursion_t;
@@ -593,6 +763,7 @@ p4est_local_recursion (const p4est_local_recursion_t * rec,
   size_t              split[P4EST_CHILDREN + 1];
   p4est_locidx_t      local_num;
   p4est_quadrant_t   *q, *lq, child;
+  int8_t             *keep;
   sc_array_t          child_quadrants, child_actives, *chact;
 
   /*
@@ -684,14 +855,24 @@ p4est_local_recursion (const p4est_local_recursion_t * rec,
     /* query callback for all points and return if none remain */
     chact = &child_actives;
     sc_array_init (chact, sizeof (size_t));
-    for (zz = 0; zz < act_count; ++zz) {
-      pz = actives == NULL ? &zz : (size_t *) sc_array_index (actives, zz);
-      is_match = rec->point_fn (rec->p4est, rec->which_tree,
-                                quadrant, local_num,
-                                sc_array_index (rec->points, *pz));
-      if (!is_leaf && is_match) {
-        qz = (size_t *) sc_array_push (chact);
-        *qz = *pz;
+    if (rec->batch_fn != NULL) {
+      /* one call for all points */
+      keep = p4est_search_batch_prepare (actives, act_count, chact);
+      rec->batch_fn (rec->p4est, rec->which_tree, quadrant, local_num,
+                     rec->points, (const size_t *) chact->array, act_count,
+                     keep);
+      p4est_search_batch_compact (chact, keep, !is_leaf);
+    }
+    else {
+      for (zz = 0; zz < act_count; ++zz) {
+        pz = actives == NULL ? &zz : (size_t *) sc_array_index (actives, zz);
+        is_match = rec->point_fn (rec->p4est, rec->which_tree,
+                                  quadrant, local_num,
+                                  sc_array_index (rec->points, *pz));
+        if (!is_leaf && is_match) {
+          qz = (size_t *) sc_array_push (chact);
+          *qz = *pz;
+        }
       }
     }
 
@@ -729,20 +910,24 @@ p4est_local_recursion (const p4est_local_recursion_t * rec,
   }
 }
 
-void
-p4est_search_local (p4est_t * p4est,
-                    int call_post, p4est_search_local_t quadrant_fn,
-                    p4est_search_local_t point_fn, sc_array_t * points)
+/* the common implementation of p4est_search_local and its batch variant */
+static void
+p4est_search_local_internal (p4est_t * p4est, int call_post,
+                             p4est_search_local_t quadrant_fn,
+                             p4est_search_local_t point_fn,
+                             p4est_search_local_batch_t batch_fn,
+                             sc_array_t * points)
 {
   p4est_topidx_t      jt;
   p4est_tree_t       *tree;
   p4est_quadrant_t    root;
   p4est_local_recursion_t srec, *rec = &srec;
   sc_array_t         *tquadrants;
+  double              inspect_start;
 
   /* correct call convention? */
   P4EST_ASSERT (p4est != NULL);
-  P4EST_ASSERT (points == NULL || point_fn != NULL);
+  P4EST_ASSERT (points == NULL || (point_fn != NULL) != (batch_fn != NULL));
 
   /* we do nothing if there is nothing we can do */
   if (quadrant_fn == NULL && points == NULL) {
@@ -750,14 +935,17 @@ p4est_search_local (p4est_t * p4est,
   }
 
   /* set recursion context */
+  inspect_start = p4est_inspect_start (p4est->inspect);
   rec->p4est = p4est;
   rec->which_tree = -1;
   rec->call_post = call_post;
   rec->children_fn = NULL;
+  rec->order_fn = NULL;
   rec->quadrant_fn = quadrant_fn;
   rec->pre_quadrant_fn = NULL;
   rec->post_quadrant_fn = NULL;
   rec->point_fn = point_fn;
+  rec->batch_fn = batch_fn;
   rec->points = points;
   rec->skip = 1;
   for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
@@ -771,6 +959,141 @@ p4est_search_local (p4est_t * p4est,
     p4est_quadrant_set_morton (&root, 0, 0);
     p4est_local_recursion (rec, &root, tquadrants, NULL);
   }
+  p4est_inspect_stop (p4est->inspect, P4EST_INSPECT_SEARCH, inspect_start);
+}
+
+void
+p4est_search_local (p4est_t * p4est,
+                    int call_post, p4est_search_local_t quadrant_fn,
+                    p4est_search_local_t point_fn, sc_array_t * points)
+{
+  p4est_search_local_internal (p4est, call_post, quadrant_fn, point_fn,
+                               NULL, points);
+}
+
+void
+p4est_search_local_batch (p4est_t * p4est,
+                          int call_post, p4est_search_local_t quadrant_fn,
+                          p4est_search_local_batch_t batch_fn,
+                          sc_array_t * points)
+{
+  p4est_search_local_internal (p4est, call_post, quadrant_fn, NULL,
+                               batch_fn, points);
+}
+
+void
+p4est_search_local_threads (p4est_t * p4est,
+                            int call_post, p4est_search_local_t quadrant_fn,
+                            p4est_search_local_t point_fn,
+                            sc_array_t * points)
+{
+  int                 num_threads;
+  double              inspect_start;
+
+  /* correct call convention? */
+  P4EST_ASSERT (p4est != NULL);
+  P4EST_ASSERT (points == NULL || point_fn != NULL);
+
+  num_threads = p4est_get_num_threads ();
+  if (num_threads == 1 || p4est->first_local_tree < 0 ||
+      (quadrant_fn == NULL && points == NULL)) {
+    p4est_search_local (p4est, call_post, quadrant_fn, point_fn, points);
+    return;
+  }
+
+  inspect_start = p4est_inspect_start (p4est->inspect);
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel num_threads (num_threads)
+#endif
+  {
+    int                 thread_num;
+    size_t              pbegin, pend;
+    long                jl;
+    p4est_tree_t       *tree;
+    p4est_quadrant_t    root;
+    p4est_local_recursion_t srec, *rec = &srec;
+    sc_array_t          pview;
+
+    /* each thread works on its own copy of the recursion context */
+    rec->p4est = p4est;
+    rec->which_tree = -1;
+    rec->call_post = call_post;
+    rec->children_fn = NULL;
+    rec->order_fn = NULL;
+    rec->quadrant_fn = quadrant_fn;
+    rec->pre_quadrant_fn = NULL;
+    rec->post_quadrant_fn = NULL;
+    rec->point_fn = point_fn;
+    rec->batch_fn = NULL;
+    rec->points = NULL;
+    rec->skip = 1;
+    if (points != NULL) {
+      /* every thread searches all trees for a contiguous share of points */
+      thread_num = p4est_get_thread_num ();
+      pbegin = (points->elem_count * (size_t) thread_num) / num_threads;
+      pend = (points->elem_count * (size_t) (thread_num + 1)) / num_threads;
+      if (pbegin < pend) {
+        sc_array_init_view (&pview, points, pbegin, pend - pbegin);
+        rec->points = &pview;
+        for (jl = (long) p4est->first_local_tree;
+             jl <= (long) p4est->last_local_tree; ++jl) {
+          rec->which_tree = (p4est_topidx_t) jl;
+          tree = p4est_tree_array_index (p4est->trees, rec->which_tree);
+          p4est_quadrant_set_morton (&root, 0, 0);
+          p4est_local_recursion (rec, &root, &tree->quadrants, NULL);
+        }
+        sc_array_reset (&pview);
+      }
+    }
+    else {
+      /* without points the trees are distributed among the threads */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp for schedule (dynamic, 1)
+#endif
+      for (jl = (long) p4est->first_local_tree;
+           jl <= (long) p4est->last_local_tree; ++jl) {
+        rec->which_tree = (p4est_topidx_t) jl;
+        tree = p4est_tree_array_index (p4est->trees, rec->which_tree);
+        p4est_quadrant_set_morton (&root, 0, 0);
+        p4est_local_recursion (rec, &root, &tree->quadrants, NULL);
+      }
+    }
+  }
+  p4est_inspect_stop (p4est->inspect, P4EST_INSPECT_SEARCH, inspect_start);
+}
+
+/** Masks to combine with the order number by exclusive or.
+ * The children are sorted by the number of coordinate directions
+ * in which they differ from the child of the same number as the order. */
+static const int    p4est_search_order_masks[P4EST_CHILDREN] =
+#ifndef P4_TO_P8
+{ 0, 1, 2, 3 };
+#else
+{ 0, 1, 2, 4, 3, 5, 6, 7 };
+#endif
+
+static void         p4est_reorder_recursion (const p4est_local_recursion_t *
+                                             rec, p4est_quadrant_t * quadrant,
+                                             sc_array_t * quadrants,
+                                             sc_array_t * actives);
+
+/** Recurse into one non-empty child of the search quadrant. */
+static void
+p4est_reorder_child (const p4est_local_recursion_t * rec,
+                     p4est_quadrant_t * quadrant, sc_array_t * quadrants,
+                     const size_t * split, int i, sc_array_t * chact)
+{
+  p4est_quadrant_t    child;
+  sc_array_t          child_quadrants;
+
+  P4EST_ASSERT (0 <= i && i < P4EST_CHILDREN);
+  P4EST_ASSERT (split[i] < split[i + 1]);
+
+  sc_array_init_view (&child_quadrants, quadrants,
+                      split[i], split[i + 1] - split[i]);
+  p4est_quadrant_child (quadrant, &child, i);
+  p4est_reorder_recursion (rec, &child, &child_quadrants, chact);
+  sc_array_reset (&child_quadrants);
 }
 
 /* The recursion may overwrite the \a quadrant input argument contents. */
@@ -789,7 +1112,7 @@ p4est_reorder_recursion (const p4est_local_recursion_t * rec,
   size_t              split[P4EST_CHILDREN + 1];
   p4est_locidx_t      local_num;
   p4est_quadrant_t   *q;
-  sc_array_t          child_quadrants, child_actives, *chact;
+  sc_array_t          child_actives, *chact;
   sc_array_t          child_indices;
 
   /*
@@ -908,8 +1231,29 @@ p4est_reorder_recursion (const p4est_local_recursion_t * rec,
     }
   }
 
+  /* recurse in a precomputed order chosen by the order callback */
+  if (conchildren && !is_leaf && rec->order_fn != NULL) {
+    int                 order;
+
+    P4EST_ASSERT (qcount > 1);
+    p4est_split_array (quadrants, (int) quadrant->level, split);
+    order = rec->order_fn (rec->p4est, rec->which_tree, quadrant);
+    P4EST_ASSERT (-1 <= order && order < P4EST_CHILDREN);
+    if (order >= 0) {
+      for (zz = 0; zz < P4EST_CHILDREN; ++zz) {
+        i = order ^ p4est_search_order_masks[zz];
+        if (split[i] < split[i + 1]) {
+          p4est_reorder_child (rec, quadrant, quadrants, split, i, chact);
+        }
+      }
+    }
+    else {
+      conchildren = 0;
+    }
+  }
+
   /* execute search recursion, either when points remain or there never were any */
-  if (conchildren && !is_leaf) {
+  if (conchildren && !is_leaf && rec->order_fn == NULL) {
     /* identify search children, figure out which are relevant */
     P4EST_ASSERT (qcount > 1);
     p4est_split_array (quadrants, (int) quadrant->level, split);
@@ -938,18 +1282,9 @@ p4est_reorder_recursion (const p4est_local_recursion_t * rec,
 
     /* go into recursion in potentially reordered child order */
     if (conchildren) {
-      p4est_quadrant_t    child;
-
       for (zz = 0; zz < child_indices.elem_count; ++zz) {
         i = (int) *(p4est_topidx_t *) sc_array_index (&child_indices, zz);
-        P4EST_ASSERT (0 <= i && i < P4EST_CHILDREN);
-        P4EST_ASSERT (split[i] < split[i + 1]);
-
-        sc_array_init_view (&child_quadrants, quadrants,
-                            split[i], split[i + 1] - split[i]);
-        p4est_quadrant_child (quadrant, &child, i);
-        p4est_reorder_recursion (rec, &child, &child_quadrants, chact);
-        sc_array_reset (&child_quadrants);
+        p4est_reorder_child (rec, quadrant, quadrants, split, i, chact);
       }
     }
     sc_array_reset (&child_indices);
@@ -996,6 +1331,19 @@ p4est_search_reorder (p4est_t * p4est, int skip_levels,
                       p4est_search_query_t pre_quadrant_fn,
                       p4est_search_query_t post_quadrant_fn,
                       p4est_search_query_t point_fn, sc_array_t * points)
+{
+  p4est_search_reorder_ext (p4est, skip_levels, reorder_fn, NULL,
+                            pre_quadrant_fn, post_quadrant_fn,
+                            point_fn, points);
+}
+
+void
+p4est_search_reorder_ext (p4est_t * p4est, int skip_levels,
+                          p4est_search_reorder_t reorder_fn,
+                          p4est_search_order_t order_fn,
+                          p4est_search_query_t pre_quadrant_fn,
+                          p4est_search_query_t post_quadrant_fn,
+                          p4est_search_query_t point_fn, sc_array_t * points)
 {
   sc_array_t         *tquadrants;
   sc_array_t         *root_indices;
@@ -1053,10 +1401,12 @@ p4est_search_reorder (p4est_t * p4est, int skip_levels,
   rec->which_tree = -1;
   rec->call_post = 1;
   rec->children_fn = reorder_fn;
+  rec->order_fn = order_fn;
   rec->quadrant_fn = NULL;
   rec->pre_quadrant_fn = pre_quadrant_fn;
   rec->post_quadrant_fn = post_quadrant_fn;
   rec->point_fn = point_fn;
+  rec->batch_fn = NULL;
   rec->points = points;
   rec->skip = skip_levels;
 
@@ -1091,198 +1441,141 @@ p4est_search (p4est_t * p4est, p4est_search_query_t quadrant_fn,
   p4est_search_local (p4est, 0, quadrant_fn, point_fn, points);
 }
 
-static              size_t
-p4est_traverse_array_index (sc_array_t * array, p4est_topidx_t tt)
-{
-  P4EST_ASSERT (array != NULL);
-  P4EST_ASSERT (array->elem_size == sizeof (size_t));
-  P4EST_ASSERT (tt >= 0);
-
-  return *(size_t *) sc_array_index (array, (size_t) tt);
-}
-
-static              size_t
-p4est_traverse_type_tree (sc_array_t * array, size_t pindex, void *data)
+/** This recursion context is used by the search over local and ghosts. */
+typedef struct p4est_ghost_recursion
 {
-  p4est_quadrant_t   *pos;
-
-  P4EST_ASSERT (data == NULL);
-  P4EST_ASSERT (array != NULL);
-  pos = p4est_quadrant_array_index (array, pindex);
-  P4EST_ASSERT (pos->p.which_tree >= 0);
-
-  return (size_t) pos->p.which_tree;
+  p4est_t            *p4est;            /**< Forest being traversed. */
+  p4est_ghost_t      *ghost;            /**< Ghost layer being traversed. */
+  p4est_topidx_t      which_tree;       /**< Current tree number. */
+  int                 call_post;        /**< Boolean to call quadrant twice. */
+  p4est_search_ghost_t quadrant_fn;     /**< The quadrant callback, if any. */
+  p4est_search_ghost_t point_fn;        /**< The point callback, if any. */
+  sc_array_t         *points;           /**< Array of points to search. */
 }
+p4est_ghost_recursion_t;
 
-/** Check whether a processor begins entering a given quadrant.
- * \param [in] p4est    Used for its partition markers.
- * \param [in] quadrant This quadrant's q->p.which_tree field must match p's.
- * \param [in] p        Processor number that must start in quadrant's tree.
- * \return              True if and only if \b p starts with \p quadrant.
- */
-static int
-p4est_traverse_is_clean_start (const p4est_quadrant_t *gfp, int num_procs,
-                               p4est_topidx_t num_trees,
-                               p4est_quadrant_t *quadrant, int p)
+/* The recursion may overwrite the \a quadrant input argument contents.
+ * The local and ghost quadrants of one tree are disjoint leaves of the
+ * same forest, which we descend simultaneously. */
+static void
+p4est_ghost_recursion (const p4est_ghost_recursion_t * rec,
+                       p4est_quadrant_t * quadrant,
+                       sc_array_t * lquadrants, sc_array_t * gquadrants,
+                       sc_array_t * actives)
 {
-  const p4est_quadrant_t *marker;
+  int                 i;
+  int                 is_leaf, is_ghost, is_match;
+  int                 level;
+  size_t              lcount, gcount, act_count;
+  size_t              zz, *pz, *qz;
+  size_t              lsplit[P4EST_CHILDREN + 1];
+  size_t              gsplit[P4EST_CHILDREN + 1];
+  p4est_locidx_t      local_num;
+  p4est_quadrant_t   *q, *lq, *tq, child;
+  sc_array_t          child_lquadrants, child_gquadrants;
+  sc_array_t          child_actives, *chact;
 
-  P4EST_ASSERT (gfp != NULL);
+  /*
+   * Invariants of the recursion:
+   * 1. quadrant is larger or equal in size than those in both arrays.
+   * 2. quadrant is equal to or an ancestor of those in both arrays.
+   */
+  P4EST_ASSERT (rec != NULL);
   P4EST_ASSERT (quadrant != NULL);
-  P4EST_ASSERT (0 <= p && p <= num_procs);
-
-  marker = gfp + p;
-  P4EST_ASSERT (marker->level == P4EST_QMAXLEVEL);
-  P4EST_ASSERT (0 <= marker->p.which_tree &&
-                marker->p.which_tree <= num_trees);
-  P4EST_ASSERT (marker->p.which_tree == quadrant->p.which_tree);
+  P4EST_ASSERT (lquadrants != NULL && gquadrants != NULL);
 
-  return marker->x == quadrant->x && marker->y == quadrant->y
-#ifdef P4_TO_P8
-    && marker->z == quadrant->z
-#endif
-    ;
-}
+  lcount = lquadrants->elem_count;
+  gcount = gquadrants->elem_count;
 
-static              size_t
-p4est_traverse_type_childid (sc_array_t * array, size_t pindex, void *data)
-{
-  p4est_quadrant_t   *quadrant = (p4est_quadrant_t *) data;
-  p4est_quadrant_t   *pos;
+  /* As an optimization we pass a NULL actives array to every root. */
+  if (rec->points != NULL && actives == NULL) {
+    act_count = rec->points->elem_count;
+  }
+  else {
+    P4EST_ASSERT ((rec->points == NULL) == (actives == NULL));
+    act_count = actives == NULL ? 0 : actives->elem_count;
+  }
 
-  P4EST_ASSERT (array != NULL);
-  P4EST_ASSERT (data != NULL);
-  P4EST_ASSERT (p4est_quadrant_is_valid (quadrant));
+  /* return if there are no quadrants or active points */
+  if (lcount + gcount == 0 || (rec->points != NULL && act_count == 0))
+    return;
 
-  pos = p4est_quadrant_array_index (array, pindex);
-  P4EST_ASSERT (pos->p.which_tree >= 0);
-  P4EST_ASSERT (p4est_quadrant_is_ancestor (quadrant, pos));
+  /* determine leaf situation */
+  is_ghost = 0;
+  if (lcount + gcount > 1) {
+    is_leaf = 0;
+    local_num = -1;
 
-  return (size_t) p4est_quadrant_ancestor_id (pos, quadrant->level + 1);
-}
+    /* find the first and last quadrant over both arrays */
+    q = lcount > 0 ? p4est_quadrant_array_index (lquadrants, 0) : NULL;
+    if (gcount > 0) {
+      tq = p4est_quadrant_array_index (gquadrants, 0);
+      if (q == NULL || p4est_quadrant_compare (tq, q) < 0) {
+        q = tq;
+      }
+    }
+    lq = lcount > 0 ?
+      p4est_quadrant_array_index (lquadrants, lcount - 1) : NULL;
+    if (gcount > 0) {
+      tq = p4est_quadrant_array_index (gquadrants, gcount - 1);
+      if (lq == NULL || p4est_quadrant_compare (tq, lq) > 0) {
+        lq = tq;
+      }
+    }
+    P4EST_ASSERT (!p4est_quadrant_is_equal (q, lq));
+    P4EST_ASSERT (p4est_quadrant_is_ancestor (quadrant, q));
+    P4EST_ASSERT (p4est_quadrant_is_ancestor (quadrant, lq));
 
-#ifdef P4EST_ENABLE_DEBUG
+    /* skip unnecessary intermediate levels if possible */
+    level = (int) quadrant->level;
+    if (p4est_quadrant_ancestor_id (q, level + 1) ==
+        p4est_quadrant_ancestor_id (lq, level + 1)) {
+      p4est_nearest_common_ancestor (q, lq, quadrant);
+      P4EST_ASSERT (level < (int) quadrant->level);
+    }
+  }
+  else if (lcount == 1) {
+    p4est_tree_t       *tree;
 
-static int          p4est_traverse_is_valid_quadrant
-  (const p4est_quadrant_t *gfp, int num_procs, p4est_topidx_t num_trees,
-   p4est_topidx_t which_tree, const p4est_quadrant_t *quadrant,
-   int pfirst, int plast)
-{
-  p4est_quadrant_t    desc;
+    is_leaf = 1;
+    q = p4est_quadrant_array_index (lquadrants, 0);
 
-  P4EST_ASSERT (gfp != NULL);
-  P4EST_ASSERT (0 <= which_tree && which_tree < num_trees);
-  P4EST_ASSERT (p4est_quadrant_is_valid (quadrant));
-  P4EST_ASSERT (0 <= pfirst && pfirst <= plast && plast < num_procs);
+    /* determine offset of quadrant in local forest */
+    tree = p4est_tree_array_index (rec->p4est->trees, rec->which_tree);
+    local_num = tree->quadrants_offset + (p4est_locidx_t)
+      ((lquadrants->array - tree->quadrants.array) /
+       sizeof (p4est_quadrant_t));
 
-  /* check that pfirst is really the first owner in this quadrant */
-  p4est_quadrant_first_descendant (quadrant, &desc, P4EST_QMAXLEVEL);
-  if (!p4est_comm_is_owner_gfp (gfp, num_procs, num_trees,
-                                which_tree, &desc, pfirst)) {
-    return 0;
+    /* skip unnecessary intermediate levels if possible */
+    quadrant = q;
   }
+  else {
+    is_leaf = 1;
+    is_ghost = 1;
+    q = p4est_quadrant_array_index (gquadrants, 0);
 
-  /* check that plast is really the last owner in this quadrant */
-  p4est_quadrant_last_descendant (quadrant, &desc, P4EST_QMAXLEVEL);
-  if (!p4est_comm_is_owner_gfp (gfp, num_procs, num_trees,
-                                which_tree, &desc, plast)) {
-    return 0;
-  }
-
-#if 0
-  /* this is redundant after the checks above */
-  /* we're optimizing this away to avoid passing gfq in addition */
-  P4EST_ASSERT (!p4est_comm_is_empty_gfq (gfq, num_procs, pfirst) &&
-                !p4est_comm_is_empty_gfq (gfq, num_procs, plast));
-#endif
-
-  return 1;
-}
-
-static int          p4est_traverse_is_valid_tree
-  (const p4est_quadrant_t *gfp, int num_procs, p4est_topidx_t num_trees,
-   p4est_topidx_t which_tree, int pfirst, int plast)
-{
-  p4est_quadrant_t    root;
-
-  P4EST_ASSERT (gfp != NULL);
-  P4EST_ASSERT (0 <= which_tree && which_tree < num_trees);
-  P4EST_ASSERT (0 <= pfirst && pfirst <= plast && plast < num_procs);
-
-  p4est_quadrant_set_morton (&root, 0, 0);
-
-  return p4est_traverse_is_valid_quadrant
-    (gfp, num_procs, num_trees, which_tree, &root, pfirst, plast);
-}
-
-#endif /* P4EST_ENABLE_DEBUG */
-
-/** This recursion context saves on the number of parameters passed. */
-typedef struct p4est_partition_recursion
-{
-  p4est_t            *user_p4est;       /**< Forest passed to callbacks. */
-  const p4est_gloidx_t *gfq;            /**< Global first quadrant array. */
-  const p4est_quadrant_t *gfp;          /**< Global first positiion array. */
-  int                 num_procs;        /**< Number of ranks in partition. */
-  p4est_topidx_t      num_trees;        /**< Number of trees in partition. */
-  p4est_topidx_t      which_tree;       /**< Current tree number. */
-  int                 call_post;        /**< Boolean to call quadrant twice. */
-  p4est_search_partition_t quadrant_fn; /**< Per-quadrant callback. */
-  p4est_search_partition_t point_fn;    /**< Per-point callback. */
-  sc_array_t         *points;           /**< Array of points to search. */
-  sc_array_t         *position_array;   /**< Array view of partition's
-                                             global_first_position */
-}
-p4est_partition_recursion_t;
-
-static void
-p4est_partition_recursion (const p4est_partition_recursion_t * rec,
-                           p4est_quadrant_t * quadrant, int pfirst, int plast,
-                           sc_array_t * actives)
-{
-  int                 i;
-  int                 is_match;
-  int                 cpfirst, cplast, cpnext;
-  size_t              zz, *pz, *qz;
-  size_t              act_count;
-  p4est_quadrant_t    child;
-  sc_array_t          pview, offsets;
-  sc_array_t          child_actives, *chact;
-
-  P4EST_ASSERT (rec != NULL);
-  P4EST_ASSERT (0 <= rec->which_tree && rec->which_tree < rec->num_trees);
-  P4EST_ASSERT (p4est_traverse_is_valid_quadrant
-                (rec->gfp, rec->num_procs, rec->num_trees,
-                 rec->which_tree, quadrant, pfirst, plast));
-  P4EST_ASSERT (quadrant != NULL && p4est_quadrant_is_valid (quadrant));
-  P4EST_ASSERT (quadrant->p.which_tree == rec->which_tree);
+    /* determine offset of quadrant in the ghost layer */
+    local_num = (p4est_locidx_t)
+      ((gquadrants->array - rec->ghost->ghosts.array) /
+       sizeof (p4est_quadrant_t));
+    P4EST_ASSERT (rec->ghost->tree_offsets[rec->which_tree] <= local_num &&
+                  local_num < rec->ghost->tree_offsets[rec->which_tree + 1]);
 
-  /* As an optimization we pass a NULL actives array to every root. */
-  if (rec->points != NULL && actives == NULL) {
-    act_count = rec->points->elem_count;
-  }
-  else {
-    P4EST_ASSERT ((rec->points == NULL) == (actives == NULL));
-    P4EST_ASSERT (rec->points == NULL ||
-                  actives->elem_count <= rec->points->elem_count);
-    act_count = actives == NULL ? 0 : actives->elem_count;
+    /* skip unnecessary intermediate levels if possible */
+    quadrant = q;
   }
 
-  /* return if there are no active points */
-  if (rec->points != NULL && act_count == 0)
-    return;
-
   /* execute pre-quadrant callback if present, which may stop the recursion */
   if (rec->quadrant_fn != NULL &&
-      !rec->quadrant_fn (rec->user_p4est, rec->which_tree,
-                         quadrant, pfirst, plast, NULL)) {
+      !rec->quadrant_fn (rec->p4est, rec->which_tree,
+                         quadrant, is_ghost, local_num, NULL)) {
     return;
   }
 
   /* check out points */
   if (rec->points == NULL) {
-    /* we have called the callback already.  Maybe we are done */
-    if (pfirst == plast) {
+    /* we have called the callback already.  For leaves we are done */
+    if (is_leaf) {
       return;
     }
     chact = NULL;
@@ -1293,10 +1586,10 @@ p4est_partition_recursion (const p4est_partition_recursion_t * rec,
     sc_array_init (chact, sizeof (size_t));
     for (zz = 0; zz < act_count; ++zz) {
       pz = actives == NULL ? &zz : (size_t *) sc_array_index (actives, zz);
-      is_match = rec->point_fn (rec->user_p4est, rec->which_tree,
-                                quadrant, pfirst, plast,
+      is_match = rec->point_fn (rec->p4est, rec->which_tree,
+                                quadrant, is_ghost, local_num,
                                 sc_array_index (rec->points, *pz));
-      if (!(pfirst == plast) && is_match) {
+      if (!is_leaf && is_match) {
         qz = (size_t *) sc_array_push (chact);
         *qz = *pz;
       }
@@ -1304,8 +1597,8 @@ p4est_partition_recursion (const p4est_partition_recursion_t * rec,
 
     /* call post-quadrant callback, which may also terminate the recursion */
     if (rec->call_post && rec->quadrant_fn != NULL &&
-        !rec->quadrant_fn (rec->user_p4est, rec->which_tree,
-                           quadrant, pfirst, plast, NULL)) {
+        !rec->quadrant_fn (rec->p4est, rec->which_tree,
+                           quadrant, is_ghost, local_num, NULL)) {
       /* clears memory and will trigger the return below */
       sc_array_reset (chact);
     }
@@ -1316,208 +1609,331 @@ p4est_partition_recursion (const p4est_partition_recursion_t * rec,
     }
   }
 
-  /* the one-processor branch has returned above */
-  P4EST_ASSERT (!(pfirst == plast));
+  /* leaf situation has returned above */
+  P4EST_ASSERT (!is_leaf);
   P4EST_ASSERT (quadrant->level < P4EST_QMAXLEVEL);
 
-  /* find the processors for all children of the quadrant */
-  sc_array_init_view (&pview, rec->position_array,
-                      pfirst + 1, plast - pfirst);
-  sc_array_init_size (&offsets, sizeof (size_t), P4EST_CHILDREN + 1);
-  sc_array_split (&pview, &offsets, P4EST_CHILDREN,
-                  p4est_traverse_type_childid, quadrant);
-  P4EST_ASSERT (offsets.elem_count == (size_t) (P4EST_CHILDREN + 1));
-  P4EST_ASSERT (p4est_traverse_array_index
-                (&offsets, P4EST_CHILDREN) == (size_t) (plast - pfirst));
-  P4EST_ASSERT (p4est_traverse_array_index (&offsets, 0) == 0);
-
-  /* go through the quadrant's children */
-  child.p.which_tree = rec->which_tree;
-  for (cpfirst = pfirst + 1, i = 0; i < P4EST_CHILDREN; cpfirst = cpnext, ++i) {
-    p4est_quadrant_child (quadrant, &child, i);
-
-    /* determine the exclusive upper bound of processors starting in child */
-    cpnext = p4est_traverse_array_index (&offsets, i + 1) + pfirst + 1;
-    P4EST_ASSERT (cpfirst <= cpnext && cpnext <= plast + 1);
-
-    /* fix the last processor in child, which is known at this point */
-    P4EST_ASSERT (cpnext > 0);
-    cplast = cpnext - 1;
-
-    /* now check multiple cases for the beginning processor */
-    if (cpfirst < cpnext) {
-      /* at least one processor starts in this child */
-
-      if (p4est_traverse_is_clean_start
-          (rec->gfp, rec->num_procs, rec->num_trees, &child, cpfirst)) {
-        /* cpfirst starts at the tree's first descendant but may be empty */
-        P4EST_ASSERT (i > 0);
-        while (P4EST_COMM_IS_EMPTY_GFQ_GFP
-               (rec->gfq, rec->gfp, rec->num_procs, cpfirst)) {
-          ++cpfirst;
-          P4EST_ASSERT (p4est_traverse_type_childid
-                        (rec->position_array, cpfirst, quadrant) ==
-                        (size_t) i);
-        }
-      }
-      else {
-        /* there must be exactly one processor before us in this child */
-        --cpfirst;
-        P4EST_ASSERT (cpfirst == pfirst ||
-                      p4est_traverse_type_childid
-                      (rec->position_array, cpfirst, quadrant) < (size_t) i);
-      }
-    }
-    else {
-      /* this whole child is owned by one processor */
-      cpfirst = cplast;
+  /* split both quadrant arrays and run recursion */
+  p4est_split_array (lquadrants, (int) quadrant->level, lsplit);
+  p4est_split_array (gquadrants, (int) quadrant->level, gsplit);
+  for (i = 0; i < P4EST_CHILDREN; ++i) {
+    if (lsplit[i] < lsplit[i + 1] || gsplit[i] < gsplit[i + 1]) {
+      sc_array_init_view (&child_lquadrants, lquadrants,
+                          lsplit[i], lsplit[i + 1] - lsplit[i]);
+      sc_array_init_view (&child_gquadrants, gquadrants,
+                          gsplit[i], gsplit[i + 1] - gsplit[i]);
+      p4est_quadrant_child (quadrant, &child, i);
+      p4est_ghost_recursion (rec, &child, &child_lquadrants,
+                             &child_gquadrants, chact);
+      sc_array_reset (&child_lquadrants);
+      sc_array_reset (&child_gquadrants);
     }
-
-    /* we should have found tight bounds on processors for this child */
-    P4EST_ASSERT (i > 0 || pfirst == cpfirst);
-    P4EST_ASSERT (i < P4EST_CHILDREN - 1 || plast == cplast);
-    P4EST_ASSERT (pfirst <= cpfirst && cpfirst <= cplast && cplast <= plast);
-
-    /* we know these are non-negative; check before casting to unsigned */
-    P4EST_ASSERT (cplast >= 0 && cpnext >= 0 && plast + 1 >= 0);
-
-    /* These casts remove compiler warnings due to the assumption of the
-     * compiler under -O3 that there cannot happen a signed overflow.
-     */
-    P4EST_ASSERT ((unsigned) cplast <= (unsigned) cpnext
-                  && (unsigned) cpnext <= (unsigned) plast + 1);
-    P4EST_ASSERT (cplast == pfirst ||
-                  p4est_traverse_type_childid
-                  (rec->position_array, cplast, quadrant) <= (size_t) i);
-    P4EST_ASSERT (p4est_traverse_is_valid_quadrant
-                  (rec->gfp, rec->num_procs, rec->num_trees,
-                   rec->which_tree, &child, cpfirst, cplast));
-
-    /* go deeper into the recursion */
-    p4est_partition_recursion (rec, &child, cpfirst, cplast, chact);
   }
-
-  /* this is it */
   if (chact != NULL) {
     sc_array_reset (chact);
   }
-  sc_array_reset (&offsets);
-  sc_array_reset (&pview);
 }
 
-static void         p4est_search_partition_internal
-  (const p4est_gloidx_t *gfq, const p4est_quadrant_t *gfp,
-   int nmemb, p4est_topidx_t num_trees, int call_post, p4est_t *user_p4est,
-   p4est_search_partition_t quadrant_fn, p4est_search_partition_t point_fn,
-   sc_array_t *points);
-
 void
-p4est_search_partition (p4est_t *p4est, int call_post,
-                        p4est_search_partition_t quadrant_fn,
-                        p4est_search_partition_t point_fn,
-                        sc_array_t *points)
+p4est_search_ghost (p4est_t * p4est, p4est_ghost_t * ghost, int call_post,
+                    p4est_search_ghost_t quadrant_fn,
+                    p4est_search_ghost_t point_fn, sc_array_t * points)
 {
-  P4EST_ASSERT (p4est != NULL);
-  P4EST_ASSERT (p4est->connectivity != NULL);
+  p4est_topidx_t      jt;
+  p4est_locidx_t      goffset;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t    root;
+  p4est_ghost_recursion_t srec, *rec = &srec;
+  sc_array_t          gquadrants;
+  double              inspect_start;
 
-  p4est_search_partition_internal
-    (p4est->global_first_quadrant, p4est->global_first_position,
-     p4est->mpisize, p4est->connectivity->num_trees,
-     call_post, p4est, quadrant_fn, point_fn, points);
-}
+  /* correct call convention? */
+  P4EST_ASSERT (p4est != NULL && ghost != NULL);
+  P4EST_ASSERT (points == NULL || point_fn != NULL);
 
-void
-p4est_search_partition_gfx (const p4est_gloidx_t *gfq,
-                            const p4est_quadrant_t *gfp,
-                            int nmemb, p4est_topidx_t num_trees,
-                            int call_post, void *user,
-                            p4est_search_partition_t quadrant_fn,
-                            p4est_search_partition_t point_fn,
-                            sc_array_t *points)
-{
-  p4est_t             p, *user_p4est = &p;
+  /* we do nothing if there is nothing we can do */
+  if (quadrant_fn == NULL && points == NULL) {
+    return;
+  }
 
-  /* sanity checks on global first quadrant */
-  P4EST_ASSERT (gfq != NULL);
-  P4EST_ASSERT (gfq[0] == 0);
-  P4EST_ASSERT (gfq[nmemb] >= (p4est_gloidx_t) num_trees);
+  /* set recursion context */
+  inspect_start = p4est_inspect_start (p4est->inspect);
+  rec->p4est = p4est;
+  rec->ghost = ghost;
+  rec->which_tree = -1;
+  rec->call_post = call_post;
+  rec->quadrant_fn = quadrant_fn;
+  rec->point_fn = point_fn;
+  rec->points = points;
+  for (jt = 0; jt < p4est->connectivity->num_trees; ++jt) {
+    rec->which_tree = jt;
 
-  /* sanity checks on global first position */
-  P4EST_ASSERT (gfp != NULL);
-  P4EST_ASSERT (gfp[0].p.which_tree == 0);
-  P4EST_ASSERT (gfp[nmemb].x == 0);
-  P4EST_ASSERT (gfp[nmemb].y == 0);
-#ifdef P4_TO_P8
-  P4EST_ASSERT (gfp[nmemb].z == 0);
-#endif
-  P4EST_ASSERT (gfp[nmemb].p.which_tree == num_trees);
+    /* the quadrant array of a remote tree is empty */
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    goffset = ghost->tree_offsets[jt];
+    if (tree->quadrants.elem_count == 0 &&
+        goffset == ghost->tree_offsets[jt + 1]) {
+      continue;
+    }
+    sc_array_init_view (&gquadrants, &ghost->ghosts, (size_t) goffset,
+                        (size_t) (ghost->tree_offsets[jt + 1] - goffset));
 
-  /* conjure up call convention for partition search */
-  memset (user_p4est, 0, sizeof (p4est_t));
-  user_p4est->user_pointer = user;
-  p4est_search_partition_internal
-    (gfq, gfp, nmemb, num_trees, call_post, user_p4est,
-     quadrant_fn, point_fn, points);
+    /* the recursion shrinks the search quadrant whenever possible */
+    p4est_quadrant_set_morton (&root, 0, 0);
+    p4est_ghost_recursion (rec, &root, &tree->quadrants, &gquadrants, NULL);
+    sc_array_reset (&gquadrants);
+  }
+  p4est_inspect_stop (p4est->inspect, P4EST_INSPECT_SEARCH, inspect_start);
 }
 
-void
-p4est_search_partition_gfp (const p4est_quadrant_t *gfp, int nmemb,
-                            p4est_topidx_t num_trees, int call_post,
-                            void *user, p4est_search_partition_t quadrant_fn,
-                            p4est_search_partition_t point_fn,
-                            sc_array_t *points)
+static              size_t
+p4est_traverse_array_index (sc_array_t * array, p4est_topidx_t tt)
 {
-  p4est_t             p, *user_p4est = &p;
+  P4EST_ASSERT (array != NULL);
+  P4EST_ASSERT (array->elem_size == sizeof (size_t));
+  P4EST_ASSERT (tt >= 0);
 
-  /* sanity checks on global first position */
-  P4EST_ASSERT (gfp != NULL);
-  P4EST_ASSERT (gfp[0].p.which_tree == 0);
-  P4EST_ASSERT (gfp[nmemb].x == 0);
-  P4EST_ASSERT (gfp[nmemb].y == 0);
+  return *(size_t *) sc_array_index (array, (size_t) tt);
+}
+
+static              size_t
+p4est_traverse_type_tree (sc_array_t * array, size_t pindex, void *data)
+{
+  p4est_quadrant_t   *pos;
+
+  P4EST_ASSERT (data == NULL);
+  P4EST_ASSERT (array != NULL);
+  pos = p4est_quadrant_array_index (array, pindex);
+  P4EST_ASSERT (pos->p.which_tree >= 0);
+
+  return (size_t) pos->p.which_tree;
+}
+
+/** Check whether a processor begins entering a given quadrant.
+ * \param [in] p4est    Used for its partition markers.
+ * \param [in] quadrant This quadrant's q->p.which_tree field must match p's.
+ * \param [in] p        Processor number that must start in quadrant's tree.
+ * \return              True if and only if \b p starts with \p quadrant.
+ */
+static int
+p4est_traverse_is_clean_start (const p4est_quadrant_t *gfp, int num_procs,
+                               p4est_topidx_t num_trees,
+                               p4est_quadrant_t *quadrant, int p)
+{
+  const p4est_quadrant_t *marker;
+
+  P4EST_ASSERT (gfp != NULL);
+  P4EST_ASSERT (quadrant != NULL);
+  P4EST_ASSERT (0 <= p && p <= num_procs);
+
+  marker = gfp + p;
+  P4EST_ASSERT (marker->level == P4EST_QMAXLEVEL);
+  P4EST_ASSERT (0 <= marker->p.which_tree &&
+                marker->p.which_tree <= num_trees);
+  P4EST_ASSERT (marker->p.which_tree == quadrant->p.which_tree);
+
+  return marker->x == quadrant->x && marker->y == quadrant->y
 #ifdef P4_TO_P8
-  P4EST_ASSERT (gfp[nmemb].z == 0);
+    && marker->z == quadrant->z
 #endif
-  P4EST_ASSERT (gfp[nmemb].p.which_tree == num_trees);
+    ;
+}
 
-  /* conjure up call convention for partition search */
-  memset (user_p4est, 0, sizeof (p4est_t));
-  user_p4est->user_pointer = user;
-  p4est_search_partition_internal
-    (NULL, gfp, nmemb, num_trees, call_post, user_p4est,
-     quadrant_fn, point_fn, points);
+static              size_t
+p4est_traverse_type_childid (sc_array_t * array, size_t pindex, void *data)
+{
+  p4est_quadrant_t   *quadrant = (p4est_quadrant_t *) data;
+  p4est_quadrant_t   *pos;
+
+  P4EST_ASSERT (array != NULL);
+  P4EST_ASSERT (data != NULL);
+  P4EST_ASSERT (p4est_quadrant_is_valid (quadrant));
+
+  pos = p4est_quadrant_array_index (array, pindex);
+  P4EST_ASSERT (pos->p.which_tree >= 0);
+  P4EST_ASSERT (p4est_quadrant_is_ancestor (quadrant, pos));
+
+  return (size_t) p4est_quadrant_ancestor_id (pos, quadrant->level + 1);
 }
 
-void                p4est_search_partition_internal
-  (const p4est_gloidx_t *gfq, const p4est_quadrant_t *gfp,
-   int nmemb, p4est_topidx_t num_trees, int call_post, p4est_t *user_p4est,
-   p4est_search_partition_t quadrant_fn, p4est_search_partition_t point_fn,
-   sc_array_t *points)
+#ifdef P4EST_ENABLE_DEBUG
+
+static int          p4est_traverse_is_valid_quadrant
+  (const p4est_quadrant_t *gfp, int num_procs, p4est_topidx_t num_trees,
+   p4est_topidx_t which_tree, const p4est_quadrant_t *quadrant,
+   int pfirst, int plast)
+{
+  p4est_quadrant_t    desc;
+
+  P4EST_ASSERT (gfp != NULL);
+  P4EST_ASSERT (0 <= which_tree && which_tree < num_trees);
+  P4EST_ASSERT (p4est_quadrant_is_valid (quadrant));
+  P4EST_ASSERT (0 <= pfirst && pfirst <= plast && plast < num_procs);
+
+  /* check that pfirst is really the first owner in this quadrant */
+  p4est_quadrant_first_descendant (quadrant, &desc, P4EST_QMAXLEVEL);
+  if (!p4est_comm_is_owner_gfp (gfp, num_procs, num_trees,
+                                which_tree, &desc, pfirst)) {
+    return 0;
+  }
+
+  /* check that plast is really the last owner in this quadrant */
+  p4est_quadrant_last_descendant (quadrant, &desc, P4EST_QMAXLEVEL);
+  if (!p4est_comm_is_owner_gfp (gfp, num_procs, num_trees,
+                                which_tree, &desc, plast)) {
+    return 0;
+  }
+
+#if 0
+  /* this is redundant after the checks above */
+  /* we're optimizing this away to avoid passing gfq in addition */
+  P4EST_ASSERT (!p4est_comm_is_empty_gfq (gfq, num_procs, pfirst) &&
+                !p4est_comm_is_empty_gfq (gfq, num_procs, plast));
+#endif
+
+  return 1;
+}
+
+static int          p4est_traverse_is_valid_tree
+  (const p4est_quadrant_t *gfp, int num_procs, p4est_topidx_t num_trees,
+   p4est_topidx_t which_tree, int pfirst, int plast)
 {
-  const int           num_procs = nmemb;
-  int                 pfirst, plast, pnext;
-  sc_array_t          position_array;
-  sc_array_t         *tree_offsets;
-  p4est_topidx_t      tt;
   p4est_quadrant_t    root;
-  p4est_partition_recursion_t srec, *rec = &srec;
 
-  /* we do nothing if there is nothing to be done */
   P4EST_ASSERT (gfp != NULL);
-  P4EST_ASSERT (points == NULL || point_fn != NULL);
-  if (quadrant_fn == NULL && points == NULL) {
-    return;
+  P4EST_ASSERT (0 <= which_tree && which_tree < num_trees);
+  P4EST_ASSERT (0 <= pfirst && pfirst <= plast && plast < num_procs);
+
+  p4est_quadrant_set_morton (&root, 0, 0);
+
+  return p4est_traverse_is_valid_quadrant
+    (gfp, num_procs, num_trees, which_tree, &root, pfirst, plast);
+}
+
+#endif /* P4EST_ENABLE_DEBUG */
+
+/** Find the tight processor ranges of all children of a quadrant.
+ * \param [in] quadrant     A quadrant shared by processors pfirst < plast.
+ * \param [out] cpfirsts    First processor of every child.
+ * \param [out] cplasts     Last processor of every child.
+ */
+static void
+p4est_traverse_child_ranges (const p4est_gloidx_t *gfq,
+                             const p4est_quadrant_t *gfp, int num_procs,
+                             p4est_topidx_t num_trees,
+                             sc_array_t *position_array,
+                             const p4est_quadrant_t *quadrant,
+                             int pfirst, int plast,
+                             int cpfirsts[], int cplasts[])
+{
+  int                 i;
+  int                 cpfirst, cplast, cpnext;
+  p4est_quadrant_t    child;
+  sc_array_t          pview, offsets;
+
+  P4EST_ASSERT (pfirst < plast);
+  P4EST_ASSERT (quadrant->level < P4EST_QMAXLEVEL);
+
+  /* find the processors for all children of the quadrant */
+  sc_array_init_view (&pview, position_array, pfirst + 1, plast - pfirst);
+  sc_array_init_size (&offsets, sizeof (size_t), P4EST_CHILDREN + 1);
+  sc_array_split (&pview, &offsets, P4EST_CHILDREN,
+                  p4est_traverse_type_childid, (void *) quadrant);
+  P4EST_ASSERT (offsets.elem_count == (size_t) (P4EST_CHILDREN + 1));
+  P4EST_ASSERT (p4est_traverse_array_index
+                (&offsets, P4EST_CHILDREN) == (size_t) (plast - pfirst));
+  P4EST_ASSERT (p4est_traverse_array_index (&offsets, 0) == 0);
+
+  /* go through the quadrant's children */
+  child.p.which_tree = quadrant->p.which_tree;
+  for (cpfirst = pfirst + 1, i = 0; i < P4EST_CHILDREN; cpfirst = cpnext, ++i) {
+    p4est_quadrant_child (quadrant, &child, i);
+
+    /* determine the exclusive upper bound of processors starting in child */
+    cpnext = p4est_traverse_array_index (&offsets, i + 1) + pfirst + 1;
+    P4EST_ASSERT (cpfirst <= cpnext && cpnext <= plast + 1);
+
+    /* fix the last processor in child, which is known at this point */
+    P4EST_ASSERT (cpnext > 0);
+    cplast = cpnext - 1;
+
+    /* now check multiple cases for the beginning processor */
+    if (cpfirst < cpnext) {
+      /* at least one processor starts in this child */
+
+      if (p4est_traverse_is_clean_start
+          (gfp, num_procs, num_trees, &child, cpfirst)) {
+        /* cpfirst starts at the tree's first descendant but may be empty */
+        P4EST_ASSERT (i > 0);
+        while (P4EST_COMM_IS_EMPTY_GFQ_GFP (gfq, gfp, num_procs, cpfirst)) {
+          ++cpfirst;
+          P4EST_ASSERT (p4est_traverse_type_childid
+                        (position_array, cpfirst, (void *) quadrant) ==
+                        (size_t) i);
+        }
+      }
+      else {
+        /* there must be exactly one processor before us in this child */
+        --cpfirst;
+        P4EST_ASSERT (cpfirst == pfirst ||
+                      p4est_traverse_type_childid
+                      (position_array, cpfirst, (void *) quadrant) <
+                      (size_t) i);
+      }
+    }
+    else {
+      /* this whole child is owned by one processor */
+      cpfirst = cplast;
+    }
+
+    /* we should have found tight bounds on processors for this child */
+    P4EST_ASSERT (i > 0 || pfirst == cpfirst);
+    P4EST_ASSERT (i < P4EST_CHILDREN - 1 || plast == cplast);
+    P4EST_ASSERT (pfirst <= cpfirst && cpfirst <= cplast && cplast <= plast);
+
+    /* we know these are non-negative; check before casting to unsigned */
+    P4EST_ASSERT (cplast >= 0 && cpnext >= 0 && plast + 1 >= 0);
+
+    /* These casts remove compiler warnings due to the assumption of the
+     * compiler under -O3 that there cannot happen a signed overflow.
+     */
+    P4EST_ASSERT ((unsigned) cplast <= (unsigned) cpnext
+                  && (unsigned) cpnext <= (unsigned) plast + 1);
+    P4EST_ASSERT (cplast == pfirst ||
+                  p4est_traverse_type_childid
+                  (position_array, cplast, (void *) quadrant) <= (size_t) i);
+    P4EST_ASSERT (p4est_traverse_is_valid_quadrant
+                  (gfp, num_procs, num_trees,
+                   quadrant->p.which_tree, &child, cpfirst, cplast));
+
+    cpfirsts[i] = cpfirst;
+    cplasts[i] = cplast;
   }
 
-  /* array to split is the p4est partition marker.  A const crime */
-  /* it is important to include the highest tree number plus one */
-  sc_array_init_data (&position_array, (p4est_quadrant_t *) gfp,
-                      sizeof (p4est_quadrant_t), num_procs + 1);
+  sc_array_reset (&offsets);
+  sc_array_reset (&pview);
+}
+
+/** Find the tight processor ranges of all trees.
+ * \param [out] ranges      First and last processor of every tree,
+ *                          that is two integers per tree.
+ */
+static void
+p4est_traverse_tree_ranges (const p4est_gloidx_t *gfq,
+                            const p4est_quadrant_t *gfp, int num_procs,
+                            p4est_topidx_t num_trees,
+                            sc_array_t *position_array, int *ranges)
+{
+  int                 pfirst, plast, pnext;
+  sc_array_t         *tree_offsets;
+  p4est_topidx_t      tt;
+  p4est_quadrant_t    root;
 
   /* the enumerable type is the tree number -- we know the size already */
   tree_offsets = sc_array_new_size (sizeof (size_t), num_trees + 2);
 
   /* split processors into tree-wise sections, going one beyond */
-  sc_array_split (&position_array, tree_offsets, num_trees + 1,
+  sc_array_split (position_array, tree_offsets, num_trees + 1,
                   p4est_traverse_type_tree, NULL);
   P4EST_ASSERT (tree_offsets->elem_count == (size_t) (num_trees + 2));
   P4EST_ASSERT (p4est_traverse_array_index
@@ -1526,22 +1942,10 @@ void                p4est_search_partition_internal
                 (tree_offsets, num_trees) <= (size_t) num_procs);
   P4EST_ASSERT (p4est_traverse_array_index (tree_offsets, 0) == 0);
 
-  /* now loop through all trees, local or not */
-  rec->user_p4est = user_p4est;
-  rec->gfq = gfq;
-  rec->gfp = gfp;
-  rec->num_procs = num_procs;
-  rec->num_trees = num_trees;
-  rec->which_tree = -1;
-  rec->call_post = call_post;
-  rec->quadrant_fn = quadrant_fn;
-  rec->point_fn = point_fn;
-  rec->points = points;
-  rec->position_array = &position_array;
   p4est_quadrant_set_morton (&root, 0, 0);
   for (pfirst = 0, tt = 0; tt < num_trees; pfirst = pnext, ++tt) {
     /* pfirst is the first processor indexed for this tree */
-    rec->which_tree = root.p.which_tree = tt;
+    root.p.which_tree = tt;
 
     /* determine the exclusive upper bound of processors starting in this tree */
     pnext = p4est_traverse_array_index (tree_offsets, tt + 1);
@@ -1556,20 +1960,19 @@ void                p4est_search_partition_internal
       /* at least one processor starts in this tree */
 
       if (p4est_traverse_is_clean_start
-          (rec->gfp, rec->num_procs, rec->num_trees, &root, pfirst)) {
+          (gfp, num_procs, num_trees, &root, pfirst)) {
         /* pfirst starts at the tree's first descendant but may be empty */
-        while (P4EST_COMM_IS_EMPTY_GFQ_GFP
-               (rec->gfq, rec->gfp, rec->num_procs, pfirst)) {
+        while (P4EST_COMM_IS_EMPTY_GFQ_GFP (gfq, gfp, num_procs, pfirst)) {
           ++pfirst;
           P4EST_ASSERT (p4est_traverse_type_tree
-                        (&position_array, pfirst, NULL) == (size_t) tt);
+                        (position_array, pfirst, NULL) == (size_t) tt);
         }
       }
       else {
         /* there must be exactly one processor before us in this tree */
         --pfirst;
         P4EST_ASSERT (p4est_traverse_type_tree
-                      (&position_array, pfirst, NULL) < (size_t) tt);
+                      (position_array, pfirst, NULL) < (size_t) tt);
       }
     }
     else {
@@ -1589,53 +1992,367 @@ void                p4est_search_partition_internal
     P4EST_ASSERT ((unsigned) plast <= (unsigned) pnext
                   && (unsigned) pnext <= (unsigned) num_procs);
     P4EST_ASSERT (p4est_traverse_type_tree
-                  (&position_array, plast, NULL) <= (size_t) tt);
+                  (position_array, plast, NULL) <= (size_t) tt);
     P4EST_ASSERT (p4est_traverse_is_valid_tree
-                  (rec->gfp, rec->num_procs, rec->num_trees,
-                   tt, pfirst, plast));
+                  (gfp, num_procs, num_trees, tt, pfirst, plast));
 
-    /* go into recursion for this tree */
-    p4est_partition_recursion (rec, &root, pfirst, plast, NULL);
+    ranges[2 * tt] = pfirst;
+    ranges[2 * tt + 1] = plast;
   }
 
-  /* cleanup */
   sc_array_destroy (tree_offsets);
-  sc_array_reset (&position_array);
 }
 
+/** A node of the partition search index is a quadrant shared by several
+ * processors.  It stores the processor ranges of all its children. */
+typedef struct p4est_search_index_node
+{
+  int                 pfirst[P4EST_CHILDREN];   /**< First processors */
+  int                 plast[P4EST_CHILDREN];    /**< Last processors */
+  p4est_locidx_t      child[P4EST_CHILDREN];    /**< Child nodes or -1 */
+}
+p4est_search_index_node_t;
+
+struct p4est_search_index
+{
+  int                 num_procs;        /**< Number of ranks in partition. */
+  p4est_topidx_t      num_trees;        /**< Number of trees in partition. */
+  long                revision;         /**< Forest revision when built. */
+  int                *tree_ranges;      /**< Two processors per tree. */
+  p4est_locidx_t     *tree_nodes;       /**< Root node per tree or -1. */
+  sc_array_t         *nodes;            /**< Shared quadrants top-down. */
+};
+
 /** This recursion context saves on the number of parameters passed. */
-typedef struct p4est_all_recursion
+typedef struct p4est_partition_recursion
 {
-  p4est_t            *p4est;            /**< Forest being traversed. */
+  p4est_t            *user_p4est;       /**< Forest passed to callbacks. */
   const p4est_gloidx_t *gfq;            /**< Global first quadrant array. */
   const p4est_quadrant_t *gfp;          /**< Global first positiion array. */
   int                 num_procs;        /**< Number of ranks in partition. */
   p4est_topidx_t      num_trees;        /**< Number of trees in partition. */
   p4est_topidx_t      which_tree;       /**< Current tree number. */
   int                 call_post;        /**< Boolean to call quadrant twice. */
-  p4est_search_all_t  quadrant_fn;      /**< Per-quadrant callback. */
-  p4est_search_all_t  point_fn;         /**< Per-point callback. */
+  p4est_search_partition_t quadrant_fn; /**< Per-quadrant callback. */
+  p4est_search_partition_t point_fn;    /**< Per-point callback. */
   sc_array_t         *points;           /**< Array of points to search. */
-  sc_array_t         *position_array;   /**< Array view of p4est's
+  sc_array_t         *position_array;   /**< Array view of partition's
                                              global_first_position */
+  const p4est_search_index_t *index;    /**< Precomputed ranges or NULL. */
 }
-p4est_all_recursion_t;
+p4est_partition_recursion_t;
 
 static void
-p4est_all_recursion (const p4est_all_recursion_t * rec,
+p4est_partition_recursion (const p4est_partition_recursion_t * rec,
+                           p4est_quadrant_t * quadrant, int pfirst, int plast,
+                           sc_array_t * actives, p4est_locidx_t node)
+{
+  int                 i;
+  int                 is_match;
+  int                 cpfirsts[P4EST_CHILDREN], cplasts[P4EST_CHILDREN];
+  const int          *cpf, *cpl;
+  size_t              zz, *pz, *qz;
+  size_t              act_count;
+  p4est_quadrant_t    child;
+  p4est_search_index_node_t *inode;
+  sc_array_t          child_actives, *chact;
+
+  P4EST_ASSERT (rec != NULL);
+  P4EST_ASSERT (0 <= rec->which_tree && rec->which_tree < rec->num_trees);
+  P4EST_ASSERT (p4est_traverse_is_valid_quadrant
+                (rec->gfp, rec->num_procs, rec->num_trees,
+                 rec->which_tree, quadrant, pfirst, plast));
+  P4EST_ASSERT (quadrant != NULL && p4est_quadrant_is_valid (quadrant));
+  P4EST_ASSERT (quadrant->p.which_tree == rec->which_tree);
+
+  /* As an optimization we pass a NULL actives array to every root. */
+  if (rec->points != NULL && actives == NULL) {
+    act_count = rec->points->elem_count;
+  }
+  else {
+    P4EST_ASSERT ((rec->points == NULL) == (actives == NULL));
+    P4EST_ASSERT (rec->points == NULL ||
+                  actives->elem_count <= rec->points->elem_count);
+    act_count = actives == NULL ? 0 : actives->elem_count;
+  }
+
+  /* return if there are no active points */
+  if (rec->points != NULL && act_count == 0)
+    return;
+
+  /* execute pre-quadrant callback if present, which may stop the recursion */
+  if (rec->quadrant_fn != NULL &&
+      !rec->quadrant_fn (rec->user_p4est, rec->which_tree,
+                         quadrant, pfirst, plast, NULL)) {
+    return;
+  }
+
+  /* check out points */
+  if (rec->points == NULL) {
+    /* we have called the callback already.  Maybe we are done */
+    if (pfirst == plast) {
+      return;
+    }
+    chact = NULL;
+  }
+  else {
+    /* query callback for all points and return if none remain */
+    chact = &child_actives;
+    sc_array_init (chact, sizeof (size_t));
+    for (zz = 0; zz < act_count; ++zz) {
+      pz = actives == NULL ? &zz : (size_t *) sc_array_index (actives, zz);
+      is_match = rec->point_fn (rec->user_p4est, rec->which_tree,
+                                quadrant, pfirst, plast,
+                                sc_array_index (rec->points, *pz));
+      if (!(pfirst == plast) && is_match) {
+        qz = (size_t *) sc_array_push (chact);
+        *qz = *pz;
+      }
+    }
+
+    /* call post-quadrant callback, which may also terminate the recursion */
+    if (rec->call_post && rec->quadrant_fn != NULL &&
+        !rec->quadrant_fn (rec->user_p4est, rec->which_tree,
+                           quadrant, pfirst, plast, NULL)) {
+      /* clears memory and will trigger the return below */
+      sc_array_reset (chact);
+    }
+
+    if (chact->elem_count == 0) {
+      /* with zero members there is no need to call sc_array_reset */
+      return;
+    }
+  }
+
+  /* the one-processor branch has returned above */
+  P4EST_ASSERT (!(pfirst == plast));
+  P4EST_ASSERT (quadrant->level < P4EST_QMAXLEVEL);
+
+  /* find the processors for all children of the quadrant */
+  inode = NULL;
+  if (rec->index != NULL) {
+    P4EST_ASSERT (0 <= node && (size_t) node < rec->index->nodes->elem_count);
+    inode = (p4est_search_index_node_t *)
+      sc_array_index (rec->index->nodes, (size_t) node);
+    cpf = inode->pfirst;
+    cpl = inode->plast;
+  }
+  else {
+    p4est_traverse_child_ranges (rec->gfq, rec->gfp, rec->num_procs,
+                                 rec->num_trees, rec->position_array,
+                                 quadrant, pfirst, plast, cpfirsts, cplasts);
+    cpf = cpfirsts;
+    cpl = cplasts;
+  }
+
+  /* go through the quadrant's children */
+  child.p.which_tree = rec->which_tree;
+  for (i = 0; i < P4EST_CHILDREN; ++i) {
+    p4est_quadrant_child (quadrant, &child, i);
+
+    /* go deeper into the recursion */
+    p4est_partition_recursion (rec, &child, cpf[i], cpl[i], chact,
+                               inode != NULL ? inode->child[i] : -1);
+  }
+
+  /* this is it */
+  if (chact != NULL) {
+    sc_array_reset (chact);
+  }
+}
+
+static void         p4est_search_partition_internal
+  (const p4est_gloidx_t *gfq, const p4est_quadrant_t *gfp,
+   int nmemb, p4est_topidx_t num_trees, int call_post, p4est_t *user_p4est,
+   p4est_search_partition_t quadrant_fn, p4est_search_partition_t point_fn,
+   sc_array_t *points, const p4est_search_index_t *index);
+
+void
+p4est_search_partition (p4est_t *p4est, int call_post,
+                        p4est_search_partition_t quadrant_fn,
+                        p4est_search_partition_t point_fn,
+                        sc_array_t *points)
+{
+  P4EST_ASSERT (p4est != NULL);
+  P4EST_ASSERT (p4est->connectivity != NULL);
+
+  p4est_search_partition_internal
+    (p4est->global_first_quadrant, p4est->global_first_position,
+     p4est->mpisize, p4est->connectivity->num_trees,
+     call_post, p4est, quadrant_fn, point_fn, points, NULL);
+}
+
+void
+p4est_search_partition_gfx (const p4est_gloidx_t *gfq,
+                            const p4est_quadrant_t *gfp,
+                            int nmemb, p4est_topidx_t num_trees,
+                            int call_post, void *user,
+                            p4est_search_partition_t quadrant_fn,
+                            p4est_search_partition_t point_fn,
+                            sc_array_t *points)
+{
+  p4est_t             p, *user_p4est = &p;
+
+  /* sanity checks on global first quadrant */
+  P4EST_ASSERT (gfq != NULL);
+  P4EST_ASSERT (gfq[0] == 0);
+  P4EST_ASSERT (gfq[nmemb] >= (p4est_gloidx_t) num_trees);
+
+  /* sanity checks on global first position */
+  P4EST_ASSERT (gfp != NULL);
+  P4EST_ASSERT (gfp[0].p.which_tree == 0);
+  P4EST_ASSERT (gfp[nmemb].x == 0);
+  P4EST_ASSERT (gfp[nmemb].y == 0);
+#ifdef P4_TO_P8
+  P4EST_ASSERT (gfp[nmemb].z == 0);
+#endif
+  P4EST_ASSERT (gfp[nmemb].p.which_tree == num_trees);
+
+  /* conjure up call convention for partition search */
+  memset (user_p4est, 0, sizeof (p4est_t));
+  user_p4est->user_pointer = user;
+  p4est_search_partition_internal
+    (gfq, gfp, nmemb, num_trees, call_post, user_p4est,
+     quadrant_fn, point_fn, points, NULL);
+}
+
+void
+p4est_search_partition_gfp (const p4est_quadrant_t *gfp, int nmemb,
+                            p4est_topidx_t num_trees, int call_post,
+                            void *user, p4est_search_partition_t quadrant_fn,
+                            p4est_search_partition_t point_fn,
+                            sc_array_t *points)
+{
+  p4est_t             p, *user_p4est = &p;
+
+  /* sanity checks on global first position */
+  P4EST_ASSERT (gfp != NULL);
+  P4EST_ASSERT (gfp[0].p.which_tree == 0);
+  P4EST_ASSERT (gfp[nmemb].x == 0);
+  P4EST_ASSERT (gfp[nmemb].y == 0);
+#ifdef P4_TO_P8
+  P4EST_ASSERT (gfp[nmemb].z == 0);
+#endif
+  P4EST_ASSERT (gfp[nmemb].p.which_tree == num_trees);
+
+  /* conjure up call convention for partition search */
+  memset (user_p4est, 0, sizeof (p4est_t));
+  user_p4est->user_pointer = user;
+  p4est_search_partition_internal
+    (NULL, gfp, nmemb, num_trees, call_post, user_p4est,
+     quadrant_fn, point_fn, points, NULL);
+}
+
+void                p4est_search_partition_internal
+  (const p4est_gloidx_t *gfq, const p4est_quadrant_t *gfp,
+   int nmemb, p4est_topidx_t num_trees, int call_post, p4est_t *user_p4est,
+   p4est_search_partition_t quadrant_fn, p4est_search_partition_t point_fn,
+   sc_array_t *points, const p4est_search_index_t *index)
+{
+  const int           num_procs = nmemb;
+  int                *ranges;
+  sc_array_t          position_array;
+  p4est_topidx_t      tt;
+  p4est_quadrant_t    root;
+  p4est_partition_recursion_t srec, *rec = &srec;
+  p4est_inspect_t    *inspect = user_p4est != NULL ? user_p4est->inspect : NULL;
+  double              inspect_start;
+
+  /* we do nothing if there is nothing to be done */
+  P4EST_ASSERT (gfp != NULL);
+  P4EST_ASSERT (points == NULL || point_fn != NULL);
+  if (quadrant_fn == NULL && points == NULL) {
+    return;
+  }
+
+  inspect_start = p4est_inspect_start (inspect);
+
+  /* array to split is the p4est partition marker.  A const crime */
+  /* it is important to include the highest tree number plus one */
+  sc_array_init_data (&position_array, (p4est_quadrant_t *) gfp,
+                      sizeof (p4est_quadrant_t), num_procs + 1);
+
+  /* the processor ranges of the trees are precomputed or found now */
+  if (index != NULL) {
+    P4EST_ASSERT (index->num_procs == num_procs);
+    P4EST_ASSERT (index->num_trees == num_trees);
+    ranges = index->tree_ranges;
+  }
+  else {
+    ranges = P4EST_ALLOC (int, 2 * num_trees);
+    p4est_traverse_tree_ranges (gfq, gfp, num_procs, num_trees,
+                                &position_array, ranges);
+  }
+
+  /* now loop through all trees, local or not */
+  rec->user_p4est = user_p4est;
+  rec->gfq = gfq;
+  rec->gfp = gfp;
+  rec->num_procs = num_procs;
+  rec->num_trees = num_trees;
+  rec->which_tree = -1;
+  rec->call_post = call_post;
+  rec->quadrant_fn = quadrant_fn;
+  rec->point_fn = point_fn;
+  rec->points = points;
+  rec->position_array = &position_array;
+  rec->index = index;
+  p4est_quadrant_set_morton (&root, 0, 0);
+  for (tt = 0; tt < num_trees; ++tt) {
+    rec->which_tree = root.p.which_tree = tt;
+
+    /* go into recursion for this tree */
+    p4est_partition_recursion (rec, &root, ranges[2 * tt],
+                               ranges[2 * tt + 1], NULL,
+                               index != NULL ? index->tree_nodes[tt] : -1);
+  }
+
+  /* cleanup */
+  if (index == NULL) {
+    P4EST_FREE (ranges);
+  }
+  sc_array_reset (&position_array);
+  p4est_inspect_stop (inspect, P4EST_INSPECT_SEARCH, inspect_start);
+}
+
+/** This recursion context saves on the number of parameters passed. */
+typedef struct p4est_all_recursion
+{
+  p4est_t            *p4est;            /**< Forest being traversed. */
+  const p4est_gloidx_t *gfq;            /**< Global first quadrant array. */
+  const p4est_quadrant_t *gfp;          /**< Global first positiion array. */
+  int                 num_procs;        /**< Number of ranks in partition. */
+  p4est_topidx_t      num_trees;        /**< Number of trees in partition. */
+  p4est_topidx_t      which_tree;       /**< Current tree number. */
+  int                 call_post;        /**< Boolean to call quadrant twice. */
+  p4est_search_all_t  quadrant_fn;      /**< Per-quadrant callback. */
+  p4est_search_all_t  point_fn;         /**< Per-point callback. */
+  p4est_search_all_batch_t batch_fn;   /**< Batch per-point callback. */
+  sc_array_t         *points;           /**< Array of points to search. */
+  sc_array_t         *position_array;   /**< Array view of p4est's
+                                             global_first_position */
+  const p4est_search_index_t *index;    /**< Precomputed ranges or NULL. */
+}
+p4est_all_recursion_t;
+
+static void
+p4est_all_recursion (const p4est_all_recursion_t * rec,
                      p4est_quadrant_t * quadrant, int pfirst, int plast,
-                     sc_array_t * quadrants, sc_array_t * actives)
+                     sc_array_t * quadrants, sc_array_t * actives,
+                     p4est_locidx_t node)
 {
   int                 i;
   int                 proceed;
   int                 is_leaf, is_match;
-  int                 cpfirst, cplast, cpnext;
+  int                 cpfirsts[P4EST_CHILDREN], cplasts[P4EST_CHILDREN];
+  const int          *cpf, *cpl;
   size_t              qcount, act_count;
   size_t              zz, *pz, *qz;
   size_t              split[P4EST_CHILDREN + 1];
   p4est_locidx_t      local_num;
   p4est_quadrant_t   *q, child;
-  sc_array_t          pview, offsets;
+  p4est_search_index_node_t *inode;
+  int8_t             *keep;
   sc_array_t          child_quadrants, *chpass, child_actives, *chact;
 
   P4EST_ASSERT (rec != NULL);
@@ -1727,14 +2444,24 @@ p4est_all_recursion (const p4est_all_recursion_t * rec,
     /* query callback for all points and return if none remain */
     chact = &child_actives;
     sc_array_init (chact, sizeof (size_t));
-    for (zz = 0; zz < act_count; ++zz) {
-      pz = actives == NULL ? &zz : (size_t *) sc_array_index (actives, zz);
-      is_match = rec->point_fn (rec->p4est, rec->which_tree,
-                                quadrant, pfirst, plast, local_num,
-                                sc_array_index (rec->points, *pz));
-      if (proceed && is_match) {
-        qz = (size_t *) sc_array_push (chact);
-        *qz = *pz;
+    if (rec->batch_fn != NULL) {
+      /* one call for all points */
+      keep = p4est_search_batch_prepare (actives, act_count, chact);
+      rec->batch_fn (rec->p4est, rec->which_tree, quadrant, pfirst, plast,
+                     local_num, rec->points, (const size_t *) chact->array,
+                     act_count, keep);
+      p4est_search_batch_compact (chact, keep, proceed);
+    }
+    else {
+      for (zz = 0; zz < act_count; ++zz) {
+        pz = actives == NULL ? &zz : (size_t *) sc_array_index (actives, zz);
+        is_match = rec->point_fn (rec->p4est, rec->which_tree,
+                                  quadrant, pfirst, plast, local_num,
+                                  sc_array_index (rec->points, *pz));
+        if (proceed && is_match) {
+          qz = (size_t *) sc_array_push (chact);
+          *qz = *pz;
+        }
       }
     }
 
@@ -1757,15 +2484,29 @@ p4est_all_recursion (const p4est_all_recursion_t * rec,
   P4EST_ASSERT (quadrant->level < P4EST_QMAXLEVEL);
 
   /* find the processors for all children of the quadrant */
-  sc_array_init_view (&pview, rec->position_array,
-                      pfirst + 1, plast - pfirst);
-  sc_array_init_size (&offsets, sizeof (size_t), P4EST_CHILDREN + 1);
-  sc_array_split (&pview, &offsets, P4EST_CHILDREN,
-                  p4est_traverse_type_childid, quadrant);
-  P4EST_ASSERT (offsets.elem_count == (size_t) (P4EST_CHILDREN + 1));
-  P4EST_ASSERT (p4est_traverse_array_index
-                (&offsets, P4EST_CHILDREN) == (size_t) (plast - pfirst));
-  P4EST_ASSERT (p4est_traverse_array_index (&offsets, 0) == 0);
+  inode = NULL;
+  if (pfirst == plast) {
+    /* all children belong to this processor */
+    for (i = 0; i < P4EST_CHILDREN; ++i) {
+      cpfirsts[i] = cplasts[i] = pfirst;
+    }
+    cpf = cpfirsts;
+    cpl = cplasts;
+  }
+  else if (rec->index != NULL) {
+    P4EST_ASSERT (0 <= node && (size_t) node < rec->index->nodes->elem_count);
+    inode = (p4est_search_index_node_t *)
+      sc_array_index (rec->index->nodes, (size_t) node);
+    cpf = inode->pfirst;
+    cpl = inode->plast;
+  }
+  else {
+    p4est_traverse_child_ranges (rec->gfq, rec->gfp, rec->num_procs,
+                                 rec->num_trees, rec->position_array,
+                                 quadrant, pfirst, plast, cpfirsts, cplasts);
+    cpf = cpfirsts;
+    cpl = cplasts;
+  }
 
   /* split quadrant array for local portion */
   if (quadrants != NULL) {
@@ -1774,65 +2515,9 @@ p4est_all_recursion (const p4est_all_recursion_t * rec,
 
   /* go through the quadrant's children */
   child.p.which_tree = rec->which_tree;
-  for (cpfirst = pfirst + 1, i = 0; i < P4EST_CHILDREN; cpfirst = cpnext, ++i) {
+  for (i = 0; i < P4EST_CHILDREN; ++i) {
     p4est_quadrant_child (quadrant, &child, i);
 
-    /* determine the exclusive upper bound of processors starting in child */
-    cpnext = p4est_traverse_array_index (&offsets, i + 1) + pfirst + 1;
-    P4EST_ASSERT (cpfirst <= cpnext && cpnext <= plast + 1);
-
-    /* fix the last processor in child, which is known at this point */
-    P4EST_ASSERT (cpnext > 0);
-    cplast = cpnext - 1;
-
-    /* now check multiple cases for the beginning processor */
-    if (cpfirst < cpnext) {
-      /* at least one processor starts in this child */
-
-      if (p4est_traverse_is_clean_start
-          (rec->gfp, rec->num_procs, rec->num_trees, &child, cpfirst)) {
-        /* cpfirst starts at the tree's first descendant but may be empty */
-        P4EST_ASSERT (i > 0);
-        while (p4est_comm_is_empty (rec->p4est, cpfirst)) {
-          ++cpfirst;
-          P4EST_ASSERT (p4est_traverse_type_childid
-                        (rec->position_array, cpfirst, quadrant) ==
-                        (size_t) i);
-        }
-      }
-      else {
-        /* there must be exactly one processor before us in this child */
-        --cpfirst;
-        P4EST_ASSERT (cpfirst == pfirst ||
-                      p4est_traverse_type_childid
-                      (rec->position_array, cpfirst, quadrant) < (size_t) i);
-      }
-    }
-    else {
-      /* this whole child is owned by one processor */
-      cpfirst = cplast;
-    }
-
-    /* we should have found tight bounds on processors for this child */
-    P4EST_ASSERT (i > 0 || pfirst == cpfirst);
-    P4EST_ASSERT (i < P4EST_CHILDREN - 1 || plast == cplast);
-    P4EST_ASSERT (pfirst <= cpfirst && cpfirst <= cplast && cplast <= plast);
-
-    /* we know these are non-negative; check before casting to unsigned */
-    P4EST_ASSERT (cplast >= 0 && cpnext >= 0 && plast + 1 >= 0);
-
-    /* These casts remove compiler warnings due to the assumption of the
-     * compiler under -O3 that there cannot happen a signed overflow.
-     */
-    P4EST_ASSERT ((unsigned) cplast <= (unsigned) cpnext
-                  && (unsigned) cpnext <= (unsigned) plast + 1);
-    P4EST_ASSERT (cplast == pfirst ||
-                  p4est_traverse_type_childid
-                  (rec->position_array, cplast, quadrant) <= (size_t) i);
-    P4EST_ASSERT (p4est_traverse_is_valid_quadrant
-                  (rec->gfp, rec->num_procs, rec->num_trees,
-                   rec->which_tree, &child, cpfirst, cplast));
-
     /* designate the subarray of local quadrants */
     chpass = NULL;
     if (quadrants != NULL && split[i] < split[i + 1]) {
@@ -1842,7 +2527,8 @@ p4est_all_recursion (const p4est_all_recursion_t * rec,
     }
 
     /* go deeper into the recursion */
-    p4est_all_recursion (rec, &child, cpfirst, cplast, chpass, chact);
+    p4est_all_recursion (rec, &child, cpf[i], cpl[i], chpass, chact,
+                         inode != NULL ? inode->child[i] : -1);
     if (chpass != NULL) {
       sc_array_reset (&child_quadrants);
     }
@@ -1852,50 +2538,88 @@ p4est_all_recursion (const p4est_all_recursion_t * rec,
   if (chact != NULL) {
     sc_array_reset (chact);
   }
-  sc_array_reset (&offsets);
-  sc_array_reset (&pview);
 }
 
-void
-p4est_search_all (p4est_t * p4est,
-                  int call_post, p4est_search_all_t quadrant_fn,
-                  p4est_search_all_t point_fn, sc_array_t * points)
+/* Run the recursion for one tree; the context is modified. */
+static void
+p4est_all_tree (p4est_all_recursion_t * rec, const int *ranges,
+                p4est_topidx_t tt)
+{
+  const int           pfirst = ranges[2 * tt];
+  const int           plast = ranges[2 * tt + 1];
+  sc_array_t         *tquadrants;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t    root;
+
+  p4est_quadrant_set_morton (&root, 0, 0);
+  rec->which_tree = root.p.which_tree = tt;
+
+  /* if this tree is at least partially local, get the local quadrants */
+  if (rec->p4est->first_local_tree <= tt &&
+      tt <= rec->p4est->last_local_tree) {
+    P4EST_ASSERT (pfirst <= rec->p4est->mpirank &&
+                  rec->p4est->mpirank <= plast);
+
+    /* grab complete tree quadrant array */
+    tree = p4est_tree_array_index (rec->p4est->trees, tt);
+    tquadrants = &tree->quadrants;
+
+    /* we must not shrink the root quadrant in p4est_search_all */
+  }
+  else {
+    /* this processor is empty or entirely before or after this tree */
+    tquadrants = NULL;
+  }
+
+  /* go into recursion for this tree */
+  p4est_all_recursion (rec, &root, pfirst, plast, tquadrants, NULL,
+                       rec->index != NULL ? rec->index->tree_nodes[tt] : -1);
+}
+
+/* the common implementation of p4est_search_all and its variants */
+static void
+p4est_search_all_internal (p4est_t * p4est,
+                           int call_post, p4est_search_all_t quadrant_fn,
+                           p4est_search_all_t point_fn,
+                           p4est_search_all_batch_t batch_fn,
+                           sc_array_t * points, int num_threads,
+                           const p4est_search_index_t * index)
 {
   const int           num_procs = p4est->mpisize;
   const p4est_topidx_t num_trees = p4est->connectivity->num_trees;
-  int                 pfirst, plast, pnext;
+  int                *ranges;
   sc_array_t          position_array;
-  sc_array_t         *tree_offsets;
-  sc_array_t         *tquadrants;
   p4est_topidx_t      tt;
-  p4est_tree_t       *tree;
-  p4est_quadrant_t    root;
   p4est_all_recursion_t srec, *rec = &srec;
+  double              inspect_start;
 
   /* we do nothing if there is nothing to be done */
   P4EST_ASSERT (p4est != NULL);
-  P4EST_ASSERT (points == NULL || point_fn != NULL);
+  P4EST_ASSERT (points == NULL || (point_fn != NULL) != (batch_fn != NULL));
   if (quadrant_fn == NULL && points == NULL) {
     return;
   }
 
+  inspect_start = p4est_inspect_start (p4est->inspect);
+
   /* array to split is the p4est partition marker */
   /* it is important to include the highest tree number plus one */
   sc_array_init_data (&position_array, p4est->global_first_position,
                       sizeof (p4est_quadrant_t), num_procs + 1);
 
-  /* the enumerable type is the tree number -- we know the size already */
-  tree_offsets = sc_array_new_size (sizeof (size_t), num_trees + 2);
-
-  /* split processors into tree-wise sections, going one beyond */
-  sc_array_split (&position_array, tree_offsets, num_trees + 1,
-                  p4est_traverse_type_tree, NULL);
-  P4EST_ASSERT (tree_offsets->elem_count == (size_t) (num_trees + 2));
-  P4EST_ASSERT (p4est_traverse_array_index
-                (tree_offsets, num_trees + 1) == (size_t) num_procs + 1);
-  P4EST_ASSERT (p4est_traverse_array_index
-                (tree_offsets, num_trees) <= (size_t) num_procs);
-  P4EST_ASSERT (p4est_traverse_array_index (tree_offsets, 0) == 0);
+  /* the processor ranges of the trees are precomputed or found now */
+  if (index != NULL) {
+    P4EST_ASSERT (index->num_procs == num_procs);
+    P4EST_ASSERT (index->num_trees == num_trees);
+    P4EST_ASSERT (index->revision == p4est->revision);
+    ranges = index->tree_ranges;
+  }
+  else {
+    ranges = P4EST_ALLOC (int, 2 * num_trees);
+    p4est_traverse_tree_ranges (p4est->global_first_quadrant,
+                                p4est->global_first_position, num_procs,
+                                num_trees, &position_array, ranges);
+  }
 
   /* now loop through all trees, local or not */
   rec->p4est = p4est;
@@ -1907,83 +2631,732 @@ p4est_search_all (p4est_t * p4est,
   rec->call_post = call_post;
   rec->quadrant_fn = quadrant_fn;
   rec->point_fn = point_fn;
+  rec->batch_fn = batch_fn;
   rec->points = points;
   rec->position_array = &position_array;
+  rec->index = index;
+  if (num_threads == 1) {
+    for (tt = 0; tt < num_trees; ++tt) {
+      p4est_all_tree (rec, ranges, tt);
+    }
+  }
+  else {
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel num_threads (num_threads)
+#endif
+    {
+      int                 thread_num;
+      size_t              pbegin, pend;
+      long                jl;
+      p4est_all_recursion_t trec;
+      sc_array_t          pview;
+
+      /* each thread works on its own copy of the recursion context */
+      trec = *rec;
+      if (points != NULL) {
+        /* every thread searches all trees for a contiguous share of points */
+        thread_num = p4est_get_thread_num ();
+        pbegin = (points->elem_count * (size_t) thread_num) / num_threads;
+        pend = (points->elem_count * (size_t) (thread_num + 1)) / num_threads;
+        if (pbegin < pend) {
+          sc_array_init_view (&pview, points, pbegin, pend - pbegin);
+          trec.points = &pview;
+          for (jl = 0; jl < (long) num_trees; ++jl) {
+            p4est_all_tree (&trec, ranges, (p4est_topidx_t) jl);
+          }
+          sc_array_reset (&pview);
+        }
+      }
+      else {
+        /* without points the trees are distributed among the threads */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp for schedule (dynamic, 1)
+#endif
+        for (jl = 0; jl < (long) num_trees; ++jl) {
+          p4est_all_tree (&trec, ranges, (p4est_topidx_t) jl);
+        }
+      }
+    }
+  }
+
+  /* cleanup */
+  if (index == NULL) {
+    P4EST_FREE (ranges);
+  }
+  sc_array_reset (&position_array);
+  p4est_inspect_stop (p4est->inspect, P4EST_INSPECT_SEARCH, inspect_start);
+}
+
+void
+p4est_search_all (p4est_t * p4est,
+                  int call_post, p4est_search_all_t quadrant_fn,
+                  p4est_search_all_t point_fn, sc_array_t * points)
+{
+  p4est_search_all_internal (p4est, call_post, quadrant_fn, point_fn, NULL,
+                             points, 1, NULL);
+}
+
+void
+p4est_search_all_batch (p4est_t * p4est,
+                        int call_post, p4est_search_all_t quadrant_fn,
+                        p4est_search_all_batch_t batch_fn,
+                        sc_array_t * points)
+{
+  p4est_search_all_internal (p4est, call_post, quadrant_fn, NULL, batch_fn,
+                             points, 1, NULL);
+}
+
+void
+p4est_search_all_threads (p4est_t * p4est,
+                          int call_post, p4est_search_all_t quadrant_fn,
+                          p4est_search_all_t point_fn, sc_array_t * points)
+{
+  p4est_search_all_internal (p4est, call_post, quadrant_fn, point_fn, NULL,
+                             points, p4est_get_num_threads (), NULL);
+}
+
+/* Add the node of a shared quadrant and those of its shared descendants. */
+static              p4est_locidx_t
+p4est_search_index_build (p4est_search_index_t * index, p4est_t * p4est,
+                          sc_array_t * position_array,
+                          const p4est_quadrant_t * quadrant,
+                          int pfirst, int plast)
+{
+  int                 i;
+  int                 cpfirsts[P4EST_CHILDREN], cplasts[P4EST_CHILDREN];
+  p4est_locidx_t      node, cnode;
+  p4est_quadrant_t    child;
+  p4est_search_index_node_t *inode;
+
+  P4EST_ASSERT (pfirst < plast);
+
+  /* the children's nodes are added after their parent's */
+  node = (p4est_locidx_t) index->nodes->elem_count;
+  inode = (p4est_search_index_node_t *) sc_array_push (index->nodes);
+  p4est_traverse_child_ranges (p4est->global_first_quadrant,
+                               p4est->global_first_position,
+                               index->num_procs, index->num_trees,
+                               position_array, quadrant, pfirst, plast,
+                               cpfirsts, cplasts);
+  for (i = 0; i < P4EST_CHILDREN; ++i) {
+    inode->pfirst[i] = cpfirsts[i];
+    inode->plast[i] = cplasts[i];
+    inode->child[i] = -1;
+  }
+  child.p.which_tree = quadrant->p.which_tree;
+  for (i = 0; i < P4EST_CHILDREN; ++i) {
+    if (cpfirsts[i] < cplasts[i]) {
+      p4est_quadrant_child (quadrant, &child, i);
+      cnode = p4est_search_index_build (index, p4est, position_array, &child,
+                                        cpfirsts[i], cplasts[i]);
+
+      /* the array may have been reallocated */
+      inode = (p4est_search_index_node_t *)
+        sc_array_index (index->nodes, (size_t) node);
+      inode->child[i] = cnode;
+    }
+  }
+  return node;
+}
+
+p4est_search_index_t *
+p4est_search_index_new (p4est_t * p4est)
+{
+  const int           num_procs = p4est->mpisize;
+  const p4est_topidx_t num_trees = p4est->connectivity->num_trees;
+  p4est_topidx_t      tt;
+  p4est_quadrant_t    root;
+  p4est_search_index_t *index;
+  sc_array_t          position_array;
+
+  index = P4EST_ALLOC (p4est_search_index_t, 1);
+  index->num_procs = num_procs;
+  index->num_trees = num_trees;
+  index->revision = p4est->revision;
+  index->tree_ranges = P4EST_ALLOC (int, 2 * num_trees);
+  index->tree_nodes = P4EST_ALLOC (p4est_locidx_t, num_trees);
+  index->nodes = sc_array_new (sizeof (p4est_search_index_node_t));
+
+  sc_array_init_data (&position_array, p4est->global_first_position,
+                      sizeof (p4est_quadrant_t), num_procs + 1);
+  p4est_traverse_tree_ranges (p4est->global_first_quadrant,
+                              p4est->global_first_position, num_procs,
+                              num_trees, &position_array,
+                              index->tree_ranges);
+
+  /* descend into the quadrants shared by more than one processor */
   p4est_quadrant_set_morton (&root, 0, 0);
-  for (pfirst = 0, tt = 0; tt < num_trees; pfirst = pnext, ++tt) {
-    /* pfirst is the first processor indexed for this tree */
-    rec->which_tree = root.p.which_tree = tt;
+  for (tt = 0; tt < num_trees; ++tt) {
+    index->tree_nodes[tt] = -1;
+    if (index->tree_ranges[2 * tt] < index->tree_ranges[2 * tt + 1]) {
+      root.p.which_tree = tt;
+      index->tree_nodes[tt] =
+        p4est_search_index_build (index, p4est, &position_array, &root,
+                                  index->tree_ranges[2 * tt],
+                                  index->tree_ranges[2 * tt + 1]);
+    }
+  }
+  sc_array_reset (&position_array);
 
-    /* determine the exclusive upper bound of processors starting in this tree */
-    pnext = p4est_traverse_array_index (tree_offsets, tt + 1);
-    P4EST_ASSERT (pfirst <= pnext && pnext <= num_procs);
+  return index;
+}
 
-    /* fix the last processor in the tree, which is known at this point */
-    P4EST_ASSERT (pnext > 0);
-    plast = pnext - 1;
+void
+p4est_search_index_destroy (p4est_search_index_t * index)
+{
+  sc_array_destroy (index->nodes);
+  P4EST_FREE (index->tree_nodes);
+  P4EST_FREE (index->tree_ranges);
+  P4EST_FREE (index);
+}
 
-    /* now check multiple cases for the beginning processor */
-    if (pfirst < pnext) {
-      /* at least one processor starts in this tree */
+int
+p4est_search_index_is_valid (p4est_search_index_t * index, p4est_t * p4est)
+{
+  return index->revision == p4est->revision &&
+    index->num_procs == p4est->mpisize &&
+    index->num_trees == p4est->connectivity->num_trees;
+}
 
-      if (p4est_traverse_is_clean_start
-          (rec->gfp, rec->num_procs, rec->num_trees, &root, pfirst)) {
-        /* pfirst starts at the tree's first descendant but may be empty */
-        while (p4est_comm_is_empty (p4est, pfirst)) {
-          ++pfirst;
-          P4EST_ASSERT (p4est_traverse_type_tree
-                        (&position_array, pfirst, NULL) == (size_t) tt);
-        }
-      }
-      else {
-        /* there must be exactly one processor before us in this tree */
-        --pfirst;
-        P4EST_ASSERT (p4est_traverse_type_tree
-                      (&position_array, pfirst, NULL) < (size_t) tt);
-      }
+size_t
+p4est_search_index_memory_used (p4est_search_index_t * index)
+{
+  return sizeof (p4est_search_index_t) +
+    index->num_trees * (2 * sizeof (int) + sizeof (p4est_locidx_t)) +
+    sc_array_memory_used (index->nodes, 1);
+}
+
+void
+p4est_search_partition_index (p4est_t * p4est,
+                              p4est_search_index_t * index, int call_post,
+                              p4est_search_partition_t quadrant_fn,
+                              p4est_search_partition_t point_fn,
+                              sc_array_t * points)
+{
+  P4EST_ASSERT (p4est != NULL);
+  P4EST_ASSERT (p4est->connectivity != NULL);
+  P4EST_ASSERT (index == NULL || p4est_search_index_is_valid (index, p4est));
+
+  p4est_search_partition_internal
+    (p4est->global_first_quadrant, p4est->global_first_position,
+     p4est->mpisize, p4est->connectivity->num_trees,
+     call_post, p4est, quadrant_fn, point_fn, points, index);
+}
+
+void
+p4est_search_all_index (p4est_t * p4est, p4est_search_index_t * index,
+                        int call_post, p4est_search_all_t quadrant_fn,
+                        p4est_search_all_t point_fn, sc_array_t * points)
+{
+  P4EST_ASSERT (index == NULL || p4est_search_index_is_valid (index, p4est));
+
+  p4est_search_all_internal (p4est, call_post, quadrant_fn, point_fn, NULL,
+                             points, 1, index);
+}
+
+/** An entry of the priority queue of the nearest neighbor search.
+ * It is either a region of the tree that holds more than one quadrant,
+ * or a single quadrant whose key is the exact distance of its center.
+ */
+typedef struct p4est_nearest_entry
+{
+  double              key;      /**< Lower bound or exact distance */
+  int                 is_quad;  /**< Whether this is a single quadrant */
+  p4est_quadrant_t    region;   /**< The region of the tree */
+  size_t              lbegin, lend;     /**< Local quadrants in region */
+  size_t              gbegin, gend;     /**< Ghost quadrants in region */
+}
+p4est_nearest_entry_t;
+
+/** Push an entry and restore the heap order by its key. */
+static void
+p4est_nearest_push (sc_array_t * heap, const p4est_nearest_entry_t * entry)
+{
+  size_t              pos, parent;
+  p4est_nearest_entry_t *base;
+
+  sc_array_push (heap);
+  base = (p4est_nearest_entry_t *) heap->array;
+  for (pos = heap->elem_count - 1; pos > 0; pos = parent) {
+    parent = (pos - 1) / 2;
+    if (base[parent].key <= entry->key) {
+      break;
+    }
+    base[pos] = base[parent];
+  }
+  base[pos] = *entry;
+}
+
+/** Remove the entry with the smallest key from a nonempty heap. */
+static void
+p4est_nearest_pop (sc_array_t * heap, p4est_nearest_entry_t * entry)
+{
+  size_t              pos, child, count;
+  p4est_nearest_entry_t *base, last;
+
+  P4EST_ASSERT (heap->elem_count > 0);
+  base = (p4est_nearest_entry_t *) heap->array;
+  *entry = base[0];
+  last = *(p4est_nearest_entry_t *) sc_array_pop (heap);
+  count = heap->elem_count;
+  for (pos = 0; 2 * pos + 1 < count; pos = child) {
+    child = 2 * pos + 1;
+    if (child + 1 < count && base[child + 1].key < base[child].key) {
+      ++child;
+    }
+    if (last.key <= base[child].key) {
+      break;
+    }
+    base[pos] = base[child];
+  }
+  if (count > 0) {
+    base[pos] = last;
+  }
+}
+
+/** Squared distance of a point to a box, or to its center if requested. */
+static double
+p4est_nearest_distance2 (const p4est_quadrant_t * point,
+                         const p4est_quadrant_t * box, int center)
+{
+  const p4est_qcoord_t len = P4EST_QUADRANT_LEN (box->level);
+  int                 i;
+  double              d, lo, dist2 = 0.;
+  p4est_qcoord_t      pc[P4EST_DIM], bc[P4EST_DIM];
+
+  pc[0] = point->x;
+  pc[1] = point->y;
+  bc[0] = box->x;
+  bc[1] = box->y;
+#ifdef P4_TO_P8
+  pc[2] = point->z;
+  bc[2] = box->z;
+#endif
+  for (i = 0; i < P4EST_DIM; ++i) {
+    lo = (double) bc[i];
+    if (center) {
+      d = (double) pc[i] - (lo + .5 * (double) len);
+    }
+    else if ((double) pc[i] < lo) {
+      d = lo - (double) pc[i];
+    }
+    else if ((double) pc[i] > lo + (double) len) {
+      d = (double) pc[i] - (lo + (double) len);
     }
     else {
-      /* this whole tree is owned by one processor */
-      pfirst = plast;
+      d = 0.;
     }
+    d /= (double) P4EST_ROOT_LEN;
+    dist2 += d * d;
+  }
+  return dist2;
+}
 
-    /* we should have found tight bounds on processors for this tree */
-    P4EST_ASSERT (pfirst <= plast && plast < num_procs);
+/** Push a region, or the only quadrant it contains. */
+static void
+p4est_nearest_push_region (sc_array_t * heap, const p4est_quadrant_t * point,
+                           sc_array_t * local, sc_array_t * ghosts,
+                           p4est_nearest_entry_t * entry)
+{
+  const p4est_quadrant_t *q;
 
-    /* we know these are non-negative; check before casting to unsigned */
-    P4EST_ASSERT (plast >= 0 && pnext >= 0 && num_procs >= 0);
+  if (entry->lend - entry->lbegin + entry->gend - entry->gbegin == 0) {
+    return;
+  }
+  if (entry->lend - entry->lbegin + entry->gend - entry->gbegin == 1) {
+    entry->is_quad = 1;
+    q = entry->lend > entry->lbegin ?
+      p4est_quadrant_array_index (local, entry->lbegin) :
+      p4est_quadrant_array_index (ghosts, entry->gbegin);
+    entry->region = *q;
+    entry->key = p4est_nearest_distance2 (point, q, 1);
+  }
+  else {
+    entry->is_quad = 0;
+    entry->key = p4est_nearest_distance2 (point, &entry->region, 0);
+  }
+  p4est_nearest_push (heap, entry);
+}
 
-    /* These casts remove compiler warnings due to the assumption of the
-     * compiler under -O3 that there cannot happen a signed overflow.
-     */
-    P4EST_ASSERT ((unsigned) plast <= (unsigned) pnext
-                  && (unsigned) pnext <= (unsigned) num_procs);
-    P4EST_ASSERT (p4est_traverse_type_tree
-                  (&position_array, plast, NULL) <= (size_t) tt);
-    P4EST_ASSERT (p4est_traverse_is_valid_tree
-                  (rec->gfp, rec->num_procs, rec->num_trees,
-                   tt, pfirst, plast));
+void
+p4est_search_nearest (p4est_t * p4est, p4est_ghost_t * ghost,
+                      sc_array_t * queries, int k, double radius,
+                      sc_array_t * offsets, sc_array_t * results)
+{
+  int                 i;
+  size_t              zz, count;
+  size_t              lsplit[P4EST_CHILDREN + 1], gsplit[P4EST_CHILDREN + 1];
+  double              radius2;
+  p4est_topidx_t      which_tree;
+  p4est_locidx_t      ghost_begin;
+  p4est_quadrant_t   *point;
+  p4est_tree_t       *tree;
+  p4est_nearest_entry_t entry, child;
+  p4est_search_nearest_t *result;
+  sc_array_t          heap, empty, local, ghosts, view;
+
+  P4EST_ASSERT (queries->elem_size == sizeof (p4est_quadrant_t));
+  P4EST_ASSERT (offsets->elem_size == sizeof (size_t));
+  P4EST_ASSERT (results->elem_size == sizeof (p4est_search_nearest_t));
+  P4EST_ASSERT (k > 0 || radius >= 0.);
+
+  radius2 = radius * radius;
+  sc_array_init (&heap, sizeof (p4est_nearest_entry_t));
+  sc_array_init (&empty, sizeof (p4est_quadrant_t));
+  sc_array_resize (offsets, queries->elem_count + 1);
+  sc_array_truncate (results);
+  for (zz = 0; zz < queries->elem_count; ++zz) {
+    *(size_t *) sc_array_index (offsets, zz) = results->elem_count;
+    point = p4est_quadrant_array_index (queries, zz);
+    which_tree = point->p.which_tree;
+    tree = NULL;
+    P4EST_ASSERT (p4est_quadrant_is_node (point, 1));
+    P4EST_ASSERT (0 <= which_tree &&
+                  which_tree < p4est->connectivity->num_trees);
+
+    /* the local and ghost quadrants of the query's tree */
+    local = empty;
+    if (p4est->first_local_tree <= which_tree &&
+        which_tree <= p4est->last_local_tree) {
+      tree = p4est_tree_array_index (p4est->trees, which_tree);
+      local = tree->quadrants;
+    }
+    ghosts = empty;
+    ghost_begin = 0;
+    if (ghost != NULL) {
+      ghost_begin = ghost->tree_offsets[which_tree];
+      sc_array_init_view (&ghosts, &ghost->ghosts, (size_t) ghost_begin,
+                          (size_t) (ghost->tree_offsets[which_tree + 1] -
+                                    ghost_begin));
+    }
 
-    /* if this tree is at least partially local, get the local quadrants */
-    if (p4est->first_local_tree <= tt && tt <= p4est->last_local_tree) {
-      P4EST_ASSERT (pfirst <= p4est->mpirank && p4est->mpirank <= plast);
+    /* best-first descent from the root of the tree */
+    memset (&entry, 0, sizeof (entry));
+    p4est_quadrant_set_morton (&entry.region, 0, 0);
+    entry.lend = local.elem_count;
+    entry.gend = ghosts.elem_count;
+    sc_array_truncate (&heap);
+    p4est_nearest_push_region (&heap, point, &local, &ghosts, &entry);
+    count = 0;
+    while (heap.elem_count > 0 && (k <= 0 || count < (size_t) k)) {
+      p4est_nearest_pop (&heap, &entry);
+      if (radius >= 0. && entry.key > radius2) {
+        /* every remaining quadrant is farther away */
+        break;
+      }
+      if (entry.is_quad) {
+        /* no remaining quadrant is closer than this one */
+        result = (p4est_search_nearest_t *) sc_array_push (results);
+        result->quadid = entry.lend > entry.lbegin ?
+          tree->quadrants_offset + (p4est_locidx_t) entry.lbegin :
+          p4est->local_num_quadrants + ghost_begin +
+          (p4est_locidx_t) entry.gbegin;
+        result->distance = sqrt (entry.key);
+        ++count;
+        continue;
+      }
+
+      /* split the region into its children */
+      P4EST_ASSERT (entry.region.level < P4EST_QMAXLEVEL);
+      sc_array_init_view (&view, &local, entry.lbegin,
+                          entry.lend - entry.lbegin);
+      p4est_split_array (&view, (int) entry.region.level, lsplit);
+      sc_array_init_view (&view, &ghosts, entry.gbegin,
+                          entry.gend - entry.gbegin);
+      p4est_split_array (&view, (int) entry.region.level, gsplit);
+      for (i = 0; i < P4EST_CHILDREN; ++i) {
+        p4est_quadrant_child (&entry.region, &child.region, i);
+        child.lbegin = entry.lbegin + lsplit[i];
+        child.lend = entry.lbegin + lsplit[i + 1];
+        child.gbegin = entry.gbegin + gsplit[i];
+        child.gend = entry.gbegin + gsplit[i + 1];
+        p4est_nearest_push_region (&heap, point, &local, &ghosts, &child);
+      }
+    }
+  }
+  *(size_t *) sc_array_index (offsets, queries->elem_count) =
+    results->elem_count;
+  sc_array_reset (&heap);
+}
 
-      /* grab complete tree quadrant array */
-      tree = p4est_tree_array_index (p4est->trees, tt);
-      tquadrants = &tree->quadrants;
+/** The context of tracing one ray through the local quadrants of a tree. */
+typedef struct p4est_ray_context
+{
+  p4est_t            *p4est;
+  p4est_topidx_t      which_tree;
+  p4est_locidx_t      quadrants_offset;
+  sc_array_t         *quadrants;
+  p4est_search_ray_t  ray_fn;
+  p4est_ray_t        *ray;
+  double              inv[P4EST_DIM];   /**< Inverse direction */
+}
+p4est_ray_context_t;
 
-      /* we must not shrink the root quadrant in p4est_search_all */
+/** Intersect a ray with a box in tree coordinates.
+ * \param [out] face    If not NULL, the face of the box through which
+ *                      the ray exits.
+ * \return              True if the intersection has positive length.
+ */
+static int
+p4est_ray_box (const p4est_ray_t * ray, const double inv[],
+               const double lower[], double len, double *t_enter,
+               double *t_exit, int *face)
+{
+  int                 i;
+  double              t0, t1, t;
+
+  *t_enter = -HUGE_VAL;
+  *t_exit = HUGE_VAL;
+  for (i = 0; i < P4EST_DIM; ++i) {
+    if (ray->direction[i] == 0.) {
+      if (ray->origin[i] < lower[i] || ray->origin[i] > lower[i] + len) {
+        return 0;
+      }
+      continue;
     }
-    else {
-      /* this processor is empty or entirely before or after this tree */
-      tquadrants = NULL;
+    t0 = (lower[i] - ray->origin[i]) * inv[i];
+    t1 = (lower[i] + len - ray->origin[i]) * inv[i];
+    if (t0 > t1) {
+      t = t0;
+      t0 = t1;
+      t1 = t;
     }
+    *t_enter = SC_MAX (*t_enter, t0);
+    if (t1 < *t_exit) {
+      *t_exit = t1;
+      if (face != NULL) {
+        *face = 2 * i + (ray->direction[i] > 0.);
+      }
+    }
+  }
+  return *t_enter < *t_exit;
+}
 
-    /* go into recursion for this tree */
-    p4est_all_recursion (rec, &root, pfirst, plast, tquadrants, NULL);
+/** Trace the ray through a region of the tree and its local quadrants.
+ * \return          False if the ray terminated or was handed off.
+ */
+static int
+p4est_ray_region (p4est_ray_context_t * ctx, const p4est_quadrant_t * region,
+                  size_t begin, size_t end, double t_lo, double t_hi)
+{
+  int                 i, j, n;
+  int                 order[P4EST_CHILDREN];
+  size_t              split[P4EST_CHILDREN + 1];
+  double              lower[P4EST_DIM], len, t_enter, t_exit;
+  double              enter[P4EST_CHILDREN], coord;
+  p4est_ray_t        *ray = ctx->ray;
+  p4est_qcoord_t      qc[P4EST_DIM];
+  p4est_quadrant_t    child[P4EST_CHILDREN], *q, node;
+  sc_array_t          view;
+
+  if (begin == end) {
+    /* the ray enters the partition of another process */
+    P4EST_QUADRANT_INIT (&node);
+    qc[0] = region->x;
+    qc[1] = region->y;
+#ifdef P4_TO_P8
+    qc[2] = region->z;
+#endif
+    len = (double) P4EST_QUADRANT_LEN (region->level);
+    for (i = 0; i < P4EST_DIM; ++i) {
+      coord = (ray->origin[i] + t_lo * ray->direction[i]) * P4EST_ROOT_LEN;
+      coord = SC_MAX (coord, (double) qc[i]);
+      coord = SC_MIN (coord, (double) qc[i] + len - 1.);
+      qc[i] = (p4est_qcoord_t) coord;
+    }
+    node.x = qc[0];
+    node.y = qc[1];
+#ifdef P4_TO_P8
+    node.z = qc[2];
+#endif
+    node.level = P4EST_MAXLEVEL;
+    ray->t = t_lo;
+    ray->owner = p4est_comm_find_owner (ctx->p4est, ctx->which_tree, &node,
+                                        ctx->p4est->mpirank);
+    P4EST_ASSERT (ray->owner != ctx->p4est->mpirank);
+    return 0;
   }
 
-  /* cleanup */
-  sc_array_destroy (tree_offsets);
-  sc_array_reset (&position_array);
+  q = p4est_quadrant_array_index (ctx->quadrants, begin);
+  if (end - begin == 1 && q->level == region->level) {
+    /* the ray crosses a local leaf */
+    P4EST_ASSERT (p4est_quadrant_is_equal (q, region));
+    ray->t = t_hi;
+    if (!ctx->ray_fn (ctx->p4est, ctx->which_tree, q,
+                      ctx->quadrants_offset + (p4est_locidx_t) begin,
+                      ray, t_lo, t_hi)) {
+      ray->owner = -1;
+      return 0;
+    }
+    return 1;
+  }
+
+  /* order the children crossed by the ray by their entry */
+  P4EST_ASSERT (region->level < P4EST_QMAXLEVEL);
+  sc_array_init_view (&view, ctx->quadrants, begin, end - begin);
+  p4est_split_array (&view, (int) region->level, split);
+  len = (double) P4EST_QUADRANT_LEN (region->level + 1) / P4EST_ROOT_LEN;
+  n = 0;
+  for (i = 0; i < P4EST_CHILDREN; ++i) {
+    p4est_quadrant_child (region, &child[i], i);
+    lower[0] = (double) child[i].x / P4EST_ROOT_LEN;
+    lower[1] = (double) child[i].y / P4EST_ROOT_LEN;
+#ifdef P4_TO_P8
+    lower[2] = (double) child[i].z / P4EST_ROOT_LEN;
+#endif
+    if (!p4est_ray_box (ray, ctx->inv, lower, len, &t_enter, &t_exit, NULL)
+        || t_exit <= t_lo || t_enter >= t_hi) {
+      continue;
+    }
+    enter[i] = SC_MAX (t_enter, t_lo);
+    for (j = n++; j > 0 && enter[order[j - 1]] > enter[i]; --j) {
+      order[j] = order[j - 1];
+    }
+    order[j] = i;
+  }
+  for (j = 0; j < n; ++j) {
+    i = order[j];
+    lower[0] = (double) child[i].x / P4EST_ROOT_LEN;
+    lower[1] = (double) child[i].y / P4EST_ROOT_LEN;
+#ifdef P4_TO_P8
+    lower[2] = (double) child[i].z / P4EST_ROOT_LEN;
+#endif
+    p4est_ray_box (ray, ctx->inv, lower, len, &t_enter, &t_exit, NULL);
+    if (!p4est_ray_region (ctx, &child[i], begin + split[i],
+                           begin + split[i + 1], SC_MAX (t_enter, t_lo),
+                           SC_MIN (t_exit, t_hi))) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/** Transform a ray into the coordinates of a face neighbor tree. */
+static void
+p4est_ray_transform (p4est_ray_t * ray, const int ftransform[])
+{
+  int                 i;
+  double              origin[P4EST_DIM], direction[P4EST_DIM];
+  const int          *my_axis = &ftransform[0];
+  const int          *target_axis = &ftransform[3];
+  const int          *edge_reverse = &ftransform[6];
+
+  for (i = 0; i < P4EST_DIM; ++i) {
+    origin[i] = ray->origin[i];
+    direction[i] = ray->direction[i];
+  }
+  for (i = 0; i < 3; ++i) {
+#ifndef P4_TO_P8
+    if (i == 1) {
+      continue;
+    }
+#endif
+    if (i < 2) {
+      /* tangential axes */
+      ray->origin[target_axis[i]] =
+        edge_reverse[i] ? 1. - origin[my_axis[i]] : origin[my_axis[i]];
+      ray->direction[target_axis[i]] =
+        edge_reverse[i] ? -direction[my_axis[i]] : direction[my_axis[i]];
+      continue;
+    }
+    /* normal axis */
+    switch (edge_reverse[2]) {
+    case 0:
+      ray->origin[target_axis[2]] = -origin[my_axis[2]];
+      break;
+    case 1:
+      ray->origin[target_axis[2]] = origin[my_axis[2]] + 1.;
+      break;
+    case 2:
+      ray->origin[target_axis[2]] = origin[my_axis[2]] - 1.;
+      break;
+    case 3:
+      ray->origin[target_axis[2]] = 2. - origin[my_axis[2]];
+      break;
+    default:
+      SC_ABORT_NOT_REACHED ();
+    }
+    ray->direction[target_axis[2]] =
+      (edge_reverse[2] == 0 || edge_reverse[2] == 3) ?
+      -direction[my_axis[2]] : direction[my_axis[2]];
+  }
+}
+
+void
+p4est_search_rays (p4est_t * p4est, sc_array_t * rays,
+                   p4est_search_ray_t ray_fn)
+{
+  int                 i, face;
+  int                 ftransform[P4EST_FTRANSFORM];
+  size_t              zz;
+  double              lower[P4EST_DIM], t_enter, t_exit, t_end;
+  p4est_topidx_t      ntree;
+  p4est_quadrant_t    root;
+  p4est_tree_t       *tree;
+  p4est_ray_t        *ray;
+  p4est_ray_context_t ctx;
+  sc_array_t          empty;
+
+  P4EST_ASSERT (rays->elem_size == sizeof (p4est_ray_t));
+  P4EST_ASSERT (ray_fn != NULL);
+
+  sc_array_init (&empty, sizeof (p4est_quadrant_t));
+  P4EST_QUADRANT_INIT (&root);
+  p4est_quadrant_set_morton (&root, 0, 0);
+  lower[0] = lower[1] = 0.;
+#ifdef P4_TO_P8
+  lower[2] = 0.;
+#endif
+  ctx.p4est = p4est;
+  ctx.ray_fn = ray_fn;
+
+  for (zz = 0; zz < rays->elem_count; ++zz) {
+    ray = (p4est_ray_t *) sc_array_index (rays, zz);
+    ray->owner = -1;
+    ctx.ray = ray;
+    for (i = 0; i < P4EST_DIM; ++i) {
+      ctx.inv[i] = ray->direction[i] != 0. ? 1. / ray->direction[i] : 0.;
+    }
+    for (;;) {
+      P4EST_ASSERT (0 <= ray->which_tree &&
+                    ray->which_tree < p4est->connectivity->num_trees);
+      face = -1;
+      if (!p4est_ray_box (ray, ctx.inv, lower, 1., &t_enter, &t_exit, &face)
+          || t_exit <= ray->t || ray->t >= ray->t_max) {
+        /* the ray does not cross this tree any further */
+        break;
+      }
+      ctx.which_tree = ray->which_tree;
+      ctx.quadrants = &empty;
+      ctx.quadrants_offset = 0;
+      if (p4est->first_local_tree <= ray->which_tree &&
+          ray->which_tree <= p4est->last_local_tree) {
+        tree = p4est_tree_array_index (p4est->trees, ray->which_tree);
+        ctx.quadrants = &tree->quadrants;
+        ctx.quadrants_offset = tree->quadrants_offset;
+      }
+      t_end = SC_MIN (t_exit, ray->t_max);
+      if (!p4est_ray_region (&ctx, &root, 0, ctx.quadrants->elem_count,
+                             SC_MAX (t_enter, ray->t), t_end)) {
+        /* terminated by the callback or handed off */
+        break;
+      }
+      ray->t = t_end;
+      if (t_end >= ray->t_max || face < 0) {
+        break;
+      }
+
+      /* continue in the face neighbor tree if there is one */
+      ntree = p4est_find_face_transform (p4est->connectivity,
+                                         ray->which_tree, face, ftransform);
+      if (ntree < 0) {
+        break;
+      }
+      p4est_ray_transform (ray, ftransform);
+      ray->which_tree = ntree;
+      for (i = 0; i < P4EST_DIM; ++i) {
+        ctx.inv[i] = ray->direction[i] != 0. ? 1. / ray->direction[i] : 0.;
+      }
+    }
+  }
 }
@@ -57,7 +57,7 @@
  * \ingroup p4est
  */
 
-#include <p4est.h>
+#include <p4est_ghost.h>
 
 SC_EXTERN_C_BEGIN;
 
@@ -133,6 +133,34 @@ p4est_quadrant_t   *p4est_find_quadrant_cumulative (p4est_t * p4est,
                                                     p4est_locidx_t *
                                                     quadrant_id);
 
+/** Search many local quadrants by their cumulative numbers in the forest.
+ *
+ * The local tree offsets serve as a compact run-length encoded map from
+ * cumulative number to tree.  If the numbers are sorted ascending, they
+ * are translated by one merge over the local trees in linear time.
+ * Otherwise each number costs a binary search over the local trees.
+ *
+ * \param [in]  p4est           Forest to work with.
+ * \param [in]  num_ids         Number of cumulative indices.
+ * \param [in]  cumulative_ids  Cumulative indices over all local trees.
+ * \param [out] which_trees     If not NULL, filled with the tree of each
+ *                              quadrant.
+ * \param [out] quadrant_ids    If not NULL, filled with the number of each
+ *                              quadrant in its tree.
+ * \param [out] quadrants       If not NULL, filled with the quadrants.
+ */
+void                p4est_find_quadrant_cumulative_batch (p4est_t * p4est,
+                                                          size_t num_ids,
+                                                          const
+                                                          p4est_locidx_t *
+                                                          cumulative_ids,
+                                                          p4est_topidx_t *
+                                                          which_trees,
+                                                          p4est_locidx_t *
+                                                          quadrant_ids,
+                                                          p4est_quadrant_t
+                                                          ** quadrants);
+
 /** Split an array of quadrants by the children of an ancestor.
  *
  * Given a sorted \b array of quadrants that have a common ancestor at level
@@ -211,6 +239,39 @@ typedef int         (*p4est_search_local_t) (p4est_t * p4est,
                                              p4est_locidx_t local_num,
                                              void *point);
 
+/** Callback function to query the match of many points with a quadrant.
+ *
+ * It replaces the per-point calls of a \ref p4est_search_local_t callback
+ * by one call per quadrant.  The candidate points are passed as a
+ * contiguous array of indices into the points array, in ascending order,
+ * such that the callback may gather their coordinates into a
+ * structure-of-arrays layout and test them with vector instructions.
+ *
+ * \param [in] p4est        The forest to be queried.
+ * \param [in] which_tree   The tree id under consideration.
+ * \param [in] quadrant     The quadrant under consideration, as for
+ *                          \ref p4est_search_local_t.
+ * \param [in] local_num    If the quadrant is not a leaf, this is < 0.
+ *                          Otherwise it is the (non-negative) index of the
+ *                          quadrant relative to the processor-local storage.
+ * \param [in] points       The complete user-defined array of points.
+ * \param [in] indices      Indices into \b points of the candidates.
+ * \param [in] num_indices  Number of entries in \b indices.
+ * \param [out] keep        Array of \b num_indices entries.  The callback
+ *                          must set each entry to true if the point may be
+ *                          contained in the quadrant and to false otherwise;
+ *                          the values have no effect on a leaf.
+ */
+typedef void        (*p4est_search_local_batch_t) (p4est_t * p4est,
+                                                   p4est_topidx_t which_tree,
+                                                   p4est_quadrant_t *
+                                                   quadrant,
+                                                   p4est_locidx_t local_num,
+                                                   sc_array_t * points,
+                                                   const size_t * indices,
+                                                   size_t num_indices,
+                                                   int8_t * keep);
+
 /** This typedef is provided for backwards compatibility. */
 typedef p4est_search_local_t p4est_search_query_t;
 
@@ -278,6 +339,37 @@ void                p4est_search_local (p4est_t * p4est, int call_post,
                                         p4est_search_local_t point_fn,
                                         sc_array_t * points);
 
+/** Search the local part of the forest with several threads.
+ * The semantics of the callbacks are those of \ref p4est_search_local.
+ * The number of threads is set by \ref p4est_set_num_threads.
+ * With one thread, or without OpenMP, this is \ref p4est_search_local.
+ *
+ * If \b points is not NULL, it is split into contiguous sections, one
+ * per thread, and each thread searches all local trees for its section.
+ * The quadrant callback may then be called for the same quadrant by more
+ * than one thread, each time with the points of that thread only.
+ * If \b points is NULL, the local trees are distributed among the threads.
+ * The callbacks must be thread-safe; they may call \ref p4est_get_thread_num
+ * to write into per-thread buffers without locking.
+ */
+void                p4est_search_local_threads (p4est_t * p4est, int call_post,
+                                                p4est_search_local_t
+                                                quadrant_fn,
+                                                p4est_search_local_t point_fn,
+                                                sc_array_t * points);
+
+/** Search the local part of the forest, querying the points in batches.
+ * This function behaves as \ref p4est_search_local with the exception that
+ * the point callback is called once per quadrant for all candidate points.
+ * \param [in] batch_fn     If \b points is not NULL, must be not NULL.
+ *                          If \b points is NULL, this callback is ignored.
+ */
+void                p4est_search_local_batch (p4est_t * p4est, int call_post,
+                                              p4est_search_local_t
+                                              quadrant_fn,
+                                              p4est_search_local_batch_t
+                                              batch_fn, sc_array_t * points);
+
 /** This function is provided for backwards compatibility.
  * We call \ref p4est_search_local with call_post = 0.
  */
@@ -286,6 +378,64 @@ void                p4est_search (p4est_t * p4est,
                                   p4est_search_query_t point_fn,
                                   sc_array_t * points);
 
+/** Callback function to query the match of a "point" with a local or ghost
+ * quadrant.  It is used by \ref p4est_search_ghost and has the semantics
+ * of \ref p4est_search_local_t, with an additional flag for the leaves.
+ *
+ * \param [in] p4est        The forest to be queried.
+ * \param [in] which_tree   The tree id under consideration.
+ * \param [in] quadrant     The quadrant under consideration.
+ *                          This quadrant may be coarser than the quadrants
+ *                          that are contained in the forest (an ancestor), in
+ *                          which case it is a temporary variable and not part
+ *                          of the forest or ghost storage.  Otherwise, it is
+ *                          a leaf and points directly into that storage.
+ * \param [in] is_ghost     If the quadrant is not a leaf, this is false.
+ *                          Otherwise true if and only if it is a ghost.
+ * \param [in] local_num    If the quadrant is not a leaf, this is < 0.
+ *                          For a local leaf, it is its index relative to the
+ *                          processor-local storage.  For a ghost leaf, it is
+ *                          its index into the ghost layer's \a ghosts array.
+ * \param [in] point        Representation of a "point"; user-defined.
+ *                          If \b point is NULL, the callback may be used to
+ *                          prepare quadrant-related search meta data.
+ * \return                  As for \ref p4est_search_local_t.
+ */
+typedef int         (*p4est_search_ghost_t) (p4est_t * p4est,
+                                             p4est_topidx_t which_tree,
+                                             p4est_quadrant_t * quadrant,
+                                             int is_ghost,
+                                             p4est_locidx_t local_num,
+                                             void *point);
+
+/** Search through the local part of a forest together with its ghost layer.
+ * This function behaves as \ref p4est_search_local, except that it
+ * traverses the union of the local and ghost leaves in one pass, as if
+ * the ghosts were part of the local storage.  It descends through the
+ * implicit ancestors of both per tree, using the ghost layer's
+ * \a tree_offsets to find the ghosts of each tree.  This way points near
+ * the boundary of the processor domain are located in a single search.
+ *
+ * \param [in] p4est        The forest to be searched.
+ * \param [in] ghost        A ghost layer of the forest, of any type.
+ * \param [in] call_post    If true, call quadrant callback both pre and post
+ *                          point callback, in both cases before recursion (!).
+ * \param [in] quadrant_fn  Executed as described for \ref p4est_search_local.
+ *                          May be NULL in which case it is ignored.
+ * \param [in] point_fn     If \b points is not NULL, must be not NULL.
+ *                          Shall return true for any possible matching point.
+ *                          If \b points is NULL, this callback is ignored.
+ * \param [in] points       User-defined array of "points".
+ *                          If NULL, only the \b quadrant_fn callback
+ *                          is executed.  If that is NULL, this function noops.
+ */
+void                p4est_search_ghost (p4est_t * p4est,
+                                        p4est_ghost_t * ghost,
+                                        int call_post,
+                                        p4est_search_ghost_t quadrant_fn,
+                                        p4est_search_ghost_t point_fn,
+                                        sc_array_t * points);
+
 /** Callback function to query, reorder, and reduce a set of quadrants.
  * It receives an array of quadrants and an array of array indices on input.
  * On output, the array of quadrants is unmodified but the indices may be.
@@ -310,6 +460,22 @@ typedef int         (*p4est_search_reorder_t) (p4est_t * p4est,
                                                sc_array_t * quadrants,
                                                sc_array_t * indices);
 
+/** Callback function to choose one of the precomputed orders of children.
+ * Order number c visits child c first, followed by the other children
+ * sorted by the number of coordinate directions in which they differ
+ * from child c.  For example, the children 0, 1, 2, 3 are visited in the
+ * orders 0 1 2 3, 1 0 3 2, 2 3 0 1 and 3 2 1 0.
+ * Thus c may be chosen as the child in the direction of a search target
+ * to visit the children nearest first.  Empty children are skipped.
+ * \param [in] p4est        The forest to be queried.
+ * \param [in] which_tree   The tree id under consideration.
+ * \param [in] quadrant     The branch quadrant whose children are visited.
+ * \return                  An order number in 0..3, or -1 to not recurse.
+ */
+typedef int         (*p4est_search_order_t) (p4est_t * p4est,
+                                          p4est_topidx_t which_tree,
+                                          p4est_quadrant_t * quadrant);
+
 /** Run a depth-first traversal, optionally filtering search points.
  * There are three main differences to \ref p4est_search_local :
  *
@@ -361,6 +527,29 @@ void                p4est_search_reorder (p4est_t * p4est,
                                           p4est_search_local_t point_fn,
                                           sc_array_t * points);
 
+/** Run a depth-first traversal as \ref p4est_search_reorder.
+ * If \a order_fn is not NULL, it replaces \a reorder_fn for the children
+ * of a branch quadrant, such that no index array is built and the order
+ * is taken from a small table.  The \a reorder_fn is then only used to
+ * order the local trees and may be NULL.
+ * \param [in] order_fn          Called for each branch quadrant that has
+ *                               more than one leaf in its search window.
+ *                               May be NULL to use \a reorder_fn.
+ *
+ * The remaining parameters are as in \ref p4est_search_reorder.
+ */
+void                p4est_search_reorder_ext (p4est_t * p4est,
+                                              int skip_levels,
+                                              p4est_search_reorder_t
+                                              reorder_fn,
+                                              p4est_search_order_t order_fn,
+                                              p4est_search_local_t
+                                              pre_quadrant_fn,
+                                              p4est_search_local_t
+                                              post_quadrant_fn,
+                                              p4est_search_local_t point_fn,
+                                              sc_array_t * points);
+
 /** Callback function for the partition recursion.
  * \param [in] p4est        The forest to traverse.
  *                          Its local quadrants are never accessed.
@@ -545,6 +734,22 @@ typedef int         (*p4est_search_all_t) (p4est_t * p4est,
                                            p4est_locidx_t local_num,
                                            void *point);
 
+/** Callback function to query the match of many points with a quadrant.
+ * It replaces the per-point calls of a \ref p4est_search_all_t callback by
+ * one call per quadrant, as \ref p4est_search_local_batch_t does for
+ * \ref p4est_search_local_t.  The arguments \b pfirst and \b plast are
+ * those of \ref p4est_search_all_t.
+ */
+typedef void        (*p4est_search_all_batch_t) (p4est_t * p4est,
+                                                 p4est_topidx_t which_tree,
+                                                 p4est_quadrant_t * quadrant,
+                                                 int pfirst, int plast,
+                                                 p4est_locidx_t local_num,
+                                                 sc_array_t * points,
+                                                 const size_t * indices,
+                                                 size_t num_indices,
+                                                 int8_t * keep);
+
 /** Perform a top-down search on the whole forest.
  *
  * This function combines the functionality of \ref p4est_search_local and \ref
@@ -609,6 +814,194 @@ void                p4est_search_all (p4est_t * p4est, int call_post,
                                       p4est_search_all_t point_fn,
                                       sc_array_t * points);
 
+/** Search the whole forest with several threads.
+ * The semantics of the callbacks are those of \ref p4est_search_all.
+ * The threads divide the points or the trees as described for
+ * \ref p4est_search_local_threads.  With one thread, or without OpenMP,
+ * this is \ref p4est_search_all.
+ */
+void                p4est_search_all_threads (p4est_t * p4est, int call_post,
+                                              p4est_search_all_t quadrant_fn,
+                                              p4est_search_all_t point_fn,
+                                              sc_array_t * points);
+
+/** Search the whole forest, querying the points in batches.
+ * This function behaves as \ref p4est_search_all with the exception that
+ * the point callback is called once per quadrant for all candidate points.
+ * \param [in] batch_fn     If \b points is not NULL, must be not NULL.
+ *                          If \b points is NULL, this callback is ignored.
+ */
+void                p4est_search_all_batch (p4est_t * p4est, int call_post,
+                                            p4est_search_all_t quadrant_fn,
+                                            p4est_search_all_batch_t
+                                            batch_fn, sc_array_t * points);
+
+/** Precomputed processor ranges for repeated partition traversals.
+ * It stores, top-down, every quadrant that is shared by more than one
+ * process together with the process ranges of its children.  The index
+ * depends only on the partition; it must be rebuilt whenever the forest
+ * is modified, which \ref p4est_search_index_is_valid recognizes.
+ */
+typedef struct p4est_search_index p4est_search_index_t;
+
+/** Build the partition search index of a forest.  Not collective.
+ * \param [in] p4est        The forest whose partition is indexed.
+ * \return                  The index, to be freed by
+ *                          \ref p4est_search_index_destroy.
+ */
+p4est_search_index_t *p4est_search_index_new (p4est_t * p4est);
+
+/** Free the memory of a partition search index. */
+void                p4est_search_index_destroy (p4est_search_index_t *
+                                                index);
+
+/** Check whether a partition search index matches a forest.
+ * \return                  True if the forest has not been modified since
+ *                          the index was built from it.
+ */
+int                 p4est_search_index_is_valid (p4est_search_index_t *
+                                                 index, p4est_t * p4est);
+
+/** Return the number of bytes used by a partition search index. */
+size_t              p4est_search_index_memory_used (p4est_search_index_t *
+                                                     index);
+
+/** Traverse the global partition using a precomputed index.
+ * This function behaves as \ref p4est_search_partition.
+ * \param [in] index        Valid index of the forest's partition or NULL,
+ *                          in which case the ranges are computed on the fly.
+ */
+void                p4est_search_partition_index (p4est_t * p4est,
+                                                  p4est_search_index_t *
+                                                  index, int call_post,
+                                                  p4est_search_partition_t
+                                                  quadrant_fn,
+                                                  p4est_search_partition_t
+                                                  point_fn,
+                                                  sc_array_t * points);
+
+/** Search the whole forest using a precomputed partition index.
+ * This function behaves as \ref p4est_search_all.
+ * \param [in] index        Valid index of the forest's partition or NULL,
+ *                          in which case the ranges are computed on the fly.
+ */
+void                p4est_search_all_index (p4est_t * p4est,
+                                            p4est_search_index_t * index,
+                                            int call_post,
+                                            p4est_search_all_t quadrant_fn,
+                                            p4est_search_all_t point_fn,
+                                            sc_array_t * points);
+
+/** A result of \ref p4est_search_nearest. */
+typedef struct p4est_search_nearest
+{
+  p4est_locidx_t      quadid;   /**< Local quadrant number, or the number
+                                     of local quadrants plus the index
+                                     into the ghost layer for a ghost */
+  double              distance; /**< Distance of the quadrant's center to
+                                     the query point, relative to the length
+                                     of the tree */
+}
+p4est_search_nearest_t;
+
+/** Find the quadrants nearest to a set of query points.
+ * For each query we return the k quadrants whose centers are nearest to it,
+ * optionally only those within a given radius, sorted by distance.
+ * The local and the ghost quadrants are candidates; both are traversed
+ * best-first through the implicit tree, ordered by the distance to each
+ * branch's bounding box, such that the cost grows with the size of the
+ * answer rather than the size of the partition.
+ *
+ * Distances are measured in the reference coordinates of the tree that
+ * contains the query point.  Quadrants of other trees are not considered,
+ * since their distance depends on the geometry, which is not known here.
+ * A query near a tree boundary may thus obtain fewer than k results.
+ *
+ * \param [in] p4est        The forest to be searched.
+ * \param [in] ghost        Ghost layer whose quadrants are candidates too.
+ *                          May be NULL to consider the local quadrants only.
+ * \param [in] queries      Array of p4est_quadrant_t, each a node as in
+ *                          \ref p4est_quadrant_is_node (clamped), the tree
+ *                          number stored in its p.which_tree field.
+ * \param [in] k            Maximum number of results per query.  If not
+ *                          positive, the number of results is not limited
+ *                          and \b radius must be non-negative.
+ * \param [in] radius       Largest distance of a result.  If negative,
+ *                          the distance is not limited and \b k must be
+ *                          positive.
+ * \param [in,out] offsets  Array of size_t resized to one more than the
+ *                          number of queries.  The results of query i are
+ *                          at positions offsets[i] to offsets[i + 1] - 1.
+ * \param [in,out] results  Array of p4est_search_nearest_t, overwritten.
+ */
+void                p4est_search_nearest (p4est_t * p4est,
+                                          p4est_ghost_t * ghost,
+                                          sc_array_t * queries, int k,
+                                          double radius,
+                                          sc_array_t * offsets,
+                                          sc_array_t * results);
+
+/** A ray traced through the forest by \ref p4est_search_rays.
+ * The ray is given in the reference coordinates [0, 1]^2 of a tree
+ * and parametrized as origin + t * direction.  When the ray crosses into
+ * a face neighbor tree, its origin and direction are transformed into
+ * the coordinates of that tree, so the parameter t is continuous.
+ */
+typedef struct p4est_ray
+{
+  p4est_topidx_t      which_tree;       /**< The tree of origin/direction */
+  double              origin[3];        /**< Origin in tree coordinates */
+  double              direction[3];     /**< Direction in tree coordinates */
+  double              t;        /**< On input, the parameter to start at.
+                                     On output, where the trace stopped */
+  double              t_max;    /**< The largest parameter to trace */
+  int                 owner;    /**< On output, -1 if the ray is done.
+                                     Otherwise the process to continue
+                                     the trace at t with the current tree,
+                                     origin and direction */
+  void               *user_data;        /**< Not touched by p4est */
+}
+p4est_ray_t;
+
+/** Callback function for every local leaf crossed by a ray.
+ * \param [in] p4est        The forest that is searched.
+ * \param [in] which_tree   The tree of the quadrant.
+ * \param [in] quadrant     The local leaf crossed by the ray.
+ * \param [in] local_num    The process-local number of the leaf.
+ * \param [in,out] ray      The ray; its user_data may be modified.
+ * \param [in] t_enter      The ray parameter where it enters the leaf.
+ * \param [in] t_exit       The ray parameter where it exits the leaf.
+ * \return                  False to terminate the trace of this ray.
+ */
+typedef int         (*p4est_search_ray_t) (p4est_t * p4est,
+                                           p4est_topidx_t which_tree,
+                                           p4est_quadrant_t * quadrant,
+                                           p4est_locidx_t local_num,
+                                           p4est_ray_t * ray,
+                                           double t_enter, double t_exit);
+
+/** Trace rays through the local leaves in the order they are crossed.
+ * Each ray descends the implicit tree, visiting the children of a branch
+ * in the order of the ray's entry, such that the leaves are reported
+ * in increasing order of t.  A ray that leaves a tree through a face
+ * continues in the neighbor tree; one that leaves a tree through an edge
+ * or a corner continues across one of the adjacent faces.
+ *
+ * A ray stops when it reaches t_max or the domain boundary, when the
+ * callback returns false, or when it enters a part of the forest owned by
+ * another process.  In the last case the ray's owner is set to that process
+ * and the caller may send the ray there to trace it further by calling
+ * this function again.  Rays in a batch are traced one after the other;
+ * coherent rays benefit from sharing the upper levels of the tree in cache.
+ *
+ * \param [in] p4est        The forest to be searched.
+ * \param [in,out] rays     Array of p4est_ray_t.  The members t and owner are
+ *                          updated as described for the p4est_ray_t type.
+ * \param [in] ray_fn       Callback for the crossed local leaves; not NULL.
+ */
+void                p4est_search_rays (p4est_t * p4est, sc_array_t * rays,
+                                       p4est_search_ray_t ray_fn);
+
 SC_EXTERN_C_END;
 
 #endif /* !P4EST_SEARCH_H */
@@ -0,0 +1,567 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef P4_TO_P8
+#include <p4est_bits.h>
+#include <p4est_soa.h>
+#else
+#include <p8est_bits.h>
+#include <p8est_soa.h>
+#endif
+
+/* Avoid redefinition in p4est_to_p8est.h */
+#ifdef P4_TO_P8
+#define p4est_soa_device p8est_soa_device
+#endif
+
+/** Index of the device buffers. */
+enum
+{
+  P4EST_SOA_BUFFER_X,
+  P4EST_SOA_BUFFER_Y,
+#ifdef P4_TO_P8
+  P4EST_SOA_BUFFER_Z,
+#endif
+  P4EST_SOA_BUFFER_LEVEL,
+  P4EST_SOA_BUFFER_TREE,
+  P4EST_SOA_BUFFER_Q2Q,
+  P4EST_SOA_BUFFER_Q2F,
+  P4EST_SOA_BUFFER_Q2H,
+  P4EST_SOA_BUFFER_NODES,
+  P4EST_SOA_NUM_BUFFERS
+};
+
+struct p4est_soa_device
+{
+  p4est_soa_t        *soa;      /**< Host mirror owned by the device mirror */
+  p4est_soa_allocator_t allocator;      /**< Copy of the hooks */
+  p4est_soa_view_t    view;     /**< Pointers into the buffers */
+
+  /* state of the last update, revision is -1 before the first one */
+  long                revision;
+  p4est_ghost_t      *ghost;
+  p4est_mesh_t       *mesh;
+  p4est_lnodes_t     *lnodes;
+
+  void               *buffer[P4EST_SOA_NUM_BUFFERS];
+  size_t              capacity[P4EST_SOA_NUM_BUFFERS];
+  char               *staging;  /**< Host memory for assembling buffers */
+  size_t              staging_size;
+};
+
+static void
+p4est_soa_build (p4est_soa_t * soa)
+{
+  p4est_t            *p4est = soa->p4est;
+  p4est_topidx_t      jt, num_trees;
+  p4est_locidx_t      lid;
+  size_t              zz;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+
+  P4EST_FREE (soa->tree_offsets);
+  P4EST_FREE (soa->x);
+  P4EST_FREE (soa->y);
+#ifdef P4_TO_P8
+  P4EST_FREE (soa->z);
+#endif
+  P4EST_FREE (soa->level);
+  P4EST_FREE (soa->user_data);
+
+  soa->revision = p4est->revision;
+  soa->first_local_tree = p4est->first_local_tree;
+  soa->last_local_tree = p4est->last_local_tree;
+  soa->num_quadrants = p4est->local_num_quadrants;
+
+  num_trees = p4est->last_local_tree - p4est->first_local_tree + 1;
+  P4EST_ASSERT (num_trees >= 0);
+  soa->tree_offsets = P4EST_ALLOC (p4est_locidx_t, num_trees + 1);
+  soa->x = P4EST_ALLOC (p4est_qcoord_t, soa->num_quadrants);
+  soa->y = P4EST_ALLOC (p4est_qcoord_t, soa->num_quadrants);
+#ifdef P4_TO_P8
+  soa->z = P4EST_ALLOC (p4est_qcoord_t, soa->num_quadrants);
+#endif
+  soa->level = P4EST_ALLOC (int8_t, soa->num_quadrants);
+  soa->user_data = P4EST_ALLOC (void *, soa->num_quadrants);
+
+  lid = 0;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    P4EST_ASSERT (tree->quadrants_offset == lid);
+    soa->tree_offsets[jt - p4est->first_local_tree] = lid;
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lid) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      soa->x[lid] = q->x;
+      soa->y[lid] = q->y;
+#ifdef P4_TO_P8
+      soa->z[lid] = q->z;
+#endif
+      soa->level[lid] = q->level;
+      soa->user_data[lid] = q->p.user_data;
+    }
+  }
+  P4EST_ASSERT (lid == soa->num_quadrants);
+  soa->tree_offsets[num_trees] = lid;
+}
+
+p4est_soa_t        *
+p4est_soa_new (p4est_t * p4est)
+{
+  p4est_soa_t        *soa;
+
+  soa = P4EST_ALLOC_ZERO (p4est_soa_t, 1);
+  soa->p4est = p4est;
+  p4est_soa_build (soa);
+
+  return soa;
+}
+
+void
+p4est_soa_destroy (p4est_soa_t * soa)
+{
+  P4EST_FREE (soa->tree_offsets);
+  P4EST_FREE (soa->x);
+  P4EST_FREE (soa->y);
+#ifdef P4_TO_P8
+  P4EST_FREE (soa->z);
+#endif
+  P4EST_FREE (soa->level);
+  P4EST_FREE (soa->user_data);
+  P4EST_FREE (soa);
+}
+
+int
+p4est_soa_is_current (p4est_soa_t * soa)
+{
+  p4est_t            *p4est = soa->p4est;
+
+  return soa->revision == p4est->revision &&
+    soa->num_quadrants == p4est->local_num_quadrants &&
+    soa->first_local_tree == p4est->first_local_tree &&
+    soa->last_local_tree == p4est->last_local_tree;
+}
+
+int
+p4est_soa_update (p4est_soa_t * soa, int force)
+{
+  if (!force && p4est_soa_is_current (soa)) {
+    return 0;
+  }
+  p4est_soa_build (soa);
+  return 1;
+}
+
+void
+p4est_soa_get_quadrant (p4est_soa_t * soa, p4est_locidx_t lid,
+                        p4est_quadrant_t * q)
+{
+  P4EST_ASSERT (0 <= lid && lid < soa->num_quadrants);
+
+  P4EST_QUADRANT_INIT (q);
+  q->x = soa->x[lid];
+  q->y = soa->y[lid];
+#ifdef P4_TO_P8
+  q->z = soa->z[lid];
+#endif
+  q->level = soa->level[lid];
+  q->p.user_data = soa->user_data[lid];
+}
+
+/** Compare the mirrored quadrant lid with q as in p4est_quadrant_compare.
+ * \return  Negative, zero, or positive if lid is lower, equal, or higher.
+ */
+static int
+p4est_soa_compare (p4est_soa_t * soa, p4est_locidx_t lid,
+                   const p4est_quadrant_t * q)
+{
+  p4est_qcoord_t      a[P4EST_DIM], b[P4EST_DIM];
+  int                 coord_diff;
+
+  a[0] = soa->x[lid];
+  a[1] = soa->y[lid];
+#ifdef P4_TO_P8
+  a[2] = soa->z[lid];
+#endif
+  b[0] = q->x;
+  b[1] = q->y;
+#ifdef P4_TO_P8
+  b[2] = q->z;
+#endif
+  coord_diff = p4est_coordinates_compare (a, b);
+  return coord_diff ? coord_diff : ((int) soa->level[lid] - (int) q->level);
+}
+
+ssize_t
+p4est_soa_find_lower_bound (p4est_soa_t * soa, p4est_topidx_t which_tree,
+                            const p4est_quadrant_t * q, size_t guess)
+{
+  int                 comp;
+  size_t              count;
+  size_t              quad_low, quad_high;
+  p4est_locidx_t      offset;
+
+  P4EST_ASSERT (p4est_soa_is_current (soa));
+  P4EST_ASSERT (soa->first_local_tree <= which_tree &&
+                which_tree <= soa->last_local_tree);
+
+  offset = p4est_soa_tree_offset (soa, which_tree);
+  count = (size_t) (p4est_soa_tree_offset (soa, which_tree + 1) - offset);
+  if (count == 0)
+    return -1;
+
+  quad_low = 0;
+  quad_high = count - 1;
+
+  for (;;) {
+    P4EST_ASSERT (quad_low <= quad_high);
+    P4EST_ASSERT (quad_low < count && quad_high < count);
+    P4EST_ASSERT (quad_low <= guess && guess <= quad_high);
+
+    /* compare two quadrants */
+    comp = -p4est_soa_compare (soa, offset + (p4est_locidx_t) guess, q);
+
+    /* check if guess is higher or equal q and there's room below it */
+    if (comp <= 0 && (guess > 0 && p4est_soa_compare
+                      (soa, offset + (p4est_locidx_t) guess - 1, q) >= 0)) {
+      quad_high = guess - 1;
+      guess = (quad_low + quad_high + 1) / 2;
+      continue;
+    }
+
+    /* check if guess is lower than q */
+    if (comp > 0) {
+      quad_low = guess + 1;
+      if (quad_low > quad_high)
+        return -1;
+
+      guess = (quad_low + quad_high) / 2;
+      continue;
+    }
+
+    /* otherwise guess is the correct quadrant */
+    break;
+  }
+
+  return (ssize_t) guess;
+}
+
+ssize_t
+p4est_soa_find_higher_bound (p4est_soa_t * soa, p4est_topidx_t which_tree,
+                             const p4est_quadrant_t * q, size_t guess)
+{
+  int                 comp;
+  size_t              count;
+  size_t              quad_low, quad_high;
+  p4est_locidx_t      offset;
+
+  P4EST_ASSERT (p4est_soa_is_current (soa));
+  P4EST_ASSERT (soa->first_local_tree <= which_tree &&
+                which_tree <= soa->last_local_tree);
+
+  offset = p4est_soa_tree_offset (soa, which_tree);
+  count = (size_t) (p4est_soa_tree_offset (soa, which_tree + 1) - offset);
+  if (count == 0)
+    return -1;
+
+  quad_low = 0;
+  quad_high = count - 1;
+
+  for (;;) {
+    P4EST_ASSERT (quad_low <= quad_high);
+    P4EST_ASSERT (quad_low < count && quad_high < count);
+    P4EST_ASSERT (quad_low <= guess && guess <= quad_high);
+
+    /* compare two quadrants */
+    comp = p4est_soa_compare (soa, offset + (p4est_locidx_t) guess, q);
+
+    /* check if guess is lower or equal q and there's room above it */
+    if (comp <= 0 && (guess < count - 1 && p4est_soa_compare
+                      (soa, offset + (p4est_locidx_t) guess + 1, q) <= 0)) {
+      quad_low = guess + 1;
+      guess = (quad_low + quad_high) / 2;
+      continue;
+    }
+
+    /* check if guess is higher than q */
+    if (comp > 0) {
+      if (guess == 0)
+        return -1;
+
+      quad_high = guess - 1;
+      if (quad_high < quad_low)
+        return -1;
+
+      guess = (quad_low + quad_high + 1) / 2;
+      continue;
+    }
+
+    /* otherwise guess is the correct quadrant */
+    break;
+  }
+
+  return (ssize_t) guess;
+}
+
+static void        *
+p4est_soa_host_alloc (size_t bytes, void *user)
+{
+  return P4EST_ALLOC (char, bytes);
+}
+
+static void
+p4est_soa_host_free (void *ptr, void *user)
+{
+  P4EST_FREE (ptr);
+}
+
+static void
+p4est_soa_host_copy (void *dst, const void *src, size_t bytes, void *user)
+{
+  memcpy (dst, src, bytes);
+}
+
+p4est_soa_device_t *
+p4est_soa_device_new (p4est_t * p4est,
+                      const p4est_soa_allocator_t * allocator)
+{
+  p4est_soa_device_t *dev;
+
+  dev = P4EST_ALLOC_ZERO (p4est_soa_device_t, 1);
+  dev->soa = p4est_soa_new (p4est);
+  if (allocator != NULL) {
+    P4EST_ASSERT (allocator->alloc != NULL && allocator->free != NULL &&
+                  allocator->copy != NULL);
+    dev->allocator = *allocator;
+  }
+  else {
+    dev->allocator.alloc = p4est_soa_host_alloc;
+    dev->allocator.free = p4est_soa_host_free;
+    dev->allocator.copy = p4est_soa_host_copy;
+  }
+  dev->revision = -1;
+
+  return dev;
+}
+
+void
+p4est_soa_device_destroy (p4est_soa_device_t * dev)
+{
+  int                 i;
+
+  for (i = 0; i < P4EST_SOA_NUM_BUFFERS; ++i) {
+    if (dev->buffer[i] != NULL) {
+      dev->allocator.free (dev->buffer[i], dev->allocator.user);
+    }
+  }
+  P4EST_FREE (dev->staging);
+  p4est_soa_destroy (dev->soa);
+  P4EST_FREE (dev);
+}
+
+/** Return a device buffer of at least the given size, or NULL for zero.
+ * The buffer is only reallocated if it is too small.
+ */
+static void        *
+p4est_soa_device_reserve (p4est_soa_device_t * dev, int which, size_t bytes)
+{
+  if (bytes == 0) {
+    return NULL;
+  }
+  if (bytes > dev->capacity[which]) {
+    if (dev->buffer[which] != NULL) {
+      dev->allocator.free (dev->buffer[which], dev->allocator.user);
+    }
+    dev->buffer[which] = dev->allocator.alloc (bytes, dev->allocator.user);
+    dev->capacity[which] = bytes;
+  }
+  return dev->buffer[which];
+}
+
+/** Copy host memory into a device buffer at a byte offset. */
+static void
+p4est_soa_device_copy (p4est_soa_device_t * dev, void *buffer,
+                       size_t offset, const void *src, size_t bytes)
+{
+  if (bytes > 0) {
+    dev->allocator.copy ((char *) buffer + offset, src, bytes,
+                         dev->allocator.user);
+  }
+}
+
+/** Return host staging memory of at least the given size. */
+static void        *
+p4est_soa_device_stage (p4est_soa_device_t * dev, size_t bytes)
+{
+  if (bytes > dev->staging_size) {
+    dev->staging = P4EST_REALLOC (dev->staging, char, bytes);
+    dev->staging_size = bytes;
+  }
+  return dev->staging;
+}
+
+int
+p4est_soa_device_update (p4est_soa_device_t * dev, p4est_ghost_t * ghost,
+                         p4est_mesh_t * mesh, p4est_lnodes_t * lnodes,
+                         int force)
+{
+  p4est_soa_t        *soa = dev->soa;
+  p4est_soa_view_t   *view = &dev->view;
+  p4est_topidx_t      jt, *trees;
+  p4est_locidx_t      nq, ng, lid;
+  const p4est_qcoord_t *local[P4EST_DIM];
+  p4est_qcoord_t     *coords;
+  p4est_quadrant_t   *g;
+  void               *buffer[P4EST_DIM];
+  int8_t             *levels;
+  size_t              zz, n, bytes;
+  int                 d;
+
+  if (!p4est_soa_update (soa, force) && !force &&
+      dev->revision == soa->revision && dev->ghost == ghost &&
+      dev->mesh == mesh && dev->lnodes == lnodes) {
+    return 0;
+  }
+
+  nq = soa->num_quadrants;
+  ng = ghost != NULL ? (p4est_locidx_t) ghost->ghosts.elem_count : 0;
+  n = (size_t) nq + (size_t) ng;
+  P4EST_ASSERT (mesh == NULL || (mesh->local_num_quadrants == nq &&
+                                 mesh->ghost_num_quadrants == ng));
+  P4EST_ASSERT (lnodes == NULL || lnodes->num_local_elements == nq);
+
+  /* the local coordinates come from the host mirror, the ghosts follow */
+  local[0] = soa->x;
+  local[1] = soa->y;
+#ifdef P4_TO_P8
+  local[2] = soa->z;
+#endif
+  for (d = 0; d < P4EST_DIM; ++d) {
+    bytes = sizeof (p4est_qcoord_t);
+    buffer[d] = p4est_soa_device_reserve (dev, P4EST_SOA_BUFFER_X + d,
+                                          n * bytes);
+    p4est_soa_device_copy (dev, buffer[d], 0, local[d], nq * bytes);
+    if (ng > 0) {
+      coords = (p4est_qcoord_t *) p4est_soa_device_stage (dev, ng * bytes);
+      for (zz = 0; zz < (size_t) ng; ++zz) {
+        g = p4est_quadrant_array_index (&ghost->ghosts, zz);
+        if (d == 0) {
+          coords[zz] = g->x;
+        }
+        else if (d == 1) {
+          coords[zz] = g->y;
+        }
+#ifdef P4_TO_P8
+        else {
+          coords[zz] = g->z;
+        }
+#endif
+      }
+      p4est_soa_device_copy (dev, buffer[d], nq * bytes, coords, ng * bytes);
+    }
+  }
+  view->x = (const p4est_qcoord_t *) buffer[0];
+  view->y = (const p4est_qcoord_t *) buffer[1];
+#ifdef P4_TO_P8
+  view->z = (const p4est_qcoord_t *) buffer[2];
+#endif
+
+  /* levels */
+  levels = (int8_t *) p4est_soa_device_stage (dev, n * sizeof (int8_t));
+  memcpy (levels, soa->level, nq * sizeof (int8_t));
+  for (zz = 0; zz < (size_t) ng; ++zz) {
+    g = p4est_quadrant_array_index (&ghost->ghosts, zz);
+    levels[nq + zz] = g->level;
+  }
+  view->level = (const int8_t *) p4est_soa_device_reserve
+    (dev, P4EST_SOA_BUFFER_LEVEL, n * sizeof (int8_t));
+  p4est_soa_device_copy (dev, (void *) view->level, 0, levels,
+                         n * sizeof (int8_t));
+
+  /* trees */
+  trees = (p4est_topidx_t *) p4est_soa_device_stage
+    (dev, n * sizeof (p4est_topidx_t));
+  for (jt = soa->first_local_tree; jt <= soa->last_local_tree; ++jt) {
+    for (lid = p4est_soa_tree_offset (soa, jt);
+         lid < p4est_soa_tree_offset (soa, jt + 1); ++lid) {
+      trees[lid] = jt;
+    }
+  }
+  for (zz = 0; zz < (size_t) ng; ++zz) {
+    g = p4est_quadrant_array_index (&ghost->ghosts, zz);
+    trees[nq + zz] = g->p.piggy3.which_tree;
+  }
+  view->which_tree = (const p4est_topidx_t *) p4est_soa_device_reserve
+    (dev, P4EST_SOA_BUFFER_TREE, n * sizeof (p4est_topidx_t));
+  p4est_soa_device_copy (dev, (void *) view->which_tree, 0, trees,
+                         n * sizeof (p4est_topidx_t));
+
+  /* neighbor tables of the mesh */
+  view->quad_to_quad = NULL;
+  view->quad_to_face = NULL;
+  view->quad_to_half = NULL;
+  if (mesh != NULL) {
+    bytes = P4EST_FACES * (size_t) nq * sizeof (p4est_locidx_t);
+    view->quad_to_quad = (const p4est_locidx_t *) p4est_soa_device_reserve
+      (dev, P4EST_SOA_BUFFER_Q2Q, bytes);
+    p4est_soa_device_copy (dev, (void *) view->quad_to_quad, 0,
+                           mesh->quad_to_quad, bytes);
+    bytes = P4EST_FACES * (size_t) nq * sizeof (int8_t);
+    view->quad_to_face = (const int8_t *) p4est_soa_device_reserve
+      (dev, P4EST_SOA_BUFFER_Q2F, bytes);
+    p4est_soa_device_copy (dev, (void *) view->quad_to_face, 0,
+                           mesh->quad_to_face, bytes);
+    bytes = mesh->quad_to_half->elem_count * mesh->quad_to_half->elem_size;
+    view->quad_to_half = (const p4est_locidx_t *) p4est_soa_device_reserve
+      (dev, P4EST_SOA_BUFFER_Q2H, bytes);
+    p4est_soa_device_copy (dev, (void *) view->quad_to_half, 0,
+                           mesh->quad_to_half->array, bytes);
+  }
+
+  /* element nodes */
+  view->vnodes = 0;
+  view->element_nodes = NULL;
+  if (lnodes != NULL) {
+    view->vnodes = lnodes->vnodes;
+    bytes = (size_t) lnodes->vnodes * (size_t) nq * sizeof (p4est_locidx_t);
+    view->element_nodes = (const p4est_locidx_t *) p4est_soa_device_reserve
+      (dev, P4EST_SOA_BUFFER_NODES, bytes);
+    p4est_soa_device_copy (dev, (void *) view->element_nodes, 0,
+                           lnodes->element_nodes, bytes);
+  }
+
+  view->num_quadrants = nq;
+  view->num_ghosts = ng;
+  dev->revision = soa->revision;
+  dev->ghost = ghost;
+  dev->mesh = mesh;
+  dev->lnodes = lnodes;
+  return 1;
+}
+
+const p4est_soa_view_t *
+p4est_soa_device_view (p4est_soa_device_t * dev)
+{
+  return &dev->view;
+}
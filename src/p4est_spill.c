@@ -0,0 +1,262 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef P4_TO_P8
+#include <p4est_algorithms.h>
+#include <p4est_spill.h>
+#else
+#include <p8est_algorithms.h>
+#include <p8est_spill.h>
+#endif
+#ifdef P4EST_HAVE_SYS_MMAN_H
+#include <fcntl.h>
+#endif
+
+/* Avoid redefinition in p4est_to_p8est.h */
+#ifdef P4_TO_P8
+#define p4est_spill                     p8est_spill
+#endif
+
+/** The user data of this many quadrants is copied through one buffer. */
+#define P4EST_SPILL_CHUNK 4096
+
+/** Location of one local tree in the scratch file. */
+typedef struct p4est_spill_tree
+{
+  long                offset;           /**< Byte offset of the record */
+  size_t              capacity;         /**< Quadrants the record holds */
+  size_t              count;            /**< Quadrants currently stored */
+  int                 is_out;           /**< The tree is spilled */
+}
+p4est_spill_tree_t;
+
+struct p4est_spill
+{
+  p4est_t            *p4est;
+  char               *filename;
+  FILE               *file;
+  long                end;              /**< End of the used file */
+  size_t              record_size;      /**< Bytes per quadrant */
+  p4est_topidx_t      num_trees;        /**< Local trees */
+  p4est_spill_tree_t *trees;            /**< One for each local tree */
+  char               *buffer;           /**< Chunk of user data */
+};
+
+static p4est_spill_tree_t *
+p4est_spill_tree (p4est_spill_t * spill, p4est_topidx_t which_tree)
+{
+  P4EST_ASSERT (spill->p4est->first_local_tree <= which_tree &&
+                which_tree <= spill->p4est->last_local_tree);
+  return spill->trees + (which_tree - spill->p4est->first_local_tree);
+}
+
+p4est_spill_t      *
+p4est_spill_new (p4est_t * p4est, const char *filename)
+{
+  FILE               *file;
+  p4est_spill_t      *spill;
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (filename != NULL);
+
+  file = fopen (filename, "w+b");
+  if (file == NULL) {
+    P4EST_LERRORF ("Could not create spill file %s\n", filename);
+    return NULL;
+  }
+
+  spill = P4EST_ALLOC_ZERO (p4est_spill_t, 1);
+  spill->p4est = p4est;
+  spill->filename = P4EST_ALLOC (char, strlen (filename) + 1);
+  strcpy (spill->filename, filename);
+  spill->file = file;
+  spill->record_size = sizeof (p4est_quadrant_t) + p4est->data_size;
+  spill->num_trees = p4est->first_local_tree < 0 ? 0 :
+    p4est->last_local_tree - p4est->first_local_tree + 1;
+  spill->trees = P4EST_ALLOC_ZERO (p4est_spill_tree_t,
+                                   SC_MAX (spill->num_trees, 1));
+  if (p4est->data_size > 0) {
+    spill->buffer = P4EST_ALLOC (char, P4EST_SPILL_CHUNK * p4est->data_size);
+  }
+
+  return spill;
+}
+
+int
+p4est_spill_destroy (p4est_spill_t * spill)
+{
+  int                 retval = 0;
+  p4est_topidx_t      jt;
+
+  P4EST_ASSERT (spill != NULL);
+
+  for (jt = 0; jt < spill->num_trees; ++jt) {
+    if (spill->trees[jt].is_out &&
+        p4est_spill_in (spill, spill->p4est->first_local_tree + jt)) {
+      retval = -1;
+    }
+  }
+  fclose (spill->file);
+  remove (spill->filename);
+
+  P4EST_FREE (spill->buffer);
+  P4EST_FREE (spill->trees);
+  P4EST_FREE (spill->filename);
+  P4EST_FREE (spill);
+
+  return retval;
+}
+
+int
+p4est_spill_out (p4est_spill_t * spill, p4est_topidx_t which_tree)
+{
+  const size_t        data_size = spill->p4est->data_size;
+  size_t              zz, zc, nc;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  p4est_spill_tree_t *st = p4est_spill_tree (spill, which_tree);
+
+  P4EST_ASSERT (!st->is_out);
+  /* the quadrants of a shallow copy are released below */
+  p4est_unshare_quadrants (spill->p4est);
+  tree = p4est_tree_array_index (spill->p4est->trees, which_tree);
+
+  /* reuse the record of the tree if it is large enough */
+  if (tree->quadrants.elem_count > st->capacity) {
+    st->offset = spill->end;
+    st->capacity = tree->quadrants.elem_count;
+    spill->end += (long) (st->capacity * spill->record_size);
+  }
+  st->count = tree->quadrants.elem_count;
+
+  /* the quadrants are followed by their user data */
+  if (fseek (spill->file, st->offset, SEEK_SET) ||
+      fwrite (tree->quadrants.array, sizeof (p4est_quadrant_t), st->count,
+              spill->file) != st->count) {
+    return -1;
+  }
+  if (data_size > 0) {
+    for (zc = 0; zc < st->count; zc += nc) {
+      nc = SC_MIN (P4EST_SPILL_CHUNK, st->count - zc);
+      for (zz = 0; zz < nc; ++zz) {
+        q = p4est_quadrant_array_index (&tree->quadrants, zc + zz);
+        memcpy (spill->buffer + zz * data_size, q->p.user_data, data_size);
+      }
+      if (fwrite (spill->buffer, data_size, nc, spill->file) != nc) {
+        return -1;
+      }
+    }
+  }
+  if (fflush (spill->file)) {
+    return -1;
+  }
+
+  /* the tree is written completely and may be released */
+  for (zz = 0; zz < st->count; ++zz) {
+    q = p4est_quadrant_array_index (&tree->quadrants, zz);
+    p4est_quadrant_free_data (spill->p4est, q);
+  }
+  sc_array_reset (&tree->quadrants);
+  st->is_out = 1;
+
+  return 0;
+}
+
+int
+p4est_spill_in (p4est_spill_t * spill, p4est_topidx_t which_tree)
+{
+  const size_t        data_size = spill->p4est->data_size;
+  size_t              zz, zc, nc;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  p4est_spill_tree_t *st = p4est_spill_tree (spill, which_tree);
+
+  P4EST_ASSERT (st->is_out);
+  tree = p4est_tree_array_index (spill->p4est->trees, which_tree);
+  P4EST_ASSERT (tree->quadrants.elem_count == 0);
+
+  sc_array_resize (&tree->quadrants, st->count);
+  if (fseek (spill->file, st->offset, SEEK_SET) ||
+      fread (tree->quadrants.array, sizeof (p4est_quadrant_t), st->count,
+             spill->file) != st->count) {
+    sc_array_reset (&tree->quadrants);
+    return -1;
+  }
+  if (data_size > 0) {
+    /* without user data the quadrants keep their stored user_int */
+    for (zz = 0; zz < st->count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      p4est_quadrant_init_data (spill->p4est, which_tree, q, NULL);
+    }
+    for (zc = 0; zc < st->count; zc += nc) {
+      nc = SC_MIN (P4EST_SPILL_CHUNK, st->count - zc);
+      if (fread (spill->buffer, data_size, nc, spill->file) != nc) {
+        for (zz = 0; zz < st->count; ++zz) {
+          q = p4est_quadrant_array_index (&tree->quadrants, zz);
+          p4est_quadrant_free_data (spill->p4est, q);
+        }
+        sc_array_reset (&tree->quadrants);
+        return -1;
+      }
+      for (zz = 0; zz < nc; ++zz) {
+        q = p4est_quadrant_array_index (&tree->quadrants, zc + zz);
+        memcpy (q->p.user_data, spill->buffer + zz * data_size, data_size);
+      }
+    }
+  }
+  st->is_out = 0;
+
+  /* a sweep in tree order will access the next spilled tree soon */
+  for (jt = which_tree + 1; jt <= spill->p4est->last_local_tree; ++jt) {
+    if (p4est_spill_tree (spill, jt)->is_out) {
+      p4est_spill_prefetch (spill, jt);
+      break;
+    }
+  }
+
+  return 0;
+}
+
+void
+p4est_spill_prefetch (p4est_spill_t * spill, p4est_topidx_t which_tree)
+{
+  p4est_spill_tree_t *st = p4est_spill_tree (spill, which_tree);
+
+  if (!st->is_out || st->count == 0) {
+    return;
+  }
+#if defined P4EST_HAVE_SYS_MMAN_H && defined POSIX_FADV_WILLNEED
+  (void) posix_fadvise (fileno (spill->file), (off_t) st->offset,
+                        (off_t) (st->count * spill->record_size),
+                        POSIX_FADV_WILLNEED);
+#endif
+}
+
+int
+p4est_spill_is_out (p4est_spill_t * spill, p4est_topidx_t which_tree)
+{
+  return p4est_spill_tree (spill, which_tree)->is_out;
+}
@@ -0,0 +1,113 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+/** \file p4est_spill.h
+ *
+ * Move the quadrants of local trees to a file and back.
+ *
+ * A forest whose quadrants and user data exceed the memory of a process
+ * may keep only some trees in memory at a time.  The quadrants of a tree
+ * and their user data are written in Morton order to a local scratch
+ * file and released from memory by \ref p4est_spill_out.  They are read
+ * back by \ref p4est_spill_in before the tree is accessed again.  When a
+ * tree is read back, the next spilled tree in order is announced to the
+ * operating system to be read ahead, such that a sweep over the trees in
+ * order streams through the file.
+ *
+ * While any tree is spilled, its quadrant array is empty and the forest is
+ * not valid: only code that accesses the trees in memory may run.  Ghost
+ * layers, meshes and other structures pointing into the quadrant arrays
+ * of spilled trees become invalid.  All trees are read back when the
+ * context is destroyed.
+ *
+ * \ingroup p4est
+ */
+
+#ifndef P4EST_SPILL_H
+#define P4EST_SPILL_H
+
+#include <p4est.h>
+
+SC_EXTERN_C_BEGIN;
+
+/** The opaque context of the trees spilled to a file. */
+typedef struct p4est_spill p4est_spill_t;
+
+/** Create a scratch file to spill the local trees of a forest.
+ * This function is not collective; every process needs its own file.
+ * \param [in] p4est        The forest; its local trees and data size
+ *                          must not change while trees are spilled.
+ * \param [in] filename     Path of the scratch file.  It is created or
+ *                          truncated and removed by \ref
+ *                          p4est_spill_destroy.
+ * \return                  The context, or NULL if the file cannot be
+ *                          created.
+ */
+p4est_spill_t      *p4est_spill_new (p4est_t * p4est, const char *filename);
+
+/** Read back all spilled trees, close and remove the scratch file.
+ * \param [in] spill        The context is freed.
+ * \return                  0 on success and -1 if a tree could not be
+ *                          read back; its quadrant array stays empty.
+ */
+int                 p4est_spill_destroy (p4est_spill_t * spill);
+
+/** Write the quadrants and user data of a local tree to the file.
+ * Its quadrant array and the user data of its quadrants are freed.
+ * The storage of a tree is reused when it is spilled again with no more
+ * quadrants than before.
+ * \param [in] spill        The context.
+ * \param [in] which_tree   A local tree that is not spilled.
+ * \return                  0 on success and -1 on a write error, in which
+ *                          case the tree stays in memory.
+ */
+int                 p4est_spill_out (p4est_spill_t * spill,
+                                     p4est_topidx_t which_tree);
+
+/** Read the quadrants and user data of a spilled tree from the file.
+ * Afterwards, the next spilled tree is announced to be read ahead.
+ * \param [in] spill        The context.
+ * \param [in] which_tree   A local tree that is spilled.
+ * \return                  0 on success and -1 on a read error, in which
+ *                          case the tree stays spilled.
+ */
+int                 p4est_spill_in (p4est_spill_t * spill,
+                                    p4est_topidx_t which_tree);
+
+/** Announce that a spilled tree will be read soon.
+ * This is a hint to the operating system and may do nothing.
+ * \param [in] spill        The context.
+ * \param [in] which_tree   A local tree; nothing is done if not spilled.
+ */
+void                p4est_spill_prefetch (p4est_spill_t * spill,
+                                          p4est_topidx_t which_tree);
+
+/** Query whether a local tree is currently spilled. */
+int                 p4est_spill_is_out (p4est_spill_t * spill,
+                                        p4est_topidx_t which_tree);
+
+SC_EXTERN_C_END;
+
+#endif /* !P4EST_SPILL_H */
@@ -0,0 +1,224 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P4_TO_P8
+#include <p4est_taskgraph.h>
+#else
+#include <p8est_taskgraph.h>
+#endif
+
+/** The task a face of the mesh face list is assigned to. */
+typedef struct p4est_taskgraph_key
+{
+  int                 type;     /**< A \ref p4est_task_type_t */
+  p4est_locidx_t      block[2]; /**< As in \ref p4est_task_t */
+  p4est_locidx_t      face;     /**< Index into the mesh face list */
+}
+p4est_taskgraph_key_t;
+
+/** Order keys by task type, then blocks, then face. */
+static int
+taskgraph_key_compare (const void *v1, const void *v2)
+{
+  const p4est_taskgraph_key_t *k1 = (const p4est_taskgraph_key_t *) v1;
+  const p4est_taskgraph_key_t *k2 = (const p4est_taskgraph_key_t *) v2;
+
+  if (k1->type != k2->type) {
+    return k1->type < k2->type ? -1 : 1;
+  }
+  if (k1->block[0] != k2->block[0]) {
+    return k1->block[0] < k2->block[0] ? -1 : 1;
+  }
+  if (k1->block[1] != k2->block[1]) {
+    return k1->block[1] < k2->block[1] ? -1 : 1;
+  }
+  return k1->face == k2->face ? 0 : k1->face < k2->face ? -1 : 1;
+}
+
+/** Append a dependency to the last task unless it is already there. */
+static void
+taskgraph_add_dep (sc_array_t * deps, p4est_task_t * task,
+                   p4est_locidx_t dep)
+{
+  p4est_locidx_t      i;
+
+  for (i = 0; i < task->num_deps; ++i) {
+    if (*(p4est_locidx_t *) sc_array_index (deps, task->dep_offset + i) ==
+        dep) {
+      return;
+    }
+  }
+  *(p4est_locidx_t *) sc_array_push (deps) = dep;
+  ++task->num_deps;
+}
+
+p4est_taskgraph_t  *
+p4est_taskgraph_new (p4est_mesh_t * mesh, p4est_locidx_t block_size)
+{
+  int                 k;
+  size_t              zz, num_faces;
+  p4est_locidx_t      lq, b, fi, left, right, tid;
+  p4est_locidx_t     *last;
+  p4est_task_t       *task;
+  p4est_taskgraph_key_t *key, *first;
+  p4est_taskgraph_t  *graph;
+  sc_array_t         *keys, *tasks, *deps;
+
+  P4EST_ASSERT (mesh != NULL && mesh->face_to_quad != NULL);
+  P4EST_ASSERT (block_size > 0);
+
+  lq = mesh->local_num_quadrants;
+  num_faces = (size_t) mesh->local_num_faces;
+
+  graph = P4EST_ALLOC_ZERO (p4est_taskgraph_t, 1);
+  graph->block_size = block_size;
+  graph->num_blocks = (lq + block_size - 1) / block_size;
+  graph->block_offsets = P4EST_ALLOC (p4est_locidx_t, graph->num_blocks + 1);
+  for (b = 0; b < graph->num_blocks; ++b) {
+    graph->block_offsets[b] = b * block_size;
+  }
+  graph->block_offsets[graph->num_blocks] = lq;
+
+  /* assign each face to the task that processes it */
+  keys = sc_array_new_count (sizeof (p4est_taskgraph_key_t), num_faces);
+  for (fi = 0; fi < (p4est_locidx_t) num_faces; ++fi) {
+    key = (p4est_taskgraph_key_t *) sc_array_index (keys, (size_t) fi);
+    left = mesh->face_to_quad[2 * fi];
+    right = mesh->face_to_quad[2 * fi + 1];
+    P4EST_ASSERT (0 <= left && left < lq);
+    key->face = fi;
+    key->block[0] = left / block_size;
+    key->block[1] = -1;
+    if (right < 0) {
+      key->type = P4EST_TASK_VOLUME;
+    }
+    else if (right >= lq) {
+      key->type = P4EST_TASK_BOUNDARY;
+    }
+    else if (right / block_size == key->block[0]) {
+      key->type = P4EST_TASK_VOLUME;
+    }
+    else {
+      key->type = P4EST_TASK_INTERFACE;
+      key->block[1] = right / block_size;
+      if (key->block[1] < key->block[0]) {
+        key->block[1] = key->block[0];
+        key->block[0] = right / block_size;
+      }
+    }
+  }
+  sc_array_sort (keys, taskgraph_key_compare);
+
+  /* the ghost task and one volume task per block come first */
+  graph->faces = P4EST_ALLOC (p4est_locidx_t, num_faces);
+  tasks = sc_array_new (sizeof (p4est_task_t));
+  task = (p4est_task_t *) sc_array_push (tasks);
+  task->type = P4EST_TASK_GHOST;
+  task->block[0] = task->block[1] = -1;
+  task->face_offset = task->num_faces = 0;
+  zz = 0;
+  for (b = 0; b < graph->num_blocks; ++b) {
+    task = (p4est_task_t *) sc_array_push (tasks);
+    task->type = P4EST_TASK_VOLUME;
+    task->block[0] = b;
+    task->block[1] = -1;
+    task->face_offset = (p4est_locidx_t) zz;
+    for (; zz < num_faces; ++zz) {
+      key = (p4est_taskgraph_key_t *) sc_array_index (keys, zz);
+      if (key->type != P4EST_TASK_VOLUME || key->block[0] != b) {
+        break;
+      }
+      graph->faces[zz] = key->face;
+    }
+    task->num_faces = (p4est_locidx_t) zz - task->face_offset;
+  }
+
+  /* the interface and boundary tasks follow in sorted order */
+  while (zz < num_faces) {
+    first = (p4est_taskgraph_key_t *) sc_array_index (keys, zz);
+    P4EST_ASSERT (first->type != P4EST_TASK_VOLUME);
+    task = (p4est_task_t *) sc_array_push (tasks);
+    task->type = (p4est_task_type_t) first->type;
+    task->block[0] = first->block[0];
+    task->block[1] = first->block[1];
+    task->face_offset = (p4est_locidx_t) zz;
+    for (; zz < num_faces; ++zz) {
+      key = (p4est_taskgraph_key_t *) sc_array_index (keys, zz);
+      if (key->type != first->type || key->block[0] != first->block[0] ||
+          key->block[1] != first->block[1]) {
+        break;
+      }
+      graph->faces[zz] = key->face;
+    }
+    task->num_faces = (p4est_locidx_t) zz - task->face_offset;
+  }
+  sc_array_destroy (keys);
+
+  /* each task waits for the previous task on each of its blocks */
+  deps = sc_array_new (sizeof (p4est_locidx_t));
+  last = P4EST_ALLOC (p4est_locidx_t, graph->num_blocks);
+  for (tid = 0; tid < (p4est_locidx_t) tasks->elem_count; ++tid) {
+    task = (p4est_task_t *) sc_array_index (tasks, (size_t) tid);
+    task->dep_offset = (p4est_locidx_t) deps->elem_count;
+    task->num_deps = 0;
+    if (task->type == P4EST_TASK_BOUNDARY) {
+      taskgraph_add_dep (deps, task, 0);
+    }
+    for (k = 0; k < 2; ++k) {
+      b = task->block[k];
+      if (b < 0) {
+        continue;
+      }
+      if (task->type != P4EST_TASK_VOLUME) {
+        taskgraph_add_dep (deps, task, last[b]);
+      }
+      last[b] = tid;
+    }
+  }
+  P4EST_FREE (last);
+
+  graph->num_tasks = (p4est_locidx_t) tasks->elem_count;
+  graph->tasks = P4EST_ALLOC (p4est_task_t, graph->num_tasks);
+  memcpy (graph->tasks, tasks->array, tasks->elem_count * tasks->elem_size);
+  graph->deps = P4EST_ALLOC (p4est_locidx_t, deps->elem_count);
+  memcpy (graph->deps, deps->array, deps->elem_count * deps->elem_size);
+  sc_array_destroy (tasks);
+  sc_array_destroy (deps);
+
+  P4EST_VERBOSEF ("Task graph with %lld blocks and %lld tasks\n",
+                  (long long) graph->num_blocks,
+                  (long long) graph->num_tasks);
+
+  return graph;
+}
+
+void
+p4est_taskgraph_destroy (p4est_taskgraph_t * graph)
+{
+  P4EST_FREE (graph->block_offsets);
+  P4EST_FREE (graph->tasks);
+  P4EST_FREE (graph->faces);
+  P4EST_FREE (graph->deps);
+  P4EST_FREE (graph);
+}
@@ -43,6 +43,7 @@
 
 /* redefine macros */
 #define P4EST_ONDISK_FORMAT             P8EST_ONDISK_FORMAT
+#define P4EST_MAPPED_FORMAT             P8EST_MAPPED_FORMAT
 #define P4EST_DIM                       P8EST_DIM
 #define P4EST_DIM_POW                   P8EST_DIM_POW
 #define P4EST_FACES                     P8EST_FACES
@@ -63,6 +64,8 @@
 #define P4EST_LAST_OFFSET               P8EST_LAST_OFFSET
 #define P4EST_QUADRANT_INIT             P8EST_QUADRANT_INIT
 #define P4EST_LEAF_IS_FIRST_IN_TREE     P8EST_LEAF_IS_FIRST_IN_TREE
+#define P4EST_LNODES_CODES              P8EST_LNODES_CODES
+#define P4EST_CONNECTIVITY_HEADER_BYTES P8EST_CONNECTIVITY_HEADER_BYTES
 
 #ifdef P4EST_ENABLE_FILE_DEPRECATED
 
@@ -88,15 +91,38 @@
 #define P4EST_CONNECT_ALMOST            P8EST_CONNECT_ALMOST
 #define P4EST_CONNECT_CORNER            P8EST_CONNECT_CORNER
 #define P4EST_CONNECT_FULL              P8EST_CONNECT_FULL
+#define P4EST_VALID_CHANGED             P8EST_VALID_CHANGED
+#define P4EST_VALID_SAMPLED             P8EST_VALID_SAMPLED
+#define P4EST_VALID_FULL                P8EST_VALID_FULL
 #define P4EST_CONN_ENCODE_NONE          P8EST_CONN_ENCODE_NONE
+#define P4EST_ITER_FACE_SAME            P8EST_ITER_FACE_SAME
+#define P4EST_ITER_FACE_HANGING         P8EST_ITER_FACE_HANGING
+#define P4EST_ITER_FACE_BOUNDARY        P8EST_ITER_FACE_BOUNDARY
+#define P4EST_ITER_FACE_NUM_KINDS       P8EST_ITER_FACE_NUM_KINDS
 #define P4EST_TRANSFER_COMM_SRC         P8EST_TRANSFER_COMM_SRC
 #define P4EST_TRANSFER_COMM_DEST        P8EST_TRANSFER_COMM_DEST
 #define P4EST_TRANSFER_COMM_SRC_DUP     P8EST_TRANSFER_COMM_SRC_DUP
 #define P4EST_TRANSFER_COMM_DEST_DUP    P8EST_TRANSFER_COMM_DEST_DUP
 #define P4EST_TRANSFER_COMM_EXTERNAL    P8EST_TRANSFER_COMM_EXTERNAL
+#define P4EST_VTK_REDUCE_MEAN           P8EST_VTK_REDUCE_MEAN
+#define P4EST_VTK_REDUCE_MIN            P8EST_VTK_REDUCE_MIN
+#define P4EST_VTK_REDUCE_MAX            P8EST_VTK_REDUCE_MAX
+#define P4EST_ADAPT_SAME                P8EST_ADAPT_SAME
+#define P4EST_ADAPT_CHILD               P8EST_ADAPT_CHILD
+#define P4EST_ADAPT_PARENT              P8EST_ADAPT_PARENT
 #define P4EST_WRAP_NONE                 P8EST_WRAP_NONE
 #define P4EST_WRAP_REFINE               P8EST_WRAP_REFINE
 #define P4EST_WRAP_COARSEN              P8EST_WRAP_COARSEN
+#define P4EST_WRAP_STAGE_ADAPT          P8EST_WRAP_STAGE_ADAPT
+#define P4EST_WRAP_STAGE_BALANCE        P8EST_WRAP_STAGE_BALANCE
+#define P4EST_WRAP_STAGE_PARTITION      P8EST_WRAP_STAGE_PARTITION
+#define P4EST_WRAP_STAGE_GHOST          P8EST_WRAP_STAGE_GHOST
+#define P4EST_WRAP_STAGE_MESH           P8EST_WRAP_STAGE_MESH
+#define P4EST_WRAP_STAGE_COUNT          P8EST_WRAP_STAGE_COUNT
+#define P4EST_TASK_GHOST                P8EST_TASK_GHOST
+#define P4EST_TASK_VOLUME               P8EST_TASK_VOLUME
+#define P4EST_TASK_INTERFACE            P8EST_TASK_INTERFACE
+#define P4EST_TASK_BOUNDARY             P8EST_TASK_BOUNDARY
 
 #ifdef P4EST_ENABLE_FILE_DEPRECATED
 
@@ -121,6 +147,8 @@
 #define P4EST_FILE_ERR_COUNT            P8EST_FILE_ERR_COUNT
 #define P4EST_FILE_ERR_UNKNOWN          P8EST_FILE_ERR_UNKNOWN
 #define P4EST_FILE_ERR_LASTCODE         P8EST_FILE_ERR_LASTCODE
+#define P4EST_FILE_BACKEND_NATIVE       P8EST_FILE_BACKEND_NATIVE
+#define P4EST_FILE_BACKEND_HDF5         P8EST_FILE_BACKEND_HDF5
 
 #endif
 
@@ -129,13 +157,18 @@
 #define p4est_balance_type_t            p8est_balance_type_t
 #endif
 #define p4est_connect_type_t            p8est_connect_type_t
+#define p4est_valid_check_t             p8est_valid_check_t
 #define p4est_connectivity_encode_t     p8est_connectivity_encode_t
 #define p4est_connectivity_t            p8est_connectivity_t
+#define p4est_connectivity_brick_t      p8est_connectivity_brick_t
 #define p4est_corner_transform_t        p8est_corner_transform_t
 #define p4est_corner_info_t             p8est_corner_info_t
 #define p4est_neighbor_transform_t      p8est_neighbor_transform_t
 #define p4est_geometry_t                p8est_geometry_t
 #define p4est_geometry_destroy_t        p8est_geometry_destroy_t
+#define p4est_geometry_X_batch_t        p8est_geometry_X_batch_t
+#define p4est_geometry_J_t              p8est_geometry_J_t
+#define p4est_geometry_cache_t          p8est_geometry_cache_t
 #define p4est_t                         p8est_t
 #define p4est_tree_t                    p8est_tree_t
 #define p4est_quadrant_t                p8est_quadrant_t
@@ -145,8 +178,34 @@
 #define p4est_refine_t                  p8est_refine_t
 #define p4est_coarsen_t                 p8est_coarsen_t
 #define p4est_weight_t                  p8est_weight_t
+#define p4est_weights_t                 p8est_weights_t
+#define p4est_partition_data_t          p8est_partition_data_t
+#define p4est_partition_context         p8est_partition_context
+#define p4est_partition_context_t       p8est_partition_context_t
+#define p4est_partition_data            p8est_partition_data
 #define p4est_ghost_t                   p8est_ghost_t
 #define p4est_ghost_exchange_t          p8est_ghost_exchange_t
+#define p4est_ghost_build_t             p8est_ghost_build_t
+#define p4est_ghost_build               p8est_ghost_build
+#define p4est_ghost_plan_t              p8est_ghost_plan_t
+#define p4est_ghost_types_t             p8est_ghost_types_t
+#define p4est_ghost_field_t             p8est_ghost_field_t
+#define p4est_ghost_field               p8est_ghost_field
+#define p4est_ghost_shared              p8est_ghost_shared
+#define p4est_ghost_index_t             p8est_ghost_index_t
+#define p4est_ghost_compact_t           p8est_ghost_compact_t
+#define p4est_ghost_index               p8est_ghost_index
+#define p4est_ghost_compact             p8est_ghost_compact
+#define p4est_balance_context_t         p8est_balance_context_t
+#define p4est_balance_context           p8est_balance_context
+#define p4est_comm_sparse_t             p8est_comm_sparse_t
+#define p4est_comm_sparse               p8est_comm_sparse
+#define p4est_adapt_relation_t          p8est_adapt_relation_t
+#define p4est_adapt_map_t               p8est_adapt_map_t
+#define p4est_adapt_map                 p8est_adapt_map
+#define p4est_shared_quadrants          p8est_shared_quadrants
+#define p4est_scratch                   p8est_scratch
+#define p4est_data_cache                p8est_data_cache
 #define p4est_indep_t                   p8est_indep_t
 #define p4est_nodes_t                   p8est_nodes_t
 #define p4est_lid_t                     p8est_lid_t
@@ -154,6 +213,9 @@
 #define p4est_lnodes_code_t             p8est_lnodes_code_t
 #define p4est_lnodes_rank_t             p8est_lnodes_rank_t
 #define p4est_lnodes_buffer_t           p8est_lnodes_buffer_t
+#define p4est_lnodes_plan_t             p8est_lnodes_plan_t
+#define p4est_lnodes_export_t           p8est_lnodes_export_t
+#define p4est_lnodes_hanging_t          p8est_lnodes_hanging_t
 #define p4est_iter_volume_t             p8est_iter_volume_t
 #define p4est_iter_volume_info_t        p8est_iter_volume_info_t
 #define p4est_iter_face_t               p8est_iter_face_t
@@ -162,24 +224,70 @@
 #define p4est_iter_corner_t             p8est_iter_corner_t
 #define p4est_iter_corner_side_t        p8est_iter_corner_side_t
 #define p4est_iter_corner_info_t        p8est_iter_corner_info_t
+#define p4est_iter_face_kind_t          p8est_iter_face_kind_t
+#define p4est_iter_face_batch_t         p8est_iter_face_batch_t
+#define p4est_iter_face_batch_info_t    p8est_iter_face_batch_info_t
+#define p4est_iter_plan_t               p8est_iter_plan_t
 #define p4est_mesh_params_t             p8est_mesh_params_t
 #define p4est_search_query_t            p8est_search_query_t
 #define p4est_search_local_t            p8est_search_local_t
+#define p4est_search_local_batch_t      p8est_search_local_batch_t
+#define p4est_search_ghost_t            p8est_search_ghost_t
 #define p4est_search_reorder_t          p8est_search_reorder_t
+#define p4est_search_order_t            p8est_search_order_t
 #define p4est_search_partition_t        p8est_search_partition_t
 #define p4est_search_all_t              p8est_search_all_t
+#define p4est_search_all_batch_t        p8est_search_all_batch_t
+#define p4est_search_nearest_t          p8est_search_nearest_t
+#define p4est_ray_t                     p8est_ray_t
+#define p4est_search_ray_t              p8est_search_ray_t
+#define p4est_search_index_t            p8est_search_index_t
+#define p4est_search_index              p8est_search_index
 #define p4est_build                     p8est_build
 #define p4est_build_t                   p8est_build_t
+#define p4est_build_stream              p8est_build_stream
+#define p4est_build_stream_t            p8est_build_stream_t
+#define p4est_points_migrate_t          p8est_points_migrate_t
 #define p4est_transfer_comm_t           p8est_transfer_comm_t
 #define p4est_transfer_context_t        p8est_transfer_context_t
+#define p4est_transfer_iovec            p8est_transfer_iovec
+#define p4est_transfer_iovec_t          p8est_transfer_iovec_t
+#define p4est_transfer_alloc_t          p8est_transfer_alloc_t
+#define p4est_transfer_plan_t           p8est_transfer_plan_t
 #define p4est_mesh_t                    p8est_mesh_t
+#define p4est_mesh_history_t            p8est_mesh_history_t
 #define p4est_mesh_face_neighbor_t      p8est_mesh_face_neighbor_t
+#define p4est_soa_t                     p8est_soa_t
+#define p4est_soa_allocator_t           p8est_soa_allocator_t
+#define p4est_soa_view_t                p8est_soa_view_t
+#define p4est_soa_device_t              p8est_soa_device_t
+#define p4est_task_type_t               p8est_task_type_t
+#define p4est_task_t                    p8est_task_t
+#define p4est_taskgraph_t               p8est_taskgraph_t
+#define p4est_compact_t                 p8est_compact_t
+#define p4est_hierarchy_t               p8est_hierarchy_t
+#define p4est_hierarchy_level_t         p8est_hierarchy_level_t
+#define p4est_remap_t                   p8est_remap_t
+#define p4est_object_t                  p8est_object_t
+#define p4est_objects_t                 p8est_objects_t
+#define p4est_objects_refine_t          p8est_objects_refine_t
+#define p4est_spill_t                   p8est_spill_t
 #define p4est_wrap_t                    p8est_wrap_t
 #define p4est_wrap_leaf_t               p8est_wrap_leaf_t
 #define p4est_wrap_flags_t              p8est_wrap_flags_t
 #define p4est_wrap_params_t             p8est_wrap_params_t
+#define p4est_wrap_stage_t              p8est_wrap_stage_t
 #define p4est_vtk_context_t             p8est_vtk_context_t
+#define p4est_vtk_hdf5_t                p8est_vtk_hdf5_t
+#define p4est_vtk_mesh_t                p8est_vtk_mesh_t
+#define p4est_vtk_reduce_t              p8est_vtk_reduce_t
+#define p4est_vtk_ho_points_t           p8est_vtk_ho_points_t
 #define p4est_file_context_t            p8est_file_context_t
+#define p4est_file_backend_t            p8est_file_backend_t
+#define p4est_file_async_t              p8est_file_async_t
+#define p4est_file_delta_t              p8est_file_delta_t
+#define p4est_file_map_t                p8est_file_map_t
+#define p4est_file_map_scan_t           p8est_file_map_scan_t
 #define p4est_file_section_metadata_t   p8est_file_section_metadata_t
 
 /* redefine external variables */
@@ -198,21 +306,43 @@
 #define p4est_connectivity_memory_used  p8est_connectivity_memory_used
 #define p4est_connectivity_new          p8est_connectivity_new
 #define p4est_connectivity_new_brick    p8est_connectivity_new_brick
+#define p4est_connectivity_new_brick_implicit           \
+        p8est_connectivity_new_brick_implicit
+#define p4est_connectivity_brick_face_neighbor          \
+        p8est_connectivity_brick_face_neighbor
+#define p4est_connectivity_face_neighbor_tree           \
+        p8est_connectivity_face_neighbor_tree
+#define p4est_connectivity_tree_vertex  p8est_connectivity_tree_vertex
 #define p4est_connectivity_new_periodic p8est_connectivity_new_periodic
 #define p4est_connectivity_new_twotrees p8est_connectivity_new_twotrees
 #define p4est_connectivity_new_byname   p8est_connectivity_new_byname
 #define p4est_connectivity_new_copy     p8est_connectivity_new_copy
 #define p4est_connectivity_bcast        p8est_connectivity_bcast
+#define p4est_connectivity_bcast_shared p8est_connectivity_bcast_shared
+#define p4est_connectivity_extract      p8est_connectivity_extract
+#define p4est_connectivity_scatter      p8est_connectivity_scatter
 #define p4est_connectivity_destroy      p8est_connectivity_destroy
+#define p4est_connectivity_ref          p8est_connectivity_ref
+#define p4est_connectivity_unref        p8est_connectivity_unref
 #define p4est_connectivity_set_attr     p8est_connectivity_set_attr
+#define p4est_connectivity_set_transform_cache          \
+        p8est_connectivity_set_transform_cache
 #define p4est_connectivity_is_valid     p8est_connectivity_is_valid
+#define p4est_connectivity_is_valid_parallel \
+        p8est_connectivity_is_valid_parallel
 #define p4est_connectivity_is_equal     p8est_connectivity_is_equal
 #define p4est_connectivity_sink         p8est_connectivity_sink
+#define p4est_connectivity_checksum     p8est_connectivity_checksum
 #define p4est_connectivity_deflate      p8est_connectivity_deflate
 #define p4est_connectivity_save         p8est_connectivity_save
 #define p4est_connectivity_source       p8est_connectivity_source
+#define p4est_connectivity_source_ext   p8est_connectivity_source_ext
+#define p4est_connectivity_sink_bytes   p8est_connectivity_sink_bytes
 #define p4est_connectivity_inflate      p8est_connectivity_inflate
 #define p4est_connectivity_load         p8est_connectivity_load
+#define p4est_connectivity_load_ext     p8est_connectivity_load_ext
+#define p4est_connectivity_save_mapped  p8est_connectivity_save_mapped
+#define p4est_connectivity_load_mapped  p8est_connectivity_load_mapped
 #define p4est_connectivity_complete     p8est_connectivity_complete
 #define p4est_connectivity_reduce       p8est_connectivity_reduce
 #define p4est_expand_face_transform     p8est_expand_face_transform
@@ -229,13 +359,16 @@
 #define p4est_connectivity_reorder_newid                \
         p8est_connectivity_reorder_newid
 #define p4est_connectivity_permute      p8est_connectivity_permute
+#define p4est_connectivity_reorder_sfc  p8est_connectivity_reorder_sfc
 #define p4est_connectivity_join_faces   p8est_connectivity_join_faces
 #define p4est_connectivity_is_equivalent p8est_connectivity_is_equivalent
 #define p4est_connectivity_read_inp_stream p8est_connectivity_read_inp_stream
+#define p4est_connectivity_read_inp_buffer p8est_connectivity_read_inp_buffer
 #define p4est_connectivity_read_inp     p8est_connectivity_read_inp
 
 /* functions in p4est */
 #define p4est_qcoord_to_vertex          p8est_qcoord_to_vertex
+#define p4est_qcoord_to_vertex_batch    p8est_qcoord_to_vertex_batch
 #define p4est_memory_used               p8est_memory_used
 #define p4est_revision                  p8est_revision
 #define p4est_new                       p8est_new
@@ -248,6 +381,7 @@
 #define p4est_partition                 p8est_partition
 #define p4est_checksum                  p8est_checksum
 #define p4est_checksum_partition        p8est_checksum_partition
+#define p4est_checksum_crc32c           p8est_checksum_crc32c
 #define p4est_save                      p8est_save
 #define p4est_load                      p8est_load
 #define p4est_connect_type_int          p8est_connect_type_int
@@ -283,31 +417,97 @@
 #define p4est_lid_bitwise_and_inplace   p8est_lid_bitwise_and_inplace
 #define p4est_quadrant_linear_id_ext128 p8est_quadrant_linear_id_ext128
 #define p4est_quadrant_set_morton_ext128 p8est_quadrant_set_morton_ext128
+#define p4est_quadrant_linear_id_ext128_batch \
+        p8est_quadrant_linear_id_ext128_batch
+#define p4est_quadrant_set_morton_ext128_batch \
+        p8est_quadrant_set_morton_ext128_batch
 #define p4est_new_ext                   p8est_new_ext
 #define p4est_mesh_new_ext              p8est_mesh_new_ext
 #define p4est_mesh_new_params           p8est_mesh_new_params
 #define p4est_mesh_params_init          p8est_mesh_params_init
 #define p4est_copy_ext                  p8est_copy_ext
+#define p4est_copy_shared               p8est_copy_shared
+#define p4est_unshare_quadrants         p8est_unshare_quadrants
+#define p4est_scratch_array_new         p8est_scratch_array_new
+#define p4est_scratch_array_destroy     p8est_scratch_array_destroy
+#define p4est_scratch_trim              p8est_scratch_trim
+#define p4est_set_data_contiguous       p8est_set_data_contiguous
+#define p4est_set_balance_incremental   p8est_set_balance_incremental
+#define p4est_set_valid_incremental     p8est_set_valid_incremental
+#define p4est_snapshot_size             p8est_snapshot_size
+#define p4est_snapshot_save             p8est_snapshot_save
+#define p4est_snapshot_restore          p8est_snapshot_restore
+#define p4est_inspect_start             p8est_inspect_start
+#define p4est_inspect_stop              p8est_inspect_stop
+#define p4est_inspect_comm              p8est_inspect_comm
+#define p4est_inspect_send              p8est_inspect_send
+#define p4est_inspect_peers_enable      p8est_inspect_peers_enable
+#define p4est_inspect_peers_disable     p8est_inspect_peers_disable
+#define p4est_inspect_peers_write       p8est_inspect_peers_write
+#define p4est_inspect_memory            p8est_inspect_memory
+#define p4est_inspect_alloc             p8est_inspect_alloc
+#define p4est_inspect_free              p8est_inspect_free
+#define p4est_inspect_memory_tight      p8est_inspect_memory_tight
+#define p4est_inspect_reset             p8est_inspect_reset
+#define p4est_inspect_statistics        p8est_inspect_statistics
 #define p4est_refine_ext                p8est_refine_ext
 #define p4est_coarsen_ext               p8est_coarsen_ext
 #define p4est_balance_ext               p8est_balance_ext
+#define p4est_balance_begin             p8est_balance_begin
+#define p4est_balance_end               p8est_balance_end
+#define p4est_balance_ensemble          p8est_balance_ensemble
+#define p4est_refine_balanced           p8est_refine_balanced
+#define p4est_adapt_map_new             p8est_adapt_map_new
+#define p4est_adapt_map_update          p8est_adapt_map_update
+#define p4est_adapt_map_destroy         p8est_adapt_map_destroy
+#define p4est_adapt_map_counts          p8est_adapt_map_counts
 #define p4est_balance_subtree_ext       p8est_balance_subtree_ext
 #define p4est_partition_ext             p8est_partition_ext
+#define p4est_partition_weights         p8est_partition_weights
+#define p4est_partition_weights64       p8est_partition_weights64
+#define p4est_partition_ext_data        p8est_partition_ext_data
+#define p4est_partition_begin           p8est_partition_begin
+#define p4est_partition_end             p8est_partition_end
+#define p4est_partition_ensemble        p8est_partition_ensemble
+#define p4est_partition_multi           p8est_partition_multi
+#define p4est_partition_incremental     p8est_partition_incremental
+#define p4est_partition_targets         p8est_partition_targets
+#define p4est_agglomerate_new           p8est_agglomerate_new
+#define p4est_agglomerate_expand        p8est_agglomerate_expand
 #define p4est_partition_for_coarsening  p8est_partition_for_coarsening
 #define p4est_save_ext                  p8est_save_ext
+#define p4est_save_info                 p8est_save_info
 #define p4est_load_ext                  p8est_load_ext
+#define p4est_load_info                 p8est_load_info
 #define p4est_source_ext                p8est_source_ext
 
 #ifdef P4EST_ENABLE_FILE_DEPRECATED
 
+#define p4est_file_open_create_partition \
+        p8est_file_open_create_partition
 #define p4est_file_open_read_ext        p8est_file_open_read_ext
+#define p4est_file_get_mpicomm          p8est_file_get_mpicomm
+#define p4est_file_get_global_num_quadrants \
+        p8est_file_get_global_num_quadrants
 #define p4est_file_read_field_ext       p8est_file_read_field_ext
+#define p4est_file_read_field_compressed_ext \
+        p8est_file_read_field_compressed_ext
+#define p4est_file_read_p4est_ext       p8est_file_read_p8est_ext
 
 #endif
 
 /* functions in p4est_iterate */
 #define p4est_iterate                   p8est_iterate
 #define p4est_iterate_ext               p8est_iterate_ext
+#define p4est_iterate_threads           p8est_iterate_threads
+#define p4est_iterate_face_batch        p8est_iterate_face_batch
+#define p4est_iterate_active            p8est_iterate_active
+#define p4est_iterate_levels            p8est_iterate_levels
+#define p4est_iter_plan_new             p8est_iter_plan_new
+#define p4est_iter_plan_destroy         p8est_iter_plan_destroy
+#define p4est_iter_plan_is_current      p8est_iter_plan_is_current
+#define p4est_iter_plan_replay          p8est_iter_plan_replay
+#define p4est_iter_plan_replay_blocked  p8est_iter_plan_replay_blocked
 #define p4est_iter_fside_array_index    p8est_iter_fside_array_index
 #define p4est_iter_fside_array_index_int p8est_iter_fside_array_index_int
 #define p4est_iter_cside_array_index    p8est_iter_cside_array_index
@@ -315,6 +515,10 @@
 
 /* functions in p4est_points */
 #define p4est_new_points                p8est_new_points
+#define p4est_new_points_sort           p8est_new_points_sort
+#define p4est_points_migrate_new        p8est_points_migrate_new
+#define p4est_points_migrate_destroy    p8est_points_migrate_destroy
+#define p4est_points_migrate            p8est_points_migrate
 
 /* functions in p4est_bits */
 #define p4est_quadrant_pad              p8est_quadrant_pad
@@ -391,9 +595,22 @@
 #define p4est_quadrant_transform_corner p8est_quadrant_transform_corner
 #define p4est_quadrant_shift_corner     p8est_quadrant_shift_corner
 #define p4est_quadrant_linear_id        p8est_quadrant_linear_id
+#define p4est_quadrant_compare_batch    p8est_quadrant_compare_batch
+#define p4est_quadrant_is_ancestor_batch        \
+        p8est_quadrant_is_ancestor_batch
+#define p4est_quadrant_overlaps_batch   p8est_quadrant_overlaps_batch
+#define p4est_quadrant_linear_id_batch  p8est_quadrant_linear_id_batch
+#define p4est_quadrant_set_morton_batch p8est_quadrant_set_morton_batch
 #define p4est_quadrant_set_morton       p8est_quadrant_set_morton
 #define p4est_quadrant_successor        p8est_quadrant_successor
 #define p4est_quadrant_predecessor      p8est_quadrant_predecessor
+#define p4est_quadrant_hilbert_id       p8est_quadrant_hilbert_id
+#define p4est_quadrant_set_hilbert      p8est_quadrant_set_hilbert
+#define p4est_quadrant_compare_hilbert  p8est_quadrant_compare_hilbert
+#define p4est_quadrant_hilbert_successor        \
+        p8est_quadrant_hilbert_successor
+#define p4est_quadrant_hilbert_predecessor      \
+        p8est_quadrant_hilbert_predecessor
 #define p4est_quadrant_srand            p8est_quadrant_srand
 #define p4est_neighbor_transform_quadrant       \
         p8est_neighbor_transform_quadrant
@@ -404,39 +621,95 @@
 #define p4est_quadrant_is_ancestor_corner        \
         p8est_quadrant_is_ancestor_corner
 
+/* functions in p4est_bits_inline */
+#define p4est_linear_id_spread          p8est_linear_id_spread
+#define p4est_linear_id_squeeze         p8est_linear_id_squeeze
+#define p4est_coordinates_compare_inline \
+        p8est_coordinates_compare_inline
+#define p4est_quadrant_compare_inline   p8est_quadrant_compare_inline
+#define p4est_quadrant_is_equal_inline  p8est_quadrant_is_equal_inline
+#define p4est_quadrant_overlaps_inline  p8est_quadrant_overlaps_inline
+#define p4est_quadrant_ancestor_id_inline \
+        p8est_quadrant_ancestor_id_inline
+#define p4est_quadrant_child_id_inline  p8est_quadrant_child_id_inline
+#define p4est_quadrant_is_inside_root_inline \
+        p8est_quadrant_is_inside_root_inline
+#define p4est_quadrant_is_parent_inline p8est_quadrant_is_parent_inline
+#define p4est_quadrant_is_ancestor_inline \
+        p8est_quadrant_is_ancestor_inline
+#define p4est_quadrant_parent_inline    p8est_quadrant_parent_inline
+#define p4est_quadrant_sibling_inline   p8est_quadrant_sibling_inline
+#define p4est_quadrant_child_inline     p8est_quadrant_child_inline
+#define p4est_quadrant_face_neighbor_inline \
+        p8est_quadrant_face_neighbor_inline
+#define p4est_quadrant_first_descendant_inline \
+        p8est_quadrant_first_descendant_inline
+#define p4est_quadrant_last_descendant_inline \
+        p8est_quadrant_last_descendant_inline
+#define p4est_quadrant_linear_id_inline p8est_quadrant_linear_id_inline
+#define p4est_quadrant_set_morton_inline \
+        p8est_quadrant_set_morton_inline
+
 /* functions in p4est_search */
 #define p4est_find_partition            p8est_find_partition
 #define p4est_find_lower_bound          p8est_find_lower_bound
 #define p4est_find_higher_bound         p8est_find_higher_bound
 #define p4est_find_quadrant_cumulative  p8est_find_quadrant_cumulative
+#define p4est_find_quadrant_cumulative_batch \
+        p8est_find_quadrant_cumulative_batch
 #define p4est_split_array               p8est_split_array
 #define p4est_find_range_boundaries     p8est_find_range_boundaries
 #define p4est_search                    p8est_search
 #define p4est_search_local              p8est_search_local
+#define p4est_search_local_threads      p8est_search_local_threads
+#define p4est_search_local_batch        p8est_search_local_batch
+#define p4est_search_ghost              p8est_search_ghost
 #define p4est_search_reorder            p8est_search_reorder
+#define p4est_search_reorder_ext        p8est_search_reorder_ext
 #define p4est_search_partition          p8est_search_partition
 #define p4est_search_partition_gfx      p8est_search_partition_gfx
 #define p4est_search_partition_gfp      p8est_search_partition_gfp
 #define p4est_search_all                p8est_search_all
+#define p4est_search_all_threads        p8est_search_all_threads
+#define p4est_search_all_batch          p8est_search_all_batch
+#define p4est_search_index_new          p8est_search_index_new
+#define p4est_search_index_destroy      p8est_search_index_destroy
+#define p4est_search_index_is_valid     p8est_search_index_is_valid
+#define p4est_search_index_memory_used  p8est_search_index_memory_used
+#define p4est_search_partition_index    p8est_search_partition_index
+#define p4est_search_all_index          p8est_search_all_index
+#define p4est_search_nearest            p8est_search_nearest
+#define p4est_search_rays               p8est_search_rays
 #define p4est_build_new                 p8est_build_new
 #define p4est_build_init_add            p8est_build_init_add
 #define p4est_build_add                 p8est_build_add
 #define p4est_build_complete            p8est_build_complete
+#define p4est_build_stream_new          p8est_build_stream_new
+#define p4est_build_stream_add          p8est_build_stream_add
+#define p4est_build_stream_complete     p8est_build_stream_complete
 
 /* functions in p4est_algorithms */
 #define p4est_quadrant_mempool_new      p8est_quadrant_mempool_new
 #define p4est_quadrant_init_data        p8est_quadrant_init_data
 #define p4est_quadrant_free_data        p8est_quadrant_free_data
+#define p4est_quadrant_data_count       p8est_quadrant_data_count
+#define p4est_quadrant_data_cache_prepare       \
+        p8est_quadrant_data_cache_prepare
+#define p4est_quadrant_data_cache_flush p8est_quadrant_data_cache_flush
+#define p4est_compact_data              p8est_compact_data
+#define p4est_replace_quadrants         p8est_replace_quadrants
 #define p4est_quadrant_checksum         p8est_quadrant_checksum
 #define p4est_quadrant_in_range         p8est_quadrant_in_range
 #define p4est_tree_is_sorted            p8est_tree_is_sorted
 #define p4est_tree_is_linear            p8est_tree_is_linear
+#define p4est_tree_hilbert_order        p8est_tree_hilbert_order
 #define p4est_tree_is_almost_sorted     p8est_tree_is_almost_sorted
 #define p4est_tree_is_complete          p8est_tree_is_complete
 #define p4est_tree_print                p8est_tree_print
 #define p4est_is_equal                  p8est_is_equal
 #define p4est_quadrant_copy             p8est_quadrant_copy
 #define p4est_is_valid                  p8est_is_valid
+#define p4est_is_valid_ext              p8est_is_valid_ext
 #define p4est_tree_compute_overlap      p8est_tree_compute_overlap
 #define p4est_tree_uniqify_overlap      p8est_tree_uniqify_overlap
 #define p4est_tree_remove_nonowned      p8est_tree_remove_nonowned
@@ -460,6 +733,8 @@
 #define p4est_comm_parallel_env_is_null p8est_comm_parallel_env_is_null
 #define p4est_comm_parallel_env_reduce  p8est_comm_parallel_env_reduce
 #define p4est_comm_parallel_env_reduce_ext p8est_comm_parallel_env_reduce_ext
+#define p4est_comm_node_order           p8est_comm_node_order
+#define p4est_comm_parallel_env_node_order p8est_comm_parallel_env_node_order
 #define p4est_comm_count_quadrants      p8est_comm_count_quadrants
 #define p4est_comm_global_partition     p8est_comm_global_partition
 #define p4est_comm_global_first_quadrant p8est_comm_global_first_quadrant
@@ -471,10 +746,16 @@
 #define p4est_comm_is_owner             p8est_comm_is_owner
 #define p4est_comm_is_owner_gfp         p8est_comm_is_owner_gfp
 #define p4est_comm_find_owner           p8est_comm_find_owner
+#define p4est_comm_find_owners          p8est_comm_find_owners
+#define p4est_comm_sparse_new           p8est_comm_sparse_new
+#define p4est_comm_sparse_destroy       p8est_comm_sparse_destroy
+#define p4est_comm_sparse_find_owners   p8est_comm_sparse_find_owners
 #define p4est_comm_tree_info            p8est_comm_tree_info
 #define p4est_comm_neighborhood_owned   p8est_comm_neighborhood_owned
 #define p4est_comm_sync_flag            p8est_comm_sync_flag
 #define p4est_comm_checksum             p8est_comm_checksum
+#define p4est_comm_checksum_crc32c      p8est_comm_checksum_crc32c
+#define p4est_comm_notify_nodes         p8est_comm_notify_nodes
 #define p4est_transfer_fixed            p8est_transfer_fixed
 #define p4est_bsearch_partition         p8est_bsearch_partition
 #define p4est_transfer_fixed_begin      p8est_transfer_fixed_begin
@@ -482,9 +763,26 @@
 #define p4est_transfer_custom           p8est_transfer_custom
 #define p4est_transfer_custom_begin     p8est_transfer_custom_begin
 #define p4est_transfer_custom_end       p8est_transfer_custom_end
+#define p4est_transfer_custom_compressed \
+        p8est_transfer_custom_compressed
+#define p4est_transfer_custom_compressed_begin \
+        p8est_transfer_custom_compressed_begin
+#define p4est_transfer_custom_ext       p8est_transfer_custom_ext
+#define p4est_transfer_custom_ext_begin p8est_transfer_custom_ext_begin
 #define p4est_transfer_items            p8est_transfer_items
 #define p4est_transfer_items_begin      p8est_transfer_items_begin
 #define p4est_transfer_items_end        p8est_transfer_items_end
+#define p4est_transfer_iovec_begin      p8est_transfer_iovec_begin
+#define p4est_transfer_iovec_end        p8est_transfer_iovec_end
+#define p4est_transfer_plan_new         p8est_transfer_plan_new
+#define p4est_transfer_plan_destroy     p8est_transfer_plan_destroy
+#define p4est_transfer_plan_is_valid    p8est_transfer_plan_is_valid
+#define p4est_transfer_plan_add_fixed   p8est_transfer_plan_add_fixed
+#define p4est_transfer_plan_add_custom  p8est_transfer_plan_add_custom
+#define p4est_transfer_plan_clear       p8est_transfer_plan_clear
+#define p4est_transfer_plan_execute     p8est_transfer_plan_execute
+#define p4est_transfer_plan_begin       p8est_transfer_plan_begin
+#define p4est_transfer_plan_end         p8est_transfer_plan_end
 #define p4est_transfer_end              p8est_transfer_end
 
 /* functions in p4est_io */
@@ -495,48 +793,101 @@
 #ifdef P4EST_ENABLE_FILE_DEPRECATED
 
 #define p4est_file_open_create          p8est_file_open_create
+#define p4est_file_open_create_ext      p8est_file_open_create_ext
 #define p4est_file_open_append          p8est_file_open_append
 #define p4est_file_open_read            p8est_file_open_read
 #define p4est_file_write_block          p8est_file_write_block
 #define p4est_file_read_block           p8est_file_read_block
 #define p4est_file_write_field          p8est_file_write_field
 #define p4est_file_read_field           p8est_file_read_field
+#define p4est_file_write_field_compressed p8est_file_write_field_compressed
+#define p4est_file_read_field_compressed p8est_file_read_field_compressed
 #define p4est_file_info                 p8est_file_info
 #define p4est_file_error_string         p8est_file_error_string
 #define p4est_file_write_p4est          p8est_file_write_p8est
 #define p4est_file_read_p4est           p8est_file_read_p8est
+#define p4est_file_write_p4est_compact  p8est_file_write_p8est_compact
+#define p4est_file_read_p4est_compact   p8est_file_read_p8est_compact
+#define p4est_file_read_weights         p8est_file_read_weights
 #define p4est_file_write_connectivity   p8est_file_write_connectivity
 #define p4est_file_read_connectivity    p8est_file_read_connectivity
 #define p4est_file_close                p8est_file_close
+#define p4est_file_async_new            p8est_file_async_new
+#define p4est_file_async_write_field    p8est_file_async_write_field
+#define p4est_file_async_write_p4est    p8est_file_async_write_p8est
+#define p4est_file_async_test           p8est_file_async_test
+#define p4est_file_async_staged         p8est_file_async_staged
+#define p4est_file_async_wait           p8est_file_async_wait
+#define p4est_file_delta_new            p8est_file_delta_new
+#define p4est_file_delta_destroy        p8est_file_delta_destroy
+#define p4est_file_delta_write_p4est    p8est_file_delta_write_p8est
+#define p4est_file_delta_write_field    p8est_file_delta_write_field
+#define p4est_file_delta_read_p4est     p8est_file_delta_read_p8est
+#define p4est_file_delta_read_field     p8est_file_delta_read_field
+#define p4est_file_map_open             p8est_file_map_open
+#define p4est_file_map_close            p8est_file_map_close
+#define p4est_file_map_global_num_quadrants \
+        p8est_file_map_global_num_quadrants
+#define p4est_file_map_num_sections     p8est_file_map_num_sections
+#define p4est_file_map_section          p8est_file_map_section
+#define p4est_file_map_block            p8est_file_map_block
+#define p4est_file_map_field            p8est_file_map_field
+#define p4est_file_map_scan             p8est_file_map_scan
 
 #endif /* P4EST_ENABLE_FILE_DEPRECATED */
 
 /* functions in p4est_geometry */
 #define p4est_geometry_destroy          p8est_geometry_destroy
 #define p4est_geometry_new_connectivity p8est_geometry_new_connectivity
+#define p4est_geometry_X_batch          p8est_geometry_X_batch
+#define p4est_geometry_J                p8est_geometry_J
 #define p4est_geometry_connectivity_X   p8est_geometry_connectivity_X
+#define p4est_geometry_connectivity_X_batch \
+        p8est_geometry_connectivity_X_batch
+#define p4est_geometry_cache_new        p8est_geometry_cache_new
+#define p4est_geometry_cache_destroy    p8est_geometry_cache_destroy
+#define p4est_geometry_cache_X_batch    p8est_geometry_cache_X_batch
+#define p4est_geometry_cache_J          p8est_geometry_cache_J
 
 /* functions in p4est_vtk */
 #define p4est_vtk_context_new           p8est_vtk_context_new
+#define p4est_vtk_context_new_mesh      p8est_vtk_context_new_mesh
 #define p4est_vtk_context_destroy       p8est_vtk_context_destroy
 #define p4est_vtk_context_set_geom      p8est_vtk_context_set_geom
 #define p4est_vtk_context_set_scale     p8est_vtk_context_set_scale
 #define p4est_vtk_context_set_continuous p8est_vtk_context_set_continuous
+#define p4est_vtk_context_set_single_file p8est_vtk_context_set_single_file
+#define p4est_vtk_context_set_lnodes p8est_vtk_context_set_lnodes
+#define p4est_vtk_context_set_max_level p8est_vtk_context_set_max_level
+#define p4est_vtk_mesh_new              p8est_vtk_mesh_new
+#define p4est_vtk_mesh_destroy          p8est_vtk_mesh_destroy
+#define p4est_vtk_context_set_compression_level \
+        p8est_vtk_context_set_compression_level
 #define p4est_vtk_write_file            p8est_vtk_write_file
 #define p4est_vtk_write_header          p8est_vtk_write_header
+#define p4est_vtk_write_header_mesh     p8est_vtk_write_header_mesh
 #define p4est_vtk_write_header_ho       p8est_vtk_write_header_ho
+#define p4est_vtk_write_header_ho_fn    p8est_vtk_write_header_ho_fn
 #define p4est_vtk_write_cell_dataf      p8est_vtk_write_cell_dataf
 #define p4est_vtk_write_cell_datav      p8est_vtk_write_cell_datav
 #define p4est_vtk_write_cell_data       p8est_vtk_write_cell_data
 #define p4est_vtk_write_point_dataf     p8est_vtk_write_point_dataf
 #define p4est_vtk_write_point_data      p8est_vtk_write_point_data
 #define p4est_vtk_write_footer          p8est_vtk_write_footer
+#define p4est_vtk_hdf5_open             p8est_vtk_hdf5_open
+#define p4est_vtk_hdf5_write_cell_data  p8est_vtk_hdf5_write_cell_data
+#define p4est_vtk_hdf5_write_point_data p8est_vtk_hdf5_write_point_data
+#define p4est_vtk_hdf5_close            p8est_vtk_hdf5_close
 
 /* functions in p4est_ghost */
 #define p4est_quadrant_find_owner       p8est_quadrant_find_owner
 #define p4est_ghost_memory_used         p8est_ghost_memory_used
 #define p4est_ghost_new                 p8est_ghost_new
+#define p4est_ghost_new_begin           p8est_ghost_new_begin
+#define p4est_ghost_new_end             p8est_ghost_new_end
+#define p4est_ghost_new_ensemble        p8est_ghost_new_ensemble
 #define p4est_ghost_new_local           p8est_ghost_new_local
+#define p4est_ghost_new_selective       p8est_ghost_new_selective
 #define p4est_ghost_destroy             p8est_ghost_destroy
 #define p4est_ghost_exchange_data       p8est_ghost_exchange_data
 #define p4est_ghost_exchange_data_begin p8est_ghost_exchange_data_begin
@@ -544,11 +895,18 @@
 #define p4est_ghost_exchange_custom     p8est_ghost_exchange_custom
 #define p4est_ghost_exchange_custom_begin p8est_ghost_exchange_custom_begin
 #define p4est_ghost_exchange_custom_end p8est_ghost_exchange_custom_end
+#define p4est_ghost_exchange_packed     p8est_ghost_exchange_packed
+#define p4est_ghost_exchange_packed_begin \
+        p8est_ghost_exchange_packed_begin
 #define p4est_ghost_exchange_custom_levels p8est_ghost_exchange_custom_levels
 #define p4est_ghost_exchange_custom_levels_begin        \
         p8est_ghost_exchange_custom_levels_begin
 #define p4est_ghost_exchange_custom_levels_end  \
         p8est_ghost_exchange_custom_levels_end
+#define p4est_ghost_exchange_fields     p8est_ghost_exchange_fields
+#define p4est_ghost_exchange_fields_begin \
+        p8est_ghost_exchange_fields_begin
+#define p4est_ghost_exchange_fields_end p8est_ghost_exchange_fields_end
 #define p4est_ghost_bsearch             p8est_ghost_bsearch
 #define p4est_ghost_contains            p8est_ghost_contains
 #define p4est_ghost_is_valid            p8est_ghost_is_valid
@@ -557,6 +915,27 @@
 #define p4est_is_balanced               p8est_is_balanced
 #define p4est_ghost_checksum            p8est_ghost_checksum
 #define p4est_ghost_expand              p8est_ghost_expand
+#define p4est_ghost_new_layers          p8est_ghost_new_layers
+#define p4est_ghost_set_neighborhood    p8est_ghost_set_neighborhood
+#define p4est_ghost_update              p8est_ghost_update
+#define p4est_ghost_set_index           p8est_ghost_set_index
+#define p4est_ghost_set_compact         p8est_ghost_set_compact
+#define p4est_ghost_compact_ghost       p8est_ghost_compact_ghost
+#define p4est_ghost_compact_mirror      p8est_ghost_compact_mirror
+#define p4est_ghost_compact_proc_mirrors p8est_ghost_compact_proc_mirrors
+#define p4est_ghost_plan_new            p8est_ghost_plan_new
+#define p4est_ghost_plan_new_levels     p8est_ghost_plan_new_levels
+#define p4est_ghost_plan_destroy        p8est_ghost_plan_destroy
+#define p4est_ghost_plan_is_valid       p8est_ghost_plan_is_valid
+#define p4est_ghost_plan_begin          p8est_ghost_plan_begin
+#define p4est_ghost_plan_end            p8est_ghost_plan_end
+#define p4est_ghost_plan_exchange       p8est_ghost_plan_exchange
+#define p4est_ghost_types_new           p8est_ghost_types_new
+#define p4est_ghost_types_destroy       p8est_ghost_types_destroy
+#define p4est_ghost_types_is_valid      p8est_ghost_types_is_valid
+#define p4est_ghost_types_begin         p8est_ghost_types_begin
+#define p4est_ghost_types_end           p8est_ghost_types_end
+#define p4est_ghost_types_exchange      p8est_ghost_types_exchange
 
 /* functions in p4est_nodes */
 #define p4est_nodes_new                 p8est_nodes_new
@@ -565,11 +944,25 @@
 
 /* functions in p4est_lnodes */
 #define p4est_lnodes_new                p8est_lnodes_new
+#define p4est_lnodes_new_ext            p8est_lnodes_new_ext
+#define p4est_lnodes_global_owned_count p8est_lnodes_global_owned_count
 #define p4est_lnodes_destroy            p8est_lnodes_destroy
+#define p4est_lnodes_reorder            p8est_lnodes_reorder
+#define p4est_lnodes_export_new         p8est_lnodes_export_new
+#define p4est_lnodes_export_destroy     p8est_lnodes_export_destroy
+#define p4est_lnodes_hanging_new        p8est_lnodes_hanging_new
+#define p4est_lnodes_hanging_destroy    p8est_lnodes_hanging_destroy
+#define p4est_lnodes_hanging_interpolate \
+        p8est_lnodes_hanging_interpolate
+#define p4est_lnodes_hanging_restrict   p8est_lnodes_hanging_restrict
+#define p4est_lnodes_hanging_gather     p8est_lnodes_hanging_gather
+#define p4est_lnodes_hanging_scatter    p8est_lnodes_hanging_scatter
+#define p4est_lnodes_code_groups        p8est_lnodes_code_groups
 #define p4est_ghost_support_lnodes      p8est_ghost_support_lnodes
 #define p4est_ghost_expand_by_lnodes    p8est_ghost_expand_by_lnodes
 #define p4est_partition_lnodes          p8est_partition_lnodes
 #define p4est_partition_lnodes_detailed p8est_partition_lnodes_detailed
+#define p4est_partition_lnodes_ext      p8est_partition_lnodes_ext
 #define p4est_lnodes_decode             p8est_lnodes_decode
 #define p4est_lnodes_share_owned_begin  p8est_lnodes_share_owned_begin
 #define p4est_lnodes_share_owned_end    p8est_lnodes_share_owned_end
@@ -578,6 +971,10 @@
 #define p4est_lnodes_share_all_end      p8est_lnodes_share_all_end
 #define p4est_lnodes_share_all          p8est_lnodes_share_all
 #define p4est_lnodes_buffer_destroy     p8est_lnodes_buffer_destroy
+#define p4est_lnodes_plan_new           p8est_lnodes_plan_new
+#define p4est_lnodes_plan_destroy       p8est_lnodes_plan_destroy
+#define p4est_lnodes_plan_share_owned   p8est_lnodes_plan_share_owned
+#define p4est_lnodes_plan_add_reduce    p8est_lnodes_plan_add_reduce
 #define p4est_lnodes_rank_array_index   p8est_lnodes_rank_array_index
 #define p4est_lnodes_rank_array_index_int       \
         p8est_lnodes_rank_array_index_int
@@ -587,6 +984,10 @@
 #define p4est_mesh_memory_used          p8est_mesh_memory_used
 #define p4est_mesh_new                  p8est_mesh_new
 #define p4est_mesh_destroy              p8est_mesh_destroy
+#define p4est_mesh_history_new          p8est_mesh_history_new
+#define p4est_mesh_history_destroy      p8est_mesh_history_destroy
+#define p4est_mesh_history_add          p8est_mesh_history_add
+#define p4est_mesh_update               p8est_mesh_update
 #define p4est_mesh_get_quadrant         p8est_mesh_get_quadrant
 #define p4est_mesh_get_neighbors        p8est_mesh_get_neighbors
 #define p4est_mesh_quadrant_cumulative  p8est_mesh_quadrant_cumulative
@@ -594,11 +995,70 @@
 #define p4est_mesh_face_neighbor_init2  p8est_mesh_face_neighbor_init2
 #define p4est_mesh_face_neighbor_next   p8est_mesh_face_neighbor_next
 #define p4est_mesh_face_neighbor_data   p8est_mesh_face_neighbor_data
+#define p4est_mesh_face_neighbors       p8est_mesh_face_neighbors
+
+/* functions in p4est_soa */
+#define p4est_soa_new                   p8est_soa_new
+#define p4est_soa_destroy               p8est_soa_destroy
+#define p4est_soa_update                p8est_soa_update
+#define p4est_soa_is_current            p8est_soa_is_current
+#define p4est_soa_get_quadrant          p8est_soa_get_quadrant
+#define p4est_soa_find_lower_bound      p8est_soa_find_lower_bound
+#define p4est_soa_find_higher_bound     p8est_soa_find_higher_bound
+#define p4est_soa_tree_offset           p8est_soa_tree_offset
+#define p4est_soa_device_new            p8est_soa_device_new
+#define p4est_soa_device_destroy        p8est_soa_device_destroy
+#define p4est_soa_device_update         p8est_soa_device_update
+#define p4est_soa_device_view           p8est_soa_device_view
+#define p4est_soa_view_quadrant_len     p8est_soa_view_quadrant_len
+#define p4est_soa_view_linear_id        p8est_soa_view_linear_id
+#define p4est_soa_view_face_neighbor    p8est_soa_view_face_neighbor
+#define p4est_soa_view_half_neighbors   p8est_soa_view_half_neighbors
+#define p4est_soa_view_element_node     p8est_soa_view_element_node
+
+/* functions in p4est_taskgraph */
+#define p4est_taskgraph_new             p8est_taskgraph_new
+#define p4est_taskgraph_destroy         p8est_taskgraph_destroy
+#define p4est_taskgraph_block           p8est_taskgraph_block
+
+/* functions in p4est_compact */
+#define p4est_compact_new               p8est_compact_new
+#define p4est_compact_destroy           p8est_compact_destroy
+#define p4est_compact_memory_used       p8est_compact_memory_used
+#define p4est_compact_key               p8est_compact_key
+#define p4est_compact_get_quadrant      p8est_compact_get_quadrant
+#define p4est_compact_find_higher_bound p8est_compact_find_higher_bound
+#define p4est_compact_expand            p8est_compact_expand
+
+/* functions in p4est_hierarchy */
+#define p4est_hierarchy_new             p8est_hierarchy_new
+#define p4est_hierarchy_destroy         p8est_hierarchy_destroy
+#define p4est_hierarchy_transfer        p8est_hierarchy_transfer
+
+/* functions in p4est_remap */
+#define p4est_remap_new                 p8est_remap_new
+#define p4est_remap_destroy             p8est_remap_destroy
+#define p4est_remap_gather              p8est_remap_gather
+
+/* functions in p4est_objects */
+#define p4est_objects_refine            p8est_objects_refine
+#define p4est_objects_destroy           p8est_objects_destroy
+
+/* functions in p4est_spill */
+#define p4est_spill_new                 p8est_spill_new
+#define p4est_spill_destroy             p8est_spill_destroy
+#define p4est_spill_out                 p8est_spill_out
+#define p4est_spill_in                  p8est_spill_in
+#define p4est_spill_prefetch            p8est_spill_prefetch
+#define p4est_spill_is_out              p8est_spill_is_out
 
 /* functions in p4est_balance */
 #define p4est_balance_seeds_face        p8est_balance_seeds_face
 #define p4est_balance_seeds_corner      p8est_balance_seeds_corner
 #define p4est_balance_seeds             p8est_balance_seeds
+#define p4est_balance_seeds_face_batch  p8est_balance_seeds_face_batch
+#define p4est_balance_seeds_corner_batch \
+        p8est_balance_seeds_corner_batch
 
 /* functions in p4est_wrap */
 #define p4est_wrap_params_init          p8est_wrap_params_init
@@ -618,10 +1078,18 @@
 #define p4est_wrap_get_mesh             p8est_wrap_get_mesh
 #define p4est_wrap_mark_refine          p8est_wrap_mark_refine
 #define p4est_wrap_mark_coarsen         p8est_wrap_mark_coarsen
+#define p4est_wrap_mark_array           p8est_wrap_mark_array
+#define p4est_wrap_mark_bitset          p8est_wrap_mark_bitset
+#define p4est_wrap_mark_threshold       p8est_wrap_mark_threshold
 #define p4est_wrap_adapt                p8est_wrap_adapt
 #define p4est_wrap_partition            p8est_wrap_partition
+#define p4est_wrap_adapt_partition      p8est_wrap_adapt_partition
+#define p4est_wrap_partition_predict    p8est_wrap_partition_predict
 #define p4est_wrap_complete             p8est_wrap_complete
+#define p4est_wrap_monitor_add          p8est_wrap_monitor_add
+#define p4est_wrap_monitor_check        p8est_wrap_monitor_check
 #define p4est_wrap_leaf_next            p8est_wrap_leaf_next
+#define p4est_wrap_leaf_batch           p8est_wrap_leaf_batch
 #define p4est_wrap_leaf_first           p8est_wrap_leaf_first
 
 /* functions in p4est_plex */
@@ -630,5 +1098,7 @@
 
 /* functions in p4est_connrefine */
 #define p4est_connectivity_refine       p8est_connectivity_refine
+#define p4est_connectivity_refine_parallel      \
+        p8est_connectivity_refine_parallel
 
 #endif /* !P4EST_TO_P8EST_H */
@@ -40,20 +40,33 @@
  */
 
 #ifdef P4_TO_P8
+#include <p8est_bits.h>
 #include <p8est_vtk.h>
-#include <p8est_nodes.h>
+#include <p8est_lnodes.h>
 #define P4EST_VTK_CELL_TYPE     11      /* VTK_VOXEL */
 #define P4EST_VTK_CELL_TYPE_HO  72      /* VTK_LAGRANGE_HEXAHEDRON */
 #else
+#include <p4est_bits.h>
 #include <p4est_vtk.h>
-#include <p4est_nodes.h>
+#include <p4est_lnodes.h>
 #define P4EST_VTK_CELL_TYPE      8      /* VTK_PIXEL */
 #define P4EST_VTK_CELL_TYPE_HO  70      /* VTK_LAGRANGE_QUADRILATERAL */
 #endif /* !P4_TO_P8 */
+#if defined P4EST_ENABLE_VTK_COMPRESSION && defined P4EST_HAVE_ZLIB
+#include <zlib.h>
+#define P4EST_VTK_ZLIB 1
+#endif
+#ifdef P4EST_ENABLE_OPENMP
+#include <omp.h>
+#endif
+#ifdef P4EST_WITH_HDF5
+#include <hdf5.h>
+#endif
 
 /* default parameters for the vtk context */
 static const double p4est_vtk_scale = 0.95;
 static const int    p4est_vtk_continuous = 0;
+static const int    p4est_vtk_compression_level = -1;
 
 /* default parameters for p4est_vtk_write_file */
 static const int    p4est_vtk_write_tree = 1;
@@ -139,6 +152,7 @@ static
 
 #ifdef P4_TO_P8
 #define p4est_vtk_context               p8est_vtk_context
+#define p4est_vtk_hdf5                  p8est_vtk_hdf5
 #endif
 
 #ifndef P4EST_ENABLE_VTK_DOUBLES
@@ -154,18 +168,9 @@ static
 #define P4EST_VTK_FORMAT_STRING "ascii"
 #else
 #define P4EST_VTK_FORMAT_STRING "binary"
-
-static int
-p4est_vtk_write_binary (FILE * vtkfile, char *numeric_data,
-                        size_t byte_length)
-{
-#ifndef P4EST_ENABLE_VTK_COMPRESSION
-  return sc_vtk_write_binary (vtkfile, numeric_data, byte_length);
-#else
-  return sc_vtk_write_compressed (vtkfile, numeric_data, byte_length);
-#endif /* P4EST_ENABLE_VTK_COMPRESSION */
-}
-
+#if !defined P4EST_ENABLE_VTK_COMPRESSION || defined P4EST_VTK_ZLIB
+#define P4EST_VTK_STREAM 1
+#endif
 #endif /* P4EST_ENABLE_VTK_BINARY */
 
 /** Opaque context type for writing VTK output with multiple function calls.
@@ -176,7 +181,11 @@ p4est_vtk_write_binary (FILE * vtkfile, char *numeric_data,
  * destroyed by \b p4est_vtk_write_footer; it can also be destroyed manually
  * using the \b p4est_vtk_context_destroy function if necessary.
  *
- * The \a p4est member is a pointer to the local p4est.
+ * The \a p4est member is a pointer to the local p4est.  It is NULL for a
+ * context created by \ref p4est_vtk_context_new_mesh, whose points and
+ * cells are passed in by \ref p4est_vtk_write_header_mesh.
+ * The \a mpicomm, \a mpirank and \a mpisize members are those of the
+ * forest or the communicator given.
  * The \a geom member is a pointer to the geometry used to create the p4est.
  * The \a num_points member holds the number of nodes present in the vtk output;
  * this is determined in \ref p4est_vtk_write_header using the \a scale parameter
@@ -187,6 +196,11 @@ p4est_vtk_write_binary (FILE * vtkfile, char *numeric_data,
  * The \a vtufile, \a pvtufile, and \a visitfile members are the vtk file
  * pointers; opened by \ref p4est_vtk_write_header and closed by \b
  * p4est_vtk_write_footer.
+ * With \a single_file, \a vtufile is a scratch file holding this process'
+ * piece, which the footer copies into the common file with MPI I/O.
+ * With a nonnegative \a max_level, the \a cells written are the ancestors
+ * of the leaves at that level, and \a cell_first holds the index of the
+ * first local leaf of each cell, followed by the number of local leaves.
  *
  */
 struct p4est_vtk_context
@@ -194,18 +208,28 @@ struct p4est_vtk_context
   /* data passed initially */
   p4est_t            *p4est;       /**< The p4est structure must be alive. */
   char               *filename;    /**< Original filename provided is copied. */
+  sc_MPI_Comm         mpicomm;     /**< Communicator of the output. */
+  int                 mpirank;     /**< Rank of this process. */
+  int                 mpisize;     /**< Number of processes. */
 
   /* parameters that can optionally be set in a context */
   p4est_geometry_t   *geom;        /**< The geometry may be NULL. */
   double              scale;       /**< Parameter to shrink quadrants. */
   int                 continuous;  /**< Assume continuous point data? */
+  int                 single_file; /**< Collect all pieces into one file? */
+  int                 level;       /**< Compression level for zlib. */
+  p4est_lnodes_t     *lnodes;      /**< Degree one node numbering or NULL. */
+  int                 max_level;   /**< Truncate the output at this level. */
+  p4est_vtk_reduce_t  reduce;      /**< Reduce cell data over descendants. */
 
   /* internal context data */
   int                 writing;     /**< True after p4est_vtk_write_header. */
+  p4est_locidx_t      num_cells;   /**< Number of VTK cells written. */
+  sc_array_t         *cells;       /**< Truncated cells or NULL. */
+  sc_array_t         *cell_first;  /**< First leaf of each truncated cell. */
   p4est_locidx_t      num_corners; /**< Number of local element corners. */
   p4est_locidx_t      num_points;  /**< Number of VTK points written. */
   p4est_locidx_t     *node_to_corner;     /**< Map a node to an element corner. */
-  p4est_nodes_t      *nodes;       /**< NULL? depending on scale/continuous. */
   char                vtufilename[BUFSIZ];   /**< Each process writes one. */
   char                pvtufilename[BUFSIZ];  /**< Only root writes this one. */
   char                visitfilename[BUFSIZ]; /**< Only root writes this one. */
@@ -227,9 +251,42 @@ p4est_vtk_context_new (p4est_t * p4est, const char *filename)
 
   cont->p4est = p4est;
   cont->filename = P4EST_STRDUP (filename);
+  cont->mpicomm = p4est->mpicomm;
+  cont->mpirank = p4est->mpirank;
+  cont->mpisize = p4est->mpisize;
+
+  cont->scale = p4est_vtk_scale;
+  cont->continuous = p4est_vtk_continuous;
+  cont->level = p4est_vtk_compression_level;
+  cont->max_level = -1;
+  cont->reduce = P4EST_VTK_REDUCE_MEAN;
+
+  return cont;
+}
+
+p4est_vtk_context_t *
+p4est_vtk_context_new_mesh (sc_MPI_Comm mpicomm, const char *filename)
+{
+  int                 mpiret;
+  p4est_vtk_context_t *cont;
+
+  P4EST_ASSERT (filename != NULL);
+
+  /* a context without forest only takes its parameters from the defaults */
+  cont = P4EST_ALLOC_ZERO (p4est_vtk_context_t, 1);
+
+  cont->filename = P4EST_STRDUP (filename);
+  cont->mpicomm = mpicomm;
+  mpiret = sc_MPI_Comm_rank (mpicomm, &cont->mpirank);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Comm_size (mpicomm, &cont->mpisize);
+  SC_CHECK_MPI (mpiret);
 
   cont->scale = p4est_vtk_scale;
   cont->continuous = p4est_vtk_continuous;
+  cont->level = p4est_vtk_compression_level;
+  cont->max_level = -1;
+  cont->reduce = P4EST_VTK_REDUCE_MEAN;
 
   return cont;
 }
@@ -263,11 +320,486 @@ p4est_vtk_context_set_continuous (p4est_vtk_context_t * cont, int continuous)
   cont->continuous = continuous;
 }
 
+void
+p4est_vtk_context_set_single_file (p4est_vtk_context_t * cont,
+                                   int single_file)
+{
+  P4EST_ASSERT (cont != NULL);
+  P4EST_ASSERT (!cont->writing);
+
+  cont->single_file = single_file;
+}
+
+void
+p4est_vtk_context_set_compression_level (p4est_vtk_context_t * cont,
+                                         int level)
+{
+  P4EST_ASSERT (cont != NULL);
+  P4EST_ASSERT (!cont->writing);
+  P4EST_ASSERT (-1 <= level && level <= 9);
+
+  cont->level = level;
+}
+
+void
+p4est_vtk_context_set_lnodes (p4est_vtk_context_t * cont,
+                              p4est_lnodes_t * lnodes)
+{
+  P4EST_ASSERT (cont != NULL);
+  P4EST_ASSERT (!cont->writing);
+  P4EST_ASSERT (lnodes == NULL || lnodes->degree == 1);
+
+  cont->lnodes = lnodes;
+}
+
+void
+p4est_vtk_context_set_max_level (p4est_vtk_context_t * cont,
+                                 int max_level, p4est_vtk_reduce_t reduce)
+{
+  P4EST_ASSERT (cont != NULL);
+  P4EST_ASSERT (!cont->writing);
+  P4EST_ASSERT (-1 <= max_level && max_level <= P4EST_QMAXLEVEL);
+  P4EST_ASSERT (reduce == P4EST_VTK_REDUCE_MEAN ||
+                reduce == P4EST_VTK_REDUCE_MIN ||
+                reduce == P4EST_VTK_REDUCE_MAX);
+
+  cont->max_level = max_level;
+  cont->reduce = reduce;
+}
+
+#if defined P4EST_VTK_ZLIB || defined P4EST_VTK_STREAM
+
+static const char   p4est_vtk_base64[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/** Encode a byte range in base64 without line breaks.
+ * The output receives 4 * ((length + 2) / 3) characters.
+ * Any ranges starting at multiples of three bytes are independent.
+ */
+static void
+p4est_vtk_encode_base64 (const unsigned char *in, size_t length, char *out)
+{
+  size_t              zz;
+  uint32_t            w;
+
+  for (zz = 0; zz + 3 <= length; zz += 3) {
+    w = (uint32_t) in[zz] << 16 | (uint32_t) in[zz + 1] << 8 | in[zz + 2];
+    *out++ = p4est_vtk_base64[(w >> 18) & 0x3f];
+    *out++ = p4est_vtk_base64[(w >> 12) & 0x3f];
+    *out++ = p4est_vtk_base64[(w >> 6) & 0x3f];
+    *out++ = p4est_vtk_base64[w & 0x3f];
+  }
+  if (zz < length) {
+    w = (uint32_t) in[zz] << 16;
+    if (zz + 1 < length) {
+      w |= (uint32_t) in[zz + 1] << 8;
+    }
+    *out++ = p4est_vtk_base64[(w >> 18) & 0x3f];
+    *out++ = p4est_vtk_base64[(w >> 12) & 0x3f];
+    *out++ = zz + 1 < length ? p4est_vtk_base64[(w >> 6) & 0x3f] : '=';
+    *out++ = '=';
+  }
+}
+
+#endif /* P4EST_VTK_ZLIB || P4EST_VTK_STREAM */
+
+#ifdef P4EST_VTK_ZLIB
+
+/** Uncompressed size of the blocks compressed independently. */
+#define P4EST_VTK_BLOCK_SIZE (1 << 15)
+
+/** Write data in the blocked zlib format of VTK's vtkZLibDataCompressor.
+ * The blocks are compressed and base64 encoded by the threads set with
+ * \ref p4est_set_num_threads; the file is written by the calling thread.
+ * \param [in] level    Compression level passed to zlib.
+ * \return              0 on success, -1 on error.
+ */
+static int
+p4est_vtk_write_compressed (FILE * vtkfile, int level,
+                            const char *numeric_data, size_t byte_length)
+{
+  int                 retval, num_threads;
+  long                ib, num_blocks;
+  size_t              bound, zz, num_chars;
+  size_t              header_length;
+  uint32_t           *header;
+  char               *blocks, *encoded;
+  uLongf             *block_length;
+  const long          last_size = (long) (byte_length % P4EST_VTK_BLOCK_SIZE);
+
+  /* the header holds the number of blocks, the block size, the size of the
+     last block and the compressed size of every block */
+  num_blocks = (long) ((byte_length + P4EST_VTK_BLOCK_SIZE - 1) /
+                       P4EST_VTK_BLOCK_SIZE);
+  header_length = (size_t) (3 + num_blocks);
+  header = P4EST_ALLOC (uint32_t, header_length);
+  header[0] = (uint32_t) num_blocks;
+  header[1] = (uint32_t) P4EST_VTK_BLOCK_SIZE;
+  header[2] = (uint32_t) last_size;
+
+  /* compress every block into its own slot of the output buffer */
+  bound = (size_t) compressBound ((uLong) P4EST_VTK_BLOCK_SIZE);
+  blocks = P4EST_ALLOC (char, SC_MAX (num_blocks, 1) * bound);
+  block_length = P4EST_ALLOC (uLongf, SC_MAX (num_blocks, 1));
+  num_threads = p4est_get_num_threads ();
+  retval = 0;
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_threads) schedule (dynamic) \
+  reduction (|:retval)
+#endif
+  for (ib = 0; ib < num_blocks; ++ib) {
+    const uLong         raw_length = (ib == num_blocks - 1 && last_size > 0) ?
+      (uLong) last_size : (uLong) P4EST_VTK_BLOCK_SIZE;
+
+    block_length[ib] = (uLongf) bound;
+    if (compress2 ((Bytef *) blocks + ib * bound, &block_length[ib],
+                   (const Bytef *) numeric_data + ib * P4EST_VTK_BLOCK_SIZE,
+                   raw_length, level) != Z_OK) {
+      retval |= 1;
+    }
+  }
+  if (retval) {
+    P4EST_FREE (header);
+    P4EST_FREE (blocks);
+    P4EST_FREE (block_length);
+    return -1;
+  }
+
+  /* concatenate the compressed blocks */
+  for (zz = 0, ib = 0; ib < num_blocks; ++ib) {
+    header[3 + ib] = (uint32_t) block_length[ib];
+    memmove (blocks + zz, blocks + ib * bound, block_length[ib]);
+    zz += block_length[ib];
+  }
+  P4EST_FREE (block_length);
+
+  /* encode the header and the data separately as VTK expects */
+  num_chars = 4 * ((header_length * sizeof (uint32_t) + 2) / 3);
+  encoded = P4EST_ALLOC (char, SC_MAX (num_chars, 4 * ((zz + 2) / 3)));
+  p4est_vtk_encode_base64 ((const unsigned char *) header,
+                           header_length * sizeof (uint32_t), encoded);
+  fwrite (encoded, 1, num_chars, vtkfile);
+  P4EST_FREE (header);
+
+  /* each thread encodes a range of whole base64 quanta */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_threads)
+#endif
+  for (ib = 0; ib < (long) num_threads; ++ib) {
+    const size_t        quanta = (zz + 2) / 3;
+    const size_t        begin = 3 * (quanta * ib / num_threads);
+    const size_t        end = SC_MIN (3 * (quanta * (ib + 1) / num_threads),
+                                      zz);
+
+    if (begin < end) {
+      p4est_vtk_encode_base64 ((const unsigned char *) blocks + begin,
+                               end - begin, encoded + 4 * (begin / 3));
+    }
+  }
+  fwrite (encoded, 1, 4 * ((zz + 2) / 3), vtkfile);
+  P4EST_FREE (encoded);
+  P4EST_FREE (blocks);
+
+  return ferror (vtkfile) ? -1 : 0;
+}
+
+#endif /* P4EST_VTK_ZLIB */
+
+#ifdef P4EST_ENABLE_VTK_BINARY
+
+static int
+p4est_vtk_write_binary (p4est_vtk_context_t * cont, char *numeric_data,
+                        size_t byte_length)
+{
+#ifndef P4EST_ENABLE_VTK_COMPRESSION
+  return sc_vtk_write_binary (cont->vtufile, numeric_data, byte_length);
+#elif defined P4EST_VTK_ZLIB
+  return p4est_vtk_write_compressed (cont->vtufile, cont->level,
+                                     numeric_data, byte_length);
+#else
+  return sc_vtk_write_compressed (cont->vtufile, numeric_data, byte_length);
+#endif /* P4EST_ENABLE_VTK_COMPRESSION */
+}
+
+/** Size of the raw pieces encoded at a time without compression. */
+#define P4EST_VTK_STREAM_SIZE (3 << 13)
+
+/** A binary data array written in pieces of bounded size.
+ * Its total length must be known when the stream is begun.
+ * Without \ref P4EST_VTK_STREAM, the pieces are collected and the
+ * array is written at the end with \ref p4est_vtk_write_binary.
+ */
+typedef struct p4est_vtk_stream
+{
+  p4est_vtk_context_t *cont;    /**< The context writing the array. */
+  size_t              byte_length;      /**< Length announced up front. */
+  size_t              written;  /**< Number of bytes passed so far. */
+  char               *raw;      /**< Bytes not yet processed. */
+  size_t              num_raw;  /**< Number of bytes in \a raw. */
+  size_t              raw_size; /**< Capacity of \a raw. */
+#ifdef P4EST_VTK_STREAM
+  char               *encoded;  /**< Base64 output of one piece. */
+#endif
+#ifdef P4EST_VTK_ZLIB
+  char               *pending;  /**< Compressed bytes not yet encoded. */
+  size_t              num_pending;      /**< Number of bytes in \a pending. */
+  uint32_t           *header;   /**< Block header, completed at the end. */
+  size_t              header_length;    /**< Number of header entries. */
+  long                header_pos;       /**< File position of the header. */
+  long                num_blocks;       /**< Number of blocks compressed. */
+#endif
+}
+p4est_vtk_stream_t;
+
+/** Begin a binary data array of a given length at the current position.
+ * With compression, a placeholder of the block header is written
+ * that is overwritten by \ref p4est_vtk_stream_end.
+ */
+static void
+p4est_vtk_stream_begin (p4est_vtk_stream_t * stream,
+                        p4est_vtk_context_t * cont, size_t byte_length)
+{
+#if defined P4EST_VTK_STREAM && !defined P4EST_VTK_ZLIB
+  uint32_t            int_header;
+#endif
+#ifdef P4EST_VTK_ZLIB
+  long                num_blocks;
+  size_t              bound;
+#endif
+
+  memset (stream, 0, sizeof (*stream));
+  stream->cont = cont;
+  stream->byte_length = byte_length;
+
+#ifndef P4EST_VTK_STREAM
+  /* the fallback compressor needs the whole array at once */
+  stream->raw_size = byte_length;
+#elif !defined P4EST_VTK_ZLIB
+  /* the length header and the data are encoded as one sequence */
+  P4EST_ASSERT (byte_length <= (size_t) UINT32_MAX);
+  stream->raw_size = P4EST_VTK_STREAM_SIZE;
+  stream->encoded = P4EST_ALLOC (char, 4 * (P4EST_VTK_STREAM_SIZE / 3));
+  int_header = (uint32_t) byte_length;
+  stream->raw = P4EST_ALLOC (char, stream->raw_size);
+  memcpy (stream->raw, &int_header, sizeof (int_header));
+  stream->num_raw = sizeof (int_header);
+#else
+  /* the header is encoded separately and its length is known */
+  num_blocks = (long) ((byte_length + P4EST_VTK_BLOCK_SIZE - 1) /
+                       P4EST_VTK_BLOCK_SIZE);
+  stream->header_length = (size_t) (3 + num_blocks);
+  stream->header = P4EST_ALLOC_ZERO (uint32_t, stream->header_length);
+  stream->header[0] = (uint32_t) num_blocks;
+  stream->header[1] = (uint32_t) P4EST_VTK_BLOCK_SIZE;
+  stream->header[2] = (uint32_t) (byte_length % P4EST_VTK_BLOCK_SIZE);
+  stream->raw_size = P4EST_VTK_BLOCK_SIZE;
+
+  /* compressed blocks are appended to at most two pending bytes */
+  bound = (size_t) compressBound ((uLong) P4EST_VTK_BLOCK_SIZE) + 2;
+  stream->pending = P4EST_ALLOC (char, bound);
+  stream->encoded = P4EST_ALLOC (char, SC_MAX (4 * ((bound + 2) / 3),
+                                               4 * ((stream->header_length *
+                                                     sizeof (uint32_t) +
+                                                     2) / 3)));
+
+  /* reserve the space of the header */
+  stream->header_pos = ftell (cont->vtufile);
+  p4est_vtk_encode_base64 ((const unsigned char *) stream->header,
+                           stream->header_length * sizeof (uint32_t),
+                           stream->encoded);
+  fwrite (stream->encoded, 1,
+          4 * ((stream->header_length * sizeof (uint32_t) + 2) / 3),
+          cont->vtufile);
+#endif
+  if (stream->raw == NULL) {
+    stream->raw = P4EST_ALLOC (char, SC_MAX (stream->raw_size, 1));
+  }
+}
+
+#ifdef P4EST_VTK_STREAM
+
+/** Encode and write the bytes collected in a stream.
+ * \param [in] last     If false, bytes that do not fill a base64 quantum
+ *                      are kept for the next call.
+ * \return              0 on success, -1 on error.
+ */
+static int
+p4est_vtk_stream_flush (p4est_vtk_stream_t * stream, int last)
+{
+  size_t              length;
+  char               *data;
+  size_t             *num_data;
+#ifdef P4EST_VTK_ZLIB
+  uLongf              block_length;
+
+  /* compress the collected bytes into one block */
+  if (stream->num_raw > 0) {
+    block_length = (uLongf) compressBound ((uLong) P4EST_VTK_BLOCK_SIZE);
+    if (compress2 ((Bytef *) stream->pending + stream->num_pending,
+                   &block_length, (const Bytef *) stream->raw,
+                   (uLong) stream->num_raw, stream->cont->level) != Z_OK) {
+      return -1;
+    }
+    P4EST_ASSERT (stream->num_blocks < (long) stream->header[0]);
+    stream->header[3 + stream->num_blocks++] = (uint32_t) block_length;
+    stream->num_pending += block_length;
+    stream->num_raw = 0;
+  }
+  data = stream->pending;
+  num_data = &stream->num_pending;
+#else
+  data = stream->raw;
+  num_data = &stream->num_raw;
+#endif
+
+  /* encode whole quanta and keep the remainder */
+  length = last ? *num_data : *num_data - *num_data % 3;
+  p4est_vtk_encode_base64 ((const unsigned char *) data, length,
+                           stream->encoded);
+  fwrite (stream->encoded, 1, 4 * ((length + 2) / 3), stream->cont->vtufile);
+  memmove (data, data + length, *num_data - length);
+  *num_data -= length;
+
+  return ferror (stream->cont->vtufile) ? -1 : 0;
+}
+
+#endif /* P4EST_VTK_STREAM */
+
+/** Append bytes to a binary data array.
+ * \return              0 on success, -1 on error.
+ */
+static int
+p4est_vtk_stream_write (p4est_vtk_stream_t * stream,
+                        const void *data, size_t length)
+{
+  size_t              piece;
+  const char         *bytes = (const char *) data;
+
+  P4EST_ASSERT (stream->written + length <= stream->byte_length);
+  stream->written += length;
+  while (length > 0) {
+    piece = SC_MIN (length, stream->raw_size - stream->num_raw);
+    memcpy (stream->raw + stream->num_raw, bytes, piece);
+    stream->num_raw += piece;
+    bytes += piece;
+    length -= piece;
+#ifdef P4EST_VTK_STREAM
+    if (stream->num_raw == stream->raw_size &&
+        p4est_vtk_stream_flush (stream, 0)) {
+      return -1;
+    }
+#endif
+  }
+  return 0;
+}
+
+/** Finish a binary data array and free the stream's memory.
+ * \param [in] retval   If nonzero, an error has occurred before and
+ *                      the stream is only freed.
+ * \return              0 on success, -1 on error.
+ */
+static int
+p4est_vtk_stream_end (p4est_vtk_stream_t * stream, int retval)
+{
+#ifdef P4EST_VTK_ZLIB
+  long                end_pos;
+  FILE               *vtufile = stream->cont->vtufile;
+#endif
+
+  if (!retval) {
+    P4EST_ASSERT (stream->written == stream->byte_length);
+#ifndef P4EST_VTK_STREAM
+    retval = p4est_vtk_write_binary (stream->cont, stream->raw,
+                                     stream->num_raw);
+#else
+    retval = p4est_vtk_stream_flush (stream, 1);
+#endif
+  }
+#ifdef P4EST_VTK_ZLIB
+  if (!retval) {
+    /* the block sizes are known now: overwrite the placeholder */
+    P4EST_ASSERT (stream->num_blocks == (long) stream->header[0]);
+    end_pos = ftell (vtufile);
+    p4est_vtk_encode_base64 ((const unsigned char *) stream->header,
+                             stream->header_length * sizeof (uint32_t),
+                             stream->encoded);
+    if (end_pos < 0 || fseek (vtufile, stream->header_pos, SEEK_SET)) {
+      retval = -1;
+    }
+    else {
+      fwrite (stream->encoded, 1,
+              4 * ((stream->header_length * sizeof (uint32_t) + 2) / 3),
+              vtufile);
+      retval = fseek (vtufile, end_pos, SEEK_SET) || ferror (vtufile) ?
+        -1 : 0;
+    }
+  }
+  P4EST_FREE (stream->pending);
+  P4EST_FREE (stream->header);
+#endif
+#ifdef P4EST_VTK_STREAM
+  P4EST_FREE (stream->encoded);
+#endif
+  P4EST_FREE (stream->raw);
+  return retval;
+}
+
+#endif /* P4EST_ENABLE_VTK_BINARY */
+
+/** Open the VTU file of this process and begin its piece.
+ * Without the single file option, every process writes a full file.
+ * Otherwise the piece goes to a scratch file until the footer.
+ * \return          0 on success, -1 on error.
+ */
+static int
+p4est_vtk_open_piece (p4est_vtk_context_t * cont, p4est_locidx_t Npoints,
+                      p4est_locidx_t Ncells)
+{
+  if (cont->single_file) {
+    snprintf (cont->vtufilename, BUFSIZ, "%s.vtu", cont->filename);
+    cont->vtufile = tmpfile ();
+    if (cont->vtufile == NULL) {
+      P4EST_LERRORF ("Could not open scratch file for %s\n",
+                     cont->vtufilename);
+      return -1;
+    }
+  }
+  else {
+    /* Have each proc write to its own file */
+    snprintf (cont->vtufilename, BUFSIZ, "%s_%04d.vtu", cont->filename,
+              cont->mpirank);
+    /* Use "w" for writing the initial part of the file.
+     * For further parts, use "r+" and fseek so write_compressed succeeds.
+     */
+    cont->vtufile = fopen (cont->vtufilename, "wb");
+    if (cont->vtufile == NULL) {
+      P4EST_LERRORF ("Could not open %s for output\n", cont->vtufilename);
+      return -1;
+    }
+
+    fprintf (cont->vtufile, "<?xml version=\"1.0\"?>\n");
+    fprintf (cont->vtufile,
+             "<VTKFile type=\"UnstructuredGrid\" version=\"0.1\"");
+#if defined P4EST_ENABLE_VTK_BINARY && defined P4EST_ENABLE_VTK_COMPRESSION
+    fprintf (cont->vtufile, " compressor=\"vtkZLibDataCompressor\"");
+#endif
+#ifdef SC_IS_BIGENDIAN
+    fprintf (cont->vtufile, " byte_order=\"BigEndian\">\n");
+#else
+    fprintf (cont->vtufile, " byte_order=\"LittleEndian\">\n");
+#endif
+    fprintf (cont->vtufile, "  <UnstructuredGrid>\n");
+  }
+  fprintf (cont->vtufile,
+           "    <Piece NumberOfPoints=\"%lld\" NumberOfCells=\"%lld\">\n",
+           (long long) Npoints, (long long) Ncells);
+  return 0;
+}
+
 void
 p4est_vtk_context_destroy (p4est_vtk_context_t * context)
 {
   P4EST_ASSERT (context != NULL);
-  P4EST_ASSERT (context->p4est != NULL);
 
   /* since this function is called inside write_header and write_footer,
    * we cannot assume a consistent state of all member variables */
@@ -276,10 +808,11 @@ p4est_vtk_context_destroy (p4est_vtk_context_t * context)
   P4EST_FREE (context->filename);
 
   /* deallocate node storage */
-  if (context->nodes != NULL) {
-    p4est_nodes_destroy (context->nodes);
-  }
   P4EST_FREE (context->node_to_corner);
+  if (context->cells != NULL) {
+    sc_array_destroy (context->cells);
+    sc_array_destroy (context->cell_first);
+  }
 
   /* Close all file pointers. */
   if (context->vtufile != NULL) {
@@ -293,7 +826,7 @@ p4est_vtk_context_destroy (p4est_vtk_context_t * context)
   /* Close paraview master file */
   if (context->pvtufile != NULL) {
     /* Only the root process opens/closes these files. */
-    P4EST_ASSERT (context->p4est->mpirank == 0);
+    P4EST_ASSERT (context->mpirank == 0);
     if (fclose (context->pvtufile)) {
       P4EST_LERRORF (P4EST_STRING "_vtk: Error closing <%s>.\n",
                      context->pvtufilename);
@@ -304,7 +837,7 @@ p4est_vtk_context_destroy (p4est_vtk_context_t * context)
   /* Close visit master file */
   if (context->visitfile != NULL) {
     /* Only the root process opens/closes these files. */
-    P4EST_ASSERT (context->p4est->mpirank == 0);
+    P4EST_ASSERT (context->mpirank == 0);
     if (fclose (context->visitfile)) {
       P4EST_LERRORF (P4EST_STRING "_vtk: Error closing <%s>.\n",
                      context->visitfilename);
@@ -347,287 +880,489 @@ p4est_vtk_write_file (p4est_t * p4est, p4est_geometry_t * geom,
   SC_CHECK_ABORT (!retval, P4EST_STRING "_vtk: Error writing footer");
 }
 
-p4est_vtk_context_t *
-p4est_vtk_write_header (p4est_vtk_context_t * cont)
+/** Compute the positions of the corners of one quadrant.
+ * \param [in] v           Vertices of the tree corners, or NULL to
+ *                         output tree-local reference coordinates.
+ * \param [in] quad        The quadrant.
+ * \param [in] scale       Shrink factor for the quadrant in (0, 1].
+ * \param [out] float_data Three coordinates for each of its corners.
+ */
+static void
+p4est_vtk_quadrant_positions (const double *v, const p4est_quadrant_t * quad,
+                              double scale, double *float_data)
 {
   const double        intsize = 1.0 / P4EST_ROOT_LEN;
-  int                 mpirank;
-  int                 conti;
-  double              scale;
-  const char         *filename;
-  const double       *v;
-  const p4est_topidx_t *tree_to_vertex;
-  p4est_topidx_t      first_local_tree, last_local_tree;
-  p4est_locidx_t      Ncells, Ncorners;
-  p4est_t            *p4est;
-  p4est_connectivity_t *connectivity;
-  p4est_geometry_t   *geom;
-#ifdef P4EST_VTK_ASCII
-  double              wx, wy, wz;
-#else
-  int                 retval;
-  uint8_t            *uint8_data;
-  p4est_locidx_t     *locidx_data;
-#endif
   int                 xi, yi, j, k;
 #ifdef P4_TO_P8
   int                 zi;
 #endif
   double              h2, eta_x, eta_y, eta_z = 0.;
-  double              xyz[3], XYZ[3];   /* 3 not P4EST_DIM */
+
+  h2 = .5 * intsize * P4EST_QUADRANT_LEN (quad->level);
+  k = 0;
+#ifdef P4_TO_P8
+  for (zi = 0; zi < 2; ++zi) {
+    eta_z = intsize * quad->z + h2 * (1. + (zi * 2 - 1) * scale);
+#endif
+    for (yi = 0; yi < 2; ++yi) {
+      eta_y = intsize * quad->y + h2 * (1. + (yi * 2 - 1) * scale);
+      for (xi = 0; xi < 2; ++xi) {
+        P4EST_ASSERT (0 <= k && k < P4EST_CHILDREN);
+        eta_x = intsize * quad->x + h2 * (1. + (xi * 2 - 1) * scale);
+        if (v == NULL) {
+          /* the geometry is applied to all corners of the tree at once */
+          float_data[3 * k + 0] = eta_x;
+          float_data[3 * k + 1] = eta_y;
+          float_data[3 * k + 2] = eta_z;
+        }
+        else {
+          for (j = 0; j < 3; ++j) {
+            /* *INDENT-OFF* */
+            float_data[3 * k + j] =
+          ((1. - eta_z) * ((1. - eta_y) * ((1. - eta_x) * v[3 * 0 + j] +
+                                                 eta_x  * v[3 * 1 + j]) +
+                                 eta_y  * ((1. - eta_x) * v[3 * 2 + j] +
+                                                 eta_x  * v[3 * 3 + j]))
+#ifdef P4_TO_P8
+           +     eta_z  * ((1. - eta_y) * ((1. - eta_x) * v[3 * 4 + j] +
+                                                 eta_x  * v[3 * 5 + j]) +
+                                 eta_y  * ((1. - eta_x) * v[3 * 6 + j] +
+                                                 eta_x  * v[3 * 7 + j]))
+#endif
+          );
+            /* *INDENT-ON* */
+          }
+        }
+        ++k;
+      }
+    }
+#ifdef P4_TO_P8
+  }
+#endif
+  P4EST_ASSERT (k == P4EST_CHILDREN);
+}
+
+/** Compute the positions of all local quadrant corners.
+ * \param [in] p4est       The forest.
+ * \param [in] geom        The geometry, or NULL for vertex space.
+ * \param [in] scale       Shrink factor for the quadrants in (0, 1].
+ * \param [in] cells       If NULL, use the local quadrants.  Otherwise,
+ *                         quadrants with the tree in p.which_tree, sorted
+ *                         by tree, to be used in place of the leaves.
+ * \param [out] float_data Three coordinates for each of the
+ *                         P4EST_CHILDREN corners of each local quadrant.
+ */
+static void
+p4est_vtk_corner_positions (p4est_t * p4est, p4est_geometry_t * geom,
+                            double scale, sc_array_t * cells,
+                            double *float_data)
+{
+  int                 k;
+  double              corners[3 * P4EST_CHILDREN];
   size_t              num_quads, zz;
   p4est_topidx_t      jt;
-  p4est_topidx_t      vt[P4EST_CHILDREN];
-  p4est_locidx_t      quad_count, Npoints;
-  p4est_locidx_t      sk, il, ntcid, *ntc;
-  P4EST_VTK_FLOAT_TYPE *float_data;
-  sc_array_t         *quadrants, *indeps;
-  sc_array_t         *trees;
+  p4est_topidx_t      first_local_tree = p4est->first_local_tree;
+  p4est_topidx_t      last_local_tree = p4est->last_local_tree;
+  p4est_locidx_t      quad_count, tree_first;
+  p4est_connectivity_t *connectivity = p4est->connectivity;
+  sc_array_t         *trees = p4est->trees;
+  sc_array_t         *quadrants;
   p4est_tree_t       *tree;
   p4est_quadrant_t   *quad;
-  p4est_nodes_t      *nodes;
-  p4est_indep_t      *in;
 
-  /* check a whole bunch of assertions, here and below */
-  P4EST_ASSERT (cont != NULL);
-  P4EST_ASSERT (!cont->writing);
+  /* loop over the trees */
+  for (jt = first_local_tree, quad_count = 0; jt <= last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (trees, jt);
+    quadrants = &tree->quadrants;
+    num_quads = quadrants->elem_count;
+
+    /* retrieve corners of the tree */
+    if (geom == NULL) {
+      for (k = 0; k < P4EST_CHILDREN; ++k) {
+        p4est_connectivity_tree_vertex (connectivity, jt, k,
+                                        corners + 3 * k);
+      }
+    }
+    tree_first = quad_count;
 
-  /* avoid uninitialized warning */
-  for (k = 0; k < P4EST_CHILDREN; ++k) {
-    vt[k] = -(k + 1);
+    if (cells == NULL) {
+      /* loop over the elements in tree and calculate vertex coordinates */
+      for (zz = 0; zz < num_quads; ++zz, ++quad_count) {
+        quad = p4est_quadrant_array_index (quadrants, zz);
+        p4est_vtk_quadrant_positions (geom == NULL ? corners : NULL,
+                                      quad, scale, float_data +
+                                      3 * P4EST_CHILDREN * quad_count);
+      }
+    }
+    else {
+      /* the cells of this tree follow those of the trees before */
+      for (; (size_t) quad_count < cells->elem_count; ++quad_count) {
+        quad = p4est_quadrant_array_index (cells, (size_t) quad_count);
+        if (quad->p.which_tree != jt) {
+          break;
+        }
+        p4est_vtk_quadrant_positions (geom == NULL ? corners : NULL,
+                                      quad, scale, float_data +
+                                      3 * P4EST_CHILDREN * quad_count);
+      }
+    }
+
+    /* map the reference coordinates of this tree in place */
+    if (geom != NULL) {
+      p4est_geometry_X_batch (geom, jt, (size_t) P4EST_CHILDREN *
+                              (quad_count - tree_first),
+                              float_data + 3 * P4EST_CHILDREN * tree_first,
+                              float_data + 3 * P4EST_CHILDREN * tree_first);
+    }
   }
+  P4EST_ASSERT (cells != NULL ||
+                quad_count == p4est->local_num_quadrants);
+  P4EST_ASSERT (cells == NULL || (size_t) quad_count == cells->elem_count);
+}
 
-  /* from now on this context is officially in use for writing */
-  cont->writing = 1;
+/** Determine whether a corner of a degree one lnodes element is hanging.
+ * \param [in] face_code   The lnodes face code of the element.
+ * \param [in] corner      Corner number of the element.
+ * \return                True if the corner lies in the middle of a
+ *                         coarser face or edge.
+ */
+static int
+p4est_vtk_corner_hangs (p4est_lnodes_code_t face_code, int corner)
+{
+  int                 hanging_face[P4EST_FACES];
+  int                 i;
+#ifdef P4_TO_P8
+  int                 hanging_edge[P8EST_EDGES];
 
-  /* grab context variables */
-  p4est = cont->p4est;
-  filename = cont->filename;
-  geom = cont->geom;
-  scale = cont->scale;
-  conti = cont->continuous;
-  P4EST_ASSERT (filename != NULL);
+  if (!p8est_lnodes_decode (face_code, hanging_face, hanging_edge)) {
+    return 0;
+  }
+#else
+  if (!p4est_lnodes_decode (face_code, hanging_face)) {
+    return 0;
+  }
+#endif
+
+  /* the corner shared with the parent never hangs */
+  if (corner == (face_code & (P4EST_CHILDREN - 1))) {
+    return 0;
+  }
+  for (i = 0; i < P4EST_DIM; ++i) {
+    if (hanging_face[p4est_corner_faces[corner][i]] >= 0) {
+      return 1;
+    }
+#ifdef P4_TO_P8
+    if (hanging_edge[p8est_corner_edges[corner][i]] >= 0) {
+      return 1;
+    }
+#endif
+  }
+  return 0;
+}
+
+/** Create the points and cells of an in-memory mesh.
+ * \param [in] cells       If not NULL, the quadrants to be used in place of
+ *                         the local leaves as in \ref
+ *                         p4est_vtk_corner_positions.  Then every corner
+ *                         is its own point.
+ * \return                 A mesh as described in \ref p4est_vtk_mesh_new.
+ */
+static p4est_vtk_mesh_t *
+p4est_vtk_mesh_build (p4est_t * p4est, p4est_geometry_t * geom,
+                      double scale, int continuous, p4est_lnodes_t * lnodes,
+                      sc_array_t * cells)
+{
+  int                 j, k;
+  p4est_locidx_t      Ncells, Ncorners, Npoints;
+  p4est_locidx_t      sk, il, ntcid, *ntc;
+  p4est_locidx_t     *node_to_point;
+  p4est_connectivity_t *connectivity;
+  p4est_ghost_t      *ghost;
+  p4est_lnodes_t     *given;
+  p4est_vtk_mesh_t   *mesh;
 
-  /* grab details from the forest */
   P4EST_ASSERT (p4est != NULL);
-  mpirank = p4est->mpirank;
+  P4EST_ASSERT (0. < scale && scale <= 1.);
+  P4EST_ASSERT (lnodes == NULL || lnodes->degree == 1);
   connectivity = p4est->connectivity;
   P4EST_ASSERT (connectivity != NULL);
-  v = connectivity->vertices;
-  tree_to_vertex = connectivity->tree_to_vertex;
   if (geom == NULL) {
     SC_CHECK_ABORT (connectivity->num_vertices > 0,
                     "Must provide connectivity with vertex information");
-    P4EST_ASSERT (v != NULL && tree_to_vertex != NULL);
+    P4EST_ASSERT (connectivity->brick != NULL ||
+                  (connectivity->vertices != NULL &&
+                   connectivity->tree_to_vertex != NULL));
   }
-  trees = p4est->trees;
-  first_local_tree = p4est->first_local_tree;
-  last_local_tree = p4est->last_local_tree;
-  Ncells = p4est->local_num_quadrants;
 
-  cont->num_corners = Ncorners = P4EST_CHILDREN * Ncells;
-  if (scale < 1. || !conti) {
+  mesh = P4EST_ALLOC (p4est_vtk_mesh_t, 1);
+  mesh->num_cells = Ncells = cells == NULL ? p4est->local_num_quadrants :
+    (p4est_locidx_t) cells->elem_count;
+  mesh->num_corners = Ncorners = P4EST_CHILDREN * Ncells;
+  mesh->connectivity = P4EST_ALLOC (p4est_locidx_t, SC_MAX (Ncorners, 1));
+
+  /* we compute all corners even if fewer points are kept */
+  mesh->coordinates = P4EST_ALLOC (double, 3 * SC_MAX (Ncorners, 1));
+  p4est_vtk_corner_positions (p4est, geom, scale, cells, mesh->coordinates);
+
+  if (scale < 1. || !continuous || cells != NULL) {
     /* when we scale the quadrants we need each corner separately */
-    cont->nodes = nodes = NULL;
-    cont->num_points = Npoints = Ncorners;
-    cont->node_to_corner = ntc = NULL;
-    indeps = NULL;
+    mesh->num_points = Ncorners;
+    mesh->point_to_corner = NULL;
+    for (sk = 0; sk < Ncorners; ++sk) {
+      mesh->connectivity[sk] = sk;
+    }
+    return mesh;
   }
-  else {
-    /* if scale == 1. and the point data is continuous,
-     * we can reuse shared quadrant corners */
-    cont->nodes = nodes = p4est_nodes_new (p4est, NULL);
-    indeps = &nodes->indep_nodes;
-    cont->num_points = Npoints = nodes->num_owned_indeps;
-    P4EST_ASSERT ((size_t) Npoints == indeps->elem_count);
-
-    /* Establish a reverse lookup table from a node to its first reference.
-     * It is slow to run twice through memory like this.  However, we also know
-     * that writing data to disk is slower still, so we do not optimize.
-     */
-    cont->node_to_corner = ntc = P4EST_ALLOC (p4est_locidx_t, Npoints);
-    memset (ntc, -1, Npoints * sizeof (p4est_locidx_t));
-    for (sk = 0, il = 0; il < Ncells; ++il) {
-      for (k = 0; k < P4EST_CHILDREN; ++sk, ++k) {
-        ntcid = nodes->local_nodes[sk];
-        P4EST_ASSERT (0 <= ntcid && ntcid < Npoints);
-        if (ntc[ntcid] < 0) {
-          ntc[ntcid] = sk;
-        }
+
+  /* if scale == 1. and the point data is continuous, we reuse shared
+   * quadrant corners through a degree one node numbering */
+  given = lnodes;
+  if (lnodes == NULL) {
+    ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+    lnodes = p4est_lnodes_new (p4est, ghost, 1);
+    p4est_ghost_destroy (ghost);
+  }
+  P4EST_ASSERT (lnodes->degree == 1);
+  P4EST_ASSERT (lnodes->num_local_elements == Ncells);
+
+  /* Number the points in the order of their first reference.  A hanging
+   * corner refers to the nodes of its parent, thus it gets its own point.
+   * Nodes that are only referenced as hanging dependencies are skipped.
+   */
+  node_to_point = P4EST_ALLOC (p4est_locidx_t, lnodes->num_local_nodes);
+  memset (node_to_point, -1,
+          lnodes->num_local_nodes * sizeof (p4est_locidx_t));
+  ntc = P4EST_ALLOC (p4est_locidx_t, SC_MAX (Ncorners, 1));
+  for (Npoints = 0, sk = 0, il = 0; il < Ncells; ++il) {
+    for (k = 0; k < P4EST_CHILDREN; ++sk, ++k) {
+      if (p4est_vtk_corner_hangs (lnodes->face_code[il], k)) {
+        ntc[Npoints] = sk;
+        mesh->connectivity[sk] = Npoints++;
+        continue;
       }
+      ntcid = lnodes->element_nodes[sk];
+      P4EST_ASSERT (0 <= ntcid && ntcid < lnodes->num_local_nodes);
+      if (node_to_point[ntcid] < 0) {
+        ntc[Npoints] = sk;
+        node_to_point[ntcid] = Npoints++;
+      }
+      mesh->connectivity[sk] = node_to_point[ntcid];
     }
-#ifdef P4EST_ENABLE_DEBUG
-    /* the particular version of nodes we call makes sure they are tight */
-    for (ntcid = 0; ntcid < Npoints; ++ntcid) {
-      P4EST_ASSERT (0 <= ntc[ntcid] && ntc[ntcid] < Ncorners);
-    }
-#endif
+  }
+  P4EST_FREE (node_to_point);
+  if (lnodes != given) {
+    p4est_lnodes_destroy (lnodes);
   }
 
-  /* Have each proc write to its own file */
-  snprintf (cont->vtufilename, BUFSIZ, "%s_%04d.vtu", filename, mpirank);
-  /* Use "w" for writing the initial part of the file.
-   * For further parts, use "r+" and fseek so write_compressed succeeds.
-   */
-  cont->vtufile = fopen (cont->vtufilename, "wb");
-  if (cont->vtufile == NULL) {
-    P4EST_LERRORF ("Could not open %s for output\n", cont->vtufilename);
-    p4est_vtk_context_destroy (cont);
-    return NULL;
+  /* keep the position of the first corner of every point */
+  for (il = 0; il < Npoints; ++il) {
+    /* points are numbered in order, so we never overwrite a source */
+    P4EST_ASSERT (il <= ntc[il] && ntc[il] < Ncorners);
+    for (j = 0; j < 3; ++j) {
+      mesh->coordinates[3 * il + j] = mesh->coordinates[3 * ntc[il] + j];
+    }
   }
+  mesh->num_points = Npoints;
+  mesh->point_to_corner =
+    P4EST_REALLOC (ntc, p4est_locidx_t, SC_MAX (Npoints, 1));
+  mesh->coordinates =
+    P4EST_REALLOC (mesh->coordinates, double, 3 * SC_MAX (Npoints, 1));
+  return mesh;
+}
 
-  fprintf (cont->vtufile, "<?xml version=\"1.0\"?>\n");
-  fprintf (cont->vtufile,
-           "<VTKFile type=\"UnstructuredGrid\" version=\"0.1\"");
-#if defined P4EST_ENABLE_VTK_BINARY && defined P4EST_ENABLE_VTK_COMPRESSION
-  fprintf (cont->vtufile, " compressor=\"vtkZLibDataCompressor\"");
-#endif
-#ifdef SC_IS_BIGENDIAN
-  fprintf (cont->vtufile, " byte_order=\"BigEndian\">\n");
-#else
-  fprintf (cont->vtufile, " byte_order=\"LittleEndian\">\n");
-#endif
-  fprintf (cont->vtufile, "  <UnstructuredGrid>\n");
-  fprintf (cont->vtufile,
-           "    <Piece NumberOfPoints=\"%lld\" NumberOfCells=\"%lld\">\n",
-           (long long) Npoints, (long long) Ncells);
-  fprintf (cont->vtufile, "      <Points>\n");
+p4est_vtk_mesh_t   *
+p4est_vtk_mesh_new (p4est_t * p4est, p4est_geometry_t * geom,
+                    double scale, int continuous, p4est_lnodes_t * lnodes)
+{
+  return p4est_vtk_mesh_build (p4est, geom, scale, continuous, lnodes, NULL);
+}
 
-  float_data = P4EST_ALLOC (P4EST_VTK_FLOAT_TYPE, 3 * Npoints);
+void
+p4est_vtk_mesh_destroy (p4est_vtk_mesh_t * mesh)
+{
+  P4EST_ASSERT (mesh != NULL);
 
-  /* write point position data */
-  fprintf (cont->vtufile, "        <DataArray type=\"%s\" Name=\"Position\""
-           " NumberOfComponents=\"3\" format=\"%s\">\n",
-           P4EST_VTK_FLOAT_NAME, P4EST_VTK_FORMAT_STRING);
+  P4EST_FREE (mesh->coordinates);
+  P4EST_FREE (mesh->connectivity);
+  P4EST_FREE (mesh->point_to_corner);
+  P4EST_FREE (mesh);
+}
 
-  if (nodes == NULL) {
-    /* loop over the trees */
-    for (jt = first_local_tree, quad_count = 0; jt <= last_local_tree; ++jt) {
-      tree = p4est_tree_array_index (trees, jt);
-      quadrants = &tree->quadrants;
-      num_quads = quadrants->elem_count;
-
-      /* retrieve corners of the tree */
-      if (geom == NULL) {
-        for (k = 0; k < P4EST_CHILDREN; ++k) {
-          vt[k] = tree_to_vertex[jt * P4EST_CHILDREN + k];
-        }
-      }
-      else {
-        /* provoke crash on logic bug */
-        P4EST_ASSERT (vt[0] == -1);
-        v = NULL;
-      }
+/** Collect the ancestors of the local leaves at the maximum level.
+ * Leaves that are not finer are kept as they are.  Since the descendants
+ * of an ancestor are contiguous, each ancestor is recorded once.
+ */
+static void
+p4est_vtk_truncate (p4est_vtk_context_t * cont)
+{
+  const int           max_level = cont->max_level;
+  int                 level;
+  size_t              num_quads, zz;
+  p4est_t            *p4est = cont->p4est;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      il, num_fine;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *quad, *cell;
 
-      /* loop over the elements in tree and calculate vertex coordinates */
-      for (zz = 0; zz < num_quads; ++zz, ++quad_count) {
-        quad = p4est_quadrant_array_index (quadrants, zz);
-        h2 = .5 * intsize * P4EST_QUADRANT_LEN (quad->level);
-        k = 0;
-#ifdef P4_TO_P8
-        for (zi = 0; zi < 2; ++zi) {
-          eta_z = intsize * quad->z + h2 * (1. + (zi * 2 - 1) * scale);
-#endif
-          for (yi = 0; yi < 2; ++yi) {
-            eta_y = intsize * quad->y + h2 * (1. + (yi * 2 - 1) * scale);
-            for (xi = 0; xi < 2; ++xi) {
-              P4EST_ASSERT (0 <= k && k < P4EST_CHILDREN);
-              eta_x = intsize * quad->x + h2 * (1. + (xi * 2 - 1) * scale);
-              if (geom != NULL) {
-                xyz[0] = eta_x;
-                xyz[1] = eta_y;
-                xyz[2] = eta_z;
-                geom->X (geom, jt, xyz, XYZ);
-                for (j = 0; j < 3; ++j) {
-                  float_data[3 * (P4EST_CHILDREN * quad_count + k) + j] =
-                    (P4EST_VTK_FLOAT_TYPE) XYZ[j];
-                }
-              }
-              else {
-                for (j = 0; j < 3; ++j) {
-                  /* *INDENT-OFF* */
-                xyz[j] =
-            ((1. - eta_z) * ((1. - eta_y) * ((1. - eta_x) * v[3 * vt[0] + j] +
-                                                   eta_x  * v[3 * vt[1] + j]) +
-                                   eta_y  * ((1. - eta_x) * v[3 * vt[2] + j] +
-                                                   eta_x  * v[3 * vt[3] + j]))
-#ifdef P4_TO_P8
-             +     eta_z  * ((1. - eta_y) * ((1. - eta_x) * v[3 * vt[4] + j] +
-                                                   eta_x  * v[3 * vt[5] + j]) +
-                                   eta_y  * ((1. - eta_x) * v[3 * vt[6] + j] +
-                                                   eta_x  * v[3 * vt[7] + j]))
-#endif
-            );
-                  /* *INDENT-ON* */
-                  float_data[3 * (P4EST_CHILDREN * quad_count + k) + j] =
-                    (P4EST_VTK_FLOAT_TYPE) xyz[j];
-                }
-              }
-              ++k;
-            }
-          }
-#ifdef P4_TO_P8
-        }
-#endif
-        P4EST_ASSERT (k == P4EST_CHILDREN);
-      }
+  P4EST_ASSERT (0 <= max_level && max_level <= P4EST_QMAXLEVEL);
+
+  cont->cells = sc_array_new (sizeof (p4est_quadrant_t));
+  cont->cell_first = sc_array_new (sizeof (p4est_locidx_t));
+  for (il = 0, jt = p4est->first_local_tree;
+       jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    num_quads = tree->quadrants.elem_count;
+
+    /* trees without finer leaves are copied as they are */
+    for (num_fine = 0, level = max_level + 1; level <= tree->maxlevel;
+         ++level) {
+      num_fine += tree->quadrants_per_level[level];
     }
-    P4EST_ASSERT (P4EST_CHILDREN * quad_count == Npoints);
-  }
-  else {
-    for (zz = 0; zz < indeps->elem_count; ++zz) {
-      in = (p4est_indep_t *) sc_array_index (indeps, zz);
-
-      /* retrieve corners of the tree */
-      jt = in->p.which_tree;
-      if (geom == NULL) {
-        for (k = 0; k < P4EST_CHILDREN; ++k) {
-          vt[k] = tree_to_vertex[jt * P4EST_CHILDREN + k];
+    cell = NULL;
+    for (zz = 0; zz < num_quads; ++zz, ++il) {
+      quad = p4est_quadrant_array_index (&tree->quadrants, zz);
+      if (num_fine > 0 && quad->level > max_level) {
+        if (cell != NULL && p4est_quadrant_is_ancestor (cell, quad)) {
+          continue;
         }
+        cell = (p4est_quadrant_t *) sc_array_push (cont->cells);
+        p4est_quadrant_ancestor (quad, max_level, cell);
       }
       else {
-        /* provoke crash on logic bug */
-        P4EST_ASSERT (vt[0] == -1);
-        v = NULL;
+        cell = (p4est_quadrant_t *) sc_array_push (cont->cells);
+        *cell = *quad;
       }
+      cell->p.which_tree = jt;
+      *(p4est_locidx_t *) sc_array_push (cont->cell_first) = il;
+    }
+  }
+  P4EST_ASSERT (il == p4est->local_num_quadrants);
+  *(p4est_locidx_t *) sc_array_push (cont->cell_first) = il;
+  cont->num_cells = (p4est_locidx_t) cont->cells->elem_count;
+}
 
-      /* calculate vertex coordinates */
-      eta_x = intsize * in->x;
-      eta_y = intsize * in->y;
-#ifdef P4_TO_P8
-      eta_z = intsize * in->z;
-#endif
-      if (geom != NULL) {
-        xyz[0] = eta_x;
-        xyz[1] = eta_y;
-        xyz[2] = eta_z;
-        geom->X (geom, jt, xyz, XYZ);
-        for (j = 0; j < 3; ++j) {
-          float_data[3 * zz + j] = (P4EST_VTK_FLOAT_TYPE) XYZ[j];
-        }
+/** Reduce cell values of the local leaves onto the cells written.
+ * The mean is weighted by the volume of the leaves.
+ * \param [in] values      Values of the local leaves.
+ * \param [in] ncomp       Number of values per leaf.
+ * \return                 \a values if the output is not truncated,
+ *                         otherwise a new array of values per cell.
+ */
+static sc_array_t  *
+p4est_vtk_reduce_cells (p4est_vtk_context_t * cont, sc_array_t * values,
+                        int ncomp)
+{
+  int                 j;
+  double              w, wsum;
+  const double       *v;
+  double             *r;
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      ic, il, *first;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *quad, *cell;
+  sc_array_t         *reduced;
+
+  if (cont->cells == NULL) {
+    return values;
+  }
+  P4EST_ASSERT (values->elem_size == sizeof (double));
+  P4EST_ASSERT (values->elem_count ==
+                (size_t) ncomp * cont->p4est->local_num_quadrants);
+
+  reduced = sc_array_new_count (sizeof (double),
+                                (size_t) ncomp * cont->num_cells);
+  first = (p4est_locidx_t *) cont->cell_first->array;
+  jt = cont->p4est->first_local_tree - 1;
+  tree = NULL;
+  zz = 0;
+  for (ic = 0; ic < cont->num_cells; ++ic) {
+    cell = p4est_quadrant_array_index (cont->cells, (size_t) ic);
+    r = (double *) sc_array_index (reduced, (size_t) ncomp * ic);
+    wsum = 0.;
+    for (il = first[ic]; il < first[ic + 1]; ++il, ++zz) {
+      /* advance to the tree holding the next leaf */
+      while (tree == NULL || zz == tree->quadrants.elem_count) {
+        tree = p4est_tree_array_index (cont->p4est->trees, ++jt);
+        zz = 0;
       }
-      else {
-        for (j = 0; j < 3; ++j) {
-          /* *INDENT-OFF* */
-          xyz[j] =
-            ((1. - eta_z) * ((1. - eta_y) * ((1. - eta_x) * v[3 * vt[0] + j] +
-                                                   eta_x  * v[3 * vt[1] + j]) +
-                                   eta_y  * ((1. - eta_x) * v[3 * vt[2] + j] +
-                                                   eta_x  * v[3 * vt[3] + j]))
-  #ifdef P4_TO_P8
-             +     eta_z  * ((1. - eta_y) * ((1. - eta_x) * v[3 * vt[4] + j] +
-                                                   eta_x  * v[3 * vt[5] + j]) +
-                                   eta_y  * ((1. - eta_x) * v[3 * vt[6] + j] +
-                                                   eta_x  * v[3 * vt[7] + j]))
-  #endif
-            );
-          /* *INDENT-ON* */
-
-          float_data[3 * zz + j] = (P4EST_VTK_FLOAT_TYPE) xyz[j];
+      quad = p4est_quadrant_array_index (&tree->quadrants, zz);
+      P4EST_ASSERT (quad->level >= cell->level);
+      v = (const double *) sc_array_index (values, (size_t) ncomp * il);
+      w = ldexp (1., -P4EST_DIM * (quad->level - cell->level));
+      for (j = 0; j < ncomp; ++j) {
+        if (il == first[ic]) {
+          r[j] = cont->reduce == P4EST_VTK_REDUCE_MEAN ? w * v[j] : v[j];
+        }
+        else if (cont->reduce == P4EST_VTK_REDUCE_MEAN) {
+          r[j] += w * v[j];
+        }
+        else if (cont->reduce == P4EST_VTK_REDUCE_MIN) {
+          r[j] = SC_MIN (r[j], v[j]);
         }
+        else {
+          r[j] = SC_MAX (r[j], v[j]);
+        }
+      }
+      wsum += w;
+    }
+    if (cont->reduce == P4EST_VTK_REDUCE_MEAN) {
+      for (j = 0; j < ncomp; ++j) {
+        r[j] /= wsum;
       }
     }
   }
+  return reduced;
+}
+
+/** Write the points and cells of a mesh and open the parallel meta files.
+ * The mesh is not modified and remains owned by the caller.
+ * \return          On success, the context that has been passed in.
+ *                  On failure, returns NULL and deallocates the context.
+ */
+static p4est_vtk_context_t *
+p4est_vtk_write_mesh (p4est_vtk_context_t * cont,
+                      const p4est_vtk_mesh_t * mesh)
+{
+  const int           mpirank = cont->mpirank;
+  const char         *filename = cont->filename;
+  p4est_locidx_t      Ncells, Ncorners;
+#ifdef P4EST_VTK_ASCII
+  int                 k;
+  double              wx, wy, wz;
+  p4est_locidx_t      sk;
+#else
+  int                 retval;
+  uint8_t            *uint8_data;
+  p4est_locidx_t     *locidx_data;
+#endif
+  p4est_locidx_t      Npoints;
+  p4est_locidx_t      il;
+  P4EST_VTK_FLOAT_TYPE *float_data;
+
+  P4EST_ASSERT (filename != NULL);
+  P4EST_ASSERT (mesh != NULL);
+
+  cont->num_cells = Ncells = mesh->num_cells;
+  cont->num_corners = Ncorners = mesh->num_corners;
+  cont->num_points = Npoints = mesh->num_points;
+  P4EST_ASSERT (Ncorners == P4EST_CHILDREN * Ncells);
+
+  if (p4est_vtk_open_piece (cont, Npoints, Ncells)) {
+    p4est_vtk_context_destroy (cont);
+    return NULL;
+  }
+  fprintf (cont->vtufile, "      <Points>\n");
+
+  float_data = P4EST_ALLOC (P4EST_VTK_FLOAT_TYPE, 3 * Npoints);
+  for (il = 0; il < 3 * Npoints; ++il) {
+    float_data[il] = (P4EST_VTK_FLOAT_TYPE) mesh->coordinates[il];
+  }
+
+  /* write point position data */
+  fprintf (cont->vtufile, "        <DataArray type=\"%s\" Name=\"Position\""
+           " NumberOfComponents=\"3\" format=\"%s\">\n",
+           P4EST_VTK_FLOAT_NAME, P4EST_VTK_FORMAT_STRING);
 
 #ifdef P4EST_VTK_ASCII
   for (il = 0; il < Npoints; ++il) {
@@ -649,7 +1384,7 @@ p4est_vtk_write_header (p4est_vtk_context_t * cont)
    * the chunk that will be passed to zlib and do this a chunk
    * at a time.
    */
-  retval = p4est_vtk_write_binary (cont->vtufile, (char *) float_data,
+  retval = p4est_vtk_write_binary (cont, (char *) float_data,
                                    sizeof (*float_data) * 3 * Npoints);
   fprintf (cont->vtufile, "\n");
   if (retval) {
@@ -673,28 +1408,15 @@ p4est_vtk_write_header (p4est_vtk_context_t * cont)
   for (sk = 0, il = 0; il < Ncells; ++il) {
     fprintf (cont->vtufile, "         ");
     for (k = 0; k < P4EST_CHILDREN; ++sk, ++k) {
-      fprintf (cont->vtufile, " %lld", nodes == NULL ?
-               (long long) sk : (long long) nodes->local_nodes[sk]);
+      fprintf (cont->vtufile, " %lld", (long long) mesh->connectivity[sk]);
     }
     fprintf (cont->vtufile, "\n");
   }
 #else
   fprintf (cont->vtufile, "          ");
-  if (nodes == NULL) {
-    locidx_data = P4EST_ALLOC (p4est_locidx_t, Ncorners);
-    for (il = 0; il < Ncorners; ++il) {
-      locidx_data[il] = il;
-    }
-    retval =
-      p4est_vtk_write_binary (cont->vtufile, (char *) locidx_data,
-                              sizeof (p4est_locidx_t) * Ncorners);
-    P4EST_FREE (locidx_data);
-  }
-  else {
-    retval =
-      p4est_vtk_write_binary (cont->vtufile, (char *) nodes->local_nodes,
-                              sizeof (p4est_locidx_t) * Ncorners);
-  }
+  retval =
+    p4est_vtk_write_binary (cont, (char *) mesh->connectivity,
+                            sizeof (p4est_locidx_t) * Ncorners);
   fprintf (cont->vtufile, "\n");
   if (retval) {
     P4EST_LERROR (P4EST_STRING "_vtk: Error encoding connectivity\n");
@@ -721,7 +1443,7 @@ p4est_vtk_write_header (p4est_vtk_context_t * cont)
     locidx_data[il - 1] = P4EST_CHILDREN * il;  /* same type */
 
   fprintf (cont->vtufile, "          ");
-  retval = p4est_vtk_write_binary (cont->vtufile, (char *) locidx_data,
+  retval = p4est_vtk_write_binary (cont, (char *) locidx_data,
                                    sizeof (p4est_locidx_t) * Ncells);
   fprintf (cont->vtufile, "\n");
 
@@ -752,7 +1474,7 @@ p4est_vtk_write_header (p4est_vtk_context_t * cont)
     uint8_data[il] = P4EST_VTK_CELL_TYPE;
 
   fprintf (cont->vtufile, "          ");
-  retval = p4est_vtk_write_binary (cont->vtufile, (char *) uint8_data,
+  retval = p4est_vtk_write_binary (cont, (char *) uint8_data,
                                    sizeof (*uint8_data) * Ncells);
   fprintf (cont->vtufile, "\n");
 
@@ -774,7 +1496,7 @@ p4est_vtk_write_header (p4est_vtk_context_t * cont)
   }
 
   /* Only have the root write to the parallel vtk file */
-  if (mpirank == 0) {
+  if (mpirank == 0 && !cont->single_file) {
     snprintf (cont->pvtufilename, BUFSIZ, "%s.pvtu", filename);
 
     cont->pvtufile = fopen (cont->pvtufilename, "wb");
@@ -821,15 +1543,60 @@ p4est_vtk_write_header (p4est_vtk_context_t * cont)
     }
   }
 
-  /* the nodes object is no longer needed */
-  if (nodes != NULL) {
-    p4est_nodes_destroy (cont->nodes);
-    cont->nodes = NULL;
+  return cont;
+}
+
+p4est_vtk_context_t *
+p4est_vtk_write_header (p4est_vtk_context_t * cont)
+{
+  p4est_vtk_mesh_t   *mesh;
+
+  /* check a whole bunch of assertions, here and below */
+  P4EST_ASSERT (cont != NULL);
+  P4EST_ASSERT (!cont->writing);
+  P4EST_ASSERT (cont->p4est != NULL);
+
+  /* from now on this context is officially in use for writing */
+  cont->writing = 1;
+
+  /* the points and their connectivity are shared with in-memory meshes */
+  if (cont->max_level >= 0) {
+    p4est_vtk_truncate (cont);
   }
+  mesh = p4est_vtk_mesh_build (cont->p4est, cont->geom, cont->scale,
+                               cont->continuous, cont->lnodes, cont->cells);
+
+  /* the context keeps the map from points to corners for the point data */
+  cont->node_to_corner = mesh->point_to_corner;
+  mesh->point_to_corner = NULL;
 
+  cont = p4est_vtk_write_mesh (cont, mesh);
+  p4est_vtk_mesh_destroy (mesh);
   return cont;
 }
 
+p4est_vtk_context_t *
+p4est_vtk_write_header_mesh (p4est_vtk_context_t * cont,
+                             const p4est_vtk_mesh_t * mesh)
+{
+  P4EST_ASSERT (cont != NULL);
+  P4EST_ASSERT (!cont->writing);
+  P4EST_ASSERT (mesh != NULL);
+  SC_CHECK_ABORT (cont->max_level < 0, P4EST_STRING
+                  "_vtk: A given mesh cannot be truncated");
+
+  cont->writing = 1;
+
+  /* point data refers to the first corner of every point */
+  if (mesh->point_to_corner != NULL) {
+    cont->node_to_corner = P4EST_ALLOC (p4est_locidx_t,
+                                        SC_MAX (mesh->num_points, 1));
+    memcpy (cont->node_to_corner, mesh->point_to_corner,
+            mesh->num_points * sizeof (p4est_locidx_t));
+  }
+  return p4est_vtk_write_mesh (cont, mesh);
+}
+
 #ifdef P4_TO_P8
 /* Based on
  * https://github.com/Kitware/VTK/blob/99770c75c2df471c456323d66a4a0bd154cf3a82
@@ -924,25 +1691,38 @@ point_index_from_ijk (int i, int j, const int *order)
 }
 #endif
 
-p4est_vtk_context_t *
-p4est_vtk_write_header_ho (p4est_vtk_context_t * cont, sc_array_t * positions,
-                           int Nnodes1D)
+/** Write the VTK header for higher order visualization.
+ * The point coordinates are taken from \a positions if it is not NULL
+ * and otherwise produced for one element at a time by \a points_fn.
+ * Binary output is encoded while the elements are traversed, such that
+ * no array proportional to the number of points is allocated.
+ */
+static p4est_vtk_context_t *
+p4est_vtk_write_header_ho_points (p4est_vtk_context_t * cont,
+                                  sc_array_t * positions,
+                                  p4est_vtk_ho_points_t points_fn,
+                                  void *user, int Nnodes1D)
 {
-  /* positions in order of: x,y,z,x,y,z */
   int                 mpirank;
   const char         *filename;
   p4est_locidx_t      Ncells;
   p4est_t            *p4est;
-  p4est_locidx_t     *locidx_data;
+  p4est_tree_t       *tree;
+  p4est_topidx_t      jt;
+  size_t              zz;
+  double             *xyz;
+  const double       *pos;
+  p4est_locidx_t     *locidx_data, *ijk_to_point;
 #ifdef P4EST_VTK_ASCII
-  double              wx, wy, wz = 0.;
+  p4est_locidx_t      pk;
 #else
   P4EST_VTK_FLOAT_TYPE *float_data;
   int                 retval;
   uint8_t            *uint8_data;
+  p4est_vtk_stream_t  stream;
 #endif
   int                 i, j;
-#if defined P4_TO_P8 || defined P4EST_VTK_ASCII
+#ifdef P4_TO_P8
   int                 k;
 #endif
   int                 order[P4EST_DIM];
@@ -952,6 +1732,8 @@ p4est_vtk_write_header_ho (p4est_vtk_context_t * cont, sc_array_t * positions,
   /* check a whole bunch of assertions, here and below */
   P4EST_ASSERT (cont != NULL);
   P4EST_ASSERT (!cont->writing);
+  P4EST_ASSERT ((positions == NULL) != (points_fn == NULL));
+  P4EST_ASSERT (Nnodes1D >= 2);
 
   /* from now on this context is officially in use for writing */
   cont->writing = 1;
@@ -966,8 +1748,10 @@ p4est_vtk_write_header_ho (p4est_vtk_context_t * cont, sc_array_t * positions,
   mpirank = p4est->mpirank;
   Ncells = p4est->local_num_quadrants;
 
+  SC_CHECK_ABORT (cont->max_level < 0, P4EST_STRING
+                  "_vtk: Higher order output cannot be truncated");
+  cont->num_cells = Ncells;
   cont->num_corners = P4EST_CHILDREN * Ncells;
-  cont->nodes = NULL;
 #ifdef P4_TO_P8
   Npointscell = Nnodes1D * Nnodes1D * Nnodes1D;
 #else
@@ -975,34 +1759,14 @@ p4est_vtk_write_header_ho (p4est_vtk_context_t * cont, sc_array_t * positions,
 #endif
   cont->num_points = Npoints = Npointscell * Ncells;
   cont->node_to_corner = NULL;
+  P4EST_ASSERT (positions == NULL ||
+                (positions->elem_size == sizeof (double) &&
+                 positions->elem_count >= (size_t) P4EST_DIM * Npoints));
 
-  /* Have each proc write to its own file */
-  snprintf (cont->vtufilename, BUFSIZ, "%s_%04d.vtu", filename, mpirank);
-  /* Use "w" for writing the initial part of the file.
-   * For further parts, use "r+" and fseek so write_compressed succeeds.
-   */
-  cont->vtufile = fopen (cont->vtufilename, "wb");
-  if (cont->vtufile == NULL) {
-    P4EST_LERRORF ("Could not open %s for output\n", cont->vtufilename);
+  if (p4est_vtk_open_piece (cont, Npoints, Ncells)) {
     p4est_vtk_context_destroy (cont);
     return NULL;
   }
-
-  fprintf (cont->vtufile, "<?xml version=\"1.0\"?>\n");
-  fprintf (cont->vtufile,
-           "<VTKFile type=\"UnstructuredGrid\" version=\"0.1\"");
-#if defined P4EST_ENABLE_VTK_BINARY && defined P4EST_ENABLE_VTK_COMPRESSION
-  fprintf (cont->vtufile, " compressor=\"vtkZLibDataCompressor\"");
-#endif
-#ifdef SC_IS_BIGENDIAN
-  fprintf (cont->vtufile, " byte_order=\"BigEndian\">\n");
-#else
-  fprintf (cont->vtufile, " byte_order=\"LittleEndian\">\n");
-#endif
-  fprintf (cont->vtufile, "  <UnstructuredGrid>\n");
-  fprintf (cont->vtufile,
-           "    <Piece NumberOfPoints=\"%lld\" NumberOfCells=\"%lld\">\n",
-           (long long) Npoints, (long long) Ncells);
   fprintf (cont->vtufile, "      <Points>\n");
 
   /* write point position data */
@@ -1010,48 +1774,66 @@ p4est_vtk_write_header_ho (p4est_vtk_context_t * cont, sc_array_t * positions,
            " NumberOfComponents=\"3\" format=\"%s\">\n",
            P4EST_VTK_FLOAT_NAME, P4EST_VTK_FORMAT_STRING);
 
-#ifdef P4EST_VTK_ASCII
-  for (il = 0; il < Npoints; ++il) {
-    wx = *(double *) sc_array_index (positions, (il * P4EST_DIM));
-    wy = *(double *) sc_array_index (positions, (il * P4EST_DIM) + 1);
-#ifdef P4_TO_P8
-    wz = *(double *) sc_array_index (positions, (il * P4EST_DIM) + 2);
+  /* the coordinates of one element at a time, z = 0 in 2D by default */
+  xyz = P4EST_ALLOC_ZERO (double, 3 * Npointscell);
+#ifndef P4EST_VTK_ASCII
+  float_data = P4EST_ALLOC (P4EST_VTK_FLOAT_TYPE, 3 * Npointscell);
+  fprintf (cont->vtufile, "          ");
+  p4est_vtk_stream_begin (&stream, cont, sizeof (*float_data) * 3 * Npoints);
+  retval = 0;
 #endif
-
-    fprintf (cont->vtufile,
+  for (il = 0, jt = p4est->first_local_tree;
+       jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++il) {
+      if (positions != NULL) {
+        /* positions in order of: x,y,z,x,y,z */
+        pos = (const double *) positions->array +
+          (size_t) il * Npointscell * P4EST_DIM;
+        for (sk = 0; sk < Npointscell; ++sk) {
+          for (j = 0; j < P4EST_DIM; ++j) {
+            xyz[3 * sk + j] = pos[sk * P4EST_DIM + j];
+          }
+        }
+      }
+      else {
+        points_fn (p4est, jt,
+                   p4est_quadrant_array_index (&tree->quadrants, zz),
+                   Nnodes1D, xyz, user);
+      }
+#ifdef P4EST_VTK_ASCII
+      for (sk = 0; sk < Npointscell; ++sk) {
+        fprintf (cont->vtufile,
 #ifdef P4EST_ENABLE_VTK_DOUBLES
-             "     %24.16e %24.16e %24.16e\n",
+                 "     %24.16e %24.16e %24.16e\n",
 #else
-             "          %16.8e %16.8e %16.8e\n",
+                 "          %16.8e %16.8e %16.8e\n",
 #endif
-             wx, wy, wz);
-  }
+                 xyz[3 * sk], xyz[3 * sk + 1], xyz[3 * sk + 2]);
+      }
 #else
-  float_data = P4EST_ALLOC (P4EST_VTK_FLOAT_TYPE, 3 * Npoints);
-  fprintf (cont->vtufile, "          ");
-  /* TODO: Don't allocate the full size of the array, only allocate
-   * the chunk that will be passed to zlib and do this a chunk
-   * at a time.
-   */
-  for (il = 0; il < Npoints; ++il) {
-    for (j = 0; j < P4EST_DIM; ++j) {
-      float_data[il * 3 + j] = (P4EST_VTK_FLOAT_TYPE) *
-        ((double *) sc_array_index (positions, (il * P4EST_DIM) + j));
-    }
-#ifndef P4_TO_P8
-    float_data[il * 3 + 2] = 0.;
+      for (sk = 0; sk < 3 * Npointscell; ++sk) {
+        float_data[sk] = (P4EST_VTK_FLOAT_TYPE) xyz[sk];
+      }
+      if (!retval) {
+        retval = p4est_vtk_stream_write (&stream, float_data,
+                                         sizeof (*float_data) * 3 *
+                                         Npointscell);
+      }
 #endif
+    }
   }
-  retval = p4est_vtk_write_binary (cont->vtufile, (char *) float_data,
-                                   sizeof (*float_data) * 3 * Npoints);
+  P4EST_ASSERT (il == Ncells);
+  P4EST_FREE (xyz);
+#ifndef P4EST_VTK_ASCII
+  P4EST_FREE (float_data);
+  retval = p4est_vtk_stream_end (&stream, retval);
   fprintf (cont->vtufile, "\n");
   if (retval) {
     P4EST_LERROR (P4EST_STRING "_vtk: Error encoding points\n");
     p4est_vtk_context_destroy (cont);
-    P4EST_FREE (float_data);
     return NULL;
   }
-  P4EST_FREE (float_data);
 #endif
 
   fprintf (cont->vtufile, "        </DataArray>\n");
@@ -1062,43 +1844,58 @@ p4est_vtk_write_header_ho (p4est_vtk_context_t * cont, sc_array_t * positions,
   fprintf (cont->vtufile,
            "        <DataArray type=\"%s\" Name=\"connectivity\""
            " format=\"%s\">\n", P4EST_VTK_LOCIDX, P4EST_VTK_FORMAT_STRING);
-  locidx_data = P4EST_ALLOC (p4est_locidx_t, Npoints);
+
+  /* the VTK ordering of an element's points is the same for all cells */
+  ijk_to_point = P4EST_ALLOC (p4est_locidx_t, Npointscell);
   order[0] = order[1] = Nnodes1D - 1;
 #ifdef P4_TO_P8
   order[2] = order[0];
 #endif
-  for (sk = 0, il = 0; il < Ncells; ++il) {
+  sk = 0;
 #ifdef P4_TO_P8
-    for (k = 0; k < Nnodes1D; ++k) {
+  for (k = 0; k < Nnodes1D; ++k) {
 #endif
-      for (j = 0; j < Nnodes1D; ++j) {
-        for (i = 0; i < Nnodes1D; ++sk, ++i) {
-          locidx_data[il * Npointscell +
+    for (j = 0; j < Nnodes1D; ++j) {
+      for (i = 0; i < Nnodes1D; ++sk, ++i) {
+        ijk_to_point[sk] =
 #ifdef P4_TO_P8
-                      point_index_from_ijk (i, j, k, order)
+          point_index_from_ijk (i, j, k, order);
 #else
-                      point_index_from_ijk (i, j, order)
+          point_index_from_ijk (i, j, order);
 #endif
-            ] = sk;
-        }
       }
-#ifdef P4_TO_P8
     }
-#endif
+#ifdef P4_TO_P8
   }
+#endif
+  locidx_data = P4EST_ALLOC (p4est_locidx_t, Npointscell);
+#ifndef P4EST_VTK_ASCII
+  fprintf (cont->vtufile, "          ");
+  p4est_vtk_stream_begin (&stream, cont, sizeof (p4est_locidx_t) * Npoints);
+  retval = 0;
+#endif
+  for (il = 0; il < Ncells; ++il) {
+    for (sk = 0; sk < Npointscell; ++sk) {
+      locidx_data[ijk_to_point[sk]] = il * Npointscell + sk;
+    }
 #ifdef P4EST_VTK_ASCII
-  for (sk = 0, il = 0; il < Ncells; ++il) {
     fprintf (cont->vtufile, "         ");
-    for (k = 0; k < Npointscell; ++sk, ++k) {
-      fprintf (cont->vtufile, " %lld", (long long) locidx_data[sk]);
+    for (pk = 0; pk < Npointscell; ++pk) {
+      fprintf (cont->vtufile, " %lld", (long long) locidx_data[pk]);
     }
     fprintf (cont->vtufile, "\n");
-  }
 #else
-  fprintf (cont->vtufile, "          ");
-  retval =
-    p4est_vtk_write_binary (cont->vtufile, (char *) locidx_data,
-                            sizeof (p4est_locidx_t) * Npoints);
+    if (!retval) {
+      retval = p4est_vtk_stream_write (&stream, locidx_data,
+                                       sizeof (p4est_locidx_t) *
+                                       Npointscell);
+    }
+#endif
+  }
+  P4EST_FREE (locidx_data);
+  P4EST_FREE (ijk_to_point);
+#ifndef P4EST_VTK_ASCII
+  retval = p4est_vtk_stream_end (&stream, retval);
   fprintf (cont->vtufile, "\n");
   if (retval) {
     P4EST_LERROR (P4EST_STRING "_vtk: Error encoding connectivity\n");
@@ -1106,7 +1903,6 @@ p4est_vtk_write_header_ho (p4est_vtk_context_t * cont, sc_array_t * positions,
     return NULL;
   }
 #endif
-  P4EST_FREE (locidx_data);
   fprintf (cont->vtufile, "        </DataArray>\n");
 
   /* write offset data */
@@ -1126,7 +1922,7 @@ p4est_vtk_write_header_ho (p4est_vtk_context_t * cont, sc_array_t * positions,
     locidx_data[il - 1] = Npointscell * il;     /* same type */
 
   fprintf (cont->vtufile, "          ");
-  retval = p4est_vtk_write_binary (cont->vtufile, (char *) locidx_data,
+  retval = p4est_vtk_write_binary (cont, (char *) locidx_data,
                                    sizeof (p4est_locidx_t) * Ncells);
   fprintf (cont->vtufile, "\n");
 
@@ -1157,7 +1953,7 @@ p4est_vtk_write_header_ho (p4est_vtk_context_t * cont, sc_array_t * positions,
     uint8_data[il] = P4EST_VTK_CELL_TYPE_HO;
 
   fprintf (cont->vtufile, "          ");
-  retval = p4est_vtk_write_binary (cont->vtufile, (char *) uint8_data,
+  retval = p4est_vtk_write_binary (cont, (char *) uint8_data,
                                    sizeof (*uint8_data) * Ncells);
   fprintf (cont->vtufile, "\n");
 
@@ -1179,7 +1975,7 @@ p4est_vtk_write_header_ho (p4est_vtk_context_t * cont, sc_array_t * positions,
   }
 
   /* Only have the root write to the parallel vtk file */
-  if (mpirank == 0) {
+  if (mpirank == 0 && !cont->single_file) {
     snprintf (cont->pvtufilename, BUFSIZ, "%s.pvtu", filename);
 
     cont->pvtufile = fopen (cont->pvtufilename, "wb");
@@ -1229,6 +2025,25 @@ p4est_vtk_write_header_ho (p4est_vtk_context_t * cont, sc_array_t * positions,
   return cont;
 }
 
+p4est_vtk_context_t *
+p4est_vtk_write_header_ho (p4est_vtk_context_t * cont, sc_array_t * positions,
+                           int Nnodes1D)
+{
+  P4EST_ASSERT (positions != NULL);
+  return p4est_vtk_write_header_ho_points (cont, positions, NULL, NULL,
+                                           Nnodes1D);
+}
+
+p4est_vtk_context_t *
+p4est_vtk_write_header_ho_fn (p4est_vtk_context_t * cont,
+                              p4est_vtk_ho_points_t points_fn, void *user,
+                              int Nnodes1D)
+{
+  P4EST_ASSERT (points_fn != NULL);
+  return p4est_vtk_write_header_ho_points (cont, NULL, points_fn, user,
+                                           Nnodes1D);
+}
+
 /** Write VTK point data.
  *
  * This function exports custom point data to the vtk file; it is functionally
@@ -1265,13 +2080,14 @@ p4est_vtk_write_point_datav (p4est_vtk_context_t * cont,
   p4est_locidx_t      ecount;
 
   P4EST_ASSERT (cont != NULL && cont->writing);
-  P4EST_ASSERT (cont->p4est != NULL);
 
   /* This function needs to do nothing if there is no data. */
   if (!(num_point_scalars || num_point_vectors)) {
     return cont;
   }
-  mpirank = cont->p4est->mpirank;
+  mpirank = cont->mpirank;
+  SC_CHECK_ABORT (cont->cells == NULL, P4EST_STRING
+                  "_vtk: Point data cannot be written with a maximum level");
 
   /* Allocate storage to manage the data fields. */
   values = P4EST_ALLOC (sc_array_t *, num_point_all);
@@ -1380,7 +2196,7 @@ p4est_vtk_write_point_datav (p4est_vtk_context_t * cont,
   }
 
   /* Only have the root write to the parallel vtk file */
-  if (mpirank == 0) {
+  if (mpirank == 0 && !cont->single_file) {
     fprintf (cont->pvtufile, "    <PPointData>\n");
 
     all = 0;
@@ -1505,15 +2321,15 @@ p4est_vtk_write_cell_data (p4est_vtk_context_t * cont,
                            int num_cell_vectors,
                            const char *fieldnames[], sc_array_t * values[])
 {
-  const int           mpirank = cont->p4est->mpirank;
+  const int           mpirank = cont->mpirank;
   int                 retval;
   int                 i, all = 0;
   int                 scalar_strlen, vector_strlen;
-  sc_array_t         *trees = cont->p4est->trees;
+  sc_array_t         *trees = NULL;
   p4est_tree_t       *tree;
-  const p4est_topidx_t first_local_tree = cont->p4est->first_local_tree;
-  const p4est_topidx_t last_local_tree = cont->p4est->last_local_tree;
-  const p4est_locidx_t Ncells = cont->p4est->local_num_quadrants;
+  p4est_topidx_t      first_local_tree = 0, last_local_tree = -1;
+  const p4est_locidx_t Ncells = cont->num_cells;
+  p4est_locidx_t      Nvalues = Ncells;
   char                cell_scalars[BUFSIZ], cell_vectors[BUFSIZ];
   const char         *name, **names;
   size_t              num_quads, zz;
@@ -1541,6 +2357,18 @@ p4est_vtk_write_cell_data (p4est_vtk_context_t * cont,
        || num_cell_scalars || num_cell_vectors))
     return cont;
 
+  /* values are given per local leaf, which may be reduced onto the cells */
+  if (cont->p4est != NULL) {
+    trees = cont->p4est->trees;
+    first_local_tree = cont->p4est->first_local_tree;
+    last_local_tree = cont->p4est->last_local_tree;
+    Nvalues = cont->p4est->local_num_quadrants;
+  }
+  else {
+    SC_CHECK_ABORT (!write_tree && !write_level, P4EST_STRING
+                    "_vtk: Tree and level need a forest in the context");
+  }
+
   names = P4EST_ALLOC (const char *, num_cell_scalars + num_cell_vectors);
 
   /* Gather cell data. */
@@ -1559,8 +2387,7 @@ p4est_vtk_write_cell_data (p4est_vtk_context_t * cont,
                     P4EST_STRING
                     "_vtk: Error: incorrect cell scalar data type;"
                     " scalar data must contain doubles.");
-    SC_CHECK_ABORT (values[all]->elem_count ==
-                    (size_t) cont->p4est->local_num_quadrants,
+    SC_CHECK_ABORT (values[all]->elem_count == (size_t) Nvalues,
                     P4EST_STRING
                     "_vtk: Error: incorrect cell scalar data count;"
                     " scalar data must contain exactly"
@@ -1582,8 +2409,7 @@ p4est_vtk_write_cell_data (p4est_vtk_context_t * cont,
                     P4EST_STRING
                     "_vtk: Error: incorrect cell vector data type;"
                     " vector data must contain doubles.");
-    SC_CHECK_ABORT (values[all]->elem_count ==
-                    3 * (size_t) cont->p4est->local_num_quadrants,
+    SC_CHECK_ABORT (values[all]->elem_count == 3 * (size_t) Nvalues,
                     P4EST_STRING
                     "_vtk: Error: incorrect cell vector data count;"
                     " vector data must contain exactly"
@@ -1626,26 +2452,45 @@ p4est_vtk_write_cell_data (p4est_vtk_context_t * cont,
              " format=\"%s\">\n", P4EST_VTK_LOCIDX, P4EST_VTK_FORMAT_STRING);
 #ifdef P4EST_VTK_ASCII
     fprintf (cont->vtufile, "         ");
-    for (il = 0, sk = 1, jt = first_local_tree; jt <= last_local_tree; ++jt) {
-      tree = p4est_tree_array_index (trees, jt);
-      num_quads = tree->quadrants.elem_count;
-      for (zz = 0; zz < num_quads; ++zz, ++sk, ++il) {
-        fprintf (cont->vtufile, " %lld", (long long) jt);
+    if (cont->cells != NULL) {
+      for (il = 0, sk = 1; il < Ncells; ++il, ++sk) {
+        quad = p4est_quadrant_array_index (cont->cells, (size_t) il);
+        fprintf (cont->vtufile, " %lld", (long long) quad->p.which_tree);
         if (!(sk % 20) && il != (Ncells - 1))
           fprintf (cont->vtufile, "\n         ");
       }
     }
+    else {
+      for (il = 0, sk = 1, jt = first_local_tree; jt <= last_local_tree;
+           ++jt) {
+        tree = p4est_tree_array_index (trees, jt);
+        num_quads = tree->quadrants.elem_count;
+        for (zz = 0; zz < num_quads; ++zz, ++sk, ++il) {
+          fprintf (cont->vtufile, " %lld", (long long) jt);
+          if (!(sk % 20) && il != (Ncells - 1))
+            fprintf (cont->vtufile, "\n         ");
+        }
+      }
+    }
     fprintf (cont->vtufile, "\n");
 #else
-    for (il = 0, jt = first_local_tree; jt <= last_local_tree; ++jt) {
-      tree = p4est_tree_array_index (trees, jt);
-      num_quads = tree->quadrants.elem_count;
-      for (zz = 0; zz < num_quads; ++zz, ++il) {
-        locidx_data[il] = (p4est_locidx_t) jt;
+    if (cont->cells != NULL) {
+      for (il = 0; il < Ncells; ++il) {
+        quad = p4est_quadrant_array_index (cont->cells, (size_t) il);
+        locidx_data[il] = (p4est_locidx_t) quad->p.which_tree;
+      }
+    }
+    else {
+      for (il = 0, jt = first_local_tree; jt <= last_local_tree; ++jt) {
+        tree = p4est_tree_array_index (trees, jt);
+        num_quads = tree->quadrants.elem_count;
+        for (zz = 0; zz < num_quads; ++zz, ++il) {
+          locidx_data[il] = (p4est_locidx_t) jt;
+        }
       }
     }
     fprintf (cont->vtufile, "          ");
-    retval = p4est_vtk_write_binary (cont->vtufile, (char *) locidx_data,
+    retval = p4est_vtk_write_binary (cont, (char *) locidx_data,
                                      sizeof (*locidx_data) * Ncells);
     fprintf (cont->vtufile, "\n");
     if (retval) {
@@ -1671,31 +2516,50 @@ p4est_vtk_write_cell_data (p4est_vtk_context_t * cont,
              " format=\"%s\">\n", "UInt8", P4EST_VTK_FORMAT_STRING);
 #ifdef P4EST_VTK_ASCII
     fprintf (cont->vtufile, "         ");
-    for (il = 0, sk = 1, jt = first_local_tree; jt <= last_local_tree; ++jt) {
-      tree = p4est_tree_array_index (trees, jt);
-      quadrants = &tree->quadrants;
-      num_quads = quadrants->elem_count;
-      for (zz = 0; zz < num_quads; ++zz, ++sk, ++il) {
-        quad = p4est_quadrant_array_index (quadrants, zz);
+    if (cont->cells != NULL) {
+      for (il = 0, sk = 1; il < Ncells; ++il, ++sk) {
+        quad = p4est_quadrant_array_index (cont->cells, (size_t) il);
         fprintf (cont->vtufile, " %d", (int) quad->level);
         if (!(sk % 20) && il != (Ncells - 1))
           fprintf (cont->vtufile, "\n         ");
       }
     }
+    else {
+      for (il = 0, sk = 1, jt = first_local_tree; jt <= last_local_tree;
+           ++jt) {
+        tree = p4est_tree_array_index (trees, jt);
+        quadrants = &tree->quadrants;
+        num_quads = quadrants->elem_count;
+        for (zz = 0; zz < num_quads; ++zz, ++sk, ++il) {
+          quad = p4est_quadrant_array_index (quadrants, zz);
+          fprintf (cont->vtufile, " %d", (int) quad->level);
+          if (!(sk % 20) && il != (Ncells - 1))
+            fprintf (cont->vtufile, "\n         ");
+        }
+      }
+    }
     fprintf (cont->vtufile, "\n");
 #else
-    for (il = 0, jt = first_local_tree; jt <= last_local_tree; ++jt) {
-      tree = p4est_tree_array_index (trees, jt);
-      quadrants = &tree->quadrants;
-      num_quads = quadrants->elem_count;
-      for (zz = 0; zz < num_quads; ++zz, ++il) {
-        quad = p4est_quadrant_array_index (quadrants, zz);
+    if (cont->cells != NULL) {
+      for (il = 0; il < Ncells; ++il) {
+        quad = p4est_quadrant_array_index (cont->cells, (size_t) il);
         uint8_data[il] = (uint8_t) quad->level;
       }
     }
+    else {
+      for (il = 0, jt = first_local_tree; jt <= last_local_tree; ++jt) {
+        tree = p4est_tree_array_index (trees, jt);
+        quadrants = &tree->quadrants;
+        num_quads = quadrants->elem_count;
+        for (zz = 0; zz < num_quads; ++zz, ++il) {
+          quad = p4est_quadrant_array_index (quadrants, zz);
+          uint8_data[il] = (uint8_t) quad->level;
+        }
+      }
+    }
 
     fprintf (cont->vtufile, "          ");
-    retval = p4est_vtk_write_binary (cont->vtufile, (char *) uint8_data,
+    retval = p4est_vtk_write_binary (cont, (char *) uint8_data,
                                      sizeof (*uint8_data) * Ncells);
     fprintf (cont->vtufile, "\n");
 
@@ -1733,7 +2597,7 @@ p4est_vtk_write_cell_data (p4est_vtk_context_t * cont,
       locidx_data[il] = (p4est_locidx_t) wrapped_rank;
 
     fprintf (cont->vtufile, "          ");
-    retval = p4est_vtk_write_binary (cont->vtufile, (char *) locidx_data,
+    retval = p4est_vtk_write_binary (cont, (char *) locidx_data,
                                      sizeof (*locidx_data) * Ncells);
     fprintf (cont->vtufile, "\n");
 
@@ -1793,7 +2657,7 @@ p4est_vtk_write_cell_data (p4est_vtk_context_t * cont,
   }
 
   /* Only have the root write to the parallel vtk file */
-  if (mpirank == 0) {
+  if (mpirank == 0 && !cont->single_file) {
     fprintf (cont->pvtufile, "    <PCellData Scalars=\"%s\">\n",
              vtkCellDataString);
 
@@ -1953,7 +2817,7 @@ p4est_vtk_write_point (p4est_vtk_context_t * cont,
    * the chunk that will be passed to zlib and do this a chunk
    * at a time.
    */
-  retval = p4est_vtk_write_binary (cont->vtufile, (char *) float_data,
+  retval = p4est_vtk_write_binary (cont, (char *) float_data,
                                    sizeof (*float_data) * Npoints
                                    * (is_vector ? 3 : 1));
   fprintf (cont->vtufile, "\n");
@@ -1999,15 +2863,19 @@ p4est_vtk_write_cell (p4est_vtk_context_t * cont,
                       const char *field_name, sc_array_t * values,
                       int is_vector)
 {
-  const p4est_locidx_t Ncells = cont->p4est->local_num_quadrants;
+  const p4est_locidx_t Ncells = cont->num_cells;
   p4est_locidx_t      il;
 #ifndef P4EST_VTK_ASCII
   int                 retval;
   P4EST_VTK_FLOAT_TYPE *float_data;
 #endif
+  sc_array_t         *given = values;
 
   P4EST_ASSERT (cont != NULL && cont->writing);
 
+  /* the values of the leaves are reduced onto truncated cells */
+  values = p4est_vtk_reduce_cells (cont, values, is_vector ? 3 : 1);
+
   /* Write cell data. */
   fprintf (cont->vtufile, "        <DataArray type=\"%s\" %s Name=\"%s\""
            " format=\"%s\">\n",
@@ -2039,6 +2907,9 @@ p4est_vtk_write_cell (p4est_vtk_context_t * cont,
                *(double *) sc_array_index (values, 3 * il + 2));
     }
   }
+  if (values != given) {
+    sc_array_destroy (values);
+  }
 #else
   if (!is_vector) {
     float_data = P4EST_ALLOC (P4EST_VTK_FLOAT_TYPE, Ncells);
@@ -2067,12 +2938,15 @@ p4est_vtk_write_cell (p4est_vtk_context_t * cont,
    * the chunk that will be passed to zlib and do this a chunk
    * at a time.
    */
-  retval = p4est_vtk_write_binary (cont->vtufile, (char *) float_data,
+  retval = p4est_vtk_write_binary (cont, (char *) float_data,
                                    sizeof (*float_data) * Ncells
                                    * (is_vector ? 3 : 1));
   fprintf (cont->vtufile, "\n");
 
   P4EST_FREE (float_data);
+  if (values != given) {
+    sc_array_destroy (values);
+  }
 
   if (retval) {
     P4EST_LERROR (P4EST_STRING "_vtk: Error encoding scalar cell data\n");
@@ -2105,17 +2979,138 @@ p4est_vtk_write_cell_vector (p4est_vtk_context_t * cont,
   return p4est_vtk_write_cell (cont, vector_name, values, 1);
 }
 
+/** Copy the pieces of all processes into one VTU file.
+ * The offset of each piece is the prefix sum of the piece sizes,
+ * the root adds the file prologue and the last process the epilogue.
+ * \return          0 on success, -1 on error on any process.
+ */
+static int
+p4est_vtk_write_single (p4est_vtk_context_t * cont)
+{
+  int                 mpiret, count, error, gerror;
+  int                 rank = cont->mpirank;
+  int                 num_procs = cont->mpisize;
+  char                prologue[BUFSIZ];
+  const char         *epilogue = "  </UnstructuredGrid>\n</VTKFile>\n";
+  char               *buffer;
+  long                piece;
+  long long           local, offset, total;
+  size_t              prolen, epilen, pos;
+  sc_MPI_File         file;
+
+  /* the root writes the XML prologue ahead of its piece */
+  prolen = 0;
+  if (rank == 0) {
+    snprintf (prologue, BUFSIZ, "<?xml version=\"1.0\"?>\n"
+              "<VTKFile type=\"UnstructuredGrid\" version=\"0.1\"%s"
+              " byte_order=\"%s\">\n  <UnstructuredGrid>\n",
+#if defined P4EST_ENABLE_VTK_BINARY && defined P4EST_ENABLE_VTK_COMPRESSION
+              " compressor=\"vtkZLibDataCompressor\"",
+#else
+              "",
+#endif
+#ifdef SC_IS_BIGENDIAN
+              "BigEndian"
+#else
+              "LittleEndian"
+#endif
+      );
+    prolen = strlen (prologue);
+  }
+  epilen = rank == num_procs - 1 ? strlen (epilogue) : 0;
+
+  /* read back the piece from the scratch file */
+  error = 0;
+  buffer = NULL;
+  piece = ftell (cont->vtufile);
+  if (ferror (cont->vtufile) || piece < 0 ||
+      fseek (cont->vtufile, 0, SEEK_SET)) {
+    error = 1;
+    piece = 0;
+  }
+  else {
+    buffer = P4EST_ALLOC (char, prolen + (size_t) piece + epilen);
+    memcpy (buffer, prologue, prolen);
+    pos = fread (buffer + prolen, 1, (size_t) piece, cont->vtufile);
+    error = (pos != (size_t) piece);
+    memcpy (buffer + prolen + piece, epilogue, epilen);
+  }
+  local = (long long) (prolen + (size_t) piece + epilen);
+  if (local > (long long) INT_MAX) {
+    P4EST_LERROR (P4EST_STRING "_vtk: Piece too large for one write\n");
+    error = 1;
+  }
+  mpiret = sc_MPI_Allreduce (&error, &gerror, 1, sc_MPI_INT, sc_MPI_LOR,
+                             cont->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  if (gerror) {
+    P4EST_LERRORF (P4EST_STRING "_vtk: Error collecting %s\n",
+                   cont->vtufilename);
+    P4EST_FREE (buffer);
+    return -1;
+  }
+
+  /* the piece offsets are an exclusive prefix sum of the sizes */
+  offset = 0;
+  mpiret = sc_MPI_Exscan (&local, &offset, 1, sc_MPI_LONG_LONG_INT,
+                          sc_MPI_SUM, cont->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  if (rank == 0) {
+    offset = 0;
+  }
+  mpiret = sc_MPI_Allreduce (&local, &total, 1, sc_MPI_LONG_LONG_INT,
+                             sc_MPI_SUM, cont->mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  /* all processes write their piece at once */
+  mpiret = sc_io_open (cont->mpicomm, cont->vtufilename,
+                       SC_IO_WRITE_CREATE, sc_MPI_INFO_NULL, &file);
+  error = (mpiret != sc_MPI_SUCCESS);
+  if (!error) {
+#ifdef P4EST_ENABLE_MPIIO
+    /* a previous file of the same name may have been longer */
+    mpiret = MPI_File_set_size (file, (MPI_Offset) total);
+    error = (mpiret != sc_MPI_SUCCESS);
+#endif
+    mpiret = sc_io_write_at_all (file, (sc_MPI_Offset) offset, buffer,
+                                 (int) local, sc_MPI_BYTE, &count);
+    error = error || mpiret != sc_MPI_SUCCESS || count != (int) local;
+    mpiret = sc_io_close (&file);
+    error = error || mpiret != sc_MPI_SUCCESS;
+  }
+  P4EST_FREE (buffer);
+
+  mpiret = sc_MPI_Allreduce (&error, &gerror, 1, sc_MPI_INT, sc_MPI_LOR,
+                             cont->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  if (gerror) {
+    P4EST_LERRORF (P4EST_STRING "_vtk: Error writing %s\n",
+                   cont->vtufilename);
+    return -1;
+  }
+  return 0;
+}
+
 int
 p4est_vtk_write_footer (p4est_vtk_context_t * cont)
 {
   int                 p;
-  int                 procRank = cont->p4est->mpirank;
-  int                 numProcs = cont->p4est->mpisize;
+  int                 procRank = cont->mpirank;
+  int                 numProcs = cont->mpisize;
   char               *filename_basename, filename_cpy[BUFSIZ];
 
   P4EST_ASSERT (cont != NULL && cont->writing);
 
   fprintf (cont->vtufile, "    </Piece>\n");
+  if (cont->single_file) {
+    /* the remainder of the file is written collectively */
+    if (p4est_vtk_write_single (cont)) {
+      p4est_vtk_context_destroy (cont);
+      return -1;
+    }
+    p4est_vtk_context_destroy (cont);
+    return 0;
+  }
   fprintf (cont->vtufile, "  </UnstructuredGrid>\n");
   fprintf (cont->vtufile, "</VTKFile>\n");
 
@@ -2166,3 +3161,397 @@ p4est_vtk_write_footer (p4est_vtk_context_t * cont)
 
   return 0;
 }
+
+#ifdef P4EST_WITH_HDF5
+
+/** Context for writing one VTKHDF file with parallel HDF5.
+ * Each process writes its local quadrants as one partition of the file.
+ */
+struct p4est_vtk_hdf5
+{
+  p4est_t            *p4est;       /**< The p4est structure must be alive. */
+  char               *filename;    /**< Copied for error reporting. */
+  hid_t               file;        /**< The HDF5 file. */
+  hid_t               root;        /**< The VTKHDF group. */
+  hid_t               cell_data;   /**< Group of the cell fields. */
+  hid_t               point_data;  /**< Group of the point fields. */
+};
+
+/** Close all HDF5 objects and free the context. */
+static void
+p4est_vtk_hdf5_destroy (p4est_vtk_hdf5_t * h5)
+{
+  if (h5->point_data >= 0) {
+    H5Gclose (h5->point_data);
+  }
+  if (h5->cell_data >= 0) {
+    H5Gclose (h5->cell_data);
+  }
+  if (h5->root >= 0) {
+    H5Gclose (h5->root);
+  }
+  if (h5->file >= 0) {
+    H5Fclose (h5->file);
+  }
+  P4EST_FREE (h5->filename);
+  P4EST_FREE (h5);
+}
+
+/** Agree on the failure of a collective operation.
+ * \return          True if it failed on any process; then the context
+ *                  has been destroyed.
+ */
+static int
+p4est_vtk_hdf5_check (p4est_vtk_hdf5_t * h5, int failed, const char *what)
+{
+  int                 mpiret, gfailed;
+
+  mpiret = sc_MPI_Allreduce (&failed, &gfailed, 1, sc_MPI_INT, sc_MPI_LOR,
+                             h5->p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  if (gfailed) {
+    P4EST_LERRORF (P4EST_STRING "_vtk: Error %s in %s\n", what,
+                   h5->filename);
+    p4est_vtk_hdf5_destroy (h5);
+    return 1;
+  }
+  return 0;
+}
+
+/** Write the rows of this process into a new dataset.
+ * The dataset is one-dimensional if \a num_components is 1.
+ * \return          0 on success, nonzero on error.
+ */
+static int
+p4est_vtk_hdf5_dataset (hid_t loc, const char *name, hid_t type,
+                        hsize_t global_rows, hsize_t num_components,
+                        hsize_t row_offset, hsize_t local_rows,
+                        const void *data)
+{
+  int                 failed;
+  const int           ndims = num_components == 1 ? 1 : 2;
+  hsize_t             dims[2], start[2], count[2];
+  hid_t               filespace, memspace, dset, dxpl;
+
+  dims[0] = global_rows;
+  dims[1] = num_components;
+  start[0] = row_offset;
+  start[1] = 0;
+  count[0] = local_rows;
+  count[1] = num_components;
+
+  filespace = H5Screate_simple (ndims, dims, NULL);
+  memspace = H5Screate_simple (ndims, count, NULL);
+  if (local_rows > 0) {
+    H5Sselect_hyperslab (filespace, H5S_SELECT_SET, start, NULL, count,
+                         NULL);
+  }
+  else {
+    H5Sselect_none (filespace);
+    H5Sselect_none (memspace);
+  }
+  dxpl = H5Pcreate (H5P_DATASET_XFER);
+#ifdef P4EST_ENABLE_MPI
+  H5Pset_dxpl_mpio (dxpl, H5FD_MPIO_COLLECTIVE);
+#endif
+
+  dset = H5Dcreate2 (loc, name, type, filespace,
+                     H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+  failed = dset < 0;
+  if (!failed) {
+    failed = H5Dwrite (dset, type, memspace, filespace, dxpl, data) < 0;
+    H5Dclose (dset);
+  }
+  H5Pclose (dxpl);
+  H5Sclose (memspace);
+  H5Sclose (filespace);
+  return failed;
+}
+
+/** Write the VTKHDF attributes of the root group.
+ * \return          0 on success, nonzero on error.
+ */
+static int
+p4est_vtk_hdf5_attributes (hid_t root)
+{
+  const char         *type_name = "UnstructuredGrid";
+  const int           version[2] = { 1, 0 };
+  int                 failed;
+  hsize_t             two = 2;
+  hid_t               type, space, attr;
+
+  space = H5Screate_simple (1, &two, NULL);
+  attr = H5Acreate2 (root, "Version", H5T_NATIVE_INT, space,
+                     H5P_DEFAULT, H5P_DEFAULT);
+  failed = attr < 0 || H5Awrite (attr, H5T_NATIVE_INT, version) < 0;
+  if (attr >= 0) {
+    H5Aclose (attr);
+  }
+  H5Sclose (space);
+
+  /* readers expect a fixed-length ASCII string */
+  type = H5Tcopy (H5T_C_S1);
+  H5Tset_size (type, strlen (type_name));
+  H5Tset_strpad (type, H5T_STR_NULLPAD);
+  space = H5Screate (H5S_SCALAR);
+  attr = H5Acreate2 (root, "Type", type, space, H5P_DEFAULT, H5P_DEFAULT);
+  failed = attr < 0 || H5Awrite (attr, type, type_name) < 0 || failed;
+  if (attr >= 0) {
+    H5Aclose (attr);
+  }
+  H5Sclose (space);
+  H5Tclose (type);
+  return failed;
+}
+
+p4est_vtk_hdf5_t   *
+p4est_vtk_hdf5_open (p4est_t * p4est, p4est_geometry_t * geom,
+                     double scale, const char *filename)
+{
+  int                 failed;
+  int                *int_data;
+  int64_t             sizes[3], *int64_data;
+  uint8_t            *uint8_data;
+  hsize_t             num_cells, cell_offset, total_cells;
+  hsize_t             num_procs, rank;
+  hid_t               fapl;
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      il, ncells;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *quad;
+  double             *float_data;
+  p4est_vtk_hdf5_t   *h5;
+
+  P4EST_ASSERT (p4est != NULL);
+  P4EST_ASSERT (filename != NULL);
+  P4EST_ASSERT (0. < scale && scale <= 1.);
+  if (geom == NULL) {
+    SC_CHECK_ABORT (p4est->connectivity->num_vertices > 0,
+                    "Must provide connectivity with vertex information");
+  }
+
+  h5 = P4EST_ALLOC (p4est_vtk_hdf5_t, 1);
+  h5->p4est = p4est;
+  h5->filename = P4EST_STRDUP (filename);
+  h5->file = h5->root = h5->cell_data = h5->point_data = -1;
+
+  fapl = H5Pcreate (H5P_FILE_ACCESS);
+#ifdef P4EST_ENABLE_MPI
+  H5Pset_fapl_mpio (fapl, p4est->mpicomm, sc_MPI_INFO_NULL);
+#endif
+  h5->file = H5Fcreate (filename, H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
+  H5Pclose (fapl);
+  if (h5->file >= 0) {
+    h5->root = H5Gcreate2 (h5->file, "VTKHDF", H5P_DEFAULT, H5P_DEFAULT,
+                           H5P_DEFAULT);
+  }
+  if (h5->root >= 0) {
+    h5->cell_data = H5Gcreate2 (h5->root, "CellData", H5P_DEFAULT,
+                                H5P_DEFAULT, H5P_DEFAULT);
+    h5->point_data = H5Gcreate2 (h5->root, "PointData", H5P_DEFAULT,
+                                 H5P_DEFAULT, H5P_DEFAULT);
+  }
+  failed = h5->cell_data < 0 || h5->point_data < 0 ||
+    p4est_vtk_hdf5_attributes (h5->root);
+  if (p4est_vtk_hdf5_check (h5, failed, "creating the file")) {
+    return NULL;
+  }
+
+  /* every process is one partition of the unstructured grid */
+  ncells = p4est->local_num_quadrants;
+  num_cells = (hsize_t) ncells;
+  cell_offset = (hsize_t) p4est->global_first_quadrant[p4est->mpirank];
+  total_cells = (hsize_t) p4est->global_num_quadrants;
+  num_procs = (hsize_t) p4est->mpisize;
+  rank = (hsize_t) p4est->mpirank;
+
+  sizes[0] = P4EST_CHILDREN * (int64_t) ncells;
+  sizes[1] = (int64_t) ncells;
+  sizes[2] = P4EST_CHILDREN * (int64_t) ncells;
+  failed = p4est_vtk_hdf5_dataset (h5->root, "NumberOfPoints",
+                                   H5T_NATIVE_INT64, num_procs, 1, rank, 1,
+                                   &sizes[0]);
+  failed = p4est_vtk_hdf5_dataset (h5->root, "NumberOfCells",
+                                   H5T_NATIVE_INT64, num_procs, 1, rank, 1,
+                                   &sizes[1]) || failed;
+  failed = p4est_vtk_hdf5_dataset (h5->root, "NumberOfConnectivityIds",
+                                   H5T_NATIVE_INT64, num_procs, 1, rank, 1,
+                                   &sizes[2]) || failed;
+
+  /* every quadrant has its own corners as in the scaled XML output */
+  float_data = P4EST_ALLOC (double, 3 * P4EST_CHILDREN * num_cells);
+  p4est_vtk_corner_positions (p4est, geom, scale, NULL, float_data);
+  failed = p4est_vtk_hdf5_dataset (h5->root, "Points", H5T_NATIVE_DOUBLE,
+                                   P4EST_CHILDREN * total_cells, 3,
+                                   P4EST_CHILDREN * cell_offset,
+                                   P4EST_CHILDREN * num_cells, float_data)
+    || failed;
+  P4EST_FREE (float_data);
+
+  /* the connectivity ids are local to each partition */
+  int64_data = P4EST_ALLOC (int64_t, P4EST_CHILDREN * num_cells + 1);
+  for (il = 0; il < P4EST_CHILDREN * ncells; ++il) {
+    int64_data[il] = (int64_t) il;
+  }
+  failed = p4est_vtk_hdf5_dataset (h5->root, "Connectivity",
+                                   H5T_NATIVE_INT64,
+                                   P4EST_CHILDREN * total_cells, 1,
+                                   P4EST_CHILDREN * cell_offset,
+                                   P4EST_CHILDREN * num_cells, int64_data)
+    || failed;
+  for (il = 0; il <= ncells; ++il) {
+    int64_data[il] = P4EST_CHILDREN * (int64_t) il;
+  }
+  failed = p4est_vtk_hdf5_dataset (h5->root, "Offsets", H5T_NATIVE_INT64,
+                                   total_cells + num_procs, 1,
+                                   cell_offset + rank, num_cells + 1,
+                                   int64_data) || failed;
+  P4EST_FREE (int64_data);
+
+  uint8_data = P4EST_ALLOC (uint8_t, num_cells);
+  for (il = 0; il < ncells; ++il) {
+    uint8_data[il] = P4EST_VTK_CELL_TYPE;
+  }
+  failed = p4est_vtk_hdf5_dataset (h5->root, "Types", H5T_NATIVE_UINT8,
+                                   total_cells, 1, cell_offset, num_cells,
+                                   uint8_data) || failed;
+  P4EST_FREE (uint8_data);
+
+  /* the tree, level and rank of each quadrant */
+  int_data = P4EST_ALLOC (int, 2 * num_cells);
+  for (jt = p4est->first_local_tree, il = 0;
+       jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++il) {
+      quad = p4est_quadrant_array_index (&tree->quadrants, zz);
+      int_data[il] = (int) jt;
+      int_data[ncells + il] = (int) quad->level;
+    }
+  }
+  P4EST_ASSERT (il == ncells);
+  failed = p4est_vtk_hdf5_dataset (h5->cell_data, "treeid", H5T_NATIVE_INT,
+                                   total_cells, 1, cell_offset, num_cells,
+                                   int_data) || failed;
+  failed = p4est_vtk_hdf5_dataset (h5->cell_data, "level", H5T_NATIVE_INT,
+                                   total_cells, 1, cell_offset, num_cells,
+                                   int_data + ncells) || failed;
+  for (il = 0; il < ncells; ++il) {
+    int_data[il] = p4est->mpirank;
+  }
+  failed = p4est_vtk_hdf5_dataset (h5->cell_data, "mpirank", H5T_NATIVE_INT,
+                                   total_cells, 1, cell_offset, num_cells,
+                                   int_data) || failed;
+  P4EST_FREE (int_data);
+
+  if (p4est_vtk_hdf5_check (h5, failed, "writing the grid")) {
+    return NULL;
+  }
+  return h5;
+}
+
+p4est_vtk_hdf5_t   *
+p4est_vtk_hdf5_write_cell_data (p4est_vtk_hdf5_t * h5, const char *name,
+                                int num_components, sc_array_t * values)
+{
+  int                 failed;
+  p4est_t            *p4est = h5->p4est;
+
+  P4EST_ASSERT (name != NULL);
+  P4EST_ASSERT (num_components >= 1);
+  P4EST_ASSERT (values != NULL && values->elem_size == sizeof (double));
+  P4EST_ASSERT (values->elem_count ==
+                (size_t) num_components * p4est->local_num_quadrants);
+
+  failed = p4est_vtk_hdf5_dataset
+    (h5->cell_data, name, H5T_NATIVE_DOUBLE,
+     (hsize_t) p4est->global_num_quadrants, (hsize_t) num_components,
+     (hsize_t) p4est->global_first_quadrant[p4est->mpirank],
+     (hsize_t) p4est->local_num_quadrants, values->array);
+  if (p4est_vtk_hdf5_check (h5, failed, "writing cell data")) {
+    return NULL;
+  }
+  return h5;
+}
+
+p4est_vtk_hdf5_t   *
+p4est_vtk_hdf5_write_point_data (p4est_vtk_hdf5_t * h5, const char *name,
+                                 int num_components, sc_array_t * values)
+{
+  int                 failed;
+  p4est_t            *p4est = h5->p4est;
+
+  P4EST_ASSERT (name != NULL);
+  P4EST_ASSERT (num_components >= 1);
+  P4EST_ASSERT (values != NULL && values->elem_size == sizeof (double));
+  P4EST_ASSERT (values->elem_count == (size_t) num_components *
+                P4EST_CHILDREN * p4est->local_num_quadrants);
+
+  failed = p4est_vtk_hdf5_dataset
+    (h5->point_data, name, H5T_NATIVE_DOUBLE,
+     P4EST_CHILDREN * (hsize_t) p4est->global_num_quadrants,
+     (hsize_t) num_components,
+     P4EST_CHILDREN * (hsize_t) p4est->global_first_quadrant[p4est->mpirank],
+     P4EST_CHILDREN * (hsize_t) p4est->local_num_quadrants, values->array);
+  if (p4est_vtk_hdf5_check (h5, failed, "writing point data")) {
+    return NULL;
+  }
+  return h5;
+}
+
+int
+p4est_vtk_hdf5_close (p4est_vtk_hdf5_t * h5)
+{
+  int                 failed;
+
+  P4EST_ASSERT (h5 != NULL);
+
+  /* closing the file flushes it collectively */
+  H5Gclose (h5->point_data);
+  H5Gclose (h5->cell_data);
+  H5Gclose (h5->root);
+  h5->point_data = h5->cell_data = h5->root = -1;
+  failed = H5Fclose (h5->file) < 0;
+  h5->file = -1;
+  if (p4est_vtk_hdf5_check (h5, failed, "closing the file")) {
+    return -1;
+  }
+  p4est_vtk_hdf5_destroy (h5);
+  return 0;
+}
+
+#else
+
+p4est_vtk_hdf5_t   *
+p4est_vtk_hdf5_open (p4est_t * p4est, p4est_geometry_t * geom,
+                     double scale, const char *filename)
+{
+  P4EST_GLOBAL_LERRORF (P4EST_STRING "_vtk: Cannot write %s"
+                        " without HDF5 support\n", filename);
+  return NULL;
+}
+
+p4est_vtk_hdf5_t   *
+p4est_vtk_hdf5_write_cell_data (p4est_vtk_hdf5_t * h5, const char *name,
+                                int num_components, sc_array_t * values)
+{
+  SC_ABORT_NOT_REACHED ();
+  return NULL;
+}
+
+p4est_vtk_hdf5_t   *
+p4est_vtk_hdf5_write_point_data (p4est_vtk_hdf5_t * h5, const char *name,
+                                 int num_components, sc_array_t * values)
+{
+  SC_ABORT_NOT_REACHED ();
+  return NULL;
+}
+
+int
+p4est_vtk_hdf5_close (p4est_vtk_hdf5_t * h5)
+{
+  SC_ABORT_NOT_REACHED ();
+  return -1;
+}
+
+#endif /* P4EST_WITH_HDF5 */
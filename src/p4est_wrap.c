@@ -25,13 +25,18 @@
 #ifndef P4_TO_P8
 #include <p4est_algorithms.h>
 #include <p4est_bits.h>
+#include <p4est_search.h>
 #include <p4est_wrap.h>
 #else
 #include <p8est_algorithms.h>
 #include <p8est_bits.h>
+#include <p8est_search.h>
 #include <p8est_wrap.h>
 #endif
 
+/** Without a measured migration cost, repartition above this imbalance. */
+#define P4EST_WRAP_MONITOR_IMBALANCE 1.05
+
 static int
 refine_callback (p4est_t * p4est, p4est_topidx_t which_tree,
                  p4est_quadrant_t * q)
@@ -45,7 +50,9 @@ refine_callback (p4est_t * p4est, p4est_topidx_t which_tree,
   P4EST_ASSERT (0 <= pp->num_replaced
                 && pp->num_replaced <= pp->num_refine_flags);
 
-  /* copy current flag since we cannot be certain that refinement occurs */
+  /* copy current flag to its position after refinement */
+  /* the replace callbacks of a tree may follow all of its refine callbacks,
+     so we count the refinements here; the children's flags stay zero */
   pp->flags[old_counter] = 0;
   pp->temp_flags[old_counter + (P4EST_CHILDREN - 1) * pp->num_replaced] =
     flag & ~P4EST_WRAP_REFINE;
@@ -56,7 +63,12 @@ refine_callback (p4est_t * p4est, p4est_topidx_t which_tree,
     ++q->p.user_int;
   }
 
-  return flag & P4EST_WRAP_REFINE;
+  if ((flag & P4EST_WRAP_REFINE) && (int) q->level < P4EST_QMAXLEVEL) {
+    P4EST_ASSERT (!(flag & P4EST_WRAP_COARSEN));
+    ++pp->num_replaced;
+    return 1;
+  }
+  return 0;
 }
 
 static void
@@ -65,19 +77,10 @@ replace_on_refine (p4est_t * p4est, p4est_topidx_t which_tree,
                    int num_incoming, p4est_quadrant_t * incoming[])
 {
   p4est_wrap_t       *pp = (p4est_wrap_t *) p4est->user_pointer;
-  const p4est_locidx_t new_counter =
-    pp->inside_counter - 1 + (P4EST_CHILDREN - 1) * pp->num_replaced++;
-  const uint8_t       flag = pp->temp_flags[new_counter];
   int                 k;
 
   /* this function is only called when refinement actually happens */
   P4EST_ASSERT (num_outgoing == 1 && num_incoming == P4EST_CHILDREN);
-  P4EST_ASSERT (!(flag & (P4EST_WRAP_REFINE | P4EST_WRAP_COARSEN)));
-
-  /* we have set the first flag in the refinement callback, do the others */
-  for (k = 1; k < P4EST_CHILDREN; ++k) {
-    pp->temp_flags[new_counter + k] = flag;
-  }
 
   /* reset the counter for most recent adaptation */
   P4EST_ASSERT (pp->params.coarsen_delay >= 0);
@@ -171,6 +174,47 @@ replace_on_balance (p4est_t * p4est, p4est_topidx_t which_tree,
   }
 }
 
+/** Build the ghost layer and optionally the mesh of the current forest.
+ * Only the members that are NULL are created.
+ * The mesh is built by a full traversal in p4est_mesh_new_params.  It is
+ * not built from an iteration plan (\ref p4est_iter_plan_new), since the
+ * mesh has no constructor taking a plan, and a plan kept by the wrap would
+ * be stale whenever the forest changed.
+ * \param [in,out] ghost   Ghost layer, created if NULL.
+ * \param [in,out] mesh    Mesh, created if NULL and \a need_mesh is true.
+ * \param [in] need_mesh   If false, the mesh is not touched.
+ */
+static void
+p4est_wrap_ghost_mesh_new (p4est_wrap_t * pp, p4est_ghost_t ** ghost,
+                           p4est_mesh_t ** mesh, int need_mesh)
+{
+  P4EST_ASSERT (*mesh == NULL || *ghost != NULL);
+
+  if (*ghost == NULL) {
+    *ghost = p4est_ghost_new (pp->p4est, pp->params.mesh_params.btype);
+  }
+  if (need_mesh && *mesh == NULL) {
+    *mesh = p4est_mesh_new_params (pp->p4est, *ghost,
+                                   &pp->params.mesh_params);
+  }
+}
+
+/** Free a ghost layer and its mesh and set both to NULL.
+ * Either may be NULL already, which happens when they are built lazily.
+ */
+static void
+p4est_wrap_ghost_mesh_destroy (p4est_ghost_t ** ghost, p4est_mesh_t ** mesh)
+{
+  if (*mesh != NULL) {
+    p4est_mesh_destroy (*mesh);
+    *mesh = NULL;
+  }
+  if (*ghost != NULL) {
+    p4est_ghost_destroy (*ghost);
+    *ghost = NULL;
+  }
+}
+
 void
 p4est_wrap_params_init (p4est_wrap_params_t *params)
 {
@@ -236,9 +280,7 @@ p4est_wrap_new_p4est_params (p4est_t * p4est, p4est_wrap_params_t * params)
     p4est_wrap_params_init (&pp->params);
   }
 
-  sc_refcount_init (&pp->conn_rc, p4est_package_id);
   pp->conn = p4est->connectivity;
-  pp->conn_owner = NULL;
 
   pp->p4est_dim = P4EST_DIM;
   pp->p4est_half = P4EST_HALF;
@@ -249,9 +291,9 @@ p4est_wrap_new_p4est_params (p4est_t * p4est, p4est_wrap_params_t * params)
 
   if (!pp->params.hollow) {
     pp->flags = P4EST_ALLOC_ZERO (uint8_t, pp->p4est->local_num_quadrants);
-    pp->ghost = p4est_ghost_new (pp->p4est, pp->params.mesh_params.btype);
-    pp->mesh =
-      p4est_mesh_new_params (pp->p4est, pp->ghost, &pp->params.mesh_params);
+    if (!pp->params.lazy) {
+      p4est_wrap_ghost_mesh_new (pp, &pp->ghost, &pp->mesh, 1);
+    }
   }
 
   /* reset the data size since changing the p4est_wrap will affect p.user_int */
@@ -304,20 +346,21 @@ p4est_wrap_new_copy (p4est_wrap_t * source, size_t data_size,
   pp->params = source->params;
   pp->params.hollow = 1;
 
-  sc_refcount_init_invalid (&pp->conn_rc);
-  pp->conn_owner = (source->conn_owner != NULL ? source->conn_owner : source);
-  pp->conn = pp->conn_owner->conn;
-  sc_refcount_ref (&pp->conn_owner->conn_rc);
+  pp->conn = p4est_connectivity_ref (source->conn);
 
   pp->p4est_dim = P4EST_DIM;
   pp->p4est_half = P4EST_HALF;
   pp->p4est_faces = P4EST_FACES;
   pp->p4est_children = P4EST_CHILDREN;
   pp->params.replace_fn = replace_fn;
-  pp->p4est = p4est_copy (source->p4est, 0);
   if (data_size > 0) {
+    pp->p4est = p4est_copy (source->p4est, 0);
     p4est_reset_data (pp->p4est, data_size, NULL, NULL);
   }
+  else {
+    /* the quadrants are copied when either forest changes */
+    pp->p4est = p4est_copy_shared (source->p4est, 0);
+  }
 
   pp->weight_exponent = 0;      /* keep this even though using ALLOC_ZERO */
 
@@ -450,34 +493,16 @@ p4est_wrap_new_world (int initial_level)
 void
 p4est_wrap_destroy (p4est_wrap_t * pp)
 {
-  if (pp->mesh_aux != NULL) {
-    p4est_mesh_destroy (pp->mesh_aux);
-  }
-  if (pp->ghost_aux != NULL) {
-    p4est_ghost_destroy (pp->ghost_aux);
-  }
-
-  if (!pp->params.hollow) {
-    p4est_mesh_destroy (pp->mesh);
-    p4est_ghost_destroy (pp->ghost);
-  }
+  p4est_wrap_ghost_mesh_destroy (&pp->ghost_aux, &pp->mesh_aux);
+  p4est_wrap_ghost_mesh_destroy (&pp->ghost, &pp->mesh);
 
   P4EST_FREE (pp->flags);
   P4EST_FREE (pp->temp_flags);
 
   p4est_destroy (pp->p4est);
 
-  /* safety checks for connectivity ownership */
-  if (pp->conn_owner != NULL) {
-    /* we are a copy of a wrap and have borrowed its connectivity */
-    P4EST_ASSERT (!sc_refcount_is_active (&pp->conn_rc));
-    P4EST_EXECUTE_ASSERT_FALSE (sc_refcount_unref (&pp->conn_owner->conn_rc));
-  }
-  else {
-    /* we are the original wrap that owns the connectivity */
-    P4EST_EXECUTE_ASSERT_TRUE (sc_refcount_unref (&pp->conn_rc));
-    p4est_connectivity_destroy (pp->conn);
-  }
+  /* copies of a wrap hold their own reference to the connectivity */
+  p4est_connectivity_unref (pp->conn);
 
   P4EST_FREE (pp);
 }
@@ -488,8 +513,8 @@ p4est_wrap_set_hollow (p4est_wrap_t * pp, int hollow)
   /* Verify consistency */
   if (!pp->params.hollow) {
     P4EST_ASSERT (pp->flags != NULL);
-    P4EST_ASSERT (pp->ghost != NULL);
-    P4EST_ASSERT (pp->mesh != NULL);
+    P4EST_ASSERT (pp->params.lazy || pp->ghost != NULL);
+    P4EST_ASSERT (pp->params.lazy || pp->mesh != NULL);
   }
   else {
     P4EST_ASSERT (pp->flags == NULL);
@@ -511,17 +536,14 @@ p4est_wrap_set_hollow (p4est_wrap_t * pp, int hollow)
   if (pp->params.hollow) {
     /* Allocate the ghost, mesh, and flag members */
     pp->flags = P4EST_ALLOC_ZERO (uint8_t, pp->p4est->local_num_quadrants);
-    pp->ghost = p4est_ghost_new (pp->p4est, pp->params.mesh_params.btype);
-    pp->mesh =
-      p4est_mesh_new_params (pp->p4est, pp->ghost, &pp->params.mesh_params);
+    if (!pp->params.lazy) {
+      p4est_wrap_ghost_mesh_new (pp, &pp->ghost, &pp->mesh, 1);
+    }
   }
   else {
     /* Free and nullify the ghost, mesh, and flag members */
-    p4est_mesh_destroy (pp->mesh);
-    p4est_ghost_destroy (pp->ghost);
+    p4est_wrap_ghost_mesh_destroy (&pp->ghost, &pp->mesh);
     P4EST_FREE (pp->flags);
-    pp->ghost = NULL;
-    pp->mesh = NULL;
     pp->flags = NULL;
   }
   pp->num_refine_flags = pp->inside_counter = pp->num_replaced = 0;
@@ -548,6 +570,7 @@ p4est_wrap_set_coarsen_delay (p4est_wrap_t * pp,
   P4EST_ASSERT (p4est->data_size == 0);
 
   /* initialize delay memory in the quadrants' user field */
+  p4est_unshare_quadrants (p4est);
   for (tt = p4est->first_local_tree; tt <= p4est->last_local_tree; ++tt) {
     tree = p4est_tree_array_index (p4est->trees, tt);
     tquadrants = &tree->quadrants;
@@ -570,7 +593,12 @@ p4est_wrap_get_ghost (p4est_wrap_t * pp)
 {
   P4EST_ASSERT (!pp->params.hollow);
 
-  return pp->match_aux ? pp->ghost_aux : pp->ghost;
+  if (pp->match_aux) {
+    p4est_wrap_ghost_mesh_new (pp, &pp->ghost_aux, &pp->mesh_aux, 0);
+    return pp->ghost_aux;
+  }
+  p4est_wrap_ghost_mesh_new (pp, &pp->ghost, &pp->mesh, 0);
+  return pp->ghost;
 }
 
 p4est_mesh_t       *
@@ -578,7 +606,12 @@ p4est_wrap_get_mesh (p4est_wrap_t * pp)
 {
   P4EST_ASSERT (!pp->params.hollow);
 
-  return pp->match_aux ? pp->mesh_aux : pp->mesh;
+  if (pp->match_aux) {
+    p4est_wrap_ghost_mesh_new (pp, &pp->ghost_aux, &pp->mesh_aux, 1);
+    return pp->mesh_aux;
+  }
+  p4est_wrap_ghost_mesh_new (pp, &pp->ghost, &pp->mesh, 1);
+  return pp->mesh;
 }
 
 void
@@ -635,31 +668,119 @@ p4est_wrap_mark_coarsen (p4est_wrap_t * pp,
   pp->flags[pos] |= P4EST_WRAP_COARSEN;
 }
 
-int
-p4est_wrap_adapt (p4est_wrap_t * pp)
+void
+p4est_wrap_mark_array (p4est_wrap_t * pp, const int8_t * marks)
+{
+  const long          num = (long) pp->p4est->local_num_quadrants;
+  long                jl;
+  p4est_locidx_t      num_refine = 0;
+  uint8_t            *flags = pp->flags;
+
+  P4EST_ASSERT (!pp->params.hollow);
+  P4EST_ASSERT (num == 0 || marks != NULL);
+
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (p4est_get_num_threads ()) \
+  schedule (static) reduction (+:num_refine)
+#endif
+  for (jl = 0; jl < num; ++jl) {
+    flags[jl] = (uint8_t) ((marks[jl] > 0 ? P4EST_WRAP_REFINE : 0) |
+                           (marks[jl] < 0 ? P4EST_WRAP_COARSEN : 0));
+    num_refine += marks[jl] > 0;
+  }
+  pp->num_refine_flags = num_refine;
+}
+
+void
+p4est_wrap_mark_bitset (p4est_wrap_t * pp, const uint8_t * refine_bits,
+                        const uint8_t * coarsen_bits)
+{
+  const long          num = (long) pp->p4est->local_num_quadrants;
+  long                jl;
+  p4est_locidx_t      num_refine = 0;
+  uint8_t            *flags = pp->flags;
+
+  P4EST_ASSERT (!pp->params.hollow);
+
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (p4est_get_num_threads ()) \
+  schedule (static) reduction (+:num_refine)
+#endif
+  for (jl = 0; jl < num; ++jl) {
+    const int           bit = 1 << (jl & 7);
+    const int           refine =
+      refine_bits != NULL && (refine_bits[jl >> 3] & bit);
+    const int           coarsen =
+      coarsen_bits != NULL && (coarsen_bits[jl >> 3] & bit);
+
+    /* refinement takes precedence */
+    flags[jl] = (uint8_t) (refine ? P4EST_WRAP_REFINE :
+                           coarsen ? P4EST_WRAP_COARSEN : 0);
+    num_refine += refine;
+  }
+  pp->num_refine_flags = num_refine;
+}
+
+p4est_locidx_t
+p4est_wrap_mark_threshold (p4est_wrap_t * pp, const double *values,
+                           double refine_above, double coarsen_below)
+{
+  const long          num = (long) pp->p4est->local_num_quadrants;
+  long                jl;
+  p4est_locidx_t      num_refine = 0;
+  uint8_t            *flags = pp->flags;
+
+  P4EST_ASSERT (!pp->params.hollow);
+  P4EST_ASSERT (num == 0 || values != NULL);
+  P4EST_ASSERT (coarsen_below <= refine_above);
+
+  /* the two conditions are exclusive, so the loop body has no branches */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (p4est_get_num_threads ()) \
+  schedule (static) reduction (+:num_refine)
+#endif
+  for (jl = 0; jl < num; ++jl) {
+    const int           refine = values[jl] > refine_above;
+
+    flags[jl] = (uint8_t) (refine * P4EST_WRAP_REFINE +
+                           (values[jl] < coarsen_below) * P4EST_WRAP_COARSEN);
+    num_refine += refine;
+  }
+  pp->num_refine_flags = num_refine;
+
+  return num_refine;
+}
+
+/** Refine, coarsen and balance the forest as in p4est_wrap_adapt.
+ * The flags are reset for the adapted forest.  Ghost and mesh are not
+ * touched.
+ * \param [in,out] stage_times  If not NULL, the time of refinement and
+ *                              coarsening and of balancing is added.
+ * \return                      True if the forest has changed.
+ */
+static int
+p4est_wrap_adapt_forest (p4est_wrap_t * pp, double *stage_times)
 {
   int                 changed;
   int                 have_zlib;
+  int                 num_threads = p4est_get_num_threads ();
 #ifdef P4EST_ENABLE_DEBUG
   p4est_locidx_t      jl, local_num;
 #endif
   p4est_gloidx_t      global_num, global_num_entry;
   unsigned            checksum_entry, checksum_exit;
+  double              start;
   p4est_t            *p4est = pp->p4est;
 
   P4EST_ASSERT (!pp->params.hollow);
   P4EST_ASSERT (pp->params.coarsen_delay >= 0);
 
-  P4EST_ASSERT (pp->mesh != NULL);
-  P4EST_ASSERT (pp->ghost != NULL);
-  P4EST_ASSERT (pp->mesh_aux == NULL);
-  P4EST_ASSERT (pp->ghost_aux == NULL);
-  P4EST_ASSERT (pp->match_aux == 0);
-
   P4EST_ASSERT (pp->temp_flags == NULL);
   P4EST_ASSERT (pp->num_refine_flags >= 0 &&
                 pp->num_refine_flags <= p4est->local_num_quadrants);
 
+  start = sc_MPI_Wtime ();
+
   /* This allocation is optimistic when not all refine requests are honored */
   pp->temp_flags = P4EST_ALLOC_ZERO (uint8_t, p4est->local_num_quadrants +
                                      (P4EST_CHILDREN - 1) *
@@ -672,6 +793,9 @@ p4est_wrap_adapt (p4est_wrap_t * pp)
     checksum_entry = p4est_checksum (p4est);
   }
 
+  /* the callbacks count the quadrants in order and share the flags */
+  p4est_set_num_threads (1);
+
   /* Execute refinement */
   pp->inside_counter = pp->num_replaced = 0;
 #ifdef P4EST_ENABLE_DEBUG
@@ -697,13 +821,19 @@ p4est_wrap_adapt (p4est_wrap_t * pp)
   P4EST_ASSERT (local_num - p4est->local_num_quadrants ==
                 pp->num_replaced * (P4EST_CHILDREN - 1));
   changed = changed || global_num != p4est->global_num_quadrants;
+  p4est_set_num_threads (num_threads);
 
   /* Free temporary flags */
   P4EST_FREE (pp->temp_flags);
   pp->temp_flags = NULL;
 
+  if (stage_times != NULL) {
+    stage_times[P4EST_WRAP_STAGE_ADAPT] += sc_MPI_Wtime () - start;
+  }
+
   /* Only if refinement and/or coarsening happened do we need to balance */
   if (changed) {
+    start = sc_MPI_Wtime ();
     p4est_balance_ext (p4est, pp->params.mesh_params.btype, NULL,
                        pp->params.coarsen_delay ? replace_on_balance :
                        pp->params.replace_fn);
@@ -714,16 +844,13 @@ p4est_wrap_adapt (p4est_wrap_t * pp)
       checksum_exit = p4est_checksum (p4est);
       changed = (checksum_entry != checksum_exit);
     }
+    if (stage_times != NULL) {
+      stage_times[P4EST_WRAP_STAGE_BALANCE] += sc_MPI_Wtime () - start;
+    }
 
     if (changed) {
-      /* compute new ghost and mesh for the changed p4est */
       P4EST_FREE (pp->flags);
       pp->flags = P4EST_ALLOC_ZERO (uint8_t, p4est->local_num_quadrants);
-
-      pp->ghost_aux = p4est_ghost_new (p4est, pp->params.mesh_params.btype);
-      pp->mesh_aux =
-        p4est_mesh_new_params (p4est, pp->ghost_aux, &pp->params.mesh_params);
-      pp->match_aux = 1;
     }
     else {
       memset (pp->flags, 0,
@@ -742,6 +869,33 @@ p4est_wrap_adapt (p4est_wrap_t * pp)
   return changed;
 }
 
+int
+p4est_wrap_adapt (p4est_wrap_t * pp)
+{
+  int                 changed;
+
+  P4EST_ASSERT (pp->params.lazy || pp->mesh != NULL);
+  P4EST_ASSERT (pp->params.lazy || pp->ghost != NULL);
+  P4EST_ASSERT (pp->mesh_aux == NULL);
+  P4EST_ASSERT (pp->ghost_aux == NULL);
+  P4EST_ASSERT (pp->match_aux == 0);
+
+  changed = p4est_wrap_adapt_forest (pp, NULL);
+  if (changed) {
+    if (pp->params.lazy) {
+      /* ghost and mesh of the input forest are stale and never returned */
+      p4est_wrap_ghost_mesh_destroy (&pp->ghost, &pp->mesh);
+    }
+    else {
+      /* compute new ghost and mesh for the changed p4est */
+      p4est_wrap_ghost_mesh_new (pp, &pp->ghost_aux, &pp->mesh_aux, 1);
+    }
+    pp->match_aux = 1;
+  }
+
+  return changed;
+}
+
 static int
 partition_weight (p4est_t * p4est, p4est_topidx_t which_tree,
                   p4est_quadrant_t * quadrant)
@@ -807,19 +961,20 @@ p4est_wrap_partition (p4est_wrap_t * pp, int weight_exponent,
                       p4est_locidx_t * unchanged_old_first)
 {
   int                 changed;
+  double              start;
+  p4est_gloidx_t      shipped;
   p4est_gloidx_t      pre_me, pre_next;
   p4est_gloidx_t      post_me, post_next;
 
   P4EST_ASSERT (!pp->params.hollow);
 
-  P4EST_ASSERT (pp->ghost != NULL);
-  P4EST_ASSERT (pp->mesh != NULL);
-  P4EST_ASSERT (pp->ghost_aux != NULL);
-  P4EST_ASSERT (pp->mesh_aux != NULL);
+  P4EST_ASSERT (pp->params.lazy || pp->ghost != NULL);
+  P4EST_ASSERT (pp->params.lazy || pp->mesh != NULL);
+  P4EST_ASSERT (pp->params.lazy || pp->ghost_aux != NULL);
+  P4EST_ASSERT (pp->params.lazy || pp->mesh_aux != NULL);
   P4EST_ASSERT (pp->match_aux == 1);
 
-  p4est_mesh_destroy (pp->mesh);
-  p4est_ghost_destroy (pp->ghost);
+  p4est_wrap_ghost_mesh_destroy (&pp->ghost, &pp->mesh);
   pp->match_aux = 0;
 
   /* Remember the window onto global quadrant sequence before partition */
@@ -841,17 +996,26 @@ p4est_wrap_partition (p4est_wrap_t * pp, int weight_exponent,
   /* We need to lift the restriction on 64 bits for the global weight sum */
   P4EST_ASSERT (weight_exponent == 0 || weight_exponent == 1);
   pp->weight_exponent = weight_exponent;
-  changed =
+  start = sc_MPI_Wtime ();
+  shipped =
     p4est_partition_ext (pp->p4est, pp->params.partition_for_coarsening,
-                         weight_exponent ? partition_weight : NULL) > 0;
+                         weight_exponent ? partition_weight : NULL);
+  changed = shipped > 0;
+
+  /* the cost monitor starts over with the new partition */
+  pp->monitor_cost = 0.;
+  pp->monitor_steps = 0;
 
   if (changed) {
     P4EST_FREE (pp->flags);
     pp->flags = P4EST_ALLOC_ZERO (uint8_t, pp->p4est->local_num_quadrants);
 
-    pp->ghost = p4est_ghost_new (pp->p4est, pp->params.mesh_params.btype);
-    pp->mesh =
-      p4est_mesh_new_params (pp->p4est, pp->ghost, &pp->params.mesh_params);
+    if (!pp->params.lazy) {
+      p4est_wrap_ghost_mesh_new (pp, &pp->ghost, &pp->mesh, 1);
+    }
+
+    /* calibrate the cost of migration including the new ghost and mesh */
+    pp->monitor_migration = (sc_MPI_Wtime () - start) / (double) shipped;
 
     /* Query the window onto global quadrant sequence after partition */
     if (unchanged_first != NULL || unchanged_length != NULL ||
@@ -884,16 +1048,306 @@ p4est_wrap_complete (p4est_wrap_t * pp)
 {
   P4EST_ASSERT (!pp->params.hollow);
 
-  P4EST_ASSERT (pp->ghost != NULL);
-  P4EST_ASSERT (pp->mesh != NULL);
-  P4EST_ASSERT (pp->ghost_aux != NULL);
-  P4EST_ASSERT (pp->mesh_aux != NULL);
+  P4EST_ASSERT (pp->params.lazy || pp->ghost != NULL);
+  P4EST_ASSERT (pp->params.lazy || pp->mesh != NULL);
+  P4EST_ASSERT (pp->params.lazy || pp->ghost_aux != NULL);
+  P4EST_ASSERT (pp->params.lazy || pp->mesh_aux != NULL);
   P4EST_ASSERT (pp->match_aux == 0);
 
-  p4est_mesh_destroy (pp->mesh_aux);
-  p4est_ghost_destroy (pp->ghost_aux);
-  pp->ghost_aux = NULL;
-  pp->mesh_aux = NULL;
+  p4est_wrap_ghost_mesh_destroy (&pp->ghost_aux, &pp->mesh_aux);
+}
+
+int
+p4est_wrap_adapt_partition (p4est_wrap_t * pp, int weight_exponent,
+                            p4est_locidx_t * unchanged_first,
+                            p4est_locidx_t * unchanged_length,
+                            p4est_locidx_t * unchanged_old_first,
+                            double *stage_times)
+{
+  int                 i;
+  double              start, mark;
+  p4est_gloidx_t      shipped;
+  p4est_gloidx_t      pre_me, pre_next;
+  p4est_t            *p4est = pp->p4est;
+
+  P4EST_ASSERT (pp->params.lazy || pp->mesh != NULL);
+  P4EST_ASSERT (pp->params.lazy || pp->ghost != NULL);
+  P4EST_ASSERT (pp->mesh_aux == NULL);
+  P4EST_ASSERT (pp->ghost_aux == NULL);
+  P4EST_ASSERT (pp->match_aux == 0);
+
+  if (stage_times != NULL) {
+    for (i = 0; i < P4EST_WRAP_STAGE_COUNT; ++i) {
+      stage_times[i] = 0.;
+    }
+  }
+
+  /* Initialize output for the case that the partition does not change */
+  if (!p4est_wrap_adapt_forest (pp, stage_times)) {
+    p4est_wrap_partition_unchanged (0, p4est->local_num_quadrants,
+                                    0, p4est->local_num_quadrants,
+                                    unchanged_first, unchanged_length,
+                                    unchanged_old_first);
+    return 0;
+  }
+
+  /* the ghost and mesh of the input forest are of no further use */
+  p4est_wrap_ghost_mesh_destroy (&pp->ghost, &pp->mesh);
+
+  /* Remember the window onto global quadrant sequence before partition */
+  pre_me = p4est->global_first_quadrant[p4est->mpirank];
+  pre_next = p4est->global_first_quadrant[p4est->mpirank + 1];
+
+  /* Partition the balanced forest before building ghost and mesh */
+  P4EST_ASSERT (weight_exponent == 0 || weight_exponent == 1);
+  pp->weight_exponent = weight_exponent;
+  start = sc_MPI_Wtime ();
+  shipped =
+    p4est_partition_ext (p4est, pp->params.partition_for_coarsening,
+                         weight_exponent ? partition_weight : NULL);
+  mark = sc_MPI_Wtime ();
+  if (stage_times != NULL) {
+    stage_times[P4EST_WRAP_STAGE_PARTITION] = mark - start;
+  }
+
+  /* the cost monitor starts over with the new partition */
+  pp->monitor_cost = 0.;
+  pp->monitor_steps = 0;
+
+  if (shipped > 0) {
+    P4EST_FREE (pp->flags);
+    pp->flags = P4EST_ALLOC_ZERO (uint8_t, p4est->local_num_quadrants);
+  }
+  p4est_wrap_partition_unchanged (pre_me, pre_next,
+                                  p4est->global_first_quadrant
+                                  [p4est->mpirank],
+                                  p4est->global_first_quadrant
+                                  [p4est->mpirank + 1], unchanged_first,
+                                  unchanged_length, unchanged_old_first);
+
+  /* compute ghost and mesh once for the final forest unless lazy */
+  if (!pp->params.lazy) {
+    p4est_wrap_ghost_mesh_new (pp, &pp->ghost, &pp->mesh, 0);
+    if (stage_times != NULL) {
+      stage_times[P4EST_WRAP_STAGE_GHOST] = sc_MPI_Wtime () - mark;
+      mark = sc_MPI_Wtime ();
+    }
+    p4est_wrap_ghost_mesh_new (pp, &pp->ghost, &pp->mesh, 1);
+    if (stage_times != NULL) {
+      stage_times[P4EST_WRAP_STAGE_MESH] = sc_MPI_Wtime () - mark;
+    }
+  }
+
+  /* calibrate the cost of migration including the new ghost and mesh */
+  if (shipped > 0) {
+    pp->monitor_migration = (sc_MPI_Wtime () - start) / (double) shipped;
+  }
+
+  return 1;
+}
+
+/** Predict the weight of a quadrant after the pending adaptation.
+ * The unit is a quadrant of the next finer level, such that a family
+ * that will be coarsened weighs as much as one unchanged quadrant.
+ */
+static int
+partition_predict_weight (p4est_t * p4est, p4est_topidx_t which_tree,
+                          p4est_quadrant_t * quadrant)
+{
+  p4est_wrap_t       *pp = (p4est_wrap_t *) p4est->user_pointer;
+  const p4est_locidx_t counter = pp->inside_counter++;
+  const uint8_t       flag = pp->flags[counter];
+  int                 id, k;
+  size_t              lz;
+  sc_array_t         *quadrants;
+  p4est_quadrant_t   *family;
+
+  if (flag & P4EST_WRAP_REFINE) {
+    return P4EST_CHILDREN * P4EST_CHILDREN;
+  }
+  if (!(flag & P4EST_WRAP_COARSEN) || quadrant->level == 0) {
+    return P4EST_CHILDREN;
+  }
+
+  /* a quadrant is only coarsened together with its complete family */
+  quadrants = &p4est_tree_array_index (p4est->trees, which_tree)->quadrants;
+  lz = (size_t) (quadrant - (p4est_quadrant_t *) quadrants->array);
+  id = p4est_quadrant_child_id (quadrant);
+  if (lz < (size_t) id || lz - id + P4EST_CHILDREN > quadrants->elem_count) {
+    return P4EST_CHILDREN;
+  }
+  family = quadrant - id;
+  if (!p4est_quadrant_is_familyv (family)) {
+    return P4EST_CHILDREN;
+  }
+  for (k = 0; k < P4EST_CHILDREN; ++k) {
+    if (!(pp->flags[counter - id + k] & P4EST_WRAP_COARSEN)) {
+      return P4EST_CHILDREN;
+    }
+
+    /* the refinement pass has advanced the counter by one */
+    if (pp->params.coarsen_delay && family[k].p.user_int >= 0 &&
+        family[k].p.user_int < pp->params.coarsen_delay) {
+      return P4EST_CHILDREN;
+    }
+  }
+  return 1;
+}
+
+int
+p4est_wrap_partition_predict (p4est_wrap_t * pp,
+                              p4est_locidx_t * unchanged_first,
+                              p4est_locidx_t * unchanged_length,
+                              p4est_locidx_t * unchanged_old_first)
+{
+  double              start;
+  p4est_locidx_t      jl;
+  p4est_gloidx_t      shipped;
+  p4est_gloidx_t      pre_me, pre_next;
+  p4est_partition_data_t data;
+  p4est_t            *p4est = pp->p4est;
+
+  P4EST_ASSERT (!pp->params.hollow);
+  P4EST_ASSERT (pp->params.lazy || pp->mesh != NULL);
+  P4EST_ASSERT (pp->params.lazy || pp->ghost != NULL);
+  P4EST_ASSERT (pp->mesh_aux == NULL);
+  P4EST_ASSERT (pp->ghost_aux == NULL);
+  P4EST_ASSERT (pp->match_aux == 0);
+  P4EST_ASSERT (pp->temp_flags == NULL);
+
+  /* Remember the window onto global quadrant sequence before partition */
+  pre_me = p4est->global_first_quadrant[p4est->mpirank];
+  pre_next = p4est->global_first_quadrant[p4est->mpirank + 1];
+
+  /* the marks travel with their quadrants */
+  data.data_size = sizeof (uint8_t);
+  data.src_data = pp->flags;
+  data.src_sizes = NULL;
+  start = sc_MPI_Wtime ();
+  pp->inside_counter = 0;
+  shipped =
+    p4est_partition_ext_data (p4est, pp->params.partition_for_coarsening,
+                              partition_predict_weight, 1, &data);
+  pp->inside_counter = 0;
+  P4EST_FREE (pp->flags);
+  pp->flags = (uint8_t *) data.dest_data;
+  pp->num_refine_flags = 0;
+  for (jl = 0; jl < p4est->local_num_quadrants; ++jl) {
+    if (pp->flags[jl] & P4EST_WRAP_REFINE) {
+      ++pp->num_refine_flags;
+    }
+  }
+
+  p4est_wrap_partition_unchanged (pre_me, pre_next,
+                                  p4est->global_first_quadrant
+                                  [p4est->mpirank],
+                                  p4est->global_first_quadrant
+                                  [p4est->mpirank + 1], unchanged_first,
+                                  unchanged_length, unchanged_old_first);
+  if (shipped == 0) {
+    return 0;
+  }
+
+  /* the cost monitor starts over with the new partition */
+  pp->monitor_cost = 0.;
+  pp->monitor_steps = 0;
+
+  /* ghost and mesh describe the new partition of the unadapted forest */
+  p4est_wrap_ghost_mesh_destroy (&pp->ghost, &pp->mesh);
+  if (!pp->params.lazy) {
+    p4est_wrap_ghost_mesh_new (pp, &pp->ghost, &pp->mesh, 1);
+  }
+  pp->monitor_migration = (sc_MPI_Wtime () - start) / (double) shipped;
+
+  return 1;
+}
+
+void
+p4est_wrap_monitor_add (p4est_wrap_t * pp, double cost)
+{
+  P4EST_ASSERT (cost >= 0.);
+
+  pp->monitor_cost += cost;
+  ++pp->monitor_steps;
+}
+
+int
+p4est_wrap_monitor_check (p4est_wrap_t * pp, int horizon)
+{
+  int                 mpiret;
+  int                 p, q;
+  int                 repartition;
+  const int           num_procs = pp->p4est->mpisize;
+  const p4est_gloidx_t *gfq = pp->p4est->global_first_quadrant;
+  double              cost_sum, cost_max, cost_avg, cost_lower;
+  double              target, gain, migration;
+  double             *costs;
+  p4est_gloidx_t      cut, prev_cut, overlap, volume;
+
+  P4EST_ASSERT (horizon >= 0);
+
+  /* one allgather provides both the total and the largest cost */
+  costs = P4EST_ALLOC (double, num_procs);
+  mpiret = sc_MPI_Allgather (&pp->monitor_cost, 1, sc_MPI_DOUBLE,
+                             costs, 1, sc_MPI_DOUBLE, pp->p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  cost_sum = cost_max = 0.;
+  for (p = 0; p < num_procs; ++p) {
+    cost_sum += costs[p];
+    cost_max = SC_MAX (cost_max, costs[p]);
+  }
+  if (pp->monitor_steps == 0 || cost_sum <= 0.) {
+    P4EST_FREE (costs);
+    return 0;
+  }
+  cost_avg = cost_sum / num_procs;
+
+  /* count the quadrants p4est_partition_given would ship to equalize the
+     cost, assuming the cost is uniform among the quadrants of a process */
+  volume = 0;
+  cost_lower = 0.;
+  prev_cut = 0;
+  for (p = 1, q = 0; p <= num_procs; ++p) {
+    if (p == num_procs) {
+      cut = gfq[num_procs];
+    }
+    else {
+      target = cost_sum * p / num_procs;
+      while (q < num_procs - 1 && cost_lower + costs[q] < target) {
+        cost_lower += costs[q++];
+      }
+      cut = gfq[q];
+      if (costs[q] > 0.) {
+        cut += (p4est_gloidx_t) ((target - cost_lower) / costs[q] *
+                                 (double) (gfq[q + 1] - gfq[q]));
+      }
+      cut = SC_MAX (prev_cut, SC_MIN (cut, gfq[q + 1]));
+    }
+
+    /* quadrants that stay on process p - 1 are not shipped */
+    overlap = SC_MIN (cut, gfq[p]) - SC_MAX (prev_cut, gfq[p - 1]);
+    volume += cut - prev_cut - SC_MAX (overlap, 0);
+    prev_cut = cut;
+  }
+  P4EST_FREE (costs);
+
+  /* compare the time saved over the horizon with the cost of moving */
+  gain = (cost_max - cost_avg) / pp->monitor_steps * horizon;
+  if (pp->monitor_migration > 0.) {
+    migration = pp->monitor_migration * (double) volume;
+    repartition = gain > migration;
+  }
+  else {
+    /* without a calibration we only react to a significant imbalance */
+    migration = 0.;
+    repartition = volume > 0 &&
+      cost_max > P4EST_WRAP_MONITOR_IMBALANCE * cost_avg;
+  }
+  P4EST_GLOBAL_VERBOSEF ("Wrap monitor imbalance %g gain %g shipping %lld"
+                         " migration %g\n", cost_max / cost_avg, gain,
+                         (long long) volume, migration);
+
+  return repartition;
 }
 
 static p4est_wrap_leaf_t *
@@ -1033,3 +1487,90 @@ p4est_wrap_leaf_next (p4est_wrap_leaf_t * leaf)
 
   return p4est_wrap_leaf_info (leaf);
 }
+
+p4est_locidx_t
+p4est_wrap_leaf_batch (p4est_wrap_t * pp, p4est_locidx_t first,
+                       p4est_locidx_t max_count, p4est_topidx_t * which_tree,
+                       p4est_locidx_t * which_quad, int8_t * level,
+                       p4est_qcoord_t * coords, int8_t * is_mirror)
+{
+  p4est_t            *p4est = pp->p4est;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      count, jl, lq, tq, nq;
+  p4est_locidx_t      low, high, guess, nm, num_mirrors;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *quad, *mirror;
+  sc_array_t         *mirrors;
+
+  P4EST_ASSERT (0 <= first && first <= p4est->local_num_quadrants);
+  P4EST_ASSERT (max_count >= 0);
+
+  count = SC_MIN (max_count, p4est->local_num_quadrants - first);
+  if (count == 0) {
+    return 0;
+  }
+
+  if (is_mirror != NULL) {
+    /* binary search for the first mirror not below the range */
+    mirrors = &(p4est_wrap_get_ghost (pp))->mirrors;
+    num_mirrors = (p4est_locidx_t) mirrors->elem_count;
+    low = 0;
+    high = num_mirrors;
+    while (low < high) {
+      guess = low + (high - low) / 2;
+      mirror = p4est_quadrant_array_index (mirrors, guess);
+      if (mirror->p.piggy3.local_num < first) {
+        low = guess + 1;
+      }
+      else {
+        high = guess;
+      }
+    }
+    nm = low;
+    memset (is_mirror, 0, count * sizeof (int8_t));
+    for (; nm < num_mirrors; ++nm) {
+      mirror = p4est_quadrant_array_index (mirrors, nm);
+      lq = mirror->p.piggy3.local_num - first;
+      if (lq >= count) {
+        break;
+      }
+      is_mirror[lq] = 1;
+    }
+  }
+
+  if (which_tree == NULL && which_quad == NULL &&
+      level == NULL && coords == NULL) {
+    return count;
+  }
+
+  /* locate the tree of the first leaf, then run through the trees */
+  jt = -1;
+  (void) p4est_find_quadrant_cumulative (p4est, first, &jt, &tq);
+  for (jl = 0; jl < count; ++jt, tq = 0) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    nq = SC_MIN ((p4est_locidx_t) tree->quadrants.elem_count - tq,
+                 count - jl);
+    for (lq = 0; lq < nq; ++lq, ++jl) {
+      quad = p4est_quadrant_array_index (&tree->quadrants, tq + lq);
+      if (which_tree != NULL) {
+        which_tree[jl] = jt;
+      }
+      if (which_quad != NULL) {
+        which_quad[jl] = tq + lq;
+      }
+      if (level != NULL) {
+        level[jl] = quad->level;
+      }
+      if (coords != NULL) {
+        coords[P4EST_DIM * jl + 0] = quad->x;
+        coords[P4EST_DIM * jl + 1] = quad->y;
+#ifdef P4_TO_P8
+        coords[P4EST_DIM * jl + 2] = quad->z;
+#endif
+      }
+    }
+  }
+  P4EST_ASSERT (jl == count);
+
+  return count;
+}
@@ -30,6 +30,7 @@
 #include <p8est.h>
 #include <p4est_extended.h>
 #include <p4est_algorithms.h>
+#include <p4est_bits.h>
 #include <sc_containers.h>
 #include <p4est_communication.h>
 #include <sc_io.h>
@@ -684,6 +685,59 @@ p6est_reset_data (p6est_t * p6est, size_t data_size, p6est_init_t init_fn,
   }
 }
 
+p6est_layers_soa_t *
+p6est_layers_soa_new (p6est_t * p6est, int copy_data)
+{
+  p6est_layers_soa_t *soa = P4EST_ALLOC (p6est_layers_soa_t, 1);
+  size_t              zz, nlayers = p6est->layers->elem_count;
+  p2est_quadrant_t   *layer;
+
+  soa->num_layers = nlayers;
+  soa->data_size = copy_data ? p6est->data_size : 0;
+  soa->z = P4EST_ALLOC (p4est_qcoord_t, nlayers);
+  soa->level = P4EST_ALLOC (int8_t, nlayers);
+  soa->data = soa->data_size > 0 ?
+    P4EST_ALLOC (char, soa->data_size * nlayers) : NULL;
+
+  for (zz = 0; zz < nlayers; ++zz) {
+    layer = p2est_quadrant_array_index (p6est->layers, zz);
+    soa->z[zz] = layer->z;
+    soa->level[zz] = layer->level;
+    if (soa->data_size > 0) {
+      memcpy (soa->data + zz * soa->data_size, layer->p.user_data,
+              soa->data_size);
+    }
+  }
+
+  return soa;
+}
+
+void
+p6est_layers_soa_store (p6est_layers_soa_t * soa, p6est_t * p6est)
+{
+  size_t              zz;
+  p2est_quadrant_t   *layer;
+
+  P4EST_ASSERT (soa->num_layers == p6est->layers->elem_count);
+  P4EST_ASSERT (soa->data_size > 0 && soa->data_size == p6est->data_size);
+
+  for (zz = 0; zz < soa->num_layers; ++zz) {
+    layer = p2est_quadrant_array_index (p6est->layers, zz);
+    P4EST_ASSERT (layer->z == soa->z[zz] && layer->level == soa->level[zz]);
+    memcpy (layer->p.user_data, soa->data + zz * soa->data_size,
+            soa->data_size);
+  }
+}
+
+void
+p6est_layers_soa_destroy (p6est_layers_soa_t * soa)
+{
+  P4EST_FREE (soa->z);
+  P4EST_FREE (soa->level);
+  P4EST_FREE (soa->data);
+  P4EST_FREE (soa);
+}
+
 void
 p6est_save (const char *filename, p6est_t * p6est, int save_data)
 {
@@ -1063,6 +1117,428 @@ p6est_load_ext (const char *filename, sc_MPI_Comm mpicomm, size_t data_size,
   return p6est;
 }
 
+#ifdef P4EST_ENABLE_FILE_DEPRECATED
+
+/** Column coordinates x, y and level, layer coordinate z and level. */
+#define P6EST_FILE_COMPRESSED_LAYER_SIZE (5 * sizeof (p4est_qcoord_t))
+
+p4est_file_context_t *
+p6est_file_open_create (p6est_t * p6est, const char *filename,
+                        const char *user_string, int *errcode)
+{
+  P4EST_ASSERT (p6est != NULL);
+  P4EST_ASSERT (p6est->global_first_layer != NULL);
+
+  return p4est_file_open_create_partition (p6est->mpicomm,
+                                           p6est->global_first_layer,
+                                           filename, user_string, errcode);
+}
+
+p4est_file_context_t *
+p6est_file_write_field (p4est_file_context_t * fc, p6est_t * p6est,
+                        size_t layer_size, sc_array_t * layer_data,
+                        const char *user_string, int *errcode)
+{
+  P4EST_ASSERT (fc != NULL);
+  P4EST_ASSERT (p6est != NULL);
+  P4EST_ASSERT (p4est_file_get_global_num_quadrants (fc) ==
+                p6est->global_first_layer[p6est->mpisize]);
+  P4EST_ASSERT (layer_data != NULL && (p4est_gloidx_t) layer_data->elem_count
+                == p6est->global_first_layer[p6est->mpirank + 1] -
+                p6est->global_first_layer[p6est->mpirank]);
+
+  return p4est_file_write_field (fc, layer_size, layer_data, user_string,
+                                 errcode);
+}
+
+p4est_file_context_t *
+p6est_file_read_field (p4est_file_context_t * fc, p6est_t * p6est,
+                       size_t layer_size, sc_array_t * layer_data,
+                       char *user_string, int *errcode)
+{
+  P4EST_ASSERT (fc != NULL);
+  P4EST_ASSERT (p6est != NULL);
+
+  return p4est_file_read_field_ext (fc, p6est->global_first_layer,
+                                    layer_size, layer_data, user_string,
+                                    errcode);
+}
+
+p4est_file_context_t *
+p6est_file_write_p6est (p4est_file_context_t * fc, p6est_t * p6est,
+                        const char *layer_string,
+                        const char *layer_data_string, int *errcode)
+{
+  int                 mpiret;
+  p4est_t            *columns = p6est->columns;
+  p4est_topidx_t      jt, num_trees = columns->connectivity->num_trees;
+  p4est_gloidx_t     *pertree, *lcount;
+  p4est_locidx_t      nlayers;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *col;
+  p2est_quadrant_t   *layer;
+  p4est_qcoord_t     *clayer;
+  sc_array_t          arr, *layers, *layer_data;
+  size_t              zz, zy, first, last, lz;
+
+  P4EST_ASSERT (fc != NULL);
+  P4EST_ASSERT (errcode != NULL);
+
+  if (p4est_file_get_global_num_quadrants (fc) !=
+      p6est->global_first_layer[p6est->mpisize]) {
+    P4EST_GLOBAL_LERROR ("p6est_file_write_p6est: file and forest "
+                         "differ in the global number of layers\n");
+    p4est_file_close (fc, errcode);
+    *errcode = P4EST_FILE_ERR_IN_DATA;
+    return NULL;
+  }
+  nlayers = (p4est_locidx_t)
+    (p6est->global_first_layer[p6est->mpirank + 1] -
+     p6est->global_first_layer[p6est->mpirank]);
+
+  /* the column counts, the layer counts and the height of the domain */
+  pertree = P4EST_ALLOC (p4est_gloidx_t, 2 * (num_trees + 1) + 1);
+  p4est_comm_count_pertree (columns, pertree);
+  lcount = P4EST_ALLOC_ZERO (p4est_gloidx_t, num_trees);
+
+  /* compress the layers in the order of the columns */
+  layers = sc_array_new_count (P6EST_FILE_COMPRESSED_LAYER_SIZE,
+                               (size_t) nlayers);
+  layer_data = sc_array_new_count (p6est->data_size, (size_t) nlayers);
+  lz = 0;
+  for (jt = columns->first_local_tree; jt <= columns->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (columns->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      col = p4est_quadrant_array_index (&tree->quadrants, zz);
+      P6EST_COLUMN_GET_RANGE (col, &first, &last);
+      lcount[jt] += (p4est_gloidx_t) (last - first);
+      for (zy = first; zy < last; ++zy, ++lz) {
+        layer = p2est_quadrant_array_index (p6est->layers, zy);
+        clayer = (p4est_qcoord_t *) sc_array_index (layers, lz);
+        clayer[0] = col->x;
+        clayer[1] = col->y;
+        clayer[2] = (p4est_qcoord_t) col->level;
+        clayer[3] = layer->z;
+        clayer[4] = (p4est_qcoord_t) layer->level;
+        if (p6est->data_size > 0) {
+          memcpy (sc_array_index (layer_data, lz), layer->p.user_data,
+                  p6est->data_size);
+        }
+      }
+    }
+  }
+  P4EST_ASSERT (lz == (size_t) nlayers);
+
+  mpiret = sc_MPI_Allreduce (lcount, pertree + num_trees + 2, num_trees,
+                             P4EST_MPI_GLOIDX, sc_MPI_SUM, p6est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (lcount);
+  pertree[num_trees + 1] = 0;
+  for (jt = 0; jt < num_trees; ++jt) {
+    pertree[num_trees + 2 + jt] += pertree[num_trees + 1 + jt];
+  }
+  P4EST_ASSERT (pertree[2 * num_trees + 1] ==
+                p6est->global_first_layer[p6est->mpisize]);
+  pertree[2 * num_trees + 2] = (p4est_gloidx_t) p6est->root_len;
+
+  sc_array_init_data (&arr, pertree,
+                      sizeof (p4est_gloidx_t) * (2 * (num_trees + 1) + 1), 1);
+  fc = p4est_file_write_block (fc, arr.elem_size, &arr, layer_string,
+                               errcode);
+  P4EST_FREE (pertree);
+  if (*errcode != P4EST_FILE_ERR_SUCCESS) {
+    sc_array_destroy (layers);
+    sc_array_destroy (layer_data);
+    return NULL;
+  }
+
+  fc = p4est_file_write_field (fc, layers->elem_size, layers, layer_string,
+                               errcode);
+  sc_array_destroy (layers);
+  if (*errcode != P4EST_FILE_ERR_SUCCESS) {
+    P4EST_ASSERT (fc == NULL);
+    sc_array_destroy (layer_data);
+    return NULL;
+  }
+
+  fc = p4est_file_write_field (fc, layer_data->elem_size, layer_data,
+                               layer_data_string, errcode);
+  sc_array_destroy (layer_data);
+
+  return fc;
+}
+
+/** Agree on a local error and close the file context if any process failed.
+ * \return          The input context or NULL after closing it.
+ */
+static p4est_file_context_t *
+p6est_file_check_close (p4est_file_context_t * fc, int failed,
+                        const char *msg, int *errcode)
+{
+  int                 mpiret, gfailed;
+
+  mpiret = sc_MPI_Allreduce (&failed, &gfailed, 1, sc_MPI_INT, sc_MPI_LOR,
+                             p4est_file_get_mpicomm (fc));
+  SC_CHECK_MPI (mpiret);
+  if (gfailed) {
+    P4EST_GLOBAL_LERRORF ("p6est_file_read_p6est: %s\n", msg);
+    p4est_file_close (fc, errcode);
+    *errcode = P4EST_FILE_ERR_P4EST;
+    return NULL;
+  }
+  return fc;
+}
+
+/** Check a compressed layer in isolation. */
+static int
+p6est_file_layer_is_valid (const p4est_qcoord_t * clayer,
+                           p4est_qcoord_t root_len)
+{
+  return p4est_coordinates_is_valid (clayer, (int) clayer[2]) &&
+    clayer[4] >= 0 && clayer[4] <= P4EST_QMAXLEVEL &&
+    clayer[3] >= 0 && (clayer[3] & (P4EST_QUADRANT_LEN (clayer[4]) - 1)) == 0
+    && clayer[3] <= root_len - P4EST_QUADRANT_LEN (clayer[4]);
+}
+
+p4est_file_context_t *
+p6est_file_read_p6est (p4est_file_context_t * fc,
+                       p6est_connectivity_t * conn, size_t data_size,
+                       p6est_t ** p6est, char *layer_string,
+                       char *layer_data_string, int *errcode)
+{
+  int                 mpiret, mpisize, mpirank, failed, r;
+  sc_MPI_Comm         mpicomm;
+  p4est_topidx_t      jt, num_trees;
+  p4est_gloidx_t      gnl, mystart, lcols, *pertree, *gfl0, *gfl, *gfc, *lcount;
+  p4est_locidx_t      nlayers, ncols, il, ifirst;
+  p4est_qcoord_t      root_len, *clayer, *cprev, *ccol;
+  sc_array_t          pertree_arr, readlayers, layers, layer_data, colquads;
+  p4est_t            *columns;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *col;
+  p2est_quadrant_t   *layer;
+  p6est_t            *p6;
+  size_t              zz;
+
+  P4EST_ASSERT (fc != NULL);
+  P4EST_ASSERT (conn != NULL);
+  P4EST_ASSERT (p6est != NULL);
+  P4EST_ASSERT (errcode != NULL);
+  *p6est = NULL;
+  *errcode = P4EST_FILE_ERR_UNKNOWN;
+
+  mpicomm = p4est_file_get_mpicomm (fc);
+  gnl = p4est_file_get_global_num_quadrants (fc);
+  mpiret = sc_MPI_Comm_size (mpicomm, &mpisize);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Comm_rank (mpicomm, &mpirank);
+  SC_CHECK_MPI (mpiret);
+
+  num_trees = conn->conn4->num_trees;
+  gfl0 = P4EST_ALLOC (p4est_gloidx_t, mpisize + 1);
+  gfl = P4EST_ALLOC (p4est_gloidx_t, mpisize + 1);
+  gfc = P4EST_ALLOC (p4est_gloidx_t, mpisize + 1);
+  sc_array_init_size (&pertree_arr,
+                      (2 * (num_trees + 1) + 1) * sizeof (p4est_gloidx_t), 1);
+  sc_array_init (&readlayers, P6EST_FILE_COMPRESSED_LAYER_SIZE);
+  sc_array_init (&layers, P6EST_FILE_COMPRESSED_LAYER_SIZE);
+  sc_array_init (&layer_data, data_size);
+  sc_array_init (&colquads, sizeof (p4est_qcoord_t));
+
+  /* read and check the counts per tree */
+  fc = p4est_file_read_block (fc, pertree_arr.elem_size, &pertree_arr,
+                              layer_string, errcode);
+  if (*errcode != P4EST_FILE_ERR_SUCCESS) {
+    P4EST_ASSERT (fc == NULL);
+    goto p6est_file_read_p6est_end;
+  }
+  pertree = (p4est_gloidx_t *) pertree_arr.array;
+  failed = pertree[0] != 0 || pertree[num_trees + 1] != 0 ||
+    pertree[2 * num_trees + 1] != gnl || pertree[2 * num_trees + 2] <= 0 ||
+    pertree[2 * num_trees + 2] > (p4est_gloidx_t) P4EST_ROOT_LEN;
+  for (jt = 0; jt < num_trees; ++jt) {
+    failed = failed || pertree[jt] > pertree[jt + 1] ||
+      pertree[num_trees + 1 + jt] > pertree[num_trees + 2 + jt];
+  }
+  if ((fc = p6est_file_check_close (fc, failed, "invalid counts per tree",
+                                    errcode)) == NULL) {
+    goto p6est_file_read_p6est_end;
+  }
+  root_len = (p4est_qcoord_t) pertree[2 * num_trees + 2];
+
+  /* read the layers in a uniform partition */
+  p4est_comm_global_first_quadrant (gnl, mpisize, gfl0);
+  fc = p4est_file_read_field_ext (fc, gfl0, readlayers.elem_size,
+                                  &readlayers, layer_string, errcode);
+  if (*errcode != P4EST_FILE_ERR_SUCCESS) {
+    P4EST_ASSERT (fc == NULL);
+    goto p6est_file_read_p6est_end;
+  }
+  failed = 0;
+  mystart = gnl;
+  for (zz = 0; zz < readlayers.elem_count; ++zz) {
+    clayer = (p4est_qcoord_t *) sc_array_index (&readlayers, zz);
+    failed = failed || !p6est_file_layer_is_valid (clayer, root_len);
+    if (mystart == gnl && clayer[3] == 0) {
+      mystart = gfl0[mpirank] + (p4est_gloidx_t) zz;
+    }
+  }
+
+  /* move the layers such that every column starts on its process */
+  mpiret = sc_MPI_Allgather (&mystart, 1, P4EST_MPI_GLOIDX,
+                             gfl, 1, P4EST_MPI_GLOIDX, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  gfl[mpisize] = gnl;
+  for (r = mpisize - 1; r >= 0; --r) {
+    gfl[r] = SC_MIN (gfl[r], gfl[r + 1]);
+  }
+  failed = failed || gfl[0] != 0;
+  if ((fc = p6est_file_check_close (fc, failed, "invalid layers",
+                                    errcode)) == NULL) {
+    goto p6est_file_read_p6est_end;
+  }
+  nlayers = (p4est_locidx_t) (gfl[mpirank + 1] - gfl[mpirank]);
+  sc_array_resize (&layers, (size_t) nlayers);
+  p4est_transfer_fixed (gfl, gfl0, mpicomm, P6EST_COMM_FILE, layers.array,
+                        readlayers.array, P6EST_FILE_COMPRESSED_LAYER_SIZE);
+  sc_array_reset (&readlayers);
+
+  /* read the layer data directly in the column-aligned partition */
+  fc = p4est_file_read_field_ext (fc, gfl, layer_data.elem_size,
+                                  &layer_data, layer_data_string, errcode);
+  if (*errcode != P4EST_FILE_ERR_SUCCESS) {
+    P4EST_ASSERT (fc == NULL);
+    goto p6est_file_read_p6est_end;
+  }
+
+  /* each column stacks layers that tile the height of the domain */
+  failed = 0;
+  cprev = NULL;
+  for (il = 0; il < nlayers; ++il) {
+    clayer = (p4est_qcoord_t *) sc_array_index (&layers, (size_t) il);
+    if (clayer[3] == 0) {
+      failed = failed || (cprev != NULL && cprev[3] +
+                          P4EST_QUADRANT_LEN (cprev[4]) != root_len);
+      ccol = (p4est_qcoord_t *) sc_array_push_count (&colquads, 3);
+      memcpy (ccol, clayer, 3 * sizeof (p4est_qcoord_t));
+    }
+    else {
+      failed = failed || cprev == NULL ||
+        memcmp (cprev, clayer, 3 * sizeof (p4est_qcoord_t)) ||
+        cprev[3] + P4EST_QUADRANT_LEN (cprev[4]) != clayer[3];
+    }
+    cprev = clayer;
+  }
+  failed = failed || (cprev != NULL && cprev[3] +
+                      P4EST_QUADRANT_LEN (cprev[4]) != root_len);
+  if ((fc = p6est_file_check_close (fc, failed, "invalid columns",
+                                    errcode)) == NULL) {
+    goto p6est_file_read_p6est_end;
+  }
+
+  /* create the columns */
+  ncols = (p4est_locidx_t) (colquads.elem_count / 3);
+  lcols = (p4est_gloidx_t) ncols;
+  mpiret = sc_MPI_Allgather (&lcols, 1, P4EST_MPI_GLOIDX,
+                             gfc + 1, 1, P4EST_MPI_GLOIDX, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  gfc[0] = 0;
+  for (r = 0; r < mpisize; ++r) {
+    gfc[r + 1] += gfc[r];
+  }
+  columns = NULL;
+  if (gfc[mpisize] == pertree[num_trees]) {
+    columns = p4est_inflate_null (mpicomm, conn->conn4, gfc, pertree,
+                                  &colquads, NULL, NULL);
+  }
+  if ((fc = p6est_file_check_close (fc, columns == NULL, "invalid columns",
+                                    errcode)) == NULL) {
+    if (columns != NULL) {
+      p4est_destroy (columns);
+    }
+    goto p6est_file_read_p6est_end;
+  }
+
+  /* assign the layer ranges and compare the layer counts per tree */
+  lcount = P4EST_ALLOC_ZERO (p4est_gloidx_t, 2 * num_trees);
+  il = 0;
+  for (jt = columns->first_local_tree; jt <= columns->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (columns->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      col = p4est_quadrant_array_index (&tree->quadrants, zz);
+      ifirst = il;
+      do {
+        ++il;
+      } while (il < nlayers &&
+               ((p4est_qcoord_t *) sc_array_index (&layers,
+                                                   (size_t) il))[3] != 0);
+      P6EST_COLUMN_SET_RANGE (col, (size_t) ifirst, (size_t) il);
+      lcount[jt] += (p4est_gloidx_t) (il - ifirst);
+    }
+  }
+  P4EST_ASSERT (il == nlayers);
+  mpiret = sc_MPI_Allreduce (lcount, lcount + num_trees, num_trees,
+                             P4EST_MPI_GLOIDX, sc_MPI_SUM, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  failed = 0;
+  for (jt = 0; jt < num_trees; ++jt) {
+    failed = failed || lcount[num_trees + jt] != pertree[num_trees + 2 + jt] -
+      pertree[num_trees + 1 + jt];
+  }
+  P4EST_FREE (lcount);
+  if (failed) {
+    /* the counts are the same on all processes */
+    p4est_destroy (columns);
+    fc = p6est_file_check_close (fc, 1, "layer counts mismatch", errcode);
+    goto p6est_file_read_p6est_end;
+  }
+
+  /* create the forest */
+  p6 = P4EST_ALLOC (p6est_t, 1);
+  columns->user_pointer = p6;
+  p6->columns = columns;
+  p6->connectivity = conn;
+  p6->data_size = data_size;
+  p6->user_pointer = NULL;
+  p6->root_len = root_len;
+  p6est_comm_parallel_env_assign (p6, mpicomm);
+  p6->global_first_layer = P4EST_ALLOC (p4est_gloidx_t, mpisize + 1);
+  p6->layers = sc_array_new_count (sizeof (p2est_quadrant_t),
+                                   (size_t) nlayers);
+  p6->layer_pool = p2est_quadrant_mempool_new ();
+  p6->user_data_pool = data_size ? sc_mempool_new (data_size) : NULL;
+  for (il = 0; il < nlayers; ++il) {
+    layer = p2est_quadrant_array_index (p6->layers, (size_t) il);
+    clayer = (p4est_qcoord_t *) sc_array_index (&layers, (size_t) il);
+    P2EST_QUADRANT_INIT (layer);
+    layer->z = clayer[3];
+    layer->level = (int8_t) clayer[4];
+    if (data_size > 0) {
+      layer->p.user_data = sc_mempool_alloc (p6->user_data_pool);
+      memcpy (layer->p.user_data, sc_array_index (&layer_data, (size_t) il),
+              data_size);
+    }
+  }
+  p6est_update_offsets (p6);
+  P4EST_ASSERT (!memcmp (p6->global_first_layer, gfl,
+                         (mpisize + 1) * sizeof (p4est_gloidx_t)));
+  *p6est = p6;
+  *errcode = P4EST_FILE_ERR_SUCCESS;
+
+p6est_file_read_p6est_end:
+  P4EST_FREE (gfl0);
+  P4EST_FREE (gfl);
+  P4EST_FREE (gfc);
+  sc_array_reset (&pertree_arr);
+  sc_array_reset (&readlayers);
+  sc_array_reset (&layers);
+  sc_array_reset (&layer_data);
+  sc_array_reset (&colquads);
+  return fc;
+}
+
+#endif /* P4EST_ENABLE_FILE_DEPRECATED */
+
 typedef struct p6est_refine_col_data
 {
   p6est_refine_column_t refine_col_fn;
@@ -1228,6 +1704,65 @@ p6est_update_offsets (p6est_t * p6est)
                 p6est->layers->elem_count);
 }
 
+void
+p6est_column_locate (p6est_t * p6est, p4est_locidx_t lidx,
+                     p4est_topidx_t * which_tree, size_t *zz)
+{
+  p4est_t            *columns = p6est->columns;
+  p4est_topidx_t      jt = columns->first_local_tree;
+  p4est_tree_t       *tree = p4est_tree_array_index (columns->trees, jt);
+
+  P4EST_ASSERT (0 <= lidx && lidx <= columns->local_num_quadrants);
+  while (jt < columns->last_local_tree &&
+         lidx >= tree->quadrants_offset +
+         (p4est_locidx_t) tree->quadrants.elem_count) {
+    tree = p4est_tree_array_index (columns->trees, ++jt);
+  }
+  *which_tree = jt;
+  *zz = (size_t) (lidx - tree->quadrants_offset);
+}
+
+void
+p6est_layers_from_chunks (p6est_t * p6est, int num_chunks,
+                          sc_array_t * chunks)
+{
+  int                 i;
+  size_t              zz, first, last, offset, count;
+  p4est_topidx_t      jt;
+  p4est_t            *columns = p6est->columns;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *col;
+  sc_array_t         *layers = p6est->layers;
+
+  /* the chunks hold the layers of all local columns in order */
+  for (offset = 0, i = 0; i < num_chunks; ++i) {
+    offset += chunks[i].elem_count;
+  }
+  sc_array_resize (layers, offset);
+  for (offset = 0, i = 0; i < num_chunks; ++i) {
+    count = chunks[i].elem_count;
+    if (count > 0) {
+      memcpy (sc_array_index (layers, offset), chunks[i].array,
+              count * layers->elem_size);
+    }
+    offset += count;
+    sc_array_reset (&chunks[i]);
+  }
+
+  /* the column ranges still count from the start of their chunk */
+  offset = 0;
+  for (jt = columns->first_local_tree; jt <= columns->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (columns->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      col = p4est_quadrant_array_index (&tree->quadrants, zz);
+      P6EST_COLUMN_GET_RANGE (col, &first, &last);
+      P6EST_COLUMN_SET_RANGE (col, offset, offset + (last - first));
+      offset += last - first;
+    }
+  }
+  P4EST_ASSERT (offset == layers->elem_count);
+}
+
 void
 p6est_refine_columns_ext (p6est_t * p6est, int refine_recursive,
                           int allowed_level, p6est_refine_column_t refine_fn,
@@ -1235,6 +1770,7 @@ p6est_refine_columns_ext (p6est_t * p6est, int refine_recursive,
 {
   p6est_refine_col_data_t refine_col;
   void               *orig_user_pointer = p6est->user_pointer;
+  int                 num_threads = p4est_get_num_threads ();
 
   P4EST_GLOBAL_PRODUCTIONF ("Into p6est_refine_columns with %lld total layers"
                             " in %lld total columns\n", (long long)
@@ -1248,9 +1784,12 @@ p6est_refine_columns_ext (p6est_t * p6est, int refine_recursive,
 
   p6est->user_pointer = (void *) &refine_col;
   P4EST_GLOBAL_VERBOSE ("Refining p4est for columns\n");
+  /* the column callbacks swap the user pointer and append to the layers */
+  p4est_set_num_threads (1);
   p4est_refine_ext (p6est->columns, refine_recursive, allowed_level,
                     p6est_refine_column_int, NULL,
                     p6est_replace_column_split);
+  p4est_set_num_threads (num_threads);
   p6est->user_pointer = orig_user_pointer;
 
   p6est_compress_columns (p6est);
@@ -1262,27 +1801,99 @@ p6est_refine_columns_ext (p6est_t * p6est, int refine_recursive,
                             (long long) p6est->columns->global_num_quadrants);
 }
 
+/** Refine the layers of one column.
+ * The resulting layers are appended to \a newcol.
+ * \return True if any layer has been refined.
+ */
+static int
+p6est_refine_column_layers (p6est_t * p6est, p4est_topidx_t jt,
+                            p4est_quadrant_t * col, int refine_recursive,
+                            int allowed_level, p6est_refine_layer_t refine_fn,
+                            p6est_init_t init_fn, p6est_replace_t replace_fn,
+                            sc_array_t * newcol)
+{
+  sc_array_t         *layers = p6est->layers;
+  p2est_quadrant_t   *q, *newq;
+  p2est_quadrant_t    nextq[P4EST_MAXLEVEL];
+  p2est_quadrant_t    c[2];
+  p2est_quadrant_t    p, *parent = &p;
+  p2est_quadrant_t   *child[2];
+  size_t              first, last, current;
+  int                 any_change;
+  int                 level;
+  int                 stop_recurse;
+
+  P6EST_COLUMN_GET_RANGE (col, &first, &last);
+
+  any_change = 0;
+
+  for (current = first; current < last; current++) {
+    q = p2est_quadrant_array_index (layers, current);
+    stop_recurse = 0;
+    level = q->level;
+    parent = q;
+    for (;;) {
+      if (!stop_recurse && refine_fn (p6est, jt, col, parent) &&
+          (allowed_level < 0 || (int) parent->level < allowed_level)) {
+        level++;
+        any_change = 1;
+        c[0] = *parent;
+        c[0].level = level;
+        c[1] = *parent;
+        c[1].level = level;
+        c[1].z += P4EST_QUADRANT_LEN (level);
+        child[0] = &c[0];
+        child[1] = &c[1];
+        p6est_layer_init_data (p6est, jt, col, child[0], init_fn);
+        p6est_layer_init_data (p6est, jt, col, child[1], init_fn);
+        if (replace_fn != NULL) {
+          replace_fn (p6est, jt, 1, 1, &col, &parent, 1, 2, &col, child);
+        }
+        p6est_layer_free_data (p6est, parent);
+        p = c[0];
+        parent = &p;
+        nextq[level] = c[1];
+        stop_recurse = !refine_recursive;
+      }
+      else {
+        /* parent is accepted */
+        newq = p2est_quadrant_array_push (newcol);
+        *newq = *parent;
+        if (parent == &p) {
+          parent = &nextq[level];
+        }
+        else {
+          while (--level > q->level && parent->z > nextq[level].z) {
+          }
+          if (level <= q->level) {
+            break;
+          }
+          parent = &(nextq[level]);
+        }
+      }
+    }
+  }
+
+  return any_change;
+}
+
 void
 p6est_refine_layers_ext (p6est_t * p6est, int refine_recursive,
                          int allowed_level, p6est_refine_layer_t refine_fn,
                          p6est_init_t init_fn, p6est_replace_t replace_fn)
 {
+#ifdef P4EST_ENABLE_OPENMP
+  int                 num_threads;
+#endif
   p4est_t            *columns = p6est->columns;
   sc_array_t         *layers = p6est->layers;
-  sc_array_t         *newcol = sc_array_new (sizeof (p2est_quadrant_t));
+  sc_array_t         *newcol;
   p4est_topidx_t      jt;
   p4est_tree_t       *tree;
   sc_array_t         *tquadrants;
   p4est_quadrant_t   *col;
-  p2est_quadrant_t   *q, *newq;
-  p2est_quadrant_t    nextq[P4EST_MAXLEVEL];
-  p2est_quadrant_t    c[2];
-  p2est_quadrant_t    p, *parent = &p;
-  p2est_quadrant_t   *child[2];
-  size_t              first, last, zz, current, old_count;
-  int                 any_change;
-  int                 level;
-  int                 stop_recurse;
+  p2est_quadrant_t   *newq;
+  size_t              zz, old_count;
 
   P4EST_GLOBAL_PRODUCTIONF ("Into p6est_refine_layers with %lld total layers"
                             " in %lld total columns, allowed level %d\n",
@@ -1291,75 +1902,71 @@ p6est_refine_layers_ext (p6est_t * p6est, int refine_recursive,
                             (long long) p6est->columns->global_num_quadrants,
                             allowed_level);
   p4est_log_indent_push ();
-  for (jt = columns->first_local_tree; jt <= columns->last_local_tree; ++jt) {
-    tree = p4est_tree_array_index (columns->trees, jt);
-    tquadrants = &tree->quadrants;
 
-    for (zz = 0; zz < tquadrants->elem_count; ++zz) {
-      col = p4est_quadrant_array_index (tquadrants, zz);
-      P6EST_COLUMN_GET_RANGE (col, &first, &last);
-
-      any_change = 0;
-
-      for (current = first; current < last; current++) {
-        q = p2est_quadrant_array_index (layers, current);
-        stop_recurse = 0;
-        level = q->level;
-        parent = q;
-        for (;;) {
-          if (!stop_recurse && refine_fn (p6est, jt, col, parent) &&
-              (allowed_level < 0 || (int) parent->level < allowed_level)) {
-            level++;
-            any_change = 1;
-            c[0] = *parent;
-            c[0].level = level;
-            c[1] = *parent;
-            c[1].level = level;
-            c[1].z += P4EST_QUADRANT_LEN (level);
-            child[0] = &c[0];
-            child[1] = &c[1];
-            p6est_layer_init_data (p6est, jt, col, child[0], init_fn);
-            p6est_layer_init_data (p6est, jt, col, child[1], init_fn);
-            if (replace_fn != NULL) {
-              replace_fn (p6est, jt, 1, 1, &col, &parent, 1, 2, &col, child);
-            }
-            p6est_layer_free_data (p6est, parent);
-            p = c[0];
-            parent = &p;
-            nextq[level] = c[1];
-            stop_recurse = !refine_recursive;
-          }
-          else {
-            /* parent is accepted */
-            newq = p2est_quadrant_array_push (newcol);
-            *newq = *parent;
-            if (parent == &p) {
-              parent = &nextq[level];
-            }
-            else {
-              while (--level > q->level && parent->z > nextq[level].z) {
-              }
-              if (level <= q->level) {
-                break;
-              }
-              parent = &(nextq[level]);
-            }
-          }
+#ifdef P4EST_ENABLE_OPENMP
+  num_threads = SC_MIN (p4est_get_num_threads (),
+                        (int) columns->local_num_quadrants);
+  if (num_threads > 1) {
+    int                 t;
+    sc_array_t         *chunks = P4EST_ALLOC (sc_array_t, num_threads);
+
+    /* each chunk of consecutive columns is refined into its own buffer */
+#pragma omp parallel for num_threads (num_threads) schedule (static, 1) \
+  private (jt, tree, col, zz, old_count)
+    for (t = 0; t < num_threads; ++t) {
+      p4est_locidx_t      k, lo, hi;
+
+      lo = (p4est_locidx_t)
+        (((p4est_gloidx_t) columns->local_num_quadrants * t) / num_threads);
+      hi = (p4est_locidx_t)
+        (((p4est_gloidx_t) columns->local_num_quadrants * (t + 1)) /
+         num_threads);
+      sc_array_init (&chunks[t], sizeof (p2est_quadrant_t));
+      p6est_column_locate (p6est, lo, &jt, &zz);
+      tree = p4est_tree_array_index (columns->trees, jt);
+      for (k = lo; k < hi; ++k, ++zz) {
+        while (zz == tree->quadrants.elem_count) {
+          tree = p4est_tree_array_index (columns->trees, ++jt);
+          zz = 0;
         }
+        col = p4est_quadrant_array_index (&tree->quadrants, zz);
+        old_count = chunks[t].elem_count;
+        (void) p6est_refine_column_layers (p6est, jt, col, refine_recursive,
+                                           allowed_level, refine_fn, init_fn,
+                                           replace_fn, &chunks[t]);
+        P6EST_COLUMN_SET_RANGE (col, old_count, chunks[t].elem_count);
       }
-      if (any_change) {
-        old_count = layers->elem_count;
-        newq = (p2est_quadrant_t *) sc_array_push_count (layers,
-                                                         newcol->elem_count);
-        memcpy (newq, sc_array_index (newcol, 0),
-                newcol->elem_size * newcol->elem_count);
-        P6EST_COLUMN_SET_RANGE (col, old_count,
-                                old_count + newcol->elem_count);
+    }
+    p6est_layers_from_chunks (p6est, num_threads, chunks);
+    P4EST_FREE (chunks);
+  }
+  else
+#endif
+  {
+    newcol = sc_array_new (sizeof (p2est_quadrant_t));
+    for (jt = columns->first_local_tree; jt <= columns->last_local_tree;
+         ++jt) {
+      tree = p4est_tree_array_index (columns->trees, jt);
+      tquadrants = &tree->quadrants;
+
+      for (zz = 0; zz < tquadrants->elem_count; ++zz) {
+        col = p4est_quadrant_array_index (tquadrants, zz);
+        if (p6est_refine_column_layers (p6est, jt, col, refine_recursive,
+                                        allowed_level, refine_fn, init_fn,
+                                        replace_fn, newcol)) {
+          old_count = layers->elem_count;
+          newq = (p2est_quadrant_t *) sc_array_push_count (layers,
+                                                           newcol->elem_count);
+          memcpy (newq, sc_array_index (newcol, 0),
+                  newcol->elem_size * newcol->elem_count);
+          P6EST_COLUMN_SET_RANGE (col, old_count,
+                                  old_count + newcol->elem_count);
+        }
+        sc_array_truncate (newcol);
       }
-      sc_array_truncate (newcol);
     }
+    sc_array_destroy (newcol);
   }
-  sc_array_destroy (newcol);
   p6est_compress_columns (p6est);
   p6est_update_offsets (p6est);
   p4est_log_indent_pop ();
@@ -1552,7 +2159,9 @@ p6est_coarsen_all_layers (p6est_t * p6est, p4est_topidx_t which_tree,
   sc_array_resize (descendants, new_count);
 
 #ifdef P4EST_ENABLE_DEBUG
-  P4EST_ASSERT (mcount - p6est->user_data_pool->elem_count ==
+  /* other threads may be working on the pool concurrently */
+  P4EST_ASSERT (p4est_in_parallel_region () ||
+                mcount - p6est->user_data_pool->elem_count ==
                 (old_count - new_count));
 
   q = p2est_quadrant_array_index (descendants, new_count - 1);
@@ -1672,6 +2281,7 @@ p6est_coarsen_columns_ext (p6est_t * p6est, int coarsen_recursive,
 {
   p6est_coarsen_col_data_t coarsen_col;
   void               *orig_user_pointer = p6est->user_pointer;
+  int                 num_threads = p4est_get_num_threads ();
 
   P4EST_GLOBAL_PRODUCTIONF
     ("Into p6est_coarsen_columns with %lld total layers"
@@ -1687,9 +2297,12 @@ p6est_coarsen_columns_ext (p6est_t * p6est, int coarsen_recursive,
   coarsen_col.work_array = sc_array_new (sizeof (p2est_quadrant_t));
 
   p6est->user_pointer = (void *) &coarsen_col;
+  /* the column callbacks swap the user pointer and share the work array */
+  p4est_set_num_threads (1);
   p4est_coarsen_ext (p6est->columns, coarsen_recursive, callback_orphans,
                      p6est_coarsen_column_int, NULL,
                      p6est_replace_column_join);
+  p4est_set_num_threads (num_threads);
   p6est->user_pointer = orig_user_pointer;
 
   sc_array_destroy (coarsen_col.work_array);
@@ -1712,20 +2325,44 @@ p6est_coarsen_columns (p6est_t * p6est, int coarsen_recursive,
                              coarsen_fn, init_fn, NULL);
 }
 
+/** Coarsen the layers of one column in place. */
+static void
+p6est_coarsen_column_layers (p6est_t * p6est, p4est_topidx_t jt,
+                             p4est_quadrant_t * col, int coarsen_recursive,
+                             int callback_orphans,
+                             p6est_coarsen_layer_t coarsen_fn,
+                             p6est_init_t init_fn, p6est_replace_t replace_fn)
+{
+  sc_array_t          view;
+  size_t              first, last, count;
+
+  P6EST_COLUMN_GET_RANGE (col, &first, &last);
+
+  count = last - first;
+  sc_array_init_view (&view, p6est->layers, first, count);
+  p6est_coarsen_all_layers (p6est, jt, col, 0, &view,
+                            coarsen_recursive, callback_orphans,
+                            coarsen_fn, init_fn, replace_fn);
+  P4EST_ASSERT (view.elem_count > 0);
+  P4EST_ASSERT (view.elem_count <= count);
+  last = first + view.elem_count;
+  P6EST_COLUMN_SET_RANGE (col, first, last);
+}
+
 void
 p6est_coarsen_layers_ext (p6est_t * p6est, int coarsen_recursive,
                           int callback_orphans,
                           p6est_coarsen_layer_t coarsen_fn,
                           p6est_init_t init_fn, p6est_replace_t replace_fn)
 {
+#ifdef P4EST_ENABLE_OPENMP
+  int                 num_threads;
+#endif
   p4est_t            *columns = p6est->columns;
-  sc_array_t         *layers = p6est->layers;
-  sc_array_t          view;
   p4est_topidx_t      jt;
   p4est_tree_t       *tree;
   sc_array_t         *tquadrants;
-  p4est_quadrant_t   *col;
-  size_t              first, last, zz, count;
+  size_t              zz;
 
   P4EST_GLOBAL_PRODUCTIONF ("Into p6est_coarsen_layers with %lld total layers"
                             " in %lld total columns\n", (long long)
@@ -1733,28 +2370,59 @@ p6est_coarsen_layers_ext (p6est_t * p6est, int coarsen_recursive,
                             (long long) p6est->columns->global_num_quadrants);
   p4est_log_indent_push ();
 
-  for (jt = columns->first_local_tree; jt <= columns->last_local_tree; ++jt) {
-    tree = p4est_tree_array_index (columns->trees, jt);
-    tquadrants = &tree->quadrants;
-
-    for (zz = 0; zz < tquadrants->elem_count; ++zz) {
-      col = p4est_quadrant_array_index (tquadrants, zz);
-      P6EST_COLUMN_GET_RANGE (col, &first, &last);
+#ifdef P4EST_ENABLE_OPENMP
+  num_threads = SC_MIN (p4est_get_num_threads (),
+                        (int) columns->local_num_quadrants);
+  if (num_threads > 1) {
+    int                 t;
+
+    /* the columns are coarsened in place, each by exactly one thread */
+#pragma omp parallel for num_threads (num_threads) schedule (static, 1) \
+  private (jt, tree, zz)
+    for (t = 0; t < num_threads; ++t) {
+      p4est_locidx_t      k, lo, hi;
+
+      lo = (p4est_locidx_t)
+        (((p4est_gloidx_t) columns->local_num_quadrants * t) / num_threads);
+      hi = (p4est_locidx_t)
+        (((p4est_gloidx_t) columns->local_num_quadrants * (t + 1)) /
+         num_threads);
+      p6est_column_locate (p6est, lo, &jt, &zz);
+      tree = p4est_tree_array_index (columns->trees, jt);
+      for (k = lo; k < hi; ++k, ++zz) {
+        while (zz == tree->quadrants.elem_count) {
+          tree = p4est_tree_array_index (columns->trees, ++jt);
+          zz = 0;
+        }
+        p6est_coarsen_column_layers (p6est, jt,
+                                     p4est_quadrant_array_index
+                                     (&tree->quadrants, zz),
+                                     coarsen_recursive, callback_orphans,
+                                     coarsen_fn, init_fn, replace_fn);
+      }
+    }
+  }
+  else
+#endif
+  {
+    for (jt = columns->first_local_tree; jt <= columns->last_local_tree;
+         ++jt) {
+      tree = p4est_tree_array_index (columns->trees, jt);
+      tquadrants = &tree->quadrants;
 
-      count = last - first;
-      sc_array_init_view (&view, layers, first, count);
-      p6est_coarsen_all_layers (p6est, jt, col, 0, &view,
-                                coarsen_recursive, callback_orphans,
-                                coarsen_fn, init_fn, replace_fn);
-      P4EST_ASSERT (view.elem_count > 0);
-      P4EST_ASSERT (view.elem_count <= count);
-      last = first + view.elem_count;
-      P6EST_COLUMN_SET_RANGE (col, first, last);
+      for (zz = 0; zz < tquadrants->elem_count; ++zz) {
+        p6est_coarsen_column_layers (p6est, jt,
+                                     p4est_quadrant_array_index
+                                     (tquadrants, zz),
+                                     coarsen_recursive, callback_orphans,
+                                     coarsen_fn, init_fn, replace_fn);
+      }
     }
   }
   p6est_compress_columns (p6est);
   p6est_update_offsets (p6est);
-  P4EST_ASSERT (p6est->user_data_pool->elem_count == layers->elem_count);
+  P4EST_ASSERT (p6est->user_data_pool->elem_count ==
+                p6est->layers->elem_count);
 
   p4est_log_indent_pop ();
   P4EST_GLOBAL_PRODUCTIONF
@@ -2483,6 +3151,7 @@ p6est_balance_ext (p6est_t * p6est, p8est_connect_type_t btype,
   p6est_profile_t    *profile;
   int                 any_change;
   int                 niter;
+  int                 num_threads = p4est_get_num_threads ();
 
   P4EST_GLOBAL_PRODUCTIONF ("Into p6est_balance with %lld total layers"
                             " in %lld total columns\n", (long long)
@@ -2517,8 +3186,11 @@ p6est_balance_ext (p6est_t * p6est, p8est_connect_type_t btype,
   refine_col.user_pointer = orig_user_pointer;
   p6est->user_pointer = (void *) &refine_col;
   P4EST_GLOBAL_VERBOSE ("Balancing p4est for columns\n");
+  /* the column callbacks append to the layers */
+  p4est_set_num_threads (1);
   p4est_balance_ext (p6est->columns, hbtype, NULL,
                      p6est_replace_column_split);
+  p4est_set_num_threads (num_threads);
   p6est->user_pointer = orig_user_pointer;
   p6est_compress_columns (p6est);
   p6est_update_offsets (p6est);
@@ -464,7 +464,10 @@ typedef enum
 {
   P6EST_COMM_PARTITION = 1,
   P6EST_COMM_GHOST,
-  P6EST_COMM_BALANCE
+  P6EST_COMM_BALANCE,
+  P6EST_COMM_FILE,
+  P6EST_COMM_GHOST_EXCHANGE,
+  P6EST_COMM_GHOST_PLAN
 }
 p6est_comm_tag_t;
 
@@ -609,6 +612,9 @@ p6est_layer_init_data (p6est_t * p6est, p4est_topidx_t which_tree,
                        p2est_quadrant_t * layer, p6est_init_t init_fn)
 {
   if (p6est->data_size > 0) {
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (p6est_user_data_pool)
+#endif
     layer->p.user_data = sc_mempool_alloc (p6est->user_data_pool);
   }
   else {
@@ -624,6 +630,9 @@ static inline void
 p6est_layer_free_data (p6est_t * p6est, p2est_quadrant_t * layer)
 {
   if (p6est->data_size > 0) {
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (p6est_user_data_pool)
+#endif
     sc_mempool_free (p6est->user_data_pool, layer->p.user_data);
   }
   layer->p.user_data = NULL;
@@ -631,6 +640,13 @@ p6est_layer_free_data (p6est_t * p6est, p2est_quadrant_t * layer)
 
 void                p6est_compress_columns (p6est_t * p6est);
 void                p6est_update_offsets (p6est_t * p6est);
+void                p6est_column_locate (p6est_t * p6est,
+                                         p4est_locidx_t lidx,
+                                         p4est_topidx_t * which_tree,
+                                         size_t *zz);
+void                p6est_layers_from_chunks (p6est_t * p6est,
+                                              int num_chunks,
+                                              sc_array_t * chunks);
 
 SC_EXTERN_C_END;
 
@@ -41,6 +41,7 @@
  */
 
 #include <p6est.h>
+#include <p4est_io.h>
 
 SC_EXTERN_C_BEGIN;
 
@@ -85,6 +86,45 @@ p6est_t            *p6est_new_ext (sc_MPI_Comm mpicomm,
 p6est_t            *p6est_copy_ext (p6est_t * input, int copy_data,
                                     int duplicate_mpicomm);
 
+/** The layers of a p6est as a structure of arrays.
+ * Entry i describes the layer p6est->layers[i], so the range of a column
+ * given by \ref P6EST_COLUMN_GET_RANGE addresses the contiguous block of
+ * its z-coordinates, levels and data in bottom to top order.
+ * This allows vertical sweeps over a column without following the user
+ * data pointer of each layer.
+ */
+typedef struct p6est_layers_soa
+{
+  size_t              num_layers;       /**< Local layers of the p6est */
+  size_t              data_size;        /**< Bytes per layer in \a data */
+  p4est_qcoord_t     *z;        /**< Vertical coordinate of each layer */
+  int8_t             *level;    /**< Vertical level of each layer */
+  char               *data;     /**< data_size bytes per layer or NULL */
+}
+p6est_layers_soa_t;
+
+/** Copy the local layers of a p6est into a structure of arrays.
+ * The arrays match the forest until its layers change.
+ * \param [in] p6est      Valid forest.
+ * \param [in] copy_data  If true and p6est->data_size is positive, the
+ *                        layer user data is copied into the data array.
+ *                        Otherwise data_size is 0 and data is NULL.
+ * \return                Allocated layer arrays.
+ */
+p6est_layers_soa_t *p6est_layers_soa_new (p6est_t * p6est, int copy_data);
+
+/** Copy the data array of a structure of arrays back into the layer user
+ * data of the p6est it was created from.
+ * \param [in] soa        Layer arrays with a positive data size.
+ * \param [in,out] p6est  The forest, whose layers have not changed since
+ *                        \a soa was created.
+ */
+void                p6est_layers_soa_store (p6est_layers_soa_t * soa,
+                                            p6est_t * p6est);
+
+/** Free the structure of arrays. */
+void                p6est_layers_soa_destroy (p6est_layers_soa_t * soa);
+
 /** Save the complete connectivity/p6est data to disk.
  *
  * This is a collective operation that all MPI processes need to call.  All
@@ -136,6 +176,107 @@ p6est_t            *p6est_load_ext (const char *filename, sc_MPI_Comm mpicomm,
                                     void *user_pointer,
                                     p6est_connectivity_t ** connectivity);
 
+#ifdef P4EST_ENABLE_FILE_DEPRECATED
+
+/** Create a file in the parallel p4est file format for a p6est.
+ * The file holds one entry per layer and data field, so its header records
+ * the global number of layers.  Every process writes its layers in the
+ * partition given by \a p6est->global_first_layer by collective calls.
+ * The layer fields can be written by \ref p6est_file_write_field and the
+ * forest by \ref p6est_file_write_p6est.  The file is read with \ref
+ * p4est_file_open_read_ext.
+ * See \ref p4est_file_open_create for the remaining parameters.
+ * \param [in] p6est      Valid forest.  Its partition is copied.
+ */
+p4est_file_context_t *p6est_file_open_create (p6est_t * p6est,
+                                              const char *filename,
+                                              const char *user_string,
+                                              int *errcode);
+
+/** Write one per-layer data field to a file opened for a p6est.
+ * \param [in] fc          Context created by \ref p6est_file_open_create.
+ * \param [in] p6est       The forest with the partition of \a fc.
+ * \param [in] layer_size  The number of bytes per layer.
+ * \param [in] layer_data  One element of \a layer_size bytes per local layer
+ *                         in the order of the columns.
+ * See \ref p4est_file_write_field for the remaining parameters.
+ */
+p4est_file_context_t *p6est_file_write_field (p4est_file_context_t * fc,
+                                              p6est_t * p6est,
+                                              size_t layer_size,
+                                              sc_array_t * layer_data,
+                                              const char *user_string,
+                                              int *errcode);
+
+/** Read one per-layer data field in the partition of a p6est.
+ * \param [in] fc          Context opened by \ref p4est_file_open_read_ext.
+ * \param [in] p6est       Forest whose global number of layers matches the
+ *                         file.  Every process reads its local layers.
+ * \param [in] layer_size  The number of bytes per layer.
+ * \param [in,out] layer_data  Resized to the local number of layers and
+ *                         filled in the order of the columns.  If NULL,
+ *                         the field is skipped.
+ * See \ref p4est_file_read_field for the remaining parameters.
+ */
+p4est_file_context_t *p6est_file_read_field (p4est_file_context_t * fc,
+                                             p6est_t * p6est,
+                                             size_t layer_size,
+                                             sc_array_t * layer_data,
+                                             char *user_string,
+                                             int *errcode);
+
+/** Write a p6est to a file opened by \ref p6est_file_open_create.
+ * This writes three sections: a block with the column and layer counts per
+ * tree and the height of the domain, a field of the column and layer
+ * coordinates of every layer and a field of the layer user data.
+ * The connectivity is not written.
+ * \param [in] fc                Context created by \ref p6est_file_open_create.
+ * \param [in] p6est             The forest written; it must have the
+ *                               partition that \a fc was created with.
+ * \param [in] layer_string      User string of the block and coordinates.
+ * \param [in] layer_data_string User string of the data field.
+ * \param [out] errcode          An errcode that can be interpreted by \ref
+ *                               p4est_file_error_string.
+ * \return                       The input context to continue writing, or
+ *                               NULL on error, in which case the file is
+ *                               closed and \a fc is freed.
+ */
+p4est_file_context_t *p6est_file_write_p6est (p4est_file_context_t * fc,
+                                              p6est_t * p6est,
+                                              const char *layer_string,
+                                              const char *layer_data_string,
+                                              int *errcode);
+
+/** Read a p6est written by \ref p6est_file_write_p6est.
+ * The layers are read by collective calls in a uniform partition and then
+ * moved so that no column is split between processes.
+ * \param [in] fc               Context opened by \ref p4est_file_open_read_ext.
+ * \param [in] conn             Connectivity of the written forest.  It must
+ *                              outlive the p6est and is not destroyed by it.
+ * \param [in] data_size        Layer data size, which must match the file.
+ *                              If zero, user_data_pool is set to NULL.
+ * \param [out] p6est           The forest read, or NULL on error.
+ * \param [in,out] layer_string At least \ref P4EST_FILE_USER_STRING_BYTES
+ *                              bytes; filled with the user string of the
+ *                              layer coordinates.
+ * \param [in,out] layer_data_string  Filled like \a layer_string for the
+ *                              data field.
+ * \param [out] errcode         An errcode that can be interpreted by \ref
+ *                              p4est_file_error_string.
+ * \return                      The input context to continue reading, or
+ *                              NULL on error, in which case the file is
+ *                              closed and \a fc is freed.
+ */
+p4est_file_context_t *p6est_file_read_p6est (p4est_file_context_t * fc,
+                                             p6est_connectivity_t * conn,
+                                             size_t data_size,
+                                             p6est_t ** p6est,
+                                             char *layer_string,
+                                             char *layer_data_string,
+                                             int *errcode);
+
+#endif /* P4EST_ENABLE_FILE_DEPRECATED */
+
 /** Horizontally refine a forest with a bounded refinement level and a replace option.
  *
  * \param [in,out] p6est The forest is changed in place.
@@ -186,6 +327,10 @@ void                p6est_refine_columns_ext (p6est_t * p6est,
  * \param [in] replace_fn Callback function that allows the user to change
  *                        incoming quadrants based on the quadrants they
  *                        replace; may be NULL.
+ * With more than one thread set by \ref p4est_set_num_threads, the local
+ * columns are distributed among the threads and the callbacks must be
+ * thread-safe.  Within one column the order of the callbacks is the same
+ * as in the serial case, and so is the resulting forest.
  */
 void                p6est_refine_layers_ext (p6est_t * p6est,
                                              int refine_recursive,
@@ -237,6 +382,7 @@ void                p6est_coarsen_columns_ext (p6est_t * p6est,
  * \param [in] replace_fn Callback function that allows the user to change
  *                        incoming quadrants based on the quadrants they
  *                        replace.
+ * The columns are processed by threads as in \ref p6est_refine_layers_ext.
  */
 void                p6est_coarsen_layers_ext (p6est_t * p6est,
                                               int coarsen_recursive,
@@ -276,6 +422,8 @@ p4est_gloidx_t      p6est_partition_ext (p6est_t * p6est,
  * \param [in] replace_fn Callback function that allows the user to change
  *                        incoming quadrants based on the quadrants they
  *                        replace.
+ * The vertical refinement of the columns is done by threads as in
+ * \ref p6est_refine_layers_ext, so the callbacks must be thread-safe.
  */
 void                p6est_balance_ext (p6est_t * p6est,
                                        p8est_connect_type_t btype,
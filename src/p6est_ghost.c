@@ -624,3 +624,358 @@ p6est_ghost_expand (p6est_t * p6est, p6est_ghost_t * ghost)
   P4EST_GLOBAL_PRODUCTION ("Done p6est_ghost_expand\n");
 
 }
+
+/** Collect the runs of consecutive local layers in the mirror send order.
+ * The layers of a column are consecutive, so there is at most one run for
+ * every column sent to a process.
+ * \param [in,out] runs     Initialized array of p4est_locidx_t pairs of the
+ *                          first local layer and count of each run.
+ */
+static void
+p6est_ghost_mirror_runs (p6est_ghost_t * ghost, sc_array_t * runs)
+{
+  p4est_locidx_t      il, nl, li, *run = NULL;
+  p2est_quadrant_t   *mirror;
+
+  P4EST_ASSERT (runs->elem_size == 2 * sizeof (p4est_locidx_t));
+  sc_array_truncate (runs);
+
+  nl = ghost->mirror_proc_offsets[ghost->mpisize];
+  for (il = 0; il < nl; ++il) {
+    mirror = p2est_quadrant_array_index (&ghost->mirrors, (size_t)
+                                         ghost->mirror_proc_mirrors[il]);
+    li = mirror->p.piggy3.local_num;
+    if (run != NULL && li == run[0] + run[1]) {
+      ++run[1];
+    }
+    else {
+      run = (p4est_locidx_t *) sc_array_push (runs);
+      run[0] = li;
+      run[1] = 1;
+    }
+  }
+}
+
+/** Pack the mirror data in the order of the receivers.
+ * \param [in] layer_data   Contiguous data of the local layers, or NULL to
+ *                          send the layer user data.
+ */
+static void
+p6est_ghost_pack (p6est_t * p6est, sc_array_t * runs, size_t data_size,
+                  const void *layer_data, char *mem)
+{
+  size_t              zz;
+  p4est_locidx_t     *run, li;
+  p2est_quadrant_t   *layer;
+
+  for (zz = 0; zz < runs->elem_count; ++zz) {
+    run = (p4est_locidx_t *) sc_array_index (runs, zz);
+    P4EST_ASSERT (run[0] >= 0 && run[1] > 0 &&
+                  (size_t) (run[0] + run[1]) <= p6est->layers->elem_count);
+    if (layer_data != NULL) {
+      /* one copy for all layers of the run */
+      memcpy (mem, (const char *) layer_data + run[0] * data_size,
+              run[1] * data_size);
+      mem += run[1] * data_size;
+    }
+    else {
+      for (li = run[0]; li < run[0] + run[1]; ++li) {
+        layer = p2est_quadrant_array_index (p6est->layers, (size_t) li);
+        memcpy (mem, p6est->data_size == 0 ?
+                (void *) &layer->p.user_data : layer->p.user_data,
+                data_size);
+        mem += data_size;
+      }
+    }
+  }
+}
+
+static p6est_ghost_exchange_t *
+p6est_ghost_exchange_begin (p6est_t * p6est, p6est_ghost_t * ghost,
+                            size_t data_size, const void *layer_data,
+                            void *ghost_data)
+{
+  const int           num_procs = p6est->mpisize;
+  int                 mpiret;
+  int                 q;
+  p4est_locidx_t      ng_excl, ng_incl, ng;
+  p6est_ghost_exchange_t *exc;
+  sc_array_t          runs;
+  sc_MPI_Request     *r;
+
+  P4EST_ASSERT (ghost->mpisize == num_procs);
+
+  /* initialize transient storage */
+  exc = P4EST_ALLOC_ZERO (p6est_ghost_exchange_t, 1);
+  exc->p6est = p6est;
+  exc->ghost = ghost;
+  exc->data_size = data_size;
+  exc->ghost_data = ghost_data;
+  sc_array_init (&exc->requests, sizeof (sc_MPI_Request));
+
+  /* return early if there is nothing to do */
+  if (data_size == 0) {
+    return exc;
+  }
+
+  /* receive data from other processors */
+  for (q = 0; q < num_procs; ++q) {
+    ng_excl = ghost->proc_offsets[q];
+    ng_incl = ghost->proc_offsets[q + 1];
+    ng = ng_incl - ng_excl;
+    P4EST_ASSERT (ng >= 0);
+    if (ng > 0) {
+      r = (sc_MPI_Request *) sc_array_push (&exc->requests);
+      mpiret = sc_MPI_Irecv ((char *) ghost_data + ng_excl * data_size,
+                             ng * data_size, sc_MPI_BYTE, q,
+                             P6EST_COMM_GHOST_EXCHANGE, p6est->mpicomm, r);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+
+  /* pack the mirror data of all receivers into one buffer */
+  exc->send_buffer = P4EST_ALLOC (char, data_size *
+                                  ghost->mirror_proc_offsets[num_procs]);
+  sc_array_init (&runs, 2 * sizeof (p4est_locidx_t));
+  p6est_ghost_mirror_runs (ghost, &runs);
+  p6est_ghost_pack (p6est, &runs, data_size, layer_data, exc->send_buffer);
+  sc_array_reset (&runs);
+
+  /* send data to other processors */
+  for (q = 0; q < num_procs; ++q) {
+    ng_excl = ghost->mirror_proc_offsets[q];
+    ng_incl = ghost->mirror_proc_offsets[q + 1];
+    ng = ng_incl - ng_excl;
+    P4EST_ASSERT (ng >= 0);
+    if (ng > 0) {
+      r = (sc_MPI_Request *) sc_array_push (&exc->requests);
+      mpiret = sc_MPI_Isend (exc->send_buffer + ng_excl * data_size,
+                             ng * data_size, sc_MPI_BYTE, q,
+                             P6EST_COMM_GHOST_EXCHANGE, p6est->mpicomm, r);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+
+  /* we are done posting the messages */
+  return exc;
+}
+
+static void
+p6est_ghost_exchange_end (p6est_ghost_exchange_t * exc)
+{
+  int                 mpiret;
+
+  /* wait for messages to complete and clean up */
+  mpiret = sc_MPI_Waitall (exc->requests.elem_count, (sc_MPI_Request *)
+                           exc->requests.array, sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  sc_array_reset (&exc->requests);
+  P4EST_FREE (exc->send_buffer);
+
+  /* free the store */
+  P4EST_FREE (exc);
+}
+
+void
+p6est_ghost_exchange_data (p6est_t * p6est, p6est_ghost_t * ghost,
+                           void *ghost_data)
+{
+  p6est_ghost_exchange_data_end (p6est_ghost_exchange_data_begin
+                                 (p6est, ghost, ghost_data));
+}
+
+p6est_ghost_exchange_t *
+p6est_ghost_exchange_data_begin (p6est_t * p6est, p6est_ghost_t * ghost,
+                                 void *ghost_data)
+{
+  size_t              data_size;
+
+  data_size = p6est->data_size == 0 ? sizeof (void *) : p6est->data_size;
+  return p6est_ghost_exchange_begin (p6est, ghost, data_size, NULL,
+                                     ghost_data);
+}
+
+void
+p6est_ghost_exchange_data_end (p6est_ghost_exchange_t * exc)
+{
+  /* don't confuse this function with p6est_ghost_exchange_custom_end */
+  P4EST_ASSERT (!exc->is_custom);
+
+  p6est_ghost_exchange_end (exc);
+}
+
+void
+p6est_ghost_exchange_custom (p6est_t * p6est, p6est_ghost_t * ghost,
+                             size_t data_size, const void *layer_data,
+                             void *ghost_data)
+{
+  p6est_ghost_exchange_custom_end (p6est_ghost_exchange_custom_begin
+                                   (p6est, ghost, data_size,
+                                    layer_data, ghost_data));
+}
+
+p6est_ghost_exchange_t *
+p6est_ghost_exchange_custom_begin (p6est_t * p6est, p6est_ghost_t * ghost,
+                                   size_t data_size, const void *layer_data,
+                                   void *ghost_data)
+{
+  p6est_ghost_exchange_t *exc;
+
+  P4EST_ASSERT (data_size == 0 || layer_data != NULL ||
+                p6est->layers->elem_count == 0);
+
+  exc = p6est_ghost_exchange_begin (p6est, ghost, data_size, layer_data,
+                                    ghost_data);
+  exc->is_custom = 1;
+  return exc;
+}
+
+void
+p6est_ghost_exchange_custom_end (p6est_ghost_exchange_t * exc)
+{
+  /* don't confuse this function with p6est_ghost_exchange_data_end */
+  P4EST_ASSERT (exc->is_custom);
+
+  p6est_ghost_exchange_end (exc);
+}
+
+p6est_ghost_plan_t *
+p6est_ghost_plan_new (p6est_t * p6est, p6est_ghost_t * ghost,
+                      size_t data_size)
+{
+  p6est_ghost_plan_t *plan;
+#ifdef P4EST_ENABLE_MPI
+  const int           num_procs = p6est->mpisize;
+  int                 mpiret;
+  int                 q;
+  p4est_locidx_t      ng_excl, ng_incl, ng;
+#endif
+
+  P4EST_ASSERT (ghost->mpisize == p6est->mpisize);
+
+  plan = P4EST_ALLOC_ZERO (p6est_ghost_plan_t, 1);
+  plan->p6est = p6est;
+  plan->ghost = ghost;
+  plan->num_layers = p6est->layers->elem_count;
+  plan->num_ghosts = ghost->ghosts.elem_count;
+  plan->num_mirrors = ghost->mirrors.elem_count;
+  plan->data_size = data_size;
+  sc_array_init (&plan->runs, 2 * sizeof (p4est_locidx_t));
+  p6est_ghost_mirror_runs (ghost, &plan->runs);
+  plan->send_buffer = P4EST_ALLOC
+    (char, data_size * ghost->mirror_proc_offsets[ghost->mpisize]);
+  plan->ghost_data = P4EST_ALLOC (char, data_size * plan->num_ghosts);
+  plan->requests = P4EST_ALLOC (sc_MPI_Request, 2 * ghost->mpisize);
+
+#ifdef P4EST_ENABLE_MPI
+  if (data_size == 0) {
+    return plan;
+  }
+
+  /* set up the receives of ghost data from other processors */
+  for (q = 0; q < num_procs; ++q) {
+    ng_excl = ghost->proc_offsets[q];
+    ng_incl = ghost->proc_offsets[q + 1];
+    ng = ng_incl - ng_excl;
+    P4EST_ASSERT (ng >= 0);
+    if (ng > 0) {
+      mpiret = MPI_Recv_init (plan->ghost_data + ng_excl * data_size,
+                              ng * data_size, MPI_BYTE, q,
+                              P6EST_COMM_GHOST_PLAN, p6est->mpicomm,
+                              plan->requests + plan->num_requests++);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+
+  /* set up the sends of mirror data to other processors */
+  for (q = 0; q < num_procs; ++q) {
+    ng_excl = ghost->mirror_proc_offsets[q];
+    ng_incl = ghost->mirror_proc_offsets[q + 1];
+    ng = ng_incl - ng_excl;
+    P4EST_ASSERT (ng >= 0);
+    if (ng > 0) {
+      mpiret = MPI_Send_init (plan->send_buffer + ng_excl * data_size,
+                              ng * data_size, MPI_BYTE, q,
+                              P6EST_COMM_GHOST_PLAN, p6est->mpicomm,
+                              plan->requests + plan->num_requests++);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+#endif
+
+  return plan;
+}
+
+void
+p6est_ghost_plan_destroy (p6est_ghost_plan_t * plan)
+{
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+  int                 i;
+#endif
+
+  P4EST_ASSERT (!plan->is_active);
+
+#ifdef P4EST_ENABLE_MPI
+  for (i = 0; i < plan->num_requests; ++i) {
+    mpiret = MPI_Request_free (plan->requests + i);
+    SC_CHECK_MPI (mpiret);
+  }
+#endif
+
+  sc_array_reset (&plan->runs);
+  P4EST_FREE (plan->requests);
+  P4EST_FREE (plan->ghost_data);
+  P4EST_FREE (plan->send_buffer);
+  P4EST_FREE (plan);
+}
+
+void
+p6est_ghost_plan_begin (p6est_ghost_plan_t * plan, const void *layer_data)
+{
+  p6est_t            *p6est = plan->p6est;
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+#endif
+
+  SC_CHECK_ABORT (plan->num_layers == p6est->layers->elem_count &&
+                  plan->num_ghosts == plan->ghost->ghosts.elem_count &&
+                  plan->num_mirrors == plan->ghost->mirrors.elem_count,
+                  "Ghost plan does not match the forest");
+  P4EST_ASSERT (!plan->is_active);
+  P4EST_ASSERT (layer_data != NULL || plan->data_size ==
+                (p6est->data_size == 0 ? sizeof (void *) : p6est->data_size));
+  plan->is_active = 1;
+
+  p6est_ghost_pack (p6est, &plan->runs, plan->data_size, layer_data,
+                    plan->send_buffer);
+
+#ifdef P4EST_ENABLE_MPI
+  if (plan->num_requests > 0) {
+    mpiret = MPI_Startall (plan->num_requests, plan->requests);
+    SC_CHECK_MPI (mpiret);
+  }
+#endif
+}
+
+void               *
+p6est_ghost_plan_end (p6est_ghost_plan_t * plan)
+{
+  int                 mpiret;
+
+  P4EST_ASSERT (plan->is_active);
+
+  mpiret = sc_MPI_Waitall (plan->num_requests, plan->requests,
+                           sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  plan->is_active = 0;
+
+  return plan->ghost_data;
+}
+
+void               *
+p6est_ghost_plan_exchange (p6est_ghost_plan_t * plan, const void *layer_data)
+{
+  p6est_ghost_plan_begin (plan, layer_data);
+  return p6est_ghost_plan_end (plan);
+}
@@ -194,6 +194,147 @@ int                 p6est_is_balanced (p6est_t * p6est,
 unsigned            p6est_ghost_checksum (p6est_t * p6est,
                                           p6est_ghost_t * ghost);
 
+/** Exchange the user data of the mirror layers with the ghost layers.
+ * \param [in] p6est            The forest used to create the ghost layer.
+ * \param [in] ghost            The ghost layer used for reference.
+ * \param [in,out] ghost_data   Pre-allocated contiguous data for all ghost
+ *                              layers in sequence.  If p6est->data_size is
+ *                              0, must at least hold sizeof (void *) bytes for
+ *                              each, otherwise p6est->data_size each.
+ */
+void                p6est_ghost_exchange_data (p6est_t * p6est,
+                                               p6est_ghost_t * ghost,
+                                               void *ghost_data);
+
+/** Transient storage for asynchronous ghost exchange. */
+typedef struct p6est_ghost_exchange
+{
+  int                 is_custom;        /**< False for p6est_ghost_exchange_data */
+  p6est_t            *p6est;
+  p6est_ghost_t      *ghost;
+  size_t              data_size;
+  void               *ghost_data;
+  char               *send_buffer;      /**< Mirror data ordered by receiver */
+  sc_array_t          requests;
+}
+p6est_ghost_exchange_t;
+
+/** Begin an asynchronous ghost data exchange by posting messages.
+ * The arguments are identical to p6est_ghost_exchange_data.
+ * The return type is always non-NULL and must be passed to
+ * p6est_ghost_exchange_data_end to complete the exchange.
+ * The ghost data must not be accessed before completion.
+ * \return          Transient storage for messages in progress.
+ */
+p6est_ghost_exchange_t *p6est_ghost_exchange_data_begin
+  (p6est_t * p6est, p6est_ghost_t * ghost, void *ghost_data);
+
+/** Complete an asynchronous ghost data exchange.
+ * This function waits for all pending MPI communications.
+ * \param [in,out]  Data created ONLY by p6est_ghost_exchange_data_begin.
+ *                  It is deallocated before this function returns.
+ */
+void                p6est_ghost_exchange_data_end
+  (p6est_ghost_exchange_t * exc);
+
+/** Exchange layer data stored contiguously in the order of the local layers.
+ * Since the layers of a column are consecutive, the mirror data of each
+ * column is packed by one memory copy.
+ * \param [in] p6est            The forest used to create the ghost layer.
+ * \param [in] ghost            The ghost layer used for reference.
+ * \param [in] data_size        The data size to transfer per layer.
+ * \param [in] layer_data       Data of all local layers in the order of
+ *                              p6est->layers, data_size bytes each.
+ * \param [in,out] ghost_data   Pre-allocated contiguous data for all ghost
+ *                              layers in sequence, data_size bytes each.
+ */
+void                p6est_ghost_exchange_custom (p6est_t * p6est,
+                                                 p6est_ghost_t * ghost,
+                                                 size_t data_size,
+                                                 const void *layer_data,
+                                                 void *ghost_data);
+
+/** Begin an asynchronous ghost data exchange by posting messages.
+ * The arguments are identical to p6est_ghost_exchange_custom.
+ * The layer data is copied before this function returns.
+ * The return type is always non-NULL and must be passed to
+ * p6est_ghost_exchange_custom_end to complete the exchange.
+ * \return          Transient storage for messages in progress.
+ */
+p6est_ghost_exchange_t *p6est_ghost_exchange_custom_begin
+  (p6est_t * p6est, p6est_ghost_t * ghost, size_t data_size,
+   const void *layer_data, void *ghost_data);
+
+/** Complete an asynchronous ghost data exchange.
+ * \param [in,out]  Data created ONLY by p6est_ghost_exchange_custom_begin.
+ *                  It is deallocated before this function returns.
+ */
+void                p6est_ghost_exchange_custom_end
+  (p6est_ghost_exchange_t * exc);
+
+/** Persistent storage for repeated exchanges on an unchanged ghost layer.
+ * The runs of consecutive mirror layers, the buffers and the MPI requests
+ * are set up once by \ref p6est_ghost_plan_new.
+ */
+typedef struct p6est_ghost_plan
+{
+  p6est_t            *p6est;
+  p6est_ghost_t      *ghost;
+  size_t              num_layers;       /**< Local layers when created */
+  size_t              num_ghosts, num_mirrors;  /**< Sizes when created */
+  size_t              data_size;        /**< Bytes exchanged per layer */
+  sc_array_t          runs;     /**< Pairs of first local layer and count */
+  char               *send_buffer;      /**< Mirror data ordered by receiver */
+  char               *ghost_data;       /**< Data of all ghosts in sequence */
+  int                 num_requests;     /**< Receives first, then sends */
+  int                 is_active;        /**< True between begin and end */
+  sc_MPI_Request     *requests;         /**< Persistent requests */
+}
+p6est_ghost_plan_t;
+
+/** Create a persistent plan for exchanging data of a given size.
+ * The plan must be destroyed before the forest and the ghost layer.
+ * \param [in] p6est            The forest used for reference.
+ * \param [in] ghost            The ghost layer used for reference.
+ * \param [in] data_size        The data size to transfer per layer.
+ * \return                      Plan ready for \ref p6est_ghost_plan_begin.
+ */
+p6est_ghost_plan_t *p6est_ghost_plan_new (p6est_t * p6est,
+                                          p6est_ghost_t * ghost,
+                                          size_t data_size);
+
+/** Destroy a plan that is not active. */
+void                p6est_ghost_plan_destroy (p6est_ghost_plan_t * plan);
+
+/** Begin a ghost data exchange by starting the persistent requests.
+ * This function does not allocate memory.  It aborts if the number of
+ * layers, ghosts or mirrors has changed since the plan was created.
+ * \param [in,out] plan         A plan that is not active.
+ * \param [in] layer_data       Data of all local layers as in \ref
+ *                              p6est_ghost_exchange_custom.  If NULL, the
+ *                              layer user data is sent as with \ref
+ *                              p6est_ghost_exchange_data; the plan's data
+ *                              size must then be the forest's data size, or
+ *                              sizeof (void *) if that is zero.
+ */
+void                p6est_ghost_plan_begin (p6est_ghost_plan_t * plan,
+                                            const void *layer_data);
+
+/** Complete a ghost data exchange started by \ref p6est_ghost_plan_begin.
+ * \param [in,out] plan         An active plan.
+ * \return                      The plan's ghost data array, holding
+ *                              data_size bytes for each ghost in sequence.
+ *                              It is overwritten by the next exchange.
+ */
+void               *p6est_ghost_plan_end (p6est_ghost_plan_t * plan);
+
+/** Exchange ghost data using a plan.
+ * This is equivalent to \ref p6est_ghost_plan_begin followed by
+ * \ref p6est_ghost_plan_end.
+ */
+void               *p6est_ghost_plan_exchange (p6est_ghost_plan_t * plan,
+                                               const void *layer_data);
+
 SC_EXTERN_C_END;
 
 #endif /* P6EST_GHOST_H */
@@ -310,39 +310,64 @@ p6est_profile_balance_full (sc_array_t * a, sc_array_t * b, sc_array_t * work,
   p6est_profile_balance_self_one_pass (work, b);
 }
 
+/* Number the nodes of one 2D node position along a column: the element
+ * layers elem are matched against the (coarser or equal) node profile node.
+ * The degree + 1 entries of element az start at e_to_n + az * stride.  If the
+ * two profiles are the same, no layer can hang and the numbering is a plain
+ * stride-degree sequence. */
 static void
 p6est_profile_element_to_node_single (sc_array_t * elem, sc_array_t * node,
                                       int degree, p4est_locidx_t offset,
-                                      p4est_locidx_t ** elem_to_node,
+                                      p4est_locidx_t * e_to_n, size_t stride,
                                       p6est_lnodes_code_t * fc, int fcoffset)
 {
+  size_t              nelem = elem->elem_count;
   size_t              nedge = node->elem_count;
   size_t              az, bz;
+  const int8_t       *ea, *nb;
+  p4est_locidx_t     *etn;
   int                 i;
 
   P4EST_ASSERT (degree > 1);
+  P4EST_ASSERT (elem->elem_size == sizeof (int8_t));
+  P4EST_ASSERT (node->elem_size == sizeof (int8_t));
 
+  if (node == elem) {
+    P4EST_ASSERT (fc == NULL);
+    for (az = 0, etn = e_to_n; az < nelem; az++, etn += stride) {
+      for (i = 0; i < degree + 1; i++) {
+        etn[i] = offset + az * degree + i;
+      }
+    }
+    return;
+  }
+
+  ea = (const int8_t *) elem->array;
+  nb = (const int8_t *) node->array;
   az = 0;
+  etn = e_to_n;
 
   for (bz = 0; bz < nedge; bz++) {
     int8_t              a;
-    int8_t              b = *((int8_t *) sc_array_index (node, bz));
+    int8_t              b = nb[bz];
     int                 loop = 0;
 
     do {
-      a = *((int8_t *) sc_array_index (elem, az));
+      P4EST_ASSERT (az < nelem);
+      a = ea[az];
       P4EST_ASSERT (a == b || a == b + 1);
       loop = !loop && (a == b + 1);
       for (i = 0; i < degree + 1; i++) {
-        elem_to_node[az][i] = offset + bz * degree + i;
+        etn[i] = offset + bz * degree + i;
       }
       if (fc && a == b + 1) {
         fc[az] |= (1 << (fcoffset + 5));
       }
       az++;
+      etn += stride;
     } while (loop);
   }
-  P4EST_ASSERT (az == elem->elem_count);
+  P4EST_ASSERT (az == nelem);
 }
 
 static void
@@ -354,7 +379,6 @@ p6est_profile_element_to_node_col (p6est_profile_t * profile,
 {
   p4est_locidx_t (*lr)[2] = (p4est_locidx_t (*)[2]) profile->lnode_ranges;
   p4est_locidx_t      nelem;
-  p4est_locidx_t    **elem_to_node;
   int                 i, j, k;
   p4est_locidx_t      ll;
   sc_array_t          elem, node;
@@ -365,6 +389,7 @@ p6est_profile_element_to_node_col (p6est_profile_t * profile,
   int                 degree = profile->lnodes->degree;
   int                 Nrp = degree + 1;
   int                 Nfp = (degree + 1) * (degree + 1);
+  size_t              stride = (size_t) Nfp * Nrp;
 
   P4EST_ASSERT (degree > 1);
 
@@ -373,42 +398,40 @@ p6est_profile_element_to_node_col (p6est_profile_t * profile,
 
   sc_array_init_view (&elem, lc, lr[ncid][0], nelem);
 
-  elem_to_node = P4EST_ALLOC (p4est_locidx_t *, nelem);
-
   for (ll = 0; ll < nelem; ll++) {
     fc[ll] = (p6est_lnodes_code_t) fc4;
   }
   for (k = 0, j = 0; j < Nrp; j++) {
     for (i = 0; i < Nrp; i++, k++) {
       nid = en[Nfp * cid + k];
-      sc_array_init_view (&node, lc, lr[nid][0], lr[nid][1]);
-      for (ll = 0; ll < nelem; ll++) {
-        elem_to_node[ll] = e_to_n +
-          (degree + 1) * (degree + 1) * (degree + 1) * ll + (degree + 1) * k;
-      }
       if (!(i % degree) && !(j % degree)) {
         int                 c = 2 * (! !j) + (! !i);
 
+        sc_array_init_view (&node, lc, lr[nid][0], lr[nid][1]);
         p6est_profile_element_to_node_single (&elem, &node, degree,
-                                              offsets[nid], elem_to_node, fc,
+                                              offsets[nid],
+                                              e_to_n + Nrp * k, stride, fc,
                                               4 + c);
       }
       else if ((i % degree) && (j % degree)) {
+        /* interior nodes belong to this column alone */
         p6est_profile_element_to_node_single (&elem, &elem, degree,
-                                              offsets[nid], elem_to_node,
+                                              offsets[nid],
+                                              e_to_n + Nrp * k, stride,
                                               NULL, -1);
       }
       else {
         int                 f = 2 * !(j % degree) + (i == degree
                                                      || j == degree);
 
+        sc_array_init_view (&node, lc, lr[nid][0], lr[nid][1]);
         p6est_profile_element_to_node_single (&elem, &node, degree,
-                                              offsets[nid], elem_to_node, fc,
+                                              offsets[nid],
+                                              e_to_n + Nrp * k, stride, fc,
                                               f);
       }
     }
   }
-  P4EST_FREE (elem_to_node);
 }
 
 void
@@ -488,7 +511,8 @@ p6est_profile_compress (p6est_profile_t * profile)
   if (!old_count) {
     return;
   }
-  perm = sc_array_new_size (sizeof (size_t), old_count);
+  perm = profile->perm;
+  sc_array_resize (perm, old_count);
   newindex = (size_t *) sc_array_index (perm, 0);
 
   for (zz = 0; zz < old_count; zz++) {
@@ -518,7 +542,6 @@ p6est_profile_compress (p6est_profile_t * profile)
   }
 
   sc_array_permute (lc, perm, 0);
-  sc_array_destroy (perm);
   sc_array_resize (lc, new_count);
 }
 
@@ -561,6 +584,8 @@ p6est_profile_new_local (p6est_t * p6est,
   profile->lnode_changed[1] = NULL;
   profile->enode_counts = NULL;
   profile->diff = diff;
+  profile->node_offsets = NULL;
+  profile->node_elements = NULL;
   if (btype == P8EST_CONNECT_FACE) {
     hbtype = P4EST_CONNECT_FACE;
   }
@@ -587,10 +612,15 @@ p6est_profile_new_local (p6est_t * p6est,
   profile->lnode_ranges = P4EST_ALLOC_ZERO (p4est_locidx_t, 2 * nln);
   lr = (p4est_locidx_t (*)[2]) profile->lnode_ranges;
   profile->lnode_columns = lc = sc_array_new (sizeof (int8_t));
-  selfprof = sc_array_new (sizeof (int8_t));
-  work = sc_array_new (sizeof (int8_t));
-  faceprof = sc_array_new (sizeof (int8_t));
-  cornerprof = sc_array_new (sizeof (int8_t));
+  profile->selfprof = selfprof = sc_array_new (sizeof (int8_t));
+  profile->work = work = sc_array_new (sizeof (int8_t));
+  profile->faceprof = faceprof = sc_array_new (sizeof (int8_t));
+  profile->cornerprof = cornerprof = sc_array_new (sizeof (int8_t));
+  profile->perm = sc_array_new (sizeof (size_t));
+  profile->visit = sc_array_new (sizeof (p4est_locidx_t));
+  /* every node profile has to be sent by the first sync */
+  profile->lnode_dirty = P4EST_ALLOC (int, nln);
+  memset (profile->lnode_dirty, -1, nln * sizeof (int));
   if (ptype == P6EST_PROFILE_UNION) {
     profile->lnode_changed[0] = P4EST_ALLOC (p4est_locidx_t, nln);
     profile->lnode_changed[1] = P4EST_ALLOC (p4est_locidx_t, nln);
@@ -703,14 +733,81 @@ p6est_profile_new_local (p6est_t * p6est,
   }
   p6est_profile_compress (profile);
 
-  sc_array_destroy (selfprof);
-  sc_array_destroy (faceprof);
-  sc_array_destroy (cornerprof);
-  sc_array_destroy (work);
-
   return profile;
 }
 
+/* build the list of elements adjacent to each node */
+static void
+p6est_profile_node_elements (p6est_profile_t * profile)
+{
+  p4est_lnodes_t     *lnodes = profile->lnodes;
+  p4est_locidx_t      nln = lnodes->num_local_nodes;
+  p4est_locidx_t      nle = lnodes->num_local_elements;
+  p4est_locidx_t     *en = lnodes->element_nodes;
+  p4est_locidx_t     *offsets, *elements;
+  p4est_locidx_t      nidx, eidx, enidx;
+
+  P4EST_ASSERT (profile->node_offsets == NULL);
+  offsets = P4EST_ALLOC_ZERO (p4est_locidx_t, nln + 1);
+  for (enidx = 0; enidx < P4EST_INSUL * nle; enidx++) {
+    ++offsets[en[enidx] + 1];
+  }
+  for (nidx = 0; nidx < nln; nidx++) {
+    offsets[nidx + 1] += offsets[nidx];
+  }
+  elements = P4EST_ALLOC (p4est_locidx_t, P4EST_INSUL * nle);
+  for (eidx = 0, enidx = 0; eidx < nle; eidx++) {
+    for (; enidx < P4EST_INSUL * (eidx + 1); enidx++) {
+      elements[offsets[en[enidx]]++] = eidx;
+    }
+  }
+  /* the fill has advanced each offset to the start of the next node */
+  for (nidx = nln; nidx > 0; nidx--) {
+    offsets[nidx] = offsets[nidx - 1];
+  }
+  offsets[0] = 0;
+
+  profile->node_offsets = offsets;
+  profile->node_elements = elements;
+}
+
+/* collect the elements adjacent to the changed nodes in ascending order,
+ * or return NULL if so many nodes have changed that we visit them all */
+static sc_array_t  *
+p6est_profile_visit_elements (p6est_profile_t * profile, int evenodd)
+{
+  p4est_locidx_t      nln = profile->lnodes->num_local_nodes;
+  p4est_locidx_t      nidx, num_changed, il;
+  int                *changed = profile->lnode_changed[evenodd];
+  sc_array_t         *visit = profile->visit;
+
+  for (num_changed = 0, nidx = 0; nidx < nln; nidx++) {
+    if (changed[nidx]) {
+      num_changed++;
+    }
+  }
+  if (num_changed > nln / 8) {
+    return NULL;
+  }
+
+  if (profile->node_offsets == NULL) {
+    p6est_profile_node_elements (profile);
+  }
+  sc_array_truncate (visit);
+  for (nidx = 0; nidx < nln; nidx++) {
+    if (changed[nidx]) {
+      il = profile->node_offsets[nidx + 1] - profile->node_offsets[nidx];
+      memcpy (sc_array_push_count (visit, il),
+              profile->node_elements + profile->node_offsets[nidx],
+              il * sizeof (p4est_locidx_t));
+    }
+  }
+  sc_array_sort (visit, p4est_locidx_compare);
+  sc_array_uniq (visit, p4est_locidx_compare);
+
+  return visit;
+}
+
 void
 p6est_profile_balance_local (p6est_profile_t * profile)
 {
@@ -719,15 +816,16 @@ p6est_profile_balance_local (p6est_profile_t * profile)
   p4est_locidx_t     *en, (*lr)[2];
   sc_array_t         *lc;
   int                 i, j;
-  p4est_locidx_t      nidx, enidx, eidx;
+  p4est_locidx_t      nidx, enidx, eidx, vidx, nvisit;
   p8est_connect_type_t btype = profile->btype;
   p4est_connect_type_t hbtype;
   int8_t             *c;
   sc_array_t         *thisprof;
-  sc_array_t         *selfprof;
-  sc_array_t         *faceprof;
-  sc_array_t         *cornerprof;
-  sc_array_t         *work;
+  sc_array_t         *selfprof = profile->selfprof;
+  sc_array_t         *faceprof = profile->faceprof;
+  sc_array_t         *cornerprof = profile->cornerprof;
+  sc_array_t         *work = profile->work;
+  sc_array_t         *visit;
   sc_array_t          oldprof;
   sc_array_t          testprof;
   int                 any_prof_change;
@@ -748,19 +846,23 @@ p6est_profile_balance_local (p6est_profile_t * profile)
   nle = lnodes->num_local_elements;
   lr = (p4est_locidx_t (*)[2]) profile->lnode_ranges;
   lc = profile->lnode_columns;
-  selfprof = sc_array_new (sizeof (int8_t));
-  work = sc_array_new (sizeof (int8_t));
-  faceprof = sc_array_new (sizeof (int8_t));
-  cornerprof = sc_array_new (sizeof (int8_t));
 
   do {
     /* We read from evenodd and write to evenodd ^ 1 */
     memset (&(profile->lnode_changed[evenodd ^ 1][0]), 0, sizeof (int) * nln);
     P4EST_GLOBAL_VERBOSE ("p6est_balance local loop\n");
 
+    /* an element none of whose nodes has changed has nothing to do */
+    visit = p6est_profile_visit_elements (profile, evenodd);
+    nvisit = visit != NULL ? (p4est_locidx_t) visit->elem_count : nle;
+
     any_local_change = 0;
-    for (eidx = 0, enidx = 0; eidx < nle; eidx++) {
-      p4est_locidx_t      start_enidx = enidx;
+    for (vidx = 0; vidx < nvisit; vidx++) {
+      p4est_locidx_t      start_enidx;
+
+      eidx = visit != NULL ?
+        *((p4est_locidx_t *) sc_array_index (visit, vidx)) : vidx;
+      enidx = start_enidx = P4EST_INSUL * eidx;
       nidx = en[start_enidx + P4EST_INSUL / 2];
       P4EST_ASSERT (lr[nidx][1]);
       sc_array_init_view (&oldprof, lc, lr[nidx][0], lr[nidx][1]);
@@ -857,6 +959,7 @@ p6est_profile_balance_local (p6est_profile_t * profile)
                 profile->lnode_changed[evenodd ^ 1][nidx] = 1;
                 any_local_change = 1;
               }
+              profile->lnode_dirty[nidx] = 1;
               lr[nidx][0] = lc->elem_count;
               lr[nidx][1] = work->elem_count;
               c = (int8_t *) sc_array_push_count (lc, work->elem_count);
@@ -872,10 +975,6 @@ p6est_profile_balance_local (p6est_profile_t * profile)
   } while (any_local_change);
 
   profile->evenodd = evenodd;
-  sc_array_destroy (selfprof);
-  sc_array_destroy (faceprof);
-  sc_array_destroy (cornerprof);
-  sc_array_destroy (work);
 }
 
 int
@@ -894,10 +993,11 @@ p6est_profile_sync (p6est_profile_t * profile)
   p4est_locidx_t     *recv_offsets, recv_offset;
   p4est_locidx_t      send_total;
   p4est_locidx_t     *send_offsets, send_offset;
-  p4est_locidx_t (*lr)[2];
+  p4est_locidx_t (*lr)[2], (*sr)[2];
+  p4est_locidx_t      nidx;
   sc_array_t         *lc = profile->lnode_columns;
   sc_MPI_Request     *recv_request, *send_request;
-  sc_array_t         *work;
+  sc_array_t         *work = profile->work;
   int                 any_change = 0;
   int                 any_global_change;
   int                 mpiret, mpirank;
@@ -910,7 +1010,14 @@ p6est_profile_sync (p6est_profile_t * profile)
   mpiret = sc_MPI_Comm_rank (lnodes->mpicomm, &mpirank);
   SC_CHECK_MPI (mpiret);
 
-  sc_array_init_data (&lrview, lr, 2 * sizeof (p4est_locidx_t), nln);
+  /* announce an empty range for the profiles that have not changed since
+   * they were last sent: the receivers have merged them already */
+  sr = (p4est_locidx_t (*)[2]) P4EST_ALLOC (p4est_locidx_t, 2 * nln);
+  for (nidx = 0; nidx < nln; nidx++) {
+    sr[nidx][0] = lr[nidx][0];
+    sr[nidx][1] = profile->lnode_dirty[nidx] ? lr[nidx][1] : 0;
+  }
+  sc_array_init_data (&lrview, sr, 2 * sizeof (p4est_locidx_t), nln);
 
   countbuf = p4est_lnodes_share_all_begin (&lrview, lnodes);
   send_offsets = P4EST_ALLOC (p4est_locidx_t, nsharers + 1);
@@ -1015,19 +1122,18 @@ p6est_profile_sync (p6est_profile_t * profile)
     nnodes = shared_nodes->elem_count;
     icount = 0;
     for (zy = 0; zy < nnodes; zy++) {
-      p4est_locidx_t      nidx;
       int8_t             *c;
 
       nidx = *((p4est_locidx_t *) sc_array_index (shared_nodes, zy));
 
-      if (lr[nidx][1]) {
+      if (sr[nidx][1]) {
         c = (int8_t *) sc_array_index (lc, lr[nidx][0]);
         memcpy (send + send_offsets[zz] + icount, c,
                 lr[nidx][1] * sizeof (int8_t));
         icount += lr[nidx][1];
       }
       else {
-        P4EST_ASSERT (!lr[nidx][0]);
+        P4EST_ASSERT (!lr[nidx][1] || !profile->lnode_dirty[nidx]);
       }
     }
     P4EST_ASSERT (icount == send_offsets[zz + 1] - send_offsets[zz]);
@@ -1043,7 +1149,9 @@ p6est_profile_sync (p6est_profile_t * profile)
     }
   }
 
-  work = sc_array_new (sizeof (int8_t));
+  memset (profile->lnode_dirty, 0, nln * sizeof (int));
+  P4EST_FREE (sr);
+
   array_of_indices = P4EST_ALLOC (int, nsharers);
   while (nleft) {
     int                 outcount;
@@ -1069,11 +1177,14 @@ p6est_profile_sync (p6est_profile_t * profile)
       recv_offset = recv_offsets[zz];
       for (zy = 0; zy < nnode; zy++) {
         p4est_locidx_t     *lp;
-        p4est_locidx_t      nidx;
         sc_array_t          oldview, newview;
 
         nidx = *((p4est_locidx_t *) sc_array_index (shared_nodes, zy));
         lp = (p4est_locidx_t *) sc_array_index (recv_buf, zy);
+        if (!lp[1]) {
+          /* the sender has nothing new for this node */
+          continue;
+        }
 
         sc_array_init_view (&oldview, lc, lr[nidx][0], lr[nidx][1]);
         sc_array_init_data (&newview, recv + recv_offset, sizeof (int8_t),
@@ -1112,7 +1223,6 @@ p6est_profile_sync (p6est_profile_t * profile)
     P4EST_ASSERT (nleft >= 0);
   }
   P4EST_FREE (array_of_indices);
-  sc_array_destroy (work);
 
   p6est_profile_compress (profile);
   p4est_lnodes_buffer_destroy (countbuf);
@@ -1153,100 +1263,180 @@ p6est_profile_destroy (p6est_profile_t * profile)
     P4EST_ASSERT (profile->enode_counts);
     P4EST_FREE (profile->enode_counts);
   }
+  P4EST_FREE (profile->lnode_dirty);
+  P4EST_FREE (profile->node_offsets);
+  P4EST_FREE (profile->node_elements);
   P4EST_FREE (profile->lnode_ranges);
   sc_array_destroy (profile->lnode_columns);
+  sc_array_destroy (profile->selfprof);
+  sc_array_destroy (profile->faceprof);
+  sc_array_destroy (profile->cornerprof);
+  sc_array_destroy (profile->work);
+  sc_array_destroy (profile->perm);
+  sc_array_destroy (profile->visit);
   P4EST_FREE (profile);
 }
 
+/** Refine the layers of one column to its profile.
+ * The resulting layers are appended to \a work.
+ */
+static void
+p6est_refine_column_to_profile (p6est_t * p6est, p6est_profile_t * profile,
+                                p4est_topidx_t jt, p4est_quadrant_t * col,
+                                p4est_locidx_t eidx, p6est_init_t init_fn,
+                                p6est_replace_t replace_fn, sc_array_t * work)
+{
+  size_t              zy, first, last;
+  p4est_locidx_t     *en = profile->lnodes->element_nodes;
+  p4est_locidx_t (*lr)[2];
+  p4est_locidx_t      nidx, pidx, pfirst, plast;
+  sc_array_t         *layers = p6est->layers;
+  sc_array_t         *lc = profile->lnode_columns;
+  p2est_quadrant_t    stack[P4EST_QMAXLEVEL];
+  p2est_quadrant_t   *q, *r, s, t;
+  int                 stackcount;
+#ifdef P4EST_ENABLE_DEBUG
+  size_t              old_count = work->elem_count;
+#endif
+
+  lr = (p4est_locidx_t (*)[2]) profile->lnode_ranges;
+  P6EST_COLUMN_GET_RANGE (col, &first, &last);
+  nidx = en[P4EST_INSUL * eidx + P4EST_INSUL / 2];
+  P4EST_ASSERT ((size_t) lr[nidx][1] >= last - first);
+  pfirst = lr[nidx][0];
+  plast = pfirst + lr[nidx][1];
+
+  stackcount = 0;
+  zy = first;
+  for (pidx = pfirst; pidx < plast; pidx++) {
+    int8_t              p;
+
+    P4EST_ASSERT (stackcount || zy < last);
+
+    p = *((int8_t *) sc_array_index (lc, pidx));
+
+    if (stackcount) {
+      q = &(stack[--stackcount]);
+    }
+    else {
+      q = p2est_quadrant_array_index (layers, zy++);
+    }
+
+    P4EST_ASSERT (q->level <= p);
+    while (q->level < p) {
+      p2est_quadrant_t   *child[2];
+
+      t = *q;
+      s = *q;
+      s.level++;
+      stack[stackcount] = s;
+      stack[stackcount].z += P4EST_QUADRANT_LEN (s.level);
+      child[0] = &s;
+      child[1] = &stack[stackcount++];
+      p6est_layer_init_data (p6est, jt, col, child[0], init_fn);
+      p6est_layer_init_data (p6est, jt, col, child[1], init_fn);
+      q = &t;
+      if (replace_fn) {
+        replace_fn (p6est, jt, 1, 1, &col, &q, 1, 2, &col, child);
+      }
+      p6est_layer_free_data (p6est, &t);
+      q = &s;
+    }
+    r = p2est_quadrant_array_push (work);
+    *r = *q;
+  }
+  P4EST_ASSERT (work->elem_count - old_count == (size_t) lr[nidx][1]);
+}
+
 void
 p6est_refine_to_profile (p6est_t * p6est, p6est_profile_t * profile,
                          p6est_init_t init_fn, p6est_replace_t replace_fn)
 {
-  size_t              zz, zy, first, last;
+#ifdef P4EST_ENABLE_OPENMP
+  int                 num_threads;
+#endif
+  size_t              zz, first, last;
   p4est_topidx_t      jt;
+  p4est_t            *columns = p6est->columns;
   p4est_quadrant_t   *col;
   p4est_tree_t       *tree;
   sc_array_t         *tquadrants;
   p4est_locidx_t      eidx;
   p4est_locidx_t     *en = profile->lnodes->element_nodes;
   p4est_locidx_t (*lr)[2];
-  p4est_locidx_t      nidx, pidx, pfirst, plast;
+  p4est_locidx_t      nidx;
   sc_array_t         *layers = p6est->layers;
-  sc_array_t         *lc = profile->lnode_columns;
   sc_array_t         *work;
+  p2est_quadrant_t   *q;
 
   P4EST_ASSERT (profile->lnodes->degree == 2);
 
   lr = (p4est_locidx_t (*)[2]) profile->lnode_ranges;
-  work = sc_array_new (sizeof (p2est_quadrant_t));
-  for (eidx = 0, jt = p6est->columns->first_local_tree;
-       jt <= p6est->columns->last_local_tree; ++jt) {
-    tree = p4est_tree_array_index (p6est->columns->trees, jt);
-    tquadrants = &tree->quadrants;
-    for (zz = 0; zz < tquadrants->elem_count; ++zz, eidx++) {
 
-      col = p4est_quadrant_array_index (tquadrants, zz);
-      P6EST_COLUMN_GET_RANGE (col, &first, &last);
-      nidx = en[P4EST_INSUL * eidx + P4EST_INSUL / 2];
-      P4EST_ASSERT ((size_t) lr[nidx][1] >= last - first);
-      pfirst = lr[nidx][0];
-      plast = pfirst + lr[nidx][1];
-      if ((size_t) lr[nidx][1] > last - first) {
-        p2est_quadrant_t    stack[P4EST_QMAXLEVEL];
-        p2est_quadrant_t   *q, *r, s, t;
-        int                 stackcount;
-
-        sc_array_truncate (work);
-        stackcount = 0;
-        zy = first;
-        for (pidx = pfirst; pidx < plast; pidx++) {
-          int8_t              p;
-
-          P4EST_ASSERT (stackcount || zy < last);
-
-          p = *((int8_t *) sc_array_index (lc, pidx));
-
-          if (stackcount) {
-            q = &(stack[--stackcount]);
-          }
-          else {
-            q = p2est_quadrant_array_index (layers, zy++);
-          }
-
-          P4EST_ASSERT (q->level <= p);
-          while (q->level < p) {
-            p2est_quadrant_t   *child[2];
-
-            t = *q;
-            s = *q;
-            s.level++;
-            stack[stackcount] = s;
-            stack[stackcount].z += P4EST_QUADRANT_LEN (s.level);
-            child[0] = &s;
-            child[1] = &stack[stackcount++];
-            p6est_layer_init_data (p6est, jt, col, child[0], init_fn);
-            p6est_layer_init_data (p6est, jt, col, child[1], init_fn);
-            q = &t;
-            if (replace_fn) {
-              replace_fn (p6est, jt, 1, 1, &col, &q, 1, 2, &col, child);
-            }
-            p6est_layer_free_data (p6est, &t);
-            q = &s;
-          }
-          r = p2est_quadrant_array_push (work);
-          *r = *q;
+#ifdef P4EST_ENABLE_OPENMP
+  num_threads = SC_MIN (p4est_get_num_threads (),
+                        (int) columns->local_num_quadrants);
+  if (num_threads > 1) {
+    int                 t;
+    sc_array_t         *chunks = P4EST_ALLOC (sc_array_t, num_threads);
+
+    /* each chunk of consecutive columns is refined into its own buffer */
+#pragma omp parallel for num_threads (num_threads) schedule (static, 1) \
+  private (jt, tree, col, zz, first, eidx)
+    for (t = 0; t < num_threads; ++t) {
+      p4est_locidx_t      lo, hi;
+
+      lo = (p4est_locidx_t)
+        (((p4est_gloidx_t) columns->local_num_quadrants * t) / num_threads);
+      hi = (p4est_locidx_t)
+        (((p4est_gloidx_t) columns->local_num_quadrants * (t + 1)) /
+         num_threads);
+      sc_array_init (&chunks[t], sizeof (p2est_quadrant_t));
+      p6est_column_locate (p6est, lo, &jt, &zz);
+      tree = p4est_tree_array_index (columns->trees, jt);
+      for (eidx = lo; eidx < hi; ++eidx, ++zz) {
+        while (zz == tree->quadrants.elem_count) {
+          tree = p4est_tree_array_index (columns->trees, ++jt);
+          zz = 0;
+        }
+        col = p4est_quadrant_array_index (&tree->quadrants, zz);
+        first = chunks[t].elem_count;
+        p6est_refine_column_to_profile (p6est, profile, jt, col, eidx,
+                                        init_fn, replace_fn, &chunks[t]);
+        P6EST_COLUMN_SET_RANGE (col, first, chunks[t].elem_count);
+      }
+    }
+    p6est_layers_from_chunks (p6est, num_threads, chunks);
+    P4EST_FREE (chunks);
+  }
+  else
+#endif
+  {
+    work = sc_array_new (sizeof (p2est_quadrant_t));
+    for (eidx = 0, jt = columns->first_local_tree;
+         jt <= columns->last_local_tree; ++jt) {
+      tree = p4est_tree_array_index (columns->trees, jt);
+      tquadrants = &tree->quadrants;
+      for (zz = 0; zz < tquadrants->elem_count; ++zz, eidx++) {
+
+        col = p4est_quadrant_array_index (tquadrants, zz);
+        P6EST_COLUMN_GET_RANGE (col, &first, &last);
+        nidx = en[P4EST_INSUL * eidx + P4EST_INSUL / 2];
+        if ((size_t) lr[nidx][1] > last - first) {
+          sc_array_truncate (work);
+          p6est_refine_column_to_profile (p6est, profile, jt, col, eidx,
+                                          init_fn, replace_fn, work);
+          first = layers->elem_count;
+          last = first + work->elem_count;
+          P6EST_COLUMN_SET_RANGE (col, first, last);
+          q = (p2est_quadrant_t *) sc_array_push_count (layers,
+                                                        work->elem_count);
+          memcpy (q, work->array, work->elem_count * work->elem_size);
         }
-        P4EST_ASSERT (work->elem_count == (size_t) lr[nidx][1]);
-        first = layers->elem_count;
-        last = first + work->elem_count;
-        P6EST_COLUMN_SET_RANGE (col, first, last);
-        q = (p2est_quadrant_t *) sc_array_push_count (layers,
-                                                      work->elem_count);
-        memcpy (q, work->array, work->elem_count * work->elem_size);
       }
     }
+    sc_array_destroy (work);
   }
-  sc_array_destroy (work);
   p6est_compress_columns (p6est);
   p6est_update_offsets (p6est);
 }
@@ -54,9 +54,20 @@ typedef struct p6est_profile
   p4est_locidx_t     *lnode_ranges;
   sc_array_t         *lnode_columns;
   int                *lnode_changed[2];
+  int                *lnode_dirty;      /* changed since the last sync */
   p4est_locidx_t     *enode_counts;
   int                 evenodd;
   p4est_qcoord_t      diff;
+  /* adjacent elements of each node, built when first needed */
+  p4est_locidx_t     *node_offsets;
+  p4est_locidx_t     *node_elements;
+  /* workspace reused by all passes over the profile */
+  sc_array_t         *selfprof;
+  sc_array_t         *faceprof;
+  sc_array_t         *cornerprof;
+  sc_array_t         *work;
+  sc_array_t         *perm;
+  sc_array_t         *visit;
 }
 p6est_profile_t;
 
@@ -79,12 +90,16 @@ p6est_profile_t    *p6est_profile_new_local (p6est_t * p6est,
 /** Destroy a profile */
 void                p6est_profile_destroy (p6est_profile_t * profile);
 
-/** Enforce balance between the column profiles locally: no communication */
+/** Enforce balance between the column profiles locally: no communication.
+ * When only a few node profiles have changed since the previous pass,
+ * only the columns adjacent to them are visited.
+ */
 void                p6est_profile_balance_local (p6est_profile_t * profile);
 
 /** Synchronize the data from other processors, taking unions or
  * intersections, as determined at profile creation in \a
- * p6est_profile_new_local
+ * p6est_profile_new_local.  Only the node profiles that have changed since
+ * the previous synchronization are sent.
  *
  * \return whether any change has occurred.
  * */
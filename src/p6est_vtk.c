@@ -774,3 +774,189 @@ p6est_vtk_write_footer (p6est_t * p4est, const char *filename)
 
   return 0;
 }
+
+p8est_vtk_mesh_t   *
+p6est_vtk_mesh_new (p6est_t * p6est, double scale)
+{
+  p6est_connectivity_t *connectivity = p6est->connectivity;
+  p4est_t            *columns = p6est->columns;
+  sc_array_t         *layers = p6est->layers;
+  const double        intsize = 1.0 / P4EST_ROOT_LEN;
+  double              v[24], w[8];
+  double              h2, h2z, eta_x, eta_y, eta_z;
+  double             *xyz;
+  int                 xi, yi, zi, j, k;
+  size_t              zz, zy, first, last;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      Ncells, sk;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *col;
+  p2est_quadrant_t   *layer;
+  p8est_vtk_mesh_t   *mesh;
+
+  SC_CHECK_ABORT (connectivity->conn4->num_vertices > 0,
+                  "Must provide connectivity with vertex information");
+  P4EST_ASSERT (0. < scale && scale <= 1.);
+
+  mesh = P4EST_ALLOC (p8est_vtk_mesh_t, 1);
+  mesh->num_cells = Ncells = (p4est_locidx_t) layers->elem_count;
+  mesh->num_corners = mesh->num_points = P8EST_CHILDREN * Ncells;
+  mesh->point_to_corner = NULL;
+  mesh->connectivity = P4EST_ALLOC (p4est_locidx_t,
+                                    SC_MAX (mesh->num_corners, 1));
+  mesh->coordinates = xyz = P4EST_ALLOC (double,
+                                         3 * SC_MAX (mesh->num_corners, 1));
+  for (sk = 0; sk < mesh->num_corners; ++sk) {
+    mesh->connectivity[sk] = sk;
+  }
+
+  /* the layers of a column are contiguous, so we stream through them */
+  for (jt = columns->first_local_tree; jt <= columns->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (columns->trees, jt);
+    p6est_tree_get_vertices (connectivity, jt, v);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      col = p4est_quadrant_array_index (&tree->quadrants, zz);
+      P6EST_COLUMN_GET_RANGE (col, &first, &last);
+      h2 = .5 * intsize * P4EST_QUADRANT_LEN (col->level);
+      for (zy = first; zy < last; ++zy) {
+        layer = p2est_quadrant_array_index (layers, zy);
+        h2z = .5 * intsize * P4EST_QUADRANT_LEN (layer->level);
+        for (zi = 0; zi < 2; ++zi) {
+          eta_z = intsize * layer->z + h2z * (1. + (zi * 2 - 1) * scale);
+          for (yi = 0; yi < 2; ++yi) {
+            eta_y = intsize * col->y + h2 * (1. + (yi * 2 - 1) * scale);
+            for (xi = 0; xi < 2; ++xi) {
+              eta_x = intsize * col->x + h2 * (1. + (xi * 2 - 1) * scale);
+
+              /* trilinear weights of the tree vertices */
+              w[0] = (1. - eta_z) * (1. - eta_y) * (1. - eta_x);
+              w[1] = (1. - eta_z) * (1. - eta_y) * eta_x;
+              w[2] = (1. - eta_z) * eta_y * (1. - eta_x);
+              w[3] = (1. - eta_z) * eta_y * eta_x;
+              w[4] = eta_z * (1. - eta_y) * (1. - eta_x);
+              w[5] = eta_z * (1. - eta_y) * eta_x;
+              w[6] = eta_z * eta_y * (1. - eta_x);
+              w[7] = eta_z * eta_y * eta_x;
+              for (j = 0; j < 3; ++j) {
+                xyz[j] = 0.;
+                for (k = 0; k < P8EST_CHILDREN; ++k) {
+                  xyz[j] += w[k] * v[3 * k + j];
+                }
+              }
+              xyz += 3;
+            }
+          }
+        }
+      }
+    }
+  }
+  P4EST_ASSERT (xyz == mesh->coordinates + 3 * mesh->num_corners);
+
+  return mesh;
+}
+
+p8est_vtk_context_t *
+p6est_vtk_context_new (p6est_t * p6est, const char *filename)
+{
+  P4EST_ASSERT (p6est != NULL);
+
+  return p8est_vtk_context_new_mesh (p6est->mpicomm, filename);
+}
+
+p8est_vtk_context_t *
+p6est_vtk_write_header_layers (p8est_vtk_context_t * cont, p6est_t * p6est,
+                               double scale)
+{
+  p8est_vtk_mesh_t   *mesh;
+
+  mesh = p6est_vtk_mesh_new (p6est, scale);
+  cont = p8est_vtk_write_header_mesh (cont, mesh);
+  p8est_vtk_mesh_destroy (mesh);
+
+  return cont;
+}
+
+p8est_vtk_context_t *
+p6est_vtk_write_cell_data (p8est_vtk_context_t * cont, p6est_t * p6est,
+                           int write_tree, int write_level,
+                           int write_rank, int wrap_rank,
+                           int num_cell_scalars, int num_cell_vectors,
+                           const char *fieldnames[], sc_array_t * values[])
+{
+  int                 i, num_all, num_extra;
+  const char        **names;
+  double             *treeid, *level;
+  size_t              zz, zy, first, last;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      il;
+  p4est_t            *columns = p6est->columns;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *col;
+  sc_array_t        **all;
+  sc_array_t         *tree_values = NULL, *level_values = NULL;
+  const size_t        Ncells = p6est->layers->elem_count;
+
+  P4EST_ASSERT (cont != NULL);
+  P4EST_ASSERT (num_cell_scalars >= 0 && num_cell_vectors >= 0);
+
+  /* the tree and level are passed on as leading scalar fields */
+  num_extra = (write_tree ? 1 : 0) + (write_level ? 1 : 0);
+  num_all = num_extra + num_cell_scalars + num_cell_vectors;
+  names = P4EST_ALLOC (const char *, SC_MAX (num_all, 1));
+  all = P4EST_ALLOC (sc_array_t *, SC_MAX (num_all, 1));
+  i = 0;
+  if (write_tree) {
+    tree_values = sc_array_new_count (sizeof (double), Ncells);
+    names[i] = "treeid";
+    all[i++] = tree_values;
+  }
+  if (write_level) {
+    level_values = sc_array_new_count (sizeof (double), Ncells);
+    names[i] = "level";
+    all[i++] = level_values;
+  }
+  P4EST_ASSERT (i == num_extra);
+  for (; i < num_all; ++i) {
+    names[i] = fieldnames[i - num_extra];
+    all[i] = values[i - num_extra];
+  }
+
+  /* fill both fields in one pass over the columns and their layers */
+  if (num_extra > 0) {
+    treeid = write_tree ? (double *) tree_values->array : NULL;
+    level = write_level ? (double *) level_values->array : NULL;
+    for (il = 0, jt = columns->first_local_tree;
+         jt <= columns->last_local_tree; ++jt) {
+      tree = p4est_tree_array_index (columns->trees, jt);
+      for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+        col = p4est_quadrant_array_index (&tree->quadrants, zz);
+        P6EST_COLUMN_GET_RANGE (col, &first, &last);
+        for (zy = first; zy < last; ++zy, ++il) {
+          if (treeid != NULL) {
+            treeid[il] = (double) jt;
+          }
+          if (level != NULL) {
+            level[il] = (double)
+              p2est_quadrant_array_index (p6est->layers, zy)->level;
+          }
+        }
+      }
+    }
+    P4EST_ASSERT ((size_t) il == Ncells);
+  }
+
+  cont = p8est_vtk_write_cell_data (cont, 0, 0, write_rank, wrap_rank,
+                                    num_extra + num_cell_scalars,
+                                    num_cell_vectors, names, all);
+
+  if (tree_values != NULL) {
+    sc_array_destroy (tree_values);
+  }
+  if (level_values != NULL) {
+    sc_array_destroy (level_values);
+  }
+  P4EST_FREE (all);
+  P4EST_FREE (names);
+
+  return cont;
+}
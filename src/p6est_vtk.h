@@ -26,6 +26,7 @@
 #define P6EST_VTK_H
 
 #include <p6est.h>
+#include <p8est_vtk.h>
 
 SC_EXTERN_C_BEGIN;
 
@@ -169,6 +170,76 @@ int                 p6est_vtk_write_point_vector (p6est_t * p6est,
 int                 p6est_vtk_write_footer (p6est_t * p6est,
                                             const char *filename);
 
+/** Compute the points and cells of the local layers.
+ * The corners are taken directly from the layers array without building
+ * a three-dimensional forest.  Every corner is its own point.
+ * \param [in] p6est       The forest, its connectivity must have vertices.
+ * \param [in] scale       Shrink factor for the layers in (0, 1].
+ * \return                 A mesh to be freed with \ref p8est_vtk_mesh_destroy.
+ */
+p8est_vtk_mesh_t   *p6est_vtk_mesh_new (p6est_t * p6est, double scale);
+
+/** Create a VTK context for the layers of a p6est.
+ *
+ * The p6est is written by the same code as the p8est, so the
+ * \b p8est_vtk_context_set_* functions for the scale, single file and
+ * compression level apply, and the output is finished by calling
+ * \ref p8est_vtk_write_footer.  A typical sequence would be
+ *
+ * \begincode
+ * cont = p6est_vtk_context_new (p6est, "output");
+ * p8est_vtk_context_set_single_file (cont, 1);
+ * cont = p6est_vtk_write_header_layers (cont, p6est);
+ * cont = p6est_vtk_write_cell_data (cont, p6est, 1, 1, 1, 0, 0, 0,
+ *                                   NULL, NULL);
+ * retval = p8est_vtk_write_footer (cont);
+ * \endcode
+ *
+ * \param [in] p6est     The forest must stay alive while writing.
+ * \param filename  The first part of the file names as in
+ *                  \ref p8est_vtk_context_new.
+ * \return          A VTK context for further use.
+ */
+p8est_vtk_context_t *p6est_vtk_context_new (p6est_t * p6est,
+                                            const char *filename);
+
+/** Write the points and cells of the local layers.
+ * \param [in,out] cont    A context from \ref p6est_vtk_context_new.
+ * \param [in] p6est       The forest given to the context.
+ * \param [in] scale       Shrink factor for the layers in (0, 1].
+ * \return          The context on success, NULL on error.
+ */
+p8est_vtk_context_t *p6est_vtk_write_header_layers (p8est_vtk_context_t *
+                                                    cont, p6est_t * p6est,
+                                                    double scale);
+
+/** Write cell data of the local layers.
+ * The tree id and the level are read from the layers array and written
+ * along with the given fields as by \ref p8est_vtk_write_cell_data.
+ * The level is the vertical level of each layer.
+ * \param [in,out] cont    A context after \ref p6est_vtk_write_header_layers.
+ * \param [in] p6est       The forest given to the context.
+ * \param [in] write_tree  Boolean to write the tree id of each layer.
+ * \param [in] write_level Boolean to write the level of each layer.
+ * \param [in] write_rank  Boolean to write the MPI rank.
+ * \param [in] wrap_rank   Wrap the rank with this modulo, or 0.
+ * \param [in] num_cell_scalars  Number of scalar fields given.
+ * \param [in] num_cell_vectors  Number of 3-vector fields given.
+ * \param [in] fieldnames  Names of the scalars, then of the vectors.
+ * \param [in] values      Arrays of doubles, one or three per layer.
+ * \return          The context on success, NULL on error.
+ */
+p8est_vtk_context_t *p6est_vtk_write_cell_data (p8est_vtk_context_t * cont,
+                                                p6est_t * p6est,
+                                                int write_tree,
+                                                int write_level,
+                                                int write_rank,
+                                                int wrap_rank,
+                                                int num_cell_scalars,
+                                                int num_cell_vectors,
+                                                const char *fieldnames[],
+                                                sc_array_t * values[]);
+
 SC_EXTERN_C_END;
 
 #endif /* P6EST_VTK_H */
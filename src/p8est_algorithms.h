@@ -58,6 +58,57 @@ void                p8est_quadrant_init_data (p8est_t * p8est,
 void                p8est_quadrant_free_data (p8est_t * p8est,
                                               p8est_quadrant_t * quad);
 
+/** Return the number of quadrant user data entries currently allocated.
+ * This counts the entries of the user data pool and those entries of the
+ * contiguous data array that still belong to a quadrant.
+ */
+size_t              p8est_quadrant_data_count (p8est_t * p8est);
+
+/** Create per-thread caches of free entries in front of the user data pool.
+ * Inside a parallel region, \ref p8est_quadrant_init_data and
+ * \ref p8est_quadrant_free_data then take and return entries in batches,
+ * such that the shared pool is only locked once per batch.  The threaded
+ * algorithms call this function themselves; an application that allocates
+ * quadrant data from its own threads may call it before its parallel
+ * region.  Does nothing inside a parallel region, with a single thread,
+ * or without user data.  Entries of a thread without a cache are taken
+ * from the pool under a lock.
+ */
+void                p8est_quadrant_data_cache_prepare (p8est_t * p8est);
+
+/** Return the entries of all caches to the user data pool and free them.
+ * Must not be called from a parallel region.
+ */
+void                p8est_quadrant_data_cache_flush (p8est_t * p8est);
+
+/** Move the user data of all local quadrants into a new contiguous array.
+ * Does nothing unless the forest is in contiguous data mode, see
+ * \ref p8est_set_data_contiguous.  Must not be called from a parallel
+ * region.
+ * \param [in,out] p8est   Its data_array and all user data pointers of
+ *                         local quadrants are replaced.
+ */
+void                p8est_compact_data (p8est_t * p8est);
+
+/** Replace the local quadrants by an array given in curve order.
+ * Used when quadrants arrive from other processes as a whole.
+ * The tree bookkeeping, the first and last local tree and the local
+ * quadrant count are recomputed; the global partition information is
+ * left to the caller.
+ * \param [in,out] p8est        Its local quadrants and user data are
+ *                              released and replaced.
+ * \param [in] quadrants        The new local quadrants, sorted.  The tree
+ *                              of each is read from its p.which_tree.
+ * \param [in] data             The user data of the new quadrants,
+ *                              data_size bytes each.  If NULL, the user
+ *                              data is allocated but not initialized.
+ * \param [in] num_quadrants    Number of entries in \a quadrants.
+ */
+void                p8est_replace_quadrants (p8est_t * p8est,
+                                             const p8est_quadrant_t *
+                                             quadrants, const char *data,
+                                             p4est_locidx_t num_quadrants);
+
 /** Computes a machine-independent checksum of a list of quadrants.
  * \param [in] quadrants       Array of quadrants.
  * \param [in,out] checkarray  Temporary array of elem_size 4.
@@ -108,6 +159,17 @@ int                 p8est_tree_is_linear (p8est_tree_t * tree);
  */
 int                 p8est_tree_is_complete (p8est_tree_t * tree);
 
+/** Compute the Hilbert ordering of the leaves of a tree.
+ * The tree keeps its Morton storage; the permutation lets callers visit
+ * the leaves along the Hilbert curve for better locality.
+ * \param [in] tree    Linear tree.
+ * \param [out] perm   Array of length tree->quadrants.elem_count.  Entry
+ *                     k is the index in tree->quadrants of the k-th leaf
+ *                     in Hilbert order.
+ */
+void                p8est_tree_hilbert_order (p8est_tree_t * tree,
+                                              p4est_locidx_t * perm);
+
 /** Check if a tree is sorted/linear except across edges or corners.
  * \param [in]  check_linearity  Boolean for additional check for linearity.
  * \return Returns true if almost sorted/linear, false otherwise.
@@ -152,6 +214,40 @@ int                 p8est_is_equal (p8est_t * p8est1, p8est_t * p8est2,
  */
 int                 p8est_is_valid (p8est_t * p8est);
 
+/** Levels of the validity check by \ref p8est_is_valid_ext. */
+typedef enum p8est_valid_check
+{
+  P8EST_VALID_CHANGED,          /**< Counters of all trees and completeness
+                                     of the trees changed since the last
+                                     passed check of this or the full level */
+  P8EST_VALID_SAMPLED,          /**< Counters of all trees and a random
+                                     sample of quadrants */
+  P8EST_VALID_FULL              /**< All of \ref p8est_is_valid */
+}
+p8est_valid_check_t;
+
+/** Check a forest for validity at a selectable cost.
+ * The cheaper levels are meant to stay enabled in production runs.
+ * They check the per-tree counters and first and last descendants, which
+ * costs a few operations per tree, and then either the completeness of
+ * the trees flagged as changed, see \ref p8est_set_valid_incremental, or
+ * a random sample of the local quadrants and their successors.
+ * Changes are flagged only by refinement and coarsening; after any other
+ * change of the revision counter, all trees are checked.
+ * A passed check of the changed trees or the full forest clears the flags.
+ * This function is collective and communicates a single flag.
+ * \param [in,out] p8est    The forest to be tested.
+ * \param [in] check        The level of the check.
+ * \param [in] sample_rate  Fraction of the local quadrants to sample for
+ *                          \ref P8EST_VALID_SAMPLED, ignored otherwise.
+ *                          The sample depends on the revision and rank.
+ *                          A rate of 1 checks every local quadrant.
+ * \return                  Returns true if valid, false otherwise.
+ */
+int                 p8est_is_valid_ext (p8est_t * p8est,
+                                        p8est_valid_check_t check,
+                                        double sample_rate);
+
 /** Compute the overlap of a number of insulation layers with a tree.
  * Every quadrant out of the insulation layer of the quadrants in \a in
  * except the quadrant itself is checked for overlap of quadrants
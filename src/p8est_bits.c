@@ -208,12 +208,13 @@ p8est_quadrant_edge_neighbor_extra (const p4est_quadrant_t * q, p4est_topidx_t
       }
       else if (nedges != NULL) {
         int                 opedge = (edge ^ 1);
-        int                 nface =
-          conn->tree_to_face[P4EST_FACES * t + face];
-        int                 o = nface / P4EST_FACES;
+        int                 nface;
+        int                 o;
         int                 ref, set;
         int                 c1, c2, nc1, nc2;
 
+        p8est_connectivity_face_neighbor_tree (conn, t, face, &nface);
+        o = nface / P4EST_FACES;
         nface = nface % P4EST_FACES;
 
         P4EST_ASSERT (p8est_edge_faces[opedge][1] == face);
@@ -253,11 +254,13 @@ p8est_quadrant_edge_neighbor_extra (const p4est_quadrant_t * q, p4est_topidx_t
     }
     else if (nedges != NULL) {
       int                 opedge = (edge ^ 2);
-      int                 nface = conn->tree_to_face[P4EST_FACES * t + face];
-      int                 o = nface / P4EST_FACES;
+      int                 nface;
+      int                 o;
       int                 ref, set;
       int                 c1, c2, nc1, nc2;
 
+      p8est_connectivity_face_neighbor_tree (conn, t, face, &nface);
+      o = nface / P4EST_FACES;
       nface = nface % P4EST_FACES;
 
       P4EST_ASSERT (p8est_edge_faces[opedge][0] == face);
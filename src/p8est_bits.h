@@ -830,6 +830,73 @@ uint64_t            p8est_quadrant_linear_id (const p8est_quadrant_t *
 void                p8est_quadrant_set_morton (p8est_quadrant_t * quadrant,
                                                int level, uint64_t id);
 
+/** Compare one quadrant against a contiguous run of quadrants.
+ * This is equivalent to calling \ref p8est_quadrant_compare for each
+ * quadrant of the run, but the loop is free of function calls and
+ * branches on the data, so the compiler may vectorize it.
+ * \param [in] q        An extended quadrant.
+ * \param [in] r        Array of \a n extended quadrants.
+ * \param [in] n        Number of quadrants in \a r.
+ * \param [out] result  Array of length \a n.  Entry i is -1, 0, or 1
+ *                      if \a q is less than, equal to, or greater than
+ *                      r[i] in the Morton ordering.
+ */
+void                p8est_quadrant_compare_batch (const p8est_quadrant_t * q,
+                                                  const p8est_quadrant_t * r,
+                                                  size_t n, int8_t * result);
+
+/** Test one quadrant for being an ancestor of each of a run of quadrants.
+ * \param [in] q        An extended quadrant.
+ * \param [in] r        Array of \a n extended quadrants.
+ * \param [in] n        Number of quadrants in \a r.
+ * \param [out] result  Array of length \a n.  Entry i is the result of
+ *                      \ref p8est_quadrant_is_ancestor (q, &r[i]).
+ */
+void                p8est_quadrant_is_ancestor_batch (const p8est_quadrant_t *
+                                                      q,
+                                                      const p8est_quadrant_t *
+                                                      r, size_t n,
+                                                      int8_t * result);
+
+/** Test one quadrant for overlap with each of a run of quadrants.
+ * \param [in] q        An extended quadrant.
+ * \param [in] r        Array of \a n extended quadrants.
+ * \param [in] n        Number of quadrants in \a r.
+ * \param [out] result  Array of length \a n.  Entry i is the result of
+ *                      \ref p8est_quadrant_overlaps (q, &r[i]).
+ */
+void                p8est_quadrant_overlaps_batch (const p8est_quadrant_t * q,
+                                                   const p8est_quadrant_t * r,
+                                                   size_t n, int8_t * result);
+
+/** Compute the linear positions of a run of quadrants on a uniform grid.
+ * The result is the same as calling \ref p8est_quadrant_linear_id for each
+ * quadrant, but the bits are interleaved by masks instead of a loop.
+ * \param [in] r        Array of \a n extended quadrants.
+ * \param [in] n        Number of quadrants in \a r.
+ * \param [in] level    The level of the regular grid as in
+ *                      \ref p8est_quadrant_linear_id.
+ * \param [out] id      Array of length \a n receiving the positions.
+ */
+void                p8est_quadrant_linear_id_batch (const p8est_quadrant_t *
+                                                    r, size_t n, int level,
+                                                    uint64_t * id);
+
+/** Set the coordinates of a run of quadrants from their linear positions.
+ * The result is the same as calling \ref p8est_quadrant_set_morton for
+ * each quadrant, but the bits are separated by masks instead of a loop.
+ * \param [out] quadrants  Array of \a n quadrants; coordinates and level
+ *                          are set, other fields are left untouched.
+ * \param [in] n           Number of quadrants.
+ * \param [in] level       The level of the regular grid as in
+ *                          \ref p8est_quadrant_set_morton.
+ * \param [in] id          Array of \a n positions on that level.
+ */
+void                p8est_quadrant_set_morton_batch (p8est_quadrant_t *
+                                                     quadrants, size_t n,
+                                                     int level,
+                                                     const uint64_t * id);
+
 /** Compute the successor according to the Morton index in a uniform mesh.
  * \param[in] quadrant  Quadrant whose Morton successor will be computed.
  *                      Must not be the last (top right) quadrant in the tree.
@@ -850,6 +917,61 @@ void                p8est_quadrant_predecessor (const p8est_quadrant_t *
                                                 quadrant,
                                                 p8est_quadrant_t * result);
 
+/** Compute the position of a quadrant along the Hilbert curve.
+ * The curve is fixed at level P8EST_QMAXLEVEL, so positions on coarser
+ * levels are consistent: the children of a quadrant occupy a contiguous
+ * block of positions on the next finer level.  The forest itself is still
+ * stored in Morton order; this serves to rank or traverse leaves along
+ * a curve with face-connected subsequences.
+ * \param [in] quadrant  Valid quadrant.
+ * \param [in] level     Level of the grid, at most the quadrant's level.
+ * \return               Hilbert index of the ancestor of \a quadrant
+ *                       on \a level, in [0, 2**(P8EST_DIM * level)).
+ */
+uint64_t            p8est_quadrant_hilbert_id (const p8est_quadrant_t *
+                                               quadrant, int level);
+
+/** Set quadrant coordinates based on its Hilbert index in a uniform grid.
+ * This is the inverse operation of \ref p8est_quadrant_hilbert_id.
+ * \param [in,out] quadrant  Quadrant whose coordinates will be set.
+ * \param [in]     level     Level of the grid and of the resulting quadrant.
+ * \param [in]     id        Hilbert index of the quadrant on a uniform grid.
+ * \note The user_data of \a quadrant is never modified.
+ */
+void                p8est_quadrant_set_hilbert (p8est_quadrant_t * quadrant,
+                                                int level, uint64_t id);
+
+/** Compare two quadrants of the same tree in their Hilbert order.
+ * Ancestors come before their descendants as in p8est_quadrant_compare.
+ * \param [in] v1, v2  Valid quadrants.
+ * \return Returns < 0 if \a v1 < \a v2, 0 if \a v1 == \a v2, > 0 else.
+ */
+int                 p8est_quadrant_compare_hilbert (const void *v1,
+                                                    const void *v2);
+
+/** Compute the successor along the Hilbert curve in a uniform mesh.
+ * \param[in] quadrant  Quadrant whose Hilbert successor will be computed.
+ *                      Must not be the last quadrant of the curve.
+ * \param[in,out] result    The coordinates and level of the successor of
+ *                          \b quadrant will be saved in \b result.
+ */
+void                p8est_quadrant_hilbert_successor (const p8est_quadrant_t
+                                                      * quadrant,
+                                                      p8est_quadrant_t *
+                                                      result);
+
+/** Compute the predecessor along the Hilbert curve in a uniform mesh.
+ * \param[in] quadrant  Quadrant whose Hilbert predecessor will be computed.
+ *                      Must not be the first quadrant of the curve.
+ * \param[in,out] result    The coordinates and level of the predecessor of
+ *                          \b quadrant will be saved in \b result.
+ */
+void                p8est_quadrant_hilbert_predecessor (const
+                                                        p8est_quadrant_t *
+                                                        quadrant,
+                                                        p8est_quadrant_t *
+                                                        result);
+
 /** Initialize a random number generator by quadrant coordinates.
  * This serves to generate partition-independent and reproducible samples.
  * \param [in]  q               Valid quadrant.
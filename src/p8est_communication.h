@@ -119,6 +119,34 @@ int                 p8est_comm_parallel_env_reduce_ext (p8est_t **
                                                         int add_to_beginning,
                                                         int **ranks_subcomm);
 
+/** Create a communicator whose ranks are grouped by shared memory node.
+ * The nodes are ordered by their lowest rank in \a mpicomm, and the
+ * processes of a node keep their relative order.  Since a forest assigns
+ * consecutive ranges of the space filling curve to consecutive ranks,
+ * creating it on \a ordered places neighboring ranges on the same node,
+ * which keeps most of the ghost and partition traffic inside the nodes.
+ * Without MPI-3 shared memory communicators, \a mpicomm is duplicated.
+ * This function is collective over \a mpicomm.
+ * \param [in] mpicomm    A valid MPI communicator.
+ * \param [out] ordered   The reordered communicator, to be freed by the
+ *                        caller.  It has the same size as \a mpicomm.
+ * \return                True if the rank order differs from \a mpicomm.
+ */
+int                 p8est_comm_node_order (sc_MPI_Comm mpicomm,
+                                           sc_MPI_Comm * ordered);
+
+/** Reorder the ranks of the forest's communicator by shared memory node.
+ * The communicator is replaced by the one of \ref p8est_comm_node_order.
+ * The partition boundaries stay the same: each range of the curve moves
+ * with its quadrant data to the process that carries its rank number in
+ * the new communicator.  The forest owns the new communicator afterwards.
+ * Ghost layers and other structures built on the forest must be rebuilt
+ * if the ranks were reordered.
+ * \param [in,out] p8est  The forest whose communicator is reordered.
+ * \return                True if the ranks were reordered.
+ */
+int                 p8est_comm_parallel_env_node_order (p8est_t * p8est);
+
 /** Calculate the number and partition of quadrants.
  * \param [in,out] p8est  Adds all \c p8est->local_num_quadrant counters and
  *                        puts cumulative sums in p8est->global_first_quadrant.
@@ -241,6 +269,75 @@ int                 p8est_comm_find_owner (p8est_t * p8est,
                                            const p8est_quadrant_t * q,
                                            int guess);
 
+/** Searches the owners of many quadrants via p8est->global_first_position.
+ * Each search starts at the owner of the previous quadrant and gallops
+ * from there, which takes constant time for queries in or near Morton
+ * order and logarithmic time in the number of processes otherwise.
+ * Assumes a tree with no overlaps.
+ * \param [in] quadrants   Array of p8est_quadrant_t whose p.which_tree
+ *                         holds the tree of each quadrant.
+ * \param [out] owners     Array of quadrants->elem_count entries that
+ *                         receive the processor id of each owner.
+ */
+void                p8est_comm_find_owners (p8est_t * p8est,
+                                            sc_array_t * quadrants,
+                                            int *owners);
+
+/** Partition markers stored in memory independent of the process count.
+ * The processes are grouped into blocks of \a stride consecutive ranks.
+ * Every process knows the exact markers of its own block and the first
+ * marker of every block.  The markers equal the entries of
+ * global_first_quadrant and global_first_position at the same ranks.
+ */
+typedef struct p8est_comm_sparse
+{
+  sc_MPI_Comm         mpicomm;          /**< Not owned */
+  int                 mpisize, mpirank;
+  int                 stride;           /**< Ranks per block */
+  int                 block_first;      /**< First rank of our block */
+  int                 block_count;      /**< Ranks in our block */
+  p4est_gloidx_t     *block_quadrant;   /**< block_count + 1 first global
+                                             quadrants from block_first */
+  p8est_quadrant_t   *block_position;   /**< block_count + 1 first
+                                             positions from block_first */
+  int                 num_samples;      /**< Number of blocks */
+  p4est_gloidx_t     *sample_quadrant;  /**< num_samples + 1 first global
+                                             quadrants of the blocks */
+  p8est_quadrant_t   *sample_position;  /**< num_samples + 1 first
+                                             positions of the blocks */
+}
+p8est_comm_sparse_t;
+
+/** Build the sparse partition markers of a forest.
+ * Only the local quadrants and the global quadrant count are used.  The
+ * communication is a scan over all processes and gathers within a block
+ * and among the first processes of the blocks.  Collective.
+ * \param [in] p8est    The forest whose partition is recorded.
+ * \param [in] stride   The number of ranks per block, at least 1.  The
+ *                      square root of the process count minimizes memory.
+ * \return              The markers that only reference p8est->mpicomm.
+ */
+p8est_comm_sparse_t *p8est_comm_sparse_new (p8est_t * p8est, int stride);
+
+/** Free the sparse partition markers. */
+void                p8est_comm_sparse_destroy (p8est_comm_sparse_t *
+                                               sparse);
+
+/** Searches the owners of many quadrants via sparse partition markers.
+ * The block of every quadrant is found among the samples.  Quadrants of
+ * our own block are resolved locally; the others are sent to the first
+ * process of their block, which knows its markers exactly.  Collective.
+ * \param [in] sparse      Markers of the partition that is searched.
+ * \param [in] quadrants   Array of p8est_quadrant_t whose p.which_tree
+ *                         holds the tree of each quadrant.
+ * \param [out] owners     Array of quadrants->elem_count entries that
+ *                         receive the processor id of each owner.
+ */
+void                p8est_comm_sparse_find_owners (p8est_comm_sparse_t *
+                                                   sparse,
+                                                   sc_array_t * quadrants,
+                                                   int *owners);
+
 /** Computes information about a tree being fully owned.
  * This is determined separately for the beginning and end of the tree.
  * \param [in] p8est            The p8est to work on.
@@ -294,6 +391,39 @@ unsigned            p8est_comm_checksum (p8est_t * p8est,
                                          unsigned local_crc,
                                          size_t local_bytes);
 
+/** Combine local CRC32C checksums into a partition-independent one.
+ * The pieces are combined in rank order by a reduction of logarithmic
+ * depth, without gathering all of them on every process.
+ * Unlike \ref p8est_comm_checksum, this does not require zlib.
+ * \param [in] p8est       The MPI information of this p8est will be used.
+ * \param [in] local_crc   Locally computed \ref p4est_crc32c checksum.
+ * \param [in] local_bytes Number of bytes used for local checksum.
+ * \return                 Parallel checksum on all processors.
+ */
+unsigned            p8est_comm_checksum_crc32c (p8est_t * p8est,
+                                                unsigned local_crc,
+                                                size_t local_bytes);
+
+/** Determine the processes that send to this one, aware of the nodes.
+ * This is a drop-in replacement for sc_notify that works hierarchically:
+ * the receiver lists of each shared memory node are gathered on its first
+ * process, these node leaders run sc_notify among themselves and exchange
+ * the messages addressed to their nodes, and each leader hands the senders
+ * back to the members of its node.  Without MPI-3 shared memory
+ * communicators, sc_notify is called instead.
+ * This function is collective over \a mpicomm.
+ * \param [in] receivers     Sorted ranks that this process sends to.
+ * \param [in] num_receivers Number of entries in \a receivers.
+ * \param [out] senders      Sorted ranks that send to this process.  Must
+ *                           hold as many entries as \a mpicomm has ranks.
+ * \param [out] num_senders  Number of entries written to \a senders.
+ * \param [in] mpicomm       The communicator of the pattern.
+ * \return                   sc_MPI_SUCCESS; errors abort the program.
+ */
+int                 p8est_comm_notify_nodes (int *receivers, int num_receivers,
+                                          int *senders, int *num_senders,
+                                          sc_MPI_Comm mpicomm);
+
 /** Context data to allow for split begin/end data transfer. */
 typedef struct p8est_transfer_context
 {
@@ -302,6 +432,12 @@ typedef struct p8est_transfer_context
   int                 num_receivers;
   sc_MPI_Request     *recv_req;
   sc_MPI_Request     *send_req;
+  p4est_comm_compress_t *compress;      /**< NULL unless compressing */
+  char              **recv_buf, **recv_dest;    /**< Compressed receives */
+  size_t             *recv_bytes;       /**< Decoded size of receives */
+  char              **send_buf;         /**< Compressed sends */
+  p8est_inspect_t    *inspect;          /**< NULL unless recording */
+  double              inspect_start;    /**< Start of the recording */
 }
 p8est_transfer_context_t;
 
@@ -483,6 +619,72 @@ p8est_transfer_context_t *p8est_transfer_custom_begin (const p4est_gloidx_t *
  */
 void                p8est_transfer_custom_end (p8est_transfer_context_t * tc);
 
+/** Transfer variable-size quadrant data with compressed messages.
+ * The parameters and the result are the same as for \ref
+ * p8est_transfer_custom; only the message payloads are encoded.
+ * A message to another process is compressed or sent raw as decided by
+ * \ref p4est_comm_compress_pack.  The data that stays local is copied.
+ * \param [in,out] compress Compression settings.  The bytes sent are added
+ *                          to its counters.  If NULL or its codec is
+ *                          P4EST_COMM_CODEC_NONE, this function behaves
+ *                          like \ref p8est_transfer_custom.
+ */
+void                p8est_transfer_custom_compressed (const p4est_gloidx_t *
+                                                      dest_gfq,
+                                                      const p4est_gloidx_t *
+                                                      src_gfq,
+                                                      sc_MPI_Comm mpicomm,
+                                                      int tag,
+                                                      void *dest_data,
+                                                      const int *dest_sizes,
+                                                      const void *src_data,
+                                                      const int *src_sizes,
+                                                      p4est_comm_compress_t *
+                                                      compress);
+
+/** Initiate a variable-size data transfer with compressed messages.
+ * See \ref p8est_transfer_custom_compressed and \ref
+ * p8est_transfer_custom_begin.  The source data is encoded before this
+ * function returns, and the destination data is decoded by
+ * \ref p8est_transfer_custom_end, which must be called for completion.
+ */
+p8est_transfer_context_t *p8est_transfer_custom_compressed_begin
+  (const p4est_gloidx_t * dest_gfq, const p4est_gloidx_t * src_gfq,
+   sc_MPI_Comm mpicomm, int tag, void *dest_data, const int *dest_sizes,
+   const void *src_data, const int *src_sizes,
+   p4est_comm_compress_t * compress);
+
+/** Transfer variable-size quadrant data and record its communication.
+ * The same as \ref p8est_transfer_custom_compressed, except that the
+ * messages, payload bytes and time of the transfer are recorded for
+ * P4EST_INSPECT_TRANSFER in an inspect structure.
+ * \param [in,out] compress Compression settings, may be NULL.
+ * \param [in,out] inspect  Inspect structure, usually the one of the
+ *                          forest that was partitioned.  May be NULL.
+ */
+void                p8est_transfer_custom_ext (const p4est_gloidx_t *
+                                               dest_gfq,
+                                               const p4est_gloidx_t *
+                                               src_gfq, sc_MPI_Comm mpicomm,
+                                               int tag, void *dest_data,
+                                               const int *dest_sizes,
+                                               const void *src_data,
+                                               const int *src_sizes,
+                                               p4est_comm_compress_t *
+                                               compress,
+                                               p8est_inspect_t * inspect);
+
+/** Initiate a variable-size data transfer that records its communication.
+ * See \ref p8est_transfer_custom_ext and \ref
+ * p8est_transfer_custom_compressed_begin.  The time is recorded by
+ * \ref p8est_transfer_custom_end, which must be called for completion.
+ */
+p8est_transfer_context_t *p8est_transfer_custom_ext_begin
+  (const p4est_gloidx_t * dest_gfq, const p4est_gloidx_t * src_gfq,
+   sc_MPI_Comm mpicomm, int tag, void *dest_data, const int *dest_sizes,
+   const void *src_data, const int *src_sizes,
+   p4est_comm_compress_t * compress, p8est_inspect_t * inspect);
+
 /** Transfer variable-count item data between partitions.
  * Each quadrant may have a different number of items (including 0).
  * (See \ref p8est_transfer_fixed that is optimized for fixed-count data,
@@ -553,6 +755,172 @@ p8est_transfer_context_t *p8est_transfer_items_begin
  */
 void                p8est_transfer_items_end (p8est_transfer_context_t * tc);
 
+/** Memory of one quadrant's data for \ref p8est_transfer_iovec. */
+typedef struct p8est_transfer_iovec
+{
+  void               *base;     /**< Start of the data, may be NULL if empty */
+  size_t              len;      /**< Size of the data in bytes */
+}
+p8est_transfer_iovec_t;
+
+/** Callback to provide the memory a received quadrant's data goes into.
+ * \param [in] user     The user pointer passed to the transfer.
+ * \param [in] index    Local index of the quadrant in the new partition.
+ * \param [in] bytes    Size of its data, which is positive.
+ * \return              Memory of at least \a bytes bytes that stays alive
+ *                      until the transfer has completed.
+ */
+typedef void       *(*p8est_transfer_alloc_t) (void *user,
+                                               p4est_locidx_t index,
+                                               size_t bytes);
+
+/** Transfer variable-size data that is scattered over user memory.
+ * This works like \ref p8est_transfer_custom, but neither side needs a
+ * contiguous buffer: the data of each source quadrant is described by its
+ * own pointer and length, and the memory of each destination quadrant is
+ * requested from a callback before the messages are posted.  The messages
+ * use MPI derived datatypes built from these addresses, so there is no
+ * packing or unpacking step.  Data staying on the process is copied.
+ * \param [in] dest_gfq     The target partition, see \ref
+ *                          p8est_transfer_items.
+ * \param [in] src_gfq      The original partition, analogous to \b dest_gfq.
+ * \param [in] mpicomm      The communicator to use.
+ * \param [in] tag          This tag is used in all messages.
+ * \param [in] dest_sizes   One byte count per destination quadrant.  Must
+ *                          match the \b len of its source item.  They may
+ *                          be obtained by a prior \ref p8est_transfer_fixed.
+ * \param [in] alloc_fn     Called once for every destination quadrant with
+ *                          a positive size, in order, before this function
+ *                          returns.
+ * \param [in] user         Passed through to \b alloc_fn.
+ * \param [in] src_iov      One entry per source quadrant.
+ */
+void                p8est_transfer_iovec
+  (const p4est_gloidx_t * dest_gfq, const p4est_gloidx_t * src_gfq,
+   sc_MPI_Comm mpicomm, int tag, const int *dest_sizes,
+   p8est_transfer_alloc_t alloc_fn, void *user,
+   const p8est_transfer_iovec_t * src_iov);
+
+/** Initiate a transfer of scattered variable-size data.
+ * See \ref p8est_transfer_iovec for a full description.
+ * The source memory and the memory returned by the callback must stay
+ * alive until \ref p8est_transfer_iovec_end has been called.
+ */
+p8est_transfer_context_t *p8est_transfer_iovec_begin
+  (const p4est_gloidx_t * dest_gfq, const p4est_gloidx_t * src_gfq,
+   sc_MPI_Comm mpicomm, int tag, const int *dest_sizes,
+   p8est_transfer_alloc_t alloc_fn, void *user,
+   const p8est_transfer_iovec_t * src_iov);
+
+/** Complete a transfer of scattered variable-size data.
+ * \param [in] tc       Context data from \ref p8est_transfer_iovec_begin.
+ *                      Is deallocated before this function returns.
+ */
+void                p8est_transfer_iovec_end (p8est_transfer_context_t * tc);
+
+/** A transfer between two fixed partitions that is reused for many fields.
+ * The processes to exchange with and the quadrant ranges of the messages
+ * are computed once.  Any number of fields may be registered, and every
+ * execution sends one combined message per peer for all of them.
+ */
+typedef struct p8est_transfer_plan
+{
+  sc_MPI_Comm         mpicomm;
+  int                 mpisize, mpirank;
+  p4est_gloidx_t     *dest_gfq, *src_gfq;       /**< Copies of the partitions */
+  int                 num_senders;      /**< Processes we receive from */
+  int                *senders;          /**< Their ranks, ascending */
+  p4est_locidx_t     *recv_ranges;      /**< Two local destination quadrant
+                                             indices per sender */
+  int                 num_receivers;    /**< Processes we send to */
+  int                *receivers;        /**< Their ranks, ascending */
+  p4est_locidx_t     *send_ranges;      /**< Two local source quadrant
+                                             indices per receiver */
+  p4est_locidx_t      local_dest;       /**< First destination quadrant
+                                             that remains local */
+  p4est_locidx_t      local_src;        /**< Its source quadrant */
+  p4est_locidx_t      local_count;      /**< Quadrants that remain local */
+  sc_array_t          fields;   /**< The registered fields */
+}
+p8est_transfer_plan_t;
+
+/** Create a transfer plan between two partitions.
+ * The arguments have the same meaning as for \ref p8est_transfer_fixed.
+ * The partitions are copied, so the arrays may change after the call.
+ * This function does not communicate.
+ * \param [in] dest_gfq     The target partition.
+ * \param [in] src_gfq      The original partition.
+ * \param [in] mpicomm      The communicator to use.
+ * \return                  A plan without fields.
+ */
+p8est_transfer_plan_t *p8est_transfer_plan_new (const p4est_gloidx_t *
+                                                dest_gfq,
+                                                const p4est_gloidx_t *
+                                                src_gfq,
+                                                sc_MPI_Comm mpicomm);
+
+/** Free a transfer plan. */
+void                p8est_transfer_plan_destroy (p8est_transfer_plan_t *
+                                                 plan);
+
+/** Check whether a transfer plan applies to a pair of partitions.
+ * \return          True if the partitions are those of the plan.
+ */
+int                 p8est_transfer_plan_is_valid (p8est_transfer_plan_t *
+                                                  plan,
+                                                  const p4est_gloidx_t *
+                                                  dest_gfq,
+                                                  const p4est_gloidx_t *
+                                                  src_gfq);
+
+/** Register a field of fixed-size quadrant data with a transfer plan.
+ * The arguments are those of \ref p8est_transfer_fixed.  The memory must
+ * stay alive while the plan is executed and is not accessed otherwise.
+ * \return          The number of the field in the plan.
+ */
+int                 p8est_transfer_plan_add_fixed (p8est_transfer_plan_t *
+                                                   plan, void *dest_data,
+                                                   const void *src_data,
+                                                   size_t data_size);
+
+/** Register a field of variable-size quadrant data with a transfer plan.
+ * The arguments are those of \ref p8est_transfer_custom.  The sizes are
+ * read at every execution, so they may change between executions.
+ * \return          The number of the field in the plan.
+ */
+int                 p8est_transfer_plan_add_custom (p8est_transfer_plan_t *
+                                                    plan, void *dest_data,
+                                                    const int *dest_sizes,
+                                                    const void *src_data,
+                                                    const int *src_sizes);
+
+/** Remove all fields from a transfer plan to register new ones. */
+void                p8est_transfer_plan_clear (p8est_transfer_plan_t *
+                                               plan);
+
+/** Transfer all fields of a plan in one message per peer.
+ * This function is collective over the communicator of the plan.
+ * \param [in] plan     The plan, whose fields may not be changed until
+ *                      the transfer has completed.
+ * \param [in] tag      Tag of all messages, see \ref p8est_transfer_fixed.
+ */
+void                p8est_transfer_plan_execute (p8est_transfer_plan_t *
+                                                 plan, int tag);
+
+/** Initiate the transfer of all fields of a plan.
+ * See \ref p8est_transfer_plan_execute.  The data that remains on the
+ * process is copied before this function returns.
+ * \return              Context to pass to \ref p8est_transfer_plan_end.
+ */
+p8est_transfer_context_t *p8est_transfer_plan_begin (p8est_transfer_plan_t *
+                                                     plan, int tag);
+
+/** Complete the transfer of the fields of a plan.
+ * \param [in] tc       Context data from \ref p8est_transfer_plan_begin.
+ *                      Is deallocated before this function returns.
+ */
+void                p8est_transfer_plan_end (p8est_transfer_context_t * tc);
+
 /** Complete any of the transfer_begin functions.
  * The specialized transfer_end functions are recommended over this one
  * for slightly stricter error checking: \ref p8est_transfer_fixed_end,
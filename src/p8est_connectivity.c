@@ -23,6 +23,7 @@
 */
 
 #include <p4est_to_p8est.h>
+#include <p8est_bits.h>
 #include <p8est_connectivity.h>
 #include <p8est.h>
 
@@ -1456,8 +1457,7 @@ p8est_find_edge_transform_internal (p4est_connectivity_t * conn,
   /* identify touching faces */
   for (i = 0; i < 2; ++i) {
     face = p8est_edge_faces[iedge][i];
-    ntree = conn->tree_to_tree[P4EST_FACES * itree + face];
-    nface = (int) conn->tree_to_face[P4EST_FACES * itree + face];
+    ntree = p8est_connectivity_face_neighbor_tree (conn, itree, face, &nface);
     if (ntree != itree || nface != face) {      /* not domain boundary */
       orient = nface / P4EST_FACES;
       nface %= P4EST_FACES;
@@ -1654,8 +1654,15 @@ p8est_find_edge_transform (p4est_connectivity_t * conn,
   P4EST_ASSERT (0 <= iedge && iedge < P8EST_EDGES);
   P4EST_ASSERT (ta->elem_size == sizeof (p8est_edge_transform_t));
 
-  /* check if this edge exists at all */
   ei->iedge = (int8_t) iedge;
+  if (conn->transforms != NULL) {
+    p4est_connectivity_transforms_copy
+      (&conn->transforms->edge_transforms, conn->transforms->edge_offset,
+       (size_t) P8EST_EDGES * itree + iedge, ta);
+    return;
+  }
+
+  /* check if this edge exists at all */
   sc_array_resize (ta, 0);
   if (conn->num_edges == 0) {
     return;
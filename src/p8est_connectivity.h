@@ -62,6 +62,7 @@
 #define P8EST_CONNECTIVITY_H
 
 #include <sc_io.h>
+#include <sc_refcount.h>
 #include <p4est_base.h>
 
 SC_EXTERN_C_BEGIN;
@@ -105,6 +106,12 @@ SC_EXTERN_C_BEGIN;
  */
 #define P8EST_ONDISK_FORMAT 0x3000009
 
+/** The revision number of the memory-mappable connectivity file format.
+ * Increase this number whenever that format changes, see
+ * \ref p8est_connectivity_save_mapped.
+ */
+#define P8EST_MAPPED_FORMAT 0x3000001
+
 /** Characterize a type of adjacency.
  *
  * Several functions involve relationships between neighboring trees and/or
@@ -151,6 +158,16 @@ int                 p8est_connect_type_int (p8est_connect_type_t btype);
  */
 const char         *p8est_connect_type_string (p8est_connect_type_t btype);
 
+/** Dimensions of a brick whose face and vertex information is computed.
+ * Its trees are numbered lexicographically with x varying fastest.
+ */
+typedef struct p8est_connectivity_brick
+{
+  p4est_topidx_t      dims[3];     /**< number of trees per direction */
+  int                 periodic[3]; /**< periodicity per direction */
+}
+p8est_connectivity_brick_t;
+
 /** This structure holds the 3D inter-tree connectivity information.
  * Identification of arbitrary faces, edges and corners is possible.
  *
@@ -249,6 +266,22 @@ typedef struct p8est_connectivity
   p4est_topidx_t     *corner_to_tree; /**< list of trees that meet at a corner */
   int8_t             *corner_to_corner; /**< list of tree-corners that meet at
                                              a corner */
+  p8est_connectivity_brick_t *brick; /**< NULL unless the connectivity
+                                          is an implicit brick, see
+                                          \ref p8est_connectivity_new_brick_implicit */
+  struct p8est_connectivity_shared *shared; /**< NULL unless the arrays
+                                             are shared by the processes
+                                             of a node, see
+                                             \ref p8est_connectivity_bcast_shared */
+  struct p8est_connectivity_mapped *mapped; /**< NULL unless the arrays
+                                             point into a file, see
+                                             \ref p8est_connectivity_load_mapped */
+  struct p8est_connectivity_transforms *transforms; /**< NULL unless the
+                                             neighbor transforms are cached,
+                                             see \ref
+                                             p8est_connectivity_set_transform_cache */
+  sc_refcount_t       rc;       /**< reference count, see
+                                     \ref p8est_connectivity_ref */
 }
 p8est_connectivity_t;
 
@@ -583,11 +616,100 @@ p8est_connectivity_t *p8est_connectivity_bcast (p8est_connectivity_t *
                                                 conn_in, int root,
                                                 sc_MPI_Comm comm);
 
-/** Destroy a connectivity structure.  Also destroy all attributes.
+/** Broadcast a connectivity and store one copy of its arrays per node.
+ * The arrays live in an MPI shared memory window of the processes on a
+ * shared memory node.  Only the node leaders receive them by broadcast.
+ * The returned connectivity is read-only: it must not be modified by
+ * functions that reallocate its arrays or attributes.  It is destroyed
+ * by \ref p8est_connectivity_destroy, which is collective over the
+ * communicator in this case.  Without MPI shared windows this function
+ * falls back to \ref p8est_connectivity_bcast.
+ * \param [in] conn_in For the root process the connectivity to be broadcast,
+ *                      which is taken over by this function; for the other
+ *                      processes it must be NULL.
+ * \param [in] root    The rank of the process that provides the connectivity.
+ * \param [in] comm    The MPI communicator.
+ * \return             On every process a connectivity with the same values
+ *                      as \a conn_in on the root process.
+ */
+p8est_connectivity_t *p8est_connectivity_bcast_shared (p8est_connectivity_t
+                                                       * conn_in, int root,
+                                                       sc_MPI_Comm comm);
+
+/** Extract the connectivity of a range of trees and their neighbors.
+ * The result holds the trees first_tree..last_tree, numbered from 0, and
+ * after them a halo of all trees that touch them across faces, edges
+ * and corners, in ascending global order.  Shared corners and edges of
+ * the range are kept; faces of halo trees that lead outside the result
+ * become domain boundaries.  Thus \ref p8est_find_face_transform,
+ * \ref p8est_find_edge_transform and \ref p8est_find_corner_transform
+ * give the same neighbors for the trees in the range as with the full
+ * connectivity, up to the numbering.
+ * Vertices are renumbered to the ones used, tree attributes are kept.
+ * \param [in] conn        Valid connectivity.
+ * \param [in] first_tree  First tree of the range.
+ * \param [in] last_tree   Last tree of the range.  It may be
+ *                         first_tree - 1 for an empty range.
+ * \param [in,out] global_ids  Array of p4est_topidx_t resized to the
+ *                         number of local trees.  On output, the global
+ *                         index of each local tree.
+ * \return                 Newly allocated valid connectivity.
+ */
+p8est_connectivity_t *p8est_connectivity_extract (p8est_connectivity_t *
+                                                  conn,
+                                                  p4est_topidx_t first_tree,
+                                                  p4est_topidx_t last_tree,
+                                                  sc_array_t * global_ids);
+
+/** Distribute a connectivity that exists only on one process.
+ * Each process receives the result of \ref p8est_connectivity_extract
+ * for its range of trees, so that no process besides the root holds
+ * more than its trees and their halo.
+ * \param [in] conn_in     For the root process the connectivity to be
+ *                         distributed, for the other processes NULL.
+ *                         It remains owned by the caller.
+ * \param [in] root        The rank of the process that provides it.
+ * \param [in] tree_offsets    On the root, an array of mpisize + 1
+ *                         entries.  Process q receives the trees
+ *                         tree_offsets[q] to tree_offsets[q + 1] - 1.
+ *                         Ignored on the other processes.
+ * \param [in,out] global_ids  Array of p4est_topidx_t resized to the
+ *                         number of local trees.  On output, the global
+ *                         index of each local tree.
+ * \param [in] comm        The MPI communicator.
+ * \return                 Newly allocated connectivity on each process.
+ */
+p8est_connectivity_t *p8est_connectivity_scatter (p8est_connectivity_t *
+                                                  conn_in, int root,
+                                                  const p4est_topidx_t *
+                                                  tree_offsets,
+                                                  sc_array_t * global_ids,
+                                                  sc_MPI_Comm comm);
+
+/** Release a reference to a connectivity structure.
+ * A new connectivity holds one reference.  When the last one is released,
+ * the connectivity is destroyed with all its attributes.
  */
 void                p8est_connectivity_destroy (p8est_connectivity_t *
                                                 connectivity);
 
+/** Acquire a reference to a connectivity structure.
+ * Objects that share a connectivity, such as several \ref p8est_wrap_t,
+ * each hold a reference and release it by \ref p8est_connectivity_unref.
+ * \param [in,out] conn    Connectivity with at least one reference.
+ * \return                 The connectivity \a conn.
+ */
+p8est_connectivity_t *p8est_connectivity_ref (p8est_connectivity_t *
+                                              conn);
+
+/** Release a reference to a connectivity structure.
+ * \param [in,out] conn    Connectivity with at least one reference.
+ * \return                 True if this was the last reference and the
+ *                         connectivity has been destroyed.
+ */
+int                 p8est_connectivity_unref (p8est_connectivity_t *
+                                                conn);
+
 /** Allocate or free the attribute fields in a connectivity.
  * \param [in,out] conn         The conn->*_to_attr fields must either be NULL
  *                              or previously be allocated by this function.
@@ -597,12 +719,41 @@ void                p8est_connectivity_destroy (p8est_connectivity_t *
 void                p8est_connectivity_set_attr (p8est_connectivity_t * conn,
                                                  size_t bytes_per_tree);
 
+/** Precompute the neighbor transforms of all trees or drop them again.
+ * With the cache, \ref p8est_find_face_transform, \ref p8est_find_edge_transform and
+ * \ref p8est_find_corner_transform copy their result from per-tree
+ * tables instead of scanning the connectivity on every call.  This speeds
+ * up balance, ghost and iterate at the cost of memory that grows with the
+ * number of trees.  Functions of this library that change the
+ * connectivity drop the cache; any other change must be followed by
+ * calling this function again.
+ * \param [in,out] conn     Valid connectivity.
+ * \param [in] cache        If true, (re)build the cache.
+ *                          If false, free it if it exists.
+ */
+void                p8est_connectivity_set_transform_cache
+  (p8est_connectivity_t * conn, int cache);
+
 /** Examine a connectivity structure.
- * \return  Returns true if structure is valid, false otherwise.
+ * The trees are checked by several threads if p4est is configured with
+ * OpenMP.
+ * \return          Returns true if structure is valid, false otherwise.
  */
 int                 p8est_connectivity_is_valid (p8est_connectivity_t *
                                                  connectivity);
 
+/** Examine a connectivity structure present on all processes of a
+ * communicator.  Each process checks a disjoint range of trees, and the
+ * results are combined.  This function is collective.
+ * \param [in] conn     The same connectivity on all processes.
+ * \param [in] mpicomm  The processes sharing the work.
+ * \return              True on all processes if the structure is valid.
+ */
+int                 p8est_connectivity_is_valid_parallel (p8est_connectivity_t
+                                                          * conn,
+                                                          sc_MPI_Comm
+                                                          mpicomm);
+
 /** Check two connectivity structures for equality.
  * \return          Returns true if structures are equal, false otherwise.
  */
@@ -618,6 +769,14 @@ int                 p8est_connectivity_is_equal (p8est_connectivity_t * conn1,
 int                 p8est_connectivity_sink (p8est_connectivity_t * conn,
                                              sc_io_sink_t * sink);
 
+/** Compute a checksum of the arrays of a connectivity.
+ * It is stored by \ref p8est_connectivity_sink in the file header, such that
+ * a trusted source may skip the validation of the connectivity it reads.
+ * \param [in] conn     A connectivity that is not an implicit brick.
+ * \return              A nonzero checksum.
+ */
+uint64_t            p8est_connectivity_checksum (p8est_connectivity_t * conn);
+
 /** Allocate memory and store the connectivity information there.
  * \param [in] conn     The connectivity structure to be exported to memory.
  * \param [in] code     Encoding and compression method for serialization.
@@ -642,6 +801,32 @@ int                 p8est_connectivity_save (const char *filename,
  */
 p8est_connectivity_t *p8est_connectivity_source (sc_io_source_t * source);
 
+/** Read connectivity from a source object, optionally without validation.
+ * \param [in,out] source       The connectivity is read from this source.
+ * \param [in] trusted          If true and the source stores a checksum,
+ *                              the connectivity is accepted if its checksum
+ *                              matches instead of running
+ *                              \ref p8est_connectivity_is_valid.  Use this only
+ *                              for data written by a trusted program.
+ *                              Sources without a checksum are validated.
+ * \return              The newly created connectivity, or NULL on error.
+ */
+p8est_connectivity_t *p8est_connectivity_source_ext (sc_io_source_t * source,
+                                                    int trusted);
+
+/** The number of leading bytes of a stored connectivity that determine
+ * its size, see \ref p8est_connectivity_sink_bytes. */
+#define P8EST_CONNECTIVITY_HEADER_BYTES 112
+
+/** Compute the size of a stored connectivity from its leading bytes.
+ * This allows to read a connectivity in one piece, for example by MPI I/O.
+ * \param [in] header   The first \ref P8EST_CONNECTIVITY_HEADER_BYTES bytes
+ *                      written by \ref p8est_connectivity_sink.
+ * \return              The number of bytes written by the sink, or 0 if the
+ *                      header does not match the format of this build.
+ */
+size_t              p8est_connectivity_sink_bytes (const char *header);
+
 /** Create new connectivity from a memory buffer.
  * This function aborts on malloc errors.
  * \param [in] buffer   The connectivity is created from this memory buffer.
@@ -658,6 +843,51 @@ p8est_connectivity_t *p8est_connectivity_inflate (sc_array_t * buffer);
 p8est_connectivity_t *p8est_connectivity_load (const char *filename,
                                                size_t *bytes);
 
+/** Load a connectivity structure from disk, optionally without validation.
+ * \param [in] filename         Name of the file to read.
+ * \param [out] bytes           Size in bytes of connectivity on disk or NULL.
+ * \param [in] trusted          As in \ref p8est_connectivity_source_ext.
+ * \return              Returns valid connectivity, or NULL on file error.
+ */
+p8est_connectivity_t *p8est_connectivity_load_ext (const char *filename,
+                                                  size_t *bytes, int trusted);
+
+/** Save a connectivity structure to disk in the memory-mappable format.
+ * The file begins with a versioned header that lists the offset and size of
+ * each array, followed by the arrays in native layout, each aligned to 64
+ * bytes.  The format is little-endian; on big-endian hosts this function
+ * fails.  Without compression, all arrays can be used directly from the
+ * file by \ref p8est_connectivity_load_mapped.
+ * \param [in] filename         Name of the file to write.
+ * \param [in] connectivity     Valid connectivity structure.
+ * \param [in] compress         If true and zlib is available, each array is
+ *                              stored compressed if that saves space.
+ *                              Compressed arrays are not mapped but
+ *                              decompressed on loading.
+ * \return                      Returns 0 on success, nonzero on file error.
+ */
+int                 p8est_connectivity_save_mapped (const char *filename,
+                                                    p8est_connectivity_t *
+                                                    connectivity,
+                                                    int compress);
+
+/** Load a connectivity structure written by
+ * \ref p8est_connectivity_save_mapped.
+ * The file is memory-mapped if the system supports it, else it is read.
+ * The uncompressed arrays of the connectivity point into the file contents
+ * without any decoding, such that pages are only read when accessed.
+ * The processes of a node that load the same file share its pages in memory.
+ * The arrays of the returned connectivity must not be modified; functions
+ * that change or reallocate them may not be called on it.
+ * The file contents are released by \ref p8est_connectivity_destroy.
+ * \param [in] filename         Name of the file to read.
+ * \param [out] bytes           Size in bytes of the file or NULL.
+ * \return              Returns valid connectivity, or NULL on file or
+ *                      format error.
+ */
+p8est_connectivity_t *p8est_connectivity_load_mapped (const char *filename,
+                                                      size_t *bytes);
+
 /** Create a connectivity structure for the unit cube.
  */
 p8est_connectivity_t *p8est_connectivity_new_unitcube (void);
@@ -710,6 +940,26 @@ p8est_connectivity_t *p8est_connectivity_new_brick (int m, int n, int p,
                                                     int periodic_b,
                                                     int periodic_c);
 
+/** An m by n by p array of trees that stores no face and vertex arrays.
+ * The tree_to_tree, tree_to_face, tree_to_vertex and vertices members are
+ * NULL and the \a brick member describes the grid instead.  Trees are
+ * numbered lexicographically with x varying fastest, unlike the
+ * space-filling order of \ref p8est_connectivity_new_brick.  Tree
+ * corners are at integer coordinates as there.  The edge and corner
+ * arrays are stored as usual.
+ *
+ * Code that accesses the faces or vertices of a connectivity must use
+ * \ref p8est_connectivity_face_neighbor_tree and \ref
+ * p8est_connectivity_tree_vertex, which all of p8est's algorithms do.
+ * Functions that modify, serialize or compare connectivities expect the
+ * explicit arrays and must not be called with an implicit brick.
+ */
+p8est_connectivity_t *p8est_connectivity_new_brick_implicit (int m, int n,
+                                                             int p,
+                                                             int periodic_a,
+                                                             int periodic_b,
+                                                             int periodic_c);
+
 /** Create a connectivity structure that builds a spherical shell.
  * It is made up of six connected parts [-1,1]x[-1,1]x[1,2].
  * This connectivity reuses vertices and relies on a geometry transformation.
@@ -768,6 +1018,31 @@ p8est_connectivity_t *p8est_connectivity_new_byname (const char *name);
 p8est_connectivity_t *p8est_connectivity_refine (p8est_connectivity_t * conn,
                                                  int num_per_dim);
 
+/** Uniformly refine a connectivity in parallel.
+ * Each process refines the trees of its partition of a level 0 forest
+ * and numbers the new vertices consistently through \ref p8est_lnodes_new.
+ * The root process collects and completes the result, which is then
+ * broadcast.  The trees are in the same order as in
+ * \ref p8est_connectivity_refine, while the vertices may be numbered
+ * differently.  This function is collective.
+ *
+ * \param [in] conn         A valid connectivity, the same on all processes.
+ * \param [in] num_per_dim  The number of new trees in each direction.
+ *                      Must use no more than \ref P8EST_OLD_QMAXLEVEL bits.
+ * \param [in] shared       If true, the result is distributed with
+ *                          \ref p8est_connectivity_bcast_shared, otherwise
+ *                          with \ref p8est_connectivity_bcast.
+ * \param [in] mpicomm      The MPI communicator.
+ *
+ * \return a refined connectivity on every process.
+ */
+p8est_connectivity_t *p8est_connectivity_refine_parallel (p8est_connectivity_t *
+                                                          conn,
+                                                          int num_per_dim,
+                                                          int shared,
+                                                          sc_MPI_Comm
+                                                          mpicomm);
+
 /** Fill an array with the axis combination of a face neighbor transform.
  * \param [in]  iface       The number of the originating face.
  * \param [in]  nface       Encoded as nface = r * 6 + nf, where nf = 0..5 is
@@ -831,6 +1106,9 @@ void                p8est_find_corner_transform (p8est_connectivity_t *
 
 /** Internally connect a connectivity based on tree_to_vertex information.
  * Periodicity that is not inherent in the list of vertices will be lost.
+ * Faces, edges and corners are identified by sorting their vertex
+ * numbers, which takes time linear in the number of trees and vertices.
+ * With OpenMP enabled, it uses p4est_get_num_threads threads.
  * \param [in,out] conn     The connectivity needs to have proper vertices
  *                          and tree_to_vertex fields.  The tree_to_tree
  *                          and tree_to_face fields must be allocated
@@ -865,6 +1143,29 @@ void                p8est_connectivity_permute (p8est_connectivity_t * conn,
                                                 sc_array_t * perm,
                                                 int is_current_to_new);
 
+/** Reorder the trees of a connectivity along a space filling curve.
+ *
+ * The trees are sorted by the Hilbert index of their centroids, computed
+ * from the vertex coordinates within the bounding box of all vertices.
+ * Each process computes the keys of a slice of the trees, and the keys are
+ * gathered to sort identically on all processes.  This is meant for large
+ * connectivities whose tree numbering follows an unstructured input mesh,
+ * and should be done BEFORE a p8est is created.  The trees are renumbered
+ * in place, including their attributes, with \ref p8est_connectivity_permute.
+ * Unlike \ref p8est_connectivity_reorder this does not require METIS.
+ * \param [in]     comm       MPI communicator.
+ * \param [in,out] conn       Connectivity with vertices to be reordered.
+ *                            It must be identical on all processes.
+ * \param [in,out] newid      If not NULL, an array of size_t that is
+ *                            resized to map old tree indices to new ones.
+ * \return                    \a newid, or a new array holding the map
+ *                            if \a newid is NULL.
+ */
+sc_array_t         *p8est_connectivity_reorder_sfc (sc_MPI_Comm comm,
+                                                    p8est_connectivity_t *
+                                                    conn,
+                                                    sc_array_t * newid);
+
 #ifdef P4EST_WITH_METIS
 
 /** Reorder a connectivity using METIS.
@@ -972,6 +1273,52 @@ p8est_edge_array_index (sc_array_t * array, size_t it)
                                      sizeof (p8est_edge_transform_t) * it);
 }
 
+/** Compute the face neighbor of a tree in an implicit brick.
+ * Use \ref p8est_connectivity_face_neighbor_tree instead.
+ */
+p4est_topidx_t      p8est_connectivity_brick_face_neighbor
+  (p8est_connectivity_t * conn, p4est_topidx_t tree, int face, int *nface);
+
+/** Return the neighbor tree across a face as tree_to_tree would.
+ * This works for explicit connectivities and implicit bricks alike.
+ * \param [in] conn    Valid connectivity.
+ * \param [in] tree    Tree number.
+ * \param [in] face    Face of \a tree.
+ * \param [out] nface  The tree_to_face entry: the neighbor's face plus
+ *                     P8EST_FACES times the orientation.
+ * \return             The neighbor tree, which is \a tree with \a nface
+ *                     equal to \a face on a domain boundary.
+ */
+/*@unused@*/
+static inline       p4est_topidx_t
+p8est_connectivity_face_neighbor_tree (p8est_connectivity_t * conn,
+                                       p4est_topidx_t tree, int face,
+                                       int *nface)
+{
+  P4EST_ASSERT (0 <= tree && tree < conn->num_trees);
+  P4EST_ASSERT (0 <= face && face < P8EST_FACES);
+  P4EST_ASSERT (nface != NULL);
+
+  if (conn->brick != NULL) {
+    return p8est_connectivity_brick_face_neighbor (conn, tree, face, nface);
+  }
+  *nface = (int) conn->tree_to_face[P8EST_FACES * tree + face];
+  return conn->tree_to_tree[P8EST_FACES * tree + face];
+}
+
+/** Return the coordinates of a tree corner as tree_to_vertex would.
+ * This works for explicit connectivities and implicit bricks alike.
+ * \param [in] conn    Connectivity with vertex information.
+ * \param [in] tree    Tree number.
+ * \param [in] corner  Corner of \a tree.
+ * \param [out] xyz    The coordinates of the corner.
+ */
+void                p8est_connectivity_tree_vertex (p8est_connectivity_t *
+                                                    conn,
+                                                    p4est_topidx_t tree,
+                                                    int corner,
+                                                    double xyz[3]);
+
 /** Return a pointer to a p8est_corner_transform_t array element. */
 /*@unused@*/
 static inline p8est_corner_transform_t *
@@ -1093,6 +1440,33 @@ int                 p8est_connectivity_read_inp_stream (FILE * stream,
                                                         p4est_topidx_t *
                                                         tree_to_vertex);
 
+/** Read an ABAQUS input file held in memory.
+ *
+ * This function has the same contract and two ways of calling as
+ * \ref p8est_connectivity_read_inp_stream.  The buffer is cut into chunks
+ * of whole lines that are counted and parsed in parallel by the threads
+ * set with \ref p4est_set_num_threads.
+ *
+ * \param[in]      buffer         contents of the \c .inp file; it need
+ *                                not be NUL-terminated
+ * \param[in]      length         number of bytes in \a buffer
+ * \param[in,out]  num_vertices   the number of vertices in the connectivity
+ * \param[in,out]  num_trees      the number of trees in the connectivity
+ * \param[out]     vertices       the list of \c vertices of the connectivity
+ * \param[out]     tree_to_vertex the \c tree_to_vertex map of the connectivity
+ *
+ * \returns 0 if successful and nonzero if not
+ */
+int                 p8est_connectivity_read_inp_buffer (const char *buffer,
+                                                        size_t length,
+                                                        p4est_topidx_t *
+                                                        num_vertices,
+                                                        p4est_topidx_t *
+                                                        num_trees,
+                                                        double *vertices,
+                                                        p4est_topidx_t *
+                                                        tree_to_vertex);
+
 /** Create a p4est connectivity from an ABAQUS input file.
  *
  * This utility function reads a basic ABAQUS file supporting element type with
@@ -55,6 +55,41 @@ SC_EXTERN_C_BEGIN;
  */
 typedef sc_uint128_t p8est_lid_t;
 
+#if defined (__SIZEOF_INT128__) && !defined (P8EST_LID_NO_NATIVE)
+/** Defined if the compiler provides a native unsigned 128 bit integer.
+ * The p8est_lid_* functions then compute with this type instead of calling
+ * the libsc struct arithmetic.  The storage layout of \ref p8est_lid_t is
+ * unchanged.  Define P8EST_LID_NO_NATIVE to use the libsc code always.
+ */
+#define P8EST_LID_NATIVE
+
+/** The native unsigned 128 bit integer type. */
+__extension__ typedef unsigned __int128 p8est_lid_native_t;
+
+/** Convert a linear index to the native 128 bit integer.
+ * \param [in] a       A pointer to a p8est_lid_t.
+ * \return             The value of \a a.
+ */
+/*@unused@*/
+static inline       p8est_lid_native_t
+p8est_lid_to_native (const p8est_lid_t * a)
+{
+  return ((p8est_lid_native_t) a->high_bits << 64) | a->low_bits;
+}
+
+/** Store a native 128 bit integer into a linear index.
+ * \param [out] a      A pointer to a p8est_lid_t.
+ * \param [in] v       The value to store.
+ */
+/*@unused@*/
+static inline void
+p8est_lid_from_native (p8est_lid_t * a, p8est_lid_native_t v)
+{
+  a->high_bits = (uint64_t) (v >> 64);
+  a->low_bits = (uint64_t) v;
+}
+#endif
+
 /* Data pertaining to selecting, inspecting, and profiling algorithms.
  * A pointer to this structure is hooked into the p8est main structure.
  *
@@ -73,6 +108,18 @@ struct p8est_inspect
   int                 use_balance_ranges_notify;
   /** Verify sc_ranges and/or sc_notify as applicable. */
   int                 use_balance_verify;
+  /** Replace sc_notify by the node-aware \ref p8est_comm_notify_nodes. */
+  int                 use_notify_nodes;
+  /** Find the quadrants of a tree that overlap the insulation layers of
+   * the quadrants received in balance by one merge of sorted queries per
+   * tree instead of two binary searches per insulation quadrant. */
+  int                 use_overlap_merge;
+  /** Before balancing, check by one local pass and one small allreduce
+   * whether the forest is balanced already, and if so return without
+   * changing it.  The check may miss balanced forests whose border
+   * quadrants differ by more than one level, which then run the full
+   * algorithm. */
+  int                 use_balance_precheck;
   /** If positive and smaller than p8est_num ranges, overrides it */
   int                 balance_max_ranges;
   size_t              balance_A_count_in;
@@ -86,12 +133,180 @@ struct p8est_inspect
   double              balance_comm;
   double              balance_B;
   double              balance_ranges;   /**< time spent in sc_ranges */
-  double              balance_notify;   /**< time spent in sc_notify */
+  double              balance_notify;   /**< time spent in sc_notify or
+                                             p8est_comm_notify_nodes */
   /** time spent in sc_notify_allgather */
   double              balance_notify_allgather;
   int                 use_B;
+  /** Number of threads used for the local balance in phases A and B */
+  int                 balance_num_threads;
+  /** Time spent by each thread on the local balance of phase A;
+   * the first min (balance_num_threads, P4EST_INSPECT_MAX_THREADS)
+   * entries are valid */
+  double              balance_A_threads[P4EST_INSPECT_MAX_THREADS];
+  /** Time spent by each thread on the local balance of phase B */
+  double              balance_B_threads[P4EST_INSPECT_MAX_THREADS];
+  /** If not NULL and its codec is not P4EST_COMM_CODEC_NONE, the custom
+   * and data ghost exchanges compress their messages with these settings
+   * and add the raw and wire bytes they send to its counters */
+  p4est_comm_compress_t *ghost_compress;
+  /** Cost of the algorithms listed in \ref p4est_inspect_algorithm_t.
+   * Collected whenever an inspect structure is present in the forest */
+  p4est_inspect_record_t records[P4EST_INSPECT_NUM_ALGORITHMS];
+  /** Transient memory held by the recorded algorithms right now */
+  size_t              memory_current;
+  /** Largest value of memory_current since the last reset */
+  size_t              memory_peak;
+  /** If positive, a soft limit for memory_current.  Algorithms that are
+   * about to exceed it switch to a strategy that uses less memory, if they
+   * have one.  Currently \ref p8est_partition_given sends one message at a
+   * time instead of all at once. */
+  size_t              memory_budget;
+  /** Number of processes in peer_matrix, or 0 if it is not kept.
+   * Set by \ref p8est_inspect_peers_enable. */
+  int                 peer_matrix_size;
+  /** If not NULL, the payload bytes sent to every process by the
+   * algorithms recorded with \ref p8est_inspect_send.  The entry for
+   * algorithm a and receiver q is at a * peer_matrix_size + q. */
+  size_t             *peer_matrix;
 };
 
+/** Return the start time for profiling an algorithm.
+ * \param [in] inspect  Inspect structure of a forest, may be NULL.
+ * \return              The current wall time, or 0 if \a inspect is NULL.
+ */
+double              p8est_inspect_start (p8est_inspect_t * inspect);
+
+/** Count a call of an algorithm and add its elapsed time.
+ * \param [in,out] inspect  Inspect structure of a forest, may be NULL
+ *                          in which case nothing is done.
+ * \param [in] algorithm    The algorithm to record.
+ * \param [in] start        Value returned by \ref p8est_inspect_start.
+ */
+void                p8est_inspect_stop (p8est_inspect_t * inspect,
+                                        p4est_inspect_algorithm_t algorithm,
+                                        double start);
+
+/** Add the point-to-point communication of one call of an algorithm.
+ * \param [in,out] inspect  Inspect structure of a forest, may be NULL
+ *                          in which case nothing is done.
+ * \param [in] algorithm    The algorithm to record.
+ * \param [in] peers        Number of distinct processes exchanged with.
+ * \param [in] messages_sent        Number of messages sent.
+ * \param [in] bytes_sent           Number of bytes sent.
+ * \param [in] messages_received    Number of messages received.
+ * \param [in] bytes_received       Number of bytes received.
+ */
+void                p8est_inspect_comm (p8est_inspect_t * inspect,
+                                        p4est_inspect_algorithm_t algorithm,
+                                        size_t peers, size_t messages_sent,
+                                        size_t bytes_sent,
+                                        size_t messages_received,
+                                        size_t bytes_received);
+
+/** Record the payload sent to one peer in one call of an algorithm.
+ * This feeds the per-peer statistics of the record and, if enabled, the
+ * rank-by-rank matrix.  The totals are still added by
+ * \ref p8est_inspect_comm, which also counts auxiliary messages.
+ * \param [in,out] inspect  Inspect structure of a forest, may be NULL
+ *                          in which case nothing is done.
+ * \param [in] algorithm    The algorithm to record.
+ * \param [in] peer         Rank of the receiving process.
+ * \param [in] bytes        Payload sent to \a peer.  Zero means that the
+ *                          peer was contacted without payload, for example
+ *                          by sending a count of zero.
+ */
+void                p8est_inspect_send (p8est_inspect_t * inspect,
+                                        p4est_inspect_algorithm_t algorithm,
+                                        int peer, size_t bytes);
+
+/** Start keeping the rank-by-rank matrix of payload bytes.
+ * An existing matrix is cleared.
+ * \param [in,out] inspect  Valid inspect structure.
+ * \param [in] mpisize      Number of processes of the forest.
+ */
+void                p8est_inspect_peers_enable (p8est_inspect_t * inspect,
+                                                int mpisize);
+
+/** Stop keeping the rank-by-rank matrix and free its memory.
+ * Must be called before freeing an inspect structure with a matrix.
+ * \param [in,out] inspect  Valid inspect structure.
+ */
+void                p8est_inspect_peers_disable (p8est_inspect_t * inspect);
+
+/** Write the rank-by-rank matrices of payload bytes to a text file.
+ * The rows are gathered to rank zero, which writes one matrix for every
+ * algorithm that sent any payload.  Row p, column q holds the bytes sent
+ * from rank p to rank q since the last reset.
+ * This function is collective over the forest's communicator.
+ * \param [in] p8est        Forest whose inspect structure keeps a matrix
+ *                          for its number of processes.
+ * \param [in] filename     Name of the file written by rank zero.
+ * \return                  0 on success, nonzero if the file could not be
+ *                          written.  The same on all processes.
+ */
+int                 p8est_inspect_peers_write (p8est_t * p8est,
+                                               const char *filename);
+
+/** Record the memory footprint of a structure created by an algorithm.
+ * \param [in,out] inspect  Inspect structure of a forest, may be NULL
+ *                          in which case nothing is done.
+ * \param [in] algorithm    The algorithm to record.
+ * \param [in] bytes        Memory used by the created structure.
+ */
+void                p8est_inspect_memory (p8est_inspect_t * inspect,
+                                          p4est_inspect_algorithm_t algorithm,
+                                          size_t bytes);
+
+/** Account for transient memory allocated by an algorithm.
+ * Only the large temporary buffers are tracked, such as message buffers
+ * and copies of quadrant arrays.
+ * \param [in,out] inspect  Inspect structure of a forest, may be NULL
+ *                          in which case nothing is done.
+ * \param [in] algorithm    The algorithm holding the memory.
+ * \param [in] bytes        Size of the allocation.
+ */
+void                p8est_inspect_alloc (p8est_inspect_t * inspect,
+                                         p4est_inspect_algorithm_t algorithm,
+                                         size_t bytes);
+
+/** Account for transient memory released by an algorithm.
+ * \param [in,out] inspect  Inspect structure of a forest, may be NULL
+ *                          in which case nothing is done.
+ * \param [in] algorithm    The algorithm holding the memory.
+ * \param [in] bytes        Size previously passed to
+ *                          \ref p8est_inspect_alloc.
+ */
+void                p8est_inspect_free (p8est_inspect_t * inspect,
+                                        p4est_inspect_algorithm_t algorithm,
+                                        size_t bytes);
+
+/** Query whether an allocation would exceed the soft memory budget.
+ * \param [in] inspect      Inspect structure of a forest, may be NULL.
+ * \param [in] bytes        Size of the intended allocation.
+ * \return                  True if \a inspect is not NULL, its
+ *                          memory_budget is positive and the allocation
+ *                          would raise memory_current above it.
+ */
+int                 p8est_inspect_memory_tight (p8est_inspect_t * inspect,
+                                                size_t bytes);
+
+/** Clear the records of all algorithms and restart the memory peak.
+ * The rank-by-rank matrix is cleared if it is kept.
+ * The switches, the memory budget and the balance counters are not changed.
+ * \param [in,out] inspect  Valid inspect structure.
+ */
+void                p8est_inspect_reset (p8est_inspect_t * inspect);
+
+/** Print statistics of the algorithm records over all processes.
+ * This function is collective over the forest's communicator.
+ * Only algorithms called at least once on any process are printed.
+ * \param [in] p8est        Forest with a non-NULL inspect structure.
+ * \param [in] log_priority Priority for sc_stats_print.
+ */
+void                p8est_inspect_statistics (p8est_t * p8est,
+                                              int log_priority);
+
 /** Callback function prototype to replace one set of quadrants with another.
  *
  * This is used by extended routines when the quadrants of an existing, valid
@@ -348,6 +563,48 @@ void                p8est_quadrant_set_morton_ext128 (p8est_quadrant_t *
                                                       quadrant, int level,
                                                       const p8est_lid_t * id);
 
+/** Compute the linear positions of an array of quadrants.
+ * This is the batched form of \ref p8est_quadrant_linear_id_ext128.
+ * \param [in] quadrants Array of \a n extended quadrants.
+ * \param [in] n         Number of quadrants.
+ * \param [in] level     Level of the grid, see
+ *                       \ref p8est_quadrant_linear_id_ext128.
+ * \param [out] id       Array of \a n linear positions.
+ */
+void                p8est_quadrant_linear_id_ext128_batch
+  (const p8est_quadrant_t * quadrants, size_t n, int level,
+   p8est_lid_t * id);
+
+/** Set an array of quadrants from their linear positions.
+ * This is the batched form of \ref p8est_quadrant_set_morton_ext128.
+ * \param [out] quadrants Array of \a n quadrants whose Morton indices and
+ *                        levels are set.  The user data is not modified.
+ * \param [in] n          Number of quadrants.
+ * \param [in] level      Level of the grid and of the quadrants.
+ * \param [in] id         Array of \a n linear positions.
+ */
+void                p8est_quadrant_set_morton_ext128_batch
+  (p8est_quadrant_t * quadrants, size_t n, int level,
+   const p8est_lid_t * id);
+
+/** Transform several quadrant coordinates of one tree into vertex space.
+ * This is the batched form of \ref p8est_qcoord_to_vertex with identical
+ * results.  The corner vertices of the tree are retrieved once for all
+ * points, and the loop over the points has no branches.
+ * \param [in] connectivity  Connectivity must provide the vertices.
+ * \param [in] treeid        The tree that contains all points.
+ * \param [in] n             Number of points.
+ * \param [in] qcoords       The x, y, z coordinates of each point,
+ *                           3 entries per point.
+ * \param [out] vxyz         Three coordinates in vertex space per point.
+ */
+void                p8est_qcoord_to_vertex_batch (p8est_connectivity_t *
+                                                  connectivity,
+                                                  p4est_topidx_t treeid,
+                                                  size_t n,
+                                                  const p4est_qcoord_t *
+                                                  qcoords, double *vxyz);
+
 /** Create a new forest.
  * This is a more general form of \ref p8est_new.
  * The forest created is either uniformly refined at a given level
@@ -422,6 +679,152 @@ p8est_mesh_t       *p8est_mesh_new_ext (p8est_t * p8est,
 p8est_t            *p8est_copy_ext (p8est_t * input, int copy_data,
                                     int duplicate_mpicomm);
 
+/** Make a copy of a p8est that shares the local quadrants with the input.
+ * The quadrant arrays of the local trees are not copied.  Both forests
+ * refer to them until either one is modified: refine, coarsen, balance,
+ * partition, \ref p8est_reset_data and \ref p8est_set_data_contiguous
+ * call \ref p8est_unshare_quadrants before they change the quadrants.
+ * The last forest to do so takes over the arrays without copying.
+ * Any other write to the quadrants of a sharing forest, including their
+ * p.user_int or p.user_data members, must be preceded by this call.
+ * The copy has a data size of 0 and otherwise behaves like the result
+ * of \ref p8est_copy_ext without data.  Sharing is not thread safe.
+ *
+ * \param [in,out] input  The forest to copy.  Its quadrant arrays are
+ *                         moved into the shared storage.
+ * \param [in]  duplicate_mpicomm  If true, MPI communicator is copied.
+ * \return  Returns a valid p8est with its revision counter 0.
+ */
+p8est_t            *p8est_copy_shared (p8est_t * input,
+                                      int duplicate_mpicomm);
+
+/** Give a forest its own copy of quadrants shared by \ref p8est_copy_shared.
+ * If no other forest refers to the shared quadrants any more, they are
+ * taken over without copying.  Does nothing for a forest without sharing.
+ * Not collective.
+ * \param [in,out] p8est     The forest is not changed otherwise.
+ */
+void                p8est_unshare_quadrants (p8est_t * p8est);
+
+/** Obtain an empty array from the scratch arena of a forest.
+ * Balance and ghost take their temporary quadrant arrays from this arena
+ * and return them afterwards, so that repeated calls reuse the
+ * allocations instead of growing them anew.  The arena keeps one list of
+ * arrays per thread; the calling thread takes from its own list.
+ * The arena is created on the first call outside of a parallel region.
+ * Inside a parallel region without a matching list a new array is made.
+ * \param [in,out] p8est     The forest owning the arena.
+ * \param [in] elem_size     Element size of the array.
+ * \return                   Array with zero elements.  Must be handed
+ *                           back by \ref p8est_scratch_array_destroy.
+ */
+sc_array_t         *p8est_scratch_array_new (p8est_t * p8est,
+                                             size_t elem_size);
+
+/** Return an array obtained by \ref p8est_scratch_array_new to the arena.
+ * The elements are dropped while the allocation is kept for reuse.
+ * \param [in,out] p8est     The forest owning the arena.
+ * \param [in] array         Array to return; not to be accessed after.
+ */
+void                p8est_scratch_array_destroy (p8est_t * p8est,
+                                                 sc_array_t * array);
+
+/** Release memory held by the scratch arena of a forest.
+ * Kept arrays are freed until at most \a max_bytes remain allocated.
+ * Not collective.  Must not be called from a parallel region.
+ * \param [in,out] p8est     The forest owning the arena.
+ * \param [in] max_bytes     Allocation to retain; 0 frees all.
+ */
+void                p8est_scratch_trim (p8est_t * p8est, size_t max_bytes);
+
+/** Switch the storage of the quadrant user data of a forest.
+ * In contiguous mode the user data of local quadrant number i lives at
+ * \a data_array + i * \a data_size, and each quadrant's p.user_data
+ * points there.  The whole array can then be handed to external kernels
+ * or wrapped by \ref sc_array_init_data, for example to write it with
+ * \ref p8est_file_write_field, without copying.
+ *
+ * Refine, coarsen, balance, partition and \ref p8est_reset_data allocate
+ * the data of new quadrants from the user data pool as usual and move
+ * all data back into a new contiguous array before they return.  Thus
+ * every p.user_data pointer and the array itself are invalidated by
+ * these functions.  \ref p8est_copy preserves the mode.
+ * Not collective.
+ *
+ * \param [in,out] p8est      The forest is not changed except for the
+ *                            location of its quadrant data.
+ * \param [in] contiguous     If true, pack the data into one array.
+ *                            If false, return the data to the pool.
+ */
+void                p8est_set_data_contiguous (p8est_t * p8est,
+                                               int contiguous);
+
+/** Track the changes to a forest to make subsequent balance incremental.
+ * In this mode, \ref p8est_refine_ext and \ref p8est_coarsen_ext flag the
+ * trees they modify.  A balance then skips the local pass on the trees
+ * that are not flagged, and returns immediately if the forest has not
+ * changed globally since the last balance of the same or a stronger type.
+ * Modifying the quadrants in any other way is not tracked; call this
+ * function again with \a incremental true to flag all trees.
+ * \ref p8est_copy preserves the mode.  Not collective.
+ *
+ * \param [in,out] p8est      The forest is not changed.
+ * \param [in] incremental   If true, flag all trees and start tracking.
+ *                            If false, stop tracking.
+ */
+void                p8est_set_balance_incremental (p8est_t * p8est,
+                                                int incremental);
+
+/** Track the changes to a forest to make the validity check incremental.
+ * In this mode, \ref p8est_refine_ext and \ref p8est_coarsen_ext flag the
+ * trees they modify, and \ref p8est_is_valid_ext with
+ * \ref P8EST_VALID_CHANGED checks only those trees for completeness.
+ * \ref p8est_copy preserves the mode.  Not collective.
+ *
+ * \param [in,out] p8est      The forest is not changed.
+ * \param [in] incremental   If true, flag all trees and start tracking.
+ *                            If false, stop tracking.
+ */
+void                p8est_set_valid_incremental (p8est_t * p8est,
+                                                 int incremental);
+
+/** Return the size of a snapshot of the local part of a forest.
+ * \param [in] p8est      The forest.
+ * \param [in] save_data  If true, the quadrant data is included.
+ * \return                Bytes to provide to \ref p8est_snapshot_save.
+ */
+size_t              p8est_snapshot_size (p8est_t * p8est, int save_data);
+
+/** Copy the local part of a forest into a buffer provided by the caller.
+ * The local quadrants are copied with one memcpy per tree, together with
+ * the tree structures and the partition.  No memory is allocated, so the
+ * same buffer may be reused for taking a snapshot at every step.
+ * Not collective.
+ * \param [in] p8est      The forest is not changed.
+ * \param [in] save_data  If true, the quadrant data is included.
+ * \param [out] buffer    At least \ref p8est_snapshot_size bytes.
+ */
+void                p8est_snapshot_save (p8est_t * p8est, int save_data,
+                                         void *buffer);
+
+/** Reset a forest to a snapshot taken from it earlier.
+ * The forest may have been refined, coarsened, balanced or partitioned
+ * since, but its connectivity, communicator and data size must be the
+ * same.  The quadrant arrays of the trees are reused in place and filled
+ * with one memcpy per tree.  The revision counter is increased.  Since
+ * the partition is restored as well, the call must be made on all
+ * processes with snapshots taken at the same time, but it does not
+ * communicate.
+ * \param [in,out] p8est  The forest is restored to the snapshot.
+ * \param [in] buffer     Filled by \ref p8est_snapshot_save.
+ * \param [in] init_fn    If the snapshot has no quadrant data, the data
+ *                        of the restored quadrants is initialized by this
+ *                        function unless NULL.
+ */
+void                p8est_snapshot_restore (p8est_t * p8est,
+                                            const void *buffer,
+                                            p8est_init_t init_fn);
+
 /** Refine a forest with a bounded refinement level and a replace option.
  * \param [in,out] p8est The forest is changed in place.
  * \param [in] refine_recursive Boolean to decide on recursive refinement.
@@ -442,6 +845,12 @@ p8est_t            *p8est_copy_ext (p8est_t * input, int copy_data,
  * \param [in] replace_fn Callback function that allows the user to change
  *                        incoming quadrants based on the quadrants they
  *                        replace; may be NULL.
+ *
+ * If more than one thread is set by \ref p4est_set_num_threads
+ * and p4est is configured with OpenMP, the local trees are refined
+ * concurrently.  The callbacks are then called from several threads at
+ * once, each for a different tree, and must be thread-safe.  Within one
+ * tree the order of the callbacks is the same as in the serial case.
  */
 void                p8est_refine_ext (p8est_t * p8est,
                                       int refine_recursive, int maxlevel,
@@ -456,12 +865,13 @@ void                p8est_refine_ext (p8est_t * p8est,
  *                        non-families.  In this case, the second quadrant
  *                        pointer in the argument list of the callback is NULL,
  *                        subsequent pointers are undefined, and the return
- *                        value is ignored.  If coarsen_recursive is true, it
- *                        is possible that a quadrant is called once or more as
- *                        an orphan and eventually becomes part of a family.
- *                        With coarsen_recursive false and callback_orphans true,
- *                        it is guaranteed that every quadrant is passed exactly
- *                        once into the coarsen_fn callback.
+ *                        value is ignored.  With coarsen_recursive false and
+ *                        callback_orphans true, it is guaranteed that every
+ *                        quadrant is passed exactly once into the coarsen_fn
+ *                        callback.  If coarsen_recursive is true, this holds
+ *                        as well, including the parents created on the way,
+ *                        and a quadrant is passed as an orphan only once it
+ *                        cannot become part of a family anymore.
  * \param [in] coarsen_fn Callback function that returns true if a
  *                        family of quadrants shall be coarsened.
  * \param [in] init_fn    Callback function to initialize the user_data
@@ -469,6 +879,12 @@ void                p8est_refine_ext (p8est_t * p8est,
  * \param [in] replace_fn Callback function that allows the user to change
  *                        incoming quadrants based on the quadrants they
  *                        replace.
+ *
+ * If more than one thread is set by \ref p4est_set_num_threads
+ * and p4est is configured with OpenMP, the local trees are coarsened
+ * concurrently.  The callbacks are then called from several threads at
+ * once, each for a different tree, and must be thread-safe.  Within one
+ * tree the order of the callbacks is the same as in the serial case.
  */
 void                p8est_coarsen_ext (p8est_t * p8est, int coarsen_recursive,
                                        int callback_orphans,
@@ -492,6 +908,156 @@ void                p8est_balance_ext (p8est_t * p8est,
                                        p8est_init_t init_fn,
                                        p8est_replace_t replace_fn);
 
+/** Opaque state of a balance between \ref p8est_balance_begin and
+ * \ref p8est_balance_end. */
+typedef struct p8est_balance_context p8est_balance_context_t;
+
+/** Begin a 2:1 balance and return while its messages are in flight.
+ * This function runs the local balance of all trees that need to be
+ * communicated, posts the first round of messages, and then balances the
+ * trees that are isolated from the other processes.  The arguments are
+ * identical to \ref p8est_balance_ext.  Between this call and the matching
+ * \ref p8est_balance_end, the application may do work that does not modify
+ * the forest; the communication of the balance progresses meanwhile.
+ * The pattern of senders and receivers is determined collectively.
+ * \return             Transient storage to be passed to p8est_balance_end.
+ */
+p8est_balance_context_t *p8est_balance_begin
+  (p8est_t * p8est, p8est_connect_type_t btype,
+   p8est_init_t init_fn, p8est_replace_t replace_fn);
+
+/** Complete a 2:1 balance started by \ref p8est_balance_begin.
+ * This function answers the requests of other processes, waits for all
+ * pending messages, and merges the received quadrants into the forest.
+ * The result is identical to that of \ref p8est_balance_ext.
+ * \param [in] ctx     Created ONLY by p8est_balance_begin.
+ *                     It is deallocated before this function returns.
+ */
+void                p8est_balance_end (p8est_balance_context_t * ctx);
+
+/** Balance several forests that share one communicator together.
+ * The first round of messages of all forests is posted before any forest
+ * waits for its messages, so the latencies overlap.  Each forest still
+ * determines its senders and receivers by its own collective call and
+ * sends its own messages; these are not merged per pair of processes.
+ * The result is identical to calling \ref p8est_balance_ext on each forest.
+ * This function is collective.
+ * \param [in] num_forests  Number of forests, may be 0.
+ * \param [in,out] forests  Array of \a num_forests forests.
+ * \param [in] btype        Balance type, applied to all forests.
+ * \param [in] init_fn      Callback function to initialize the user_data
+ *                          which is already allocated automatically.
+ * \param [in] replace_fn   Callback function that allows the user to change
+ *                          incoming quadrants based on the quadrants they
+ *                          replace.
+ */
+void                p8est_balance_ensemble (int num_forests,
+                                            p8est_t * forests[],
+                                            p8est_connect_type_t btype,
+                                            p8est_init_t init_fn,
+                                            p8est_replace_t replace_fn);
+
+/** Refine a balanced forest and restore its balance with little work.
+ * The refinement is done by \ref p4est_refine_ext.  The 2:1 ripple it
+ * causes is then inserted into each changed tree by the local balance
+ * kernel.  A full parallel \ref p4est_balance_ext follows only if on any
+ * process the refinement or its ripple replaced a quadrant that may
+ * have a neighbor in another tree or on another process.  Refining a
+ * few quadrants away from process and tree boundaries thus costs one
+ * local pass and a single reduction.  Collective.
+ *
+ * The forest must be balanced with \a btype on input.  If incremental
+ * balance is enabled by \ref p8est_set_balance_incremental, this is
+ * checked and the parallel balance is run otherwise.
+ *
+ * \param [in,out] p8est The forest is refined and balanced in place.
+ * \param [in] refine_recursive  As in \ref p8est_refine_ext.
+ * \param [in] allowed_level     As in \ref p8est_refine_ext.
+ * \param [in] btype      The balance type.
+ * \param [in] refine_fn  Refinement callback as in \ref p8est_refine_ext.
+ * \param [in] init_fn    Callback for new quadrants of both refinement and
+ *                        balance.
+ * \param [in] replace_fn Replace callback of both refinement and balance.
+ */
+void                p8est_refine_balanced (p8est_t * p8est,
+                                           int refine_recursive,
+                                           int allowed_level,
+                                           p8est_connect_type_t btype,
+                                           p8est_refine_t refine_fn,
+                                           p8est_init_t init_fn,
+                                           p8est_replace_t replace_fn);
+
+/** Relation of a quadrant in an adapted forest to its origin. */
+typedef enum
+{
+  P8EST_ADAPT_SAME,            /**< The quadrant is unchanged. */
+  P8EST_ADAPT_CHILD,           /**< The quadrant is a descendant of one
+                                     old quadrant. */
+  P8EST_ADAPT_PARENT           /**< The quadrant is the ancestor of a
+                                     range of old quadrants. */
+}
+p8est_adapt_relation_t;
+
+/** Map the local quadrants of an adapted forest to the ones before.
+ * Created by \ref p8est_adapt_map_new, which records the local quadrants,
+ * and filled by \ref p8est_adapt_map_update after any sequence of refine,
+ * coarsen and balance calls.  The arrays may then be used to project
+ * data in one pass instead of through per-family replace callbacks.
+ * All indices are local quadrant numbers across the local trees.
+ */
+typedef struct p8est_adapt_map
+{
+  p4est_locidx_t      num_old;          /**< Recorded local quadrants. */
+  p4est_locidx_t      num_new;          /**< Local quadrants at update. */
+  p4est_locidx_t     *old_first;        /**< For each new quadrant the
+                                             first old quadrant it derives
+                                             from. */
+  p4est_locidx_t     *old_count;        /**< For each new quadrant the
+                                             number of old quadrants: one
+                                             unless the relation is
+                                             P8EST_ADAPT_PARENT. */
+  int8_t             *relation;         /**< For each new quadrant a
+                                             p8est_adapt_relation_t. */
+
+  /* private */
+  sc_array_t         *old_quadrants;
+}
+p8est_adapt_map_t;
+
+/** Record the local quadrants of a forest to map adaptation later.
+ * Only the coordinates are kept, not the user data.
+ * \param [in] p8est    The forest before adaptation.
+ * \return              A map with num_new zero and NULL arrays.
+ */
+p8est_adapt_map_t *p8est_adapt_map_new (p8est_t * p8est);
+
+/** Compute the map from the recorded quadrants to the current ones.
+ * Between \ref p8est_adapt_map_new and this call the forest may be
+ * refined, coarsened and balanced any number of times, but not
+ * partitioned.  The arrays are reallocated on every call.
+ * \param [in,out] map  The map created from this forest.
+ * \param [in] p8est    The adapted forest.
+ */
+void                p8est_adapt_map_update (p8est_adapt_map_t * map,
+                                            p8est_t * p8est);
+
+/** Free the recorded quadrants and the arrays of a map. */
+void                p8est_adapt_map_destroy (p8est_adapt_map_t * map);
+
+/** Carry integer counts per quadrant, such as particles, through a map.
+ * Unchanged quadrants keep their count and parents receive the sum over
+ * their old children.  The count of a refined quadrant is spread evenly
+ * over its descendants, which preserves the local sum but is only an
+ * estimate until the counts are recomputed, for example by the next
+ * point migration.
+ * \param [in] map         A map filled by \ref p8est_adapt_map_update.
+ * \param [in] old_counts  One count per recorded quadrant.
+ * \param [out] new_counts One count per current local quadrant.
+ */
+void                p8est_adapt_map_counts (const p8est_adapt_map_t * map,
+                                          const int *old_counts,
+                                          int *new_counts);
+
 void                p8est_balance_subtree_ext (p8est_t * p8est,
                                                p8est_connect_type_t btype,
                                                p4est_topidx_t which_tree,
@@ -518,6 +1084,209 @@ p4est_gloidx_t      p8est_partition_ext (p8est_t * p8est,
                                          int partition_for_coarsening,
                                          p8est_weight_t weight_fn);
 
+/** Repartition the forest by weights given as an array.
+ * The weight of local quadrant i is \a base_weight + \a counts[i], for
+ * example one plus its number of particles as kept by
+ * p8est_points_migrate.  This avoids a weight callback and the state it
+ * would have to track between calls.  The counts are not moved to the
+ * new partition.
+ * \param [in,out] p8est      The forest that will be partitioned.
+ * \param [in]     partition_for_coarsening     If true, the partition
+ *                            is modified to allow one level of coarsening.
+ * \param [in]     base_weight        Weight added to every quadrant, >= 0.
+ * \param [in]     counts     One count >= 0 per local quadrant, or NULL
+ *                            on all processes for uniform partitioning.
+ * \return         The global number of shipped quadrants
+ */
+p4est_gloidx_t      p8est_partition_weights (p8est_t * p8est,
+                                             int partition_for_coarsening,
+                                             int base_weight,
+                                             const int *counts);
+
+/** Repartition the forest by 64-bit weights given as an array.
+ * The cumulative sums of the weights are computed without calls per
+ * quadrant, in one piece per thread for large arrays, and the cuts and
+ * the transfer are those of p8est_partition_ext.
+ * \param [in,out] p8est      The forest that will be partitioned.
+ * \param [in]     partition_for_coarsening     If true, the partition
+ *                            is modified to allow one level of coarsening.
+ * \param [in]     weights    One weight >= 0 per local quadrant in the
+ *                            order of the local trees; not NULL, even if
+ *                            there are no local quadrants.
+ * \return         The global number of shipped quadrants
+ * \note    The global sum of the weights must fit into a 64bit integer.
+ */
+p4est_gloidx_t      p8est_partition_weights64 (p8est_t * p8est,
+                                               int partition_for_coarsening,
+                                               const int64_t * weights);
+
+/** User data moved along with the quadrants by p8est_partition_ext_data.
+ * The data is either of fixed size per quadrant or, if \a src_sizes is
+ * not NULL, of variable size as in p4est_transfer_custom.
+ */
+typedef struct p8est_partition_data
+{
+  size_t              data_size;        /**< Fixed size per quadrant */
+  const void         *src_data; /**< Data of the local quadrants in order */
+  const int          *src_sizes;        /**< Byte size per quadrant or NULL */
+  void               *dest_data;        /**< Allocated and filled in the new
+                                             partition, free with P4EST_FREE */
+  int                *dest_sizes;       /**< Allocated and filled if
+                                             \a src_sizes is not NULL */
+}
+p8est_partition_data_t;
+
+/** Repartition the forest and move user data in the same epoch.
+ * The partition is the same as that of p8est_partition_ext.  The data of
+ * each descriptor is sent with point-to-point messages that are posted
+ * before the quadrants move and completed after, replacing a separate
+ * call to p4est_transfer_fixed or p4est_transfer_custom.  Variable size
+ * data first transfers the sizes.  The new arrays are also allocated if
+ * the partition does not change.
+ * \param [in,out] p8est      The forest that will be partitioned.
+ * \param [in]     partition_for_coarsening     If true, the partition
+ *                            is modified to allow one level of coarsening.
+ * \param [in]     weight_fn  A weighting function or NULL
+ *                            for uniform partitioning.
+ * \param [in]     num_data   Number of user data descriptors.
+ * \param [in,out] data       On input, the source members are set.
+ *                            On output, the destination members are set.
+ * \return         The global number of shipped quadrants
+ */
+p4est_gloidx_t      p8est_partition_ext_data (p8est_t * p8est,
+                                              int partition_for_coarsening,
+                                              p8est_weight_t weight_fn,
+                                              int num_data,
+                                              p8est_partition_data_t * data);
+
+/** Opaque context of a split-phase partition. */
+typedef struct p8est_partition_context p8est_partition_context_t;
+
+/** Begin to repartition the forest without waiting for the quadrants.
+ * The new partition is the same as that of p8est_partition_ext.  Its cuts
+ * are computed with collective communication, then the messages carrying
+ * the quadrants and their user data are posted and this function returns.
+ * Until the matching \ref p8est_partition_end the forest keeps its old
+ * partition: it may be read, for example to pack application data for
+ * p8est_transfer_fixed, but it must not be modified.
+ * \param [in] p8est          The forest that will be partitioned.
+ * \param [in]     partition_for_coarsening     If true, the partition
+ *                            is modified to allow one level of coarsening.
+ * \param [in]     weight_fn  A weighting function or NULL
+ *                            for uniform partitioning.
+ * \return         Context to be passed to \ref p8est_partition_end.
+ */
+p8est_partition_context_t *p8est_partition_begin (p8est_t * p8est,
+                                                  int
+                                                  partition_for_coarsening,
+                                                  p8est_weight_t weight_fn);
+
+/** Complete a partition started by \ref p8est_partition_begin.
+ * Waits for the messages and rebuilds the local trees in the new
+ * partition.
+ * \param [in] pc  The context, which is freed by this function.
+ * \return         The global number of shipped quadrants
+ */
+p4est_gloidx_t      p8est_partition_end (p8est_partition_context_t * pc);
+
+/** Repartition several forests that share one communicator together.
+ * Each forest receives the same partition as with p8est_partition_ext.
+ * The weight sums of all forests are gathered with one collective and
+ * the cuts are combined into one reduction instead of separate messages
+ * per forest.  Then the quadrants of all forests are sent concurrently.
+ * \param [in] num_forests  Number of forests, may be 0.
+ * \param [in,out] forests  Array of \a num_forests forests.
+ * \param [in]     partition_for_coarsening     If true, the partition
+ *                            is modified to allow one level of coarsening.
+ * \param [in]     weight_fn  A weighting function or NULL
+ *                            for uniform partitioning.
+ * \return         The global number of shipped quadrants of all forests.
+ */
+p4est_gloidx_t      p8est_partition_ensemble (int num_forests,
+                                              p8est_t * forests[],
+                                              int partition_for_coarsening,
+                                              p8est_weight_t weight_fn);
+
+/** Callback function prototype to calculate several weights per quadrant.
+ * \param [in] p8est       the forest
+ * \param [in] which_tree  the tree containing \a quadrant
+ * \param [in] quadrant    the quadrant to be weighted
+ * \param [out] weights    one integer >= 0 per constraint
+ * \note    Global sum of each weight must fit into a 64bit integer.
+ */
+typedef void        (*p8est_weights_t) (p8est_t * p8est,
+                                        p4est_topidx_t which_tree,
+                                        p8est_quadrant_t * quadrant,
+                                        int *weights);
+
+/** Repartition the forest balancing several weights at once.
+ *
+ * The cut points remain on the space filling curve.  They are found with
+ * the parallel prefix sums of p8est_partition_ext applied to a combination
+ * of the weights, each normalized by its global sum.  The combination is
+ * adjusted for a few rounds to favor the weights whose largest load per
+ * process exceeds its tolerance.  The best partition found is used.
+ *
+ * \param [in,out] p8est      The forest that will be partitioned.
+ * \param [in]     partition_for_coarsening     If true, the partition
+ *                            is modified to allow one level of coarsening.
+ * \param [in]     num_weights        Number of constraints, at least one.
+ * \param [in]     weights_fn A function to fill the weights of a quadrant.
+ * \param [in]     tolerances For each constraint, the allowed relative excess
+ *                            of the largest load over the average load.
+ *                            If NULL, each tolerance is 0.05.
+ * \return         The global number of shipped quadrants
+ */
+p4est_gloidx_t      p8est_partition_multi (p8est_t * p8est,
+                                           int partition_for_coarsening,
+                                           int num_weights,
+                                           p8est_weights_t weights_fn,
+                                           const double *tolerances);
+
+/** Repartition the forest while moving as few quadrants as possible.
+ *
+ * If the largest load per process exceeds the average load by no more than
+ * \a tolerance, relative to the average, the partition is left unchanged.
+ * Otherwise only those cuts on the space filling curve are moved that are
+ * too far from their position in p8est_partition_ext, and only as far as
+ * needed to bring every load within the tolerance.
+ *
+ * \param [in,out] p8est      The forest that will be partitioned.
+ * \param [in]     partition_for_coarsening     If true, the partition
+ *                            is modified to allow one level of coarsening.
+ * \param [in]     weight_fn  A weighting function or NULL
+ *                            for uniform partitioning.
+ * \param [in]     tolerance  Allowed relative imbalance in [0, 2),
+ *                            for example 0.03.
+ * \return         The global number of shipped quadrants
+ */
+p4est_gloidx_t      p8est_partition_incremental (p8est_t * p8est,
+                                                 int partition_for_coarsening,
+                                                 p8est_weight_t weight_fn,
+                                                 double tolerance);
+
+/** Repartition the forest with a prescribed share for each process.
+ *
+ * This serves processes of different capacity, for example on nodes with
+ * and without accelerators.  Process p receives the fraction
+ * targets[p] / sum (targets) of the total weight.  The cuts remain on the
+ * space filling curve, and partition_for_coarsening applies as usual.
+ *
+ * \param [in,out] p8est      The forest that will be partitioned.
+ * \param [in]     partition_for_coarsening     If true, the partition
+ *                            is modified to allow one level of coarsening.
+ * \param [in]     weight_fn  A weighting function or NULL
+ *                            for unit weight of every quadrant.
+ * \param [in]     targets    Nonnegative relative share of each process,
+ *                            mpisize entries, identical on all processes.
+ *                            Their sum must be positive.
+ * \return         The global number of shipped quadrants
+ */
+p4est_gloidx_t      p8est_partition_targets (p8est_t * p8est,
+                                             int partition_for_coarsening,
+                                             p8est_weight_t weight_fn,
+                                             const double *targets);
+
 /** Correct partition to allow one level of coarsening.
  *
  * \param [in] p8est                     forest whose partition is corrected
@@ -528,6 +1297,38 @@ p4est_gloidx_t      p8est_partition_for_coarsening (p8est_t * p8est,
                                                     p4est_locidx_t *
                                                     num_quadrants_in_proc);
 
+/** Agglomerate a small forest onto the fewest processes that hold a
+ * given number of quadrants each.  Coarse problems such as the lower levels
+ * of a multigrid hierarchy run balance, ghost and lnodes faster there.
+ * The forest is copied and the copy is partitioned onto the first
+ * processes, which then form a new communicator.  Collective.
+ * \param [in] p8est      The forest is not modified.
+ * \param [in] quadrants_per_rank   Target number of quadrants per process.
+ * \param [in] copy_data  If true, the user data is copied and moved along.
+ * \return                The agglomerated forest on its own duplicated
+ *                        communicator on the first processes, NULL on the
+ *                        other processes.
+ */
+p8est_t            *p8est_agglomerate_new (p8est_t * p8est,
+                                           p4est_gloidx_t quadrants_per_rank,
+                                           int copy_data);
+
+/** Expand an agglomerated forest back onto all processes.
+ * The quadrants of \a coarse replace those of \a p8est, which are then
+ * partitioned uniformly over its communicator.  Collective over the
+ * communicator of \a p8est.
+ * \param [in,out] p8est  The forest from which \a coarse was created.
+ * \param [in] coarse     The agglomerated forest, possibly refined,
+ *                        coarsened or balanced, or NULL on the processes
+ *                        not in it.  It is destroyed.
+ * \param [in] init_fn    If the data size of \a coarse differs from that
+ *                        of \a p8est, this callback may initialize the data
+ *                        of the quadrants.  Otherwise the data is copied.
+ */
+void                p8est_agglomerate_expand (p8est_t * p8est,
+                                              p8est_t * coarse,
+                                              p8est_init_t init_fn);
+
 /** p8est_iterate_ext adds the option \a remote: if this is false, then it is
  * the same as p8est_iterate; if this is true, then corner/edge callbacks are
  * also called on corners/edges for hanging faces/edges touched by local
@@ -542,6 +1343,78 @@ void                p8est_iterate_ext (p8est_t * p8est,
                                        p8est_iter_corner_t iter_corner,
                                        int remote);
 
+/** Iterate over the forest with several threads as p8est_iterate_ext does.
+ * The number of threads is set by \ref p4est_set_num_threads.
+ * With one thread, or without OpenMP, this is p8est_iterate_ext.
+ *
+ * The work is distributed by trees: each tree's volume traversal and the
+ * traversal of the inter-tree faces, edges and corners it owns (as
+ * determined for p8est_iterate_ext) is done by one thread at a time.
+ * Within a tree, the order of callbacks is the same as in
+ * p8est_iterate_ext.  If only a volume callback is given, the quadrants
+ * of each tree are split among the threads instead.  The callbacks must
+ * be thread-safe.
+ *
+ * \param [in] colored   If true, trees are visited concurrently only if
+ *                       they do not share a face, edge or corner with a
+ *                       common tree.  Then no two concurrent callbacks
+ *                       touch the same quadrant, and for example a face
+ *                       callback may write to the data of both sides
+ *                       without atomics.  Trees are processed in groups
+ *                       one after another.
+ * \param [in] deterministic    If true, the assignment of trees to threads
+ *                       depends only on the number of threads and the
+ *                       forest, such that each thread executes the same
+ *                       callbacks in the same order on every run.
+ */
+void                p8est_iterate_threads (p8est_t * p8est,
+                                           p8est_ghost_t * ghost_layer,
+                                           void *user_data,
+                                           p8est_iter_volume_t iter_volume,
+                                           p8est_iter_face_t iter_face,
+                                           p8est_iter_edge_t iter_edge,
+                                           p8est_iter_corner_t iter_corner,
+                                           int remote, int colored,
+                                           int deterministic);
+
+/** Iterate as p8est_iterate_ext does, restricted to a range of levels.
+ *
+ * The volume callback is executed for the local quadrants whose level
+ * lies in [\a minlevel, \a maxlevel], and the face, edge and corner callbacks
+ * are executed where at least one of the local sides is such a quadrant.
+ * The search skips the trees without quadrants of these levels, using
+ * their quadrants_per_level counts, and does not descend below
+ * \a maxlevel.  This serves the separate stages of local time stepping.
+ *
+ * \param [in] minlevel  the coarsest level visited
+ * \param [in] maxlevel  the finest level visited; if it is less than
+ *                       \a minlevel, nothing is visited
+ */
+void                p8est_iterate_levels (p8est_t * p8est,
+                                          p8est_ghost_t * ghost_layer,
+                                          void *user_data,
+                                          int minlevel, int maxlevel,
+                                          p8est_iter_volume_t iter_volume,
+                                          p8est_iter_face_t iter_face,
+                                          p8est_iter_edge_t iter_edge,
+                                          p8est_iter_corner_t iter_corner,
+                                          int remote);
+
+/** Compute a CRC32C checksum of a forest without copying its quadrants.
+ * The coordinates and level of each quadrant are hashed in place by
+ * \ref p4est_crc32c, using the threads set by \ref p4est_set_num_threads
+ * for large trees, and the local checksums are combined by
+ * \ref p8est_comm_checksum_crc32c.  The value differs from the one of
+ * \ref p8est_checksum and does not require zlib.
+ * \param [in] p8est    Valid forest structure.
+ * \param [in] partition_dependent  If true, the local quadrant counts
+ *                      enter the checksum as with
+ *                      \ref p8est_checksum_partition.
+ * \return              The checksum on all processors.
+ */
+unsigned            p8est_checksum_crc32c (p8est_t * p8est,
+                                           int partition_dependent);
+
 /** Save the complete connectivity/p8est data to disk.  This is a collective
  * operation that all MPI processes need to call.  All processes write
  * into the same file, so the filename given needs to be identical over
@@ -562,6 +1435,18 @@ void                p8est_iterate_ext (p8est_t * p8est,
 void                p8est_save_ext (const char *filename, p8est_t * p8est,
                                     int save_data, int save_partition);
 
+/** Save a forest as p8est_save_ext does, passing hints to MPI I/O.
+ * With MPI I/O enabled, every process writes its quadrants by a single
+ * collective call, which lets the MPI library aggregate the requests.
+ * Hints such as "cb_nodes", "cb_buffer_size" or "striping_unit" control
+ * how many processes access the file system and how writes are aligned.
+ * \param [in] info       Hints passed to MPI_File_open; may be
+ *                         sc_MPI_INFO_NULL.  Ignored without MPI I/O.
+ */
+void                p8est_save_info (const char *filename, p8est_t * p8est,
+                                     int save_data, int save_partition,
+                                     sc_MPI_Info info);
+
 /** Load the complete connectivity/p4est structure from disk.
  * It is possible to load the file with a different number of processors
  * than has been used to write it.  The partition will then be uniform.
@@ -589,6 +1474,20 @@ p8est_t            *p8est_load_ext (const char *filename, sc_MPI_Comm mpicomm,
                                     void *user_pointer,
                                     p8est_connectivity_t ** connectivity);
 
+/** Load a forest as p8est_load_ext does, passing hints to MPI I/O.
+ * With MPI I/O enabled, every process reads its quadrants by a single
+ * collective call.  If the quadrant data is skipped, a file view selects
+ * the coordinates only.
+ * \param [in] info       Hints passed to MPI_File_open and the file view;
+ *                         may be sc_MPI_INFO_NULL.  Ignored without MPI I/O.
+ */
+p8est_t            *p8est_load_info (const char *filename,
+                                     sc_MPI_Comm mpicomm, size_t data_size,
+                                     int load_data, int autopartition,
+                                     int broadcasthead, sc_MPI_Info info,
+                                     void *user_pointer,
+                                     p8est_connectivity_t ** connectivity);
+
 /** The same as p8est_load_ext, but reading the connectivity/p8est from an
  * open sc_io_source_t stream.
  */
@@ -600,6 +1499,36 @@ p8est_t            *p8est_source_ext (sc_io_source_t * src,
 
 #ifdef P4EST_ENABLE_FILE_DEPRECATED
 
+/** Create a file for parallel writing without a p8est at hand.
+ * The file holds gfq[mpisize] elements per data field and this rank writes
+ * the elements gfq[rank] to gfq[rank + 1] - 1 (cf. \ref
+ * p8est_file_open_create, which uses the partition of a forest).
+ * This allows to store fields of other element counts, such as the layers
+ * of a p6est, in the same file format.
+ * The parameters that are not documented are the same as in \ref
+ * p8est_file_open_create.
+ *
+ * \param [in]  mpicomm   The MPI communicator that is used to write the file.
+ * \param [in]  gfq       An array of size mpisize + 1 with gfq[0] == 0 that
+ *                        partitions the elements of the file.  It is copied.
+ */
+p8est_file_context_t *p8est_file_open_create_partition (sc_MPI_Comm mpicomm,
+                                                        const p4est_gloidx_t *
+                                                        gfq,
+                                                        const char *filename,
+                                                        const char
+                                                        *user_string,
+                                                        int *errcode);
+
+/** Return the MPI communicator of an open file context. */
+sc_MPI_Comm         p8est_file_get_mpicomm (p8est_file_context_t * fc);
+
+/** Return the global number of elements per data field of an open file
+ * context as written to or read from the file header.
+ */
+p4est_gloidx_t      p8est_file_get_global_num_quadrants (p8est_file_context_t
+                                                         * fc);
+
 /** Open a file for reading without knowing the p4est that is associated
  * with the mesh-related data in the file (cf. \ref p8est_file_open_read).
  * For more general comments on open_read see the documentation of
@@ -631,6 +1560,42 @@ p8est_file_context_t *p8est_file_read_field_ext (p8est_file_context_t * fc,
                                                  char *user_string,
                                                  int *errcode);
 
+/** Read a compressed data field and specify the partition for reading.
+ * See also the documentation of \ref p8est_file_read_field_compressed.
+ *
+ * \param [in]  gfq   As in \ref p8est_file_read_field_ext.  The partition
+ *                    may differ from the one used for writing.
+ */
+p8est_file_context_t *p8est_file_read_field_compressed_ext (p8est_file_context_t *
+                                                            fc,
+                                                            p4est_gloidx_t *
+                                                            gfq,
+                                                            size_t
+                                                            quadrant_size,
+                                                            sc_array_t *
+                                                            quadrant_data,
+                                                            char *user_string,
+                                                            int *errcode);
+
+
+/** Read a forest into a given partition.
+ * See also the documentation of \ref p8est_file_read_p8est.
+ *
+ * \param [in]  gfq   An array of the size mpisize + 1 as in \ref
+ *                    p8est_file_read_field_ext, for example computed by
+ *                    \ref p8est_file_read_weights.  The quadrants and their
+ *                    data are read directly in this partition, which is
+ *                    also the partition of the created forest.  NULL
+ *                    reads in a uniform partition.
+ */
+p8est_file_context_t *p8est_file_read_p8est_ext (p8est_file_context_t * fc,
+                                                   p8est_connectivity_t * conn,
+                                                   size_t data_size,
+                                                   const p4est_gloidx_t * gfq,
+                                                   p8est_t ** p8est,
+                                                   char *quad_string,
+                                                   char *quad_data_string,
+                                                   int *errcode);
 #endif /* P4EST_ENABLE_FILE_DEPRECATED */
 
 /** Create the data necessary to create a PETsc DMPLEX representation of a
@@ -643,8 +1608,12 @@ p8est_file_context_t *p8est_file_read_field_ext (p8est_file_context_t * fc,
  * (2 * sizeof (p4est_locidx_t)).
  *
  * \param[in]     p8est                 the forest
- * \param[out]    ghost                 the ghost layer
- * \param[out]    lnodes                the lnodes
+ * \param[in,out] ghost                 the ghost layer; if *ghost is NULL,
+ *                                      it is created and expanded to the
+ *                                      overlap, otherwise it is used as is
+ * \param[in,out] lnodes                the lnodes; if *lnodes is NULL, it
+ *                                      is created, otherwise it must have
+ *                                      degree -P8EST_DIM and is reused
  * \param[in]     ctype                 the type of adjacency for the overlap
  * \param[in]     overlap               the number of layers of overlap (zero
  *                                      is acceptable)
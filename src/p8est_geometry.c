@@ -74,6 +74,8 @@ typedef struct p8est_geometry_builtin
 {
   /** The geom member needs to come first; we cast to p8est_geometry_t * */
   p8est_geometry_t    geom;
+  /** The cache member comes second as in p4est_geometry_cached_t */
+  p8est_geometry_cache_t *cache;
   union
   {
     p8est_geometry_builtin_type_t type;
@@ -85,6 +87,61 @@ typedef struct p8est_geometry_builtin
 }
 p8est_geometry_builtin_t;
 
+/**
+ * Select the rotation of a shell patch.  The Cartesian coordinates are
+ * xyz[i] = q * (cq[i] + cx[i] * x + cy[i] * y).
+ *
+ * \param[in]  patch      0 through 5 for right, bottom, left, top, back
+ *                        and front
+ * \param[out] cq         coefficients of q
+ * \param[out] cx         coefficients of q * x
+ * \param[out] cy         coefficients of q * y
+ */
+static void
+p8est_geometry_shell_patch (int patch, double cq[3], double cx[3],
+                            double cy[3])
+{
+  memset (cq, 0, 3 * sizeof (double));
+  memset (cx, 0, 3 * sizeof (double));
+  memset (cy, 0, 3 * sizeof (double));
+
+  /* assign correct coordinates based on patch id */
+  switch (patch) {
+  case 3:                      /* top */
+    cy[0] = +1.;
+    cx[1] = -1.;
+    cq[2] = +1.;
+    break;
+  case 2:                      /* left */
+    cq[0] = -1.;
+    cx[1] = -1.;
+    cy[2] = +1.;
+    break;
+  case 1:                      /* bottom */
+    cy[0] = -1.;
+    cx[1] = -1.;
+    cq[2] = -1.;
+    break;
+  case 0:                      /* right */
+    cq[0] = +1.;
+    cx[1] = -1.;
+    cy[2] = -1.;
+    break;
+  case 4:                      /* back */
+    cx[0] = -1.;
+    cq[1] = +1.;
+    cy[2] = +1.;
+    break;
+  case 5:                      /* front */
+    cx[0] = +1.;
+    cq[1] = -1.;
+    cy[2] = +1.;
+    break;
+  default:
+    SC_ABORT_NOT_REACHED ();
+  }
+}
+
 static void
 p8est_geometry_shell_X (p8est_geometry_t * geom,
                         p4est_topidx_t which_tree,
@@ -93,10 +150,11 @@ p8est_geometry_shell_X (p8est_geometry_t * geom,
   const struct p8est_geometry_builtin_shell *shell
     = &((p8est_geometry_builtin_t *) geom)->p.shell;
   double              x, y, R, q;
-  double              abc[3];
+  double              abc[3], cq[3], cx[3], cy[3];
+  int                 i;
 
   /* transform from the reference cube into vertex space */
-  p8est_geometry_connectivity_X (geom, which_tree, rst, abc);
+  p4est_geometry_cached_X (geom, which_tree, rst, abc);
 
   /* assert that input points are in the expected range */
   P4EST_ASSERT (shell->type == P8EST_GEOMETRY_BUILTIN_SHELL);
@@ -114,40 +172,52 @@ p8est_geometry_shell_X (p8est_geometry_t * geom,
   q = R / sqrt (x * x + y * y + 1.);
 
   /* assign correct coordinates based on patch id */
-  switch (which_tree / 4) {
-  case 3:                      /* top */
-    xyz[0] = +q * y;
-    xyz[1] = -q * x;
-    xyz[2] = +q;
-    break;
-  case 2:                      /* left */
-    xyz[0] = -q;
-    xyz[1] = -q * x;
-    xyz[2] = +q * y;
-    break;
-  case 1:                      /* bottom */
-    xyz[0] = -q * y;
-    xyz[1] = -q * x;
-    xyz[2] = -q;
-    break;
-  case 0:                      /* right */
-    xyz[0] = +q;
-    xyz[1] = -q * x;
-    xyz[2] = -q * y;
-    break;
-  case 4:                      /* back */
-    xyz[0] = -q * x;
-    xyz[1] = +q;
-    xyz[2] = +q * y;
-    break;
-  case 5:                      /* front */
-    xyz[0] = +q * x;
-    xyz[1] = -q;
-    xyz[2] = +q * y;
-    break;
-  default:
-    SC_ABORT_NOT_REACHED ();
+  p8est_geometry_shell_patch (which_tree / 4, cq, cx, cy);
+  for (i = 0; i < 3; ++i) {
+    xyz[i] = q * (cq[i] + cx[i] * x + cy[i] * y);
+  }
+}
+
+/**
+ * Jacobian of the shell geometry.
+ *
+ * \param[in]  geom       associated geometry
+ * \param[in]  which_tree tree id inside forest
+ * \param[in]  rst        tree-local reference coordinates : [0,1]^3
+ * \param[out] J          derivatives of xyz by rst
+ */
+static void
+p8est_geometry_shell_J (p8est_geometry_t * geom,
+                        p4est_topidx_t which_tree,
+                        const double rst[3], double J[3][3])
+{
+  const struct p8est_geometry_builtin_shell *shell
+    = &((p8est_geometry_builtin_t *) geom)->p.shell;
+  double              x, y, s, R, q, w;
+  double              abc[3], cq[3], cx[3], cy[3], M[3][3];
+  int                 i;
+
+  P4EST_ASSERT (shell->type == P8EST_GEOMETRY_BUILTIN_SHELL);
+  P4EST_ASSERT (0 <= which_tree && which_tree < 24);
+
+  p4est_geometry_cached_X (geom, which_tree, rst, abc);
+  p4est_geometry_cached_J (geom, which_tree, rst, J);
+
+  x = tan (abc[0] * M_PI_4);
+  y = tan (abc[1] * M_PI_4);
+  s = x * x + y * y + 1.;
+  R = shell->R1sqrbyR2 * pow (shell->R2byR1, abc[2]);
+  q = R / sqrt (s);
+
+  /* derivatives of the physical by the vertex coordinates */
+  p8est_geometry_shell_patch (which_tree / 4, cq, cx, cy);
+  for (i = 0; i < 3; ++i) {
+    w = cq[i] + cx[i] * x + cy[i] * y;
+    M[i][0] = (-q * x / s * w + q * cx[i]) * M_PI_4 * (1. + x * x);
+    M[i][1] = (-q * y / s * w + q * cy[i]) * M_PI_4 * (1. + y * y);
+    M[i][2] = q * shell->Rlog * w;
   }
+  p4est_geometry_chain_J (M, J);
 }
 
 p8est_geometry_t   *
@@ -157,6 +227,7 @@ p8est_geometry_new_shell (p8est_connectivity_t * conn, double R2, double R1)
   struct p8est_geometry_builtin_shell *shell;
 
   builtin = P4EST_ALLOC_ZERO (p8est_geometry_builtin_t, 1);
+  builtin->cache = p8est_geometry_cache_new (conn);
 
   shell = &builtin->p.shell;
   shell->type = P8EST_GEOMETRY_BUILTIN_SHELL;
@@ -169,6 +240,8 @@ p8est_geometry_new_shell (p8est_connectivity_t * conn, double R2, double R1)
   builtin->geom.name = "p8est_shell";
   builtin->geom.user = conn;
   builtin->geom.X = p8est_geometry_shell_X;
+  builtin->geom.J = p8est_geometry_shell_J;
+  builtin->geom.destroy = p4est_geometry_cached_destroy;
 
   return (p8est_geometry_t *) builtin;
 }
@@ -184,7 +257,7 @@ p8est_geometry_sphere_X (p8est_geometry_t * geom,
   double              abc[3];
 
   /* transform from the reference cube into vertex space */
-  p8est_geometry_connectivity_X (geom, which_tree, rst, abc);
+  p4est_geometry_cached_X (geom, which_tree, rst, abc);
 
   /* assert that input points are in the expected range */
   P4EST_ASSERT (sphere->type == P8EST_GEOMETRY_BUILTIN_SPHERE);
@@ -285,6 +358,7 @@ p8est_geometry_new_sphere (p8est_connectivity_t * conn,
   struct p8est_geometry_builtin_sphere *sphere;
 
   builtin = P4EST_ALLOC_ZERO (p8est_geometry_builtin_t, 1);
+  builtin->cache = p8est_geometry_cache_new (conn);
 
   sphere = &builtin->p.sphere;
   sphere->type = P8EST_GEOMETRY_BUILTIN_SPHERE;
@@ -309,6 +383,7 @@ p8est_geometry_new_sphere (p8est_connectivity_t * conn,
   builtin->geom.name = "p8est_sphere";
   builtin->geom.user = conn;
   builtin->geom.X = p8est_geometry_sphere_X;
+  builtin->geom.destroy = p4est_geometry_cached_destroy;
 
   return (p8est_geometry_t *) builtin;
 }
@@ -341,7 +416,7 @@ p8est_geometry_torus_X (p8est_geometry_t * geom,
 
   /* transform from the reference cube [0,1]^3 into logical vertex space
      using bi/trilinear transformation */
-  p8est_geometry_connectivity_X (geom, which_tree, rst, abc);
+  p4est_geometry_cached_X (geom, which_tree, rst, abc);
 
   /*
    * assert that input points are in the expected range
@@ -432,6 +507,7 @@ p8est_geometry_new_torus (p8est_connectivity_t * conn,
   struct p8est_geometry_builtin_torus *torus;
 
   builtin = P4EST_ALLOC_ZERO (p8est_geometry_builtin_t, 1);
+  builtin->cache = p8est_geometry_cache_new (conn);
 
   torus = &builtin->p.torus;
   torus->type = P8EST_GEOMETRY_BUILTIN_TORUS;
@@ -452,6 +528,7 @@ p8est_geometry_new_torus (p8est_connectivity_t * conn,
   builtin->geom.name = "p8est_torus";
   builtin->geom.user = conn;
   builtin->geom.X = p8est_geometry_torus_X;
+  builtin->geom.destroy = p4est_geometry_cached_destroy;
 
   return (p8est_geometry_t *) builtin;
 
@@ -53,6 +53,34 @@ typedef void        (*p8est_geometry_X_t) (p8est_geometry_t * geom,
                                            const double abc[3],
                                            double xyz[3]);
 
+/** Forward transformation of many points of one tree to physical space.
+ * The result must agree with calling \ref p8est_geometry_X_t for each point.
+ * Implementations should hoist all per-tree work out of the point loop.
+ *
+ * \param[in]  geom       associated geometry
+ * \param[in]  which_tree tree id inside forest
+ * \param[in]  n          number of points
+ * \param[in]  abc        tree-local coordinates, 3 values per point.
+ * \param[out] xyz        physical coordinates, 3 values per point.
+ *                        May be the same array as \a abc.
+ */
+typedef void        (*p8est_geometry_X_batch_t) (p8est_geometry_t * geom,
+                                                 p4est_topidx_t which_tree,
+                                                 size_t n, const double *abc,
+                                                 double *xyz);
+
+/** Jacobian of the forward transformation to physical space.
+ *
+ * \param[in]  geom       associated geometry
+ * \param[in]  which_tree tree id inside forest
+ * \param[in]  abc        tree-local coordinates: \f$[0,1]^3\f$.
+ * \param[out] J          J[i][j] is the derivative of xyz[i] by abc[j].
+ */
+typedef void        (*p8est_geometry_J_t) (p8est_geometry_t * geom,
+                                           p4est_topidx_t which_tree,
+                                           const double abc[3],
+                                           double J[3][3]);
+
 /** Destructor prototype for a user-allocated \a p8est_geometry_t.
  * It is invoked by p8est_geometry_destroy.  If the user chooses to
  * reserve the structure statically, there is no need to provide it.
@@ -61,6 +89,8 @@ typedef void        (*p8est_geometry_destroy_t) (p8est_geometry_t * geom);
 
 /** This structure can be created by the user,
  * p4est will never change its contents.
+ * Structures allocated without zeroing must set \a X_batch and \a J
+ * explicitly.
  */
 struct p8est_geometry
 {
@@ -70,6 +100,12 @@ struct p8est_geometry
   p8est_geometry_destroy_t destroy;     /**< Destructor called by
                                              p8est_geometry_destroy.  If
                                              NULL, P4EST_FREE is called. */
+  p8est_geometry_X_batch_t X_batch;     /**< Optional transformation of
+                                             many points at once.  If NULL,
+                                             \a X is called per point. */
+  p8est_geometry_J_t  J;        /**< Optional analytic Jacobian.  If
+                                     NULL, p8est_geometry_J uses
+                                     finite differences of \a X. */
 };
 
 /** Can be used to conveniently destroy a geometry structure.
@@ -78,6 +114,34 @@ struct p8est_geometry
  */
 void                p8est_geometry_destroy (p8est_geometry_t * geom);
 
+/** Transform many points of one tree to physical space.
+ * Calls the \a X_batch member of the geometry if it is not NULL and
+ * otherwise \a X once for each point.
+ * \param[in]  geom       The geometry to apply.
+ * \param[in]  which_tree Tree id inside forest.
+ * \param[in]  n          Number of points.
+ * \param[in]  abc        Tree-local coordinates, 3 values per point.
+ * \param[out] xyz        Physical coordinates, 3 values per point.
+ *                        May be the same array as \a abc.
+ */
+void                p8est_geometry_X_batch (p8est_geometry_t * geom,
+                                            p4est_topidx_t which_tree,
+                                            size_t n, const double *abc,
+                                            double *xyz);
+
+/** Compute the Jacobian of the transformation at one point.
+ * Calls the \a J member of the geometry if it is not NULL and otherwise
+ * approximates the Jacobian by one-sided differences of \a X that stay
+ * inside the tree.
+ * \param[in]  geom       The geometry to apply.
+ * \param[in]  which_tree Tree id inside forest.
+ * \param[in]  abc        Tree-local coordinates.
+ * \param[out] J          J[i][j] is the derivative of xyz[i] by abc[j].
+ */
+void                p8est_geometry_J (p8est_geometry_t * geom,
+                                      p4est_topidx_t which_tree,
+                                      const double abc[3], double J[3][3]);
+
 /** Create a geometry structure based on the vertices in a connectivity.
  * The transformation is constructed using trilinear interpolation.
  * \param [in] conn A p8est_connectivity_t with valid vertices.  We do NOT
@@ -107,6 +171,77 @@ void p8est_geometry_connectivity_X (p8est_geometry_t * geom,
                                       p4est_topidx_t which_tree,
                                       const double abc[3], double xyz[3]);
 
+/** Batch version of \ref p8est_geometry_connectivity_X.
+ * The tree vertices are looked up once for all points.
+ * \param[in]  geom       associated geometry
+ * \param[in]  which_tree tree id inside forest
+ * \param[in]  n          number of points
+ * \param[in]  abc        tree-local reference coordinates, 3 per point.
+ * \param[out] xyz        Cartesian coordinates, 3 per point.
+ *                        May be the same array as \a abc.
+ */
+void                p8est_geometry_connectivity_X_batch (p8est_geometry_t *
+                                                       geom,
+                                                       p4est_topidx_t
+                                                       which_tree, size_t n,
+                                                       const double *abc,
+                                                       double *xyz);
+
+/** Per-tree coefficients of the trilinear vertex transformation.
+ * Writing the transformation of each tree as a polynomial in the tree-local
+ * coordinates, evaluating it needs neither the tree-to-vertex lookup nor the
+ * vertex array.  The coefficients of one tree are stored by coordinate
+ * direction: first the eight coefficients of x, then those of y and z.
+ * Coefficient k multiplies the product of the abc[j] whose bit j is set in k.
+ */
+typedef struct p8est_geometry_cache
+{
+  p8est_connectivity_t *conn;   /**< The connectivity, not owned. */
+  p4est_topidx_t      num_trees;        /**< Number of trees in \a conn. */
+  double             *coeff;    /**< 3 * P4EST_CHILDREN values per tree. */
+}
+p8est_geometry_cache_t;
+
+/** Compute the per-tree coefficients of a connectivity.
+ * \param [in] conn A connectivity with vertex coordinate information.
+ *                  We do \a not take ownership and expect it to stay alive.
+ * \return          The cache; free with \ref p8est_geometry_cache_destroy.
+ */
+p8est_geometry_cache_t *p8est_geometry_cache_new (p8est_connectivity_t *
+                                                  conn);
+
+/** Free the memory of a geometry cache.
+ * \param [in] cache    The cache is invalid after this call.
+ */
+void                p8est_geometry_cache_destroy (p8est_geometry_cache_t *
+                                                  cache);
+
+/** Transform many points of one tree using the cached coefficients.
+ * The result agrees with \ref p8est_geometry_connectivity_X_batch.
+ * \param[in]  cache      A cache for the connectivity of the tree.
+ * \param[in]  which_tree Tree id inside forest.
+ * \param[in]  n          Number of points.
+ * \param[in]  abc        Tree-local coordinates, 3 values per point.
+ * \param[out] xyz        Vertex space coordinates, 3 values per point.
+ *                        May be the same array as \a abc.
+ */
+void                p8est_geometry_cache_X_batch (p8est_geometry_cache_t *
+                                                  cache,
+                                                  p4est_topidx_t which_tree,
+                                                  size_t n, const double *abc,
+                                                  double *xyz);
+
+/** Compute the Jacobian of the vertex transformation of one tree.
+ * \param[in]  cache      A cache for the connectivity of the tree.
+ * \param[in]  which_tree Tree id inside forest.
+ * \param[in]  abc        Tree-local coordinates.
+ * \param[out] J          J[i][j] is the derivative of xyz[i] by abc[j].
+ */
+void                p8est_geometry_cache_J (p8est_geometry_cache_t * cache,
+                                            p4est_topidx_t which_tree,
+                                            const double abc[3],
+                                            double J[3][3]);
+
 /** Create a geometry structure for the spherical shell of 24 trees.
  * \param [in] conn Result of p8est_connectivity_new_shell or equivalent.
  *                  We do NOT take ownership and expect it to stay alive.
@@ -226,7 +226,7 @@ static int
 p8est_quadrant_on_edge_boundary (p4est_t * p4est, p4est_topidx_t treeid,
                                  int edge, const p4est_quadrant_t * q)
 {
-  int                 face;
+  int                 face, nface;
   int                 on_boundary;
   p4est_quadrant_t    q2;
   p4est_connectivity_t *conn = p4est->connectivity;
@@ -274,8 +274,8 @@ p8est_quadrant_on_edge_boundary (p4est_t * p4est, p4est_topidx_t treeid,
   }
 
   return
-    (conn->tree_to_tree[P4EST_FACES * treeid + face] == treeid &&
-     (int) conn->tree_to_face[P4EST_FACES * treeid + face] == face);
+    (p8est_connectivity_face_neighbor_tree (conn, treeid, face, &nface)
+     == treeid && nface == face);
 }
 
 #include "p4est_ghost.c"
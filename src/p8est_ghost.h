@@ -36,6 +36,12 @@
 
 SC_EXTERN_C_BEGIN;
 
+/** Opaque lookup table for ghost quadrants, see p8est_ghost_set_index. */
+typedef struct p8est_ghost_index p8est_ghost_index_t;
+
+/** Opaque compact storage of a ghost layer, see p8est_ghost_set_compact. */
+typedef struct p8est_ghost_compact p8est_ghost_compact_t;
+
 /** quadrants that neighbor the local domain */
 typedef struct
 {
@@ -74,6 +80,17 @@ typedef struct
   p4est_locidx_t     *mirror_proc_front_offsets;        /**< NULL until
                                                            p8est_ghost_expand is
                                                            called */
+  sc_MPI_Comm         neighbor_comm;    /**< Graph communicator of the
+                                           neighbor processes, see
+                                           p8est_ghost_set_neighborhood.
+                                           Otherwise sc_MPI_COMM_NULL */
+
+  /** The tree fingerprints and the partition of the last call to
+   * p8est_ghost_update, or NULL if it has not been called. */
+  uint64_t           *tree_fingerprints;
+  p8est_quadrant_t   *update_positions;
+  p8est_ghost_index_t *index;      /**< Lookup table or NULL */
+  p8est_ghost_compact_t *compact;   /**< Compact storage or NULL */
 }
 p8est_ghost_t;
 
@@ -93,6 +110,7 @@ int                 p8est_ghost_is_valid (p8est_t * p8est,
                                           p8est_ghost_t * ghost);
 
 /** Calculate the memory usage of the ghost layer.
+ * This includes the mirrors, the lookup table and the compact storage.
  * \param [in] ghost    Ghost layer structure.
  * \return              Memory used in bytes.
  */
@@ -130,6 +148,82 @@ int                 p8est_quadrant_find_owner (p8est_t * p8est,
 p8est_ghost_t      *p8est_ghost_new (p8est_t * p8est,
                                      p8est_connect_type_t btype);
 
+/** Builds the ghost layer for a selected part of the local quadrants.
+ *
+ * Only the selected local quadrants become mirrors, so the ghost layer of
+ * each process contains only the selected quadrants of its neighbors.
+ * The layout of the result is that of \ref p8est_ghost_new, and the data
+ * exchange functions apply unchanged.  The ghosts of a process depend on
+ * the selection of the others, not on its own.
+ * A selective layer is not maintained by \ref p8est_ghost_update or
+ * \ref p8est_ghost_expand, which assume a complete layer.
+ *
+ * \param [in] p8est            The forest for which the ghost layer will be
+ *                              generated.
+ * \param [in] btype            Which ghosts to include (across face, corner
+ *                              or full).
+ * \param [in] selected         Array of local_num_quadrants flags, nonzero
+ *                              for the quadrants to offer as ghosts.
+ *                              If NULL, the result equals p8est_ghost_new.
+ * \return                      A fully initialized ghost layer.
+ */
+p8est_ghost_t      *p8est_ghost_new_selective (p8est_t * p8est,
+                                               p8est_connect_type_t btype,
+                                               const int8_t * selected);
+
+/** Transient storage for a ghost layer under construction. */
+typedef struct p8est_ghost_build
+{
+  p8est_t            *p4est;
+  p8est_ghost_t      *ghost;    /**< Only the mirrors are complete */
+  p8est_ghost_t      *old;      /**< Used by p8est_ghost_update */
+  p4est_locidx_t      skipped;  /**< Quadrants without owner search */
+  int                 num_peers;
+  p4est_locidx_t     *recv_counts, *send_counts;
+  sc_MPI_Request     *recv_request, *send_request;
+  sc_array_t          send_bufs;
+  double              inspect_time;     /**< Time spent in the begin call */
+}
+p8est_ghost_build_t;
+
+/** Begin to build the ghost layer by identifying the mirrors.
+ * The arguments are identical to p8est_ghost_new.  This function posts the
+ * messages that carry the mirrors to the other processes and returns.
+ * In the meantime, the application may work on the quadrants whose
+ * neighborhood is local, see p8est_comm_neighborhood_owned.
+ * The forest must not be modified before p8est_ghost_new_end is called.
+ * This function is collective.
+ * \return                      Transient storage for the messages in
+ *                              progress, to be passed to p8est_ghost_new_end.
+ */
+p8est_ghost_build_t *p8est_ghost_new_begin (p8est_t * p8est,
+                                            p8est_connect_type_t btype);
+
+/** Complete building a ghost layer begun with p8est_ghost_new_begin.
+ * This function receives the ghosts and computes the ghost tree and
+ * process offsets.  The result is identical to that of p8est_ghost_new.
+ * \param [in] build    Created by p8est_ghost_new_begin and freed here.
+ * \return              A fully initialized ghost layer.
+ */
+p8est_ghost_t      *p8est_ghost_new_end (p8est_ghost_build_t * build);
+
+/** Build the ghost layers of several forests in one communication epoch.
+ * The forests must share one communicator.  The messages of all forests
+ * are posted before any of them is waited for, so the latencies overlap.
+ * Each forest sends its own messages; they are not merged per pair of
+ * processes.
+ * The result is identical to calling p8est_ghost_new on each forest.
+ * This function is collective.
+ * \param [in] num_forests  Number of forests, may be 0.
+ * \param [in] forests      Array of \a num_forests valid forests.
+ * \param [in] btype        The ghost type, applied to all forests.
+ * \param [out] ghosts      Array of \a num_forests new ghost layers.
+ */
+void                p8est_ghost_new_ensemble (int num_forests,
+                                              p8est_t * forests[],
+                                              p8est_connect_type_t btype,
+                                              p8est_ghost_t * ghosts[]);
+
 /** Generate an empty ghost layer.
  * This ghost layer pretends that there are no parallel neighbor elements.
  * It is useful if general algorithms should be run with local data only.
@@ -144,6 +238,96 @@ p8est_ghost_t      *p8est_ghost_new_local (p8est_t * p8est,
 /** Frees all memory used for the ghost layer. */
 void                p8est_ghost_destroy (p8est_ghost_t * ghost);
 
+/** Select the backend used by the ghost data exchange functions.
+ * When enabled, a distributed graph communicator of the neighbor processes
+ * is created and stored in the ghost layer.  All custom, data and level
+ * exchanges then use a single MPI-3 neighborhood collective.  The
+ * communicator is updated when the ghost layer is expanded or supported and
+ * freed by p8est_ghost_destroy.  Without MPI-3 this function has no effect.
+ * This function is collective.
+ * \param [in] p8est            The forest used to create the ghost layer.
+ * \param [in,out] ghost        The ghost layer to be modified.
+ * \param [in] enable           True to use neighborhood collectives,
+ *                              false to return to point-to-point messages.
+ */
+/** Update a ghost layer after the forest has been changed.
+ * The result is identical to destroying it and calling p8est_ghost_new
+ * with the same connection type.  The first update rebuilds the ghost layer
+ * and records a fingerprint of each local tree.  Later updates reuse the
+ * mirrors of unchanged trees without any owner search, provided that the
+ * partition has not changed and the ghost layer has not been expanded.
+ * Processes whose mirror lists are unchanged send no quadrants; the receiver
+ * keeps its previous ghosts instead.
+ * This function is collective.
+ * \param [in] p8est            The forest after adaptation or partition.
+ * \param [in,out] ghost        A ghost layer built for a previous state of
+ *                              the forest with p8est_ghost_new or this
+ *                              function.  It is updated in place.
+ */
+void                p8est_ghost_update (p8est_t * p8est,
+                                     p8est_ghost_t * ghost);
+
+/** Attach a hash table for constant time lookup of ghost quadrants.
+ * While it is present, p8est_ghost_bsearch and p8est_ghost_contains with a
+ * valid tree number use it instead of a binary search.  So do the functions
+ * that call them, such as p8est_face_quadrant_exists and
+ * p8est_quadrant_exists.  The table is rebuilt when the ghost layer is
+ * expanded, supported or updated, and freed by p8est_ghost_destroy.
+ * This function is not collective.
+ * \param [in,out] ghost        The ghost layer to be modified.
+ * \param [in] enable           True to build the table, false to free it.
+ */
+void                p8est_ghost_set_index (p8est_ghost_t * ghost, int enable);
+
+/** Switch a ghost layer into or out of its compact storage.
+ * In compact storage, the mirrors are kept as local quadrant numbers only,
+ * the ghosts as Morton index, level and owner's local number, and the lists
+ * in mirror_proc_mirrors as variable length differences.  The arrays \a
+ * ghosts and \a mirrors are then empty and mirror_proc_mirrors is NULL.
+ * Use p8est_ghost_compact_ghost, p8est_ghost_compact_mirror and
+ * p8est_ghost_compact_proc_mirrors to read them.  All other functions taking
+ * a ghost layer, except p8est_ghost_memory_used and p8est_ghost_destroy,
+ * require it to be switched back first.
+ * This function is not collective.
+ * \param [in] p8est            The forest the ghost layer was built for.
+ *                              It is needed to restore the mirrors.
+ * \param [in,out] ghost        The ghost layer to be modified.
+ * \param [in] enable           True to compact, false to restore.
+ */
+void                p8est_ghost_set_compact (p8est_t * p8est,
+                                             p8est_ghost_t * ghost, int enable);
+
+/** Read a ghost quadrant, whether or not the ghost layer is compact.
+ * \param [in] ghost    A valid ghost layer.
+ * \param [in] n        Ghost number in [0, number of ghosts).
+ * \param [out] q       The ghost quadrant with its piggy3 data filled.
+ */
+void                p8est_ghost_compact_ghost (p8est_ghost_t * ghost,
+                                               p4est_locidx_t n,
+                                               p8est_quadrant_t * q);
+
+/** Read the local quadrant number of a mirror, compact or not.
+ * \param [in] ghost    A valid ghost layer.
+ * \param [in] n        Mirror number in [0, number of mirrors).
+ * \return              The local number of the mirror, cumulative over trees.
+ */
+p4est_locidx_t      p8est_ghost_compact_mirror (p8est_ghost_t * ghost,
+                                                p4est_locidx_t n);
+
+/** Read the mirrors sent to one process, compact or not.
+ * \param [in] ghost    A valid ghost layer with mirror_proc_offsets.
+ * \param [in] p        A process number.
+ * \param [in,out] mirrors      Array of p4est_locidx_t, resized to hold the
+ *                              ascending indices into the mirrors.
+ */
+void                p8est_ghost_compact_proc_mirrors (p8est_ghost_t * ghost,
+                                                      int p,
+                                                      sc_array_t * mirrors);
+
+void                p8est_ghost_set_neighborhood (p8est_t * p8est,
+                                                  p8est_ghost_t * ghost,
+                                                  int enable);
+
 /** Conduct binary search for exact match on a range of the ghost layer.
  * \param [in] ghost            The ghost layer.
  * \param [in] which_proc       The owner of the searched quadrant.  Can be -1.
@@ -156,6 +340,18 @@ ssize_t             p8est_ghost_bsearch (p8est_ghost_t * ghost,
                                          p4est_topidx_t which_tree,
                                          const p8est_quadrant_t * q);
 
+/** Conduct binary search for ancestor on range of the ghost layer.
+ * \param [in] ghost            The ghost layer.
+ * \param [in] which_proc       The owner of the searched quadrant.  Can be -1.
+ * \param [in] which_tree       The tree of the searched quadrant.  Can be -1.
+ * \param [in] q                Valid quadrant's ancestor is searched.
+ * \return                      Offset in the ghost layer, or -1 if not found.
+ */
+ssize_t             p8est_ghost_contains (p8est_ghost_t * ghost,
+                                          int which_proc,
+                                          p4est_topidx_t which_tree,
+                                          const p8est_quadrant_t * q);
+
 /** Conduct binary search for ancestor on range of the ghost layer.
  * \param [in] ghost            The ghost layer.
  * \param [in] which_proc       The owner of the searched quadrant.  Can be -1.
@@ -275,6 +471,10 @@ typedef struct p8est_ghost_exchange
   int                *qactive, *qbuffer;
   sc_array_t          requests, sbuffers;
   sc_array_t          rrequests, rbuffers;
+  int                *ncounts;  /**< Used by neighborhood collectives */
+  p4est_comm_compress_t *compress;      /**< Used by compressed exchanges */
+  int                 num_fields;       /**< Used by fields exchange */
+  struct p8est_ghost_field *fields;
 }
 p8est_ghost_exchange_t;
 
@@ -336,6 +536,41 @@ p8est_ghost_exchange_t *p8est_ghost_exchange_custom_begin
 void                p8est_ghost_exchange_custom_end
   (p8est_ghost_exchange_t * exc);
 
+/** Transfer mirror data that the caller has already packed by receiver.
+ * The send buffer holds \a data_size bytes for each entry of
+ * \c ghost->mirror_proc_mirrors, in that order.  Thus the data for process
+ * q begins at \c ghost->mirror_proc_offsets[q] * data_size.  The received
+ * data is stored in \a ghost_data in ghost order as for
+ * p8est_ghost_exchange_custom.  This function never reads or writes the
+ * contents of either buffer itself: they are passed to MPI unchanged.
+ * Hence, with an MPI implementation that supports it, both buffers may
+ * reside in device memory and the packing may run on the device.
+ * \param [in] p8est            The forest used for reference.
+ * \param [in] ghost            The ghost layer used for reference.
+ * \param [in] data_size        The data size to transfer per quadrant.
+ * \param [in] send_buffer      Packed data for all mirrors by receiver.
+ * \param [in,out] ghost_data   Pre-allocated contiguous data for all ghosts
+ *                              in sequence, which must hold at least \c
+ *                              data_size for each ghost.
+ */
+void                p8est_ghost_exchange_packed (p8est_t * p8est,
+                                                 p8est_ghost_t * ghost,
+                                                 size_t data_size,
+                                                 void *send_buffer,
+                                                 void *ghost_data);
+
+/** Begin an asynchronous exchange of packed mirror data.
+ * The arguments are identical to p8est_ghost_exchange_packed.
+ * The return type is always non-NULL and must be passed to
+ * p8est_ghost_exchange_custom_end to complete the exchange.
+ * \param [in]      send_buffer Must stay alive into the completion call.
+ * \param [in,out]  ghost_data  Must stay alive into the completion call.
+ * \return          Transient storage for messages in progress.
+ */
+p8est_ghost_exchange_t *p8est_ghost_exchange_packed_begin
+  (p8est_t * p8est, p8est_ghost_t * ghost,
+   size_t data_size, void *send_buffer, void *ghost_data);
+
 /** Transfer data for local quadrants that are ghosts to other processors.
  * The data size is the same for all quadrants and can be chosen arbitrarily.
  * This function restricts the transfer to a range of refinement levels.
@@ -383,6 +618,60 @@ p8est_ghost_exchange_t *p8est_ghost_exchange_custom_levels_begin
 void                p8est_ghost_exchange_custom_levels_end
   (p8est_ghost_exchange_t * exc);
 
+/** Description of one per-quadrant field for \ref p8est_ghost_exchange_fields.
+ * The data of local quadrant i is read from local_data + i * stride, and the
+ * data of ghost g is written to ghost_data + g * stride.
+ */
+typedef struct p8est_ghost_field
+{
+  const void         *local_data;       /**< Data of all local quadrants */
+  void               *ghost_data;       /**< Data of all ghost quadrants */
+  size_t              stride;           /**< Bytes between consecutive
+                                             quadrants; 0 means elem_size */
+  size_t              elem_size;        /**< Bytes to transfer per quadrant */
+  uint32_t            level_mask;       /**< If nonzero, only quadrants whose
+                                             level bit is set are exchanged */
+}
+p8est_ghost_field_t;
+
+/** Transfer several per-quadrant fields in a single message per process.
+ * All fields are packed one after the other into one buffer for each
+ * receiving process and scattered into their ghost arrays on receipt.
+ * A field's level mask restricts it to some levels in the way of
+ * p8est_ghost_exchange_custom_levels: ghost memory for other levels is
+ * not touched and mirror memory for other levels is not read.
+ * \param [in] p8est            The forest used for reference.
+ * \param [in] ghost            The ghost layer used for reference.
+ * \param [in] num_fields       Number of field descriptions.
+ * \param [in] fields           Array of \a num_fields field descriptions.
+ */
+void                p8est_ghost_exchange_fields (p8est_t * p8est,
+                                                 p8est_ghost_t * ghost,
+                                                 int num_fields,
+                                                 const p8est_ghost_field_t *
+                                                 fields);
+
+/** Begin an asynchronous exchange of several fields by posting messages.
+ * The arguments are identical to p8est_ghost_exchange_fields.
+ * The return type is always non-NULL and must be passed to
+ * p8est_ghost_exchange_fields_end to complete the exchange.
+ * The local data is copied before this function returns.
+ * \param [in]      fields      The array is copied, but the ghost data
+ *                              must stay alive into the completion call.
+ * \return          Transient storage for messages in progress.
+ */
+p8est_ghost_exchange_t *p8est_ghost_exchange_fields_begin
+  (p8est_t * p8est, p8est_ghost_t * ghost,
+   int num_fields, const p8est_ghost_field_t * fields);
+
+/** Complete an asynchronous exchange of several fields.
+ * This function waits for all pending MPI communications.
+ * \param [in,out]  Data created ONLY by p8est_ghost_exchange_fields_begin.
+ *                  It is deallocated before this function returns.
+ */
+void                p8est_ghost_exchange_fields_end
+  (p8est_ghost_exchange_t * exc);
+
 /** Expand the size of the ghost layer and mirrors by one additional layer of
  * adjacency.
  * \param [in] p8est            The forest from which the ghost layer was
@@ -392,6 +681,207 @@ void                p8est_ghost_exchange_custom_levels_end
 void                p8est_ghost_expand (p8est_t * p8est,
                                         p8est_ghost_t * ghost);
 
+/** Build a ghost layer of several layers of adjacency.
+ * The result is the same as calling p8est_ghost_new followed by
+ * \a nlayers - 1 calls to p8est_ghost_expand.  The expansions sort only the
+ * quadrants they add and merge them with the sorted previous layers.
+ * \param [in] p8est            The forest for which the ghost layer will be
+ *                              generated.
+ * \param [in] btype            Which ghosts to include (across face, edge,
+ *                              corner or full).
+ * \param [in] nlayers          Positive number of layers.
+ * \return                      A fully initialized ghost layer.
+ */
+p8est_ghost_t      *p8est_ghost_new_layers (p8est_t * p8est,
+                                             p8est_connect_type_t btype,
+                                             int nlayers);
+
+/** Persistent storage for repeated exchanges on an unchanged ghost layer.
+ * The buffers and MPI requests are set up once by \ref p8est_ghost_plan_new.
+ * Each exchange only packs the mirror data and starts the requests.
+ * If p8est is configured with MPI-3 shared communicators, the send buffer
+ * lives in a window shared by the processes of a node, which copy their
+ * ghost data directly out of it and send messages only across nodes.
+ */
+typedef struct p8est_ghost_plan
+{
+  p8est_t            *p4est;
+  p8est_ghost_t      *ghost;
+  long                revision;         /**< Revision of p8est when created */
+  size_t              num_ghosts, num_mirrors;  /**< Sizes when created */
+  size_t              data_size;        /**< Bytes exchanged per quadrant */
+  char               *send_buffer;      /**< Mirror data ordered by receiver */
+  char               *ghost_data;       /**< Data of all ghosts in sequence */
+  int                 minlevel, maxlevel;       /**< Levels exchanged */
+  p4est_locidx_t     *send_offsets;     /**< Per receiver into send_mirrors */
+  p4est_locidx_t     *send_mirrors;     /**< Mirrors packed, by receiver */
+  p4est_locidx_t     *recv_offsets;     /**< Per sender, counting the
+                                             ghosts received */
+  p4est_locidx_t     *recv_ghosts;      /**< Ghosts received, by sender;
+                                             NULL if all are received */
+  char               *recv_buffer;      /**< Received data to be placed
+                                             by recv_ghosts, or NULL */
+  int                 num_requests;     /**< Receives first, then sends */
+  int                 is_active;        /**< True between begin and end */
+  sc_MPI_Request     *requests;         /**< Persistent requests */
+  struct p8est_ghost_shared *shared;     /**< Send buffer shared with the
+                                             processes of this node, NULL
+                                             unless used */
+}
+p8est_ghost_plan_t;
+
+/** Create a persistent plan for exchanging data of a given size.
+ * The plan belongs to this forest and ghost layer and must be destroyed
+ * before either of them.
+ * \param [in] p8est            The forest used for reference.
+ * \param [in] ghost            The ghost layer used for reference.
+ * \param [in] data_size        The data size to transfer per quadrant.
+ * \return                      Plan ready for \ref p8est_ghost_plan_begin.
+ */
+p8est_ghost_plan_t *p8est_ghost_plan_new (p8est_t * p8est,
+                                          p8est_ghost_t * ghost,
+                                          size_t data_size);
+
+/** Create a persistent plan for exchanging data of a range of levels.
+ * This is the persistent counterpart of
+ * \ref p8est_ghost_exchange_custom_levels.  The mirrors and ghosts of the
+ * levels are selected per peer once, so each exchange only packs the
+ * selected mirror data and starts the requests.  Several plans for
+ * different level ranges may exist for the same ghost layer, for example
+ * one per substep of local time stepping.
+ * \param [in] p4est            The forest used for reference.
+ * \param [in] ghost            The ghost layer used for reference.
+ * \param [in] minlevel         Level of the largest quads to be exchanged.
+ *                              Use <= 0 for no restriction.
+ * \param [in] maxlevel         Level of the smallest quads to be exchanged.
+ *                              Use >= P8EST_QMAXLEVEL for no restriction.
+ * \param [in] data_size        The data size to transfer per quadrant.
+ * \return                      Plan ready for \ref p8est_ghost_plan_begin.
+ *                              The ghost data returned by the exchange is
+ *                              only written for ghosts of these levels.
+ */
+p8est_ghost_plan_t *p8est_ghost_plan_new_levels (p8est_t * p8est,
+                                                 p8est_ghost_t * ghost,
+                                                 int minlevel, int maxlevel,
+                                                 size_t data_size);
+
+/** Destroy a plan that is not active. */
+void                p8est_ghost_plan_destroy (p8est_ghost_plan_t * plan);
+
+/** Check whether a plan still matches its forest and ghost layer.
+ * A plan becomes invalid when the revision of the forest changes or
+ * when the ghost layer is expanded.
+ * \return              True if the plan may be used for an exchange.
+ */
+int                 p8est_ghost_plan_is_valid (p8est_ghost_plan_t * plan);
+
+/** Begin a ghost data exchange by starting the persistent requests.
+ * This function does not allocate memory.  It aborts if the plan is not
+ * valid; in that case, destroy it and create a new one.
+ * \param [in,out] plan         A valid plan that is not active.
+ * \param [in] mirror_data      One data pointer per mirror quadrant.
+ *                              If NULL, the quadrant data is sent as with
+ *                              \ref p8est_ghost_exchange_data; the plan's
+ *                              data size must then be the forest's data
+ *                              size, or sizeof (void *) if that is zero.
+ *                              It is copied before this function returns.
+ */
+void                p8est_ghost_plan_begin (p8est_ghost_plan_t * plan,
+                                            void **mirror_data);
+
+/** Complete a ghost data exchange started by \ref p8est_ghost_plan_begin.
+ * \param [in,out] plan         An active plan.
+ * \return                      The plan's ghost data array, holding
+ *                              data_size bytes for each ghost in sequence.
+ *                              It is overwritten by the next exchange.
+ */
+void               *p8est_ghost_plan_end (p8est_ghost_plan_t * plan);
+
+/** Exchange ghost data using a plan.
+ * This is equivalent to \ref p8est_ghost_plan_begin followed by
+ * \ref p8est_ghost_plan_end.
+ */
+void               *p8est_ghost_plan_exchange (p8est_ghost_plan_t * plan,
+                                               void **mirror_data);
+
+/** MPI datatypes for exchanging quadrant data directly between user arrays.
+ * The mirror data is read from one array indexed by local quadrant number,
+ * and the ghost data is written to one array indexed by ghost number, both
+ * with the same stride.  One datatype per peer and direction is built once
+ * by \ref p8est_ghost_types_new, so an exchange copies no data itself.  The
+ * MPI library gathers the mirrors of each message from the user array.
+ */
+typedef struct p8est_ghost_types
+{
+  p8est_t            *p4est;
+  p8est_ghost_t      *ghost;
+  long                revision;         /**< Revision of p8est when created */
+  p4est_locidx_t      num_ghosts;       /**< Ghosts when created */
+  p4est_locidx_t      num_sends;        /**< Mirror messages when created */
+  size_t              elem_size;        /**< Bytes exchanged per quadrant */
+  size_t              stride;           /**< Bytes between quadrants */
+  int                 num_recv_peers;   /**< Processes we receive from */
+  int                 num_send_peers;   /**< Processes we send to */
+  int                *peers;            /**< Senders first, then receivers */
+  sc_MPI_Datatype    *types;            /**< One datatype per peer */
+  sc_MPI_Request     *requests;         /**< One request per peer */
+  int                 is_active;        /**< True between begin and end */
+}
+p8est_ghost_types_t;
+
+/** Create the datatypes for exchanging strided quadrant data.
+ * The ghost layer may be compact.  The datatypes belong to this forest and
+ * ghost layer and must be destroyed before either of them.
+ * \param [in] p8est            The forest used for reference.
+ * \param [in] ghost            The ghost layer used for reference.
+ * \param [in] elem_size        Bytes to transfer per quadrant.
+ * \param [in] stride           Bytes between consecutive quadrants in the
+ *                              local and ghost arrays; 0 means elem_size.
+ * \return                      Datatypes for \ref p8est_ghost_types_begin.
+ */
+p8est_ghost_types_t *p8est_ghost_types_new (p8est_t * p8est,
+                                            p8est_ghost_t * ghost,
+                                            size_t elem_size,
+                                            size_t stride);
+
+/** Destroy datatypes that are not active. */
+void                p8est_ghost_types_destroy (p8est_ghost_types_t * types);
+
+/** Check whether the datatypes still match their forest and ghost layer.
+ * \return              True if they may be used for an exchange.
+ */
+int                 p8est_ghost_types_is_valid (p8est_ghost_types_t * types);
+
+/** Begin an exchange by posting messages from and into the user arrays.
+ * This function does not allocate memory.  It aborts if the datatypes are
+ * not valid; in that case, destroy them and create new ones.
+ * \param [in,out] types        Valid datatypes that are not active.
+ * \param [in] local_data       Data of all local quadrants, the one of
+ *                              local quadrant i at i * stride bytes.
+ *                              It must not be modified before completion.
+ * \param [in,out] ghost_data   Data of all ghosts, the one of ghost g at
+ *                              g * stride bytes.  Only elem_size bytes per
+ *                              ghost are written.  It must not be accessed
+ *                              before completion.
+ */
+void                p8est_ghost_types_begin (p8est_ghost_types_t * types,
+                                             const void *local_data,
+                                             void *ghost_data);
+
+/** Complete an exchange started by \ref p8est_ghost_types_begin.
+ * \param [in,out] types        Active datatypes.
+ */
+void                p8est_ghost_types_end (p8est_ghost_types_t * types);
+
+/** Exchange ghost data using datatypes.
+ * This is equivalent to \ref p8est_ghost_types_begin followed by
+ * \ref p8est_ghost_types_end.
+ */
+void                p8est_ghost_types_exchange (p8est_ghost_types_t *
+                                                types,
+                                                const void *local_data,
+                                                void *ghost_data);
+
 SC_EXTERN_C_END;
 
 #endif /* !P8EST_GHOST_H */
@@ -224,6 +224,18 @@ typedef enum p8est_file_error
 }
 p8est_file_error_t;
 
+/** Storage backends for writing p8est data files.
+ * The native backend writes the format described in this file through
+ * MPI I/O or, without MPI I/O, through serial C file operations.
+ */
+typedef enum p8est_file_backend
+{
+  P8EST_FILE_BACKEND_NATIVE, /**< the native p8est data file format */
+  P8EST_FILE_BACKEND_HDF5 /**< a parallel HDF5 file; requires
+                                 P4EST_WITH_HDF5 */
+}
+p8est_file_backend_t;
+
 /** Begin writing file header and saving data blocks into a parallel file.
  *
  * This function creates a new file or overwrites an existing one.
@@ -271,6 +283,41 @@ p8est_file_context_t *p8est_file_open_create
   (p8est_t * p8est, const char *filename,
    const char *user_string, int *errcode);
 
+/** Begin writing file header and saving data blocks into a file
+ * using a selectable storage backend.
+ * For \ref P8EST_FILE_BACKEND_NATIVE this function is identical to
+ * \ref p8est_file_open_create.
+ *
+ * For \ref P8EST_FILE_BACKEND_HDF5 the file is created collectively
+ * by parallel HDF5.  The user string, the p8est version and the global
+ * number of quadrants become attributes of the root group.  Every
+ * section written by \ref p8est_file_write_field or \ref
+ * p8est_file_write_block and the functions calling them becomes a
+ * dataset named section_%06d in the order of writing.  A field is a
+ * two-dimensional byte dataset indexed by global quadrant number and
+ * byte, to which every rank writes its partition collectively.  A block
+ * is a one-dimensional byte dataset.  Each dataset carries the section
+ * type and user string as attributes.  Such a context supports only
+ * these writing functions and \ref p8est_file_close; the files are
+ * read by HDF5 tools and not by \ref p8est_file_open_read.
+ *
+ * \param [in] p8est          Valid forest.
+ * \param [in] filename       Path to parallel file that is to be created.
+ * \param [in] user_string    A user string as in \ref p8est_file_open_create.
+ * \param [in] backend        The storage backend of the file.  If
+ *                            \ref P8EST_FILE_BACKEND_HDF5 is requested in
+ *                            a build without HDF5 the function reports
+ *                            \ref P8EST_FILE_ERR_IN_DATA.
+ * \param [out] errcode       An errcode that can be interpreted by \ref
+ *                            p8est_file_error_string.
+ * \return                    Newly allocated context to continue writing
+ *                            and eventually closing the file. NULL in
+ *                            case of error.
+ */
+p8est_file_context_t *p8est_file_open_create_ext
+  (p8est_t * p8est, const char *filename,
+   const char *user_string, p8est_file_backend_t backend, int *errcode);
+
 /** Open a file for reading and read its user string on rank zero.
  * The user string is broadcasted to all ranks after reading.
  * The file must exist and be at least of the size of the file header.
@@ -516,13 +563,56 @@ p8est_file_context_t *p8est_file_read_field (p8est_file_context_t * fc,
                                              sc_array_t * quadrant_data,
                                              char *user_string, int *errcode);
 
+/** Write one (more) per-quadrant data set in compressed form.
+ *
+ * Each rank compresses its local chunk independently.  The section stores
+ * an index of the partition of the writer and of the byte offsets of the
+ * compressed chunks, such that it can be read by \ref
+ * p8est_file_read_field_compressed under any partition.  The chunks are
+ * zlib streams if p4est is configured with zlib and verbatim otherwise.
+ * The section is marked by the type 'C' and its size in bytes counts the
+ * index and the compressed chunks.
+ *
+ * The parameters and the error handling are the same as for
+ * \ref p8est_file_write_field.
+ */
+p8est_file_context_t *p8est_file_write_field_compressed (p8est_file_context_t *
+                                                         fc,
+                                                         size_t quadrant_size,
+                                                         sc_array_t *
+                                                         quadrant_data,
+                                                         const char
+                                                         *user_string,
+                                                         int *errcode);
+
+/** Read one (more) per-quadrant data set written by \ref
+ * p8est_file_write_field_compressed.
+ *
+ * Every rank reads and decompresses only those chunks of the writer that
+ * overlap its own window of quadrants.  A section written with zlib can
+ * not be read by a build without zlib and yields \ref P4EST_FILE_ERR_FORMAT.
+ * The parameters and the error handling are the same as for
+ * \ref p8est_file_read_field.  Use \ref p8est_file_read_field_compressed_ext
+ * to specify the partition for reading.
+ */
+p8est_file_context_t *p8est_file_read_field_compressed (p8est_file_context_t *
+                                                        fc,
+                                                        size_t quadrant_size,
+                                                        sc_array_t *
+                                                        quadrant_data,
+                                                        char *user_string,
+                                                        int *errcode);
+
 /** A data type that encodes the metadata of one data block in a p4est data file.
  */
 typedef struct p8est_file_section_metadata
 {
-  char                block_type; /**< 'H' (header) or 'F' (data file) */
+  char                block_type; /**< 'H' (header), 'F' (data file),
+                                       'C' (compressed data file) or
+                                       'R' (delta reference) */
   size_t              data_size;  /**< data size in bytes per array element ('F')
-                                       or of the header section ('H') */
+                                       or of the header section ('H') or of
+                                       the compressed section ('C') */
   char                user_string[P8EST_FILE_USER_STRING_BYTES]; /**< user string of the data section */
 }
 p8est_file_section_metadata_t;
@@ -668,6 +758,86 @@ p8est_file_context_t *p8est_file_read_p8est (p8est_file_context_t * fc,
                                              char *quad_data_string,
                                              int *errcode);
 
+/** Write a p8est to an opened file in a compact encoding.
+ * The sections are as in \ref p8est_file_write_p8est, except that the
+ * quadrant section stores only the level of each quadrant in one byte.
+ * Since the leaves of every tree are complete and sorted, their
+ * coordinates follow from the sequence of levels and the count per tree.
+ * The result is read by \ref p8est_file_read_p8est_compact.
+ *
+ * \param [in,out] fc         As in \ref p8est_file_write_p8est.
+ * \param [in]    p8est       The p8est that is written to the file.
+ * \param [in]    quad_string As in \ref p8est_file_write_p8est.
+ * \param [in]    quad_data_string  As in \ref p8est_file_write_p8est.
+ * \param [out]   errcode     As in \ref p8est_file_write_p8est.
+ * \return                    As in \ref p8est_file_write_p8est.
+ */
+p8est_file_context_t *p8est_file_write_p8est_compact (p8est_file_context_t *
+                                                      fc, p8est_t * p8est,
+                                                      const char
+                                                      *quad_string,
+                                                      const char
+                                                      *quad_data_string,
+                                                      int *errcode);
+
+/** Read a p8est written by \ref p8est_file_write_p8est_compact.
+ * The coordinates of the quadrants are reconstructed from their levels,
+ * which requires one allgather of two integers per process.  Levels that
+ * do not describe complete trees yield \ref P4EST_FILE_ERR_P4EST.
+ *
+ * \param [in,out] fc         As in \ref p8est_file_read_p8est.
+ * \param [in]    conn        As in \ref p8est_file_read_p8est.
+ * \param [in]    data_size   As in \ref p8est_file_read_p8est.
+ * \param [in]    gfq         The partition to read into as in \ref
+ *                            p8est_file_read_p8est_ext, or NULL for a
+ *                            uniform partition.
+ * \param [out]   p8est       The p8est that is created from the file.
+ * \param [in,out] quad_string As in \ref p8est_file_read_p8est.
+ * \param [in,out] quad_data_string  As in \ref p8est_file_read_p8est.
+ * \param [out]   errcode     As in \ref p8est_file_read_p8est.
+ * \return                    As in \ref p8est_file_read_p8est.
+ */
+p8est_file_context_t *p8est_file_read_p8est_compact (p8est_file_context_t *
+                                                     fc,
+                                                     p8est_connectivity_t *
+                                                     conn, size_t data_size,
+                                                     const p4est_gloidx_t *
+                                                     gfq, p8est_t ** p8est,
+                                                     char *quad_string,
+                                                     char *quad_data_string,
+                                                     int *errcode);
+
+/** Read a per-quadrant weight field and compute a weighted partition.
+ * The field must have been written by \ref p8est_file_write_field with
+ * non-negative int entries, one per quadrant.  The weights are read in a
+ * uniform partition and the result matches the partition computed by
+ * \ref p8est_partition_ext for the same weights.  If all weights are zero,
+ * the partition is uniform.  Passing the result to \ref
+ * p8est_file_read_field_ext and \ref p8est_file_read_p8est_ext lets every rank
+ * read exactly its new range of the following sections, such that a
+ * restart on a different number of ranks needs no repartitioning.
+ *
+ * \param [in,out] fc         Context previously created by \ref
+ *                            p8est_file_open_read (_ext).
+ * \param [out]   gfq         An array of mpisize + 1 entries that is filled
+ *                            with the global first quadrants of the
+ *                            weighted partition.
+ * \param [in,out] user_string At least \ref P4EST_FILE_USER_STRING_BYTES
+ *                            bytes that receive the user string of the
+ *                            weight section.
+ * \param [out]   errcode     An errcode that can be interpreted by \ref
+ *                            p8est_file_error_string.  A negative weight yields
+ *                            \ref P4EST_FILE_ERR_IN_DATA.
+ * \return                    Return a pointer to input context or NULL in case
+ *                            of errors that does not abort the program.
+ *                            In case of error the file is tried to close
+ *                            and fc is freed.
+ */
+p8est_file_context_t *p8est_file_read_weights (p8est_file_context_t * fc,
+                                               p4est_gloidx_t * gfq,
+                                               char *user_string,
+                                               int *errcode);
+
 /** Write a connectivity to an opened file.
  * This function writes two block sections to the opened file.
  * The first block contains the size of the serialized connectivity data
@@ -746,6 +916,322 @@ p8est_file_context_t *p8est_file_read_connectivity (p8est_file_context_t * fc,
 int                 p8est_file_close (p8est_file_context_t * fc,
                                       int *errcode);
 
+/** Opaque context for writing data sets of a file in the background. */
+typedef struct p8est_file_async p8est_file_async_t;
+
+/** Begin writing data sets to an opened file in the background.
+ *
+ * The data sets passed to \ref p8est_file_async_write_field and
+ * \ref p8est_file_async_write_p8est are copied into staging buffers, and
+ * the functions return once the writes are started.  With MPI I/O of
+ * version 3.1 or later the data is written by MPI_File_iwrite_at_all
+ * while the program continues.  Otherwise each data set is written
+ * before the call returns.  The file context must not be used directly
+ * until \ref p8est_file_async_wait returns it.
+ *
+ * \param [in] fc            Context previously created by \ref
+ *                           p8est_file_open_create.  Owned by the new
+ *                           context until \ref p8est_file_async_wait.
+ * \param [in] max_staged    Bound on the local bytes held in staging
+ *                           buffers.  Before it would be exceeded, the
+ *                           pending writes are completed.  A single data
+ *                           set larger than the bound is staged alone.
+ * \return                   The context for writing in the background.
+ */
+p8est_file_async_t *p8est_file_async_new (p8est_file_context_t * fc,
+                                          size_t max_staged);
+
+/** Start writing a per-quadrant data set in the background.
+ * This function is collective and takes the same arguments as
+ * \ref p8est_file_write_field.  The data is copied, so the caller may
+ * modify \a quadrant_data right after the call.
+ *
+ * \param [in,out] async     Context created by \ref p8est_file_async_new.
+ * \param [out] errcode      An errcode that can be interpreted by \ref
+ *                           p8est_file_error_string.
+ * \return                   The input context, or NULL in case of error.
+ *                           Then the pending writes are completed, the file
+ *                           is tried to close and both contexts are freed.
+ */
+p8est_file_async_t *p8est_file_async_write_field (p8est_file_async_t *
+                                                  async,
+                                                  size_t quadrant_size,
+                                                  sc_array_t * quadrant_data,
+                                                  const char *user_string,
+                                                  int *errcode);
+
+/** Start writing a forest in the background.
+ * This function is collective and writes the same sections as
+ * \ref p8est_file_write_p8est.  It completes earlier pending writes,
+ * writes the small count per tree section directly and stages the
+ * quadrants and their data, such that the forest may change right
+ * after the call.
+ *
+ * \param [in,out] async     Context created by \ref p8est_file_async_new.
+ * \param [out] errcode      An errcode that can be interpreted by \ref
+ *                           p8est_file_error_string.
+ * \return                   The input context, or NULL in case of error
+ *                           as in \ref p8est_file_async_write_field.
+ */
+p8est_file_async_t *p8est_file_async_write_p8est (p8est_file_async_t *
+                                                  async, p8est_t * p8est,
+                                                  const char *quad_string,
+                                                  const char
+                                                  *quad_data_string,
+                                                  int *errcode);
+
+/** Check whether the writes started so far have completed on this process.
+ * This function is not collective.  It frees the staging buffers of the
+ * completed writes.
+ * \return                   True if no write is pending locally.
+ */
+int                 p8est_file_async_test (p8est_file_async_t * async);
+
+/** Return the number of local bytes currently held in staging buffers. */
+size_t              p8est_file_async_staged (p8est_file_async_t * async);
+
+/** Complete all pending writes and free the context.
+ * This function is collective.
+ *
+ * \param [in,out] async     Context created by \ref p8est_file_async_new.
+ *                           Is freed.
+ * \param [out] errcode      An errcode that can be interpreted by \ref
+ *                           p8est_file_error_string.
+ * \return                   The file context to continue writing or to
+ *                           close, or NULL in case of error.  Then the
+ *                           file is tried to close and fc is freed.
+ */
+p8est_file_context_t *p8est_file_async_wait (p8est_file_async_t * async,
+                                             int *errcode);
+
+/** The opaque context for writing delta checkpoints.
+ *
+ * A delta checkpoint is a regular data file in which sections that did not
+ * change since an earlier checkpoint are replaced by a reference section of
+ * the type 'R'.  It holds the number of the checkpoint and the number of
+ * the section within that file that store the data.  The forest is
+ * considered unchanged if its revision, local quadrant counts and quadrant
+ * user data are the same.  Fields are identified by their user string and
+ * compared by a hash of their content; if the forest changes, all fields
+ * are written again.  Checkpoints are numbered from 0 by the calls to
+ * \ref p8est_file_delta_write_p8est, which must begin every checkpoint.
+ */
+typedef struct p8est_file_delta p8est_file_delta_t;
+
+/** Create a context for writing a chain of delta checkpoints.
+ * \return                   The context, to be freed by \ref
+ *                           p8est_file_delta_destroy.
+ */
+p8est_file_delta_t *p8est_file_delta_new (void);
+
+/** Free a delta checkpoint context.
+ * \param [in] delta         Context created by \ref p8est_file_delta_new.
+ */
+void                p8est_file_delta_destroy (p8est_file_delta_t * delta);
+
+/** Begin a delta checkpoint by writing a forest or a reference to it.
+ * This function is collective.  The forest is written by \ref
+ * p8est_file_write_p8est if it changed since the last checkpoint that
+ * stored it.  Otherwise a single reference section is written.
+ *
+ * \param [in,out] fc        Context previously created by \ref
+ *                           p8est_file_open_create.
+ * \param [in,out] delta     Context created by \ref p8est_file_delta_new.
+ * \param [in] p8est         The forest to write.
+ * \param [in] quad_string   As in \ref p8est_file_write_p8est.
+ *                           A reference uses this user string.
+ * \param [in] quad_data_string  As in \ref p8est_file_write_p8est.
+ * \param [out] errcode      An errcode that can be interpreted by \ref
+ *                           p8est_file_error_string.
+ * \return                   As in \ref p8est_file_write_p8est.
+ */
+p8est_file_context_t *p8est_file_delta_write_p8est (p8est_file_context_t * fc,
+                                                    p8est_file_delta_t * delta,
+                                                    p8est_t * p8est,
+                                                    const char *quad_string,
+                                                    const char
+                                                    *quad_data_string,
+                                                    int *errcode);
+
+/** Write a per-quadrant data set or a reference to an unchanged one.
+ * This function is collective.  The parameters are the same as for \ref
+ * p8est_file_write_field, except that the user string identifies the
+ * field and is required on all ranks.
+ *
+ * \param [in,out] delta     Context used for the preceding call of \ref
+ *                           p8est_file_delta_write_p8est.
+ */
+p8est_file_context_t *p8est_file_delta_write_field (p8est_file_context_t * fc,
+                                                    p8est_file_delta_t * delta,
+                                                    size_t quadrant_size,
+                                                    sc_array_t *
+                                                    quadrant_data,
+                                                    const char *user_string,
+                                                    int *errcode);
+
+/** Read a forest from a delta checkpoint.
+ * If the next section is a reference, the referenced checkpoint is opened
+ * and the forest is read from there.  Otherwise this function behaves as
+ * \ref p8est_file_read_p8est.
+ *
+ * \param [in,out] fc        Context of the checkpoint to reassemble,
+ *                           created by \ref p8est_file_open_read (_ext).
+ * \param [in] chain         The file names of the checkpoints written with
+ *                           the same delta context, indexed by checkpoint
+ *                           number.  Only referenced entries are accessed.
+ * \param [out] errcode      An errcode that can be interpreted by \ref
+ *                           p8est_file_error_string.
+ * The remaining parameters are the same as for \ref p8est_file_read_p8est.
+ */
+p8est_file_context_t *p8est_file_delta_read_p8est (p8est_file_context_t * fc,
+                                                   const char **chain,
+                                                   p8est_connectivity_t *
+                                                   conn, size_t data_size,
+                                                   p8est_t ** p8est,
+                                                   char *quad_string,
+                                                   char *quad_data_string,
+                                                   int *errcode);
+
+/** Read a per-quadrant data set from a delta checkpoint.
+ * If the next section is a reference, the data is read from the
+ * referenced checkpoint in the partition used by \a fc.  Otherwise this
+ * function behaves as \ref p8est_file_read_field.
+ *
+ * \param [in] chain         As in \ref p8est_file_delta_read_p8est.
+ * The remaining parameters are the same as for \ref p8est_file_read_field.
+ */
+p8est_file_context_t *p8est_file_delta_read_field (p8est_file_context_t * fc,
+                                                   const char **chain,
+                                                   size_t quadrant_size,
+                                                   sc_array_t *
+                                                   quadrant_data,
+                                                   char *user_string,
+                                                   int *errcode);
+
+/** The opaque context for serial random access to a data file.
+ *
+ * The file is mapped into memory read-only where the platform supports it
+ * and read completely otherwise.  The section headers are parsed once when
+ * opening, and the data of any section is accessed through pointers into
+ * the mapping without copying.  Only the pages actually accessed are read
+ * from disk.  The functions are serial and do not use MPI.
+ */
+typedef struct p8est_file_map p8est_file_map_t;
+
+/** Open a data file for serial random access.
+ * Sections are parsed until the first one that is incomplete or has an
+ * invalid format, as in \ref p8est_file_info.
+ *
+ * \param [in] filename      Path to the data file.
+ * \param [out] user_string  At least \ref P4EST_FILE_USER_STRING_BYTES
+ *                           bytes that receive the user string of the file.
+ * \param [out] errcode      An errcode that can be interpreted by \ref
+ *                           p8est_file_error_string.
+ * \return                   The context to be closed by \ref
+ *                           p8est_file_map_close or NULL on error.
+ */
+p8est_file_map_t   *p8est_file_map_open (const char *filename,
+                                       char *user_string, int *errcode);
+
+/** Close a file opened by \ref p8est_file_map_open.
+ * All pointers obtained from the context become invalid.
+ * \param [in] map           The context is freed.
+ */
+void                p8est_file_map_close (p8est_file_map_t * map);
+
+/** Return the global number of quadrants stored in the file header. */
+p4est_gloidx_t      p8est_file_map_global_num_quadrants (const
+                                                         p8est_file_map_t *
+                                                         map);
+
+/** Return the number of complete sections found in the file. */
+size_t              p8est_file_map_num_sections (const p8est_file_map_t *
+                                                 map);
+
+/** Return the metadata of a section.
+ * \param [in] section       Index less than \ref p8est_file_map_num_sections.
+ */
+const p8est_file_section_metadata_t *p8est_file_map_section (const
+                                                           p8est_file_map_t
+                                                           * map,
+                                                           size_t section);
+
+/** Return a pointer to the data of a non-field section.
+ * \param [in] section       Index of a section.
+ * \return                   Pointer to the section data of the size given by
+ *                           its metadata, or NULL for an invalid index or a
+ *                           field section.
+ */
+const void         *p8est_file_map_block (const p8est_file_map_t * map,
+                                        size_t section);
+
+/** Return a pointer to the entries of a range of quadrants in a field.
+ * The entries are stored contiguously with the element size given by the
+ * section metadata.  Where supported, the range is announced to the
+ * operating system to be read ahead.
+ *
+ * \param [in] section       Index of a section of type 'F'.
+ * \param [in] first         Global index of the first quadrant.
+ * \param [in] count         Number of quadrants to be accessed; the range
+ *                           must lie within the global quadrants.
+ * \return                   Pointer to the entry of quadrant \a first, or
+ *                           NULL for an invalid index, type or range.
+ */
+const void         *p8est_file_map_field (const p8est_file_map_t * map,
+                                        size_t section, p4est_gloidx_t first,
+                                        p4est_gloidx_t count);
+
+/** Callback for \ref p8est_file_map_scan.
+ * \param [in] which_tree    Tree of the quadrant.
+ * \param [in] quadrant      Quadrant read from the file; it is valid only
+ *                           during the call and its p.which_tree is set.
+ * \param [in] global_index  Global index of the quadrant in the file.
+ * \param [in] fields        One pointer per requested field section to the
+ *                           entry of this quadrant.
+ * \param [in,out] user      The user pointer passed to the scan.
+ * \return                   True to continue and false to stop the scan.
+ */
+typedef int         (*p8est_file_map_scan_t) (p4est_topidx_t which_tree,
+                                              const p8est_quadrant_t *
+                                              quadrant,
+                                              p4est_gloidx_t global_index,
+                                              const void **fields,
+                                              void *user);
+
+/** Traverse the quadrants stored in a mapped file in Morton order.
+ * The quadrants are decoded from the section written by \ref
+ * p8est_file_write_p4est without building a forest.  The file is accessed
+ * in chunks of bounded size with read ahead, such that the memory used
+ * does not depend on the number of quadrants.  To split the traversal
+ * over processes, each process passes its own range, for example one
+ * given by \ref p4est_partition_cut_gloidx.
+ *
+ * With OpenMP the range is split into contiguous pieces that are traversed
+ * concurrently, each piece in order; the callback must be thread safe
+ * then.  Returning false from the callback stops the current piece only.
+ *
+ * \param [in] quad_section  Index of the quadrant section; the preceding
+ *                           section must hold the counts per tree.
+ * \param [in] num_fields    Number of field sections passed to the callback.
+ * \param [in] field_sections Indices of sections of type 'F'.
+ * \param [in] first         Global index of the first quadrant to visit.
+ * \param [in] count         Number of quadrants to visit.
+ * \param [in] scan_fn       Called for every quadrant of the range.
+ * \param [in,out] user      Passed to \a scan_fn.
+ * \return                   \ref P4EST_FILE_ERR_SUCCESS, \ref
+ *                           P4EST_FILE_ERR_FORMAT if the sections do not
+ *                           store a forest, or \ref P4EST_FILE_ERR_IN_DATA
+ *                           for an invalid index or range.
+ */
+int                 p8est_file_map_scan (const p8est_file_map_t * map,
+                                        size_t quad_section,
+                                        size_t num_fields,
+                                        const size_t *field_sections,
+                                        p4est_gloidx_t first,
+                                        p4est_gloidx_t count,
+                                        p8est_file_map_scan_t scan_fn,
+                                        void *user);
+
 #endif /* P4EST_ENABLE_FILE_DEPRECATED */
 
 SC_EXTERN_C_END;
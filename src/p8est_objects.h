@@ -0,0 +1,128 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+/** \file p8est_objects.h
+ *
+ * Refine a forest of octrees to a set of geometric objects.
+ *
+ * Each object is described by an axis-aligned bounding box in the
+ * reference coordinates of one tree.  The objects are routed to the
+ * processes whose partition they overlap by \ref p8est_search_partition,
+ * and the object lists are split top-down among the local quadrants by
+ * \ref p8est_search_local.  A user predicate decides which leaves are
+ * refined for an object.  This is repeated level by level until no
+ * leaf is refined anymore, and the final object lists of the local leaves
+ * are returned in compressed row storage.
+ *
+ * \ingroup p8est
+ */
+
+#ifndef P8EST_OBJECTS_H
+#define P8EST_OBJECTS_H
+
+#include <p8est.h>
+
+SC_EXTERN_C_BEGIN;
+
+/** The bounding box of a geometric object.
+ * Objects are passed as an array whose element size may be larger than
+ * this structure; the bytes following it are a payload that travels with
+ * the object.  An object that crosses tree boundaries is passed once for
+ * each tree it touches.
+ */
+typedef struct p8est_object
+{
+  p4est_topidx_t      which_tree;       /**< The tree holding the box */
+  double              lower[3];         /**< Lower corner in the reference
+                                             coordinates [0, 1] of the tree */
+  double              upper[3];         /**< Upper corner, likewise */
+}
+p8est_object_t;
+
+/** Decide whether a leaf is refined for an object.
+ * It is only called for local leaves below the maximum level whose box
+ * overlaps the bounding box of the object, and only until the first
+ * object asks to refine the leaf.  The user pointer of the forest is
+ * in use during the call; pass any context through \a user instead.
+ * \param [in] p4est        The forest being refined.
+ * \param [in] which_tree   The tree of the leaf.
+ * \param [in] quadrant     The leaf.
+ * \param [in] object       The object with its payload, if any.
+ * \param [in] user         The pointer passed to \ref p8est_objects_refine.
+ * \return                  True if the leaf shall be refined.
+ */
+typedef int         (*p8est_objects_refine_t) (p8est_t * p8est,
+                                               p4est_topidx_t which_tree,
+                                               p8est_quadrant_t * quadrant,
+                                               const p8est_object_t * object,
+                                               void *user);
+
+/** The objects overlapping the local leaves in compressed row storage. */
+typedef struct p8est_objects
+{
+  sc_array_t         *objects;          /**< Copies of the objects that
+                                             overlap at least one local
+                                             leaf, with their payloads */
+  p4est_locidx_t      num_leaves;       /**< Local leaves of the forest */
+  p4est_locidx_t     *offsets;          /**< For each local leaf and one
+                                             beyond, its first entry in
+                                             \a indices */
+  p4est_locidx_t     *indices;          /**< Indices into \a objects */
+}
+p8est_objects_t;
+
+/** Refine a forest to a distributed set of objects.
+ * This function is collective.  Every process passes its own objects;
+ * they need not overlap the local partition.  In each round, the objects
+ * are sent to the processes whose partition their boxes overlap, the
+ * local leaves overlapping an object are offered to \a refine_fn, and the
+ * forest is refined once and optionally partitioned.  The rounds stop
+ * when no leaf is refined anywhere.
+ * \param [in,out] p4est    The forest is refined and maybe partitioned.
+ * \param [in] maxlevel     Leaves are not refined beyond this level.
+ *                          If negative, P8EST_QMAXLEVEL is used.
+ * \param [in] partition    If true, partition after each refinement.
+ * \param [in] objects      Local objects, each beginning with a
+ *                          \ref p8est_object_t.
+ * \param [in] refine_fn    The refinement predicate.  If NULL, the forest
+ *                          is not changed and only the lists are made.
+ * \param [in] init_fn      Initializes the data of new quadrants, or NULL.
+ * \param [in] user         Passed to \a refine_fn.
+ * \return                  The objects of the local leaves of the refined
+ *                          forest, to be freed with
+ *                          \ref p8est_objects_destroy.
+ */
+p8est_objects_t    *p8est_objects_refine (p8est_t * p8est, int maxlevel,
+                                          int partition,
+                                          sc_array_t * objects,
+                                          p8est_objects_refine_t refine_fn,
+                                          p8est_init_t init_fn, void *user);
+
+/** Free the object lists returned by \ref p8est_objects_refine. */
+void                p8est_objects_destroy (p8est_objects_t * objs);
+
+SC_EXTERN_C_END;
+
+#endif /* !P8EST_OBJECTS_H */
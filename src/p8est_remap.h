@@ -0,0 +1,110 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+/** \file p8est_remap.h
+ *
+ * Overlap of two forests and remapping of data between them.
+ *
+ * The two forests share a connectivity and a communicator but may differ
+ * in refinement and partition.  For every local quadrant of the target
+ * forest, \ref p8est_remap_new finds the overlapping quadrants of the
+ * source forest, their owners, and the fraction of the target quadrant
+ * each of them covers.  The owners are found by galloping through the
+ * partition markers of the source, and the overlaps on each owner by a
+ * merge of Morton ranges.  The resulting plan is reused by
+ * \ref p8est_remap_gather to fetch source data into the overlaps any
+ * number of times.
+ *
+ * \ingroup p8est
+ */
+
+#ifndef P8EST_REMAP_H
+#define P8EST_REMAP_H
+
+#include <p8est.h>
+
+SC_EXTERN_C_BEGIN;
+
+/** The overlaps of the local target quadrants with a source forest. */
+typedef struct p8est_remap
+{
+  p4est_locidx_t      num_local;        /**< Local target quadrants */
+  p4est_locidx_t      num_overlaps;     /**< Total number of overlaps */
+  p4est_locidx_t     *offsets;          /**< For each local target quadrant
+                                             and one beyond, its first
+                                             overlap */
+  p4est_gloidx_t     *overlap_index;    /**< Global number of each overlap
+                                             in the source forest */
+  int                *overlap_owner;    /**< Owner of each overlap in the
+                                             source forest */
+  double             *overlap_fraction; /**< Part of the target quadrant's
+                                             volume that each overlap
+                                             covers */
+
+  /* private communication plan */
+  sc_MPI_Comm         mpicomm;
+  int                 mpirank;
+  int                 num_recvs;
+  int                *recv_ranks;
+  p4est_locidx_t     *recv_offsets;
+  p4est_locidx_t     *recv_slots;
+  int                 num_sends;
+  int                *send_ranks;
+  p4est_locidx_t     *send_offsets;
+  p4est_locidx_t     *send_index;
+}
+p8est_remap_t;
+
+/** Compute the overlaps of the local quadrants of a target forest with a
+ * source forest.  Collective over the communicator of the forests.
+ * \param [in] p8est    The target forest.
+ * \param [in] source   The source forest with the same connectivity and
+ *                      a communicator of the same processes.
+ * \return              The overlaps and the plan to remap data.  The
+ *                      overlaps of each target quadrant are ordered by
+ *                      their global number in the source.
+ */
+p8est_remap_t      *p8est_remap_new (p8est_t * p8est, p8est_t * source);
+
+/** Free the overlaps and the plan. */
+void                p8est_remap_destroy (p8est_remap_t * remap);
+
+/** Fetch the data of the overlapping source quadrants.  Collective.
+ * \param [in] remap        The plan built by \ref p8est_remap_new.
+ * \param [in] source_data  Data of the local source quadrants, \a data_size
+ *                          bytes each in local order.
+ * \param [out] overlap_data Receives the data of every overlap in the
+ *                          order of the overlap arrays, \a data_size
+ *                          bytes each.
+ * \param [in] data_size    The fixed data size per quadrant.
+ */
+void                p8est_remap_gather (p8est_remap_t * remap,
+                                        const void *source_data,
+                                        void *overlap_data,
+                                        size_t data_size);
+
+SC_EXTERN_C_END;
+
+#endif /* ! P8EST_REMAP_H */
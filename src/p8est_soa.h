@@ -0,0 +1,332 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/** \file p8est_soa.h
+ *
+ * Structure-of-arrays mirror of the local quadrants of a forest.
+ *
+ * The quadrants of a forest are stored per tree as arrays of
+ * \ref p8est_quadrant_t.  Loops that only need the coordinates or the
+ * levels still pull the whole structure through the cache.  A
+ * \ref p8est_soa_t holds the same quadrants in separate, contiguous arrays
+ * of coordinates, levels and user data pointers, indexed by the local
+ * quadrant number as in \ref p8est_tree_t::quadrants_offset.
+ *
+ * The mirror remembers the revision counter of the forest.  Refine,
+ * coarsen, balance and partition bump that counter when they change the
+ * mesh; \ref p8est_soa_update then rebuilds the mirror.  Replacing the
+ * user data with \ref p8est_reset_data does not bump the revision, so this
+ * requires a rebuild by \ref p8est_soa_update with \a force set.
+ *
+ * A \ref p8est_soa_device_t copies the same arrays, the ghost quadrants
+ * and optionally the neighbor tables of a mesh and the element nodes of an
+ * lnodes structure into memory obtained through allocator hooks, which is
+ * typically device memory.  Kernels read it through a plain
+ * \ref p8est_soa_view_t and inline accessors usable in device code.
+ *
+ * \ingroup p8est
+ */
+
+#ifndef P8EST_SOA_H
+#define P8EST_SOA_H
+
+#include <p8est_mesh.h>
+#include <p8est_lnodes.h>
+
+SC_EXTERN_C_BEGIN;
+
+/** Local quadrants of a forest as a structure of arrays. */
+typedef struct p8est_soa
+{
+  p8est_t            *p4est;            /**< The forest mirrored */
+  long                revision;         /**< Revision of the forest mirrored */
+  p4est_topidx_t      first_local_tree; /**< Copy of the forest's value */
+  p4est_topidx_t      last_local_tree;  /**< Copy of the forest's value */
+  p4est_locidx_t      num_quadrants;    /**< Number of local quadrants */
+  /** For each local tree and one beyond, the local number of the tree's
+   * first quadrant.  Accessed by \ref p8est_soa_tree_offset. */
+  p4est_locidx_t     *tree_offsets;
+  p4est_qcoord_t     *x;                /**< x coordinates of all quadrants */
+  p4est_qcoord_t     *y;                /**< y coordinates of all quadrants */
+  p4est_qcoord_t     *z;                /**< z coordinates of all quadrants */
+  int8_t             *level;            /**< levels of all quadrants */
+  void              **user_data;        /**< user data pointers */
+}
+p8est_soa_t;
+
+/** Create a mirror of the current local quadrants of a forest.
+ * \param [in] p8est    The forest must stay alive while the mirror is used.
+ * \return              An up-to-date mirror, destroy with
+ *                      \ref p8est_soa_destroy.
+ */
+p8est_soa_t        *p8est_soa_new (p8est_t * p8est);
+
+/** Free the memory of a mirror.  The forest is not touched. */
+void                p8est_soa_destroy (p8est_soa_t * soa);
+
+/** Rebuild the mirror if the forest has changed since the last build.
+ * \param [in,out] soa  The mirror is afterwards consistent with its forest.
+ * \param [in] force    Rebuild even if the revision counter of the forest
+ *                      is unchanged, for example after
+ *                      \ref p8est_reset_data.
+ * \return              True if the mirror has been rebuilt.
+ */
+int                 p8est_soa_update (p8est_soa_t * soa, int force);
+
+/** Check whether the mirror reflects the current mesh of its forest.
+ * \return              True if the forest's revision counter and local
+ *                      quadrant count are unchanged since the last build.
+ */
+int                 p8est_soa_is_current (p8est_soa_t * soa);
+
+/** Copy a quadrant from the mirror into a quadrant structure.
+ * \param [in] soa      A current mirror.
+ * \param [in] lid      Local quadrant number, less than num_quadrants.
+ * \param [out] q       Its coordinates, level and user data are set.
+ */
+void                p8est_soa_get_quadrant (p8est_soa_t * soa,
+                                            p4est_locidx_t lid,
+                                            p8est_quadrant_t * q);
+
+/** Find the lowest quadrant of a local tree that is >= q in the mirror.
+ * This is the analogue of \ref p8est_find_lower_bound, reading only the
+ * coordinate and level arrays.
+ * \param [in] soa      A current mirror.
+ * \param [in] which_tree   A local tree.
+ * \param [in] q        The quadrant to search for.
+ * \param [in] guess    Initial guess relative to the tree's first quadrant.
+ * \return              Index relative to the tree's first quadrant,
+ *                      or -1 if there is no such quadrant.
+ */
+ssize_t             p8est_soa_find_lower_bound (p8est_soa_t * soa,
+                                                p4est_topidx_t which_tree,
+                                                const p8est_quadrant_t * q,
+                                                size_t guess);
+
+/** Find the highest quadrant of a local tree that is <= q in the mirror.
+ * This is the analogue of \ref p8est_find_higher_bound.
+ * \param [in] soa      A current mirror.
+ * \param [in] which_tree   A local tree.
+ * \param [in] q        The quadrant to search for.
+ * \param [in] guess    Initial guess relative to the tree's first quadrant.
+ * \return              Index relative to the tree's first quadrant,
+ *                      or -1 if there is no such quadrant.
+ */
+ssize_t             p8est_soa_find_higher_bound (p8est_soa_t * soa,
+                                                 p4est_topidx_t which_tree,
+                                                 const p8est_quadrant_t * q,
+                                                 size_t guess);
+
+/** Return the local number of the first quadrant of a local tree.
+ * \param [in] soa      A current mirror.
+ * \param [in] which_tree   A local tree or last_local_tree + 1.
+ */
+/*@unused@*/
+static inline       p4est_locidx_t
+p8est_soa_tree_offset (p8est_soa_t * soa, p4est_topidx_t which_tree)
+{
+  P4EST_ASSERT (soa->first_local_tree <= which_tree &&
+                which_tree <= soa->last_local_tree + 1);
+  return soa->tree_offsets[which_tree - soa->first_local_tree];
+}
+
+/** Memory hooks for the buffers of a \ref p8est_soa_device_t.
+ * With CUDA, for example, alloc may call cudaMalloc, free cudaFree and copy
+ * cudaMemcpy with cudaMemcpyHostToDevice.  The hooks are only called on the
+ * host.  Passing NULL for the hooks uses host memory and memcpy.
+ */
+typedef struct p8est_soa_allocator
+{
+  /** Allocate bytes > 0 of device memory. */
+  void               *(*alloc) (size_t bytes, void *user);
+  /** Free memory returned by alloc. */
+  void                (*free) (void *ptr, void *user);
+  /** Copy bytes from host memory src into device memory dst.
+   * The source may be reused as soon as the hook returns. */
+  void                (*copy) (void *dst, const void *src, size_t bytes,
+                               void *user);
+  void               *user;     /**< Passed to the hooks */
+}
+p8est_soa_allocator_t;
+
+/** Read-only pointers into the device buffers of a \ref p8est_soa_device_t.
+ * The structure contains no host pointers and may be passed by value to a
+ * device kernel.  Local quadrants are numbered 0..num_quadrants-1 and the
+ * ghost quadrants follow them, such that an index from quad_to_quad
+ * addresses the coordinate, level and tree arrays directly.
+ * The mesh and lnodes members are NULL if these were not attached.
+ */
+typedef struct p8est_soa_view
+{
+  p4est_locidx_t      num_quadrants;    /**< Number of local quadrants */
+  p4est_locidx_t      num_ghosts;       /**< Number of ghost quadrants */
+  const p4est_qcoord_t *x;      /**< x coordinates, local then ghost */
+  const p4est_qcoord_t *y;      /**< y coordinates, local then ghost */
+  const p4est_qcoord_t *z;      /**< z coordinates, local then ghost */
+  const int8_t       *level;    /**< levels, local then ghost */
+  const p4est_topidx_t *which_tree;     /**< trees, local then ghost */
+  const p4est_locidx_t *quad_to_quad;   /**< As in \ref p8est_mesh_t */
+  const int8_t       *quad_to_face;     /**< As in \ref p8est_mesh_t */
+  const p4est_locidx_t *quad_to_half;   /**< P8EST_HALF entries per pair */
+  int                 vnodes;   /**< Nodes per element of the lnodes */
+  const p4est_locidx_t *element_nodes;  /**< As in \ref p8est_lnodes_t */
+}
+p8est_soa_view_t;
+
+/** A mirror of the local and ghost quadrants, the mesh neighbor tables
+ * and the lnodes element nodes in device memory.  The buffers are built
+ * on the host and copied once per change of the forest.  Buffers are
+ * reused across updates and only reallocated when they need to grow.
+ */
+typedef struct p8est_soa_device p8est_soa_device_t;
+
+/** Create a device mirror of a forest.  No memory is copied before the
+ * first call to \ref p8est_soa_device_update.
+ * \param [in] p8est    The forest must stay alive while the mirror is used.
+ * \param [in] allocator    The hooks are copied.  NULL selects host memory.
+ * \return              The mirror, destroy with \ref p8est_soa_device_destroy.
+ */
+p8est_soa_device_t *p8est_soa_device_new (p8est_t * p8est,
+                                          const p8est_soa_allocator_t *
+                                          allocator);
+
+/** Free the device buffers and the mirror. */
+void                p8est_soa_device_destroy (p8est_soa_device_t * dev);
+
+/** Bring the device buffers up to date with the forest.
+ * Nothing is copied if the forest revision and the attached structures
+ * are unchanged since the last update.
+ * \param [in,out] dev  The device mirror.
+ * \param [in] ghost    Ghost layer of the current forest, or NULL.
+ * \param [in] mesh     Mesh of the current forest, or NULL.  If it has
+ *                      ghost quadrants, the ghost layer must be given.
+ * \param [in] lnodes   Nodes of the current forest, or NULL.
+ * \param [in] force    Copy even if nothing seems to have changed, for
+ *                      example after recreating the mesh in place.
+ * \return              True if the device buffers have been written.
+ */
+int                 p8est_soa_device_update (p8est_soa_device_t * dev,
+                                             p8est_ghost_t * ghost,
+                                             p8est_mesh_t * mesh,
+                                             p8est_lnodes_t * lnodes,
+                                             int force);
+
+/** Return the device pointers valid since the last update.
+ * The view is invalidated by the next update that writes the buffers.
+ */
+const p8est_soa_view_t *p8est_soa_device_view (p8est_soa_device_t * dev);
+
+/* The view accessors below do not assert and call no library functions,
+ * so they can be compiled for a device.  With CUDA, define
+ * P8EST_SOA_VIEW_INLINE to static inline __host__ __device__ before
+ * including this file. */
+#ifndef P8EST_SOA_VIEW_INLINE
+#define P8EST_SOA_VIEW_INLINE static inline
+#endif
+
+/** Return the side length of a quadrant in the view.
+ * \param [in] view     Device view.
+ * \param [in] lid      Local or ghost quadrant number.
+ */
+/*@unused@*/
+P8EST_SOA_VIEW_INLINE p4est_qcoord_t
+p8est_soa_view_quadrant_len (const p8est_soa_view_t * view,
+                             p4est_locidx_t lid)
+{
+  return P8EST_QUADRANT_LEN (view->level[lid]);
+}
+
+/** Compute the Morton index of a quadrant in the view relative to its
+ * tree as in \ref p8est_quadrant_linear_id.
+ * \param [in] view     Device view.
+ * \param [in] lid      Local or ghost quadrant number.
+ * \param [in] level    Level <= P8EST_OLD_QMAXLEVEL of the index.
+ */
+/*@unused@*/
+P8EST_SOA_VIEW_INLINE uint64_t
+p8est_soa_view_linear_id (const p8est_soa_view_t * view,
+                          p4est_locidx_t lid, int level)
+{
+  int                 i, shift;
+  uint64_t            id, bx, by, bz;
+
+  shift = P8EST_MAXLEVEL - level;
+  bx = (uint64_t) (view->x[lid] >> shift);
+  by = (uint64_t) (view->y[lid] >> shift);
+  bz = (uint64_t) (view->z[lid] >> shift);
+  id = 0;
+  for (i = 0; i < level; ++i) {
+    id |= ((bx >> i) & 1) << (P8EST_DIM * i);
+    id |= ((by >> i) & 1) << (P8EST_DIM * i + 1);
+    id |= ((bz >> i) & 1) << (P8EST_DIM * i + 2);
+  }
+  return id;
+}
+
+/** Look up the face neighbor of a local quadrant in the view's mesh.
+ * \param [in] view     Device view with a mesh attached.
+ * \param [in] lid      Local quadrant number.
+ * \param [in] face     Face of the quadrant.
+ * \param [out] nface   The quad_to_face entry of \ref p8est_mesh_t.
+ * \return              The quad_to_quad entry of \ref p8est_mesh_t.
+ *                      If *nface is negative, it indexes the pairs of
+ *                      \ref p8est_soa_view_half_neighbors.
+ */
+/*@unused@*/
+P8EST_SOA_VIEW_INLINE p4est_locidx_t
+p8est_soa_view_face_neighbor (const p8est_soa_view_t * view,
+                              p4est_locidx_t lid, int face, int *nface)
+{
+  *nface = (int) view->quad_to_face[P8EST_FACES * lid + face];
+  return view->quad_to_quad[P8EST_FACES * lid + face];
+}
+
+/** Return the P8EST_HALF half-size neighbors for a negative nface.
+ * \param [in] view     Device view with a mesh attached.
+ * \param [in] half     Value returned by \ref p8est_soa_view_face_neighbor.
+ */
+/*@unused@*/
+P8EST_SOA_VIEW_INLINE const p4est_locidx_t *
+p8est_soa_view_half_neighbors (const p8est_soa_view_t * view,
+                               p4est_locidx_t half)
+{
+  return view->quad_to_half + P8EST_HALF * half;
+}
+
+/** Return the local node number of a node of a local quadrant.
+ * \param [in] view     Device view with lnodes attached.
+ * \param [in] lid      Local quadrant number.
+ * \param [in] k        Node number 0..vnodes-1 of the element.
+ */
+/*@unused@*/
+P8EST_SOA_VIEW_INLINE p4est_locidx_t
+p8est_soa_view_element_node (const p8est_soa_view_t * view,
+                             p4est_locidx_t lid, int k)
+{
+  return view->element_nodes[view->vnodes * lid + k];
+}
+
+SC_EXTERN_C_END;
+
+#endif /* !P8EST_SOA_H */
@@ -0,0 +1,134 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/** \file p8est_taskgraph.h
+ *
+ * Dependency graph of the volume and face work on the local quadrants.
+ *
+ * \ref p8est_iterate runs the volume and face callbacks in one sweep and
+ * cannot overlap them with the ghost exchange.  A \ref p8est_taskgraph_t
+ * splits the local quadrants into blocks of consecutive quadrants in
+ * Morton order and distributes the unique faces of a \ref p8est_mesh_t
+ * onto tasks, such that a task runtime may execute them asynchronously.
+ *
+ * There are four kinds of tasks, stored in this order:
+ *  1. One ghost task without work.  It stands for the completion of
+ *     \ref p8est_ghost_exchange_data_end or any other exchange of ghost
+ *     data and is the only task without work.
+ *  2. One volume task per block.  It covers the quadrants of the block,
+ *     the faces between two quadrants of the block and the faces of the
+ *     block's quadrants on the domain boundary.
+ *  3. One interface task per pair of blocks that share a face.
+ *     It covers all faces between the two blocks.
+ *  4. One boundary task per block that has faces with ghost quadrants.
+ *     It covers these faces and depends on the ghost task.
+ *
+ * Each face of the mesh face list belongs to exactly one task.  For each
+ * of its blocks, a task depends on the latest earlier task in the array
+ * that touches this block, and boundary tasks depend on the ghost task.  Thus two tasks
+ * that may run at the same time never write to the same quadrant, the
+ * array order is a valid serial schedule, and all volume and interface
+ * tasks may run while the ghost exchange is in progress.
+ *
+ * \ingroup p8est
+ */
+
+#ifndef P8EST_TASKGRAPH_H
+#define P8EST_TASKGRAPH_H
+
+#include <p8est_mesh.h>
+
+SC_EXTERN_C_BEGIN;
+
+/** The kind of work in a task of a \ref p8est_taskgraph_t. */
+typedef enum
+{
+  P8EST_TASK_GHOST,             /**< completion of the ghost exchange */
+  P8EST_TASK_VOLUME,            /**< quadrants and inner faces of a block */
+  P8EST_TASK_INTERFACE,         /**< faces between two blocks */
+  P8EST_TASK_BOUNDARY           /**< faces between a block and ghosts */
+}
+p8est_task_type_t;
+
+/** A task of a \ref p8est_taskgraph_t. */
+typedef struct p8est_task
+{
+  p8est_task_type_t   type;     /**< Kind of work */
+  /** The blocks touched.  For a volume or boundary task, block[1] is -1.
+   * For an interface task, block[0] < block[1].
+   * Both are -1 for the ghost task. */
+  p4est_locidx_t      block[2];
+  p4est_locidx_t      face_offset;      /**< First entry in faces */
+  p4est_locidx_t      num_faces;        /**< Number of entries in faces */
+  p4est_locidx_t      dep_offset;       /**< First entry in deps */
+  p4est_locidx_t      num_deps;         /**< Number of entries in deps */
+}
+p8est_task_t;
+
+/** Tasks and dependencies for the local quadrants of a forest. */
+typedef struct p8est_taskgraph
+{
+  p4est_locidx_t      block_size;       /**< Quadrants per full block */
+  p4est_locidx_t      num_blocks;       /**< Number of blocks */
+  /** For each block and one beyond, the local number of its first
+   * quadrant.  The last block may be smaller than block_size. */
+  p4est_locidx_t     *block_offsets;
+  p4est_locidx_t      num_tasks;        /**< Number of tasks */
+  p8est_task_t       *tasks;            /**< Tasks in a valid serial order */
+  /** Indices into the face list of the mesh, grouped by task. */
+  p4est_locidx_t     *faces;
+  /** Indices of earlier tasks, grouped by the task depending on them. */
+  p4est_locidx_t     *deps;
+}
+p8est_taskgraph_t;
+
+/** Create the task graph for a mesh.
+ * \param [in] mesh     A mesh created with compute_face_list set in its
+ *                      parameters, see \ref p8est_mesh_new_params.
+ *                      It is only read during this call.
+ * \param [in] block_size   Positive number of quadrants per block.
+ * \return              The task graph, destroy with
+ *                      \ref p8est_taskgraph_destroy.
+ */
+p8est_taskgraph_t  *p8est_taskgraph_new (p8est_mesh_t * mesh,
+                                         p4est_locidx_t block_size);
+
+/** Free the memory of a task graph. */
+void                p8est_taskgraph_destroy (p8est_taskgraph_t * graph);
+
+/** Return the block of a local quadrant.
+ * \param [in] graph    Task graph.
+ * \param [in] lid      Local quadrant number.
+ */
+/*@unused@*/
+static inline       p4est_locidx_t
+p8est_taskgraph_block (p8est_taskgraph_t * graph, p4est_locidx_t lid)
+{
+  P4EST_ASSERT (0 <= lid && lid < graph->block_offsets[graph->num_blocks]);
+  return lid / graph->block_size;
+}
+
+SC_EXTERN_C_END;
+
+#endif /* !P8EST_TASKGRAPH_H */
@@ -365,247 +365,196 @@ p8est_tets_make_righthanded (p8est_tets_t * ptg)
   return tnum_flips;
 }
 
-typedef struct p8est_tet_edge_info
+/** A tet edge or face identified by its sorted node numbers. */
+typedef struct p8est_tet_key
 {
-  p4est_topidx_t      ek[2];
-  sc_array_t          tets;
-  sc_array_t          tet_edges;
+  p4est_topidx_t      key[3];   /**< Sorted node numbers, unused is -1. */
+  p4est_topidx_t      tet;      /**< Number of the tet it is taken from. */
+  int                 entity;   /**< Edge or face number within the tet. */
 }
-p8est_tet_edge_info_t;
+p8est_tet_key_t;
 
-/** Create unique edge key for a given edge of a tetrahedron.
- * \param [out] ek      The edge key consists of two node numbers.
+/** Create unique key for a given edge or face of a tetrahedron.
+ * \param [out] tk      The key consists of two or three node numbers.
  * \param [in] tet      A tetrahedron referring to node indices.
- * \param [in] edge     Tetrahedron edge number in [ 0 .. 5 ].
+ * \param [in] nkey     Two for an edge, three for a face.
+ * \param [in] entity   Tetrahedron edge number in [ 0 .. 5 ]
+ *                      or face number in [ 0 .. 3 ].
  */
 static void
-p8est_tet_edge_key (p4est_topidx_t * ek, p4est_topidx_t * tet, int edge)
+p8est_tet_key (p8est_tet_key_t * tk, p4est_topidx_t * tet, int nkey,
+               int entity)
 {
-  P4EST_ASSERT (0 <= edge && edge < 6);
-
-  ek[0] = tet[p8est_tet_edge_corners[edge][0]];
-  ek[1] = tet[p8est_tet_edge_corners[edge][1]];
-
-  P4EST_ASSERT (ek[0] != ek[1]);
-  p4est_topidx_bsort (ek, 2);
-}
-
-static unsigned
-p8est_tet_edge_hash (const void *v, const void *u)
-{
-  const p8est_tet_edge_info_t *ei = (p8est_tet_edge_info_t *) v;
-
-  return p4est_topidx_hash2 (ei->ek);
+  if (nkey == 2) {
+    P4EST_ASSERT (0 <= entity && entity < 6);
+    tk->key[0] = tet[p8est_tet_edge_corners[entity][0]];
+    tk->key[1] = tet[p8est_tet_edge_corners[entity][1]];
+    tk->key[2] = -1;
+    P4EST_ASSERT (tk->key[0] != tk->key[1]);
+  }
+  else {
+    P4EST_ASSERT (nkey == 3);
+    P4EST_ASSERT (0 <= entity && entity < 4);
+    tk->key[0] = tet[p8est_tet_face_corners[entity][0]];
+    tk->key[1] = tet[p8est_tet_face_corners[entity][1]];
+    tk->key[2] = tet[p8est_tet_face_corners[entity][2]];
+    P4EST_ASSERT (tk->key[0] != tk->key[1] && tk->key[0] != tk->key[2] &&
+                  tk->key[1] != tk->key[2]);
+  }
+  p4est_topidx_bsort (tk->key, nkey);
 }
 
+/** Order keys by node numbers, ties by tet and entity number. */
 static int
-p8est_tet_edge_equal (const void *v1, const void *v2, const void *u)
+p8est_tet_key_compare (const void *v1, const void *v2)
 {
-  const p8est_tet_edge_info_t *ei1 = (p8est_tet_edge_info_t *) v1;
-  const p8est_tet_edge_info_t *ei2 = (p8est_tet_edge_info_t *) v2;
-
-  return !memcmp (ei1->ek, ei2->ek, 2 * sizeof (p4est_topidx_t));
-}
+  int                 k;
+  const p8est_tet_key_t *tk1 = (const p8est_tet_key_t *) v1;
+  const p8est_tet_key_t *tk2 = (const p8est_tet_key_t *) v2;
 
-static sc_hash_array_t *
-p8est_tets_identify_edges (p8est_tets_t * ptg)
-{
-  int                 edge, *pi;
-  size_t              iz, znum_tets, pz;
-  sc_hash_array_t    *edge_ha;
-  p4est_topidx_t     *tet, *pt;
-  p8est_tet_edge_info_t eikey, *ei;
-
-  /* create hash array for shared edges */
-  edge_ha = sc_hash_array_new (sizeof (p8est_tet_edge_info_t),
-                               p8est_tet_edge_hash, p8est_tet_edge_equal,
-                               NULL);
-
-  /* loop through all edges and identify edge-neighbor tet groups */
-  znum_tets = ptg->tets->elem_count / 4;
-  for (iz = 0; iz < znum_tets; ++iz) {
-    tet = p8est_tets_tet_index (ptg, iz);
-    for (edge = 0; edge < 6; ++edge) {
-      p8est_tet_edge_key (eikey.ek, tet, edge);
-      ei = (p8est_tet_edge_info_t *)
-        sc_hash_array_insert_unique (edge_ha, &eikey, &pz);
-      if (ei != NULL) {
-        /* added new edge group ei to hash array */
-        P4EST_ASSERT (sc_array_position (&edge_ha->a, ei) == pz);
-        memcpy (ei->ek, eikey.ek, 2 * sizeof (p4est_topidx_t));
-        sc_array_init (&ei->tets, sizeof (p4est_topidx_t));
-        pt = (p4est_topidx_t *) sc_array_push (&ei->tets);
-        *pt = (p4est_topidx_t) iz;
-        sc_array_init (&ei->tet_edges, sizeof (int));
-        pi = (int *) sc_array_push (&ei->tet_edges);
-        *pi = edge;
-      }
-      else {
-        /* found existing entry from earlier edge */
-        ei = (p8est_tet_edge_info_t *) sc_array_index (&edge_ha->a, pz);
-        P4EST_ASSERT (p8est_tet_edge_equal (ei->ek, eikey.ek, NULL));
-        P4EST_ASSERT (ei->tets.elem_count > 0);
-        pt = (p4est_topidx_t *) sc_array_push (&ei->tets);
-        *pt = (p4est_topidx_t) iz;
-        P4EST_ASSERT (ei->tet_edges.elem_count > 0);
-        pi = (int *) sc_array_push (&ei->tet_edges);
-        *pi = edge;
-      }
+  for (k = 0; k < 3; ++k) {
+    if (tk1->key[k] != tk2->key[k]) {
+      return tk1->key[k] < tk2->key[k] ? -1 : 1;
     }
   }
-
-  return edge_ha;
-}
-
-typedef struct p8est_tet_face_info
-{
-  p4est_topidx_t      fk[3];
-  p4est_topidx_t      tets[2];
-  int                 tet_faces[2];
+  if (tk1->tet != tk2->tet) {
+    return tk1->tet < tk2->tet ? -1 : 1;
+  }
+  return tk1->entity - tk2->entity;
 }
-p8est_tet_face_info_t;
 
-/** Create unique face key for a given face of a tetrahedron.
- * \param [out] fk      The face key consists of three node numbers.
- * \param [in] tet      A tetrahedron referring to node indices.
- * \param [in] face     Tetrahedron face number in [ 0 .. 3 ].
+/** Number the unique edges or faces of all tets.
+ * The keys of all tet edges (faces) are sorted, which places the tets
+ * sharing an edge (face) next to each other.  Compared to inserting the
+ * keys into a hash table of edge (face) groups, this needs one small
+ * record per tet edge (face) that is released on return.
+ * \param [in] ptg      Structure with node and tet information.
+ * \param [in] nkey     Two to number edges, three to number faces.
+ * \param [out] ids     Per tet, 6 edge or 4 face numbers that index into
+ *                      the unique edges or faces, ordered by their keys.
+ * \param [in,out] coords   Array of 3 doubles; the midpoint of each
+ *                          unique edge or face is appended to it.
+ * \return              The number of unique edges or faces.
  */
-static void
-p8est_tet_face_key (p4est_topidx_t * fk, p4est_topidx_t * tet, int face)
-{
-  P4EST_ASSERT (0 <= face && face < 4);
-
-  fk[0] = tet[p8est_tet_face_corners[face][0]];
-  fk[1] = tet[p8est_tet_face_corners[face][1]];
-  fk[2] = tet[p8est_tet_face_corners[face][2]];
-
-  P4EST_ASSERT (fk[0] != fk[1] && fk[0] != fk[2] && fk[1] != fk[2]);
-  p4est_topidx_bsort (fk, 3);
-}
-
-static unsigned
-p8est_tet_face_hash (const void *v, const void *u)
-{
-  const p8est_tet_face_info_t *fi = (p8est_tet_face_info_t *) v;
-
-  return p4est_topidx_hash3 (fi->fk);
-}
-
-static int
-p8est_tet_face_equal (const void *v1, const void *v2, const void *u)
-{
-  const p8est_tet_face_info_t *fi1 = (p8est_tet_face_info_t *) v1;
-  const p8est_tet_face_info_t *fi2 = (p8est_tet_face_info_t *) v2;
-
-  return !memcmp (fi1->fk, fi2->fk, 3 * sizeof (p4est_topidx_t));
-}
-
-static sc_hash_array_t *
-p8est_tets_identify_faces (p8est_tets_t * ptg)
+static size_t
+p8est_tets_number_entities (p8est_tets_t * ptg, int nkey,
+                            p4est_topidx_t * ids, sc_array_t * coords)
 {
-  int                 face;
-  size_t              iz, znum_tets, pz;
-  sc_hash_array_t    *face_ha;
+  int                 entity, nent, j;
+  size_t              iz, znum_tets, zc;
+  size_t              num_unique;
+#ifdef P4EST_ENABLE_DEBUG
+  int                 group = 0;
+#endif
+  double             *vp, *n;
   p4est_topidx_t     *tet;
-  p8est_tet_face_info_t fikey, *fi;
+  p8est_tet_key_t    *tk, *prev;
+  sc_array_t         *keys;
 
-  /* create hash array for shared faces */
-  face_ha = sc_hash_array_new (sizeof (p8est_tet_face_info_t),
-                               p8est_tet_face_hash, p8est_tet_face_equal,
-                               NULL);
+  P4EST_ASSERT (nkey == 2 || nkey == 3);
+  P4EST_ASSERT (coords->elem_size == 3 * sizeof (double));
+  nent = (nkey == 2) ? 6 : 4;
 
-  /* loop through all faces and identify face-neighbor tet pairs */
+  /* collect the keys of all tet edges or faces */
   znum_tets = ptg->tets->elem_count / 4;
+  keys = sc_array_new_count (sizeof (p8est_tet_key_t), nent * znum_tets);
   for (iz = 0; iz < znum_tets; ++iz) {
     tet = p8est_tets_tet_index (ptg, iz);
-    for (face = 0; face < 4; ++face) {
-      p8est_tet_face_key (fikey.fk, tet, face);
-      fi = (p8est_tet_face_info_t *)
-        sc_hash_array_insert_unique (face_ha, &fikey, &pz);
-      if (fi != NULL) {
-        /* added fi to hash array as the first of two tets */
-        P4EST_ASSERT (sc_array_position (&face_ha->a, fi) == pz);
-        memcpy (fi->fk, fikey.fk, 3 * sizeof (p4est_topidx_t));
-        fi->tets[0] = (p4est_topidx_t) iz;
-        fi->tets[1] = -1;
-        fi->tet_faces[0] = face;
-        fi->tet_faces[1] = -1;
-      }
-      else {
-        /* found existing entry from the first face */
-        fi = (p8est_tet_face_info_t *) sc_array_index (&face_ha->a, pz);
-        P4EST_ASSERT (p8est_tet_face_equal (fi->fk, fikey.fk, NULL));
-        P4EST_ASSERT (fi->tets[0] >= 0 && fi->tet_faces[0] >= 0);
-        P4EST_ASSERT (fi->tets[1] == -1 && fi->tet_faces[1] == -1);
-        fi->tets[1] = (p4est_topidx_t) iz;
-        fi->tet_faces[1] = face;
+    for (entity = 0; entity < nent; ++entity) {
+      tk = (p8est_tet_key_t *) sc_array_index (keys, nent * iz + entity);
+      p8est_tet_key (tk, tet, nkey, entity);
+      tk->tet = (p4est_topidx_t) iz;
+      tk->entity = entity;
+    }
+  }
+  sc_array_sort (keys, p8est_tet_key_compare);
+
+  /* identical keys are adjacent and receive the same number */
+  num_unique = 0;
+  prev = NULL;
+  for (zc = 0; zc < keys->elem_count; ++zc) {
+    tk = (p8est_tet_key_t *) sc_array_index (keys, zc);
+    if (prev == NULL || memcmp (prev->key, tk->key,
+                                3 * sizeof (p4est_topidx_t))) {
+      /* the first occurrence defines the new vertex */
+      vp = (double *) sc_array_push (coords);
+      vp[0] = vp[1] = vp[2] = 0.;
+      for (j = 0; j < nkey; ++j) {
+        n = p8est_tets_node_index (ptg, (size_t) tk->key[j]);
+        vp[0] += n[0];
+        vp[1] += n[1];
+        vp[2] += n[2];
       }
+      vp[0] *= 1. / nkey;
+      vp[1] *= 1. / nkey;
+      vp[2] *= 1. / nkey;
+      ++num_unique;
+#ifdef P4EST_ENABLE_DEBUG
+      group = 0;
+#endif
     }
+#ifdef P4EST_ENABLE_DEBUG
+    else {
+      /* a face is shared by at most two tets */
+      P4EST_ASSERT (nkey == 2 || ++group == 1);
+    }
+#endif
+    ids[nent * (size_t) tk->tet + tk->entity] =
+      (p4est_topidx_t) (num_unique - 1);
+    prev = tk;
   }
+  sc_array_destroy (keys);
 
-  return face_ha;
+  return num_unique;
 }
 
 /** Create a connectivity where the trees are not connected to each other. */
 static p8est_connectivity_t *
-p8est_tets_connectivity_new (p8est_tets_t * ptg,
-                             sc_hash_array_t * edge_ha,
-                             sc_hash_array_t * face_ha)
+p8est_tets_connectivity_new (p8est_tets_t * ptg)
 {
   int                 j, k;
   int                 edge, face;
   size_t              nvz, evzoffset, fvzoffset, vvzoffset;
-  size_t              iz, pz;
+  size_t              iz, znum_tets;
+  size_t              znum_edges, znum_faces;
   double             *vp, *n[4];
   int8_t             *ttf;
-  p4est_topidx_t      tt, *tet, node;
+  p4est_topidx_t      tt, *tet;
   p4est_topidx_t     *ttv, *ttt;
+  p4est_topidx_t     *edge_ids, *face_ids;
   p4est_topidx_t      nid[15];
+  sc_array_t         *coords;
   p8est_connectivity_t *conn;
-  p8est_tet_edge_info_t *ei, eikey;
-  p8est_tet_face_info_t *fi, fikey;
+
+  /* identify unique edges and faces */
+  znum_tets = ptg->tets->elem_count / 4;
+  coords = sc_array_new (3 * sizeof (double));
+  edge_ids = P4EST_ALLOC (p4est_topidx_t, 6 * znum_tets);
+  znum_edges = p8est_tets_number_entities (ptg, 2, edge_ids, coords);
+  P4EST_GLOBAL_LDEBUGF ("Added %ld unique tetrahedron edges\n",
+                        (long) znum_edges);
+  face_ids = P4EST_ALLOC (p4est_topidx_t, 4 * znum_tets);
+  znum_faces = p8est_tets_number_entities (ptg, 3, face_ids, coords);
+  P4EST_GLOBAL_LDEBUGF ("Added %ld unique tetrahedron faces\n",
+                        (long) znum_faces);
+  P4EST_ASSERT (coords->elem_count == znum_edges + znum_faces);
 
   /* arrange vertices by tet corners, edges, faces, and volumes */
   evzoffset = ptg->nodes->elem_count / 3;
-  fvzoffset = evzoffset + edge_ha->a.elem_count;
-  vvzoffset = fvzoffset + face_ha->a.elem_count;
-  nvz = vvzoffset + ptg->tets->elem_count / 4;
+  fvzoffset = evzoffset + znum_edges;
+  vvzoffset = fvzoffset + znum_faces;
+  nvz = vvzoffset + znum_tets;
 
   /* allocate connectivity */
   conn = p8est_connectivity_new (nvz, ptg->tets->elem_count, 0, 0, 0, 0);
 
   /* populate vertices */
   memcpy (conn->vertices, ptg->nodes->array, 3 * evzoffset * sizeof (double));
-  vp = conn->vertices + 3 * evzoffset;
-  for (iz = 0; iz < edge_ha->a.elem_count; ++iz) {
-    ei = (p8est_tet_edge_info_t *) sc_array_index (&edge_ha->a, iz);
-    tt = *((p4est_topidx_t *) sc_array_index (&ei->tets, 0));
-    edge = *((int *) sc_array_index (&ei->tet_edges, 0));
-    tet = p8est_tets_tet_index (ptg, tt);
-    for (j = 0; j < 2; ++j) {
-      node = tet[p8est_tet_edge_corners[edge][j]];
-      n[j] = p8est_tets_node_index (ptg, node);
-    }
-    vp[0] = .5 * (n[0][0] + n[1][0]);
-    vp[1] = .5 * (n[0][1] + n[1][1]);
-    vp[2] = .5 * (n[0][2] + n[1][2]);
-    vp += 3;
-  }
-  for (iz = 0; iz < face_ha->a.elem_count; ++iz) {
-    fi = (p8est_tet_face_info_t *) sc_array_index (&face_ha->a, iz);
-    tt = fi->tets[0];
-    face = fi->tet_faces[0];
-    tet = p8est_tets_tet_index (ptg, tt);
-    for (j = 0; j < 3; ++j) {
-      node = tet[p8est_tet_face_corners[face][j]];
-      n[j] = p8est_tets_node_index (ptg, node);
-    }
-    vp[0] = (1. / 3.) * (n[0][0] + n[1][0] + n[2][0]);
-    vp[1] = (1. / 3.) * (n[0][1] + n[1][1] + n[2][1]);
-    vp[2] = (1. / 3.) * (n[0][2] + n[1][2] + n[2][2]);
-    vp += 3;
-  }
-  for (iz = 0; iz < ptg->tets->elem_count / 4; ++iz) {
+  memcpy (conn->vertices + 3 * evzoffset, coords->array,
+          3 * coords->elem_count * sizeof (double));
+  sc_array_destroy (coords);
+  vp = conn->vertices + 3 * vvzoffset;
+  for (iz = 0; iz < znum_tets; ++iz) {
     tet = p8est_tets_tet_index (ptg, iz);
     for (j = 0; j < 4; ++j) {
       n[j] = p8est_tets_node_index (ptg, tet[j]);
@@ -618,7 +567,7 @@ p8est_tets_connectivity_new (p8est_tets_t * ptg,
 
   /* associate forest trees with vertices */
   ttv = conn->tree_to_vertex;
-  for (iz = 0; iz < ptg->tets->elem_count / 4; ++iz) {
+  for (iz = 0; iz < znum_tets; ++iz) {
     tet = p8est_tets_tet_index (ptg, iz);
 
     /* look up node numbers for all vertices in this tetrahedron */
@@ -626,14 +575,10 @@ p8est_tets_connectivity_new (p8est_tets_t * ptg,
       nid[j] = tet[j];
     }
     for (edge = 0; edge < 6; ++edge) {
-      p8est_tet_edge_key (eikey.ek, tet, edge);
-      P4EST_EXECUTE_ASSERT_TRUE (sc_hash_array_lookup (edge_ha, &eikey, &pz));
-      nid[4 + edge] = (p4est_topidx_t) (evzoffset + pz);
+      nid[4 + edge] = (p4est_topidx_t) (evzoffset + edge_ids[6 * iz + edge]);
     }
     for (face = 0; face < 4; ++face) {
-      p8est_tet_face_key (fikey.fk, tet, face);
-      P4EST_EXECUTE_ASSERT_TRUE (sc_hash_array_lookup (face_ha, &fikey, &pz));
-      nid[10 + face] = (p4est_topidx_t) (fvzoffset + pz);
+      nid[10 + face] = (p4est_topidx_t) (fvzoffset + face_ids[4 * iz + face]);
     }
     nid[14] = (p4est_topidx_t) (vvzoffset + iz);
 
@@ -644,6 +589,8 @@ p8est_tets_connectivity_new (p8est_tets_t * ptg,
       }
     }
   }
+  P4EST_FREE (edge_ids);
+  P4EST_FREE (face_ids);
 
   /* create neighborhood information for isolated trees */
   ttt = conn->tree_to_tree;
@@ -665,38 +612,14 @@ p8est_connectivity_new_tets (p8est_tets_t * ptg)
 {
   int                *pint, i;
   int8_t              attr;
-  size_t              ez, znum_edges;
   size_t              tz, znum_tets;
-  sc_hash_array_t    *edge_ha, *face_ha;
-  sc_array_t          edge_array;
-  p8est_tet_edge_info_t *ei;
   p8est_connectivity_t *conn;
 
-  /* identify unique edges and faces */
-  edge_ha = p8est_tets_identify_edges (ptg);
-  P4EST_GLOBAL_LDEBUGF ("Added %ld unique tetrahedron edges\n",
-                        (long) edge_ha->a.elem_count);
-
-  face_ha = p8est_tets_identify_faces (ptg);
-  P4EST_GLOBAL_LDEBUGF ("Added %ld unique tetrahedron faces\n",
-                        (long) face_ha->a.elem_count);
-
   /* add vertex information to connectivity */
-  conn = p8est_tets_connectivity_new (ptg, edge_ha, face_ha);
+  conn = p8est_tets_connectivity_new (ptg);
   P4EST_GLOBAL_LDEBUGF ("Connectivity has %ld vertices and %ld trees\n",
                         (long) conn->num_vertices, (long) conn->num_trees);
 
-  /* clean unique edges and faces */
-  sc_hash_array_rip (edge_ha, &edge_array);
-  znum_edges = edge_array.elem_count;
-  for (ez = 0; ez < znum_edges; ++ez) {
-    ei = (p8est_tet_edge_info_t *) sc_array_index (&edge_array, ez);
-    sc_array_reset (&ei->tets);
-    sc_array_reset (&ei->tet_edges);
-  }
-  sc_array_reset (&edge_array);
-  sc_hash_array_destroy (face_ha);
-
   /* transfer tree tags */
   if (ptg->tet_attributes != NULL) {
     znum_tets = ptg->tet_attributes->elem_count;
@@ -718,3 +641,36 @@ p8est_connectivity_new_tets (p8est_tets_t * ptg)
 
   return conn;
 }
+
+p8est_connectivity_t *
+p8est_connectivity_read_tets (const char *tetgenbasename, int root,
+                              sc_MPI_Comm mpicomm)
+{
+  int                 mpiret, mpirank;
+  int                 success;
+  p8est_tets_t       *ptg;
+  p8est_connectivity_t *conn;
+
+  mpiret = sc_MPI_Comm_rank (mpicomm, &mpirank);
+  SC_CHECK_MPI (mpiret);
+
+  /* only the root reads the tetgen files and converts them */
+  conn = NULL;
+  if (mpirank == root) {
+    ptg = p8est_tets_read (tetgenbasename);
+    if (ptg != NULL) {
+      p8est_tets_make_righthanded (ptg);
+      conn = p8est_connectivity_new_tets (ptg);
+      p8est_tets_destroy (ptg);
+    }
+  }
+  success = (conn != NULL);
+  mpiret = sc_MPI_Bcast (&success, 1, sc_MPI_INT, root, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  if (!success) {
+    return NULL;
+  }
+
+  /* store one copy of the connectivity per shared memory node */
+  return p8est_connectivity_bcast_shared (conn, root, mpicomm);
+}
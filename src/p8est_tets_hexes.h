@@ -87,6 +87,23 @@ p4est_topidx_t      p8est_tets_make_righthanded (p8est_tets_t * ptg);
  */
 p8est_connectivity_t *p8est_connectivity_new_tets (p8est_tets_t * ptg);
 
+/** Read tetgen files and create a connectivity on all processes.
+ * Only the root process reads the files, flips all tets to be right-handed
+ * and converts them.  The result is stored once per shared memory node by
+ * \ref p8est_connectivity_bcast_shared.
+ * \param [in] tetgenbasename   Base name for tetgen files (without suffix),
+ *                              only accessed on the root process.
+ * \param [in] root             The rank of the process that reads the files.
+ * \param [in] mpicomm          The MPI communicator.
+ * \return          Connectivity (free with p8est_connectivity_destroy,
+ *                  which is collective over \a mpicomm) on all processes,
+ *                  or NULL on all processes on file error.
+ */
+p8est_connectivity_t *p8est_connectivity_read_tets (const char
+                                                    *tetgenbasename,
+                                                    int root,
+                                                    sc_MPI_Comm mpicomm);
+
 SC_EXTERN_C_END;
 
 #endif /* !P8EST_TETS_HEXES */
@@ -34,6 +34,7 @@
 
 #include <p8est_geometry.h>
 #include <p8est.h>
+#include <p8est_lnodes.h>
 
 SC_EXTERN_C_BEGIN;
 
@@ -41,6 +42,61 @@ SC_EXTERN_C_BEGIN;
  */
 typedef struct p8est_vtk_context p8est_vtk_context_t;
 
+/** Opaque context type for writing VTKHDF output with parallel HDF5.
+ */
+typedef struct p8est_vtk_hdf5 p8est_vtk_hdf5_t;
+
+/** Compute the coordinates of the points of one element for the
+ * higher order output of \ref p8est_vtk_write_header_ho_fn.
+ * \param [in] p8est      The forest being written.
+ * \param [in] which_tree The tree containing \a quadrant.
+ * \param [in] quadrant   A local quadrant of the forest.
+ * \param [in] Nnodes1D   Number of points of the element in 1D.
+ * \param [out] xyz       Three coordinates for each of the Nnodes1D^3
+ *                        points, the x index varying fastest, then y,
+ *                        then z.  Any geometry transformation must be
+ *                        applied here.
+ * \param [in] user       The pointer passed to the header function.
+ */
+typedef void        (*p8est_vtk_ho_points_t) (p8est_t * p8est,
+                                           p4est_topidx_t which_tree,
+                                           p8est_quadrant_t * quadrant,
+                                           int Nnodes1D, double *xyz,
+                                           void *user);
+
+/** Reduction of cell data over the leaves of a truncated cell. */
+typedef enum
+{
+  P8EST_VTK_REDUCE_MEAN,        /**< Mean weighted by leaf volume. */
+  P8EST_VTK_REDUCE_MIN,         /**< Minimum over the leaves. */
+  P8EST_VTK_REDUCE_MAX          /**< Maximum over the leaves. */
+}
+p8est_vtk_reduce_t;
+
+/** The points and cells of the local quadrants as held in memory.
+ * It is the mesh written by \ref p8est_vtk_write_header and may be handed
+ * to in-situ visualization without any file I/O, for example as the
+ * explicit coordset and unstructured topology of a Conduit Blueprint mesh.
+ * All arrays are contiguous, so they can be passed as external views.
+ */
+typedef struct p8est_vtk_mesh
+{
+  p4est_locidx_t      num_cells;       /**< Number of local quadrants. */
+  p4est_locidx_t      num_corners;     /**< P8EST_CHILDREN per quadrant. */
+  p4est_locidx_t      num_points;      /**< Number of distinct points. */
+  double             *coordinates;     /**< Interleaved x, y, z of each point. */
+  p4est_locidx_t     *connectivity;    /**< P8EST_CHILDREN point indices per
+                                            quadrant in z-order, which is
+                                            the order of the VTK pixel and
+                                            voxel.  Blueprint's hex
+                                            shape needs corners 2 and 3 as well as 6 and 7
+                                            swapped. */
+  p4est_locidx_t     *point_to_corner; /**< First corner of each point, or
+                                            NULL if every corner is its own
+                                            point. */
+}
+p8est_vtk_mesh_t;
+
 /** Write the p8est in VTK format.
  *
  * This is a convenience function for the special case of writing out
@@ -84,6 +140,19 @@ void                p8est_vtk_write_file (p8est_t * p8est,
 p8est_vtk_context_t *p8est_vtk_context_new (p8est_t * p4est,
                                             const char *filename);
 
+/** Create a context for writing a mesh that is not a forest of this kind.
+ * The points and cells are passed to \ref p8est_vtk_write_header_mesh.
+ * Since there are no trees, the tree and level fields of
+ * \ref p8est_vtk_write_cell_data are not available and the output cannot
+ * be truncated with \ref p8est_vtk_context_set_max_level.
+ * \param [in] mpicomm   The processes that write the output collectively.
+ * \param filename  The first part of the file names as in
+ *                  \ref p8est_vtk_context_new.
+ * \return          A VTK context for further use.
+ */
+p8est_vtk_context_t *p8est_vtk_context_new_mesh (sc_MPI_Comm mpicomm,
+                                                 const char *filename);
+
 /** Modify the geometry transformation registered in the context.
  * After \ref p8est_vtk_context_new, it is at the default NULL.
  * \param [in,out] cont         The context is modified.
@@ -119,6 +188,75 @@ void                p8est_vtk_context_set_scale (p8est_vtk_context_t * cont,
  */
 void                p8est_vtk_context_set_continuous (p8est_vtk_context_t *
                                                       cont, int continuous);
+
+/** Modify the context parameter for writing a single file.
+ * If set to true, all processes write their piece into one file
+ * filename.vtu using collective MPI I/O, and no per-process files or
+ * parallel meta-files are created.  The pieces are encoded as usual.
+ * After \ref p8est_vtk_context_new, it is at the default false.
+ * \param [in,out] cont         The context is modified.
+ *                              It must not yet have been used to start writing
+ *                              in \ref p8est_vtk_write_header.
+ * \param [in] single_file      Boolean parameter.
+ */
+void                p8est_vtk_context_set_single_file (p8est_vtk_context_t *
+                                                       cont, int single_file);
+
+/** Modify the context parameter for truncating the output at a level.
+ * With a nonnegative level, every leaf finer than the level is replaced
+ * by its ancestor at that level, and cell data is reduced over the leaves
+ * of each ancestor without building a coarsened forest.  This is meant
+ * for monitoring output many times smaller than the leaf mesh.
+ * An ancestor split by the partition is written by every process holding
+ * some of its leaves, each reducing over its local part.
+ * The treeid, level and mpirank fields refer to the written cells.
+ * Point data and higher order output are not supported with a level.
+ * After \ref p8est_vtk_context_new, the level is at the default -1,
+ * which writes the leaves.
+ * \param [in,out] cont         The context is modified.
+ *                              It must not yet have been used to start writing
+ *                              in \ref p8est_vtk_write_header.
+ * \param [in] max_level        Level in -1 .. P8EST_QMAXLEVEL.
+ * \param [in] reduce           Reduction of the cell data of the leaves.
+ */
+void                p8est_vtk_context_set_max_level (p8est_vtk_context_t *
+                                                     cont, int max_level,
+                                                     p8est_vtk_reduce_t
+                                                     reduce);
+
+/** Modify the context parameter for the zlib compression level.
+ * It only applies if p4est is configured with VTK compression.
+ * The data is compressed in blocks of 32 KiB, which are distributed over
+ * the threads set by \ref p4est_set_num_threads.  A level of 1 is
+ * considerably faster than the default at a moderately larger file size.
+ * After \ref p8est_vtk_context_new, it is at the default -1, which selects
+ * the default level of zlib.
+ * \param [in,out] cont         The context is modified.
+ *                              It must not yet have been used to start writing
+ *                              in \ref p8est_vtk_write_header.
+ * \param [in] level            Compression level in -1 .. 9,
+ *                              where 0 stores the data uncompressed.
+ */
+void                p8est_vtk_context_set_compression_level
+  (p8est_vtk_context_t * cont, int level);
+
+/** Modify the context parameter for the node numbering of continuous output.
+ * With continuous point data and scale == 1, the points are shared between
+ * quadrants by a degree one \ref p8est_lnodes_t numbering.  Corners that are
+ * hanging on a coarser face or edge are written as separate points.
+ * If no numbering is set, one is created and destroyed in
+ * \ref p8est_vtk_write_header.
+ * After \ref p8est_vtk_context_new, it is at the default NULL.
+ * \param [in,out] cont         The context is modified.
+ *                              It must not yet have been used to start writing
+ *                              in \ref p8est_vtk_write_header.
+ * \param [in] lnodes           A degree one node numbering of the forest,
+ *                              or NULL.  It is not owned by the context and
+ *                              must stay alive until the header is written.
+ */
+void                p8est_vtk_context_set_lnodes (p8est_vtk_context_t *
+                                                  cont,
+                                                  p8est_lnodes_t * lnodes);
 /** Cleanly destroy a \ref p8est_vtk_context_t structure.
  *
  * This function closes all the file pointers and frees the context.
@@ -163,6 +301,22 @@ void                p8est_vtk_context_destroy (p8est_vtk_context_t * context);
  */
 p8est_vtk_context_t *p8est_vtk_write_header (p8est_vtk_context_t * cont);
 
+/** Write the VTK header for the points and cells of a given mesh.
+ *
+ * This is the counterpart of \ref p8est_vtk_write_header for a mesh not
+ * computed from the forest, such as one built by another forest type.
+ * Its cells are written with the cell type of this dimension, and cell
+ * and point data refer to the mesh's cells and points.
+ *
+ * \param [in,out] cont    A VTK context as in \ref p8est_vtk_write_header.
+ * \param [in] mesh        The points and cells; its \a point_to_corner is
+ *                         copied.  It may be freed after this call.
+ * \return          The context on success, NULL on error.
+ */
+p8est_vtk_context_t *p8est_vtk_write_header_mesh (p8est_vtk_context_t * cont,
+                                                  const p8est_vtk_mesh_t *
+                                                  mesh);
+
 /** Write the VTK header for higher order visualization.
  *
  * This function follows the same routines as p8est_vtk_write_header.
@@ -187,6 +341,29 @@ p8est_vtk_context_t *p8est_vtk_write_header_ho (p8est_vtk_context_t * cont,
                                                 sc_array_t * positions,
                                                 int Nnodes1D);
 
+/** Write the VTK header for higher order visualization without building
+ * an array of all point coordinates.
+ *
+ * This function writes the same output as \ref p8est_vtk_write_header_ho.
+ * The coordinates are requested from a callback for one element at a time
+ * while the output is encoded, such that the memory used is bounded by the
+ * size of one element and the encoding buffers.  The points of the local
+ * elements are numbered consecutively in the order of the forest.
+ *
+ * \param [in,out] cont    A VTK context created by \ref p8est_vtk_context_new.
+ *                         None of the vtk_write functions must have been called.
+ *                         This context is the return value if no error occurs.
+ * \param [in] points_fn   Called once for every local quadrant in order.
+ * \param [in] user        Passed to \a points_fn.
+ * \param [in] Nnodes1D    Integer number of points in each element in 1D.
+ *
+ * \return          The context on success, NULL on error.
+ */
+p8est_vtk_context_t *p8est_vtk_write_header_ho_fn (p8est_vtk_context_t * cont,
+                                                   p8est_vtk_ho_points_t
+                                                   points_fn, void *user,
+                                                   int Nnodes1D);
+
  /** Write VTK cell data.
  *
  * There are options to have this function write
@@ -360,6 +537,88 @@ p8est_vtk_context_t *p8est_vtk_write_point_dataf (p8est_vtk_context_t * cont,
  */
 int                 p8est_vtk_write_footer (p8est_vtk_context_t * cont);
 
+/** Create the points and cells of the local quadrants in memory.
+ *
+ * This uses the same construction as \ref p8est_vtk_write_header.
+ * Cell data ordered by local quadrant applies to the mesh without a copy.
+ * If every corner is its own point, this holds for point data ordered by
+ * corner as well.  Otherwise, point data is either ordered by point, or
+ * its values are picked through the point_to_corner member.
+ * This function is not collective unless an lnodes numbering is created.
+ *
+ * \param [in] p4est       The forest.
+ * \param [in] geom        A geometry, or NULL for vertex space.
+ * \param [in] scale       Shrink factor for the quadrants in (0, 1].
+ * \param [in] continuous  If true and \a scale is 1, shared corners are
+ *                         merged into one point, except for hanging ones.
+ * \param [in] lnodes      A degree one node numbering to merge the corners,
+ *                         or NULL to create one collectively if needed.
+ * \return                 A mesh to be freed with \ref p8est_vtk_mesh_destroy.
+ */
+p8est_vtk_mesh_t   *p8est_vtk_mesh_new (p8est_t * p8est,
+                                        p8est_geometry_t * geom,
+                                        double scale, int continuous,
+                                        p8est_lnodes_t * lnodes);
+
+/** Free the memory of an in-memory mesh.
+ * \param [in] mesh        Mesh from \ref p8est_vtk_mesh_new.
+ */
+void                p8est_vtk_mesh_destroy (p8est_vtk_mesh_t * mesh);
+
+/** Begin writing the forest into one VTKHDF file readable by ParaView.
+ *
+ * Unlike the XML format, the data is written without encoding into
+ * datasets of one parallel HDF5 file, where each process stores its local
+ * quadrants as one partition of an unstructured grid.  Readers may load
+ * any subset of the partitions.  Every quadrant has its own P8EST_CHILDREN
+ * points.  The cell fields treeid, level and mpirank are always written.
+ * This function and all functions below are collective.
+ *
+ * \param [in] p8est       The forest to be written.
+ * \param [in] geom        A geometry, or NULL for vertex space.
+ * \param [in] scale       Shrink factor for the quadrants in (0, 1].
+ * \param [in] filename    Full name of the file, usually ending in .vtkhdf.
+ * \return                 A context for writing fields, NULL on error or
+ *                         if p4est is not configured with HDF5.
+ */
+p8est_vtk_hdf5_t   *p8est_vtk_hdf5_open (p8est_t * p8est,
+                                         p8est_geometry_t * geom,
+                                         double scale, const char *filename);
+
+/** Write a cell field into a VTKHDF file.
+ * \param [in] h5          Context from \ref p8est_vtk_hdf5_open.
+ * \param [in] name        Name of the field.
+ * \param [in] num_components Number of components per cell, e.g. 1 or 3.
+ * \param [in] values      Array of doubles, num_components per local
+ *                         quadrant.
+ * \return                 The context, or NULL on error; then the
+ *                         context is deallocated.
+ */
+p8est_vtk_hdf5_t   *p8est_vtk_hdf5_write_cell_data (p8est_vtk_hdf5_t * h5,
+                                                    const char *name,
+                                                    int num_components,
+                                                    sc_array_t * values);
+
+/** Write a point field into a VTKHDF file.
+ * \param [in] h5          Context from \ref p8est_vtk_hdf5_open.
+ * \param [in] name        Name of the field.
+ * \param [in] num_components Number of components per point, e.g. 1 or 3.
+ * \param [in] values      Array of doubles, num_components for each of the
+ *                         P8EST_CHILDREN corners of each local quadrant.
+ * \return                 The context, or NULL on error; then the
+ *                         context is deallocated.
+ */
+p8est_vtk_hdf5_t   *p8est_vtk_hdf5_write_point_data (p8est_vtk_hdf5_t * h5,
+                                                     const char *name,
+                                                     int num_components,
+                                                     sc_array_t * values);
+
+/** Close a VTKHDF file and deallocate the context.
+ * \param [in] h5          Context from \ref p8est_vtk_hdf5_open.
+ * \return                 0 on success, -1 on error.
+ */
+int                 p8est_vtk_hdf5_close (p8est_vtk_hdf5_t * h5);
+
 SC_EXTERN_C_END;
 
 #endif /* !P8EST_VTK_H */
@@ -47,6 +47,18 @@ typedef enum p8est_wrap_flags
 }
 p8est_wrap_flags_t;
 
+/** The stages timed by \ref p8est_wrap_adapt_partition. */
+typedef enum p8est_wrap_stage
+{
+  P8EST_WRAP_STAGE_ADAPT,       /**< Refinement and coarsening */
+  P8EST_WRAP_STAGE_BALANCE,
+  P8EST_WRAP_STAGE_PARTITION,
+  P8EST_WRAP_STAGE_GHOST,
+  P8EST_WRAP_STAGE_MESH,
+  P8EST_WRAP_STAGE_COUNT        /**< Number of stages */
+}
+p8est_wrap_stage_t;
+
 /** This structure contains the different parameters of wrap creation.
  * A default instance can be initialized by calling \ref p8est_wrap_params_init
  * and used for wrap creation by calling \ref p8est_wrap_new_params. */
@@ -54,6 +66,11 @@ typedef struct
 {
   int                 hollow;           /**< Do not allocate flags, ghost, and
                                              mesh members. */
+  int                 lazy;             /**< Boolean: If true, ghost and mesh
+                                             are not built when the forest
+                                             changes, but on first access by
+                                             \ref p8est_wrap_get_ghost or
+                                             \ref p8est_wrap_get_mesh. */
   p8est_mesh_params_t mesh_params;      /**< Parameters for mesh creation. The
                                              btype member is used for ghost
                                              creation as well. */
@@ -86,14 +103,8 @@ typedef struct p8est_wrap
   /* collection of wrap-related parameters */
   p8est_wrap_params_t params;
 
-  /** This reference counter is a workaround for internal use only.
-   * Until we have refcounting/copy-on-write for the connectivity,
-   * we count the references to conn by copies of this wrap structure.
-   * There must be no external references left when this wrap is destroyed.
-   */
-  sc_refcount_t       conn_rc;
+  /** The wrap and each of its copies hold a reference to conn. */
   p8est_connectivity_t *conn;
-  struct p8est_wrap  *conn_owner;
 
   /* these members are considered public and read-only */
   int                 p4est_dim;
@@ -113,6 +124,11 @@ typedef struct p8est_wrap
   p8est_ghost_t      *ghost_aux;
   p8est_mesh_t       *mesh_aux;
   int                 match_aux;
+
+  /* cost monitor, see p8est_wrap_monitor_check */
+  double              monitor_cost;
+  int                 monitor_steps;
+  double              monitor_migration;
 }
 p8est_wrap_t;
 
@@ -212,8 +228,10 @@ p8est_wrap_t       *p8est_wrap_new_params (sc_MPI_Comm mpicomm,
                                            p8est_wrap_params_t * params);
 
 /** Create a p8est wrapper from an existing one.
- * \note This wrapper must be destroyed before the original one.
  * We set it to hollow and copy the original p8est data structure.
+ * Without user data the copy shares its quadrants with the original
+ * until either one is changed, see \ref p8est_copy_shared.
+ * The wraps may be destroyed in any order.
  * \param [in,out] source   We access the source for debugging purposes.
  * \param [in] data_size    The data size installed in the copied forest.
  * \param [in] replace_fn     Callback to replace quadrants during refinement,
@@ -288,6 +306,8 @@ void                p8est_wrap_set_partitioning (p8est_wrap_t *pp,
 /** Return the appropriate ghost layer.
  * This function is necessary since two versions may exist simultaneously
  * after refinement and before partition/complete.
+ * If the wrap is lazy and the ghost layer is stale, it is built here.
+ * This is collective then, and all processes must call this function.
  * \param [in,out] pp The p8est wrapper to work with, must not be hollow.
  * */
 p8est_ghost_t      *p8est_wrap_get_ghost (p8est_wrap_t * pp);
@@ -295,6 +315,8 @@ p8est_ghost_t      *p8est_wrap_get_ghost (p8est_wrap_t * pp);
 /** Return the appropriate mesh structure.
  * This function is necessary since two versions may exist simultaneously
  * after refinement and before partition/complete.
+ * If the wrap is lazy and the mesh is stale, it is built here together
+ * with a stale ghost layer.  This is collective then.
  * \param [in,out] pp The p8est wrapper to work with, must not be hollow.
  * */
 p8est_mesh_t       *p8est_wrap_get_mesh (p8est_wrap_t * pp);
@@ -319,12 +341,52 @@ void                p8est_wrap_mark_coarsen (p8est_wrap_t * pp,
                                              p4est_topidx_t which_tree,
                                              p4est_locidx_t which_quad);
 
+/** Set the marks of all local elements from a dense array.
+ * This replaces all marks set previously.
+ * \param [in,out] pp The p8est wrapper to work with, must not be hollow.
+ * \param [in] marks  One entry per local element in the order of the
+ *                    trees: positive to refine, negative to coarsen and
+ *                    zero for no change.
+ */
+void                p8est_wrap_mark_array (p8est_wrap_t * pp,
+                                           const int8_t * marks);
+
+/** Set the marks of all local elements from two bitsets.
+ * This replaces all marks set previously.  Local element i is
+ * represented by the bit (1 << (i % 8)) of the byte i / 8.
+ * \param [in,out] pp The p8est wrapper to work with, must not be hollow.
+ * \param [in] refine_bits   Elements to refine; may be NULL for none.
+ * \param [in] coarsen_bits  Elements to coarsen; may be NULL for none.
+ *                           An element in both sets is refined.
+ */
+void                p8est_wrap_mark_bitset (p8est_wrap_t * pp,
+                                            const uint8_t * refine_bits,
+                                            const uint8_t * coarsen_bits);
+
+/** Set the marks of all local elements by comparing one value per element
+ * against two thresholds.  This replaces all marks set previously.
+ * \param [in,out] pp The p8est wrapper to work with, must not be hollow.
+ * \param [in] values        One value per local element in the order of
+ *                           the trees, such as an error indicator.
+ * \param [in] refine_above  Elements with a larger value are refined.
+ * \param [in] coarsen_below Elements with a smaller value are coarsened.
+ *                           Must not exceed \a refine_above.
+ * \return                   The local number of elements marked for
+ *                           refinement.
+ */
+p4est_locidx_t      p8est_wrap_mark_threshold (p8est_wrap_t * pp,
+                                               const double *values,
+                                               double refine_above,
+                                               double coarsen_below);
+
 /** Call p8est_refine, coarsen, and balance to update pp->p8est.
  * Checks pp->flags as per-quadrant input against p8est_wrap_flags_t.
  * The pp->flags array is updated along with p8est and reset to zeros.
  * Creates ghost_aux and mesh_aux to represent the intermediate mesh.
  * If zlib is available, the routine checks whether coarsening and balancing the
  * p8est canceled out and skips computing ghost_aux and mesh_aux when possible.
+ * If the wrap is lazy, ghost_aux and mesh_aux are only marked stale, and
+ * the ghost and mesh of the input forest are freed.
  * \param [in,out] pp The p8est wrapper to work with, must not be hollow.
  * \return          boolean whether p8est has changed.
  *                  If true, partition must be called.
@@ -335,7 +397,7 @@ int                 p8est_wrap_adapt (p8est_wrap_t * pp);
 
 /** Call p8est_partition for equal leaf distribution.
  * Frees the old ghost and mesh first and updates pp->flags along with p8est.
- * Creates ghost and mesh to represent the new mesh.
+ * Creates ghost and mesh to represent the new mesh, unless the wrap is lazy.
  * \param [in,out] pp The p8est wrapper to work with, must not be hollow.
  * \param [in] weight_exponent      Integer weight assigned to each leaf
  *                  according to 2 ** (level * exponent).  Passing 0 assigns
@@ -367,6 +429,60 @@ int                 p8est_wrap_partition (p8est_wrap_t * pp,
                                           p4est_locidx_t *
                                           unchanged_old_first);
 
+/** Adapt and partition the forest with a single ghost and mesh rebuild.
+ * This performs refinement, coarsening and balance as \ref p8est_wrap_adapt
+ * and the partition as \ref p8est_wrap_partition, but builds neither
+ * ghost_aux nor mesh_aux for the intermediate forest.  Ghost and mesh are
+ * only created for the partitioned forest, and not at all if the wrap is
+ * lazy.  Use this function when the intermediate mesh is not needed, for
+ * example when the replace callback takes care of the quadrant data.
+ * \param [in,out] pp The p8est wrapper to work with, must not be hollow.
+ * \param [in] weight_exponent      See \ref p8est_wrap_partition.
+ * \param [out] unchanged_first     See \ref p8est_wrap_partition.  The old
+ *                  partition is that of the forest after balance.
+ * \param [out] unchanged_length    See \ref p8est_wrap_partition.
+ * \param [out] unchanged_old_first See \ref p8est_wrap_partition.
+ * \param [out] stage_times         If not NULL, array of \ref
+ *                  P8EST_WRAP_STAGE_COUNT entries that receives the wall time
+ *                  of each stage on this process.  Skipped stages are 0.
+ * \return          boolean whether p8est has changed.  In either case,
+ *                  complete must not be called.
+ */
+int                 p8est_wrap_adapt_partition (p8est_wrap_t * pp,
+                                                int weight_exponent,
+                                                p4est_locidx_t *
+                                                unchanged_first,
+                                                p4est_locidx_t *
+                                                unchanged_length,
+                                                p4est_locidx_t *
+                                                unchanged_old_first,
+                                                double *stage_times);
+
+/** Repartition the forest for the result of the pending adaptation.
+ * Call this function after marking and before \ref p8est_wrap_adapt or
+ * \ref p8est_wrap_adapt_partition.  Each leaf is weighted by the number
+ * of leaves it is predicted to turn into: a leaf marked for refinement
+ * counts as its children, and a local family of leaves that will be
+ * coarsened counts as its parent.  Balance is not predicted.
+ * The coarse forest and its marks are moved instead of the refined one,
+ * and the subsequent adaptation happens mostly in place.
+ * The ghost and mesh are rebuilt unless the wrap is lazy, so a lazy wrap
+ * avoids building them for the intermediate partition.
+ * \param [in,out] pp The p4est wrapper to work with, must not be hollow.
+ * \param [out] unchanged_first     See \ref p8est_wrap_partition.
+ * \param [out] unchanged_length    See \ref p8est_wrap_partition.
+ * \param [out] unchanged_old_first See \ref p8est_wrap_partition.
+ * \return          boolean whether the partition has changed.
+ *                  Complete must not be called in either case.
+ */
+int                 p8est_wrap_partition_predict (p8est_wrap_t * pp,
+                                                  p4est_locidx_t *
+                                                  unchanged_first,
+                                                  p4est_locidx_t *
+                                                  unchanged_length,
+                                                  p4est_locidx_t *
+                                                  unchanged_old_first);
+
 /** Free memory for the intermediate mesh.
  * Sets mesh_aux and ghost_aux to NULL.
  * This function must be used if both refinement and partition effect changes.
@@ -375,6 +491,28 @@ int                 p8est_wrap_partition (p8est_wrap_t * pp,
  */
 void                p8est_wrap_complete (p8est_wrap_t * pp);
 
+/** Accumulate the measured cost of one step on this process.
+ * The cost is typically the wall time spent in the local computation.
+ * The accumulated cost is reset by \ref p8est_wrap_partition.
+ * \param [in,out] pp The p8est wrapper to work with.
+ * \param [in] cost   Nonnegative cost of the step, for example in seconds.
+ */
+void                p8est_wrap_monitor_add (p8est_wrap_t * pp, double cost);
+
+/** Decide whether repartitioning would pay off.
+ * This function is collective.  It gathers the accumulated costs and
+ * compares the time lost to imbalance over the next \a horizon steps with
+ * the cost of migration.  The latter is estimated from the quadrants that
+ * a cost-equalizing partition would ship, each priced by the time per
+ * shipped quadrant measured in the last changing \ref p8est_wrap_partition.
+ * Before such a measurement exists, we repartition if the largest cost
+ * exceeds the average by five percent.
+ * \param [in] pp      The p8est wrapper to work with.
+ * \param [in] horizon Nonnegative number of steps until the next check.
+ * \return             True on all processes if partition is advised.
+ */
+int                 p8est_wrap_monitor_check (p8est_wrap_t * pp, int horizon);
+
 /*** ITERATOR OVER THE FOREST LEAVES ***/
 
 typedef struct p8est_wrap_leaf
@@ -426,6 +564,35 @@ p8est_wrap_leaf_t  *p8est_wrap_leaf_first (p8est_wrap_t * pp,
  */
 p8est_wrap_leaf_t  *p8est_wrap_leaf_next (p8est_wrap_leaf_t * leaf);
 
+/** Fill caller-provided arrays with information on a range of local leaves.
+ * This is an alternative to \ref p8est_wrap_leaf_first and
+ * \ref p8est_wrap_leaf_next that processes many leaves per call.
+ * The local number of the i-th leaf filled is implicitly \a first + i.
+ * Each output array may be NULL, in which case it is not written.
+ * \param [in] pp           Legal p8est_wrap structure, hollow or not.
+ * \param [in] first        Local number of the first leaf to report,
+ *                          between 0 and the local number of quadrants.
+ * \param [in] max_count    Nonnegative maximum number of leaves to report.
+ * \param [out] which_tree  Tree number of each leaf.
+ * \param [out] which_quad  Quadrant number of each leaf relative to tree.
+ * \param [out] level       Refinement level of each leaf.
+ * \param [out] coords      Integer coordinates of each leaf, stored
+ *                          interleaved with P8EST_DIM entries per leaf.
+ * \param [out] is_mirror   True for each leaf that is a mirror.
+ *                          If not NULL, \a pp must not be hollow.
+ * \return                  The number of leaves reported, which is
+ *                          the smaller of \a max_count and the number
+ *                          of local leaves from \a first on.
+ */
+p4est_locidx_t      p8est_wrap_leaf_batch (p8est_wrap_t * pp,
+                                           p4est_locidx_t first,
+                                           p4est_locidx_t max_count,
+                                           p4est_topidx_t * which_tree,
+                                           p4est_locidx_t * which_quad,
+                                           int8_t * level,
+                                           p4est_qcoord_t * coords,
+                                           int8_t * is_mirror);
+
 SC_EXTERN_C_END;
 
 #endif /* !P8EST_WRAP_H */
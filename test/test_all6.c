@@ -23,6 +23,7 @@
 */
 
 #include <p4est_bits.h>
+#include <p4est_extended.h>
 #include <p6est.h>
 #include <p6est_extended.h>
 #include <p6est_ghost.h>
@@ -133,6 +134,518 @@ coarsen_layer_fn (p6est_t * p6est, p4est_topidx_t which_tree,
   return 1;
 }
 
+/* two forests have the same columns, column ranges and layers */
+static int
+test_p6est_is_equal (p6est_t * p6est1, p6est_t * p6est2)
+{
+  size_t              zz, first1, last1, first2, last2, k;
+  p4est_topidx_t      jt;
+  p4est_t            *columns1 = p6est1->columns;
+  p4est_t            *columns2 = p6est2->columns;
+  p4est_tree_t       *tree1, *tree2;
+  p4est_quadrant_t   *col1, *col2;
+  p2est_quadrant_t   *layer1, *layer2;
+
+  if (columns1->first_local_tree != columns2->first_local_tree ||
+      columns1->last_local_tree != columns2->last_local_tree ||
+      p6est1->layers->elem_count != p6est2->layers->elem_count) {
+    return 0;
+  }
+  for (jt = columns1->first_local_tree; jt <= columns1->last_local_tree;
+       ++jt) {
+    tree1 = p4est_tree_array_index (columns1->trees, jt);
+    tree2 = p4est_tree_array_index (columns2->trees, jt);
+    if (tree1->quadrants.elem_count != tree2->quadrants.elem_count) {
+      return 0;
+    }
+    for (zz = 0; zz < tree1->quadrants.elem_count; ++zz) {
+      col1 = p4est_quadrant_array_index (&tree1->quadrants, zz);
+      col2 = p4est_quadrant_array_index (&tree2->quadrants, zz);
+      P6EST_COLUMN_GET_RANGE (col1, &first1, &last1);
+      P6EST_COLUMN_GET_RANGE (col2, &first2, &last2);
+      if (!p4est_quadrant_is_equal (col1, col2) ||
+          first1 != first2 || last1 != last2) {
+        return 0;
+      }
+      for (k = first1; k < last1; ++k) {
+        layer1 = p2est_quadrant_array_index (p6est1->layers, k);
+        layer2 = p2est_quadrant_array_index (p6est2->layers, k);
+        if (layer1->z != layer2->z || layer1->level != layer2->level) {
+          return 0;
+        }
+      }
+    }
+  }
+  return 1;
+}
+
+/* every local column index is found in its tree */
+static void
+test_column_locate (p6est_t * p6est)
+{
+  size_t              zz, zl;
+  p4est_topidx_t      jt, tl;
+  p4est_locidx_t      lidx;
+  p4est_t            *columns = p6est->columns;
+  p4est_tree_t       *tree;
+
+  if (columns->local_num_quadrants == 0) {
+    return;
+  }
+  lidx = 0;
+  for (jt = columns->first_local_tree; jt <= columns->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (columns->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lidx) {
+      p6est_column_locate (p6est, lidx, &tl, &zl);
+      SC_CHECK_ABORT (tl == jt && zl == zz, "Column locate");
+    }
+  }
+  SC_CHECK_ABORT (lidx == columns->local_num_quadrants, "Column count");
+
+  /* one past the last column is the end of the last tree */
+  p6est_column_locate (p6est, lidx, &tl, &zl);
+  tree = p4est_tree_array_index (columns->trees, columns->last_local_tree);
+  SC_CHECK_ABORT (tl == columns->last_local_tree &&
+                  zl == tree->quadrants.elem_count, "Column locate end");
+}
+
+/* the layers split into chunks of columns are joined back in order */
+static void
+test_layers_from_chunks (p6est_t * p6est)
+{
+  const int           num_chunks = 3;
+  int                 c;
+  size_t              zz, first, last, count;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      lidx, num_columns;
+  p6est_t            *copy;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *col;
+  sc_array_t         *chunks;
+
+  copy = p6est_copy (p6est, 1);
+  chunks = P4EST_ALLOC (sc_array_t, num_chunks);
+  for (c = 0; c < num_chunks; ++c) {
+    sc_array_init (&chunks[c], sizeof (p2est_quadrant_t));
+  }
+  num_columns = copy->columns->local_num_quadrants;
+  lidx = 0;
+  for (jt = copy->columns->first_local_tree;
+       jt <= copy->columns->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (copy->columns->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lidx) {
+      c = (int) (((long long) lidx * num_chunks) / num_columns);
+      col = p4est_quadrant_array_index (&tree->quadrants, zz);
+      P6EST_COLUMN_GET_RANGE (col, &first, &last);
+      count = chunks[c].elem_count;
+      memcpy (sc_array_push_count (&chunks[c], last - first),
+              sc_array_index (copy->layers, first),
+              (last - first) * sizeof (p2est_quadrant_t));
+      P6EST_COLUMN_SET_RANGE (col, count, chunks[c].elem_count);
+    }
+  }
+  sc_array_reset (copy->layers);
+  p6est_layers_from_chunks (copy, num_chunks, chunks);
+  P4EST_FREE (chunks);
+
+  SC_CHECK_ABORT (test_p6est_is_equal (p6est, copy), "Layers from chunks");
+  p6est_destroy (copy);
+}
+
+/* the threaded layer algorithms produce the serial forest */
+static void
+test_layers_threads (p6est_t * p6est)
+{
+  int                 num_threads;
+  p6est_t            *serial, *threaded;
+
+  num_threads = p4est_get_num_threads ();
+  serial = p6est_copy (p6est, 1);
+  threaded = p6est_copy (p6est, 1);
+
+  refine_zlevel += 1;
+  p4est_set_num_threads (1);
+  p6est_refine_layers (serial, 1, refine_layer_fn, init_fn);
+  p4est_set_num_threads (4);
+  p6est_refine_layers (threaded, 1, refine_layer_fn, init_fn);
+  refine_zlevel -= 1;
+  SC_CHECK_ABORT (test_p6est_is_equal (serial, threaded),
+                  "Threaded refine layers");
+
+  p4est_set_num_threads (1);
+  p6est_balance (serial, P8EST_CONNECT_FULL, init_fn);
+  p4est_set_num_threads (4);
+  p6est_balance (threaded, P8EST_CONNECT_FULL, init_fn);
+  SC_CHECK_ABORT (test_p6est_is_equal (serial, threaded),
+                  "Threaded balance");
+
+  p4est_set_num_threads (1);
+  p6est_coarsen_layers (serial, 0, coarsen_layer_fn, init_fn);
+  p4est_set_num_threads (4);
+  p6est_coarsen_layers (threaded, 0, coarsen_layer_fn, init_fn);
+  SC_CHECK_ABORT (test_p6est_is_equal (serial, threaded),
+                  "Threaded coarsen layers");
+
+  p4est_set_num_threads (num_threads);
+  p6est_destroy (serial);
+  p6est_destroy (threaded);
+}
+
+/* refine the bottom layer of the first column of the first tree deeply */
+static int
+refine_corner_fn (p6est_t * p6est, p4est_topidx_t which_tree,
+                  p4est_quadrant_t * column, p2est_quadrant_t * layer)
+{
+  return which_tree == 0 && column->x == 0 && column->y == 0 &&
+    layer->z == 0 && layer->level < 7;
+}
+
+/* balancing after a local refinement, when the profiles change only in a
+ * few columns, gives the forest balanced in one go */
+static void
+test_balance_incremental (p6est_t * p6est)
+{
+  p6est_t            *direct, *incremental, *again;
+
+  direct = p6est_copy (p6est, 1);
+  p6est_refine_layers (direct, 1, refine_corner_fn, init_fn);
+  p6est_balance (direct, P8EST_CONNECT_FULL, init_fn);
+
+  incremental = p6est_copy (p6est, 1);
+  p6est_balance (incremental, P8EST_CONNECT_FULL, init_fn);
+  again = p6est_copy (incremental, 1);
+  p6est_balance (again, P8EST_CONNECT_FULL, init_fn);
+  SC_CHECK_ABORT (test_p6est_is_equal (incremental, again),
+                  "Balance is not idempotent");
+  p6est_destroy (again);
+
+  p6est_refine_layers (incremental, 1, refine_corner_fn, init_fn);
+  p6est_balance (incremental, P8EST_CONNECT_FULL, init_fn);
+  SC_CHECK_ABORT (test_p6est_is_equal (direct, incremental),
+                  "Incremental balance");
+
+  p6est_destroy (direct);
+  p6est_destroy (incremental);
+}
+
+/* the layer arrays mirror the layers and write their data back */
+static void
+test_layers_soa (p6est_t * p6est)
+{
+  size_t              zz;
+  p6est_t            *copy;
+  p6est_layers_soa_t *soa;
+  p2est_quadrant_t   *layer;
+
+  copy = p6est_copy (p6est, 1);
+  p6est_reset_data (copy, sizeof (p4est_gloidx_t), init_fn,
+                    TEST_USER_POINTER);
+  for (zz = 0; zz < copy->layers->elem_count; ++zz) {
+    layer = p2est_quadrant_array_index (copy->layers, zz);
+    *(p4est_gloidx_t *) layer->p.user_data = (p4est_gloidx_t) zz;
+  }
+
+  soa = p6est_layers_soa_new (copy, 0);
+  SC_CHECK_ABORT (soa->num_layers == copy->layers->elem_count &&
+                  soa->data_size == 0 && soa->data == NULL,
+                  "Layer arrays without data");
+  p6est_layers_soa_destroy (soa);
+
+  soa = p6est_layers_soa_new (copy, 1);
+  SC_CHECK_ABORT (soa->num_layers == copy->layers->elem_count &&
+                  soa->data_size == copy->data_size,
+                  "Layer arrays with data");
+  for (zz = 0; zz < soa->num_layers; ++zz) {
+    layer = p2est_quadrant_array_index (copy->layers, zz);
+    SC_CHECK_ABORT (soa->z[zz] == layer->z && soa->level[zz] == layer->level
+                    && ((p4est_gloidx_t *) soa->data)[zz] ==
+                    (p4est_gloidx_t) zz, "Layer arrays content");
+    ((p4est_gloidx_t *) soa->data)[zz] = -(p4est_gloidx_t) zz;
+  }
+  p6est_layers_soa_store (soa, copy);
+  for (zz = 0; zz < soa->num_layers; ++zz) {
+    layer = p2est_quadrant_array_index (copy->layers, zz);
+    SC_CHECK_ABORT (*(p4est_gloidx_t *) layer->p.user_data ==
+                    -(p4est_gloidx_t) zz, "Layer arrays store");
+  }
+  p6est_layers_soa_destroy (soa);
+  p6est_destroy (copy);
+}
+
+/* layer data identifying the column and the layer and an exchange round */
+typedef struct test_layer_data
+{
+  p4est_gloidx_t      column;
+  p4est_gloidx_t      z;
+  p4est_gloidx_t      level;
+  p4est_gloidx_t      round;
+}
+test_layer_data_t;
+
+/* the data of every ghost layer as computed from the ghost columns */
+static void
+test_ghost_expected (p6est_t * p6est, p6est_ghost_t * ghost,
+                     int round, test_layer_data_t * expected)
+{
+  int                 p;
+  size_t              zz, zy;
+  p4est_locidx_t      gfirst, glast;
+  p4est_ghost_t      *cghost = ghost->column_ghost;
+  p4est_quadrant_t   *col;
+  p2est_quadrant_t   *layer;
+
+  p = 0;
+  for (zz = 0; zz < cghost->ghosts.elem_count; ++zz) {
+    while ((size_t) cghost->proc_offsets[p + 1] <= zz) {
+      ++p;
+    }
+    col = p4est_quadrant_array_index (&cghost->ghosts, zz);
+    gfirst = *(p4est_locidx_t *) sc_array_index
+      (ghost->column_layer_offsets, zz);
+    glast = *(p4est_locidx_t *) sc_array_index
+      (ghost->column_layer_offsets, zz + 1);
+    for (zy = (size_t) gfirst; zy < (size_t) glast; ++zy) {
+      layer = p2est_quadrant_array_index (&ghost->ghosts, zy);
+      expected[zy].column = p6est->columns->global_first_quadrant[p] +
+        col->p.piggy3.local_num;
+      expected[zy].z = layer->z;
+      expected[zy].level = layer->level;
+      expected[zy].round = round;
+    }
+  }
+}
+
+/* exchange layer data in all ways and compare with the ghost columns */
+static void
+test_ghost_exchange (p6est_t * p6est)
+{
+  const size_t        ds = sizeof (test_layer_data_t);
+  int                 round;
+  size_t              zz, zy, first, last, nghosts;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      lcol;
+  p6est_t            *copy;
+  p6est_ghost_t      *ghost;
+  p6est_ghost_exchange_t *exc;
+  p6est_ghost_plan_t *plan;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *col;
+  p2est_quadrant_t   *layer;
+  test_layer_data_t  *layer_data, *ghost_data, *expected, *plan_data;
+
+  copy = p6est_copy (p6est, 1);
+  p6est_reset_data (copy, ds, init_fn, TEST_USER_POINTER);
+  layer_data = P4EST_ALLOC_ZERO (test_layer_data_t,
+                                 copy->layers->elem_count);
+  lcol = 0;
+  for (jt = copy->columns->first_local_tree;
+       jt <= copy->columns->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (copy->columns->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lcol) {
+      col = p4est_quadrant_array_index (&tree->quadrants, zz);
+      P6EST_COLUMN_GET_RANGE (col, &first, &last);
+      for (zy = first; zy < last; ++zy) {
+        layer = p2est_quadrant_array_index (copy->layers, zy);
+        layer_data[zy].column =
+          copy->columns->global_first_quadrant[copy->mpirank] + lcol;
+        layer_data[zy].z = layer->z;
+        layer_data[zy].level = layer->level;
+        layer_data[zy].round = 0;
+        memcpy (layer->p.user_data, &layer_data[zy], ds);
+      }
+    }
+  }
+
+  ghost = p6est_ghost_new (copy, P4EST_CONNECT_FULL);
+  nghosts = ghost->ghosts.elem_count;
+  expected = P4EST_ALLOC_ZERO (test_layer_data_t, nghosts + 1);
+  ghost_data = P4EST_ALLOC (test_layer_data_t, nghosts + 1);
+  test_ghost_expected (copy, ghost, 0, expected);
+
+  /* the user data of the layers */
+  memset (ghost_data, -1, nghosts * ds);
+  p6est_ghost_exchange_data (copy, ghost, ghost_data);
+  SC_CHECK_ABORT (!memcmp (ghost_data, expected, nghosts * ds),
+                  "Ghost exchange data");
+  memset (ghost_data, -1, nghosts * ds);
+  exc = p6est_ghost_exchange_data_begin (copy, ghost, ghost_data);
+  p6est_ghost_exchange_data_end (exc);
+  SC_CHECK_ABORT (!memcmp (ghost_data, expected, nghosts * ds),
+                  "Ghost exchange data begin and end");
+
+  /* contiguous layer data */
+  memset (ghost_data, -1, nghosts * ds);
+  p6est_ghost_exchange_custom (copy, ghost, ds, layer_data, ghost_data);
+  SC_CHECK_ABORT (!memcmp (ghost_data, expected, nghosts * ds),
+                  "Ghost exchange custom");
+  memset (ghost_data, -1, nghosts * ds);
+  exc = p6est_ghost_exchange_custom_begin (copy, ghost, ds, layer_data,
+                                           ghost_data);
+  p6est_ghost_exchange_custom_end (exc);
+  SC_CHECK_ABORT (!memcmp (ghost_data, expected, nghosts * ds),
+                  "Ghost exchange custom begin and end");
+
+  /* a plan is reused for changing contiguous and user data */
+  plan = p6est_ghost_plan_new (copy, ghost, ds);
+  for (round = 1; round <= 2; ++round) {
+    for (zz = 0; zz < copy->layers->elem_count; ++zz) {
+      layer_data[zz].round = round;
+    }
+    test_ghost_expected (copy, ghost, round, expected);
+    plan_data = (test_layer_data_t *)
+      p6est_ghost_plan_exchange (plan, layer_data);
+    SC_CHECK_ABORT (!memcmp (plan_data, expected, nghosts * ds),
+                    "Ghost plan exchange");
+  }
+  test_ghost_expected (copy, ghost, 0, expected);
+  p6est_ghost_plan_begin (plan, NULL);
+  plan_data = (test_layer_data_t *) p6est_ghost_plan_end (plan);
+  SC_CHECK_ABORT (!memcmp (plan_data, expected, nghosts * ds),
+                  "Ghost plan begin and end");
+  p6est_ghost_plan_destroy (plan);
+
+  P4EST_FREE (layer_data);
+  P4EST_FREE (ghost_data);
+  P4EST_FREE (expected);
+  p6est_ghost_destroy (ghost);
+  p6est_destroy (copy);
+}
+
+/* every node is used and element interior nodes belong to one element */
+static void
+test_lnodes (p6est_t * p6est, p6est_lnodes_t * lnodes)
+{
+  int                 i, j, k, n, degree = lnodes->degree;
+  p4est_locidx_t      el, nid, *count;
+
+  SC_CHECK_ABORT (lnodes->num_local_elements ==
+                  (p4est_locidx_t) p6est->layers->elem_count &&
+                  lnodes->vnodes == (degree + 1) * (degree + 1) *
+                  (degree + 1), "Lnodes size");
+  count = P4EST_ALLOC_ZERO (p4est_locidx_t, lnodes->num_local_nodes);
+  for (el = 0; el < lnodes->num_local_elements; ++el) {
+    for (n = 0, k = 0; k <= degree; ++k) {
+      for (j = 0; j <= degree; ++j) {
+        for (i = 0; i <= degree; ++i, ++n) {
+          nid = lnodes->element_nodes[el * lnodes->vnodes + n];
+          SC_CHECK_ABORT (0 <= nid && nid < lnodes->num_local_nodes,
+                          "Lnodes node range");
+          if (0 < i && i < degree && 0 < j && j < degree &&
+              0 < k && k < degree) {
+            SC_CHECK_ABORT (count[nid] == 0, "Lnodes interior node");
+            count[nid] = -1;
+          }
+          else {
+            SC_CHECK_ABORT (count[nid] >= 0, "Lnodes boundary node");
+            ++count[nid];
+          }
+        }
+      }
+    }
+  }
+  for (nid = 0; nid < lnodes->num_local_nodes; ++nid) {
+    SC_CHECK_ABORT (count[nid] != 0, "Lnodes unused node");
+  }
+  P4EST_FREE (count);
+}
+
+#ifdef P4EST_ENABLE_FILE_DEPRECATED
+
+/* user strings are read back padded with spaces */
+static int
+test_user_string (const char *read_string, const char *string)
+{
+  return !strncmp (read_string, string, strlen (string));
+}
+
+/* write a layer field and the forest to a file and read them back */
+static void
+test_file (p6est_t * p6est)
+{
+  const char         *filename = "test_all6.p6d";
+  int                 errcode;
+  char                user_string[P4EST_FILE_USER_STRING_BYTES];
+  char                data_string[P4EST_FILE_USER_STRING_BYTES];
+  size_t              zz;
+  p4est_gloidx_t      gnl, *gidx;
+  p2est_quadrant_t   *layer, *loaded_layer;
+  p4est_file_context_t *fc;
+  p6est_t            *copy, *loaded;
+  sc_array_t         *field, *read_field;
+
+  /* the data of every layer and a separate field hold its global index */
+  copy = p6est_copy (p6est, 1);
+  SC_CHECK_ABORT (copy->data_size >= sizeof (char), "Layer data size");
+  field = sc_array_new_count (sizeof (p4est_gloidx_t),
+                              copy->layers->elem_count);
+  for (zz = 0; zz < copy->layers->elem_count; ++zz) {
+    gidx = (p4est_gloidx_t *) sc_array_index (field, zz);
+    *gidx = copy->global_first_layer[copy->mpirank] + (p4est_gloidx_t) zz;
+    layer = p2est_quadrant_array_index (copy->layers, zz);
+    memset (layer->p.user_data, (int) (*gidx % 127), copy->data_size);
+  }
+
+  fc = p6est_file_open_create (copy, filename, "p6est file", &errcode);
+  SC_CHECK_ABORT (fc != NULL, "Open create p6est file");
+  SC_CHECK_ABORT (p4est_file_get_global_num_quadrants (fc) ==
+                  copy->global_first_layer[copy->mpisize],
+                  "Global number of layers in file");
+  fc = p6est_file_write_field (fc, copy, field->elem_size, field,
+                               "Global layer index", &errcode);
+  SC_CHECK_ABORT (fc != NULL, "Write p6est field");
+  fc = p6est_file_write_p6est (fc, copy, "Layers", "Layer data", &errcode);
+  SC_CHECK_ABORT (fc != NULL, "Write p6est");
+  SC_CHECK_ABORT (p4est_file_close (fc, &errcode) == 0,
+                  "Close p6est file");
+
+  fc = p4est_file_open_read_ext (copy->mpicomm, filename, user_string,
+                                 &gnl, &errcode);
+  SC_CHECK_ABORT (fc != NULL &&
+                  test_user_string (user_string, "p6est file") &&
+                  gnl == copy->global_first_layer[copy->mpisize],
+                  "Open read p6est file");
+  read_field = sc_array_new (sizeof (p4est_gloidx_t));
+  fc = p6est_file_read_field (fc, copy, read_field->elem_size, read_field,
+                              user_string, &errcode);
+  SC_CHECK_ABORT (fc != NULL &&
+                  test_user_string (user_string, "Global layer index") &&
+                  sc_array_is_equal (field, read_field), "Read p6est field");
+  fc = p6est_file_read_p6est (fc, copy->connectivity, copy->data_size,
+                              &loaded, user_string, data_string, &errcode);
+  SC_CHECK_ABORT (fc != NULL && test_user_string (user_string, "Layers") &&
+                  test_user_string (data_string, "Layer data"), "Read p6est");
+  SC_CHECK_ABORT (p4est_file_close (fc, &errcode) == 0,
+                  "Close p6est file 2");
+
+  /* the forest is read in a partition without split columns */
+  SC_CHECK_ABORT (loaded->global_first_layer[loaded->mpisize] ==
+                  copy->global_first_layer[copy->mpisize] &&
+                  loaded->columns->global_num_quadrants ==
+                  copy->columns->global_num_quadrants, "Compare counts");
+  if (!memcmp (loaded->global_first_layer, copy->global_first_layer,
+               (copy->mpisize + 1) * sizeof (p4est_gloidx_t))) {
+    SC_CHECK_ABORT (test_p6est_is_equal (copy, loaded), "Compare p6est");
+    for (zz = 0; zz < copy->layers->elem_count; ++zz) {
+      layer = p2est_quadrant_array_index (copy->layers, zz);
+      loaded_layer = p2est_quadrant_array_index (loaded->layers, zz);
+      SC_CHECK_ABORT (!memcmp (layer->p.user_data,
+                               loaded_layer->p.user_data, copy->data_size),
+                      "Compare layer data");
+    }
+  }
+  if (p4est_have_zlib ()) {
+    SC_CHECK_ABORT (p6est_checksum (copy) == p6est_checksum (loaded),
+                    "Compare p6est checksums");
+  }
+
+  sc_array_destroy (field);
+  sc_array_destroy (read_field);
+  p6est_destroy (loaded);
+  p6est_destroy (copy);
+}
+
+#endif /* P4EST_ENABLE_FILE_DEPRECATED */
+
 enum
 {
   TIMINGS_CONNECTIVITY,
@@ -262,6 +775,16 @@ main (int argc, char **argv)
   sc_stats_set1 (&stats[TIMINGS_REFINE_COLUMNS_B], snapshot.iwtime,
                  "Refine layers B");
 
+  test_column_locate (p6est);
+  test_layers_from_chunks (p6est);
+  test_layers_threads (p6est);
+  test_balance_incremental (p6est);
+  test_ghost_exchange (p6est);
+  test_layers_soa (p6est);
+#ifdef P4EST_ENABLE_FILE_DEPRECATED
+  test_file (p6est);
+#endif
+
   copy_p6est = p6est_copy (p6est, 1);
   sc_flops_snap (&fi, &snapshot);
   p6est_coarsen_columns (copy_p6est, 1, coarsen_column_fn, init_fn);
@@ -355,7 +878,20 @@ main (int argc, char **argv)
                  "Partition same");
 
   if (vtk) {
+    p8est_vtk_context_t *cont;
+
     p6est_vtk_write_file (p6est, "p6est_test_partition");
+
+    /* the same forest through the context writer into a single file */
+    cont = p6est_vtk_context_new (p6est, "p6est_test_partition_single");
+    p8est_vtk_context_set_single_file (cont, 1);
+    cont = p6est_vtk_write_header_layers (cont, p6est, 0.95);
+    SC_CHECK_ABORT (cont != NULL, "p6est_vtk: Error writing header");
+    cont = p6est_vtk_write_cell_data (cont, p6est, 1, 1, 1, 0, 0, 0,
+                                      NULL, NULL);
+    SC_CHECK_ABORT (cont != NULL, "p6est_vtk: Error writing cell data");
+    SC_CHECK_ABORT (!p8est_vtk_write_footer (cont),
+                    "p6est_vtk: Error writing footer");
   }
 
   for (i = 1; i <= 3; i++) {
@@ -375,6 +911,7 @@ main (int argc, char **argv)
       sc_stats_set1 (&stats[TIMINGS_LNODES_3], snapshot.iwtime, "Lnodes 3");
       break;
     }
+    test_lnodes (p6est, lnodes);
 
     p6est_lnodes_destroy (lnodes);
   }
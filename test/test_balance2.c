@@ -92,6 +92,347 @@ test_checksum (p4est_t * p4est, int have_zlib)
   return have_zlib ? p4est_checksum (p4est) : 0;
 }
 
+/* balance a refined copy of the forest using a number of threads */
+static unsigned
+test_threads (p4est_t * p4est, int num_threads, int have_zlib)
+{
+  int                 i;
+  unsigned            crc;
+  p4est_t            *copy;
+  p4est_inspect_t     inspect;
+
+  memset (&inspect, 0, sizeof (inspect));
+  copy = p4est_copy (p4est, 0);
+  copy->inspect = &inspect;
+  p4est_refine (copy, 0, refine_fn, NULL);
+
+  p4est_set_num_threads (num_threads);
+  p4est_balance (copy, P4EST_CONNECT_FULL, NULL);
+  p4est_set_num_threads (1);
+  SC_CHECK_ABORT (p4est_is_balanced (copy, P4EST_CONNECT_FULL),
+                  "Balance threads");
+  SC_CHECK_ABORT (inspect.balance_num_threads >= 1 &&
+                  inspect.balance_num_threads <= num_threads,
+                  "Balance thread count");
+  for (i = 0; i < SC_MIN (inspect.balance_num_threads,
+                          P4EST_INSPECT_MAX_THREADS); ++i) {
+    SC_CHECK_ABORT (inspect.balance_A_threads[i] >= 0. &&
+                    inspect.balance_B_threads[i] >= 0.,
+                    "Balance thread times");
+  }
+  crc = test_checksum (copy, have_zlib);
+
+  copy->inspect = NULL;
+  p4est_destroy (copy);
+  return crc;
+}
+
+/* balance a refined copy of the forest with the merged overlap search */
+static unsigned
+test_overlap_merge (p4est_t * p4est, int have_zlib)
+{
+  unsigned            crc;
+  p4est_t            *copy;
+  p4est_inspect_t     inspect;
+
+  memset (&inspect, 0, sizeof (inspect));
+  inspect.use_overlap_merge = 1;
+  copy = p4est_copy (p4est, 0);
+  copy->inspect = &inspect;
+  p4est_refine (copy, 0, refine_fn, NULL);
+  p4est_balance (copy, P4EST_CONNECT_FULL, NULL);
+  SC_CHECK_ABORT (p4est_is_balanced (copy, P4EST_CONNECT_FULL),
+                  "Balance overlap merge");
+  crc = test_checksum (copy, have_zlib);
+
+  copy->inspect = NULL;
+  p4est_destroy (copy);
+  return crc;
+}
+
+/* the precheck skips a balanced forest and balances an unbalanced one */
+static void
+test_precheck (p4est_t * p4est, int have_zlib)
+{
+  long                revision;
+  p4est_t            *copy;
+  p4est_inspect_t     inspect;
+
+  memset (&inspect, 0, sizeof (inspect));
+  inspect.use_balance_precheck = 1;
+  copy = p4est_new_ext (p4est->mpicomm, p4est->connectivity, 0, 2, 1, 0,
+                        NULL, NULL);
+  copy->inspect = &inspect;
+  revision = p4est_revision (copy);
+  p4est_balance (copy, P4EST_CONNECT_FULL, NULL);
+  SC_CHECK_ABORT (inspect.records[P4EST_INSPECT_BALANCE].calls == 0 &&
+                  p4est_revision (copy) == revision, "Precheck uniform");
+  copy->inspect = NULL;
+  p4est_destroy (copy);
+
+  memset (&inspect, 0, sizeof (inspect));
+  inspect.use_balance_precheck = 1;
+  copy = p4est_copy (p4est, 0);
+  copy->inspect = &inspect;
+  p4est_refine (copy, 0, refine_fn, NULL);
+  p4est_balance (copy, P4EST_CONNECT_FULL, NULL);
+  SC_CHECK_ABORT (inspect.records[P4EST_INSPECT_BALANCE].calls == 1 &&
+                  p4est_is_balanced (copy, P4EST_CONNECT_FULL),
+                  "Precheck refined");
+  SC_CHECK_ABORT (test_checksum (copy, have_zlib) ==
+                  test_threads (p4est, 1, have_zlib), "Precheck crc");
+  copy->inspect = NULL;
+  p4est_destroy (copy);
+}
+
+/* nesting depth and number of the annotated regions */
+typedef struct test_regions
+{
+  int                 depth;
+  int                 count;
+}
+test_regions_t;
+
+static void
+region_begin (const char *region, void *user)
+{
+  test_regions_t     *regions = (test_regions_t *) user;
+
+  SC_CHECK_ABORT (region != NULL, "Region name");
+  ++regions->depth;
+  ++regions->count;
+}
+
+static void
+region_end (const char *region, void *user)
+{
+  test_regions_t     *regions = (test_regions_t *) user;
+
+  SC_CHECK_ABORT (region != NULL, "Region name");
+  SC_CHECK_ABORT (regions->depth > 0, "Region nesting");
+  --regions->depth;
+}
+
+/* balance a refined copy of the forest in two phases */
+static void
+test_split (p4est_t * p4est)
+{
+  long                revision;
+  p4est_topidx_t      nt;
+  p4est_t            *ref, *copy;
+  p4est_tree_t       *tree;
+  p4est_inspect_t     inspect;
+  p4est_balance_context_t *ctx;
+  test_regions_t      regions;
+
+  ref = p4est_copy (p4est, 0);
+  p4est_refine (ref, 0, refine_fn, NULL);
+  copy = p4est_copy (ref, 0);
+  revision = ref->revision + 1;
+  copy->revision = ref->revision;
+  p4est_balance_ext (ref, P4EST_CONNECT_FULL, init_fn, NULL);
+
+  /* use and verify the node-aware notification as well */
+  memset (&inspect, 0, sizeof (inspect));
+  inspect.use_notify_nodes = 1;
+  inspect.use_balance_verify = 1;
+  copy->inspect = &inspect;
+  memset (&regions, 0, sizeof (regions));
+  p4est_set_region_hooks (region_begin, region_end, &regions);
+  ctx = p4est_balance_begin (copy, P4EST_CONNECT_FULL, init_fn, NULL);
+  SC_CHECK_ABORT (regions.depth == 0 && regions.count > 0,
+                  "Balance split regions");
+
+  /* read-only work on the forest is permitted in the meantime */
+  for (nt = copy->first_local_tree; nt <= copy->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (copy->trees, nt);
+    SC_CHECK_ABORT (p4est_tree_is_linear (tree), "Balance split linear");
+  }
+
+  p4est_balance_end (ctx);
+  p4est_set_region_hooks (NULL, NULL, NULL);
+  SC_CHECK_ABORT (regions.depth == 0, "Balance split regions");
+  SC_CHECK_ABORT (p4est_is_balanced (copy, P4EST_CONNECT_FULL),
+                  "Balance split");
+  SC_CHECK_ABORT (p4est_is_equal (ref, copy, 0), "Balance split equal");
+  copy->inspect = NULL;
+  SC_CHECK_ABORT (ref->revision == revision &&
+                  copy->revision == revision, "Balance split revision");
+
+  p4est_destroy (copy);
+  p4est_destroy (ref);
+}
+
+/* balancing several forests together equals balancing each alone */
+static void
+test_ensemble (p4est_t * p4est)
+{
+  int                 f;
+  p4est_t            *forests[3], *refs[3];
+
+  forests[0] = p4est_copy (p4est, 0);
+  p4est_refine (forests[0], 0, refine_fn, NULL);
+  forests[1] = p4est_copy (forests[0], 0);
+  p4est_refine (forests[1], 0, refine_fn, NULL);
+  forests[2] = p4est_new_ext (p4est->mpicomm, p4est->connectivity, 0, 2, 1,
+                              0, NULL, NULL);
+  for (f = 0; f < 3; ++f) {
+    refs[f] = p4est_copy (forests[f], 0);
+    p4est_balance_ext (refs[f], P4EST_CONNECT_FULL, init_fn, NULL);
+  }
+
+  p4est_balance_ensemble (3, forests, P4EST_CONNECT_FULL, init_fn, NULL);
+  for (f = 0; f < 3; ++f) {
+    SC_CHECK_ABORT (p4est_is_balanced (forests[f], P4EST_CONNECT_FULL),
+                    "Balance ensemble");
+    SC_CHECK_ABORT (p4est_is_equal (refs[f], forests[f], 0),
+                    "Balance ensemble equal");
+    p4est_destroy (refs[f]);
+    p4est_destroy (forests[f]);
+  }
+
+  /* an empty ensemble does not communicate */
+  p4est_balance_ensemble (0, NULL, P4EST_CONNECT_FULL, NULL, NULL);
+}
+
+static p4est_topidx_t refine_some_tree = 1;
+
+/* refine a few quadrants of one tree only */
+static int
+refine_some_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+                p4est_quadrant_t * quadrant)
+{
+  return which_tree == refine_some_tree &&
+    quadrant->x == 0 && quadrant->y == 0 &&
+#ifdef P4_TO_P8
+    quadrant->z == 0 &&
+#endif
+    quadrant->level < P4EST_QMAXLEVEL;
+}
+
+/* balance a balanced forest after localized refinement incrementally */
+static void
+test_incremental (p4est_t * p4est)
+{
+  p4est_t            *ref, *copy;
+  p4est_inspect_t     inspect;
+
+  ref = p4est_copy (p4est, 0);
+  copy = p4est_copy (p4est, 0);
+  memset (&inspect, 0, sizeof (inspect));
+  copy->inspect = &inspect;
+  p4est_set_balance_incremental (copy, 1);
+
+  /* the first balance knows nothing and runs in full */
+  inspect.balance_A = -1.;
+  p4est_balance (copy, P4EST_CONNECT_FULL, NULL);
+  SC_CHECK_ABORT (inspect.balance_A >= 0., "Incremental first");
+
+  /* an unchanged forest is not balanced again, even after partition */
+  inspect.balance_A = -1.;
+  p4est_balance (copy, P4EST_CONNECT_FACE, NULL);
+  SC_CHECK_ABORT (inspect.balance_A == -1., "Incremental skip");
+  p4est_partition (copy, 0, NULL);
+  p4est_balance (copy, P4EST_CONNECT_FULL, NULL);
+  SC_CHECK_ABORT (inspect.balance_A == -1., "Incremental partition");
+
+  /* localized refinement must produce the same forest as before */
+  p4est_partition (ref, 0, NULL);
+  p4est_refine (ref, 0, refine_some_fn, NULL);
+  p4est_refine (ref, 0, refine_some_fn, NULL);
+  p4est_refine (copy, 0, refine_some_fn, NULL);
+  p4est_refine (copy, 0, refine_some_fn, NULL);
+  p4est_balance (ref, P4EST_CONNECT_FULL, NULL);
+  p4est_balance (copy, P4EST_CONNECT_FULL, NULL);
+  SC_CHECK_ABORT (inspect.balance_A >= 0., "Incremental refine");
+  SC_CHECK_ABORT (p4est_is_equal (ref, copy, 0), "Incremental equal");
+
+  /* and so must refinement followed by partition */
+  refine_some_tree = 0;
+  p4est_refine (ref, 0, refine_some_fn, NULL);
+  p4est_refine (copy, 0, refine_some_fn, NULL);
+  refine_some_tree = 1;
+  p4est_partition (ref, 0, NULL);
+  p4est_partition (copy, 0, NULL);
+  p4est_balance (ref, P4EST_CONNECT_FULL, NULL);
+  p4est_balance (copy, P4EST_CONNECT_FULL, NULL);
+  SC_CHECK_ABORT (p4est_is_equal (ref, copy, 0), "Incremental partition eq");
+
+  copy->inspect = NULL;
+  p4est_set_balance_incremental (copy, 0);
+  p4est_destroy (copy);
+  p4est_destroy (ref);
+}
+
+/* refine_balanced must produce the same forest as refine and balance */
+static void
+test_refine_balanced (p4est_t * p4est)
+{
+  int                 i;
+  p4est_t            *ref, *copy;
+
+  ref = p4est_copy (p4est, 0);
+  copy = p4est_copy (p4est, 0);
+  for (i = 0; i < 2; ++i) {
+    p4est_refine (ref, 0, refine_some_fn, NULL);
+    p4est_balance (ref, P4EST_CONNECT_FULL, NULL);
+    p4est_refine_balanced (copy, 0, -1, P4EST_CONNECT_FULL,
+                           refine_some_fn, NULL, NULL);
+    SC_CHECK_ABORT (p4est_is_balanced (copy, P4EST_CONNECT_FULL),
+                    "Refine balanced");
+    SC_CHECK_ABORT (p4est_is_equal (ref, copy, 0), "Refine balanced equal");
+  }
+
+  /* with incremental tracking the forest is known to be balanced */
+  p4est_set_balance_incremental (copy, 1);
+  p4est_balance (copy, P4EST_CONNECT_FULL, NULL);
+  p4est_refine (ref, 0, refine_some_fn, NULL);
+  p4est_balance (ref, P4EST_CONNECT_FULL, NULL);
+  p4est_refine_balanced (copy, 0, -1, P4EST_CONNECT_FULL,
+                         refine_some_fn, NULL, NULL);
+  SC_CHECK_ABORT (p4est_is_equal (ref, copy, 0), "Refine balanced tracked");
+
+  p4est_destroy (copy);
+  p4est_destroy (ref);
+}
+
+/* balance takes its temporary arrays from the scratch arena */
+static void
+test_scratch (p4est_t * p4est, int have_zlib)
+{
+  unsigned            crc;
+  size_t              used;
+  sc_array_t         *array, *again;
+  p4est_t            *copy;
+
+  copy = p4est_copy (p4est, 0);
+  p4est_refine (copy, 0, refine_fn, NULL);
+  p4est_balance (copy, P4EST_CONNECT_FULL, NULL);
+  crc = test_checksum (copy, have_zlib);
+
+  /* a returned array is handed out again, empty */
+  array = p4est_scratch_array_new (copy, sizeof (p4est_quadrant_t));
+  SC_CHECK_ABORT (array->elem_count == 0, "Scratch new");
+  sc_array_resize (array, 10);
+  p4est_scratch_array_destroy (copy, array);
+  again = p4est_scratch_array_new (copy, sizeof (p4est_quadrant_t));
+  SC_CHECK_ABORT (again == array && again->elem_count == 0, "Scratch reuse");
+  p4est_scratch_array_destroy (copy, again);
+
+  /* balancing again with kept arrays does not change the forest */
+  p4est_set_num_threads (4);
+  p4est_balance (copy, P4EST_CONNECT_FULL, NULL);
+  p4est_set_num_threads (1);
+  p4est_balance (copy, P4EST_CONNECT_FULL, NULL);
+  SC_CHECK_ABORT (test_checksum (copy, have_zlib) == crc, "Scratch balance");
+
+  used = p4est_memory_used (copy);
+  p4est_scratch_trim (copy, 0);
+  SC_CHECK_ABORT (copy->scratch == NULL, "Scratch trim");
+  SC_CHECK_ABORT (p4est_memory_used (copy) < used, "Scratch memory");
+  p4est_destroy (copy);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -203,6 +544,32 @@ main (int argc, char **argv)
   p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
   SC_CHECK_ABORT (test_checksum (p4est, have_zlib) == crc, "Rebalance");
 
+  /* threaded balance must produce the same forest */
+  SC_CHECK_ABORT (test_threads (p4est, 1, have_zlib) ==
+                  test_threads (p4est, 4, have_zlib), "Balance threads crc");
+
+  /* so must the merged overlap search */
+  SC_CHECK_ABORT (test_threads (p4est, 1, have_zlib) ==
+                  test_overlap_merge (p4est, have_zlib), "Overlap merge crc");
+
+  /* so must balance with the precheck */
+  test_precheck (p4est, have_zlib);
+
+  /* split balance must produce the same forest */
+  test_split (p4est);
+
+  /* so must balancing several forests together */
+  test_ensemble (p4est);
+
+  /* incremental balance must produce the same forest */
+  test_incremental (p4est);
+
+  /* so must refinement with the ripple inserted locally */
+  test_refine_balanced (p4est);
+
+  /* balance with reused temporary arrays must produce the same forest */
+  test_scratch (p4est, have_zlib);
+
   /* clean up and exit */
   P4EST_ASSERT (p4est->user_data_pool->elem_count ==
                 (size_t) p4est->local_num_quadrants);
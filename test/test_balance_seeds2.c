@@ -300,6 +300,88 @@ compare_seeds (sc_array_t * seeds, sc_array_t * seeds_check)
   }
 }
 
+/* compare the batched split test to the single seeds functions */
+static void
+check_seeds_batch (p4est_quadrant_t * root, int level)
+{
+  int                 k, b, which;
+  size_t              zz, count, nsplit;
+  uint64_t            i, ifirst;
+  int8_t             *split;
+  p4est_quadrant_t    p, desc, *qs;
+  p4est_connect_type_t balance;
+#ifndef P4_TO_P8
+  const int           nkinds = 2;
+  const p4est_connect_type_t btypes[2] =
+    { P4EST_CONNECT_FACE, P4EST_CONNECT_FULL };
+#else
+  const int           nkinds = 3;
+  const p4est_connect_type_t btypes[3] =
+    { P8EST_CONNECT_FACE, P8EST_CONNECT_EDGE, P8EST_CONNECT_FULL };
+#endif
+
+  /* all descendants of root on this level */
+  p4est_quadrant_first_descendant (root, &desc, level);
+  ifirst = p4est_quadrant_linear_id (&desc, level);
+  count = (size_t) 1 << (P4EST_DIM * (level - root->level));
+  qs = P4EST_ALLOC (p4est_quadrant_t, count);
+  split = P4EST_ALLOC (int8_t, count);
+  for (zz = 0; zz < count; ++zz) {
+    i = ifirst + (uint64_t) zz;
+    P4EST_QUADRANT_INIT (&qs[zz]);
+    p4est_quadrant_set_morton (&qs[zz], level, i);
+  }
+
+  for (b = 0; b < nkinds; ++b) {
+    balance = btypes[b];
+    for (k = 0; k < nkinds; ++k) {
+      for (which = 0; which < (k == 0 ? P4EST_FACES :
+#ifdef P4_TO_P8
+                               k == 1 && nkinds == 3 ? P8EST_EDGES :
+#endif
+                               P4EST_CHILDREN); ++which) {
+        P4EST_QUADRANT_INIT (&p);
+        if (k == 0) {
+          p4est_quadrant_face_neighbor (root, which ^ 1, &p);
+          nsplit = p4est_balance_seeds_face_batch (qs, count, &p, which,
+                                                   split);
+        }
+#ifdef P4_TO_P8
+        else if (k == 1) {
+          p8est_quadrant_edge_neighbor (root, which ^ 3, &p);
+          nsplit = p8est_balance_seeds_edge_batch (qs, count, &p, which,
+                                                   balance, split);
+        }
+#endif
+        else {
+          p4est_quadrant_corner_neighbor (root, which ^ (P4EST_CHILDREN - 1),
+                                          &p);
+          nsplit = p4est_balance_seeds_corner_batch (qs, count, &p, which,
+                                                     balance, split);
+        }
+        for (zz = 0; zz < count; ++zz) {
+          SC_CHECK_ABORT (split[zz] == (k == 0 ?
+                                        p4est_balance_seeds_face
+                                        (&qs[zz], &p, which, balance, NULL) :
+#ifdef P4_TO_P8
+                                        k == 1 ?
+                                        p8est_balance_seeds_edge
+                                        (&qs[zz], &p, which, balance, NULL) :
+#endif
+                                        p4est_balance_seeds_corner
+                                        (&qs[zz], &p, which, balance, NULL)),
+                          "balance seeds batch error");
+          nsplit -= (size_t) split[zz];
+        }
+        SC_CHECK_ABORT (nsplit == 0, "balance seeds batch count");
+      }
+    }
+  }
+
+  P4EST_FREE (qs);
+  P4EST_FREE (split);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -641,6 +723,11 @@ main (int argc, char **argv)
     }
   }
 
+  P4EST_GLOBAL_VERBOSE ("Testing batches\n");
+  for (level = 4; level <= maxlevel; level++) {
+    check_seeds_batch (&root, level);
+  }
+
   sc_array_destroy (seeds);
   sc_array_destroy (seeds_check);
 
@@ -23,9 +23,11 @@
 */
 
 #ifndef P4_TO_P8
-#include <p4est.h>
+#include <p4est_extended.h>
+#include <p4est_ghost.h>
 #else
-#include <p8est.h>
+#include <p8est_extended.h>
+#include <p8est_ghost.h>
 #endif
 
 static inline       p4est_locidx_t
@@ -431,6 +433,251 @@ check_brick (p8est_connectivity_t * conn, int mi, int ni, int pi,
 
 }
 
+static void
+test_reorder_sfc (sc_MPI_Comm mpicomm)
+{
+  int                 f;
+  size_t              zz;
+  p4est_topidx_t      jt, ntrees, *attr;
+  p4est_connectivity_t *conn;
+  sc_array_t         *perm, *newid;
+
+  /* a brick with the trees numbered backwards */
+#ifndef P4_TO_P8
+  conn = p4est_connectivity_new_brick (4, 4, 0, 0);
+#else
+  conn = p8est_connectivity_new_brick (4, 4, 4, 0, 0, 0);
+#endif
+  ntrees = conn->num_trees;
+  perm = sc_array_new_size (sizeof (size_t), (size_t) ntrees);
+  for (zz = 0; zz < (size_t) ntrees; ++zz) {
+    *(size_t *) sc_array_index (perm, zz) = (size_t) ntrees - 1 - zz;
+  }
+  p4est_connectivity_permute (conn, perm, 1);
+  sc_array_destroy (perm);
+
+  /* remember the current index of each tree as its attribute */
+  p4est_connectivity_set_attr (conn, sizeof (p4est_topidx_t));
+  attr = (p4est_topidx_t *) conn->tree_to_attr;
+  for (jt = 0; jt < ntrees; ++jt) {
+    attr[jt] = jt;
+  }
+
+  newid = p4est_connectivity_reorder_sfc (mpicomm, conn, NULL);
+  SC_CHECK_ABORT (p4est_connectivity_is_valid (conn), "Reorder SFC valid");
+  attr = (p4est_topidx_t *) conn->tree_to_attr;
+  for (zz = 0; zz < (size_t) ntrees; ++zz) {
+    SC_CHECK_ABORT (attr[*(size_t *) sc_array_index (newid, zz)] ==
+                    (p4est_topidx_t) zz, "Reorder SFC attributes");
+  }
+
+  /* on a uniform brick the Hilbert curve steps across faces */
+  for (jt = 0; jt + 1 < ntrees; ++jt) {
+    for (f = 0; f < P4EST_FACES; ++f) {
+      if (conn->tree_to_tree[P4EST_FACES * jt + f] == jt + 1) {
+        break;
+      }
+    }
+    SC_CHECK_ABORT (f < P4EST_FACES, "Reorder SFC neighbors");
+  }
+
+  sc_array_destroy (newid);
+  p4est_connectivity_destroy (conn);
+}
+
+/** Lexicographic index of a tree from its lower vertex. */
+static              p4est_topidx_t
+explicit_coords (p4est_connectivity_t * conn, p4est_topidx_t tree,
+                 const p4est_topidx_t dims[P4EST_DIM])
+{
+  double              xyz[3];
+
+  p4est_connectivity_tree_vertex (conn, tree, 0, xyz);
+#ifndef P4_TO_P8
+  return (p4est_topidx_t) xyz[0] + dims[0] * (p4est_topidx_t) xyz[1];
+#else
+  return (p4est_topidx_t) xyz[0] + dims[0] * ((p4est_topidx_t) xyz[1] +
+                                              dims[1] *
+                                              (p4est_topidx_t) xyz[2]);
+#endif
+}
+
+static int
+refine_corner (p4est_t * p4est, p4est_topidx_t which_tree,
+               p4est_quadrant_t * q)
+{
+  double              xyz[3];
+
+  if (q->level >= 4) {
+    return 0;
+  }
+  p4est_qcoord_to_vertex (p4est->connectivity, which_tree, q->x, q->y,
+#ifdef P4_TO_P8
+                          q->z,
+#endif
+                          xyz);
+  return xyz[0] + xyz[1] + xyz[2] < 1.5;
+}
+
+static              p4est_gloidx_t
+forest_count (sc_MPI_Comm mpicomm, p4est_connectivity_t * conn)
+{
+  p4est_gloidx_t      count;
+  p4est_t            *p4est;
+  p4est_ghost_t      *ghost;
+  p4est_inspect_t     inspect;
+
+  p4est = p4est_new_ext (mpicomm, conn, 0, 1, 1, 0, NULL, NULL);
+  p4est_refine (p4est, 1, refine_corner, NULL);
+  p4est_partition (p4est, 0, NULL);
+
+  /* the precheck looks up the face neighbors of the border quadrants */
+  memset (&inspect, 0, sizeof (inspect));
+  inspect.use_balance_precheck = 1;
+  p4est->inspect = &inspect;
+  p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
+  p4est->inspect = NULL;
+  SC_CHECK_ABORT (p4est_is_balanced (p4est, P4EST_CONNECT_FULL),
+                  "Implicit brick balance");
+  ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+  SC_CHECK_ABORT (p4est_ghost_is_valid (p4est, ghost),
+                  "Implicit brick ghost");
+  count = p4est->global_num_quadrants;
+  p4est_ghost_destroy (ghost);
+  p4est_destroy (p4est);
+  return count;
+}
+
+/* the batched transformation of points agrees with the single one */
+static void
+test_qcoord_batch (p4est_connectivity_t * conn, p4est_topidx_t tree,
+                   p4est_connectivity_t * ref, p4est_topidx_t ref_tree)
+{
+  const int           num_points = 5;
+  int                 i, j;
+  p4est_qcoord_t      qcoords[5 * P4EST_DIM], *qc;
+  double              vxyz[5 * 3], single[3];
+
+  for (i = 0; i < num_points; ++i) {
+    qc = qcoords + P4EST_DIM * i;
+    for (j = 0; j < P4EST_DIM; ++j) {
+      qc[j] = (p4est_qcoord_t) ((int64_t) P4EST_ROOT_LEN * ((i + j) % 4) / 3);
+    }
+  }
+  p4est_qcoord_to_vertex_batch (conn, tree, num_points, qcoords, vxyz);
+  for (i = 0; i < num_points; ++i) {
+    qc = qcoords + P4EST_DIM * i;
+    p4est_qcoord_to_vertex (ref, ref_tree, qc[0], qc[1],
+#ifdef P4_TO_P8
+                            qc[2],
+#endif
+                            single);
+    SC_CHECK_ABORT (vxyz[3 * i] == single[0] && vxyz[3 * i + 1] == single[1]
+                    && vxyz[3 * i + 2] == single[2], "Vertex batch");
+  }
+}
+
+static void
+#ifndef P4_TO_P8
+test_implicit (sc_MPI_Comm mpicomm, int mi, int ni,
+               int periodic_a, int periodic_b)
+#else
+test_implicit (sc_MPI_Comm mpicomm, int mi, int ni, int pi,
+               int periodic_a, int periodic_b, int periodic_c)
+#endif
+{
+  int                 i, nf, enf;
+  p4est_topidx_t      dims[P4EST_DIM];
+  p4est_topidx_t      et, nt, ent, *lex;
+  double              xyz[3], exyz[3];
+  p4est_connectivity_t *conn, *expl;
+  p4est_corner_info_t ci, eci;
+#ifdef P4_TO_P8
+  p8est_edge_info_t   ei, eei;
+#endif
+
+#ifndef P4_TO_P8
+  conn = p4est_connectivity_new_brick_implicit (mi, ni, periodic_a,
+                                                periodic_b);
+  expl = p4est_connectivity_new_brick (mi, ni, periodic_a, periodic_b);
+#else
+  conn = p8est_connectivity_new_brick_implicit (mi, ni, pi, periodic_a,
+                                                periodic_b, periodic_c);
+  expl = p8est_connectivity_new_brick (mi, ni, pi, periodic_a, periodic_b,
+                                       periodic_c);
+  dims[2] = pi;
+#endif
+  dims[0] = mi;
+  dims[1] = ni;
+  SC_CHECK_ABORT (p4est_connectivity_is_valid (conn), "Implicit valid");
+  SC_CHECK_ABORT (conn->num_trees == expl->num_trees, "Implicit trees");
+  SC_CHECK_ABORT (conn->tree_to_tree == NULL && conn->vertices == NULL,
+                  "Implicit arrays");
+  SC_CHECK_ABORT (p4est_connectivity_memory_used (conn) <
+                  p4est_connectivity_memory_used (expl), "Implicit memory");
+
+  /* map the Morton numbering of the explicit brick to the implicit one */
+  lex = P4EST_ALLOC (p4est_topidx_t, expl->num_trees);
+  for (et = 0; et < expl->num_trees; ++et) {
+    lex[et] = explicit_coords (expl, et, dims);
+  }
+
+  sc_array_init (&ci.corner_transforms, sizeof (p4est_corner_transform_t));
+  sc_array_init (&eci.corner_transforms, sizeof (p4est_corner_transform_t));
+#ifdef P4_TO_P8
+  sc_array_init (&ei.edge_transforms, sizeof (p8est_edge_transform_t));
+  sc_array_init (&eei.edge_transforms, sizeof (p8est_edge_transform_t));
+#endif
+  for (et = 0; et < expl->num_trees; ++et) {
+    for (i = 0; i < P4EST_FACES; ++i) {
+      nt = p4est_connectivity_face_neighbor_tree (conn, lex[et], i, &nf);
+      ent = p4est_connectivity_face_neighbor_tree (expl, et, i, &enf);
+      SC_CHECK_ABORT (nt == lex[ent] && nf == enf, "Implicit face");
+    }
+    for (i = 0; i < P4EST_CHILDREN; ++i) {
+      p4est_connectivity_tree_vertex (conn, lex[et], i, xyz);
+      p4est_connectivity_tree_vertex (expl, et, i, exyz);
+      SC_CHECK_ABORT (xyz[0] == exyz[0] && xyz[1] == exyz[1] &&
+                      xyz[2] == exyz[2], "Implicit vertex");
+      p4est_find_corner_transform (conn, lex[et], i, &ci);
+      p4est_find_corner_transform (expl, et, i, &eci);
+      SC_CHECK_ABORT (ci.corner_transforms.elem_count ==
+                      eci.corner_transforms.elem_count, "Implicit corner");
+    }
+    test_qcoord_batch (conn, lex[et], expl, et);
+#ifdef P4_TO_P8
+    for (i = 0; i < P8EST_EDGES; ++i) {
+      p8est_find_edge_transform (conn, lex[et], i, &ei);
+      p8est_find_edge_transform (expl, et, i, &eei);
+      SC_CHECK_ABORT (ei.edge_transforms.elem_count ==
+                      eei.edge_transforms.elem_count, "Implicit edge");
+    }
+#endif
+  }
+  sc_array_reset (&ci.corner_transforms);
+  sc_array_reset (&eci.corner_transforms);
+#ifdef P4_TO_P8
+  sc_array_reset (&ei.edge_transforms);
+  sc_array_reset (&eei.edge_transforms);
+#endif
+  P4EST_FREE (lex);
+
+  /* refinement by coordinates yields the same forest on both */
+  SC_CHECK_ABORT (forest_count (mpicomm, conn) ==
+                  forest_count (mpicomm, expl), "Implicit forest");
+
+  /* balance and ghost find the same neighbors in the transform cache */
+  p4est_connectivity_set_transform_cache (conn, 1);
+  p4est_connectivity_set_transform_cache (expl, 1);
+  SC_CHECK_ABORT (p4est_connectivity_memory_used (expl) >
+                  p4est_connectivity_memory_used (conn), "Cached memory");
+  SC_CHECK_ABORT (forest_count (mpicomm, conn) ==
+                  forest_count (mpicomm, expl), "Cached forest");
+
+  p4est_connectivity_destroy (expl);
+  p4est_connectivity_destroy (conn);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -484,6 +731,17 @@ main (int argc, char **argv)
     }
   }
 
+  test_reorder_sfc (mpicomm);
+#ifndef P4_TO_P8
+  test_implicit (mpicomm, 3, 2, 0, 0);
+  test_implicit (mpicomm, 4, 3, 1, 0);
+  test_implicit (mpicomm, 2, 1, 1, 1);
+#else
+  test_implicit (mpicomm, 3, 2, 2, 0, 0, 0);
+  test_implicit (mpicomm, 2, 3, 2, 1, 0, 1);
+  test_implicit (mpicomm, 1, 2, 2, 1, 1, 1);
+#endif
+
   /* clean up and exit */
   sc_finalize ();
 
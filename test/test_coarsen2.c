@@ -27,12 +27,14 @@
 #include <p4est_bits.h>
 #include <p4est_extended.h>
 #include <p4est_communication.h>
+#include <p4est_hierarchy.h>
 #include <p4est_vtk.h>
 #else
 #include <p8est_algorithms.h>
 #include <p8est_bits.h>
 #include <p8est_extended.h>
 #include <p8est_communication.h>
+#include <p8est_hierarchy.h>
 #include <p8est_vtk.h>
 #endif
 
@@ -254,16 +256,23 @@ p4est_coarsen_both (p4est_t * p4est, int coarsen_recursive,
                     p4est_coarsen_t coarsen_fn, p4est_init_t init_fn)
 {
   int                 success;
+  p4est_locidx_t      save_local_count, expected;
   p4est_t            *copy;
 
   copy = p4est_copy (p4est, 1);
   p4est_coarsen_old (copy, coarsen_recursive, coarsen_fn, init_fn);
 
   coarsen_callback_count = 0;
+  save_local_count = p4est->local_num_quadrants;
   p4est_coarsen_ext (p4est, coarsen_recursive, 1, coarsen_fn, init_fn, NULL);
-  SC_CHECK_ABORT (coarsen_recursive ||
-                  coarsen_callback_count == (int) p4est->local_num_quadrants,
-                  "Coarsen count");
+
+  /* recursion calls back once more for every family that was coarsened */
+  expected = p4est->local_num_quadrants;
+  if (coarsen_recursive) {
+    expected += (save_local_count - p4est->local_num_quadrants) /
+      (P4EST_CHILDREN - 1);
+  }
+  SC_CHECK_ABORT (coarsen_callback_count == (int) expected, "Coarsen count");
 
   success = p4est_is_equal (p4est, copy, 1);
   SC_CHECK_ABORT (success, "Coarsen mismatch");
@@ -271,6 +280,88 @@ p4est_coarsen_both (p4est_t * p4est, int coarsen_recursive,
   p4est_destroy (copy);
 }
 
+/* the parents computed from the maps of each level, moved into the
+ * partition of that level, are its local quadrants */
+static void
+test_hierarchy (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity)
+{
+  int                 l;
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      i, k, lid;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, *parents, *received;
+  p4est_quadrant_t  **fine_quadrants;
+  p4est_t            *p4est, *fine, *coarse;
+  p4est_hierarchy_t  *hierarchy;
+
+  p4est = p4est_new_ext (mpicomm, connectivity, 0, 0, 0, 0, NULL, NULL);
+  p4est_refine (p4est, 1, test_refine, NULL);
+  p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
+  hierarchy = p4est_hierarchy_new (p4est, refine_level + 2,
+                                   P4EST_CONNECT_FULL, NULL);
+  SC_CHECK_ABORT (hierarchy->num_levels == refine_level + 1,
+                  "Hierarchy levels");
+  SC_CHECK_ABORT (hierarchy->levels[hierarchy->num_levels - 1].p4est->
+                  global_num_quadrants ==
+                  (p4est_gloidx_t) connectivity->num_trees, "Hierarchy root");
+
+  for (l = 1; l < hierarchy->num_levels; ++l) {
+    fine = hierarchy->levels[l - 1].p4est;
+    coarse = hierarchy->levels[l].p4est;
+
+    /* collect the local quadrants of the finer level */
+    fine_quadrants = P4EST_ALLOC (p4est_quadrant_t *,
+                                  fine->local_num_quadrants);
+    for (jt = fine->first_local_tree; jt <= fine->last_local_tree; ++jt) {
+      tree = p4est_tree_array_index (fine->trees, jt);
+      for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+        q = p4est_quadrant_array_index (&tree->quadrants, zz);
+        q->p.which_tree = jt;
+        fine_quadrants[tree->quadrants_offset + zz] = q;
+      }
+    }
+
+    /* derive each parent from its children */
+    parents = P4EST_ALLOC (p4est_quadrant_t, hierarchy->levels[l].num_parents);
+    for (i = 0; i < hierarchy->levels[l].num_parents; ++i) {
+      k = hierarchy->levels[l].child_offsets[i];
+      SC_CHECK_ABORT (hierarchy->levels[l].parent_index[k] == i,
+                      "Hierarchy parent index");
+      if (hierarchy->levels[l].child_offsets[i + 1] - k == 1) {
+        parents[i] = *fine_quadrants[k];
+      }
+      else {
+        SC_CHECK_ABORT (hierarchy->levels[l].child_offsets[i + 1] - k ==
+                        P4EST_CHILDREN, "Hierarchy family");
+        p4est_quadrant_parent (fine_quadrants[k], &parents[i]);
+        parents[i].p.which_tree = fine_quadrants[k]->p.which_tree;
+      }
+    }
+    P4EST_FREE (fine_quadrants);
+
+    /* compare with the coarse level in its own partition */
+    received = P4EST_ALLOC (p4est_quadrant_t, coarse->local_num_quadrants);
+    p4est_hierarchy_transfer (hierarchy, l, 1, received, parents,
+                              sizeof (p4est_quadrant_t));
+    lid = 0;
+    for (jt = coarse->first_local_tree; jt <= coarse->last_local_tree; ++jt) {
+      tree = p4est_tree_array_index (coarse->trees, jt);
+      for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lid) {
+        q = p4est_quadrant_array_index (&tree->quadrants, zz);
+        SC_CHECK_ABORT (p4est_quadrant_is_equal (q, &received[lid]) &&
+                        received[lid].p.which_tree == jt,
+                        "Hierarchy transfer");
+      }
+    }
+    P4EST_FREE (received);
+    P4EST_FREE (parents);
+  }
+
+  p4est_hierarchy_destroy (hierarchy);
+  p4est_destroy (p4est);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -323,6 +414,9 @@ main (int argc, char **argv)
   }
 
   p4est_destroy (p4est);
+
+  /* multigrid hierarchy of coarsened forests */
+  test_hierarchy (mpicomm, connectivity);
   if (geom != NULL) {
     p4est_geometry_destroy (geom);
   }
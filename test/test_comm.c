@@ -25,6 +25,7 @@
 #include <p4est_algorithms.h>
 #include <p4est_communication.h>
 #include <p4est_extended.h>
+#include <sc_notify.h>
 
 typedef struct
 {
@@ -74,6 +75,159 @@ test_pertree (p4est_t * p4est)
   P4EST_FREE (pertree);
 }
 
+static void
+test_notify_nodes (p4est_t * p4est)
+{
+  int                 mpiret;
+  int                 i, j;
+  int                 num_receivers;
+  int                 num_senders, num_senders2;
+  int                *receivers, *senders, *senders2;
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+
+  /* send to a rank dependent sparse subset of the processes */
+  receivers = P4EST_ALLOC (int, num_procs);
+  senders = P4EST_ALLOC (int, num_procs);
+  senders2 = P4EST_ALLOC (int, num_procs);
+  num_receivers = 0;
+  for (j = 0; j < num_procs; ++j) {
+    if ((j * 7 + rank * 3) % 5 < 2 || j == (rank + 1) % num_procs) {
+      receivers[num_receivers++] = j;
+    }
+  }
+
+  mpiret = p4est_comm_notify_nodes (receivers, num_receivers,
+                                    senders, &num_senders, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_notify_allgather (receivers, num_receivers,
+                                senders2, &num_senders2, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  SC_CHECK_ABORT (num_senders == num_senders2, "Notify nodes count");
+  for (i = 0; i < num_senders; ++i) {
+    SC_CHECK_ABORT (senders[i] == senders2[i], "Notify nodes rank");
+  }
+
+  P4EST_FREE (receivers);
+  P4EST_FREE (senders);
+  P4EST_FREE (senders2);
+}
+
+static void
+test_compress (void)
+{
+  int                 codec;
+  size_t              zz, wire_bytes;
+  const size_t        num_values = 1000;
+  double             *values, *result;
+  char               *wire;
+  p4est_comm_compress_t compress;
+
+  values = P4EST_ALLOC (double, num_values);
+  result = P4EST_ALLOC (double, num_values);
+  wire = P4EST_ALLOC (char, p4est_comm_compress_bound
+                      (num_values * sizeof (double)));
+  for (zz = 0; zz < num_values; ++zz) {
+    values[zz] = 1. + (double) (zz % 17) / 3.;
+  }
+
+  /* every codec must reproduce the values within its tolerance */
+  for (codec = P4EST_COMM_CODEC_NONE; codec <= P4EST_COMM_CODEC_FLOAT;
+       ++codec) {
+    memset (&compress, 0, sizeof (compress));
+    compress.codec = (p4est_comm_codec_t) codec;
+    compress.tolerance = 1e-6;
+    wire_bytes = p4est_comm_compress_pack (&compress, values,
+                                           num_values * sizeof (double),
+                                           wire);
+    SC_CHECK_ABORT (wire_bytes == compress.wire_bytes &&
+                    compress.raw_bytes == num_values * sizeof (double),
+                    "Compress counters");
+    SC_CHECK_ABORT (wire_bytes <= p4est_comm_compress_bound
+                    (num_values * sizeof (double)), "Compress bound");
+    p4est_comm_compress_unpack (wire, result, num_values * sizeof (double));
+    for (zz = 0; zz < num_values; ++zz) {
+      if (codec == P4EST_COMM_CODEC_FLOAT) {
+        SC_CHECK_ABORT (fabs (result[zz] - values[zz]) <=
+                        compress.tolerance * fabs (values[zz]),
+                        "Compress float tolerance");
+      }
+      else {
+        SC_CHECK_ABORT (result[zz] == values[zz], "Compress lossless");
+      }
+    }
+  }
+
+  P4EST_FREE (values);
+  P4EST_FREE (result);
+  P4EST_FREE (wire);
+}
+
+static void
+test_crc32c (p4est_t * p4est)
+{
+  const char          check[] = "123456789";
+  size_t              zz;
+  unsigned            crc1, crc2;
+
+  /* the standard check value of the Castagnoli polynomial */
+  SC_CHECK_ABORT (p4est_crc32c (0, check, 9) == 0xe3069283U,
+                  "CRC32C check value");
+  for (zz = 0; zz <= 9; ++zz) {
+    crc1 = p4est_crc32c (0, check, zz);
+    crc2 = p4est_crc32c (0, check + zz, 9 - zz);
+    SC_CHECK_ABORT (p4est_crc32c (crc1, check + zz, 9 - zz) == 0xe3069283U,
+                    "CRC32C continuation");
+    SC_CHECK_ABORT (p4est_crc32c_combine (crc1, crc2, 9 - zz) ==
+                    0xe3069283U, "CRC32C combine");
+  }
+
+  /* the forest checksum does not depend on the number of threads */
+  crc1 = p4est_checksum_crc32c (p4est, 0);
+  p4est_set_num_threads (3);
+  crc2 = p4est_checksum_crc32c (p4est, 0);
+  p4est_set_num_threads (1);
+  SC_CHECK_ABORT (crc1 == crc2, "CRC32C threads");
+}
+
+static void
+test_node_order (p4est_t * p4est)
+{
+  int                 mpiret, result;
+  unsigned            crc1, crc2;
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  p4est_t            *copy;
+
+  /* reordering the ranks keeps the forest and its data intact */
+  copy = p4est_copy (p4est, 1);
+  crc1 = p4est_checksum (copy);
+  if (!p4est_comm_parallel_env_node_order (copy)) {
+    mpiret = sc_MPI_Comm_compare (p4est->mpicomm, copy->mpicomm, &result);
+    SC_CHECK_MPI (mpiret);
+    SC_CHECK_ABORT (result == sc_MPI_IDENT || result == sc_MPI_CONGRUENT,
+                    "Node order unchanged");
+  }
+  crc2 = p4est_checksum (copy);
+  SC_CHECK_ABORT (crc1 == crc2, "Node order checksum");
+  SC_CHECK_ABORT (copy->local_num_quadrants ==
+                  (p4est_locidx_t) (copy->global_first_quadrant
+                                    [copy->mpirank + 1] -
+                                    copy->global_first_quadrant
+                                    [copy->mpirank]), "Node order count");
+  for (jt = copy->first_local_tree; jt <= copy->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (copy->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      SC_CHECK_ABORT (((user_data_t *) q->p.user_data)->a == jt,
+                      "Node order data");
+    }
+  }
+  p4est_destroy (copy);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -142,6 +296,18 @@ main (int argc, char **argv)
   SC_CHECK_ABORT (qsum == p4est->global_num_quadrants,
                   "Wrong number after quadrant counting");
 
+  /* test the node-aware notification */
+  test_notify_nodes (p4est);
+
+  /* test the message payload codecs */
+  test_compress ();
+
+  /* test the hardware-friendly checksums */
+  test_crc32c (p4est);
+
+  /* test the node-aware rank order */
+  test_node_order (p4est);
+
   /* clean up and exit */
   p4est_destroy (p4est);
   p4est_connectivity_destroy (connectivity);
@@ -30,6 +30,7 @@
 #include <p8est_connectivity.h>
 #include <p8est_ghost.h>
 #include <p8est_lnodes.h>
+#include <p8est_tets_hexes.h>
 #endif
 
 static void
@@ -50,6 +51,9 @@ test_the_p4est (p4est_connectivity_t * conn, int N)
 static void
 test_complete (p4est_connectivity_t * conn, const char *which, int test_p4est)
 {
+  int8_t             *ttf;
+  int8_t              rface;
+
   SC_GLOBAL_INFOF ("Testing standard connectivity %s\n", which);
   SC_CHECK_ABORTF (p4est_connectivity_is_valid (conn),
                    "Invalid connectivity %s before completion", which);
@@ -61,6 +65,20 @@ test_complete (p4est_connectivity_t * conn, const char *which, int test_p4est)
   p4est_connectivity_complete (conn);
   SC_CHECK_ABORTF (p4est_connectivity_is_valid (conn),
                    "Invalid connectivity %s after completion", which);
+  SC_CHECK_ABORTF (p4est_connectivity_is_valid_parallel
+                   (conn, sc_MPI_COMM_WORLD),
+                   "Invalid parallel connectivity %s", which);
+
+  /* a face without its reciprocal is found by both checks */
+  ttf = conn->tree_to_face + P4EST_FACES * (conn->num_trees - 1);
+  rface = *ttf;
+  *ttf = (int8_t) ((rface + 1) % P4EST_FACES);
+  SC_CHECK_ABORTF (!p4est_connectivity_is_valid (conn) &&
+                   !p4est_connectivity_is_valid_parallel
+                   (conn, sc_MPI_COMM_WORLD),
+                   "Broken connectivity %s not detected", which);
+  *ttf = rface;
+
   if (test_p4est) {
     test_the_p4est (conn, 3);
   }
@@ -68,6 +86,261 @@ test_complete (p4est_connectivity_t * conn, const char *which, int test_p4est)
   p4est_connectivity_destroy (conn);
 }
 
+/* completing with one or several threads yields identical connectivities */
+static void
+test_complete_threads (p4est_connectivity_t * conn1,
+                       p4est_connectivity_t * conn2, const char *which)
+{
+  int                 num_threads;
+
+  SC_GLOBAL_INFOF ("Testing threaded completion for connectivity %s\n",
+                   which);
+  num_threads = p4est_get_num_threads ();
+  p4est_connectivity_reduce (conn1);
+  p4est_connectivity_reduce (conn2);
+  p4est_set_num_threads (1);
+  p4est_connectivity_complete (conn1);
+  p4est_set_num_threads (4);
+  p4est_connectivity_complete (conn2);
+  p4est_set_num_threads (num_threads);
+  SC_CHECK_ABORTF (p4est_connectivity_is_valid (conn1) &&
+                   p4est_connectivity_is_equal (conn1, conn2),
+                   "Threaded completion of %s differs", which);
+
+  p4est_connectivity_destroy (conn1);
+  p4est_connectivity_destroy (conn2);
+}
+
+/* elements per direction of the generated .inp mesh; its size exceeds the
+ * parser's chunk size so that chunk boundaries fall inside lines */
+#ifndef P4_TO_P8
+#define TEST_INP_N 160
+#else
+#define TEST_INP_N 32
+#endif
+
+static void
+test_inp_append (sc_array_t * buf, const char *fmt, ...)
+{
+  char                line[BUFSIZ];
+  int                 n;
+  va_list             ap;
+
+  va_start (ap, fmt);
+  n = vsnprintf (line, BUFSIZ, fmt, ap);
+  va_end (ap);
+  SC_CHECK_ABORT (n >= 0 && n < BUFSIZ, "Line overflow");
+  memcpy (sc_array_push_count (buf, (size_t) n), line, (size_t) n);
+}
+
+static void
+test_read_inp_buffer (void)
+{
+  const int           N = TEST_INP_N;
+  const int           M = TEST_INP_N + 1;
+  int                 i, j, k, c, retval;
+  int                 num_threads;
+  FILE               *stream;
+  sc_array_t         *buf;
+  p4est_topidx_t      nv, nt, snv, stt;
+  p4est_topidx_t     *ttv, *sttv;
+  double             *vv, *svv;
+#ifndef P4_TO_P8
+  const int           ci[4] = { 0, 1, 1, 0 };
+  const int           cj[4] = { 0, 0, 1, 1 };
+#else
+  const int           ci[8] = { 0, 1, 1, 0, 0, 1, 1, 0 };
+  const int           cj[8] = { 0, 0, 1, 1, 0, 0, 1, 1 };
+  const int           ck[8] = { 0, 0, 0, 0, 1, 1, 1, 1 };
+#endif
+
+  /* a grid of unit elements with comment lines between the sections */
+  buf = sc_array_new (sizeof (char));
+  test_inp_append (buf, "** generated by test_conn_complete\n*Heading\n");
+  test_inp_append (buf, "** nodes\n*Node\n");
+#ifndef P4_TO_P8
+  for (j = 0; j < M; ++j) {
+    for (i = 0; i < M; ++i) {
+      test_inp_append (buf, "%d, %.17g, %.17g, 0\n",
+                       1 + i + M * j, i * .5, j * .25);
+    }
+  }
+  test_inp_append (buf, "** elements\n*Element, type=C2D4, ELSET=Grid\n");
+  for (j = 0; j < N; ++j) {
+    for (i = 0; i < N; ++i) {
+      test_inp_append (buf, "%d", 1 + i + N * j);
+      for (c = 0; c < P4EST_CHILDREN; ++c) {
+        test_inp_append (buf, ", %d", 1 + i + ci[c] + M * (j + cj[c]));
+      }
+      test_inp_append (buf, i == N - 1 && j == N - 1 ? "" : "\n");
+    }
+  }
+#else
+  for (k = 0; k < M; ++k) {
+    for (j = 0; j < M; ++j) {
+      for (i = 0; i < M; ++i) {
+        test_inp_append (buf, "%d, %.17g, %.17g, %.17g\n",
+                         1 + i + M * (j + M * k), i * .5, j * .25, k * .125);
+      }
+    }
+  }
+  test_inp_append (buf, "** elements\n*Element, type=C3D8, ELSET=Grid\n");
+  for (k = 0; k < N; ++k) {
+    for (j = 0; j < N; ++j) {
+      for (i = 0; i < N; ++i) {
+        test_inp_append (buf, "%d", 1 + i + N * (j + N * k));
+        for (c = 0; c < P4EST_CHILDREN; ++c) {
+          test_inp_append (buf, ", %d",
+                           1 + i + ci[c] + M * (j + cj[c] + M * (k + ck[c])));
+        }
+        test_inp_append (buf, i == N - 1 && j == N - 1 && k == N - 1 ?
+                         "" : "\n");
+      }
+    }
+  }
+#endif
+  SC_CHECK_ABORT (buf->elem_count > 1 << 20, "Generated .inp too small");
+
+  /* the stream reader on the same bytes is the reference */
+  stream = tmpfile ();
+  SC_CHECK_ABORT (stream != NULL, "Open temporary file");
+  SC_CHECK_ABORT (fwrite (buf->array, 1, buf->elem_count, stream) ==
+                  buf->elem_count, "Write temporary file");
+  rewind (stream);
+  snv = stt = 0;
+  retval = p4est_connectivity_read_inp_stream (stream, &snv, &stt,
+                                               NULL, NULL);
+  SC_CHECK_ABORT (!retval, "Count .inp stream");
+  SC_CHECK_ABORT (snv == (p4est_topidx_t) M * M * (P4EST_DIM == 3 ? M : 1)
+                  && stt == (p4est_topidx_t) N * N * (P4EST_DIM == 3 ? N : 1),
+                  "Counts of .inp stream");
+  svv = P4EST_ALLOC (double, 3 * snv);
+  sttv = P4EST_ALLOC (p4est_topidx_t, P4EST_CHILDREN * stt);
+  rewind (stream);
+  retval = p4est_connectivity_read_inp_stream (stream, &snv, &stt, svv, sttv);
+  SC_CHECK_ABORT (!retval, "Read .inp stream");
+  fclose (stream);
+
+  /* one and several threads parse the buffer identically to the stream */
+  vv = P4EST_ALLOC (double, 3 * snv);
+  ttv = P4EST_ALLOC (p4est_topidx_t, P4EST_CHILDREN * stt);
+  num_threads = p4est_get_num_threads ();
+  for (k = 1; k <= 4; k *= 4) {
+    p4est_set_num_threads (k);
+    nv = nt = 0;
+    retval = p4est_connectivity_read_inp_buffer
+      ((const char *) buf->array, buf->elem_count, &nv, &nt, NULL, NULL);
+    SC_CHECK_ABORTF (!retval && nv == snv && nt == stt,
+                     "Count .inp buffer with %d threads", k);
+    memset (vv, -1, 3 * snv * sizeof (double));
+    memset (ttv, -1, P4EST_CHILDREN * stt * sizeof (p4est_topidx_t));
+    retval = p4est_connectivity_read_inp_buffer
+      ((const char *) buf->array, buf->elem_count, &nv, &nt, vv, ttv);
+    SC_CHECK_ABORTF (!retval, "Read .inp buffer with %d threads", k);
+    SC_CHECK_ABORTF (!memcmp (vv, svv, 3 * snv * sizeof (double)) &&
+                     !memcmp (ttv, sttv,
+                              P4EST_CHILDREN * stt * sizeof (p4est_topidx_t)),
+                     "Parse .inp buffer with %d threads", k);
+  }
+  p4est_set_num_threads (num_threads);
+
+  P4EST_FREE (vv);
+  P4EST_FREE (ttv);
+  P4EST_FREE (svv);
+  P4EST_FREE (sttv);
+  sc_array_destroy (buf);
+}
+
+#ifdef P4_TO_P8
+
+/* six tets around the diagonal of the unit cube, some of them left-handed */
+static void
+test_read_tets (void)
+{
+  const char         *basename = "test_conn_complete3_tets";
+  const int           path[6][2] = {
+    {1, 3}, {1, 5}, {2, 3}, {2, 6}, {4, 5}, {4, 6}
+  };
+  int                 mpiret, rank;
+  int                 i;
+  char                nodename[BUFSIZ], elename[BUFSIZ];
+  FILE               *file;
+  double             *node;
+  p4est_topidx_t     *tet;
+  p8est_tets_t       *ptg;
+  p8est_connectivity_t *conn, *read;
+
+  mpiret = sc_MPI_Comm_rank (sc_MPI_COMM_WORLD, &rank);
+  SC_CHECK_MPI (mpiret);
+  snprintf (nodename, BUFSIZ, "%s.node", basename);
+  snprintf (elename, BUFSIZ, "%s.ele", basename);
+
+  ptg = P4EST_ALLOC (p8est_tets_t, 1);
+  ptg->nodes = sc_array_new_size (sizeof (double), 3 * 8);
+  ptg->tets = sc_array_new_size (sizeof (p4est_topidx_t), 4 * 6);
+  ptg->tet_attributes = sc_array_new_size (sizeof (int), 6);
+  for (i = 0; i < 8; ++i) {
+    node = (double *) sc_array_index_int (ptg->nodes, 3 * i);
+    node[0] = i & 1;
+    node[1] = (i >> 1) & 1;
+    node[2] = i >> 2;
+  }
+  for (i = 0; i < 6; ++i) {
+    tet = (p4est_topidx_t *) sc_array_index_int (ptg->tets, 4 * i);
+    tet[0] = 0;
+    tet[1] = path[i][0];
+    tet[2] = path[i][1];
+    tet[3] = 7;
+    *(int *) sc_array_index_int (ptg->tet_attributes, i) = i;
+  }
+
+  /* only the root process writes and reads the tetgen files */
+  if (rank == 0) {
+    file = fopen (nodename, "wb");
+    SC_CHECK_ABORT (file != NULL, "Open tetgen node file");
+    fprintf (file, "8 3 0 0\n");
+    for (i = 0; i < 8; ++i) {
+      node = (double *) sc_array_index_int (ptg->nodes, 3 * i);
+      fprintf (file, "%d %g %g %g\n", i, node[0], node[1], node[2]);
+    }
+    SC_CHECK_ABORT (fclose (file) == 0, "Close tetgen node file");
+    file = fopen (elename, "wb");
+    SC_CHECK_ABORT (file != NULL, "Open tetgen ele file");
+    fprintf (file, "6 4 1\n");
+    for (i = 0; i < 6; ++i) {
+      tet = (p4est_topidx_t *) sc_array_index_int (ptg->tets, 4 * i);
+      fprintf (file, "%d %d %d %d %d %d\n", i, (int) tet[0], (int) tet[1],
+               (int) tet[2], (int) tet[3], i);
+    }
+    SC_CHECK_ABORT (fclose (file) == 0, "Close tetgen ele file");
+  }
+  p8est_tets_make_righthanded (ptg);
+  conn = p8est_connectivity_new_tets (ptg);
+  p8est_tets_destroy (ptg);
+  SC_CHECK_ABORT (conn->num_trees == 4 * 6 &&
+                  p8est_connectivity_is_valid (conn), "Tets connectivity");
+
+  /* the connectivity read on the root matches the one built in memory */
+  read = p8est_connectivity_read_tets (basename, 0, sc_MPI_COMM_WORLD);
+  SC_CHECK_ABORT (read != NULL && p8est_connectivity_is_equal (conn, read),
+                  "Read tets connectivity");
+  p8est_connectivity_destroy (read);
+
+  /* a missing file fails on all processes */
+  if (rank == 0) {
+    SC_CHECK_ABORT (remove (nodename) == 0, "Remove tetgen node file");
+  }
+  read = p8est_connectivity_read_tets (basename, 0, sc_MPI_COMM_WORLD);
+  SC_CHECK_ABORT (read == NULL, "Read missing tets");
+  if (rank == 0) {
+    SC_CHECK_ABORT (remove (elename) == 0, "Remove tetgen ele file");
+  }
+
+  p8est_connectivity_destroy (conn);
+}
+
+#endif
+
 int
 main (int argc, char **argv)
 {
@@ -101,6 +374,23 @@ main (int argc, char **argv)
   test_complete (p8est_connectivity_new_brick (3, 2, 8, 0, 0, 0),
                  "3D brick", 1);
 #endif
+#ifndef P4_TO_P8
+  test_complete_threads (p4est_connectivity_new_moebius (),
+                         p4est_connectivity_new_moebius (), "moebius");
+  test_complete_threads (p4est_connectivity_new_brick (37, 23, 1, 0),
+                         p4est_connectivity_new_brick (37, 23, 1, 0),
+                         "2D brick");
+#else
+  test_complete_threads (p8est_connectivity_new_rotcubes (),
+                         p8est_connectivity_new_rotcubes (), "rotcubes");
+  test_complete_threads (p8est_connectivity_new_brick (9, 7, 5, 1, 0, 0),
+                         p8est_connectivity_new_brick (9, 7, 5, 1, 0, 0),
+                         "3D brick");
+#endif
+  test_read_inp_buffer ();
+#ifdef P4_TO_P8
+  test_read_tets ();
+#endif
 
   sc_finalize ();
 
@@ -44,6 +44,89 @@ test_reduce (p4est_connectivity_t * conn, const char *which)
   p4est_connectivity_destroy (conn);
 }
 
+static void
+test_bcast_shared (void)
+{
+  int                 mpiret, rank;
+  p4est_connectivity_t *conn, *shared;
+
+  mpiret = sc_MPI_Comm_rank (sc_MPI_COMM_WORLD, &rank);
+  SC_CHECK_MPI (mpiret);
+
+  /* the root passes its own copy, which is taken over */
+#ifndef P4_TO_P8
+  conn = p4est_connectivity_new_brick (3, 2, 0, 1);
+  shared = p4est_connectivity_bcast_shared
+    (rank == 0 ? p4est_connectivity_new_brick (3, 2, 0, 1) : NULL, 0,
+     sc_MPI_COMM_WORLD);
+#else
+  conn = p8est_connectivity_new_brick (4, 3, 2, 0, 1, 0);
+  shared = p8est_connectivity_bcast_shared
+    (rank == 0 ? p8est_connectivity_new_brick (4, 3, 2, 0, 1, 0) : NULL, 0,
+     sc_MPI_COMM_WORLD);
+#endif
+  SC_CHECK_ABORT (p4est_connectivity_is_valid (shared),
+                  "Invalid shared connectivity");
+  SC_CHECK_ABORT (p4est_connectivity_is_equal (conn, shared),
+                  "Shared connectivity differs");
+  p4est_connectivity_destroy (shared);
+  p4est_connectivity_destroy (conn);
+}
+
+static void
+test_scatter (void)
+{
+  int                 mpiret, rank, size, q, face;
+  p4est_topidx_t      lt, gt, *offsets;
+  p4est_topidx_t     *gids;
+  p4est_connectivity_t *conn, *local;
+  sc_array_t          global_ids;
+
+  mpiret = sc_MPI_Comm_rank (sc_MPI_COMM_WORLD, &rank);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Comm_size (sc_MPI_COMM_WORLD, &size);
+  SC_CHECK_MPI (mpiret);
+
+#ifndef P4_TO_P8
+  conn = p4est_connectivity_new_brick (5, 4, 1, 0);
+#else
+  conn = p8est_connectivity_new_brick (4, 3, 2, 1, 0, 1);
+#endif
+  offsets = P4EST_ALLOC (p4est_topidx_t, size + 1);
+  for (q = 0; q <= size; ++q) {
+    offsets[q] = (p4est_topidx_t)
+      (((long long) conn->num_trees * q) / size);
+  }
+
+  sc_array_init (&global_ids, sizeof (p4est_topidx_t));
+  local = p4est_connectivity_scatter (rank == 0 ? conn : NULL, 0,
+                                      rank == 0 ? offsets : NULL,
+                                      &global_ids, sc_MPI_COMM_WORLD);
+  SC_CHECK_ABORT (p4est_connectivity_is_valid (local),
+                  "Invalid scattered connectivity");
+  SC_CHECK_ABORT (global_ids.elem_count == (size_t) local->num_trees,
+                  "Scattered ids count");
+
+  /* owned trees see the same face neighbors as in the full mesh */
+  gids = (p4est_topidx_t *) global_ids.array;
+  for (lt = 0; lt < offsets[rank + 1] - offsets[rank]; ++lt) {
+    gt = offsets[rank] + lt;
+    SC_CHECK_ABORT (gids[lt] == gt, "Scattered owned tree");
+    for (face = 0; face < P4EST_FACES; ++face) {
+      SC_CHECK_ABORT (gids[local->tree_to_tree[P4EST_FACES * lt + face]] ==
+                      conn->tree_to_tree[P4EST_FACES * gt + face] &&
+                      local->tree_to_face[P4EST_FACES * lt + face] ==
+                      conn->tree_to_face[P4EST_FACES * gt + face],
+                      "Scattered face neighbor");
+    }
+  }
+
+  sc_array_reset (&global_ids);
+  P4EST_FREE (offsets);
+  p4est_connectivity_destroy (local);
+  p4est_connectivity_destroy (conn);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -87,6 +170,9 @@ main (int argc, char *argv[])
   test_reduce (p8est_connectivity_new_brick (4, 3, 2, 1, 0, 1), "brick101");
   test_reduce (p8est_connectivity_new_brick (4, 3, 2, 1, 1, 1), "brick111");
 #endif
+  test_bcast_shared ();
+  test_scatter ();
+
   /* clean up and exit */
   sc_finalize ();
 
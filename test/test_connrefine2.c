@@ -30,6 +30,34 @@
 #include <p8est_vtk.h>
 #endif
 
+/* compare the parallel refinement to the serial one up to vertex numbers */
+static void
+check_refine_parallel (p4est_connectivity_t * conn_in,
+                       p4est_connectivity_t * conn_out, int shared)
+{
+  size_t              num_faces;
+  p4est_connectivity_t *conn_par;
+
+  conn_par = p4est_connectivity_refine_parallel (conn_in, 5, shared,
+                                                 sc_MPI_COMM_WORLD);
+  SC_CHECK_ABORT (p4est_connectivity_is_valid (conn_par),
+                  "Parallel refine invalid");
+  SC_CHECK_ABORT (conn_par->num_trees == conn_out->num_trees &&
+                  conn_par->num_vertices == conn_out->num_vertices &&
+#ifdef P4_TO_P8
+                  conn_par->num_edges == conn_out->num_edges &&
+#endif
+                  conn_par->num_corners == conn_out->num_corners,
+                  "Parallel refine counts");
+  num_faces = P4EST_FACES * (size_t) conn_out->num_trees;
+  SC_CHECK_ABORT (!memcmp (conn_par->tree_to_tree, conn_out->tree_to_tree,
+                           num_faces * sizeof (p4est_topidx_t)) &&
+                  !memcmp (conn_par->tree_to_face, conn_out->tree_to_face,
+                           num_faces * sizeof (int8_t)),
+                  "Parallel refine neighbors");
+  p4est_connectivity_destroy (conn_par);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -49,6 +77,8 @@ main (int argc, char **argv)
   conn_in = p8est_connectivity_new_rotcubes ();
 #endif
   conn_out = p4est_connectivity_refine (conn_in, 5);
+  check_refine_parallel (conn_in, conn_out, 0);
+  check_refine_parallel (conn_in, conn_out, 1);
   p4est_connectivity_destroy (conn_in);
 
   p4est = p4est_new (sc_MPI_COMM_WORLD, conn_out, 0, NULL, NULL);
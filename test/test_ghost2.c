@@ -26,10 +26,12 @@
 #include <p4est_bits.h>
 #include <p4est_ghost.h>
 #include <p4est_lnodes.h>
+#include <p4est_extended.h>
 #else
 #include <p8est_bits.h>
 #include <p8est_ghost.h>
 #include <p8est_lnodes.h>
+#include <p8est_extended.h>
 #endif
 
 #ifndef P4_TO_P8
@@ -323,6 +325,8 @@ test_exchange_D (p4est_t * p4est, p4est_ghost_t * ghost)
   void              **mirror_data;
   test_exchange_t    *mirror_struct_data;
   test_exchange_t    *ghost_struct_data, *e;
+  test_exchange_t    *plan_data;
+  p4est_ghost_plan_t *plan;
 
   /* Test C: don't use p4est user_data at all */
 
@@ -345,6 +349,12 @@ test_exchange_D (p4est_t * p4est, p4est_ghost_t * ghost)
                                       sizeof (test_exchange_t),
                                       mirror_data, ghost_struct_data);
 
+  /* a persistent plan for the same levels sends the same data */
+  plan = p4est_ghost_plan_new_levels (p4est, ghost, exchange_minlevel,
+                                      exchange_maxlevel,
+                                      sizeof (test_exchange_t));
+  plan_data = (test_exchange_t *) p4est_ghost_plan_exchange (plan,
+                                                             mirror_data);
   P4EST_FREE (mirror_data);
   P4EST_FREE (mirror_struct_data);
 
@@ -366,12 +376,808 @@ test_exchange_D (p4est_t * p4est, p4est_ghost_t * ghost)
                         (p4est_gloidx_t) e->ll, "Ghost exchange mismatch D2");
         SC_CHECK_ABORT (e->magic == TEST_EXCHANGE_MAGIC,
                         "Ghost exchange mismatch D3");
+        SC_CHECK_ABORT (!memcmp (e, plan_data + gl,
+                                 sizeof (test_exchange_t)),
+                        "Ghost exchange mismatch D4");
       }
     }
     gexcl = gincl;
   }
   P4EST_ASSERT (gexcl == (p4est_locidx_t) ghost->ghosts.elem_count);
   P4EST_FREE (ghost_struct_data);
+  p4est_ghost_plan_destroy (plan);
+}
+
+static void
+test_exchange_E (p4est_t * p4est, p4est_ghost_t * ghost)
+{
+  int                 p;
+  p4est_locidx_t      il, nl, mirr;
+  p4est_locidx_t      gexcl, gincl, gl;
+  p4est_gloidx_t      gnum;
+  p4est_quadrant_t   *q;
+  test_exchange_t    *send_buffer;
+  test_exchange_t    *ghost_struct_data, *e;
+
+  /* Test E: the caller packs the mirror data by receiver */
+
+  nl = ghost->mirror_proc_offsets[p4est->mpisize];
+  send_buffer = P4EST_ALLOC (test_exchange_t, nl);
+  for (il = 0; il < nl; ++il) {
+    mirr = ghost->mirror_proc_mirrors[il];
+    q = p4est_quadrant_array_index (&ghost->mirrors, mirr);
+    gnum = p4est->global_first_quadrant[p4est->mpirank] +
+      (p4est_gloidx_t) q->p.piggy3.local_num;
+    e = send_buffer + il;
+    e->gi = gnum;
+    e->ll = (long) gnum;
+    e->magic = TEST_EXCHANGE_MAGIC;
+  }
+
+  ghost_struct_data = P4EST_ALLOC (test_exchange_t, ghost->ghosts.elem_count);
+  p4est_ghost_exchange_packed (p4est, ghost, sizeof (test_exchange_t),
+                               send_buffer, ghost_struct_data);
+  P4EST_FREE (send_buffer);
+
+  gexcl = 0;
+  for (p = 0; p < p4est->mpisize; ++p) {
+    gincl = ghost->proc_offsets[p + 1];
+    gnum = p4est->global_first_quadrant[p];
+    for (gl = gexcl; gl < gincl; ++gl) {
+      q = p4est_quadrant_array_index (&ghost->ghosts, gl);
+      e = ghost_struct_data + gl;
+      SC_CHECK_ABORT (gnum + (p4est_gloidx_t) q->p.piggy3.local_num ==
+                      e->gi, "Ghost exchange mismatch E1");
+      SC_CHECK_ABORT (gnum + (p4est_gloidx_t) q->p.piggy3.local_num ==
+                      (p4est_gloidx_t) e->ll, "Ghost exchange mismatch E2");
+      SC_CHECK_ABORT (e->magic == TEST_EXCHANGE_MAGIC,
+                      "Ghost exchange mismatch E3");
+    }
+    gexcl = gincl;
+  }
+  P4EST_ASSERT (gexcl == (p4est_locidx_t) ghost->ghosts.elem_count);
+  P4EST_FREE (ghost_struct_data);
+}
+
+static void
+test_exchange_F (p4est_t * p4est, p4est_ghost_t * ghost)
+{
+  const int           exchange_minlevel = 1;
+  const int           exchange_maxlevel = refine_level - 1;
+  int                 p, l;
+  p4est_locidx_t      il, nl;
+  p4est_locidx_t      gexcl, gincl, gl;
+  p4est_gloidx_t      gnum;
+  p4est_gloidx_t     *local_gnum, *ghost_gnum;
+  p4est_quadrant_t   *q;
+  test_exchange_t    *local_struct_data;
+  test_exchange_t    *ghost_struct_data, *e;
+  p4est_ghost_field_t fields[2];
+
+  /* Test F: exchange two fields at once, the second one by levels */
+
+  nl = p4est->local_num_quadrants;
+  local_gnum = P4EST_ALLOC (p4est_gloidx_t, nl);
+  local_struct_data = P4EST_ALLOC (test_exchange_t, nl);
+  for (il = 0; il < nl; ++il) {
+    gnum = p4est->global_first_quadrant[p4est->mpirank] + il;
+    local_gnum[il] = 3 * gnum + 17;
+    e = local_struct_data + il;
+    e->gi = gnum;
+    e->ll = (long) gnum;
+    e->magic = TEST_EXCHANGE_MAGIC;
+  }
+
+  ghost_gnum = P4EST_ALLOC (p4est_gloidx_t, ghost->ghosts.elem_count);
+  ghost_struct_data =
+    P4EST_ALLOC_ZERO (test_exchange_t, ghost->ghosts.elem_count);
+  fields[0].local_data = local_gnum;
+  fields[0].ghost_data = ghost_gnum;
+  fields[0].stride = 0;
+  fields[0].elem_size = sizeof (p4est_gloidx_t);
+  fields[0].level_mask = 0;
+  fields[1].local_data = &local_struct_data->ll;
+  fields[1].ghost_data = &ghost_struct_data->ll;
+  fields[1].stride = sizeof (test_exchange_t);
+  fields[1].elem_size = sizeof (long long);
+  fields[1].level_mask = 0;
+  for (l = exchange_minlevel; l <= exchange_maxlevel; ++l) {
+    fields[1].level_mask |= (uint32_t) 1 << l;
+  }
+  p4est_ghost_exchange_fields (p4est, ghost, 2, fields);
+
+  P4EST_FREE (local_gnum);
+  P4EST_FREE (local_struct_data);
+
+  gexcl = 0;
+  for (p = 0; p < p4est->mpisize; ++p) {
+    gincl = ghost->proc_offsets[p + 1];
+    gnum = p4est->global_first_quadrant[p];
+    for (gl = gexcl; gl < gincl; ++gl) {
+      q = p4est_quadrant_array_index (&ghost->ghosts, gl);
+      SC_CHECK_ABORT (3 * (gnum + (p4est_gloidx_t) q->p.piggy3.local_num)
+                      + 17 == ghost_gnum[gl], "Ghost exchange mismatch F1");
+      e = ghost_struct_data + gl;
+      if (exchange_minlevel <= (int) q->level &&
+          (int) q->level <= exchange_maxlevel) {
+        SC_CHECK_ABORT (gnum + (p4est_gloidx_t) q->p.piggy3.local_num ==
+                        (p4est_gloidx_t) e->ll, "Ghost exchange mismatch F2");
+      }
+      else {
+        SC_CHECK_ABORT (e->ll == 0, "Ghost exchange mismatch F3");
+      }
+      SC_CHECK_ABORT (e->gi == 0 && e->magic == 0.,
+                      "Ghost exchange mismatch F4");
+    }
+    gexcl = gincl;
+  }
+  P4EST_ASSERT (gexcl == (p4est_locidx_t) ghost->ghosts.elem_count);
+  P4EST_FREE (ghost_gnum);
+  P4EST_FREE (ghost_struct_data);
+}
+
+static void
+test_exchange_plan (p4est_t * p4est, p4est_ghost_t * ghost)
+{
+  const int           num_rounds = 3;
+  int                 p, round;
+  size_t              zz;
+  p4est_topidx_t      nt;
+  p4est_locidx_t      gexcl, gincl, gl;
+  p4est_gloidx_t      gnum;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  void              **mirror_data;
+  test_exchange_t    *ghost_struct_data, *e;
+  p4est_ghost_plan_t *plan;
+
+  /* Test plan: repeat exchanges of user_data and custom data */
+
+  p4est_reset_data (p4est, sizeof (test_exchange_t), NULL, NULL);
+  plan = p4est_ghost_plan_new (p4est, ghost, sizeof (test_exchange_t));
+  SC_CHECK_ABORT (p4est_ghost_plan_is_valid (plan), "Ghost plan invalid");
+  mirror_data = P4EST_ALLOC (void *, ghost->mirrors.elem_count);
+  for (round = 0; round < num_rounds; ++round) {
+    gnum = p4est->global_first_quadrant[p4est->mpirank];
+    for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+      tree = p4est_tree_array_index (p4est->trees, nt);
+      for (zz = 0; zz < tree->quadrants.elem_count; ++gnum, ++zz) {
+        q = p4est_quadrant_array_index (&tree->quadrants, zz);
+        e = (test_exchange_t *) q->p.user_data;
+        e->gi = gnum;
+        e->ll = (long) (gnum + round);
+        e->magic = TEST_EXCHANGE_MAGIC;
+      }
+    }
+    P4EST_ASSERT (gnum == p4est->global_first_quadrant[p4est->mpirank + 1]);
+
+    /* on the last round the mirror data is passed explicitly */
+    for (zz = 0; zz < ghost->mirrors.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&ghost->mirrors, zz);
+      tree = p4est_tree_array_index (p4est->trees, q->p.piggy3.which_tree);
+      q = p4est_quadrant_array_index
+        (&tree->quadrants, q->p.piggy3.local_num - tree->quadrants_offset);
+      mirror_data[zz] = q->p.user_data;
+    }
+    ghost_struct_data = (test_exchange_t *) p4est_ghost_plan_exchange
+      (plan, round == num_rounds - 1 ? mirror_data : NULL);
+
+    gexcl = 0;
+    for (p = 0; p < p4est->mpisize; ++p) {
+      gincl = ghost->proc_offsets[p + 1];
+      gnum = p4est->global_first_quadrant[p];
+      for (gl = gexcl; gl < gincl; ++gl) {
+        q = p4est_quadrant_array_index (&ghost->ghosts, gl);
+        e = ghost_struct_data + gl;
+        SC_CHECK_ABORT (gnum + (p4est_gloidx_t) q->p.piggy3.local_num ==
+                        e->gi, "Ghost exchange mismatch plan 1");
+        SC_CHECK_ABORT (gnum + (p4est_gloidx_t) q->p.piggy3.local_num +
+                        round == (p4est_gloidx_t) e->ll,
+                        "Ghost exchange mismatch plan 2");
+        SC_CHECK_ABORT (e->magic == TEST_EXCHANGE_MAGIC,
+                        "Ghost exchange mismatch plan 3");
+      }
+      gexcl = gincl;
+    }
+    P4EST_ASSERT (gexcl == (p4est_locidx_t) ghost->ghosts.elem_count);
+  }
+  P4EST_FREE (mirror_data);
+  p4est_ghost_plan_destroy (plan);
+}
+
+static void
+test_exchange_plan_overlap (p4est_t * p4est, p4est_ghost_t * ghost)
+{
+  int                 p;
+  size_t              zz;
+  p4est_topidx_t      nt;
+  p4est_locidx_t      gexcl, gincl, gl;
+  p4est_gloidx_t      gnum, *mirror_gi, *ghost_gi;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  void              **mirror_data;
+  test_exchange_t    *ghost_struct_data, *e;
+  p4est_ghost_plan_t *plan_gi, *plan_struct;
+#ifdef P4EST_ENABLE_MPICOMMSHARED
+  int                 mpiret, nodesize;
+  MPI_Comm            nodecomm;
+#endif
+
+  /* two live plans whose exchanges overlap must not mix their buffers */
+  p4est_reset_data (p4est, sizeof (test_exchange_t), NULL, NULL);
+  gnum = p4est->global_first_quadrant[p4est->mpirank];
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++gnum, ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      e = (test_exchange_t *) q->p.user_data;
+      e->gi = gnum;
+      e->ll = -(long long) gnum;
+      e->magic = TEST_EXCHANGE_MAGIC;
+    }
+  }
+  mirror_gi = P4EST_ALLOC (p4est_gloidx_t, ghost->mirrors.elem_count);
+  mirror_data = P4EST_ALLOC (void *, ghost->mirrors.elem_count);
+  for (zz = 0; zz < ghost->mirrors.elem_count; ++zz) {
+    q = p4est_quadrant_array_index (&ghost->mirrors, zz);
+    mirror_gi[zz] = p4est->global_first_quadrant[p4est->mpirank] +
+      q->p.piggy3.local_num;
+    mirror_data[zz] = &mirror_gi[zz];
+  }
+
+  plan_gi = p4est_ghost_plan_new (p4est, ghost, sizeof (p4est_gloidx_t));
+  plan_struct = p4est_ghost_plan_new (p4est, ghost, sizeof (test_exchange_t));
+#ifdef P4EST_ENABLE_MPICOMMSHARED
+  /* the send buffer is shared whenever the node has other processes */
+  mpiret = MPI_Comm_split_type (p4est->mpicomm, MPI_COMM_TYPE_SHARED,
+                                p4est->mpirank, MPI_INFO_NULL, &nodecomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_size (nodecomm, &nodesize);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_free (&nodecomm);
+  SC_CHECK_MPI (mpiret);
+  SC_CHECK_ABORT ((plan_gi->shared != NULL) == (nodesize > 1) &&
+                  (plan_struct->shared != NULL) == (nodesize > 1),
+                  "Ghost plan shared buffer");
+#endif
+  p4est_ghost_plan_begin (plan_gi, mirror_data);
+  p4est_ghost_plan_begin (plan_struct, NULL);
+  ghost_struct_data =
+    (test_exchange_t *) p4est_ghost_plan_end (plan_struct);
+  ghost_gi = (p4est_gloidx_t *) p4est_ghost_plan_end (plan_gi);
+
+  gexcl = 0;
+  for (p = 0; p < p4est->mpisize; ++p) {
+    gincl = ghost->proc_offsets[p + 1];
+    gnum = p4est->global_first_quadrant[p];
+    for (gl = gexcl; gl < gincl; ++gl) {
+      q = p4est_quadrant_array_index (&ghost->ghosts, gl);
+      e = ghost_struct_data + gl;
+      SC_CHECK_ABORT (ghost_gi[gl] == gnum + q->p.piggy3.local_num,
+                      "Ghost exchange mismatch overlap 1");
+      SC_CHECK_ABORT (e->gi == ghost_gi[gl] && e->ll == -(long long) e->gi
+                      && e->magic == TEST_EXCHANGE_MAGIC,
+                      "Ghost exchange mismatch overlap 2");
+    }
+    gexcl = gincl;
+  }
+  P4EST_ASSERT (gexcl == (p4est_locidx_t) ghost->ghosts.elem_count);
+
+  p4est_ghost_plan_destroy (plan_struct);
+  p4est_ghost_plan_destroy (plan_gi);
+  P4EST_FREE (mirror_data);
+  P4EST_FREE (mirror_gi);
+}
+
+static void
+test_exchange_types (p4est_t * p4est, p4est_ghost_t * ghost)
+{
+  const p4est_locidx_t num_local = p4est->local_num_quadrants;
+  const p4est_locidx_t num_ghosts = ghost->proc_offsets[ghost->mpisize];
+  int                 p, round;
+  p4est_locidx_t      il, gl;
+  p4est_quadrant_t   *q;
+  test_exchange_t    *local_data, *ghost_data;
+  p4est_ghost_types_t *types;
+
+  /* Test types: exchange one member of a struct array in place */
+
+  local_data = P4EST_ALLOC (test_exchange_t, num_local);
+  ghost_data = P4EST_ALLOC (test_exchange_t, num_ghosts);
+
+  /* the datatypes may be built from a compact ghost layer */
+  p4est_ghost_set_compact (p4est, ghost, 1);
+  types = p4est_ghost_types_new (p4est, ghost, sizeof (p4est_gloidx_t),
+                                 sizeof (test_exchange_t));
+  p4est_ghost_set_compact (p4est, ghost, 0);
+  SC_CHECK_ABORT (p4est_ghost_types_is_valid (types), "Ghost types invalid");
+
+  for (round = 0; round < 2; ++round) {
+    for (il = 0; il < num_local; ++il) {
+      local_data[il].gi = p4est->global_first_quadrant[p4est->mpirank] +
+        il + round;
+      local_data[il].magic = TEST_EXCHANGE_MAGIC;
+    }
+    for (gl = 0; gl < num_ghosts; ++gl) {
+      ghost_data[gl].gi = -1;
+      ghost_data[gl].magic = -1.;
+    }
+    p4est_ghost_types_exchange (types, local_data, ghost_data);
+    for (p = 0; p < p4est->mpisize; ++p) {
+      for (gl = ghost->proc_offsets[p]; gl < ghost->proc_offsets[p + 1];
+           ++gl) {
+        q = p4est_quadrant_array_index (&ghost->ghosts, gl);
+        SC_CHECK_ABORT (ghost_data[gl].gi ==
+                        p4est->global_first_quadrant[p] +
+                        q->p.piggy3.local_num + round,
+                        "Ghost exchange mismatch types 1");
+        SC_CHECK_ABORT (ghost_data[gl].magic == -1.,
+                        "Ghost exchange mismatch types 2");
+      }
+    }
+  }
+
+  p4est_ghost_types_destroy (types);
+  P4EST_FREE (ghost_data);
+  P4EST_FREE (local_data);
+}
+
+static void
+test_index (p4est_ghost_t * ghost)
+{
+  const size_t        num_ghosts = ghost->ghosts.elem_count;
+  int                 p, owner;
+  size_t              zz;
+  ssize_t            *parents;
+  p4est_topidx_t      nt;
+  p4est_quadrant_t   *g, c;
+  p4est_ghost_index_t *index;
+
+  /* record binary search results with the table detached */
+  index = ghost->index;
+  ghost->index = NULL;
+  parents = P4EST_ALLOC (ssize_t, num_ghosts);
+  for (zz = 0; zz < num_ghosts; ++zz) {
+    g = p4est_quadrant_array_index (&ghost->ghosts, zz);
+    parents[zz] = -2;
+    if (g->level > 0) {
+      p4est_quadrant_parent (g, &c);
+      parents[zz] = p4est_ghost_contains (ghost, -1,
+                                          g->p.piggy3.which_tree, &c);
+    }
+  }
+  ghost->index = index;
+  if (index == NULL) {
+    p4est_ghost_set_index (ghost, 1);
+  }
+
+  /* compare the hash table lookups with the binary searches */
+  for (zz = 0; zz < num_ghosts; ++zz) {
+    g = p4est_quadrant_array_index (&ghost->ghosts, zz);
+    nt = g->p.piggy3.which_tree;
+    owner = 0;
+    while ((size_t) ghost->proc_offsets[owner + 1] <= zz) {
+      ++owner;
+    }
+    for (p = -1; p <= owner; p += owner + 1) {
+      SC_CHECK_ABORT (p4est_ghost_bsearch (ghost, p, nt, g) == (ssize_t) zz,
+                      "Ghost index bsearch");
+      SC_CHECK_ABORT (p4est_ghost_contains (ghost, p, nt, g) == (ssize_t) zz,
+                      "Ghost index contains");
+    }
+    if (g->level < P4EST_QMAXLEVEL) {
+      p4est_quadrant_last_descendant (g, &c, g->level + 1);
+      SC_CHECK_ABORT (p4est_ghost_contains (ghost, -1, nt, &c) ==
+                      (ssize_t) zz, "Ghost index child");
+      SC_CHECK_ABORT (p4est_ghost_bsearch (ghost, -1, nt, &c) == -1,
+                      "Ghost index child bsearch");
+    }
+    if (g->level > 0) {
+      p4est_quadrant_parent (g, &c);
+      SC_CHECK_ABORT (p4est_ghost_contains (ghost, -1, nt, &c) ==
+                      parents[zz], "Ghost index parent");
+    }
+  }
+  P4EST_FREE (parents);
+}
+
+static void
+test_compact (p4est_t * p4est, p4est_ghost_t * ghost)
+{
+  int                 p;
+  size_t              zz;
+  p4est_locidx_t      il, *pm;
+  p4est_quadrant_t    q;
+  sc_array_t         *ghosts, *mirrors, *proc_mirrors;
+
+  ghosts = sc_array_new_count (sizeof (p4est_quadrant_t),
+                               ghost->ghosts.elem_count);
+  sc_array_copy (ghosts, &ghost->ghosts);
+  mirrors = sc_array_new_count (sizeof (p4est_quadrant_t),
+                                ghost->mirrors.elem_count);
+  sc_array_copy (mirrors, &ghost->mirrors);
+  proc_mirrors = sc_array_new (sizeof (p4est_locidx_t));
+
+  /* the compact form must reproduce ghosts, mirrors and mirror lists */
+  p4est_ghost_set_compact (p4est, ghost, 1);
+  SC_CHECK_ABORT (ghost->ghosts.elem_count == 0 &&
+                  ghost->mirror_proc_mirrors == NULL, "Compact arrays");
+  for (zz = 0; zz < ghosts->elem_count; ++zz) {
+    p4est_ghost_compact_ghost (ghost, (p4est_locidx_t) zz, &q);
+    SC_CHECK_ABORT (p4est_quadrant_is_equal_piggy
+                    (&q, p4est_quadrant_array_index (ghosts, zz)),
+                    "Compact ghost");
+  }
+  for (zz = 0; zz < mirrors->elem_count; ++zz) {
+    SC_CHECK_ABORT (p4est_ghost_compact_mirror (ghost, (p4est_locidx_t) zz)
+                    == p4est_quadrant_array_index (mirrors, zz)->
+                    p.piggy3.local_num, "Compact mirror");
+  }
+  for (p = 0; p < ghost->mpisize; ++p) {
+    p4est_ghost_compact_proc_mirrors (ghost, p, proc_mirrors);
+    SC_CHECK_ABORT ((p4est_locidx_t) proc_mirrors->elem_count ==
+                    ghost->mirror_proc_offsets[p + 1] -
+                    ghost->mirror_proc_offsets[p], "Compact mirror count");
+  }
+
+  /* switching back restores the exact arrays */
+  p4est_ghost_set_compact (p4est, ghost, 0);
+  SC_CHECK_ABORT (ghost->ghosts.elem_count == ghosts->elem_count &&
+                  ghost->mirrors.elem_count == mirrors->elem_count,
+                  "Compact restore count");
+  for (zz = 0; zz < ghosts->elem_count; ++zz) {
+    SC_CHECK_ABORT (p4est_quadrant_is_equal_piggy
+                    (p4est_quadrant_array_index (&ghost->ghosts, zz),
+                     p4est_quadrant_array_index (ghosts, zz)),
+                    "Compact restore ghost");
+  }
+  for (zz = 0; zz < mirrors->elem_count; ++zz) {
+    SC_CHECK_ABORT (p4est_quadrant_is_equal_piggy
+                    (p4est_quadrant_array_index (&ghost->mirrors, zz),
+                     p4est_quadrant_array_index (mirrors, zz)),
+                    "Compact restore mirror");
+  }
+  for (p = 0; p < ghost->mpisize; ++p) {
+    p4est_ghost_compact_proc_mirrors (ghost, p, proc_mirrors);
+    pm = ghost->mirror_proc_mirrors + ghost->mirror_proc_offsets[p];
+    for (il = 0; il < (p4est_locidx_t) proc_mirrors->elem_count; ++il) {
+      SC_CHECK_ABORT (pm[il] == *(p4est_locidx_t *)
+                      sc_array_index (proc_mirrors, (size_t) il),
+                      "Compact restore mirror list");
+    }
+  }
+
+  sc_array_destroy (ghosts);
+  sc_array_destroy (mirrors);
+  sc_array_destroy (proc_mirrors);
+}
+
+typedef struct test_node
+{
+  p4est_gloidx_t      global;
+  p4est_locidx_t      local;
+}
+test_node_t;
+
+static int
+test_node_compare (const void *v1, const void *v2)
+{
+  const test_node_t  *n1 = (const test_node_t *) v1;
+  const test_node_t  *n2 = (const test_node_t *) v2;
+
+  return n1->global < n2->global ? -1 : n1->global > n2->global;
+}
+
+/* whether an element lists its k-th node already at a smaller position */
+static int
+test_node_repeated (const p4est_gloidx_t * element_nodes, int k)
+{
+  int                 j;
+
+  for (j = 0; j < k; ++j) {
+    if (element_nodes[j] == element_nodes[k]) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* every element of any process that references a local node is either
+ * local or a ghost, and no ghost is counted twice */
+static void
+test_support (p4est_t * p4est, p4est_lnodes_t * lnodes,
+              p4est_ghost_t * ghost)
+{
+  const int           vnodes = lnodes->vnodes;
+  const p4est_locidx_t nle = lnodes->num_local_elements;
+  int                 k;
+  size_t              zz, zy, num_ghosts;
+  ssize_t             result;
+  p4est_locidx_t      el, nid, *counts, *totals;
+  p4est_gloidx_t     *element_nodes, *ghost_nodes, *gn;
+  p4est_quadrant_t   *q;
+  void              **mirror_data;
+  sc_array_t          count_array, nonlocal, *peer_buffer;
+  test_node_t        *node, key;
+  p4est_lnodes_rank_t *lrank;
+  p4est_lnodes_buffer_t *buffer;
+
+  /* count the local elements referencing each local node */
+  element_nodes = P4EST_ALLOC (p4est_gloidx_t, nle * vnodes);
+  counts = P4EST_ALLOC_ZERO (p4est_locidx_t, lnodes->num_local_nodes);
+  for (el = 0; el < nle; ++el) {
+    for (k = 0; k < vnodes; ++k) {
+      nid = lnodes->element_nodes[el * vnodes + k];
+      element_nodes[el * vnodes + k] = p4est_lnodes_global_index (lnodes, nid);
+      if (!test_node_repeated (element_nodes + el * vnodes, k)) {
+        ++counts[nid];
+      }
+    }
+  }
+
+  /* add the counts of the other processes sharing a node */
+  totals = P4EST_ALLOC (p4est_locidx_t, lnodes->num_local_nodes);
+  memcpy (totals, counts, lnodes->num_local_nodes * sizeof (p4est_locidx_t));
+  sc_array_init_data (&count_array, counts, sizeof (p4est_locidx_t),
+                      lnodes->num_local_nodes);
+  buffer = p4est_lnodes_share_all (&count_array, lnodes);
+  for (zz = 0; zz < lnodes->sharers->elem_count; ++zz) {
+    lrank = p4est_lnodes_rank_array_index (lnodes->sharers, zz);
+    if (lrank->rank == p4est->mpirank) {
+      continue;
+    }
+    peer_buffer = (sc_array_t *) sc_array_index (buffer->recv_buffers, zz);
+    for (zy = 0; zy < lrank->shared_nodes.elem_count; ++zy) {
+      nid = *(p4est_locidx_t *) sc_array_index (&lrank->shared_nodes, zy);
+      totals[nid] += *(p4est_locidx_t *) sc_array_index (peer_buffer, zy);
+    }
+  }
+  p4est_lnodes_buffer_destroy (buffer);
+
+  /* fetch the global nodes of the ghost elements */
+  mirror_data = P4EST_ALLOC (void *, ghost->mirrors.elem_count);
+  for (zz = 0; zz < ghost->mirrors.elem_count; ++zz) {
+    q = p4est_quadrant_array_index (&ghost->mirrors, zz);
+    mirror_data[zz] = element_nodes + q->p.piggy3.local_num * vnodes;
+  }
+  num_ghosts = ghost->ghosts.elem_count;
+  ghost_nodes = P4EST_ALLOC (p4est_gloidx_t, num_ghosts * vnodes);
+  p4est_ghost_exchange_custom (p4est, ghost, vnodes * sizeof (p4est_gloidx_t),
+                               mirror_data, ghost_nodes);
+
+  /* subtract the local and ghost elements referencing each local node */
+  sc_array_init (&nonlocal, sizeof (test_node_t));
+  for (nid = lnodes->owned_count; nid < lnodes->num_local_nodes; ++nid) {
+    node = (test_node_t *) sc_array_push (&nonlocal);
+    node->global = lnodes->nonlocal_nodes[nid - lnodes->owned_count];
+    node->local = nid;
+  }
+  sc_array_sort (&nonlocal, test_node_compare);
+  for (nid = 0; nid < lnodes->num_local_nodes; ++nid) {
+    totals[nid] -= counts[nid];
+  }
+  for (zz = 0; zz < num_ghosts; ++zz) {
+    gn = ghost_nodes + zz * vnodes;
+    for (k = 0; k < vnodes; ++k) {
+      if (test_node_repeated (gn, k)) {
+        continue;
+      }
+      if (lnodes->global_offset <= gn[k] &&
+          gn[k] < lnodes->global_offset + lnodes->owned_count) {
+        nid = (p4est_locidx_t) (gn[k] - lnodes->global_offset);
+      }
+      else {
+        key.global = gn[k];
+        result = sc_array_bsearch (&nonlocal, &key, test_node_compare);
+        if (result < 0) {
+          continue;
+        }
+        nid = ((test_node_t *)
+               sc_array_index (&nonlocal, (size_t) result))->local;
+      }
+      --totals[nid];
+    }
+  }
+  for (nid = 0; nid < lnodes->num_local_nodes; ++nid) {
+    SC_CHECK_ABORT (totals[nid] == 0, "Ghost support lnodes");
+  }
+
+  sc_array_reset (&nonlocal);
+  P4EST_FREE (ghost_nodes);
+  P4EST_FREE (mirror_data);
+  P4EST_FREE (totals);
+  P4EST_FREE (counts);
+  P4EST_FREE (element_nodes);
+}
+
+static int
+refine_origin_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+                  p4est_quadrant_t * quadrant)
+{
+  return which_tree == 0 && quadrant->x == 0 && quadrant->y == 0 &&
+#ifdef P4_TO_P8
+    quadrant->z == 0 &&
+#endif
+    (int) quadrant->level <= refine_level;
+}
+
+static void
+test_ghost_equal (p4est_ghost_t * ghost, p4est_ghost_t * fresh)
+{
+  const int           mpisize = ghost->mpisize;
+  const p4est_topidx_t num_trees = ghost->num_trees;
+  size_t              zz;
+  p4est_quadrant_t   *q1, *q2;
+
+  SC_CHECK_ABORT (ghost->ghosts.elem_count == fresh->ghosts.elem_count &&
+                  ghost->mirrors.elem_count == fresh->mirrors.elem_count,
+                  "Ghost update counts");
+  for (zz = 0; zz < ghost->ghosts.elem_count; ++zz) {
+    q1 = p4est_quadrant_array_index (&ghost->ghosts, zz);
+    q2 = p4est_quadrant_array_index (&fresh->ghosts, zz);
+    SC_CHECK_ABORT (p4est_quadrant_is_equal_piggy (q1, q2) &&
+                    q1->p.piggy3.local_num == q2->p.piggy3.local_num,
+                    "Ghost update ghosts");
+  }
+  for (zz = 0; zz < ghost->mirrors.elem_count; ++zz) {
+    q1 = p4est_quadrant_array_index (&ghost->mirrors, zz);
+    q2 = p4est_quadrant_array_index (&fresh->mirrors, zz);
+    SC_CHECK_ABORT (p4est_quadrant_is_equal_piggy (q1, q2) &&
+                    q1->p.piggy3.local_num == q2->p.piggy3.local_num,
+                    "Ghost update mirrors");
+  }
+  SC_CHECK_ABORT (!memcmp (ghost->tree_offsets, fresh->tree_offsets,
+                           (num_trees + 1) * sizeof (p4est_locidx_t)) &&
+                  !memcmp (ghost->proc_offsets, fresh->proc_offsets,
+                           (mpisize + 1) * sizeof (p4est_locidx_t)) &&
+                  !memcmp (ghost->mirror_tree_offsets,
+                           fresh->mirror_tree_offsets,
+                           (num_trees + 1) * sizeof (p4est_locidx_t)) &&
+                  !memcmp (ghost->mirror_proc_offsets,
+                           fresh->mirror_proc_offsets,
+                           (mpisize + 1) * sizeof (p4est_locidx_t)) &&
+                  !memcmp (ghost->mirror_proc_mirrors,
+                           fresh->mirror_proc_mirrors,
+                           fresh->mirror_proc_offsets[mpisize] *
+                           sizeof (p4est_locidx_t)),
+                  "Ghost update offsets");
+}
+
+static void
+test_update (p4est_t * p4est)
+{
+  int                 i;
+  p4est_ghost_t      *ghost, *fresh;
+
+  /* update after no change, a local refinement, and a partition */
+  ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+  for (i = 0; i < 4; ++i) {
+    if (i == 2) {
+      p4est_refine (p4est, 0, refine_origin_fn, NULL);
+      p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
+    }
+    else if (i == 3) {
+      p4est_partition (p4est, 0, NULL);
+    }
+    p4est_ghost_update (p4est, ghost);
+    fresh = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+    test_ghost_equal (ghost, fresh);
+    p4est_ghost_destroy (fresh);
+  }
+  test_exchange_A (p4est, ghost);
+  p4est_ghost_destroy (ghost);
+}
+
+static void
+test_new_layers (p4est_t * p4est)
+{
+  int                 i;
+  p4est_ghost_t      *ghost, *fresh;
+
+  /* compare against repeated expansion of a single layer */
+  ghost = p4est_ghost_new_layers (p4est, P4EST_CONNECT_FULL, 3);
+  fresh = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+  for (i = 1; i < 3; ++i) {
+    p4est_ghost_expand (p4est, fresh);
+  }
+  test_ghost_equal (ghost, fresh);
+  test_exchange_C (p4est, ghost);
+  p4est_ghost_destroy (fresh);
+  p4est_ghost_destroy (ghost);
+}
+
+static void
+test_new_begin (p4est_t * p4est)
+{
+  int                 f;
+  p4est_ghost_build_t *build;
+  p4est_ghost_t      *ghost, *fresh;
+  p4est_t            *forests[2];
+  p4est_ghost_t      *ghosts[2];
+
+  /* the split construction must match the blocking one */
+  build = p4est_ghost_new_begin (p4est, P4EST_CONNECT_FULL);
+  SC_CHECK_ABORT (build->ghost != NULL, "Ghost build context");
+  ghost = p4est_ghost_new_end (build);
+  fresh = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+  test_ghost_equal (ghost, fresh);
+  test_exchange_C (p4est, ghost);
+  p4est_ghost_destroy (fresh);
+  p4est_ghost_destroy (ghost);
+
+  /* so must the layers of an ensemble of differently refined forests */
+  forests[0] = p4est;
+  forests[1] = p4est_copy (p4est, 0);
+  p4est_refine (forests[1], 0, refine_origin_fn, NULL);
+  p4est_balance (forests[1], P4EST_CONNECT_FULL, NULL);
+  p4est_partition (forests[1], 0, NULL);
+  p4est_ghost_new_ensemble (2, forests, P4EST_CONNECT_FULL, ghosts);
+  for (f = 0; f < 2; ++f) {
+    fresh = p4est_ghost_new (forests[f], P4EST_CONNECT_FULL);
+    test_ghost_equal (ghosts[f], fresh);
+    p4est_ghost_destroy (fresh);
+    p4est_ghost_destroy (ghosts[f]);
+  }
+  p4est_destroy (forests[1]);
+}
+
+static void
+test_selective (p4est_t * p4est)
+{
+  int                 p;
+  int8_t             *selected;
+  size_t              zz;
+  p4est_locidx_t      li, gl;
+  p4est_gloidx_t      gnum;
+  p4est_quadrant_t   *q;
+  p4est_ghost_t      *ghost, *fresh;
+
+  /* selecting every quadrant reproduces the complete layer */
+  selected = P4EST_ALLOC (int8_t, p4est->local_num_quadrants);
+  memset (selected, 1, p4est->local_num_quadrants * sizeof (int8_t));
+  ghost = p4est_ghost_new_selective (p4est, P4EST_CONNECT_FULL, selected);
+  fresh = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+  test_ghost_equal (ghost, fresh);
+  p4est_ghost_destroy (ghost);
+
+  /* otherwise mirrors and ghosts are the selected part of the complete one */
+  gnum = p4est->global_first_quadrant[p4est->mpirank];
+  for (li = 0; li < p4est->local_num_quadrants; ++li) {
+    selected[li] = (int8_t) ((gnum + li) % 3 == 0);
+  }
+  ghost = p4est_ghost_new_selective (p4est, P4EST_CONNECT_FULL, selected);
+  SC_CHECK_ABORT (p4est_ghost_is_valid (p4est, ghost), "Selective valid");
+  SC_CHECK_ABORT (ghost->ghosts.elem_count <= fresh->ghosts.elem_count,
+                  "Selective ghost count");
+  li = 0;
+  for (zz = 0; zz < fresh->mirrors.elem_count; ++zz) {
+    q = p4est_quadrant_array_index (&fresh->mirrors, zz);
+    if (selected[q->p.piggy3.local_num]) {
+      SC_CHECK_ABORT ((size_t) li < ghost->mirrors.elem_count &&
+                      p4est_quadrant_is_equal_piggy
+                      (q, p4est_quadrant_array_index (&ghost->mirrors,
+                                                      (size_t) li)),
+                      "Selective mirrors");
+      ++li;
+    }
+  }
+  SC_CHECK_ABORT ((size_t) li == ghost->mirrors.elem_count,
+                  "Selective mirror count");
+  for (p = 0; p < p4est->mpisize; ++p) {
+    gnum = p4est->global_first_quadrant[p];
+    for (gl = ghost->proc_offsets[p]; gl < ghost->proc_offsets[p + 1]; ++gl) {
+      q = p4est_quadrant_array_index (&ghost->ghosts, (size_t) gl);
+      SC_CHECK_ABORT ((gnum + q->p.piggy3.local_num) % 3 == 0 &&
+                      p4est_ghost_bsearch (fresh, p, q->p.which_tree, q) >= 0,
+                      "Selective ghosts");
+    }
+  }
+  test_exchange_A (p4est, ghost);
+  test_exchange_C (p4est, ghost);
+
+  p4est_ghost_destroy (fresh);
+  p4est_ghost_destroy (ghost);
+  P4EST_FREE (selected);
 }
 
 int
@@ -383,10 +1189,13 @@ main (int argc, char **argv)
   p4est_connectivity_t *conn;
   p4est_ghost_t      *ghost;
   p4est_ghost_exchange_t *exc;
+  p4est_ghost_plan_t *plan;
   int                 num_cycles = 2;
   int                 i;
   p4est_lnodes_t     *lnodes;
   int                 type;
+  p4est_inspect_t     inspect;
+  p4est_comm_compress_t compress;
 
   /* initialize MPI */
   mpiret = sc_MPI_Init (&argc, &argv);
@@ -421,17 +1230,64 @@ main (int argc, char **argv)
   test_exchange_B (p4est, ghost);
   test_exchange_C (p4est, ghost);
   test_exchange_D (p4est, ghost);
+  test_exchange_E (p4est, ghost);
+  test_exchange_F (p4est, ghost);
+  test_exchange_plan (p4est, ghost);
+  test_exchange_plan_overlap (p4est, ghost);
+  test_exchange_types (p4est, ghost);
+  test_index (ghost);
+  test_compact (p4est, ghost);
+  p4est_ghost_set_index (ghost, 0);
+
+  /* repeat the tests with compressed messages */
+  memset (&inspect, 0, sizeof (inspect));
+  memset (&compress, 0, sizeof (compress));
+  compress.codec = P4EST_COMM_CODEC_DEFLATE;
+  inspect.ghost_compress = &compress;
+  p4est->inspect = &inspect;
+  test_exchange_A (p4est, ghost);
+  test_exchange_B (p4est, ghost);
+  test_exchange_C (p4est, ghost);
+  test_exchange_D (p4est, ghost);
+  p4est->inspect = NULL;
 
   for (i = 0; i < num_cycles; i++) {
     /* expand and test that the ghost layer can still exchange data properly
      * */
+    plan = p4est_ghost_plan_new (p4est, ghost, sizeof (long));
     p4est_ghost_expand (p4est, ghost);
+    SC_CHECK_ABORT (!p4est_ghost_plan_is_valid (plan) ==
+                    (plan->num_ghosts != ghost->ghosts.elem_count),
+                    "Ghost plan validity after expand");
+    p4est_ghost_plan_destroy (plan);
     test_exchange_A (p4est, ghost);
     test_exchange_B (p4est, ghost);
     test_exchange_C (p4est, ghost);
     test_exchange_D (p4est, ghost);
+    test_exchange_F (p4est, ghost);
+    test_exchange_plan (p4est, ghost);
+    test_exchange_types (p4est, ghost);
   }
 
+  /* repeat the tests with neighborhood collectives if available */
+  p4est_ghost_set_neighborhood (p4est, ghost, 1);
+  test_exchange_A (p4est, ghost);
+  test_exchange_B (p4est, ghost);
+  test_exchange_C (p4est, ghost);
+  test_exchange_D (p4est, ghost);
+  test_exchange_E (p4est, ghost);
+  test_exchange_F (p4est, ghost);
+  test_index (ghost);
+  p4est_ghost_expand (p4est, ghost);
+  test_index (ghost);
+  test_compact (p4est, ghost);
+  test_exchange_A (p4est, ghost);
+  test_exchange_B (p4est, ghost);
+  test_exchange_C (p4est, ghost);
+  test_exchange_D (p4est, ghost);
+  test_exchange_E (p4est, ghost);
+  test_exchange_F (p4est, ghost);
+
   p4est_ghost_destroy (ghost);
   /* repeat the cycle, but with lnodes */
   /* create the ghost layer */
@@ -439,6 +1295,7 @@ main (int argc, char **argv)
   type = p4est_connect_type_int (ghost->btype);
   lnodes = p4est_lnodes_new (p4est, ghost, -type);
   p4est_ghost_support_lnodes (p4est, lnodes, ghost);
+  test_support (p4est, lnodes, ghost);
   /* test ghost data exchange */
   test_exchange_A (p4est, ghost);
   test_exchange_B (p4est, ghost);
@@ -449,6 +1306,7 @@ main (int argc, char **argv)
     /* expand and test that the ghost layer can still exchange data properly
      * */
     p4est_ghost_expand_by_lnodes (p4est, lnodes, ghost);
+    test_support (p4est, lnodes, ghost);
     exc = test_exchange_begin (p4est, ghost);
     test_exchange_A (p4est, ghost);
     test_exchange_B (p4est, ghost);
@@ -460,6 +1318,12 @@ main (int argc, char **argv)
   /* clean up */
   p4est_lnodes_destroy (lnodes);
   p4est_ghost_destroy (ghost);
+
+  /* test the incremental ghost layer update */
+  test_update (p4est);
+  test_new_layers (p4est);
+  test_new_begin (p4est);
+  test_selective (p4est);
   p4est_destroy (p4est);
   p4est_connectivity_destroy (conn);
 
@@ -24,10 +24,12 @@
 
 #ifndef P4_TO_P8
 #include <p4est_io.h>
+#include <p4est_algorithms.h>
 #include <p4est_extended.h>
 #include <p4est_bits.h>
 #else
 #include <p8est_io.h>
+#include <p8est_algorithms.h>
 #include <p8est_extended.h>
 #include <p8est_bits.h>
 #endif
@@ -204,6 +206,452 @@ typedef struct compressed_quadrant
 }
 compressed_quadrant_t;
 
+/* write a field and the forest in the background and read them back */
+static void
+test_async (p4est_t * p4est, sc_array_t * quad_data)
+{
+  int                 errcode;
+  char                user_string[P4EST_FILE_USER_STRING_BYTES];
+  p4est_t            *loaded;
+  p4est_file_context_t *fc;
+  p4est_file_async_t *async;
+  sc_array_t          read_data;
+
+  fc = p4est_file_open_create (p4est, "test_io_async." P4EST_DATA_FILE_EXT,
+                               "Async data file", &errcode);
+  SC_CHECK_ABORT (fc != NULL, "Open create async");
+
+  /* a small bound forces the first write to complete early */
+  async = p4est_file_async_new (fc, 1);
+  write_chars (p4est, quad_data);
+  SC_CHECK_ABORT (p4est_file_async_write_field
+                  (async, quad_data->elem_size, quad_data,
+                   "Quadrant-wise char", &errcode) == async,
+                  "Write chars async");
+
+  /* the staged copy is not affected by changing the source */
+  memset (quad_data->array, 0, quad_data->elem_count);
+  SC_CHECK_ABORT (p4est_file_async_write_p4est
+                  (async, p4est, "Quadrants", "Quadrant data",
+                   &errcode) == async, "Write forest async");
+  p4est_file_async_test (async);
+  fc = p4est_file_async_wait (async, &errcode);
+  SC_CHECK_ABORT (fc != NULL && errcode == P4EST_FILE_ERR_SUCCESS,
+                  "Wait async");
+  SC_CHECK_ABORT (p4est_file_close (fc, &errcode) == 0,
+                  "Close async file context");
+
+  fc = p4est_file_open_read (p4est, "test_io_async." P4EST_DATA_FILE_EXT,
+                             user_string, &errcode);
+  SC_CHECK_ABORT (fc != NULL, "Open read async");
+  sc_array_init_size (&read_data, sizeof (char),
+                      (size_t) p4est->local_num_quadrants);
+  SC_CHECK_ABORT (p4est_file_read_field
+                  (fc, read_data.elem_size, &read_data, user_string,
+                   &errcode) != NULL, "Read chars async");
+  write_chars (p4est, quad_data);
+  SC_CHECK_ABORT (sc_array_is_equal (&read_data, quad_data),
+                  "Compare chars async");
+  sc_array_reset (&read_data);
+
+  SC_CHECK_ABORT (p4est_file_read_p4est
+                  (fc, p4est->connectivity, 0, &loaded, user_string,
+                   user_string, &errcode) != NULL, "Read forest async");
+  SC_CHECK_ABORT (p4est_is_equal (p4est, loaded, 0), "Compare forest async");
+  p4est_destroy (loaded);
+  SC_CHECK_ABORT (p4est_file_close (fc, &errcode) == 0,
+                  "Close async file context 2");
+}
+
+/* write the forest compactly and read it back in two partitions */
+static void
+test_compact (p4est_t * p4est)
+{
+  int                 errcode;
+  char                user_string[P4EST_FILE_USER_STRING_BYTES];
+  p4est_t            *loaded;
+  p4est_file_context_t *fc;
+
+  fc = p4est_file_open_create (p4est, "test_io_compact." P4EST_DATA_FILE_EXT,
+                               "Compact forest", &errcode);
+  SC_CHECK_ABORT (fc != NULL, "Open create compact");
+  SC_CHECK_ABORT (p4est_file_write_p4est_compact
+                  (fc, p4est, "Levels", "Quadrant data",
+                   &errcode) != NULL, "Write forest compact");
+  SC_CHECK_ABORT (p4est_file_write_p4est_compact
+                  (fc, p4est, "Levels", "Quadrant data",
+                   &errcode) != NULL, "Write forest compact 2");
+  SC_CHECK_ABORT (p4est_file_close (fc, &errcode) == 0,
+                  "Close compact file context");
+
+  fc = p4est_file_open_read (p4est, "test_io_compact." P4EST_DATA_FILE_EXT,
+                             user_string, &errcode);
+  SC_CHECK_ABORT (fc != NULL, "Open read compact");
+  SC_CHECK_ABORT (p4est_file_read_p4est_compact
+                  (fc, p4est->connectivity, 0, NULL, &loaded, user_string,
+                   user_string, &errcode) != NULL, "Read forest compact");
+  SC_CHECK_ABORT (p4est_is_equal (p4est, loaded, 0),
+                  "Compare forest compact");
+  p4est_destroy (loaded);
+  SC_CHECK_ABORT (p4est_file_read_p4est_compact
+                  (fc, p4est->connectivity, 0, p4est->global_first_quadrant,
+                   &loaded, user_string, user_string, &errcode) != NULL,
+                  "Read forest compact in partition");
+  SC_CHECK_ABORT (p4est_is_equal (p4est, loaded, 0),
+                  "Compare forest compact in partition");
+  p4est_destroy (loaded);
+  SC_CHECK_ABORT (p4est_file_close (fc, &errcode) == 0,
+                  "Close compact file context 2");
+}
+
+static void
+test_compressed (p4est_t * p4est)
+{
+  int                 errcode;
+  char                user_string[P4EST_FILE_USER_STRING_BYTES];
+  p4est_gloidx_t      global_num_quadrants, offset;
+  p4est_file_context_t *fc;
+  p4est_file_map_t   *map;
+  p4est_file_section_metadata_t *section;
+  p4est_locidx_t      i;
+  sc_array_t          ids, read_data, sections;
+
+  /* the global quadrant numbers are an easily checked field */
+  sc_array_init_size (&ids, sizeof (p4est_gloidx_t),
+                      (size_t) p4est->local_num_quadrants);
+  offset = p4est->global_first_quadrant[p4est->mpirank];
+  for (i = 0; i < p4est->local_num_quadrants; ++i) {
+    *(p4est_gloidx_t *) sc_array_index (&ids, i) = offset + i;
+  }
+
+  fc = p4est_file_open_create (p4est, "test_io_compressed."
+                               P4EST_DATA_FILE_EXT, "Compressed data file",
+                               &errcode);
+  SC_CHECK_ABORT (fc != NULL, "Open create compressed");
+  SC_CHECK_ABORT (p4est_file_write_field_compressed
+                  (fc, ids.elem_size, &ids, "Global ids",
+                   &errcode) != NULL, "Write compressed");
+  SC_CHECK_ABORT (p4est_file_write_field
+                  (fc, ids.elem_size, &ids, "Global ids plain",
+                   &errcode) != NULL, "Write plain after compressed");
+  SC_CHECK_ABORT (p4est_file_close (fc, &errcode) == 0,
+                  "Close compressed file context");
+
+  /* the compressed section is listed and skipped */
+  sc_array_init (&sections, sizeof (p4est_file_section_metadata_t));
+  SC_CHECK_ABORT (p4est_file_info
+                  (p4est, "test_io_compressed." P4EST_DATA_FILE_EXT,
+                   user_string, &sections, &errcode) == 0,
+                  "Info compressed");
+  SC_CHECK_ABORT (sections.elem_count == 2, "Info compressed count");
+  section = (p4est_file_section_metadata_t *) sc_array_index (&sections, 0);
+  SC_CHECK_ABORT (section->block_type == 'C', "Info compressed type");
+  section = (p4est_file_section_metadata_t *) sc_array_index (&sections, 1);
+  SC_CHECK_ABORT (section->block_type == 'F', "Info plain type");
+  sc_array_reset (&sections);
+
+  /* read in a uniform partition that differs from the written one */
+  fc = p4est_file_open_read_ext (p4est->mpicomm, "test_io_compressed."
+                                 P4EST_DATA_FILE_EXT, user_string,
+                                 &global_num_quadrants, &errcode);
+  SC_CHECK_ABORT (fc != NULL, "Open read compressed");
+  SC_CHECK_ABORT (global_num_quadrants == p4est->global_num_quadrants,
+                  "Compressed global count");
+  sc_array_init (&read_data, sizeof (p4est_gloidx_t));
+  SC_CHECK_ABORT (p4est_file_read_field_compressed
+                  (fc, read_data.elem_size, &read_data, user_string,
+                   &errcode) != NULL, "Read compressed");
+  offset = p4est_partition_cut_gloidx (global_num_quadrants, p4est->mpirank,
+                                       p4est->mpisize);
+  for (i = 0; i < (p4est_locidx_t) read_data.elem_count; ++i) {
+    SC_CHECK_ABORT (*(p4est_gloidx_t *) sc_array_index (&read_data, i) ==
+                    offset + i, "Compare compressed");
+  }
+  SC_CHECK_ABORT (p4est_file_read_field
+                  (fc, read_data.elem_size, &read_data, user_string,
+                   &errcode) != NULL, "Read plain after compressed");
+  for (i = 0; i < (p4est_locidx_t) read_data.elem_count; ++i) {
+    SC_CHECK_ABORT (*(p4est_gloidx_t *) sc_array_index (&read_data, i) ==
+                    offset + i, "Compare plain after compressed");
+  }
+  SC_CHECK_ABORT (p4est_file_close (fc, &errcode) == 0,
+                  "Close compressed file context 2");
+
+  /* serial random access to the plain section */
+  if (p4est->mpirank == 0) {
+    map = p4est_file_map_open ("test_io_compressed." P4EST_DATA_FILE_EXT,
+                               user_string, &errcode);
+    SC_CHECK_ABORT (map != NULL, "Map open");
+    SC_CHECK_ABORT (p4est_file_map_global_num_quadrants (map) ==
+                    p4est->global_num_quadrants, "Map global count");
+    SC_CHECK_ABORT (p4est_file_map_num_sections (map) == 2, "Map count");
+    SC_CHECK_ABORT (p4est_file_map_section (map, 0)->block_type == 'C' &&
+                    p4est_file_map_block (map, 0) != NULL &&
+                    p4est_file_map_field (map, 0, 0, 1) == NULL,
+                    "Map compressed section");
+    SC_CHECK_ABORT (p4est_file_map_section (map, 1)->data_size ==
+                    sizeof (p4est_gloidx_t), "Map field size");
+    for (offset = 0; offset < p4est->global_num_quadrants; ++offset) {
+      SC_CHECK_ABORT (*(const p4est_gloidx_t *) p4est_file_map_field
+                      (map, 1, offset, 1) == offset, "Map field entry");
+    }
+    SC_CHECK_ABORT (p4est_file_map_field
+                    (map, 1, p4est->global_num_quadrants, 1) == NULL,
+                    "Map field range");
+    p4est_file_map_close (map);
+  }
+
+  sc_array_reset (&read_data);
+  sc_array_reset (&ids);
+}
+
+static int
+level_weight (p4est_t * p4est, p4est_topidx_t which_tree,
+              p4est_quadrant_t * quadrant)
+{
+  return (int) quadrant->level;
+}
+
+typedef struct test_scan
+{
+  p4est_topidx_t      last_tree;
+  p4est_gloidx_t      next_index;
+  p4est_quadrant_t    last;
+}
+test_scan_t;
+
+static int
+scan_weights (p4est_topidx_t which_tree, const p4est_quadrant_t * quadrant,
+              p4est_gloidx_t global_index, const void **fields, void *user)
+{
+  test_scan_t        *ts = (test_scan_t *) user;
+
+  SC_CHECK_ABORT (global_index == ts->next_index, "Scan index");
+  SC_CHECK_ABORT (p4est_quadrant_is_valid (quadrant) &&
+                  quadrant->p.which_tree == which_tree, "Scan quadrant");
+  SC_CHECK_ABORT (*(const int *) fields[0] == (int) quadrant->level,
+                  "Scan field");
+  if (which_tree == ts->last_tree) {
+    SC_CHECK_ABORT (p4est_quadrant_compare (&ts->last, quadrant) < 0,
+                    "Scan order");
+  }
+  else {
+    SC_CHECK_ABORT (which_tree > ts->last_tree, "Scan tree order");
+  }
+  ts->last_tree = which_tree;
+  ts->last = *quadrant;
+  ++ts->next_index;
+  return 1;
+}
+
+static void
+test_weights (p4est_t * p4est)
+{
+  int                 errcode;
+  char                user_string[P4EST_FILE_USER_STRING_BYTES];
+  size_t              zz, field;
+  p4est_gloidx_t      global_num_quadrants, *gfq;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_t            *partitioned, *loaded;
+  p4est_file_context_t *fc;
+  p4est_file_map_t   *map;
+  sc_array_t          weights;
+  test_scan_t         ts;
+
+  /* store the weights ahead of the forest */
+  sc_array_init (&weights, sizeof (int));
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      *(int *) sc_array_push (&weights) = level_weight
+        (p4est, jt, p4est_quadrant_array_index (&tree->quadrants, zz));
+    }
+  }
+  fc = p4est_file_open_create (p4est, "test_io_weights."
+                               P4EST_DATA_FILE_EXT, "Weighted restart",
+                               &errcode);
+  SC_CHECK_ABORT (fc != NULL, "Open create weights");
+  SC_CHECK_ABORT (p4est_file_write_field
+                  (fc, weights.elem_size, &weights, "Weights",
+                   &errcode) != NULL, "Write weights");
+  SC_CHECK_ABORT (p4est_file_write_p4est
+                  (fc, p4est, "Quadrants", "Quadrant data",
+                   &errcode) != NULL, "Write forest after weights");
+  SC_CHECK_ABORT (p4est_file_close (fc, &errcode) == 0,
+                  "Close weights file context");
+  sc_array_reset (&weights);
+
+  /* traverse the stored forest without loading it */
+  if (p4est->mpirank == 0) {
+    map = p4est_file_map_open ("test_io_weights." P4EST_DATA_FILE_EXT,
+                               user_string, &errcode);
+    SC_CHECK_ABORT (map != NULL, "Map open weights");
+    field = 0;
+    ts.last_tree = -1;
+    ts.next_index = 0;
+    SC_CHECK_ABORT (p4est_file_map_scan
+                    (map, 2, 1, &field, 0, p4est->global_num_quadrants,
+                     scan_weights, &ts) == P4EST_FILE_ERR_SUCCESS,
+                    "Map scan");
+    SC_CHECK_ABORT (ts.next_index == p4est->global_num_quadrants,
+                    "Map scan count");
+    SC_CHECK_ABORT (p4est_file_map_scan
+                    (map, 0, 1, &field, 0, 1, scan_weights, &ts) ==
+                    P4EST_FILE_ERR_IN_DATA, "Map scan section");
+    p4est_file_map_close (map);
+  }
+
+  /* the reference is the partition computed from the forest */
+  partitioned = p4est_copy (p4est, 0);
+  p4est_partition_ext (partitioned, 0, level_weight);
+
+  fc = p4est_file_open_read_ext (p4est->mpicomm, "test_io_weights."
+                                 P4EST_DATA_FILE_EXT, user_string,
+                                 &global_num_quadrants, &errcode);
+  SC_CHECK_ABORT (fc != NULL, "Open read weights");
+  gfq = P4EST_ALLOC (p4est_gloidx_t, p4est->mpisize + 1);
+  SC_CHECK_ABORT (p4est_file_read_weights (fc, gfq, user_string, &errcode)
+                  != NULL, "Read weights");
+  SC_CHECK_ABORT (!memcmp (gfq, partitioned->global_first_quadrant,
+                           (p4est->mpisize + 1) * sizeof (p4est_gloidx_t)),
+                  "Compare weighted partition");
+  SC_CHECK_ABORT (p4est_file_read_p4est_ext
+                  (fc, p4est->connectivity, 0, gfq, &loaded, user_string,
+                   user_string, &errcode) != NULL, "Read forest in partition");
+  SC_CHECK_ABORT (p4est_is_equal (partitioned, loaded, 0),
+                  "Compare forest in partition");
+  SC_CHECK_ABORT (p4est_file_close (fc, &errcode) == 0,
+                  "Close weights file context 2");
+
+  P4EST_FREE (gfq);
+  p4est_destroy (loaded);
+  p4est_destroy (partitioned);
+}
+
+static void
+test_delta (p4est_t * p4est, sc_array_t * quad_data)
+{
+  int                 errcode, c;
+  char                user_string[P4EST_FILE_USER_STRING_BYTES];
+  const char         *chain[2] = {
+    "test_io_delta0." P4EST_DATA_FILE_EXT,
+    "test_io_delta1." P4EST_DATA_FILE_EXT
+  };
+  p4est_t            *loaded;
+  p4est_file_context_t *fc;
+  p4est_file_delta_t *delta;
+  p4est_file_section_metadata_t *section;
+  sc_array_t          ids, read_data, sections;
+
+  sc_array_init_size (&ids, sizeof (p4est_gloidx_t),
+                      (size_t) p4est->local_num_quadrants);
+  for (c = 0; c < p4est->local_num_quadrants; ++c) {
+    *(p4est_gloidx_t *) sc_array_index_int (&ids, c) =
+      p4est->global_first_quadrant[p4est->mpirank] + c;
+  }
+
+  /* the second checkpoint changes only the char field */
+  delta = p4est_file_delta_new ();
+  for (c = 0; c < 2; ++c) {
+    write_chars (p4est, quad_data);
+    if (c == 1) {
+      memset (quad_data->array, 'x', quad_data->elem_count);
+    }
+    fc = p4est_file_open_create (p4est, chain[c], "Delta checkpoint",
+                                 &errcode);
+    SC_CHECK_ABORT (fc != NULL, "Open create delta");
+    SC_CHECK_ABORT (p4est_file_delta_write_p4est
+                    (fc, delta, p4est, "Quadrants", "Quadrant data",
+                     &errcode) != NULL, "Write delta forest");
+    SC_CHECK_ABORT (p4est_file_delta_write_field
+                    (fc, delta, ids.elem_size, &ids, "Global ids",
+                     &errcode) != NULL, "Write delta ids");
+    SC_CHECK_ABORT (p4est_file_delta_write_field
+                    (fc, delta, quad_data->elem_size, quad_data, "Chars",
+                     &errcode) != NULL, "Write delta chars");
+    SC_CHECK_ABORT (p4est_file_close (fc, &errcode) == 0,
+                    "Close delta file context");
+  }
+  p4est_file_delta_destroy (delta);
+
+  /* unchanged sections are references */
+  sc_array_init (&sections, sizeof (p4est_file_section_metadata_t));
+  SC_CHECK_ABORT (p4est_file_info (p4est, chain[1], user_string, &sections,
+                                   &errcode) == 0, "Info delta");
+  SC_CHECK_ABORT (sections.elem_count == 3, "Info delta count");
+  for (c = 0; c < 3; ++c) {
+    section = (p4est_file_section_metadata_t *)
+      sc_array_index_int (&sections, c);
+    SC_CHECK_ABORT (section->block_type == (c < 2 ? 'R' : 'F'),
+                    "Info delta type");
+  }
+  sc_array_reset (&sections);
+
+  /* reassemble the second checkpoint */
+  fc = p4est_file_open_read (p4est, chain[1], user_string, &errcode);
+  SC_CHECK_ABORT (fc != NULL, "Open read delta");
+  SC_CHECK_ABORT (p4est_file_delta_read_p4est
+                  (fc, chain, p4est->connectivity, 0, &loaded, user_string,
+                   user_string, &errcode) != NULL, "Read delta forest");
+  SC_CHECK_ABORT (p4est_is_equal (p4est, loaded, 0), "Compare delta forest");
+  p4est_destroy (loaded);
+  sc_array_init (&read_data, sizeof (p4est_gloidx_t));
+  SC_CHECK_ABORT (p4est_file_delta_read_field
+                  (fc, chain, read_data.elem_size, &read_data, user_string,
+                   &errcode) != NULL, "Read delta ids");
+  SC_CHECK_ABORT (sc_array_is_equal (&read_data, &ids), "Compare delta ids");
+  sc_array_reset (&read_data);
+  sc_array_init (&read_data, sizeof (char));
+  SC_CHECK_ABORT (p4est_file_delta_read_field
+                  (fc, chain, read_data.elem_size, &read_data, user_string,
+                   &errcode) != NULL, "Read delta chars");
+  SC_CHECK_ABORT (sc_array_is_equal (&read_data, quad_data),
+                  "Compare delta chars");
+  sc_array_reset (&read_data);
+  SC_CHECK_ABORT (p4est_file_close (fc, &errcode) == 0,
+                  "Close delta file context 2");
+
+  sc_array_reset (&ids);
+}
+
+static void
+test_backend (p4est_t * p4est, sc_array_t * quad_data)
+{
+  int                 errcode;
+  p4est_file_context_t *fc;
+
+  /* the native backend is the default file format */
+  write_chars (p4est, quad_data);
+  fc = p4est_file_open_create_ext (p4est, "test_io_native."
+                                   P4EST_DATA_FILE_EXT, "Native backend",
+                                   P4EST_FILE_BACKEND_NATIVE, &errcode);
+  SC_CHECK_ABORT (fc != NULL, "Open create native");
+  SC_CHECK_ABORT (p4est_file_write_field
+                  (fc, quad_data->elem_size, quad_data, "Chars",
+                   &errcode) != NULL, "Write native field");
+  SC_CHECK_ABORT (p4est_file_close (fc, &errcode) == 0,
+                  "Close native file context");
+
+  fc = p4est_file_open_create_ext (p4est, "test_io_backend.h5",
+                                   "HDF5 backend", P4EST_FILE_BACKEND_HDF5,
+                                   &errcode);
+#ifdef P4EST_WITH_HDF5
+  SC_CHECK_ABORT (fc != NULL, "Open create HDF5");
+  SC_CHECK_ABORT (p4est_file_write_p4est
+                  (fc, p4est, "Quadrants", "Quadrant data",
+                   &errcode) != NULL, "Write HDF5 forest");
+  SC_CHECK_ABORT (p4est_file_write_field
+                  (fc, quad_data->elem_size, quad_data, "Chars",
+                   &errcode) != NULL, "Write HDF5 field");
+  SC_CHECK_ABORT (p4est_file_close (fc, &errcode) == 0,
+                  "Close HDF5 file context");
+#else
+  SC_CHECK_ABORT (fc == NULL && errcode == P4EST_FILE_ERR_IN_DATA,
+                  "HDF5 backend unavailable");
+#endif
+}
+
 #endif /* P4EST_ENABLE_FILE_DEPRECATED */
 
 int
@@ -621,6 +1069,15 @@ main (int argc, char **argv)
                     "Close file context 4");
   }
 
+  if (!header_only && !read_only) {
+    test_async (p4est, &quad_data);
+    test_compressed (p4est);
+    test_compact (p4est);
+    test_weights (p4est);
+    test_delta (p4est, &quad_data);
+    test_backend (p4est, &quad_data);
+  }
+
   /* clean up */
   p4est_destroy (p4est);
   p4est_connectivity_destroy (connectivity);
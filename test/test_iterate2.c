@@ -823,6 +823,395 @@ test_volume_adjacency (p4est_iter_volume_info_t * info, void *data)
   }
 }
 
+/* count the faces of each local quadrant */
+static void
+face_count_local (p4est_iter_face_info_t * info, void *data)
+{
+  int                *counts = (int *) data;
+  int                 h;
+  size_t              zz;
+  p4est_tree_t       *tree;
+  p4est_iter_face_side_t *side;
+
+  for (zz = 0; zz < info->sides.elem_count; zz++) {
+    side = p4est_iter_fside_array_index (&info->sides, zz);
+    tree = p4est_tree_array_index (info->p4est->trees, side->treeid);
+    if (!side->is_hanging) {
+      if (!side->is.full.is_ghost) {
+        counts[tree->quadrants_offset + side->is.full.quadid]++;
+      }
+    }
+    else {
+      for (h = 0; h < P4EST_HALF; h++) {
+        if (!side->is.hanging.is_ghost[h]) {
+          counts[tree->quadrants_offset + side->is.hanging.quadid[h]]++;
+        }
+      }
+    }
+  }
+}
+
+/* count the faces of each local quadrant from the batches */
+static void
+face_batch_count_local (p4est_iter_face_batch_info_t * info, void *data)
+{
+  int                *counts = (int *) data;
+  int                 s, num_sides, per_face;
+  size_t              zz;
+
+  num_sides = (info->kind == P4EST_ITER_FACE_BOUNDARY) ? 1 : 2;
+  for (s = 0; s < num_sides; s++) {
+    per_face = (s == 1 && info->kind == P4EST_ITER_FACE_HANGING) ?
+      P4EST_HALF : 1;
+    for (zz = 0; zz < info->count * per_face; zz++) {
+      if (!info->is_ghost[s][zz]) {
+        SC_CHECK_ABORT (info->quadid[s][zz] >= 0 &&
+                        info->quadid[s][zz] <
+                        info->p4est->local_num_quadrants,
+                        "Iterate: batch index");
+        counts[info->quadid[s][zz]]++;
+      }
+    }
+  }
+  for (zz = 0; zz < info->count; zz++) {
+    SC_CHECK_ABORT (info->face[0][zz] >= 0 &&
+                    info->face[0][zz] < P4EST_FACES, "Iterate: batch face");
+    if (info->kind == P4EST_ITER_FACE_BOUNDARY) {
+      SC_CHECK_ABORT (info->tree_boundary[zz], "Iterate: batch boundary");
+    }
+  }
+}
+
+static void
+test_face_batch (p4est_t * p4est, p4est_ghost_t * ghost_layer)
+{
+  p4est_locidx_t      li;
+  int                *counts, *batch_counts;
+
+  counts = P4EST_ALLOC_ZERO (int, p4est->local_num_quadrants);
+  batch_counts = P4EST_ALLOC_ZERO (int, p4est->local_num_quadrants);
+  p4est_iterate (p4est, ghost_layer, counts, NULL, face_count_local,
+#ifdef P4_TO_P8
+                 NULL,
+#endif
+                 NULL);
+  p4est_iterate_face_batch (p4est, ghost_layer, batch_counts, 7,
+                            face_batch_count_local);
+  for (li = 0; li < p4est->local_num_quadrants; li++) {
+    SC_CHECK_ABORT (counts[li] == P4EST_FACES, "Iterate: face count");
+    SC_CHECK_ABORT (batch_counts[li] == P4EST_FACES,
+                    "Iterate: batch face count");
+  }
+  P4EST_FREE (counts);
+  P4EST_FREE (batch_counts);
+}
+
+/* count the corners of each local quadrant */
+static void
+corner_count_local (p4est_iter_corner_info_t * info, void *data)
+{
+  int                *counts = (int *) data;
+  size_t              zz;
+  p4est_tree_t       *tree;
+  p4est_iter_corner_side_t *side;
+
+  for (zz = 0; zz < info->sides.elem_count; zz++) {
+    side = p4est_iter_cside_array_index (&info->sides, zz);
+    if (!side->is_ghost) {
+      tree = p4est_tree_array_index (info->p4est->trees, side->treeid);
+      counts[tree->quadrants_offset + side->quadid]++;
+    }
+  }
+}
+
+static void
+test_iter_plan (p4est_t * p4est, p4est_ghost_t * ghost_layer)
+{
+  p4est_locidx_t      li;
+  int                *counts, *plan_counts;
+  p4est_iter_plan_t  *plan;
+
+  counts = P4EST_ALLOC_ZERO (int, p4est->local_num_quadrants);
+  plan_counts = P4EST_ALLOC_ZERO (int, p4est->local_num_quadrants);
+  p4est_iterate (p4est, ghost_layer, counts, NULL, NULL,
+#ifdef P4_TO_P8
+                 NULL,
+#endif
+                 corner_count_local);
+
+  plan = p4est_iter_plan_new (p4est, ghost_layer, 0);
+  SC_CHECK_ABORT (p4est_iter_plan_is_current (plan), "Iterate: plan");
+  SC_CHECK_ABORT (plan->face_offsets->elem_count ==
+                  plan->face_orientation->elem_count + 1,
+                  "Iterate: plan offsets");
+  p4est_iter_plan_replay (plan, plan_counts, NULL, NULL,
+#ifdef P4_TO_P8
+                          NULL,
+#endif
+                          corner_count_local);
+  for (li = 0; li < p4est->local_num_quadrants; li++) {
+    SC_CHECK_ABORT (counts[li] == plan_counts[li],
+                    "Iterate: plan corner count");
+  }
+
+  /* the replay may be repeated */
+  memset (plan_counts, 0, sizeof (int) * p4est->local_num_quadrants);
+  p4est_iter_plan_replay (plan, plan_counts, NULL, face_count_local,
+#ifdef P4_TO_P8
+                          NULL,
+#endif
+                          NULL);
+  for (li = 0; li < p4est->local_num_quadrants; li++) {
+    SC_CHECK_ABORT (plan_counts[li] == P4EST_FACES,
+                    "Iterate: plan face count");
+  }
+
+  /* the blocked replay executes the same callbacks in another order */
+  memset (plan_counts, 0, sizeof (int) * p4est->local_num_quadrants);
+  p4est_iter_plan_replay_blocked (plan, plan_counts, 5, NULL, 0, NULL,
+                                  face_count_local,
+#ifdef P4_TO_P8
+                                  NULL,
+#endif
+                                  corner_count_local);
+  for (li = 0; li < p4est->local_num_quadrants; li++) {
+    SC_CHECK_ABORT (plan_counts[li] == counts[li] + P4EST_FACES,
+                    "Iterate: plan blocked count");
+  }
+  p4est_iter_plan_destroy (plan);
+
+  P4EST_FREE (counts);
+  P4EST_FREE (plan_counts);
+}
+
+typedef struct active_data
+{
+  int8_t             *mark;
+  int                 filter;
+  long                volumes, faces, edges, corners;
+}
+active_data_t;
+
+static int
+active_side (p4est_t * p4est, active_data_t * ad, p4est_topidx_t treeid,
+             int8_t is_ghost, p4est_locidx_t quadid)
+{
+  p4est_tree_t       *tree;
+
+  if (is_ghost || quadid < 0) {
+    return 0;
+  }
+  tree = p4est_tree_array_index (p4est->trees, treeid);
+  return ad->mark[tree->quadrants_offset + quadid];
+}
+
+static void
+active_volume (p4est_iter_volume_info_t * info, void *data)
+{
+  active_data_t      *ad = (active_data_t *) data;
+  int                 is_active;
+
+  is_active = active_side (info->p4est, ad, info->treeid, 0, info->quadid);
+  SC_CHECK_ABORT (ad->filter || is_active, "Iterate: inactive volume");
+  ad->volumes += is_active;
+}
+
+static void
+active_face (p4est_iter_face_info_t * info, void *data)
+{
+  active_data_t      *ad = (active_data_t *) data;
+  int                 h, is_active = 0;
+  size_t              zz;
+  p4est_iter_face_side_t *side;
+
+  for (zz = 0; zz < info->sides.elem_count; zz++) {
+    side = p4est_iter_fside_array_index (&info->sides, zz);
+    if (!side->is_hanging) {
+      is_active |= active_side (info->p4est, ad, side->treeid,
+                                side->is.full.is_ghost,
+                                side->is.full.quadid);
+    }
+    else {
+      for (h = 0; h < P4EST_HALF; h++) {
+        is_active |= active_side (info->p4est, ad, side->treeid,
+                                  side->is.hanging.is_ghost[h],
+                                  side->is.hanging.quadid[h]);
+      }
+    }
+  }
+  SC_CHECK_ABORT (ad->filter || is_active, "Iterate: inactive face");
+  ad->faces += is_active;
+}
+
+#ifdef P4_TO_P8
+static void
+active_edge (p8est_iter_edge_info_t * info, void *data)
+{
+  active_data_t      *ad = (active_data_t *) data;
+  int                 h, is_active = 0;
+  size_t              zz;
+  p8est_iter_edge_side_t *side;
+
+  for (zz = 0; zz < info->sides.elem_count; zz++) {
+    side = p8est_iter_eside_array_index (&info->sides, zz);
+    if (!side->is_hanging) {
+      is_active |= active_side (info->p4est, ad, side->treeid,
+                                side->is.full.is_ghost,
+                                side->is.full.quadid);
+    }
+    else {
+      for (h = 0; h < 2; h++) {
+        is_active |= active_side (info->p4est, ad, side->treeid,
+                                  side->is.hanging.is_ghost[h],
+                                  side->is.hanging.quadid[h]);
+      }
+    }
+  }
+  SC_CHECK_ABORT (ad->filter || is_active, "Iterate: inactive edge");
+  ad->edges += is_active;
+}
+#endif
+
+static void
+active_corner (p4est_iter_corner_info_t * info, void *data)
+{
+  active_data_t      *ad = (active_data_t *) data;
+  int                 is_active = 0;
+  size_t              zz;
+  p4est_iter_corner_side_t *side;
+
+  for (zz = 0; zz < info->sides.elem_count; zz++) {
+    side = p4est_iter_cside_array_index (&info->sides, zz);
+    is_active |= active_side (info->p4est, ad, side->treeid,
+                              side->is_ghost, side->quadid);
+  }
+  SC_CHECK_ABORT (ad->filter || is_active, "Iterate: inactive corner");
+  ad->corners += is_active;
+}
+
+static void
+test_iterate_active (p4est_t * p4est, p4est_ghost_t * ghost_layer)
+{
+  p4est_locidx_t      li, num_active;
+  p4est_locidx_t     *active;
+  active_data_t       ref, act;
+
+  ref.mark = P4EST_ALLOC_ZERO (int8_t, p4est->local_num_quadrants);
+  active = P4EST_ALLOC (p4est_locidx_t, p4est->local_num_quadrants);
+  num_active = 0;
+  for (li = 0; li < p4est->local_num_quadrants; li += 5) {
+    ref.mark[li] = 1;
+    active[num_active++] = li;
+  }
+  ref.filter = 1;
+  ref.volumes = ref.faces = ref.edges = ref.corners = 0;
+  act = ref;
+  act.filter = 0;
+
+  p4est_iterate (p4est, ghost_layer, &ref, active_volume, active_face,
+#ifdef P4_TO_P8
+                 NULL,
+#endif
+                 active_corner);
+  p4est_iterate_active (p4est, ghost_layer, &act, active, num_active,
+                        active_volume, active_face,
+#ifdef P4_TO_P8
+                        NULL,
+#endif
+                        active_corner);
+  SC_CHECK_ABORT (ref.volumes == (long) num_active &&
+                  act.volumes == ref.volumes, "Iterate: active volumes");
+  SC_CHECK_ABORT (act.faces == ref.faces, "Iterate: active faces");
+  SC_CHECK_ABORT (act.corners == ref.corners, "Iterate: active corners");
+
+  /* the volume callback alone walks the list */
+  act.volumes = 0;
+  p4est_iterate_active (p4est, ghost_layer, &act, active, num_active,
+                        active_volume, NULL,
+#ifdef P4_TO_P8
+                        NULL,
+#endif
+                        NULL);
+  SC_CHECK_ABORT (act.volumes == (long) num_active,
+                  "Iterate: active volume list");
+
+  P4EST_FREE (active);
+  P4EST_FREE (ref.mark);
+}
+
+static void
+test_iterate_levels (p4est_t * p4est, p4est_ghost_t * ghost_layer,
+                     int minlevel, int maxlevel)
+{
+  p4est_topidx_t      t;
+  size_t              zz;
+  p4est_locidx_t      li, num_in_range;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  active_data_t       ref, act;
+
+  ref.mark = P4EST_ALLOC_ZERO (int8_t, p4est->local_num_quadrants);
+  num_in_range = 0;
+  for (t = p4est->first_local_tree; t <= p4est->last_local_tree; t++) {
+    tree = p4est_tree_array_index (p4est->trees, t);
+    for (zz = 0; zz < tree->quadrants.elem_count; zz++) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      li = tree->quadrants_offset + (p4est_locidx_t) zz;
+      if ((int) q->level >= minlevel && (int) q->level <= maxlevel) {
+        ref.mark[li] = 1;
+        num_in_range++;
+      }
+    }
+  }
+  ref.filter = 1;
+  ref.volumes = ref.faces = ref.edges = ref.corners = 0;
+  act = ref;
+  act.filter = 0;
+
+  p4est_iterate (p4est, ghost_layer, &ref, active_volume, active_face,
+#ifdef P4_TO_P8
+                 active_edge,
+#endif
+                 active_corner);
+  p4est_iterate_levels (p4est, ghost_layer, &act, minlevel, maxlevel,
+                        active_volume, active_face,
+#ifdef P4_TO_P8
+                        active_edge,
+#endif
+                        active_corner, 0);
+  SC_CHECK_ABORT (ref.volumes == (long) num_in_range &&
+                  act.volumes == ref.volumes, "Iterate: level volumes");
+  SC_CHECK_ABORT (act.faces == ref.faces, "Iterate: level faces");
+  SC_CHECK_ABORT (act.edges == ref.edges, "Iterate: level edges");
+  SC_CHECK_ABORT (act.corners == ref.corners, "Iterate: level corners");
+
+  /* a single callback, which may skip the face search, finds the same */
+  act.volumes = act.faces = act.edges = act.corners = 0;
+  p4est_iterate_levels (p4est, ghost_layer, &act, minlevel, maxlevel,
+                        active_volume, NULL,
+#ifdef P4_TO_P8
+                        NULL,
+#endif
+                        NULL, 0);
+  SC_CHECK_ABORT (act.volumes == ref.volumes, "Iterate: level volume only");
+  p4est_iterate_levels (p4est, ghost_layer, &act, minlevel, maxlevel,
+                        NULL, NULL,
+#ifdef P4_TO_P8
+                        NULL,
+#endif
+                        active_corner, 0);
+  SC_CHECK_ABORT (act.corners == ref.corners, "Iterate: level corner only");
+#ifdef P4_TO_P8
+  p4est_iterate_levels (p4est, ghost_layer, &act, minlevel, maxlevel,
+                        NULL, NULL, active_edge, NULL, 0);
+  SC_CHECK_ABORT (act.edges == ref.edges, "Iterate: level edge only");
+#endif
+  SC_CHECK_ABORT (act.volumes == ref.volumes && act.faces == 0,
+                  "Iterate: level single callbacks");
+
+  P4EST_FREE (ref.mark);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -1000,11 +1389,25 @@ main (int argc, char **argv)
 
         P4EST_GLOBAL_PRODUCTIONF ("Begin adjacency test %d:%d:%d\n", i, j, k);
 
-        p4est_iterate (p4est, ghost_layer, &iter_data, iter_volume, iter_face,
+        if (k % 2 == 0) {
+          p4est_iterate (p4est, ghost_layer, &iter_data, iter_volume,
+                         iter_face,
 #ifdef P4_TO_P8
-                       iter_edge,
+                         iter_edge,
 #endif
-                       iter_corner);
+                         iter_corner);
+        }
+        else {
+          /* the checks are not atomic: the traversal must be colored */
+          p4est_set_num_threads (4);
+          p4est_iterate_threads (p4est, ghost_layer, &iter_data,
+                                 iter_volume, iter_face,
+#ifdef P4_TO_P8
+                                 iter_edge,
+#endif
+                                 iter_corner, 0, 1, j % 2);
+          p4est_set_num_threads (1);
+        }
 
         for (li = 0; li < num_checks; li++) {
           switch (check_to_type[li % checks_per_quad]) {
@@ -1035,6 +1438,15 @@ main (int argc, char **argv)
     }
     P4EST_FREE (checks);
 
+    ghost_layer = p4est_ghost_new (p4est, P4EST_CONNECT_FACE);
+    test_face_batch (p4est, ghost_layer);
+    test_iter_plan (p4est, ghost_layer);
+    test_iterate_active (p4est, ghost_layer);
+    test_iterate_levels (p4est, ghost_layer, 0, 1);
+    test_iterate_levels (p4est, ghost_layer, 2, P4EST_QMAXLEVEL);
+    test_iterate_levels (p4est, ghost_layer, 3, 3);
+    p4est_ghost_destroy (ghost_layer);
+
     p4est_destroy (p4est);
     p4est_connectivity_destroy (connectivity);
     P4EST_GLOBAL_PRODUCTIONF ("End adjacency test %d\n", i);
@@ -578,6 +578,203 @@ same_point (tpoint_t * a, tpoint_t * b, p4est_connectivity_t * conn)
 
 }
 
+/** Evaluate a polynomial of the given degree in each coordinate. */
+static double
+hanging_poly (const double x[P4EST_DIM], int degree)
+{
+  int                 d;
+  double              f = 1.;
+
+  for (d = 0; d < P4EST_DIM; d++) {
+    f *= pow (x[d] + d + 1., degree);
+  }
+  return f;
+}
+
+/** Check that the hanging node interpolation reproduces polynomials for all
+ * face codes and that scattering is the transpose of gathering.
+ */
+static void
+test_hanging (p4est_lnodes_t * lnodes)
+{
+  const int           degree = lnodes->degree;
+  const int           vnodes = lnodes->vnodes;
+  int                 code, c, k, d, n, t, hangs;
+  double              own[P4EST_DIM], coarse[P4EST_DIM];
+  double             *values, *weights, *node_values, *node_sums;
+  double              dot_element, dot_node, f;
+  p4est_locidx_t      el, nid;
+  p4est_locidx_t     *offsets, *elements;
+  p4est_lnodes_hanging_t *hanging;
+
+  hanging = p4est_lnodes_hanging_new (degree, NULL);
+  SC_CHECK_ABORT (hanging->vnodes == vnodes, "Lnodes: bad hanging vnodes");
+
+  /* the hanging nodes of two elements hold the coarse node values */
+  values = P4EST_ALLOC (double, 2 * vnodes);
+  for (code = 0; code < P4EST_LNODES_CODES; code++) {
+    c = code & (P4EST_CHILDREN - 1);
+    for (k = 0; k < vnodes; k++) {
+      for (d = 0, t = k; d < P4EST_DIM; d++, t /= degree + 1) {
+        coarse[d] = hanging->points[t % (degree + 1)];
+        own[d] = .5 * (coarse[d] + ((c >> d) & 1));
+      }
+      hangs = 0;
+      for (n = 0; n < P4EST_DIM; n++) {
+        if ((code & (1 << (P4EST_DIM + n))) &&
+            coarse[n] == (double) ((c >> n) & 1)) {
+          hangs = 1;
+        }
+#ifdef P4_TO_P8
+        if ((code & (1 << (2 * P4EST_DIM + n))) &&
+            coarse[(n + 1) % 3] == (double) ((c >> ((n + 1) % 3)) & 1) &&
+            coarse[(n + 2) % 3] == (double) ((c >> ((n + 2) % 3)) & 1)) {
+          hangs = 1;
+        }
+#endif
+      }
+      f = hanging_poly (hangs ? coarse : own, degree);
+      values[k] = f;
+      values[vnodes + k] = 2. * f;
+    }
+    p4est_lnodes_hanging_interpolate (hanging, (p4est_lnodes_code_t) code,
+                                      2, values);
+    for (k = 0; k < vnodes; k++) {
+      for (d = 0, t = k; d < P4EST_DIM; d++, t /= degree + 1) {
+        own[d] = .5 * (hanging->points[t % (degree + 1)] + ((c >> d) & 1));
+      }
+      f = hanging_poly (own, degree);
+      SC_CHECK_ABORT (fabs (values[k] - f) < 1.e-10 * f &&
+                      fabs (values[vnodes + k] - 2. * f) < 2.e-10 * f,
+                      "Lnodes: bad hanging interpolation");
+    }
+  }
+  P4EST_FREE (values);
+
+  /* group the local elements by face code */
+  offsets = P4EST_ALLOC (p4est_locidx_t, P4EST_LNODES_CODES + 1);
+  elements = P4EST_ALLOC (p4est_locidx_t, lnodes->num_local_elements);
+  p4est_lnodes_code_groups (lnodes, offsets, elements);
+  SC_CHECK_ABORT (offsets[0] == 0 && offsets[P4EST_LNODES_CODES] ==
+                  lnodes->num_local_elements, "Lnodes: bad code groups");
+  for (code = 0; code < P4EST_LNODES_CODES; code++) {
+    for (el = offsets[code]; el < offsets[code + 1]; el++) {
+      SC_CHECK_ABORT ((int) lnodes->face_code[elements[el]] == code &&
+                      (el == offsets[code] ||
+                       elements[el - 1] < elements[el]),
+                      "Lnodes: bad code group element");
+    }
+  }
+
+  /* scattering is the transpose of gathering */
+  node_values = P4EST_ALLOC (double, lnodes->num_local_nodes);
+  node_sums = P4EST_ALLOC_ZERO (double, lnodes->num_local_nodes);
+  for (nid = 0; nid < lnodes->num_local_nodes; nid++) {
+    node_values[nid] = (double) (nid % 7 - 3);
+  }
+  values = P4EST_ALLOC (double, vnodes * lnodes->num_local_elements);
+  weights = P4EST_ALLOC (double, vnodes * lnodes->num_local_elements);
+  for (k = 0; k < vnodes * lnodes->num_local_elements; k++) {
+    weights[k] = (double) (k % 5 - 2);
+  }
+  dot_element = 0.;
+  for (code = 0; code < P4EST_LNODES_CODES; code++) {
+    el = offsets[code];
+    p4est_lnodes_hanging_gather (hanging, lnodes, offsets[code + 1] - el,
+                                 elements + el, node_values,
+                                 values + vnodes * el);
+    for (k = vnodes * el; k < vnodes * offsets[code + 1]; k++) {
+      dot_element += values[k] * weights[k];
+    }
+    p4est_lnodes_hanging_scatter (hanging, lnodes, offsets[code + 1] - el,
+                                  elements + el, weights + vnodes * el,
+                                  node_sums);
+  }
+  dot_node = 0.;
+  for (nid = 0; nid < lnodes->num_local_nodes; nid++) {
+    dot_node += node_values[nid] * node_sums[nid];
+  }
+  SC_CHECK_ABORT (fabs (dot_element - dot_node) <
+                  1.e-10 * (1. + fabs (dot_element)),
+                  "Lnodes: bad hanging scatter");
+
+  P4EST_FREE (weights);
+  P4EST_FREE (values);
+  P4EST_FREE (node_sums);
+  P4EST_FREE (node_values);
+  P4EST_FREE (elements);
+  P4EST_FREE (offsets);
+  p4est_lnodes_hanging_destroy (hanging);
+}
+
+static int         *partition_weights;
+static p4est_locidx_t partition_count;
+
+static int
+weight_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+           p4est_quadrant_t * quadrant)
+{
+  return partition_weights[partition_count++];
+}
+
+/** Check the variants of partitioning by node counts against each other.
+ * Replaying a plan must weight as the iteration does, and with lnodes each
+ * owned node is counted for the first local element referencing it.
+ */
+static void
+test_partition_lnodes (p4est_t * p4est, int degree)
+{
+  int                 vid, V;
+  int8_t             *counted;
+  p4est_locidx_t      elid, nid;
+  p4est_t            *p4est1, *p4est2;
+  p4est_ghost_t      *ghost;
+  p4est_lnodes_t     *lnodes;
+  p4est_iter_plan_t  *plan;
+
+  p4est1 = p4est_copy (p4est, 0);
+  p4est2 = p4est_copy (p4est, 0);
+  ghost = p4est_ghost_new (p4est1, P4EST_CONNECT_FULL);
+  plan = p4est_iter_plan_new (p4est1, ghost, 0);
+  p4est_partition_lnodes_ext (p4est1, ghost, NULL, plan, degree, 0);
+  p4est_partition_lnodes (p4est2, NULL, degree, 0);
+  SC_CHECK_ABORT (p4est_is_equal (p4est1, p4est2, 0),
+                  "Lnodes: partition by plan");
+  p4est_iter_plan_destroy (plan);
+  p4est_ghost_destroy (ghost);
+  p4est_destroy (p4est1);
+  p4est_destroy (p4est2);
+
+  p4est1 = p4est_copy (p4est, 0);
+  p4est2 = p4est_copy (p4est, 0);
+  ghost = p4est_ghost_new (p4est1, P4EST_CONNECT_FULL);
+  lnodes = p4est_lnodes_new (p4est1, ghost, degree);
+  V = lnodes->vnodes;
+  partition_weights = P4EST_ALLOC (int, lnodes->num_local_elements);
+  counted = P4EST_ALLOC_ZERO (int8_t, lnodes->owned_count);
+  for (elid = 0; elid < lnodes->num_local_elements; ++elid) {
+    partition_weights[elid] = 0;
+    for (vid = 0; vid < V; ++vid) {
+      nid = lnodes->element_nodes[V * elid + vid];
+      if (nid < lnodes->owned_count && !counted[nid]) {
+        counted[nid] = 1;
+        ++partition_weights[elid];
+      }
+    }
+  }
+  p4est_partition_lnodes_ext (p4est1, NULL, lnodes, NULL, 0, 0);
+  partition_count = 0;
+  p4est_partition_ext (p4est2, 0, weight_fn);
+  SC_CHECK_ABORT (p4est_is_equal (p4est1, p4est2, 0),
+                  "Lnodes: partition by lnodes");
+  P4EST_FREE (counted);
+  P4EST_FREE (partition_weights);
+  p4est_lnodes_destroy (lnodes);
+  p4est_ghost_destroy (ghost);
+  p4est_destroy (p4est1);
+  p4est_destroy (p4est2);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -593,7 +790,7 @@ main (int argc, char **argv)
 #endif
   int                 ntests;
   int                 i, j, k;
-  p4est_lnodes_t     *lnodes;
+  p4est_lnodes_t     *lnodes, *lnodes_threads, *lnodes_scalable;
   p4est_locidx_t      nin;
   tpoint_t           *tpoints, tpoint, *tpoint_p;
   p4est_locidx_t      elid;
@@ -624,6 +821,12 @@ main (int argc, char **argv)
 #endif
   sc_array_t         *global_nodes;
   p4est_gloidx_t      gn;
+  p4est_lnodes_plan_t *plan;
+  sc_array_t         *node_values;
+  int                *num_sharers;
+  p4est_locidx_t     *perm, *old_nodes;
+  tpoint_t           *tpoints_perm;
+  p4est_lnodes_export_t *lnodes_export;
 
 #ifndef P4_TO_P8
   ntests = 4;
@@ -755,6 +958,88 @@ main (int argc, char **argv)
         p4est_log_indent_pop ();
         continue;
       }
+
+      /* the numbering does not depend on the number of threads */
+      p4est_set_num_threads (4);
+      lnodes_threads = p4est_lnodes_new (p4est, ghost_layer, j);
+      p4est_set_num_threads (1);
+      SC_CHECK_ABORT (lnodes_threads->num_local_nodes ==
+                      lnodes->num_local_nodes &&
+                      !memcmp (lnodes_threads->element_nodes,
+                               lnodes->element_nodes,
+                               sizeof (p4est_locidx_t) * lnodes->vnodes *
+                               lnodes->num_local_elements),
+                      "lnodes: threaded element nodes");
+      p4est_lnodes_destroy (lnodes_threads);
+
+      /* the numbering does not depend on gathering the owned counts */
+      lnodes_scalable = p4est_lnodes_new_ext (p4est, ghost_layer, j, 0);
+      SC_CHECK_ABORT (lnodes_scalable->global_owned_count == NULL &&
+                      lnodes_scalable->global_offset ==
+                      lnodes->global_offset &&
+                      lnodes_scalable->owned_count == lnodes->owned_count &&
+                      lnodes_scalable->num_local_nodes ==
+                      lnodes->num_local_nodes &&
+                      lnodes_scalable->sharers->elem_count ==
+                      lnodes->sharers->elem_count, "lnodes: scalable sizes");
+      SC_CHECK_ABORT (!memcmp (lnodes_scalable->element_nodes,
+                               lnodes->element_nodes,
+                               sizeof (p4est_locidx_t) * lnodes->vnodes *
+                               lnodes->num_local_elements) &&
+                      !memcmp (lnodes_scalable->nonlocal_nodes,
+                               lnodes->nonlocal_nodes,
+                               sizeof (p4est_gloidx_t) *
+                               (lnodes->num_local_nodes -
+                                lnodes->owned_count)),
+                      "lnodes: scalable numbering");
+      SC_CHECK_ABORT (!memcmp (p4est_lnodes_global_owned_count
+                               (lnodes_scalable), lnodes->global_owned_count,
+                               sizeof (p4est_locidx_t) * mpisize),
+                      "lnodes: scalable owned counts");
+      p4est_lnodes_destroy (lnodes_scalable);
+
+      /* the flat export matches the element nodes and face codes */
+      for (k = 0; k < 2; k++) {
+        lnodes_export = p4est_lnodes_export_new (lnodes, k);
+        for (elid = 0; elid < lnodes->num_local_elements; elid++) {
+          for (c = 0; c < lnodes->vnodes; c++) {
+            SC_CHECK_ABORT (lnodes_export->element_nodes
+                            [k ? c * lnodes->num_local_elements + elid :
+                             elid * lnodes->vnodes + c] ==
+                            lnodes->element_nodes[elid * lnodes->vnodes + c],
+                            "lnodes: bad exported element nodes");
+          }
+        }
+        for (elid = 0, nid = 0; elid < lnodes->num_local_elements; elid++) {
+          if (!lnodes->face_code[elid]) {
+            continue;
+          }
+          SC_CHECK_ABORT (nid < lnodes_export->num_hanging &&
+                          lnodes_export->hanging_elements[nid] == elid,
+                          "lnodes: bad exported hanging element");
+#ifndef P4_TO_P8
+          p4est_lnodes_decode (lnodes->face_code[elid], hface);
+#else
+          p8est_lnodes_decode (lnodes->face_code[elid], hface, hedge);
+          for (e = 0; e < P8EST_EDGES; e++) {
+            SC_CHECK_ABORT (lnodes_export->hanging_edge[nid * P8EST_EDGES
+                                                        + e] == hedge[e],
+                            "lnodes: bad exported hanging edge");
+          }
+#endif
+          for (f = 0; f < P4EST_FACES; f++) {
+            SC_CHECK_ABORT (lnodes_export->hanging_face[nid * P4EST_FACES
+                                                        + f] == hface[f],
+                            "lnodes: bad exported hanging face");
+          }
+          nid++;
+        }
+        SC_CHECK_ABORT (nid == lnodes_export->num_hanging,
+                        "lnodes: bad exported hanging count");
+        p4est_lnodes_export_destroy (lnodes_export);
+      }
+      test_hanging (lnodes);
+
       nin = lnodes->num_local_nodes;
       tpoints = P4EST_ALLOC (tpoint_t, nin);
       memset (tpoints, -1, nin * sizeof (tpoint_t));
@@ -956,12 +1241,108 @@ main (int argc, char **argv)
 
       sc_array_destroy (global_nodes);
 
+      /* a persistent plan sums the contributions of all sharers */
+      plan = p4est_lnodes_plan_new (lnodes, sizeof (double));
+      num_sharers = P4EST_ALLOC (int, nin);
+      for (nid = 0; nid < nin; nid++) {
+        num_sharers[nid] = 1;
+      }
+      for (zz = 0; zz < lnodes->sharers->elem_count; zz++) {
+        lrank = p4est_lnodes_rank_array_index (lnodes->sharers, zz);
+        if (lrank->rank == mpirank) {
+          continue;
+        }
+        for (zy = 0; zy < lrank->shared_nodes.elem_count; zy++) {
+          nid = *((p4est_locidx_t *)
+                  sc_array_index (&lrank->shared_nodes, zy));
+          num_sharers[nid]++;
+        }
+      }
+      node_values = sc_array_new_count (sizeof (double), (size_t) nin);
+      for (k = 0; k < 2; k++) {
+        for (zz = 0; zz < node_values->elem_count; zz++) {
+          *((double *) sc_array_index (node_values, zz)) =
+            (double) p4est_lnodes_global_index (lnodes, zz);
+        }
+        p4est_lnodes_plan_add_reduce (plan, node_values);
+        for (zz = 0; zz < node_values->elem_count; zz++) {
+          SC_CHECK_ABORT (*((double *) sc_array_index (node_values, zz)) ==
+                          (double) num_sharers[zz] *
+                          (double) p4est_lnodes_global_index (lnodes, zz),
+                          "Lnodes: bad plan sum across processors");
+        }
+        for (zz = 0; zz < node_values->elem_count; zz++) {
+          *((double *) sc_array_index (node_values, zz)) =
+            (zz < (size_t) lnodes->owned_count) ?
+            (double) p4est_lnodes_global_index (lnodes, zz) : -1.;
+        }
+        p4est_lnodes_plan_share_owned (plan, node_values);
+        for (zz = 0; zz < node_values->elem_count; zz++) {
+          SC_CHECK_ABORT (*((double *) sc_array_index (node_values, zz)) ==
+                          (double) p4est_lnodes_global_index (lnodes, zz),
+                          "Lnodes: bad plan values across processors");
+        }
+      }
+      sc_array_destroy (node_values);
+      P4EST_FREE (num_sharers);
+      p4est_lnodes_plan_destroy (plan);
+
+      /* renumber for locality and verify the numbering stays consistent */
+      perm = P4EST_ALLOC (p4est_locidx_t, nin);
+      old_nodes = P4EST_ALLOC (p4est_locidx_t,
+                               lnodes->vnodes * lnodes->num_local_elements);
+      memcpy (old_nodes, lnodes->element_nodes, sizeof (p4est_locidx_t) *
+              lnodes->vnodes * lnodes->num_local_elements);
+      p4est_lnodes_reorder (lnodes, perm);
+      nid = 0;
+      for (elnid = 0; elnid < lnodes->vnodes * lnodes->num_local_elements;
+           elnid++) {
+        SC_CHECK_ABORT (lnodes->element_nodes[elnid] ==
+                        perm[old_nodes[elnid]], "Lnodes: bad reorder");
+        if (lnodes->element_nodes[elnid] == nid) {
+          nid++;
+        }
+        else {
+          SC_CHECK_ABORT (lnodes->element_nodes[elnid] < nid ||
+                          lnodes->element_nodes[elnid] >=
+                          lnodes->owned_count, "Lnodes: bad first touch");
+        }
+      }
+      tpoints_perm = P4EST_ALLOC (tpoint_t, nin);
+      for (nid = 0; nid < nin; nid++) {
+        tpoints_perm[perm[nid]] = tpoints[nid];
+      }
+      sc_array_init_data (&tpoint_array, tpoints_perm, sizeof (tpoint_t),
+                          nin);
+      buffer = p4est_lnodes_share_all (&tpoint_array, lnodes);
+      for (zz = 0; zz < lnodes->sharers->elem_count; zz++) {
+        lrank = p4est_lnodes_rank_array_index (lnodes->sharers, zz);
+        if (lrank->rank == mpirank) {
+          continue;
+        }
+        peer_buffer =
+          (sc_array_t *) sc_array_index (buffer->recv_buffers, zz);
+        shared_nodes = &(lrank->shared_nodes);
+        for (zy = 0; zy < shared_nodes->elem_count; zy++) {
+          nid = *((p4est_locidx_t *) sc_array_index (shared_nodes, zy));
+          tpoint_p = (tpoint_t *) sc_array_index (peer_buffer, zy);
+          SC_CHECK_ABORT (same_point (tpoint_p, tpoints_perm + nid, conn),
+                          "Lnodes: bad reordered node map across processors");
+        }
+      }
+      p4est_lnodes_buffer_destroy (buffer);
+      P4EST_FREE (tpoints_perm);
+      P4EST_FREE (old_nodes);
+      P4EST_FREE (perm);
+
       p4est_lnodes_destroy (lnodes);
       P4EST_FREE (tpoints);
       p4est_log_indent_pop ();
       P4EST_GLOBAL_PRODUCTIONF ("End lnodes test %d:%d\n", i, j);
     }
 
+    test_partition_lnodes (p4est, 2);
+
     /* clean up */
     p4est_ghost_destroy (ghost_layer);
     p4est_ghost_destroy (face_ghost_layer);
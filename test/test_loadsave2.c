@@ -28,12 +28,14 @@
 #include <p4est_communication.h>
 #include <p4est_extended.h>
 #include <p4est_io.h>
+#include <p4est_spill.h>
 #else
 #include <p8est_algorithms.h>
 #include <p8est_bits.h>
 #include <p8est_communication.h>
 #include <p8est_extended.h>
 #include <p8est_io.h>
+#include <p8est_spill.h>
 #endif
 #include <sc_options.h>
 #include <sc_statistics.h>
@@ -149,6 +151,100 @@ test_deflate (p4est_t * p4est)
   }
 }
 
+static void
+test_spill (p4est_t * p4est, const char *prefix)
+{
+  char                spill_name[BUFSIZ];
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_t            *copy, *shared;
+  p4est_tree_t       *tree, *stree;
+  p4est_spill_t      *spill;
+
+  snprintf (spill_name, BUFSIZ, "%s.spill.%d", prefix, p4est->mpirank);
+  copy = p4est_copy (p4est, 1);
+  spill = p4est_spill_new (p4est, spill_name);
+  SC_CHECK_ABORT (spill != NULL, "spill_new failed");
+
+  /* spill every tree, read back in order and spill again */
+  for (jt = p4est->last_local_tree; jt >= p4est->first_local_tree; --jt) {
+    SC_CHECK_ABORT (p4est_spill_out (spill, jt) == 0, "spill_out failed");
+    SC_CHECK_ABORT (p4est_spill_is_out (spill, jt), "spill_is_out");
+  }
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    SC_CHECK_ABORT (p4est_spill_in (spill, jt) == 0, "spill_in failed");
+    SC_CHECK_ABORT (!p4est_spill_is_out (spill, jt), "spill_is_out");
+  }
+  SC_CHECK_ABORT (p4est_is_equal (p4est, copy, 1), "spill in order");
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    SC_CHECK_ABORT (p4est_spill_out (spill, jt) == 0, "spill_out again");
+  }
+
+  /* the remaining trees are read back on destruction */
+  SC_CHECK_ABORT (p4est_spill_destroy (spill) == 0, "spill_destroy failed");
+  SC_CHECK_ABORT (p4est_is_valid (p4est), "spill validity");
+  SC_CHECK_ABORT (p4est_is_equal (p4est, copy, 1), "spill destroy");
+
+  /* a shallow copy is unshared by the spill and keeps its inline data */
+  shared = p4est_copy_shared (p4est, 0);
+  spill = p4est_spill_new (shared, spill_name);
+  SC_CHECK_ABORT (spill != NULL, "spill_new shared");
+  for (jt = shared->first_local_tree; jt <= shared->last_local_tree; ++jt) {
+    SC_CHECK_ABORT (p4est_spill_out (spill, jt) == 0, "spill_out shared");
+  }
+  SC_CHECK_ABORT (p4est_spill_destroy (spill) == 0, "spill_destroy shared");
+  SC_CHECK_ABORT (p4est_is_equal (shared, p4est, 0), "spill shared");
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    stree = p4est_tree_array_index (shared->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      SC_CHECK_ABORT (p4est_quadrant_array_index
+                      (&stree->quadrants, zz)->p.user_long ==
+                      p4est_quadrant_array_index
+                      (&tree->quadrants, zz)->p.user_long,
+                      "spill inline data");
+    }
+  }
+  p4est_destroy (shared);
+  SC_CHECK_ABORT (p4est_is_equal (p4est, copy, 1), "spill original");
+  p4est_destroy (copy);
+}
+
+static int
+coarsen_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+            p4est_quadrant_t * quadrants[])
+{
+  return which_tree % 2 == 0;
+}
+
+static void
+test_snapshot (p4est_t * p4est)
+{
+  size_t              size;
+  char               *buffer;
+  p4est_t            *copy;
+
+  copy = p4est_copy (p4est, 1);
+  size = p4est_snapshot_size (p4est, 1);
+  buffer = P4EST_ALLOC (char, size);
+  p4est_snapshot_save (p4est, 1, buffer);
+
+  /* change the forest and its partition and roll back */
+  p4est_coarsen (p4est, 0, coarsen_fn, init_fn);
+  p4est_partition (p4est, 0, NULL);
+  p4est_snapshot_restore (p4est, buffer, NULL);
+  SC_CHECK_ABORT (p4est_is_equal (p4est, copy, 1), "snapshot restore");
+
+  /* restore again without the data */
+  p4est_snapshot_save (p4est, 0, buffer);
+  p4est_refine (p4est, 0, refine_fn, init_fn);
+  p4est_snapshot_restore (p4est, buffer, init_fn);
+  SC_CHECK_ABORT (p4est_is_equal (p4est, copy, 0), "snapshot no data");
+
+  P4EST_FREE (buffer);
+  p4est_destroy (copy);
+}
+
 static unsigned
 test_checksum (p4est_t * p4est, int have_zlib)
 {
@@ -160,16 +256,20 @@ test_loadsave (p4est_connectivity_t * connectivity, const char *prefix,
                sc_MPI_Comm mpicomm, int mpirank)
 {
   int                 mpiret, retval;
-  int                 have_zlib;
+  int                 have_zlib, compress;
   unsigned            csum, csum2;
   double              elapsed, wtime;
   p4est_connectivity_t *conn2;
   p4est_t            *p4est, *p4est2;
   sc_statinfo_t       stats[STATS_COUNT];
   char                conn_name[BUFSIZ];
+  char                conn_mapped_name[BUFSIZ];
   char                p4est_name[BUFSIZ];
+  sc_MPI_Info         info;
 
   snprintf (conn_name, BUFSIZ, "%s.%s", prefix, P4EST_CONN_SUFFIX);
+  snprintf (conn_mapped_name, BUFSIZ, "%s.map.%s", prefix,
+            P4EST_CONN_SUFFIX);
   snprintf (p4est_name, BUFSIZ, "%s.%s", prefix, P4EST_FOREST_SUFFIX);
   P4EST_GLOBAL_INFOF ("Using file names %s and %s\n", conn_name, p4est_name);
 
@@ -183,6 +283,8 @@ test_loadsave (p4est_connectivity_t * connectivity, const char *prefix,
                          sizeof (int), init_fn, NULL);
   p4est_refine (p4est, 1, refine_fn, init_fn);
   test_deflate (p4est);
+  test_spill (p4est, prefix);
+  test_snapshot (p4est);
 
   /* save, synchronize, load connectivity and compare */
   if (mpirank == 0) {
@@ -201,6 +303,35 @@ test_loadsave (p4est_connectivity_t * connectivity, const char *prefix,
                   "load/save connectivity mismatch A");
   p4est_connectivity_destroy (conn2);
 
+  /* a trusted load compares the stored checksum instead of validating */
+  conn2 = p4est_connectivity_load_ext (conn_name, NULL, 1);
+  SC_CHECK_ABORT (conn2 != NULL, "connectivity_load_ext failed");
+  SC_CHECK_ABORT (p4est_connectivity_is_equal (connectivity, conn2),
+                  "load/save connectivity mismatch B");
+  SC_CHECK_ABORT (p4est_connectivity_checksum (conn2) ==
+                  p4est_connectivity_checksum (connectivity),
+                  "load/save connectivity checksum");
+  SC_CHECK_ABORT (p4est_connectivity_is_valid_parallel (conn2, mpicomm),
+                  "load/save connectivity validity");
+  p4est_connectivity_destroy (conn2);
+
+  /* save and load the memory-mappable format, raw and compressed */
+  for (compress = 0; compress < 2; ++compress) {
+    if (mpirank == 0) {
+      retval = p4est_connectivity_save_mapped (conn_mapped_name,
+                                               connectivity, compress);
+      SC_CHECK_ABORT (retval == 0, "connectivity_save_mapped failed");
+    }
+    mpiret = sc_MPI_Barrier (mpicomm);
+    SC_CHECK_MPI (mpiret);
+
+    conn2 = p4est_connectivity_load_mapped (conn_mapped_name, NULL);
+    SC_CHECK_ABORT (conn2 != NULL, "connectivity_load_mapped failed");
+    SC_CHECK_ABORT (p4est_connectivity_is_equal (connectivity, conn2),
+                    "load/save mapped connectivity mismatch");
+    p4est_connectivity_destroy (conn2);
+  }
+
   /* save, synchronize, load p4est and compare */
   wtime = sc_MPI_Wtime ();
   p4est_save (p4est_name, p4est, 1);
@@ -290,6 +421,37 @@ test_loadsave (p4est_connectivity_t * connectivity, const char *prefix,
   p4est_destroy (p4est2);
   p4est_connectivity_destroy (conn2);
 
+  /* the header may be read by the root only or by all processes */
+  p4est2 = p4est_load_ext (p4est_name, mpicomm, sizeof (int), 1,
+                           0, 1, NULL, &conn2);
+  SC_CHECK_ABORT (p4est_connectivity_is_equal (connectivity, conn2),
+                  "load/save connectivity mismatch G");
+  SC_CHECK_ABORT (p4est_is_equal (p4est, p4est2, 1),
+                  "load/save p4est mismatch G");
+  p4est_destroy (p4est2);
+  p4est_connectivity_destroy (conn2);
+
+  /* save and load with data and hints for collective buffering */
+#ifdef P4EST_ENABLE_MPIIO
+  mpiret = MPI_Info_create (&info);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Info_set (info, "cb_nodes", "1");
+  SC_CHECK_MPI (mpiret);
+#else
+  info = sc_MPI_INFO_NULL;
+#endif
+  p4est_save_info (p4est_name, p4est, 1, 1, info);
+  p4est2 = p4est_load_info (p4est_name, mpicomm, sizeof (int), 1,
+                            0, 0, info, NULL, &conn2);
+  SC_CHECK_ABORT (p4est_is_equal (p4est, p4est2, 1),
+                  "load/save p4est mismatch F");
+  p4est_destroy (p4est2);
+  p4est_connectivity_destroy (conn2);
+#ifdef P4EST_ENABLE_MPIIO
+  mpiret = MPI_Info_free (&info);
+  SC_CHECK_MPI (mpiret);
+#endif
+
   /* destroy data structures */
   p4est_destroy (p4est);
 
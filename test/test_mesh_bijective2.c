@@ -27,10 +27,12 @@
 #include <p4est_extended.h>
 #include <p4est_ghost.h>
 #include <p4est_mesh.h>
+#include <p4est_taskgraph.h>
 #else /* !P4_TO_P8 */
 #include <p8est_extended.h>
 #include <p8est_ghost.h>
 #include <p8est_mesh.h>
+#include <p8est_taskgraph.h>
 #endif /* !P4_TO_P8 */
 
 /** Set constants needed to decode an encoding obtained from \ref
@@ -710,6 +712,518 @@ test_mesh_multiple_trees_brick (p4est_t * p4est, p4est_connectivity_t * conn,
   return 0;
 }
 
+static int
+refine_first_tree (p4est_t * p4est, p4est_topidx_t which_tree,
+                   p4est_quadrant_t * quadrant)
+{
+  return which_tree == 0 && quadrant->level < 3;
+}
+
+/* Function for testing the compressed face neighbor lists of p4est-mesh
+ * against the face neighbor iterator on a forest with hanging faces.
+ *
+ * \param [in] mpicomm   MPI communicator
+ * \returns 0 for success, -1 for failure
+ */
+int
+test_mesh_face_csr (sc_MPI_Comm mpicomm)
+{
+  int                 f, qtf, h, num;
+  int8_t              nsubface[P4EST_HALF];
+  p4est_locidx_t      lq, ientry, qtq, nquad[P4EST_HALF];
+  p4est_topidx_t      jt;
+  size_t              zz;
+  p4est_t            *p4est;
+  p4est_connectivity_t *conn;
+  p4est_ghost_t      *ghost;
+  p4est_mesh_params_t params;
+  p4est_mesh_t       *mesh;
+  p4est_mesh_face_neighbor_t mfn;
+  p4est_tree_t       *tree;
+
+  P4EST_VERBOSE ("Check compressed face neighbors for brick of trees\n");
+
+#ifndef P4_TO_P8
+  conn = p4est_connectivity_new_brick (2, 1, 1, 0);
+#else /* !P4_TO_P8 */
+  conn = p8est_connectivity_new_brick (2, 1, 1, 1, 0, 1);
+#endif /* !P4_TO_P8 */
+  p4est = p4est_new_ext (mpicomm, conn, 0, 2, 0, 0, NULL, NULL);
+  p4est_refine (p4est, 1, refine_first_tree, NULL);
+  p4est_balance (p4est, P4EST_CONNECT_FACE, NULL);
+  p4est_partition (p4est, 0, NULL);
+
+  ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FACE);
+  p4est_mesh_params_init (&params);
+  params.compute_face_csr = 1;
+  mesh = p4est_mesh_new_params (p4est, ghost, &params);
+
+  /* the entries of each quadrant appear in the order of the iterator */
+  lq = 0;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lq) {
+      ientry = mesh->face_offset[lq];
+      p4est_mesh_face_neighbor_init2 (&mfn, p4est, ghost, mesh, jt,
+                                      (p4est_locidx_t) zz);
+      for (;;) {
+        f = mfn.face;
+        h = mfn.subface;
+        if (p4est_mesh_face_neighbor_next (&mfn, NULL, NULL, &qtf, NULL)
+            == NULL) {
+          break;
+        }
+        qtq = mfn.current_qtq;
+        if (qtq == lq && qtf == f) {
+          /* the domain boundary has no entry */
+          continue;
+        }
+        SC_CHECK_ABORT (ientry < mesh->face_offset[lq + 1] &&
+                        mesh->face_quad[ientry] == qtq &&
+                        mesh->face_face[ientry] == f,
+                        "Compressed face neighbor mismatch");
+        if (qtf < 0) {
+          SC_CHECK_ABORT (mesh->face_subface[ientry] == h &&
+                          mesh->face_nface[ientry] ==
+                          P4EST_HALF * P4EST_FACES + qtf,
+                          "Compressed half-size face mismatch");
+        }
+        else if (qtf >= P4EST_HALF * P4EST_FACES) {
+          SC_CHECK_ABORT (mesh->face_subface[ientry] ==
+                          P4EST_HALF + qtf / (P4EST_HALF * P4EST_FACES) - 1
+                          && mesh->face_nface[ientry] ==
+                          qtf % (P4EST_HALF * P4EST_FACES),
+                          "Compressed double-size face mismatch");
+        }
+        else {
+          SC_CHECK_ABORT (mesh->face_subface[ientry] == -1 &&
+                          mesh->face_nface[ientry] == qtf,
+                          "Compressed same-size face mismatch");
+        }
+        ++ientry;
+      }
+      SC_CHECK_ABORT (ientry == mesh->face_offset[lq + 1],
+                      "Compressed face neighbor count");
+    }
+  }
+
+  /* the inline accessor decodes the same neighbors */
+  for (ientry = 0, qtq = 0; qtq < lq; ++qtq) {
+    for (f = 0; f < P4EST_FACES; ++f) {
+      num = p4est_mesh_face_neighbors (mesh, qtq, f, nquad, nsubface, &qtf);
+      for (h = 0; h < num; ++h, ++ientry) {
+        SC_CHECK_ABORT (mesh->face_quad[ientry] == nquad[h] &&
+                        mesh->face_face[ientry] == f &&
+                        mesh->face_nface[ientry] == qtf &&
+                        mesh->face_subface[ientry] == nsubface[h],
+                        "Inline face neighbor mismatch");
+      }
+    }
+  }
+  SC_CHECK_ABORT (ientry == mesh->face_offset[lq],
+                  "Inline face neighbor count");
+
+  /* cleanup */
+  p4est_mesh_destroy (mesh);
+  p4est_ghost_destroy (ghost);
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (conn);
+
+  return 0;
+}
+
+/* Function for testing the unique face list of p4est-mesh against the
+ * compressed face neighbor lists on a forest with hanging faces.
+ *
+ * \param [in] mpicomm   MPI communicator
+ * \returns 0 for success, -1 for failure
+ */
+int
+test_mesh_face_list (sc_MPI_Comm mpicomm)
+{
+  int                 level, flevel, found;
+  int8_t             *qlevel;
+  size_t              zz;
+  p4est_locidx_t      lq, fi, ientry, left, right, num_entries;
+  p4est_locidx_t      num_boundary, num_found_boundary;
+  p4est_locidx_t     *lp;
+  p4est_t            *p4est;
+  p4est_connectivity_t *conn;
+  p4est_ghost_t      *ghost;
+  p4est_mesh_params_t params;
+  p4est_mesh_t       *mesh;
+
+  P4EST_VERBOSE ("Check unique face list for brick of trees\n");
+
+#ifndef P4_TO_P8
+  conn = p4est_connectivity_new_brick (2, 1, 1, 0);
+#else /* !P4_TO_P8 */
+  conn = p8est_connectivity_new_brick (2, 1, 1, 1, 0, 1);
+#endif /* !P4_TO_P8 */
+  p4est = p4est_new_ext (mpicomm, conn, 0, 2, 0, 0, NULL, NULL);
+  p4est_refine (p4est, 1, refine_first_tree, NULL);
+  p4est_balance (p4est, P4EST_CONNECT_FACE, NULL);
+  p4est_partition (p4est, 0, NULL);
+
+  ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FACE);
+  p4est_mesh_params_init (&params);
+  params.compute_level_lists = 1;
+  params.compute_face_csr = 1;
+  params.compute_face_list = 1;
+  params.compute_ghost_faces = 1;
+  mesh = p4est_mesh_new_params (p4est, ghost, &params);
+  lq = mesh->local_num_quadrants;
+
+  /* the level of each local quadrant from the level lists */
+  qlevel = P4EST_ALLOC (int8_t, lq);
+  for (level = 0; level <= P4EST_QMAXLEVEL; ++level) {
+    for (zz = 0; zz < mesh->quad_level[level].elem_count; ++zz) {
+      lp = (p4est_locidx_t *) sc_array_index (mesh->quad_level + level, zz);
+      qlevel[*lp] = (int8_t) level;
+    }
+  }
+
+  /* count the boundary faces */
+  num_boundary = 0;
+  for (fi = 0; fi < P4EST_FACES * lq; ++fi) {
+    if (mesh->quad_to_quad[fi] == fi / P4EST_FACES &&
+        mesh->quad_to_face[fi] == fi % P4EST_FACES) {
+      ++num_boundary;
+    }
+  }
+
+  /* every face matches a neighbor entry of its left side */
+  SC_CHECK_ABORT (mesh->face_level_offset[0] == 0 &&
+                  mesh->face_level_offset[P4EST_QMAXLEVEL + 1] ==
+                  mesh->local_num_faces, "Face list level offsets");
+  num_entries = num_found_boundary = 0;
+  for (level = 0; level <= P4EST_QMAXLEVEL; ++level) {
+    for (fi = mesh->face_level_offset[level];
+         fi < mesh->face_level_offset[level + 1]; ++fi) {
+      left = mesh->face_to_quad[2 * fi];
+      right = mesh->face_to_quad[2 * fi + 1];
+      SC_CHECK_ABORT (0 <= left && left < lq, "Face list left side");
+      flevel = qlevel[left];
+      if (0 <= mesh->face_hanging[fi] &&
+          mesh->face_hanging[fi] < P4EST_HALF) {
+        /* the smaller side is the ghost on the right */
+        SC_CHECK_ABORT (right >= lq, "Face list half-size side");
+        ++flevel;
+      }
+      SC_CHECK_ABORT (flevel == level, "Face list level");
+      if (right < 0) {
+        SC_CHECK_ABORT (mesh->face_to_face[2 * fi + 1] == -1,
+                        "Face list boundary");
+        ++num_found_boundary;
+        continue;
+      }
+      num_entries += (right < lq ? 2 : 1);
+      found = 0;
+      for (ientry = mesh->face_offset[left];
+           ientry < mesh->face_offset[left + 1]; ++ientry) {
+        found = found ||
+          (mesh->face_quad[ientry] == right &&
+           mesh->face_face[ientry] == mesh->face_to_face[2 * fi] &&
+           mesh->face_nface[ientry] == mesh->face_to_face[2 * fi + 1] &&
+           mesh->face_subface[ientry] == mesh->face_hanging[fi]);
+      }
+      SC_CHECK_ABORT (found, "Face list entry");
+    }
+  }
+
+  /* each neighbor relation is covered exactly once */
+  SC_CHECK_ABORT (num_entries == mesh->face_offset[lq],
+                  "Face list neighbor count");
+  SC_CHECK_ABORT (num_found_boundary == num_boundary,
+                  "Face list boundary count");
+
+  /* a ghost face with a local neighbor is also a face of that neighbor */
+  for (fi = 0; fi < P4EST_FACES * mesh->ghost_num_quadrants; ++fi) {
+    right = mesh->ghost_to_quad[fi];
+    if (right < 0 || right >= lq || mesh->ghost_to_face[fi] < 0) {
+      continue;
+    }
+    left = lq + fi / P4EST_FACES;
+    found = 0;
+    for (ientry = mesh->face_offset[right];
+         ientry < mesh->face_offset[right + 1]; ++ientry) {
+      found = found ||
+        (mesh->face_quad[ientry] == left &&
+         mesh->face_face[ientry] == mesh->ghost_to_face[fi] % P4EST_FACES);
+    }
+    SC_CHECK_ABORT (found, "Ghost face neighbor");
+  }
+
+  /* cleanup */
+  P4EST_FREE (qlevel);
+  p4est_mesh_destroy (mesh);
+  p4est_ghost_destroy (ghost);
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (conn);
+
+  return 0;
+}
+
+static void
+record_history (p4est_t * p4est, p4est_topidx_t which_tree,
+                int num_outgoing, p4est_quadrant_t * outgoing[],
+                int num_incoming, p4est_quadrant_t * incoming[])
+{
+  p4est_mesh_history_add ((p4est_mesh_history_t *) p4est->user_pointer,
+                          which_tree, num_outgoing, outgoing,
+                          num_incoming, incoming);
+}
+
+static int
+refine_corner_quadrant (p4est_t * p4est, p4est_topidx_t which_tree,
+                        p4est_quadrant_t * quadrant)
+{
+  return which_tree == 1 && quadrant->x == 0 && quadrant->y == 0 &&
+    quadrant->level < 4;
+}
+
+static int
+coarsen_first_tree (p4est_t * p4est, p4est_topidx_t which_tree,
+                    p4est_quadrant_t * quadrants[])
+{
+  return which_tree == 0;
+}
+
+/* Check that two meshes of the same forest store the same face neighbors
+ * and per-quadrant lists; the order of quad_to_half may differ. */
+static void
+compare_meshes (p4est_mesh_t * mesh, p4est_mesh_t * ref)
+{
+  int                 level;
+  p4est_locidx_t      il, *halfs, *rhalfs;
+
+  SC_CHECK_ABORT (mesh->local_num_quadrants == ref->local_num_quadrants &&
+                  mesh->ghost_num_quadrants == ref->ghost_num_quadrants,
+                  "Updated mesh size");
+  for (il = 0; il < P4EST_FACES * ref->local_num_quadrants; ++il) {
+    SC_CHECK_ABORT (mesh->quad_to_face[il] == ref->quad_to_face[il],
+                    "Updated mesh quad_to_face");
+    if (ref->quad_to_face[il] >= 0) {
+      SC_CHECK_ABORT (mesh->quad_to_quad[il] == ref->quad_to_quad[il],
+                      "Updated mesh quad_to_quad");
+    }
+    else {
+      halfs = (p4est_locidx_t *)
+        sc_array_index (mesh->quad_to_half, mesh->quad_to_quad[il]);
+      rhalfs = (p4est_locidx_t *)
+        sc_array_index (ref->quad_to_half, ref->quad_to_quad[il]);
+      SC_CHECK_ABORT (!memcmp (halfs, rhalfs,
+                               P4EST_HALF * sizeof (p4est_locidx_t)),
+                      "Updated mesh quad_to_half");
+    }
+  }
+  SC_CHECK_ABORT (!memcmp (mesh->ghost_to_proc, ref->ghost_to_proc,
+                           ref->ghost_num_quadrants * sizeof (int)),
+                  "Updated mesh ghost_to_proc");
+  SC_CHECK_ABORT (!memcmp (mesh->quad_to_tree, ref->quad_to_tree,
+                           ref->local_num_quadrants *
+                           sizeof (p4est_topidx_t)),
+                  "Updated mesh quad_to_tree");
+  for (level = 0; level <= P4EST_QMAXLEVEL; ++level) {
+    SC_CHECK_ABORT (sc_array_is_equal (mesh->quad_level + level,
+                                       ref->quad_level + level),
+                    "Updated mesh quad_level");
+  }
+  SC_CHECK_ABORT (!memcmp (mesh->face_offset, ref->face_offset,
+                           (ref->local_num_quadrants + 1) *
+                           sizeof (p4est_locidx_t)),
+                  "Updated mesh face_offset");
+}
+
+/* Function for testing the update of p4est-mesh after adaptation
+ * against a mesh built from scratch.
+ *
+ * \param [in] mpicomm   MPI communicator
+ * \returns 0 for success, -1 for failure
+ */
+int
+test_mesh_update (sc_MPI_Comm mpicomm)
+{
+  int                 round;
+  p4est_t            *p4est;
+  p4est_connectivity_t *conn;
+  p4est_ghost_t      *ghost;
+  p4est_mesh_params_t params;
+  p4est_mesh_t       *mesh, *ref;
+  p4est_mesh_history_t *history;
+
+  P4EST_VERBOSE ("Check mesh update after adaptation\n");
+
+#ifndef P4_TO_P8
+  conn = p4est_connectivity_new_brick (2, 1, 1, 1);
+#else /* !P4_TO_P8 */
+  conn = p8est_connectivity_new_brick (2, 1, 1, 1, 1, 0);
+#endif /* !P4_TO_P8 */
+  history = p4est_mesh_history_new ();
+  p4est = p4est_new_ext (mpicomm, conn, 0, 2, 0, 0, NULL, history);
+  p4est_refine (p4est, 1, refine_first_tree, NULL);
+  p4est_partition (p4est, 0, NULL);
+
+  ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FACE);
+  p4est_mesh_params_init (&params);
+  params.compute_tree_index = 1;
+  params.compute_level_lists = 1;
+  params.compute_face_csr = 1;
+  mesh = p4est_mesh_new_params (p4est, ghost, &params);
+
+  for (round = 0; round < 2; ++round) {
+    /* adapt and balance without partitioning */
+    if (round == 0) {
+      p4est_refine_ext (p4est, 1, -1, refine_corner_quadrant, NULL,
+                        record_history);
+    }
+    else {
+      p4est_coarsen_ext (p4est, 0, 0, coarsen_first_tree, NULL,
+                         record_history);
+    }
+    p4est_balance_ext (p4est, P4EST_CONNECT_FACE, NULL, record_history);
+    p4est_ghost_destroy (ghost);
+    ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FACE);
+
+    p4est_mesh_update (mesh, p4est, ghost, history);
+    ref = p4est_mesh_new_params (p4est, ghost, &params);
+    compare_meshes (mesh, ref);
+    p4est_mesh_destroy (ref);
+  }
+
+  /* after partitioning the mesh is rebuilt */
+  p4est_partition (p4est, 0, NULL);
+  p4est_ghost_destroy (ghost);
+  ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FACE);
+  p4est_mesh_update (mesh, p4est, ghost, NULL);
+  ref = p4est_mesh_new_params (p4est, ghost, &params);
+  compare_meshes (mesh, ref);
+  p4est_mesh_destroy (ref);
+
+  /* cleanup */
+  p4est_mesh_destroy (mesh);
+  p4est_ghost_destroy (ghost);
+  p4est_destroy (p4est);
+  p4est_mesh_history_destroy (history);
+  p4est_connectivity_destroy (conn);
+
+  return 0;
+}
+
+/* Check that two meshes store the same corner or edge groups behind the
+ * links of every local quadrant; the numbering of the groups may differ. */
+static void
+compare_groups (p4est_locidx_t num_links, p4est_locidx_t first_group,
+                const p4est_locidx_t * link, sc_array_t * offset,
+                sc_array_t * quad, sc_array_t * code,
+                const p4est_locidx_t * rlink, sc_array_t * roffset,
+                sc_array_t * rquad, sc_array_t * rcode)
+{
+  p4est_locidx_t      il, gl, rgl, start, rstart, size;
+
+  SC_CHECK_ABORT (offset->elem_count == roffset->elem_count,
+                  "Threaded mesh group count");
+  for (il = 0; il < num_links; ++il) {
+    SC_CHECK_ABORT ((link[il] >= first_group) == (rlink[il] >= first_group),
+                    "Threaded mesh link");
+    if (rlink[il] < first_group) {
+      SC_CHECK_ABORT (link[il] == rlink[il], "Threaded mesh link");
+      continue;
+    }
+    gl = link[il] - first_group;
+    rgl = rlink[il] - first_group;
+    start = *(p4est_locidx_t *) sc_array_index (offset, gl);
+    rstart = *(p4est_locidx_t *) sc_array_index (roffset, rgl);
+    size = *(p4est_locidx_t *) sc_array_index (roffset, rgl + 1) - rstart;
+    SC_CHECK_ABORT (*(p4est_locidx_t *) sc_array_index (offset, gl + 1) -
+                    start == size, "Threaded mesh group size");
+    SC_CHECK_ABORT (!memcmp (sc_array_index (quad, start),
+                             sc_array_index (rquad, rstart),
+                             size * sizeof (p4est_locidx_t)) &&
+                    !memcmp (sc_array_index (code, start),
+                             sc_array_index (rcode, rstart),
+                             size * sizeof (int8_t)),
+                    "Threaded mesh group");
+  }
+}
+
+/* Function for testing the threaded mesh construction against the serial
+ * one on a forest with hanging faces, edges and corners between trees.
+ *
+ * \param [in] mpicomm   MPI communicator
+ * \returns 0 for success, -1 for failure
+ */
+int
+test_mesh_threads (sc_MPI_Comm mpicomm)
+{
+  int                 num_threads;
+  p4est_locidx_t      lq, first_group;
+  p4est_t            *p4est;
+  p4est_connectivity_t *conn;
+  p4est_ghost_t      *ghost;
+  p4est_mesh_params_t params;
+  p4est_mesh_t       *mesh, *ref;
+
+  P4EST_VERBOSE ("Check threaded mesh construction\n");
+
+#ifndef P4_TO_P8
+  conn = p4est_connectivity_new_brick (2, 2, 1, 1);
+#else /* !P4_TO_P8 */
+  conn = p8est_connectivity_new_brick (2, 2, 1, 1, 1, 0);
+#endif /* !P4_TO_P8 */
+  p4est = p4est_new_ext (mpicomm, conn, 0, 1, 0, 0, NULL, NULL);
+  p4est_refine (p4est, 1, refine_first_tree, NULL);
+  p4est_refine (p4est, 1, refine_corner_quadrant, NULL);
+  p4est_partition (p4est, 0, NULL);
+  p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
+  p4est_partition (p4est, 0, NULL);
+
+  ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+  p4est_mesh_params_init (&params);
+  params.btype = P4EST_CONNECT_FULL;
+#ifdef P4_TO_P8
+  params.edgehanging_corners = 1;
+#endif /* P4_TO_P8 */
+  params.compute_tree_index = 1;
+  params.compute_level_lists = 1;
+  params.compute_face_csr = 1;
+  ref = p4est_mesh_new_params (p4est, ghost, &params);
+  lq = ref->local_num_quadrants;
+  first_group = lq + ref->ghost_num_quadrants;
+
+  for (num_threads = 2; num_threads <= 4; num_threads += 2) {
+    p4est_set_num_threads (num_threads);
+    mesh = p4est_mesh_new_params (p4est, ghost, &params);
+    p4est_set_num_threads (1);
+
+    compare_meshes (mesh, ref);
+    SC_CHECK_ABORT (mesh->local_num_corners == ref->local_num_corners,
+                    "Threaded mesh corners");
+    compare_groups (P4EST_CHILDREN * lq, first_group, mesh->quad_to_corner,
+                    mesh->corner_offset, mesh->corner_quad,
+                    mesh->corner_corner, ref->quad_to_corner,
+                    ref->corner_offset, ref->corner_quad,
+                    ref->corner_corner);
+#ifdef P4_TO_P8
+    SC_CHECK_ABORT (mesh->local_num_edges == ref->local_num_edges,
+                    "Threaded mesh edges");
+    compare_groups (P8EST_EDGES * lq, first_group, mesh->quad_to_edge,
+                    mesh->edge_offset, mesh->edge_quad, mesh->edge_edge,
+                    ref->quad_to_edge, ref->edge_offset, ref->edge_quad,
+                    ref->edge_edge);
+#endif /* P4_TO_P8 */
+    p4est_mesh_destroy (mesh);
+  }
+
+  /* cleanup */
+  p4est_mesh_destroy (ref);
+  p4est_ghost_destroy (ghost);
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (conn);
+
+  return 0;
+}
+
 /* Function for testing p4est-mesh for multiple trees in a non-brick scenario
  *
  * \param [in] p4est     The forest.
@@ -725,6 +1239,147 @@ test_mesh_multiple_trees_nonbrick (p4est_t * p4est,
   return 0;
 }
 
+/* Function for testing the task graph built from the unique face list.
+ * Every face must belong to one task, tasks on a common block must be
+ * ordered, and only boundary tasks may wait for the ghost exchange.
+ *
+ * \param [in] mpicomm   MPI communicator
+ * \returns 0 for success, -1 for failure
+ */
+int
+test_mesh_taskgraph (sc_MPI_Comm mpicomm)
+{
+  int                 i, k;
+  char               *before;
+  p4est_locidx_t      block_sizes[3] = { 1, 5, 1 << 20 };
+  p4est_locidx_t      lq, fi, t, s, d, left, right, bl, br;
+  p4est_locidx_t      nt;
+  p4est_locidx_t     *owner;
+  p4est_task_t       *task, *other;
+  p4est_t            *p4est;
+  p4est_connectivity_t *conn;
+  p4est_ghost_t      *ghost;
+  p4est_mesh_params_t params;
+  p4est_mesh_t       *mesh;
+  p4est_taskgraph_t  *graph;
+
+  P4EST_VERBOSE ("Check task graph of the face list\n");
+
+#ifndef P4_TO_P8
+  conn = p4est_connectivity_new_brick (2, 1, 1, 0);
+#else /* !P4_TO_P8 */
+  conn = p8est_connectivity_new_brick (2, 1, 1, 1, 0, 1);
+#endif /* !P4_TO_P8 */
+  p4est = p4est_new_ext (mpicomm, conn, 0, 2, 0, 0, NULL, NULL);
+  p4est_refine (p4est, 1, refine_first_tree, NULL);
+  p4est_balance (p4est, P4EST_CONNECT_FACE, NULL);
+  p4est_partition (p4est, 0, NULL);
+
+  ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FACE);
+  p4est_mesh_params_init (&params);
+  params.compute_face_list = 1;
+  mesh = p4est_mesh_new_params (p4est, ghost, &params);
+  lq = mesh->local_num_quadrants;
+  owner = P4EST_ALLOC (p4est_locidx_t, mesh->local_num_faces);
+
+  for (i = 0; i < 3; ++i) {
+    graph = p4est_taskgraph_new (mesh, block_sizes[i]);
+    nt = graph->num_tasks;
+    SC_CHECK_ABORT (graph->block_offsets[0] == 0 &&
+                    graph->block_offsets[graph->num_blocks] == lq,
+                    "Task graph block offsets");
+    SC_CHECK_ABORT (nt >= 1 + graph->num_blocks &&
+                    graph->tasks[0].type == P4EST_TASK_GHOST &&
+                    graph->tasks[0].num_faces == 0, "Task graph ghost task");
+
+    /* each face is in exactly one task of the right kind */
+    for (fi = 0; fi < mesh->local_num_faces; ++fi) {
+      owner[fi] = -1;
+    }
+    for (t = 0; t < nt; ++t) {
+      task = graph->tasks + t;
+      SC_CHECK_ABORT (t == 0 || ((1 <= t && t <= graph->num_blocks) ==
+                                 (task->type == P4EST_TASK_VOLUME)),
+                      "Task order");
+      for (k = 0; k < task->num_faces; ++k) {
+        fi = graph->faces[task->face_offset + k];
+        SC_CHECK_ABORT (owner[fi] == -1, "Face in two tasks");
+        owner[fi] = t;
+        left = mesh->face_to_quad[2 * fi];
+        right = mesh->face_to_quad[2 * fi + 1];
+        bl = p4est_taskgraph_block (graph, left);
+        br = (0 <= right && right < lq) ?
+          p4est_taskgraph_block (graph, right) : -1;
+        if (right >= lq) {
+          SC_CHECK_ABORT (task->type == P4EST_TASK_BOUNDARY &&
+                          task->block[0] == bl, "Boundary task face");
+        }
+        else if (right < 0 || br == bl) {
+          SC_CHECK_ABORT (task->type == P4EST_TASK_VOLUME &&
+                          task->block[0] == bl, "Volume task face");
+        }
+        else {
+          SC_CHECK_ABORT (task->type == P4EST_TASK_INTERFACE &&
+                          task->block[0] == SC_MIN (bl, br) &&
+                          task->block[1] == SC_MAX (bl, br),
+                          "Interface task face");
+        }
+      }
+    }
+    for (fi = 0; fi < mesh->local_num_faces; ++fi) {
+      SC_CHECK_ABORT (owner[fi] >= 0, "Face in no task");
+    }
+
+    /* compute which tasks precede each other through dependencies */
+    before = P4EST_ALLOC_ZERO (char, nt * nt);
+    for (t = 0; t < nt; ++t) {
+      task = graph->tasks + t;
+      SC_CHECK_ABORT ((task->type == P4EST_TASK_BOUNDARY) ==
+                      (task->num_deps > 0 &&
+                       graph->deps[task->dep_offset] == 0),
+                      "Boundary task waits for ghosts");
+      for (k = 0; k < task->num_deps; ++k) {
+        d = graph->deps[task->dep_offset + k];
+        SC_CHECK_ABORT (0 <= d && d < t, "Dependency order");
+        before[nt * t + d] = 1;
+        for (s = 0; s < d; ++s) {
+          before[nt * t + s] |= before[nt * d + s];
+        }
+      }
+    }
+
+    /* tasks that share a block never run at the same time */
+    for (t = 0; t < nt; ++t) {
+      task = graph->tasks + t;
+      for (s = 1; s < t; ++s) {
+        other = graph->tasks + s;
+        if ((task->block[0] >= 0 &&
+             (task->block[0] == other->block[0] ||
+              task->block[0] == other->block[1])) ||
+            (task->block[1] >= 0 &&
+             (task->block[1] == other->block[0] ||
+              task->block[1] == other->block[1]))) {
+          SC_CHECK_ABORT (before[nt * t + s], "Unordered tasks on a block");
+        }
+      }
+      SC_CHECK_ABORT (task->type == P4EST_TASK_BOUNDARY || !before[nt * t],
+                      "Interior task waits for ghosts");
+    }
+
+    P4EST_FREE (before);
+    p4est_taskgraph_destroy (graph);
+  }
+
+  /* cleanup */
+  P4EST_FREE (owner);
+  p4est_mesh_destroy (mesh);
+  p4est_ghost_destroy (ghost);
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (conn);
+
+  return 0;
+}
+
 int
 main (int argc, char **argv)
 {
@@ -789,6 +1444,21 @@ main (int argc, char **argv)
     test_mesh_multiple_trees_nonbrick (p4est, conn, periodic_boundaries,
                                        mpicomm);
   }
+  /* test compressed face neighbors with hanging faces */
+  test_mesh_face_csr (mpicomm);
+
+  /* test the unique face list */
+  test_mesh_face_list (mpicomm);
+
+  /* test the mesh update after adaptation */
+  test_mesh_update (mpicomm);
+
+  /* test the threaded mesh construction */
+  test_mesh_threads (mpicomm);
+
+  /* test the task graph of the face list */
+  test_mesh_taskgraph (mpicomm);
+
   /* exit */
   sc_finalize ();
   mpiret = sc_MPI_Finalize ();
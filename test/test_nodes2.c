@@ -24,10 +24,12 @@
 
 #ifndef P4_TO_P8
 #include <p4est.h>
+#include <p4est_bits.h>
 #include <p4est_extended.h>
 #include <p4est_nodes.h>
 #else
 #include <p8est.h>
+#include <p8est_bits.h>
 #include <p8est_extended.h>
 #include <p8est_nodes.h>
 #endif
@@ -50,6 +52,63 @@ refine_fn (p4est_t * p4est, p4est_topidx_t which_tree,
   return 0;
 }
 
+/* the merged independent nodes are unique and sorted inside the trees */
+static void
+check_nodes (p4est_t * p4est, p4est_nodes_t * nodes)
+{
+  size_t              zz;
+  p4est_quadrant_t    prev, c;
+  p4est_indep_t      *in;
+
+  SC_CHECK_ABORT (p4est_nodes_is_valid (p4est, nodes), "nodes valid");
+  for (zz = 0; zz < nodes->indep_nodes.elem_count; ++zz) {
+    in = (p4est_indep_t *) sc_array_index (&nodes->indep_nodes, zz);
+    p4est_node_clamp_inside ((p4est_quadrant_t *) in, &c);
+    c.p.which_tree = in->p.which_tree;
+    SC_CHECK_ABORT (zz == 0 || p4est_quadrant_compare_piggy (&prev, &c) < 0,
+                    "nodes sorted");
+    prev = c;
+  }
+}
+
+/* a uniform mesh has one node per lattice point and no hanging nodes */
+static void
+test_nodes_uniform (sc_MPI_Comm mpicomm,
+                    p4est_connectivity_t * connectivity)
+{
+  const int           level = 3;
+  int                 mpiret;
+  p4est_gloidx_t      owned, global, expected;
+  p4est_t            *p4est;
+  p4est_ghost_t      *ghost;
+  p4est_nodes_t      *nodes;
+
+  p4est = p4est_new_ext (mpicomm, connectivity, 0, level, 1, 0, NULL, NULL);
+  ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+  nodes = p4est_nodes_new (p4est, ghost);
+  check_nodes (p4est, nodes);
+  SC_CHECK_ABORT (nodes->face_hangings.elem_count == 0, "no face hangings");
+#ifdef P4_TO_P8
+  SC_CHECK_ABORT (nodes->edge_hangings.elem_count == 0, "no edge hangings");
+#endif
+
+  owned = (p4est_gloidx_t) nodes->num_owned_indeps;
+  mpiret = sc_MPI_Allreduce (&owned, &global, 1, P4EST_MPI_GLOIDX,
+                             sc_MPI_SUM, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  expected = (1 << level) + 1;
+#ifndef P4_TO_P8
+  expected *= expected;
+#else
+  expected *= expected * expected;
+#endif
+  SC_CHECK_ABORT (global == expected, "global independent nodes");
+
+  p4est_nodes_destroy (nodes);
+  p4est_ghost_destroy (ghost);
+  p4est_destroy (p4est);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -87,12 +146,17 @@ main (int argc, char **argv)
   nodes1 = p4est_nodes_new (p4est, ghost);
   P4EST_GLOBAL_INFO ("Making nodes without ghosts\n");
   nodes2 = p4est_nodes_new (p4est, NULL);
+  check_nodes (p4est, nodes1);
+  SC_CHECK_ABORT (p4est_nodes_is_valid (p4est, nodes2), "local nodes valid");
 
   /* clean up and exit */
   p4est_nodes_destroy (nodes1);
   p4est_nodes_destroy (nodes2);
   p4est_ghost_destroy (ghost);
   p4est_destroy (p4est);
+
+  /* count the nodes of a uniform forest */
+  test_nodes_uniform (mpicomm, connectivity);
   p4est_connectivity_destroy (connectivity);
   sc_finalize ();
 
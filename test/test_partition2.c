@@ -24,13 +24,17 @@
 
 #ifndef P4_TO_P8
 #include <p4est_algorithms.h>
+#include <p4est_bits.h>
 #include <p4est_communication.h>
 #include <p4est_extended.h>
+#include <p4est_remap.h>
 #include <p4est_search.h>
 #else
 #include <p8est_algorithms.h>
+#include <p8est_bits.h>
 #include <p8est_communication.h>
 #include <p8est_extended.h>
+#include <p8est_remap.h>
 #include <p8est_search.h>
 #endif
 
@@ -88,6 +92,30 @@ weight_one (p4est_t * p4est, p4est_topidx_t which_tree,
   return 1;
 }
 
+static int
+weight_level (p4est_t * p4est, p4est_topidx_t which_tree,
+              p4est_quadrant_t * quadrant)
+{
+  return 1 + quadrant->level;
+}
+
+static int
+coarsen_all (p4est_t * p4est, p4est_topidx_t which_tree,
+             p4est_quadrant_t * quadrants[])
+{
+  return 1;
+}
+
+static void
+weights_multi (p4est_t * p4est, p4est_topidx_t which_tree,
+               p4est_quadrant_t * quadrant, int *weights)
+{
+  /* one unit per quadrant, a fine-level load and a tree dependent load */
+  weights[0] = 1;
+  weights[1] = quadrant->level >= 5 ? 8 : 0;
+  weights[2] = (int) which_tree % 3;
+}
+
 static int
 weight_once (p4est_t * p4est, p4est_topidx_t which_tree,
              p4est_quadrant_t * quadrant)
@@ -123,6 +151,15 @@ circle_init (p4est_t * p4est, p4est_topidx_t which_tree,
   *idata = ++circle_count;
 }
 
+/* receive every quadrant's variable data into its own allocation */
+static void        *
+transfer_alloc (void *user, p4est_locidx_t index, size_t bytes)
+{
+  char              **items = (char **) user;
+
+  return items[index] = P4EST_ALLOC (char, bytes);
+}
+
 typedef struct test_transfer
 {
   p4est_t            *p4est;
@@ -153,6 +190,7 @@ test_transfer_post (test_transfer_t * tt, p4est_t * p4est)
   int                *src_vdata;
   int                *ti;
   char               *dest_data;
+  char              **dest_items;
   char               *src_data;
   char               *td, *cmp;
   size_t              zz;
@@ -164,6 +202,10 @@ test_transfer_post (test_transfer_t * tt, p4est_t * p4est)
   p4est_tree_t       *tree;
   p4est_quadrant_t   *quad;
   p4est_transfer_context_t *tf;
+  p4est_comm_compress_t compress;
+  p4est_transfer_iovec_t *src_iov;
+  p4est_transfer_plan_t *plan;
+  int                 k;
 
   P4EST_ASSERT (tt != NULL);
   P4EST_ASSERT (tt->p4est == p4est);
@@ -266,6 +308,92 @@ test_transfer_post (test_transfer_t * tt, p4est_t * p4est)
   }
   P4EST_ASSERT (ti - dest_vdata == (ptrdiff_t) vcountd);
 
+  /* repeat the variable transfer with compressed messages */
+  memset (&compress, 0, sizeof (compress));
+  compress.codec = P4EST_COMM_CODEC_DEFLATE;
+  memset (dest_vdata, -1, vcountd * sizeof (int));
+  p4est_transfer_custom_compressed (p4est->global_first_quadrant,
+                                    back->global_first_quadrant,
+                                    p4est->mpicomm, 1, dest_vdata,
+                                    dest_sizes, src_vdata, src_sizes,
+                                    &compress);
+  ti = dest_vdata;
+  for (li = 0; li < p4est->local_num_quadrants; ++li) {
+    for (i = 0; i < dest_sizes[li] / (int) sizeof (int); ++i) {
+      SC_CHECK_ABORT (*ti == i, "Transfer compressed mismatch");
+      ++ti;
+    }
+  }
+  P4EST_ASSERT (ti - dest_vdata == (ptrdiff_t) vcountd);
+
+  /* and once more while recording the transfer */
+  memset (dest_vdata, -1, vcountd * sizeof (int));
+  p4est_transfer_custom_ext (p4est->global_first_quadrant,
+                             back->global_first_quadrant,
+                             p4est->mpicomm, 1, dest_vdata,
+                             dest_sizes, src_vdata, src_sizes,
+                             &compress, p4est->inspect);
+  ti = dest_vdata;
+  for (li = 0; li < p4est->local_num_quadrants; ++li) {
+    for (i = 0; i < dest_sizes[li] / (int) sizeof (int); ++i) {
+      SC_CHECK_ABORT (*ti == i, "Transfer recorded mismatch");
+      ++ti;
+    }
+  }
+  P4EST_ASSERT (ti - dest_vdata == (ptrdiff_t) vcountd);
+
+  /* repeat the variable transfer without contiguous buffers */
+  src_iov = P4EST_ALLOC (p4est_transfer_iovec_t, back->local_num_quadrants);
+  for (li = 0, ti = src_vdata; li < back->local_num_quadrants; ++li) {
+    src_iov[li].base = ti;
+    src_iov[li].len = (size_t) src_sizes[li];
+    ti += src_sizes[li] / (int) sizeof (int);
+  }
+  dest_items = P4EST_ALLOC_ZERO (char *, p4est->local_num_quadrants);
+  p4est_transfer_iovec (p4est->global_first_quadrant,
+                        back->global_first_quadrant, p4est->mpicomm, 1,
+                        dest_sizes, transfer_alloc, dest_items, src_iov);
+  for (li = 0; li < p4est->local_num_quadrants; ++li) {
+    SC_CHECK_ABORT ((dest_items[li] == NULL) == (dest_sizes[li] == 0),
+                    "Transfer iovec allocation");
+    ti = (int *) dest_items[li];
+    for (i = 0; i < dest_sizes[li] / (int) sizeof (int); ++i) {
+      SC_CHECK_ABORT (ti[i] == i, "Transfer iovec mismatch");
+    }
+    P4EST_FREE (dest_items[li]);
+  }
+  P4EST_FREE (dest_items);
+  P4EST_FREE (src_iov);
+
+  /* repeat both transfers as fields of one reusable plan */
+  plan = p4est_transfer_plan_new (p4est->global_first_quadrant,
+                                  back->global_first_quadrant,
+                                  p4est->mpicomm);
+  SC_CHECK_ABORT (p4est_transfer_plan_is_valid
+                  (plan, p4est->global_first_quadrant,
+                   back->global_first_quadrant), "Transfer plan validity");
+  p4est_transfer_plan_add_fixed (plan, dest_data, src_data, data_size);
+  p4est_transfer_plan_add_custom (plan, dest_vdata, dest_sizes,
+                                  src_vdata, src_sizes);
+  for (k = 0; k < 2; ++k) {
+    memset (dest_data, -1, data_size * p4est->local_num_quadrants);
+    memset (dest_vdata, -1, vcountd * sizeof (int));
+    p4est_transfer_plan_execute (plan, 2);
+    td = dest_data;
+    ti = dest_vdata;
+    tog = p4est->global_first_quadrant[p4est->mpirank];
+    for (li = 0; li < p4est->local_num_quadrants; ++li, ++tog) {
+      SC_CHECK_ABORT (*(p4est_gloidx_t *) td == tog,
+                      "Transfer plan fixed mismatch");
+      td += data_size;
+      for (i = 0; i < dest_sizes[li] / (int) sizeof (int); ++i) {
+        SC_CHECK_ABORT (*ti == i, "Transfer plan variable mismatch");
+        ++ti;
+      }
+    }
+  }
+  p4est_transfer_plan_destroy (plan);
+
   /* cleanup memory */
   P4EST_FREE (dest_data);
   P4EST_FREE (dest_vdata);
@@ -317,6 +445,61 @@ test_checksum (p4est_t * p4est, int have_zlib)
   return have_zlib ? p4est_checksum (p4est) : 0;
 }
 
+static void
+test_partition_data (p4est_t * p4est)
+{
+  size_t              zz, offset;
+  p4est_gloidx_t      gk, *ids;
+  p4est_locidx_t      kl, num;
+  int                *sizes, k;
+  char               *bytes, *got;
+  p4est_partition_data_t data[2];
+
+  /* tag every quadrant with its global index, which is kept */
+  num = p4est->local_num_quadrants;
+  gk = p4est->global_first_quadrant[p4est->mpirank];
+  ids = P4EST_ALLOC (p4est_gloidx_t, num);
+  sizes = P4EST_ALLOC (int, num);
+  for (kl = 0, offset = 0; kl < num; ++kl) {
+    ids[kl] = gk + kl;
+    offset += (size_t) (sizes[kl] = (int) ((gk + kl) % 3));
+  }
+  bytes = P4EST_ALLOC (char, offset);
+  for (kl = 0, offset = 0; kl < num; ++kl) {
+    for (k = 0; k < sizes[kl]; ++k) {
+      bytes[offset++] = (char) ((gk + kl) % 101);
+    }
+  }
+  data[0].data_size = sizeof (p4est_gloidx_t);
+  data[0].src_data = ids;
+  data[0].src_sizes = NULL;
+  data[1].data_size = 0;
+  data[1].src_data = bytes;
+  data[1].src_sizes = sizes;
+  p4est_partition_ext_data (p4est, 0, weight_one, 2, data);
+  P4EST_FREE (ids);
+  P4EST_FREE (sizes);
+  P4EST_FREE (bytes);
+
+  /* the data must follow the quadrants into the new partition */
+  num = p4est->local_num_quadrants;
+  gk = p4est->global_first_quadrant[p4est->mpirank];
+  ids = (p4est_gloidx_t *) data[0].dest_data;
+  got = (char *) data[1].dest_data;
+  for (kl = 0, zz = 0; kl < num; ++kl) {
+    SC_CHECK_ABORT (ids[kl] == gk + kl, "partition data fixed");
+    SC_CHECK_ABORT (data[1].dest_sizes[kl] == (int) ((gk + kl) % 3),
+                    "partition data sizes");
+    for (k = 0; k < data[1].dest_sizes[kl]; ++k, ++zz) {
+      SC_CHECK_ABORT (got[zz] == (char) ((gk + kl) % 101),
+                      "partition data variable");
+    }
+  }
+  P4EST_FREE (data[0].dest_data);
+  P4EST_FREE (data[1].dest_data);
+  P4EST_FREE (data[1].dest_sizes);
+}
+
 static void
 test_partition_circle (sc_MPI_Comm mpicomm,
                        p4est_connectivity_t * connectivity,
@@ -415,6 +598,467 @@ test_partition_circle (sc_MPI_Comm mpicomm,
   p4est_destroy (p4est);
 }
 
+static void
+test_partition_targets (p4est_t * p4est)
+{
+  const int           num_procs = p4est->mpisize;
+  int                 p;
+  double              total, share;
+  double             *targets;
+
+  targets = P4EST_ALLOC (double, num_procs);
+  for (p = 0, total = 0.; p < num_procs; ++p) {
+    total += targets[p] = 1. + p % 2;
+  }
+  p4est_partition_targets (p4est, 0, NULL, targets);
+  for (p = 0; p < num_procs; ++p) {
+    share = p4est->global_num_quadrants * targets[p] / total;
+    SC_CHECK_ABORT (fabs ((double) (p4est->global_first_quadrant[p + 1] -
+                                    p4est->global_first_quadrant[p]) -
+                          share) <= 2., "partition targets share");
+  }
+  p4est_partition_targets (p4est, 1, NULL, targets);
+  P4EST_FREE (targets);
+}
+
+static int
+search_all_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+               p4est_quadrant_t * quadrant, p4est_locidx_t local_num,
+               void *point)
+{
+  return 1;
+}
+
+/* every algorithm run with an inspect structure is recorded in it */
+static void
+test_inspect_records (p4est_t * p4est)
+{
+  int                 k;
+  double              start;
+  p4est_inspect_t     inspect;
+  p4est_inspect_record_t *record;
+  p4est_ghost_t      *ghost;
+  p4est_lnodes_t     *lnodes;
+  p4est_mesh_t       *mesh;
+  const p4est_inspect_algorithm_t algorithms[6] =
+    { P4EST_INSPECT_GHOST, P4EST_INSPECT_GHOST_EXPAND, P4EST_INSPECT_LNODES,
+    P4EST_INSPECT_MESH, P4EST_INSPECT_ITERATE, P4EST_INSPECT_SEARCH
+  };
+
+  memset (&inspect, 0, sizeof (inspect));
+  p4est->inspect = &inspect;
+  p4est_partition (p4est, 0, NULL);
+  ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+  p4est_ghost_expand (p4est, ghost);
+  lnodes = p4est_lnodes_new (p4est, ghost, 1);
+  mesh = p4est_mesh_new (p4est, ghost, P4EST_CONNECT_FULL);
+#ifndef P4_TO_P8
+  p4est_iterate (p4est, ghost, NULL, NULL, NULL, NULL);
+#else
+  p8est_iterate (p4est, ghost, NULL, NULL, NULL, NULL, NULL);
+#endif
+  p4est_search_local (p4est, 0, search_all_fn, NULL, NULL);
+  p4est->inspect = NULL;
+
+  SC_CHECK_ABORT (inspect.records[P4EST_INSPECT_PARTITION].calls == 1,
+                  "partition recorded");
+  for (k = 0; k < 6; ++k) {
+    record = &inspect.records[algorithms[k]];
+    SC_CHECK_ABORTF (record->calls >= 1 && record->time >= 0.,
+                     "algorithm %d recorded", (int) algorithms[k]);
+  }
+  SC_CHECK_ABORT (inspect.records[P4EST_INSPECT_GHOST].memory > 0 &&
+                  inspect.records[P4EST_INSPECT_LNODES].memory > 0 &&
+                  inspect.records[P4EST_INSPECT_MESH].memory > 0,
+                  "created memory recorded");
+
+  /* the statistics are collective and leave the records unchanged */
+  p4est->inspect = &inspect;
+  p4est_inspect_statistics (p4est, SC_LP_DEBUG);
+  p4est->inspect = NULL;
+  SC_CHECK_ABORT (inspect.records[P4EST_INSPECT_PARTITION].calls == 1,
+                  "statistics keep records");
+
+  /* the reset clears the records, which then accumulate again */
+  p4est_inspect_reset (&inspect);
+  for (k = 0; k < P4EST_INSPECT_NUM_ALGORITHMS; ++k) {
+    record = &inspect.records[k];
+    SC_CHECK_ABORT (record->calls == 0 && record->time == 0. &&
+                    record->bytes_sent == 0 && record->memory == 0,
+                    "records reset");
+  }
+  start = p4est_inspect_start (&inspect);
+  p4est_inspect_stop (&inspect, P4EST_INSPECT_FILE, start);
+  p4est_inspect_comm (&inspect, P4EST_INSPECT_FILE, 2, 3, 30, 4, 40);
+  p4est_inspect_comm (&inspect, P4EST_INSPECT_FILE, 1, 1, 10, 1, 10);
+  p4est_inspect_memory (&inspect, P4EST_INSPECT_FILE, 100);
+  p4est_inspect_memory (&inspect, P4EST_INSPECT_FILE, 50);
+  record = &inspect.records[P4EST_INSPECT_FILE];
+  SC_CHECK_ABORT (record->calls == 1 && record->time >= 0. &&
+                  record->peers == 3 && record->messages_sent == 4 &&
+                  record->bytes_sent == 40 && record->messages_received == 5
+                  && record->bytes_received == 50 && record->memory == 100,
+                  "records accumulate");
+
+  /* without an inspect structure nothing is recorded */
+  SC_CHECK_ABORT (p4est_inspect_start (NULL) == 0., "start without inspect");
+  p4est_inspect_stop (NULL, P4EST_INSPECT_FILE, 0.);
+  p4est_inspect_comm (NULL, P4EST_INSPECT_FILE, 1, 1, 1, 1, 1);
+  p4est_inspect_memory (NULL, P4EST_INSPECT_FILE, 1);
+
+  p4est_mesh_destroy (mesh);
+  p4est_lnodes_destroy (lnodes);
+  p4est_ghost_destroy (ghost);
+}
+
+/* batched owner search agrees with the search of single quadrants, both
+ * for the sorted local quadrants and for unsorted level-one queries, and
+ * so does the search with sparse partition markers */
+static void
+test_find_owners (p4est_t * p4est)
+{
+  int                 stride;
+  int                *owners, *sparse_owners;
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  p4est_comm_sparse_t *sparse;
+  sc_array_t         *queries;
+
+  queries = sc_array_new (sizeof (p4est_quadrant_t));
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_push_copy
+        (queries, p4est_quadrant_array_index (&tree->quadrants, zz));
+      q->p.which_tree = jt;
+    }
+  }
+  owners = P4EST_ALLOC (int, queries->elem_count);
+  p4est_comm_find_owners (p4est, queries, owners);
+  for (zz = 0; zz < queries->elem_count; ++zz) {
+    SC_CHECK_ABORT (owners[zz] == p4est->mpirank, "find owners local");
+  }
+  P4EST_FREE (owners);
+
+  sc_array_truncate (queries);
+  for (jt = p4est->connectivity->num_trees - 1; jt >= 0; --jt) {
+    for (zz = 0; zz < P4EST_CHILDREN; ++zz) {
+      q = (p4est_quadrant_t *) sc_array_push (queries);
+      P4EST_QUADRANT_INIT (q);
+      p4est_quadrant_set_morton (q, 1, (uint64_t) (P4EST_CHILDREN - 1 - zz));
+      q->p.which_tree = jt;
+    }
+  }
+  owners = P4EST_ALLOC (int, queries->elem_count);
+  p4est_comm_find_owners (p4est, queries, owners);
+  for (zz = 0; zz < queries->elem_count; ++zz) {
+    q = p4est_quadrant_array_index (queries, zz);
+    SC_CHECK_ABORT (owners[zz] == p4est_comm_find_owner
+                    (p4est, q->p.which_tree, q, p4est->mpirank),
+                    "find owners unsorted");
+  }
+
+  /* sparse partition markers find the same owners */
+  sparse_owners = P4EST_ALLOC (int, queries->elem_count);
+  for (stride = 1; stride <= 3; ++stride) {
+    sparse = p4est_comm_sparse_new (p4est, stride);
+    p4est_comm_sparse_find_owners (sparse, queries, sparse_owners);
+    for (zz = 0; zz < queries->elem_count; ++zz) {
+      SC_CHECK_ABORT (sparse_owners[zz] == owners[zz], "sparse owners");
+    }
+    p4est_comm_sparse_destroy (sparse);
+  }
+  P4EST_FREE (sparse_owners);
+  P4EST_FREE (owners);
+  sc_array_destroy (queries);
+}
+
+/* refining an agglomerated forest and expanding it again gives the same
+ * forest and data as refining on all processes */
+static void
+test_agglomerate (p4est_t * p4est)
+{
+  p4est_t            *full, *coarse, *ref;
+
+  full = p4est_copy (p4est, 1);
+  ref = p4est_copy (p4est, 1);
+  coarse = p4est_agglomerate_new (full, p4est->global_num_quadrants / 2 + 1,
+                                  1);
+  SC_CHECK_ABORT ((coarse != NULL) == (p4est->mpirank < 2),
+                  "agglomerate ranks");
+  if (coarse != NULL) {
+    SC_CHECK_ABORT (coarse->global_num_quadrants ==
+                    p4est->global_num_quadrants, "agglomerate count");
+    p4est_refine (coarse, 0, refine_fn, init_fn);
+  }
+  p4est_agglomerate_expand (full, coarse, NULL);
+  p4est_refine (ref, 0, refine_fn, init_fn);
+  p4est_partition (ref, 0, NULL);
+  SC_CHECK_ABORT (p4est_is_equal (full, ref, 1), "agglomerate expand");
+
+  p4est_destroy (full);
+  p4est_destroy (ref);
+}
+
+/* the split-phase partition gives the same forest and data as the
+ * blocking one, while the forest stays readable in between */
+static void
+test_partition_split (p4est_t * p4est)
+{
+  p4est_t            *split, *ref;
+  p4est_partition_context_t *pc;
+  p4est_gloidx_t      shipped;
+
+  split = p4est_copy (p4est, 1);
+  ref = p4est_copy (p4est, 1);
+  shipped = p4est_partition_ext (ref, 1, weight_level);
+  pc = p4est_partition_begin (split, 1, weight_level);
+  SC_CHECK_ABORT (p4est_is_equal (split, p4est, 1), "partition begin");
+  SC_CHECK_ABORT (p4est_partition_end (pc) == shipped, "partition shipped");
+  SC_CHECK_ABORT (p4est_is_equal (split, ref, 1), "partition end");
+
+  /* the way back to the uniform partition */
+  shipped = p4est_partition_ext (ref, 0, NULL);
+  pc = p4est_partition_begin (split, 0, NULL);
+  SC_CHECK_ABORT (p4est_partition_end (pc) == shipped, "partition back");
+  SC_CHECK_ABORT (p4est_is_equal (split, ref, 1), "partition end back");
+
+  p4est_destroy (split);
+  p4est_destroy (ref);
+}
+
+/* an ensemble of forests partitions like each forest on its own */
+static void
+test_partition_ensemble (p4est_t * p4est)
+{
+  int                 f;
+  p4est_t            *ensemble[2], *ref[2];
+  p4est_gloidx_t      shipped;
+
+  /* the second forest starts from a different partition */
+  for (f = 0; f < 2; ++f) {
+    ensemble[f] = p4est_copy (p4est, 1);
+    ref[f] = p4est_copy (p4est, 1);
+  }
+  p4est_partition_ext (ensemble[1], 0, weight_level);
+  p4est_partition_ext (ref[1], 0, weight_level);
+
+  shipped = p4est_partition_ext (ref[0], 1, weight_level) +
+    p4est_partition_ext (ref[1], 1, weight_level);
+  SC_CHECK_ABORT (p4est_partition_ensemble (2, ensemble, 1, weight_level)
+                  == shipped, "partition ensemble shipped");
+  for (f = 0; f < 2; ++f) {
+    SC_CHECK_ABORT (p4est_is_equal (ensemble[f], ref[f], 1),
+                    "partition ensemble");
+  }
+
+  /* the uniform partition needs no communication of weights */
+  shipped = p4est_partition_ext (ref[0], 0, NULL) +
+    p4est_partition_ext (ref[1], 0, NULL);
+  SC_CHECK_ABORT (p4est_partition_ensemble (2, ensemble, 0, NULL)
+                  == shipped, "partition ensemble back");
+  for (f = 0; f < 2; ++f) {
+    SC_CHECK_ABORT (p4est_is_equal (ensemble[f], ref[f], 1),
+                    "partition ensemble uniform");
+    p4est_destroy (ensemble[f]);
+    p4est_destroy (ref[f]);
+  }
+}
+
+/* a partition for coarsening keeps every family on one process, so one
+ * round of coarsening removes as many quadrants as on a single process */
+static void
+test_partition_coarsening (p4est_t * p4est)
+{
+  int                 k;
+  p4est_locidx_t     *counts;
+  p4est_gloidx_t      coarsened;
+  p4est_t            *ref, *part;
+
+  ref = p4est_copy (p4est, 0);
+  counts = P4EST_ALLOC_ZERO (p4est_locidx_t, p4est->mpisize);
+  counts[0] = (p4est_locidx_t) p4est->global_num_quadrants;
+  p4est_partition_given (ref, counts);
+  p4est_coarsen (ref, 0, coarsen_all, NULL);
+  coarsened = ref->global_num_quadrants;
+  P4EST_FREE (counts);
+  p4est_destroy (ref);
+
+  for (k = 0; k < 2; ++k) {
+    part = p4est_copy (p4est, 0);
+    p4est_partition_ext (part, 1, k ? weight_level : NULL);
+    p4est_coarsen (part, 0, coarsen_all, NULL);
+    SC_CHECK_ABORT (part->global_num_quadrants == coarsened,
+                    "partition for coarsening");
+    p4est_destroy (part);
+  }
+}
+
+/* arrays of counts or weights partition like the weight callback */
+static void
+test_partition_weights (p4est_t * p4est)
+{
+  int                *counts;
+  int64_t            *weights;
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      kl;
+  p4est_tree_t       *tree;
+  p4est_t            *weighted, *ref;
+  p4est_gloidx_t      shipped;
+
+  weighted = p4est_copy (p4est, 1);
+  ref = p4est_copy (p4est, 1);
+  counts = P4EST_ALLOC (int, p4est->local_num_quadrants);
+  weights = P4EST_ALLOC (int64_t, SC_MAX (p4est->local_num_quadrants, 1));
+  for (kl = 0, jt = p4est->first_local_tree;
+       jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++kl) {
+      counts[kl] = (int) p4est_quadrant_array_index
+        (&tree->quadrants, zz)->level;
+      weights[kl] = 1 + counts[kl];
+    }
+  }
+  shipped = p4est_partition_ext (ref, 1, weight_level);
+  SC_CHECK_ABORT (p4est_partition_weights (weighted, 1, 1, counts) ==
+                  shipped, "partition weights shipped");
+  SC_CHECK_ABORT (p4est_is_equal (weighted, ref, 1), "partition weights");
+  P4EST_FREE (counts);
+
+  /* the same partition from 64-bit weights of the original forest */
+  p4est_destroy (weighted);
+  weighted = p4est_copy (p4est, 1);
+  SC_CHECK_ABORT (p4est_partition_weights64 (weighted, 1, weights) ==
+                  shipped, "partition weights64 shipped");
+  SC_CHECK_ABORT (p4est_is_equal (weighted, ref, 1), "partition weights64");
+  P4EST_FREE (weights);
+
+  /* without counts the partition is uniform */
+  shipped = p4est_partition_ext (ref, 0, NULL);
+  SC_CHECK_ABORT (p4est_partition_weights (weighted, 0, 1, NULL) ==
+                  shipped, "partition weights uniform");
+  SC_CHECK_ABORT (p4est_is_equal (weighted, ref, 1),
+                  "partition weights back");
+
+  p4est_destroy (weighted);
+  p4est_destroy (ref);
+}
+
+static void
+test_remap_one (p4est_t * target, p4est_t * source)
+{
+  p4est_locidx_t      lid, k;
+  p4est_topidx_t      jt;
+  size_t              zz;
+  double              volume;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, *o, *data, *overlaps;
+  p4est_remap_t      *remap;
+
+  /* the data of each source quadrant is the quadrant itself */
+  data = P4EST_ALLOC (p4est_quadrant_t, source->local_num_quadrants);
+  lid = 0;
+  for (jt = source->first_local_tree; jt <= source->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (source->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lid) {
+      data[lid] = *p4est_quadrant_array_index (&tree->quadrants, zz);
+      data[lid].p.which_tree = jt;
+    }
+  }
+
+  remap = p4est_remap_new (target, source);
+  SC_CHECK_ABORT (remap->num_local == target->local_num_quadrants,
+                  "remap count");
+  overlaps = P4EST_ALLOC (p4est_quadrant_t, remap->num_overlaps);
+  p4est_remap_gather (remap, data, overlaps, sizeof (p4est_quadrant_t));
+
+  /* the overlaps are ordered and cover each target quadrant exactly */
+  lid = 0;
+  for (jt = target->first_local_tree; jt <= target->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (target->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lid) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      volume = 0.;
+      SC_CHECK_ABORT (remap->offsets[lid] < remap->offsets[lid + 1],
+                      "remap empty");
+      for (k = remap->offsets[lid]; k < remap->offsets[lid + 1]; ++k) {
+        o = &overlaps[k];
+        SC_CHECK_ABORT (o->p.which_tree == jt &&
+                        p4est_quadrant_overlaps (o, q), "remap overlap");
+        SC_CHECK_ABORT (source->global_first_quadrant
+                        [remap->overlap_owner[k]] <= remap->overlap_index[k]
+                        && remap->overlap_index[k] < source->
+                        global_first_quadrant[remap->overlap_owner[k] + 1],
+                        "remap owner");
+        SC_CHECK_ABORT (k == remap->offsets[lid] ||
+                        remap->overlap_index[k - 1] <
+                        remap->overlap_index[k], "remap order");
+        volume += remap->overlap_fraction[k];
+      }
+      SC_CHECK_ABORT (fabs (volume - 1.) < 1e-12, "remap volume");
+    }
+  }
+
+  P4EST_FREE (overlaps);
+  P4EST_FREE (data);
+  p4est_remap_destroy (remap);
+}
+
+static void
+test_remap (p4est_t * p4est)
+{
+  p4est_t            *uniform;
+
+  /* remap between the adapted forest and a shifted uniform one */
+  uniform = p4est_new_ext (p4est->mpicomm, p4est->connectivity, 0, 3, 1,
+                           0, NULL, NULL);
+  weight_counter = 0;
+  weight_index = (int) (uniform->global_num_quadrants / 3);
+  p4est_partition (uniform, 0, weight_once);
+  test_remap_one (p4est, uniform);
+  test_remap_one (uniform, p4est);
+  test_remap_one (p4est, p4est);
+  p4est_destroy (uniform);
+}
+
+static void
+test_peer_matrix (p4est_t * p4est, p4est_inspect_t * inspect)
+{
+  const int           num_procs = p4est->mpisize;
+  int                 k, q;
+  size_t              total, *row;
+  p4est_inspect_record_t *record;
+  const p4est_inspect_algorithm_t algorithms[2] =
+    { P4EST_INSPECT_PARTITION, P4EST_INSPECT_TRANSFER };
+
+  /* every payload recorded for a peer is found in our row of the matrix */
+  SC_CHECK_ABORT (inspect->records[P4EST_INSPECT_TRANSFER].calls == 1,
+                  "transfer recorded");
+  for (k = 0; k < 2; ++k) {
+    record = &inspect->records[algorithms[k]];
+    row = inspect->peer_matrix + algorithms[k] * num_procs;
+    SC_CHECK_ABORT (row[p4est->mpirank] == 0, "no payload to ourselves");
+    for (q = 0, total = 0; q < num_procs; ++q) {
+      total += row[q];
+    }
+    SC_CHECK_ABORT (total == record->peer_bytes, "peer matrix total");
+    SC_CHECK_ABORT (record->peer_sends == 0 ||
+                    (record->peer_bytes_min <= record->peer_bytes_max &&
+                     record->peer_bytes_max <= record->peer_bytes),
+                    "peer payload range");
+  }
+  SC_CHECK_ABORT (!p4est_inspect_peers_write (p4est, P4EST_STRING
+                                              "_test_peers.txt"),
+                  "peer matrix write");
+  if (p4est->mpirank == 0) {
+    SC_CHECK_ABORT (!remove (P4EST_STRING "_test_peers.txt"),
+                    "peer matrix remove");
+  }
+}
+
 int
 main (int argc, char **argv)
 {
@@ -435,8 +1079,9 @@ main (int argc, char **argv)
   p4est_tree_t       *tree;
   user_data_t        *user_data;
   int64_t             sum;
-  unsigned            crc;
+  unsigned            crc, crc32c;
   test_transfer_t    *tt;
+  p4est_inspect_t     inspect;
 
   mpiret = sc_MPI_Init (&argc, &argv);
   SC_CHECK_MPI (mpiret);
@@ -489,6 +1134,7 @@ main (int argc, char **argv)
 
   /* Save a checksum of the original forest */
   crc = test_checksum (p4est, have_zlib);
+  crc32c = p4est_checksum_crc32c (p4est, 0);
 
   /* partition the forest */
   tt = test_transfer_pre (p4est);
@@ -499,6 +1145,8 @@ main (int argc, char **argv)
   /* Double check that we didn't loose any quads */
   SC_CHECK_ABORT (crc == test_checksum (p4est, have_zlib),
                   "bad checksum, missing a quad");
+  SC_CHECK_ABORT (crc32c == p4est_checksum_crc32c (p4est, 0),
+                  "bad CRC32C checksum, missing a quad");
 
   /* count the actual number of quadrants per proc */
   SC_CHECK_ABORT (num_quadrants_in_proc[rank]
@@ -518,6 +1166,11 @@ main (int argc, char **argv)
     }
   }
 
+  /* the data of the outgoing quadrants went back to the pool */
+  SC_CHECK_ABORT (p4est_quadrant_data_count (p4est) ==
+                  (size_t) p4est->local_num_quadrants,
+                  "partition user data released");
+
   /* do a weighted partition with uniform weights */
   tt = test_transfer_pre (p4est);
   p4est_partition (p4est, 0, weight_one);
@@ -566,6 +1219,84 @@ main (int argc, char **argv)
   SC_CHECK_ABORT (crc == test_checksum (copy, have_zlib),
                   "bad checksum after unevenly weighted partition 3");
 
+  /* balance several weights at once, also for coarsening */
+  tt = test_transfer_pre (copy);
+  p4est_partition_multi (copy, 0, 3, weights_multi, NULL);
+  test_transfer_post (tt, copy);
+  test_pertree (copy, pertree1, pertree2);
+  SC_CHECK_ABORT (crc == test_checksum (copy, have_zlib),
+                  "bad checksum after multi-weight partition");
+  p4est_partition_multi (copy, 1, 3, weights_multi, NULL);
+  SC_CHECK_ABORT (crc == test_checksum (copy, have_zlib),
+                  "bad checksum after multi-weight partition for coarsening");
+
+  /* an incremental partition is left alone once it is balanced enough */
+  tt = test_transfer_pre (copy);
+  p4est_partition_incremental (copy, 0, NULL, .03);
+  test_transfer_post (tt, copy);
+  test_pertree (copy, pertree1, pertree2);
+  SC_CHECK_ABORT (crc == test_checksum (copy, have_zlib),
+                  "bad checksum after incremental partition");
+  SC_CHECK_ABORT (p4est_partition_incremental (copy, 0, NULL, .5) == 0,
+                  "incremental partition within tolerance");
+
+  /* give the odd processes twice the share of the even ones */
+  test_partition_targets (copy);
+  SC_CHECK_ABORT (crc == test_checksum (copy, have_zlib),
+                  "bad checksum after partition with targets");
+
+  /* a tiny memory budget makes the partition send one message at a time */
+  memset (&inspect, 0, sizeof (inspect));
+  inspect.memory_budget = 1;
+  p4est_inspect_peers_enable (&inspect, copy->mpisize);
+  copy->inspect = &inspect;
+  tt = test_transfer_pre (copy);
+  p4est_partition (copy, 0, NULL);
+  test_transfer_post (tt, copy);
+  copy->inspect = NULL;
+  SC_CHECK_ABORT (crc == test_checksum (copy, have_zlib),
+                  "bad checksum after partition within memory budget");
+  SC_CHECK_ABORT (inspect.memory_current == 0 &&
+                  inspect.records[P4EST_INSPECT_PARTITION].memory_current
+                  == 0, "partition memory released");
+  test_peer_matrix (copy, &inspect);
+  p4est_inspect_peers_disable (&inspect);
+  test_inspect_records (copy);
+
+  /* the memory placement must not change the result */
+  p4est_set_memory_policy (P4EST_MEMORY_HUGEPAGES | P4EST_MEMORY_FIRST_TOUCH);
+  test_partition_targets (copy);
+  p4est_partition (copy, 0, NULL);
+  p4est_set_memory_policy (P4EST_MEMORY_DEFAULT);
+  SC_CHECK_ABORT (crc == test_checksum (copy, have_zlib),
+                  "bad checksum after partition with memory policy");
+
+  /* batched owner search */
+  test_find_owners (copy);
+
+  /* agglomeration onto few processes */
+  test_agglomerate (copy);
+
+  /* overlaps and data remapping between two forests */
+  test_remap (copy);
+
+  /* partition with the quadrant messages in flight between two calls */
+  test_partition_split (copy);
+
+  /* several forests partitioned with shared collectives */
+  test_partition_ensemble (copy);
+
+  /* weights given by an array of counts */
+  test_partition_weights (copy);
+
+  /* families are not split by the corrected cuts */
+  test_partition_coarsening (copy);
+
+  /* move user data in the same epoch as the quadrants */
+  test_partition_data (copy);
+  SC_CHECK_ABORT (crc == test_checksum (copy, have_zlib),
+                  "bad checksum after partition with data");
+
   /* check user data content */
   for (t = copy->first_local_tree; t <= copy->last_local_tree; ++t) {
     tree = p4est_tree_array_index (copy->trees, t);
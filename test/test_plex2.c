@@ -165,6 +165,40 @@ refine_tree_one_fn (p4est_t * p4est, p4est_topidx_t which_tree,
   return !!which_tree;
 }
 
+/* recreate the plex data with a prebuilt ghost layer and lnodes */
+static void
+test_reuse_lnodes (p4est_t * p4est, int overlap, sc_array_t * cones,
+                   sc_array_t * coords)
+{
+  int                 pass;
+  sc_array_t         *arrays[10];
+  p4est_locidx_t      first_local_quad;
+  p4est_ghost_t      *ghost = NULL;
+  p4est_lnodes_t     *lnodes = NULL;
+  size_t              zz;
+
+  for (pass = 0; pass < 2; ++pass) {
+    for (zz = 0; zz < 10; ++zz) {
+      arrays[zz] = sc_array_new (zz == 4 ? 3 * sizeof (double) :
+                                 zz == 9 ? 2 * sizeof (p4est_locidx_t) :
+                                 sizeof (p4est_locidx_t));
+    }
+    /* the second pass reuses the ghost layer and lnodes of the first */
+    p4est_get_plex_data_ext (p4est, &ghost, &lnodes, P4EST_CONNECT_FULL,
+                             overlap, &first_local_quad, arrays[0],
+                             arrays[1], arrays[2], arrays[3], arrays[4],
+                             arrays[5], arrays[6], arrays[7], arrays[8],
+                             arrays[9], 0);
+    SC_CHECK_ABORT (sc_array_is_equal (arrays[2], cones) &&
+                    sc_array_is_equal (arrays[4], coords), "Plex reuse");
+    for (zz = 0; zz < 10; ++zz) {
+      sc_array_destroy (arrays[zz]);
+    }
+  }
+  p4est_lnodes_destroy (lnodes);
+  p4est_ghost_destroy (ghost);
+}
+
 static int
 test_forest (int argc, char **argv, p4est_t * p4est, int overlap)
 {
@@ -198,6 +232,7 @@ test_forest (int argc, char **argv, p4est_t * p4est, int overlap)
                        &first_local_quad, points_per_dim, cone_sizes, cones,
                        cone_orientations, coords, children, parents, childids,
                        leaves, remotes);
+  test_reuse_lnodes (p4est, (mpisize > 1) ? overlap : 0, cones, coords);
 
 #ifdef P4EST_WITH_PETSC
   {
@@ -24,6 +24,7 @@
 
 #include <p4est_algorithms.h>
 #include <p4est_bits.h>
+#include <p4est_bits_inline.h>
 #include <p4est_extended.h>
 
 static int
@@ -118,6 +119,130 @@ check_linear_id (const p4est_quadrant_t * q1, const p4est_quadrant_t * q2)
   }
 }
 
+/* the header-only kernels must agree with the library functions */
+static void
+check_inline (const p4est_quadrant_t * q, const p4est_quadrant_t * r)
+{
+  int                 i, level;
+  p4est_quadrant_t    a, b;
+
+  SC_CHECK_ABORT (p4est_quadrant_compare_inline (q, r) ==
+                  p4est_quadrant_compare (q, r), "compare_inline");
+  SC_CHECK_ABORT (p4est_quadrant_is_equal_inline (q, r) ==
+                  p4est_quadrant_is_equal (q, r), "is_equal_inline");
+  SC_CHECK_ABORT (p4est_quadrant_overlaps_inline (q, r) ==
+                  p4est_quadrant_overlaps (q, r), "overlaps_inline");
+  SC_CHECK_ABORT (p4est_quadrant_is_ancestor_inline (q, r) ==
+                  p4est_quadrant_is_ancestor (q, r), "is_ancestor_inline");
+  SC_CHECK_ABORT (p4est_quadrant_is_parent_inline (q, r) ==
+                  p4est_quadrant_is_parent (q, r), "is_parent_inline");
+  SC_CHECK_ABORT (p4est_quadrant_child_id_inline (r) ==
+                  p4est_quadrant_child_id (r), "child_id_inline");
+  SC_CHECK_ABORT (p4est_quadrant_is_inside_root_inline (r) ==
+                  p4est_quadrant_is_inside_root (r), "inside_root_inline");
+  level = SC_MIN ((int) r->level, P4EST_OLD_QMAXLEVEL);
+  SC_CHECK_ABORT (p4est_quadrant_linear_id_inline (r, level) ==
+                  p4est_quadrant_linear_id (r, level), "linear_id_inline");
+  p4est_quadrant_set_morton_inline (&a, level,
+                                    p4est_quadrant_linear_id (r, level));
+  p4est_quadrant_set_morton (&b, level, p4est_quadrant_linear_id (r, level));
+  SC_CHECK_ABORT (p4est_quadrant_is_equal (&a, &b), "set_morton_inline");
+  if (r->level > 0) {
+    p4est_quadrant_parent_inline (r, &a);
+    p4est_quadrant_parent (r, &b);
+    SC_CHECK_ABORT (p4est_quadrant_is_equal (&a, &b), "parent_inline");
+    for (i = 0; i < P4EST_CHILDREN; ++i) {
+      p4est_quadrant_sibling_inline (r, &a, i);
+      p4est_quadrant_sibling (r, &b, i);
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (&a, &b), "sibling_inline");
+    }
+  }
+  if (r->level < P4EST_QMAXLEVEL) {
+    for (i = 0; i < P4EST_CHILDREN; ++i) {
+      p4est_quadrant_child_inline (r, &a, i);
+      p4est_quadrant_child (r, &b, i);
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (&a, &b), "child_inline");
+    }
+    p4est_quadrant_first_descendant_inline (r, &a, P4EST_QMAXLEVEL);
+    p4est_quadrant_first_descendant (r, &b, P4EST_QMAXLEVEL);
+    SC_CHECK_ABORT (p4est_quadrant_is_equal (&a, &b), "first_desc_inline");
+    p4est_quadrant_last_descendant_inline (r, &a, P4EST_QMAXLEVEL);
+    p4est_quadrant_last_descendant (r, &b, P4EST_QMAXLEVEL);
+    SC_CHECK_ABORT (p4est_quadrant_is_equal (&a, &b), "last_desc_inline");
+  }
+  if (p4est_quadrant_is_valid (r)) {
+    for (i = 0; i < P4EST_FACES; ++i) {
+      p4est_quadrant_face_neighbor_inline (r, i, &a);
+      p4est_quadrant_face_neighbor (r, i, &b);
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (&a, &b), "face_inline");
+    }
+  }
+}
+
+static void
+check_batch (const p4est_quadrant_t * q, const p4est_quadrant_t * r,
+             size_t n)
+{
+  int                 comp, level;
+  size_t              iz;
+  int8_t             *result;
+  uint64_t           *id;
+  p4est_lid_t        *lid, tlid;
+  p4est_quadrant_t   *s, t;
+
+  result = P4EST_ALLOC (int8_t, n);
+  id = P4EST_ALLOC (uint64_t, n);
+  lid = P4EST_ALLOC (p4est_lid_t, n);
+  s = P4EST_ALLOC (p4est_quadrant_t, n);
+
+  p4est_quadrant_compare_batch (q, r, n, result);
+  for (iz = 0; iz < n; ++iz) {
+    check_inline (q, &r[iz]);
+    comp = p4est_quadrant_compare (q, &r[iz]);
+    SC_CHECK_ABORT (result[iz] == SC_MIN (1, SC_MAX (-1, comp)),
+                    "compare_batch");
+  }
+  p4est_quadrant_is_ancestor_batch (q, r, n, result);
+  for (iz = 0; iz < n; ++iz) {
+    SC_CHECK_ABORT (result[iz] == p4est_quadrant_is_ancestor (q, &r[iz]),
+                    "is_ancestor_batch");
+  }
+  p4est_quadrant_overlaps_batch (q, r, n, result);
+  for (iz = 0; iz < n; ++iz) {
+    SC_CHECK_ABORT (result[iz] == p4est_quadrant_overlaps (q, &r[iz]),
+                    "overlaps_batch");
+  }
+  level = SC_MIN ((int) q->level, P4EST_OLD_QMAXLEVEL);
+  p4est_quadrant_linear_id_batch (r, n, level, id);
+  for (iz = 0; iz < n; ++iz) {
+    SC_CHECK_ABORT (id[iz] == p4est_quadrant_linear_id (&r[iz], level),
+                    "linear_id_batch");
+  }
+  p4est_quadrant_set_morton_batch (s, n, level, id);
+  for (iz = 0; iz < n; ++iz) {
+    p4est_quadrant_set_morton (&t, level, id[iz]);
+    SC_CHECK_ABORT (p4est_quadrant_is_equal (&s[iz], &t),
+                    "set_morton_batch");
+  }
+  p4est_quadrant_linear_id_ext128_batch (r, n, q->level, lid);
+  for (iz = 0; iz < n; ++iz) {
+    p4est_quadrant_linear_id_ext128 (&r[iz], q->level, &tlid);
+    SC_CHECK_ABORT (p4est_lid_is_equal (&lid[iz], &tlid),
+                    "linear_id_ext128_batch");
+  }
+  p4est_quadrant_set_morton_ext128_batch (s, n, q->level, lid);
+  for (iz = 0; iz < n; ++iz) {
+    p4est_quadrant_set_morton_ext128 (&t, q->level, &lid[iz]);
+    SC_CHECK_ABORT (p4est_quadrant_is_equal (&s[iz], &t),
+                    "set_morton_ext128_batch");
+  }
+
+  P4EST_FREE (result);
+  P4EST_FREE (id);
+  P4EST_FREE (lid);
+  P4EST_FREE (s);
+}
+
 static void
 check_successor_predecessor (const p4est_quadrant_t * q)
 {
@@ -148,8 +273,108 @@ check_predecessor_successor (const p4est_quadrant_t * q)
   SC_CHECK_ABORT (p4est_quadrant_is_equal (&temp2, q), "successor");
 }
 
+static              p4est_qcoord_t
+hilbert_abs (p4est_qcoord_t d)
+{
+  return d < 0 ? -d : d;
+}
+
+static void
+check_hilbert (int level)
+{
+  uint64_t            id, num_ids;
+  p4est_qcoord_t      dist;
+  p4est_quadrant_t    q, prev, temp;
+
+  num_ids = (uint64_t) 1 << P4EST_DIM * level;
+  for (id = 0; id < num_ids; ++id) {
+    p4est_quadrant_set_hilbert (&q, level, id);
+    SC_CHECK_ABORT (p4est_quadrant_is_valid (&q) &&
+                    p4est_quadrant_hilbert_id (&q, level) == id,
+                    "set_hilbert/hilbert_id");
+    SC_CHECK_ABORT (p4est_quadrant_hilbert_id (&q, level - 1) ==
+                    id >> P4EST_DIM, "hilbert_id ancestor");
+    if (id > 0) {
+      /* consecutive quadrants along the curve share a face */
+      dist = hilbert_abs (q.x - prev.x) + hilbert_abs (q.y - prev.y)
+#ifdef P4_TO_P8
+        + hilbert_abs (q.z - prev.z)
+#endif
+        ;
+      SC_CHECK_ABORT (dist == P4EST_QUADRANT_LEN (level), "hilbert face");
+      SC_CHECK_ABORT (p4est_quadrant_compare_hilbert (&prev, &q) < 0,
+                      "compare_hilbert");
+      p4est_quadrant_hilbert_successor (&prev, &temp);
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (&temp, &q),
+                      "hilbert_successor");
+      p4est_quadrant_hilbert_predecessor (&q, &temp);
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (&temp, &prev),
+                      "hilbert_predecessor");
+    }
+    prev = q;
+  }
+}
+
 #define NEG_ONE_MAXL (~((((p4est_qcoord_t) 1) << P4EST_MAXLEVEL) - 1))
 #define NEG_ONE_MAXLM1 (~((((p4est_qcoord_t) 1) << (P4EST_MAXLEVEL - 1)) - 1))
+static void
+check_complete_region (p4est_t * p4est, const p4est_quadrant_t * q1,
+                       const p4est_quadrant_t * q2)
+{
+  int                 include, k;
+  size_t              iz, count, first;
+  p4est_locidx_t      sum;
+  p4est_tree_t        tree;
+  p4est_quadrant_t   *q, *r, parent;
+
+  count = 0;
+  for (include = 1; include >= 0; --include) {
+    sc_array_init (&tree.quadrants, sizeof (p4est_quadrant_t));
+    for (k = 0; k <= P4EST_MAXLEVEL; ++k) {
+      tree.quadrants_per_level[k] = 0;
+    }
+    p4est_complete_region (p4est, q1, include, q2, include, &tree, 0, NULL);
+    SC_CHECK_ABORT (p4est_tree_is_complete (&tree), "complete region");
+    if (include) {
+      count = tree.quadrants.elem_count;
+      SC_CHECK_ABORT (count >= 2, "region endpoints");
+      q = p4est_quadrant_array_index (&tree.quadrants, 0);
+      r = p4est_quadrant_array_index (&tree.quadrants, count - 1);
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (q, q1) &&
+                      p4est_quadrant_is_equal (r, q2), "region endpoints");
+    }
+    else {
+      SC_CHECK_ABORT (tree.quadrants.elem_count + 2 == count,
+                      "region without endpoints");
+    }
+
+    /* the region has no holes and no family that could be coarsened */
+    first = include ? 1 : 0;
+    sum = 0;
+    for (iz = 0; iz < tree.quadrants.elem_count; ++iz) {
+      q = p4est_quadrant_array_index (&tree.quadrants, iz);
+      if (iz > 0) {
+        SC_CHECK_ABORT (p4est_quadrant_is_next (r, q), "region is_next");
+      }
+      if (iz >= first && iz + first < tree.quadrants.elem_count) {
+        p4est_quadrant_parent (q, &parent);
+        SC_CHECK_ABORT (p4est_quadrant_is_ancestor (&parent, q1) ||
+                        p4est_quadrant_is_ancestor (&parent, q2),
+                        "region is minimal");
+      }
+      r = q;
+    }
+    for (k = 0; k <= P4EST_MAXLEVEL; ++k) {
+      SC_CHECK_ABORT (k <= tree.maxlevel || tree.quadrants_per_level[k] == 0,
+                      "region maxlevel");
+      sum += tree.quadrants_per_level[k];
+    }
+    SC_CHECK_ABORT ((size_t) sum == tree.quadrants.elem_count,
+                    "region level count");
+    sc_array_reset (&tree.quadrants);
+  }
+}
+
 #define NEG_ONE_MAXLP1 \
   (NEG_ONE_MAXL & ~(((p4est_qcoord_t) 1) << P4EST_MAXLEVEL))
 
@@ -173,6 +398,7 @@ main (int argc, char **argv)
   p4est_quadrant_t    c0, c1, c2, c3;
   p4est_quadrant_t    cv[P4EST_CHILDREN], *cp[P4EST_CHILDREN];
   p4est_quadrant_t    A, B, C, D, E, F, G, H, I, P, Q;
+  p4est_quadrant_t    batch[8];
   p4est_quadrant_t    a, f, g, h;
   uint64_t            Aid, Fid;
 
@@ -200,6 +426,10 @@ main (int argc, char **argv)
   for (iz = 0; iz < t1->quadrants.elem_count; ++iz) {
     q1 = p4est_quadrant_array_index (&t1->quadrants, iz);
 
+    /* test the batch functions against the scalar ones */
+    check_batch (q1, p4est_quadrant_array_index (&t2->quadrants, 0),
+                 t2->quadrants.elem_count);
+
     /* test the index conversion */
     index1 = p4est_quadrant_linear_id (q1, (int) q1->level);
     p4est_quadrant_set_morton (&r, (int) q1->level, index1);
@@ -440,6 +670,21 @@ main (int argc, char **argv)
 
   sc_array_reset (&tree.quadrants);
 
+  /* the completion between two quadrants is linear and minimal */
+  for (iz = 0; iz + 1 < t2->quadrants.elem_count; iz += 7) {
+    jz = SC_MIN (t2->quadrants.elem_count - 1, 3 * iz + 1);
+    check_complete_region (p4est1,
+                           p4est_quadrant_array_index (&t2->quadrants, iz),
+                           p4est_quadrant_array_index (&t2->quadrants, jz));
+  }
+  p4est_quadrant_set_morton (&A, 1, 0);
+  p4est_quadrant_last_descendant (&A, &B, P4EST_QMAXLEVEL);
+  p4est_quadrant_set_morton (&C, 1, P4EST_CHILDREN - 1);
+  p4est_quadrant_first_descendant (&C, &D, P4EST_QMAXLEVEL);
+  check_complete_region (p4est1, &B, &D);
+  check_complete_region (p4est1, &A, &D);
+  check_complete_region (p4est1, &B, &C);
+
   /* destroy the p4est and its connectivity structure */
   p4est_destroy (p4est1);
   p4est_destroy (p4est2);
@@ -499,6 +744,18 @@ main (int argc, char **argv)
   I.y = NEG_ONE_MAXLM1;
   I.level = 1;
 
+  batch[0] = A;
+  batch[1] = B;
+  batch[2] = C;
+  batch[3] = D;
+  batch[4] = F;
+  batch[5] = G;
+  batch[6] = H;
+  batch[7] = I;
+  for (k = 0; k < 8; ++k) {
+    check_batch (&batch[k], batch, 8);
+  }
+
   check_linear_id (&A, &A);
   check_linear_id (&A, &B);
   check_linear_id (&A, &C);
@@ -662,6 +919,10 @@ main (int argc, char **argv)
   check_predecessor_successor (&F);
   check_predecessor_successor (&G);
 
+  for (k = 1; k <= 3; ++k) {
+    check_hilbert (k);
+  }
+
   for (k = 0; k < 16; ++k) {
     if (k != 4 && k != 6 && k != 8 && k != 9 && k != 12 && k != 13 && k != 14) {
       p4est_quadrant_set_morton (&E, 0, (uint64_t) k);
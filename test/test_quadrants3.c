@@ -24,6 +24,7 @@
 
 #include <p8est_algorithms.h>
 #include <p8est_bits.h>
+#include <p8est_bits_inline.h>
 #include <p8est_extended.h>
 #include <p4est_to_p8est.h>
 
@@ -126,6 +127,176 @@ check_linear_id (const p4est_quadrant_t * q1, const p4est_quadrant_t * q2)
   }
 }
 
+/* the header-only kernels must agree with the library functions */
+static void
+check_inline (const p4est_quadrant_t * q, const p4est_quadrant_t * r)
+{
+  int                 i, level;
+  p4est_quadrant_t    a, b;
+
+  SC_CHECK_ABORT (p4est_quadrant_compare_inline (q, r) ==
+                  p4est_quadrant_compare (q, r), "compare_inline");
+  SC_CHECK_ABORT (p4est_quadrant_is_equal_inline (q, r) ==
+                  p4est_quadrant_is_equal (q, r), "is_equal_inline");
+  SC_CHECK_ABORT (p4est_quadrant_overlaps_inline (q, r) ==
+                  p4est_quadrant_overlaps (q, r), "overlaps_inline");
+  SC_CHECK_ABORT (p4est_quadrant_is_ancestor_inline (q, r) ==
+                  p4est_quadrant_is_ancestor (q, r), "is_ancestor_inline");
+  SC_CHECK_ABORT (p4est_quadrant_is_parent_inline (q, r) ==
+                  p4est_quadrant_is_parent (q, r), "is_parent_inline");
+  SC_CHECK_ABORT (p4est_quadrant_child_id_inline (r) ==
+                  p4est_quadrant_child_id (r), "child_id_inline");
+  SC_CHECK_ABORT (p4est_quadrant_is_inside_root_inline (r) ==
+                  p4est_quadrant_is_inside_root (r), "inside_root_inline");
+  level = SC_MIN ((int) r->level, P4EST_OLD_QMAXLEVEL);
+  SC_CHECK_ABORT (p4est_quadrant_linear_id_inline (r, level) ==
+                  p4est_quadrant_linear_id (r, level), "linear_id_inline");
+  p4est_quadrant_set_morton_inline (&a, level,
+                                    p4est_quadrant_linear_id (r, level));
+  p4est_quadrant_set_morton (&b, level, p4est_quadrant_linear_id (r, level));
+  SC_CHECK_ABORT (p4est_quadrant_is_equal (&a, &b), "set_morton_inline");
+  if (r->level > 0) {
+    p4est_quadrant_parent_inline (r, &a);
+    p4est_quadrant_parent (r, &b);
+    SC_CHECK_ABORT (p4est_quadrant_is_equal (&a, &b), "parent_inline");
+    for (i = 0; i < P4EST_CHILDREN; ++i) {
+      p4est_quadrant_sibling_inline (r, &a, i);
+      p4est_quadrant_sibling (r, &b, i);
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (&a, &b), "sibling_inline");
+    }
+  }
+  if (r->level < P4EST_QMAXLEVEL) {
+    for (i = 0; i < P4EST_CHILDREN; ++i) {
+      p4est_quadrant_child_inline (r, &a, i);
+      p4est_quadrant_child (r, &b, i);
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (&a, &b), "child_inline");
+    }
+    p4est_quadrant_first_descendant_inline (r, &a, P4EST_QMAXLEVEL);
+    p4est_quadrant_first_descendant (r, &b, P4EST_QMAXLEVEL);
+    SC_CHECK_ABORT (p4est_quadrant_is_equal (&a, &b), "first_desc_inline");
+    p4est_quadrant_last_descendant_inline (r, &a, P4EST_QMAXLEVEL);
+    p4est_quadrant_last_descendant (r, &b, P4EST_QMAXLEVEL);
+    SC_CHECK_ABORT (p4est_quadrant_is_equal (&a, &b), "last_desc_inline");
+  }
+  if (p4est_quadrant_is_valid (r)) {
+    for (i = 0; i < P4EST_FACES; ++i) {
+      p4est_quadrant_face_neighbor_inline (r, i, &a);
+      p4est_quadrant_face_neighbor (r, i, &b);
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (&a, &b), "face_inline");
+    }
+  }
+}
+
+static void
+check_batch (const p4est_quadrant_t * q, const p4est_quadrant_t * r,
+             size_t n)
+{
+  int                 comp, level;
+  size_t              iz;
+  int8_t             *result;
+  uint64_t           *id;
+  p4est_lid_t        *lid, tlid;
+  p4est_quadrant_t   *s, t;
+
+  result = P4EST_ALLOC (int8_t, n);
+  id = P4EST_ALLOC (uint64_t, n);
+  lid = P4EST_ALLOC (p4est_lid_t, n);
+  s = P4EST_ALLOC (p4est_quadrant_t, n);
+
+  p4est_quadrant_compare_batch (q, r, n, result);
+  for (iz = 0; iz < n; ++iz) {
+    check_inline (q, &r[iz]);
+    comp = p4est_quadrant_compare (q, &r[iz]);
+    SC_CHECK_ABORT (result[iz] == SC_MIN (1, SC_MAX (-1, comp)),
+                    "compare_batch");
+  }
+  p4est_quadrant_is_ancestor_batch (q, r, n, result);
+  for (iz = 0; iz < n; ++iz) {
+    SC_CHECK_ABORT (result[iz] == p4est_quadrant_is_ancestor (q, &r[iz]),
+                    "is_ancestor_batch");
+  }
+  p4est_quadrant_overlaps_batch (q, r, n, result);
+  for (iz = 0; iz < n; ++iz) {
+    SC_CHECK_ABORT (result[iz] == p4est_quadrant_overlaps (q, &r[iz]),
+                    "overlaps_batch");
+  }
+  level = SC_MIN ((int) q->level, P4EST_OLD_QMAXLEVEL);
+  p4est_quadrant_linear_id_batch (r, n, level, id);
+  for (iz = 0; iz < n; ++iz) {
+    SC_CHECK_ABORT (id[iz] == p4est_quadrant_linear_id (&r[iz], level),
+                    "linear_id_batch");
+  }
+  p4est_quadrant_set_morton_batch (s, n, level, id);
+  for (iz = 0; iz < n; ++iz) {
+    p4est_quadrant_set_morton (&t, level, id[iz]);
+    SC_CHECK_ABORT (p4est_quadrant_is_equal (&s[iz], &t),
+                    "set_morton_batch");
+  }
+  p4est_quadrant_linear_id_ext128_batch (r, n, q->level, lid);
+  for (iz = 0; iz < n; ++iz) {
+    p4est_quadrant_linear_id_ext128 (&r[iz], q->level, &tlid);
+    SC_CHECK_ABORT (p4est_lid_is_equal (&lid[iz], &tlid),
+                    "linear_id_ext128_batch");
+  }
+  p4est_quadrant_set_morton_ext128_batch (s, n, q->level, lid);
+  for (iz = 0; iz < n; ++iz) {
+    p4est_quadrant_set_morton_ext128 (&t, q->level, &lid[iz]);
+    SC_CHECK_ABORT (p4est_quadrant_is_equal (&s[iz], &t),
+                    "set_morton_ext128_batch");
+  }
+
+  P4EST_FREE (result);
+  P4EST_FREE (id);
+  P4EST_FREE (lid);
+  P4EST_FREE (s);
+}
+
+#ifdef P8EST_LID_NATIVE
+
+/* the native 128 bit arithmetic must agree with the libsc struct code */
+static void
+check_lid_native (void)
+{
+  int                 i, k;
+  unsigned            shifts[] = { 0, 1, 63, 64, 65, 127, 128 };
+  uint64_t            seed = 1;
+  p4est_lid_t         a, b, r, t;
+
+  for (i = 0; i < 64; ++i) {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    p4est_lid_init (&a, seed >> (i % 64), seed);
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    p4est_lid_init (&b, seed >> (i % 32), ~seed);
+    if (p4est_lid_compare (&a, &b) < 0) {
+      r = a;
+      a = b;
+      b = r;
+    }
+    SC_CHECK_ABORT (p4est_lid_compare (&a, &b) == sc_uint128_compare (&a, &b),
+                    "lid native compare");
+    p4est_lid_add (&a, &b, &r);
+    sc_uint128_add (&a, &b, &t);
+    SC_CHECK_ABORT (sc_uint128_is_equal (&r, &t), "lid native add");
+    p4est_lid_sub (&a, &b, &r);
+    sc_uint128_sub (&a, &b, &t);
+    SC_CHECK_ABORT (sc_uint128_is_equal (&r, &t), "lid native sub");
+    r = a;
+    p4est_lid_add_inplace (&r, &b);
+    p4est_lid_sub_inplace (&r, &b);
+    SC_CHECK_ABORT (sc_uint128_is_equal (&r, &a), "lid native inplace");
+    for (k = 0; k < (int) (sizeof (shifts) / sizeof (shifts[0])); ++k) {
+      p4est_lid_shift_left (&a, shifts[k], &r);
+      sc_uint128_shift_left (&a, shifts[k], &t);
+      SC_CHECK_ABORT (sc_uint128_is_equal (&r, &t), "lid native left");
+      p4est_lid_shift_right (&a, shifts[k], &r);
+      sc_uint128_shift_right (&a, shifts[k], &t);
+      SC_CHECK_ABORT (sc_uint128_is_equal (&r, &t), "lid native right");
+    }
+  }
+}
+
+#endif
+
 static void
 check_successor_predecessor (const p4est_quadrant_t * q)
 {
@@ -185,6 +356,7 @@ main (int argc, char **argv)
   p4est_quadrant_t    c0, c1, c2, c3, c4, c5, c6, c7;
   p4est_quadrant_t    cv[P4EST_CHILDREN], *cp[P4EST_CHILDREN];
   p4est_quadrant_t    A, B, C, D, E, F, G, H, I, P, Q, R, S;
+  p4est_quadrant_t    batch[8];
   p4est_quadrant_t    a, f, g, h;
   uint64_t            Aid;
   p4est_lid_t         Fid;
@@ -219,6 +391,10 @@ main (int argc, char **argv)
   for (iz = 0; iz < t1->quadrants.elem_count; ++iz) {
     q1 = p4est_quadrant_array_index (&t1->quadrants, iz);
 
+    /* test the batch functions against the scalar ones */
+    check_batch (q1, p4est_quadrant_array_index (&t2->quadrants, 0),
+                 t2->quadrants.elem_count);
+
     /* test the index conversion */
     index1 = p4est_quadrant_linear_id (q1, (int) q1->level);
     p4est_quadrant_set_morton (&r, (int) q1->level, index1);
@@ -573,6 +749,18 @@ main (int argc, char **argv)
   SC_CHECK_ABORT (p4est_quadrant_compare (&B, &G) < 0, "Comp 6");
   SC_CHECK_ABORT (p4est_quadrant_compare (&G, &G) == 0, "Comp 7");
 
+  batch[0] = A;
+  batch[1] = B;
+  batch[2] = C;
+  batch[3] = D;
+  batch[4] = F;
+  batch[5] = G;
+  batch[6] = H;
+  batch[7] = I;
+  for (k = 0; k < 8; ++k) {
+    check_batch (&batch[k], batch, 8);
+  }
+
   check_linear_id (&A, &A);
   check_linear_id (&A, &B);
   check_linear_id (&A, &C);
@@ -727,6 +915,9 @@ main (int argc, char **argv)
   SC_CHECK_ABORT (Aid == 27, "linear_id");
   SC_CHECK_ABORT (p4est_quadrant_is_equal (&A, &a), "set_morton/linear_id");
 
+#ifdef P8EST_LID_NATIVE
+  check_lid_native ();
+#endif
   check_successor_predecessor (&F);
   check_predecessor_successor (&F);
   check_predecessor_successor (&G);
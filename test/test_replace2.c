@@ -27,12 +27,14 @@
 #include <p4est_bits.h>
 #include <p4est_extended.h>
 #include <p4est_communication.h>
+#include <p4est_iterate.h>
 #include <p4est_vtk.h>
 #else
 #include <p8est_algorithms.h>
 #include <p8est_bits.h>
 #include <p8est_extended.h>
 #include <p8est_communication.h>
+#include <p8est_iterate.h>
 #include <p8est_vtk.h>
 #endif
 
@@ -116,12 +118,262 @@ replace_fn (p4est_t * p4est, p4est_topidx_t which_tree,
                   "_replace_t incoming and outgoing don't align");
 }
 
+static void
+init_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+         p4est_quadrant_t * quadrant)
+{
+  *(p4est_topidx_t *) quadrant->p.user_data = which_tree;
+}
+
+/* verify the data set by init_fn and, if requested, its location */
+static void
+check_data (p4est_t * p4est, int contiguous)
+{
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      lid;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+
+  SC_CHECK_ABORT (p4est->data_contiguous == contiguous, "Data mode");
+  lid = 0;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lid) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      SC_CHECK_ABORT (*(p4est_topidx_t *) q->p.user_data == jt, "Data value");
+      if (contiguous) {
+        SC_CHECK_ABORT ((char *) q->p.user_data ==
+                        p4est->data_array + lid * p4est->data_size,
+                        "Data location");
+      }
+    }
+  }
+  SC_CHECK_ABORT (!contiguous ||
+                  p4est->data_array_used == p4est->local_num_quadrants,
+                  "Data array count");
+  SC_CHECK_ABORT (p4est_quadrant_data_count (p4est) ==
+                  (size_t) p4est->local_num_quadrants, "Data count");
+}
+
+/* refine, coarsen, balance and partition a new forest using a number of
+ * threads and optionally keeping the user data contiguous */
+static unsigned
+adapt_forest (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
+              int num_threads, int contiguous)
+{
+  unsigned            crc;
+  p4est_t            *p4est, *copy;
+
+  p4est_set_num_threads (num_threads);
+  p4est = p4est_new_ext (mpicomm, connectivity, 15, 0, 0,
+                         sizeof (p4est_topidx_t), init_fn, NULL);
+  p4est_set_data_contiguous (p4est, contiguous);
+  check_data (p4est, contiguous);
+  p4est_refine_ext (p4est, 1, P4EST_QMAXLEVEL, refine_fn, init_fn,
+                    replace_fn);
+  check_data (p4est, contiguous);
+  p4est_coarsen_ext (p4est, 1, 0, coarsen_fn, init_fn, replace_fn);
+  check_data (p4est, contiguous);
+  p4est_balance_ext (p4est, P4EST_CONNECT_FULL, init_fn, replace_fn);
+  check_data (p4est, contiguous);
+  p4est_partition (p4est, 0, NULL);
+  check_data (p4est, contiguous);
+  crc = p4est_checksum (p4est);
+
+  /* the copy keeps the data mode, which can be switched back */
+  copy = p4est_copy (p4est, 1);
+  check_data (copy, contiguous);
+  p4est_set_data_contiguous (copy, 0);
+  check_data (copy, 0);
+  p4est_refine (copy, 0, refine_fn, init_fn);
+  check_data (copy, 0);
+  p4est_destroy (copy);
+
+  p4est_destroy (p4est);
+  p4est_set_num_threads (1);
+
+  return crc;
+}
+
+/* a uniform forest made by threads equals the serial one; the level
+ * is chosen large enough for the trees to be split among the threads */
+static void
+test_new_threads (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity)
+{
+  const int           level = refine_level + 2;
+  p4est_t            *p4est, *ref;
+
+  ref = p4est_new_ext (mpicomm, connectivity, 0, level, 1,
+                       sizeof (p4est_topidx_t), init_fn, NULL);
+  p4est_set_num_threads (4);
+  p4est = p4est_new_ext (mpicomm, connectivity, 0, level, 1,
+                         sizeof (p4est_topidx_t), init_fn, NULL);
+  p4est_set_num_threads (1);
+  check_data (p4est, 0);
+  SC_CHECK_ABORT (p4est_is_valid (p4est), "New threads valid");
+  SC_CHECK_ABORT (p4est_is_equal (p4est, ref, 1), "New threads");
+
+  p4est_destroy (ref);
+  p4est_destroy (p4est);
+}
+
+static void
+realloc_volume (p4est_iter_volume_info_t * info, void *user_data)
+{
+  p4est_quadrant_free_data (info->p4est, info->quad);
+  p4est_quadrant_init_data (info->p4est, info->treeid, info->quad, init_fn);
+}
+
+/* the callbacks of a threaded iteration may replace the quadrant data */
+static void
+test_data_threads (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity)
+{
+  int                 i;
+  p4est_t            *p4est;
+
+  p4est = p4est_new_ext (mpicomm, connectivity, 0, refine_level, 1,
+                         sizeof (p4est_topidx_t), init_fn, NULL);
+  p4est_set_num_threads (4);
+  for (i = 0; i < 2; ++i) {
+    p4est_iterate_threads (p4est, NULL, NULL, realloc_volume, NULL,
+#ifdef P4_TO_P8
+                           NULL,
+#endif
+                           NULL, 0, 0, 0);
+    check_data (p4est, 0);
+  }
+  p4est_set_num_threads (1);
+
+  /* the cached entries go back to the pool */
+  p4est_quadrant_data_cache_flush (p4est);
+  SC_CHECK_ABORT (p4est->data_cache == NULL, "Data cache flush");
+  check_data (p4est, 0);
+  p4est_destroy (p4est);
+}
+
+/* non-recursive refinement must match a recursive refinement that is
+ * limited to one level below a uniform forest; without init and replace
+ * callbacks it works in place */
+static void
+test_inplace (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity)
+{
+  p4est_t            *p4est, *ref, *inplace;
+
+  p4est = p4est_new_ext (mpicomm, connectivity, 0, 2, 1,
+                         sizeof (p4est_topidx_t), init_fn, NULL);
+  ref = p4est_copy (p4est, 1);
+  inplace = p4est_copy (p4est, 1);
+  p4est_refine_ext (p4est, 0, -1, refine_fn, init_fn, replace_fn);
+  check_data (p4est, 0);
+  p4est_refine_ext (ref, 1, 3, refine_fn, init_fn, replace_fn);
+  SC_CHECK_ABORT (p4est_is_equal (p4est, ref, 1), "Refine one level");
+  p4est_refine_ext (inplace, 0, -1, refine_fn, NULL, NULL);
+  SC_CHECK_ABORT (p4est_is_equal (inplace, ref, 0), "Refine in place");
+
+  p4est_destroy (inplace);
+  p4est_destroy (ref);
+  p4est_destroy (p4est);
+}
+
+/* return a local quadrant by its number across the local trees */
+static p4est_quadrant_t *
+local_quadrant (p4est_t * p4est, p4est_locidx_t lid)
+{
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+
+  for (jt = p4est->first_local_tree;; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    if (lid < tree->quadrants_offset +
+        (p4est_locidx_t) tree->quadrants.elem_count) {
+      return p4est_quadrant_array_index (&tree->quadrants,
+                                         (size_t) (lid -
+                                                   tree->quadrants_offset));
+    }
+  }
+}
+
+/* the adapt map relates every new quadrant to the old ones it covers */
+static void
+test_adapt_map (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity)
+{
+  int                 old_sum, new_sum;
+  int                *old_counts, *new_counts;
+  p4est_locidx_t      ln, lo, next;
+  p4est_quadrant_t   *n, *o;
+  p4est_t            *p4est, *old;
+  p4est_adapt_map_t  *map;
+
+  p4est = p4est_new_ext (mpicomm, connectivity, 0, 2, 1,
+                         sizeof (p4est_topidx_t), init_fn, NULL);
+  old = p4est_copy (p4est, 0);
+  map = p4est_adapt_map_new (p4est);
+  p4est_refine_ext (p4est, 1, P4EST_QMAXLEVEL, refine_fn, init_fn,
+                    replace_fn);
+  p4est_coarsen_ext (p4est, 1, 0, coarsen_fn, init_fn, replace_fn);
+  p4est_balance_ext (p4est, P4EST_CONNECT_FULL, init_fn, replace_fn);
+  p4est_adapt_map_update (map, p4est);
+
+  SC_CHECK_ABORT (map->num_old == old->local_num_quadrants &&
+                  map->num_new == p4est->local_num_quadrants, "Map counts");
+  next = 0;
+  for (ln = 0; ln < map->num_new; ++ln) {
+    n = local_quadrant (p4est, ln);
+    lo = map->old_first[ln];
+    SC_CHECK_ABORT (lo == next || (lo == next - 1 &&
+                                   map->relation[ln] == P4EST_ADAPT_CHILD),
+                    "Map order");
+    o = local_quadrant (old, lo);
+    switch (map->relation[ln]) {
+    case P4EST_ADAPT_SAME:
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (o, n), "Map same");
+      break;
+    case P4EST_ADAPT_CHILD:
+      SC_CHECK_ABORT (p4est_quadrant_is_ancestor (o, n), "Map child");
+      break;
+    case P4EST_ADAPT_PARENT:
+      for (; lo < map->old_first[ln] + map->old_count[ln]; ++lo) {
+        SC_CHECK_ABORT (p4est_quadrant_is_ancestor
+                        (n, local_quadrant (old, lo)), "Map parent");
+      }
+      break;
+    default:
+      SC_ABORT_NOT_REACHED ();
+    }
+    next = map->old_first[ln] + map->old_count[ln];
+  }
+  SC_CHECK_ABORT (next == map->num_old, "Map coverage");
+
+  /* counts keep their local sum through the map */
+  old_counts = P4EST_ALLOC (int, SC_MAX (map->num_old, 1));
+  new_counts = P4EST_ALLOC (int, SC_MAX (map->num_new, 1));
+  for (old_sum = 0, lo = 0; lo < map->num_old; ++lo) {
+    old_sum += old_counts[lo] = (int) (lo % 7);
+  }
+  p4est_adapt_map_counts (map, old_counts, new_counts);
+  for (new_sum = 0, ln = 0; ln < map->num_new; ++ln) {
+    SC_CHECK_ABORT (map->relation[ln] != P4EST_ADAPT_SAME ||
+                    new_counts[ln] == old_counts[map->old_first[ln]],
+                    "Map counts same");
+    new_sum += new_counts[ln];
+  }
+  SC_CHECK_ABORT (old_sum == new_sum, "Map counts sum");
+  P4EST_FREE (old_counts);
+  P4EST_FREE (new_counts);
+
+  p4est_adapt_map_destroy (map);
+  p4est_destroy (old);
+  p4est_destroy (p4est);
+}
+
 int
 main (int argc, char **argv)
 {
   int                 mpirank, mpisize;
   int                 mpiret;
   sc_MPI_Comm         mpicomm;
+  unsigned            crc_serial, crc_threads;
   p4est_t            *p4est;
   p4est_connectivity_t *connectivity;
 
@@ -148,6 +400,30 @@ main (int argc, char **argv)
   p4est_balance_ext (p4est, P4EST_CONNECT_FULL, NULL, replace_fn);
 
   p4est_destroy (p4est);
+
+  /* uniform forest creation with threads */
+  test_new_threads (mpicomm, connectivity);
+
+  /* quadrant data replaced from the threads of an iteration */
+  test_data_threads (mpicomm, connectivity);
+
+  /* non-recursive refinement in place */
+  test_inplace (mpicomm, connectivity);
+
+  /* old-to-new index map of adaptation */
+  test_adapt_map (mpicomm, connectivity);
+
+  /* threaded adaptation must produce the same forest */
+  crc_serial = adapt_forest (mpicomm, connectivity, 1, 0);
+  crc_threads = adapt_forest (mpicomm, connectivity, 4, 0);
+  SC_CHECK_ABORT (crc_serial == crc_threads, "Threaded adaptation");
+
+  /* so must adaptation with contiguous user data */
+  crc_threads = adapt_forest (mpicomm, connectivity, 1, 1);
+  SC_CHECK_ABORT (crc_serial == crc_threads, "Contiguous adaptation");
+  crc_threads = adapt_forest (mpicomm, connectivity, 4, 1);
+  SC_CHECK_ABORT (crc_serial == crc_threads, "Contiguous threaded");
+
   p4est_connectivity_destroy (connectivity);
   sc_finalize ();
 
@@ -28,6 +28,8 @@
 #include <p4est_build.h>
 #include <p4est_extended.h>
 #include <p4est_geometry.h>
+#include <p4est_objects.h>
+#include <p4est_points.h>
 #include <p4est_search.h>
 #include <p4est_vtk.h>
 #else
@@ -36,9 +38,140 @@
 #include <p8est_build.h>
 #include <p8est_extended.h>
 #include <p8est_geometry.h>
+#include <p8est_objects.h>
+#include <p8est_points.h>
 #include <p8est_search.h>
 #include <p8est_vtk.h>
 #endif
+/* a bounding box with an identifying payload */
+typedef struct
+{
+  p4est_object_t      box;
+  int                 id;
+}
+test_object_t;
+
+static const int    objects_level = 5;
+static const int    objects_per_rank = 3;
+
+static void
+test_object_make (int id, p4est_topidx_t num_trees, test_object_t * o)
+{
+  int                 i;
+  double              c;
+
+  o->box.which_tree = (p4est_topidx_t) (id % num_trees);
+  for (i = 0; i < 3; ++i) {
+    c = .37 * id + .19 * i + .1;
+    o->box.lower[i] = .8 * (c - floor (c));
+    o->box.upper[i] = o->box.lower[i] + .07 + .01 * (id % 5);
+  }
+  o->id = id;
+}
+
+static int
+test_object_overlap (const p4est_object_t * o, p4est_topidx_t which_tree,
+                     const p4est_quadrant_t * q)
+{
+  int                 i;
+  double              lower[3], h;
+
+  h = (double) P4EST_QUADRANT_LEN (q->level) / (double) P4EST_ROOT_LEN;
+  lower[0] = (double) q->x / (double) P4EST_ROOT_LEN;
+  lower[1] = (double) q->y / (double) P4EST_ROOT_LEN;
+#ifdef P4_TO_P8
+  lower[2] = (double) q->z / (double) P4EST_ROOT_LEN;
+#endif
+  if (o->which_tree != which_tree) {
+    return 0;
+  }
+  for (i = 0; i < P4EST_DIM; ++i) {
+    if (o->upper[i] < lower[i] || lower[i] + h < o->lower[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int
+test_object_refine (p4est_t * p4est, p4est_topidx_t which_tree,
+                    p4est_quadrant_t * quadrant,
+                    const p4est_object_t * object, void *user)
+{
+  SC_CHECK_ABORT (user == (void *) &objects_level, "Objects user");
+  SC_CHECK_ABORT (test_object_overlap (object, which_tree, quadrant),
+                  "Objects refine overlap");
+  return (int) quadrant->level < objects_level;
+}
+
+/* refine to objects and compare the lists with a brute-force search */
+static void
+test_objects_refine (p4est_t * p4est)
+{
+  int                 id, num_ids, partition, count;
+  size_t              zz;
+  p4est_topidx_t      jt, num_trees;
+  p4est_locidx_t      li, lk, lj;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  p4est_t            *copy;
+  sc_array_t         *objects;
+  p4est_objects_t    *objs;
+  test_object_t       o, *po, *pk;
+
+  num_trees = p4est->connectivity->num_trees;
+  num_ids = objects_per_rank * p4est->mpisize;
+  for (partition = 0; partition < 2; ++partition) {
+    copy = p4est_copy (p4est, 0);
+    objects = sc_array_new_count (sizeof (test_object_t),
+                                  (size_t) objects_per_rank);
+    for (id = 0; id < objects_per_rank; ++id) {
+      test_object_make (objects_per_rank * copy->mpirank + id, num_trees,
+                        (test_object_t *) sc_array_index_int (objects, id));
+    }
+    objs = p4est_objects_refine (copy, -1, partition, objects,
+                                 test_object_refine, NULL,
+                                 (void *) &objects_level);
+    sc_array_destroy (objects);
+    SC_CHECK_ABORT (objs->num_leaves == copy->local_num_quadrants,
+                    "Objects leaves");
+
+    for (jt = copy->first_local_tree; jt <= copy->last_local_tree; ++jt) {
+      tree = p4est_tree_array_index (copy->trees, jt);
+      for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+        q = p4est_quadrant_array_index (&tree->quadrants, zz);
+        li = tree->quadrants_offset + (p4est_locidx_t) zz;
+
+        /* every listed object overlaps the leaf and appears once */
+        for (lk = objs->offsets[li]; lk < objs->offsets[li + 1]; ++lk) {
+          pk = (test_object_t *) sc_array_index_int
+            (objs->objects, (int) objs->indices[lk]);
+          SC_CHECK_ABORT (test_object_overlap (&pk->box, jt, q),
+                          "Objects list overlap");
+          for (lj = objs->offsets[li]; lj < lk; ++lj) {
+            po = (test_object_t *) sc_array_index_int
+              (objs->objects, (int) objs->indices[lj]);
+            SC_CHECK_ABORT (po->id != pk->id, "Objects list unique");
+          }
+        }
+
+        /* every overlapping object is listed and the leaf is refined */
+        for (count = 0, id = 0; id < num_ids; ++id) {
+          test_object_make (id, num_trees, &o);
+          if (test_object_overlap (&o.box, jt, q)) {
+            ++count;
+          }
+        }
+        SC_CHECK_ABORT (count == objs->offsets[li + 1] - objs->offsets[li],
+                        "Objects list complete");
+        SC_CHECK_ABORT (count == 0 || (int) q->level >= objects_level,
+                        "Objects refined");
+      }
+    }
+    p4est_objects_destroy (objs);
+    p4est_destroy (copy);
+  }
+}
 
 typedef struct
 {
@@ -447,9 +580,14 @@ p4est_build_verify_5 (p4est_t * p4est)
 static void
 test_build_local (sc_MPI_Comm mpicomm)
 {
+  size_t              zz;
   sc_array_t         *points;
+  p4est_topidx_t      jt;
   p4est_connectivity_t *conn;
+  p4est_quadrant_t   *q;
+  p4est_tree_t       *tree;
   p4est_t            *p4est, *built, *copy;
+  p4est_build_stream_t *stream;
   test_build_t        stb, *tb = &stb;
 
   /* 0. prepare data that we will reuse */
@@ -537,11 +675,1097 @@ test_build_local (sc_MPI_Comm mpicomm)
   p4est_destroy (built);
   sc_array_destroy (points);
 
+  /* 6. Stream the local leaves in small chunks into a new forest */
+
+  tb->build = NULL;
+  stream = p4est_build_stream_new (mpicomm, conn, 0, NULL, NULL);
+  points = sc_array_new (sizeof (p4est_quadrant_t));
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = (p4est_quadrant_t *) sc_array_push (points);
+      *q = *p4est_quadrant_array_index (&tree->quadrants, zz);
+      q->p.which_tree = jt;
+      if (points->elem_count == 7) {
+        p4est_build_stream_add (stream, points);
+        sc_array_truncate (points);
+      }
+    }
+  }
+  p4est_build_stream_add (stream, points);
+  sc_array_destroy (points);
+  built = p4est_build_stream_complete (stream, 0);
+  SC_CHECK_ABORT (p4est_is_equal (p4est, built, 0), "Mismatch build_stream");
+  p4est_destroy (built);
+
   /* clean up */
   p4est_destroy (p4est);
   p4est_connectivity_destroy (conn);
 }
 
+/* match a point that is a copy of a local leaf */
+static int
+thread_point_match (p4est_topidx_t which_tree, p4est_quadrant_t * quadrant,
+                    p4est_locidx_t local_num, p4est_quadrant_t * q)
+{
+  if (which_tree != q->p.piggy3.which_tree) {
+    return 0;
+  }
+  if (quadrant->level < q->level ? !p4est_quadrant_is_ancestor (quadrant, q)
+      : p4est_quadrant_compare (quadrant, q)) {
+    return 0;
+  }
+  if (local_num >= 0) {
+    /* each point is only seen by one thread */
+    q->p.piggy3.local_num = local_num;
+  }
+  return 1;
+}
+
+static int
+thread_local_callback (p4est_t * p4est, p4est_topidx_t which_tree,
+                       p4est_quadrant_t * quadrant, p4est_locidx_t local_num,
+                       void *point)
+{
+  return thread_point_match (which_tree, quadrant, local_num,
+                             (p4est_quadrant_t *) point);
+}
+
+static int
+thread_all_callback (p4est_t * p4est, p4est_topidx_t which_tree,
+                     p4est_quadrant_t * quadrant, int pfirst, int plast,
+                     p4est_locidx_t local_num, void *point)
+{
+  return thread_point_match (which_tree, quadrant, local_num,
+                             (p4est_quadrant_t *) point);
+}
+
+static void
+batch_local_callback (p4est_t * p4est, p4est_topidx_t which_tree,
+                      p4est_quadrant_t * quadrant, p4est_locidx_t local_num,
+                      sc_array_t * points, const size_t * indices,
+                      size_t num_indices, int8_t * keep)
+{
+  size_t              zz;
+
+  for (zz = 0; zz < num_indices; ++zz) {
+    keep[zz] = (int8_t) thread_point_match
+      (which_tree, quadrant, local_num,
+       p4est_quadrant_array_index (points, indices[zz]));
+  }
+}
+
+static void
+batch_all_callback (p4est_t * p4est, p4est_topidx_t which_tree,
+                    p4est_quadrant_t * quadrant, int pfirst, int plast,
+                    p4est_locidx_t local_num, sc_array_t * points,
+                    const size_t * indices, size_t num_indices, int8_t * keep)
+{
+  batch_local_callback (p4est, which_tree, quadrant, local_num,
+                        points, indices, num_indices, keep);
+}
+
+static int
+thread_count_callback (p4est_t * p4est, p4est_topidx_t which_tree,
+                       p4est_quadrant_t * quadrant, p4est_locidx_t local_num,
+                       void *point)
+{
+  p4est_locidx_t     *counts = (p4est_locidx_t *) p4est->user_pointer;
+
+  if (local_num >= 0) {
+    ++counts[p4est_get_thread_num ()];
+  }
+  return 1;
+}
+
+/* search for every local leaf with the thread-parallel and batch searches */
+static void
+test_search_threads (p4est_t * p4est)
+{
+  int                 i;
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      lnum, sum;
+  p4est_locidx_t      counts[P4EST_INSPECT_MAX_THREADS];
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *quad, *q;
+  sc_array_t         *points;
+  void               *user_pointer = p4est->user_pointer;
+
+  points = sc_array_new_count (sizeof (p4est_quadrant_t),
+                               (size_t) p4est->local_num_quadrants);
+  for (i = 0; i < 4; ++i) {
+    lnum = 0;
+    for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lnum) {
+        quad = p4est_quadrant_array_index (&tree->quadrants, zz);
+        q = p4est_quadrant_array_index (points, (size_t) lnum);
+        *q = *quad;
+        q->p.piggy3.which_tree = jt;
+        q->p.piggy3.local_num = -1;
+      }
+    }
+    if (i == 0) {
+      p4est_search_local_threads (p4est, 0, NULL, thread_local_callback,
+                                  points);
+    }
+    else if (i == 1) {
+      p4est_search_all_threads (p4est, 0, NULL, thread_all_callback, points);
+    }
+    else if (i == 2) {
+      p4est_search_local_batch (p4est, 0, NULL, batch_local_callback, points);
+    }
+    else {
+      p4est_search_all_batch (p4est, 0, NULL, batch_all_callback, points);
+    }
+    for (lnum = 0; lnum < p4est->local_num_quadrants; ++lnum) {
+      q = p4est_quadrant_array_index (points, (size_t) lnum);
+      SC_CHECK_ABORT (q->p.piggy3.local_num == lnum,
+                      "Thread or batch search");
+    }
+  }
+  sc_array_destroy (points);
+
+  /* count the local leaves with per-thread counters */
+  memset (counts, 0, sizeof (counts));
+  p4est->user_pointer = counts;
+  p4est_search_local_threads (p4est, 0, thread_count_callback, NULL, NULL);
+  p4est->user_pointer = user_pointer;
+  for (sum = 0, i = 0; i < P4EST_INSPECT_MAX_THREADS; ++i) {
+    sum += counts[i];
+  }
+  SC_CHECK_ABORT (sum == p4est->local_num_quadrants, "Thread count search");
+}
+
+/* move pseudo-random points to their owners twice and check their leaves */
+static void
+test_points_migrate (p4est_t * p4est)
+{
+  const int           num_points = 100;
+  int                 mpiret, round;
+  unsigned            state;
+  size_t              zz;
+  long long           sums[2], gsums[2];
+  p4est_topidx_t      which_tree;
+  p4est_quadrant_t   *q, *leaf;
+  p4est_points_migrate_t *migrate;
+  sc_array_t         *points, *payloads;
+
+  points = sc_array_new_count (sizeof (p4est_quadrant_t), num_points);
+  payloads = sc_array_new_count (sizeof (long long), num_points);
+  state = 1 + (unsigned) p4est->mpirank;
+  for (zz = 0; zz < (size_t) num_points; ++zz) {
+    q = p4est_quadrant_array_index (points, zz);
+    P4EST_QUADRANT_INIT (q);
+    q->level = P4EST_MAXLEVEL;
+    state = state * 1103515245u + 12345u;
+    q->x = (p4est_qcoord_t) ((state >> 1) % (unsigned) P4EST_ROOT_LEN);
+    state = state * 1103515245u + 12345u;
+    q->y = (p4est_qcoord_t) ((state >> 1) % (unsigned) P4EST_ROOT_LEN);
+#ifdef P4_TO_P8
+    state = state * 1103515245u + 12345u;
+    q->z = (p4est_qcoord_t) ((state >> 1) % (unsigned) P4EST_ROOT_LEN);
+#endif
+    q->p.which_tree = (p4est_topidx_t)
+      ((state >> 3) % (unsigned) p4est->connectivity->num_trees);
+    *(long long *) sc_array_index (payloads, zz) =
+      (long long) p4est->mpirank * num_points + (long long) zz;
+  }
+
+  migrate = p4est_points_migrate_new (p4est, sizeof (long long));
+  for (round = 0; round < 2; ++round) {
+    p4est_points_migrate (migrate, points, payloads);
+    SC_CHECK_ABORT (points->elem_count == payloads->elem_count,
+                    "Migrate count");
+    sums[0] = (long long) points->elem_count;
+    sums[1] = 0;
+    for (zz = 0; zz < points->elem_count; ++zz) {
+      q = p4est_quadrant_array_index (points, zz);
+      which_tree = -1;
+      leaf = p4est_find_quadrant_cumulative (p4est, q->p.piggy3.local_num,
+                                             &which_tree, NULL);
+      SC_CHECK_ABORT (which_tree == q->p.piggy3.which_tree &&
+                      p4est_quadrant_contains_node (leaf, q),
+                      "Migrate leaf");
+      SC_CHECK_ABORT (zz == 0 || (q - 1)->p.piggy3.local_num <=
+                      q->p.piggy3.local_num, "Migrate order");
+      sums[1] += *(long long *) sc_array_index (payloads, zz);
+    }
+    mpiret = sc_MPI_Allreduce (sums, gsums, 2, sc_MPI_LONG_LONG_INT,
+                               sc_MPI_SUM, p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+    SC_CHECK_ABORT (gsums[0] == (long long) p4est->mpisize * num_points &&
+                    2 * gsums[1] == gsums[0] * (gsums[0] - 1),
+                    "Migrate payloads");
+  }
+
+  /* the second round keeps all points and reuses the pattern */
+  SC_CHECK_ABORT (migrate->num_calls == 2 && migrate->num_notify <= 1,
+                  "Migrate pattern reuse");
+  p4est_points_migrate_destroy (migrate);
+  sc_array_destroy (points);
+  sc_array_destroy (payloads);
+}
+
+static int
+nearest_compare (const void *v1, const void *v2)
+{
+  const double        d1 = *(const double *) v1;
+  const double        d2 = *(const double *) v2;
+
+  return d1 < d2 ? -1 : d1 > d2 ? 1 : 0;
+}
+
+typedef struct
+{
+  p4est_quadrant_t    quad;     /* point of maximum level with tree number */
+  int                 found;    /* number of leaves that contain it */
+}
+test_ghost_point_t;
+
+typedef struct
+{
+  p4est_ghost_t      *ghost;
+  char               *marks;    /* one entry per local quadrant and ghost */
+}
+test_ghost_search_t;
+
+static int
+ghost_quadrant_callback (p4est_t * p4est, p4est_topidx_t which_tree,
+                         p4est_quadrant_t * quadrant, int is_ghost,
+                         p4est_locidx_t local_num, void *point)
+{
+  test_ghost_search_t *gs = (test_ghost_search_t *) p4est->user_pointer;
+  size_t              pos;
+
+  P4EST_ASSERT (point == NULL);
+  if (local_num < 0) {
+    SC_CHECK_ABORT (!is_ghost, "Ghost branch");
+    return 1;
+  }
+  if (is_ghost) {
+    SC_CHECK_ABORT (quadrant == p4est_quadrant_array_index
+                    (&gs->ghost->ghosts, (size_t) local_num), "Ghost leaf");
+    SC_CHECK_ABORT (quadrant->p.piggy3.which_tree == which_tree,
+                    "Ghost tree");
+    pos = (size_t) p4est->local_num_quadrants + (size_t) local_num;
+  }
+  else {
+    SC_CHECK_ABORT (quadrant == p4est_find_quadrant_cumulative
+                    (p4est, local_num, NULL, NULL), "Local leaf");
+    pos = (size_t) local_num;
+  }
+  SC_CHECK_ABORT (!gs->marks[pos], "Leaf visited twice");
+  gs->marks[pos] = 1;
+  return 1;
+}
+
+static int
+ghost_point_callback (p4est_t * p4est, p4est_topidx_t which_tree,
+                      p4est_quadrant_t * quadrant, int is_ghost,
+                      p4est_locidx_t local_num, void *point)
+{
+  test_ghost_point_t *gp = (test_ghost_point_t *) point;
+
+  if (gp->quad.p.which_tree != which_tree ||
+      !p4est_quadrant_contains_node (quadrant, &gp->quad)) {
+    return 0;
+  }
+  if (local_num >= 0) {
+    ++gp->found;
+  }
+  return 1;
+}
+
+/* locate points in the local and ghost leaves in one pass */
+static void
+test_search_ghost (p4est_t * p4est)
+{
+  const int           num_points = 50;
+  int                 expected;
+  unsigned            state;
+  size_t              zz, jj, num_leaves;
+  void               *user_pointer;
+  p4est_topidx_t      tt;
+  p4est_locidx_t      gl;
+  p4est_quadrant_t   *cand;
+  p4est_tree_t       *tree;
+  test_ghost_point_t *gp;
+  test_ghost_search_t sgs, *gs = &sgs;
+  sc_array_t         *points, view;
+
+  gs->ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+  num_leaves = (size_t) p4est->local_num_quadrants +
+    gs->ghost->ghosts.elem_count;
+  gs->marks = P4EST_ALLOC_ZERO (char, num_leaves);
+  user_pointer = p4est->user_pointer;
+  p4est->user_pointer = gs;
+
+  /* without points every local and ghost leaf is visited exactly once */
+  p4est_search_ghost (p4est, gs->ghost, 0, ghost_quadrant_callback,
+                      NULL, NULL);
+  for (zz = 0; zz < num_leaves; ++zz) {
+    SC_CHECK_ABORT (gs->marks[zz], "Leaf not visited");
+  }
+
+  /* compare point location to a brute force search */
+  points = sc_array_new_count (sizeof (test_ghost_point_t), num_points);
+  state = 11 + (unsigned) p4est->mpirank;
+  for (zz = 0; zz < (size_t) num_points; ++zz) {
+    gp = (test_ghost_point_t *) sc_array_index (points, zz);
+    P4EST_QUADRANT_INIT (&gp->quad);
+    gp->quad.level = P4EST_MAXLEVEL;
+    state = state * 1103515245u + 12345u;
+    gp->quad.x = (p4est_qcoord_t) ((state >> 1) % (unsigned) P4EST_ROOT_LEN);
+    state = state * 1103515245u + 12345u;
+    gp->quad.y = (p4est_qcoord_t) ((state >> 1) % (unsigned) P4EST_ROOT_LEN);
+#ifdef P4_TO_P8
+    state = state * 1103515245u + 12345u;
+    gp->quad.z = (p4est_qcoord_t) ((state >> 1) % (unsigned) P4EST_ROOT_LEN);
+#endif
+    gp->quad.p.which_tree = (p4est_topidx_t)
+      ((state >> 3) % (unsigned) p4est->connectivity->num_trees);
+    gp->found = 0;
+  }
+  p4est_search_ghost (p4est, gs->ghost, 0, NULL, ghost_point_callback,
+                      points);
+  for (zz = 0; zz < (size_t) num_points; ++zz) {
+    gp = (test_ghost_point_t *) sc_array_index (points, zz);
+    tt = gp->quad.p.which_tree;
+    tree = p4est_tree_array_index (p4est->trees, tt);
+    expected = 0;
+    for (jj = 0; jj < tree->quadrants.elem_count; ++jj) {
+      cand = p4est_quadrant_array_index (&tree->quadrants, jj);
+      expected += p4est_quadrant_contains_node (cand, &gp->quad);
+    }
+    gl = gs->ghost->tree_offsets[tt];
+    sc_array_init_view (&view, &gs->ghost->ghosts, (size_t) gl,
+                        (size_t) (gs->ghost->tree_offsets[tt + 1] - gl));
+    for (jj = 0; jj < view.elem_count; ++jj) {
+      cand = p4est_quadrant_array_index (&view, jj);
+      expected += p4est_quadrant_contains_node (cand, &gp->quad);
+    }
+    SC_CHECK_ABORT (expected <= 1 && gp->found == expected, "Ghost points");
+  }
+
+  p4est->user_pointer = user_pointer;
+  sc_array_destroy (points);
+  P4EST_FREE (gs->marks);
+  p4est_ghost_destroy (gs->ghost);
+}
+
+/* compare nearest neighbor queries to a brute force search */
+static void
+test_search_nearest (p4est_t * p4est)
+{
+  const int           num_queries = 20;
+  const int           k = 5;
+  const double        radius = .3;
+  const double        eps = 1e-12;
+  int                 i, pass;
+  unsigned            state;
+  size_t              zz, jj, num, begin, end;
+  double              d, c;
+  double             *brute;
+  p4est_topidx_t      tt;
+  p4est_locidx_t      gl;
+  p4est_quadrant_t   *q, *cand;
+  p4est_tree_t       *tree;
+  p4est_ghost_t      *ghost;
+  p4est_search_nearest_t *result;
+  sc_array_t         *queries, *offsets, *results;
+
+  ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+  queries = sc_array_new_count (sizeof (p4est_quadrant_t), num_queries);
+  offsets = sc_array_new (sizeof (size_t));
+  results = sc_array_new (sizeof (p4est_search_nearest_t));
+  brute = P4EST_ALLOC (double, p4est->local_num_quadrants +
+                       ghost->ghosts.elem_count);
+  state = 7 + (unsigned) p4est->mpirank;
+  for (zz = 0; zz < (size_t) num_queries; ++zz) {
+    q = p4est_quadrant_array_index (queries, zz);
+    P4EST_QUADRANT_INIT (q);
+    q->level = P4EST_MAXLEVEL;
+    state = state * 1103515245u + 12345u;
+    q->x = (p4est_qcoord_t) ((state >> 1) % (unsigned) P4EST_ROOT_LEN);
+    state = state * 1103515245u + 12345u;
+    q->y = (p4est_qcoord_t) ((state >> 1) % (unsigned) P4EST_ROOT_LEN);
+#ifdef P4_TO_P8
+    state = state * 1103515245u + 12345u;
+    q->z = (p4est_qcoord_t) ((state >> 1) % (unsigned) P4EST_ROOT_LEN);
+#endif
+    q->p.which_tree = (p4est_topidx_t)
+      ((state >> 3) % (unsigned) p4est->connectivity->num_trees);
+  }
+
+  for (pass = 0; pass < 2; ++pass) {
+    /* the first pass asks for k neighbors, the second for a radius */
+    p4est_search_nearest (p4est, ghost, queries, pass ? 0 : k,
+                          pass ? radius : -1., offsets, results);
+    SC_CHECK_ABORT (offsets->elem_count == (size_t) num_queries + 1,
+                    "Nearest offsets");
+    for (zz = 0; zz < (size_t) num_queries; ++zz) {
+      q = p4est_quadrant_array_index (queries, zz);
+      tt = q->p.which_tree;
+
+      /* distances of all candidates of the query's tree */
+      num = 0;
+      for (i = 0; i < 2; ++i) {
+        sc_array_t          view, *cands = &view;
+        if (i == 0) {
+          if (tt < p4est->first_local_tree || tt > p4est->last_local_tree) {
+            continue;
+          }
+          tree = p4est_tree_array_index (p4est->trees, tt);
+          cands = &tree->quadrants;
+        }
+        else {
+          gl = ghost->tree_offsets[tt];
+          sc_array_init_view (&view, &ghost->ghosts, (size_t) gl,
+                              (size_t) (ghost->tree_offsets[tt + 1] - gl));
+        }
+        for (jj = 0; jj < cands->elem_count; ++jj) {
+          cand = p4est_quadrant_array_index (cands, jj);
+          c = .5 * P4EST_QUADRANT_LEN (cand->level);
+          d = ((double) q->x - (cand->x + c)) * (q->x - (cand->x + c)) +
+            ((double) q->y - (cand->y + c)) * (q->y - (cand->y + c));
+#ifdef P4_TO_P8
+          d += ((double) q->z - (cand->z + c)) * (q->z - (cand->z + c));
+#endif
+          brute[num++] = sqrt (d) / P4EST_ROOT_LEN;
+        }
+      }
+      qsort (brute, num, sizeof (double), nearest_compare);
+      if (pass == 0) {
+        num = SC_MIN (num, (size_t) k);
+      }
+      else {
+        for (jj = 0; jj < num && brute[jj] <= radius; ++jj);
+        num = jj;
+      }
+
+      /* the results must have the same distances in order */
+      begin = *(size_t *) sc_array_index (offsets, zz);
+      end = *(size_t *) sc_array_index (offsets, zz + 1);
+      SC_CHECK_ABORT (end - begin == num, "Nearest count");
+      for (jj = 0; jj < num; ++jj) {
+        result = (p4est_search_nearest_t *)
+          sc_array_index (results, begin + jj);
+        SC_CHECK_ABORT (0 <= result->quadid &&
+                        (size_t) result->quadid <
+                        (size_t) p4est->local_num_quadrants +
+                        ghost->ghosts.elem_count, "Nearest index");
+        SC_CHECK_ABORT (fabs (result->distance - brute[jj]) < eps,
+                        "Nearest distance");
+      }
+    }
+  }
+
+  P4EST_FREE (brute);
+  sc_array_destroy (queries);
+  sc_array_destroy (offsets);
+  sc_array_destroy (results);
+  p4est_ghost_destroy (ghost);
+}
+
+typedef struct
+{
+  int                 count;    /* number of leaves crossed so far */
+  int                 limit;    /* stop after this many leaves if positive */
+  double              t_last;   /* exit parameter of the previous leaf */
+}
+test_ray_t;
+
+static int
+ray_callback (p4est_t * p4est, p4est_topidx_t which_tree,
+              p4est_quadrant_t * quadrant, p4est_locidx_t local_num,
+              p4est_ray_t * ray, double t_enter, double t_exit)
+{
+  const double        eps = 1e-9;
+  int                 i;
+  double              t, x, lower, len;
+  p4est_qcoord_t      qc[P4EST_DIM];
+  test_ray_t         *tr = (test_ray_t *) ray->user_data;
+
+  /* the leaves are contiguous along the ray */
+  SC_CHECK_ABORT (t_enter < t_exit, "Ray interval");
+  SC_CHECK_ABORT (tr->count == 0 || fabs (t_enter - tr->t_last) < eps,
+                  "Ray order");
+  tr->t_last = t_exit;
+
+  /* the middle of the interval lies in the leaf */
+  SC_CHECK_ABORT (p4est_quadrant_is_equal
+                  (quadrant, p4est_find_quadrant_cumulative
+                   (p4est, local_num, NULL, NULL)), "Ray local number");
+  qc[0] = quadrant->x;
+  qc[1] = quadrant->y;
+#ifdef P4_TO_P8
+  qc[2] = quadrant->z;
+#endif
+  t = .5 * (t_enter + t_exit);
+  len = (double) P4EST_QUADRANT_LEN (quadrant->level) / P4EST_ROOT_LEN;
+  for (i = 0; i < P4EST_DIM; ++i) {
+    x = ray->origin[i] + t * ray->direction[i];
+    lower = (double) qc[i] / P4EST_ROOT_LEN;
+    SC_CHECK_ABORT (lower - eps <= x && x <= lower + len + eps,
+                    "Ray containment");
+  }
+  SC_CHECK_ABORT (0 <= which_tree && which_tree == ray->which_tree,
+                  "Ray tree");
+
+  ++tr->count;
+  return tr->limit <= 0 || tr->count < tr->limit;
+}
+
+/* trace rays from the center of every tree */
+static void
+test_search_rays (p4est_t * p4est)
+{
+  const int           num_dirs = 5;
+  const int           limit = 3;
+  int                 i, pass;
+  size_t              zz, num_rays;
+  p4est_topidx_t      tt;
+  p4est_ray_t        *ray;
+  test_ray_t         *trs;
+  sc_array_t         *rays;
+
+  num_rays = (size_t) p4est->connectivity->num_trees * num_dirs;
+  rays = sc_array_new_count (sizeof (p4est_ray_t), num_rays);
+  trs = P4EST_ALLOC (test_ray_t, num_rays);
+  for (pass = 0; pass < 2; ++pass) {
+    /* the second pass terminates the rays early */
+    for (zz = 0; zz < num_rays; ++zz) {
+      tt = (p4est_topidx_t) (zz / num_dirs);
+      i = (int) (zz % num_dirs);
+      ray = (p4est_ray_t *) sc_array_index (rays, zz);
+      memset (ray, 0, sizeof (*ray));
+      ray->which_tree = tt;
+      ray->origin[0] = ray->origin[1] = ray->origin[2] = .5;
+      ray->direction[0] = cos (1. + i);
+      ray->direction[1] = sin (1. + i);
+#ifdef P4_TO_P8
+      ray->direction[2] = .5 - .2 * i;
+#endif
+      ray->t = 0.;
+      ray->t_max = 2.;
+      ray->user_data = &trs[zz];
+      trs[zz].count = 0;
+      trs[zz].limit = pass ? limit : 0;
+      trs[zz].t_last = 0.;
+    }
+    p4est_search_rays (p4est, rays, ray_callback);
+    for (zz = 0; zz < num_rays; ++zz) {
+      ray = (p4est_ray_t *) sc_array_index (rays, zz);
+      SC_CHECK_ABORT (ray->owner == -1 ||
+                      (0 <= ray->owner && ray->owner < p4est->mpisize &&
+                       ray->owner != p4est->mpirank), "Ray owner");
+      SC_CHECK_ABORT (ray->t <= ray->t_max, "Ray end");
+      if (pass && trs[zz].count == limit) {
+        SC_CHECK_ABORT (ray->owner == -1 && ray->t == trs[zz].t_last,
+                        "Ray termination");
+      }
+      SC_CHECK_ABORT (!pass || trs[zz].count <= limit, "Ray limit");
+      if (p4est->mpisize == 1) {
+        /* a serial trace reaches the end or the boundary */
+        SC_CHECK_ABORT (ray->owner == -1, "Ray serial");
+        SC_CHECK_ABORT (trs[zz].count > 0, "Ray count");
+      }
+    }
+  }
+  P4EST_FREE (trs);
+  sc_array_destroy (rays);
+}
+
+/* record of the quadrants visited by a partition traversal */
+static sc_array_t  *index_trace;
+
+static void
+index_record (p4est_topidx_t which_tree, p4est_quadrant_t * quadrant,
+              int pfirst, int plast, p4est_locidx_t local_num)
+{
+  long long          *entry;
+
+  entry = (long long *) sc_array_push_count (index_trace, 6);
+  entry[0] = (long long) which_tree;
+  entry[1] = (long long) p4est_quadrant_linear_id (quadrant,
+                                                   (int) quadrant->level);
+  entry[2] = (long long) quadrant->level;
+  entry[3] = (long long) pfirst;
+  entry[4] = (long long) plast;
+  entry[5] = (long long) local_num;
+}
+
+static int
+index_partition_callback (p4est_t * p4est, p4est_topidx_t which_tree,
+                          p4est_quadrant_t * quadrant, int pfirst, int plast,
+                          void *point)
+{
+  index_record (which_tree, quadrant, pfirst, plast, -1);
+  return 1;
+}
+
+static int
+index_all_callback (p4est_t * p4est, p4est_topidx_t which_tree,
+                    p4est_quadrant_t * quadrant, int pfirst, int plast,
+                    p4est_locidx_t local_num, void *point)
+{
+  index_record (which_tree, quadrant, pfirst, plast, local_num);
+
+  /* do not descend into remote processors beyond their top quadrant */
+  return pfirst < plast || pfirst == p4est->mpirank;
+}
+
+/* the searches must visit the same quadrants with and without index */
+static void
+test_search_index (p4est_t * p4est)
+{
+  p4est_search_index_t *index;
+  sc_array_t         *plain;
+
+  index = p4est_search_index_new (p4est);
+  SC_CHECK_ABORT (p4est_search_index_is_valid (index, p4est),
+                  "Index valid");
+  SC_CHECK_ABORT (p4est_search_index_memory_used (index) > 0,
+                  "Index memory");
+
+  plain = sc_array_new (sizeof (long long));
+  index_trace = sc_array_new (sizeof (long long));
+  p4est_search_partition_index (p4est, NULL, 0, index_partition_callback,
+                                NULL, NULL);
+  sc_array_copy (plain, index_trace);
+  sc_array_truncate (index_trace);
+  p4est_search_partition_index (p4est, index, 0, index_partition_callback,
+                                NULL, NULL);
+  SC_CHECK_ABORT (sc_array_is_equal (plain, index_trace),
+                  "Index partition search");
+
+  sc_array_truncate (index_trace);
+  p4est_search_all_index (p4est, NULL, 0, index_all_callback, NULL, NULL);
+  sc_array_copy (plain, index_trace);
+  sc_array_truncate (index_trace);
+  p4est_search_all_index (p4est, index, 0, index_all_callback, NULL, NULL);
+  SC_CHECK_ABORT (sc_array_is_equal (plain, index_trace),
+                  "Index search all");
+
+  sc_array_destroy (index_trace);
+  index_trace = NULL;
+  sc_array_destroy (plain);
+  p4est_search_index_destroy (index);
+}
+
+/* translate sorted and unsorted batches of cumulative numbers */
+static void
+test_cumulative_batch (p4est_t * p4est)
+{
+  int                 pass;
+  size_t              zz, num_ids;
+  p4est_topidx_t      which_tree, *trees;
+  p4est_locidx_t      quadrant_id, *ids, *qids;
+  p4est_quadrant_t   *q, **quads;
+
+  num_ids = (size_t) p4est->local_num_quadrants;
+  ids = P4EST_ALLOC (p4est_locidx_t, num_ids);
+  trees = P4EST_ALLOC (p4est_topidx_t, num_ids);
+  qids = P4EST_ALLOC (p4est_locidx_t, num_ids);
+  quads = P4EST_ALLOC (p4est_quadrant_t *, num_ids);
+  for (pass = 0; pass < 2; ++pass) {
+    /* first pass ascending, second pass descending */
+    for (zz = 0; zz < num_ids; ++zz) {
+      ids[zz] = (p4est_locidx_t) (pass == 0 ? zz : num_ids - 1 - zz);
+    }
+    p4est_find_quadrant_cumulative_batch (p4est, num_ids, ids,
+                                          trees, qids, quads);
+    for (zz = 0; zz < num_ids; ++zz) {
+      which_tree = -1;
+      q = p4est_find_quadrant_cumulative (p4est, ids[zz], &which_tree,
+                                          &quadrant_id);
+      SC_CHECK_ABORT (trees[zz] == which_tree && qids[zz] == quadrant_id &&
+                      quads[zz] == q, "Cumulative batch");
+    }
+  }
+  P4EST_FREE (ids);
+  P4EST_FREE (trees);
+  P4EST_FREE (qids);
+  P4EST_FREE (quads);
+}
+
+/* build a forest from unsorted points and check the leaves' contents */
+static void
+test_new_points_sort (p4est_t * p4est)
+{
+  const int           num_points = 200;
+  const int           maxlevel = 6;
+  const p4est_locidx_t max_points = 3;
+  int                 mpiret;
+  unsigned            state;
+  size_t              zz, next;
+  long long           lcount, gcount;
+  ssize_t             result;
+  p4est_topidx_t      jt;
+  p4est_quadrant_t   *q, *leaf, *prev;
+  p4est_tree_t       *tree;
+  p4est_t            *built;
+  sc_array_t         *points;
+
+  points = sc_array_new_count (sizeof (p4est_quadrant_t), num_points);
+  state = 11 + (unsigned) p4est->mpirank;
+  for (zz = 0; zz < (size_t) num_points; ++zz) {
+    q = p4est_quadrant_array_index (points, zz);
+    P4EST_QUADRANT_INIT (q);
+    q->level = P4EST_MAXLEVEL;
+    state = state * 1103515245u + 12345u;
+    q->x = (p4est_qcoord_t) ((state >> 1) % (unsigned) P4EST_ROOT_LEN);
+    state = state * 1103515245u + 12345u;
+    q->y = (p4est_qcoord_t) ((state >> 1) % (unsigned) P4EST_ROOT_LEN);
+#ifdef P4_TO_P8
+    state = state * 1103515245u + 12345u;
+    q->z = (p4est_qcoord_t) ((state >> 1) % (unsigned) P4EST_ROOT_LEN);
+#endif
+    q->p.which_tree = (p4est_topidx_t)
+      ((state >> 3) % (unsigned) p4est->connectivity->num_trees);
+  }
+
+  built = p4est_new_points_sort (p4est->mpicomm, p4est->connectivity,
+                                 maxlevel, points, max_points, 0, NULL, NULL);
+  SC_CHECK_ABORT (p4est_is_valid (built), "Points sort valid");
+
+  /* no points are lost */
+  lcount = (long long) points->elem_count;
+  mpiret = sc_MPI_Allreduce (&lcount, &gcount, 1, sc_MPI_LONG_LONG_INT,
+                             sc_MPI_SUM, built->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  SC_CHECK_ABORT (gcount == (long long) built->mpisize * num_points,
+                  "Points sort count");
+
+  /* every local point is in a local leaf with few points */
+  for (zz = 0; zz < points->elem_count; zz = next) {
+    q = p4est_quadrant_array_index (points, zz);
+    jt = q->p.which_tree;
+    SC_CHECK_ABORT (built->first_local_tree <= jt &&
+                    jt <= built->last_local_tree, "Points sort tree");
+    tree = p4est_tree_array_index (built->trees, jt);
+    result = p4est_find_higher_bound (&tree->quadrants, q, 0);
+    SC_CHECK_ABORT (result >= 0, "Points sort leaf");
+    leaf = p4est_quadrant_array_index (&tree->quadrants, (size_t) result);
+    SC_CHECK_ABORT (p4est_quadrant_contains_node (leaf, q),
+                    "Points sort contains");
+    for (next = zz + 1; next < points->elem_count; ++next) {
+      prev = p4est_quadrant_array_index (points, next - 1);
+      q = p4est_quadrant_array_index (points, next);
+      SC_CHECK_ABORT (p4est_quadrant_compare_piggy (prev, q) <= 0,
+                      "Points sort order");
+      if (q->p.which_tree != jt || !p4est_quadrant_contains_node (leaf, q)) {
+        break;
+      }
+    }
+    SC_CHECK_ABORT (next - zz <= (size_t) max_points ||
+                    leaf->level == maxlevel, "Points sort refinement");
+  }
+
+  p4est_destroy (built);
+  sc_array_destroy (points);
+}
+
+/* number of reference points per tree in the geometry tests */
+#define TEST_GEOMETRY_POINTS 7
+
+/* reference points strictly inside the tree, the third one zero in 2D */
+static void
+test_geometry_points (double *abc)
+{
+  int                 k, j;
+
+  for (k = 0; k < TEST_GEOMETRY_POINTS; ++k) {
+    for (j = 0; j < 3; ++j) {
+      abc[3 * k + j] = j < P4EST_DIM ?
+        .05 + .9 * fmod (.37 * (k + 1) * (j + 2), 1.) : 0.;
+    }
+  }
+}
+
+/* the batch transformation agrees with the transformation of each point */
+static void
+test_geometry_batch (p4est_geometry_t * geom, p4est_topidx_t num_trees)
+{
+  const double        eps = 1e-12;
+  int                 k, j;
+  p4est_topidx_t      jt;
+  double              abc[3 * TEST_GEOMETRY_POINTS];
+  double              xyz[3 * TEST_GEOMETRY_POINTS];
+  double              inplace[3 * TEST_GEOMETRY_POINTS];
+  double              ref[3];
+
+  test_geometry_points (abc);
+  for (jt = 0; jt < num_trees; ++jt) {
+    p4est_geometry_X_batch (geom, jt, TEST_GEOMETRY_POINTS, abc, xyz);
+    memcpy (inplace, abc, sizeof (abc));
+    p4est_geometry_X_batch (geom, jt, TEST_GEOMETRY_POINTS, inplace,
+                            inplace);
+    for (k = 0; k < TEST_GEOMETRY_POINTS; ++k) {
+      geom->X (geom, jt, abc + 3 * k, ref);
+      for (j = 0; j < 3; ++j) {
+        SC_CHECK_ABORT (fabs (xyz[3 * k + j] - ref[j]) <=
+                        eps * (1. + fabs (ref[j])), "Geometry batch");
+        SC_CHECK_ABORT (inplace[3 * k + j] == xyz[3 * k + j],
+                        "Geometry batch in place");
+      }
+    }
+  }
+}
+
+/* compare a Jacobian with central differences of a transformation */
+static void
+test_geometry_J_check (p4est_geometry_t * geom, p4est_topidx_t which_tree,
+                       const double abc[3], double J[3][3])
+{
+  const double        h = 1e-6;
+  int                 i, j;
+  double              rst[3], xp[3], xm[3], d;
+
+  for (j = 0; j < 3; ++j) {
+    if (j >= P4EST_DIM) {
+      for (i = 0; i < 3; ++i) {
+        SC_CHECK_ABORT (J[i][j] == 0., "Geometry Jacobian 2D");
+      }
+      continue;
+    }
+    memcpy (rst, abc, sizeof (rst));
+    rst[j] = abc[j] + h;
+    geom->X (geom, which_tree, rst, xp);
+    rst[j] = abc[j] - h;
+    geom->X (geom, which_tree, rst, xm);
+    for (i = 0; i < 3; ++i) {
+      d = (xp[i] - xm[i]) / (2. * h);
+      SC_CHECK_ABORT (fabs (J[i][j] - d) <= 1e-6 * (1. + fabs (d)),
+                      "Geometry Jacobian");
+    }
+  }
+}
+
+/* the Jacobian agrees with finite differences of the transformation */
+static void
+test_geometry_J (p4est_geometry_t * geom, p4est_topidx_t num_trees)
+{
+  int                 k;
+  p4est_topidx_t      jt;
+  double              abc[3 * TEST_GEOMETRY_POINTS];
+  double              J[3][3];
+
+  test_geometry_points (abc);
+  for (jt = 0; jt < num_trees; ++jt) {
+    for (k = 0; k < TEST_GEOMETRY_POINTS; ++k) {
+      p4est_geometry_J (geom, jt, abc + 3 * k, J);
+      test_geometry_J_check (geom, jt, abc + 3 * k, J);
+    }
+  }
+}
+
+/* the cached coefficients reproduce the vertex transformation */
+static void
+test_geometry_cache (p4est_geometry_t * vertex, p4est_topidx_t num_trees)
+{
+  const double        eps = 1e-12;
+  int                 k, j;
+  p4est_topidx_t      jt;
+  double              abc[3 * TEST_GEOMETRY_POINTS];
+  double              xyz[3 * TEST_GEOMETRY_POINTS];
+  double              ref[3 * TEST_GEOMETRY_POINTS];
+  double              J[3][3];
+  p4est_geometry_cache_t *cache;
+
+  cache = p4est_geometry_cache_new ((p4est_connectivity_t *) vertex->user);
+  SC_CHECK_ABORT (cache->num_trees == num_trees, "Geometry cache trees");
+  test_geometry_points (abc);
+  for (jt = 0; jt < num_trees; ++jt) {
+    p4est_geometry_cache_X_batch (cache, jt, TEST_GEOMETRY_POINTS, abc, xyz);
+    p4est_geometry_connectivity_X_batch (vertex, jt, TEST_GEOMETRY_POINTS,
+                                         abc, ref);
+    for (k = 0; k < TEST_GEOMETRY_POINTS; ++k) {
+      for (j = 0; j < 3; ++j) {
+        SC_CHECK_ABORT (fabs (xyz[3 * k + j] - ref[3 * k + j]) <=
+                        eps * (1. + fabs (ref[3 * k + j])), "Geometry cache");
+      }
+      p4est_geometry_cache_J (cache, jt, abc + 3 * k, J);
+      test_geometry_J_check (vertex, jt, abc + 3 * k, J);
+    }
+  }
+  p4est_geometry_cache_destroy (cache);
+}
+
+/* transform points by the built-in geometries and differentiate them */
+static void
+test_geometries (void)
+{
+  p4est_connectivity_t *conn;
+  p4est_geometry_t   *geom;
+  p4est_geometry_t    vertex;
+
+#ifndef P4_TO_P8
+  conn = p4est_connectivity_new_star ();
+#else
+  conn = p8est_connectivity_new_rotcubes ();
+#endif
+  memset (&vertex, 0, sizeof (vertex));
+  vertex.user = conn;
+  vertex.X = p4est_geometry_connectivity_X;
+  vertex.X_batch = p4est_geometry_connectivity_X_batch;
+  test_geometry_batch (&vertex, conn->num_trees);
+  test_geometry_cache (&vertex, conn->num_trees);
+  geom = p4est_geometry_new_connectivity (conn);
+  test_geometry_batch (geom, conn->num_trees);
+  test_geometry_J (geom, conn->num_trees);
+  p4est_geometry_destroy (geom);
+  p4est_connectivity_destroy (conn);
+
+#ifndef P4_TO_P8
+  conn = p4est_connectivity_new_icosahedron ();
+  geom = p4est_geometry_new_icosahedron (conn, 1.);
+  test_geometry_batch (geom, conn->num_trees);
+  test_geometry_J (geom, conn->num_trees);
+  p4est_geometry_destroy (geom);
+  p4est_connectivity_destroy (conn);
+
+  conn = p4est_connectivity_new_shell2d ();
+  geom = p4est_geometry_new_shell2d (conn, 1., .55);
+  test_geometry_batch (geom, conn->num_trees);
+  test_geometry_J (geom, conn->num_trees);
+  p4est_geometry_destroy (geom);
+  p4est_connectivity_destroy (conn);
+
+  conn = p4est_connectivity_new_disk2d ();
+  geom = p4est_geometry_new_disk2d (conn, .44, 1.);
+  test_geometry_batch (geom, conn->num_trees);
+  test_geometry_J (geom, conn->num_trees);
+  p4est_geometry_destroy (geom);
+  p4est_connectivity_destroy (conn);
+
+  conn = p4est_connectivity_new_cubed ();
+  geom = p4est_geometry_new_sphere2d (conn, 1.);
+  test_geometry_batch (geom, conn->num_trees);
+  test_geometry_J (geom, conn->num_trees);
+  p4est_geometry_destroy (geom);
+  p4est_connectivity_destroy (conn);
+#else
+  conn = p8est_connectivity_new_shell ();
+  geom = p8est_geometry_new_shell (conn, 1., .55);
+  test_geometry_batch (geom, conn->num_trees);
+  test_geometry_J (geom, conn->num_trees);
+  p4est_geometry_destroy (geom);
+  p4est_connectivity_destroy (conn);
+
+  conn = p8est_connectivity_new_sphere ();
+  geom = p8est_geometry_new_sphere (conn, 1., 0.191728, 0.039856);
+  test_geometry_batch (geom, conn->num_trees);
+  test_geometry_J (geom, conn->num_trees);
+  p4est_geometry_destroy (geom);
+  p4est_connectivity_destroy (conn);
+
+  conn = p8est_connectivity_new_torus (8);
+  geom = p8est_geometry_new_torus (conn, .44, 1., 3.);
+  test_geometry_batch (geom, conn->num_trees);
+  test_geometry_J (geom, conn->num_trees);
+  p4est_geometry_destroy (geom);
+  p4est_connectivity_destroy (conn);
+#endif
+}
+
+/* record of the quadrants visited by a reordered traversal */
+static sc_array_t  *order_trace;
+
+static int
+order_pre_callback (p4est_t * p4est, p4est_topidx_t which_tree,
+                    p4est_quadrant_t * quadrant, p4est_locidx_t local_num,
+                    void *point)
+{
+  long long          *entry;
+
+  entry = (long long *) sc_array_push_count (order_trace, 4);
+  entry[0] = (long long) which_tree;
+  entry[1] = (long long) p4est_quadrant_linear_id (quadrant,
+                                                   (int) quadrant->level);
+  entry[2] = (long long) quadrant->level;
+  entry[3] = (long long) local_num;
+  return 1;
+}
+
+/* vary the order between branches and stop below some of them */
+static int
+order_callback (p4est_t * p4est, p4est_topidx_t which_tree,
+                p4est_quadrant_t * quadrant)
+{
+  int                 id;
+
+  id = quadrant->level > 0 ? p4est_quadrant_child_id (quadrant) : 0;
+  if (quadrant->level == 2 && id == 1) {
+    return -1;
+  }
+  return (int) ((which_tree + quadrant->level + id) % P4EST_CHILDREN);
+}
+
+/* the same orders spelled out as a permutation of the children */
+static int
+order_reorder_callback (p4est_t * p4est, sc_array_t * quadrants,
+                        sc_array_t * indices)
+{
+  int                 order, i, j, k, key[P4EST_CHILDREN];
+  size_t              zz, zy;
+  p4est_topidx_t     *index, swap;
+  p4est_quadrant_t   *q, parent;
+
+  q = p4est_quadrant_array_index (quadrants, 0);
+  if (q->level == 0) {
+    /* keep the trees in ascending order */
+    return 1;
+  }
+  p4est_quadrant_parent (q, &parent);
+  order = order_callback (p4est, q->p.piggy1.which_tree, &parent);
+  if (order < 0) {
+    sc_array_resize (indices, 0);
+    return 1;
+  }
+
+  /* sort by the number of directions differing from the first child */
+  for (i = 0; i < P4EST_CHILDREN; ++i) {
+    for (k = 0, j = i ^ order; j > 0; j >>= 1) {
+      k += j & 1;
+    }
+    key[i] = k * P4EST_CHILDREN + (i ^ order);
+  }
+  index = (p4est_topidx_t *) indices->array;
+  for (zz = 1; zz < indices->elem_count; ++zz) {
+    for (zy = zz; zy > 0 && key[index[zy - 1]] > key[index[zy]]; --zy) {
+      swap = index[zy - 1];
+      index[zy - 1] = index[zy];
+      index[zy] = swap;
+    }
+  }
+  return 1;
+}
+
+static void
+test_search_order (p4est_t * p4est)
+{
+  sc_array_t         *reorder_trace;
+
+  /* the precomputed orders traverse as the equivalent permutations */
+  reorder_trace = order_trace = sc_array_new (sizeof (long long));
+  p4est_search_reorder (p4est, 0, order_reorder_callback,
+                        order_pre_callback, NULL, NULL, NULL);
+  order_trace = sc_array_new (sizeof (long long));
+  p4est_search_reorder_ext (p4est, 0, NULL, order_callback,
+                            order_pre_callback, NULL, NULL, NULL);
+  SC_CHECK_ABORT (sc_array_is_equal (order_trace, reorder_trace),
+                  "Search order");
+  SC_CHECK_ABORT (p4est->local_num_quadrants == 0 ||
+                  order_trace->elem_count > 0, "Search order visits");
+
+  sc_array_destroy (order_trace);
+  sc_array_destroy (reorder_trace);
+  order_trace = NULL;
+}
+
 int
 main (int argc, char **argv)
 {
@@ -642,6 +1866,38 @@ main (int argc, char **argv)
   p4est_search_local (p4est, 0, count_callback, NULL, NULL);
   SC_CHECK_ABORT (local_count == p4est->local_num_quadrants, "Count search");
 
+  /* Move points to the processes that own them */
+  test_points_migrate (p4est);
+
+  /* Translate cumulative numbers in batches */
+  test_cumulative_batch (p4est);
+
+  /* Build a forest from arbitrarily distributed points */
+  test_new_points_sort (p4est);
+
+  /* Locate points in the local and ghost leaves */
+  test_search_ghost (p4est);
+
+  /* Find the quadrants nearest to points */
+  test_search_nearest (p4est);
+
+  /* Trace rays through the forest */
+  test_search_rays (p4est);
+
+  /* Search the partition with a precomputed index */
+  test_search_index (p4est);
+
+  /* Traverse the children in precomputed orders */
+  test_search_order (p4est);
+
+  /* Refine to distributed bounding boxes */
+  test_objects_refine (p4est);
+
+  /* Repeat the searches with several threads */
+  p4est_set_num_threads (4);
+  test_search_threads (p4est);
+  p4est_set_num_threads (1);
+
   /* Clear memory */
   sc_array_destroy (points);
   p4est_destroy (p4est);
@@ -653,6 +1909,9 @@ main (int argc, char **argv)
   /* Test the build_local function and friends */
   test_build_local (mpicomm);
 
+  /* Transform points by the geometries */
+  test_geometries ();
+
   /* Finalize */
   sc_finalize ();
   mpiret = sc_MPI_Finalize ();
@@ -0,0 +1,365 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef P4_TO_P8
+#include <p4est_algorithms.h>
+#include <p4est_bits.h>
+#include <p4est_compact.h>
+#include <p4est_extended.h>
+#include <p4est_search.h>
+#include <p4est_soa.h>
+#else
+#include <p8est_algorithms.h>
+#include <p8est_bits.h>
+#include <p8est_compact.h>
+#include <p8est_extended.h>
+#include <p8est_search.h>
+#include <p8est_soa.h>
+#endif
+
+static int
+refine_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+           p4est_quadrant_t * quadrant)
+{
+  return ((int) which_tree + p4est_quadrant_child_id (quadrant)) % 3 == 0
+    && quadrant->level < 4;
+}
+
+/* compare the mirror entry by entry with the tree arrays */
+static void
+check_mirror (p4est_soa_t * soa)
+{
+  p4est_t            *p4est = soa->p4est;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      lid;
+  size_t              zz;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, r;
+
+  SC_CHECK_ABORT (p4est_soa_is_current (soa), "Mirror not current");
+  SC_CHECK_ABORT (soa->num_quadrants == p4est->local_num_quadrants,
+                  "Mirror quadrant count");
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    lid = p4est_soa_tree_offset (soa, jt);
+    SC_CHECK_ABORT (lid == tree->quadrants_offset, "Mirror tree offset");
+    SC_CHECK_ABORT (p4est_soa_tree_offset (soa, jt + 1) - lid ==
+                    (p4est_locidx_t) tree->quadrants.elem_count,
+                    "Mirror tree count");
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lid) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      p4est_soa_get_quadrant (soa, lid, &r);
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (q, &r), "Mirror quadrant");
+      SC_CHECK_ABORT (q->p.user_data == r.p.user_data, "Mirror user data");
+      SC_CHECK_ABORT (soa->level[lid] == q->level, "Mirror level");
+    }
+  }
+}
+
+/* the mirror searches must agree with the array searches */
+static void
+check_search (p4est_soa_t * soa)
+{
+  p4est_t            *p4est = soa->p4est;
+  p4est_topidx_t      jt;
+  size_t              zz, count, guess;
+  ssize_t             lo, hi, slo, shi;
+  int                 c;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, r;
+
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    count = tree->quadrants.elem_count;
+    for (zz = 0; zz < count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      guess = count / 2;
+
+      /* search for the quadrant itself, its first child and its parent */
+      for (c = 0; c < 3; ++c) {
+        if (c == 0) {
+          r = *q;
+        }
+        else if (c == 1) {
+          if (q->level == P4EST_QMAXLEVEL) {
+            continue;
+          }
+          p4est_quadrant_first_descendant (q, &r, q->level + 1);
+        }
+        else {
+          if (q->level == 0) {
+            continue;
+          }
+          p4est_quadrant_parent (q, &r);
+        }
+        lo = p4est_find_lower_bound (&tree->quadrants, &r, guess);
+        hi = p4est_find_higher_bound (&tree->quadrants, &r, guess);
+        slo = p4est_soa_find_lower_bound (soa, jt, &r, guess);
+        shi = p4est_soa_find_higher_bound (soa, jt, &r, guess);
+        SC_CHECK_ABORT (lo == slo, "Mirror lower bound");
+        SC_CHECK_ABORT (hi == shi, "Mirror higher bound");
+        if (c == 0) {
+          SC_CHECK_ABORT (lo == (ssize_t) zz && hi == (ssize_t) zz,
+                          "Mirror exact match");
+        }
+      }
+    }
+  }
+}
+
+/* the compact store must decode, search and expand like the forest */
+static void
+check_compact (p4est_t * p4est)
+{
+  p4est_topidx_t      jt;
+  p4est_locidx_t      lid;
+  size_t              zz;
+  ssize_t             hi;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, r;
+  p4est_compact_t    *compact;
+  p4est_t            *expanded;
+
+  compact = p4est_compact_new (p4est);
+  SC_CHECK_ABORT (compact->num_quadrants == p4est->local_num_quadrants,
+                  "Compact quadrant count");
+  SC_CHECK_ABORT (p4est_compact_memory_used (compact) > 0, "Compact memory");
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    lid = tree->quadrants_offset;
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lid) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      p4est_compact_get_quadrant (compact, lid, &r);
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (q, &r), "Compact quadrant");
+      if (zz > 0) {
+        SC_CHECK_ABORT (compact->keys[lid - 1] < compact->keys[lid],
+                        "Compact key order");
+      }
+
+      /* the leaf itself and its last descendant are found */
+      hi = p4est_compact_find_higher_bound (compact, jt, q);
+      SC_CHECK_ABORT (hi == (ssize_t) zz, "Compact exact match");
+      p4est_quadrant_last_descendant (q, &r, P4EST_QMAXLEVEL);
+      hi = p4est_compact_find_higher_bound (compact, jt, &r);
+      SC_CHECK_ABORT (hi == (ssize_t) zz, "Compact descendant match");
+      hi = p4est_find_higher_bound (&tree->quadrants, &r, 0);
+      SC_CHECK_ABORT (hi == (ssize_t) zz, "Compact array match");
+    }
+  }
+
+  expanded = p4est_compact_expand (compact, p4est->mpicomm,
+                                   p4est->connectivity, 0, NULL, NULL);
+  SC_CHECK_ABORT (p4est_is_equal (p4est, expanded, 0), "Compact expand");
+  p4est_destroy (expanded);
+  p4est_compact_destroy (compact);
+}
+
+/* host memory hooks that count the device allocations and copies */
+static void        *
+count_alloc (size_t bytes, void *user)
+{
+  ++((int *) user)[0];
+  return P4EST_ALLOC (char, bytes);
+}
+
+static void
+count_free (void *ptr, void *user)
+{
+  --((int *) user)[0];
+  P4EST_FREE (ptr);
+}
+
+static void
+count_copy (void *dst, const void *src, size_t bytes, void *user)
+{
+  ++((int *) user)[1];
+  memcpy (dst, src, bytes);
+}
+
+/* the device view must agree with the forest, ghost, mesh and lnodes */
+static void
+check_device (p4est_t * p4est)
+{
+  int                 counts[2], copies, f, nface, k;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      lid, nq, n;
+  size_t              zz;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  p4est_ghost_t      *ghost;
+  p4est_mesh_t       *mesh;
+  p4est_lnodes_t     *lnodes;
+  p4est_soa_allocator_t allocator;
+  p4est_soa_device_t *dev;
+  const p4est_soa_view_t *view;
+  const p4est_locidx_t *half;
+
+  ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+  mesh = p4est_mesh_new (p4est, ghost, P4EST_CONNECT_FACE);
+  lnodes = p4est_lnodes_new (p4est, ghost, 2);
+
+  counts[0] = counts[1] = 0;
+  allocator.alloc = count_alloc;
+  allocator.free = count_free;
+  allocator.copy = count_copy;
+  allocator.user = counts;
+  dev = p4est_soa_device_new (p4est, &allocator);
+  SC_CHECK_ABORT (counts[1] == 0, "Device copied early");
+  SC_CHECK_ABORT (p4est_soa_device_update (dev, ghost, mesh, lnodes, 0),
+                  "Device not written");
+  view = p4est_soa_device_view (dev);
+  nq = p4est->local_num_quadrants;
+  SC_CHECK_ABORT (view->num_quadrants == nq, "Device quadrant count");
+  SC_CHECK_ABORT (view->num_ghosts ==
+                  (p4est_locidx_t) ghost->ghosts.elem_count,
+                  "Device ghost count");
+
+  /* local quadrants followed by the ghosts */
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    lid = tree->quadrants_offset;
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lid) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      SC_CHECK_ABORT (view->x[lid] == q->x && view->y[lid] == q->y &&
+#ifdef P4_TO_P8
+                      view->z[lid] == q->z &&
+#endif
+                      view->level[lid] == q->level, "Device quadrant");
+      SC_CHECK_ABORT (view->which_tree[lid] == jt, "Device tree");
+      SC_CHECK_ABORT (p4est_soa_view_quadrant_len (view, lid) ==
+                      P4EST_QUADRANT_LEN (q->level), "Device length");
+      SC_CHECK_ABORT (p4est_soa_view_linear_id (view, lid, q->level) ==
+                      p4est_quadrant_linear_id (q, q->level),
+                      "Device linear id");
+    }
+  }
+  for (zz = 0; zz < ghost->ghosts.elem_count; ++zz) {
+    q = p4est_quadrant_array_index (&ghost->ghosts, zz);
+    lid = nq + (p4est_locidx_t) zz;
+    SC_CHECK_ABORT (view->x[lid] == q->x && view->level[lid] == q->level &&
+                    view->which_tree[lid] == q->p.piggy3.which_tree,
+                    "Device ghost");
+  }
+
+  /* neighbors and nodes */
+  n = view->num_quadrants + view->num_ghosts;
+  for (lid = 0; lid < nq; ++lid) {
+    for (f = 0; f < P4EST_FACES; ++f) {
+      SC_CHECK_ABORT (p4est_soa_view_face_neighbor (view, lid, f, &nface) ==
+                      mesh->quad_to_quad[P4EST_FACES * lid + f] &&
+                      nface == mesh->quad_to_face[P4EST_FACES * lid + f],
+                      "Device face neighbor");
+      if (nface < 0) {
+        half = p4est_soa_view_half_neighbors
+          (view, mesh->quad_to_quad[P4EST_FACES * lid + f]);
+        for (k = 0; k < P4EST_HALF; ++k) {
+          SC_CHECK_ABORT (0 <= half[k] && half[k] < n, "Device half");
+        }
+      }
+    }
+    for (k = 0; k < lnodes->vnodes; ++k) {
+      SC_CHECK_ABORT (p4est_soa_view_element_node (view, lid, k) ==
+                      lnodes->element_nodes[lnodes->vnodes * lid + k],
+                      "Device element node");
+    }
+  }
+
+  /* nothing is copied while the forest stays the same */
+  copies = counts[1];
+  SC_CHECK_ABORT (!p4est_soa_device_update (dev, ghost, mesh, lnodes, 0),
+                  "Device rewritten needlessly");
+  SC_CHECK_ABORT (counts[1] == copies, "Device copies");
+
+  /* detaching the mesh and lnodes drops their tables */
+  SC_CHECK_ABORT (p4est_soa_device_update (dev, ghost, NULL, NULL, 0),
+                  "Device not detached");
+  SC_CHECK_ABORT (view->quad_to_quad == NULL &&
+                  view->element_nodes == NULL, "Device detach");
+
+  p4est_soa_device_destroy (dev);
+  SC_CHECK_ABORT (counts[0] == 0, "Device buffers leaked");
+  p4est_lnodes_destroy (lnodes);
+  p4est_mesh_destroy (mesh);
+  p4est_ghost_destroy (ghost);
+}
+
+int
+main (int argc, char **argv)
+{
+  int                 mpiret;
+  sc_MPI_Comm         mpicomm;
+  p4est_t            *p4est;
+  p4est_connectivity_t *connectivity;
+  p4est_soa_t        *soa;
+
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  mpicomm = sc_MPI_COMM_WORLD;
+
+  sc_init (mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+#ifndef P4_TO_P8
+  connectivity = p4est_connectivity_new_star ();
+#else
+  connectivity = p8est_connectivity_new_rotcubes ();
+#endif
+  p4est = p4est_new_ext (mpicomm, connectivity, 0, 1, 1, 0, NULL, NULL);
+
+  soa = p4est_soa_new (p4est);
+  check_mirror (soa);
+  check_search (soa);
+  SC_CHECK_ABORT (!p4est_soa_update (soa, 0), "Mirror rebuilt needlessly");
+
+  /* the mirror goes stale when the mesh changes */
+  p4est_refine (p4est, 1, refine_fn, NULL);
+  p4est_partition (p4est, 0, NULL);
+  SC_CHECK_ABORT (!p4est_soa_is_current (soa), "Mirror staleness");
+  SC_CHECK_ABORT (p4est_soa_update (soa, 0), "Mirror not rebuilt");
+  check_mirror (soa);
+  check_search (soa);
+
+  p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
+  p4est_soa_update (soa, 0);
+  check_mirror (soa);
+  check_search (soa);
+  check_compact (p4est);
+  check_device (p4est);
+
+  /* resetting the user data requires a forced update */
+  p4est_reset_data (p4est, 0, NULL, NULL);
+  SC_CHECK_ABORT (p4est_soa_update (soa, 1), "Mirror not forced");
+  check_mirror (soa);
+
+  p4est_soa_destroy (soa);
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (connectivity);
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
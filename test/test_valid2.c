@@ -27,18 +27,27 @@
 #endif
 
 #ifndef P4_TO_P8
+#include <p4est_algorithms.h>
 #include <p4est_bits.h>
+#include <p4est_communication.h>
 #include <p4est_extended.h>
 #include <p4est_ghost.h>
+#include <p4est_lnodes.h>
 #include <p4est_nodes.h>
 #include <p4est_vtk.h>
 #else
+#include <p8est_algorithms.h>
 #include <p8est_bits.h>
+#include <p8est_communication.h>
 #include <p8est_extended.h>
 #include <p8est_ghost.h>
+#include <p8est_lnodes.h>
 #include <p8est_nodes.h>
 #include <p8est_vtk.h>
 #endif
+#ifdef P4EST_WITH_HDF5
+#include <hdf5.h>
+#endif
 
 #ifndef P4_TO_P8
 static const int    refine_level = 5;
@@ -95,6 +104,485 @@ coarsen_fn (p4est_t * p4est, p4est_topidx_t which_tree,
   return pid == 3;
 }
 
+static void
+check_valid_ext (p4est_t * p4est)
+{
+  int                 corrupt;
+  size_t              k;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, swap;
+
+  /* a passed check clears the flags of the changed trees */
+  p4est_set_valid_incremental (p4est, 1);
+  SC_CHECK_ABORT (p4est_is_valid_ext (p4est, P4EST_VALID_SAMPLED, .1),
+                  "Valid sampled");
+  SC_CHECK_ABORT (p4est->valid_dirty[p4est->connectivity->num_trees - 1],
+                  "Valid sample keeps flags");
+  SC_CHECK_ABORT (p4est_is_valid_ext (p4est, P4EST_VALID_CHANGED, 0.),
+                  "Valid changed");
+  for (jt = 0; jt < p4est->connectivity->num_trees; ++jt) {
+    SC_CHECK_ABORT (!p4est->valid_dirty[jt], "Valid flags cleared");
+  }
+  SC_CHECK_ABORT (p4est->valid_revision == p4est->revision,
+                  "Valid revision");
+
+  /* swapping two interior quadrants escapes the per-tree counters */
+  corrupt = 0;
+  tree = NULL;
+  k = 0;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    if (tree->quadrants.elem_count >= 4) {
+      k = tree->quadrants.elem_count / 2;
+      q = p4est_quadrant_array_index (&tree->quadrants, k);
+      swap = q[0];
+      q[0] = q[1];
+      q[1] = swap;
+      corrupt = 1;
+      break;
+    }
+  }
+  corrupt = p4est_comm_sync_flag (p4est, corrupt, sc_MPI_BOR);
+  SC_CHECK_ABORT (!corrupt ||
+                  !p4est_is_valid_ext (p4est, P4EST_VALID_SAMPLED, 1.),
+                  "Valid sample of all quadrants");
+  SC_CHECK_ABORT (!corrupt ||
+                  !p4est_is_valid_ext (p4est, P4EST_VALID_FULL, 0.),
+                  "Valid full");
+  if (tree != NULL && k > 0) {
+    q = p4est_quadrant_array_index (&tree->quadrants, k);
+    swap = q[0];
+    q[0] = q[1];
+    q[1] = swap;
+  }
+  SC_CHECK_ABORT (p4est_is_valid_ext (p4est, P4EST_VALID_FULL, 0.),
+                  "Valid restored");
+  p4est_set_valid_incremental (p4est, 0);
+}
+
+/* count the pieces of a .vtu file and sum up their points and cells */
+static int
+scan_vtu_pieces (const char *filename, long long *points, long long *cells)
+{
+  int                 pieces;
+  long long           np, nc;
+  char                line[BUFSIZ];
+  const char         *s;
+  FILE               *file;
+
+  pieces = 0;
+  *points = *cells = 0;
+  file = fopen (filename, "rb");
+  SC_CHECK_ABORTF (file != NULL, "Open %s", filename);
+  while (fgets (line, BUFSIZ, file) != NULL) {
+    if ((s = strstr (line, "<Piece NumberOfPoints=")) != NULL &&
+        sscanf (s, "<Piece NumberOfPoints=\"%lld\" NumberOfCells=\"%lld\"",
+                &np, &nc) == 2) {
+      *points += np;
+      *cells += nc;
+      ++pieces;
+    }
+  }
+  SC_CHECK_ABORT (!fclose (file), "Close vtu file");
+  return pieces;
+}
+
+/* all processes write their pieces into one .vtu file */
+static void
+check_vtk_single (p4est_t * p4est, const char *vtkname)
+{
+  int                 retval;
+  long long           points, cells;
+  char                filename[BUFSIZ];
+  p4est_vtk_context_t *cont;
+
+  snprintf (filename, BUFSIZ, "%s_single", vtkname);
+  cont = p4est_vtk_context_new (p4est, filename);
+  p4est_vtk_context_set_single_file (cont, 1);
+  cont = p4est_vtk_write_header (cont);
+  SC_CHECK_ABORT (cont != NULL, "Single file header");
+  cont = p4est_vtk_write_cell_dataf (cont, 1, 1, 1, 0, 0, 0, cont);
+  SC_CHECK_ABORT (cont != NULL, "Single file cell data");
+  retval = p4est_vtk_write_footer (cont);
+  SC_CHECK_ABORT (!retval, "Single file footer");
+
+  if (p4est->mpirank == 0) {
+    snprintf (filename, BUFSIZ, "%s_single.vtu", vtkname);
+    SC_CHECK_ABORT (scan_vtu_pieces (filename, &points, &cells) ==
+                    p4est->mpisize, "Single file pieces");
+    SC_CHECK_ABORT (cells == (long long) p4est->global_num_quadrants,
+                    "Single file cells");
+    SC_CHECK_ABORT (points == P4EST_CHILDREN * cells, "Single file points");
+  }
+}
+
+/* the VTKHDF file holds one partition per process */
+static void
+check_vtk_hdf5 (p4est_t * p4est, const char *vtkname)
+{
+  char                filename[BUFSIZ];
+  p4est_vtk_hdf5_t   *h5;
+#ifdef P4EST_WITH_HDF5
+  int                 p;
+  int64_t            *cells, sum;
+  double             *values;
+  size_t              zz;
+  sc_array_t         *cell_values, *point_values;
+  hid_t               file, dset;
+  herr_t              status;
+#endif
+
+  snprintf (filename, BUFSIZ, "%s.vtkhdf", vtkname);
+  h5 = p4est_vtk_hdf5_open (p4est, NULL, .95, filename);
+#ifdef P4EST_WITH_HDF5
+  SC_CHECK_ABORT (h5 != NULL, "VTKHDF open");
+
+  cell_values = sc_array_new_count (sizeof (double),
+                                    (size_t) p4est->local_num_quadrants);
+  point_values = sc_array_new_count (sizeof (double), P4EST_CHILDREN *
+                                     (size_t) p4est->local_num_quadrants);
+  values = (double *) cell_values->array;
+  for (zz = 0; zz < cell_values->elem_count; ++zz) {
+    values[zz] = (double) zz;
+  }
+  values = (double *) point_values->array;
+  for (zz = 0; zz < point_values->elem_count; ++zz) {
+    values[zz] = (double) (zz % P4EST_CHILDREN);
+  }
+  h5 = p4est_vtk_hdf5_write_cell_data (h5, "index", 1, cell_values);
+  SC_CHECK_ABORT (h5 != NULL, "VTKHDF cell data");
+  h5 = p4est_vtk_hdf5_write_point_data (h5, "corner", 1, point_values);
+  SC_CHECK_ABORT (h5 != NULL, "VTKHDF point data");
+  SC_CHECK_ABORT (p4est_vtk_hdf5_close (h5) == 0, "VTKHDF close");
+  sc_array_destroy (cell_values);
+  sc_array_destroy (point_values);
+
+  if (p4est->mpirank == 0) {
+    cells = P4EST_ALLOC (int64_t, p4est->mpisize);
+    file = H5Fopen (filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+    SC_CHECK_ABORT (file >= 0, "VTKHDF reopen");
+    dset = H5Dopen2 (file, "VTKHDF/NumberOfCells", H5P_DEFAULT);
+    SC_CHECK_ABORT (dset >= 0, "VTKHDF cell counts");
+    status = H5Dread (dset, H5T_NATIVE_INT64, H5S_ALL, H5S_ALL,
+                      H5P_DEFAULT, cells);
+    SC_CHECK_ABORT (status >= 0, "VTKHDF read cell counts");
+    H5Dclose (dset);
+    H5Fclose (file);
+    sum = 0;
+    for (p = 0; p < p4est->mpisize; ++p) {
+      SC_CHECK_ABORT (cells[p] == p4est->global_first_quadrant[p + 1] -
+                      p4est->global_first_quadrant[p], "VTKHDF partition");
+      sum += cells[p];
+    }
+    SC_CHECK_ABORT (sum == (int64_t) p4est->global_num_quadrants,
+                    "VTKHDF cells");
+    P4EST_FREE (cells);
+  }
+#else
+  SC_CHECK_ABORT (h5 == NULL, "VTKHDF unavailable");
+#endif
+}
+
+/* read a whole file into a newly allocated buffer */
+static char        *
+read_file (const char *filename, size_t *size)
+{
+  long                length;
+  char               *buffer;
+  FILE               *file;
+
+  file = fopen (filename, "rb");
+  SC_CHECK_ABORTF (file != NULL, "Open %s", filename);
+  SC_CHECK_ABORT (!fseek (file, 0, SEEK_END) && (length = ftell (file)) >= 0,
+                  "Size of file");
+  rewind (file);
+  *size = (size_t) length;
+  buffer = P4EST_ALLOC (char, *size + 1);
+  SC_CHECK_ABORT (fread (buffer, 1, *size, file) == *size, "Read file");
+  SC_CHECK_ABORT (!fclose (file), "Close file");
+  return buffer;
+}
+
+/* the compression level changes the size, the thread count nothing */
+static void
+check_vtk_compression (p4est_t * p4est, const char *vtkname)
+{
+  const int           levels[3] = { 9, 9, 0 };
+  const int           threads[3] = { 1, 4, 1 };
+  const int           num_threads = p4est_get_num_threads ();
+  int                 k, retval;
+  char                filename[BUFSIZ];
+  char               *content[3];
+  size_t              size[3];
+  p4est_vtk_context_t *cont;
+
+  for (k = 0; k < 3; ++k) {
+    p4est_set_num_threads (threads[k]);
+    snprintf (filename, BUFSIZ, "%s_level%d", vtkname, k);
+    cont = p4est_vtk_context_new (p4est, filename);
+    p4est_vtk_context_set_compression_level (cont, levels[k]);
+    cont = p4est_vtk_write_header (cont);
+    SC_CHECK_ABORT (cont != NULL, "Compression header");
+    cont = p4est_vtk_write_cell_dataf (cont, 1, 1, 1, 0, 0, 0, cont);
+    SC_CHECK_ABORT (cont != NULL, "Compression cell data");
+    retval = p4est_vtk_write_footer (cont);
+    SC_CHECK_ABORT (!retval, "Compression footer");
+
+    snprintf (filename, BUFSIZ, "%s_level%d_%04d.vtu", vtkname, k,
+              p4est->mpirank);
+    content[k] = read_file (filename, &size[k]);
+  }
+  p4est_set_num_threads (num_threads);
+
+  SC_CHECK_ABORT (size[0] == size[1] &&
+                  !memcmp (content[0], content[1], size[0]),
+                  "Compression independent of threads");
+#if defined P4EST_ENABLE_VTK_BINARY && \
+    defined P4EST_ENABLE_VTK_COMPRESSION && defined P4EST_HAVE_ZLIB
+  SC_CHECK_ABORT (size[2] > size[0], "Compression level");
+#else
+  SC_CHECK_ABORT (size[2] == size[0], "Compression level ignored");
+#endif
+  for (k = 0; k < 3; ++k) {
+    P4EST_FREE (content[k]);
+  }
+}
+
+/* truncated output writes one cell per ancestor at the maximum level */
+static void
+check_vtk_max_level (p4est_t * p4est, const char *vtkname)
+{
+  const int           max_level = 2;
+  int                 retval;
+  long long           points, cells, expected;
+  char                filename[BUFSIZ];
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, a, prev;
+  sc_array_t         *values;
+  p4est_vtk_context_t *cont;
+
+  expected = 0;
+  values = sc_array_new (sizeof (double));
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      *(double *) sc_array_push (values) = (double) q->level;
+      if (q->level > max_level) {
+        p4est_quadrant_ancestor (q, max_level, &a);
+      }
+      else {
+        a = *q;
+      }
+      if (zz == 0 || !p4est_quadrant_is_equal (&a, &prev)) {
+        ++expected;
+      }
+      prev = a;
+    }
+  }
+
+  snprintf (filename, BUFSIZ, "%s_truncated", vtkname);
+  cont = p4est_vtk_context_new (p4est, filename);
+  p4est_vtk_context_set_max_level (cont, max_level, P4EST_VTK_REDUCE_MAX);
+  cont = p4est_vtk_write_header (cont);
+  SC_CHECK_ABORT (cont != NULL, "Truncated header");
+  cont = p4est_vtk_write_cell_dataf (cont, 1, 1, 1, 0, 1, 0,
+                                     "level", values, cont);
+  SC_CHECK_ABORT (cont != NULL, "Truncated cell data");
+  retval = p4est_vtk_write_footer (cont);
+  SC_CHECK_ABORT (!retval, "Truncated footer");
+  sc_array_destroy (values);
+
+  snprintf (filename, BUFSIZ, "%s_truncated_%04d.vtu", vtkname,
+            p4est->mpirank);
+  SC_CHECK_ABORT (scan_vtu_pieces (filename, &points, &cells) == 1,
+                  "Truncated piece");
+  SC_CHECK_ABORT (cells == expected, "Truncated cells");
+  SC_CHECK_ABORT (points == P4EST_CHILDREN * expected, "Truncated points");
+}
+
+/* the merged mesh keeps the position of the first corner of each point */
+static void
+check_vtk_mesh (p4est_t * p4est)
+{
+  int                 j;
+  p4est_locidx_t      il, point, corner;
+  p4est_vtk_mesh_t   *corners, *merged;
+
+  corners = p4est_vtk_mesh_new (p4est, NULL, 1., 0, NULL);
+  SC_CHECK_ABORT (corners->num_cells == p4est->local_num_quadrants,
+                  "Mesh cells");
+  SC_CHECK_ABORT (corners->num_corners == P4EST_CHILDREN * corners->num_cells
+                  && corners->num_points == corners->num_corners &&
+                  corners->point_to_corner == NULL, "Mesh corners");
+  for (il = 0; il < corners->num_corners; ++il) {
+    SC_CHECK_ABORT (corners->connectivity[il] == il, "Mesh corner points");
+  }
+
+  merged = p4est_vtk_mesh_new (p4est, NULL, 1., 1, NULL);
+  SC_CHECK_ABORT (merged->num_corners == corners->num_corners &&
+                  merged->num_points <= merged->num_corners &&
+                  merged->point_to_corner != NULL, "Mesh merged");
+  for (il = 0; il < merged->num_corners; ++il) {
+    point = merged->connectivity[il];
+    SC_CHECK_ABORT (0 <= point && point < merged->num_points,
+                    "Mesh merged connectivity");
+  }
+  for (point = 0; point < merged->num_points; ++point) {
+    corner = merged->point_to_corner[point];
+    SC_CHECK_ABORT (merged->connectivity[corner] == point,
+                    "Mesh point to corner");
+    for (j = 0; j < 3; ++j) {
+      SC_CHECK_ABORT (merged->coordinates[3 * point + j] ==
+                      corners->coordinates[3 * corner + j],
+                      "Mesh merged coordinates");
+    }
+  }
+
+  p4est_vtk_mesh_destroy (corners);
+  p4est_vtk_mesh_destroy (merged);
+}
+
+/* continuous output of a uniform forest writes each lnodes node once */
+static void
+check_vtk_lnodes (sc_MPI_Comm mpicomm, p4est_connectivity_t * conn,
+                  const char *vtkname)
+{
+  int                 retval;
+  long long           points, cells;
+  char                filename[BUFSIZ];
+  p4est_t            *p4est;
+  p4est_ghost_t      *ghost;
+  p4est_lnodes_t     *lnodes;
+  p4est_vtk_context_t *cont;
+
+  p4est = p4est_new_ext (mpicomm, conn, 0, 2, 1, 0, NULL, NULL);
+  ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+  lnodes = p4est_lnodes_new (p4est, ghost, 1);
+
+  snprintf (filename, BUFSIZ, "%s_lnodes", vtkname);
+  cont = p4est_vtk_context_new (p4est, filename);
+  p4est_vtk_context_set_scale (cont, 1.);
+  p4est_vtk_context_set_continuous (cont, 1);
+  p4est_vtk_context_set_lnodes (cont, lnodes);
+  cont = p4est_vtk_write_header (cont);
+  SC_CHECK_ABORT (cont != NULL, "Lnodes header");
+  retval = p4est_vtk_write_footer (cont);
+  SC_CHECK_ABORT (!retval, "Lnodes footer");
+
+  snprintf (filename, BUFSIZ, "%s_lnodes_%04d.vtu", vtkname, p4est->mpirank);
+  SC_CHECK_ABORT (scan_vtu_pieces (filename, &points, &cells) == 1,
+                  "Lnodes piece");
+  SC_CHECK_ABORT (cells == (long long) p4est->local_num_quadrants,
+                  "Lnodes cells");
+  SC_CHECK_ABORT (points == (long long) lnodes->num_local_nodes,
+                  "Lnodes points");
+
+  p4est_lnodes_destroy (lnodes);
+  p4est_ghost_destroy (ghost);
+  p4est_destroy (p4est);
+}
+
+/* equidistant points of a quadrant in the reference space of its tree */
+static void
+ho_points_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+              p4est_quadrant_t * quadrant, int Nnodes1D, double *xyz,
+              void *user)
+{
+  const double        h = P4EST_QUADRANT_LEN (quadrant->level) /
+    (double) (Nnodes1D - 1);
+#ifndef P4_TO_P8
+  const int           Nz = 1;
+#else
+  const int           Nz = Nnodes1D;
+#endif
+  int                 i, j, k;
+
+  *(int *) user += 1;
+  for (k = 0; k < Nz; ++k) {
+    for (j = 0; j < Nnodes1D; ++j) {
+      for (i = 0; i < Nnodes1D; ++i, xyz += 3) {
+        xyz[0] = which_tree + (quadrant->x + i * h) / P4EST_ROOT_LEN;
+        xyz[1] = (quadrant->y + j * h) / P4EST_ROOT_LEN;
+#ifdef P4_TO_P8
+        xyz[2] = (quadrant->z + k * h) / P4EST_ROOT_LEN;
+#endif
+      }
+    }
+  }
+}
+
+/* streaming the high order points writes the same file as the array */
+static void
+check_vtk_ho_fn (p4est_t * p4est, const char *vtkname)
+{
+  const int           Nnodes1D = 3;
+  int                 k, retval, calls;
+  size_t              zz, sk, Npointscell, size[2];
+  double             *pos, xyz[3 * 27];
+  char                filename[BUFSIZ];
+  char               *content[2];
+  sc_array_t         *positions;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_vtk_context_t *cont;
+
+  Npointscell = Nnodes1D * Nnodes1D;
+#ifdef P4_TO_P8
+  Npointscell *= Nnodes1D;
+#endif
+  positions = sc_array_new_count (sizeof (double), (size_t) P4EST_DIM *
+                                  Npointscell * p4est->local_num_quadrants);
+  pos = (double *) positions->array;
+  for (calls = 0, jt = p4est->first_local_tree;
+       jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      ho_points_fn (p4est, jt, p4est_quadrant_array_index (&tree->quadrants,
+                                                           zz),
+                    Nnodes1D, xyz, &calls);
+      for (sk = 0; sk < Npointscell; ++sk) {
+        for (k = 0; k < P4EST_DIM; ++k) {
+          *pos++ = xyz[3 * sk + k];
+        }
+      }
+    }
+  }
+
+  for (k = 0; k < 2; ++k) {
+    snprintf (filename, BUFSIZ, "%s_ho%d", vtkname, k);
+    cont = p4est_vtk_context_new (p4est, filename);
+    calls = 0;
+    if (k == 0) {
+      cont = p4est_vtk_write_header_ho (cont, positions, Nnodes1D);
+    }
+    else {
+      cont = p4est_vtk_write_header_ho_fn (cont, ho_points_fn, &calls,
+                                           Nnodes1D);
+      SC_CHECK_ABORT (calls == (int) p4est->local_num_quadrants,
+                      "High order points calls");
+    }
+    SC_CHECK_ABORT (cont != NULL, "High order header");
+    retval = p4est_vtk_write_footer (cont);
+    SC_CHECK_ABORT (!retval, "High order footer");
+
+    snprintf (filename, BUFSIZ, "%s_ho%d_%04d.vtu", vtkname, k,
+              p4est->mpirank);
+    content[k] = read_file (filename, &size[k]);
+  }
+  SC_CHECK_ABORT (size[0] == size[1] &&
+                  !memcmp (content[0], content[1], size[0]),
+                  "High order points from callback");
+
+  for (k = 0; k < 2; ++k) {
+    P4EST_FREE (content[k]);
+  }
+  sc_array_destroy (positions);
+}
+
 static void
 check_all (sc_MPI_Comm mpicomm, p4est_connectivity_t * conn,
            const char *vtkname, unsigned crc_expected,
@@ -124,6 +612,14 @@ check_all (sc_MPI_Comm mpicomm, p4est_connectivity_t * conn,
   p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
   p4est_partition (p4est, 0, NULL);
   p4est_vtk_write_file (p4est, NULL, vtkname);
+  check_vtk_single (p4est, vtkname);
+  check_vtk_hdf5 (p4est, vtkname);
+  check_vtk_compression (p4est, vtkname);
+  check_vtk_mesh (p4est);
+  check_vtk_max_level (p4est, vtkname);
+  check_vtk_lnodes (mpicomm, conn, vtkname);
+  check_vtk_ho_fn (p4est, vtkname);
+  check_valid_ext (p4est);
 
   crc_computed = have_zlib ? p4est_checksum (p4est) : 0;
   crc_partition_computed = have_zlib ? p4est_checksum_partition (p4est) : 0;
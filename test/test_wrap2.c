@@ -23,8 +23,10 @@
 */
 
 #ifndef P4_TO_P8
+#include <p4est_bits.h>
 #include <p4est_wrap.h>
 #else
+#include <p8est_bits.h>
 #include <p8est_wrap.h>
 #endif
 
@@ -69,7 +71,7 @@ test_coarsen_delay (p4est_wrap_t * wrap)
 
   wrap_adapt_partition (wrap, 1);
 
-  /* copies must be destroyed before the original is destroyed, in any order */
+  /* copies may be destroyed in any order */
   p4est_wrap_destroy (copy1);
 
   for (jl = 0, leaf = p4est_wrap_leaf_first (wrap, 1); leaf != NULL;
@@ -78,10 +80,317 @@ test_coarsen_delay (p4est_wrap_t * wrap)
   }
   wrap_adapt_partition (wrap, 1);
 
-  /* copies must be destroyed before the original is destroyed, anywhere */
+  /* the second copy holds the last reference to the shared quadrants */
   p4est_wrap_destroy (copy2);
 }
 
+static int
+refine_first_child (p4est_t * p4est, p4est_topidx_t which_tree,
+                    p4est_quadrant_t * quadrant)
+{
+  return p4est_quadrant_child_id (quadrant) == 0;
+}
+
+static void
+test_copy_shared (p4est_wrap_t * wrap)
+{
+  unsigned            crc;
+  p4est_t            *p4est;
+  p4est_wrap_t       *source, *copy;
+
+  /* a copy may outlive its source and keeps the connectivity */
+  crc = p4est_checksum (wrap->p4est);
+  source = p4est_wrap_new_copy (wrap, 0, NULL, NULL);
+  copy = p4est_wrap_new_copy (source, 0, NULL, NULL);
+  SC_CHECK_ABORT (copy->conn == wrap->conn, "Copy connectivity");
+  p4est_wrap_destroy (source);
+  SC_CHECK_ABORT (p4est_checksum (copy->p4est) == crc, "Copy shared");
+
+  /* changing one forest leaves the others sharing the quadrants intact */
+  p4est = p4est_copy_shared (copy->p4est, 0);
+  p4est_refine (p4est, 0, refine_first_child, NULL);
+  SC_CHECK_ABORT (p4est->global_num_quadrants >
+                  copy->p4est->global_num_quadrants, "Refine shared");
+  SC_CHECK_ABORT (p4est_checksum (copy->p4est) == crc, "Copy unshared");
+  SC_CHECK_ABORT (p4est_checksum (wrap->p4est) == crc, "Source unshared");
+  p4est_destroy (p4est);
+
+  p4est_wrap_destroy (copy);
+  SC_CHECK_ABORT (p4est_checksum (wrap->p4est) == crc, "Source intact");
+}
+
+static void
+test_monitor (p4est_wrap_t * wrap)
+{
+  const int           num_procs = wrap->p4est->mpisize;
+
+  /* nothing measured, nothing to do */
+  SC_CHECK_ABORT (!p4est_wrap_monitor_check (wrap, 10), "Monitor empty");
+
+  /* all cost on the first process pays off over a long horizon */
+  p4est_wrap_monitor_add (wrap, wrap->p4est->mpirank == 0 ? 1e3 : 1e-3);
+  if (num_procs > 1 && wrap->p4est->global_first_quadrant[1] >= num_procs) {
+    SC_CHECK_ABORT (p4est_wrap_monitor_check (wrap, 1 << 30),
+                    "Monitor imbalance");
+  }
+  else {
+    (void) p4est_wrap_monitor_check (wrap, 1 << 30);
+  }
+
+  /* a repartition resets the monitor */
+  if (wrap->p4est->local_num_quadrants > 0) {
+    p4est_wrap_mark_refine (wrap, wrap->p4est->first_local_tree, 0);
+  }
+  (void) wrap_adapt_partition (wrap, 0);
+  SC_CHECK_ABORT (!p4est_wrap_monitor_check (wrap, 10), "Monitor reset");
+}
+
+/* compare the batch leaf information with the leaf iterator */
+static void
+test_leaf_batch (p4est_wrap_t * wrap)
+{
+  const p4est_locidx_t chunk = 7;
+  p4est_locidx_t      jl, first, count;
+  p4est_locidx_t      which_quad[7];
+  p4est_topidx_t      which_tree[7];
+  p4est_qcoord_t      coords[7 * P4EST_DIM];
+  int8_t              level[7], is_mirror[7];
+  p4est_wrap_leaf_t  *leaf;
+
+  first = count = 0;
+  for (jl = 0, leaf = p4est_wrap_leaf_first (wrap, 1); leaf != NULL;
+       jl++, leaf = p4est_wrap_leaf_next (leaf)) {
+    if (jl == first + count) {
+      first = jl;
+      count = p4est_wrap_leaf_batch (wrap, first, chunk, which_tree,
+                                     which_quad, level, coords, is_mirror);
+      SC_CHECK_ABORT (count > 0, "Leaf batch count");
+    }
+    SC_CHECK_ABORT (which_tree[jl - first] == leaf->which_tree &&
+                    which_quad[jl - first] == leaf->which_quad &&
+                    level[jl - first] == leaf->quad->level &&
+                    coords[P4EST_DIM * (jl - first)] == leaf->quad->x &&
+                    coords[P4EST_DIM * (jl - first) + 1] == leaf->quad->y &&
+#ifdef P4_TO_P8
+                    coords[P4EST_DIM * (jl - first) + 2] == leaf->quad->z &&
+#endif
+                    is_mirror[jl - first] == leaf->is_mirror, "Leaf batch");
+  }
+  SC_CHECK_ABORT (jl == first + count, "Leaf batch end");
+  SC_CHECK_ABORT (p4est_wrap_leaf_batch (wrap, jl, chunk, NULL, NULL,
+                                         NULL, NULL, is_mirror) == 0,
+                  "Leaf batch empty");
+}
+
+static void
+mark_every_third (p4est_wrap_t * wrap)
+{
+  p4est_wrap_leaf_t  *leaf;
+
+  for (leaf = p4est_wrap_leaf_first (wrap, 0); leaf != NULL;
+       leaf = p4est_wrap_leaf_next (leaf)) {
+    if (leaf->which_quad % 3 == 0) {
+      p4est_wrap_mark_refine (wrap, leaf->which_tree, leaf->which_quad);
+    }
+  }
+}
+
+/* set the marks of mark_every_third by one of the batch functions */
+static void
+mark_every_third_batch (p4est_wrap_t * wrap, int use_bitset)
+{
+  const p4est_locidx_t num = wrap->p4est->local_num_quadrants;
+  p4est_locidx_t      jl, num_refine;
+  p4est_wrap_leaf_t  *leaf;
+  double             *values;
+  uint8_t            *bits;
+
+  values = P4EST_ALLOC (double, num);
+  bits = P4EST_ALLOC_ZERO (uint8_t, num / 8 + 1);
+  num_refine = 0;
+  for (jl = 0, leaf = p4est_wrap_leaf_first (wrap, 0); leaf != NULL;
+       jl++, leaf = p4est_wrap_leaf_next (leaf)) {
+    values[jl] = leaf->which_quad % 3 == 0 ? 1. : .5;
+    if (leaf->which_quad % 3 == 0) {
+      bits[jl / 8] |= 1 << (jl % 8);
+      ++num_refine;
+    }
+  }
+  if (use_bitset) {
+    p4est_wrap_mark_bitset (wrap, bits, NULL);
+  }
+  else {
+    SC_CHECK_ABORT (p4est_wrap_mark_threshold (wrap, values, .75, .25) ==
+                    num_refine, "Mark threshold");
+  }
+  P4EST_FREE (values);
+  P4EST_FREE (bits);
+}
+
+static void
+test_adapt_partition (sc_MPI_Comm mpicomm)
+{
+  int                 loop, i;
+  double              stage_times[P4EST_WRAP_STAGE_COUNT];
+  p4est_locidx_t      uf, ul;
+  p4est_wrap_t       *twostep, *fused;
+
+#ifndef P4_TO_P8
+  twostep = p4est_wrap_new_rotwrap (mpicomm, 0);
+  fused = p4est_wrap_new_rotwrap (mpicomm, 0);
+#else
+  twostep = p8est_wrap_new_rotwrap (mpicomm, 0);
+  fused = p8est_wrap_new_rotwrap (mpicomm, 0);
+#endif
+
+  /* the fused pipeline produces the same forest as adapt and partition */
+  for (loop = 0; loop < 2; ++loop) {
+    mark_every_third (twostep);
+    mark_every_third_batch (fused, loop);
+    SC_CHECK_ABORT (wrap_adapt_partition (twostep, 1), "Two step refine");
+    SC_CHECK_ABORT (p4est_wrap_adapt_partition (fused, 1, &uf, &ul, NULL,
+                                                stage_times), "Fused refine");
+    SC_CHECK_ABORT (uf >= 0 && ul >= 0 &&
+                    uf + ul <= fused->p4est->local_num_quadrants,
+                    "Fused post window");
+    for (i = 0; i < P4EST_WRAP_STAGE_COUNT; ++i) {
+      SC_CHECK_ABORT (stage_times[i] >= 0., "Fused stage times");
+    }
+    SC_CHECK_ABORT (p4est_checksum (twostep->p4est) ==
+                    p4est_checksum (fused->p4est), "Fused checksum");
+    SC_CHECK_ABORT (p4est_wrap_get_mesh (fused)->local_num_quadrants ==
+                    fused->p4est->local_num_quadrants, "Fused mesh");
+  }
+
+  /* without marks nothing changes */
+  SC_CHECK_ABORT (!p4est_wrap_adapt_partition (fused, 0, NULL, NULL, NULL,
+                                               NULL), "Fused noop");
+
+  p4est_wrap_destroy (twostep);
+  p4est_wrap_destroy (fused);
+}
+
+/* mark by the leaves themselves, independent of the partition */
+static p4est_locidx_t
+mark_first_child (p4est_wrap_t * wrap, int coarsen)
+{
+  p4est_locidx_t      num_refine = 0;
+  p4est_wrap_leaf_t  *leaf;
+
+  for (leaf = p4est_wrap_leaf_first (wrap, 0); leaf != NULL;
+       leaf = p4est_wrap_leaf_next (leaf)) {
+    if (p4est_quadrant_child_id (leaf->quad) == 0) {
+      p4est_wrap_mark_refine (wrap, leaf->which_tree, leaf->which_quad);
+      ++num_refine;
+    }
+    else if (coarsen) {
+      p4est_wrap_mark_coarsen (wrap, leaf->which_tree, leaf->which_quad);
+    }
+  }
+  return num_refine;
+}
+
+/* partitioning for the predicted forest keeps the marks with the leaves */
+static void
+test_partition_predict (sc_MPI_Comm mpicomm)
+{
+  int                 loop;
+  p4est_locidx_t      uf, ul, uof, num_refine;
+  p4est_wrap_t       *plain, *predict;
+
+#ifndef P4_TO_P8
+  plain = p4est_wrap_new_rotwrap (mpicomm, 1);
+  predict = p4est_wrap_new_rotwrap (mpicomm, 1);
+#else
+  plain = p8est_wrap_new_rotwrap (mpicomm, 1);
+  predict = p8est_wrap_new_rotwrap (mpicomm, 1);
+#endif
+
+  for (loop = 0; loop < 3; ++loop) {
+    (void) mark_first_child (plain, loop == 2);
+    num_refine = mark_first_child (predict, loop == 2);
+    (void) p4est_wrap_partition_predict (predict, &uf, &ul, &uof);
+    SC_CHECK_ABORT (uf >= 0 && ul >= 0 && uof >= 0 &&
+                    uf + ul <= predict->p4est->local_num_quadrants,
+                    "Predict window");
+    if (predict->p4est->mpisize == 1) {
+      SC_CHECK_ABORT (predict->num_refine_flags == num_refine,
+                      "Predict marks");
+    }
+
+    /* the adapted forest does not depend on the partition */
+    SC_CHECK_ABORT (wrap_adapt_partition (plain, 0), "Plain adapt");
+    SC_CHECK_ABORT (p4est_wrap_adapt_partition (predict, 0, NULL, NULL,
+                                                NULL, NULL), "Predict adapt");
+    SC_CHECK_ABORT (p4est_checksum (plain->p4est) ==
+                    p4est_checksum (predict->p4est), "Predict checksum");
+  }
+
+  p4est_wrap_destroy (plain);
+  p4est_wrap_destroy (predict);
+}
+
+/* a lazy wrap builds ghost and mesh only on access and agrees with eager */
+static void
+test_lazy (p4est_wrap_t * wrap)
+{
+  int                 loop;
+  p4est_mesh_t       *mesh;
+  p4est_ghost_t      *ghost;
+  p4est_wrap_params_t params;
+  p4est_wrap_t       *lazy;
+  p4est_t            *p4est;
+
+  params = wrap->params;
+  params.lazy = 1;
+  params.user_pointer = NULL;
+  p4est = p4est_copy (wrap->p4est, 0);
+  p4est->user_pointer = NULL;
+  p4est_connectivity_ref (wrap->conn);
+  lazy = p4est_wrap_new_p4est_params (p4est, &params);
+  SC_CHECK_ABORT (lazy->ghost == NULL && lazy->mesh == NULL, "Lazy new");
+
+  for (loop = 0; loop < 3; ++loop) {
+    mark_every_third (wrap);
+    mark_every_third (lazy);
+    SC_CHECK_ABORT (wrap_adapt_partition (wrap, 0), "Eager refine");
+    if (loop == 1) {
+      /* the intermediate mesh is built on request */
+      SC_CHECK_ABORT (p4est_wrap_adapt (lazy), "Lazy adapt");
+      mesh = p4est_wrap_get_mesh (lazy);
+      SC_CHECK_ABORT (mesh == lazy->mesh_aux && lazy->ghost_aux != NULL &&
+                      mesh->local_num_quadrants ==
+                      lazy->p4est->local_num_quadrants, "Lazy aux mesh");
+      if (p4est_wrap_partition (lazy, 0, NULL, NULL, NULL)) {
+        SC_CHECK_ABORT (lazy->ghost == NULL, "Lazy partition");
+        p4est_wrap_complete (lazy);
+      }
+    }
+    else {
+      /* adapt-only rounds do not build anything */
+      SC_CHECK_ABORT (wrap_adapt_partition (lazy, 0), "Lazy refine");
+      SC_CHECK_ABORT (lazy->ghost == NULL && lazy->mesh == NULL &&
+                      lazy->ghost_aux == NULL && lazy->mesh_aux == NULL,
+                      "Lazy adapt");
+    }
+  }
+
+  /* the ghost layer is built alone and completed by the mesh */
+  ghost = p4est_wrap_get_ghost (lazy);
+  SC_CHECK_ABORT (lazy->mesh == NULL, "Lazy ghost");
+  mesh = p4est_wrap_get_mesh (lazy);
+  SC_CHECK_ABORT (p4est_wrap_get_ghost (lazy) == ghost, "Lazy ghost reuse");
+  SC_CHECK_ABORT (p4est_checksum (lazy->p4est) ==
+                  p4est_checksum (wrap->p4est), "Lazy checksum");
+  SC_CHECK_ABORT (ghost->ghosts.elem_count ==
+                  p4est_wrap_get_ghost (wrap)->ghosts.elem_count &&
+                  mesh->local_num_quadrants ==
+                  p4est_wrap_get_mesh (wrap)->local_num_quadrants,
+                  "Lazy ghost and mesh");
+
+  p4est_wrap_destroy (lazy);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -170,6 +479,12 @@ main (int argc, char **argv)
   }
 
   test_coarsen_delay (wrap);
+  test_leaf_batch (wrap);
+  test_copy_shared (wrap);
+  test_monitor (wrap);
+  test_lazy (wrap);
+  test_adapt_partition (mpicomm);
+  test_partition_predict (mpicomm);
 
   p4est_wrap_destroy (wrap);
 